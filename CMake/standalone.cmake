@@ -86,6 +86,7 @@ FIND_PACKAGE(VTK 9 REQUIRED COMPONENTS
   IOImage
   IOLegacy
   IOPLY
+  IOXML
   ImagingCore
   ImagingGeneral
   InteractionStyle
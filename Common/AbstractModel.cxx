@@ -6,6 +6,7 @@
 #include <vtkCommand.h>
 
 #include "SNAPEventListenerCallbacks.h"
+#include <chrono>
 
 
 AbstractModel::AbstractModel()
@@ -36,6 +37,16 @@ void AbstractModel::Update()
                 << " [" << this << "] "
                 << " with " << *m_EventBucket << std::endl << std::flush;
       }
+    if(flag_snap_debug_events)
+      {
+      std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+      this->OnUpdate();
+      std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+      EventDispatchStatistics::GetInstance()->RecordDispatch(
+            this->GetNameOfClass(), *m_EventBucket, dt.count());
+      m_EventBucket->Clear();
+      return;
+      }
 #endif
     this->OnUpdate();
     m_EventBucket->Clear();
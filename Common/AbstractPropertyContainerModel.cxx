@@ -1,4 +1,56 @@
 #include "AbstractPropertyContainerModel.h"
+#include "SNAPEventListenerCallbacks.h"
+
+AbstractPropertyContainerModel::~AbstractPropertyContainerModel()
+{
+  for(auto &tag : m_ChildObserverTags)
+    tag.first->RemoveObserver(tag.second);
+}
+
+void
+AbstractPropertyContainerModel::ObserveChildProperty(itk::Object *model)
+{
+  typedef AbstractPropertyContainerModel Self;
+  m_ChildObserverTags.push_back(std::make_pair(model, AddListenerPair(
+      model, ValueChangedEvent(), this,
+      &Self::OnChildPropertyEvent, &Self::OnChildPropertyConstEvent)));
+  m_ChildObserverTags.push_back(std::make_pair(model, AddListenerPair(
+      model, DomainChangedEvent(), this,
+      &Self::OnChildPropertyEvent, &Self::OnChildPropertyConstEvent)));
+}
+
+void
+AbstractPropertyContainerModel::OnChildPropertyEvent(
+    itk::Object *source, const itk::EventObject &evt)
+{
+  this->OnChildPropertyConstEvent(source, evt);
+}
+
+void
+AbstractPropertyContainerModel::OnChildPropertyConstEvent(
+    const itk::Object *source, const itk::EventObject &evt)
+{
+  m_EventBucket->PutEvent(evt, source);
+  if(m_PropertyBatchDepth > 0)
+    m_PropertyBatchChanged = true;
+  else
+    this->InvokeEvent(ChildPropertyChangedEvent());
+}
+
+void AbstractPropertyContainerModel::BeginPropertyBatch()
+{
+  m_PropertyBatchDepth++;
+}
+
+void AbstractPropertyContainerModel::EndPropertyBatch()
+{
+  assert(m_PropertyBatchDepth > 0);
+  if(--m_PropertyBatchDepth == 0 && m_PropertyBatchChanged)
+    {
+    m_PropertyBatchChanged = false;
+    this->InvokeEvent(ChildPropertyChangedEvent());
+    }
+}
 
 void
 AbstractPropertyContainerModel::DeepCopy(
@@ -8,6 +60,9 @@ AbstractPropertyContainerModel::DeepCopy(
   // same order. The assertions below check that
   assert(m_Properties.size() == source->m_Properties.size());
 
+  // Observers are notified once, after all the fields have been copied
+  PropertyBatch batch(this);
+
   PropertyMapCIter itSrc = source->m_Properties.begin();
   PropertyMapIter it = m_Properties.begin();
   while(itSrc != source->m_Properties.end())
@@ -63,6 +118,7 @@ void AbstractPropertyContainerModel::WriteToRegistry(Registry &folder) const
 
 void AbstractPropertyContainerModel::ReadFromRegistry(Registry &folder)
 {
+  PropertyBatch batch(this);
   for(PropertyMapIter it = m_Properties.begin(); it != m_Properties.end(); it++)
     {
     it->second->Deserialize(folder);
@@ -233,8 +233,45 @@ public:
 
   void ReadFromRegistry(Registry &folder);
 
+  /**
+   * Start a batch of changes to the properties. Until the matching call to
+   * EndPropertyBatch(), ChildPropertyChangedEvent is not fired; instead it is
+   * fired once at the end of the batch if any of the properties changed. The
+   * events fired by the properties themselves are not affected. Batches can
+   * be nested, in which case the event is fired at the end of the outermost.
+   */
+  void BeginPropertyBatch();
+
+  /** End a batch of changes started with BeginPropertyBatch() */
+  void EndPropertyBatch();
+
+  /**
+   * A scope guard for a batch of property changes, for example
+   *
+   *   {
+   *   AbstractPropertyContainerModel::PropertyBatch batch(settings);
+   *   settings->SetFooWidth(2);
+   *   settings->SetIsFooable(false);
+   *   }
+   */
+  class PropertyBatch
+  {
+  public:
+    PropertyBatch(AbstractPropertyContainerModel *model) : m_Model(model)
+      { m_Model->BeginPropertyBatch(); }
+    ~PropertyBatch()
+      { m_Model->EndPropertyBatch(); }
+  private:
+    PropertyBatch(const PropertyBatch &) = delete;
+    PropertyBatch &operator = (const PropertyBatch &) = delete;
+    AbstractPropertyContainerModel *m_Model;
+  };
+
 protected:
 
+  AbstractPropertyContainerModel() {}
+  virtual ~AbstractPropertyContainerModel();
+
   // Register a child model with this class. This should be called in the
   // constructor when the model is created. The model should be a concrete
   // property model. This method should only be called in the constructor
@@ -253,8 +290,7 @@ protected:
     m_Properties.insert(std::make_pair(key, holder_base_ptr));
 
     // Propagate the modification events from the property
-    Rebroadcast(model, ValueChangedEvent(), ChildPropertyChangedEvent());
-    Rebroadcast(model, DomainChangedEvent(), ChildPropertyChangedEvent());
+    ObserveChildProperty(model);
 
     return model;
   }
@@ -280,8 +316,7 @@ protected:
     m_Properties.insert(std::make_pair(key, holder_base_ptr));
 
     // Propagate the modification events from the property
-    Rebroadcast(model, ValueChangedEvent(), ChildPropertyChangedEvent());
-    Rebroadcast(model, DomainChangedEvent(), ChildPropertyChangedEvent());
+    ObserveChildProperty(model);
 
     return model;
   }
@@ -327,8 +362,26 @@ protected:
     return RegisterEnumProperty(key, NewSimpleConcreteProperty(value), enummap);
   }
 
+  // Listen to the value and domain events of a child property. These are
+  // recorded in the event bucket and fired as ChildPropertyChangedEvent,
+  // unless a batch of changes is in progress
+  void ObserveChildProperty(itk::Object *model);
+
+  // Callbacks for the child property events
+  void OnChildPropertyEvent(itk::Object *source, const itk::EventObject &evt);
+  void OnChildPropertyConstEvent(const itk::Object *source, const itk::EventObject &evt);
+
 private:
 
+  // Nesting depth of property batches, and whether a child property changed
+  // during the current batch
+  int m_PropertyBatchDepth = 0;
+  bool m_PropertyBatchChanged = false;
+
+  // Observer tags on the child properties, removed on destruction since the
+  // properties may outlive this object
+  std::vector<std::pair<itk::Object *, unsigned long> > m_ChildObserverTags;
+
   // The storage for the fields
   typedef SmartPtr<ConcretePropertyHolderBase> HolderPointer;
   typedef std::map<std::string, HolderPointer> PropertyMap;
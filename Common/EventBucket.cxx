@@ -1,4 +1,7 @@
 #include "EventBucket.h"
+#include <algorithm>
+#include <iomanip>
+#include <vector>
 
 unsigned long EventBucket::m_GlobalMTime = 1;
 
@@ -35,8 +38,6 @@ bool EventBucket::HasEvent(const itk::EventObject &evt, const itk::Object *sourc
   for(BucketIt it = m_Bucket.begin(); it != m_Bucket.end(); ++it)
     {
     const BucketEntry &entry = *it;
-    std::string echeck = evt.GetEventName();
-    std::string eentry = entry.first->GetEventName();
     if(evt.CheckEvent(entry.first) && (source == NULL || source == entry.second))
       {
       return true;
@@ -79,3 +80,72 @@ std::ostream& operator<<(std::ostream& sink, const EventBucket& eb)
   return sink;
 }
 
+
+EventDispatchStatistics *EventDispatchStatistics::GetInstance()
+{
+  static EventDispatchStatistics instance;
+  return &instance;
+}
+
+void EventDispatchStatistics::RecordCoalesced(const char *target)
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  m_ByTarget[target].Coalesced++;
+}
+
+void EventDispatchStatistics::RecordDispatch(
+    const char *target, const EventBucket &bucket, double seconds)
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  Entry &et = m_ByTarget[target];
+  et.Dispatched++;
+  et.Seconds += seconds;
+
+  // Charge the time to every event type in the bucket
+  std::lock_guard<std::recursive_mutex> bucket_guard(bucket.m_Mutex);
+  for(EventBucket::BucketIt it = bucket.m_Bucket.begin(); it != bucket.m_Bucket.end(); ++it)
+    {
+    Entry &ee = m_ByEvent[it->first->GetEventName()];
+    ee.Dispatched++;
+    ee.Seconds += seconds;
+    }
+}
+
+void EventDispatchStatistics::PrintEntries(
+    std::ostream &sink, const char *title, const EntryMap &entries)
+{
+  typedef std::pair<std::string, Entry> NamedEntry;
+  std::vector<NamedEntry> sorted(entries.begin(), entries.end());
+  std::sort(sorted.begin(), sorted.end(),
+            [](const NamedEntry &a, const NamedEntry &b)
+            { return a.second.Seconds > b.second.Seconds; });
+
+  sink << title << std::endl;
+  sink << std::setw(40) << std::left << "  Name"
+       << std::setw(12) << std::right << "Dispatched"
+       << std::setw(12) << "Coalesced"
+       << std::setw(12) << "Time (ms)" << std::endl;
+  for(const NamedEntry &e : sorted)
+    {
+    sink << "  " << std::setw(38) << std::left << e.first
+         << std::setw(12) << std::right << e.second.Dispatched
+         << std::setw(12) << e.second.Coalesced
+         << std::setw(12) << std::fixed << std::setprecision(1)
+         << 1000.0 * e.second.Seconds << std::endl;
+    }
+}
+
+void EventDispatchStatistics::Print(std::ostream &sink) const
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  PrintEntries(sink, "EVENT DISPATCH STATISTICS BY TARGET", m_ByTarget);
+  PrintEntries(sink, "EVENT DISPATCH STATISTICS BY EVENT", m_ByEvent);
+  sink << std::flush;
+}
+
+void EventDispatchStatistics::Reset()
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  m_ByTarget.clear();
+  m_ByEvent.clear();
+}
@@ -4,6 +4,8 @@
 #include "SNAPEvents.h"
 #include <mutex>
 #include <set>
+#include <map>
+#include <string>
 #include <iostream>
 
 namespace itk
@@ -46,6 +48,7 @@ public:
   unsigned long GetMTime() const { return m_MTime; }
 
   friend std::ostream& operator<<(std::ostream& sink, const EventBucket& eb);
+  friend class EventDispatchStatistics;
 
 protected:
 
@@ -74,4 +77,42 @@ protected:
 // IO operator
 std::ostream& operator<<(std::ostream& sink, const EventBucket& eb);
 
+/**
+  Counts and times the dispatch of event buckets to models and widgets, for
+  diagnosing redundant updates. Statistics are kept per target class and per
+  event type, and are only collected when ITK-SNAP is run with the
+  --debug-events option.
+  */
+class EventDispatchStatistics
+{
+public:
+  static EventDispatchStatistics *GetInstance();
+
+  /** Record an event that was merged into a bucket already waiting to be
+   * dispatched to the target */
+  void RecordCoalesced(const char *target);
+
+  /** Record the dispatch of a bucket to the target, which took the given time */
+  void RecordDispatch(const char *target, const EventBucket &bucket, double seconds);
+
+  /** Print the statistics, most expensive entries first */
+  void Print(std::ostream &sink) const;
+
+  void Reset();
+
+protected:
+  struct Entry
+  {
+    unsigned long Dispatched, Coalesced;
+    double Seconds;
+    Entry() : Dispatched(0), Coalesced(0), Seconds(0.0) {}
+  };
+
+  typedef std::map<std::string, Entry> EntryMap;
+  static void PrintEntries(std::ostream &sink, const char *title, const EntryMap &entries);
+
+  EntryMap m_ByTarget, m_ByEvent;
+  mutable std::mutex m_Mutex;
+};
+
 #endif // EVENTBUCKET_H
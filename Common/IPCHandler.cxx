@@ -5,6 +5,8 @@
 #include <cerrno>
 #include <functional>
 #include <sstream>
+#include <thread>
+#include <chrono>
 
 #if defined(WIN32)
   #ifdef _WIN32_WINNT
@@ -22,6 +24,7 @@
   #include <sys/stat.h>
   #include <fcntl.h>
   #include <unistd.h>
+  #include <signal.h>
 #else
   #include <sys/types.h>
   #include <sys/ipc.h>
@@ -31,6 +34,13 @@
   #include <sys/time.h>
 #endif
 
+#if defined(__linux__)
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+  #include <climits>
+  #include <ctime>
+#endif
+
 using namespace std;
 
 void IPCHandler::Attach(const char *path, short version, size_t message_size)
@@ -49,9 +59,11 @@ void IPCHandler::Attach(const char *path, short version, size_t message_size)
   size_t msize = message_size + sizeof(Header);
 
 #if defined(WIN32)
-  // Create a shared memory block (key based on the preferences file)
+  // Create a shared memory block (key based on the preferences file and the
+  // version, so that different kinds of messages use different blocks)
+  std::ostringstream oss; oss << path << "_" << version;
   m_Handle = CreateFileMappingA(
-    INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD) msize, path);
+    INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD) msize, oss.str().c_str());
 
   // If the return value is NULL, something failed
   if(m_Handle)
@@ -70,7 +82,11 @@ void IPCHandler::Attach(const char *path, short version, size_t message_size)
   // Generate a complete key
   // std::ostringstream oss_key;
   // oss_key << "5A636Q488D.itksnap." << str_hash;
-  m_SharedMemoryObjectName = "5A636Q488D.itksnap";
+  // The version is appended so that different kinds of messages use
+  // different blocks
+  std::ostringstream oss_name;
+  oss_name << "5A636Q488D.itksnap." << std::hex << version;
+  m_SharedMemoryObjectName = oss_name.str();
 
   // Try to connect to an existing memory space
   m_Handle = shm_open(m_SharedMemoryObjectName.c_str(), O_RDWR, 0644);
@@ -156,10 +172,29 @@ bool IPCHandler::Read(void *target_ptr)
   m_LastReceivedMessageID = header->message_id;
 
   // Copy the message to the target pointer
-  memcpy(target_ptr, m_UserData, m_MessageSize);
+  return CopyMessage(target_ptr, header);
+}
 
-  // Success!
-  return true;
+bool IPCHandler::CopyMessage(void *target_ptr, Header *header)
+{
+  // Retry a few times if a writer is in the middle of an update
+  for(int attempt = 0; attempt < 100; attempt++)
+    {
+    int seq = header->write_seq.load(std::memory_order_acquire);
+    if(seq & 1)
+      {
+      std::this_thread::yield();
+      continue;
+      }
+
+    memcpy(target_ptr, m_UserData, m_MessageSize);
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if(header->write_seq.load(std::memory_order_relaxed) == seq)
+      return true;
+    }
+
+  return false;
 }
 
 bool IPCHandler::ReadIfNew(void *target_ptr)
@@ -181,13 +216,14 @@ bool IPCHandler::ReadIfNew(void *target_ptr)
   if(m_LastSender == header->sender_pid && m_LastReceivedMessageID == header->message_id)
     return false;
 
+  // Copy the message to the target pointer
+  if(!CopyMessage(target_ptr, header))
+    return false;
+
   // Store the last sender / id
   m_LastSender = header->sender_pid;
   m_LastReceivedMessageID = header->message_id;
 
-  // Copy the message to the target pointer
-  memcpy(target_ptr, m_UserData, m_MessageSize);
-
   // Success!
   return true;
 }
@@ -203,6 +239,9 @@ IPCHandler
     // Access the message header
     Header *header = static_cast<Header *>(m_SharedData);
 
+    // Mark the message as being written
+    header->write_seq.fetch_add(1, std::memory_order_acq_rel);
+
     // Write version number
     header->version = m_ProtocolVersion;
 
@@ -213,6 +252,13 @@ IPCHandler
     // Copy the message contents into the shared memory
     memcpy(m_UserData, message_ptr, m_MessageSize);
 
+    // Mark the message as complete and wake up the waiting processes
+    header->write_seq.fetch_add(1, std::memory_order_release);
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<int *>(&header->write_seq),
+            FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+
     // Done
     return true;
     }
@@ -220,6 +266,66 @@ IPCHandler
   return false;
 }
 
+bool IPCHandler::WaitForMessage(int timeout_ms)
+{
+  if(!m_SharedData)
+    {
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+    return false;
+    }
+
+  Header *header = static_cast<Header *>(m_SharedData);
+  int seq = header->write_seq.load(std::memory_order_acquire);
+
+#if defined(__linux__)
+  if(seq == m_LastWaitSeq)
+    {
+    // Sleep until a writer changes the sequence number
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<int *>(&header->write_seq),
+            FUTEX_WAIT, seq, &ts, NULL, 0);
+    seq = header->write_seq.load(std::memory_order_acquire);
+    }
+#else
+  // Check the sequence number at short intervals
+  const int interval_ms = 10;
+  for(int t = 0; seq == m_LastWaitSeq && t < timeout_ms; t += interval_ms)
+    {
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    seq = header->write_seq.load(std::memory_order_acquire);
+    }
+#endif
+
+  if(seq == m_LastWaitSeq)
+    return false;
+
+  m_LastWaitSeq = seq;
+  return true;
+}
+
+bool IPCHandler::IsProcessRunning(long pid)
+{
+  if(pid <= 0)
+    return false;
+
+#if defined(WIN32)
+  HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD) pid);
+  if(!process)
+    return false;
+
+  DWORD exit_code = 0;
+  bool running = GetExitCodeProcess(process, &exit_code) && exit_code == STILL_ACTIVE;
+  CloseHandle(process);
+  return running;
+#else
+  // Signal 0 only checks whether the process exists. EPERM means that it
+  // exists but belongs to another user
+  return kill((pid_t) pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
 void IPCHandler::Close()
 {
   // Update the message with sender PID of -1 so that if shared memory is retained
@@ -264,6 +370,7 @@ IPCHandler::IPCHandler()
   m_LastReceivedMessageID = -1;
   m_LastSender = -1;
   m_MessageID = 0;
+  m_LastWaitSeq = 0;
 
   // Reset the shared memory
   m_SharedData = NULL;
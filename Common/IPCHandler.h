@@ -1,6 +1,7 @@
 #ifndef IPCHANDLER_H
 #define IPCHANDLER_H
 
+#include <atomic>
 #include <cstddef>
 #include <set>
 #include <string>
@@ -41,6 +42,18 @@ public:
   /** Broadcast a 'message' (i.e. replace shared memory contents */
   bool Broadcast(const void *message_ptr);
 
+  /**
+   * Block until a message is broadcast (by any process) or the timeout
+   * expires. Returns true if there was a broadcast since the last call. On
+   * Linux, the wait is a futex on the shared memory, so a waiting thread is
+   * woken as soon as a message is written. Elsewhere, the shared memory is
+   * checked at short intervals. Should only be called from one thread.
+   */
+  bool WaitForMessage(int timeout_ms);
+
+  /** Check whether a process with the given id is running */
+  static bool IsProcessRunning(long pid);
+
 protected:
 
   struct Header
@@ -48,8 +61,15 @@ protected:
     short version;
     long sender_pid;
     long message_id;
+
+    // Incremented before and after the message is written, so it is odd
+    // while a write is in progress. Readers retry if it changes under them
+    std::atomic<int> write_seq;
   };
 
+  // Copy the message out of shared memory without tearing
+  bool CopyMessage(void *target_ptr, Header *header);
+
 
   // Shared data pointer
   void *m_SharedData, *m_UserData;
@@ -78,7 +98,8 @@ protected:
   // Process ID and other values used by IPC
   long m_ProcessID, m_MessageID, m_LastSender, m_LastReceivedMessageID;
 
-  bool IsProcessRunning(int pid);
+  // Value of the write sequence seen by the last call to WaitForMessage
+  int m_LastWaitSeq;
 
   // List of known process ids, with status (0 = alive, -1 = dead)
   std::set<long> m_KnownDeadPIDs;
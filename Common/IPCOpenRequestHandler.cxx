@@ -0,0 +1,142 @@
+#include "IPCOpenRequestHandler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+
+#ifdef WIN32
+  #include <process.h>
+#else
+  #include <unistd.h>
+#endif
+
+/** Structure passed on to IPC */
+struct IPCOpenRequestHandler::Message
+{
+  enum Kind { ANNOUNCE = 1, REQUEST, ACCEPTED };
+
+  // What the message is
+  int kind;
+
+  // The session that receives the requests
+  long receiver_pid;
+
+  // Id of the request, chosen by the sender, echoed by the receiver
+  long request_id;
+
+  // The arguments, separated by zero characters
+  int argc;
+  char args[16384];
+
+  // Version of the data structure. ftok only uses the lowest eight bits, which
+  // must differ from those of the synchronization message version
+  enum VersionEnum { VERSION = 0x2001 };
+};
+
+IPCOpenRequestHandler::IPCOpenRequestHandler()
+{
+#ifdef WIN32
+  m_ProcessID = _getpid();
+#else
+  m_ProcessID = getpid();
+#endif
+}
+
+IPCOpenRequestHandler::~IPCOpenRequestHandler()
+{
+  if(m_IPC.IsAttached())
+    this->Close();
+}
+
+void IPCOpenRequestHandler::Attach(const char *path)
+{
+  m_IPC.Attach(path, (short) Message::VERSION, sizeof(Message));
+}
+
+void IPCOpenRequestHandler::Close()
+{
+  m_IPC.Close();
+}
+
+void IPCOpenRequestHandler::AcceptRequests()
+{
+  Message msg;
+  memset(&msg, 0, sizeof(Message));
+  msg.kind = Message::ANNOUNCE;
+  msg.receiver_pid = m_ProcessID;
+  m_IPC.Broadcast(&msg);
+}
+
+bool IPCOpenRequestHandler::WaitForRequest(int timeout_ms, ArgumentList &args)
+{
+  if(!m_IPC.WaitForMessage(timeout_ms))
+    return false;
+
+  Message msg;
+  if(!m_IPC.ReadIfNew(&msg)
+     || msg.kind != Message::REQUEST || msg.receiver_pid != m_ProcessID)
+    return false;
+
+  // Unpack the arguments
+  args.clear();
+  const char *p = msg.args, *end = msg.args + sizeof(msg.args);
+  for(int i = 0; i < msg.argc && p < end; i++)
+    {
+    size_t len = strnlen(p, end - p);
+    args.push_back(std::string(p, len));
+    p += len + 1;
+    }
+
+  // Acknowledge the request
+  msg.kind = Message::ACCEPTED;
+  msg.argc = 0;
+  m_IPC.Broadcast(&msg);
+  return true;
+}
+
+bool IPCOpenRequestHandler::SendRequest(const ArgumentList &args, int timeout_ms)
+{
+  // Find out which session receives requests
+  Message msg;
+  if(!m_IPC.Read(&msg) || msg.kind < Message::ANNOUNCE || msg.kind > Message::ACCEPTED)
+    return false;
+
+  long receiver = msg.receiver_pid;
+  if(receiver == m_ProcessID || !IPCHandler::IsProcessRunning(receiver))
+    return false;
+
+  // Pack the arguments
+  memset(&msg, 0, sizeof(Message));
+  msg.kind = Message::REQUEST;
+  msg.receiver_pid = receiver;
+  msg.request_id = (long) (std::random_device()() & 0x7fffffff);
+  msg.argc = (int) args.size();
+
+  char *p = msg.args;
+  for(const std::string &arg : args)
+    {
+    if(p + arg.size() + 1 > msg.args + sizeof(msg.args))
+      return false;
+    memcpy(p, arg.c_str(), arg.size() + 1);
+    p += arg.size() + 1;
+    }
+
+  long request_id = msg.request_id;
+  if(!m_IPC.Broadcast(&msg))
+    return false;
+
+  // Wait for the receiver to acknowledge the request
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+  while(Clock::now() < deadline)
+    {
+    int remaining = (int) std::chrono::duration_cast<std::chrono::milliseconds>(
+                      deadline - Clock::now()).count();
+    if(m_IPC.WaitForMessage(std::max(remaining, 1))
+       && m_IPC.Read(&msg)
+       && msg.kind == Message::ACCEPTED && msg.request_id == request_id)
+      return true;
+    }
+
+  return false;
+}
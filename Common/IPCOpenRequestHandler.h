@@ -0,0 +1,64 @@
+#ifndef IPCOPENREQUESTHANDLER_H
+#define IPCOPENREQUESTHANDLER_H
+
+#include "IPCHandler.h"
+#include <string>
+#include <vector>
+
+/**
+ * This class lets a new invocation of ITK-SNAP hand its command-line arguments
+ * to a session that is already running, instead of starting up itself. It uses
+ * its own IPCHandler shared memory block, separate from the one used to
+ * synchronize the cursor and views between sessions.
+ *
+ * A session that is willing to open files calls AcceptRequests(), which makes
+ * it the receiver of requests (the session that did so last wins), and then
+ * calls WaitForRequest() in a loop. A new invocation calls SendRequest(),
+ * which returns true once the receiver has acknowledged the request.
+ */
+class IPCOpenRequestHandler
+{
+public:
+
+  typedef std::vector<std::string> ArgumentList;
+
+  IPCOpenRequestHandler();
+  ~IPCOpenRequestHandler();
+
+  /** Attach to the shared memory, path as in IPCHandler::Attach */
+  void Attach(const char *path);
+
+  /** Release shared memory */
+  void Close();
+
+  /** Whether the shared memory is attached */
+  bool IsAttached() { return m_IPC.IsAttached(); }
+
+  /** Make this session the one that receives open requests */
+  void AcceptRequests();
+
+  /**
+   * Block until a request addressed to this session arrives or the timeout
+   * expires. A request that arrives is acknowledged and its arguments are
+   * returned. Should only be called from one thread.
+   */
+  bool WaitForRequest(int timeout_ms, ArgumentList &args);
+
+  /**
+   * Send arguments to the session that receives open requests. Returns false
+   * if there is no such session, the arguments do not fit into the message,
+   * or the request is not acknowledged before the timeout expires.
+   */
+  bool SendRequest(const ArgumentList &args, int timeout_ms);
+
+protected:
+
+  struct Message;
+
+  IPCHandler m_IPC;
+
+  // Id of this process
+  long m_ProcessID;
+};
+
+#endif // IPCOPENREQUESTHANDLER_H
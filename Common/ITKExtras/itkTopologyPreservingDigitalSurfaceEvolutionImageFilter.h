@@ -8,7 +8,11 @@
 #include <deque>
 
 /** \class TopologyPreservingDigitalSurfaceEvolutionImageFilter
- *  
+ *
+ * Each iteration grows the foreground into the surface voxels where it
+ * differs from the target, if the change does not alter the topology. The
+ * surface voxels are tested and changed in parallel, in groups of voxels
+ * that are not adjacent to each other.
  */
 
 namespace itk
@@ -42,6 +46,9 @@ public:
   /** Image typedef support. */
   typedef typename ImageType::PixelType         PixelType;
   typedef typename ImageType::IndexType         IndexType;
+  typedef typename ImageType::IndexValueType    IndexValueType;
+  typedef typename ImageType::RegionType        RegionType;
+  typedef typename ImageType::SizeValueType     SizeValueType;
   typedef std::deque<IndexType>                 IndexContainerType;
   typedef NeighborhoodIterator<ImageType>       NeighborhoodIteratorType;
 
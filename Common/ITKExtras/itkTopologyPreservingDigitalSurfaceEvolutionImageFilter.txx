@@ -7,9 +7,12 @@
 #include "itkBinaryDiamondStructuringElement.h"
 #include "itkBinaryThresholdImageFilter.h"
 #include "itkImageRegionIteratorWithIndex.h"
+#include "itkMultiThreaderBase.h"
 #include "itkSubtractImageFilter.h"
 #include "itkTimeProbe.h"
 
+#include <atomic>
+
 namespace itk
 {
 
@@ -110,56 +113,89 @@ TopologyPreservingDigitalSurfaceEvolutionImageFilter<TImage>
 
     this->CreateLabelSurfaceImage();
 
-    ImageRegionIteratorWithIndex<ImageType> ItI( this->GetOutput(),
-      this->GetOutput()->GetRequestedRegion() );
-
-    ImageRegionIterator<ImageType> ItT( this->m_TargetImage,
-      this->m_TargetImage->GetRequestedRegion() );
-    ImageRegionIterator<ImageType> ItL( this->m_LabelSurfaceImage,
-      this->m_LabelSurfaceImage->GetRequestedRegion() );
-
-    ItI.GoToBegin();
-    ItT.GoToBegin();
-    ItL.GoToBegin();
+    // The voxels are visited in 3^d colors, given by the remainders of their
+    // index components modulo 3. The tests below only read the 3x3(x3)
+    // neighborhood of a voxel, and since voxels of the same color are never
+    // in each other's neighborhood, the voxels of a color are tested and
+    // changed in parallel without affecting each other's tests. The colors
+    // are visited in turn, so each change is tested against the image as it
+    // is after all the changes before it, as in a serial scan.
+    ImageType *output = this->GetOutput();
+    const RegionType region = output->GetRequestedRegion();
+    SizeValueType nRows = region.GetNumberOfPixels() / region.GetSize( 0 );
+
+    unsigned int nColors = 1;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      nColors *= 3;
+      }
 
-    while( !ItI.IsAtEnd() )
+    for( unsigned int color = 0; color < nColors; color++ )
       {
-      RealType absoluteDifference
-        = vnl_math_abs( static_cast<RealType>( ItT.Get() - ItI.Get() ) );
+      unsigned int colorOffset[ImageDimension];
+      for( unsigned int d = 0, c = color; d < ImageDimension; d++, c /= 3 )
+        {
+        colorOffset[d] = c % 3;
+        }
 
-      if( ItL.Get() == this->m_SurfaceLabel )
+      std::atomic<unsigned long> nChanged( 0 );
+      MultiThreaderBase::Pointer mt = MultiThreaderBase::New();
+      mt->ParallelizeArray( 0, nRows, [&]( SizeValueType row )
         {
-        if( absoluteDifference > this->m_ThresholdValue )
+        // Find the row of the region, and skip it if it has no voxels of
+        // the current color
+        IndexType idx = region.GetIndex();
+        for( unsigned int d = 1; d < ImageDimension; d++ )
           {
+          SizeValueType k = row % region.GetSize( d );
+          if( k % 3 != colorOffset[d] )
+            {
+            return;
+            }
+          idx[d] += k;
+          row /= region.GetSize( d );
+          }
+
+        unsigned long nRowChanged = 0;
+        IndexValueType xEnd = region.GetIndex( 0 ) + region.GetSize( 0 );
+        for( idx[0] = region.GetIndex( 0 ) + colorOffset[0]; idx[0] < xEnd; idx[0] += 3 )
+          {
+          if( this->m_LabelSurfaceImage->GetPixel( idx ) != this->m_SurfaceLabel )
+            {
+            continue;
+            }
+
+          RealType absoluteDifference = vnl_math_abs( static_cast<RealType>(
+            this->m_TargetImage->GetPixel( idx ) - output->GetPixel( idx ) ) );
+          if( absoluteDifference <= this->m_ThresholdValue )
+            {
+            continue;
+            }
+
           bool isChangeSafe = false;
           if( ImageDimension == 2 )
             {
-            isChangeSafe = this->IsChangeSafe2D( ItI.GetIndex() );
+            isChangeSafe = this->IsChangeSafe2D( idx );
             }
           else
             {
-            isChangeSafe = this->IsChangeSafe3D( ItI.GetIndex() );
+            isChangeSafe = this->IsChangeSafe3D( idx );
             }
           if( isChangeSafe )
             {
-            ItI.Set( this->m_ForegroundValue );
-            changeDetected = true;
-
-            totalNumberOfChanges += 1.0;
-            this->UpdateProgress( totalNumberOfChanges / totalDifference );
-//            RealType newProgress = this->GetProgress() * 100.0;
-//
-//            if( newProgress - oldProgress >= 1.0 )
-//              {
-//              oldProgress = newProgress;
-//              std::cout << "*" << std::flush;
-//              }
+            output->SetPixel( idx, this->m_ForegroundValue );
+            nRowChanged++;
             }
           }
+        nChanged += nRowChanged;
+        }, nullptr );
+
+      if( nChanged > 0 )
+        {
+        changeDetected = true;
+        totalNumberOfChanges += nChanged;
+        this->UpdateProgress( totalNumberOfChanges / totalDifference );
         }
-      ++ItI;
-      ++ItT;
-      ++ItL;
       }
     }
 //  timer.Stop();
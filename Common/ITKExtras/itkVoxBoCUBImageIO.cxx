@@ -39,6 +39,8 @@
 #include "itkMacro.h"
 #include "itkMetaDataObject.h"
 #include "itkByteSwapper.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
 #include <iostream>
 #include <list>
 #include <string>
@@ -64,6 +66,8 @@ public:
   virtual unsigned char ReadByte() = 0;
   virtual void ReadData(void *data, unsigned long bytes) = 0;
   virtual void WriteData(const void *data, unsigned long bytes) = 0;
+  virtual long Tell() = 0;
+  virtual void Seek(long offset) = 0;
 
   std::string ReadHeader()
     {
@@ -174,6 +178,23 @@ public:
       }
     }
 
+  long Tell()
+    {
+    return ::gztell(m_GzFile);
+    }
+
+  void Seek(long offset)
+    {
+    // Seeking forward decompresses the data in between, and seeking backward
+    // starts over from the beginning of the file
+    if(::gzseek(m_GzFile, offset, SEEK_SET) != offset)
+      {
+      ExceptionObject exception;
+      exception.SetDescription("Could not seek in file");
+      throw exception;
+      }
+    }
+
 private:
   ::gzFile m_GzFile;
 };
@@ -257,6 +278,22 @@ public:
       throw exception;
       }
     }
+
+  long Tell()
+    {
+    return ::ftell(m_File);
+    }
+
+  void Seek(long offset)
+    {
+    if(::fseek(m_File, offset, SEEK_SET) != 0)
+      {
+      ExceptionObject exception;
+      exception.SetDescription("Could not seek in file");
+      throw exception;
+      }
+    }
+
 private:
   FILE *m_File;
 };
@@ -264,7 +301,7 @@ private:
 
 /**
  * A swap helper class, used to perform swapping for any input
- * data type.
+ * data type. Large buffers are swapped in parallel blocks.
  */
 template<typename TPixel> class VoxBoCUBImageIOSwapHelper
 {
@@ -273,16 +310,38 @@ public:
   static void SwapIfNecessary(
     void *buffer, unsigned long numberOfBytes, ByteOrder order)
     {
-    if ( order == ImageIOBase::LittleEndian )
+    if ( sizeof(TPixel) == 1 )
       {
-      ByteSwapper<TPixel>::SwapRangeFromSystemToLittleEndian(
-        (TPixel*)buffer, numberOfBytes / sizeof(TPixel) );
+      return;
       }
-    else if ( order == ImageIOBase::BigEndian )
+
+    const bool bigEndian = ByteSwapper<TPixel>::SystemIsBigEndian();
+    if ( ( order == ImageIOBase::LittleEndian && !bigEndian )
+      || ( order == ImageIOBase::BigEndian && bigEndian )
+      || ( order != ImageIOBase::LittleEndian && order != ImageIOBase::BigEndian ) )
       {
-      ByteSwapper<TPixel>::SwapRangeFromSystemToBigEndian(
-        (TPixel *)buffer, numberOfBytes / sizeof(TPixel) );
+      return;
       }
+
+    const SizeValueType blockSize = 1 << 20;
+    const SizeValueType n = numberOfBytes / sizeof(TPixel);
+    const SizeValueType nBlocks = ( n + blockSize - 1 ) / blockSize;
+    TPixel *data = static_cast<TPixel *>(buffer);
+
+    MultiThreaderBase::Pointer mt = MultiThreaderBase::New();
+    mt->ParallelizeArray(0, nBlocks, [&](SizeValueType k)
+      {
+      SizeValueType first = k * blockSize;
+      SizeValueType count = std::min(blockSize, n - first);
+      if ( order == ImageIOBase::LittleEndian )
+        {
+        ByteSwapper<TPixel>::SwapRangeFromSystemToLittleEndian(data + first, count);
+        }
+      else
+        {
+        ByteSwapper<TPixel>::SwapRangeFromSystemToBigEndian(data + first, count);
+        }
+      }, nullptr);
     }
 };
 
@@ -310,6 +369,7 @@ VoxBoCUBImageIO::VoxBoCUBImageIO()
   m_ByteOrder = BigEndian;
   m_Reader = NULL;
   m_Writer = NULL;
+  m_DataOffset = 0;
 }
 
 
@@ -424,8 +484,49 @@ void VoxBoCUBImageIO::Read(void* buffer)
     throw exception;
     }
 
-  m_Reader->ReadData(buffer, GetImageSizeInBytes());
-  this->SwapBytesIfNecessary(buffer, GetImageSizeInBytes());
+  // Find the part of the image that is requested
+  SizeValueType start[3] = {0, 0, 0}, size[3] = {1, 1, 1}, dims[3];
+  bool whole = true;
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    dims[d] = GetDimensions(d);
+    if(d < m_IORegion.GetImageDimension())
+      {
+      start[d] = m_IORegion.GetIndex(d);
+      size[d] = m_IORegion.GetSize(d);
+      }
+    else
+      {
+      size[d] = dims[d];
+      }
+    if(start[d] != 0 || size[d] != dims[d])
+      whole = false;
+    }
+
+  // Voxels follow the header in x-fastest order
+  unsigned long esize = GetComponentSize() * GetNumberOfComponents();
+  if(whole)
+    {
+    m_Reader->Seek(m_DataOffset);
+    m_Reader->ReadData(buffer, GetImageSizeInBytes());
+    this->SwapBytesIfNecessary(buffer, GetImageSizeInBytes());
+    return;
+    }
+
+  // Read the rows of the region one by one, in file order
+  char *out = static_cast<char *>(buffer);
+  unsigned long row_bytes = size[0] * esize;
+  for(SizeValueType z = start[2]; z < start[2] + size[2]; z++)
+    {
+    for(SizeValueType y = start[1]; y < start[1] + size[1]; y++)
+      {
+      long offset = m_DataOffset + ((z * dims[1] + y) * dims[0] + start[0]) * esize;
+      m_Reader->Seek(offset);
+      m_Reader->ReadData(out, row_bytes);
+      out += row_bytes;
+      }
+    }
+  this->SwapBytesIfNecessary(buffer, row_bytes * size[1] * size[2]);
 }
 
 /** 
@@ -453,6 +554,9 @@ void VoxBoCUBImageIO::ReadImageInformation()
   // Read the file header
   std::istringstream issHeader(m_Reader->ReadHeader());
 
+  // The voxels start right after the header
+  m_DataOffset = m_Reader->Tell();
+
   // Read every string in the header. Parse the strings that are special
   while(issHeader.good())
     {
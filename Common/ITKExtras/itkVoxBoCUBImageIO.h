@@ -82,7 +82,10 @@ public:
   /** Set the spacing and dimension information for the set filename. */
   virtual void ReadImageInformation() ITK_OVERRIDE;
   
-  /** Reads the data from disk into the memory buffer provided. */
+  /** Regions of the image can be read without reading the rest */
+  virtual bool CanStreamRead() ITK_OVERRIDE { return true; }
+
+  /** Reads the data in the IO region from disk into the memory buffer provided. */
   virtual void Read(void* buffer) ITK_OVERRIDE;
 
   /*-------- This part of the interfaces deals with writing data. ----- */
@@ -112,6 +115,9 @@ private:
   GenericCUBFileAdaptor *CreateWriter(const char *filename);
   GenericCUBFileAdaptor *m_Reader, *m_Writer;
 
+  // Position of the first voxel in the file
+  long m_DataOffset;
+
   // Initialize the orientation map (from strings to ITK)
   void InitializeOrientationMap();
 
@@ -0,0 +1,548 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Module:    itkZarrImageIO.cxx
+  Language:  C++
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#include "itkZarrImageIO.h"
+#include "itkByteSwapper.h"
+#include "itkMultiThreaderBase.h"
+#include "itksys/SystemTools.hxx"
+#include "json/json.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <zlib.h>
+
+using itksys::SystemTools;
+
+namespace itk
+{
+
+namespace
+{
+
+bool ReadJSONFile(const std::string &filename, Json::Value &root)
+{
+  std::ifstream ifs(filename.c_str());
+  if(!ifs.good())
+    return false;
+
+  Json::Reader reader;
+  return reader.parse(ifs, root, false);
+}
+
+bool ReadBinaryFile(const std::string &filename, std::vector<unsigned char> &data)
+{
+  std::ifstream ifs(filename.c_str(), std::ios::binary);
+  if(!ifs.good())
+    return false;
+
+  ifs.seekg(0, std::ios::end);
+  std::streamoff n = ifs.tellg();
+  ifs.seekg(0, std::ios::beg);
+  data.resize((size_t) n);
+  return n == 0 || ifs.read(reinterpret_cast<char *>(data.data()), n).good();
+}
+
+// Inflate zlib or gzip compressed data, which must decode to n bytes
+bool Inflate(const std::vector<unsigned char> &src, std::vector<unsigned char> &dst, size_t n)
+{
+  dst.resize(n);
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+
+  // Adding 32 to the window bits detects zlib and gzip headers
+  if(inflateInit2(&strm, 15 + 32) != Z_OK)
+    return false;
+
+  strm.next_in = const_cast<Bytef *>(src.data());
+  strm.avail_in = (uInt) src.size();
+  strm.next_out = dst.data();
+  strm.avail_out = (uInt) n;
+  int rc = inflate(&strm, Z_FINISH);
+  inflateEnd(&strm);
+  return rc == Z_STREAM_END && strm.total_out == n;
+}
+
+template <class T>
+void EncodeFillValue(double value, std::vector<unsigned char> &out)
+{
+  // Integer arrays can not hold NaN or infinite fill values
+  T t = (std::numeric_limits<T>::is_integer && !std::isfinite(value)) ? T(0) : static_cast<T>(value);
+  out.resize(sizeof(T));
+  memcpy(out.data(), &t, sizeof(T));
+}
+
+}
+
+ZarrImageIO::ZarrImageIO()
+{
+  this->AddSupportedReadExtension(".zarr");
+}
+
+ZarrImageIO::~ZarrImageIO()
+{
+}
+
+std::string ZarrImageIO::GetStoreDirectory(const char *filename)
+{
+  // The metadata files may be given instead of the directory
+  std::string fn = SystemTools::CollapseFullPath(filename);
+  std::string name = SystemTools::GetFilenameName(fn);
+  if(name == ".zattrs" || name == ".zarray" || name == ".zgroup")
+    return SystemTools::GetFilenamePath(fn);
+  return fn;
+}
+
+bool ZarrImageIO::CanReadFile(const char *filename)
+{
+  std::string dir = GetStoreDirectory(filename);
+  if(!SystemTools::FileIsDirectory(dir))
+    return false;
+
+  if(SystemTools::FileExists(dir + "/.zarray", true))
+    return true;
+
+  Json::Value attrs;
+  return ReadJSONFile(dir + "/.zattrs", attrs) && attrs.isMember("multiscales");
+}
+
+void ZarrImageIO::ReadArrayInfo(const std::string &path, ArrayInfo &info)
+{
+  std::string dir = path.length() ? m_StoreDirectory + "/" + path : m_StoreDirectory;
+  Json::Value za;
+  if(!ReadJSONFile(dir + "/.zarray", za))
+    itkExceptionMacro(<< "Unable to read Zarr array metadata from " << dir);
+
+  if(za["zarr_format"].asInt() != 2)
+    itkExceptionMacro(<< "Only version 2 Zarr arrays are supported");
+
+  info = ArrayInfo();
+  for(const Json::Value &v : za["shape"])
+    info.Shape.push_back((SizeValueType) v.asUInt64());
+  for(const Json::Value &v : za["chunks"])
+    info.Chunks.push_back((SizeValueType) v.asUInt64());
+  if(info.Shape.empty() || info.Shape.size() != info.Chunks.size())
+    itkExceptionMacro(<< "Invalid shape or chunks in Zarr array " << dir);
+
+  const Json::Value &compressor = za["compressor"];
+  if(!compressor.isNull())
+    {
+    std::string id = compressor["id"].asString();
+    if(id != "zlib" && id != "gzip")
+      itkExceptionMacro(<< "Zarr compressor '" << id << "' is not supported, only zlib and gzip are");
+    info.Compressed = true;
+    }
+
+  if(za["filters"].isArray() && za["filters"].size())
+    itkExceptionMacro(<< "Zarr filters are not supported");
+
+  info.FortranOrder = za["order"].asString() == "F";
+  if(za.isMember("dimension_separator"))
+    info.Separator = za["dimension_separator"].asString();
+
+  // Data type, e.g., "<u2"
+  std::string dtype = za["dtype"].asString();
+  if(dtype.length() < 3)
+    itkExceptionMacro(<< "Unsupported Zarr data type '" << dtype << "'");
+
+  char order = dtype[0], kind = dtype[1];
+  info.ElementSize = (unsigned int) atoi(dtype.c_str() + 2);
+  bool big_endian = ByteSwapper<int>::SystemIsBigEndian();
+  info.SwapBytes = info.ElementSize > 1 && ((order == '>' && !big_endian) || (order == '<' && big_endian));
+
+  std::string ts = std::string(1, kind) + std::to_string(info.ElementSize);
+  IOComponentEnum ctype = IOComponentEnum::UNKNOWNCOMPONENTTYPE;
+  if(ts == "b1" || ts == "u1") ctype = IOComponentEnum::UCHAR;
+  else if(ts == "i1") ctype = IOComponentEnum::CHAR;
+  else if(ts == "u2") ctype = IOComponentEnum::USHORT;
+  else if(ts == "i2") ctype = IOComponentEnum::SHORT;
+  else if(ts == "u4") ctype = IOComponentEnum::UINT;
+  else if(ts == "i4") ctype = IOComponentEnum::INT;
+  else if(ts == "u8") ctype = IOComponentEnum::ULONGLONG;
+  else if(ts == "i8") ctype = IOComponentEnum::LONGLONG;
+  else if(ts == "f4") ctype = IOComponentEnum::FLOAT;
+  else if(ts == "f8") ctype = IOComponentEnum::DOUBLE;
+  else
+    itkExceptionMacro(<< "Unsupported Zarr data type '" << dtype << "'");
+  this->SetComponentType(ctype);
+
+  // The fill value of missing chunks, which may be a number or a string
+  const Json::Value &fv = za["fill_value"];
+  double fill = 0.0;
+  if(fv.isNumeric())
+    fill = fv.asDouble();
+  else if(fv.isString())
+    {
+    std::string s = fv.asString();
+    fill = (s == "NaN") ? std::numeric_limits<double>::quiet_NaN()
+         : (s == "Infinity") ? std::numeric_limits<double>::infinity()
+         : (s == "-Infinity") ? -std::numeric_limits<double>::infinity() : 0.0;
+    }
+
+  switch(ctype)
+    {
+    case IOComponentEnum::UCHAR: EncodeFillValue<unsigned char>(fill, info.FillElement); break;
+    case IOComponentEnum::CHAR: EncodeFillValue<signed char>(fill, info.FillElement); break;
+    case IOComponentEnum::USHORT: EncodeFillValue<unsigned short>(fill, info.FillElement); break;
+    case IOComponentEnum::SHORT: EncodeFillValue<short>(fill, info.FillElement); break;
+    case IOComponentEnum::UINT: EncodeFillValue<unsigned int>(fill, info.FillElement); break;
+    case IOComponentEnum::INT: EncodeFillValue<int>(fill, info.FillElement); break;
+    case IOComponentEnum::ULONGLONG: EncodeFillValue<unsigned long long>(fill, info.FillElement); break;
+    case IOComponentEnum::LONGLONG: EncodeFillValue<long long>(fill, info.FillElement); break;
+    case IOComponentEnum::FLOAT: EncodeFillValue<float>(fill, info.FillElement); break;
+    default: EncodeFillValue<double>(fill, info.FillElement); break;
+    }
+}
+
+void ZarrImageIO::AssignAxes(const std::vector<std::string> &names)
+{
+  // Without axis names, the axes are the last ones of (t, c, z, y, x)
+  size_t ndim = m_Array.Shape.size();
+  std::vector<std::string> axes = names;
+  if(axes.size() != ndim)
+    {
+    const char *dflt[] = { "t", "c", "z", "y", "x" };
+    if(ndim > 5)
+      itkExceptionMacro(<< "Zarr arrays with more than five axes need axis names");
+    axes.clear();
+    for(size_t a = 5 - ndim; a < 5; a++)
+      axes.push_back(dflt[a]);
+    }
+
+  m_AxisMap.assign(ndim, -2);
+  for(size_t a = 0; a < ndim; a++)
+    {
+    const std::string &n = axes[a];
+    m_AxisMap[a] = (n == "x") ? 0 : (n == "y") ? 1 : (n == "z") ? 2 : (n == "t") ? 3 : (n == "c") ? -1 : -2;
+    if(m_AxisMap[a] == -2 && m_Array.Shape[a] > 1)
+      itkExceptionMacro(<< "Unsupported axis '" << n << "' in Zarr array");
+    }
+}
+
+void ZarrImageIO::ReadImageInformation()
+{
+  m_StoreDirectory = GetStoreDirectory(m_FileName.c_str());
+  m_Levels.clear();
+
+  // Read the scales and axis names of an OME-Zarr multiscale image
+  std::vector<std::string> axis_names;
+  Json::Value attrs;
+  if(ReadJSONFile(m_StoreDirectory + "/.zattrs", attrs)
+     && attrs["multiscales"].isArray() && attrs["multiscales"].size())
+    {
+    const Json::Value &ms = attrs["multiscales"][0];
+    for(const Json::Value &axis : ms["axes"])
+      axis_names.push_back(axis.isString() ? axis.asString() : axis["name"].asString());
+
+    for(const Json::Value &ds : ms["datasets"])
+      {
+      Level level;
+      level.Path = ds["path"].asString();
+      for(const Json::Value &tran : ds["coordinateTransformations"])
+        {
+        if(tran["type"].asString() == "scale")
+          for(const Json::Value &v : tran["scale"])
+            level.Scale.push_back(v.asDouble());
+        else if(tran["type"].asString() == "translation")
+          for(const Json::Value &v : tran["translation"])
+            level.Translation.push_back(v.asDouble());
+        }
+      m_Levels.push_back(level);
+      }
+    }
+
+  // A plain array has a single scale
+  if(m_Levels.empty())
+    m_Levels.push_back(Level());
+
+  // Select the scale, going to coarser scales if the image does not fit
+  m_SelectedScaleLevel = std::min(m_ScaleLevel, (unsigned int) m_Levels.size() - 1);
+  while(true)
+    {
+    this->ReadArrayInfo(m_Levels[m_SelectedScaleLevel].Path, m_Array);
+    SizeValueType bytes = m_Array.ElementSize;
+    for(SizeValueType s : m_Array.Shape)
+      bytes *= s;
+    if(!m_MaximumBytes || bytes <= m_MaximumBytes || m_SelectedScaleLevel + 1 >= m_Levels.size())
+      break;
+    m_SelectedScaleLevel++;
+    }
+
+  const Level &level = m_Levels[m_SelectedScaleLevel];
+  m_ArrayDirectory = level.Path.length() ? m_StoreDirectory + "/" + level.Path : m_StoreDirectory;
+  this->AssignAxes(axis_names);
+
+  // Images are 3D, or 4D if there is a time axis with more than one point
+  size_t ndim = m_Array.Shape.size();
+  unsigned int nd = 3, ncomp = 1;
+  for(size_t a = 0; a < ndim; a++)
+    {
+    if(m_AxisMap[a] == 3 && m_Array.Shape[a] > 1)
+      nd = 4;
+    else if(m_AxisMap[a] == -1)
+      ncomp = (unsigned int) m_Array.Shape[a];
+    }
+
+  this->SetNumberOfDimensions(nd);
+  for(unsigned int d = 0; d < nd; d++)
+    {
+    this->SetDimensions(d, 1);
+    this->SetSpacing(d, 1.0);
+    this->SetOrigin(d, 0.0);
+    }
+
+  for(size_t a = 0; a < ndim; a++)
+    {
+    int d = m_AxisMap[a];
+    if(d < 0 || d >= (int) nd)
+      continue;
+    this->SetDimensions(d, m_Array.Shape[a]);
+    if(level.Scale.size() == ndim)
+      this->SetSpacing(d, level.Scale[a]);
+    if(level.Translation.size() == ndim)
+      this->SetOrigin(d, level.Translation[a]);
+    }
+
+  this->SetNumberOfComponents(ncomp);
+  this->SetPixelType(ncomp > 1 ? IOPixelEnum::VECTOR : IOPixelEnum::SCALAR);
+
+  // Chunks cached for another array are no use
+  std::lock_guard<std::mutex> guard(m_CacheMutex);
+  m_Cache.clear();
+  m_CacheOrder.clear();
+  m_CacheBytes = 0;
+}
+
+ZarrImageIO::ChunkPointer ZarrImageIO::ReadChunk(const std::vector<SizeValueType> &coord)
+{
+  std::ostringstream oss;
+  oss << m_ArrayDirectory << "/";
+  for(size_t a = 0; a < coord.size(); a++)
+    oss << (a ? m_Array.Separator : "") << coord[a];
+
+  size_t n = m_Array.ElementSize;
+  for(SizeValueType c : m_Array.Chunks)
+    n *= c;
+
+  std::shared_ptr<ChunkData> chunk = std::make_shared<ChunkData>();
+  std::vector<unsigned char> raw;
+  if(!ReadBinaryFile(oss.str(), raw))
+    {
+    // Chunks that were never written hold the fill value
+    chunk->resize(n);
+    for(size_t i = 0; i < n; i += m_Array.ElementSize)
+      memcpy(chunk->data() + i, m_Array.FillElement.data(), m_Array.ElementSize);
+    return chunk;
+    }
+
+  if(m_Array.Compressed)
+    {
+    if(!Inflate(raw, *chunk, n))
+      itkExceptionMacro(<< "Unable to decompress Zarr chunk " << oss.str());
+    }
+  else
+    {
+    if(raw.size() < n)
+      itkExceptionMacro(<< "Zarr chunk " << oss.str() << " is truncated");
+    raw.resize(n);
+    chunk->swap(raw);
+    }
+
+  if(m_Array.SwapBytes)
+    for(size_t i = 0; i < n; i += m_Array.ElementSize)
+      std::reverse(chunk->data() + i, chunk->data() + i + m_Array.ElementSize);
+
+  return chunk;
+}
+
+ZarrImageIO::ChunkPointer ZarrImageIO::GetChunk(const std::vector<SizeValueType> &coord)
+{
+  std::ostringstream oss;
+  for(SizeValueType c : coord)
+    oss << c << ".";
+  std::string key = oss.str();
+
+    {
+    std::lock_guard<std::mutex> guard(m_CacheMutex);
+    auto it = m_Cache.find(key);
+    if(it != m_Cache.end())
+      {
+      m_CacheOrder.splice(m_CacheOrder.begin(), m_CacheOrder, it->second.second);
+      return it->second.first;
+      }
+    }
+
+  // Chunks are read and decoded outside of the lock
+  ChunkPointer chunk = this->ReadChunk(coord);
+
+  std::lock_guard<std::mutex> guard(m_CacheMutex);
+  if(m_Cache.find(key) == m_Cache.end() && chunk->size() <= m_ChunkCacheBytes)
+    {
+    m_CacheOrder.push_front(key);
+    m_Cache[key] = std::make_pair(chunk, m_CacheOrder.begin());
+    m_CacheBytes += chunk->size();
+    while(m_CacheBytes > m_ChunkCacheBytes)
+      {
+      auto last = m_Cache.find(m_CacheOrder.back());
+      m_CacheBytes -= last->second.first->size();
+      m_Cache.erase(last);
+      m_CacheOrder.pop_back();
+      }
+    }
+  return chunk;
+}
+
+void ZarrImageIO::Read(void *buffer)
+{
+  const ImageIORegion &region = m_IORegion;
+  unsigned int nd = region.GetImageDimension();
+  size_t ndim = m_Array.Shape.size();
+  size_t es = m_Array.ElementSize;
+  SizeValueType ncomp = this->GetNumberOfComponents();
+
+  // Strides of the image dimensions in the output buffer, in elements
+  std::vector<SizeValueType> dim_stride(nd);
+  SizeValueType stride = ncomp;
+  for(unsigned int d = 0; d < nd; d++)
+    {
+    dim_stride[d] = stride;
+    stride *= region.GetSize(d);
+    }
+  if(!stride)
+    return;
+
+  // The range of each array axis to read, and its stride in the buffer
+  std::vector<SizeValueType> lo(ndim), hi(ndim), out_stride(ndim);
+  for(size_t a = 0; a < ndim; a++)
+    {
+    int d = m_AxisMap[a];
+    if(d >= 0 && d < (int) nd)
+      {
+      lo[a] = region.GetIndex(d);
+      hi[a] = lo[a] + region.GetSize(d);
+      out_stride[a] = dim_stride[d];
+      }
+    else
+      {
+      lo[a] = 0;
+      hi[a] = (d == -1) ? ncomp : 1;
+      out_stride[a] = (d == -1) ? 1 : 0;
+      }
+    }
+
+  // Strides of the array axes within a chunk
+  std::vector<SizeValueType> chunk_stride(ndim);
+  stride = 1;
+  for(size_t k = 0; k < ndim; k++)
+    {
+    size_t a = m_Array.FortranOrder ? k : ndim - 1 - k;
+    chunk_stride[a] = stride;
+    stride *= m_Array.Chunks[a];
+    }
+  size_t inner = m_Array.FortranOrder ? 0 : ndim - 1;
+
+  // List the chunks that cross the region
+  std::vector<std::vector<SizeValueType> > chunks;
+  std::vector<SizeValueType> c0(ndim), c1(ndim), coord(ndim);
+  for(size_t a = 0; a < ndim; a++)
+    {
+    c0[a] = coord[a] = lo[a] / m_Array.Chunks[a];
+    c1[a] = (hi[a] - 1) / m_Array.Chunks[a];
+    }
+  while(true)
+    {
+    chunks.push_back(coord);
+    size_t a = 0;
+    for(; a < ndim && ++coord[a] > c1[a]; a++)
+      coord[a] = c0[a];
+    if(a == ndim)
+      break;
+    }
+
+  // Read the chunks in parallel and copy their intersection with the region
+  unsigned char *out = static_cast<unsigned char *>(buffer);
+  MultiThreaderBase::Pointer mt = MultiThreaderBase::New();
+  mt->ParallelizeArray(0, chunks.size(), [&](SizeValueType ic)
+    {
+    const std::vector<SizeValueType> &cc = chunks[ic];
+    ChunkPointer chunk = this->GetChunk(cc);
+
+    std::vector<SizeValueType> b0(ndim), b1(ndim), pos(ndim);
+    for(size_t a = 0; a < ndim; a++)
+      {
+      SizeValueType origin = cc[a] * m_Array.Chunks[a];
+      b0[a] = pos[a] = std::max(lo[a], origin);
+      b1[a] = std::min(hi[a], origin + m_Array.Chunks[a]);
+      }
+
+    SizeValueType len = b1[inner] - b0[inner];
+    bool contiguous = out_stride[inner] == 1;
+    while(true)
+      {
+      size_t src = 0, dst = 0;
+      for(size_t a = 0; a < ndim; a++)
+        {
+        src += (pos[a] - cc[a] * m_Array.Chunks[a]) * chunk_stride[a];
+        dst += (pos[a] - lo[a]) * out_stride[a];
+        }
+
+      const unsigned char *ps = chunk->data() + src * es;
+      unsigned char *pd = out + dst * es;
+      if(contiguous)
+        memcpy(pd, ps, len * es);
+      else
+        for(SizeValueType i = 0; i < len; i++, ps += es, pd += out_stride[inner] * es)
+          memcpy(pd, ps, es);
+
+      // Next row of the intersection along the inner axis
+      size_t a = 0;
+      for(; a < ndim; a++)
+        {
+        if(a == inner)
+          continue;
+        if(++pos[a] < b1[a])
+          break;
+        pos[a] = b0[a];
+        }
+      if(a == ndim)
+        break;
+      }
+    }, nullptr);
+}
+
+void ZarrImageIO::Write(const void *)
+{
+  itkExceptionMacro(<< "Writing Zarr stores is not supported");
+}
+
+void ZarrImageIO::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "ScaleLevel: " << m_ScaleLevel << std::endl;
+  os << indent << "SelectedScaleLevel: " << m_SelectedScaleLevel << std::endl;
+  os << indent << "NumberOfScaleLevels: " << m_Levels.size() << std::endl;
+  os << indent << "MaximumBytes: " << m_MaximumBytes << std::endl;
+}
+
+} // end namespace itk
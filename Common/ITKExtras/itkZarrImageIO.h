@@ -0,0 +1,174 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Module:    itkZarrImageIO.h
+  Language:  C++
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#ifndef __itkZarrImageIO_h
+#define __itkZarrImageIO_h
+
+#include "itkImageIOBase.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+
+/** \class ZarrImageIO
+ *
+ * \brief Read chunked, multiscale images from Zarr (version 2) stores.
+ *
+ * The file name is the directory of the store, which may be an OME-Zarr
+ * multiscale image (with a .zattrs file listing the scales) or a single
+ * array (with a .zarray file). Chunks may be uncompressed or compressed with
+ * zlib or gzip; other codecs (e.g., blosc) are reported as errors.
+ *
+ * One scale of the store is read, the finest by default. When a maximum
+ * number of bytes is set, the finest scale that fits is read instead, so that
+ * very large stores can be opened at a reduced resolution.
+ *
+ * The IO supports streaming: only the chunks that intersect the requested
+ * region are read, in parallel. Decoded chunks are kept in a least recently
+ * used cache, so that reading neighboring regions does not decode the chunks
+ * they share again.
+ *
+ * \ingroup IOFilters
+ */
+class ITK_EXPORT ZarrImageIO : public ImageIOBase
+{
+public:
+  /** Standard class typedefs. */
+  typedef ZarrImageIO            Self;
+  typedef ImageIOBase            Superclass;
+  typedef SmartPointer<Self>     Pointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ZarrImageIO, Superclass);
+
+  /*-------- This part of the interfaces deals with reading data. ----- */
+
+  /** Determine the file type. Returns true if the directory is a Zarr store */
+  virtual bool CanReadFile(const char*) ITK_OVERRIDE;
+
+  /** Only the chunks crossing the requested region are read */
+  virtual bool CanStreamRead() ITK_OVERRIDE { return true; }
+
+  /** Read the metadata of the store and of the selected scale */
+  virtual void ReadImageInformation() ITK_OVERRIDE;
+
+  /** Reads the chunks crossing the IO region into the buffer provided. */
+  virtual void Read(void* buffer) ITK_OVERRIDE;
+
+  /*-------- This part of the interfaces deals with writing data. ----- */
+
+  /** Writing Zarr stores is not supported */
+  virtual bool CanWriteFile(const char*) ITK_OVERRIDE { return false; }
+  virtual void WriteImageInformation() ITK_OVERRIDE {}
+  virtual void Write(const void* buffer) ITK_OVERRIDE;
+
+  /** The scale to read, zero being the finest */
+  itkSetMacro(ScaleLevel, unsigned int);
+  itkGetConstMacro(ScaleLevel, unsigned int);
+
+  /**
+   * If not zero, read the finest scale not finer than the scale level whose
+   * voxels fit in this number of bytes
+   */
+  itkSetMacro(MaximumBytes, SizeValueType);
+  itkGetConstMacro(MaximumBytes, SizeValueType);
+
+  /** The number of bytes of decoded chunks kept between reads */
+  itkSetMacro(ChunkCacheBytes, SizeValueType);
+  itkGetConstMacro(ChunkCacheBytes, SizeValueType);
+
+  /** Number of scales in the store, and the scale that is read */
+  unsigned int GetNumberOfScaleLevels() const { return (unsigned int) m_Levels.size(); }
+  itkGetConstMacro(SelectedScaleLevel, unsigned int);
+
+  ZarrImageIO();
+  ~ZarrImageIO();
+  void PrintSelf(std::ostream& os, Indent indent) const ITK_OVERRIDE;
+
+private:
+  ZarrImageIO(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  // A scale of a multiscale store: the path of its array, and the scale and
+  // translation of each array axis
+  struct Level
+  {
+    std::string Path;
+    std::vector<double> Scale, Translation;
+  };
+
+  // Description of the array that is read
+  struct ArrayInfo
+  {
+    std::vector<SizeValueType> Shape, Chunks;
+    unsigned int ElementSize = 0;
+    bool SwapBytes = false, FortranOrder = false, Compressed = false;
+    std::string Separator = ".";
+    std::vector<unsigned char> FillElement;
+  };
+
+  typedef std::vector<unsigned char> ChunkData;
+  typedef std::shared_ptr<const ChunkData> ChunkPointer;
+
+  // Find the root of the store from the file name
+  static std::string GetStoreDirectory(const char *filename);
+
+  // Read the .zarray file of the array at the given path in the store
+  void ReadArrayInfo(const std::string &path, ArrayInfo &info);
+
+  // Assign the axes of the array to image dimensions and components
+  void AssignAxes(const std::vector<std::string> &names);
+
+  // Get a decoded chunk from the cache or from disk
+  ChunkPointer GetChunk(const std::vector<SizeValueType> &coord);
+  ChunkPointer ReadChunk(const std::vector<SizeValueType> &coord);
+
+  unsigned int m_ScaleLevel = 0, m_SelectedScaleLevel = 0;
+  SizeValueType m_MaximumBytes = 0;
+  SizeValueType m_ChunkCacheBytes = 512ul << 20;
+
+  std::string m_StoreDirectory, m_ArrayDirectory;
+  std::vector<Level> m_Levels;
+  ArrayInfo m_Array;
+
+  // For each array axis, the image dimension it maps to, or -1 for the
+  // component axis, or -2 for other axes (which must have size one)
+  std::vector<int> m_AxisMap;
+
+  // Least recently used cache of decoded chunks
+  std::list<std::string> m_CacheOrder;
+  std::map<std::string, std::pair<ChunkPointer, std::list<std::string>::iterator> > m_Cache;
+  SizeValueType m_CacheBytes = 0;
+  std::mutex m_CacheMutex;
+};
+
+} // end namespace itk
+
+#endif // __itkZarrImageIO_h
@@ -0,0 +1,57 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Module:    itkZarrImageIOFactory.cxx
+  Language:  C++
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#include "itkZarrImageIOFactory.h"
+#include "itkCreateObjectFunction.h"
+#include "itkZarrImageIO.h"
+#include "itkVersion.h"
+
+
+namespace itk
+{
+
+ZarrImageIOFactory::ZarrImageIOFactory()
+{
+  this->RegisterOverride("itkImageIOBase",
+                         "itkZarrImageIO",
+                         "Zarr Image IO",
+                         1,
+                         CreateObjectFunction<ZarrImageIO>::New());
+}
+
+ZarrImageIOFactory::~ZarrImageIOFactory()
+{
+}
+
+const char*
+ZarrImageIOFactory::GetITKSourceVersion(void) const
+{
+  return ITK_SOURCE_VERSION;
+}
+
+const char*
+ZarrImageIOFactory::GetDescription() const
+{
+  return "Zarr ImageIO Factory, allows the loading of chunked Zarr and OME-Zarr stores into Insight";
+}
+
+} // end namespace itk
@@ -0,0 +1,73 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Module:    itkZarrImageIOFactory.h
+  Language:  C++
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#ifndef __itkZarrImageIOFactory_h
+#define __itkZarrImageIOFactory_h
+
+#include "itkObjectFactoryBase.h"
+#include "itkImageIOBase.h"
+
+namespace itk
+{
+/** \class ZarrImageIOFactory
+ * \brief Create instances of ZarrImageIO objects using an object factory.
+ */
+class ITK_EXPORT ZarrImageIOFactory : public ObjectFactoryBase
+{
+public:
+  /** Standard class typedefs. */
+  typedef ZarrImageIOFactory   Self;
+  typedef ObjectFactoryBase  Superclass;
+  typedef SmartPointer<Self>  Pointer;
+  typedef SmartPointer<const Self>  ConstPointer;
+
+  /** Class methods used to interface with the registered factories. */
+  virtual const char* GetITKSourceVersion(void) const ITK_OVERRIDE;
+  virtual const char* GetDescription(void) const ITK_OVERRIDE;
+
+  /** Method for class instantiation. */
+  itkFactorylessNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ZarrImageIOFactory, ObjectFactoryBase);
+
+  /** Register one factory of this type  */
+  static void RegisterOneFactory(void)
+  {
+    ZarrImageIOFactory::Pointer ZarrFactory = ZarrImageIOFactory::New();
+    ObjectFactoryBase::RegisterFactory(ZarrFactory);
+  }
+
+protected:
+  ZarrImageIOFactory();
+  ~ZarrImageIOFactory();
+
+private:
+  ZarrImageIOFactory(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+};
+
+
+} // end namespace itk
+
+#endif
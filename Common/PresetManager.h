@@ -3,6 +3,9 @@
 
 #include "itkObject.h"
 #include "SNAPCommon.h"
+#include "Registry.h"
+#include <future>
+#include <map>
 
 class SystemInterface;
 
@@ -37,6 +40,11 @@ class SystemInterface;
   deletes presets, these operations are carried out on disk, without checking
   what another SNAP session might have done.
 
+  The user presets are read from disk on a background thread that is started
+  by Initialize(), so that reading them does not delay startup. They are
+  collected the first time they are needed; system presets are available
+  right away.
+
   The object fires a itk::ModifiedEvent event when presets have been modified
  */
 template<class TManagedObjectTraits>
@@ -53,7 +61,7 @@ public:
   enum PresetType { PRESET_SYSTEM, PRESET_USER, PRESET_NONE };
   typedef std::pair<PresetType, std::string> PresetMatch;
 
-  /** Load the presets from disk and initialize them */
+  /** Create the system presets and start loading the user presets from disk */
   void Initialize(SystemInterface *si);
 
   /** Get the list of user and system presets */
@@ -61,7 +69,7 @@ public:
     { return m_PresetSystem; }
 
   const std::vector<std::string> &GetUserPresets()
-    { return m_PresetUser; }
+    { WaitForUserPresets(); return m_PresetUser; }
 
   /**
    * Query if the passed in instance of the object matches one of the presets,
@@ -103,6 +111,21 @@ protected:
   // List of system and user presets
   std::vector<std::string> m_PresetSystem, m_PresetUser;
 
+  // The user presets as read from disk by the background thread
+  struct UserPresetFolders
+  {
+    std::vector<std::string> Names;
+    std::map<std::string, Registry> Folders;
+  };
+
+  std::future<UserPresetFolders> m_UserPresetFuture;
+
+  // Read the user presets in a category from disk
+  static UserPresetFolders ReadUserPresets(SystemInterface *si, std::string category);
+
+  // Create the user presets once they have been read from disk
+  void WaitForUserPresets();
+
 };
 
 
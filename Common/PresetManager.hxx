@@ -33,17 +33,48 @@ PresetManager<TManagedObjectTraits>
     m_PresetSystem.push_back(name);
     }
 
+  // Read the user presets in the background. Only the files are read on the
+  // other thread, the preset objects are created by WaitForUserPresets()
+  m_PresetUser.clear();
+  m_UserPresetFuture = std::async(std::launch::async,
+                                  &Self::ReadUserPresets, m_System, m_Category);
+
+  this->Modified();
+}
+
+template <class TManagedObjectTraits>
+typename PresetManager<TManagedObjectTraits>::UserPresetFolders
+PresetManager<TManagedObjectTraits>
+::ReadUserPresets(SystemInterface *si, std::string category)
+{
+  UserPresetFolders result;
+
   // Load all the user preset names
-  m_PresetUser = m_System->GetSavedObjectNames(m_Category.c_str());
+  result.Names = si->GetSavedObjectNames(category.c_str());
 
   // Load each of the presets from the registry
-  for(int j = 0; j < m_PresetUser.size(); j++)
+  for(const std::string &name : result.Names)
+    si->ReadSavedObject(category.c_str(), name.c_str(), result.Folders[name]);
+
+  return result;
+}
+
+template <class TManagedObjectTraits>
+void
+PresetManager<TManagedObjectTraits>
+::WaitForUserPresets()
+{
+  if(!m_UserPresetFuture.valid())
+    return;
+
+  // This rethrows any exception encountered while reading the files
+  UserPresetFolders user = m_UserPresetFuture.get();
+  m_PresetUser = user.Names;
+  for(const std::string &name : m_PresetUser)
     {
-    Registry reg;
-    m_System->ReadSavedObject(m_Category.c_str(), m_PresetUser[j].c_str(), reg);
     ManagedTypePtr mtp = ManagedType::New();
-    TManagedObjectTraits::ReadFromRegistry(mtp, reg);
-    m_PresetMap[m_PresetUser[j]] = mtp;
+    TManagedObjectTraits::ReadFromRegistry(mtp, user.Folders[name]);
+    m_PresetMap[name] = mtp;
     }
 
   this->Modified();
@@ -64,6 +95,7 @@ PresetManager<TManagedObjectTraits>
       return std::make_pair(PRESET_SYSTEM, *it);
     }
 
+  WaitForUserPresets();
   for(it = m_PresetUser.begin(); it != m_PresetUser.end(); it++)
     {
     if(*m_PresetMap[*it] == *instance)
@@ -79,6 +111,11 @@ PresetManager<TManagedObjectTraits>
 ::SetToPreset(ManagedType *instance, const std::string &preset)
 {
   typename PresetMap::iterator it = m_PresetMap.find(preset);
+  if(it == m_PresetMap.end())
+    {
+    WaitForUserPresets();
+    it = m_PresetMap.find(preset);
+    }
   if(it == m_PresetMap.end())
     throw IRISException("Preset %s not found in category %s", preset.c_str(),
                         m_Category.c_str());
@@ -90,6 +127,8 @@ void
 PresetManager<TManagedObjectTraits>
 ::SaveAsPreset(ManagedType *instance, const std::string &preset)
 {
+  WaitForUserPresets();
+
   // Check that the name is not used for a system preset
   if(std::find(m_PresetSystem.begin(), m_PresetSystem.end(), preset) != m_PresetSystem.end())
     throw IRISException(
@@ -118,6 +157,8 @@ void
 PresetManager<TManagedObjectTraits>
 ::DeletePreset(const std::string &preset)
 {
+  WaitForUserPresets();
+
   // Assign as a user preset
   std::vector<std::string>::iterator it =
       std::find(m_PresetUser.begin(), m_PresetUser.end(), preset);
@@ -140,6 +181,8 @@ typename PresetManager<TManagedObjectTraits>::ManagedType *
 PresetManager<TManagedObjectTraits>
 ::GetPreset(const std::string &preset)
 {
+  if(m_PresetMap.find(preset) == m_PresetMap.end())
+    WaitForUserPresets();
   return m_PresetMap[preset];
 }
 
@@ -148,5 +191,7 @@ bool
 PresetManager<TManagedObjectTraits>
 ::IsValidPreset(const std::string &preset)
 {
+  if(m_PresetMap.find(preset) == m_PresetMap.end())
+    WaitForUserPresets();
   return m_PresetMap.find(preset) != m_PresetMap.end();
 }
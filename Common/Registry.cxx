@@ -37,6 +37,9 @@
 #include "itkXMLFile.h"
 
 #include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <cstdarg>
 #include <fstream>
@@ -175,35 +178,82 @@ RegistryValue
   m_String = input;
 }
 
-RegistryValue&
-Registry::Entry(const std::string &key)
+namespace
 {
-  // Get the containing folder
-  StringType::size_type iDot = key.find_first_of('.');
+// Incremented whenever keys are removed from any registry
+std::atomic<unsigned long> g_RegistryRemovalGeneration(1);
 
-  // There is a subfolder
-  if(iDot != key.npos)
+// Source of the serial numbers of registries
+std::atomic<unsigned long> g_RegistrySerial(1);
+}
+
+void Registry::InvalidateIndices()
+{
+  ++g_RegistryRemovalGeneration;
+}
+
+void Registry::ValidateIndex()
+{
+  unsigned long generation = g_RegistryRemovalGeneration;
+  if(m_IndexGeneration != generation)
     {
-    StringType child = key.substr(0,iDot);
-    StringType childKey = key.substr(iDot+1);
-    return Folder(child).Entry(childKey);
+    m_EntryIndex.clear();
+    m_FolderIndex.clear();
+    m_IndexGeneration = generation;
+    }
+}
+
+Registry &
+Registry::ResolveFolder(const StringType &key, StringType::size_type &iLast)
+{
+  Registry *folder = this;
+  StringType::size_type iDot;
+  iLast = 0;
+  while((iDot = key.find('.', iLast)) != key.npos)
+    {
+    folder = &folder->LocalFolder(key.substr(iLast, iDot - iLast));
+    iLast = iDot + 1;
     }
+  return *folder;
+}
 
-  // Search for the key and return it if found
-  EntryIterator it = m_EntryMap.find(key);
-  if(it != m_EntryMap.end())
-    return it->second;
+RegistryValue&
+Registry::Entry(const std::string &key)
+{
+  // Keys in this folder take a single lookup
+  if(key.find('.') == key.npos)
+    return LocalEntry(key);
+
+  // Keys in subfolders are looked up in the index first
+  this->ValidateIndex();
+  auto it = m_EntryIndex.find(key);
+  if(it != m_EntryIndex.end())
+    return *it->second;
+
+  StringType::size_type iLast;
+  RegistryValue &value = ResolveFolder(key, iLast).LocalEntry(key.substr(iLast));
+  m_EntryIndex.emplace(key, &value);
+  return value;
+}
 
-  // Key was not found, create a null entry
-  m_EntryMap[key] = RegistryValue();
-  return m_EntryMap[key];
+RegistryValue&
+Registry::Entry(const RegistryKey &key)
+{
+  unsigned long generation = g_RegistryRemovalGeneration;
+  if(key.m_Value && key.m_Serial == m_Serial && key.m_Generation == generation)
+    return *key.m_Value;
+
+  key.m_Value = &Entry(key.m_Key);
+  key.m_Serial = m_Serial;
+  key.m_Generation = generation;
+  return *key.m_Value;
 }
 
 Registry::StringType
 Registry::Key(const char *format,...)
 {
-  // A string for prinf-ing
-  static char buffer[1024];
+  // A string for prinf-ing, on the stack so that threads may format keys at once
+  char buffer[1024];
   
   // Do the printf operation
   va_list al;
@@ -217,10 +267,10 @@ Registry::Key(const char *format,...)
 
 int
 Registry
-::GetEntryKeys(StringListType &targetArray) 
+::GetEntryKeys(StringListType &targetArray) const
 {
   // Iterate through keys in ascending order
-  for(EntryIterator it=m_EntryMap.begin();it!=m_EntryMap.end();++it)
+  for(EntryConstIterator it=m_EntryMap.begin();it!=m_EntryMap.end();++it)
     {
     // Put the key in the array
     targetArray.push_back(it->first);
@@ -232,7 +282,7 @@ Registry
 
 int
 Registry
-::GetFolderKeys(StringListType &targetArray) 
+::GetFolderKeys(StringListType &targetArray) const
 {
   // Iterate through keys in ascending order
   for(FolderIterator it=m_FolderMap.begin();it!=m_FolderMap.end();++it)
@@ -245,6 +295,35 @@ Registry
   return targetArray.size();
 }
 
+const Registry *Registry::FindFolder(const StringType &key) const
+{
+  const Registry *folder = this;
+  StringType::size_type iLast = 0, iDot;
+  do
+    {
+    iDot = key.find('.', iLast);
+    FolderIterator it = folder->m_FolderMap.find(key.substr(iLast, iDot - iLast));
+    if(it == folder->m_FolderMap.end())
+      return NULL;
+    folder = it->second;
+    iLast = iDot + 1;
+    }
+  while(iDot != key.npos);
+
+  return folder;
+}
+
+const RegistryValue *Registry::FindEntry(const StringType &key) const
+{
+  const Registry *folder = this;
+  StringType::size_type iDot = key.rfind('.');
+  if(iDot != key.npos && !(folder = this->FindFolder(key.substr(0, iDot))))
+    return NULL;
+
+  EntryConstIterator it = folder->m_EntryMap.find(iDot == key.npos ? key : key.substr(iDot + 1));
+  return it != folder->m_EntryMap.end() ? &it->second : NULL;
+}
+
 bool Registry::HasEntry(const Registry::StringType &key) const
 {
   // Get the containing folder
@@ -404,7 +483,10 @@ void Registry::CleanEmptyFolders()
     {
     itf->second->CleanEmptyFolders();
     if(itf->second->IsEmpty())
+      {
       m_FolderMap.erase(itf++);
+      InvalidateIndices();
+      }
     else
       itf++;
     }
@@ -430,7 +512,10 @@ void Registry::CleanZeroSizeArrays()
 
     // Check if it has the array size key
     if(itf->second->IsZeroSizeArray())
+      {
       m_FolderMap.erase(itf++);
+      InvalidateIndices();
+      }
     else
       itf++;
     }
@@ -524,13 +609,20 @@ Registry
       newMap[it->first] = it->second;
     }
 
-  m_EntryMap = newMap;
+  if(newMap.size() != m_EntryMap.size())
+    {
+    m_EntryMap = newMap;
+    InvalidateIndices();
+    }
 }
 
 void
 Registry
 ::Clear()
 {
+  if(!this->IsEmpty())
+    InvalidateIndices();
+
   m_EntryMap.clear();
   m_FolderMap.clear();
 }
@@ -717,17 +809,26 @@ Registry &
 Registry
 ::Folder(const string &key) 
 {
-  // Find the first separator in the key string
-  StringType::size_type iDot = key.find_first_of('.');
-
-  // Recurse on the immideate folder
-  if(iDot != key.npos) 
-    {
-    StringType child = key.substr(0,iDot);
-    StringType childKey = key.substr(iDot+1);
-    return Folder(child).Folder(childKey);
-    }
+  // Keys in this folder take a single lookup
+  if(key.find('.') == key.npos)
+    return LocalFolder(key);
+
+  // Keys in subfolders are looked up in the index first
+  this->ValidateIndex();
+  auto it = m_FolderIndex.find(key);
+  if(it != m_FolderIndex.end())
+    return *it->second;
+
+  StringType::size_type iLast;
+  Registry &folder = ResolveFolder(key, iLast).LocalFolder(key.substr(iLast));
+  m_FolderIndex.emplace(key, &folder);
+  return folder;
+}
 
+Registry &
+Registry
+::LocalFolder(const StringType &key)
+{
   // Get the folder, adding if necessary
   FolderIterator it = m_FolderMap.find(key);
   if(it != m_FolderMap.end())
@@ -741,18 +842,23 @@ Registry
 
 Registry
 ::Registry()
+  : m_Serial(g_RegistrySerial++)
 {
   m_AddIfNotFound = false;
 }
 
 Registry
 ::Registry(const char *fname) 
+  : m_Serial(g_RegistrySerial++)
 {
+  m_AddIfNotFound = false;
   ReadFromFile(fname);
 }
 
 Registry::Registry(const Registry &source)
+  : m_Serial(g_RegistrySerial++)
 {
+  m_AddIfNotFound = false;
   *this = source;
 }
 
@@ -913,6 +1019,13 @@ void Registry
 
 void Registry::ReadFromXMLFile(const char *pathname)
 {
+  // Binary registries are accepted wherever XML ones are
+  if(IsBinary(pathname))
+    {
+    ReadFromBinaryFile(pathname);
+    return;
+    }
+
   SmartPtr<RegistryXMLFileReader> reader = RegistryXMLFileReader::New();
   reader->SetOutputObject(this);
   reader->SetFilename(pathname);
@@ -920,3 +1033,186 @@ void Registry::ReadFromXMLFile(const char *pathname)
 }
 
 
+/*
+ * Binary registry format. All integers are little endian, and strings are
+ * stored as a uint32 length followed by the characters. The file starts with
+ * the magic bytes below, followed by the root folder. Each folder is stored
+ * as:
+ *
+ *   uint64  size of the entry block
+ *   entry block: uint32 number of entries, then for each entry its key and
+ *           its value (null entries are not stored)
+ *   uint32  number of subfolders
+ *   for each subfolder: its key and the uint64 size of its body
+ *   the bodies of the subfolders, in the same order
+ *
+ * The sizes let a reader skip the entries and the subfolders it doesn't need.
+ */
+static const char RegistryBinaryMagic[8] = { '\x89', 'S', 'R', 'E', 'G', '\r', '\n', '\x1a' };
+
+static void RegistryBinaryPutInt(std::string &buffer, uint64_t value, unsigned int bytes)
+{
+  for(unsigned int i = 0; i < bytes; i++)
+    buffer.push_back((char) ((value >> (8 * i)) & 0xff));
+}
+
+static void RegistryBinaryPutString(std::string &buffer, const std::string &str)
+{
+  RegistryBinaryPutInt(buffer, str.size(), 4);
+  buffer.append(str);
+}
+
+static uint64_t RegistryBinaryGetInt(std::istream &sin, unsigned int bytes)
+{
+  unsigned char data[8];
+  if(!sin.read((char *) data, bytes))
+    throw Registry::IOException("Unexpected end of the binary Registry file");
+
+  uint64_t value = 0;
+  for(unsigned int i = 0; i < bytes; i++)
+    value |= ((uint64_t) data[i]) << (8 * i);
+  return value;
+}
+
+static std::string RegistryBinaryGetString(std::istream &sin)
+{
+  uint64_t length = RegistryBinaryGetInt(sin, 4);
+  std::string str(length, '\0');
+  if(length > 0 && !sin.read(&str[0], length))
+    throw Registry::IOException("Unexpected end of the binary Registry file");
+  return str;
+}
+
+void
+Registry
+::WriteBinary(std::string &buffer) const
+{
+  // Write the entries, leaving room for the size of the block
+  size_t pos_size = buffer.size();
+  RegistryBinaryPutInt(buffer, 0, 8);
+
+  unsigned int n_entries = 0;
+  for(EntryConstIterator ite = m_EntryMap.begin(); ite != m_EntryMap.end(); ++ite)
+    if(!ite->second.IsNull())
+      n_entries++;
+
+  RegistryBinaryPutInt(buffer, n_entries, 4);
+  for(EntryConstIterator ite = m_EntryMap.begin(); ite != m_EntryMap.end(); ++ite)
+    {
+    if(!ite->second.IsNull())
+      {
+      RegistryBinaryPutString(buffer, ite->first);
+      RegistryBinaryPutString(buffer, ite->second.GetInternalString());
+      }
+    }
+
+  std::string block_size;
+  RegistryBinaryPutInt(block_size, buffer.size() - pos_size - 8, 8);
+  buffer.replace(pos_size, 8, block_size);
+
+  // Write the folders into their own buffers, since the index that comes
+  // first needs their sizes
+  std::vector<std::string> bodies;
+  bodies.reserve(m_FolderMap.size());
+  for(FolderIterator itf = m_FolderMap.begin(); itf != m_FolderMap.end(); ++itf)
+    {
+    bodies.push_back(std::string());
+    itf->second->WriteBinary(bodies.back());
+    }
+
+  RegistryBinaryPutInt(buffer, m_FolderMap.size(), 4);
+  unsigned int k = 0;
+  for(FolderIterator itf = m_FolderMap.begin(); itf != m_FolderMap.end(); ++itf, ++k)
+    {
+    RegistryBinaryPutString(buffer, itf->first);
+    RegistryBinaryPutInt(buffer, bodies[k].size(), 8);
+    }
+
+  for(k = 0; k < bodies.size(); k++)
+    buffer.append(bodies[k]);
+}
+
+void
+Registry
+::ReadBinary(std::istream &sin, const StringListType *folders)
+{
+  // Read the entries
+  RegistryBinaryGetInt(sin, 8);
+  uint64_t n_entries = RegistryBinaryGetInt(sin, 4);
+  for(uint64_t i = 0; i < n_entries; i++)
+    {
+    StringType key = RegistryBinaryGetString(sin);
+    m_EntryMap[key] = RegistryValue(RegistryBinaryGetString(sin));
+    }
+
+  // Read the folder index
+  uint64_t n_folders = RegistryBinaryGetInt(sin, 4);
+  std::vector<std::pair<StringType, uint64_t> > index;
+  for(uint64_t i = 0; i < n_folders; i++)
+    {
+    StringType key = RegistryBinaryGetString(sin);
+    index.push_back(std::make_pair(key, RegistryBinaryGetInt(sin, 8)));
+    }
+
+  // Read the folders that are requested, and seek past the others
+  for(unsigned int i = 0; i < index.size(); i++)
+    {
+    const StringType &key = index[i].first;
+    std::streamoff end = (std::streamoff) sin.tellg() + (std::streamoff) index[i].second;
+
+    bool read_all = (folders == NULL);
+    StringListType subfolders;
+    if(folders)
+      {
+      StringType prefix = key + ".";
+      for(StringListType::const_iterator it = folders->begin(); it != folders->end(); ++it)
+        {
+        if(*it == key)
+          read_all = true;
+        else if(it->compare(0, prefix.size(), prefix) == 0)
+          subfolders.push_back(it->substr(prefix.size()));
+        }
+      }
+
+    if(read_all)
+      Folder(key).ReadBinary(sin, NULL);
+    else if(subfolders.size())
+      Folder(key).ReadBinary(sin, &subfolders);
+
+    sin.seekg(end);
+    if(!sin.good())
+      throw IOException("Unexpected end of the binary Registry file");
+    }
+}
+
+bool Registry::IsBinary(const char *name)
+{
+  std::ifstream file(name, std::ios::in | std::ios::binary);
+  char magic[sizeof(RegistryBinaryMagic)];
+  return file.read(magic, sizeof(magic))
+      && std::equal(magic, magic + sizeof(magic), RegistryBinaryMagic);
+}
+
+void Registry::WriteToBinaryFile(const char *pathname)
+{
+  std::string buffer(RegistryBinaryMagic, sizeof(RegistryBinaryMagic));
+  WriteBinary(buffer);
+
+  ofstream sout(pathname, std::ios::out | std::ios::binary);
+  sout.exceptions(std::ios::failbit);
+  sout.write(buffer.data(), buffer.size());
+}
+
+void Registry::ReadFromBinaryFile(const char *pathname, const StringListType *folders)
+{
+  ifstream sin(pathname, std::ios::in | std::ios::binary);
+  if(!sin.good())
+    throw IOException("Unable to open the Registry file");
+
+  char magic[sizeof(RegistryBinaryMagic)];
+  if(!sin.read(magic, sizeof(magic))
+     || !std::equal(magic, magic + sizeof(magic), RegistryBinaryMagic))
+    throw IOException("Not a binary Registry file");
+
+  ReadBinary(sin, folders);
+}
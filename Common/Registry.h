@@ -45,6 +45,7 @@
 #include <map>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <initializer_list>
 
@@ -400,9 +401,46 @@ private:
 
 
 
+class Registry;
+
+/**
+ * \class RegistryKey
+ * \brief A key that remembers the entry it refers to.
+ *
+ * Looking up a key such as "Layers.Layer[003].LayerMetaData.DisplayMapping"
+ * takes a lookup in each folder along the path. A RegistryKey that is kept
+ * and used again with the same registry goes straight to the entry found
+ * the first time, until keys are removed from any registry.
+ */
+class RegistryKey
+{
+public:
+  RegistryKey() {}
+  explicit RegistryKey(const std::string &key) : m_Key(key) {}
+  explicit RegistryKey(const char *key) : m_Key(key) {}
+
+  const std::string &GetString() const { return m_Key; }
+
+private:
+  std::string m_Key;
+
+  // Where the entry was last found
+  mutable unsigned long m_Serial = 0, m_Generation = 0;
+  mutable RegistryValue *m_Value = nullptr;
+
+  friend class Registry;
+};
+
 /**
  * \class Registry
  * \brief A tree of key-value pair maps
+ *
+ * Keys with dots refer to entries and folders in subfolders. The registry
+ * at which such a lookup starts keeps a flat index from the whole key to
+ * the entry or folder, so that repeated lookups of the same key take a
+ * single hash table lookup. Since the maps never move their elements, the
+ * index stays valid until keys are removed, which clears the indices of
+ * all registries.
  */
 class Registry
 {
@@ -435,21 +473,35 @@ public:
 
   /** Get a reference to a value in this registry, which can then be queried */
   RegistryValue &operator[](const StringType &key) { return Entry(key); }
+  RegistryValue &operator[](const RegistryKey &key) { return Entry(key); }
 
-  /** Get a reference to a folder inside this registry, creating it if necessary */
+  /** Get a reference to a value inside this registry, creating it if necessary */
   RegistryValue &Entry(const StringType &key);
 
+  /** Get a reference to a value, reusing the entry found by the key before */
+  RegistryValue &Entry(const RegistryKey &key);
+
   /** Get a reference to a folder inside this registry, creating it if necessary */
   Registry &Folder(const StringType &key);
 
+  /**
+   * Find a folder without creating it or touching the lookup index, or return
+   * NULL. Unlike Folder(), this may be called by several threads at once on a
+   * registry that is not being modified.
+   */
+  const Registry *FindFolder(const StringType &key) const;
+
+  /** Find an entry without creating it, or return NULL. See FindFolder() */
+  const RegistryValue *FindEntry(const StringType &key) const;
+
   /** A helper method to convert a printf-style expression to a key */
   static StringType Key(const char *key,...);
 
   /** Get a list of all keys that have values, append it to keyList */
-  int GetEntryKeys(StringListType &keyList);
+  int GetEntryKeys(StringListType &keyList) const;
 
   /** Get a list of all subfolder keys, append it to keyList */
-  int GetFolderKeys(StringListType &keyList);
+  int GetFolderKeys(StringListType &keyList) const;
 
   /** Check if an entry with the given key exists */
   bool HasEntry(const StringType &key) const;
@@ -495,9 +547,25 @@ public:
   /** Read from an std::ifstream */
   void ReadFromStream(std::istream &sin);
 
-  /** Read from XML file */
+  /** Read from XML file. Binary registry files are also accepted */
   void ReadFromXMLFile(const char *pathname);
 
+  /**
+   * Write the Registry to a binary file. The binary format stores the size
+   * of each folder next to its key, so that a reader can seek past the
+   * folders it does not need. XML remains the interchange format; binary
+   * files are meant for large registries that are read often.
+   */
+  void WriteToBinaryFile(const char *pathname);
+
+  /**
+   * Read from a binary file. If a list of folder keys is given (keys may
+   * contain dots to refer to nested folders), only these folders and the
+   * entries of the folders that contain them are read, and the rest of the
+   * file is skipped.
+   */
+  void ReadFromBinaryFile(const char *pathname, const StringListType *folders = NULL);
+
   /** Print the registry in a tab-formatted way */
   void Print(std::ostream &sout, StringType indent = "  ", StringType prefix = "");
 
@@ -566,6 +634,9 @@ public:
     SyntaxException(const char *text) : StringType(text) {}
   };
 
+  /** quick method check if a file is a binary registry file */
+  static bool IsBinary(const char *name);
+
   /** quick method check if a file is an XML file */
   static bool IsXML(const char *name)
   {
@@ -597,18 +668,49 @@ private:
   /** A hash table for the registry values */
   EntryMapType m_EntryMap;
 
+  /** Entries and folders in subfolders, by their full keys */
+  std::unordered_map<StringType, RegistryValue *> m_EntryIndex;
+  std::unordered_map<StringType, Registry *> m_FolderIndex;
+
+  /** The removal generation in which the index was built */
+  unsigned long m_IndexGeneration = 0;
+
+  /** A number that identifies this registry to the RegistryKey objects */
+  unsigned long m_Serial;
+
   /**
    * A flag as to whether keys and folders that are read and not found
    * should be created and populated with default values.
    */
   bool m_AddIfNotFound;
 
+  /** Find or create an entry or a folder directly in this folder */
+  RegistryValue &LocalEntry(const StringType &key) { return m_EntryMap[key]; }
+  Registry &LocalFolder(const StringType &key);
+
+  /** Find the folder that holds a key, and the position of the last part
+   * of the key, creating the folders along the way */
+  Registry &ResolveFolder(const StringType &key, StringType::size_type &iLast);
+
+  /** Clear the index if keys have been removed since it was built */
+  void ValidateIndex();
+
+  /** Called whenever keys are removed, making all indices invalid */
+  static void InvalidateIndices();
+
   /** Write this folder recursively to a stream */
   void Write(std::ostream &sout,const StringType &keyPrefix);
 
   /** Write this folder recursively to a stream in XML format */
   void WriteXML(std::ostream &sout,const StringType &keyPrefix);
 
+  /** Append this folder recursively to a buffer in binary format */
+  void WriteBinary(std::string &buffer) const;
+
+  /** Read this folder recursively in binary format, skipping the folders
+   * that are not on the list (a NULL list means all folders) */
+  void ReadBinary(std::istream &sin, const StringListType *folders);
+
   /** Read this folder recursively from a stream, recording syntax errors */
   void Read(std::istream &sin, std::ostream &serr);
 
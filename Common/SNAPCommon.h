@@ -135,6 +135,13 @@ enum InterpolationMethod {
   SINC_WINDOW_05
 };
 
+// How scalar images with floating point voxels are kept in memory
+enum FloatImageStorage {
+  FLOAT_STORAGE_NATIVE = 0,
+  FLOAT_STORAGE_INT16,
+  FLOAT_STORAGE_UINT8
+};
+
 
 
 
@@ -0,0 +1,320 @@
+#include "SNAPLatencyMonitor.h"
+#include "SNAPProfiler.h"
+#include "json/json.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+
+/**
+ * Log-linear histogram of durations in microseconds. Values below 16 have a
+ * bucket each; above, each power of two is split into 16 buckets.
+ */
+struct LatencyHistogram
+{
+  enum { SUB_BUCKETS = 16, SUB_BITS = 4, MAX_EXPONENT = 40 };
+  enum { NUMBER_OF_BUCKETS = SUB_BUCKETS * (MAX_EXPONENT - SUB_BITS + 2) };
+
+  std::atomic<unsigned int> Buckets[NUMBER_OF_BUCKETS];
+  std::atomic<unsigned long long> Count, Sum, Max;
+
+  LatencyHistogram() { this->Reset(); }
+
+  void Reset()
+  {
+    for(auto &b : Buckets)
+      b.store(0, std::memory_order_relaxed);
+    Count = 0; Sum = 0; Max = 0;
+  }
+
+  static int BucketIndex(unsigned long long us)
+  {
+    if(us < SUB_BUCKETS)
+      return (int) us;
+    int e = std::min((int) MAX_EXPONENT, std::ilogb((double) us));
+    int sub = (int) ((us >> (e - SUB_BITS)) - SUB_BUCKETS);
+    return SUB_BUCKETS * (e - SUB_BITS + 1) + std::min(sub, SUB_BUCKETS - 1);
+  }
+
+  // Lowest value in a bucket, in microseconds
+  static double BucketLowerBound(int index)
+  {
+    if(index < SUB_BUCKETS)
+      return index;
+    int e = index / SUB_BUCKETS + SUB_BITS - 1, sub = index % SUB_BUCKETS;
+    return std::ldexp((double) (SUB_BUCKETS + sub), e - SUB_BITS);
+  }
+
+  void Add(unsigned long long us)
+  {
+    Buckets[BucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    Count.fetch_add(1, std::memory_order_relaxed);
+    Sum.fetch_add(us, std::memory_order_relaxed);
+    unsigned long long m = Max.load(std::memory_order_relaxed);
+    while(us > m && !Max.compare_exchange_weak(m, us, std::memory_order_relaxed)) {}
+  }
+
+  // Percentile in milliseconds, taken at the middle of its bucket
+  double Percentile(double p, unsigned long long count) const
+  {
+    unsigned long long rank = (unsigned long long) std::ceil(p * count), seen = 0;
+    for(int k = 0; k < NUMBER_OF_BUCKETS; k++)
+      {
+      seen += Buckets[k].load(std::memory_order_relaxed);
+      if(seen >= std::max(1ull, rank))
+        {
+        double mid = 0.5 * (BucketLowerBound(k) + BucketLowerBound(k + 1));
+        return 0.001 * std::min(mid, (double) Max.load(std::memory_order_relaxed));
+        }
+      }
+    return 0.001 * Max.load(std::memory_order_relaxed);
+  }
+};
+
+/** All of the monitor state. Only the slow log and the context use the lock */
+struct MonitorState
+{
+  // Number of slow operations kept; older ones are dropped
+  enum { SLOW_LOG_CAPACITY = 256 };
+
+  LatencyHistogram Histograms[SNAPLatencyMonitor::NUMBER_OF_OPERATIONS];
+  std::atomic<double> Thresholds[SNAPLatencyMonitor::NUMBER_OF_OPERATIONS];
+
+  std::mutex Mutex;
+  std::deque<SNAPLatencyMonitor::SlowOperation> SlowLog;
+  std::string Context;
+  std::time_t SessionStart = std::time(nullptr);
+
+  MonitorState()
+  {
+    // Interactive operations are slow when they are noticed, the others
+    // when they take much longer than usual
+    const double defaults[] = { 100.0, 50.0, 10000.0, 10000.0, 2000.0, 1000.0, 1000.0 };
+    for(int i = 0; i < SNAPLatencyMonitor::NUMBER_OF_OPERATIONS; i++)
+      Thresholds[i] = defaults[i];
+  }
+};
+
+MonitorState &GetState()
+{
+  static MonitorState state;
+  return state;
+}
+
+std::string FormatTime(std::time_t t)
+{
+  char buffer[64];
+  std::tm *tm = std::localtime(&t);
+  if(!tm || !std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", tm))
+    return std::string();
+  return buffer;
+}
+
+}
+
+void SNAPLatencyMonitor::Record(Operation op, TimePoint start, TimePoint end)
+{
+  MonitorState &ms = GetState();
+  long long us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+  ms.Histograms[op].Add((unsigned long long) std::max(0ll, us));
+
+  double ms_dur = 0.001 * us;
+  if(ms_dur > ms.Thresholds[op].load(std::memory_order_relaxed))
+    {
+    std::lock_guard<std::mutex> guard(ms.Mutex);
+    SlowOperation slow = { op, ms_dur, std::time(nullptr), ms.Context };
+    ms.SlowLog.push_back(slow);
+    if(ms.SlowLog.size() > MonitorState::SLOW_LOG_CAPACITY)
+      ms.SlowLog.pop_front();
+    }
+}
+
+const char *SNAPLatencyMonitor::GetOperationName(Operation op)
+{
+  static const char *names[] = {
+    "SliceRedraw", "Paint", "ImageLoad", "ImageSave",
+    "MeshUpdate", "SnakeIteration", "Statistics" };
+  return op < NUMBER_OF_OPERATIONS ? names[op] : "Unknown";
+}
+
+void SNAPLatencyMonitor::SetSlowThreshold(Operation op, double ms)
+{
+  GetState().Thresholds[op] = ms;
+}
+
+double SNAPLatencyMonitor::GetSlowThreshold(Operation op)
+{
+  return GetState().Thresholds[op];
+}
+
+void SNAPLatencyMonitor::SetContext(const std::string &context)
+{
+  MonitorState &ms = GetState();
+  std::lock_guard<std::mutex> guard(ms.Mutex);
+  ms.Context = context;
+}
+
+std::string SNAPLatencyMonitor::GetContext()
+{
+  MonitorState &ms = GetState();
+  std::lock_guard<std::mutex> guard(ms.Mutex);
+  return ms.Context;
+}
+
+std::vector<SNAPLatencyMonitor::Summary> SNAPLatencyMonitor::GetSummaries()
+{
+  MonitorState &ms = GetState();
+  std::vector<Summary> result;
+  for(int i = 0; i < NUMBER_OF_OPERATIONS; i++)
+    {
+    const LatencyHistogram &h = ms.Histograms[i];
+    unsigned long long n = h.Count.load(std::memory_order_relaxed);
+    if(n == 0)
+      continue;
+
+    Summary s;
+    s.Op = (Operation) i;
+    s.Count = (unsigned long) n;
+    s.Mean = 0.001 * h.Sum.load(std::memory_order_relaxed) / n;
+    s.P50 = h.Percentile(0.50, n);
+    s.P90 = h.Percentile(0.90, n);
+    s.P99 = h.Percentile(0.99, n);
+    s.Max = 0.001 * h.Max.load(std::memory_order_relaxed);
+    result.push_back(s);
+    }
+  return result;
+}
+
+std::vector<SNAPLatencyMonitor::SlowOperation> SNAPLatencyMonitor::GetSlowOperations()
+{
+  MonitorState &ms = GetState();
+  std::lock_guard<std::mutex> guard(ms.Mutex);
+  return std::vector<SlowOperation>(ms.SlowLog.begin(), ms.SlowLog.end());
+}
+
+std::string SNAPLatencyMonitor::GetSummaryText()
+{
+  std::ostringstream oss;
+  oss << "Session started " << FormatTime(GetState().SessionStart) << std::endl;
+  oss << GetContext() << std::endl << std::endl;
+
+  std::vector<Summary> summaries = GetSummaries();
+  if(summaries.empty())
+    oss << "No operations recorded yet" << std::endl;
+
+  oss.setf(std::ios::fixed);
+  oss.precision(1);
+  for(const Summary &s : summaries)
+    {
+    oss << GetOperationName(s.Op) << ": " << s.Count << " times, median "
+        << s.P50 << " ms, 99% under " << s.P99 << " ms, max " << s.Max << " ms"
+        << std::endl;
+    }
+
+  std::vector<SlowOperation> slow = GetSlowOperations();
+  oss << std::endl << slow.size() << " slow operations" << std::endl;
+  for(size_t i = slow.size() > 10 ? slow.size() - 10 : 0; i < slow.size(); i++)
+    {
+    oss << "  " << FormatTime(slow[i].Time) << " " << GetOperationName(slow[i].Op)
+        << " " << slow[i].Duration << " ms" << std::endl;
+    }
+
+  return oss.str();
+}
+
+bool SNAPLatencyMonitor::WriteDiagnosticsBundle(const std::string &filename,
+                                                const std::string &build_info)
+{
+  MonitorState &ms = GetState();
+  Json::Value root;
+
+  root["build"] = build_info;
+
+  Json::Value &session = root["session"];
+  session["start"] = FormatTime(ms.SessionStart);
+  session["saved"] = FormatTime(std::time(nullptr));
+  session["hardware_threads"] = std::thread::hardware_concurrency();
+  session["context"] = GetContext();
+
+  // Histograms, with the non-empty buckets as [lower bound in ms, count]
+  Json::Value &ops = root["operations"];
+  ops = Json::Value(Json::arrayValue);
+  for(const Summary &s : GetSummaries())
+    {
+    Json::Value op;
+    op["name"] = GetOperationName(s.Op);
+    op["count"] = (Json::UInt64) s.Count;
+    op["mean"] = s.Mean;
+    op["p50"] = s.P50;
+    op["p90"] = s.P90;
+    op["p99"] = s.P99;
+    op["max"] = s.Max;
+    op["slow_threshold"] = GetSlowThreshold(s.Op);
+
+    Json::Value &buckets = op["histogram"];
+    buckets = Json::Value(Json::arrayValue);
+    const LatencyHistogram &h = ms.Histograms[s.Op];
+    for(int k = 0; k < LatencyHistogram::NUMBER_OF_BUCKETS; k++)
+      {
+      unsigned int n = h.Buckets[k].load(std::memory_order_relaxed);
+      if(n)
+        {
+        Json::Value bucket(Json::arrayValue);
+        bucket.append(0.001 * LatencyHistogram::BucketLowerBound(k));
+        bucket.append(n);
+        buckets.append(bucket);
+        }
+      }
+    ops.append(op);
+    }
+
+  Json::Value &slow = root["slow_operations"];
+  slow = Json::Value(Json::arrayValue);
+  for(const SlowOperation &so : GetSlowOperations())
+    {
+    Json::Value entry;
+    entry["name"] = GetOperationName(so.Op);
+    entry["duration"] = so.Duration;
+    entry["time"] = FormatTime(so.Time);
+    entry["context"] = so.Context;
+    slow.append(entry);
+    }
+
+  // The pipeline stages, if the profiler has been recording
+  Json::Value &stages = root["profiler"];
+  stages = Json::Value(Json::arrayValue);
+  for(const SNAPProfiler::Statistics &st : SNAPProfiler::GetTimingStatistics())
+    {
+    Json::Value stage;
+    stage["name"] = st.Name;
+    stage["count"] = (Json::UInt64) st.Count;
+    stage["mean"] = st.Mean;
+    stage["max"] = st.Max;
+    stages.append(stage);
+    }
+
+  std::ofstream os(filename.c_str());
+  if(!os.good())
+    return false;
+
+  Json::StyledStreamWriter writer;
+  writer.write(os, root);
+  return os.good();
+}
+
+void SNAPLatencyMonitor::Reset()
+{
+  MonitorState &ms = GetState();
+  for(auto &h : ms.Histograms)
+    h.Reset();
+
+  std::lock_guard<std::mutex> guard(ms.Mutex);
+  ms.SlowLog.clear();
+}
@@ -0,0 +1,124 @@
+#ifndef SNAPLATENCYMONITOR_H
+#define SNAPLATENCYMONITOR_H
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+
+/**
+ * \class SNAPLatencyMonitor
+ * \brief Always-on record of how long the user-visible operations take.
+ *
+ * Unlike SNAPProfiler, which traces the stages of the rendering pipeline
+ * when asked to, the monitor is never turned off, so that a session that
+ * "got slow" can be diagnosed after the fact. Each kind of operation has a
+ * histogram with logarithmic buckets (16 per power of two, so a percentile
+ * is within about 6% of the true value) that is updated with a few relaxed
+ * atomic additions and no lock. Operations that take longer than the slow
+ * threshold of their kind are also kept in a short log, along with the
+ * session context (image sizes, layers, threads) at that time.
+ *
+ * The histograms, the slow operation log and the profiler statistics can be
+ * saved together as a diagnostics bundle, from the About dialog.
+ */
+class SNAPLatencyMonitor
+{
+public:
+  typedef std::chrono::steady_clock ClockType;
+  typedef ClockType::time_point TimePoint;
+
+  /** The kinds of operations that are monitored */
+  enum Operation
+  {
+    SLICE_REDRAW = 0,
+    PAINT,
+    IMAGE_LOAD,
+    IMAGE_SAVE,
+    MESH_UPDATE,
+    SNAKE_ITERATION,
+    STATISTICS,
+    NUMBER_OF_OPERATIONS
+  };
+
+  /** Statistics of one kind of operation, in milliseconds */
+  struct Summary
+  {
+    Operation Op;
+    unsigned long Count;
+    double Mean, P50, P90, P99, Max;
+  };
+
+  /** An operation that took longer than the threshold */
+  struct SlowOperation
+  {
+    Operation Op;
+    double Duration;
+    std::time_t Time;
+    std::string Context;
+  };
+
+  /** Record the duration of an operation. This is safe to call from any thread */
+  static void Record(Operation op, TimePoint start, TimePoint end);
+
+  /** Name of an operation, as it appears in the report */
+  static const char *GetOperationName(Operation op);
+
+  /** Duration (ms) above which an operation goes to the slow operation log */
+  static void SetSlowThreshold(Operation op, double ms);
+  static double GetSlowThreshold(Operation op);
+
+  /**
+   * Set a description of the session (image sizes, layers, threads) that
+   * is stored with the slow operations. It is copied, so it is safe to set
+   * from the GUI thread while operations are recorded in others.
+   */
+  static void SetContext(const std::string &context);
+  static std::string GetContext();
+
+  /** Get the statistics of the operations that were recorded at least once */
+  static std::vector<Summary> GetSummaries();
+
+  /** Get the slow operation log, oldest first */
+  static std::vector<SlowOperation> GetSlowOperations();
+
+  /** A short plain-text summary, for display */
+  static std::string GetSummaryText();
+
+  /**
+   * Write the histograms, the slow operation log and the profiler statistics
+   * as JSON, along with information about the build
+   */
+  static bool WriteDiagnosticsBundle(const std::string &filename,
+                                     const std::string &build_info);
+
+  /** Discard all recorded operations */
+  static void Reset();
+};
+
+/**
+ * A helper that records the duration of the enclosing scope. Use
+ * SNAP_LATENCY_SCOPE(SNAPLatencyMonitor::PAINT).
+ */
+class SNAPLatencyScope
+{
+public:
+  explicit SNAPLatencyScope(SNAPLatencyMonitor::Operation op)
+    : m_Op(op), m_Start(SNAPLatencyMonitor::ClockType::now()) {}
+
+  ~SNAPLatencyScope()
+  {
+    SNAPLatencyMonitor::Record(m_Op, m_Start, SNAPLatencyMonitor::ClockType::now());
+  }
+
+private:
+  SNAPLatencyMonitor::Operation m_Op;
+  SNAPLatencyMonitor::TimePoint m_Start;
+};
+
+#define SNAP_LATENCY_SCOPE_CAT_(a, b) a ## b
+#define SNAP_LATENCY_SCOPE_CAT(a, b) SNAP_LATENCY_SCOPE_CAT_(a, b)
+#define SNAP_LATENCY_SCOPE(op) \
+  SNAPLatencyScope SNAP_LATENCY_SCOPE_CAT(snap_latency_scope_, __LINE__)(op)
+
+#endif // SNAPLATENCYMONITOR_H
@@ -0,0 +1,213 @@
+#include "SNAPProfiler.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+
+std::atomic<int> SNAPProfiler::m_Requests(0);
+
+namespace
+{
+
+/** A timing or counter sample kept in the trace buffer */
+struct TraceEvent
+{
+  const char *Name;
+  SNAPProfiler::TimePoint Start;
+  double Duration;   // seconds for timings, the value for counters
+  unsigned int Thread;
+  bool IsCounter;
+};
+
+/** All of the profiler state, guarded by one mutex */
+struct ProfilerState
+{
+  // Maximum number of events kept for the trace; older events are dropped
+  enum { TRACE_CAPACITY = 1 << 16 };
+
+  // Weight of the newest sample in the running mean
+  static constexpr double MEAN_WEIGHT = 0.1;
+
+  std::mutex Mutex;
+  std::vector<TraceEvent> Trace;
+  size_t TraceNext = 0;
+  SNAPProfiler::TimePoint Origin = SNAPProfiler::ClockType::now();
+
+  std::map<std::string, SNAPProfiler::Statistics> Timings, Counters;
+  std::map<std::thread::id, unsigned int> Threads;
+
+  void Push(const TraceEvent &evt)
+  {
+    if(Trace.size() < TRACE_CAPACITY)
+      Trace.push_back(evt);
+    else
+      Trace[TraceNext] = evt;
+    TraceNext = (TraceNext + 1) % TRACE_CAPACITY;
+  }
+
+  unsigned int ThreadIndex()
+  {
+    auto it = Threads.find(std::this_thread::get_id());
+    if(it != Threads.end())
+      return it->second;
+    unsigned int index = (unsigned int) Threads.size();
+    Threads[std::this_thread::get_id()] = index;
+    return index;
+  }
+
+  static void Accumulate(std::map<std::string, SNAPProfiler::Statistics> &stats,
+                         const char *name, double value)
+  {
+    auto it = stats.find(name);
+    if(it == stats.end())
+      {
+      SNAPProfiler::Statistics s = { name, 1, value, value, value };
+      stats.insert(std::make_pair(std::string(name), s));
+      }
+    else
+      {
+      SNAPProfiler::Statistics &s = it->second;
+      s.Count++;
+      s.Last = value;
+      s.Mean += MEAN_WEIGHT * (value - s.Mean);
+      s.Max = std::max(s.Max, value);
+      }
+  }
+};
+
+ProfilerState &GetState()
+{
+  static ProfilerState state;
+  return state;
+}
+
+void WriteJSONString(std::ostream &os, const char *str)
+{
+  os << '"';
+  for(const char *p = str; *p; ++p)
+    {
+    if(*p == '"' || *p == '\\')
+      os << '\\';
+    os << *p;
+    }
+  os << '"';
+}
+
+}
+
+void SNAPProfiler::SetEnabled(Requester who, bool on)
+{
+  if(on)
+    m_Requests.fetch_or(who);
+  else
+    m_Requests.fetch_and(~who);
+}
+
+void SNAPProfiler::RecordTiming(const char *name, TimePoint start, TimePoint end)
+{
+  ProfilerState &ps = GetState();
+  double sec = std::chrono::duration<double>(end - start).count();
+
+  std::lock_guard<std::mutex> guard(ps.Mutex);
+  TraceEvent evt = { name, start, sec, ps.ThreadIndex(), false };
+  ps.Push(evt);
+  ProfilerState::Accumulate(ps.Timings, name, 1000.0 * sec);
+}
+
+void SNAPProfiler::RecordCounter(const char *name, double value)
+{
+  ProfilerState &ps = GetState();
+
+  std::lock_guard<std::mutex> guard(ps.Mutex);
+  TraceEvent evt = { name, ClockType::now(), value, ps.ThreadIndex(), true };
+  ps.Push(evt);
+  ProfilerState::Accumulate(ps.Counters, name, value);
+}
+
+std::vector<SNAPProfiler::Statistics> SNAPProfiler::GetTimingStatistics()
+{
+  ProfilerState &ps = GetState();
+  std::lock_guard<std::mutex> guard(ps.Mutex);
+  std::vector<Statistics> result;
+  for(auto &it : ps.Timings)
+    result.push_back(it.second);
+  return result;
+}
+
+std::vector<SNAPProfiler::Statistics> SNAPProfiler::GetCounterStatistics()
+{
+  ProfilerState &ps = GetState();
+  std::lock_guard<std::mutex> guard(ps.Mutex);
+  std::vector<Statistics> result;
+  for(auto &it : ps.Counters)
+    result.push_back(it.second);
+  return result;
+}
+
+std::vector<double> SNAPProfiler::GetTimings(const std::string &name, TimePoint since)
+{
+  ProfilerState &ps = GetState();
+  std::lock_guard<std::mutex> guard(ps.Mutex);
+
+  size_t n = ps.Trace.size();
+  size_t first = (n < ProfilerState::TRACE_CAPACITY) ? 0 : ps.TraceNext;
+
+  std::vector<double> result;
+  for(size_t k = 0; k < n; k++)
+    {
+    const TraceEvent &evt = ps.Trace[(first + k) % n];
+    if(!evt.IsCounter && evt.Start >= since && name == evt.Name)
+      result.push_back(1000.0 * evt.Duration);
+    }
+  return result;
+}
+
+bool SNAPProfiler::WriteChromeTrace(const std::string &filename)
+{
+  std::ofstream os(filename.c_str());
+  if(!os.good())
+    return false;
+
+  ProfilerState &ps = GetState();
+  std::lock_guard<std::mutex> guard(ps.Mutex);
+
+  // Once the buffer has wrapped around, the oldest event is at TraceNext
+  size_t n = ps.Trace.size();
+  size_t first = (n < ProfilerState::TRACE_CAPACITY) ? 0 : ps.TraceNext;
+
+  // Timestamps are in microseconds since the profiler was created
+  os << "{\"traceEvents\":[" << std::endl;
+  for(size_t k = 0; k < n; k++)
+    {
+    const TraceEvent &evt = ps.Trace[(first + k) % n];
+    double ts = std::chrono::duration<double, std::micro>(evt.Start - ps.Origin).count();
+    os << "{\"name\":";
+    WriteJSONString(os, evt.Name);
+    if(evt.IsCounter)
+      {
+      os << ",\"ph\":\"C\",\"ts\":" << ts << ",\"pid\":1,\"tid\":" << evt.Thread
+         << ",\"args\":{\"value\":" << evt.Duration << "}}";
+      }
+    else
+      {
+      os << ",\"cat\":\"snap\",\"ph\":\"X\",\"ts\":" << ts
+         << ",\"dur\":" << 1.0e6 * evt.Duration
+         << ",\"pid\":1,\"tid\":" << evt.Thread << "}";
+      }
+    os << (k + 1 < n ? "," : "") << std::endl;
+    }
+  os << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+
+  return os.good();
+}
+
+void SNAPProfiler::Reset()
+{
+  ProfilerState &ps = GetState();
+  std::lock_guard<std::mutex> guard(ps.Mutex);
+  ps.Trace.clear();
+  ps.TraceNext = 0;
+  ps.Timings.clear();
+  ps.Counters.clear();
+}
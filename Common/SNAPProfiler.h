@@ -0,0 +1,112 @@
+#ifndef SNAPPROFILER_H
+#define SNAPPROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/**
+ * \class SNAPProfiler
+ * \brief Records timings and counters of the rendering pipeline stages.
+ *
+ * Stages are timed with the SNAP_PROFILE_SCOPE macro, or with explicit calls
+ * to RecordTiming() when the start and end of a stage are reported by
+ * different callbacks. Each timing is kept in a fixed-size ring buffer that
+ * can be exported as a Chrome trace (chrome://tracing or Perfetto), and is
+ * also folded into running per-stage statistics shown in the slice view
+ * overlay.
+ *
+ * Recording is off unless it is requested from the command line (--profile)
+ * or from the preferences dialog. When it is off, a scope costs one relaxed
+ * atomic load. When it is on, it costs two clock reads and a short critical
+ * section, so stages should be coarse (a slice update, a frame), never
+ * per-voxel.
+ */
+class SNAPProfiler
+{
+public:
+  typedef std::chrono::steady_clock ClockType;
+  typedef ClockType::time_point TimePoint;
+
+  /** Parties that can request recording. Recording is on if any of them does */
+  enum Requester { COMMAND_LINE = 1, PREFERENCES = 2 };
+
+  /** Statistics for a single stage or counter */
+  struct Statistics
+  {
+    std::string Name;
+    unsigned long Count;
+    double Last, Mean, Max;
+  };
+
+  /** Check if recording is on. This is safe to call from any thread */
+  static bool IsEnabled()
+    { return m_Requests.load(std::memory_order_relaxed) != 0; }
+
+  /** Turn recording on or off on behalf of one of the requesters */
+  static void SetEnabled(Requester who, bool on);
+
+  /** Check if recording was requested by a given party */
+  static bool IsRequestedBy(Requester who)
+    { return (m_Requests.load(std::memory_order_relaxed) & who) != 0; }
+
+  /** Record the duration of a stage. The name must be a string literal */
+  static void RecordTiming(const char *name, TimePoint start, TimePoint end);
+
+  /** Record the value of a counter. The name must be a string literal */
+  static void RecordCounter(const char *name, double value);
+
+  /** Get the statistics of all stages (milliseconds), sorted by name */
+  static std::vector<Statistics> GetTimingStatistics();
+
+  /** Get the statistics of all counters, sorted by name */
+  static std::vector<Statistics> GetCounterStatistics();
+
+  /**
+   * Get the durations (milliseconds) of the recorded timings of a stage that
+   * started at or after a given time, oldest first. Only the events still in
+   * the trace buffer are returned.
+   */
+  static std::vector<double> GetTimings(const std::string &name, TimePoint since);
+
+  /** Write the recorded events in the Chrome trace event JSON format */
+  static bool WriteChromeTrace(const std::string &filename);
+
+  /** Discard all recorded events and statistics */
+  static void Reset();
+
+private:
+  static std::atomic<int> m_Requests;
+};
+
+/**
+ * A helper that times the enclosing scope. Use SNAP_PROFILE_SCOPE("Name").
+ */
+class SNAPProfilerScope
+{
+public:
+  explicit SNAPProfilerScope(const char *name)
+    : m_Name(SNAPProfiler::IsEnabled() ? name : nullptr)
+  {
+    if(m_Name)
+      m_Start = SNAPProfiler::ClockType::now();
+  }
+
+  ~SNAPProfilerScope()
+  {
+    if(m_Name)
+      SNAPProfiler::RecordTiming(m_Name, m_Start, SNAPProfiler::ClockType::now());
+  }
+
+private:
+  const char *m_Name;
+  SNAPProfiler::TimePoint m_Start;
+};
+
+#define SNAP_PROFILE_SCOPE_CAT_(a, b) a ## b
+#define SNAP_PROFILE_SCOPE_CAT(a, b) SNAP_PROFILE_SCOPE_CAT_(a, b)
+#define SNAP_PROFILE_SCOPE(name) \
+  SNAPProfilerScope SNAP_PROFILE_SCOPE_CAT(snap_profiler_scope_, __LINE__)(name)
+
+#endif // SNAPPROFILER_H
@@ -58,6 +58,7 @@
 #include <itksys/Directory.hxx>
 #include <itksys/SystemTools.hxx>
 #include "itkVoxBoCUBImageIOFactory.h"
+#include "itkZarrImageIOFactory.h"
 #include <algorithm>
 #include <ctime>
 #include <cerrno>
@@ -170,6 +171,8 @@ SystemInterface
   // Register the Image IO factories that are not part of ITK
   itk::ObjectFactoryBase::RegisterFactory( 
     itk::VoxBoCUBImageIOFactory::New() );
+  itk::ObjectFactoryBase::RegisterFactory(
+    itk::ZarrImageIOFactory::New() );
 
   // Make sure we have a preferences directory
   std::string appdir = GetApplicationDataDirectory();
@@ -639,6 +642,38 @@ SystemInterface
   return thumbdir + "/" + code + ".png";
 }
 
+std::string
+SystemInterface
+::GetRecoveryJournalAssociatedWithFile(const char *file)
+{
+  // The journal is named by the unique code of the file, like the thumbnail
+  string code = this->FindUniqueCodeForFile(file, true);
+
+  string appdir = this->GetApplicationDataDirectory();
+  string journaldir = appdir + "/Recovery";
+  if(!SystemTools::MakeDirectory(journaldir.c_str()))
+    throw IRISException("Unable to create recovery directory %s",
+                        journaldir.c_str());
+
+  return journaldir + "/" + code + ".journal";
+}
+
+std::string
+SystemInterface
+::GetDicomHeaderCacheDirectory()
+{
+  // The directory is created when the cache is first written
+  return this->GetApplicationDataDirectory() + "/DicomHeaderCache";
+}
+
+std::string
+SystemInterface
+::GetDerivedDataCacheDirectory()
+{
+  // The directory is created when the cache is first written
+  return this->GetApplicationDataDirectory() + "/DerivedDataCache";
+}
+
 void SystemInterface
 ::WriteThumbnail(
     const char *associated_file, ThumbnailImageType *thumbnail)
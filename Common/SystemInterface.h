@@ -120,6 +120,15 @@ public:
   /** Get the thumbnail filename associated with an image file */
   std::string GetThumbnailAssociatedWithFile(const char *file);
 
+  /** Get the crash recovery journal filename associated with an image file */
+  std::string GetRecoveryJournalAssociatedWithFile(const char *file);
+
+  /** Get the directory where parsed DICOM headers are cached */
+  std::string GetDicomHeaderCacheDirectory();
+
+  /** Get the directory where statistics computed from image files are cached */
+  std::string GetDerivedDataCacheDirectory();
+
   /** Write a thumbnail */
   void WriteThumbnail(const char *associated_file, ThumbnailImageType *thumbnail);
 
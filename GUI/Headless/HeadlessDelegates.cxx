@@ -0,0 +1,57 @@
+#include "HeadlessDelegates.h"
+#include "itkImage.h"
+#include "itkRGBAPixel.h"
+#include "itkImageFileWriter.h"
+#include "itksys/SystemTools.hxx"
+
+void HeadlessViewportReporter::SetViewportSize(const Vector2ui &size)
+{
+  if(m_Size != size)
+    {
+    m_Size = size;
+    this->InvokeEvent(ViewportResizeEvent());
+    }
+}
+
+HeadlessSystemInfoDelegate::HeadlessSystemInfoDelegate(const char *argv0)
+{
+  m_ExecutableName = itksys::SystemTools::CollapseFullPath(argv0);
+}
+
+std::string HeadlessSystemInfoDelegate::GetApplicationDirectory()
+{
+  return itksys::SystemTools::GetFilenamePath(m_ExecutableName);
+}
+
+std::string HeadlessSystemInfoDelegate::GetApplicationFile()
+{
+  return m_ExecutableName;
+}
+
+std::string HeadlessSystemInfoDelegate::GetApplicationPermanentDataLocation()
+{
+  std::string home;
+  if(!itksys::SystemTools::GetEnv("HOME", home)
+     && !itksys::SystemTools::GetEnv("USERPROFILE", home))
+    home = ".";
+  return home + "/.itksnap.headless";
+}
+
+std::string HeadlessSystemInfoDelegate::GetUserDocumentsLocation()
+{
+  return itksys::SystemTools::GetCurrentWorkingDirectory();
+}
+
+std::string HeadlessSystemInfoDelegate::EncodeServerURL(const std::string &url)
+{
+  return url;
+}
+
+void HeadlessSystemInfoDelegate::WriteRGBAImage2D(std::string file, RGBAImageType *image)
+{
+  typedef itk::ImageFileWriter<RGBAImageType> WriterType;
+  SmartPtr<WriterType> writer = WriterType::New();
+  writer->SetInput(image);
+  writer->SetFileName(file);
+  writer->Update();
+}
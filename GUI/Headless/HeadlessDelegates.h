@@ -0,0 +1,78 @@
+#ifndef HEADLESSDELEGATES_H
+#define HEADLESSDELEGATES_H
+
+#include "UIReporterDelegates.h"
+#include "AbstractRenderer.h"
+
+/**
+ * A viewport of fixed size, for rendering into offscreen windows without a
+ * widget. The size reported to the models is set by the headless session.
+ */
+class HeadlessViewportReporter : public ViewportSizeReporter
+{
+public:
+
+  irisITKObjectMacro(HeadlessViewportReporter, ViewportSizeReporter)
+
+  /** Set the size of the viewport, firing a resize event if it changes */
+  void SetViewportSize(const Vector2ui &size);
+
+  bool CanReportSize() ITK_OVERRIDE { return true; }
+
+  Vector2ui GetViewportSize() ITK_OVERRIDE { return m_Size; }
+
+  float GetViewportPixelRatio() ITK_OVERRIDE { return 1.0f; }
+
+  Vector2ui GetLogicalViewportSize() ITK_OVERRIDE { return m_Size; }
+
+protected:
+
+  HeadlessViewportReporter() : m_Size(512, 512) {}
+  virtual ~HeadlessViewportReporter() {}
+
+  Vector2ui m_Size;
+};
+
+/**
+ * System info delegate for running the UI models without Qt. Settings are
+ * kept in the .itksnap.headless directory under the user's home directory.
+ * Resources that are compiled into the Qt application (icons, presets) are
+ * not available.
+ */
+class HeadlessSystemInfoDelegate : public SystemInfoDelegate
+{
+public:
+
+  HeadlessSystemInfoDelegate(const char *argv0);
+
+  virtual std::string GetApplicationDirectory() ITK_OVERRIDE;
+  virtual std::string GetApplicationFile() ITK_OVERRIDE;
+  virtual std::string GetApplicationPermanentDataLocation() ITK_OVERRIDE;
+  virtual std::string GetUserDocumentsLocation() ITK_OVERRIDE;
+  virtual std::string EncodeServerURL(const std::string &url) ITK_OVERRIDE;
+
+  virtual void LoadResourceAsImage2D(std::string tag, GrayscaleImage *image) ITK_OVERRIDE {}
+  virtual void LoadResourceAsRegistry(std::string tag, Registry &reg) ITK_OVERRIDE {}
+  virtual void WriteRGBAImage2D(std::string file, RGBAImageType *image) ITK_OVERRIDE;
+
+protected:
+  std::string m_ExecutableName;
+};
+
+/**
+ * Renderer platform support without a font engine. Text overlays are not
+ * drawn in headless renders.
+ */
+class HeadlessRendererPlatformSupport : public AbstractRendererPlatformSupport
+{
+public:
+
+  virtual void RenderTextIntoVTKImage(
+      const char *text, vtkImageData *target,
+      FontInfo font, int align_horiz, int align_vert,
+      const Vector3d &rgbf, double alpha = 1.0) ITK_OVERRIDE {}
+
+  virtual int MeasureTextWidth(const char *text, FontInfo font) ITK_OVERRIDE { return 0; }
+};
+
+#endif // HEADLESSDELEGATES_H
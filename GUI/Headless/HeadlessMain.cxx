@@ -0,0 +1,83 @@
+#include "HeadlessSession.h"
+#include "HeadlessDelegates.h"
+#include "SystemInterface.h"
+#include "AbstractRenderer.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+/**
+ * Renders ITK-SNAP views without the Qt GUI. The commands (see
+ * HeadlessSession) are read from the files given on the command line in
+ * order, or from the standard input if no files are given.
+ */
+int usage()
+{
+  std::cout << "itksnap-headless: render ITK-SNAP views without a display" << std::endl;
+  std::cout << "Usage: " << std::endl;
+  std::cout << "  itksnap-headless [script_file ...]" << std::endl;
+  std::cout << "Commands are read from the script files, or from standard input if none are" << std::endl;
+  std::cout << "given. Each line holds one of the following commands:" << std::endl;
+  std::cout << "  size W H                           size of the rendered views in pixels" << std::endl;
+  std::cout << "  workspace FILE                     open a workspace" << std::endl;
+  std::cout << "  open main|overlay|segmentation FILE" << std::endl;
+  std::cout << "  labels FILE                        load label descriptions" << std::endl;
+  std::cout << "  cursor X Y Z                       cursor position, in voxels from zero" << std::endl;
+  std::cout << "  timepoint T                        time point, from zero" << std::endl;
+  std::cout << "  contrast MIN MAX | contrast auto   contrast of the main image" << std::endl;
+  std::cout << "  zoom FACTOR                        zoom of all slice views" << std::endl;
+  std::cout << "  mesh                               update the 3D segmentation meshes" << std::endl;
+  std::cout << "  screenshot 0|1|2|3d FILE           render a view into a PNG file" << std::endl;
+  std::cout << "  slices axial|sagittal|coronal FIRST LAST PATTERN [all]" << std::endl;
+  std::cout << "                                     export slices FIRST to LAST (from zero) of" << std::endl;
+  std::cout << "                                     the main image, at all time points if 'all'" << std::endl;
+  std::cout << "                                     is given, into files named by a pattern" << std::endl;
+  std::cout << "                                     such as slice_%04d.png, or slice_%04d_%02d.png" << std::endl;
+  std::cout << "                                     for all time points" << std::endl;
+  std::cout << "  quit" << std::endl;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  for(int i = 1; i < argc; i++)
+    if(!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+      return usage();
+
+  // Platform-specific functionality needed by the models and renderers
+  HeadlessSystemInfoDelegate siDelegate(argv[0]);
+  SystemInterface::SetSystemInfoDelegate(&siDelegate);
+
+  HeadlessRendererPlatformSupport platform;
+  AbstractRenderer::SetPlatformSupport(&platform);
+
+  int n_failed = 0;
+  try
+    {
+    HeadlessSession session;
+    if(argc < 2)
+      {
+      n_failed = session.Run(std::cin, std::cerr);
+      }
+    else
+      {
+      for(int i = 1; i < argc; i++)
+        {
+        std::ifstream script(argv[i]);
+        if(!script.good())
+          {
+          std::cerr << "Unable to read script " << argv[i] << std::endl;
+          return -1;
+          }
+        n_failed += session.Run(script, std::cerr);
+        }
+      }
+    }
+  catch(std::exception &exc)
+    {
+    std::cerr << "Error: " << exc.what() << std::endl;
+    return -1;
+    }
+
+  return n_failed ? 1 : 0;
+}
@@ -0,0 +1,343 @@
+#include "HeadlessSession.h"
+#include "HeadlessDelegates.h"
+#include "GlobalUIModel.h"
+#include "GenericSliceModel.h"
+#include "Generic3DModel.h"
+#include "SliceWindowCoordinator.h"
+#include "GenericSliceRenderer.h"
+#include "Generic3DRenderer.h"
+#include "IRISApplication.h"
+#include "IRISException.h"
+#include "GenericImageData.h"
+#include "DisplayMappingPolicy.h"
+#include "IntensityCurveInterface.h"
+#include <vtkRenderWindow.h>
+#include <vtkGenericRenderWindowInteractor.h>
+#include <sstream>
+#include <cctype>
+
+namespace
+{
+
+// Parse a numeric argument of a command
+double ParseNumber(const std::string &arg)
+{
+  std::istringstream iss(arg);
+  double value;
+  if(!(iss >> value) || !iss.eof())
+    throw IRISException("'%s' is not a number", arg.c_str());
+  return value;
+}
+
+// Check the number of arguments of a command
+void CheckArgs(const std::vector<std::string> &args, size_t n, const char *usage)
+{
+  if(args.size() != n)
+    throw IRISException("Usage: %s", usage);
+}
+
+// Create an offscreen render window that a renderer can be attached to
+vtkSmartPointer<vtkRenderWindow> CreateOffscreenWindow()
+{
+  vtkSmartPointer<vtkRenderWindow> rwin = vtkSmartPointer<vtkRenderWindow>::New();
+  rwin->SetOffScreenRendering(1);
+
+  // The renderers expect an interactor, even though there are no events
+  vtkSmartPointer<vtkGenericRenderWindowInteractor> interactor =
+      vtkSmartPointer<vtkGenericRenderWindowInteractor>::New();
+  interactor->SetRenderWindow(rwin);
+  return rwin;
+}
+
+}
+
+HeadlessSession::HeadlessSession()
+{
+  m_Model = GlobalUIModel::New();
+  m_Model->LoadUserPreferences();
+
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    m_Reporter[i] = HeadlessViewportReporter::New();
+    m_Model->GetSliceModel(i)->SetSizeReporter(m_Reporter[i]);
+
+    m_SliceRenderer[i] = GenericSliceRenderer::New();
+    m_SliceRenderer[i]->SetModel(m_Model->GetSliceModel(i));
+
+    m_Window[i] = CreateOffscreenWindow();
+    m_SliceRenderer[i]->SetRenderWindow(m_Window[i]);
+    }
+
+  m_Window[3] = CreateOffscreenWindow();
+  m_Model->GetModel3D()->GetRenderer()->SetRenderWindow(m_Window[3]);
+
+  this->SetViewportSize(512, 512);
+}
+
+HeadlessSession::~HeadlessSession()
+{
+}
+
+std::vector<std::string> HeadlessSession::Tokenize(const std::string &line)
+{
+  std::vector<std::string> args;
+  std::string current;
+  bool quoted = false, in_arg = false;
+  for(char c : line)
+    {
+    if(c == '"')
+      {
+      quoted = !quoted;
+      in_arg = true;
+      }
+    else if(!quoted && isspace((unsigned char) c))
+      {
+      if(in_arg)
+        args.push_back(current);
+      current.clear();
+      in_arg = false;
+      }
+    else
+      {
+      current.push_back(c);
+      in_arg = true;
+      }
+    }
+
+  if(quoted)
+    throw IRISException("Unterminated quote in '%s'", line.c_str());
+  if(in_arg)
+    args.push_back(current);
+  return args;
+}
+
+int HeadlessSession::Run(std::istream &commands, std::ostream &log)
+{
+  int n_failed = 0, line_no = 0;
+  std::string line;
+  while(std::getline(commands, line))
+    {
+    ++line_no;
+    try
+      {
+      std::vector<std::string> args = Tokenize(line);
+      if(args.empty() || args[0][0] == '#')
+        continue;
+
+      if(!this->Execute(args))
+        break;
+      }
+    catch(std::exception &exc)
+      {
+      log << "Error on line " << line_no << " (" << line << "): " << exc.what() << std::endl;
+      ++n_failed;
+      }
+    }
+
+  return n_failed;
+}
+
+bool HeadlessSession::Execute(const std::vector<std::string> &args)
+{
+  IRISApplication *driver = m_Model->GetDriver();
+  const std::string &cmd = args[0];
+  IRISWarningList warnings;
+
+  if(cmd == "quit")
+    {
+    return false;
+    }
+  else if(cmd == "size")
+    {
+    CheckArgs(args, 3, "size W H");
+    this->SetViewportSize((unsigned int) ParseNumber(args[1]),
+                          (unsigned int) ParseNumber(args[2]));
+    }
+  else if(cmd == "workspace")
+    {
+    CheckArgs(args, 2, "workspace FILE");
+    driver->OpenProject(args[1], warnings);
+    }
+  else if(cmd == "open")
+    {
+    CheckArgs(args, 3, "open main|overlay|segmentation FILE");
+    LayerRole role;
+    if(args[1] == "main")
+      role = MAIN_ROLE;
+    else if(args[1] == "overlay")
+      role = OVERLAY_ROLE;
+    else if(args[1] == "segmentation")
+      role = LABEL_ROLE;
+    else
+      throw IRISException("Unknown layer role '%s'", args[1].c_str());
+
+    if(role != MAIN_ROLE && !driver->IsMainImageLoaded())
+      throw IRISException("The main image must be opened first");
+
+    driver->OpenImage(args[2].c_str(), role, warnings);
+    }
+  else if(cmd == "labels")
+    {
+    CheckArgs(args, 2, "labels FILE");
+    driver->LoadLabelDescriptions(args[1].c_str());
+    }
+  else if(cmd == "cursor")
+    {
+    CheckArgs(args, 4, "cursor X Y Z");
+    if(!driver->IsMainImageLoaded())
+      throw IRISException("No image is loaded");
+
+    Vector3ui size = driver->GetCurrentImageData()->GetVolumeExtents();
+    Vector3ui cursor;
+    for(int d = 0; d < 3; d++)
+      {
+      double x = ParseNumber(args[d + 1]);
+      if(x < 0 || x >= size[d])
+        throw IRISException("Cursor position outside of the image");
+      cursor[d] = (unsigned int) x;
+      }
+    driver->SetCursorPosition(cursor);
+    }
+  else if(cmd == "timepoint")
+    {
+    CheckArgs(args, 2, "timepoint T");
+    double t = ParseNumber(args[1]);
+    if(t < 0 || t >= driver->GetNumberOfTimePoints())
+      throw IRISException("Time point out of range");
+    driver->SetCursorTimePoint((unsigned int) t);
+    }
+  else if(cmd == "contrast")
+    {
+    if(!driver->IsMainImageLoaded())
+      throw IRISException("No image is loaded");
+
+    auto *dmp = dynamic_cast<AbstractContinuousImageDisplayMappingPolicy *>(
+          driver->GetCurrentImageData()->GetMain()->GetDisplayMapping());
+    if(!dmp)
+      throw IRISException("The contrast of the main image cannot be adjusted");
+
+    if(args.size() == 2 && args[1] == "auto")
+      {
+      dmp->AutoFitContrast();
+      }
+    else
+      {
+      CheckArgs(args, 3, "contrast MIN MAX | contrast auto");
+      double cmin = ParseNumber(args[1]), cmax = ParseNumber(args[2]);
+      if(cmin >= cmax)
+        throw IRISException("The contrast minimum must be below the maximum");
+
+      // Map the range into curve units
+      Vector2d irange = dmp->GetNativeImageRangeForCurve();
+      dmp->GetIntensityCurve()->ScaleControlPointsToWindow(
+            (cmin - irange[0]) / (irange[1] - irange[0]),
+            (cmax - irange[0]) / (irange[1] - irange[0]));
+      }
+    }
+  else if(cmd == "zoom")
+    {
+    CheckArgs(args, 2, "zoom FACTOR");
+    double zoom = ParseNumber(args[1]);
+    if(zoom <= 0)
+      throw IRISException("The zoom factor must be positive");
+
+    this->UpdateModels();
+    m_Model->GetSliceCoordinator()->SetLinkedZoom(true);
+    m_Model->GetSliceCoordinator()->SetZoomLevelAllWindows(zoom);
+    }
+  else if(cmd == "mesh")
+    {
+    CheckArgs(args, 1, "mesh");
+    this->UpdateModels();
+    m_Model->GetModel3D()->UpdateSegmentationMesh(nullptr);
+    }
+  else if(cmd == "screenshot")
+    {
+    CheckArgs(args, 3, "screenshot 0|1|2|3d FILE");
+    this->SaveScreenshot(args[1], args[2]);
+    }
+  else if(cmd == "slices")
+    {
+    bool all = args.size() == 6 && args[5] == "all";
+    if(!all)
+      CheckArgs(args, 5, "slices axial|sagittal|coronal FIRST LAST PATTERN [all]");
+
+    if(!driver->IsMainImageLoaded())
+      throw IRISException("No image is loaded");
+
+    AnatomicalDirection dir;
+    if(args[1] == "axial")
+      dir = ANATOMY_AXIAL;
+    else if(args[1] == "sagittal")
+      dir = ANATOMY_SAGITTAL;
+    else if(args[1] == "coronal")
+      dir = ANATOMY_CORONAL;
+    else
+      throw IRISException("Unknown direction '%s'", args[1].c_str());
+
+    double first = ParseNumber(args[2]), last = ParseNumber(args[3]);
+    if(first < 0 || last < first)
+      throw IRISException("Invalid slice range");
+
+    driver->ExportSliceSeries(dir, (unsigned int) first, (unsigned int) last,
+                              all, args[4].c_str());
+    }
+  else
+    {
+    throw IRISException("Unknown command '%s'", cmd.c_str());
+    }
+
+  return true;
+}
+
+void HeadlessSession::SetViewportSize(unsigned int w, unsigned int h)
+{
+  if(w == 0 || h == 0)
+    throw IRISException("The view size must be positive");
+
+  for(unsigned int i = 0; i < 4; i++)
+    m_Window[i]->SetSize(w, h);
+
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    m_Reporter[i]->SetViewportSize(Vector2ui(w, h));
+    m_SliceRenderer[i]->OnWindowResize(w, h, 1);
+    }
+}
+
+void HeadlessSession::UpdateModels()
+{
+  m_Model->GetSliceCoordinator()->Update();
+  for(unsigned int i = 0; i < 3; i++)
+    m_Model->GetSliceModel(i)->Update();
+  m_Model->GetModel3D()->Update();
+}
+
+void HeadlessSession::SaveScreenshot(const std::string &view, const std::string &filename)
+{
+  AbstractVTKRenderer *renderer;
+  vtkRenderWindow *window;
+  if(view == "3d")
+    {
+    renderer = m_Model->GetModel3D()->GetRenderer();
+    window = m_Window[3];
+    }
+  else if(view == "0" || view == "1" || view == "2")
+    {
+    unsigned int i = view[0] - '0';
+    renderer = m_SliceRenderer[i];
+    window = m_Window[i];
+    }
+  else
+    {
+    throw IRISException("Unknown view '%s'", view.c_str());
+    }
+
+  if(!m_Model->GetDriver()->IsMainImageLoaded())
+    throw IRISException("No image is loaded");
+
+  this->UpdateModels();
+  renderer->Update();
+  window->Render();
+  renderer->SaveAsPNG(filename);
+}
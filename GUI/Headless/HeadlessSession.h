@@ -0,0 +1,81 @@
+#ifndef HEADLESSSESSION_H
+#define HEADLESSSESSION_H
+
+#include "SNAPCommon.h"
+#include <vtkSmartPointer.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class GlobalUIModel;
+class GenericSliceRenderer;
+class HeadlessViewportReporter;
+class vtkRenderWindow;
+
+/**
+ * \class HeadlessSession
+ * \brief Drives the ITK-SNAP models and renderers without the Qt GUI.
+ *
+ * The session creates a GlobalUIModel and connects the three slice renderers
+ * and the 3D renderer to offscreen VTK render windows. Whether these use EGL,
+ * OSMesa or a hidden native window depends on how VTK was built. The session
+ * is controlled by a stream of commands, one per line:
+ *
+ *   size W H                          size of the rendered views in pixels
+ *   workspace FILE                    open a workspace
+ *   open main|overlay|segmentation FILE
+ *   labels FILE                       load label descriptions
+ *   cursor X Y Z                      cursor position, in voxels from zero
+ *   timepoint T                       time point, from zero
+ *   contrast MIN MAX | contrast auto  contrast of the main image
+ *   zoom FACTOR                       zoom of all slice views
+ *   mesh                              update the 3D segmentation meshes
+ *   screenshot 0|1|2|3d FILE          render a view into a PNG file
+ *   slices axial|sagittal|coronal FIRST LAST PATTERN [all]
+ *                                     export main image slices, see
+ *                                     IRISApplication::ExportSliceSeries
+ *   quit
+ *
+ * Arguments containing spaces can be given in double quotes. Empty lines and
+ * lines starting with '#' are ignored.
+ */
+class HeadlessSession
+{
+public:
+
+  HeadlessSession();
+  ~HeadlessSession();
+
+  /**
+   * Execute the commands from a stream until it ends or a quit command is
+   * read. Errors are reported to the log and do not stop the session.
+   * Returns the number of commands that failed.
+   */
+  int Run(std::istream &commands, std::ostream &log);
+
+  /** Execute a single command. Returns false on quit. Throws on error. */
+  bool Execute(const std::vector<std::string> &args);
+
+  /** Split a command line into arguments */
+  static std::vector<std::string> Tokenize(const std::string &line);
+
+protected:
+
+  void SetViewportSize(unsigned int w, unsigned int h);
+
+  // Process the events that the models have received, as the Qt views do
+  // before painting
+  void UpdateModels();
+
+  void SaveScreenshot(const std::string &view, const std::string &filename);
+
+  SmartPtr<GlobalUIModel> m_Model;
+
+  SmartPtr<HeadlessViewportReporter> m_Reporter[3];
+  SmartPtr<GenericSliceRenderer> m_SliceRenderer[3];
+
+  // Render windows of the three slice views and the 3D view
+  vtkSmartPointer<vtkRenderWindow> m_Window[4];
+};
+
+#endif // HEADLESSSESSION_H
@@ -59,8 +59,6 @@ double AnnotationModel::GetAngleWithCurrentLine(const annot::LineSegmentAnnotati
 
 void AnnotationModel::AdjustAngleToRoundDegree(LineSegment &line, int n_degrees)
 {
-  ImageAnnotationData *adata = this->GetAnnotations();
-
   // Map the line segment from slice coordinates to window physical, where angles are
   // computed
   Vector2d p1 = m_Parent->MapSliceToPhysicalWindow(line.first);
@@ -74,13 +72,14 @@ void AnnotationModel::AdjustAngleToRoundDegree(LineSegment &line, int n_degrees)
   Vector2d p2_rot_best = p2;
   double rot_best = std::numeric_limits<double>::infinity();
 
-  // Loop over all the lines
-  for(ImageAnnotationData::AnnotationConstIterator it = adata->GetAnnotations().begin();
-      it != adata->GetAnnotations().end(); ++it)
+  // Loop over all the lines in this slice
+  ImageAnnotationData::AnnotationVector visible;
+  this->GetVisibleAnnotations(visible);
+  for(AbstractAnnotation *a : visible)
     {
     const annot::LineSegmentAnnotation *lsa =
-        dynamic_cast<const annot::LineSegmentAnnotation *>(it->GetPointer());
-    if(lsa && this->IsAnnotationVisible(lsa))
+        dynamic_cast<const annot::LineSegmentAnnotation *>(a);
+    if(lsa)
       {
       // Normalize the annotated line
       Vector2d q1 = m_Parent->MapSliceToPhysicalWindow(
@@ -172,6 +171,13 @@ bool AnnotationModel::IsAnnotationVisible(const AnnotationModel::AbstractAnnotat
         m_Parent->GetSliceIndex());
 }
 
+void AnnotationModel::GetVisibleAnnotations(ImageAnnotationData::AnnotationVector &result) const
+{
+  this->GetAnnotations()->FindVisibleAnnotations(
+        m_Parent->GetSliceDirectionInImageSpace(),
+        m_Parent->GetSliceIndex(), result);
+}
+
 double AnnotationModel
 ::GetPixelDistanceToAnnotation(
     const AbstractAnnotation *annot,
@@ -201,28 +207,21 @@ double AnnotationModel
 AnnotationModel::AbstractAnnotation *
 AnnotationModel::GetAnnotationUnderCursor(const Vector3d &xSlice)
 {
-  ImageAnnotationData *adata = this->GetAnnotations();
-
   // Current best annotation
   AbstractAnnotation *asel = NULL;
   double dist_min = std::numeric_limits<double>::infinity();
   double dist_thresh = 5 * m_Parent->GetSizeReporter()->GetViewportPixelRatio();
 
-  // Loop over all annotations
-  for(ImageAnnotationData::AnnotationConstIterator it = adata->GetAnnotations().begin();
-      it != adata->GetAnnotations().end(); ++it)
+  // Loop over the annotations visible in this slice
+  ImageAnnotationData::AnnotationVector visible;
+  this->GetVisibleAnnotations(visible);
+  for(AbstractAnnotation *a : visible)
     {
-    AbstractAnnotation *a = *it;
-
-    // Test if annotation is visible in this plane
-    if(this->IsAnnotationVisible(a))
+    double dist = GetPixelDistanceToAnnotation(a, xSlice);
+    if(dist < dist_thresh && dist < dist_min)
       {
-      double dist = GetPixelDistanceToAnnotation(a, xSlice);
-      if(dist < dist_thresh && dist < dist_min)
-        {
-        asel = a;
-        dist_min = dist;
-        }
+      asel = a;
+      dist_min = dist;
       }
     }
 
@@ -453,18 +452,10 @@ void AnnotationModel::CancelLine()
 
 void AnnotationModel::SelectAllOnSlice()
 {
-  ImageAnnotationData *adata = this->GetAnnotations();
-  for(ImageAnnotationData::AnnotationIterator it = adata->GetAnnotations().begin();
-      it != adata->GetAnnotations().end(); ++it)
-    {
-    AbstractAnnotation *a = *it;
-
-    // Test if annotation is visible in this plane
-    if(this->IsAnnotationVisible(a))
-      {
-      a->SetSelected(true);
-      }
-    }
+  ImageAnnotationData::AnnotationVector visible;
+  this->GetVisibleAnnotations(visible);
+  for(AbstractAnnotation *a : visible)
+    a->SetSelected(true);
 
   this->InvokeEvent(ModelUpdateEvent());
 }
@@ -492,14 +483,13 @@ void AnnotationModel::DeleteSelectedOnSlice()
 AnnotationModel::AbstractAnnotation *
 AnnotationModel::GetSingleSelectedAnnotation() const
 {
-  ImageAnnotationData *adata = this->GetAnnotations();
+  ImageAnnotationData::AnnotationVector visible;
+  this->GetVisibleAnnotations(visible);
   AbstractAnnotation *last_sel = NULL;
   unsigned int n_found = 0;
-  for(ImageAnnotationData::AnnotationIterator it = adata->GetAnnotations().begin();
-      it != adata->GetAnnotations().end(); it++)
+  for(AbstractAnnotation *a : visible)
     {
-    AbstractAnnotation *a = *it;
-    if(a->GetSelected() && this->IsAnnotationVisible(a))
+    if(a->GetSelected())
       {
       n_found++;
       last_sel = a;
@@ -787,18 +777,18 @@ void AnnotationModel::SetSelectedAnnotationColorValue(Vector3ui value)
 annot::AbstractAnnotation *
 AnnotationModel::GetSelectedHandleUnderCusror(const Vector3d &xSlice, int &out_handle)
 {
-  // Get the annotation data
-  ImageAnnotationData *adata = this->GetAnnotations();
+  // Get the annotations in this slice
+  ImageAnnotationData::AnnotationVector visible;
+  this->GetVisibleAnnotations(visible);
 
   out_handle = -1;
-  for(ImageAnnotationData::AnnotationConstIterator it = adata->GetAnnotations().begin();
-      it != adata->GetAnnotations().end(); ++it)
+  for(AbstractAnnotation *a : visible)
     {
-    if(this->IsAnnotationVisible(*it) && (*it)->GetSelected())
+    if(a->GetSelected())
       {
       // Draw all the line segments
       annot::LineSegmentAnnotation *lsa =
-          dynamic_cast<annot::LineSegmentAnnotation *>(it->GetPointer());
+          dynamic_cast<annot::LineSegmentAnnotation *>(a);
       if(lsa)
         {
         // Draw the line
@@ -813,7 +803,7 @@ AnnotationModel::GetSelectedHandleUnderCusror(const Vector3d &xSlice, int &out_h
         }
 
       annot::LandmarkAnnotation *lma =
-          dynamic_cast<annot::LandmarkAnnotation *>(it->GetPointer());
+          dynamic_cast<annot::LandmarkAnnotation *>(a);
       if(lma)
         {
         Vector3d xHeadSlice, xTailSlice;
@@ -828,7 +818,7 @@ AnnotationModel::GetSelectedHandleUnderCusror(const Vector3d &xSlice, int &out_h
         }
 
       if(out_handle >= 0)
-        return it->GetPointer();
+        return a;
       }
     }
 
@@ -91,6 +91,9 @@ public:
   /** Test if an annotation is visible in this slice */
   bool IsAnnotationVisible(const AbstractAnnotation *annot) const;
 
+  /** Get the annotations visible in this slice, in drawing order */
+  void GetVisibleAnnotations(ImageAnnotationData::AnnotationVector &result) const;
+
 
   bool ProcessPushEvent(const Vector3d &xSlice, bool shift_mod);
 
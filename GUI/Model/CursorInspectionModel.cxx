@@ -32,16 +32,19 @@ CurrentVoxelInfoItemSetDomain
   // Set the name
   vox.LayerName = it.GetLayer()->GetNickname().c_str();
 
+  // Get the intensity under the cursor for this layer. The probe is shared
+  // by all the rows of the table, so the layers are only sampled once.
+  const GenericImageData::LayerProbe *probe =
+      m_Model->GetCursorInspectionModel()->GetLayerProbe(it.GetLayer());
+
   // Make sure that the layer is initialized
-  if(it.GetLayer()->IsInitialized())
+  if(it.GetLayer()->IsInitialized() && probe)
     {
-    // Get the intensity under the cursor for this layer
-    vnl_vector<double> v;
-    ImageWrapperBase::DisplayPixelType disprgb;
-    it.GetLayer()->GetVoxelUnderCursorDisplayedValueAndAppearance(v, disprgb);
+    const vnl_vector<double> &v = probe->Value;
+    const ImageWrapperBase::DisplayPixelType &disprgb = probe->Appearance;
 
     // Use good old sprintf!
-    char buffer[64];
+    char buffer[64] = "";
 
     if(v.size() == 1)
       {
@@ -83,6 +86,10 @@ CurrentVoxelInfoItemSetDomain
 
 CursorInspectionModel::CursorInspectionModel()
 {
+  m_Parent = NULL;
+  m_LayerProbesValid = false;
+  m_LayerProbesTimePoint = 0;
+
   // Create the child models
   m_LabelUnderTheCursorIdModel = wrapGetterSetterPairAsProperty(
         this, &CursorInspectionModel::GetLabelUnderTheCursorIdValue);
@@ -142,7 +149,38 @@ void CursorInspectionModel::SetParentModel(GlobalUIModel *parent)
               SegmentationLabelChangeEvent(), ModelUpdateEvent());
   Rebroadcast(app, SegmentationChangeEvent(), ModelUpdateEvent());
 
+  // Display mapping changes the appearance of the probed voxels
+  Rebroadcast(app, WrapperDisplayMappingChangeEvent(), ModelUpdateEvent());
+}
+
+void CursorInspectionModel::OnUpdate()
+{
+  // Any of the events we listen to may change the probed values
+  m_LayerProbesValid = false;
+}
+
+const GenericImageData::LayerProbe *
+CursorInspectionModel::GetLayerProbe(ImageWrapperBase *layer)
+{
+  IRISApplication *app = m_Parent->GetDriver();
+  if(!app->IsMainImageLoaded())
+    return NULL;
+
+  // Probe all the layers at once if the cursor has moved since the last probe
+  Vector3ui cursor = app->GetCursorPosition();
+  unsigned int tp = app->GetCursorTimePoint();
+  if(!m_LayerProbesValid || cursor != m_LayerProbesCursor
+     || tp != m_LayerProbesTimePoint)
+    {
+    app->GetCurrentImageData()->ProbeLayersUnderCursor(
+          MAIN_ROLE | OVERLAY_ROLE | SNAP_ROLE, m_LayerProbes);
+    m_LayerProbesCursor = cursor;
+    m_LayerProbesTimePoint = tp;
+    m_LayerProbesValid = true;
+    }
 
+  auto it = m_LayerProbes.find(layer->GetUniqueId());
+  return it == m_LayerProbes.end() ? NULL : &it->second;
 }
 
 bool CursorInspectionModel::GetLabelUnderTheCursorIdValue(LabelType &value)
@@ -70,10 +70,20 @@ public:
   // The model for a table of intensity values at cursor
   irisGetMacro(VoxelAtCursorModel, ConcreteLayerVoxelAtCursorModel *)
 
+  /**
+   * Get the value and appearance of a layer under the cursor. All layers are
+   * probed together the first time this is called after the model updates,
+   * and the rows of the table then share the result. Returns NULL if the
+   * layer was not probed.
+   */
+  const GenericImageData::LayerProbe *GetLayerProbe(ImageWrapperBase *layer);
+
 protected:
 
   CursorInspectionModel();
 
+  virtual void OnUpdate() ITK_OVERRIDE;
+
 private:
 
   // Label under the cursor
@@ -90,6 +100,12 @@ private:
   // Parent
   GlobalUIModel *m_Parent;
 
+  // Layers probed under the cursor, and the cursor they were probed at
+  GenericImageData::LayerProbeMap m_LayerProbes;
+  bool m_LayerProbesValid;
+  Vector3ui m_LayerProbesCursor;
+  unsigned int m_LayerProbesTimePoint;
+
 };
 
 #endif // CURSORINSPECTIONMODEL_H
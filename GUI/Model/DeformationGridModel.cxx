@@ -2,7 +2,6 @@
 #include "GenericImageData.h"
 #include "GlobalUIModel.h"
 #include "SNAPAppearanceSettings.h"
-#include <itkImageLinearConstIteratorWithIndex.h>
 
 
 DeformationGridModel
@@ -11,130 +10,159 @@ DeformationGridModel
 
 }
 
+bool
+DeformationGridModel::GridKey
+::operator == (const GridKey &other) const
+{
+  return SliceUpdateMTime == other.SliceUpdateMTime && G0 == other.G0
+      && DGridDPhi[0] == other.DGridDPhi[0] && DGridDPhi[1] == other.DGridDPhi[1]
+      && DGridDPhi[2] == other.DGridDPhi[2]
+      && DGridDInd[0] == other.DGridDInd[0] && DGridDInd[1] == other.DGridDInd[1]
+      && LineStep[0] == other.LineStep[0] && LineStep[1] == other.LineStep[1]
+      && VertexStep[0] == other.VertexStep[0] && VertexStep[1] == other.VertexStep[1];
+}
+
 int
-DeformationGridModel::
-GetVertices(ImageWrapperBase *layer, DeformationGridVertices &v) const
+DeformationGridModel
+::GetDecimationStep(double pixels_per_voxel, double min_pixels)
 {
-  typedef ImageWrapperBase::FloatVectorSliceType SliceType;
+  int step = 1;
+  while(step * pixels_per_voxel < min_pixels && step < (1 << 20))
+    step *= 2;
+  return step;
+}
 
-  // Draw the texture for the layer
-  if (layer && (layer->GetNumberOfComponents() == 3 || layer->GetNumberOfComponents() == 2))
+const DeformationGridVertices *
+DeformationGridModel::
+GetVertices(ImageWrapperBase *layer)
+{
+  if (!layer || (layer->GetNumberOfComponents() != 3 && layer->GetNumberOfComponents() != 2))
+    return nullptr;
+
+  // The pipeline that casts the slice to a floating point vector image is
+  // created once per layer and kept, so that it only executes when the slice
+  // changes
+  GridCache &gc = m_GridCache[layer->GetUniqueId()];
+  if(!gc.Slice || !gc.Slice->GetSource())
     {
-    // Create a pipeline that casts the slice to a floating point vector image
-    // TODO: this involves new memory allocation in each call, in the future we might
-    // want to create this pipeline when deformation grid visualization is enabled
-    // and delete it when it is disabled
-    SliceType *slice = layer->CreateCastToFloatVectorSlicePipeline(
+    gc.Slice = layer->CreateCastToFloatVectorSlicePipeline(
           "DeformationGridModelCastToFloat",m_Parent->GetId());
+    gc.Key = GridKey();
+    if(!gc.Slice)
+      {
+      m_GridCache.erase(layer->GetUniqueId());
+      return nullptr;
+      }
+    }
+
+  // Get the slice
+  gc.Slice->GetSource()->UpdateLargestPossibleRegion();
+
+  // The mapping between (index, phi[index]) and on-screen coordinate for a grid
+  // point is linear (combines a bunch of transforms). To save time, we can
+  // compute this mapping once at the beginning of the loop.
+  GridKey key;
+  key.SliceUpdateMTime = gc.Slice->GetUpdateMTime();
 
-    // Get the slice
-    slice->GetSource()->UpdateLargestPossibleRegion();
+  itk::Index<2> ind;
+  Vector3d phi;
 
-    // The mapping between (index, phi[index]) and on-screen coordinate for a grid
-    // point is linear (combines a bunch of transforms). To save time, we can
-    // compute this mapping once at the beginning of the loop. We also know that the
-    // index will only be going up by one at each iteration
-    itk::Index<2> ind;
-    Vector3d phi, G0, d_grid_d_phi[3], d_grid_d_ind[2];
+  // Compute the initial displacement G0
+  ind.Fill(0); phi.fill(0.0f);
+  key.G0 = m_Parent->ComputeGridPosition(phi, ind, layer);
 
-    // Compute the initial displacement G0
+  // Compute derivative of grid displacement wrt warp components
+  for(int a = 0; a < 3; a++)
+    {
     ind.Fill(0); phi.fill(0.0f);
-    G0 = m_Parent->ComputeGridPosition(phi, ind, layer);
+    phi[a] = 1.0f;
+    key.DGridDPhi[a] = m_Parent->ComputeGridPosition(phi, ind, layer) - key.G0;
+    }
 
-    // Compute derivative of grid displacement wrt warp components
-    for(int a = 0; a < 3; a++)
-      {
-      ind.Fill(0); phi.fill(0.0f);
-      phi[a] = 1.0f;
-      d_grid_d_phi[a] = m_Parent->ComputeGridPosition(phi, ind, layer) - G0;
-      }
+  // Compute derivative of grid displacement wrt index components
+  for(int b = 0; b < 2; b++)
+    {
+    ind.Fill(0); phi.fill(0.0f);
+    ind[b] = 1;
+    key.DGridDInd[b] = m_Parent->ComputeGridPosition(phi, ind, layer) - key.G0;
+    }
 
-    // Compute derivative of grid displacement wrt index components
-    for(int b = 0; b < 2; b++)
-      {
-      ind.Fill(0); phi.fill(0.0f);
-      ind[b] = 1;
-      d_grid_d_ind[b] = m_Parent->ComputeGridPosition(phi, ind, layer) - G0;
-      }
+  // Figure out how frequently to sample lines and vertices along them. Lines
+  // are at least 8 pixels apart on the screen, vertices at least 2. Zoom is in
+  // units of px/mm. Spacing is in units of mm/vox, so zoom * spacing is
+  // (display pixels) / (image voxels). For oblique slicing, the slice is in
+  // screen pixel units already.
+  for(int d = 0; d < 2; d++)
+    {
+    double disp_pix_per_vox = layer->IsSlicingOrthogonal()
+                              ? m_Parent->GetSliceSpacing()[d] * m_Parent->GetViewZoom()
+                              : 1.0;
+    key.VertexStep[d] = GetDecimationStep(disp_pix_per_vox, 2.0);
+
+    // Lines in direction 1-d are spaced along direction d
+    key.LineStep[1-d] = GetDecimationStep(disp_pix_per_vox, 8.0);
+    }
 
-    size_t nd0[2] {0, 0}, nd1[2] {0, 0};
-    bool counted = false;
+  if(!(key == gc.Key))
+    {
+    ComputeVertices(gc.Slice, key, gc.Vertices);
+    gc.Vertices.version = ++m_VerticesVersion;
+    gc.Key = key;
+    }
 
-    // Iterate line direction
-    for(int d = 0; d < 2; d++)
+  return &gc.Vertices;
+}
+
+void
+DeformationGridModel
+::ComputeVertices(SliceType *slice, const GridKey &key, DeformationGridVertices &v)
+{
+  itk::ImageRegion<2> region = slice->GetBufferedRegion();
+  const float *buffer = slice->GetBufferPointer();
+  unsigned int nc = slice->GetNumberOfComponentsPerPixel();
+
+  v.vvec.clear();
+  for(int d = 0; d < 2; d++)
+    {
+    // Offsets of the vertices along the lines. Both grid directions use power
+    // of two steps, so the crossings of the grid lines are vertices. The last
+    // voxel is included so that the lines reach the edge of the slice.
+    long n = region.GetSize(d);
+    std::vector<long> verts;
+    for(long i = 0; i < n; i++)
+      if((region.GetIndex(d) + i) % key.VertexStep[d] == 0 || i == n - 1)
+        verts.push_back(i);
+
+    size_t n_lines = 0;
+    for(long j = 0; j < (long) region.GetSize(1-d); j++)
       {
-      // The current matrix is such that we should be drawing in pixel coordinates.
-      typedef itk::ImageLinearConstIteratorWithIndex<SliceType> IterType;
-      IterType it1(slice, slice->GetBufferedRegion());
-      it1.SetDirection(d);
-      it1.GoToBegin();
-
-      int vox_increment;
-      if(layer->IsSlicingOrthogonal())
-        {
-        // Figure out how frequently to sample lines. The spacing on the screen should be at
-        // most every 4 pixels. Zoom is in units of px/mm. Spacing is in units of mm/vox, so
-        // zoom * spacing is (display pixels) / (image voxels).
-        double disp_pix_per_vox = m_Parent->GetSliceSpacing()[d] * m_Parent->GetViewZoom();
-        vox_increment = (int) ceil(8.0 / disp_pix_per_vox);
-        }
-      else
-        {
-        // The slice is in screen pixel units already - so just 8!
-        vox_increment = 8;
-        }
+      // Do we draw this line?
+      if((region.GetIndex(1-d) + j) % key.LineStep[d] != 0)
+        continue;
+      ++n_lines;
 
-      counted = false;
-      while( !it1.IsAtEnd() )
+      for(long i : verts)
         {
-        // Do we draw this line?
-        if(it1.GetIndex()[1-d] % vox_increment == 0)
-          {
-          ++nd0[d];
-
-          // Set up the current position and increment
-          Vector3d G1 = G0 +
-              (d_grid_d_ind[0] * (double) (it1.GetIndex()[0])) +
-              (d_grid_d_ind[1] * (double) (it1.GetIndex()[1]));
-
-          while( !it1.IsAtEndOfLine() )
-            {
-            if (!counted)
-              ++nd1[d];
-
-            // Read the pixel
-            auto pix = it1.Get();
-
-            // Alternative version
-            Vector3d xDispSlice = G1 +
-                (d_grid_d_phi[0] * (double) (pix[0])) +
-                (d_grid_d_phi[1] * (double) (pix[1])) +
-                (d_grid_d_phi[2] * (double) (pix[2]));
-
-            v.vvec.push_back(xDispSlice[0]);
-            v.vvec.push_back(xDispSlice[1]);
-
-            // Add the displacement
-            ++it1;
-
-            // Update the current position
-            G1 += d_grid_d_ind[d];
-            }
-          counted = true;
-          }
-
-        it1.NextLine();
+        long off[2];
+        off[d] = i; off[1-d] = j;
+
+        // Read the pixel
+        const float *pix = buffer + (off[1] * region.GetSize(0) + off[0]) * nc;
+
+        Vector3d xDispSlice = key.G0 +
+            (key.DGridDInd[0] * (double) (region.GetIndex(0) + off[0])) +
+            (key.DGridDInd[1] * (double) (region.GetIndex(1) + off[1])) +
+            (key.DGridDPhi[0] * (double) (pix[0])) +
+            (key.DGridDPhi[1] * (double) (pix[1]));
+        if(nc > 2)
+          xDispSlice += key.DGridDPhi[2] * (double) (pix[2]);
+
+        v.vvec.push_back(xDispSlice[0]);
+        v.vvec.push_back(xDispSlice[1]);
         }
       }
 
-    v.nline[0] = nd0[0];
-    v.nvert[0] = nd1[0];
-    v.nline[1] = nd0[1];
-    v.nvert[1] = nd1[1];
-
-    // Release the mini-pipeline
-    layer->ReleaseInternalPipeline("DeformationGridModelCastToFloat", m_Parent->GetId());
+    v.nline[d] = n_lines;
+    v.nvert[d] = verts.size();
     }
-
-  return EXIT_SUCCESS;
 }
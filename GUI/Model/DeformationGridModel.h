@@ -5,6 +5,7 @@
 #include "SNAPCommon.h"
 #include "GenericSliceModel.h"
 #include "DisplayMappingPolicy.h"
+#include <map>
 
 /** This struct contains vertices' coordinates for a deformation grid.
  *  nline and nvert define the dimension of the grid */
@@ -17,6 +18,9 @@ struct DeformationGridVertices
    *  Dimension of the lines are defined by number of lines (nline),
    *  and number of vertices on each line (nvert) */
   size_t nline[2], nvert[2];
+
+  /** Changes each time the vertices are recomputed */
+  unsigned long version = 0;
 };
 
 class DeformationGridModel : public AbstractModel
@@ -27,14 +31,53 @@ public:
 
   typedef SliceViewportLayout::SubViewport ViewportType;
 
-  int GetVertices(ImageWrapperBase *layer, DeformationGridVertices &v) const;
+  /**
+   * Get the vertices of the deformation grid of a layer in this view. The
+   * vertices are cached, and only recomputed when the warp slice, its mapping
+   * to the display, or the decimation level set by the zoom changes. Returns
+   * nullptr if the layer is not a 2- or 3-component image.
+   */
+  const DeformationGridVertices *GetVertices(ImageWrapperBase *layer);
 
 protected:
   DeformationGridModel();
   virtual ~DeformationGridModel() {}
 
+  typedef ImageWrapperBase::FloatVectorSliceType SliceType;
+
+  // Everything that the grid vertices of a layer depend on
+  struct GridKey
+  {
+    unsigned long SliceUpdateMTime = 0;
+    Vector3d G0, DGridDPhi[3], DGridDInd[2];
+    int LineStep[2] = {0, 0}, VertexStep[2] = {0, 0};
+
+    bool operator == (const GridKey &other) const;
+  };
+
+  // Cast-to-float slice pipeline and grid vertices of a layer
+  struct GridCache
+  {
+    SmartPtr<SliceType> Slice;
+    GridKey Key;
+    DeformationGridVertices Vertices;
+  };
+
+  // Smallest power of two number of voxels spanning at least min_pixels
+  // on the screen. Powers of two keep the same grid lines and vertices over
+  // a range of zoom levels.
+  static int GetDecimationStep(double pixels_per_voxel, double min_pixels);
+
+  // Sample the grid vertices from the slice
+  static void ComputeVertices(SliceType *slice, const GridKey &key,
+                              DeformationGridVertices &v);
+
   int m_Id; // Identify the view this object being related to
   GenericSliceModel *m_Parent;
+
+  // Cached grids, indexed by the unique id of the layer
+  std::map<unsigned long, GridCache> m_GridCache;
+  unsigned long m_VerticesVersion = 0;
 };
 
 #endif // DEFORMATIONGRIDMODEL_H
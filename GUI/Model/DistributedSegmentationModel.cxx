@@ -36,6 +36,7 @@
 
 #include "GlobalUIModel.h"
 #include "RESTClient.h"
+#include "LocalTicketQueue.h"
 #include "FormattedTable.h"
 #include "IRISApplication.h"
 #include "IRISImageData.h"
@@ -47,6 +48,7 @@
 #include "itksys/SystemTools.hxx"
 #include "AllPurposeProgressAccumulator.h"
 #include "ImageAnnotationData.h"
+#include "ImageIODelegates.h"
 #include "TimePointProperties.h"
 
 
@@ -300,6 +302,24 @@ std::string DistributedSegmentationModel::GetURL(const std::string &path)
   return path.length() ? server + "/" + path : server;
 }
 
+bool DistributedSegmentationModel::IsLocalQueue()
+{
+  return LocalTicketQueue::IsQueueURL(this->GetURL(""));
+}
+
+std::vector<std::string> DistributedSegmentationModel::GetLocalQueueWatchPaths()
+{
+  std::vector<std::string> paths;
+  if(this->IsLocalQueue() && this->GetServerStatus().status == AUTH_AUTHENTICATED)
+    {
+    IdType selected_ticket_id = -1;
+    if(!m_TicketListModel->GetValueAndDomain(selected_ticket_id, NULL))
+      selected_ticket_id = -1;
+    paths = LocalTicketQueue(this->GetURL("")).GetWatchPaths(selected_ticket_id);
+    }
+  return paths;
+}
+
 void DistributedSegmentationModel::SetServiceListing(const ServiceListing &listing)
 {
   // Get the current service info
@@ -437,25 +457,118 @@ void DistributedSegmentationModel::ApplyTagsToTargets()
 
 
 
-void DistributedSegmentationModel::SubmitWorkspace(ProgressReporterDelegate *pdel)
+SubmissionRequest DistributedSegmentationModel::PrepareSubmission()
 {
   // At this point the project had to be saved. We read it using the API object
-  WorkspaceAPI ws;
-  ws.ReadFromXMLFile(m_Parent->GetGlobalState()->GetProjectFilename().c_str());
+  SubmissionRequest request;
+  request.source_workspace = m_Parent->GetGlobalState()->GetProjectFilename();
+  request.workspace = std::make_shared<WorkspaceAPI>();
+  request.workspace->ReadFromXMLFile(request.source_workspace.c_str());
+  request.githash = this->GetCurrentServiceGitHash();
+  request.server_url = this->GetURL("");
+  return request;
+}
 
-  // Create a command that reports accumulated progress
-  SmartPtr<itk::Command> cmd = pdel->CreateCommand();
+SubmissionResponse DistributedSegmentationModel::AsyncSubmitWorkspace(SubmissionRequest request)
+{
+  SubmissionResponse resp;
+  resp.ticket_id = -1;
+  resp.server_url = request.server_url;
+  resp.source_workspace = request.source_workspace;
 
-  // Do the upload magic
-  int ticket_id = ws.CreateWorkspaceTicket(this->GetCurrentServiceGitHash().c_str(), cmd);
+  try
+    {
+    // Do the upload magic. A local queue gets the workspace but not the images
+    if(LocalTicketQueue::IsQueueURL(request.server_url))
+      resp.ticket_id = LocalTicketQueue(request.server_url).CreateTicket(*request.workspace, request.githash);
+    else
+      resp.ticket_id = request.workspace->CreateWorkspaceTicket(request.githash);
+    }
+  catch(std::exception &exc)
+    {
+    resp.error = exc.what();
+    }
+
+  return resp;
+}
+
+void DistributedSegmentationModel::ApplySubmissionResponse(const SubmissionResponse &resp)
+{
+  if(resp.ticket_id < 0)
+    throw IRISException("%s", resp.error.c_str());
 
   // Associate the ticket id with the workspace file for the future
-  UniversalTicketId uti(this->GetURL(""), ticket_id);
-  m_TicketWorkspaceMap[uti].source_workspace = m_Parent->GetGlobalState()->GetProjectFilename();
+  UniversalTicketId uti(resp.server_url, resp.ticket_id);
+  m_TicketWorkspaceMap[uti].source_workspace = resp.source_workspace;
   m_SelectedTicketLocalWorkspaceModel->InvokeEvent(ValueChangedEvent());
 
+  // Remember to add the results when the ticket succeeds
+  if(this->GetAddResultsToWorkspace())
+    m_TicketsToAdd.insert(uti);
+
   // Stick into the model
-  m_SubmittedTicketId = ticket_id;
+  m_SubmittedTicketId = resp.ticket_id;
+}
+
+std::vector<IdType> DistributedSegmentationModel::TakeSucceededTicketsToAdd()
+{
+  std::vector<IdType> ids;
+  ids.swap(m_SucceededTicketsToAdd);
+  return ids;
+}
+
+TicketResultResponse DistributedSegmentationModel::AsyncGetTicketResult(
+    IdType ticket_id, std::string target_fn)
+{
+  TicketResultResponse resp;
+  resp.ticket_id = ticket_id;
+
+  try
+    {
+    resp.server_url = RESTClient::GetServerURL();
+    resp.result_workspace = DownloadTicketResultWorkspace(ticket_id, target_fn, NULL);
+    }
+  catch(std::exception &exc)
+    {
+    resp.error = exc.what();
+    }
+
+  return resp;
+}
+
+int DistributedSegmentationModel::AddTicketResultToWorkspace(const TicketResultResponse &resp)
+{
+  if(resp.error.size())
+    throw IRISException("Failed to get the results of ticket %ld: %s",
+                        resp.ticket_id, resp.error.c_str());
+
+  UniversalTicketId uti(resp.server_url, resp.ticket_id);
+  m_TicketWorkspaceMap[uti].result_workspace = resp.result_workspace;
+  m_SelectedTicketResultWorkspaceModel->InvokeEvent(ValueChangedEvent());
+
+  // The segmentations are added as new layers, after the ones already open
+  IRISApplication *driver = m_Parent->GetDriver();
+  if(!driver->IsMainImageLoaded())
+    return 0;
+
+  WorkspaceAPI ws;
+  ws.ReadFromXMLFile(resp.result_workspace.c_str());
+
+  int n_added = 0;
+  for(int i = 0; i < ws.GetNumberOfLayers(); i++)
+    {
+    Registry &folder = ws.GetLayerFolder(i);
+    std::string role = folder["Role"][""];
+    if(role != "SegmentationRole")
+      continue;
+
+    IRISWarningList wl;
+    driver->OpenImage(ws.GetLayerActualPath(folder).c_str(), LABEL_ROLE, wl,
+                      &folder, ws.GetLayerIOHints(folder), true);
+    n_added++;
+    }
+
+  return n_added;
 }
 
 bool DistributedSegmentationModel::IsSelectedTicketSuccessful()
@@ -477,6 +590,30 @@ std::string DistributedSegmentationModel::DownloadWorkspace(
      || m_TicketListing[selected_ticket_id].status != STATUS_SUCCESS)
     return "";
 
+  // Create a command that reports accumulated progress
+  SmartPtr<itk::Command> cmd = pdel->CreateCommand();
+
+  // Download and remember the workspace
+  std::string result_ws = DownloadTicketResultWorkspace(selected_ticket_id, target_fn, cmd);
+  UniversalTicketId uti(this->GetURL(""), selected_ticket_id);
+  m_TicketWorkspaceMap[uti].result_workspace = result_ws;
+  m_SelectedTicketResultWorkspaceModel->InvokeEvent(ValueChangedEvent());
+  return result_ws;
+}
+
+std::string DistributedSegmentationModel::DownloadTicketResultWorkspace(
+    IdType ticket_id, const std::string &target_fn, itk::Command *cmd)
+{
+  // The results in a local queue are opened where the service wrote them
+  std::string server = RESTClient::GetServerURL();
+  if(LocalTicketQueue::IsQueueURL(server))
+    {
+    std::string result_ws = LocalTicketQueue(server).GetResultWorkspace(ticket_id);
+    if(result_ws.empty())
+      throw IRISException("Ticket %ld has no result workspace", ticket_id);
+    return result_ws;
+    }
+
   // Split the target filename into a diretory and a file
   std::string dirname, filename;
   if(itksys::SystemTools::FileIsDirectory(target_fn) ||
@@ -494,12 +631,9 @@ std::string DistributedSegmentationModel::DownloadWorkspace(
   if(!itksys::SystemTools::MakeDirectory(dirname))
     throw IRISException("Could not create directory %s", dirname.c_str());
 
-  // Create a command that reports accumulated progress
-  SmartPtr<itk::Command> cmd = pdel->CreateCommand();
-
   // Download into this directory
   std::string file_list_str =
-      WorkspaceAPI::DownloadTicketFiles(selected_ticket_id, dirname.c_str(), false, "results",
+      WorkspaceAPI::DownloadTicketFiles(ticket_id, dirname.c_str(), false, "results",
                                         filename.size() ? filename.c_str() : NULL, cmd);
   std::vector<std::string> file_list;
   itksys::SystemTools::Split(file_list_str, file_list);
@@ -508,12 +642,7 @@ std::string DistributedSegmentationModel::DownloadWorkspace(
   for(int i = 0; i < file_list.size(); i++)
     {
     if(itksys::SystemTools::GetFilenameLastExtension(file_list[i]) == ".itksnap")
-      {
-      UniversalTicketId uti(this->GetURL(""), selected_ticket_id);
-      m_TicketWorkspaceMap[uti].result_workspace = file_list[i];
-      m_SelectedTicketResultWorkspaceModel->InvokeEvent(ValueChangedEvent());
       return file_list[i];
-      }
     }
 
   throw IRISException("A workspace file was not among the files that were downloaded.\n"
@@ -526,31 +655,36 @@ std::string DistributedSegmentationModel::SuggestDownloadFilename()
   // Is there a valid ticket id selected?
   IdType selected_ticket_id;
   if(m_TicketListModel->GetValueAndDomain(selected_ticket_id, NULL))
-    {
-    // The path under which we will be saving the project
-    char ticket_file[4096];
+    return this->GetDefaultResultFilename(selected_ticket_id);
 
-    // Do we have a workspace location for this ticket?
-    std::string local_ws = this->GetSelectedTicketLocalWorkspace();
-    if(local_ws.size())
-      {
-      // Create the ticket in the same folder as the local workspace
-      snprintf(ticket_file, 4096, "%s/ticket_%08ld_results.itksnap",
-              itksys::SystemTools::GetFilenamePath(local_ws).c_str(),
-              selected_ticket_id);
-      }
-    else
-      {
-      // Generate a default path for download
-      snprintf(ticket_file, 4096, "%s/ticket_%08ld/ticket_%08ld_results.itksnap",
-              this->GetDownloadLocation().c_str(),
-              selected_ticket_id, selected_ticket_id);
-      }
+  return std::string();
+}
 
-    return ticket_file;
+std::string DistributedSegmentationModel::GetDefaultResultFilename(IdType ticket_id)
+{
+  // The path under which we will be saving the project
+  char ticket_file[4096];
+
+  // Do we have a workspace location for this ticket?
+  UniversalTicketId uti(this->GetURL(""), ticket_id);
+  TicketWorkspaceMap::const_iterator it = m_TicketWorkspaceMap.find(uti);
+  std::string local_ws = it != m_TicketWorkspaceMap.end() ? it->second.source_workspace : "";
+  if(local_ws.size())
+    {
+    // Create the ticket in the same folder as the local workspace
+    snprintf(ticket_file, 4096, "%s/ticket_%08ld_results.itksnap",
+            itksys::SystemTools::GetFilenamePath(local_ws).c_str(),
+            ticket_id);
+    }
+  else
+    {
+    // Generate a default path for download
+    snprintf(ticket_file, 4096, "%s/ticket_%08ld/ticket_%08ld_results.itksnap",
+            this->GetDownloadLocation().c_str(),
+            ticket_id, ticket_id);
     }
 
-  return std::string();
+  return ticket_file;
 }
 
 void DistributedSegmentationModel::DeleteSelectedTicket()
@@ -562,9 +696,16 @@ void DistributedSegmentationModel::DeleteSelectedTicket()
     return;
 
   // Delete the ticket
-  RESTClient rc;
-  if(!rc.Get("api/tickets/%d/delete", selected_ticket_id))
-    throw IRISException("Error deleting ticket %d: %s", selected_ticket_id, rc.GetResponseText());
+  if(this->IsLocalQueue())
+    {
+    LocalTicketQueue(this->GetURL("")).DeleteTicket(selected_ticket_id);
+    }
+  else
+    {
+    RESTClient rc;
+    if(!rc.Get("api/tickets/%d/delete", selected_ticket_id))
+      throw IRISException("Error deleting ticket %d: %s", selected_ticket_id, rc.GetResponseText());
+    }
 
   // Select the next ticket in the list
   TicketListingResponse::const_iterator it = m_TicketListing.find(selected_ticket_id);
@@ -618,11 +759,14 @@ DistributedSegmentationModel::AsyncGetServiceListing(
   {
   // Second, try to get service listing
   RESTClient rc;
+  std::string server = RESTClient::GetServerURL();
+  bool is_local = LocalTicketQueue::IsQueueURL(server);
 
-  if(rc.Get("api/services?format=json"))
+  if(is_local || rc.Get("api/services?format=json"))
     {
     Json::Reader json_reader; Json::Value root;
-    if(json_reader.parse(rc.GetOutput(), root, false))
+    if(is_local ? LocalTicketQueue(server).GetServiceListing(root)
+                : json_reader.parse(rc.GetOutput(), root, false))
       {
       const Json::Value res = root["result"];
       for(int i = 0; i < res.size(); i++)
@@ -657,6 +801,21 @@ DistributedSegmentationModel::AsyncCheckStatus(std::string url, std::string toke
     RESTClient rc;
     rc.SetServerURL(url.c_str());
 
+    // A local queue needs no login, only the directory
+    if(LocalTicketQueue::IsQueueURL(url))
+      {
+      LocalTicketQueue queue(url);
+      response.auth_response.status = AUTH_NOT_CONNECTED;
+      if(queue.IsValid())
+        {
+        response.auth_response.status = AUTH_CONNECTED_NOT_AUTHENTICATED;
+        response.auth_response.user_email = queue.GetRootDirectory();
+        if(AsyncGetServiceListing(response.service_listing))
+          response.auth_response.status = AUTH_AUTHENTICATED;
+        }
+      return response;
+      }
+
     // If there is a token, post it
     bool status_login;
     if(token.size() > 0)
@@ -734,11 +893,14 @@ DistributedSegmentationModel::AsyncGetServiceDetails(std::string githash)
 
   try {
     RESTClient rc;
-    if(rc.Get("api/services/%s/detail", githash.c_str()))
+    std::string server = RESTClient::GetServerURL();
+    bool is_local = LocalTicketQueue::IsQueueURL(server);
+    if(is_local || rc.Get("api/services/%s/detail", githash.c_str()))
       {
       Json::Reader json_reader;
       Json::Value root;
-      if(json_reader.parse(rc.GetOutput(), root, false))
+      if(is_local ? LocalTicketQueue(server).GetServiceDetail(githash, root)
+                  : json_reader.parse(rc.GetOutput(), root, false))
         {
         result.longdesc = root.get("longdesc","").asString();
         result.url = root.get("url","").asString();
@@ -939,11 +1101,14 @@ TicketListingResponse DistributedSegmentationModel::AsyncGetTicketListing()
 
   try {
     RESTClient rc;
-    if(rc.Get("api/tickets?format=json"))
+    std::string server = RESTClient::GetServerURL();
+    bool is_local = LocalTicketQueue::IsQueueURL(server);
+    if(is_local || rc.Get("api/tickets?format=json"))
       {
       Json::Reader json_reader;
       Json::Value root;
-      if(json_reader.parse(rc.GetOutput(), root, false))
+      if(is_local ? LocalTicketQueue(server).GetTicketListing(root)
+                  : json_reader.parse(rc.GetOutput(), root, false))
         {
         const Json::Value tickets = root["result"];
         for(int i = 0; i < tickets.size(); i++)
@@ -1013,6 +1178,20 @@ void DistributedSegmentationModel::ApplyTicketListingResponse(const TicketListin
     m_SubmittedTicketId = -1;
     }
 
+  // Tickets whose results go into the open workspace are taken once they
+  // succeed, and forgotten if they fail
+  for(TicketListingResponse::const_iterator it = m_TicketListing.begin();
+      it != m_TicketListing.end(); ++it)
+    {
+    TicketStatus status = it->second.status;
+    if(status == STATUS_SUCCESS || status == STATUS_FAILED || status == STATUS_TIMEDOUT)
+      {
+      UniversalTicketId uti(this->GetURL(""), it->first);
+      if(m_TicketsToAdd.erase(uti) && status == STATUS_SUCCESS)
+        m_SucceededTicketsToAdd.push_back(it->first);
+      }
+    }
+
   // Fire the right domain event
   if(same_keys)
     m_TicketListModel->InvokeEvent(DomainDescriptionChangedEvent());
@@ -1030,11 +1209,14 @@ TicketDetailResponse DistributedSegmentationModel::AsyncGetTicketDetails(IdType
 
     // Get a full update on this ticket
     RESTClient rc;
-    if(rc.Get("api/tickets/%ld/detail?since=%ld", ticket_id, last_log))
+    std::string server = RESTClient::GetServerURL();
+    bool is_local = LocalTicketQueue::IsQueueURL(server);
+    if(is_local || rc.Get("api/tickets/%ld/detail?since=%ld", ticket_id, last_log))
       {
       Json::Reader json_reader;
       Json::Value root;
-      if(json_reader.parse(rc.GetOutput(), root, false))
+      if(is_local ? LocalTicketQueue(server).GetTicketDetail(ticket_id, last_log, root)
+                  : json_reader.parse(rc.GetOutput(), root, false))
         {
         const Json::Value result = root["result"];
 
@@ -1430,6 +1612,9 @@ DistributedSegmentationModel::DistributedSegmentationModel()
   // Last submitted ticket
   m_SubmittedTicketId = -1;
 
+  // Results of submitted tickets are added to the workspace
+  m_AddResultsToWorkspaceModel = NewSimpleConcreteProperty(true);
+
   // Selected ticket progress model
   m_SelectedTicketProgressModel = NewRangedConcreteProperty(0.0, 0.0, 1.0, 0.01);
   m_SelectedTicketProgressModel->SetIsValid(false);
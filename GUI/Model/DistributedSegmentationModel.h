@@ -37,10 +37,14 @@
 
 #include "PropertyModel.h"
 #include "Registry.h"
+#include <memory>
+#include <set>
 
 class GlobalUIModel;
 class IRISApplication;
 class ProgressReporterDelegate;
+class WorkspaceAPI;
+namespace itk { class Command; }
 
 namespace dss_model {
 
@@ -213,6 +217,31 @@ struct LocalTicketInfo
   std::string source_workspace, result_workspace;
 };
 
+/**
+ * A workspace to be submitted to a service. The workspace is read when the
+ * user submits it, so that it may be saved again (e.g., with the tags of
+ * another service) while the upload is still running
+ */
+struct SubmissionRequest
+{
+  std::shared_ptr<WorkspaceAPI> workspace;
+  std::string githash, server_url, source_workspace;
+};
+
+/** Outcome of a submission. The ticket id is -1 if the submission failed */
+struct SubmissionResponse
+{
+  IdType ticket_id;
+  std::string server_url, source_workspace, error;
+};
+
+/** Result workspace of a ticket that is to be added to the open workspace */
+struct TicketResultResponse
+{
+  IdType ticket_id;
+  std::string server_url, result_workspace, error;
+};
+
 } // namespace
 
 
@@ -292,6 +321,16 @@ public:
   /** Get the full URL */
   std::string GetURL(const std::string &path);
 
+  /**
+   * Whether the server is a queue in a local or shared directory (a file://
+   * URL, see LocalTicketQueue). Such a queue takes the paths of the layers
+   * instead of uploads, and its results are opened in place
+   */
+  bool IsLocalQueue();
+
+  /** Directories to watch for changes to the tickets of a local queue */
+  std::vector<std::string> GetLocalQueueWatchPaths();
+
   /** Registry describing the service listing */
   irisGetMacro(ServiceListing, const dss_model::ServiceListing &)
   void SetServiceListing(const dss_model::ServiceListing &listing);
@@ -342,8 +381,44 @@ public:
   /** Assign tags to their targets */
   void ApplyTagsToTargets();
 
-  /** Submit the workspace */
-  void SubmitWorkspace(ProgressReporterDelegate *pdel);
+  /**
+   * Capture the saved workspace for submission to the current service. The
+   * submission itself is done by AsyncSubmitWorkspace so that several
+   * tickets, e.g., for different services, can be uploaded at the same time
+   */
+  dss_model::SubmissionRequest PrepareSubmission();
+
+  /** Static function that runs asynchronously to create and upload a ticket */
+  static dss_model::SubmissionResponse AsyncSubmitWorkspace(dss_model::SubmissionRequest request);
+
+  /** Apply the results of a submission to the model */
+  void ApplySubmissionResponse(const dss_model::SubmissionResponse &resp);
+
+  /**
+   * Whether the segmentations produced for tickets submitted from this window
+   * are added to the open workspace as soon as each ticket succeeds
+   */
+  irisSimplePropertyAccessMacro(AddResultsToWorkspace, bool)
+
+  /**
+   * Tickets submitted with AddResultsToWorkspace on that have succeeded since
+   * the last call. Their results should be fetched with AsyncGetTicketResult
+   * and added with AddTicketResultToWorkspace
+   */
+  std::vector<dss_model::IdType> TakeSucceededTicketsToAdd();
+
+  /** Where the results of a ticket are downloaded to by default */
+  std::string GetDefaultResultFilename(dss_model::IdType ticket_id);
+
+  /** Static function that runs asynchronously to download the results of a ticket */
+  static dss_model::TicketResultResponse AsyncGetTicketResult(
+      dss_model::IdType ticket_id, std::string target_fn);
+
+  /**
+   * Add the segmentation layers of a ticket result to the open workspace,
+   * returning the number of layers added. Throws an exception on failure
+   */
+  int AddTicketResultToWorkspace(const dss_model::TicketResultResponse &resp);
 
   /** Can the ticket be downloaded? */
   bool IsSelectedTicketSuccessful();
@@ -453,6 +528,14 @@ protected:
   // Id of the last submitted ticket
   dss_model::IdType m_SubmittedTicketId;
 
+  // Whether results are added to the open workspace
+  SmartPtr<ConcreteSimpleBooleanProperty> m_AddResultsToWorkspaceModel;
+
+  // Tickets whose results are to be added once they succeed, and the ones
+  // that have succeeded but not been taken yet
+  std::set<dss_model::UniversalTicketId> m_TicketsToAdd;
+  std::vector<dss_model::IdType> m_SucceededTicketsToAdd;
+
   // Property model for the current tag's image layer
   typedef AbstractPropertyModel<unsigned long, LayerSelectionDomain> CurrentTagWorkspaceObjectModel;
   SmartPtr<CurrentTagWorkspaceObjectModel> m_CurrentTagWorkspaceObjectModel;
@@ -518,6 +601,11 @@ protected:
 
   // Helper function to get listing of services
   static bool AsyncGetServiceListing(std::vector<dss_model::ServiceSummary> &services);
+
+  // Download the results of a ticket from the current server (or find them in
+  // a local queue) and return the result workspace file
+  static std::string DownloadTicketResultWorkspace(
+      dss_model::IdType ticket_id, const std::string &target_fn, itk::Command *cmd);
 };
 
 #endif // DISTRIBUTEDSEGMENTATIONMODEL_H
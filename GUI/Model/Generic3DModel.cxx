@@ -17,11 +17,20 @@
 #include "ImageWrapperTraits.h"
 #include "SegmentationUpdateIterator.h"
 #include "ImageMeshLayers.h"
+#include "SegmentationMeshWrapper.h"
+#include "LabelImageWrapper.h"
+#include "GlobalState.h"
+#include "DefaultBehaviorSettings.h"
+#include "ImageRayIntersectionFinder.h"
+#include "ColorLabelTable.h"
+#include "TaskScheduler.h"
 
 // All the VTK stuff
 #include "vtkPolyData.h"
 
 #include <vnl/vnl_inverse.h>
+#include <algorithm>
+#include <climits>
 
 Generic3DModel::Generic3DModel()
 {
@@ -47,6 +56,20 @@ Generic3DModel::Generic3DModel()
 
   // Reset clear time
   m_ClearTime = 0;
+
+  m_BackgroundMeshAbort = false;
+
+  // The occupancy mask is built on first use
+  m_LabelOccupancyImage = NULL;
+  m_LabelOccupancyImageMTime = m_LabelOccupancyTableMTime = 0;
+}
+
+Generic3DModel::~Generic3DModel()
+{
+  // The background update must not outlive the model
+  m_BackgroundMeshAbort = true;
+  if(m_BackgroundMeshFuture.valid())
+    m_BackgroundMeshFuture.wait();
 }
 
 #include "itkImage.h"
@@ -65,6 +88,7 @@ void Generic3DModel::Initialize(GlobalUIModel *parent)
 
   // Listen to the layer change events
   Rebroadcast(m_Driver, MainImageDimensionsChangeEvent(), ModelUpdateEvent());
+  Rebroadcast(m_Driver, MainImagePoseChangeEvent(), ModelUpdateEvent());
 
   // Listen to segmentation change events
   Rebroadcast(m_Driver, SegmentationChangeEvent(), StateMachineChangeEvent());
@@ -202,6 +226,13 @@ vtkPolyData *Generic3DModel::GetSprayPoints() const
   return m_SprayPoints.GetPointer();
 }
 
+void Generic3DModel::ClearSprayPoints()
+{
+  m_SprayPoints->GetPoints()->Reset();
+  m_SprayPoints->Modified();
+  m_SprayVoxels.clear();
+}
+
 void Generic3DModel::OnUpdate()
 {
   // If we experienced a change in main image, we have to respond!
@@ -211,12 +242,16 @@ void Generic3DModel::OnUpdate()
     // m_Mesh->DiscardVTKMeshes();
 
     // Clear the spray points
-    m_SprayPoints->GetPoints()->Reset();
-    m_SprayPoints->Modified();
+    this->ClearSprayPoints();
 
     // The geometry has changed
     this->OnImageGeometryUpdate();
     }
+  else if(m_EventBucket->HasEvent(MainImagePoseChangeEvent()))
+    {
+    // The image was reoriented, the spray points are kept in voxel units
+    this->OnImageGeometryUpdate();
+    }
 }
 
 void Generic3DModel::OnImageGeometryUpdate()
@@ -236,6 +271,13 @@ void Generic3DModel::OnImageGeometryUpdate()
 }
 
 void Generic3DModel::UpdateSegmentationMesh(itk::Command *progressCmd)
+{
+  // Results of a background update would be overwritten anyway
+  this->CancelBackgroundMeshUpdate();
+  this->DoUpdateSegmentationMesh(progressCmd);
+}
+
+void Generic3DModel::DoUpdateSegmentationMesh(itk::Command *progressCmd)
 {
   // Prevent concurrent access to this method
   std::lock_guard<std::mutex> guard(m_Mutex);
@@ -268,6 +310,114 @@ void Generic3DModel::UpdateSegmentationMesh(itk::Command *progressCmd)
   }
 }
 
+bool Generic3DModel::UpdateSegmentationMeshInBackground(itk::Command *progressCmd)
+{
+  if(m_BackgroundMeshFuture.valid())
+    {
+    if(m_BackgroundMeshAssembly)
+      {
+      // If the segmentation has been edited, the meshes being computed are
+      // already out of date, so stop and start over
+      LabelImageWrapper *seg = m_Driver->GetSelectedSegmentationLayer();
+      if(seg != m_BackgroundMeshSegmentation
+         || seg->GetImage()->GetMTime() != m_BackgroundMeshAssembly->GetSnapshotMTime())
+        m_BackgroundMeshAbort = true;
+
+      // Show the meshes completed so far
+      else if(m_BackgroundMeshAssembly->InstallCompletedMeshes())
+        InvokeEvent(ModelUpdateEvent());
+      }
+
+    if(m_BackgroundMeshFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return true;
+
+    this->FinishBackgroundMeshUpdate();
+    }
+
+  // Does work need to be done?
+  if(!m_Driver->IsMainImageLoaded() || !this->CheckState(UIF_MESH_DIRTY))
+    return false;
+
+  // Wait out the pause that follows the last update
+  if(Clock::now() < m_NextBackgroundMeshTime)
+    return false;
+
+  m_BackgroundMeshAbort = false;
+  m_BackgroundMeshStartTime = Clock::now();
+  if(!m_Driver->IsSnakeModeLevelSetActive())
+    {
+    // Copy the segmentation here, so that it can be edited while the meshes
+    // are computed
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_BackgroundMeshSegmentation = m_Driver->GetSelectedSegmentationLayer();
+    m_BackgroundMeshAssembly = this->GetMeshLayers()->BeginActiveMeshLayerBackgroundUpdate();
+    }
+
+  if(m_BackgroundMeshAssembly)
+    {
+    SegmentationMeshAssembly *assembly = m_BackgroundMeshAssembly;
+    m_BackgroundMeshFuture = TaskScheduler::GetInstance()->Submit(
+          TaskScheduler::USER_COMPUTE, [this, assembly, progressCmd]()
+      {
+      std::lock_guard<std::mutex> guard(m_Mutex);
+      assembly->ComputeBackgroundUpdate(progressCmd, &m_BackgroundMeshAbort);
+      });
+    }
+  else
+    {
+    // Level set meshes are computed from the live image, guarded by the
+    // level set pipeline mutex
+    m_BackgroundMeshFuture = TaskScheduler::GetInstance()->Submit(
+          TaskScheduler::USER_COMPUTE, [this, progressCmd]()
+      {
+      this->DoUpdateSegmentationMesh(progressCmd);
+      });
+    }
+
+  return true;
+}
+
+void Generic3DModel::FinishBackgroundMeshUpdate()
+{
+  SmartPtr<SegmentationMeshAssembly> assembly = m_BackgroundMeshAssembly;
+  m_BackgroundMeshAssembly = nullptr;
+  m_BackgroundMeshSegmentation = nullptr;
+
+  // Pause long enough that updates take up at most the allowed share of time
+  DefaultBehaviorSettings *dbs = m_Driver->GetGlobalState()->GetDefaultBehaviorSettings();
+  double load = dbs->GetContinuousMeshUpdateMaxLoad() / 100.0;
+  auto busy = Clock::now() - m_BackgroundMeshStartTime;
+  auto pause = std::chrono::duration_cast<Clock::duration>(busy * (1.0 / load - 1.0));
+  auto max_pause = std::chrono::milliseconds(MAX_BACKGROUND_MESH_PAUSE);
+  m_NextBackgroundMeshTime = Clock::now() + (pause < max_pause ? pause : Clock::duration(max_pause));
+
+  try
+  {
+    // This rethrows any exception from the background thread
+    m_BackgroundMeshFuture.get();
+  }
+  catch(std::bad_alloc &)
+  {
+    throw IRISException("Out of memory during mesh computation");
+  }
+
+  if(assembly)
+    {
+    assembly->InstallCompletedMeshes();
+    assembly->EndBackgroundUpdate();
+    InvokeEvent(ModelUpdateEvent());
+    }
+}
+
+void Generic3DModel::CancelBackgroundMeshUpdate()
+{
+  if(m_BackgroundMeshFuture.valid())
+    {
+    m_BackgroundMeshAbort = true;
+    this->FinishBackgroundMeshUpdate();
+    }
+}
+
 bool Generic3DModel::IsMeshUpdating()
 {
   return m_MeshUpdating;
@@ -284,48 +434,79 @@ bool Generic3DModel::AcceptAction()
   // Accept the current action
   if(mode == SPRAYPAINT_MODE)
     {
-    // Anything to update?
-    bool update = false;
-
-    // Merge all the spray points into the segmentation
-    for(int i = 0; i < m_SprayPoints->GetNumberOfPoints(); i++)
+    if(m_SprayVoxels.empty())
+      return false;
+
+    // The voxels in raster order, which is the order of their offsets
+    std::vector<unsigned long> voxels(m_SprayVoxels.begin(), m_SprayVoxels.end());
+    std::sort(voxels.begin(), voxels.end());
+
+    // Find the bounding box of the spray, relative to the image region
+    itk::ImageRegion<3> image_region = app->GetCurrentImageData()->GetImageRegion();
+    unsigned long nx = image_region.GetSize(0), ny = image_region.GetSize(1);
+    unsigned long lo[3] = { ULONG_MAX, ULONG_MAX, ULONG_MAX }, hi[3] = { 0, 0, 0 };
+    for(unsigned long v : voxels)
       {
-      // Find the point in image coordinates
-      double *x = m_SprayPoints->GetPoint(i);
-
-      // Create a region around this one voxel (in the future could use other shapes)
-      SegmentationUpdateIterator::RegionType region;
-      region.SetIndex(0, static_cast<unsigned int>(x[0])); region.SetSize(0, 1);
-      region.SetIndex(1, static_cast<unsigned int>(x[1])); region.SetSize(1, 1);
-      region.SetIndex(2, static_cast<unsigned int>(x[2])); region.SetSize(2, 1);
-
-      // Treat each point as a region update
-      SegmentationUpdateIterator it(seg, region,
-                                    app->GetGlobalState()->GetDrawingColorLabel(),
-                                    app->GetGlobalState()->GetDrawOverFilter());
-
-      for(; !it.IsAtEnd(); ++it)
+      unsigned long p[3] = { v % nx, (v / nx) % ny, v / (nx * ny) };
+      for(unsigned int d = 0; d < 3; d++)
         {
-        it.PaintAsForeground();
+        lo[d] = std::min(lo[d], p[d]);
+        hi[d] = std::max(hi[d], p[d]);
         }
+      }
+
+    SegmentationRunWriter::RegionType region;
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      region.SetIndex(d, image_region.GetIndex(d) + lo[d]);
+      region.SetSize(d, hi[d] - lo[d] + 1);
+      }
 
-      // Store the delta for this update
-      if(it.Finalize())
+    // Merge the spray into the segmentation as runs, one line at a time,
+    // producing a single undo delta
+    SegmentationRunWriter writer(seg, region,
+                                 app->GetGlobalState()->GetDrawingColorLabel(),
+                                 app->GetGlobalState()->GetDrawOverFilter());
+
+    SegmentationRunWriter::UpdateLine update_line;
+    auto add_run = [&update_line](long n, SegmentationUpdateIterator::UpdateType type)
+      {
+      if(n <= 0)
+        return;
+      if(update_line.size() && update_line.back().second == type)
+        update_line.back().first += n;
+      else
+        update_line.push_back(std::make_pair((unsigned int) n, type));
+      };
+
+    auto it_voxel = voxels.begin();
+    for(unsigned long z = lo[2]; z <= hi[2]; z++)
+      {
+      for(unsigned long y = lo[1]; y <= hi[1]; y++)
         {
-        update = true;
-        seg->StoreIntermediateUndoDelta(it.RelinquishDelta());
+        update_line.clear();
+        unsigned long line_start = nx * (y + ny * z), x = lo[0];
+        for(; it_voxel != voxels.end() && *it_voxel < line_start + nx; ++it_voxel)
+          {
+          unsigned long xv = *it_voxel - line_start;
+          add_run(xv - x, SegmentationUpdateIterator::SKIP);
+          add_run(1, SegmentationUpdateIterator::FOREGROUND);
+          x = xv + 1;
+          }
+        add_run(hi[0] + 1 - x, SegmentationUpdateIterator::SKIP);
+
+        writer.PaintLine(image_region.GetIndex(1) + y, image_region.GetIndex(2) + z, update_line);
         }
       }
 
     // Store the undo point
+    bool update = writer.Finalize("3D spray paint");
     if(update)
       {
-      seg->StoreUndoPoint("3D spray paint");
       app->RecordCurrentLabelUse();
 
       // Clear the spray points
-      m_SprayPoints->GetPoints()->Reset();
-      m_SprayPoints->Modified();
+      this->ClearSprayPoints();
       InvokeEvent(SprayPaintEvent());
       }
 
@@ -366,8 +547,7 @@ void Generic3DModel::CancelAction()
   if(mode == SPRAYPAINT_MODE)
     {
     // Clear the spray points
-    m_SprayPoints->GetPoints()->Reset();
-    m_SprayPoints->Modified();
+    this->ClearSprayPoints();
     InvokeEvent(SprayPaintEvent());
     }
   else if(mode == SCALPEL_MODE && m_ScalpelStatus == SCALPEL_LINE_COMPLETED)
@@ -399,9 +579,6 @@ void Generic3DModel::ClearRenderingAction()
   InvokeEvent(ModelUpdateEvent());
 }
 
-#include "ImageRayIntersectionFinder.h"
-#include "SNAPImageData.h"
-
 /** These classes are used internally for m_Ray intersection testing */
 class LabelImageHitTester
 {
@@ -413,8 +590,7 @@ public:
 
   int operator()(LabelType label) const
   {
-    const ColorLabel &cl = m_LabelTable->GetColorLabel(label);
-    return (cl.IsVisible() && cl.IsVisibleIn3D()) ? 1 : 0;
+    return m_LabelTable->IsLabelVisibleIn3D(label) ? 1 : 0;
   }
 
 private:
@@ -428,6 +604,29 @@ public:
     { return levelSetValue <= 0 ? 1 : 0; }
 };
 
+const ImageRayOccupancyMask *Generic3DModel::GetLabelOccupancyMask()
+{
+  const LabelImageWrapperTraits::ImageType *image =
+      m_Driver->GetSelectedSegmentationLayer()->GetImage();
+  const ColorLabelTable *table = m_Driver->GetColorLabelTable();
+
+  if(!m_LabelOccupancyMask
+     || m_LabelOccupancyImage != image
+     || m_LabelOccupancyImageMTime != image->GetMTime()
+     || m_LabelOccupancyTableMTime != table->GetMTime())
+    {
+    if(!m_LabelOccupancyMask)
+      m_LabelOccupancyMask.reset(new ImageRayOccupancyMask());
+
+    m_LabelOccupancyMask->Build(image, LabelImageHitTester(table));
+    m_LabelOccupancyImage = image;
+    m_LabelOccupancyImageMTime = image->GetMTime();
+    m_LabelOccupancyTableMTime = table->GetMTime();
+    }
+
+  return m_LabelOccupancyMask.get();
+}
+
 bool Generic3DModel::IntersectSegmentation(int vx, int vy, Vector3i &hit)
 {
   // World coordinate of the click position and direction
@@ -453,6 +652,7 @@ bool Generic3DModel::IntersectSegmentation(int vx, int vy, Vector3i &hit)
     RayCasterType caster;
     LabelImageHitTester tester(m_ParentUI->GetDriver()->GetColorLabelTable());
     caster.SetHitTester(tester);
+    caster.SetOccupancyMask(this->GetLabelOccupancyMask());
     result = caster.FindIntersection(
           m_ParentUI->GetDriver()->GetSelectedSegmentationLayer()->GetImage(),
           x_image, d_image, hit);
@@ -509,9 +709,15 @@ bool Generic3DModel::SpraySegmentationVoxelUnderMouse(int px, int py)
     itk::ImageRegion<3> region = m_Driver->GetCurrentImageData()->GetImageRegion();
     if(region.IsInside(to_itkIndex(hit)))
       {
-      m_SprayPoints->GetPoints()->InsertNextPoint(hit[0], hit[1], hit[2]);
-      m_SprayPoints->Modified();
-      this->InvokeEvent(SprayPaintEvent());
+      // Only voxels that are not yet sprayed get a glyph
+      unsigned long offset = region.GetSize(0) * (region.GetSize(1) * (hit[2] - region.GetIndex(2))
+          + (hit[1] - region.GetIndex(1))) + (hit[0] - region.GetIndex(0));
+      if(m_SprayVoxels.insert(offset).second)
+        {
+        m_SprayPoints->GetPoints()->InsertNextPoint(hit[0], hit[1], hit[2]);
+        m_SprayPoints->Modified();
+        this->InvokeEvent(SprayPaintEvent());
+        }
       return true;
       }
     }
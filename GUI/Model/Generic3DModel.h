@@ -6,6 +6,11 @@
 #include "vtkSmartPointer.h"
 #include "SNAPEvents.h"
 #include <mutex>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <memory>
+#include <unordered_set>
 
 class GlobalUIModel;
 class IRISApplication;
@@ -14,6 +19,9 @@ class Generic3DRenderer;
 class vtkPolyData;
 class MeshExportSettings;
 class ImageMeshLayers;
+class SegmentationMeshAssembly;
+class LabelImageWrapper;
+class ImageRayOccupancyMask;
 
 namespace itk
 {
@@ -37,6 +45,7 @@ public:
   typedef vnl_matrix_fixed<double, 4, 4> Mat4d;
 
   Generic3DModel();
+  virtual ~Generic3DModel();
 
   // States pertaining to this model
   enum UIState {
@@ -60,7 +69,6 @@ public:
   bool CheckState(UIState state);
 
   // A flag indicating that the mesh should be continually updated
-  // TODO: replace this with an update in a background thread
   irisSimplePropertyAccessMacro(ContinuousUpdate, bool)
 
   // A flag indicating the color bar should be displayed
@@ -72,6 +80,18 @@ public:
   // Reentrant function to check if mesh is being constructed in another thread
   bool IsMeshUpdating();
 
+  // Keep the segmentation mesh up to date without blocking the caller. This
+  // is meant to be called periodically from the GUI thread. A background
+  // update is started when the mesh is dirty and aborted if the segmentation
+  // changes before it finishes. Meshes are swapped into the scene one label
+  // at a time as they are completed. Updates are spaced out based on how long
+  // the last one took, so that they respect the ContinuousMeshUpdateMaxLoad
+  // preference. Returns true while an update is running.
+  bool UpdateSegmentationMeshInBackground(itk::Command *progressCmd);
+
+  // Abort the background mesh update, if any, and wait for it to finish
+  void CancelBackgroundMeshUpdate();
+
   // Accept the current drawing operation
   bool AcceptAction();
 
@@ -166,6 +186,14 @@ protected:
   // Set of spraypainted points in image coordinates
   vtkSmartPointer<vtkPolyData> m_SprayPoints;
 
+  // The same voxels, as offsets into the image region. Spraying over a
+  // voxel that is already sprayed adds no point, so the glyphs and the
+  // update stay proportional to the number of distinct voxels
+  std::unordered_set<unsigned long> m_SprayVoxels;
+
+  // Discard the spray points
+  void ClearSprayPoints();
+
   // On-screen endpoints of the scalpel line
   Vector2i m_ScalpelStart, m_ScalpelEnd;
 
@@ -189,6 +217,39 @@ protected:
 
   // A mutex to allow background processing of mesh updates
   std::mutex m_Mutex;
+
+  // Update the segmentation mesh on the calling thread
+  void DoUpdateSegmentationMesh(itk::Command *progressCmd);
+
+  // Collect the background mesh update once it has finished
+  void FinishBackgroundMeshUpdate();
+
+  // The background mesh update, the flag used to abort it, and the assembly
+  // and segmentation it is for (these are null for level set meshes, which
+  // are updated by DoUpdateSegmentationMesh in the background)
+  std::future<void> m_BackgroundMeshFuture;
+  std::atomic<bool> m_BackgroundMeshAbort;
+  SmartPtr<SegmentationMeshAssembly> m_BackgroundMeshAssembly;
+  SmartPtr<LabelImageWrapper> m_BackgroundMeshSegmentation;
+
+  // Start time of the background mesh update, and the earliest time at which
+  // the next one may start
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point m_BackgroundMeshStartTime, m_NextBackgroundMeshTime;
+
+  // Longest pause between continuous mesh updates, in milliseconds, so that
+  // the 3D view does not lag far behind the edits when rebuilds are slow
+  static constexpr int MAX_BACKGROUND_MESH_PAUSE = 1000;
+
+  // Occupancy mask of the visible labels in the selected segmentation, used
+  // to skip empty space when picking and spray painting. It is rebuilt when
+  // the segmentation or the label table changes
+  std::unique_ptr<ImageRayOccupancyMask> m_LabelOccupancyMask;
+  const itk::Object *m_LabelOccupancyImage;
+  unsigned long m_LabelOccupancyImageMTime, m_LabelOccupancyTableMTime;
+
+  // Get the occupancy mask, rebuilding it if needed
+  const ImageRayOccupancyMask *GetLabelOccupancyMask();
 };
 
 #endif // GENERIC3DMODEL_H
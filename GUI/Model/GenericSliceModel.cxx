@@ -317,6 +317,12 @@ Vector3d GenericSliceModel::MapSliceToImage(const Vector3d &xSlice)
   return m_DisplayToImageTransform->TransformPoint(xSlice);
 }
 
+void GenericSliceModel::MapSliceToImage(const Vector3d *xSlice, Vector3d *xImage, size_t n)
+{
+  assert(IsSliceInitialized());
+  m_DisplayToImageTransform->TransformPoints(xSlice, xImage, n);
+}
+
 Vector3d GenericSliceModel::MapSliceToImagePhysical(const Vector3d &xSlice)
 {
   Vector3d xImage = this->MapSliceToImage(xSlice);
@@ -335,6 +341,12 @@ Vector3d GenericSliceModel::MapImageToSlice(const Vector3d &xImage)
   return  m_ImageToDisplayTransform->TransformPoint(xImage);
 }
 
+void GenericSliceModel::MapImageToSlice(const Vector3d *xImage, Vector3d *xSlice, size_t n)
+{
+  assert(IsSliceInitialized());
+  m_ImageToDisplayTransform->TransformPoints(xImage, xSlice, n);
+}
+
 Vector2d GenericSliceModel::MapSliceToWindow(const Vector3d &xSlice)
 {
   assert(IsSliceInitialized());
@@ -353,6 +365,22 @@ Vector2d GenericSliceModel::MapSliceToWindow(const Vector3d &xSlice)
   return uvWindow;
 }
 
+void GenericSliceModel::MapSliceToWindow(const Vector3d *xSlice, Vector2d *uvWindow, size_t n)
+{
+  assert(IsSliceInitialized());
+
+  // The same mapping as above, as uvWindow = scale * xSlice + offset
+  Vector2ui size = this->GetCanvasSize();
+  Vector2d scale(m_ViewZoom * m_SliceSpacing(0), m_ViewZoom * m_SliceSpacing(1));
+  Vector2d offset = Vector2d(0.5 * size[0], 0.5 * size[1]) - m_ViewPosition * m_ViewZoom;
+
+  for(size_t i = 0; i < n; i++)
+    {
+    uvWindow[i][0] = scale[0] * xSlice[i][0] + offset[0];
+    uvWindow[i][1] = scale[1] * xSlice[i][1] + offset[1];
+    }
+}
+
 std::pair<Vector2d, Vector2d>
 GenericSliceModel::GetSliceCornersInWindowCoordinates() const
 {
@@ -1040,6 +1068,15 @@ void GenericSliceModel::UpdateUpstreamViewportGeometry()
   dispimg->SetOrigin(to_itkPoint(origin));
   dispimg->SetDirection(dir);
   dispimg->SetRegions(region);
+
+  // Layers only need to be sliced within the viewport, except for the main
+  // layer, which the zoom thumbnail displays whole
+  bool thumb = this->IsThumbnailOn();
+  for(LayerIterator it = gid->GetLayers(); !it.IsAtEnd(); ++it)
+    {
+    it.GetLayer()->SetSlicingRestrictedToViewport(
+          this->GetId(), !(thumb && it.GetLayer() == gid->GetMain()));
+    }
 }
 
 ImageWrapperBase *GenericSliceModel::GetLayerForNthTile(int row, int col)
@@ -1236,39 +1273,26 @@ GenericSliceModel
   seg_temp->Allocate();
 
   // Convert the triangles into the data structure expected by scan converter and subtract
-  // the lower corner since the rasterization code expects the image to start at the
-  // coordinate zero
-  double **varr = new double *[tri_pd->GetNumberOfCells() * 3];
-  for(unsigned int i = 0; i < tri_pd->GetNumberOfCells(); i++)
+  // the lower corner of the region since the rasterization code expects the image to
+  // start at the coordinate zero
+  vtkIdType n_tri = tri_pd->GetNumberOfCells();
+  std::vector<double> vdata(n_tri * 9);
+  std::vector<double *> varr(n_tri * 3);
+  for(vtkIdType i = 0; i < n_tri; i++)
     {
     for(unsigned int j = 0; j < 3; j++)
       {
-      varr[i * 3 + j] = new double[3];
-      tri_pd->GetPoint(tri_pd->GetCell(i)->GetPointId(j), varr[i * 3 + j]);
+      double *v = varr[i * 3 + j] = &vdata[(i * 3 + j) * 3];
+      tri_pd->GetPoint(tri_pd->GetCell(i)->GetPointId(j), v);
       for(unsigned int k = 0; k < 3; k++)
-        varr[i * 3 + j][k] -= ext_min[k];
+        v[k] -= seg_region.GetIndex()[k];
       }
     }
 
-  // Image dimensions
-  int seg_dim[3] = { (int) seg_region.GetSize()[0], (int) seg_region.GetSize()[1], (int) seg_region.GetSize()[2] };
-  int w_line = seg_dim[2];
-
-  // Get the segmentation image and create an iterator for it
-  using RLEIter = itk::ImageRegionIterator<LabelImageWrapper::ImageType>;
-  RLEIter it_temp(seg_temp, seg_region);
-
-  // Create a lambda that can update pixels in an RLE image via the iterator
-  auto functor = [&it_temp](auto *img, int offset)
-    {
-    // Go to the indexed vertex and set value to 1
-    it_temp.SetIndex(img->ComputeIndex(offset));
-    it_temp.Set(1);
-    };
-
-  // Actual call to the scan conversion code
-  // DrawBinaryTrianglesSheetFilled(seg->GetModifiableImage(), seg_dim, varr, tri_pd->GetNumberOfCells(), functor);
-  cpu_voxelizer::DrawBinaryTrianglesSheetFilled(seg_temp.GetPointer(), seg_dim, varr, tri_pd->GetNumberOfCells(), functor);
+  // Scan convert straight into the runs of the RLE image, in parallel. Setting
+  // the voxels one at a time would split and merge its runs on every write
+  cpu_voxelizer::DrawTrianglesIntoRLEImage(
+        seg_temp.GetPointer(), varr.data(), (int) n_tri, (LabelType) 1);
 
   // Update the segmentation via IRIS
   m_Driver->UpdateSegmentationWithBinarySegmentation(seg_temp, undoTitle, invert, reverse);
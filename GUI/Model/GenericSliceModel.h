@@ -175,6 +175,12 @@ public:
    */
   Vector2d MapSliceToWindow(const Vector3d &xSlice);
 
+  /**
+   * Map an array of n points in slice coordinates to window coordinates.
+   * The zoom and pan are combined into one scale and offset per call.
+   */
+  void MapSliceToWindow(const Vector3d *xSlice, Vector2d *uvWindow, size_t n);
+
   /**
    * Get the corners of the slide in window coordinates
    */
@@ -195,6 +201,12 @@ public:
    */
   Vector3d MapSliceToImage(const Vector3d &xSlice);
 
+  /**
+   * Map an array of n points in slice coordinates to image coordinates.
+   * The arrays may be the same.
+   */
+  void MapSliceToImage(const Vector3d *xSlice, Vector3d *xImage, size_t n);
+
   /**
    * Map a point in slice coordinates to a point in image physical coordinates
    * (the ITK LPS coordinate system)
@@ -206,6 +218,12 @@ public:
    */
   Vector3d MapImageToSlice(const Vector3d &xImage);
 
+  /**
+   * Map an array of n points in image coordinates to slice coordinates.
+   * The arrays may be the same.
+   */
+  void MapImageToSlice(const Vector3d *xImage, Vector3d *xSlice, size_t n);
+
   /**
    * Get the cursor position in slice coordinates, shifted to the center
    * of the voxel
@@ -71,10 +71,16 @@
 #include "InterpolateLabelModel.h"
 #include "SmoothLabelsModel.h"
 #include "VoxelChangeReportModel.h"
+#include "LayerFileWatchModel.h"
 #include "RegistrationModel.h"
 #include "InteractiveRegistrationModel.h"
 #include "DistributedSegmentationModel.h"
 #include "ImageMeshLayers.h"
+#include "SNAPProfiler.h"
+#include "SNAPLatencyMonitor.h"
+#include "SNAPEventListenerCallbacks.h"
+#include "TaskScheduler.h"
+#include <sstream>
 
 #include <itksys/SystemTools.hxx>
 
@@ -109,10 +115,6 @@ GlobalUIModel::GlobalUIModel()
   m_RegistrationModel = RegistrationModel::New();
   m_RegistrationModel->SetParentModel(this);
 
-  // Distributed segmentation model
-  m_DistributedSegmentationModel = DistributedSegmentationModel::New();
-  m_DistributedSegmentationModel->SetParentModel(this);
-
   // Create the slice models
   for (unsigned int i = 0; i < 3; i++)
     {
@@ -179,10 +181,6 @@ GlobalUIModel::GlobalUIModel()
   m_LabelEditorModel = LabelEditorModel::New();
   m_LabelEditorModel->SetParentModel(this);
 
-  // Reorient image model
-  m_ReorientImageModel = ReorientImageModel::New();
-  m_ReorientImageModel->SetParentModel(this);
-
   // Cursor inspection
   m_CursorInspectionModel = CursorInspectionModel::New();
   m_CursorInspectionModel->SetParentModel(this);
@@ -203,34 +201,10 @@ GlobalUIModel::GlobalUIModel()
   m_SnakeParameterModel = SnakeParameterModel::New();
   m_SnakeParameterModel->SetParentModel(this);
 
-  // Mesh export model
-  m_MeshExportModel = MeshExportModel::New();
-  m_MeshExportModel->SetParentModel(this);
-
-  // Mesh import model
-  m_MeshImportModel = MeshImportModel::New();
-  m_MeshImportModel->SetParentModel(this);
-
-  // Global prefs model
-  m_GlobalPreferencesModel = GlobalPreferencesModel::New();
-  m_GlobalPreferencesModel->SetParentModel(this);
-
   // Quick list of color labels
   m_ColorLabelQuickListModel = ColorLabelQuickListModel::New();
   m_ColorLabelQuickListModel->SetParentModel(this);
 
-  // Interpolation dialog
-  m_InterpolateLabelModel = InterpolateLabelModel::New();
-  m_InterpolateLabelModel->SetParentModel(this);
-
-  // issue #24: Label smoothing feature
-  m_SmoothLabelsModel = SmoothLabelsModel::New();
-  m_SmoothLabelsModel->SetParentModel(this);
-
-  // issue #24: Voxel Change Report
-  m_VoxelChangeReportModel = VoxelChangeReportModel::New();
-  m_VoxelChangeReportModel->SetParentModel(this);
-
   // Set up the cursor position model
   m_CursorPositionModel = wrapGetterSetterPairAsProperty(
         this,
@@ -321,6 +295,9 @@ GlobalUIModel::GlobalUIModel()
   Rebroadcast(m_Driver, LayerChangeEvent(), LayerChangeEvent());
   Rebroadcast(m_Driver, LayerChangeEvent(), StateMachineChangeEvent());
 
+  // Keep the description of the session stored with slow operations current
+  AddListener(m_Driver, LayerChangeEvent(), this, &GlobalUIModel::UpdateLatencyMonitorContext);
+
   // Rebroadcast image layer change events
   Rebroadcast(m_Driver, WrapperMetadataChangeEvent(), StateMachineChangeEvent());
 
@@ -358,6 +335,94 @@ GlobalUIModel::~GlobalUIModel()
 {
 }
 
+void GlobalUIModel::UpdateLatencyMonitorContext()
+{
+  std::ostringstream oss;
+  GenericImageData *id = m_Driver->GetCurrentImageData();
+  if(id && id->IsMainLoaded())
+    {
+    Vector3ui size = id->GetMain()->GetSize();
+    oss << "Main image " << size[0] << "x" << size[1] << "x" << size[2]
+        << ", " << id->GetNumberOfTimePoints() << " time points, "
+        << id->GetNumberOfLayers() << " layers ("
+        << id->GetNumberOfLayers(LABEL_ROLE) << " segmentations), "
+        << id->GetMeshLayers()->size() << " meshes";
+    }
+  else
+    {
+    oss << "No image loaded";
+    }
+  oss << ", " << TaskScheduler::GetInstance()->GetNumberOfThreads() << " threads";
+
+  SNAPLatencyMonitor::SetContext(oss.str());
+}
+
+// Models that are only needed by dialogs and wizards are created when they are
+// first requested, so that they do not slow down startup
+template <class TModel>
+static TModel *CreateModelOnDemand(SmartPtr<TModel> &model, GlobalUIModel *parent)
+{
+  if(!model)
+    {
+    model = TModel::New();
+    model->SetParentModel(parent);
+    }
+  return model;
+}
+
+ReorientImageModel *GlobalUIModel::GetReorientImageModel()
+{
+  return CreateModelOnDemand(m_ReorientImageModel, this);
+}
+
+MeshExportModel *GlobalUIModel::GetMeshExportModel()
+{
+  return CreateModelOnDemand(m_MeshExportModel, this);
+}
+
+MeshImportModel *GlobalUIModel::GetMeshImportModel()
+{
+  return CreateModelOnDemand(m_MeshImportModel, this);
+}
+
+GlobalPreferencesModel *GlobalUIModel::GetGlobalPreferencesModel()
+{
+  return CreateModelOnDemand(m_GlobalPreferencesModel, this);
+}
+
+InterpolateLabelModel *GlobalUIModel::GetInterpolateLabelModel()
+{
+  return CreateModelOnDemand(m_InterpolateLabelModel, this);
+}
+
+DistributedSegmentationModel *GlobalUIModel::GetDistributedSegmentationModel()
+{
+  if(!m_DistributedSegmentationModel)
+    {
+    CreateModelOnDemand(m_DistributedSegmentationModel, this);
+
+    // Read the preferences that were loaded with the rest of the registry
+    m_DistributedSegmentationModel->LoadPreferences(
+          m_Driver->GetSystemInterface()->Folder("DistributedSegmentationSystem"));
+    }
+  return m_DistributedSegmentationModel;
+}
+
+SmoothLabelsModel *GlobalUIModel::GetSmoothLabelsModel()
+{
+  return CreateModelOnDemand(m_SmoothLabelsModel, this);
+}
+
+VoxelChangeReportModel *GlobalUIModel::GetVoxelChangeReportModel()
+{
+  return CreateModelOnDemand(m_VoxelChangeReportModel, this);
+}
+
+LayerFileWatchModel *GlobalUIModel::GetLayerFileWatchModel()
+{
+  return CreateModelOnDemand(m_LayerFileWatchModel, this);
+}
+
 bool GlobalUIModel::CheckState(UIState state)
 {
   // TODO: implement all the other cases
@@ -523,6 +588,10 @@ void GlobalUIModel::SetGlobalDisplaySettings(
   // Update the global display settings
   m_GlobalDisplaySettings->DeepCopy(settings);
 
+  // The profiling overlay records timings while it is shown
+  SNAPProfiler::SetEnabled(SNAPProfiler::PREFERENCES,
+                           m_GlobalDisplaySettings->GetFlagProfilingOverlay());
+
   // Update the RAI codes in all slice views
   m_Driver->SetDisplayGeometry(IRISDisplayGeometry(raiNew[0], raiNew[1], raiNew[2]));
 
@@ -605,9 +674,11 @@ void GlobalUIModel::LoadUserPreferences()
   m_PolygonSettingsModel->LoadFromRegistry(
         si->Folder("UserInterface.PolygonSettings"));
 
-  // Read the DSS-related preferences
-  m_DistributedSegmentationModel->LoadPreferences(
-        si->Folder("DistributedSegmentationSystem"));
+  // Read the DSS-related preferences. If the DSS model has not been created
+  // yet, it reads them from the registry when it is first requested
+  if(m_DistributedSegmentationModel)
+    m_DistributedSegmentationModel->LoadPreferences(
+          si->Folder("DistributedSegmentationSystem"));
 }
 
 void GlobalUIModel::SaveUserPreferences()
@@ -634,9 +705,11 @@ void GlobalUIModel::SaveUserPreferences()
   m_PolygonSettingsModel->SaveToRegistry(
         si->Folder("UserInterface.PolygonSettings"));
 
-  // Write the DSS-related preferences
-  m_DistributedSegmentationModel->SavePreferences(
-        si->Folder("DistributedSegmentationSystem"));
+  // Write the DSS-related preferences. If the DSS model was never created,
+  // the registry still holds the preferences that were read at startup
+  if(m_DistributedSegmentationModel)
+    m_DistributedSegmentationModel->SavePreferences(
+          si->Folder("DistributedSegmentationSystem"));
 
   // Save the preferences
   si->SaveUserPreferences();
@@ -1065,11 +1138,9 @@ void
 GlobalUIModel
 ::ProgressCallback(itk::Object *source, const itk::EventObject &event)
 {
+  // The delegate samples the progress at frame rate and handles cancellation
   if(m_ProgressReporterDelegate)
-    {
-    itk::ProcessObject *po = static_cast<itk::ProcessObject *>(source);
-    m_ProgressReporterDelegate->SetProgressValue(po->GetProgress());
-    }
+    m_ProgressReporterDelegate->ProgressCallback(source, event);
 }
 
 int
@@ -79,6 +79,7 @@ class RegistrationModel;
 class DistributedSegmentationModel;
 class SmoothLabelsModel;
 class VoxelChangeReportModel;
+class LayerFileWatchModel;
 
 namespace itk
 {
@@ -208,8 +209,8 @@ public:
   /** Get the model for the label editor */
   irisGetMacro(LabelEditorModel, LabelEditorModel *)
 
-  /** Get the model for image reorientation */
-  irisGetMacro(ReorientImageModel, ReorientImageModel *)
+  /** Get the model for image reorientation (created on first use) */
+  ReorientImageModel *GetReorientImageModel();
 
   /** Get the model that handles UI for the cursor inspector */
   irisGetMacro(CursorInspectionModel, CursorInspectionModel *)
@@ -235,33 +236,36 @@ public:
   /** Model for the snake ROI resampling */
   irisGetMacro(SnakeROIResampleModel, SnakeROIResampleModel *)
 
-  /** Model for the mesh export wizard */
-  irisGetMacro(MeshExportModel, MeshExportModel *)
+  /** Model for the mesh export wizard (created on first use) */
+  MeshExportModel *GetMeshExportModel();
 
-  /** Model for the mesh import wizard */
-  irisGetMacro(MeshImportModel, MeshImportModel *)
+  /** Model for the mesh import wizard (created on first use) */
+  MeshImportModel *GetMeshImportModel();
 
-  /** Model for the preferences dialog */
-  irisGetMacro(GlobalPreferencesModel, GlobalPreferencesModel *)
+  /** Model for the preferences dialog (created on first use) */
+  GlobalPreferencesModel *GetGlobalPreferencesModel();
 
   /** Model for the list of recently used color labels */
   irisGetMacro(ColorLabelQuickListModel, ColorLabelQuickListModel *)
 
-  /** Model for the interpolate labels dialog */
-  irisGetMacro(InterpolateLabelModel, InterpolateLabelModel *)
+  /** Model for the interpolate labels dialog (created on first use) */
+  InterpolateLabelModel *GetInterpolateLabelModel();
 
   /** Model for image registration */
   irisGetMacro(RegistrationModel, RegistrationModel *)
 
-  /** Model for distributed image segmentation */
-  irisGetMacro(DistributedSegmentationModel, DistributedSegmentationModel *)
+  /** Model for distributed image segmentation (created on first use) */
+  DistributedSegmentationModel *GetDistributedSegmentationModel();
 
   // issue #24
-  /** Model for label smoothing dialog */
-  irisGetMacro(SmoothLabelsModel, SmoothLabelsModel *)
+  /** Model for label smoothing dialog (created on first use) */
+  SmoothLabelsModel *GetSmoothLabelsModel();
 
-  /** Model for voxel change report dialog */
-  irisGetMacro(VoxelChangeReportModel, VoxelChangeReportModel *)
+  /** Model for voxel change report dialog (created on first use) */
+  VoxelChangeReportModel *GetVoxelChangeReportModel();
+
+  /** Model that reloads layers whose files change on disk (created on first use) */
+  LayerFileWatchModel *GetLayerFileWatchModel();
 
   /**
     Check the state of the system. This class will issue StateChangeEvent()
@@ -366,6 +370,9 @@ protected:
   // Callback for reporting progress
   void ProgressCallback(itk::Object *source, const itk::EventObject &event);
 
+  // Describe the loaded layers to the latency monitor
+  void UpdateLatencyMonitorContext();
+
   SmartPtr<IRISApplication> m_Driver;
 
   SmartPtr<SNAPAppearanceSettings> m_AppearanceSettings;
@@ -463,6 +470,9 @@ protected:
   // Issue #24: Voxel Change Report Model
   SmartPtr<VoxelChangeReportModel> m_VoxelChangeReportModel;
 
+  // Model that reloads layers whose files change on disk
+  SmartPtr<LayerFileWatchModel> m_LayerFileWatchModel;
+
   // Current coordinates of the cursor
   SmartPtr<AbstractRangedUIntVec3Property> m_CursorPositionModel;
   bool GetCursorPositionValueAndRange(
@@ -135,7 +135,10 @@ ImageIOWizardModel::GuessFileFormat(
   // For files that don't exist, format can not be reported
   if(m_Mode == LOAD)
     {
-    fileExists = itksys::SystemTools::FileExists(fname.c_str(), true);
+    // Zarr stores are directories
+    fileExists = itksys::SystemTools::FileExists(fname.c_str(), true)
+        || (itksys::SystemTools::FileIsDirectory(fname)
+            && GuidedNativeImageIO::GuessFormatForFileName(fname, false) == GuidedNativeImageIO::FORMAT_ZARR);
     if(!fileExists)
       return GuidedNativeImageIO::FORMAT_COUNT;
     }
@@ -334,6 +337,9 @@ void ImageIOWizardModel::OpenImage(std::string filename, ImageReadingProgressAcc
     // Clear the warnings
     m_Warnings.clear();
 
+    // Apply the delegate's settings to the IO
+    m_LoadDelegate->ConfigureImageIO(m_GuidedIO);
+
     // Load the header
 		m_GuidedIO->ReadNativeImageHeader(filename.c_str(), m_Registry, headerProgCmd);
 
@@ -352,6 +358,7 @@ void ImageIOWizardModel::OpenImage(std::string filename, ImageReadingProgressAcc
     // Update the application
     m_LoadedImage =	
         m_LoadDelegate->UpdateApplicationWithImage(m_GuidedIO);
+    m_Parent->GetDriver()->EnforceMemoryBudget();
 
 		miscProgSrc->AddProgress(0.9);
 
@@ -380,6 +387,22 @@ void ImageIOWizardModel::OpenImage(std::string filename, ImageReadingProgressAcc
   }
 }
 
+bool ImageIOWizardModel::CanLoadRegion() const
+{
+  return IsLoadMode()
+      && dynamic_cast<LoadAnatomicImageDelegate *>(m_LoadDelegate.GetPointer());
+}
+
+void ImageIOWizardModel::SetLoadRegion(const Vector3i &index, const Vector3i &size, int subsample)
+{
+  m_GuidedIO->SetLoadRegion(index, size, subsample);
+}
+
+void ImageIOWizardModel::ClearLoadRegion()
+{
+  m_GuidedIO->ClearLoadRegion();
+}
+
 void ImageIOWizardModel::SaveImage(std::string filename)
 {
   try
@@ -410,6 +433,8 @@ bool ImageIOWizardModel::CheckImageValidity()
 void ImageIOWizardModel::Reset()
 {
   m_Registry.Clear();
+  if(m_GuidedIO.IsNotNull())
+    m_GuidedIO->ClearLoadRegion();
 }
 
 void ImageIOWizardModel::ProcessDicomDirectory(const std::string &filename,
@@ -142,6 +142,21 @@ public:
     */
 	void OpenImage(std::string filename, ImageReadingProgressAccumulator *irAccum);
 
+  /**
+    Whether the image may be loaded partially, i.e., a box of voxels and/or
+    every n-th voxel. This is offered for anatomical images only.
+    */
+  bool CanLoadRegion() const;
+
+  /**
+    Load only a region of the image, see GuidedNativeImageIO::SetLoadRegion.
+    A size of zero along an axis loads the full extent of the image.
+    */
+  void SetLoadRegion(const Vector3i &index, const Vector3i &size, int subsample);
+
+  /** Load the whole image */
+  void ClearLoadRegion();
+
   /**
    Save the image to a filename
    */
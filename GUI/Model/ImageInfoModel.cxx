@@ -1,8 +1,11 @@
 #include "ImageInfoModel.h"
 #include "LayerAssociation.h"
 #include "MetaDataAccess.h"
+#include "MemoryAccounting.h"
 #include <cctype>
 #include <algorithm>
+#include <iomanip>
+#include <sstream>
 
 
 // This compiles the LayerAssociation for the color map
@@ -51,6 +54,9 @@ ImageInfoModel::ImageInfoModel()
   m_ImagePixelFormatDescriptionModel = wrapGetterSetterPairAsProperty(
         this, &Self::GetImagePixelFormatDescription);
 
+  m_ImageMemoryUsageModel = wrapGetterSetterPairAsProperty(
+        this, &Self::GetImageMemoryUsage);
+
   // Create the property model for the filter
   m_MetadataFilterModel = ConcreteSimpleStringProperty::New();
 
@@ -245,6 +251,39 @@ bool ImageInfoModel::GetImagePixelFormatDescription(std::string &value)
   return true;
 }
 
+// Print a number of bytes in MB or GB
+static void PrintMemorySize(std::ostream &os, size_t bytes)
+{
+  double mb = bytes / (1024.0 * 1024.0);
+  if(mb < 1024.0)
+    os << std::fixed << std::setprecision(1) << mb << " MB";
+  else
+    os << std::fixed << std::setprecision(2) << mb / 1024.0 << " GB";
+}
+
+bool ImageInfoModel::GetImageMemoryUsage(std::string &value)
+{
+  WrapperBase *l = this->GetLayer();
+  if(!l) return false;
+
+  MemoryAccounting::Usage layer_usage;
+  l->GetMemoryUsage(layer_usage);
+
+  MemoryAccounting *ma = MemoryAccounting::GetInstance();
+  std::ostringstream oss;
+  PrintMemorySize(oss, layer_usage.GetTotal());
+  oss << " (all layers: ";
+  PrintMemorySize(oss, ma->GetTotalUsage().GetTotal());
+  if(ma->GetBudget())
+    {
+    oss << " of ";
+    PrintMemorySize(oss, ma->GetBudget());
+    }
+  oss << ")";
+  value = oss.str();
+  return true;
+}
+
 bool
 ImageInfoModel
 ::GetCurrentTimePointValueAndRange(
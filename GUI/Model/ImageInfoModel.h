@@ -60,6 +60,9 @@ public:
   irisGetMacro(ImageNumberOfTimePointsModel, AbstractSimpleUIntProperty *)
   irisGetMacro(ImageCurrentTimePointModel, AbstractRangedUIntProperty *)
   irisGetMacro(ImagePixelFormatDescriptionModel, AbstractSimpleStringProperty *)
+
+  /** Memory held by the layer, and by all layers and caches against the budget */
+  irisGetMacro(ImageMemoryUsageModel, AbstractSimpleStringProperty *)
   irisGetMacro(ImageScalarIntensityUnderCursorModel, AbstractSimpleDoubleProperty *)
 
   /** This model reports whether the active layer is in reference space */
@@ -99,6 +102,7 @@ protected:
   SmartPtr<AbstractRangedUIntProperty> m_ImageCurrentTimePointModel;
   SmartPtr<AbstractSimpleDoubleProperty> m_ImageScalarIntensityUnderCursorModel;
   SmartPtr<AbstractSimpleStringProperty> m_ImagePixelFormatDescriptionModel;
+  SmartPtr<AbstractSimpleStringProperty> m_ImageMemoryUsageModel;
 
 
   bool GetImageIsInReferenceSpace(bool &value);
@@ -113,6 +117,7 @@ protected:
   bool GetImageNumberOfTimePoints(unsigned int &value);
   bool GetImageScalarIntensityUnderCursor(double &value);
   bool GetImagePixelFormatDescription(std::string &value);
+  bool GetImageMemoryUsage(std::string &value);
 
   // Current time point model
   bool GetCurrentTimePointValueAndRange(unsigned int &value, NumericValueRange<unsigned int> *range);
@@ -122,16 +122,26 @@ InteractiveRegistrationModel::~InteractiveRegistrationModel()
 }
 
 
+void InteractiveRegistrationModel::SetDragPreview(bool on)
+{
+  // Layers that are sliced orthogonally are not affected
+  GenericImageData *gid = this->GetParent()->GetDriver()->GetCurrentImageData();
+  for(LayerIterator it = gid->GetLayers(ALL_ROLES); !it.IsAtEnd(); ++it)
+    it.GetLayer()->SetObliqueSlicingSubsampling(on ? DRAG_PREVIEW_SUBSAMPLING : 1);
+}
+
 bool InteractiveRegistrationModel::ProcessPushEvent(const Vector3d &xSlice)
 {
   if(m_HoveringOverRotationWidget)
     {
     m_LastTheta = 0;
+    this->SetDragPreview(true);
     return true;
     }
   else if(m_HoveringOverMovingLayer)
     {
     m_LastDisplacement = 0;
+    this->SetDragPreview(true);
     return true;
     }
   else
@@ -252,6 +262,9 @@ InteractiveRegistrationModel
 
 bool InteractiveRegistrationModel::ProcessReleaseEvent(const Vector3d &xSlice, const Vector3d &xDragStart)
 {
+  // The last update of the transform is displayed at full resolution
+  this->SetDragPreview(false);
+
   bool status = this->ProcessDragEvent(xSlice, xDragStart);
   m_LastTheta = 0;
   return status;
@@ -82,6 +82,12 @@ protected:
   GenericSliceModel *m_Parent;
   RegistrationModel *m_RegistrationModel;
 
+  // Subsampling of the oblique slices while the moving layer is dragged
+  static constexpr unsigned int DRAG_PREVIEW_SUBSAMPLING = 2;
+
+  // Switch the oblique slicing of all layers between preview and full resolution
+  void SetDragPreview(bool on);
+
   // Radius of the rotation widget circle in slice coordinates
   double m_RotationWidgetRadius;
 
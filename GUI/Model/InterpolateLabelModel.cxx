@@ -6,6 +6,8 @@
 #include "itkMorphologicalContourInterpolator.h"
 #include "SegmentationUpdateIterator.h"
 #include "itkBinaryThresholdImageFilter.h"
+#include "RLERegionOfInterestImageFilter.h"
+#include <mutex>
 
 // SR added
 #include "itkBWAandRFinterpolation.h"
@@ -59,26 +61,86 @@ void InterpolateLabelModel::Interpolate()
   if(method == MORPHOLOGY)
     {
 
+    typedef GenericImageData::LabelImageType LabelImageType;
+    LabelImageType *seg = liw->GetImage();
+
+    // The interpolated contours lie between the annotated slices, so only the
+    // bounding box of the labels being interpolated needs to be processed
+    long lo[3], hi[3];
+    for(int d = 0; d < 3; d++)
+      {
+      lo[d] = seg->GetBufferedRegion().GetUpperIndex()[d] + 1;
+      hi[d] = seg->GetBufferedRegion().GetIndex(d) - 1;
+      }
+
+    LabelType l_bbox = this->GetInterpolateLabel();
+    std::mutex bbox_mutex;
+    seg->ParallelForEachLine(
+          seg->GetBufferedRegion(),
+          [&](LabelImageType::RLLine &line, const LabelImageType::IndexType &idx)
+    {
+      long x = idx[0], x_lo = -1, x_hi = -1;
+      for(auto &rl : line)
+        {
+        if(rl.second && (interp_all || rl.second == l_bbox))
+          {
+          if(x_lo < 0)
+            x_lo = x;
+          x_hi = x + rl.first - 1;
+          }
+        x += rl.first;
+        }
+
+      if(x_lo >= 0)
+        {
+        std::lock_guard<std::mutex> guard(bbox_mutex);
+        lo[0] = std::min(lo[0], x_lo);
+        hi[0] = std::max(hi[0], x_hi);
+        for(int d = 1; d < 3; d++)
+          {
+          lo[d] = std::min(lo[d], (long) idx[d]);
+          hi[d] = std::max(hi[d], (long) idx[d]);
+          }
+        }
+    });
+
+    // Nothing to interpolate
+    if(hi[0] < lo[0])
+      return;
+
+    LabelImageType::RegionType roi;
+    for(int d = 0; d < 3; d++)
+      {
+      roi.SetIndex(d, lo[d]);
+      roi.SetSize(d, hi[d] - lo[d] + 1);
+      }
+    roi.PadByRadius(1);
+    roi.Crop(seg->GetBufferedRegion());
+
+    typedef itk::RegionOfInterestImageFilter<LabelImageType, LabelImageType> ROIFilterType;
+    SmartPtr<ROIFilterType> roi_filter = ROIFilterType::New();
+    roi_filter->SetInput(seg);
+    roi_filter->SetRegionOfInterest(roi);
+
     // Create the morphological interpolation filter
-    typedef itk::MorphologicalContourInterpolator<GenericImageData::LabelImageType> MCIType;
+    typedef itk::MorphologicalContourInterpolator<LabelImageType> MCIType;
     SmartPtr<MCIType> mci = MCIType::New();
 
     // Should we be interpolating a specific label or all labels?
     if(interp_all)
       {
-      mci->SetInput(liw->GetImage());
+      mci->SetInput(roi_filter->GetOutput());
       }
     else
       {
       // We need to extract a single component from the segmentation image to interpolate
-      typedef GenericImageData::LabelImageType LabelImageType;
       typedef BinarizeFunctor<LabelType> FunctorType;
       typedef itk::UnaryFunctorImageFilter<LabelImageType, LabelImageType, FunctorType> BinarizeFilterType;
       BinarizeFilterType::Pointer flt = BinarizeFilterType::New();
 
       FunctorType fn;
       fn.SetLabel(this->GetInterpolateLabel());
-      flt->SetInput(liw->GetImage());
+      flt->SetInput(roi_filter->GetOutput());
       flt->SetFunctor(fn);
       flt->Update();
 
@@ -102,11 +164,11 @@ void InterpolateLabelModel::Interpolate()
     // Update the filter
     mci->Update();
 
-    // Apply the labels back to the segmentation
-    SegmentationUpdateIterator it_trg(liw, liw->GetBufferedRegion(),
+    // Apply the labels back to the segmentation, within the bounding box
+    SegmentationUpdateIterator it_trg(liw, roi,
                                       this->GetDrawingLabel(), this->GetDrawOverFilter());
 
-    itk::ImageRegionConstIterator<GenericImageData::LabelImageType>
+    itk::ImageRegionConstIterator<LabelImageType>
         it_src(mci->GetOutput(), mci->GetOutput()->GetBufferedRegion());
 
     // The way we paint back into the segmentation depends on whether all labels
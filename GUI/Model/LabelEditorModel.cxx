@@ -356,6 +356,21 @@ void LabelEditorModel::SetAllLabelsVisibilityIn3D(bool onoff)
     }
 }
 
+size_t LabelEditorModel::KeepLargestComponentOfCurrentLabel()
+{
+  // Unlike deleting a label, this can be undone
+  if(GetAndStoreCurrentLabel() && m_SelectedId > 0)
+    return m_Parent->GetDriver()->KeepLargestConnectedComponent(m_SelectedId);
+  return 0;
+}
+
+size_t LabelEditorModel::RemoveIslandsOfCurrentLabel(size_t min_voxels)
+{
+  if(GetAndStoreCurrentLabel() && m_SelectedId > 0)
+    return m_Parent->GetDriver()->RemoveSmallConnectedComponents(m_SelectedId, min_voxels);
+  return 0;
+}
+
 bool LabelEditorModel::ReassignLabelId(LabelType newid)
 {
   // Check if the ID is taken
@@ -74,6 +74,18 @@ public:
   /** Bulk 3D visibility update on the labels */
   void SetAllLabelsVisibilityIn3D(bool onoff);
 
+  /**
+   * Clear the voxels of the selected label outside of its largest connected
+   * component. Returns the number of voxels changed.
+   */
+  size_t KeepLargestComponentOfCurrentLabel();
+
+  /**
+   * Clear the connected components of the selected label that have fewer
+   * than min_voxels voxels. Returns the number of voxels changed.
+   */
+  size_t RemoveIslandsOfCurrentLabel(size_t min_voxels);
+
 protected:
 
   // Hidden constructor/destructor
@@ -0,0 +1,156 @@
+#include "LayerFileWatchModel.h"
+#include "GlobalUIModel.h"
+#include "IRISApplication.h"
+#include "IRISImageData.h"
+#include "LayerIterator.h"
+#include "ImageIODelegates.h"
+#include "ImageWrapperBase.h"
+#include "TaskScheduler.h"
+#include <itksys/SystemTools.hxx>
+#include <chrono>
+#include <iostream>
+
+LayerFileWatchModel::LayerFileWatchModel()
+{
+  m_WatchEnabledModel = NewSimpleConcreteProperty(true);
+}
+
+LayerFileWatchModel::~LayerFileWatchModel()
+{
+  // The reads refer to the delegates, and must finish before they are released
+  for(auto &p : m_Pending)
+    p.Future.wait();
+}
+
+void LayerFileWatchModel::SetParentModel(GlobalUIModel *parent)
+{
+  m_Parent = parent;
+}
+
+void LayerFileWatchModel::Poll()
+{
+  this->UpdateReloadedLayers();
+  if(this->GetWatchEnabled())
+    this->CheckLayerFiles();
+  else
+    m_Files.clear();
+}
+
+bool LayerFileWatchModel::IsReloadPending(unsigned long id) const
+{
+  for(const auto &p : m_Pending)
+    if(p.LayerId == id)
+      return true;
+  return false;
+}
+
+void LayerFileWatchModel::UpdateReloadedLayers()
+{
+  IRISApplication *driver = m_Parent->GetDriver();
+  for(auto it = m_Pending.begin(); it != m_Pending.end(); )
+    {
+    if(it->Future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      {
+      ++it;
+      continue;
+      }
+
+    PendingReload reload = std::move(*it);
+    it = m_Pending.erase(it);
+
+    try
+      {
+      reload.Future.get();
+
+      // The layer may have been unloaded or edited while the file was read,
+      // and layers are only reloaded in the main mode
+      ImageWrapperBase *layer = driver->IsMainImageLoaded() && !driver->IsSnakeModeActive()
+          ? driver->GetIRISImageData()->FindLayer(reload.LayerId, false) : nullptr;
+      if(layer && layer == reload.Delegate->GetWrapper() && !layer->HasUnsavedChanges())
+        reload.Delegate->UpdateWrapper();
+      }
+    catch(std::exception &exc)
+      {
+      // The file is read again when it changes, e.g., once it is fully written
+      std::cerr << "Failed to reload layer from file: " << exc.what() << std::endl;
+      }
+    }
+}
+
+void LayerFileWatchModel::CheckLayerFiles()
+{
+  IRISApplication *driver = m_Parent->GetDriver();
+  std::map<unsigned long, WatchedFile> files;
+  if(driver->IsMainImageLoaded() && !driver->IsSnakeModeActive())
+    {
+    GenericImageData *id = driver->GetIRISImageData();
+    for(LayerIterator it = id->GetLayers(MAIN_ROLE | OVERLAY_ROLE | LABEL_ROLE);
+        !it.IsAtEnd(); ++it)
+      {
+      ImageWrapperBase *layer = it.GetLayer();
+      std::string fn = layer->GetFileName() ? layer->GetFileName() : "";
+      if(fn.empty() || !itksys::SystemTools::FileExists(fn, true))
+        continue;
+
+      WatchedFile current;
+      current.FileName = fn;
+      current.Size = itksys::SystemTools::FileLength(fn);
+      current.MTime = itksys::SystemTools::ModifiedTime(fn);
+
+      // New layers, and layers saved to another file, start from the file
+      // as it is now
+      unsigned long uid = layer->GetUniqueId();
+      auto old = m_Files.find(uid);
+      if(old == m_Files.end() || old->second.FileName != fn)
+        {
+        files[uid] = current;
+        continue;
+        }
+
+      // A changed file is only read once it has stopped changing
+      if(current.Size != old->second.Size || current.MTime != old->second.MTime)
+        {
+        current.Changed = true;
+        }
+      else if(old->second.Changed)
+        {
+        current.Changed = IsReloadPending(uid) || layer->HasUnsavedChanges();
+        if(!current.Changed)
+          this->StartReload(uid, layer, it.GetRole());
+        }
+
+      files[uid] = current;
+      }
+    }
+
+  m_Files = files;
+}
+
+void LayerFileWatchModel::StartReload(unsigned long id, ImageWrapperBase *layer, LayerRole role)
+{
+  SmartPtr<AbstractReloadWrapperDelegate> delegate;
+  if(role == LABEL_ROLE)
+    delegate = ReloadSegmentationWrapperDelegate::New().GetPointer();
+  else
+    delegate = ReloadAnatomicWrapperDelegate::New().GetPointer();
+
+  // A file whose header no longer matches the layer can not be reloaded
+  delegate->Initialize(m_Parent->GetDriver(), layer);
+  try
+    {
+    IRISWarningList wl;
+    delegate->ValidateHeader(wl);
+    }
+  catch(std::exception &exc)
+    {
+    std::cerr << "Not reloading layer from changed file: " << exc.what() << std::endl;
+    return;
+    }
+
+  PendingReload reload;
+  reload.LayerId = id;
+  reload.Delegate = delegate;
+  reload.Future = TaskScheduler::GetInstance()->Submit(
+        TaskScheduler::USER_COMPUTE, [delegate]() { delegate->ReadImage(); });
+  m_Pending.push_back(std::move(reload));
+}
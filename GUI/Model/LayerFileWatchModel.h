@@ -0,0 +1,84 @@
+#ifndef LAYERFILEWATCHMODEL_H
+#define LAYERFILEWATCHMODEL_H
+
+#include "AbstractModel.h"
+#include "PropertyModel.h"
+#include <future>
+#include <list>
+#include <map>
+#include <string>
+
+class GlobalUIModel;
+class AbstractReloadWrapperDelegate;
+class ImageWrapperBase;
+
+/**
+ * Watches the files of the loaded image layers and reloads the layers whose
+ * files are rewritten, e.g., by a pipeline that updates segmentations or
+ * probability maps while they are being reviewed.
+ *
+ * The files are polled, which also works on network file systems. A change
+ * is acted upon once the size and modification time of the file have stayed
+ * the same for one poll, so that files are not read while they are being
+ * written. The file is read in a background thread, and only the time points
+ * that differ from the file are swapped into the layer, so the views keep
+ * the slices they have computed for the others. Layers with unsaved changes
+ * are never reloaded.
+ */
+class LayerFileWatchModel : public AbstractModel
+{
+public:
+  irisITKObjectMacro(LayerFileWatchModel, AbstractModel)
+
+  void SetParentModel(GlobalUIModel *parent);
+
+  /** Whether the layers are reloaded when their files change */
+  irisSimplePropertyAccessMacro(WatchEnabled, bool)
+
+  /**
+   * Update the layers whose files have been read, and check the files of the
+   * layers for changes. This should be called periodically by the GUI
+   */
+  void Poll();
+
+  /** Whether files are being read in the background */
+  bool IsReloadPending() const { return m_Pending.size() > 0; }
+
+protected:
+  LayerFileWatchModel();
+  virtual ~LayerFileWatchModel();
+
+  // The last seen state of the file of a layer
+  struct WatchedFile
+  {
+    std::string FileName;
+    unsigned long Size = 0;
+    long MTime = 0;
+
+    // The file has changed since the layer was loaded or last reloaded
+    bool Changed = false;
+  };
+
+  // A file being read in the background
+  struct PendingReload
+  {
+    unsigned long LayerId;
+    SmartPtr<AbstractReloadWrapperDelegate> Delegate;
+    std::future<void> Future;
+  };
+
+  void UpdateReloadedLayers();
+  void CheckLayerFiles();
+  void StartReload(unsigned long id, ImageWrapperBase *layer, LayerRole role);
+  bool IsReloadPending(unsigned long id) const;
+
+  GlobalUIModel *m_Parent = nullptr;
+
+  // Keyed by the unique id of the layer
+  std::map<unsigned long, WatchedFile> m_Files;
+  std::list<PendingReload> m_Pending;
+
+  SmartPtr<ConcreteSimpleBooleanProperty> m_WatchEnabledModel;
+};
+
+#endif // LAYERFILEWATCHMODEL_H
@@ -241,6 +241,8 @@ bool LayerGeneralPropertiesModel
         value = MODE_MAX; break;
       case SCALAR_REP_AVERAGE:
         value = MODE_AVERAGE; break;
+      case SCALAR_REP_JACOBIAN:
+        value = MODE_JACOBIAN; break;
       case SCALAR_REP_COMPONENT:
         value = MODE_COMPONENT; break;
       default:
@@ -265,6 +267,7 @@ bool LayerGeneralPropertiesModel
     if (layer->GetNumberOfComponents() == 2 || layer->GetNumberOfComponents() == 3)
       {
       (*domain)[MODE_GRID] = "Deformation Grid Display";
+      (*domain)[MODE_JACOBIAN] = "Jacobian Determinant of Deformation";
       }
 
     }
@@ -306,6 +309,12 @@ void LayerGeneralPropertiesModel
       mode.UseRGB = false;
       mode.RenderAsGrid = false;
       break;
+    case LayerGeneralPropertiesModel::MODE_JACOBIAN:
+      mode.SelectedScalarRep = SCALAR_REP_JACOBIAN;
+      mode.SelectedComponent = 0;
+      mode.UseRGB = false;
+      mode.RenderAsGrid = false;
+      break;
     case LayerGeneralPropertiesModel::MODE_RGB:
       mode.UseRGB = true;
       mode.RenderAsGrid = false;
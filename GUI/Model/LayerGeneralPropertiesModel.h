@@ -51,7 +51,8 @@ public:
    * is not a scalar representation).
    */
   enum DisplayMode {
-    MODE_COMPONENT = 0, MODE_MAGNITUDE, MODE_MAX, MODE_AVERAGE, MODE_RGB, MODE_GRID
+    MODE_COMPONENT = 0, MODE_MAGNITUDE, MODE_MAX, MODE_AVERAGE, MODE_RGB, MODE_GRID,
+    MODE_JACOBIAN
   };
 
   /** States for this model */
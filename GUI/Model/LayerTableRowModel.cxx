@@ -218,6 +218,11 @@ void ImageLayerTableRowModel::UpdateDisplayModeList()
     m_AvailableDisplayModes.push_back(
           MultiChannelDisplayMode(false, false, SCALAR_REP_AVERAGE, 0));
 
+    // Two and three component images may be displacement fields
+    if(m_ImageLayer->GetNumberOfComponents() <= 3)
+      m_AvailableDisplayModes.push_back(
+            MultiChannelDisplayMode(false, false, SCALAR_REP_JACOBIAN, 0));
+
     if(m_ImageLayer->GetNumberOfComponents() == 3)
       {
       m_AvailableDisplayModes.push_back(
@@ -413,6 +418,9 @@ ImageLayerTableRowModel::GetDisplayModeString(const MultiChannelDisplayMode &mod
     case SCALAR_REP_AVERAGE:
       return "Avg";
 
+    case SCALAR_REP_JACOBIAN:
+      return "Jac";
+
     case NUMBER_OF_SCALAR_REPS:
       break;
     };
@@ -24,11 +24,15 @@ MeshExportModel::MeshExportModel()
   m_ExportFormatModel = ConcreteFileFormatModel::New();
   m_ExportFormatModel->SetValue(GuidedMeshIO::FORMAT_VTK);
 
+  m_ExportAllTimePointsModel = NewSimpleConcreteProperty(false);
+
   // Configure the format regular expressions
   m_FormatRegExp[GuidedMeshIO::FORMAT_VTK] = ".*\\.vtk$";
   m_FormatRegExp[GuidedMeshIO::FORMAT_STL] = ".*\\.stl$";
   m_FormatRegExp[GuidedMeshIO::FORMAT_BYU] = ".*\\.(byu|y)$";
   m_FormatRegExp[GuidedMeshIO::FORMAT_VRML] = ".*\\.vrml$";
+  m_FormatRegExp[GuidedMeshIO::FORMAT_VTP] = ".*\\.vtp$";
+  m_FormatRegExp[GuidedMeshIO::FORMAT_PLY] = ".*\\.ply$";
 }
 
 
@@ -50,6 +54,8 @@ bool MeshExportModel::CheckState(MeshExportModel::UIState flag)
     {
     case MeshExportModel::UIF_LABEL_SELECTION_ACTIVE:
       return this->GetSaveMode() == SAVE_SINGLE_LABEL;
+    case MeshExportModel::UIF_MULTIPLE_TIME_POINTS:
+      return m_ParentModel->GetDriver()->GetNumberOfTimePoints() > 1;
     }
   return false;
 }
@@ -67,6 +73,10 @@ void MeshExportModel::OnDialogOpen()
   // Get the default filename for the currently loaded image
   m_ExportFileNameModel->SetValue("");
 
+  // Only the current time point is exported by default
+  m_ExportAllTimePointsModel->SetValue(false);
+  InvokeEvent(StateMachineChangeEvent());
+
   // Update the file formats list
   UpdateFormatDomain();
 }
@@ -91,6 +101,8 @@ void MeshExportModel::SaveMesh()
       settings.SetFlagSingleScene(true);
       break;
     }
+  settings.SetFlagAllTimePoints(
+        this->CheckState(UIF_MULTIPLE_TIME_POINTS) && this->GetExportAllTimePoints());
 
   // Handle the format (in a round-about way)
   Registry registry;
@@ -131,12 +143,15 @@ void MeshExportModel::UpdateFormatDomain()
     format_domain[GuidedMeshIO::FORMAT_VTK] = "VTK PolyData File";
 		format_domain[GuidedMeshIO::FORMAT_VRML] = "VRML 2.0 File";
 		format_domain[GuidedMeshIO::FORMAT_STL] = "STL Mesh File";
+    format_domain[GuidedMeshIO::FORMAT_VTP] = "VTK XML PolyData File";
     }
   else
     {
     format_domain[GuidedMeshIO::FORMAT_VTK] = "VTK PolyData File";
     format_domain[GuidedMeshIO::FORMAT_STL] = "STL Mesh File";
     format_domain[GuidedMeshIO::FORMAT_BYU] = "BYU Mesh File";
+    format_domain[GuidedMeshIO::FORMAT_VTP] = "VTK XML PolyData File";
+    format_domain[GuidedMeshIO::FORMAT_PLY] = "PLY Mesh File";
     }
 
   m_ExportFormatModel->SetDomain(format_domain);
@@ -17,7 +17,8 @@ public:
     deactivation of various widgets in the interface
     */
   enum UIState {
-    UIF_LABEL_SELECTION_ACTIVE
+    UIF_LABEL_SELECTION_ACTIVE,
+    UIF_MULTIPLE_TIME_POINTS
     };
 
   void SetParentModel(GlobalUIModel *parent);
@@ -45,6 +46,9 @@ public:
   /** File format for the export */
   irisGenericPropertyAccessMacro(ExportFormat, FileFormat, FileFormatDomain)
 
+  /** Whether the meshes of all the time points are exported */
+  irisSimplePropertyAccessMacro(ExportAllTimePoints, bool)
+
   /** Get the parent model */
   irisGetMacro(ParentModel, GlobalUIModel *)
 
@@ -93,6 +97,9 @@ protected:
   typedef ConcretePropertyModel<FileFormat, FileFormatDomain> ConcreteFileFormatModel;
   SmartPtr<ConcreteFileFormatModel> m_ExportFormatModel;
 
+  // Export all time points
+  SmartPtr<ConcreteSimpleBooleanProperty> m_ExportAllTimePointsModel;
+
   // Update the domain of the format model based on the current state of the save
   // mode. This is because only some formats are supported in save modes
   void UpdateFormatDomain();
@@ -138,6 +138,7 @@ void OrthogonalSliceCursorNavigationModel
 {
   // Get the cross-hairs position in image space
   Vector3ui xCrossImage = m_Parent->GetDriver()->GetCursorPosition();
+  Vector3ui xCrossBefore = xCrossImage;
 
   // Map it into slice space
   Vector3d xCrossSlice =
@@ -157,6 +158,25 @@ void OrthogonalSliceCursorNavigationModel
 
   // Update the crosshairs position in the global state
   m_Parent->GetDriver()->SetCursorPosition(xCrossClamped);
+
+  // Compute the slices that come next in the direction of scrolling
+  GenericImageData *id = m_Parent->GetDriver()->GetCurrentImageData();
+  unsigned int axis = id->GetMain()->GetDisplaySliceImageAxis(m_Parent->GetId());
+  int step = (int) xCrossClamped[axis] - (int) xCrossBefore[axis];
+  if(step != 0)
+    {
+    Clock::time_point now = Clock::now();
+    bool continued = (step > 0) == (m_LastScrollStep > 0)
+        && std::chrono::duration<double>(now - m_LastScrollTime).count() < SCROLL_CONTINUATION_SECONDS;
+
+    m_ScrollPrefetchCount = continued
+        ? std::min(2 * m_ScrollPrefetchCount, MAX_SCROLL_PREFETCH)
+        : MIN_SCROLL_PREFETCH;
+    m_LastScrollTime = now;
+    m_LastScrollStep = step;
+
+    id->PrefetchAdjacentSlices(m_Parent->GetId(), step, m_ScrollPrefetchCount);
+    }
 }
 
 bool OrthogonalSliceCursorNavigationModel::CheckZoomThumbnail(Vector2i xCanvas)
@@ -29,6 +29,7 @@
 
 #include <SNAPCommon.h>
 #include "AbstractModel.h"
+#include <chrono>
 
 class GenericSliceModel;
 
@@ -87,6 +88,16 @@ protected:
 
   GenericSliceModel *m_Parent;
 
+  // State of continuous scrolling, used to decide how many slices to compute
+  // ahead of the cursor. The count doubles with each scroll step that follows
+  // closely on a step in the same direction.
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point m_LastScrollTime;
+  int m_LastScrollStep = 0;
+  unsigned int m_ScrollPrefetchCount = 0;
+
+  static constexpr unsigned int MIN_SCROLL_PREFETCH = 2, MAX_SCROLL_PREFETCH = 16;
+  static constexpr double SCROLL_CONTINUATION_SECONDS = 0.25;
 
 };
 
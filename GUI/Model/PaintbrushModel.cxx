@@ -6,14 +6,25 @@
 #include "GenericImageData.h"
 #include "ImageWrapperTraits.h"
 #include "SegmentationUpdateIterator.h"
+#include "SNAPLatencyMonitor.h"
 
 #include "RLERegionOfInterestImageFilter.h"
 #include "itkGradientAnisotropicDiffusionImageFilter.h"
 #include "itkGradientMagnitudeImageFilter.h"
 #include "itkWatershedImageFilter.h"
 
+#include <algorithm>
+
 
 // TODO: move this into a separate file!!!!
+/**
+ * The watershed pipeline of the adaptive brush. The smoothing and gradient
+ * magnitude are the expensive steps, so they are computed over a block
+ * around the cursor, larger than the brush, and kept until the brush moves
+ * out of the block or the image changes. Each dab then runs the watershed
+ * on the brush region of the cached gradient, and a change of level only
+ * relabels the existing watershed hierarchy.
+ */
 class BrushWatershedPipeline
 {
 public:
@@ -21,6 +32,7 @@ public:
   typedef itk::Image<float, 3> FloatImageType;
   typedef itk::Image<itk::IdentifierType, 3> WatershedImageType;
   typedef WatershedImageType::IndexType IndexType;
+  typedef itk::ImageRegion<3> RegionType;
 
   BrushWatershedPipeline()
     {
@@ -30,19 +42,28 @@ public:
     adf->SetConductanceParameter(0.5);
     gmf = GMFType::New();
     gmf->SetInput(adf->GetOutput());
+    groi = ROIType::New();
     wf = WFType::New();
-    wf->SetInput(gmf->GetOutput());
+    wf->SetInput(groi->GetOutput());
+
+    cache_source = NULL;
+    cache_source_mtime = 0;
+    cache_iter = 0;
     }
 
+  /**
+   * Set up the watersheds for a brush region. The source is the image that
+   * grey is computed from; its modification time tells if the cached
+   * gradient is still valid.
+   */
   void PrecomputeWatersheds(
     const FloatImageType *grey,
+    const itk::ImageBase<3> *source,
     const LabelImageType *label,
-    itk::ImageRegion<3> region,
+    RegionType region,
     itk::Index<3> vcenter,
     size_t smoothing_iter)
     {
-    this->region = region;
-
     // Get the offset of vcenter in the region
     if(region.IsInside(vcenter))
       for(size_t d = 0; d < 3; d++)
@@ -51,27 +72,50 @@ public:
       for(size_t d = 0; d < 3; d++)
         this->vcenter[d] = region.GetSize()[d] / 2;
 
-    // Create a backup of the label image
-    LROIType::Pointer lroi = LROIType::New();
-    lroi->SetInput(label);
-    lroi->SetRegionOfInterest(region);
-    lroi->Update();
-    lsrc = lroi->GetOutput();
-    lsrc->DisconnectPipeline();
-
-    // Initialize the watershed pipeline
-    roi->SetInput(grey);
-    roi->SetRegionOfInterest(region);
-    adf->SetNumberOfIterations(smoothing_iter);
-
-    // Set the initial level to lowest possible - to get all watersheds
-    wf->SetLevel(1.0);
-    wf->Update();
+    // Recompute the gradient if the brush left the cached block, or if the
+    // image or the smoothing changed
+    if(!gradient || source != cache_source || source->GetMTime() != cache_source_mtime
+       || smoothing_iter != cache_iter || !cache_region.IsInside(region))
+      {
+      // The block extends the brush region by its size on each side, except
+      // along the slice axis of a 2D brush
+      cache_region = region;
+      for(size_t d = 0; d < 3; d++)
+        {
+        if(region.GetSize()[d] > 1)
+          {
+          cache_region.SetIndex(d, region.GetIndex()[d] - region.GetSize()[d]);
+          cache_region.SetSize(d, 3 * region.GetSize()[d]);
+          }
+        }
+      cache_region.Crop(label->GetBufferedRegion());
+
+      roi->SetInput(grey);
+      roi->SetRegionOfInterest(cache_region);
+      adf->SetNumberOfIterations(smoothing_iter);
+      gmf->Update();
+
+      gradient = gmf->GetOutput();
+      gradient->DisconnectPipeline();
+      groi->SetInput(gradient);
+
+      cache_source = source;
+      cache_source_mtime = source->GetMTime();
+      cache_iter = smoothing_iter;
+      }
+
+    // The region of the brush in the cached gradient, whose index starts at 0.
+    // The watershed filter only reruns the segmentation if this changes.
+    RegionType brush_region = region;
+    for(size_t d = 0; d < 3; d++)
+      brush_region.SetIndex(d, region.GetIndex()[d] - cache_region.GetIndex()[d]);
+    groi->SetRegionOfInterest(brush_region);
     }
 
   void RecomputeWatersheds(double level)
     {
-    // Reupdate the filter with new level
+    // Reupdate the filter with new level. If only the level changed, the
+    // filter just relabels the hierarchy computed before
     wf->SetLevel(level);
     wf->Update();
     }
@@ -86,7 +130,6 @@ public:
 
 private:
   typedef itk::RegionOfInterestImageFilter<FloatImageType, FloatImageType> ROIType;
-  typedef itk::RegionOfInterestImageFilter<LabelImageType, LabelImageType> LROIType;
   typedef itk::GradientAnisotropicDiffusionImageFilter<FloatImageType,FloatImageType> ADFType;
   typedef itk::GradientMagnitudeImageFilter<FloatImageType, FloatImageType> GMFType;
   typedef itk::WatershedImageFilter<FloatImageType> WFType;
@@ -94,11 +137,17 @@ private:
   ROIType::Pointer roi;
   ADFType::Pointer adf;
   GMFType::Pointer gmf;
+  ROIType::Pointer groi;
   WFType::Pointer wf;
 
-  itk::ImageRegion<3> region;
-  LabelImageType::Pointer lsrc;
   itk::Index<3> vcenter;
+
+  // The cached gradient magnitude, and what it was computed from
+  FloatImageType::Pointer gradient;
+  RegionType cache_region;
+  const itk::ImageBase<3> *cache_source;
+  itk::ModifiedTimeType cache_source_mtime;
+  size_t cache_iter;
 };
 
 
@@ -178,8 +227,8 @@ bool PaintbrushModel::TestInside(const Vector2d &x, const PaintbrushSettings &ps
 }
 
 
-// TODO: make this faster by precomputing all the repeated quantities. The inside
-// check should take a lot less time!
+// This is called for every voxel of the bounding box of the brush when a
+// stencil is computed, and by the renderer, but not for each dab
 bool PaintbrushModel::TestInside(const Vector3d &x, const PaintbrushSettings &ps)
 {
   // Determine how to scale the voxels
@@ -254,23 +303,32 @@ PaintbrushModel
   if(m_IsEngaged)
     {
     // The behavior is different for 'fast' regular brushes and adaptive brush. For the
-    // adaptive brush, dragging is disabled.
-    if(pbs.mode != PAINTBRUSH_WATERSHED || m_ReverseMode)
+    // adaptive brush, dragging is disabled. The flood fill is only applied on push.
+    if(pbs.mode != PAINTBRUSH_FLOOD_FILL
+       && (pbs.mode != PAINTBRUSH_WATERSHED || m_ReverseMode))
       {
       // See how much we have moved since the last event. If we moved more than
       // the value of the radius, we interpolate the path and place brush strokes
       // along the path
       if(pixelsMoved > pbs.radius)
         {
-        // Break up the path into steps
+        // Break up the path into steps, and paint the brush at all of them
+        // in one pass
         size_t nSteps = (int) ceil(pixelsMoved / pbs.radius);
+        std::vector<Vector3ui> centers;
         for(size_t i = 0; i < nSteps; i++)
           {
           double t = (1.0 + i) / nSteps;
           Vector3d X = t * m_LastApplyX + (1.0 - t) * xSlice;
           ComputeMousePosition(X);
-          ApplyBrush(m_ReverseMode, true);
+          if(HasMainImageTransformed())
+            ApplyBrush(m_ReverseMode, true);
+          else
+            centers.push_back(m_MousePosition);
           }
+
+        if(centers.size())
+          PaintStencil(centers, m_ReverseMode, nullptr);
         }
       else
         {
@@ -341,6 +399,12 @@ void PaintbrushModel::AcceptAtCursor()
 bool
 PaintbrushModel::ApplyBrush(bool reverse_mode, bool dragging)
 {
+  SNAP_LATENCY_SCOPE(SNAPLatencyMonitor::PAINT);
+
+  // The flood fill works on the image grid, and is not repeated when dragging
+  if (m_Parent->GetDriver()->GetGlobalState()->GetPaintbrushSettings().mode == PAINTBRUSH_FLOOD_FILL)
+    return dragging ? false : ApplyFloodFill(reverse_mode);
+
   if (HasMainImageTransformed())
     return ApplyBrushByPolygonRasterization(reverse_mode, dragging);
 
@@ -352,10 +416,6 @@ PaintbrushModel::ApplyBrush(bool reverse_mode, bool dragging)
   // Get the segmentation image
   LabelImageWrapper *imgLabel = driver->GetSelectedSegmentationLayer();
 
-  // Get the paint properties
-  LabelType drawing_color = gs->GetDrawingColorLabel();
-  DrawOverFilter drawover = gs->GetDrawOverFilter();
-
   // Get the paintbrush properties
   PaintbrushSettings pbs = gs->GetPaintbrushSettings();
 
@@ -364,31 +424,30 @@ PaintbrushModel::ApplyBrush(bool reverse_mode, bool dragging)
         pbs.mode == PAINTBRUSH_WATERSHED
         && (!reverse_mode) && (!dragging));
 
-  // Define a region of interest
-  LabelImageWrapper::ImageType::RegionType xTestRegion;
-  for(size_t i = 0; i < 3; i++)
+  // Special code for Watershed brush
+  if(flagWatershed)
     {
-    if(i != imgLabel->GetDisplaySliceImageAxis(m_Parent->GetId())
-       || pbs.volumetric)
-      {
-      // For watersheds, the radius must be > 2
-      double rad = (flagWatershed && pbs.radius < 1.5) ? 1.5 : pbs.radius;
-      xTestRegion.SetIndex(i, (long) (m_MousePosition(i) - rad)); // + 1);
-      xTestRegion.SetSize(i, (long) (2 * rad + 1)); // - 1);
-      }
-    else
+    // Define a region of interest. For watersheds, the radius must be > 2
+    LabelImageWrapper::ImageType::RegionType xTestRegion;
+    for(size_t i = 0; i < 3; i++)
       {
-      xTestRegion.SetIndex(i, m_MousePosition(i));
-      xTestRegion.SetSize(i, 1);
+      if(i != imgLabel->GetDisplaySliceImageAxis(m_Parent->GetId())
+         || pbs.volumetric)
+        {
+        double rad = pbs.radius < 1.5 ? 1.5 : pbs.radius;
+        xTestRegion.SetIndex(i, (long) (m_MousePosition(i) - rad)); // + 1);
+        xTestRegion.SetSize(i, (long) (2 * rad + 1)); // - 1);
+        }
+      else
+        {
+        xTestRegion.SetIndex(i, m_MousePosition(i));
+        xTestRegion.SetSize(i, 1);
+        }
       }
-    }
 
-  // Crop the region by the buffered region
-  xTestRegion.Crop(imgLabel->GetImage()->GetBufferedRegion());
+    // Crop the region by the buffered region
+    xTestRegion.Crop(imgLabel->GetImage()->GetBufferedRegion());
 
-  // Special code for Watershed brush
-  if(flagWatershed)
-    {
     // Get the currently engaged layer
     ImageWrapperBase *context_layer = gid->FindLayer(m_ContextLayerId, false);
     if(!context_layer)
@@ -400,7 +459,7 @@ PaintbrushModel::ApplyBrush(bool reverse_mode, bool dragging)
 
     // Precompute the watersheds
     m_Watershed->PrecomputeWatersheds(
-          img_source,
+          img_source, context_layer->GetImageBase(),
           driver->GetSelectedSegmentationLayer()->GetImage(),
           xTestRegion, to_itkIndex(m_MousePosition), pbs.watershed.smooth_iterations);
 
@@ -409,51 +468,236 @@ PaintbrushModel::ApplyBrush(bool reverse_mode, bool dragging)
     // Release the casting pipeline
     context_layer->ReleaseInternalPipeline("WatershedBrush", this->m_Parent->GetId());
 
+    return PaintStencil(std::vector<Vector3ui>(1, m_MousePosition), reverse_mode, &xTestRegion);
     }
 
+  return PaintStencil(std::vector<Vector3ui>(1, m_MousePosition), reverse_mode, nullptr);
+}
+
+bool
+PaintbrushModel::ApplyFloodFill(bool reverse_mode)
+{
+  IRISApplication *driver = m_Parent->GetDriver();
+  GenericImageData *gid = driver->GetCurrentImageData();
+  LabelImageWrapper *imgLabel = driver->GetSelectedSegmentationLayer();
+  PaintbrushSettings pbs = driver->GetGlobalState()->GetPaintbrushSettings();
+
+  // The fill is done in the slice under the mouse, or in 3D
+  int axis = pbs.volumetric ? -1 : (int) imgLabel->GetDisplaySliceImageAxis(m_Parent->GetId());
+
+  // The intensity window applies to the layer that was clicked
+  ScalarImageWrapperBase *grey = nullptr;
+  double lower = 0.0, upper = 0.0;
+  if(pbs.flood_fill.use_intensity_window)
+    {
+    ImageWrapperBase *context_layer = gid->FindLayer(m_ContextLayerId, false);
+    if(!context_layer || context_layer == imgLabel)
+      context_layer = gid->GetMain();
+    grey = context_layer->GetDefaultScalarRepresentation();
+    lower = pbs.flood_fill.lower;
+    upper = pbs.flood_fill.upper;
+    }
+
+  // The change is committed with the other paintbrush changes on release
+  return driver->FloodFillSegmentation(
+        m_MousePosition, axis, grey, lower, upper, reverse_mode, nullptr) > 0;
+}
+
+const PaintbrushModel::BrushStencil &
+PaintbrushModel::GetBrushStencil(const PaintbrushSettings &pbs)
+{
+  LabelImageWrapper *imgLabel = m_Parent->GetDriver()->GetSelectedSegmentationLayer();
+  unsigned int axis = imgLabel->GetDisplaySliceImageAxis(m_Parent->GetId());
+
   // Shift vector (different depending on whether the brush has odd/even diameter
   Vector3d offset = ComputeOffset();
+  const Vector3d &spacing = m_Parent->GetSliceSpacing();
+
+  // The stencil depends on the shape and size of the brush, on the spacing
+  // and on the orientation of the slice
+  std::vector<double> key = {
+    pbs.radius, (double) pbs.mode, (double) pbs.volumetric, (double) pbs.isotropic,
+    (double) axis, offset(0), offset(1), offset(2),
+    spacing(0), spacing(1), spacing(2) };
+  for(unsigned int j = 0; j < 3; j++)
+    {
+    Vector3d e(0.0);
+    e(j) = 1.0;
+    Vector3d t = to_double(m_Parent->GetImageToDisplayTransform()->TransformVector(e));
+    key.insert(key.end(), { t(0), t(1), t(2) });
+    }
 
-  // Iterate over the region using
-  SegmentationUpdateIterator it_update(
-        imgLabel, xTestRegion, drawing_color, drawover);
+  auto it = m_StencilCache.find(key);
+  if(it != m_StencilCache.end())
+    return it->second;
 
-  for(; !it_update.IsAtEnd(); ++it_update)
+  // Only a few brushes are used at a time
+  if(m_StencilCache.size() >= 16)
+    m_StencilCache.clear();
+
+  BrushStencil &st = m_StencilCache[key];
+  for(unsigned int i = 0; i < 3; i++)
     {
-    SegmentationUpdateIterator::IndexType idx = it_update.GetIndex();
+    if(i != axis || pbs.volumetric)
+      {
+      st.Start(i) = (int) floor(-pbs.radius);
+      st.Size(i) = (int) (2 * pbs.radius + 1);
+      }
+    else
+      {
+      st.Start(i) = 0;
+      st.Size(i) = 1;
+      }
+    }
 
-    Vector3d xDelta = offset + to_double(idx) - to_double(m_MousePosition);
-    Vector3d xDeltaSliceSpace = to_double(
-          m_Parent->GetImageToDisplayTransform()->TransformVector(xDelta));
+  st.Lines.resize(st.Size(1) * st.Size(2));
+  for(int z = 0; z < st.Size(2); z++)
+    {
+    for(int y = 0; y < st.Size(1); y++)
+      {
+      std::vector<std::pair<int, int> > &line = st.Lines[y + st.Size(1) * z];
+      bool last_inside = false;
+      for(int x = 0; x < st.Size(0); x++)
+        {
+        Vector3i d = st.Start + Vector3i(x, y, z);
+        Vector3d xDelta = offset + to_double(d);
+        Vector3d xDeltaSliceSpace = to_double(
+              m_Parent->GetImageToDisplayTransform()->TransformVector(xDelta));
+
+        bool inside = TestInside(xDeltaSliceSpace, pbs);
+        if(inside && last_inside)
+          line.back().second++;
+        else if(inside)
+          line.push_back(std::make_pair(d(0), d(0) + 1));
+        last_inside = inside;
+        }
+      }
+    }
 
-    // Check if the pixel is inside
-    if(!TestInside(xDeltaSliceSpace, pbs))
-      continue;
+  return st;
+}
 
-    // Check if the pixel is in the watershed
-    if(flagWatershed)
-      {
-      LabelImageWrapper::ImageType::IndexType idxoff;
-      for(unsigned int i = 0; i < 3; i++)
-        idxoff[i] = idx.GetIndex()[i] - xTestRegion.GetIndex().GetIndex()[i];
+bool
+PaintbrushModel
+::PaintStencil(const std::vector<Vector3ui> &centers, bool reverse_mode,
+               const itk::ImageRegion<3> *watershedRegion)
+{
+  // Get the global objects
+  IRISApplication *driver = m_Parent->GetDriver();
+  GlobalState *gs = driver->GetGlobalState();
+  LabelImageWrapper *imgLabel = driver->GetSelectedSegmentationLayer();
+
+  // Get the paint properties
+  LabelType drawing_color = gs->GetDrawingColorLabel();
+  DrawOverFilter drawover = gs->GetDrawOverFilter();
+  PaintbrushSettings pbs = gs->GetPaintbrushSettings();
 
-      if(!m_Watershed->IsPixelInSegmentation(idxoff))
-        continue;
+  const BrushStencil &st = GetBrushStencil(pbs);
+
+  // The region covered by the brush at all of the positions
+  Vector3i lo, hi;
+  for(unsigned int k = 0; k < centers.size(); k++)
+    {
+    Vector3i a = to_int(centers[k]) + st.Start, b = a + st.Size;
+    for(unsigned int i = 0; i < 3; i++)
+      {
+      lo(i) = k ? std::min(lo(i), a(i)) : a(i);
+      hi(i) = k ? std::max(hi(i), b(i)) : b(i);
       }
+    }
+
+  LabelImageWrapper::ImageType::RegionType xTestRegion;
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    xTestRegion.SetIndex(i, lo(i));
+    xTestRegion.SetSize(i, hi(i) - lo(i));
+    }
 
-    // Paint the pixel
-    if(reverse_mode)
-      it_update.PaintAsBackground();
+  // Crop the region by the buffered region
+  if(!xTestRegion.Crop(imgLabel->GetImage()->GetBufferedRegion()))
+    return false;
+
+  // Paint the region line by line. The spans of the stencil at each of the
+  // positions are merged, and the voxels between them are skipped
+  SegmentationRunWriter writer(imgLabel, xTestRegion, drawing_color, drawover);
+  SegmentationUpdateIterator::UpdateType paint_type = reverse_mode
+      ? SegmentationUpdateIterator::BACKGROUND
+      : SegmentationUpdateIterator::FOREGROUND;
+
+  SegmentationRunWriter::UpdateLine update;
+  auto add_run = [&update](long n, SegmentationUpdateIterator::UpdateType type)
+    {
+    if(n <= 0)
+      return;
+    if(update.size() && update.back().second == type)
+      update.back().first += n;
     else
-      it_update.PaintAsForeground();
+      update.push_back(std::make_pair((unsigned int) n, type));
+    };
+
+  std::vector<std::pair<long, long> > spans;
+  long x_begin = xTestRegion.GetIndex(0);
+  long x_end = x_begin + xTestRegion.GetSize(0);
+  for(unsigned int z = 0; z < xTestRegion.GetSize(2); z++)
+    {
+    long iz = xTestRegion.GetIndex(2) + z;
+    for(unsigned int y = 0; y < xTestRegion.GetSize(1); y++)
+      {
+      long iy = xTestRegion.GetIndex(1) + y;
+
+      // Collect the spans of the stencil that fall on this line
+      spans.clear();
+      for(const Vector3ui &c : centers)
+        {
+        long sy = iy - c(1) - st.Start(1), sz = iz - c(2) - st.Start(2);
+        if(sy < 0 || sy >= st.Size(1) || sz < 0 || sz >= st.Size(2))
+          continue;
+        for(const auto &span : st.Lines[sy + st.Size(1) * sz])
+          spans.push_back(std::make_pair(c(0) + span.first, c(0) + span.second));
+        }
+      std::sort(spans.begin(), spans.end());
+
+      // Convert them to runs over the width of the region
+      update.clear();
+      long x = x_begin;
+      for(const auto &span : spans)
+        {
+        long s = std::max(span.first, x), e = std::min(span.second, x_end);
+        if(e <= s)
+          continue;
+
+        add_run(s - x, SegmentationUpdateIterator::SKIP);
+        if(watershedRegion)
+          {
+          // Only the voxels in the watershed segmentation are painted
+          LabelImageWrapper::ImageType::IndexType idxoff;
+          idxoff[1] = iy - watershedRegion->GetIndex(1);
+          idxoff[2] = iz - watershedRegion->GetIndex(2);
+          for(long ix = s; ix < e; ix++)
+            {
+            idxoff[0] = ix - watershedRegion->GetIndex(0);
+            add_run(1, m_Watershed->IsPixelInSegmentation(idxoff)
+                    ? paint_type : SegmentationUpdateIterator::SKIP);
+            }
+          }
+        else
+          {
+          add_run(e - s, paint_type);
+          }
+        x = e;
+        }
+      add_run(x_end - x, SegmentationUpdateIterator::SKIP);
+
+      writer.PaintLine(iy, iz, update);
+      }
     }
 
   // Finalize the iteration
-  if(!it_update.Finalize())
+  if(!writer.Finalize())
     return false;
 
   // Send the delta for undo
-  imgLabel->StoreIntermediateUndoDelta(it_update.RelinquishDelta());
+  imgLabel->StoreIntermediateUndoDelta(writer.RelinquishDelta());
 
   // Changes were made
   return true;
@@ -5,6 +5,8 @@
 #include "GlobalState.h"
 #include <vtkSmartPointer.h>
 #include <vtkPoints2D.h>
+#include <map>
+#include <vector>
 
 class GenericSliceModel;
 class BrushWatershedPipeline;
@@ -72,6 +74,37 @@ protected:
 
   bool ApplyBrush(bool reverse_mode, bool dragging);
 
+  // The voxels of the brush relative to its center, as spans along the
+  // lines of the image: the result of TestInside() over the bounding box
+  // of the brush. It only depends on the brush settings and on the slice
+  // geometry, so it is computed once and reused for every dab.
+  struct BrushStencil
+  {
+    // Position of the bounding box relative to the center, and its size
+    Vector3i Start;
+    Vector3i Size;
+
+    // For each line of the box, in raster order, the ranges [first, last)
+    // of x offsets from the center that are inside the brush
+    std::vector<std::vector<std::pair<int, int> > > Lines;
+  };
+
+  // Get the stencil for the current brush settings and slice geometry
+  const BrushStencil &GetBrushStencil(const PaintbrushSettings &pbs);
+
+  // Stencils that have been computed, keyed on the settings and geometry
+  std::map<std::vector<double>, BrushStencil> m_StencilCache;
+
+  // Paint the brush at a series of positions, e.g. the samples of a drag
+  // stroke, in a single pass over their union. With a watershed region, the
+  // voxels must also belong to the watershed segmentation.
+  bool PaintStencil(const std::vector<Vector3ui> &centers, bool reverse_mode,
+                    const itk::ImageRegion<3> *watershedRegion);
+
+  // Flood fill the segmentation from the voxel under the mouse, in the slice
+  // or in 3D. Returns true if changes were made
+  bool ApplyFloodFill(bool reverse_mode);
+
   GenericSliceModel *m_Parent;
   BrushWatershedPipeline *m_Watershed;
 
@@ -4,6 +4,9 @@
 #include "GlobalPreferencesModel.h"
 #include "DefaultBehaviorSettings.h"
 #include "IRISApplication.h"
+#include "ImageWrapperBase.h"
+
+#include <algorithm>
 
 
 PaintbrushSettingsModel::PaintbrushSettingsModel()
@@ -49,6 +52,24 @@ PaintbrushSettingsModel::PaintbrushSettingsModel()
         this,
         &Self::GetSmoothingIterationValueAndRange,
         &Self::SetSmoothingIterationValue);
+
+  m_FloodFillModeModel = wrapGetterSetterPairAsProperty(
+        this, &Self::GetFloodFillModeValue);
+
+  m_FloodFillWindowModel = wrapGetterSetterPairAsProperty(
+        this,
+        &Self::GetFloodFillWindowValue,
+        &Self::SetFloodFillWindowValue);
+
+  m_FloodFillLowerModel = wrapGetterSetterPairAsProperty(
+        this,
+        &Self::GetFloodFillLowerValueAndRange,
+        &Self::SetFloodFillLowerValue);
+
+  m_FloodFillUpperModel = wrapGetterSetterPairAsProperty(
+        this,
+        &Self::GetFloodFillUpperValueAndRange,
+        &Self::SetFloodFillUpperValue);
 }
 
 void PaintbrushSettingsModel::SetParentModel(GlobalUIModel *parent)
@@ -64,6 +85,9 @@ void PaintbrushSettingsModel::SetParentModel(GlobalUIModel *parent)
 
   Rebroadcast(m_ParentModel->GetDriver(), WrapperDisplayMappingChangeEvent(), StateMachineChangeEvent());
 
+  // The range of the flood fill window follows the main image
+  Rebroadcast(m_ParentModel->GetDriver(), MainImageDimensionsChangeEvent(), ModelUpdateEvent());
+
   // For the maximum size, we just need the size model to be updated, no custom code
   m_BrushSizeModel->RebroadcastFromSourceProperty(dbs->GetPaintbrushDefaultMaximumSizeModel());
 }
@@ -190,6 +214,87 @@ void PaintbrushSettingsModel::SetSmoothingIterationValue(int value)
   SetPaintbrushSettings(pbs);
 }
 
+bool PaintbrushSettingsModel::GetFloodFillModeValue(bool &value)
+{
+  PaintbrushSettings pbs = GetPaintbrushSettings();
+
+  value = (pbs.mode == PAINTBRUSH_FLOOD_FILL);
+  return true;
+}
+
+bool PaintbrushSettingsModel::GetFloodFillIntensityRange(NumericValueRange<double> &range)
+{
+  IRISApplication *driver = m_ParentModel->GetDriver();
+  if(!driver->IsMainImageLoaded())
+    return false;
+
+  ImageWrapperBase *main = driver->GetMainImage();
+  double lo = main->GetImageMinNative(), hi = main->GetImageMaxNative();
+  range.Set(lo, hi, hi > lo ? (hi - lo) / 100.0 : 1.0);
+  return true;
+}
+
+bool PaintbrushSettingsModel::GetFloodFillWindowValue(bool &value)
+{
+  PaintbrushSettings pbs = GetPaintbrushSettings();
+
+  value = pbs.flood_fill.use_intensity_window;
+  return true;
+}
+
+void PaintbrushSettingsModel::SetFloodFillWindowValue(bool value)
+{
+  PaintbrushSettings pbs = GetPaintbrushSettings();
+  pbs.flood_fill.use_intensity_window = value;
+
+  // A window that has not been set starts out as the whole intensity range
+  NumericValueRange<double> range;
+  if(value && pbs.flood_fill.lower >= pbs.flood_fill.upper && GetFloodFillIntensityRange(range))
+    {
+    pbs.flood_fill.lower = range.Minimum;
+    pbs.flood_fill.upper = range.Maximum;
+    }
+  SetPaintbrushSettings(pbs);
+}
+
+bool PaintbrushSettingsModel::GetFloodFillLowerValueAndRange(
+    double &value, NumericValueRange<double> *domain)
+{
+  PaintbrushSettings pbs = GetPaintbrushSettings();
+
+  value = pbs.flood_fill.lower;
+  if(domain && !GetFloodFillIntensityRange(*domain))
+    return false;
+  return true;
+}
+
+void PaintbrushSettingsModel::SetFloodFillLowerValue(double value)
+{
+  PaintbrushSettings pbs = GetPaintbrushSettings();
+  pbs.flood_fill.lower = value;
+  pbs.flood_fill.upper = std::max(pbs.flood_fill.upper, value);
+  SetPaintbrushSettings(pbs);
+}
+
+bool PaintbrushSettingsModel::GetFloodFillUpperValueAndRange(
+    double &value, NumericValueRange<double> *domain)
+{
+  PaintbrushSettings pbs = GetPaintbrushSettings();
+
+  value = pbs.flood_fill.upper;
+  if(domain && !GetFloodFillIntensityRange(*domain))
+    return false;
+  return true;
+}
+
+void PaintbrushSettingsModel::SetFloodFillUpperValue(double value)
+{
+  PaintbrushSettings pbs = GetPaintbrushSettings();
+  pbs.flood_fill.upper = value;
+  pbs.flood_fill.lower = std::min(pbs.flood_fill.lower, value);
+  SetPaintbrushSettings(pbs);
+}
+
 
 
 
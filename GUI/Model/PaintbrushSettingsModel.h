@@ -38,6 +38,11 @@ public:
   irisGetMacro(ThresholdLevelModel, AbstractRangedDoubleProperty *)
   irisGetMacro(SmoothingIterationsModel, AbstractRangedIntProperty *)
 
+  irisGetMacro(FloodFillModeModel, AbstractSimpleBooleanProperty *)
+  irisGetMacro(FloodFillWindowModel, AbstractSimpleBooleanProperty *)
+  irisGetMacro(FloodFillLowerModel, AbstractRangedDoubleProperty *)
+  irisGetMacro(FloodFillUpperModel, AbstractRangedDoubleProperty *)
+
 protected:
 
   PaintbrushSettingsModel();
@@ -70,6 +75,24 @@ protected:
   SmartPtr<AbstractRangedIntProperty> m_SmoothingIterationsModel;
   bool GetSmoothingIterationValueAndRange(int &value, NumericValueRange<int> *domain);
   void SetSmoothingIterationValue(int value);
+
+  SmartPtr<AbstractSimpleBooleanProperty> m_FloodFillModeModel;
+  bool GetFloodFillModeValue(bool &value);
+
+  SmartPtr<AbstractSimpleBooleanProperty> m_FloodFillWindowModel;
+  bool GetFloodFillWindowValue(bool &value);
+  void SetFloodFillWindowValue(bool value);
+
+  SmartPtr<AbstractRangedDoubleProperty> m_FloodFillLowerModel;
+  bool GetFloodFillLowerValueAndRange(double &value, NumericValueRange<double> *domain);
+  void SetFloodFillLowerValue(double value);
+
+  SmartPtr<AbstractRangedDoubleProperty> m_FloodFillUpperModel;
+  bool GetFloodFillUpperValueAndRange(double &value, NumericValueRange<double> *domain);
+  void SetFloodFillUpperValue(double value);
+
+  // The native intensity range of the main image, for the flood fill window
+  bool GetFloodFillIntensityRange(NumericValueRange<double> &range);
 };
 
 #endif // PAINTBRUSHSETTINGSMODEL_H
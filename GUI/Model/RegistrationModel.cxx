@@ -15,6 +15,8 @@
 #include "vnl/algo/vnl_svd.h"
 
 #include "OptimizationProgressRenderer.h"
+#include "TDigestImageFilter.h"
+#include "TaskScheduler.h"
 
 
 const unsigned long RegistrationModel::NOID = (unsigned long)(-1);
@@ -105,11 +107,15 @@ RegistrationModel::RegistrationModel()
   m_Driver = NULL;
   m_Parent = NULL;
   m_GreedyAPI = NULL;
+  m_IterationUpdatePending = false;
 }
 
 RegistrationModel::~RegistrationModel()
 {
-
+  // Don't leave the registration thread running
+  m_RegistrationProgress.Cancel();
+  if(m_RegistrationFuture.valid())
+    m_RegistrationFuture.wait();
 }
 
 
@@ -655,14 +661,127 @@ ImageWrapperBase *RegistrationModel::GetMovingLayerWrapper() const
   return m_Driver->GetCurrentImageData()->FindLayer(m_MovingLayerId, false, MAIN_ROLE | OVERLAY_ROLE);
 }
 
-void RegistrationModel::SetIterationCommand(itk::Command *command)
+#include "GreedyAPI.h"
+
+// Thrown from the iteration callback to stop the optimizer
+struct RegistrationCancelledException {};
+
+/**
+ * Halve the resolution of a (vector) image by box averaging, with the same
+ * output geometry as the display pyramid of the image wrappers, so that the
+ * levels of either can be used in place of one another
+ */
+template <class TImage>
+static SmartPtr<TImage> DownsampleRegistrationInput(const TImage *src)
 {
-  m_IterationCommand = command;
+  auto sz = src->GetBufferedRegion().GetSize();
+  unsigned int nc = src->GetNumberOfComponentsPerPixel();
+
+  typename TImage::SizeType out_sz;
+  typename TImage::SpacingType out_spacing;
+  itk::Vector<double, 3> origin_shift;
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    out_sz[d] = (sz[d] + 1) / 2;
+    out_spacing[d] = src->GetSpacing()[d] * sz[d] / out_sz[d];
+    origin_shift[d] = 0.5 * (out_spacing[d] - src->GetSpacing()[d]);
+    }
+
+  SmartPtr<TImage> out = TImage::New();
+  out->SetRegions(typename TImage::RegionType(out_sz));
+  out->SetSpacing(out_spacing);
+  out->SetOrigin(src->GetOrigin() + src->GetDirection() * origin_shift);
+  out->SetDirection(src->GetDirection());
+  out->SetNumberOfComponentsPerPixel(nc);
+  out->Allocate();
+
+  // Slices of the output are independent
+  const float *p = src->GetBufferPointer();
+  float *q_all = out->GetBufferPointer();
+  size_t line = sz[0] * nc, plane = sz[0] * sz[1] * nc;
+  TaskScheduler::GetInstance()->ParallelFor(
+        TaskScheduler::USER_COMPUTE, 0, out_sz[2], [&](long z0, long z1)
+    {
+    std::vector<double> sum(nc);
+    for(size_t z = z0; z < (size_t) z1; z++)
+      {
+      size_t nz = std::min((size_t) 2, sz[2] - 2 * z);
+      float *q = q_all + z * out_sz[0] * out_sz[1] * nc;
+      for(size_t y = 0; y < out_sz[1]; y++)
+        {
+        size_t ny = std::min((size_t) 2, sz[1] - 2 * y);
+        for(size_t x = 0; x < out_sz[0]; x++, q += nc)
+          {
+          size_t nx = std::min((size_t) 2, sz[0] - 2 * x);
+          const float *p0 = p + 2 * (z * plane + y * line + x * nc);
+          std::fill(sum.begin(), sum.end(), 0.0);
+          for(size_t k = 0; k < nz; k++)
+            for(size_t j = 0; j < ny; j++)
+              for(size_t i = 0; i < nx; i++)
+                for(unsigned int c = 0; c < nc; c++)
+                  sum[c] += p0[k * plane + j * line + i * nc + c];
+
+          for(unsigned int c = 0; c < nc; c++)
+            q[c] = (float) (sum[c] / (nx * ny * nz));
+          }
+        }
+      }
+    });
+
+  return out;
 }
 
-#include "GreedyAPI.h"
-void RegistrationModel::RunAutoRegistration()
+template <class TImage>
+TImage *
+RegistrationModel::GetRegistrationInputAtLevel(
+    RegistrationInputSlot slot, ImageWrapperBase *layer, TImage *cast, unsigned int level)
+{
+  if(level == 0)
+    return cast;
+
+  // Drop the cached levels if the data have changed
+  RegistrationInputPyramid &pyr = m_InputPyramids[slot];
+  if(pyr.LayerId != layer->GetUniqueId()
+     || pyr.MTime != cast->GetMTime() || pyr.PipelineMTime != cast->GetPipelineMTime())
+    {
+    pyr.LayerId = layer->GetUniqueId();
+    pyr.MTime = cast->GetMTime();
+    pyr.PipelineMTime = cast->GetPipelineMTime();
+    pyr.Levels.clear();
+    }
+
+  while(pyr.Levels.size() < level)
+    {
+    const TImage *prev = pyr.Levels.size()
+        ? static_cast<const TImage *>(pyr.Levels.back().GetPointer()) : cast;
+
+    // Take the level from the display pyramid if it has the same geometry
+    SmartPtr<TImage> next;
+    if constexpr(std::is_same<TImage, ImageWrapperBase::FloatVectorImageType>::value)
+      {
+      next = layer->CreateFloatVectorPyramidLevel(pyr.Levels.size() + 1);
+      bool match = next && next->GetNumberOfComponentsPerPixel() == prev->GetNumberOfComponentsPerPixel();
+      for(unsigned int d = 0; match && d < 3; d++)
+        match = next->GetBufferedRegion().GetSize(d) == (prev->GetBufferedRegion().GetSize(d) + 1) / 2;
+      if(!match)
+        next = NULL;
+      }
+
+    if(!next)
+      next = DownsampleRegistrationInput<TImage>(prev);
+
+    pyr.Levels.push_back(next.GetPointer());
+    }
+
+  return static_cast<TImage *>(pyr.Levels[level - 1].GetPointer());
+}
+
+void RegistrationModel::StartAutoRegistration()
 {
+  // Only one registration at a time
+  if(this->IsAutoRegistrationRunning())
+    return;
+
   // Obtain the fixed and moving images.
   ImageWrapperBase *fixed = this->GetParent()->GetDriver()->GetCurrentImageData()->GetMain();
   ImageWrapperBase *moving = this->GetMovingLayerWrapper();
@@ -684,7 +803,7 @@ void RegistrationModel::RunAutoRegistration()
   if(moving_cast->GetSource()) moving_cast->GetSource()->Update();
 
   // Caster for the mask image - declared here so that SmartPtr does not go out of scope
-  ImageWrapperBase::FloatImageType *mask_cast;
+  ImageWrapperBase::FloatImageType *mask_cast = NULL;
 
   // Set up the parameters for greedy registration
   GreedyParameters param;
@@ -700,9 +819,17 @@ void RegistrationModel::RunAutoRegistration()
   ip.moving = "MOVING_IMAGE";
   ig.inputs.push_back(ip);
 
-  // Pass the actual images to the cache
-  m_GreedyAPI->AddCachedInputObject(ip.fixed, fixed_cast);
-  m_GreedyAPI->AddCachedInputObject(ip.moving, moving_cast);
+  // Greedy builds its pyramid from the images it is given, but levels finer
+  // than the finest level are not used. The images are passed at the finest
+  // level instead, which is cached across runs, and greedy only builds the
+  // coarser levels from these small images
+  unsigned int skip_levels = std::max(0, m_FinestResolutionLevel);
+  ImageWrapperBase *fixed_rep = fixed->GetDefaultScalarRepresentation();
+  ImageWrapperBase *moving_rep = moving->GetDefaultScalarRepresentation();
+  m_GreedyAPI->AddCachedInputObject(
+        ip.fixed, this->GetRegistrationInputAtLevel(FIXED_INPUT, fixed_rep, fixed_cast, skip_levels));
+  m_GreedyAPI->AddCachedInputObject(
+        ip.moving, this->GetRegistrationInputAtLevel(MOVING_INPUT, moving_rep, moving_cast, skip_levels));
 
   // Mask image
   if(this->GetUseSegmentationAsMask())
@@ -712,7 +839,9 @@ void RegistrationModel::RunAutoRegistration()
     mask_cast = seg->GetDefaultScalarRepresentation()->CreateCastToFloatPipeline("RegistrationModel");
     if(mask_cast->GetSource())
       mask_cast->GetSource()->UpdateLargestPossibleRegion();
-    m_GreedyAPI->AddCachedInputObject(ig.fixed_mask, mask_cast);
+    m_GreedyAPI->AddCachedInputObject(
+          ig.fixed_mask, this->GetRegistrationInputAtLevel(
+            MASK_INPUT, seg->GetDefaultScalarRepresentation(), mask_cast, skip_levels));
     }
 
   // Set up the metric
@@ -736,15 +865,11 @@ void RegistrationModel::RunAutoRegistration()
   else
     param.affine_dof = GreedyParameters::DOF_AFFINE;
 
-  // Set up the pyramid
+  // Set up the pyramid, which ends at the finest level since the images
+  // are already at that resolution
   param.iter_per_level.clear();
-  for(int k = m_CoarsestResolutionLevel; k >= 0; k--)
-    {
-    if(k >= m_FinestResolutionLevel)
-      param.iter_per_level.push_back(100);
-    else
-      param.iter_per_level.push_back(0);
-    }
+  for(int k = m_CoarsestResolutionLevel; k >= (int) skip_levels; k--)
+    param.iter_per_level.push_back(100);
 
   // Create a transform spec
   param.affine_init_mode = RAS_FILENAME;
@@ -775,30 +900,120 @@ void RegistrationModel::RunAutoRegistration()
   // Pass the output string - same as the input transform
   param.output = param.affine_init_transform.filename;
 
-  // Handle intermediate data
-  if(m_IterationCommand)
+  // Handle intermediate data. The callback runs on the registration thread
+  typedef itk::MemberCommand<Self> CommandType;
+  CommandType::Pointer cmd = CommandType::New();
+  cmd->SetCallbackFunction(this, &RegistrationModel::IterationCallback);
+  param.output_intermediate = param.affine_init_transform.filename;
+  tran->AddObserver(itk::ModifiedEvent(), cmd);
+
+  // Remember what to clean up after the registration
+  m_RegistrationFixed = fixed;
+  m_RegistrationMoving = moving;
+  m_RegistrationMask = mask_cast ? this->GetParent()->GetDriver()->GetSelectedSegmentationLayer() : NULL;
+  m_MetricLog.clear();
+  m_IterationUpdatePending = false;
+  m_RegistrationProgress.Reset();
+
+  // Run the registration in the background. The cast images, held by the
+  // wrappers, and the transform are kept alive until it finishes
+  m_RegistrationFuture = TaskScheduler::GetInstance()->Submit(
+        TaskScheduler::USER_COMPUTE, [this, param, tran]() mutable
     {
-    typedef itk::MemberCommand<Self> CommandType;
-    CommandType::Pointer cmd = CommandType::New();
-    cmd->SetCallbackFunction(this, &RegistrationModel::IterationCallback);
-    param.output_intermediate = param.affine_init_transform.filename;
-    tran->AddObserver(itk::ModifiedEvent(), cmd);
+    try
+      {
+      m_GreedyAPI->RunAffine(param);
+      }
+    catch(RegistrationCancelledException &)
+      {
+      return;
+      }
+
+    // Now, the transform tran should hold our matrix and offset
+    std::lock_guard<std::mutex> lock(m_IterationMutex);
+    m_IterationMatrix = tran->GetMatrix();
+    m_IterationOffset = tran->GetOffset();
+    m_IterationMetricLog = m_GreedyAPI->GetMetricLog();
+    m_IterationUpdatePending = true;
+    });
+
+  InvokeEvent(StateMachineChangeEvent());
+}
+
+bool RegistrationModel::IsAutoRegistrationRunning() const
+{
+  return m_RegistrationFuture.valid();
+}
+
+void RegistrationModel::CancelAutoRegistration()
+{
+  m_RegistrationProgress.Cancel();
+}
+
+bool RegistrationModel::UpdateAutoRegistration()
+{
+  if(!m_RegistrationFuture.valid())
+    return false;
+
+  bool finished =
+      m_RegistrationFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+
+  // Show the latest transform on the moving layer
+  ITKMatrixType matrix; ITKVectorType offset;
+  bool pending = false;
+  {
+  std::lock_guard<std::mutex> lock(m_IterationMutex);
+  if(m_IterationUpdatePending)
+    {
+    matrix = m_IterationMatrix;
+    offset = m_IterationOffset;
+    m_MetricLog.swap(m_IterationMetricLog);
+    m_IterationUpdatePending = false;
+    pending = true;
     }
+  }
 
-  // Run the registration
-  m_GreedyAPI->RunAffine(param);
+  if(pending)
+    {
+    this->SetMovingTransform(matrix, offset);
+    if(m_MetricLog.size() && m_MetricLog.back().size())
+      m_LastMetricValueModel->SetValue(m_MetricLog.back().back().TotalPerPixelMetric);
+    }
 
-  // Now, the transform tran should hold our matrix and offset
-  this->SetMovingTransform(tran->GetMatrix(), tran->GetOffset());
+  if(!finished)
+    return true;
+
+  // Rethrow any error from the registration thread
+  try
+    {
+    m_RegistrationFuture.get();
+    }
+  catch(...)
+    {
+    this->FinishAutoRegistration();
+    throw;
+    }
+
+  this->FinishAutoRegistration();
+  return false;
+}
 
+void RegistrationModel::FinishAutoRegistration()
+{
   // Delete the API
   delete(m_GreedyAPI); m_GreedyAPI = NULL;
 
   // Release the pipelines
-  fixed->GetDefaultScalarRepresentation()->ReleaseInternalPipeline("RegistrationModel");
-  moving->GetDefaultScalarRepresentation()->ReleaseInternalPipeline("RegistrationModel");
-  if(mask_cast)
-    this->GetParent()->GetDriver()->GetSelectedSegmentationLayer()->ReleaseInternalPipeline("RegistrationModel");
+  m_RegistrationFixed->GetDefaultScalarRepresentation()->ReleaseInternalPipeline("RegistrationModel");
+  m_RegistrationMoving->GetDefaultScalarRepresentation()->ReleaseInternalPipeline("RegistrationModel");
+  if(m_RegistrationMask)
+    m_RegistrationMask->ReleaseInternalPipeline("RegistrationModel");
+
+  m_RegistrationFixed = NULL;
+  m_RegistrationMoving = NULL;
+  m_RegistrationMask = NULL;
+
+  InvokeEvent(StateMachineChangeEvent());
 }
 
 void RegistrationModel::MatchByMoments(int order)
@@ -807,6 +1022,19 @@ void RegistrationModel::MatchByMoments(int order)
   ImageWrapperBase *fixed = this->GetParent()->GetDriver()->GetCurrentImageData()->GetMain();
   ImageWrapperBase *moving = this->GetMovingLayerWrapper();
 
+  // Matching the first moments only requires the centers of mass, which are
+  // cached with the intensity statistics of the layers, so greedy is not needed
+  itk::Point<double, 3> cpFix, cpMov;
+  if(order == 1
+     && this->GetLayerCenterOfMass(fixed, cpFix)
+     && this->GetLayerCenterOfMass(moving, cpMov))
+    {
+    ITKMatrixType matrix; matrix.SetIdentity();
+    ITKVectorType offset = cpMov - cpFix;
+    this->SetMovingTransform(matrix, offset);
+    return;
+    }
+
   // TODO: for now, we are not supporting vector image registration, only registration between
   // scalar components; and we use the default scalar component.
   ImageWrapperBase::FloatVectorImageType *fixed_cast =
@@ -959,8 +1187,8 @@ void RegistrationModel::SaveTransform(const char *filename, TransformFormat form
 const RegistrationModel::MetricLog &
 RegistrationModel::GetRegistrationMetricLog() const
 {
-  // Get the complete metric report
-  return m_GreedyAPI->GetMetricLog();
+  // The copy of the metric report last handed over by the registration
+  return m_MetricLog;
 }
 
 void RegistrationModel::OnDialogClosed()
@@ -1003,6 +1231,8 @@ bool RegistrationModel::CheckState(RegistrationModel::UIState state)
       return this->GetFreeRotationMode();
     case UIF_REGISTRATION_MODE:
       return !this->GetFreeRotationMode();
+    case UIF_AUTO_REGISTRATION_IDLE:
+      return !this->IsAutoRegistrationRunning();
     default:
       return false;
     }
@@ -1087,6 +1317,24 @@ void RegistrationModel::ResetTransformToIdentity()
   this->SetMovingTransform(matrix, offset);
 }
 
+bool RegistrationModel::GetLayerCenterOfMass(ImageWrapperBase *layer, itk::Point<double, 3> &point)
+{
+  // Use the same scalar representation as the registration
+  TDigestDataObject *digest = layer->GetDefaultScalarRepresentation()->GetTDigest();
+  digest->Update();
+
+  TDigestDataObject::SpatialMoments moments;
+  if(!digest->GetSpatialMoments(layer->GetTimePointIndex(), moments))
+    return false;
+
+  // Map the center from voxel to physical coordinates
+  itk::ContinuousIndex<double, 3> cidx;
+  for(int d = 0; d < 3; d++)
+    cidx[d] = moments.Center[d];
+  layer->GetImageBase()->TransformContinuousIndexToPhysicalPoint(cidx, point);
+  return true;
+}
+
 void RegistrationModel::MatchImageCenters()
 {
   // Set the transforms so that the center voxels of the two images are matched
@@ -1354,28 +1602,23 @@ void RegistrationModel::SetFinestResolutionLevelValue(int value)
     }
   }
 
-void RegistrationModel::IterationCallback(const itk::Object *object, const itk::EventObject &event)
+void RegistrationModel::IterationCallback(const itk::Object *object, const itk::EventObject &)
 {
+  // Stop the optimizer if the user cancelled
+  if(m_RegistrationProgress.IsCancelled())
+    throw RegistrationCancelledException();
+
   // Get the transform parameters
   typedef itk::MatrixOffsetTransformBase<double, 3, 3> TransformType;
   const TransformType *tran = dynamic_cast<const TransformType *>(object);
 
-  // Apply the transform
-  this->SetMovingTransform(tran->GetMatrix(), tran->GetOffset());
-
-  // Update the last metric value
-  const GreedyAPI::MetricLogType &metric_log = m_GreedyAPI->GetMetricLog();
-  if(metric_log.size())
-    {
-    const std::vector<MultiComponentMetricReport> &last_log = metric_log.back();
-    if(last_log.size())
-      m_LastMetricValueModel->SetValue(last_log.back().TotalPerPixelMetric);
-    }
-
-  // Fire the iteration command - this is to force the GUI to process events, instead of
-  // just putting the above ModelUpdateEvent() into a bucket
-  if(m_IterationCommand)
-    m_IterationCommand->Execute(object, event);
+  // Hand the transform and the metric log over to the GUI thread, replacing
+  // whatever it has not picked up yet, so that the optimizer never waits
+  std::lock_guard<std::mutex> lock(m_IterationMutex);
+  m_IterationMatrix = tran->GetMatrix();
+  m_IterationOffset = tran->GetOffset();
+  m_IterationMetricLog = m_GreedyAPI->GetMetricLog();
+  m_IterationUpdatePending = true;
 }
 
 
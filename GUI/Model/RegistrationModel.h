@@ -6,6 +6,10 @@
 #include "itkMatrix.h"
 #include "itkVector.h"
 #include "MultiComponentMetricReport.h"
+#include "ProgressToken.h"
+#include <atomic>
+#include <future>
+#include <mutex>
 
 class GlobalUIModel;
 class IRISApplication;
@@ -38,7 +42,8 @@ public:
     UIF_MOVING_SELECTION_AVAILABLE,
     UIF_MOVING_SELECTED,
     UIF_FREE_ROTATION_MODE,
-    UIF_REGISTRATION_MODE
+    UIF_REGISTRATION_MODE,
+    UIF_AUTO_REGISTRATION_IDLE
   };
 
   /** Allowed transformation models - to be expanded in the future */
@@ -121,9 +126,26 @@ public:
   irisGenericPropertyAccessMacro(FinestResolutionLevel, int, ResolutionLevelDomain)
   irisSimplePropertyAccessMacro(FreeRotationMode, bool)
 
-  void SetIterationCommand(itk::Command *command);
+  /**
+   * Start the automatic registration on a background thread. While it runs,
+   * UpdateAutoRegistration() should be called periodically from the GUI
+   * thread to show the progress.
+   */
+  void StartAutoRegistration();
+
+  /**
+   * Apply the latest intermediate transform of the running registration to
+   * the moving layer and update the metric log. Once the registration has
+   * finished, it applies the final transform, cleans up and rethrows any
+   * error from the registration. Returns true while it is still running.
+   */
+  bool UpdateAutoRegistration();
+
+  /** Ask the running registration to stop after the current iteration */
+  void CancelAutoRegistration();
 
-  void RunAutoRegistration();
+  /** Whether a registration started by StartAutoRegistration is running */
+  bool IsAutoRegistrationRunning() const;
 
   void LoadTransform(const char *filename, TransformFormat format,
                      bool compose = false, bool inverse = false);
@@ -169,9 +191,50 @@ protected:
   GlobalUIModel *m_Parent;
   IRISApplication *m_Driver;
 
-  // Pointer to the GreedyAPI. This is only non-null during RunAutoRegistration();
+  // Pointer to the GreedyAPI. This is only non-null while a registration runs
   GreedyAPI *m_GreedyAPI;
 
+  // The background registration and the token used to cancel it
+  std::future<void> m_RegistrationFuture;
+  ProgressToken m_RegistrationProgress;
+
+  // Layers whose cast pipelines must be released after the registration
+  SmartPtr<ImageWrapperBase> m_RegistrationFixed, m_RegistrationMoving, m_RegistrationMask;
+
+  // Latest transform and metric log handed over by the registration thread
+  std::mutex m_IterationMutex;
+  ITKMatrixType m_IterationMatrix;
+  ITKVectorType m_IterationOffset;
+  MetricLog m_IterationMetricLog;
+  bool m_IterationUpdatePending;
+
+  // Copy of the metric log used by the GUI thread
+  MetricLog m_MetricLog;
+
+  // Release the resources of the background registration
+  void FinishAutoRegistration();
+
+  // Reduced resolution copies of the fixed, moving and mask images, kept
+  // across registration runs so that rerunning the registration, e.g., with
+  // a different finest level, does not downsample the images again. The
+  // copies are dropped when the layer or the data of its cast pipeline
+  // change. Levels[k-1] has 2^k times fewer voxels along each axis
+  struct RegistrationInputPyramid
+  {
+    unsigned long LayerId = 0;
+    itk::ModifiedTimeType MTime = 0, PipelineMTime = 0;
+    std::vector<SmartPtr<itk::ImageBase<3> > > Levels;
+  };
+
+  enum RegistrationInputSlot { FIXED_INPUT = 0, MOVING_INPUT, MASK_INPUT, NUMBER_OF_INPUTS };
+  RegistrationInputPyramid m_InputPyramids[NUMBER_OF_INPUTS];
+
+  // Get the cast image of a layer at a pyramid level, from the cache or by
+  // downsampling. The display pyramid of the layer is used if it has the level
+  template <class TImage>
+  TImage *GetRegistrationInputAtLevel(RegistrationInputSlot slot, ImageWrapperBase *layer,
+                                      TImage *cast, unsigned int level);
+
   // Shorthand to generate an ITK affine transform from a matrix and a vector
   SmartPtr<AffineTransform> MakeTransform(const ITKMatrixType &matrix, const ITKVectorType &offset) const;
   SmartPtr<AffineTransform> MakeIdentityTransform() const;
@@ -294,6 +357,10 @@ protected:
   // Current center of rotation - should be initialized to the center when new image is loaded
   Vector3ui m_RotationCenter;
 
+  // Get the center of mass of a layer at its current time point, in physical
+  // coordinates, from the moments cached with the layer's intensity statistics
+  bool GetLayerCenterOfMass(ImageWrapperBase *layer, itk::Point<double, 3> &point);
+
   // Callback for when the transform being computed by auto-registration is modified
   void IterationCallback(const itk::Object *object, const itk::EventObject &event);
 
@@ -301,9 +368,6 @@ protected:
   // TODO: make this a model
   std::vector<int> m_IterationPyramid;
 
-  // Command used for responding to intermediate data generated by registration
-  SmartPtr<itk::Command> m_IterationCommand;
-
   // Renderer used to plot the metric
   SmartPtr<OptimizationProgressRenderer> m_RegistrationProgressRenderer;
 
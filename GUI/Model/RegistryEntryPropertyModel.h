@@ -32,7 +32,7 @@ public:
   void Initialize(Registry *registry, const char *key, TVal deflt)
   {
     m_Registry = registry;
-    m_Key = key;
+    m_Key = RegistryKey(key);
     m_DefaultValue = deflt;
 
     // Listen to events from the corresponding folder (how)
@@ -62,8 +62,8 @@ protected:
   // The registry
   Registry *m_Registry;
 
-  // Key
-  const char *m_Key;
+  // Key, which remembers the entry between accesses
+  RegistryKey m_Key;
 
   // Default value
   TVal m_DefaultValue;
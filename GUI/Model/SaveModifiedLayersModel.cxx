@@ -5,6 +5,10 @@
 #include "GenericImageData.h"
 #include "IRISImageData.h"
 #include "ImageIODelegates.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <deque>
+#include <thread>
 
 
 bool AbstractSaveableItem::IsSaveable()
@@ -61,6 +65,49 @@ bool ImageLayerSaveableItem::RequiresInteraction()
   return GetFilename().size() == 0;
 }
 
+bool ImageLayerSaveableItem::StartBackgroundSave()
+{
+  if(this->RequiresInteraction())
+    return false;
+
+  // Use the same delegate as the interactive save
+  IRISApplication *driver = m_Model->GetParentModel()->GetDriver();
+  SmartPtr<AbstractSaveImageDelegate> delegate =
+      driver->CreateSaveDelegateForLayer(m_Wrapper, m_Role);
+  if(!delegate->CanWriteInBackground())
+    return false;
+
+  m_BackgroundDelegate = delegate;
+  m_BackgroundFilename = delegate->GetCurrentFilename();
+  m_BackgroundWrite = TaskScheduler::GetInstance()->Submit(
+        TaskScheduler::USER_COMPUTE, [delegate, this]()
+    {
+    Registry reg;
+    delegate->WriteImage(m_BackgroundFilename, reg);
+    });
+
+  return true;
+}
+
+bool ImageLayerSaveableItem::FinishBackgroundSave()
+{
+  bool success = false;
+  try
+    {
+    m_BackgroundWrite.get();
+    m_BackgroundDelegate->FinishSaving(m_BackgroundFilename);
+    success = true;
+    }
+  catch(std::exception &)
+    {
+    // The layer remains unsaved, and the interactive save will report the
+    // error if it happens again
+    }
+
+  m_BackgroundDelegate = NULL;
+  return success;
+}
+
 
 
 
@@ -281,8 +328,41 @@ void SaveModifiedLayersModel::DiscardCurrent()
   this->InvokeEvent(ModelUpdateEvent());
 }
 
+void SaveModifiedLayersModel::SaveLayersInBackground()
+{
+  // A small number of layers are written at a time, to limit memory use
+  unsigned int max_tasks = (std::max)(1u, (std::min)(4u, std::thread::hardware_concurrency()));
+  std::deque<ImageLayerSaveableItem *> tasks;
+
+  for(auto &item : m_UnsavedItems)
+    {
+    ImageLayerSaveableItem *layer_item = dynamic_cast<ImageLayerSaveableItem *>(item.GetPointer());
+    if(layer_item && layer_item->NeedsDecision() && layer_item->IsSaveable())
+      {
+      // Wait for a worker to become available
+      if(tasks.size() >= max_tasks)
+        {
+        tasks.front()->FinishBackgroundSave();
+        tasks.pop_front();
+        }
+
+      if(layer_item->StartBackgroundSave())
+        tasks.push_back(layer_item);
+      }
+    }
+
+  // Wait for the remaining writes
+  for(auto *layer_item : tasks)
+    layer_item->FinishBackgroundSave();
+}
+
 void SaveModifiedLayersModel::SaveAll()
 {
+  // Layers that already have filenames are written concurrently. Whatever
+  // is left (layers that need a filename, failed writes, the workspace)
+  // is saved below
+  this->SaveLayersInBackground();
+
   // For all items that need decision, save them, respecting dependencies
   int n_Unsaved = m_UnsavedItems.size();
   while(n_Unsaved > 0)
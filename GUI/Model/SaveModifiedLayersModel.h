@@ -2,6 +2,8 @@
 #define SAVEMODIFIEDLAYERSMODEL_H
 
 #include "PropertyModel.h"
+#include "ImageIODelegates.h"
+#include <future>
 
 class ImageWrapperBase;
 class GlobalUIModel;
@@ -95,12 +97,30 @@ public:
   /** Whether this item requires interaction to be saved */
   virtual bool RequiresInteraction() ITK_OVERRIDE;
 
+  /**
+   * Start writing the layer to its current file on a worker thread. Returns
+   * false if the layer cannot be saved this way, in which case it should be
+   * saved with Save(). Otherwise, FinishBackgroundSave() must be called.
+   */
+  bool StartBackgroundSave();
+
+  /**
+   * Wait for the background write to finish and complete the save. Returns
+   * false if the write failed, leaving the layer unsaved.
+   */
+  bool FinishBackgroundSave();
+
 protected:
 
   // The image wrapper
   ImageWrapperBase *m_Wrapper;
   LayerRole m_Role;
   SaveModifiedLayersModel *m_Model;
+
+  // State of the background save
+  SmartPtr<AbstractSaveImageDelegate> m_BackgroundDelegate;
+  std::string m_BackgroundFilename;
+  std::future<void> m_BackgroundWrite;
 };
 
 /**
@@ -202,6 +222,9 @@ protected:
   // Update the list of unsaved items
   void BuildUnsavedItemsList(std::list<ImageWrapperBase *> layers, bool force_exclude_workspace);
 
+  // Write the layers that can be saved without interaction concurrently
+  void SaveLayersInBackground();
+
   // Update the current imate
   void UpdateCurrentItem();
 };
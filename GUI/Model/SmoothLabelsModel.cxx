@@ -5,7 +5,13 @@
 #include "IRISApplication.h"
 #include "SegmentationUpdateIterator.h"
 #include "SegmentationStatistics.h"
-#include "ConvertAPI.h"
+#include "RLEImageRegionIterator.h"
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkMultiThreaderBase.h>
+#include <itkRecursiveGaussianImageFilter.h>
+#include <cmath>
+#include <map>
+#include <mutex>
 
 
 SmoothLabelsModel::SmoothLabelsModel()
@@ -34,64 +40,191 @@ GlobalUIModel* SmoothLabelsModel::GetParent() const
 
 void
 SmoothLabelsModel
-::ApplyC3DSmoothing(LabelImageWrapper *liw, std::vector<double> sigma
-                    , SigmaUnit sigmaUnit, std::unordered_set<LabelType> labelsToSmooth)
+::ApplyLabelSmoothing(LabelImageWrapper *liw, std::vector<double> sigma
+                      , SigmaUnit sigmaUnit, std::unordered_set<LabelType> labelsToSmooth)
 {
-  typedef ConvertAPI<double, 3> ConvertAPIType;
   typedef LabelImageWrapper::ImageType LabelImageType;
-  typedef typename ConvertAPIType::ImageType C3DImageType;
-
-  // Convert LabelImageType to C3DImageType
-  C3DImageType::Pointer c3dInputImage = C3DImageType::New();
-  c3dInputImage->SetRegions(liw->GetImage()->GetLargestPossibleRegion());
-  c3dInputImage->Allocate();
-
-  itk::ImageRegionIterator<C3DImageType>
-      it_c3d(c3dInputImage, c3dInputImage->GetLargestPossibleRegion());
-
-  itk::ImageRegionConstIterator<LabelImageType>
-      it_label(liw->GetImage(), liw->GetBufferedRegion());
-
-  // Deep copy pixels
-  while (!it_label.IsAtEnd())
+  typedef itk::Image<float, 3> FloatImageType;
+  typedef itk::RecursiveGaussianImageFilter<FloatImageType, FloatImageType> GaussianFilterType;
+  typedef itk::ImageRegion<3> RegionType;
+
+  // Each selected label is smoothed as a binary image, and each voxel is
+  // given the label with the largest smoothed value. The labels that are not
+  // selected compete as a single label, whose smoothed value is one minus the
+  // sum of the selected ones. If they win at a voxel, the voxel keeps its
+  // label, or becomes clear if it had one of the selected labels.
+  const LabelImageType *img = liw->GetImage();
+  RegionType full = img->GetBufferedRegion();
+
+  // The smoothing of a label only reaches three sigmas past its bounding box
+  double sigma_mm[3];
+  itk::Size<3> pad;
+  for(unsigned int d = 0; d < 3; d++)
     {
-      it_c3d.Set(it_label.Get());
-      ++it_c3d;
-      ++it_label;
+    double spacing = img->GetSpacing()[d];
+    double sigma_vox = (sigmaUnit == mm) ? sigma[d] / spacing : sigma[d];
+    sigma_mm[d] = sigma_vox * spacing;
+    pad[d] = (itk::SizeValueType) std::ceil(3.0 * sigma_vox) + 1;
     }
 
-  // Build label string
-  std::string labelString;
-  for (auto cit = labelsToSmooth.cbegin(); cit != labelsToSmooth.cend(); ++cit)
+  // Find the bounding box of each selected label from its run-length lines
+  struct Extent
+  {
+    long lo[3], hi[3];
+    void Merge(const Extent &e)
     {
-      labelString += std::to_string(*cit) + ' ';
+      for(int d = 0; d < 3; d++)
+        {
+        lo[d] = std::min(lo[d], e.lo[d]);
+        hi[d] = std::max(hi[d], e.hi[d]);
+        }
     }
+  };
+
+  std::map<LabelType, Extent> extents;
+  std::mutex mutex;
+  img->ParallelForEachLine(full, [&](LabelImageType::RLLine &line, const LabelImageType::IndexType &idx)
+  {
+    std::map<LabelType, Extent> line_extents;
+    long x = idx[0];
+    for(auto &seg : line)
+      {
+      if(labelsToSmooth.count(seg.second))
+        {
+        Extent e = {{ x, (long) idx[1], (long) idx[2] }, { x + seg.first - 1, (long) idx[1], (long) idx[2] }};
+        auto it = line_extents.find(seg.second);
+        if(it == line_extents.end())
+          line_extents[seg.second] = e;
+        else
+          it->second.Merge(e);
+        }
+      x += seg.first;
+      }
 
-  ConvertAPIType c3d;
+    if(line_extents.size())
+      {
+      std::lock_guard<std::mutex> guard(mutex);
+      for(auto &it : line_extents)
+        {
+        auto itAll = extents.find(it.first);
+        if(itAll == extents.end())
+          extents.insert(it);
+        else
+          itAll->second.Merge(it.second);
+        }
+      }
+  });
 
-  // Add Input Image to the stack
-  c3d.AddImage("imgin", c3dInputImage);
+  if(extents.empty())
+    return;
 
-  // Redirect c3d standard outputs
-  c3d.RedirectOutput(std::cout, std::cerr);
+  // Padded regions of the labels, and the region that contains all of them
+  std::vector<std::pair<LabelType, RegionType> > label_regions;
+  RegionType update_region;
+  for(auto &it : extents)
+    {
+    RegionType r;
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      r.SetIndex(d, it.second.lo[d]);
+      r.SetSize(d, it.second.hi[d] - it.second.lo[d] + 1);
+      }
+    r.PadByRadius(pad);
+    r.Crop(full);
+    label_regions.push_back(std::make_pair(it.first, r));
+
+    if(update_region.GetNumberOfPixels() == 0)
+      update_region = r;
+    else
+      {
+      for(unsigned int d = 0; d < 3; d++)
+        {
+        long lo = std::min(update_region.GetIndex(d), r.GetIndex(d));
+        long hi = std::max(update_region.GetUpperIndex()[d], r.GetUpperIndex()[d]);
+        update_region.SetIndex(d, lo);
+        update_region.SetSize(d, hi - lo + 1);
+        }
+      }
+    }
 
-  // Execute API call
-  c3d.Execute(
-        "-clear -push imgin -smooth-multilabel %fx%fx%f%s \"%s\" -as imgout",
-        sigma[0], sigma[1], sigma[2], SigmaUnitStr[sigmaUnit], labelString.c_str()
-  );
+  // Largest smoothed value, its label, and the sum of the smoothed values at
+  // each voxel of the update region
+  unsigned long n_update = update_region.GetNumberOfPixels();
+  std::vector<float> best(n_update, 0.0f), sum(n_update, 0.0f);
+  std::vector<LabelType> best_label(n_update, 0);
+  std::vector<bool> has_best(n_update, false);
+
+  // The labels are smoothed in parallel. Each label uses a single thread, and
+  // only locks the accumulators to merge its result into them
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, label_regions.size(), [&](itk::SizeValueType k)
+  {
+    LabelType label = label_regions[k].first;
+    const RegionType &r = label_regions[k].second;
+
+    // Binary image of the label in its region
+    FloatImageType::Pointer binary = FloatImageType::New();
+    binary->CopyInformation(img);
+    binary->SetRegions(r);
+    binary->Allocate();
+    itk::ImageRegionConstIterator<LabelImageType> it_src(img, r);
+    itk::ImageRegionIterator<FloatImageType> it_bin(binary, r);
+    for(; !it_src.IsAtEnd(); ++it_src, ++it_bin)
+      it_bin.Set(it_src.Get() == label ? 1.0f : 0.0f);
+
+    // Smooth along each axis. Axes that are too short for the recursive
+    // filter, e.g., in 2D images, are not smoothed
+    FloatImageType::Pointer smooth = binary;
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      if(r.GetSize(d) < 4 || sigma_mm[d] <= 0.0)
+        continue;
 
-  C3DImageType::Pointer c3dOutputImage = c3d.GetImage("imgout");
+      SmartPtr<GaussianFilterType> gauss = GaussianFilterType::New();
+      gauss->SetInput(smooth);
+      gauss->SetDirection(d);
+      gauss->SetSigma(sigma_mm[d]);
+      gauss->SetOrder(itk::GaussianOrderEnum::ZeroOrder);
+      gauss->SetNumberOfWorkUnits(1);
+      gauss->Update();
+      smooth = gauss->GetOutput();
+      smooth->DisconnectPipeline();
+      }
+
+    // Merge into the accumulators
+    std::lock_guard<std::mutex> guard(mutex);
+    itk::ImageRegionConstIteratorWithIndex<FloatImageType> it_smooth(smooth, r);
+    for(; !it_smooth.IsAtEnd(); ++it_smooth)
+      {
+      const itk::Index<3> &idx = it_smooth.GetIndex();
+      unsigned long i = (idx[0] - update_region.GetIndex(0))
+          + update_region.GetSize(0) * ((idx[1] - update_region.GetIndex(1))
+          + update_region.GetSize(1) * (idx[2] - update_region.GetIndex(2)));
+      float v = it_smooth.Get();
+      sum[i] += v;
+      if(!has_best[i] || v > best[i])
+        {
+        best[i] = v;
+        best_label[i] = label;
+        has_best[i] = true;
+        }
+      }
+  }, nullptr);
 
-  // Apply output back to segmentation image
-  SegmentationUpdateIterator it_update(liw, liw->GetBufferedRegion()
+  // Apply output back to the segmentation image, only in the update region
+  SegmentationUpdateIterator it_update(liw, update_region
                                        , m_Parent->GetGlobalState()->GetDrawingColorLabel()
                                        , m_Parent->GetGlobalState()->GetDrawOverFilter());
-  itk::ImageRegionConstIterator<C3DImageType>
-      it_src(c3dOutputImage, c3dOutputImage->GetBufferedRegion());
 
-  for (; !it_update.IsAtEnd(); ++it_update, ++it_src)
-      it_update.PaintLabel(it_src.Get());
+  for (unsigned long i = 0; !it_update.IsAtEnd(); ++it_update, ++i)
+    {
+    LabelType l_old = it_update.GetLabel();
+    float rest = 1.0f - sum[i];
+    if(has_best[i] && best[i] >= rest)
+      it_update.PaintLabel(best_label[i]);
+    else if(labelsToSmooth.count(l_old))
+      it_update.PaintLabel(0);
+    }
 
   // Finalize update and create an undo point
   it_update.Finalize("Smooth Labels");
@@ -149,8 +282,8 @@ SmoothLabelsModel
       if (cnt < 2)
         continue;
 
-      // Apply the c3d multilabel smoothing api
-      this->ApplyC3DSmoothing(liw, sigmaInput, unit, labelsToSmooth);
+      // Smooth the labels in this frame
+      this->ApplyLabelSmoothing(liw, sigmaInput, unit, labelsToSmooth);
     }
 
   // Change label image to current frame
@@ -61,9 +61,9 @@ protected:
   template <typename TImage>
   void DeepCopy(typename TImage::Pointer input, typename TImage::Pointer output);
 
-  // utility method to apply c3d smoothing
-  void ApplyC3DSmoothing(LabelImageWrapper *liw, std::vector<double> sigma
-                         , SigmaUnit sigmaUnit, std::unordered_set<LabelType> labelsToSmooth);
+  // utility method to smooth the selected labels in the current frame
+  void ApplyLabelSmoothing(LabelImageWrapper *liw, std::vector<double> sigma
+                           , SigmaUnit sigmaUnit, std::unordered_set<LabelType> labelsToSmooth);
 };
 
 #endif // SMOOTHLABELMODEL_H
@@ -279,6 +279,19 @@ void SnakeROIModel::ResetROI()
   m_Parent->GetDriver()->GetGlobalState()->SetSegmentationROI(roi);
 }
 
+void SnakeROIModel::SetROIToCurrentSlice()
+{
+  IRISApplication *driver = m_Parent->GetDriver();
+  GlobalState::RegionType roi = driver->GetGlobalState()->GetSegmentationROI();
+
+  // The ROI is one voxel thick along the slice direction of this view
+  unsigned int idx = m_Parent->GetSliceDirectionInImageSpace();
+  roi.SetIndex(idx, driver->GetCursorPosition()[idx]);
+  roi.SetSize(idx, 1);
+
+  driver->GetGlobalState()->SetSegmentationROI(roi);
+}
+
 void SnakeROIModel::ProcessLeaveEvent()
 {
   // Turn off the highlight
@@ -89,6 +89,14 @@ public:
 
   void ResetROI();
 
+  /**
+   * Reduce the region of interest to the slice shown in this view, keeping
+   * its extent within the slice. The preprocessing and the level set are then
+   * computed on that slice only, and the snake evolves in 2D. The result is
+   * merged into the segmentation like that of any other snake.
+   */
+  void SetROIToCurrentSlice();
+
   /** Map from system's ROI in image coordinates to 2D slice coords */
   void GetSystemROICorners(Vector3d corner[2]);
 
@@ -17,6 +17,7 @@
 #include "RandomForestClassifyImageFilter.h"
 #include "NumericPropertyToggleAdaptor.h"
 #include "itkStreamingImageFilter.h"
+#include "HistoryManager.h"
 
 SnakeWizardModel::SnakeWizardModel()
 {
@@ -130,14 +131,13 @@ SnakeWizardModel::SnakeWizardModel()
         BubbleDefaultRadiusUpdateEvent());
 
   m_StepSizeModel = NewRangedConcreteProperty(1, 1, 100, 1);
+  m_PropagateToTimePointsModel = NewSimpleConcreteProperty(false);
 
-  // Need to define a null setter function
-  void (Self::*nullsetter)(int) = NULL;
-
+  // Setting the iteration plays the evolution back or forward to it
   m_EvolutionIterationModel = wrapGetterSetterPairAsProperty(
         this,
         &Self::GetEvolutionIterationValue,
-        nullsetter,
+        &Self::SetEvolutionIterationValue,
         EvolutionIterationEvent());
 
   m_NumberOfClustersModel = wrapGetterSetterPairAsProperty(
@@ -154,6 +154,13 @@ SnakeWizardModel::SnakeWizardModel()
         GMMModifiedEvent(),
         GMMModifiedEvent());
 
+  m_GMMMiniBatchModel = wrapGetterSetterPairAsProperty(
+        this,
+        &Self::GetGMMMiniBatchValue,
+        &Self::SetGMMMiniBatchValue,
+        GMMModifiedEvent(),
+        GMMModifiedEvent());
+
   m_ForegroundClusterModel = wrapGetterSetterPairAsProperty(
         this,
         &Self::GetForegroundClusterValueAndRange,
@@ -307,6 +314,9 @@ bool SnakeWizardModel::CheckState(SnakeWizardModel::UIState state)
     case UIF_INITIALIZATION_VALID:
       return m_GlobalState->GetSnakeInitializedWithManualSegmentation()
           || m_Driver->GetBubbleArray().size() > 0;
+    case UIF_CAN_PROPAGATE_TIME_POINTS:
+      return m_Driver->IsSnakeModeActive()
+          && m_Driver->GetIRISImageData()->GetMain()->GetNumberOfTimePoints() > 1;
     }
 
   return false;
@@ -1126,13 +1136,41 @@ void SnakeWizardModel
 
 void SnakeWizardModel::ApplyPreprocessing()
 {
-  // Compute the speed image
-  m_Driver->ApplyCurrentPreprocessingModeToSpeedVolume(m_Parent->GetProgressCommand());
+  // Compute the speed image. Only the parts that the active contour needs
+  // are computed before it evolves, the rest is computed when idle
+  m_Driver->ApplyCurrentPreprocessingModeToSpeedVolumeLazily();
 
   // Invoke an event so we get a screen update
   InvokeEvent(ModelUpdateEvent());
 }
 
+bool SnakeWizardModel::ComputeNextPreprocessingTile()
+{
+  if(!m_Driver->IsSnakeModeActive())
+    return false;
+
+  // Finish the preview of the slices in view before working ahead
+  if(m_Driver->ContinueSpeedPreview())
+    {
+    this->InvokeEvent(ModelUpdateEvent());
+    return true;
+    }
+
+  // When the speed image applied lazily is complete, the views stop showing
+  // the preview and show the speed image itself
+  bool pending = m_Driver->IsSpeedVolumePending();
+  bool more = m_Driver->ComputeNextSpeedVolumeTile();
+  if(pending && !m_Driver->IsSpeedVolumePending())
+    this->InvokeEvent(ModelUpdateEvent());
+
+  return more;
+}
+
+bool SnakeWizardModel::IsSpeedVolumePending()
+{
+  return m_Driver->IsSnakeModeActive() && m_Driver->IsSpeedVolumePending();
+}
+
 bool SnakeWizardModel::GetSnakeTypeValueAndRange(
     SnakeType &value, GlobalState::SnakeTypeDomain *range)
 {
@@ -1432,6 +1470,37 @@ bool SnakeWizardModel::PerformEvolutionStep()
   return false;
 }
 
+void SnakeWizardModel::StartEvolution()
+{
+  SNAPImageData *sid = m_Driver->GetSNAPImageData();
+  if(sid && sid->IsSegmentationActive())
+    sid->StartEvolution(m_StepSizeModel->GetValue());
+}
+
+void SnakeWizardModel::StopEvolution()
+{
+  SNAPImageData *sid = m_Driver->GetSNAPImageData();
+  if(sid && sid->IsSegmentationActive())
+    {
+    sid->StopEvolution();
+    InvokeEvent(EvolutionIterationEvent());
+    }
+}
+
+bool SnakeWizardModel::UpdateEvolutionDisplay()
+{
+  SNAPImageData *sid = m_Driver->GetSNAPImageData();
+  if(!sid || !sid->IsSegmentationActive())
+    return false;
+
+  unsigned int iteration = sid->GetElapsedSegmentationIterations();
+  bool running = sid->UpdateEvolutionDisplay();
+  if(!running || iteration != sid->GetElapsedSegmentationIterations())
+    InvokeEvent(EvolutionIterationEvent());
+
+  return running;
+}
+
 int SnakeWizardModel::GetEvolutionIterationValue()
 {
   if(m_Driver->IsSnakeModeActive() &&
@@ -1442,6 +1511,16 @@ int SnakeWizardModel::GetEvolutionIterationValue()
   else return 0;
 }
 
+void SnakeWizardModel::SetEvolutionIterationValue(int value)
+{
+  if(m_Driver->IsSnakeModeActive() &&
+     m_Driver->GetSNAPImageData()->IsSegmentationActive())
+    {
+    m_Driver->GetSNAPImageData()->GoToSegmentationIteration(value > 0 ? value : 0);
+    InvokeEvent(EvolutionIterationEvent());
+    }
+}
+
 ThresholdSettings *SnakeWizardModel::GetThresholdSettings()
 {
   // Get the layer currently being thresholded
@@ -1472,13 +1551,23 @@ void SnakeWizardModel::OnEvolutionPageBack()
 
 void SnakeWizardModel::OnEvolutionPageFinish()
 {
-  // Stop the segmentation pipeline
+  // Stop the segmentation pipeline. The other time points are evolved for
+  // as many iterations as this one
+  unsigned int nIterations = 0;
   if(m_Driver->GetSNAPImageData()->IsSegmentationActive())
+    {
+    nIterations = m_Driver->GetSNAPImageData()->GetElapsedSegmentationIterations();
     m_Driver->GetSNAPImageData()->TerminateSegmentation();
+    }
 
   // Update IRIS with SNAP images
   m_Driver->UpdateIRISWithSnapImageData(NULL);
 
+  // Segment the other time points, seeded with this result
+  if(m_PropagateToTimePointsModel->GetValue() && nIterations > 0
+     && m_Driver->CanPropagateActiveContourToTimePoints())
+    m_Driver->PropagateActiveContourToTimePoints(nIterations);
+
   // Return to IRIS mode
   m_Driver->SetCurrentImageDataToIRIS();
   m_Driver->ReleaseSNAPImageData();
@@ -1572,6 +1661,26 @@ void SnakeWizardModel::SetNumberOfGMMSamplesValue(int value)
   this->InvokeEvent(GMMModifiedEvent());
 }
 
+bool SnakeWizardModel::GetGMMMiniBatchValue(bool &value)
+{
+  UnsupervisedClustering *uc = m_Driver->GetClusteringEngine();
+  if(!uc)
+    return false;
+
+  value = uc->GetMiniBatchSize() > 0;
+  return true;
+}
+
+void SnakeWizardModel::SetGMMMiniBatchValue(bool value)
+{
+  UnsupervisedClustering *uc = m_Driver->GetClusteringEngine();
+  assert(uc);
+
+  // Only the following iterations are affected, the model is kept
+  uc->SetMiniBatchSize(value ? UnsupervisedClustering::DEFAULT_MINI_BATCH_SIZE : 0);
+  this->InvokeEvent(GMMModifiedEvent());
+}
+
 bool SnakeWizardModel::GetForegroundClusterValueAndRange(int &value, NumericValueRange<int> *range)
 {
   UnsupervisedClustering *uc = m_Driver->GetClusteringEngine();
@@ -1837,6 +1946,28 @@ bool SnakeWizardModel::IsClassifierTrained()
   return rfengine && rfengine->GetClassifier()->IsValidClassifier();
 }
 
+void SnakeWizardModel::SaveClassifier(const std::string &file)
+{
+  IRISApplication::RFEngine *rfengine = m_Driver->GetClassificationEngine();
+  assert(rfengine);
+  rfengine->SaveClassifier(file.c_str());
+
+  m_Driver->GetHistoryManager()->UpdateHistory("Classifier", file, true);
+}
+
+void SnakeWizardModel::LoadClassifier(const std::string &file)
+{
+  IRISApplication::RFEngine *rfengine = m_Driver->GetClassificationEngine();
+  assert(rfengine);
+  rfengine->LoadClassifier(file.c_str());
+
+  m_Driver->GetHistoryManager()->UpdateHistory("Classifier", file, true);
+
+  // The patch settings of the engine have changed as well
+  InvokeEvent(RFClassifierModifiedEvent());
+  TagRFPreprocessingFilterModified();
+}
+
 void SnakeWizardModel::ClearSegmentation()
 {
   m_Driver->ResetSNAPSegmentationImage();
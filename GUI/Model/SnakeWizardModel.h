@@ -65,7 +65,8 @@ public:
     UIF_PREPROCESSING_ACTIVE,         // Is the preprocessing dialog open?
     UIF_BUBBLE_SELECTED,
     UIF_INITIALIZATION_VALID,          // Do we have data to start snake evol?
-    UIF_BUBBLE_MODE
+    UIF_BUBBLE_MODE,
+    UIF_CAN_PROPAGATE_TIME_POINTS      // Can the result be propagated in 4D?
     };
 
   // Model for the threshold mode
@@ -142,6 +143,9 @@ public:
   irisGetMacro(StepSizeModel, AbstractRangedIntProperty *)
   irisGetMacro(EvolutionIterationModel, AbstractSimpleIntProperty *)
 
+  // Whether finishing also segments the other time points of a 4D image
+  irisSimplePropertyAccessMacro(PropagateToTimePoints, bool)
+
   /** Check the state flags above */
   bool CheckState(UIState state);
 
@@ -178,6 +182,12 @@ public:
   /** Perform the preprocessing based on thresholds */
   void ApplyPreprocessing();
 
+  /** Compute part of the preprocessing ahead of time, call when idle */
+  bool ComputeNextPreprocessingTile();
+
+  /** Whether the speed image is still being computed after preprocessing */
+  bool IsSpeedVolumePending();
+
   /** Do some cleanup when the preprocessing dialog closes */
   void CompletePreprocessing();
 
@@ -208,6 +218,22 @@ public:
    */
   bool PerformEvolutionStep();
 
+  /**
+   * Start evolving the snake continuously in the background. The display is
+   * updated by calling UpdateEvolutionDisplay() periodically, so that the
+   * evolution does not wait for the redraws
+   */
+  void StartEvolution();
+
+  /** Stop the continuous evolution */
+  void StopEvolution();
+
+  /**
+   * Show the latest state of the continuous evolution. Returns false once the
+   * evolution has stopped by itself
+   */
+  bool UpdateEvolutionDisplay();
+
   /** Rewind the evolution */
   void RewindEvolution();
 
@@ -224,6 +250,9 @@ public:
   /** Model controlling the number of sampled for GMM optimization */
   irisRangedPropertyAccessMacro(NumberOfGMMSamples, int)
 
+  /** Model for whether GMM iterations only visit a batch of the samples */
+  irisSimplePropertyAccessMacro(GMMMiniBatch, bool)
+
   /** Model controlling the cluster used for the foreground probability */
   irisRangedPropertyAccessMacro(ForegroundCluster, int)
 
@@ -296,6 +325,12 @@ public:
   /** Whether the classifier is trained and available for use */
   bool IsClassifierTrained();
 
+  /** Save the trained classifier, e.g., to apply it to other images with itksnap-wt */
+  void SaveClassifier(const std::string &file);
+
+  /** Load a classifier saved with SaveClassifier() */
+  void LoadClassifier(const std::string &file);
+
   /** Clear the classification examples (i.e., clear the classification) */
   void ClearSegmentation();
 
@@ -369,8 +404,11 @@ protected:
 
   SmartPtr<ConcreteRangedIntProperty> m_StepSizeModel;
 
+  SmartPtr<ConcreteSimpleBooleanProperty> m_PropagateToTimePointsModel;
+
   SmartPtr<AbstractSimpleIntProperty> m_EvolutionIterationModel;
   int GetEvolutionIterationValue();
+  void SetEvolutionIterationValue(int value);
 
   // Get the threshold settings for the active layer
   ThresholdSettings *GetThresholdSettings();
@@ -415,6 +453,10 @@ protected:
   bool GetNumberOfGMMSamplesValueAndRange(int &value, NumericValueRange<int> *range);
   void SetNumberOfGMMSamplesValue(int value);
 
+  SmartPtr<AbstractSimpleBooleanProperty> m_GMMMiniBatchModel;
+  bool GetGMMMiniBatchValue(bool &value);
+  void SetGMMMiniBatchValue(bool value);
+
   // Model for the active cluster
   SmartPtr<AbstractRangedIntProperty> m_ForegroundClusterModel;
   bool GetForegroundClusterValueAndRange(int &value, NumericValueRange<int> *range);
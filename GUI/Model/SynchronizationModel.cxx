@@ -11,6 +11,7 @@
 #include "vtkCamera.h"
 #include "vtkCommand.h"
 #include "IPCHandler.h"
+#include <cstring>
 
 /** Structure passed on to IPC */
 struct IPCMessage
@@ -28,8 +29,12 @@ struct IPCMessage
   // 3D camera state
   CameraState camera;
 
+  // Sequence numbers of the fields above, incremented whenever a session
+  // broadcasts a change to the field, so receivers only apply what changed
+  long field_seq[SynchronizationModel::FIELD_COUNT];
+
   // Version of the data structure
-  enum VersionEnum { VERSION = 0x1005 };
+  enum VersionEnum { VERSION = 0x1006 };
 };
 
 
@@ -53,6 +58,10 @@ SynchronizationModel::SynchronizationModel()
   // Broadcast state
   m_CanBroadcast = false;
 
+  // No fields have been received yet
+  for(int f = 0; f < FIELD_COUNT; f++)
+    m_LastFieldSeq[f] = -1;
+
   // Warp layer model
   m_WarpLayerModel = wrapGetterSetterPairAsProperty(
                        this,
@@ -131,11 +140,17 @@ void SynchronizationModel::OnUpdate()
 
   // Read the contents of shared memory into the local message object
   IPCMessage message;
-  m_IPCHandler->Read(static_cast<void *>(&message));
+  if(!m_IPCHandler->Read(static_cast<void *>(&message)))
+    {
+    // Nothing valid has been broadcast yet
+    memset(&message, 0, sizeof(IPCMessage));
+    }
 
   // Cursor change
   if(bc_cursor)
     {
+    message.field_seq[FIELD_CURSOR]++;
+
     // Map the cursor to NIFTI coordinates
     ImageWrapperBase *iw = app->GetCurrentImageData()->GetMain();
 
@@ -158,6 +173,10 @@ void SynchronizationModel::OnUpdate()
     }
 
   // Zoom/Pan change
+  if(bc_zoom)
+    message.field_seq[FIELD_ZOOM]++;
+  if(bc_pan)
+    message.field_seq[FIELD_PAN]++;
   for(int i = 0; i < 3; i++)
     {
     GenericSliceModel *gsm = m_Parent->GetSliceModel(i);
@@ -175,8 +194,13 @@ void SynchronizationModel::OnUpdate()
     // Get the camera state
     CameraState cs = m_Parent->GetModel3D()->GetRenderer()->GetCameraState();
     message.camera = cs;
+    message.field_seq[FIELD_CAMERA]++;
     }
 
+  // Our own changes should not be applied back to us
+  for(int f = 0; f < FIELD_COUNT; f++)
+    m_LastFieldSeq[f] = message.field_seq[f];
+
   // Broadcast the new message
   m_IPCHandler->Broadcast(static_cast<void *>(&message));
 }
@@ -242,7 +266,15 @@ void SynchronizationModel::ReadIPCState()
   IPCMessage message;
   if(m_IPCHandler->ReadIfNew(static_cast<void *>(&message)))
     {
-    if(m_SyncCursorModel->GetValue())
+    // Find the fields that changed since the last message
+    bool changed[FIELD_COUNT];
+    for(int f = 0; f < FIELD_COUNT; f++)
+      {
+      changed[f] = message.field_seq[f] != m_LastFieldSeq[f];
+      m_LastFieldSeq[f] = message.field_seq[f];
+      }
+
+    if(m_SyncCursorModel->GetValue() && changed[FIELD_CURSOR])
       {
       // Map the cursor position to the image coordinates
       GenericImageData *id = app->GetCurrentImageData();
@@ -269,6 +301,7 @@ void SynchronizationModel::ReadIPCState()
       AnatomicalDirection dir = app->GetAnatomicalDirectionForDisplayWindow(i);
 
       if(m_SyncZoomModel->GetValue()
+         && changed[FIELD_ZOOM]
          && gsm->IsSliceInitialized()
          && gsm->GetViewZoom() != message.zoom_level[dir]
          && static_cast<float>(message.zoom_level[dir]) > 0.0f)
@@ -277,6 +310,7 @@ void SynchronizationModel::ReadIPCState()
         }
 
       if(m_SyncPanModel->GetValue()
+         && changed[FIELD_PAN]
          && gsm->IsSliceInitialized()
          && to_float(gsm->GetViewPositionRelativeToCursor()) != message.viewPositionRelative[dir])
         {
@@ -285,7 +319,7 @@ void SynchronizationModel::ReadIPCState()
       }
 
     // Set the camera state
-    if(m_SyncCameraModel->GetValue())
+    if(m_SyncCameraModel->GetValue() && changed[FIELD_CAMERA])
       {
       // Get the currently used 3D camera
       CameraState cs = message.camera;
@@ -294,6 +328,7 @@ void SynchronizationModel::ReadIPCState()
     }
 }
 
-
-
-
+bool SynchronizationModel::WaitForIPCUpdate(int timeout_ms)
+{
+  return m_IPCHandler->WaitForMessage(timeout_ms);
+}
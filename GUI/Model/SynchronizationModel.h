@@ -16,6 +16,9 @@ class SynchronizationModel : public AbstractModel
 public:
   irisITKObjectMacro(SynchronizationModel, AbstractModel)
 
+  /** Fields of the shared state that are tracked separately */
+  enum SyncField { FIELD_CURSOR = 0, FIELD_ZOOM, FIELD_PAN, FIELD_CAMERA, FIELD_COUNT };
+
   void SetParentModel(GlobalUIModel *parent);
 
   /** Models controlling sync state */
@@ -40,6 +43,14 @@ public:
   /** This method should be called by UI at regular intervals to read IPC state */
   void ReadIPCState();
 
+  /**
+   * Block until another session broadcasts a change, or the timeout expires.
+   * This is meant to be called from a listener thread, which should then
+   * have the UI thread call ReadIPCState(). Returns true if there was a
+   * broadcast.
+   */
+  bool WaitForIPCUpdate(int timeout_ms);
+
 protected:
 
   SynchronizationModel();
@@ -65,6 +76,9 @@ protected:
   IPCHandler *m_IPCHandler;
 
   bool m_CanBroadcast;
+
+  // Sequence numbers of the fields last received or sent
+  long m_LastFieldSeq[FIELD_COUNT];
 };
 
 #endif // SYNCHRONIZATIONMODEL_H
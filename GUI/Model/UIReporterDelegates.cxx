@@ -6,7 +6,26 @@ void ProgressReporterDelegate
 ::ProgressCallback(itk::Object *source, const itk::EventObject &event)
 {
   itk::ProcessObject *po = static_cast<itk::ProcessObject *>(source);
-  this->SetProgressValue(po->GetProgress());
+
+  // A new operation starts with a fresh token
+  if(itk::StartEvent().CheckEvent(&event) && po->GetProgress() == 0.0f)
+    m_Token.Reset();
+  m_Token.Update(po);
+
+  // Filters may report progress from their worker threads, and very often,
+  // so the display is refreshed from the owner thread at frame rate
+  if(std::this_thread::get_id() != m_OwnerThread)
+    return;
+
+  Clock::time_point now = Clock::now();
+  bool done = itk::EndEvent().CheckEvent(&event);
+  if(!done && now - m_LastDisplayTime < std::chrono::milliseconds(16))
+    return;
+
+  m_LastDisplayTime = now;
+  this->SetProgressValue(m_Token.GetProgress());
+  if(this->IsCancelRequested())
+    m_Token.Cancel();
 }
 
 SmartPtr<itk::Command> ProgressReporterDelegate::CreateCommand()
@@ -5,6 +5,9 @@
 #include "SNAPEvents.h"
 #include "itkObject.h"
 #include "itkObjectFactory.h"
+#include "ProgressToken.h"
+#include <chrono>
+#include <thread>
 
 namespace itk
 {
@@ -46,23 +49,39 @@ protected:
   This is a progress reporter delegate that allows the SNAP model classes
   to report progress without knowing what GUI toolkit actually implements
   the progress dialog.
+
+  Progress reported through ProgressCallback() is stored in a progress
+  token, and the dialog is only updated from the thread that created the
+  delegate, at most once per display frame. If the user asks to cancel, the
+  token is cancelled, so that the filter reporting progress aborts.
   */
 class ProgressReporterDelegate
 {
 public:
-  ProgressReporterDelegate() {}
+  ProgressReporterDelegate() : m_OwnerThread(std::this_thread::get_id()) {}
   virtual ~ProgressReporterDelegate() {}
 
   /** Set the progress value between 0 and 1 */
   virtual void SetProgressValue(double) = 0;
 
+  /** Whether the user has asked for the operation to stop */
+  virtual bool IsCancelRequested() { return false; }
+
   /** For convenience, the delegate can be hooked up to an ITK command */
   void ProgressCallback(itk::Object *source, const itk::EventObject &event);
 
   /** Create a command that will call this delegate */
   SmartPtr<itk::Command> CreateCommand();
 
+  /** The token that holds the progress of the current operation */
+  ProgressToken &GetProgressToken() { return m_Token; }
+
+protected:
+  typedef std::chrono::steady_clock Clock;
 
+  ProgressToken m_Token;
+  std::thread::id m_OwnerThread;
+  Clock::time_point m_LastDisplayTime;
 };
 
 
@@ -17,6 +17,69 @@
 #include <QFileInfo>
 #include <QIcon>
 #include <QTimer>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QThreadPool>
+#include <QCache>
+#include <QMutex>
+#include <QCoreApplication>
+
+namespace
+{
+
+// How long a thumbnail may take to read before it is shown as unavailable
+const int THUMBNAIL_TIMEOUT_MS = 2000;
+
+// A thumbnail read by a worker, with the key under which it is cached
+struct ThumbnailResult
+{
+  QString Key;
+  QImage Image;
+};
+
+// The images decoded so far, for all the history lists, bounded to a few MB
+QMutex g_ThumbnailCacheMutex;
+QCache<QString, QImage> g_ThumbnailCache(8192);
+
+// The thumbnails are read by a pool of their own, so that a slow file system
+// does not hold up the other background tasks of the application
+QThreadPool *GetThumbnailThreadPool()
+{
+  static QThreadPool *pool = nullptr;
+  if(!pool)
+    {
+    pool = new QThreadPool(QCoreApplication::instance());
+    pool->setMaxThreadCount(2);
+    }
+  return pool;
+}
+
+// The icons shown while a thumbnail is loading and when there is none
+const QIcon &GetLoadingIcon()
+{
+  static QIcon icon;
+  if(icon.isNull())
+    {
+    QPixmap pixmap(128, 128);
+    pixmap.fill(QColor(Qt::lightGray));
+    icon = QIcon(pixmap);
+    }
+  return icon;
+}
+
+const QIcon &GetMissingIcon()
+{
+  static QIcon icon;
+  if(icon.isNull())
+    {
+    QPixmap pixmap(128, 128);
+    pixmap.fill(Qt::black);
+    icon = QIcon(pixmap);
+    }
+  return icon;
+}
+
+}
 
 HistoryQListModel::HistoryQListModel(QObject *parent) :
   QStandardItemModel(parent)
@@ -39,9 +102,7 @@ void HistoryQListItem::setItem(
   // Set the filename
   this->setToolTip(history_entry);
   this->setData(history_entry, Qt::UserRole);
-  QPixmap dummy(128, 128);
-  dummy.fill(Qt::black);
-  this->setIcon(QIcon(dummy));
+  this->setIcon(GetLoadingIcon());
 
   // At the moment, these are hard-coded
   this->setSizeHint(QSize(188,144));
@@ -57,54 +118,79 @@ void HistoryQListItem::setItem(
   QTimer::singleShot(0, this, SLOT(onTimer()));
 }
 
+// Find and decode a thumbnail file. This runs on a worker thread, which is
+// why the thumbnail is read into a QImage rather than a QPixmap. The file is
+// only decoded if it is not in the cache under its current timestamp
+static ThumbnailResult ReadThumbnailImage(const QString &filename)
+{
+  ThumbnailResult result;
+  QFileInfo fi(filename);
+  result.Key = QString("%1::%2").arg(filename).arg(fi.lastModified().toString());
+
+  {
+  QMutexLocker lock(&g_ThumbnailCacheMutex);
+  if(QImage *cached = g_ThumbnailCache.object(result.Key))
+    {
+    result.Image = *cached;
+    return result;
+    }
+  }
+
+  if(fi.exists())
+    result.Image = QImage(filename);
+
+  if(!result.Image.isNull())
+    {
+    QMutexLocker lock(&g_ThumbnailCacheMutex);
+    g_ThumbnailCache.insert(result.Key, new QImage(result.Image),
+                            (int) (result.Image.sizeInBytes() / 1024) + 1);
+    }
+
+  return result;
+}
+
 void HistoryQListItem::onTimer()
 {
-  // Construct a string from the filenane and the timestamp
-  QString key = QString("%1::%2")
-                .arg(m_IconFilename)
-                .arg(QFileInfo(m_IconFilename).lastModified().toString());
+  // Read the thumbnail in the background so that a long history, or one on
+  // a slow file system, does not hold up the event loop at startup
+  QFuture<ThumbnailResult> future =
+      QtConcurrent::run(GetThumbnailThreadPool(), ReadThumbnailImage, m_IconFilename);
+  QFutureWatcher<ThumbnailResult> *watcher = new QFutureWatcher<ThumbnailResult>(this);
+  connect(watcher, SIGNAL(finished()), this, SLOT(onThumbnailLoaded()));
+  watcher->setFuture(future);
+
+  // Stop showing the thumbnail as loading if it takes too long. It is still
+  // shown if it arrives later
+  QTimer::singleShot(THUMBNAIL_TIMEOUT_MS, this, SLOT(onThumbnailTimeout()));
+}
+
+void HistoryQListItem::onThumbnailLoaded()
+{
+  QFutureWatcher<ThumbnailResult> *watcher =
+      static_cast<QFutureWatcher<ThumbnailResult> *>(sender());
+  ThumbnailResult result = watcher->result();
+  watcher->deleteLater();
+  m_ThumbnailLoaded = true;
+
+  if(result.Image.isNull())
+    {
+    this->setIcon(GetMissingIcon());
+    return;
+    }
 
   QPixmap pixmap;
-  if(QPixmapCache::find(key, &pixmap))
-    this->setIcon(QIcon(pixmap));
-  else
+  if(!QPixmapCache::find(result.Key, &pixmap))
     {
-    try
-      {
-    /*
-      // Load the icon using ITK to avoid this really annoying warning
-      // from the PNG library. The only problem is that QIcon caches
-      typedef itk::RGBAPixel<unsigned char> PNGPixelType;
-      typedef itk::Image<PNGPixelType, 2> PNGSliceType;
-      typedef itk::ImageFileReader<PNGSliceType> PNGReaderType;
-      SmartPtr<PNGReaderType> reader = PNGReaderType::New();
-      reader->SetFileName(to_utf8(m_IconFilename).c_str());
-      reader->Update();
-
-      // Need to load the icon
-      SmartPtr<PNGSliceType> slice = reader->GetOutput();
-      int w = slice->GetBufferedRegion().GetSize()[0];
-      int h = slice->GetBufferedRegion().GetSize()[1];
-      QImage image(w, h, QImage::Format_ARGB32);
-      PNGPixelType *input = slice->GetBufferPointer();
-      QRgb *output = reinterpret_cast<QRgb*>(image.bits());
-      for(int i = 0; i < slice->GetPixelContainer()->Size(); i++)
-        {
-        *output++ = qRgba(input[i].GetRed(), input[i].GetGreen(), input[i].GetBlue(), input[i].GetAlpha());
-        } */
-
-      QPixmap load_pixmap(m_IconFilename);
-      this->setIcon(QIcon(load_pixmap));
-      QPixmapCache::insert(key, load_pixmap);
-      }
-    catch(itk::ExceptionObject &)
-      {
-      QPixmap dummy(128, 128);
-      dummy.fill(Qt::black);
-      this->setIcon(QIcon(dummy));
-      QPixmapCache::insert(key, dummy);
-      }
+    pixmap = QPixmap::fromImage(result.Image);
+    QPixmapCache::insert(result.Key, pixmap);
     }
+  this->setIcon(QIcon(pixmap));
+}
+
+void HistoryQListItem::onThumbnailTimeout()
+{
+  if(!m_ThumbnailLoaded)
+    this->setIcon(GetMissingIcon());
 }
 
 void HistoryQListModel::rebuildModel()
@@ -24,10 +24,17 @@ protected slots:
 
   void onTimer();
 
+  void onThumbnailLoaded();
+
+  void onThumbnailTimeout();
+
 protected:
 
   QString m_IconFilename;
 
+  // Whether the thumbnail has been read, or found to be missing
+  bool m_ThumbnailLoaded = false;
+
 };
 
 
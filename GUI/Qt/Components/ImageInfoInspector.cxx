@@ -69,6 +69,7 @@ void ImageInfoInspector::SetModel(ImageInfoModel *model)
   makeCoupling(ui->outRAI, m_Model->GetImageOrientationModel());
 
   makeCoupling(ui->outPixelFormat, m_Model->GetImagePixelFormatDescriptionModel());
+  makeCoupling(ui->outMemoryUsage, m_Model->GetImageMemoryUsageModel());
 
   // makeCoupling(ui->inVoxT, m_Model->GetImageCurrentTimePointModel());
 
@@ -2,6 +2,7 @@
 #include <itkObject.h>
 #include <QApplication>
 #include <SNAPEventListenerCallbacks.h>
+#include <chrono>
 
 LatentITKEventNotifierCleanup
 ::LatentITKEventNotifierCleanup(QObject *parent)
@@ -55,7 +56,7 @@ LatentITKEventNotifierCleanup
 
 LatentITKEventNotifierHelper
 ::LatentITKEventNotifierHelper(QObject *parent)
-  : QObject(parent)
+  : QObject(parent), m_Queued(false)
 {
   // Emitting itkEvent will result in onQueuedEvent being called when
   // control returns to the main Qt loop
@@ -83,8 +84,20 @@ LatentITKEventNotifierHelper
   // Register this event
   m_Bucket.PutEvent(evt, object);
 
-  // Emit signal
-  emit itkEvent();
+  // Emit signal, unless one is already waiting in the event loop. This way
+  // a burst of events, such as those fired by a cursor drag, results in a
+  // single dispatch once control returns to the main loop
+  if(!m_Queued.exchange(true))
+    {
+    emit itkEvent();
+    }
+#ifdef SNAP_DEBUG_EVENTS
+  else if(flag_snap_debug_events)
+    {
+    EventDispatchStatistics::GetInstance()->RecordCoalesced(
+          parent()->metaObject()->className());
+    }
+#endif
 
   // Call parent's update
   // QApplication::postEvent(this, new QEvent(QEvent::User), 1000);
@@ -95,6 +108,10 @@ LatentITKEventNotifierHelper
 ::onQueuedEvent()
 {
   static int invocation = 0;
+
+  // Events fired from here on need a new signal
+  m_Queued = false;
+
   if(!m_Bucket.IsEmpty())
     {
 #ifdef SNAP_DEBUG_EVENTS
@@ -111,6 +128,19 @@ LatentITKEventNotifierHelper
 
     ++invocation;
 
+#ifdef SNAP_DEBUG_EVENTS
+    if(flag_snap_debug_events)
+      {
+      std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+      emit dispatchEvent(m_Bucket);
+      std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+      EventDispatchStatistics::GetInstance()->RecordDispatch(
+            class_name.c_str(), m_Bucket, dt.count());
+      m_Bucket.Clear();
+      return;
+      }
+#endif
+
     // Send the event to the target object - immediate
     emit dispatchEvent(m_Bucket);
 
@@ -4,6 +4,7 @@
 #include <QObject>
 #include "EventBucket.h"
 #include <map>
+#include <atomic>
 
 class LatentITKEventNotifierHelper : public QObject
 {
@@ -24,6 +25,10 @@ signals:
 
 protected:
   EventBucket m_Bucket;
+
+  // Whether a call to onQueuedEvent is already pending in the Qt event loop.
+  // Events that arrive while it is pending are only added to the bucket
+  std::atomic<bool> m_Queued;
 };
 
 /**
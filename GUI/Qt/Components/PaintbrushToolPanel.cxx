@@ -57,6 +57,7 @@ void PaintbrushToolPanel::SetModel(PaintbrushSettingsModel *model)
   rmap[PAINTBRUSH_RECTANGULAR] = ui->btnSquare;
   rmap[PAINTBRUSH_ROUND] = ui->btnRound;
   rmap[PAINTBRUSH_WATERSHED] = ui->btnWatershed;
+  rmap[PAINTBRUSH_FLOOD_FILL] = ui->btnFloodFill;
   makeRadioGroupCoupling(ui->grpBrushStyle, rmap,
                          m_Model->GetPaintbrushModeModel());
 
@@ -74,6 +75,13 @@ void PaintbrushToolPanel::SetModel(PaintbrushSettingsModel *model)
   makeCoupling(ui->inGranularity, model->GetThresholdLevelModel());
   makeCoupling(ui->inSmoothness, model->GetSmoothingIterationsModel());
 
+  // Couple the flood fill widgets
+  makeWidgetVisibilityCoupling(ui->grpFloodFill, model->GetFloodFillModeModel());
+
+  makeCoupling(ui->chkFloodFillWindow, model->GetFloodFillWindowModel());
+  makeCoupling(ui->inFloodFillLower, model->GetFloodFillLowerModel());
+  makeCoupling(ui->inFloodFillUpper, model->GetFloodFillUpperModel());
+
   activateOnFlag(ui->chkVolumetric, m_Model,
                  PaintbrushSettingsModel::UIF_VOLUMETRIC_OK);
 
@@ -89,5 +97,7 @@ void PaintbrushToolPanel::on_actionBrushStyle_triggered()
   else if(ui->btnRound->isChecked())
     ui->btnWatershed->setChecked(true);
   else if(ui->btnWatershed->isChecked())
+    ui->btnFloodFill->setChecked(true);
+  else if(ui->btnFloodFill->isChecked())
     ui->btnSquare->setChecked(true);
 }
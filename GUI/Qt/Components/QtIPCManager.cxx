@@ -1,13 +1,26 @@
 #include "QtIPCManager.h"
 #include "SNAPEvents.h"
 #include "SynchronizationModel.h"
+#include "IPCOpenRequestHandler.h"
+#include "SNAPQtCommon.h"
 
 
 QtIPCManager::QtIPCManager(QWidget *parent) :
-  SNAPComponent(parent)
+  SNAPComponent(parent), m_Model(nullptr), m_StopListener(false),
+  m_OpenRequests(nullptr)
 {
-  // Start the IPC timer at 30ms intervals
-  startTimer(30);
+}
+
+QtIPCManager::~QtIPCManager()
+{
+  // The listeners wake up at least every 250ms to check the stop flag
+  m_StopListener = true;
+  if(m_Listener.joinable())
+    m_Listener.join();
+  if(m_OpenRequestListener.joinable())
+    m_OpenRequestListener.join();
+
+  delete m_OpenRequests;
 }
 
 void QtIPCManager::SetModel(SynchronizationModel *model)
@@ -16,6 +29,18 @@ void QtIPCManager::SetModel(SynchronizationModel *model)
 
   // Listen to update events from the model
   connectITK(m_Model, ModelUpdateEvent());
+
+  // Wait for broadcasts from other sessions on a separate thread, so that
+  // this session is idle until there is something to read
+  if(!m_Listener.joinable())
+    {
+    m_Listener = std::thread([this]()
+    {
+      while(!m_StopListener)
+        if(m_Model->WaitForIPCUpdate(250))
+          QMetaObject::invokeMethod(this, "onIPCUpdate", Qt::QueuedConnection);
+    });
+    }
 }
 
 void QtIPCManager::onModelUpdate(const EventBucket &bucket)
@@ -24,10 +49,51 @@ void QtIPCManager::onModelUpdate(const EventBucket &bucket)
   m_Model->Update();
 }
 
-void QtIPCManager::timerEvent(QTimerEvent *)
+void QtIPCManager::onIPCUpdate()
 {
   if(!m_Model) return;
   m_Model->ReadIPCState();
 }
 
 
+
+void QtIPCManager::AcceptOpenRequests(const char *path, OpenRequestHandler handler)
+{
+  m_OpenRequestHandler = handler;
+  if(m_OpenRequests)
+    return;
+
+  // Make this session the receiver of open requests
+  m_OpenRequests = new IPCOpenRequestHandler();
+  m_OpenRequests->Attach(path);
+  if(!m_OpenRequests->IsAttached())
+    return;
+
+  m_OpenRequests->AcceptRequests();
+
+  m_OpenRequestListener = std::thread([this]()
+  {
+    std::vector<std::string> args;
+    while(!m_StopListener)
+      {
+      if(m_OpenRequests->WaitForRequest(250, args))
+        {
+        QStringList qargs;
+        for(const std::string &arg : args)
+          qargs.push_back(from_utf8(arg));
+        QMetaObject::invokeMethod(this, "onOpenRequest", Qt::QueuedConnection,
+                                  Q_ARG(QStringList, qargs));
+        }
+      }
+  });
+}
+
+void QtIPCManager::onOpenRequest(const QStringList &args)
+{
+  if(!m_OpenRequestHandler) return;
+
+  std::vector<std::string> sargs;
+  foreach(const QString &arg, args)
+    sargs.push_back(to_utf8(arg));
+  m_OpenRequestHandler(sargs);
+}
@@ -2,23 +2,43 @@
 #define QTIPCMANAGER_H
 
 #include <QObject>
+#include <QStringList>
 #include <SNAPComponent.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
 
 class SynchronizationModel;
+class IPCOpenRequestHandler;
 
 /**
  * @brief This class manages IPC communications between SNAP sessions on the
- * GUI level. It uses Qt's timers to schedule checks for IPC updates, and it
- * listens to the events from the model layer in order to send IPC messages
- * out.
+ * GUI level. A listener thread waits for other sessions to broadcast, and
+ * has the GUI thread read the IPC state when they do. It also listens to the
+ * events from the model layer in order to send IPC messages out.
+ *
+ * The manager can also accept requests from new invocations of ITK-SNAP to
+ * open files in this session. These are handled by a second listener thread.
  */
 class QtIPCManager : public SNAPComponent
 {
   Q_OBJECT
 public:
   explicit QtIPCManager(QWidget *parent = 0);
+  ~QtIPCManager();
 
   void SetModel(SynchronizationModel *model);
+
+  /** Handler for the arguments of an open request, called on the GUI thread */
+  typedef std::function<void (const std::vector<std::string> &)> OpenRequestHandler;
+
+  /**
+   * Receive open requests from new invocations of ITK-SNAP. The path is the
+   * same as the one passed to IPCHandler::Attach by the new invocation.
+   */
+  void AcceptOpenRequests(const char *path, OpenRequestHandler handler);
   
 signals:
   
@@ -26,13 +46,24 @@ public slots:
 
   virtual void onModelUpdate(const EventBucket &bucket);
 
-protected:
+  /** Read the IPC state, called when the listener thread sees a broadcast */
+  void onIPCUpdate();
 
-  virtual void timerEvent(QTimerEvent *);
+  /** Handle an open request, called when the listener thread receives one */
+  void onOpenRequest(const QStringList &args);
 
 private:
 
   SynchronizationModel *m_Model;
+
+  // Thread that waits for broadcasts from other sessions
+  std::thread m_Listener;
+  std::atomic<bool> m_StopListener;
+
+  // Channel and thread for the open requests
+  IPCOpenRequestHandler *m_OpenRequests;
+  OpenRequestHandler m_OpenRequestHandler;
+  std::thread m_OpenRequestListener;
 };
 
 #endif // QTIPCMANAGER_H
@@ -165,6 +165,11 @@ void QtProgressReporterDelegate::SetProgressValue(double value)
   // QCoreApplication::processEvents();
 }
 
+bool QtProgressReporterDelegate::IsCancelRequested()
+{
+  return m_Dialog && m_Dialog->wasCanceled();
+}
+
 
 std::string QtSystemInfoDelegate::GetApplicationDirectory()
 {
@@ -55,6 +55,7 @@ public:
 
   void SetProgressDialog(QProgressDialog *dialog);
   void SetProgressValue(double);
+  bool IsCancelRequested();
 
 private:
   QProgressDialog *m_Dialog;
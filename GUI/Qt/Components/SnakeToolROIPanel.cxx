@@ -12,6 +12,9 @@
 #include "GlobalState.h"
 
 #include "ResampleDialog.h"
+#include "IRISApplication.h"
+
+#include <QMenu>
 
 SnakeToolROIPanel::SnakeToolROIPanel(QWidget *parent) :
   SNAPComponent(parent),
@@ -19,6 +22,16 @@ SnakeToolROIPanel::SnakeToolROIPanel(QWidget *parent) :
 {
   ui->setupUi(this);
   m_ResampleDialog = new ResampleDialog(this);
+
+  // One action for each slice view, named when the menu is shown since the
+  // anatomical direction of a view may change
+  m_SliceROIMenu = new QMenu(this);
+  for(int i = 0; i < 3; i++)
+    m_SliceROIMenu->addAction(QString())->setData(i);
+  ui->btnSliceROI->setMenu(m_SliceROIMenu);
+
+  connect(m_SliceROIMenu, SIGNAL(aboutToShow()), SLOT(onSliceROIMenuAboutToShow()));
+  connect(m_SliceROIMenu, SIGNAL(triggered(QAction*)), SLOT(onSliceROIActionTriggered(QAction*)));
 }
 
 SnakeToolROIPanel::~SnakeToolROIPanel()
@@ -53,6 +66,23 @@ void SnakeToolROIPanel::on_btnResetROI_clicked()
   m_Model->GetSnakeROIModel(0)->ResetROI();
 }
 
+void SnakeToolROIPanel::onSliceROIMenuAboutToShow()
+{
+  static const char *names[] = { "Axial", "Sagittal", "Coronal" };
+  for(QAction *action : m_SliceROIMenu->actions())
+    {
+    int dir = m_Model->GetDriver()->GetAnatomicalDirectionForDisplayWindow(action->data().toInt());
+    action->setText(dir >= ANATOMY_AXIAL && dir < ANATOMY_NONSENSE
+                    ? QString("Current %1 Slice").arg(names[dir])
+                    : QString("Current Slice in View %1").arg(action->data().toInt() + 1));
+    }
+}
+
+void SnakeToolROIPanel::onSliceROIActionTriggered(QAction *action)
+{
+  m_Model->GetSnakeROIModel(action->data().toInt())->SetROIToCurrentSlice();
+}
+
 void SnakeToolROIPanel::on_btnAuto_clicked()
 {
   // TODO: Check that the label configuration is valid
@@ -5,6 +5,8 @@
 
 class GlobalUIModel;
 class ResampleDialog;
+class QAction;
+class QMenu;
 
 namespace Ui {
 class SnakeToolROIPanel;
@@ -25,11 +27,18 @@ private slots:
 
   void on_btnAuto_clicked();
 
+  void onSliceROIMenuAboutToShow();
+
+  void onSliceROIActionTriggered(QAction *action);
+
 private:
   Ui::SnakeToolROIPanel *ui;
 
   GlobalUIModel *m_Model;
   ResampleDialog *m_ResampleDialog;
+
+  // Menu of the views whose current slice can be taken as the ROI
+  QMenu *m_SliceROIMenu;
 };
 
 #endif // SNAKETOOLROIPANEL_H
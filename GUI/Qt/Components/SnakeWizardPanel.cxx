@@ -157,6 +157,10 @@ SnakeWizardPanel::SnakeWizardPanel(QWidget *parent) :
   m_EvolutionTimer = new QTimer(this);
   connect(m_EvolutionTimer, SIGNAL(timeout()), this, SLOT(idleCallback()));
 
+  // This timer computes the speed image ahead of time on the preprocessing page
+  m_PreprocessingTimer = new QTimer(this);
+  connect(m_PreprocessingTimer, SIGNAL(timeout()), this, SLOT(preprocessingIdleCallback()));
+
   // Hook up the quick label selector
   connect(ui->boxLabelQuickList, SIGNAL(actionTriggered(QAction *)),
           this, SLOT(onClassifyQuickLabelSelection()));
@@ -252,6 +256,7 @@ void SnakeWizardPanel::SetModel(GlobalUIModel *model)
 
   makeCoupling(ui->inStepSize, m_Model->GetStepSizeModel());
   makeCoupling(ui->outIteration, m_Model->GetEvolutionIterationModel());
+  makeCoupling(ui->chkPropagateTimePoints, m_Model->GetPropagateToTimePointsModel());
 
   // Activation flags
   /*
@@ -267,6 +272,9 @@ void SnakeWizardPanel::SetModel(GlobalUIModel *model)
 
   activateOnFlag(ui->btnBubbleNext, m_Model,
                  SnakeWizardModel::UIF_INITIALIZATION_VALID);
+
+  activateOnFlag(ui->chkPropagateTimePoints, m_Model,
+                 SnakeWizardModel::UIF_CAN_PROPAGATE_TIME_POINTS);
 }
 
 void SnakeWizardPanel::Initialize()
@@ -276,6 +284,7 @@ void SnakeWizardPanel::Initialize()
 
   // Go to the right page
   ui->stack->setCurrentWidget(ui->pgPreproc);
+  m_PreprocessingTimer->start(50);
 }
 
 void SnakeWizardPanel::on_btnNextPreproc_clicked()
@@ -336,24 +345,49 @@ void SnakeWizardPanel::on_stack_currentChanged(int page)
 {
   // The stack at the top follows the stack at the bottom
   ui->stackStepInfo->setCurrentIndex(page);
+
+  // The speed image is computed ahead of time on the preprocessing page, and
+  // on the other pages until the speed image applied lazily is complete
+  if(ui->stack->currentWidget() == ui->pgPreproc || m_Model->IsSpeedVolumePending())
+    m_PreprocessingTimer->start(50);
+  else
+    m_PreprocessingTimer->stop();
 }
 
 void SnakeWizardPanel::on_btnPlay_toggled(bool checked)
 {
-  // This is where we toggle the snake evolution!
+  // This is where we toggle the snake evolution! The snake evolves in the
+  // background, and the timer only refreshes the display at a fixed rate
   if(checked)
-    m_EvolutionTimer->start(10);
+    {
+    m_Model->StartEvolution();
+    m_EvolutionTimer->start(33);
+    }
   else
+    {
     m_EvolutionTimer->stop();
+    m_Model->StopEvolution();
+    }
 }
 
 void SnakeWizardPanel::idleCallback()
 {
-  // Step the snake. If converged (returns true), stop playing
-  if(m_Model->PerformEvolutionStep())
+  // Show the evolving snake. If it stopped by itself, stop playing
+  if(!m_Model->UpdateEvolutionDisplay())
     ui->btnPlay->setChecked(false);
 }
 
+void SnakeWizardPanel::preprocessingIdleCallback()
+{
+  // Compute one tile of the speed image. Once all tiles are done, this only
+  // checks whether the preprocessing parameters have changed.
+  m_Model->ComputeNextPreprocessingTile();
+
+  // Past preprocessing, there is nothing more to do once the speed is done
+  if(ui->stack->currentWidget() != ui->pgPreproc && !m_Model->IsSpeedVolumePending())
+    m_PreprocessingTimer->stop();
+}
+
 void SnakeWizardPanel::on_btnSingleStep_clicked()
 {
   // Turn off the play button (will turn off the timer too)
@@ -409,6 +443,9 @@ void SnakeWizardPanel::on_btnCancel_clicked()
   // Turn off the play button (will turn off the timer too)
   ui->btnPlay->setChecked(false);
 
+  // Stop computing the speed image ahead of time
+  m_PreprocessingTimer->stop();
+
   // Make sure all dialogs are closed
   m_SpeedDialog->close();
   m_ParameterDialog->close();
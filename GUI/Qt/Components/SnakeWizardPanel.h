@@ -86,6 +86,8 @@ private slots:
 
   void idleCallback();
 
+  void preprocessingIdleCallback();
+
   void on_btnSingleStep_clicked();
 
 
@@ -132,6 +134,7 @@ private:
   SnakeWizardModel *m_Model;
 
   QTimer *m_EvolutionTimer;
+  QTimer *m_PreprocessingTimer;
 
   Ui::SnakeWizardPanel *ui;
 };
@@ -14,7 +14,6 @@
 #include "QtWidgetActivator.h"
 #include "DisplayLayoutModel.h"
 #include <QtCore>
-#include <qtconcurrentrun.h>
 #include "itkProcessObject.h"
 #include <QMenu>
 #include "QtWidgetCoupling.h"
@@ -32,11 +31,11 @@ ViewPanel3D::ViewPanel3D(QWidget *parent) :
   // Set up timer for continuous update rendering
   m_RenderTimer = new QTimer();
   m_RenderTimer->setInterval(100);
+  m_RenderElapsedTicks = 0;
   connect(m_RenderTimer, SIGNAL(timeout()), SLOT(onTimer()));
 
   // Create a progress command
-  m_RenderProgressCommand = CommandType::New();
-  m_RenderProgressCommand->SetCallbackFunction(this, &ViewPanel3D::ProgressCallback);
+  m_RenderProgressCommand = m_RenderProgress.CreateCommand();
 
   // Connect the progress event
   ui->progressBar->setRange(0, 1000);
@@ -194,25 +193,6 @@ void ViewPanel3D::UpdateExpandViewButton()
     }
 }
 
-// This method is run in a concurrent thread
-void ViewPanel3D::UpdateMeshesInBackground()
-{
-  // Make sure the model actually requires updating
-  if(m_Model && m_Model->CheckState(Generic3DModel::UIF_MESH_DIRTY))
-    {
-    m_Model->UpdateSegmentationMesh(m_RenderProgressCommand);
-    }
-}
-
-void ViewPanel3D::ProgressCallback(itk::Object *source, const itk::EventObject &)
-{
-  itk::ProcessObject *po = static_cast<itk::ProcessObject *>(source);
-
-  m_RenderProgressMutex.lock();
-  m_RenderProgressValue = po->GetProgress();
-  m_RenderProgressMutex.unlock();
-}
-
 void ViewPanel3D::on_btnScreenshot_clicked()
 {
   MainImageWindow *window = findParentWidget<MainImageWindow>(this);
@@ -256,33 +236,38 @@ void ViewPanel3D::on_btnColorBar_clicked(bool isUser)
 
 void ViewPanel3D::onTimer()
 {
-  if(!m_RenderFuture.isRunning())
+  // Does work need to be done?
+  if(!m_Model || (!m_RenderElapsedTicks && !ui->actionContinuous_Update->isChecked()))
     {
-    // Does work need to be done?
-    if(m_Model && ui->actionContinuous_Update->isChecked()
-       && m_Model->CheckState(Generic3DModel::UIF_MESH_DIRTY))
-      {
-      // Launch the worker thread
-      m_RenderProgressValue = 0;
-      m_RenderElapsedTicks = 0;
-      m_RenderFuture = QtConcurrent::run(&ViewPanel3D::UpdateMeshesInBackground, this);
-      }
-    else
-      {
-      ui->progressBar->setVisible(false);
-      }
+    ui->progressBar->setVisible(false);
+    return;
     }
-  else
+
+  // Start, follow or finish the update in the background
+  bool running = false;
+  try
     {
-    // We only want to show progress after some minimum timeout (1 sec)
-    if((++m_RenderElapsedTicks) > 10)
-      {
-      ui->progressBar->setVisible(true);
+    if(!m_RenderElapsedTicks)
+      m_RenderProgress.SetProgress(0.0);
+    running = m_Model->UpdateSegmentationMeshInBackground(m_RenderProgressCommand);
+    }
+  catch(IRISException &exc)
+    {
+    QMessageBox::warning(this, "Problem generating mesh", exc.what());
+    }
 
-      m_RenderProgressMutex.lock();
-      emit renderProgress((int)(1000 * m_RenderProgressValue));
-      m_RenderProgressMutex.unlock();
-      }
+  if(!running)
+    {
+    m_RenderElapsedTicks = 0;
+    ui->progressBar->setVisible(false);
+    }
+
+  // We only want to show progress after some minimum timeout (1 sec)
+  else if((++m_RenderElapsedTicks) > 10)
+    {
+    ui->progressBar->setVisible(true);
+
+    emit renderProgress((int)(1000 * m_RenderProgress.GetProgress()));
     }
 }
 
@@ -4,12 +4,12 @@
 #include <SNAPComponent.h>
 #include "Generic3DModel.h"
 #include <QThread>
-#include <QMutex>
 #include <QWaitCondition>
 #include <QDebug>
 #include <QTimer>
 #include <QFutureWatcher>
 #include <itkCommand.h>
+#include "ProgressToken.h"
 
 namespace Ui {
   class ViewPanel3D;
@@ -84,32 +84,22 @@ private:
 
   QTimer *m_RenderTimer;
 
-  // A future used to track background rendering
-  QFuture<void> m_RenderFuture;
-
-  // A mutex on the progress value, which is accesed by multiple threads
-  mutable QMutex m_RenderProgressMutex;
-
-  // Progress of the rendering operation
-  double m_RenderProgressValue;
+  // Progress of the rendering operation, which is reported by the mesh
+  // thread and sampled by the timer
+  ProgressToken m_RenderProgress;
 
   // Elapsed time since begin of render operation
   int m_RenderElapsedTicks;
 
-  typedef itk::MemberCommand<ViewPanel3D> CommandType;
-  SmartPtr<CommandType> m_RenderProgressCommand;
+  SmartPtr<itk::Command> m_RenderProgressCommand;
 
   void UpdateExpandViewButton();
 
-  void UpdateMeshesInBackground();
-
   void UpdateActionButtons();
 
   // Apply color bar visibility based on the active mesh layer type
   void ApplyDefaultColorBarVisibility();
 
-  void ProgressCallback(itk::Object *source, const itk::EventObject &event);
-
   bool m_ColorBarUserInputOverride = false;
 };
 
@@ -194,16 +194,28 @@ public:
     return NULL;
   }
 
+  // Get the items in a row of the model
+  QList<QStandardItem *> GetRowItems(QStandardItemModel *model, int row)
+  {
+    QList<QStandardItem *> row_items;
+    for(int j = 0; j < model->columnCount(); j++)
+      row_items.append(model->item(row, j));
+    return row_items;
+  }
+
   void SetDomain(QAbstractItemView *w, const DomainType &domain)
   {
-    // Remove everything from the model
+    // Get the model that holds the rows
     QStandardItemModel *model = GetTopLevelModel(w);
     if(!model)
       return;
 
-    model->removeRows(0, model->rowCount());
-
-    // Populate
+    // The rows are matched against the domain in order, so that only the
+    // rows of items that were added or removed are inserted or deleted. The
+    // rows of the other items are kept, and the row traits only touch them
+    // if their description changed. With thousands of items (e.g., labels)
+    // this is much cheaper than repopulating the model.
+    int row = 0;
     for(typename DomainType::const_iterator it = domain.begin();
         it != domain.end(); ++it)
       {
@@ -211,14 +223,42 @@ public:
       AtomicType value = domain.GetValue(it);
       const DescriptorType &row_desc = domain.GetDescription(it);
 
-      // Use the row traits to map information to the widget
-      QList<QStandardItem *> row_items;
-      for(int j = 0; j < model->columnCount(); j++)
-        row_items.append(new QStandardItem());
-      TRowTraits::updateRow(row_items, value, row_desc);
-      model->appendRow(row_items);
+      // Remove the rows of items that are no longer in the domain
+      bool matched = false;
+      while(row < model->rowCount())
+        {
+        AtomicType row_value = TRowTraits::getRowValue(this->GetRowItems(model, row));
+        if(row_value == value)
+          matched = true;
+        else if(domain.find(row_value) == domain.end())
+          {
+          model->removeRow(row);
+          continue;
+          }
+        break;
+        }
+
+      if(matched)
+        {
+        // Update the existing row
+        TRowTraits::updateRow(this->GetRowItems(model, row), value, row_desc);
+        }
+      else
+        {
+        // Use the row traits to map information to the widget
+        QList<QStandardItem *> row_items;
+        for(int j = 0; j < model->columnCount(); j++)
+          row_items.append(new QStandardItem());
+        TRowTraits::updateRow(row_items, value, row_desc);
+        model->insertRow(row, row_items);
+        }
+      row++;
       }
 
+    // Remove the remaining rows
+    if(row < model->rowCount())
+      model->removeRows(row, model->rowCount() - row);
+
 #if QT_VERSION >= 0x050000
     // I am not sure why this is necessary - the model should automatically be sending signals when its
     // contents are being changed. Something must be amiss.
@@ -245,9 +285,7 @@ public:
     for(int i = 0; i < nrows; i++)
       {
       // Collect the items for this row
-      QList<QStandardItem *> row_items;
-      for(int j = 0; j <  model->columnCount(); j++)
-        row_items.append(model->item(i,j));
+      QList<QStandardItem *> row_items = this->GetRowItems(model, i);
 
       // Get the value associated with this row
       AtomicType id = TRowTraits::getRowValue(row_items);
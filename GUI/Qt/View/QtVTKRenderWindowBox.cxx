@@ -8,6 +8,9 @@
 #include "QtReporterDelegates.h"
 #include "LatentITKEventNotifier.h"
 #include "SNAPQtCommon.h"
+#include "SNAPProfiler.h"
+#include "SNAPLatencyMonitor.h"
+#include "GenericSliceRenderer.h"
 
 #include <vtkSphereSource.h>
 #include <vtkPolyDataMapper.h>
@@ -27,6 +30,8 @@
 #include <QImage>
 #include <QPainter>
 #include <QCoreApplication>
+#include <QScreen>
+#include <QTimer>
 
 /**
  * An extension of QVTKOpenGLNativeWidget that handles saving screenshots
@@ -44,8 +49,15 @@ public:
   {
     if(m_NeedRender)
       {
+      // The frame includes slicing, display mapping and texture upload, which
+      // VTK performs on demand during the render
+      SNAP_PROFILE_SCOPE("Frame");
+      auto t0 = SNAPLatencyMonitor::ClockType::now();
       this->renderWindow()->Render();
       m_NeedRender = false;
+      if(m_IsSliceView)
+        SNAPLatencyMonitor::Record(SNAPLatencyMonitor::SLICE_REDRAW, t0,
+                                   SNAPLatencyMonitor::ClockType::now());
       }
 
     QVTKOpenGLNativeWidget::paintGL();
@@ -82,8 +94,15 @@ public:
     m_NeedRender = true;
   }
 
+  // Renders of slice views are recorded by the latency monitor
+  void setSliceView(bool flag)
+  {
+    m_IsSliceView = flag;
+  }
+
 private:
   bool m_NeedRender = false;
+  bool m_IsSliceView = false;
   QtVTKRenderWindowBox *m_Parent;
   QString m_ScreenshotRequest;
 };
@@ -239,6 +258,7 @@ void QtVTKRenderWindowBox::SetRenderer(AbstractVTKRenderer *renderer)
 #ifndef VTK_OPENGL_HAS_OSMESA
     auto *iw = dynamic_cast<QVTKOpenGLNativeWidgetWithScreenshot *>(m_InternalWidget);
     m_Renderer->SetRenderWindow(iw->renderWindow());
+    iw->setSliceView(dynamic_cast<GenericSliceRenderer *>(m_Renderer) != nullptr);
 #else
     auto *iw = dynamic_cast<QtVTKOffscreenMesaWidget *>(m_InternalWidget);
     m_Renderer->SetRenderWindow(iw->GetRenderWindow());
@@ -308,8 +328,43 @@ bool QtVTKRenderWindowBox::SaveScreenshot(std::string filename)
 
 void QtVTKRenderWindowBox::onModelUpdate(const EventBucket &b)
 {
+  SNAP_PROFILE_SCOPE("ViewUpdate");
   m_Renderer->Update();
 
+  // Skip the render if nothing that this view draws has changed
+  if(m_Renderer->IsRenderNeeded())
+    this->ScheduleRender();
+}
+
+void QtVTKRenderWindowBox::ScheduleRender()
+{
+  if(m_FramePending)
+    return;
+
+  // Updates that arrive faster than the display refreshes are combined
+  QScreen *screen = this->screen();
+  double rate = screen && screen->refreshRate() > 0 ? screen->refreshRate() : 60.0;
+  qint64 interval = std::max(1, (int) (1000.0 / rate));
+  qint64 elapsed = m_FrameClock.isValid() ? m_FrameClock.elapsed() : interval;
+  if(elapsed >= interval)
+    {
+    this->RequestRenderNow();
+    }
+  else
+    {
+    m_FramePending = true;
+    QTimer::singleShot((int) (interval - elapsed), this, [this]()
+      {
+      m_FramePending = false;
+      this->RequestRenderNow();
+      });
+    }
+}
+
+void QtVTKRenderWindowBox::RequestRenderNow()
+{
+  m_FrameClock.start();
+
 #ifndef VTK_OPENGL_HAS_OSMESA
   auto *iw = dynamic_cast<QVTKOpenGLNativeWidgetWithScreenshot *>(m_InternalWidget);
   iw->setNeedRender();
@@ -6,6 +6,7 @@
 #include <EventBucket.h>
 #include <itkEventObject.h>
 #include <itkObject.h>
+#include <QElapsedTimer>
 
 class AbstractVTKRenderer;
 class QtVTKInteractionDelegateWidget;
@@ -68,6 +69,14 @@ protected:
   // The class that does the actual rendering for us
   AbstractVTKRenderer *m_Renderer;
 
+  // Request a render, at most once per display refresh interval
+  void ScheduleRender();
+  void RequestRenderNow();
+
+  // Time of the last render request, and whether a delayed one is pending
+  QElapsedTimer m_FrameClock;
+  bool m_FramePending = false;
+
   // Enter and leave events
   virtual void enterEvent(QEnterEvent *) override;
   virtual void leaveEvent(QEvent *) override;
@@ -2,6 +2,9 @@
 #include "ui_AboutDialog.h"
 #include "QFile"
 #include "SNAPCommon.h"
+#include "SNAPLatencyMonitor.h"
+#include <QFileDialog>
+#include <QMessageBox>
 
 AboutDialog::AboutDialog(QWidget *parent) :
   QDialog(parent),
@@ -27,3 +30,27 @@ AboutDialog::~AboutDialog()
 {
   delete ui;
 }
+
+void AboutDialog::showEvent(QShowEvent *event)
+{
+  // Show the operations recorded so far in this session
+  ui->outDiagnostics->setPlainText(
+        QString::fromStdString(SNAPLatencyMonitor::GetSummaryText()));
+  QDialog::showEvent(event);
+}
+
+void AboutDialog::on_btnExportDiagnostics_clicked()
+{
+  QString file = QFileDialog::getSaveFileName(
+        this, "Export Diagnostics", "itksnap_diagnostics.json",
+        "Diagnostics Files (*.json)");
+  if(file.isEmpty())
+    return;
+
+  if(!SNAPLatencyMonitor::WriteDiagnosticsBundle(file.toStdString(), SNAPBuildInfo))
+    {
+    QMessageBox::warning(
+          this, "ITK-SNAP: Diagnostics Not Exported",
+          QString("The diagnostics could not be written to %1.").arg(file));
+    }
+}
@@ -15,7 +15,13 @@ public:
   explicit AboutDialog(QWidget *parent = 0);
 
   ~AboutDialog();
-  
+
+protected:
+  void showEvent(QShowEvent *) override;
+
+private slots:
+  void on_btnExportDiagnostics_clicked();
+
 private:
   Ui::AboutDialog *ui;
 };
@@ -5,6 +5,7 @@
 #include "QtLineEditCoupling.h"
 #include "QtLabelCoupling.h"
 #include "QtPagedWidgetCoupling.h"
+#include "QtCheckBoxCoupling.h"
 #include <QDesktopServices>
 #include <QUrl>
 
@@ -23,6 +24,7 @@
 #include <QtAbstractItemViewCoupling.h>
 #include <QtProgressBarCoupling.h>
 #include <QTimer>
+#include <QFileSystemWatcher>
 #include "IRISException.h"
 #include "MainImageWindow.h"
 #include <QToolButton>
@@ -299,6 +301,10 @@ DistributedSegmentationDialog::DistributedSegmentationDialog(QWidget *parent) :
   ui->tblLog->horizontalHeader()->setResizeMode(2, QHeaderView::ResizeToContents);
 #endif
 
+  m_PendingTicketListingRefreshes = 0;
+  m_PendingTicketDetailRefreshes = 0;
+  m_PendingSubmissions = 0;
+
   // The ticket detail timer should fire at regular intervals
   m_TicketDetailRefreshTimer = new QTimer(this);
   connect(m_TicketDetailRefreshTimer, SIGNAL(timeout()), this, SLOT(onSelectedTicketRefreshTimer()));
@@ -308,6 +314,11 @@ DistributedSegmentationDialog::DistributedSegmentationDialog(QWidget *parent) :
   m_TicketListingRefreshTimer = new QTimer(this);
   connect(m_TicketListingRefreshTimer, SIGNAL(timeout()), this, SLOT(onTicketListRefreshTimer()));
   m_TicketListingRefreshTimer->start(4000);
+
+  // Changes to a local queue trigger a refresh right away. Notifications are
+  // not delivered on all network file systems, so the timers are kept
+  m_LocalQueueWatcher = new QFileSystemWatcher(this);
+  connect(m_LocalQueueWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(onLocalQueueChanged()));
 }
 
 DistributedSegmentationDialog::~DistributedSegmentationDialog()
@@ -329,6 +340,7 @@ void DistributedSegmentationDialog::SetModel(DistributedSegmentationModel *model
   makeCoupling(ui->outServiceDesc, m_Model->GetServiceDescriptionModel());
   makeCoupling(ui->outProgress, m_Model->GetSelectedTicketProgressModel());
   makeCoupling(ui->outQueuePos, m_Model->GetSelectedTicketQueuePositionModel());
+  makeCoupling(ui->chkAddResults, m_Model->GetAddResultsToWorkspaceModel());
 
   // Coupling for the progress/queue stack page
   std::map<dss_model::TicketStatus, QWidget *> status_to_page_map;
@@ -408,6 +420,7 @@ void DistributedSegmentationDialog::LaunchTicketListingRefresh()
 
   connect(watcher, SIGNAL(finished()), this, SLOT(updateTicketListing()));
   watcher->setFuture(future);
+  m_PendingTicketListingRefreshes++;
 }
 
 void DistributedSegmentationDialog::LaunchTicketDetailRefresh()
@@ -424,6 +437,23 @@ void DistributedSegmentationDialog::LaunchTicketDetailRefresh()
         new QFutureWatcher<dss_model::TicketDetailResponse>();
     connect(watcher, SIGNAL(finished()), this, SLOT(updateTicketDetail()));
     watcher->setFuture(future);
+    m_PendingTicketDetailRefreshes++;
+    }
+}
+
+void DistributedSegmentationDialog::UpdateLocalQueueWatcher()
+{
+  QStringList paths;
+  for(const std::string &path : m_Model->GetLocalQueueWatchPaths())
+    paths.append(from_utf8(path));
+
+  QStringList watched = m_LocalQueueWatcher->directories();
+  if(watched != paths)
+    {
+    if(watched.size())
+      m_LocalQueueWatcher->removePaths(watched);
+    if(paths.size())
+      m_LocalQueueWatcher->addPaths(paths);
     }
 }
 
@@ -461,6 +491,7 @@ void DistributedSegmentationDialog::onModelUpdate(const EventBucket &bucket)
 
     // We need to refresh the ticket listing
     LaunchTicketListingRefresh();
+    UpdateLocalQueueWatcher();
     }
   if(bucket.HasEvent(ValueChangedEvent(), m_Model->GetTicketListModel()))
     {
@@ -469,6 +500,7 @@ void DistributedSegmentationDialog::onModelUpdate(const EventBucket &bucket)
 
     // The ticket has changed. Launch a separate job to get the ticket details
     LaunchTicketDetailRefresh();
+    UpdateLocalQueueWatcher();
     }
 }
 
@@ -499,6 +531,38 @@ void DistributedSegmentationDialog::updateTicketListing()
       dynamic_cast<QFutureWatcher<dss_model::TicketListingResponse> *>(this->sender());
 
   m_Model->ApplyTicketListingResponse(watcher->result());
+  m_PendingTicketListingRefreshes--;
+
+  delete watcher;
+
+  // Fetch the results of the tickets that have just succeeded, each of which
+  // is added to the workspace when its download is done
+  for(dss_model::IdType ticket_id : m_Model->TakeSucceededTicketsToAdd())
+    {
+    QFuture<dss_model::TicketResultResponse> future =
+        QtConcurrent::run(DistributedSegmentationModel::AsyncGetTicketResult,
+                          ticket_id, m_Model->GetDefaultResultFilename(ticket_id));
+
+    QFutureWatcher<dss_model::TicketResultResponse> *result_watcher =
+        new QFutureWatcher<dss_model::TicketResultResponse>();
+    connect(result_watcher, SIGNAL(finished()), this, SLOT(onTicketResultReady()));
+    result_watcher->setFuture(future);
+    }
+}
+
+void DistributedSegmentationDialog::onTicketResultReady()
+{
+  QFutureWatcher<dss_model::TicketResultResponse> *watcher =
+      dynamic_cast<QFutureWatcher<dss_model::TicketResultResponse> *>(this->sender());
+
+  try
+    {
+    m_Model->AddTicketResultToWorkspace(watcher->result());
+    }
+  catch(std::exception &exc)
+    {
+    ReportNonLethalException(this, exc, "Failed to add ticket results to the workspace");
+    }
 
   delete watcher;
 }
@@ -509,6 +573,7 @@ void DistributedSegmentationDialog::updateTicketDetail()
       dynamic_cast<QFutureWatcher<dss_model::TicketDetailResponse> *>(this->sender());
 
   m_Model->ApplyTicketDetailResponse(watcher->result());
+  m_PendingTicketDetailRefreshes--;
 
   delete watcher;
 }
@@ -516,7 +581,7 @@ void DistributedSegmentationDialog::updateTicketDetail()
 void DistributedSegmentationDialog::onTicketListRefreshTimer()
 {
   // If there is no model or the dialog is hidden, there is nothing to do
-  if(m_Model && this->isVisible())
+  if(m_Model && this->isVisible() && m_PendingTicketListingRefreshes == 0)
     {
     // Run the refresh
     LaunchTicketListingRefresh();
@@ -526,12 +591,20 @@ void DistributedSegmentationDialog::onTicketListRefreshTimer()
 void DistributedSegmentationDialog::onSelectedTicketRefreshTimer()
 {
   // If there is no model or the dialog is hidden, there is nothing to do
-  if(m_Model && this->isVisible() && m_Model->GetTicketListModel()->isValid())
+  if(m_Model && this->isVisible() && m_Model->GetTicketListModel()->isValid()
+     && m_PendingTicketDetailRefreshes == 0)
     {
     LaunchTicketDetailRefresh();
     }
 }
 
+void DistributedSegmentationDialog::onLocalQueueChanged()
+{
+  // Refresh as if both timers had fired
+  this->onTicketListRefreshTimer();
+  this->onSelectedTicketRefreshTimer();
+}
+
 void DistributedSegmentationDialog::on_btnGetToken_clicked()
 {
   // Open the web browsersdf
@@ -555,45 +628,64 @@ void DistributedSegmentationDialog::on_btnSubmit_clicked()
   if(!parent->SaveWorkspace(false))
     return;
 
-  // Show a progress dialog
-  QtProgressDialogScopedPointer progress(new QProgressDialog(this));
-  QtProgressReporterDelegate progress_delegate;
-  progress_delegate.SetProgressDialog(progress.data());
-  progress->setLabelText("Uploading workspace...");
-  progress->setMinimumDuration(0);
-  progress->show();
-  progress->activateWindow();
-  progress->raise();
+  // Capture the workspace and upload it in the background, so that the user
+  // can go on to submit it to another service in the meantime
+  try
+    {
+    QFuture<dss_model::SubmissionResponse> future =
+        QtConcurrent::run(DistributedSegmentationModel::AsyncSubmitWorkspace,
+                          m_Model->PrepareSubmission());
 
-  // Create a wait cursor
-  QtCursorOverride cursy;
+    QFutureWatcher<dss_model::SubmissionResponse> *watcher =
+        new QFutureWatcher<dss_model::SubmissionResponse>();
+    connect(watcher, SIGNAL(finished()), this, SLOT(onSubmissionFinished()));
+    watcher->setFuture(future);
+    m_PendingSubmissions++;
+    }
+  catch(std::exception &exc)
+    {
+    ReportNonLethalException(this, exc, "Failed to submit workspace");
+    }
+}
 
-  // Process events so that the dialog is actually shown
-  QCoreApplication::processEvents();
+void DistributedSegmentationDialog::onSubmissionFinished()
+{
+  QFutureWatcher<dss_model::SubmissionResponse> *watcher =
+      dynamic_cast<QFutureWatcher<dss_model::SubmissionResponse> *>(this->sender());
+  m_PendingSubmissions--;
 
-  // Submit the workspace
   try
     {
-    // Do the submit task
-    m_Model->SubmitWorkspace(&progress_delegate);
+    m_Model->ApplySubmissionResponse(watcher->result());
+
+    // Flip over to the results page once all the uploads are done
+    if(m_PendingSubmissions == 0)
+      ui->tabWidget->setCurrentWidget(ui->tabResults);
 
-    // Flip over to the results page
-    ui->tabWidget->setCurrentWidget(ui->tabResults);
+    // Show the new ticket without waiting for the timer
+    LaunchTicketListingRefresh();
     }
   catch(std::exception &exc)
     {
     ReportNonLethalException(this, exc, "Failed to submit workspace");
     }
+
+  delete watcher;
 }
 
 void DistributedSegmentationDialog::on_btnDownload_clicked()
 {
-  // Show the dialog to determine the save location
-  QString dl_filename = DownloadTicketDialog::showDialog(this, m_Model);
+  // Show the dialog to determine the save location. The results in a local
+  // queue are not copied anywhere
+  QString dl_filename;
+  if(!m_Model->IsLocalQueue())
+    {
+    dl_filename = DownloadTicketDialog::showDialog(this, m_Model);
 
-  // No filename - means user canceled
-  if(dl_filename.size() == 0)
-    return;
+    // No filename - means user canceled
+    if(dl_filename.size() == 0)
+      return;
+    }
 
   // Show a progress dialog
   QtProgressDialogScopedPointer progress(new QProgressDialog(this));
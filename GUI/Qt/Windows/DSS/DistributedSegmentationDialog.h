@@ -31,6 +31,7 @@ class EventBucket;
 class QAbstractItemView;
 class QComboBox;
 class DownloadTicketDialog;
+class QFileSystemWatcher;
 
 
 
@@ -101,6 +102,11 @@ public slots:
   void onTicketListRefreshTimer();
   void onSelectedTicketRefreshTimer();
 
+  void onLocalQueueChanged();
+
+  void onSubmissionFinished();
+  void onTicketResultReady();
+
 private slots:
   void on_btnGetToken_clicked();
 
@@ -130,8 +136,22 @@ private:
   QTimer *m_TicketDetailRefreshTimer;
   QTimer *m_TicketListingRefreshTimer;
 
+  // Number of refresh requests still waiting for the server. The timers do
+  // not send a new request while one is pending, so that a slow server does
+  // not get a growing queue of the same request
+  int m_PendingTicketListingRefreshes;
+  int m_PendingTicketDetailRefreshes;
+
+  // Number of submissions that are still uploading
+  int m_PendingSubmissions;
+
+  // Watches the directories of a local queue, so that changes made by the
+  // service are shown without waiting for the timers
+  QFileSystemWatcher *m_LocalQueueWatcher;
+
   void LaunchTicketListingRefresh();
   void LaunchTicketDetailRefresh();
+  void UpdateLocalQueueWatcher();
 };
 
 #endif // DISTRIBUTEDSEGMENTATIONDIALOG_H
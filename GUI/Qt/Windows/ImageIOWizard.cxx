@@ -20,6 +20,7 @@
 #include <QGridLayout>
 #include <QSpinBox>
 #include <QFrame>
+#include <QGroupBox>
 #include <QTimer>
 #include <QProgressBar>
 
@@ -190,6 +191,40 @@ SelectFilePage::SelectFilePage(QWidget *parent)
   lo->addWidget(m_FilePanel);
   //lo->addSpacing(15);
 
+  // Partial loading of very large images
+  m_RegionBox = new QGroupBox("Load only a region of the image");
+  m_RegionBox->setCheckable(true);
+  m_RegionBox->setChecked(false);
+  m_RegionBox->setToolTip(
+        "Read only a box of voxels from the file, and optionally every n-th "
+        "voxel within the box. Use a large subsampling factor to open an "
+        "overview of a very large image, and then load the structure of "
+        "interest at full resolution. A size of zero loads the full extent "
+        "of the image along that axis.");
+
+  QGridLayout *lr = new QGridLayout(m_RegionBox);
+  const char *axes[] = {"x:", "y:", "z:"};
+  lr->addWidget(new QLabel("First voxel:"), 0, 0, 1, 1);
+  lr->addWidget(new QLabel("Size:"), 1, 0, 1, 1);
+  for(int i = 0; i < 3; i++)
+    {
+    m_RegionIndex[i] = new QSpinBox();
+    m_RegionIndex[i]->setRange(0, 1000000);
+    m_RegionSize[i] = new QSpinBox();
+    m_RegionSize[i]->setRange(0, 1000000);
+    lr->addWidget(new QLabel(axes[i]), 0, 1 + 2 * i, 1, 1);
+    lr->addWidget(m_RegionIndex[i], 0, 2 + 2 * i, 1, 1);
+    lr->addWidget(new QLabel(axes[i]), 1, 1 + 2 * i, 1, 1);
+    lr->addWidget(m_RegionSize[i], 1, 2 + 2 * i, 1, 1);
+    }
+
+  m_RegionSubsample = new QSpinBox();
+  m_RegionSubsample->setRange(1, 64);
+  lr->addWidget(new QLabel("Keep every"), 2, 0, 1, 1);
+  lr->addWidget(m_RegionSubsample, 2, 2, 1, 1);
+  lr->addWidget(new QLabel("th voxel"), 2, 3, 1, 4);
+  lo->addWidget(m_RegionBox);
+
   // The output message
   lo->addStretch(1);
   lo->addWidget(m_OutMessage);
@@ -295,6 +330,9 @@ void SelectFilePage::initializePage()
 
   // Provide a callback for determining format from filename
   m_FilePanel->setCustomFormatOracle(this, "customFormatOracle");
+
+  // Partial loading is only offered for anatomical images
+  m_RegionBox->setVisible(m_Model->CanLoadRegion());
 }
 
 
@@ -315,6 +353,22 @@ bool SelectFilePage::validatePage()
     return ErrorMessage("File format is not supported for this operation");
     }
 
+  // Pass the region to load to the model
+  if(m_Model->CanLoadRegion() && m_RegionBox->isChecked())
+    {
+    Vector3i index, size;
+    for(int i = 0; i < 3; i++)
+      {
+      index[i] = m_RegionIndex[i]->value();
+      size[i] = m_RegionSize[i]->value();
+      }
+    m_Model->SetLoadRegion(index, size, m_RegionSubsample->value());
+    }
+  else
+    {
+    m_Model->ClearLoadRegion();
+    }
+
   // If format is RAW, continue to next page
   if(fmt == GuidedNativeImageIO::FORMAT_RAW)
     return true;
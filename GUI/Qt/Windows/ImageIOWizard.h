@@ -22,6 +22,7 @@ class QTreeWidgetItem;
 class QTableWidget;
 class QSpinBox;
 class QDoubleSpinBox;
+class QGroupBox;
 class FileChooserPanelWithHistory;
 class OptimizationProgressRenderer;
 class QtVTKRenderWindowBox;
@@ -96,6 +97,10 @@ public slots:
 
 private:
   FileChooserPanelWithHistory *m_FilePanel;
+
+  // Controls for loading a region of the image
+  QGroupBox *m_RegionBox;
+  QSpinBox *m_RegionIndex[3], *m_RegionSize[3], *m_RegionSubsample;
 };
 
 class SummaryPage : public AbstractPage
@@ -18,6 +18,8 @@
 #include <QtWidgetActivator.h>
 #include <ColorWheel.h>
 #include <QMenu>
+#include <QInputDialog>
+#include <limits>
 
 #include <QSortFilterProxyModel>
 #include <QStandardItemModel>
@@ -49,6 +51,11 @@ LabelEditorDialog::LabelEditorDialog(QWidget *parent) :
   menu_vis->addAction(ui->actionShow_all_labels);
   menu_vis->addAction(ui->actionShow_all_labels_in_3D_window);
 
+  QMenu *menu_cc = new QMenu("Connected Components", this);
+  menu->addMenu(menu_cc);
+  menu_cc->addAction(ui->actionKeep_largest_component);
+  menu_cc->addAction(ui->actionRemove_islands);
+
   QStandardItemModel *simodel = new QStandardItemModel(this);
   simodel->setColumnCount(2);
 
@@ -240,3 +247,20 @@ void LabelEditorDialog::on_actionShow_all_labels_in_3D_window_triggered()
 {
   m_Model->SetAllLabelsVisibilityIn3D(true);
 }
+
+void LabelEditorDialog::on_actionKeep_largest_component_triggered()
+{
+  m_Model->KeepLargestComponentOfCurrentLabel();
+}
+
+void LabelEditorDialog::on_actionRemove_islands_triggered()
+{
+  bool ok = false;
+  int n = QInputDialog::getInt(
+        this, "ITK-SNAP: Remove Islands",
+        QString("Clear the parts of label %1 with fewer voxels than:")
+        .arg(m_Model->GetCurrentLabelModel()->GetValue()),
+        100, 1, std::numeric_limits<int>::max(), 1, &ok);
+  if(ok)
+    m_Model->RemoveIslandsOfCurrentLabel((size_t) n);
+}
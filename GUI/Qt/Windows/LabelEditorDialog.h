@@ -44,6 +44,10 @@ private slots:
 
   void on_actionShow_all_labels_in_3D_window_triggered();
 
+  void on_actionKeep_largest_component_triggered();
+
+  void on_actionRemove_islands_triggered();
+
 private:
   Ui::LabelEditorDialog *ui;
 
@@ -63,6 +63,7 @@
 #include "AllPurposeProgressAccumulator.h"
 #include "LabelEditorModel.h"
 #include "RegistrationModel.h"
+#include "LayerFileWatchModel.h"
 
 #include "QtCursorOverride.h"
 #include "QtWarningDialog.h"
@@ -170,6 +171,20 @@ QString ModeTooltipBuilder::m_MainTemplate;
 QString ModeTooltipBuilder::m_RowTemplate;
 
 
+// Create a non-modal dialog the first time it is needed and hook it up to its model
+template <class TDialog, class TModel>
+static TDialog *CreateDialogOnDemand(TDialog *&dialog, QWidget *parent, TModel *model)
+{
+  if(!dialog)
+    {
+    dialog = new TDialog(parent);
+    dialog->setModal(false);
+    dialog->SetModel(model);
+    }
+  return dialog;
+}
+
+
 MainImageWindow::MainImageWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainImageWindow),
@@ -201,31 +216,16 @@ MainImageWindow::MainImageWindow(QWidget *parent) :
   m_ViewPanels[2] = ui->panel2;
   m_ViewPanels[3] = ui->panel3D;
 
-  // Initialize the dialogs
+  // Initialize the dialogs. Dialogs that are not needed to show the data, such
+  // as statistics, preferences or DSS, are created when they are first opened
   m_LabelEditor = new LabelEditorDialog(this);
   m_LabelEditor->setModal(false);
 
   m_LayerInspector = new LayerInspectorDialog(this);
   m_LayerInspector->setModal(false);
 
-  m_ReorientImageDialog = new ReorientImageDialog(this);
-  m_ReorientImageDialog->setModal(false);
-
   m_DropDialog = new DropActionDialog(this);
 
-  m_StatisticsDialog = new StatisticsDialog(this);
-  m_StatisticsDialog->setModal(false);
-
-  m_InterpolateLabelsDialog = new InterpolateLabelsDialog(this);
-  m_InterpolateLabelsDialog->setModal(false);
-
-  // issue #24: adding label smoothing feature
-  m_SmoothLabelsDialog = new SmoothLabelsDialog(this);
-  m_SmoothLabelsDialog->setModal(false);
-
-  m_DSSDialog = new DistributedSegmentationDialog(this);
-  m_DSSDialog->setModal(false);
-
 
   // Initialize the docked panels
   m_DockLeft = new QDockWidget(this);
@@ -277,12 +277,6 @@ MainImageWindow::MainImageWindow(QWidget *parent) :
   m_SplashPanel = new SplashPanel(this);
   m_DockLeft->setWidget(m_SplashPanel);
 
-  // Create the about dialog
-  m_AboutDialog = new AboutDialog(this);
-
-  // Create the preferences dialog
-  m_PreferencesDialog = new PreferencesDialog(this);
-
   // Hide the right dock for now
   m_DockRight->setVisible(false);
 
@@ -486,14 +480,8 @@ void MainImageWindow::Initialize(GlobalUIModel *model)
   m_LabelEditor->SetModel(model->GetLabelEditorModel());
   m_LayerInspector->SetModel(model);
   m_SnakeWizard->SetModel(model);
-  m_ReorientImageDialog->SetModel(model->GetReorientImageModel());
   m_DropDialog->SetModel(model);
-  m_StatisticsDialog->SetModel(model);
-  m_PreferencesDialog->SetModel(model->GetGlobalPreferencesModel());
-  m_InterpolateLabelsDialog->SetModel(model->GetInterpolateLabelModel());
   m_RegistrationDialog->SetModel(model->GetRegistrationModel());
-  m_DSSDialog->SetModel(model->GetDistributedSegmentationModel());
-  m_SmoothLabelsDialog->SetModel(model->GetSmoothLabelsModel()); // issue #24
 
   // Initialize the docked panels
   m_ControlPanel->SetModel(model);
@@ -621,6 +609,8 @@ void MainImageWindow::Initialize(GlobalUIModel *model)
   activateOnFlag(ui->actionResetLabels, m_Model, UIF_IRIS_WITH_BASEIMG_LOADED);
   activateOnFlag(ui->actionVolumesAndStatistics, m_Model, UIF_BASEIMG_LOADED);
   activateOnFlag(ui->actionReloadSegmentation, m_Model, UIF_IRIS_WITH_BASEIMG_LOADED);
+  makeCoupling(ui->actionReloadLayersWhenFilesChange,
+               m_Model->GetLayerFileWatchModel()->GetWatchEnabledModel());
   activateOnFlag(ui->actionSwitch_Foreground_Background_Labels, m_Model, UIF_IRIS_WITH_BASEIMG_LOADED);
   activateOnFlag(ui->menuAppearance, m_Model, UIF_BASEIMG_LOADED);
 
@@ -731,6 +721,10 @@ void MainImageWindow::onModelUpdate(const EventBucket &b)
             m_Model->GetDefault4DReplayInterval());
       }
 
+    // Prompt once loading is done, e.g., after the segmentation of a
+    // workspace has been loaded as well
+    if(m_Model->GetDriver()->IsSegmentationRecoveryAvailable())
+      QTimer::singleShot(0, this, SLOT(PromptSegmentationRecovery()));
     }
 
   if(layers_changed || main_history_changed)
@@ -784,6 +778,48 @@ void MainImageWindow::onActiveChanged()
     }
 }
 
+void MainImageWindow::PromptSegmentationRecovery()
+{
+  IRISApplication *driver = m_Model->GetDriver();
+  if(!driver->IsMainImageLoaded() || !driver->IsSegmentationRecoveryAvailable())
+    return;
+
+  if(QMessageBox::Yes == QMessageBox::question(
+       this, "Recover Segmentation?",
+       "The last session with this image did not end normally, and the changes "
+       "made to its segmentation were recorded.\n"
+       "Do you want to restore the segmentation from that session? The current "
+       "segmentation will be replaced.",
+       QMessageBox::Yes, QMessageBox::No))
+    {
+    bool recovered = false;
+    try
+      {
+      QtCursorOverride c(Qt::WaitCursor);
+      recovered = driver->RecoverSegmentationFromJournal();
+      }
+    catch(std::exception &exc)
+      {
+      ReportNonLethalException(this, exc, "Segmentation Recovery Error",
+                               "Failed to recover the segmentation");
+      driver->DiscardSegmentationRecovery();
+      return;
+      }
+
+    // A journal that can not be replayed is of no further use
+    if(!recovered)
+      {
+      QMessageBox::warning(this, "Segmentation Recovery Error",
+                           "The recorded changes could not be applied to the segmentation.");
+      driver->DiscardSegmentationRecovery();
+      }
+    }
+  else
+    {
+    driver->DiscardSegmentationRecovery();
+    }
+}
+
 void MainImageWindow::UpdateMainLayout()
 {
   // Update the image dimensions
@@ -1581,8 +1617,10 @@ void MainImageWindow::LoadProject(const QString &file)
     QtCursorOverride c(Qt::WaitCursor);
     IRISWarningList warnings;
 
-    // Load the project
-    m_Model->GetDriver()->OpenProject(to_utf8(file), warnings);
+    // Load the project. The progress reporter keeps the window responsive,
+    // so the main image is shown while the other layers load
+    m_Model->GetDriver()->OpenProject(to_utf8(file), warnings,
+                                      m_Model->GetProgressCommand());
     }
   catch(exception &exc)
     {
@@ -1609,7 +1647,12 @@ void MainImageWindow::LoadProjectInNewInstance(const QString &file)
 void MainImageWindow::onAnimationTimeout()
 {
   if(m_Model)
+    {
     m_Model->AnimateLayerComponents();
+
+    // Reload the layers whose files have been rewritten
+    m_Model->GetLayerFileWatchModel()->Poll();
+    }
 }
 
 void MainImageWindow::on4DReplayTimeout()
@@ -1658,7 +1701,8 @@ void MainImageWindow::on_actionUnload_All_triggered()
 void MainImageWindow::on_actionReorient_Image_triggered()
 {
   // Show the reorientation dialog
-  RaiseDialog(m_ReorientImageDialog);
+  RaiseDialog(CreateDialogOnDemand(
+                m_ReorientImageDialog, this, m_Model->GetReorientImageModel()));
 }
 
 void MainImageWindow::on_actionZoomToFitInAllViews_triggered()
@@ -1949,7 +1993,7 @@ void MainImageWindow::on_actionSaveLabels_triggered()
 
 void MainImageWindow::on_actionVolumesAndStatistics_triggered()
 {
-  m_StatisticsDialog->Activate();
+  CreateDialogOnDemand(m_StatisticsDialog, this, m_Model)->Activate();
 }
 
 bool MainImageWindow::SaveSegmentation(bool interactive, bool currentTPOnly)
@@ -2012,6 +2056,8 @@ void MainImageWindow::on_actionLayerInspector_triggered()
 void MainImageWindow::on_actionAbout_triggered()
 {
   // Show the about window
+  if(!m_AboutDialog)
+    m_AboutDialog = new AboutDialog(this);
   RaiseDialog(m_AboutDialog);
 }
 
@@ -2106,7 +2152,8 @@ QSize MainImageWindow::sizeHint() const
 
 void MainImageWindow::on_actionPreferences_triggered()
 {
-  m_PreferencesDialog->ShowDialog();
+  CreateDialogOnDemand(
+        m_PreferencesDialog, this, m_Model->GetGlobalPreferencesModel())->ShowDialog();
 }
 
 
@@ -2136,7 +2183,8 @@ void MainImageWindow::on_actionOpenWorkspace_triggered()
     IRISWarningList warnings;
 
     // Load the project
-    m_Model->GetDriver()->OpenProject(to_utf8(file_abs), warnings);
+    m_Model->GetDriver()->OpenProject(to_utf8(file_abs), warnings,
+                                      m_Model->GetProgressCommand());
     }
   catch(exception &exc)
     {
@@ -2267,7 +2315,8 @@ void MainImageWindow::on_actionToggle_Crosshair_triggered()
 void MainImageWindow::on_actionAnnotation_Preferences_triggered()
 {
   // Show the preferences dialog
-  m_PreferencesDialog->ShowDialog();
+  CreateDialogOnDemand(
+        m_PreferencesDialog, this, m_Model->GetGlobalPreferencesModel())->ShowDialog();
   m_PreferencesDialog->GoToPage(PreferencesDialog::Appearance);
 }
 
@@ -2477,12 +2526,14 @@ void MainImageWindow::on_actionActivatePreviousLayer_triggered()
 
 void MainImageWindow::on_actionInterpolate_Labels_triggered()
 {
-  RaiseDialog(m_InterpolateLabelsDialog);
+  RaiseDialog(CreateDialogOnDemand(
+                m_InterpolateLabelsDialog, this, m_Model->GetInterpolateLabelModel()));
 }
 
 // issue #24: Add label smoothing feature
 void MainImageWindow::on_actionSmooth_Labels_triggered() {
-  RaiseDialog(m_SmoothLabelsDialog);
+  RaiseDialog(CreateDialogOnDemand(
+                m_SmoothLabelsDialog, this, m_Model->GetSmoothLabelsModel()));
 }
 
 void MainImageWindow::on_actionRegistration_triggered()
@@ -2593,7 +2644,8 @@ void MainImageWindow::on_actionInstallCLI_triggered()
 
 void MainImageWindow::on_actionDSS_triggered()
 {
-  RaiseDialog(m_DSSDialog);
+  RaiseDialog(CreateDialogOnDemand(
+                m_DSSDialog, this, m_Model->GetDistributedSegmentationModel()));
 }
 
 void MainImageWindow::on_actionNext_Display_Layout_triggered()
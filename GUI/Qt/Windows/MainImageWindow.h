@@ -163,6 +163,10 @@ private slots:
 
   void onActiveChanged();
 
+  // Offer to restore the segmentation recorded by a session that ended
+  // abnormally with the main image that has just been loaded
+  void PromptSegmentationRecovery();
+
   void on_actionQuit_triggered();
 
   void on_actionLoad_from_Image_triggered();
@@ -429,7 +433,7 @@ private:
 
   LayerInspectorDialog *m_LayerInspector;
 
-  ReorientImageDialog *m_ReorientImageDialog;
+  ReorientImageDialog *m_ReorientImageDialog = nullptr;
 
   DropActionDialog *m_DropDialog;
 
@@ -437,19 +441,19 @@ private:
 
   SplashPanel *m_SplashPanel;
 
-  AboutDialog *m_AboutDialog;
+  AboutDialog *m_AboutDialog = nullptr;
 
-  StatisticsDialog *m_StatisticsDialog;
+  StatisticsDialog *m_StatisticsDialog = nullptr;
 
-  PreferencesDialog *m_PreferencesDialog;
+  PreferencesDialog *m_PreferencesDialog = nullptr;
 
-  InterpolateLabelsDialog *m_InterpolateLabelsDialog;
+  InterpolateLabelsDialog *m_InterpolateLabelsDialog = nullptr;
 
-  SmoothLabelsDialog *m_SmoothLabelsDialog;
+  SmoothLabelsDialog *m_SmoothLabelsDialog = nullptr;
 
   RegistrationDialog *m_RegistrationDialog;
 
-  DistributedSegmentationDialog *m_DSSDialog;
+  DistributedSegmentationDialog *m_DSSDialog = nullptr;
 
   QTimer *m_4DReplayTimer;
   bool m_Is4DReplayOn = false;
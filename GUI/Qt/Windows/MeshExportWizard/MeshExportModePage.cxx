@@ -4,6 +4,7 @@
 #include "MeshExportModel.h"
 #include "QtRadioButtonCoupling.h"
 #include "QtComboBoxCoupling.h"
+#include "QtCheckBoxCoupling.h"
 #include "QtWidgetActivator.h"
 
 #include <map>
@@ -34,8 +35,12 @@ void MeshExportModePage::SetModel(MeshExportModel *model)
   // Couple the label widget
   makeCoupling(ui->inLabel, m_Model->GetExportedLabelModel());
 
+  // Couple the time point option
+  makeCoupling(ui->chkAllTimePoints, m_Model->GetExportAllTimePointsModel());
+
   // Handle activation
   activateOnFlag(ui->inLabel, m_Model, MeshExportModel::UIF_LABEL_SELECTION_ACTIVE);
+  activateOnFlag(ui->chkAllTimePoints, m_Model, MeshExportModel::UIF_MULTIPLE_TIME_POINTS);
 }
 
 void MeshExportModePage::initializePage()
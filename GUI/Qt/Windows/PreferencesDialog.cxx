@@ -2,6 +2,7 @@
 #include "ui_PreferencesDialog.h"
 #include "GlobalPreferencesModel.h"
 #include "MeshOptions.h"
+#include "VTKMeshPipeline.h"
 #include "DefaultBehaviorSettings.h"
 
 #include "QtCheckBoxCoupling.h"
@@ -24,6 +25,7 @@
 Q_DECLARE_METATYPE(GlobalDisplaySettings::UIGreyInterpolation)
 Q_DECLARE_METATYPE(SNAPAppearanceSettings::UIElements)
 Q_DECLARE_METATYPE(LayerLayout)
+Q_DECLARE_METATYPE(FloatImageStorage)
 
 PreferencesDialog::PreferencesDialog(QWidget *parent) :
   QDialog(parent),
@@ -36,6 +38,12 @@ PreferencesDialog::PreferencesDialog(QWidget *parent) :
   ui->inInterpolationMode->addItem("Nearest Neighbor", QVariant::fromValue(GlobalDisplaySettings::NEAREST));
   ui->inInterpolationMode->addItem("Linear", QVariant::fromValue(GlobalDisplaySettings::LINEAR));
 
+  // Set up storage options for floating point overlays
+  ui->inFloatOverlayStorage->clear();
+  ui->inFloatOverlayStorage->addItem("Floating point (exact)", QVariant::fromValue(FLOAT_STORAGE_NATIVE));
+  ui->inFloatOverlayStorage->addItem("16-bit integer (half the memory)", QVariant::fromValue(FLOAT_STORAGE_INT16));
+  ui->inFloatOverlayStorage->addItem("8-bit integer (quarter of the memory)", QVariant::fromValue(FLOAT_STORAGE_UINT8));
+
   // Set up layoyt options
   ui->inOverlayLayout->clear();
   ui->inOverlayLayout->addItem(QIcon(":/root/layout_thumb_16.png"),
@@ -101,12 +109,23 @@ void PreferencesDialog::SetModel(GlobalPreferencesModel *model)
   DefaultBehaviorSettings *dbs = m_Model->GetDefaultBehaviorSettings();
   makeCoupling(ui->chkLinkedZoom, dbs->GetLinkedZoomModel());
   makeCoupling(ui->chkContinuousUpdate, dbs->GetContinuousMeshUpdateModel());
+  makeCoupling(ui->inMeshUpdateMaxLoad, dbs->GetContinuousMeshUpdateMaxLoadModel());
+  makeCoupling(ui->inVolumeFrameRate, dbs->GetVolumeRenderingTargetFrameRateModel());
   makeCoupling(ui->chkSynchronize, dbs->GetSynchronizationModel());
   makeCoupling(ui->chkSyncCursor, dbs->GetSyncCursorModel());
   makeCoupling(ui->chkSyncZoom, dbs->GetSyncZoomModel());
   makeCoupling(ui->chkSyncPan, dbs->GetSyncPanModel());
   makeCoupling(ui->chkCheckForUpdates, m_Model->GetCheckForUpdateModel());
   makeCoupling(ui->chkAutoContrast, dbs->GetAutoContrastModel());
+  makeCoupling(ui->chkMemoryMapImages, dbs->GetMemoryMapImagesModel());
+  makeCoupling(ui->chkLazyLoad4D, dbs->GetLazyLoad4DImagesModel());
+  makeCoupling(ui->chkBrickedSlicing, dbs->GetBrickedSlicingModel());
+  makeCoupling(ui->chkTimeMajorCopy, dbs->GetTimeMajorCopyModel());
+  makeCoupling(ui->chkCompressGreyImages, dbs->GetCompressGreyImagesModel());
+  makeCoupling(ui->chkCacheDerivedData, dbs->GetCacheDerivedDataModel());
+  makeCoupling(ui->chkShareDecodedImages, dbs->GetShareDecodedImagesModel());
+  makeCoupling(ui->inMemoryBudget, dbs->GetMemoryBudgetModel());
+  makeCoupling(ui->inFloatOverlayStorage, dbs->GetFloatOverlayStorageModel());
 
   // Hook up the display layout properties
   GlobalDisplaySettings *gds = m_Model->GetGlobalDisplaySettings();
@@ -145,6 +164,9 @@ void PreferencesDialog::SetModel(GlobalPreferencesModel *model)
 
   // Couple the interpolation mode (the domain is not provided by the model)
   makeCoupling(ui->inInterpolationMode, gds->GetGreyInterpolationModeModel());
+  makeCoupling(ui->chkGPUColorMapping, gds->GetFlagGPUColorMappingModel());
+  makeCoupling(ui->chkCPUCompositing, gds->GetFlagCPUCompositingModel());
+  makeCoupling(ui->chkProfilingOverlay, gds->GetFlagProfilingOverlayModel());
 
   // Couple the layer layout model
   makeCoupling(ui->inOverlayLayout, gds->GetLayerLayoutModel());
@@ -185,6 +207,9 @@ void PreferencesDialog::SetModel(GlobalPreferencesModel *model)
   // Hook up the mesh options
   MeshOptions *mo = m_Model->GetMeshOptions();
 
+  makeCoupling(ui->chkGPUMeshExtraction, mo->GetUseGPUExtractionModel());
+  ui->chkGPUMeshExtraction->setVisible(VTKMeshPipeline::IsGPUExtractionAvailable());
+
   makeCoupling(ui->chkGaussianSmooth, mo->GetUseGaussianSmoothingModel());
   makeCoupling(ui->inGaussianSmoothDeviation, mo->GetGaussianStandardDeviationModel());
   makeCoupling(ui->inGaussianSmoothMaxError, mo->GetGaussianErrorModel());
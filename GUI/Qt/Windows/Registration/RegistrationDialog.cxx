@@ -2,6 +2,8 @@
 #include "ui_RegistrationDialog.h"
 
 #include <QMenu>
+#include <QMessageBox>
+#include <QTimer>
 #include <QVBoxLayout>
 #include "QtComboBoxCoupling.h"
 #include "QtCheckBoxCoupling.h"
@@ -16,7 +18,7 @@
 #include "QtCursorOverride.h"
 #include "LoadTransformationDialog.h"
 #include "SimpleFileDialogWithHistory.h"
-#include "ProcessEventsITKCommand.h"
+#include "SNAPQtCommon.h"
 #include "OptimizationProgressRenderer.h"
 #include "QtVTKRenderWindowBox.h"
 
@@ -35,6 +37,11 @@ RegistrationDialog::RegistrationDialog(QWidget *parent) :
   menuMatch->addAction(ui->actionCenters_of_Mass);
   menuMatch->addAction(ui->actionMoments_of_Inertia);
   ui->btnMatchCenters->setMenu(menuMatch);
+
+  // Poll the background registration for new iterates
+  m_RegistrationTimer = new QTimer(this);
+  m_RegistrationTimer->setInterval(100);
+  connect(m_RegistrationTimer, SIGNAL(timeout()), this, SLOT(onRegistrationTimer()));
 }
 
 RegistrationDialog::~RegistrationDialog()
@@ -94,8 +101,9 @@ void RegistrationDialog::SetModel(RegistrationModel *model)
   makeCoupling(ui->inCoarseLevel, m_Model->GetCoarsestResolutionLevelModel());
   makeCoupling(ui->inFineLevel, m_Model->GetFinestResolutionLevelModel());
 
-  activateOnFlag(ui->inMovingLayer, m_Model,
-                 RegistrationModel::UIF_MOVING_SELECTION_AVAILABLE);
+  activateOnAllFlags(ui->inMovingLayer, m_Model,
+                     RegistrationModel::UIF_MOVING_SELECTION_AVAILABLE,
+                     RegistrationModel::UIF_AUTO_REGISTRATION_IDLE);
   activateOnFlag(ui->pgManual, m_Model,
                  RegistrationModel::UIF_MOVING_SELECTED);
   activateOnFlag(ui->pgAuto, m_Model,
@@ -104,11 +112,6 @@ void RegistrationDialog::SetModel(RegistrationModel *model)
   //                    RegistrationModel::UIF_MOVING_SELECTED, RegistrationModel::UIF_REGISTRATION_MODE,
   //                    QtWidgetActivator::HideInactive);
 
-  // This command just updates the GUI after each iteration - causing the images to
-  // jitter over different iterations
-  ProcessEventsITKCommand::Pointer cmdProcEvents = ProcessEventsITKCommand::New();
-  m_Model->SetIterationCommand(cmdProcEvents);
-
 }
 
 void RegistrationDialog::on_pushButton_clicked()
@@ -123,6 +126,13 @@ void RegistrationDialog::on_pushButton_2_clicked()
 
 void RegistrationDialog::on_btnRunRegistration_clicked()
 {
+  // While the registration runs, the button cancels it
+  if(m_Model->IsAutoRegistrationRunning())
+    {
+    m_Model->CancelAutoRegistration();
+    return;
+    }
+
   // Create the render panels based on the number of iterations
   int coarsest = m_Model->GetCoarsestResolutionLevel();
   int finest = m_Model->GetFinestResolutionLevel();
@@ -134,12 +144,6 @@ void RegistrationDialog::on_btnRunRegistration_clicked()
   foreach (QWidget *w, bx)
     delete w;
 
-  // Turn on the wait cursor
-  QtCursorOverride cursor(Qt::WaitCursor);
-
-  // Update the user interface
-  QCoreApplication::processEvents();
-
   // Vector of renderers - so they don't disappear
   m_PlotRenderers.clear();
   m_PlotRenderers.resize(n_levels);
@@ -173,7 +177,33 @@ void RegistrationDialog::on_btnRunRegistration_clicked()
 
   ui->scrollPlots->setVisible(true);
 
-  m_Model->RunAutoRegistration();
+  // Start the registration and follow its progress
+  m_Model->StartAutoRegistration();
+  ui->btnRunRegistration->setText("Cancel Registration");
+  m_RegistrationTimer->start();
+}
+
+void RegistrationDialog::onRegistrationTimer()
+{
+  bool running = false;
+  try
+    {
+    running = m_Model->UpdateAutoRegistration();
+    }
+  catch(IRISException &exc)
+    {
+    ReportNonLethalException(this, exc, "Registration Failed");
+    }
+  catch(std::exception &exc)
+    {
+    QMessageBox::warning(this, "Registration Failed", exc.what());
+    }
+
+  if(!running)
+    {
+    m_RegistrationTimer->stop();
+    ui->btnRunRegistration->setText("Run Registration");
+    }
 }
 
 int RegistrationDialog::GetTransformFormat(QString &format)
@@ -244,6 +274,8 @@ void RegistrationDialog::on_btnSave_clicked()
 void RegistrationDialog::on_buttonBox_clicked(QAbstractButton *button)
 {
   // Tell the model the dialog is closing
+  if(m_Model->IsAutoRegistrationRunning())
+    m_Model->CancelAutoRegistration();
   m_Model->OnDialogClosed();
 
   // The only button is close
@@ -6,6 +6,7 @@
 
 class RegistrationModel;
 class QAbstractButton;
+class QTimer;
 class OptimizationProgressRenderer;
 
 namespace Ui {
@@ -51,6 +52,8 @@ private slots:
 
   void onFreeRotationModeChange(const EventBucket &);
 
+  void onRegistrationTimer();
+
 private:
   Ui::RegistrationDialog *ui;
 
@@ -64,6 +67,9 @@ private:
 
   std::vector<RendererPtr> m_PlotRenderers;
 
+  // Timer used to follow the registration running in the background
+  QTimer *m_RegistrationTimer;
+
 
 };
 
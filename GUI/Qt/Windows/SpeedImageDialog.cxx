@@ -105,6 +105,7 @@ void SpeedImageDialog::SetModel(SnakeWizardModel *model)
   // Couple the clustering widgets
   makeCoupling(ui->inNumClusters, model->GetNumberOfClustersModel());
   makeCoupling(ui->inNumSamples, model->GetNumberOfGMMSamplesModel());
+  makeCoupling(ui->chkMiniBatch, model->GetGMMMiniBatchModel());
   makeCoupling(ui->inClusterXComponent, model->GetClusterPlottedComponentModel());
 
   // Couple the classification widgets
@@ -113,6 +114,7 @@ void SpeedImageDialog::SetModel(SnakeWizardModel *model)
   makeCoupling(ui->inClassifyBias, m_Model->GetClassifierBiasModel());
 
   activateOnFlag(ui->inClassifyBias, m_Model, SnakeWizardModel::UIF_CLASSIFIER_TRAINED);
+  activateOnFlag(ui->btnClassifierSave, m_Model, SnakeWizardModel::UIF_CLASSIFIER_TRAINED);
 
 
   makeCoupling(ui->inClassifyUsePatch, m_Model->GetClassifierUsePatchModel());
@@ -203,3 +205,48 @@ void SpeedImageDialog::on_btnClassifySave_clicked()
         m_Model->GetParent()->GetDriver()->GetSelectedSegmentationLayer(),
         LABEL_ROLE, true, this);
 }
+
+void SpeedImageDialog::on_btnClassifierLoad_clicked()
+{
+  QString selection = ShowSimpleOpenDialogWithHistory(
+        this, m_Model->GetParent(), "Classifier",
+        "Load Classifier - ITK-SNAP",
+        "Classifier File",
+        "Classifier Files (*.rf)");
+
+  if(selection.length())
+    {
+    try
+      {
+      m_Model->LoadClassifier(to_utf8(selection));
+      }
+    catch(std::exception &exc)
+      {
+      ReportNonLethalException(this, exc, "Classifier IO Error",
+                               QString("Failed to load classifier"));
+      }
+    }
+}
+
+void SpeedImageDialog::on_btnClassifierSave_clicked()
+{
+  QString selection = ShowSimpleSaveDialogWithHistory(
+        this, m_Model->GetParent(), "Classifier",
+        "Save Classifier - ITK-SNAP",
+        "Classifier File",
+        "Classifier Files (*.rf)",
+        true);
+
+  if(selection.length())
+    {
+    try
+      {
+      m_Model->SaveClassifier(to_utf8(selection));
+      }
+    catch(std::exception &exc)
+      {
+      ReportNonLethalException(this, exc, "Classifier IO Error",
+                               QString("Failed to save classifier"));
+      }
+    }
+}
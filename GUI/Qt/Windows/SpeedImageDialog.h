@@ -50,6 +50,10 @@ private slots:
 
   void on_btnClassifySave_clicked();
 
+  void on_btnClassifierLoad_clicked();
+
+  void on_btnClassifierSave_clicked();
+
 private:
   Ui::SpeedImageDialog *ui;
 
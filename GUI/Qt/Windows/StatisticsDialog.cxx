@@ -4,12 +4,17 @@
 #include "GlobalUIModel.h"
 #include "IRISApplication.h"
 #include "SegmentationStatistics.h"
+#include "LabelImageWrapper.h"
+#include "GenericImageData.h"
+#include "LayerIterator.h"
+#include "LabelSliceProfileRenderer.h"
 #include "HistoryManager.h"
 #include <QStandardItemModel>
 #include <QTableView>
 #include <QHeaderView>
 #include <QMimeData>
 #include <QClipboard>
+#include <QMessageBox>
 #include <SNAPQtCommon.h>
 #include <QtCursorOverride.h>
 #include <SimpleFileDialogWithHistory.h>
@@ -23,6 +28,10 @@ StatisticsDialog::StatisticsDialog(QWidget *parent) :
   m_ItemModel = new QStandardItemModel(this);
   ui->tvVolumes->setModel(m_ItemModel);
   m_Stats = new SegmentationStatistics();
+
+  m_ProfileRenderer = LabelSliceProfileRenderer::New();
+  ui->plotProfile->SetRenderer(m_ProfileRenderer);
+  ui->plotProfile->setVisible(false);
 }
 
 StatisticsDialog::~StatisticsDialog()
@@ -50,6 +59,22 @@ void StatisticsDialog::FillTable()
   // Compute the segmentation statistics
   m_Stats->Compute(m_Model->GetDriver());
 
+  // Compare with the other segmentation if one is selected
+  this->UpdateCompareLayerList();
+  LabelImageWrapper *other = this->GetCompareLayer();
+  if(!m_Stats->ComputeOverlap(m_Model->GetDriver()->GetSelectedSegmentationLayer(), other))
+    {
+    QMessageBox::warning(
+          this, "ITK-SNAP: Segmentations Not Compared",
+          "The segmentations can not be compared because they have different dimensions.");
+    }
+
+  // The statistics of the other time points are only computed for export
+  LabelImageWrapper *seg = m_Model->GetDriver()->GetSelectedSegmentationLayer();
+  ui->chkAllTimePoints->setVisible(seg && seg->GetNumberOfTimePoints() > 1);
+
+  this->UpdateSliceProfile();
+
   // Fill out the item model
   m_ItemModel->clear();
 
@@ -71,6 +96,19 @@ void StatisticsDialog::FillTable()
     m_ItemModel->setHorizontalHeaderItem(j+3, item);
     }
 
+  // Columns for the comparison with another segmentation
+  const SegmentationStatistics::OverlapMap &overlap = m_Stats->GetOverlap();
+  if(overlap.size())
+    {
+    int col = 3 + cols.size();
+    m_ItemModel->setHorizontalHeaderItem(col, new QStandardItem("Dice"));
+    m_ItemModel->setHorizontalHeaderItem(col + 1, new QStandardItem("Jaccard"));
+    m_ItemModel->setHorizontalHeaderItem(col + 2, new QStandardItem("Volume\nDifference (mm3)"));
+    for(int k = col; k < col + 3; k++)
+      m_ItemModel->horizontalHeaderItem(k)->setToolTip(
+            QString("Comparison of each label with segmentation %1").arg(ui->inCompareLayer->currentText()));
+    }
+
   // Add all the rows
   for(SegmentationStatistics::EntryMap::const_iterator it = m_Stats->GetStats().begin();
       it != m_Stats->GetStats().end(); ++it)
@@ -93,6 +131,15 @@ void StatisticsDialog::FillTable()
             .arg(row.stdev[j],0,'f',4);
         qsi.append(new QStandardItem(text));
         }
+      if(overlap.size())
+        {
+        auto ito = overlap.find(i);
+        SegmentationStatistics::OverlapEntry ov =
+            ito != overlap.end() ? ito->second : SegmentationStatistics::OverlapEntry();
+        qsi.append(new QStandardItem(QString("%1").arg(ov.dice,0,'f',4)));
+        qsi.append(new QStandardItem(QString("%1").arg(ov.jaccard,0,'f',4)));
+        qsi.append(new QStandardItem(QString("%1").arg(ov.volume_difference_mm3,0,'g',4)));
+        }
       m_ItemModel->appendRow(qsi);
       m_ItemModel->setVerticalHeaderItem(m_ItemModel->rowCount()-1,
                                          new QStandardItem(QString("%1").arg(i)));
@@ -108,6 +155,79 @@ void StatisticsDialog::FillTable()
     }
 }
 
+void StatisticsDialog::UpdateCompareLayerList()
+{
+  // Keep the selection if the layer is still there
+  unsigned long selected = ui->inCompareLayer->currentData().toULongLong();
+  LabelImageWrapper *seg = m_Model->GetDriver()->GetSelectedSegmentationLayer();
+
+  ui->inCompareLayer->blockSignals(true);
+  ui->inCompareLayer->clear();
+  ui->inCompareLayer->addItem("None", QVariant((qulonglong) 0));
+  for(LayerIterator it = m_Model->GetDriver()->GetCurrentImageData()->GetLayers(LABEL_ROLE);
+      !it.IsAtEnd(); ++it)
+    {
+    if(it.GetLayer() != seg)
+      {
+      ui->inCompareLayer->addItem(from_utf8(it.GetLayer()->GetNickname()),
+                                  QVariant((qulonglong) it.GetLayer()->GetUniqueId()));
+      if(it.GetLayer()->GetUniqueId() == selected)
+        ui->inCompareLayer->setCurrentIndex(ui->inCompareLayer->count() - 1);
+      }
+    }
+  ui->inCompareLayer->blockSignals(false);
+
+  // Only shown when there is another segmentation
+  ui->inCompareLayer->setVisible(ui->inCompareLayer->count() > 1);
+  ui->lblCompareLayer->setVisible(ui->inCompareLayer->count() > 1);
+}
+
+LabelImageWrapper *StatisticsDialog::GetCompareLayer() const
+{
+  unsigned long id = ui->inCompareLayer->currentData().toULongLong();
+  if(id == 0)
+    return nullptr;
+
+  for(LayerIterator it = m_Model->GetDriver()->GetCurrentImageData()->GetLayers(LABEL_ROLE);
+      !it.IsAtEnd(); ++it)
+    if(it.GetLayer()->GetUniqueId() == id)
+      return dynamic_cast<LabelImageWrapper *>(it.GetLayer());
+  return nullptr;
+}
+
+void StatisticsDialog::on_inCompareLayer_currentIndexChanged(int)
+{
+  QtCursorOverride cursy(Qt::WaitCursor);
+  this->FillTable();
+}
+
+void StatisticsDialog::UpdateSliceProfile()
+{
+  LabelImageWrapper *seg = m_Model->GetDriver()->GetSelectedSegmentationLayer();
+  int axis = ui->inProfileAxis->currentIndex() - 1;
+  if(!seg || axis < 0)
+    {
+    m_Stats->ClearSliceProfile();
+    ui->plotProfile->setVisible(false);
+    return;
+    }
+
+  m_Stats->ComputeSliceProfile(seg, axis);
+  m_ProfileRenderer->SetProfile(*m_Stats, *m_Model->GetDriver()->GetColorLabelTable());
+  ui->plotProfile->setVisible(true);
+}
+
+void StatisticsDialog::on_inProfileAxis_currentIndexChanged(int)
+{
+  QtCursorOverride cursy(Qt::WaitCursor);
+  this->UpdateSliceProfile();
+}
+
+bool StatisticsDialog::IsAllTimePointsSelected() const
+{
+  return ui->chkAllTimePoints->isVisibleTo(this) && ui->chkAllTimePoints->isChecked();
+}
+
 void StatisticsDialog::on_btnUpdate_clicked()
 {
   QtCursorOverride cursy(Qt::WaitCursor);
@@ -118,7 +238,15 @@ void StatisticsDialog::on_btnUpdate_clicked()
 void StatisticsDialog::on_btnCopy_clicked()
 {
   std::ostringstream oss;
-  m_Stats->Export(oss, "\t", *m_Model->GetDriver()->GetColorLabelTable());
+  if(this->IsAllTimePointsSelected())
+    {
+    QtCursorOverride cursy(Qt::WaitCursor);
+    SegmentationStatistics::ExportAllTimePoints(m_Model->GetDriver(), oss, "\t");
+    }
+  else
+    {
+    m_Stats->Export(oss, "\t", *m_Model->GetDriver()->GetColorLabelTable());
+    }
   QString tsv = QString::fromStdString(oss.str());
 
   QClipboard *clipboard = QApplication::clipboard();
@@ -142,6 +270,15 @@ void StatisticsDialog::on_btnExport_clicked()
     {
     try
       {
+      if(this->IsAllTimePointsSelected())
+        {
+        QtCursorOverride cursy(Qt::WaitCursor);
+        m_Model->GetDriver()->ExportSegmentationStatisticsForAllTimePoints(selection.toUtf8());
+        m_Model->GetSystemInterface()->GetHistoryManager()->
+            UpdateHistory("Statistics", to_utf8(selection), true);
+        return;
+        }
+
       std::ofstream fout(selection.toUtf8());
       if(selection.endsWith(".csv", Qt::CaseInsensitive))
         {
@@ -2,6 +2,7 @@
 #define STATISTICSDIALOG_H
 
 #include <QDialog>
+#include <SNAPCommon.h>
 
 namespace Ui {
 class StatisticsDialog;
@@ -10,6 +11,8 @@ class StatisticsDialog;
 class GlobalUIModel;
 class QStandardItemModel;
 class SegmentationStatistics;
+class LabelImageWrapper;
+class LabelSliceProfileRenderer;
 
 class StatisticsDialog : public QDialog
 {
@@ -31,14 +34,29 @@ private slots:
 
   void on_btnExport_clicked();
 
+  void on_inCompareLayer_currentIndexChanged(int index);
+
+  void on_inProfileAxis_currentIndexChanged(int index);
+
 private:
   Ui::StatisticsDialog *ui;
 
   GlobalUIModel *m_Model;
   QStandardItemModel *m_ItemModel;
   SegmentationStatistics *m_Stats;
+  SmartPtr<LabelSliceProfileRenderer> m_ProfileRenderer;
 
   void FillTable();
+
+  // Compute and plot the slice profile along the selected axis, if any
+  void UpdateSliceProfile();
+
+  // List the other segmentation layers to compare with, and get the
+  // selected one (or nullptr)
+  void UpdateCompareLayerList();
+  LabelImageWrapper *GetCompareLayer() const;
+
+  bool IsAllTimePointsSelected() const;
 };
 
 #endif // STATISTICSDIALOG_H
@@ -10,6 +10,8 @@
 #include "SnakeWizardPanel.h"
 #include "QtRendererPlatformSupport.h"
 #include "QtIPCManager.h"
+#include "IPCOpenRequestHandler.h"
+#include "SaveModifiedLayersDialog.h"
 #include "QtCursorOverride.h"
 #include "SNAPQtCommon.h"
 #include "SNAPTestQt.h"
@@ -18,11 +20,16 @@
 #include "GenericSliceModel.h"
 #include "GlobalUIModel.h"
 #include "IRISImageData.h"
+#include "EventBucket.h"
+#include "SNAPProfiler.h"
+#include "TaskScheduler.h"
 
 #include "itkEventObject.h"
 #include "itkObject.h"
 #include "itkCommand.h"
 #include "vtkObject.h"
+#include "vtkSMPTools.h"
+#include "itksys/SystemTools.hxx"
 
 #include <iostream>
 #include <clocale>
@@ -155,14 +162,21 @@ void usage(const char *progname)
   cout << "   --threads N          : Limit maximum number of CPU cores used to N." << endl;
   cout << "   --scale N            : Scale all GUI elements by factor of N (e.g., 2)." << endl;
   cout << "   --geometry WxH+X+Y   : Initial geometry of the main window." << endl;
+  cout << "   --reuse              : Open the images in a running ITK-SNAP session, if there" << endl;
+  cout << "                        :   is one, instead of starting a new session" << endl;
   cout << "Debugging/Testing Options:" << endl;
 #ifdef SNAP_DEBUG_EVENTS
   cout << "   --debug-events       : Dump information regarding UI events" << endl;
 #endif // SNAP_DEBUG_EVENTS
+  cout << "   --profile            : Record and display timings of the rendering pipeline" << endl;
+  cout << "   --profile-trace FILE : Save the timings as a Chrome trace to FILE on exit" << endl;
   cout << "   --test list          : List available tests. " << endl;
   cout << "   --test TESTID        : Execute a test. " << endl;
   cout << "   --testdir DIR        : Set the root directory for tests. " << endl;
   cout << "   --testacc factor     : Adjust the interval between test commands by factor (e.g., 0.5). " << endl;
+  cout << "   --benchmark list     : List available benchmark scenarios. " << endl;
+  cout << "   --benchmark ID       : Replay a benchmark scenario and report its timings. " << endl;
+  cout << "   --benchmark-out FILE : Save the benchmark timings as JSON to FILE. " << endl;
   cout << "   --css file           : Read stylesheet from file." << endl;
   cout << "   --opengl MAJOR MINOR : Set the OpenGL major and minor version. Experimental." << endl;
   cout << "   --testgl             : Diagnose OpenGL/VTK issues." << endl;
@@ -192,9 +206,16 @@ public:
   double xZoomFactor;
   bool flagDebugEvents;
 
+  // Profiling of the rendering pipeline
+  bool flagProfile;
+  std::string fnProfileTrace;
+
   // Whether the console-based application should not fork
   bool flagNoFork;
 
+  // Whether the files should be opened by a running session
+  bool flagReuse;
+
   // Whether the application is being launched from the console
   bool flagConsole;
 
@@ -206,6 +227,10 @@ public:
   std::string fnTestDir;
   double xTestAccel;
 
+  // Benchmark scenarios are run by the test engine
+  bool flagBenchmark;
+  std::string fnBenchmarkOutput;
+
   // Current working directory
   std::string cwd;
 
@@ -226,7 +251,9 @@ public:
   int geometry[4];
 
   CommandLineRequest()
-    : flagDebugEvents(false), flagNoFork(false), flagConsole(false), xZoomFactor(0.0),
+    : flagDebugEvents(false), flagProfile(false), flagNoFork(false), flagReuse(false),
+      flagBenchmark(false),
+      flagConsole(false), xZoomFactor(0.0),
       flagX11DoubleBuffer(false), nThreads(0), nDevicePixelRatio(0), flagTestOpenGL(false)
     {
 #if QT_VERSION >= 0x050000
@@ -331,12 +358,18 @@ int parse(int argc, char *argv[], CommandLineRequest &argdata)
 
   parser.AddOption("--debug-events", 0);
 
+  parser.AddOption("--profile", 0);
+  parser.AddOption("--profile-trace", 1);
+
   parser.AddOption("--no-fork", 0);
   parser.AddOption("--console", 0);
+  parser.AddOption("--reuse", 0);
 
   parser.AddOption("--test", 1);
   parser.AddOption("--testdir", 1);
   parser.AddOption("--testacc", 1);
+  parser.AddOption("--benchmark", 1);
+  parser.AddOption("--benchmark-out", 1);
 
   // Restrict number of threads
   // TODO: use and document this
@@ -398,6 +431,12 @@ int parse(int argc, char *argv[], CommandLineRequest &argdata)
 #endif
     }
 
+  // Profiling is implied by saving a trace
+  if(parseResult.IsOptionPresent("--profile-trace"))
+    argdata.fnProfileTrace = DecodeFilename(parseResult.GetOptionParameter("--profile-trace"));
+  argdata.flagProfile =
+      parseResult.IsOptionPresent("--profile") || argdata.fnProfileTrace.size();
+
   // Initial directory
   if(parseResult.IsOptionPresent("--cwd"))
     argdata.cwd = parseResult.GetOptionParameter("--cwd");
@@ -507,10 +546,20 @@ int parse(int argc, char *argv[], CommandLineRequest &argdata)
   // Forking behavior.
   argdata.flagNoFork = parseResult.IsOptionPresent("--no-fork");
 
-  // Testing
-  if(parseResult.IsOptionPresent("--test"))
+  // Handing the files to a running session
+  argdata.flagReuse = parseResult.IsOptionPresent("--reuse");
+
+  // Testing. A benchmark is a test script that records timings
+  if(parseResult.IsOptionPresent("--benchmark"))
     {
-    argdata.xTestId = parseResult.GetOptionParameter("--test");
+    argdata.flagBenchmark = true;
+    if(parseResult.IsOptionPresent("--benchmark-out"))
+      argdata.fnBenchmarkOutput = DecodeFilename(parseResult.GetOptionParameter("--benchmark-out"));
+    }
+
+  if(parseResult.IsOptionPresent("--test") || argdata.flagBenchmark)
+    {
+    argdata.xTestId = parseResult.GetOptionParameter(argdata.flagBenchmark ? "--benchmark" : "--test");
     if(parseResult.IsOptionPresent("--testdir"))
       argdata.fnTestDir = DecodeFilename(parseResult.GetOptionParameter("--testdir"));
     else
@@ -570,6 +619,205 @@ int parse(int argc, char *argv[], CommandLineRequest &argdata)
   return 0;
 }
 
+/**
+ * Load the workspace or the images and labels given on the command line. This
+ * is used at startup and for the open requests received from new invocations
+ * of the program.
+ */
+void LoadCommandLineFiles(MainImageWindow *mainwin, GlobalUIModel *gui,
+                          const CommandLineRequest &argdata)
+{
+  IRISWarningList warnings;
+  IRISApplication *driver = gui->GetDriver();
+
+  // Check if a workspace is being loaded
+  if(argdata.fnWorkspace.size())
+    {
+    // Put a waiting cursor
+    QtCursorOverride curse(Qt::WaitCursor);
+
+    // Load the workspace
+    try
+      {
+      driver->OpenProject(argdata.fnWorkspace, warnings);
+      }
+    catch(std::exception &exc)
+      {
+      ReportNonLethalException(mainwin, exc, "Workspace Error",
+                               QString("Failed to load workspace %1").arg(
+                                 from_utf8(argdata.fnWorkspace)));
+      }
+    }
+  else
+    {
+    // Load main image file
+    if(argdata.fnMain.size())
+      {
+      // Put a waiting cursor
+      QtCursorOverride curse(Qt::WaitCursor);
+
+      // Try loading the image
+      try
+        {
+        // Load the main image. If that fails, all else should fail too
+        driver->OpenImage(argdata.fnMain.c_str(), MAIN_ROLE, warnings);
+
+        // Load the segmentation
+        if(argdata.fnSegmentation.size())
+          {
+          std::string current_seg;
+          try
+            {
+            for (int i = 0; i < argdata.fnSegmentation.size(); ++i)
+              {
+              current_seg = argdata.fnSegmentation[i];
+              driver->OpenImage(current_seg.c_str(), LABEL_ROLE, warnings
+                                , nullptr, nullptr, i > 0);
+              }
+            }
+          catch(std::exception &exc)
+            {
+            ReportNonLethalException(mainwin, exc, "Image IO Error",
+                                     QString("Failed to load segmentation %1").arg(
+                                       from_utf8(current_seg)));
+            }
+          }
+
+        // Load the overlays
+        if(argdata.fnOverlay.size())
+          {
+          std::string current_overlay;
+          try
+          {
+            for(int i = 0; i < argdata.fnOverlay.size(); i++)
+              {
+              current_overlay = argdata.fnOverlay[i];
+              driver->OpenImage(current_overlay.c_str(), OVERLAY_ROLE, warnings);
+              }
+          }
+          catch(std::exception &exc)
+            {
+            ReportNonLethalException(mainwin, exc, "Overlay IO Error",
+                                     QString("Failed to load overlay %1").arg(
+                                       from_utf8(current_overlay)));
+            }
+          }
+        }
+      catch(std::exception &exc)
+        {
+        ReportNonLethalException(mainwin, exc, "Image IO Error",
+                                 QString("Failed to load image %1").arg(
+                                   from_utf8(argdata.fnMain)));
+        }
+      } // if main image filename supplied
+
+    if(argdata.fnLabelDesc.size())
+      {
+      try
+        {
+        // Load the label file
+        driver->LoadLabelDescriptions(argdata.fnLabelDesc.c_str());
+        }
+      catch(std::exception &exc)
+        {
+        ReportNonLethalException(mainwin, exc, "Label Description IO Error",
+                                 QString("Failed to load labels from %1").arg(
+                                   from_utf8(argdata.fnLabelDesc)));
+        }
+      }
+    } // Not loading workspace
+
+  // Zoom level
+  if(argdata.xZoomFactor > 0)
+    {
+    gui->GetSliceCoordinator()->SetLinkedZoom(true);
+    gui->GetSliceCoordinator()->SetZoomLevelAllWindows(argdata.xZoomFactor);
+    }
+}
+
+/**
+ * Build the arguments for an open request from the parsed command line. File
+ * names are made absolute, because the receiving session may run in a
+ * different directory. The arguments are parsed again by the receiver.
+ */
+std::vector<std::string> GetOpenRequestArguments(const CommandLineRequest &argdata)
+{
+  std::vector<std::string> args;
+  auto abs_path = [](const std::string &fn)
+    { return itksys::SystemTools::CollapseFullPath(fn); };
+
+  if(argdata.fnWorkspace.size())
+    {
+    args.push_back("--workspace");
+    args.push_back(abs_path(argdata.fnWorkspace));
+    }
+
+  if(argdata.fnMain.size())
+    {
+    args.push_back("--grey");
+    args.push_back(abs_path(argdata.fnMain));
+    }
+
+  if(argdata.fnSegmentation.size())
+    {
+    args.push_back("--segmentation");
+    for(const std::string &fn : argdata.fnSegmentation)
+      args.push_back(abs_path(fn));
+    }
+
+  if(argdata.fnOverlay.size())
+    {
+    args.push_back("--overlay");
+    for(const std::string &fn : argdata.fnOverlay)
+      args.push_back(abs_path(fn));
+    }
+
+  if(argdata.fnLabelDesc.size())
+    {
+    args.push_back("--labels");
+    args.push_back(abs_path(argdata.fnLabelDesc));
+    }
+
+  if(argdata.xZoomFactor > 0)
+    {
+    std::ostringstream oss; oss << argdata.xZoomFactor;
+    args.push_back("--zoom");
+    args.push_back(oss.str());
+    }
+
+  return args;
+}
+
+/**
+ * Handle an open request received from a new invocation of the program. The
+ * files replace the data loaded in this session.
+ */
+void HandleOpenRequest(MainImageWindow *mainwin, GlobalUIModel *gui,
+                       const std::vector<std::string> &args)
+{
+  // Parse the arguments just like a command line
+  std::vector<char *> argv;
+  argv.push_back(const_cast<char *>("itksnap"));
+  for(const std::string &arg : args)
+    argv.push_back(const_cast<char *>(arg.c_str()));
+
+  CommandLineRequest request;
+  if(parse((int) argv.size(), argv.data(), request) != 0)
+    return;
+
+  // Bring the window to the front
+  mainwin->showNormal();
+  mainwin->raise();
+  mainwin->activateWindow();
+
+  // Prompt for unsaved changes before the data are replaced
+  if(!SaveModifiedLayersDialog::PromptForUnsavedChanges(
+       gui, SaveModifiedLayersDialog::NoOption, mainwin))
+    return;
+
+  LoadCommandLineFiles(mainwin, gui, request);
+}
+
 int main(int argc, char *argv[])
 {  
   // Set locale to UTF8 on Windows, this allows files with non-ANSI characters to be loaded
@@ -678,14 +926,22 @@ int main(int argc, char *argv[])
   flag_snap_debug_events = argdata.flagDebugEvents;
 #endif
 
+  // Start recording pipeline timings if requested. Benchmarks read the frame
+  // times from the profiler
+  SNAPProfiler::SetEnabled(SNAPProfiler::COMMAND_LINE,
+                           argdata.flagProfile || argdata.flagBenchmark);
+
   // Setup crash signal handlers
   SetupSignalHandlers();
 
-  // Deal with threads
+  // Deal with threads. The background tasks of SNAP and the parallel code
+  // of ITK and VTK all observe the same limit
   if(argdata.nThreads > 0)
     {
     itk::MultiThreaderBase::SetGlobalDefaultNumberOfThreads(argdata.nThreads);
     itk::MultiThreaderBase::SetGlobalMaximumNumberOfThreads(argdata.nThreads);
+    vtkSMPTools::Initialize(argdata.nThreads);
+    TaskScheduler::GetInstance()->SetNumberOfThreads(argdata.nThreads);
     }
 
   // Turn off ITK and VTK warning windows
@@ -695,6 +951,12 @@ int main(int argc, char *argv[])
   // Connect Qt to the Renderer subsystem
   AbstractRenderer::SetPlatformSupport(new QtRendererPlatformSupport());
 
+  // All the render views share one OpenGL context group, so that a view that
+  // is reparented (e.g., docked into another layout or window) keeps its
+  // textures and buffers instead of creating a new context and uploading
+  // them again. This must be set before the application is created.
+  QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
+
   // Create an application
   SNAPQApplication app(argc, argv);
   Q_INIT_RESOURCE(SNAPResources);
@@ -791,6 +1053,20 @@ int main(int argc, char *argv[])
   QtSystemInfoDelegate siDelegate;
   SystemInterface::SetSystemInfoDelegate(&siDelegate);
 
+  // Hand the files to a running session if asked to. This is done before any
+  // of the heavy startup work, and we only continue if no session takes them
+  if(argdata.flagReuse && (argdata.fnWorkspace.size() || argdata.fnMain.size()))
+    {
+    SystemInterface si;
+    IPCOpenRequestHandler handler;
+    handler.Attach(si.GetUserPreferencesFileName());
+    if(handler.SendRequest(GetOpenRequestArguments(argdata), 2000))
+      {
+      std::cout << "Files opened in a running ITK-SNAP session" << std::endl;
+      return 0;
+      }
+    }
+
   // Create the global UI
   try 
     {
@@ -852,113 +1128,8 @@ int main(int argc, char *argv[])
 #endif
 #endif
 
-    // Start parsing options
-    IRISWarningList warnings;
-
-
-    // Check if a workspace is being loaded
-    if(argdata.fnWorkspace.size())
-      {
-      // Put a waiting cursor
-      QtCursorOverride curse(Qt::WaitCursor);
-
-      // Load the workspace
-      try
-        {
-        driver->OpenProject(argdata.fnWorkspace, warnings);
-        }
-      catch(std::exception &exc)
-        {
-        ReportNonLethalException(mainwin, exc, "Workspace Error",
-                                 QString("Failed to load workspace %1").arg(
-                                   from_utf8(argdata.fnWorkspace)));
-        }
-      }
-    else
-      {
-      // Load main image file
-      if(argdata.fnMain.size())
-        {
-        // Put a waiting cursor
-        QtCursorOverride curse(Qt::WaitCursor);
-
-        // Try loading the image
-        try
-          {
-          // Load the main image. If that fails, all else should fail too
-          driver->OpenImage(argdata.fnMain.c_str(), MAIN_ROLE, warnings);
-
-          // Load the segmentation
-          if(argdata.fnSegmentation.size())
-            {
-            std::string current_seg;
-            try
-              {
-              for (int i = 0; i < argdata.fnSegmentation.size(); ++i)
-                {
-                current_seg = argdata.fnSegmentation[i];
-                driver->OpenImage(current_seg.c_str(), LABEL_ROLE, warnings
-                                  , nullptr, nullptr, i > 0);
-                }
-              }
-            catch(std::exception &exc)
-              {
-              ReportNonLethalException(mainwin, exc, "Image IO Error",
-                                       QString("Failed to load segmentation %1").arg(
-                                         from_utf8(current_seg)));
-              }
-            }
-
-          // Load the overlays
-          if(argdata.fnOverlay.size())
-            {
-            std::string current_overlay;
-            try
-            {
-              for(int i = 0; i < argdata.fnOverlay.size(); i++)
-                {
-                current_overlay = argdata.fnOverlay[i];
-                driver->OpenImage(current_overlay.c_str(), OVERLAY_ROLE, warnings);
-                }
-            }
-            catch(std::exception &exc)
-              {
-              ReportNonLethalException(mainwin, exc, "Overlay IO Error",
-                                       QString("Failed to load overlay %1").arg(
-                                         from_utf8(current_overlay)));
-              }
-            }
-          }
-        catch(std::exception &exc)
-          {
-          ReportNonLethalException(mainwin, exc, "Image IO Error",
-                                   QString("Failed to load image %1").arg(
-                                     from_utf8(argdata.fnMain)));
-          }
-        } // if main image filename supplied
-
-      if(argdata.fnLabelDesc.size())
-        {
-        try
-          {
-          // Load the label file
-          driver->LoadLabelDescriptions(argdata.fnLabelDesc.c_str());
-          }
-        catch(std::exception &exc)
-          {
-          ReportNonLethalException(mainwin, exc, "Label Description IO Error",
-                                   QString("Failed to load labels from %1").arg(
-                                     from_utf8(argdata.fnLabelDesc)));
-          }
-        }
-      } // Not loading workspace
-
-    // Zoom level
-    if(argdata.xZoomFactor > 0)
-      {
-      gui->GetSliceCoordinator()->SetLinkedZoom(true);
-      gui->GetSliceCoordinator()->SetZoomLevelAllWindows(argdata.xZoomFactor);
-      }
+    // Load the images and workspace given on the command line
+    LoadCommandLineFiles(mainwin, gui, argdata);
 
     /*
      * ADD THIS LATER!
@@ -988,6 +1159,17 @@ int main(int argc, char *argv[])
     ipcman->hide();
     ipcman->SetModel(gui->GetSynchronizationModel());
 
+    // Accept the files from new invocations started with --reuse. The test
+    // scripts expect the session to be left alone, so this is off for tests
+    if(!argdata.xTestId.size())
+      {
+      GlobalUIModel *gui_ptr = gui;
+      ipcman->AcceptOpenRequests(
+            gui->GetSystemInterface()->GetUserPreferencesFileName(),
+            [mainwin, gui_ptr](const std::vector<std::string> &args)
+            { HandleOpenRequest(mainwin, gui_ptr, args); });
+      }
+
     // Start in cross-hairs mode
     gui->GetGlobalState()->SetToolbarMode(CROSSHAIRS_MODE);
 
@@ -1020,6 +1202,8 @@ int main(int argc, char *argv[])
     if(argdata.xTestId.size())
       {
       testingEngine = new SNAPTestQt(mainwin, argdata.fnTestDir, argdata.xTestAccel);
+      if(argdata.flagBenchmark)
+        testingEngine->SetBenchmarkMode(argdata.fnBenchmarkOutput);
       testingEngine->LaunchTest(argdata.xTestId);
       }
 
@@ -1050,6 +1234,17 @@ int main(int argc, char *argv[])
     // Run application
     int rc = app.exec();
 
+#ifdef SNAP_DEBUG_EVENTS
+    // Report how often models and widgets were updated, and at what cost
+    if(argdata.flagDebugEvents)
+      EventDispatchStatistics::GetInstance()->Print(std::cout);
+#endif
+
+    // Save the recorded pipeline timings
+    if(argdata.fnProfileTrace.size()
+       && !SNAPProfiler::WriteChromeTrace(argdata.fnProfileTrace))
+      cerr << "Unable to write profiler trace to " << argdata.fnProfileTrace << endl;
+
     // If everything cool, save the preferences
     if(!rc)
       gui->SaveUserPreferences();
@@ -6,7 +6,17 @@
 #include <vtkInteractorStyleTrackballActor.h>
 #include <vtkRenderer.h>
 #include <vtkCommand.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCamera.h>
+#include <vtkProp.h>
+#include <vtkPropCollection.h>
+#include <vtkRendererCollection.h>
 #include <vtkObjectFactory.h>
+#include <vtkRenderWindow.h>
+#include <vtkWindowToImageFilter.h>
+#include <vtkNew.h>
+#include <vtkPNGWriter.h>
+#include <algorithm>
 
 class QtRenderWindowInteractor : public vtkRenderWindowInteractor
 {
@@ -44,8 +54,18 @@ AbstractVTKRenderer::AbstractVTKRenderer()
 void AbstractVTKRenderer::SetRenderWindow(vtkRenderWindow *rwin)
 {
   // Store the render window pointer
+  if(m_RenderWindow && m_EndRenderTag)
+    m_RenderWindow->RemoveObserver(m_EndRenderTag);
   m_RenderWindow = rwin;
 
+  // Record the state of the scene after each render, whoever requested it
+  vtkNew<vtkCallbackCommand> cmd;
+  cmd->SetClientData(this);
+  cmd->SetCallback([](vtkObject *, unsigned long, void *self, void *)
+    { static_cast<AbstractVTKRenderer *>(self)->OnRenderWindowEndRender(); });
+  m_EndRenderTag = m_RenderWindow->AddObserver(vtkCommand::EndEvent, cmd);
+  m_RenderInvalidated = true;
+
   // Add the renderer to the window
   m_RenderWindow->AddRenderer(m_Renderer);
 
@@ -126,3 +146,65 @@ void AbstractVTKRenderer::OnWindowResize(int itkNotUsed(w), int itkNotUsed(h), i
     }
 }
 
+void AbstractVTKRenderer::SaveAsPNG(std::string filename)
+{
+  // Read back the last rendered frame. Reading the back buffer avoids
+  // capturing whatever covers the window on screen.
+  vtkNew<vtkWindowToImageFilter> grabber;
+  grabber->SetInput(m_RenderWindow);
+  grabber->SetInputBufferTypeToRGBA();
+  grabber->ReadFrontBufferOff();
+  grabber->Update();
+
+  vtkNew<vtkPNGWriter> writer;
+  writer->SetInputConnection(grabber->GetOutputPort());
+  writer->SetFileName(filename.c_str());
+  writer->Write();
+}
+
+void AbstractVTKRenderer::AddRenderDependency(vtkObject *object)
+{
+  m_RenderDependencies.push_back(object);
+}
+
+vtkMTimeType AbstractVTKRenderer::GetSceneMTime()
+{
+  // The window itself is modified, e.g., when it is resized
+  vtkMTimeType mtime = m_RenderWindow ? m_RenderWindow->GetMTime() : 0;
+  if(m_RenderWindow)
+    {
+    vtkRendererCollection *renderers = m_RenderWindow->GetRenderers();
+    renderers->InitTraversal();
+    while(vtkRenderer *ren = renderers->GetNextItem())
+      {
+      mtime = std::max(mtime, ren->GetMTime());
+      if(ren->IsActiveCameraCreated())
+        mtime = std::max(mtime, ren->GetActiveCamera()->GetMTime());
+
+      // The redraw time of a prop includes its mapper and input data
+      vtkPropCollection *props = ren->GetViewProps();
+      props->InitTraversal();
+      while(vtkProp *prop = props->GetNextProp())
+        mtime = std::max(mtime, prop->GetRedrawMTime());
+      }
+    }
+
+  for(auto &dep : m_RenderDependencies)
+    mtime = std::max(mtime, dep->GetMTime());
+
+  return mtime;
+}
+
+void AbstractVTKRenderer::OnRenderWindowEndRender()
+{
+  if(m_TrackSceneChanges)
+    m_LastRenderMTime = this->GetSceneMTime();
+  m_RenderInvalidated = false;
+}
+
+bool AbstractVTKRenderer::IsRenderNeeded()
+{
+  if(!m_TrackSceneChanges || m_RenderInvalidated)
+    return true;
+  return this->GetSceneMTime() > m_LastRenderMTime;
+}
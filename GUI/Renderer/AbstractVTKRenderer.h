@@ -3,13 +3,16 @@
 
 #include "AbstractRenderer.h"
 #include <vtkSmartPointer.h>
+#include <vtkType.h>
 #include "UIReporterDelegates.h"
+#include <vector>
 
 class vtkRenderer;
 class vtkRenderWindow;
 class vtkGenericOpenGLRenderWindow;
 class vtkRenderWindowInteractor;
 class vtkInteractorObserver;
+class vtkObject;
 
 /**
  * @brief The child of AbstractRenderer that holds a VTK render window
@@ -66,8 +69,46 @@ public:
    */
   virtual void OnWindowResize(int w, int h, int vppr);
 
+  /** Save the current contents of the render window to a PNG file */
+  virtual void SaveAsPNG(std::string filename) override;
+
+  /**
+   * Whether the image in the render window may differ from the one drawn by
+   * the last render. Widgets call this after Update() and skip rendering
+   * when it returns false.
+   *
+   * Renderers that draw from the state of the models (e.g., in context
+   * items) can not tell what changed, so by default every update renders.
+   * Renderers whose image is fully described by their VTK scene call
+   * SetTrackSceneChanges(true), and then only render when a renderer,
+   * camera or prop of the window, or a declared dependency, was modified
+   * since the last render. They call InvalidateRender() for changes that
+   * the scene does not reflect.
+   */
+  virtual bool IsRenderNeeded();
+
+  /** Force the next update to render */
+  void InvalidateRender() { m_RenderInvalidated = true; }
+
+  /** Declare a VTK object, not part of the scene, that the image depends on */
+  void AddRenderDependency(vtkObject *object);
+
 protected:
 
+  // Enable tracking of changes to the VTK scene, see IsRenderNeeded()
+  void SetTrackSceneChanges(bool track) { m_TrackSceneChanges = track; }
+
+  // Latest modification time of the objects that the image depends on
+  vtkMTimeType GetSceneMTime();
+
+  // Called after each render of the window
+  void OnRenderWindowEndRender();
+
+  bool m_TrackSceneChanges = false, m_RenderInvalidated = true;
+  vtkMTimeType m_LastRenderMTime = 0;
+  std::vector<vtkSmartPointer<vtkObject> > m_RenderDependencies;
+  unsigned long m_EndRenderTag = 0;
+
   // Render window object used to render VTK stuff
   vtkSmartPointer<vtkRenderWindow> m_RenderWindow;
   vtkSmartPointer<vtkRenderer> m_Renderer;
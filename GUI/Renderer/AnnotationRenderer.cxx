@@ -14,6 +14,11 @@
 #include <vtkBrush.h>
 #include <vtkTextProperty.h>
 #include <vtkPoints2D.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkCellArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkAbstractMapper.h>
 
 
 class AnnotationContextItem : public GenericSliceContextItem
@@ -65,6 +70,114 @@ public:
           font_info, -1, 1, color, alpha);
   }
 
+  /**
+   * Rebuild the lines and the midpoints of the visible annotations, unless
+   * the annotations, their colors, the slice, the view and the opacity are
+   * the same as when they were last built. The poly data is only modified when it is
+   * rebuilt, so the context device keeps its vertex buffers between paints
+   */
+  void UpdateGeometryCache(const ImageAnnotationData::AnnotationVector &visible, double alpha)
+  {
+    const ImageCoordinateTransform *tran = m_Model->GetImageToDisplayTransform();
+    unsigned char a_uc = (unsigned char) (255 * alpha);
+
+    // The landmark arrows have a fixed length on the screen, so the geometry
+    // also depends on how the window maps to the slice
+    Vector3d window_map[2] = {
+      m_Model->MapPhysicalWindowToSlice(Vector2d(0.0, 0.0)),
+      m_Model->MapPhysicalWindowToSlice(Vector2d(1.0, 1.0)) };
+
+    bool valid =
+        m_CacheGeometryTime == annot::AbstractAnnotation::GetGeometryTime()
+        && m_CacheTransformTime == tran->GetMTime()
+        && m_CacheSlice == (int) m_Model->GetSliceIndex()
+        && m_CacheAlpha == a_uc
+        && m_CacheWindowMap[0] == window_map[0]
+        && m_CacheWindowMap[1] == window_map[1]
+        && m_CacheAnnotations.size() == visible.size();
+
+    for(unsigned int i = 0; valid && i < visible.size(); i++)
+      valid = m_CacheAnnotations[i].first == visible[i]->GetUniqueId()
+              && m_CacheAnnotations[i].second == visible[i]->GetColor();
+
+    if(valid)
+      return;
+
+    m_CacheGeometryTime = annot::AbstractAnnotation::GetGeometryTime();
+    m_CacheTransformTime = tran->GetMTime();
+    m_CacheSlice = (int) m_Model->GetSliceIndex();
+    m_CacheAlpha = a_uc;
+    m_CacheWindowMap[0] = window_map[0];
+    m_CacheWindowMap[1] = window_map[1];
+    m_CacheAnnotations.clear();
+
+    vtkNew<vtkPoints> points;
+    vtkNew<vtkCellArray> lines;
+    m_LineColors->SetNumberOfComponents(4);
+    m_LineColors->SetNumberOfTuples(0);
+    m_MidPoints.clear();
+    m_MidPointColors.clear();
+
+    auto add_color = [a_uc](std::vector<unsigned char> &colors, const Vector3d &color)
+      {
+      for(unsigned int d = 0; d < 3; d++)
+        colors.push_back((unsigned char) (255 * color[d]));
+      colors.push_back(a_uc);
+      };
+
+    auto add_line = [&](const Vector3d &p1, const Vector3d &p2, const Vector3d &color)
+      {
+      vtkIdType id[2] = { points->InsertNextPoint(p1[0], p1[1], 0.0),
+                          points->InsertNextPoint(p2[0], p2[1], 0.0) };
+      lines->InsertNextCell(2, id);
+      unsigned char rgba[4] = { (unsigned char) (255 * color[0]),
+                                (unsigned char) (255 * color[1]),
+                                (unsigned char) (255 * color[2]), a_uc };
+      m_LineColors->InsertNextTypedTuple(rgba);
+      };
+
+    // Map the ends of all the line segments to the slice at once
+    std::vector<Vector3d> ends;
+    for(auto *a : visible)
+      {
+      if(auto *lsa = dynamic_cast<annot::LineSegmentAnnotation *>(a))
+        {
+        ends.push_back(lsa->GetSegment().first);
+        ends.push_back(lsa->GetSegment().second);
+        }
+      }
+    m_Model->MapImageToSlice(ends.data(), ends.data(), ends.size());
+
+    auto itEnd = ends.begin();
+    for(auto *a : visible)
+      {
+      m_CacheAnnotations.push_back(std::make_pair(a->GetUniqueId(), a->GetColor()));
+
+      auto *lsa = dynamic_cast<annot::LineSegmentAnnotation *>(a);
+      if(lsa)
+        {
+        const Vector3d &p1 = *itEnd++;
+        const Vector3d &p2 = *itEnd++;
+        add_line(p1, p2, lsa->GetColor());
+        m_MidPoints.push_back((p1[0] + p2[0]) * 0.5);
+        m_MidPoints.push_back((p1[1] + p2[1]) * 0.5);
+        add_color(m_MidPointColors, lsa->GetColor());
+        }
+
+      auto *lma = dynamic_cast<annot::LandmarkAnnotation *>(a);
+      if(lma)
+        {
+        Vector3d xHeadSlice, xTailSlice;
+        m_AnnotationModel->GetLandmarkArrowPoints(lma->GetLandmark(), xHeadSlice, xTailSlice);
+        add_line(xHeadSlice, xTailSlice, lma->GetColor());
+        }
+      }
+
+    m_Lines->SetPoints(points);
+    m_Lines->SetLines(lines);
+    m_Lines->Modified();
+  }
+
   void DrawSelectionHandle(vtkContext2D *painter, const Vector3d &xSlice)
   {
     // Determine the width of the line
@@ -110,9 +223,6 @@ public:
     Vector3d text_width_slice =
         m_Model->MapWindowOffsetToSliceOffset(Vector2d(96 * vppr , 12 * vppr));
 
-    // Get the list of annotations
-    const ImageAnnotationData *adata = m_AnnotationModel->GetAnnotations();
-
     // set line and point drawing parameters
     // glPointSize(3 * vppr);
     // glLineWidth(1.0 * vppr);
@@ -154,135 +264,131 @@ public:
         }
       } // Current line valid
 
-    // Draw each annotation
-    for(auto it = adata->GetAnnotations().begin(); it != adata->GetAnnotations().end(); ++it)
+    // Draw the lines and midpoints of all annotations visible in this slice
+    // in two calls, from geometry that is kept between paints
+    ImageAnnotationData::AnnotationVector visible;
+    m_AnnotationModel->GetVisibleAnnotations(visible);
+    this->UpdateGeometryCache(visible, alpha);
+
+    if(m_MidPoints.size())
+      {
+      painter->GetPen()->SetWidth(3 * vppr);
+      painter->DrawPointSprites(nullptr, m_MidPoints.data(), (int) m_MidPoints.size() / 2,
+                                m_MidPointColors.data(), 4);
+      }
+
+    if(m_LineColors->GetNumberOfTuples())
+      {
+      painter->GetPen()->SetWidth(1 * vppr);
+      painter->GetPen()->SetLineType(vtkPen::SOLID_LINE);
+      painter->DrawPolyData(0.0, 0.0, m_Lines, m_LineColors, VTK_SCALAR_MODE_USE_CELL_DATA);
+      }
+
+    // Draw the handles and text of each annotation
+    for(auto *a : visible)
       {
-      if(m_AnnotationModel->IsAnnotationVisible(*it))
+      auto *lsa = dynamic_cast<annot::LineSegmentAnnotation *>(a);
+      if(lsa)
         {
-        // Draw all the line segments
-        auto *lsa = dynamic_cast<annot::LineSegmentAnnotation *>(it->GetPointer());
-        if(lsa)
+        Vector3d p1 = m_Model->MapImageToSlice(lsa->GetSegment().first);
+        Vector3d p2 = m_Model->MapImageToSlice(lsa->GetSegment().second);
+
+        if(lsa->GetSelected()
+           && m_AnnotationModel->IsAnnotationModeActive()
+           && m_AnnotationModel->GetAnnotationMode() == ANNOTATION_SELECT)
           {
-          // Draw the line
-          Vector3d p1 = m_Model->MapImageToSlice(lsa->GetSegment().first);
-          Vector3d p2 = m_Model->MapImageToSlice(lsa->GetSegment().second);
+          this->DrawSelectionHandle(painter, p1);
+          this->DrawSelectionHandle(painter, p2);
+          }
 
-          Vector3d color = lsa->GetColor();
+        // Draw length or angle
+        if(m_AnnotationModel->IsDrawingRuler())
+          {
+          // Draw angle:
+          // Compute the dot product and no need for the third components that are zeros
+          double angle = m_AnnotationModel->GetAngleWithCurrentLine(lsa);
+          std::ostringstream oss_angle;
+          oss_angle << std::setprecision(3) << angle << "°";
+
+          Vector3d line_center = m_AnnotationModel->GetAnnotationCenter(lsa);
+
+          // Draw the angle text
+          this->DrawStringRect(painter, oss_angle.str(),
+                               line_center[0] + text_offset_slice[0],
+                               line_center[1] + text_offset_slice[1],
+                               text_width_slice[0], text_width_slice[1],
+                               font_info, -1, 1, lsa->GetColor(), alpha);
+          }
+        else
+          {
+          this->DrawLineLength(painter, p1, p2, lsa->GetColor(),alpha);
+          }
+        }
 
-          painter->GetPen()->SetColorF(color.data_block());
-          painter->GetPen()->SetOpacityF(alpha);
-          painter->GetPen()->SetWidth(3 * vppr);
-          painter->DrawPoint((p1[0] + p2[0]) * 0.5, (p1[1] + p2[1]) * 0.5);
+      auto *lma = dynamic_cast<annot::LandmarkAnnotation *>(a);
+      if(lma)
+        {
+        // Get the head and tail coordinate in slice units
+        Vector3d xHeadSlice, xTailSlice;
+        m_AnnotationModel->GetLandmarkArrowPoints(lma->GetLandmark(), xHeadSlice, xTailSlice);
 
-          painter->GetPen()->SetWidth(1 * vppr);
-          painter->GetPen()->SetLineType(vtkPen::SOLID_LINE);
-          painter->DrawLine(p1[0], p1[1], p2[0], p2[1]);
+        std::string text = lma->GetLandmark().Text;
 
-          if(lsa->GetSelected()
-             && m_AnnotationModel->IsAnnotationModeActive()
-             && m_AnnotationModel->GetAnnotationMode() == ANNOTATION_SELECT)
-            {
-            this->DrawSelectionHandle(painter, p1);
-            this->DrawSelectionHandle(painter, p2);
-            }
+        if(lma->GetSelected() && m_AnnotationModel->IsAnnotationModeActive() &&
+           m_AnnotationModel->GetAnnotationMode() == ANNOTATION_SELECT)
+          {
+          this->DrawSelectionHandle(painter, xHeadSlice);
+          this->DrawSelectionHandle(painter, xTailSlice);
+          }
 
-          // Draw length or angle
-          if(m_AnnotationModel->IsDrawingRuler())
+        // Text box size in slice coordinate units
+        Vector2d xTextSizeSlice(
+              AbstractRenderer::GetPlatformSupport()->MeasureTextWidth(text.c_str(), font_info),
+              font_info.pixel_size * GetVPPR());
+
+        // How to position the text
+        double xbox, ybox;
+        int align_horiz, align_vert;
+        if(fabs(lma->GetLandmark().Offset[0]) >= fabs(lma->GetLandmark().Offset[1]))
+          {
+          align_vert = 0;
+          ybox = xTailSlice[1] - xTextSizeSlice[1] / 2;
+          if(lma->GetLandmark().Offset[0] >= 0)
             {
-            // Draw angle:
-            // Compute the dot product and no need for the third components that are zeros
-            double angle = m_AnnotationModel->GetAngleWithCurrentLine(lsa);
-            std::ostringstream oss_angle;
-            oss_angle << std::setprecision(3) << angle << "°";
-
-            Vector3d line_center = m_AnnotationModel->GetAnnotationCenter(lsa);
-
-            // Draw the angle text
-            this->DrawStringRect(painter, oss_angle.str(),
-                                 line_center[0] + text_offset_slice[0],
-                                 line_center[1] + text_offset_slice[1],
-                                 text_width_slice[0], text_width_slice[1],
-                                 font_info, -1, 1, lsa->GetColor(), alpha);
+            align_horiz = -1;
+            xbox = xTailSlice[0];
             }
           else
             {
-            this->DrawLineLength(painter, p1, p2, lsa->GetColor(),alpha);
+            align_horiz = 1;
+            xbox = xTailSlice[0] - xTextSizeSlice[0];
             }
           }
-
-        auto *lma = dynamic_cast<annot::LandmarkAnnotation *>(it->GetPointer());
-        if(lma)
+        else
           {
-          // Get the head and tail coordinate in slice units
-          Vector3d xHeadSlice, xTailSlice;
-          m_AnnotationModel->GetLandmarkArrowPoints(lma->GetLandmark(), xHeadSlice, xTailSlice);
-
-          std::string text = lma->GetLandmark().Text;
-          Vector3d color = lma->GetColor();
-
-          // Draw the annotation line segment
-          painter->GetPen()->SetColorF(color.data_block());
-          painter->GetPen()->SetOpacityF(alpha);
-          painter->GetPen()->SetWidth(1 * vppr);
-          painter->GetPen()->SetLineType(vtkPen::SOLID_LINE);
-          painter->DrawLine(xHeadSlice[0], xHeadSlice[1], xTailSlice[0], xTailSlice[1]);
-
-          if(lma->GetSelected() && m_AnnotationModel->IsAnnotationModeActive() &&
-             m_AnnotationModel->GetAnnotationMode() == ANNOTATION_SELECT)
-            {
-            this->DrawSelectionHandle(painter, xHeadSlice);
-            this->DrawSelectionHandle(painter, xTailSlice);
-            }
-
-          // Text box size in slice coordinate units
-          Vector2d xTextSizeSlice(
-                AbstractRenderer::GetPlatformSupport()->MeasureTextWidth(text.c_str(), font_info),
-                font_info.pixel_size * GetVPPR());
-
-          // How to position the text
-          double xbox, ybox;
-          int align_horiz, align_vert;
-          if(fabs(lma->GetLandmark().Offset[0]) >= fabs(lma->GetLandmark().Offset[1]))
+          align_horiz = 0;
+          xbox = xTailSlice[0] - xTextSizeSlice[0] / 2;
+          if(lma->GetLandmark().Offset[1] >= 0)
             {
-            align_vert = 0;
-            ybox = xTailSlice[1] - xTextSizeSlice[1] / 2;
-            if(lma->GetLandmark().Offset[0] >= 0)
-              {
-              align_horiz = -1;
-              xbox = xTailSlice[0];
-              }
-            else
-              {
-              align_horiz = 1;
-              xbox = xTailSlice[0] - xTextSizeSlice[0];
-              }
+            align_vert = -1;
+            ybox = xTailSlice[1];
             }
           else
             {
-            align_horiz = 0;
-            xbox = xTailSlice[0] - xTextSizeSlice[0] / 2;
-            if(lma->GetLandmark().Offset[1] >= 0)
-              {
-              align_vert = -1;
-              ybox = xTailSlice[1];
-              }
-            else
-              {
-              align_vert = 1;
-              ybox = xTailSlice[1] - xTextSizeSlice[1];
-              }
+            align_vert = 1;
+            ybox = xTailSlice[1] - xTextSizeSlice[1];
             }
-
-          // Draw the text at the right location
-          font_info = rps->MakeFont(12 * GetVPPR(),
-                                    AbstractRendererPlatformSupport::SANS);
-          this->DrawStringRect(painter, text,
-                               xbox, ybox,
-                               xTextSizeSlice[0], xTextSizeSlice[1], font_info,
-                               align_horiz, align_vert, lma->GetColor(), alpha);
           }
 
+        // Draw the text at the right location
+        font_info = rps->MakeFont(12 * GetVPPR(),
+                                  AbstractRendererPlatformSupport::SANS);
+        this->DrawStringRect(painter, text,
+                             xbox, ybox,
+                             xTextSizeSlice[0], xTextSizeSlice[1], font_info,
+                             align_horiz, align_vert, lma->GetColor(), alpha);
         }
+
       }
 
     return true;
@@ -290,8 +396,29 @@ public:
 
 protected:
 
-  AnnotationModel *m_AnnotationModel;
+  AnnotationContextItem()
+  {
+    m_Lines = vtkSmartPointer<vtkPolyData>::New();
+    m_LineColors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+  }
+
+  AnnotationModel *m_AnnotationModel = nullptr;
+
+  // Lines of the visible annotations in slice coordinates, one color per line
+  vtkSmartPointer<vtkPolyData> m_Lines;
+  vtkSmartPointer<vtkUnsignedCharArray> m_LineColors;
+
+  // Midpoints of the visible line segments, as x,y pairs and RGBA colors
+  std::vector<float> m_MidPoints;
+  std::vector<unsigned char> m_MidPointColors;
 
+  // What the cached geometry was built from
+  unsigned long m_CacheGeometryTime = 0;
+  itk::ModifiedTimeType m_CacheTransformTime = 0;
+  int m_CacheSlice = -1;
+  unsigned char m_CacheAlpha = 0;
+  Vector3d m_CacheWindowMap[2];
+  std::vector<std::pair<unsigned long, Vector3d> > m_CacheAnnotations;
 };
 
 
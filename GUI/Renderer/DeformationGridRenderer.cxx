@@ -18,7 +18,7 @@ DeformationGridContextItem
 }
 
 void DeformationGridContextItem
-::AddLine(vtkPoints2D *pv, std::vector<double> &verts,
+::AddLine(vtkPoints2D *pv, const std::vector<double> &verts,
           size_t skip, size_t l, size_t nv, bool reverse)
 {
   if (!reverse)
@@ -51,30 +51,38 @@ DeformationGridContextItem
     return true;
 
 
-  DeformationGridVertices verts;
-  m_DeformationGridModel->GetVertices(m_ImageLayer, verts);
+  const DeformationGridVertices *verts = m_DeformationGridModel->GetVertices(m_ImageLayer);
+  if (!verts)
+    return true;
+
+  // Rebuild the lines if the vertices have changed. Horizontal (d = 0) lines
+  // come first, then vertical (d = 1)
+  if (verts->version != m_PointsVersion)
+    {
+    size_t skip = 0;
+    for (int d = 0; d < 2; ++d)
+      {
+      m_Points[d] = vtkSmartPointer<vtkPoints2D>::New();
+      m_Points[d]->Allocate(verts->nvert[d] * verts->nline[d]);
+      bool reverse = false;
+
+      for (size_t l = 0; l < verts->nline[d]; ++l)
+        {
+        AddLine(m_Points[d], verts->vvec, skip, l, verts->nvert[d], reverse);
+        reverse = !reverse;
+        }
+
+      skip += verts->nvert[d] * verts->nline[d] * 2; // skip verts for horizontal lines
+      }
+    m_PointsVersion = verts->version;
+    }
 
   auto as = m_Model->GetParentUI()->GetAppearanceSettings();
   auto elt = as->GetUIElement(SNAPAppearanceSettings::GRID_LINES);
   this->ApplyAppearanceSettingsToPen(painter, elt);
 
-  // Draw horizontal (d = 0) then vertical (d = 1)
-  size_t skip = 0;
   for (int d = 0; d < 2; ++d)
-    {
-    vtkNew<vtkPoints2D> pts;
-    pts->Allocate(verts.nvert[d] * verts.nline[d]);
-    bool reverse = false;
-
-    for (size_t l = 0; l < verts.nline[d]; ++l)
-      {
-      AddLine(pts, verts.vvec, skip, l, verts.nvert[d], reverse);
-      reverse = !reverse;
-      }
-
-    painter->DrawPoly(pts);
-    skip += verts.nvert[d] * verts.nline[d] * 2; // skip verts for horizontal lines
-    }
+    painter->DrawPoly(m_Points[d]);
 
   return true;
 }
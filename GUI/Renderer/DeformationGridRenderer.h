@@ -4,6 +4,7 @@
 #include "GenericSliceRenderer.h"
 #include "GenericSliceContextItem.h"
 #include "DeformationGridModel.h"
+#include <vtkSmartPointer.h>
 
 class vtkPoints2D;
 
@@ -22,11 +23,16 @@ protected:
   DeformationGridContextItem();
   virtual ~DeformationGridContextItem() {}
 
-  static inline void AddLine(vtkPoints2D *pv, std::vector<double> &verts,
+  static inline void AddLine(vtkPoints2D *pv, const std::vector<double> &verts,
                              size_t skip, size_t l, size_t nv, bool reverse);
 
   DeformationGridModel *m_DeformationGridModel;
 
+  // Points of the horizontal and vertical lines, rebuilt only when the model
+  // recomputes the grid vertices
+  vtkSmartPointer<vtkPoints2D> m_Points[2];
+  unsigned long m_PointsVersion = 0;
+
   ImageWrapperBase *m_ImageLayer;
 };
 
@@ -13,6 +13,8 @@
 #include "SegmentationMeshWrapper.h"
 #include "MeshWrapperBase.h"
 #include "MeshManager.h"
+#include "GlobalState.h"
+#include "DefaultBehaviorSettings.h"
 #include "Window3DPicker.h"
 
 #include "vtkGenericOpenGLRenderWindow.h"
@@ -34,12 +36,11 @@
 #include "vtkWindowedSincPolyDataFilter.h"
 #include "vtkThreshold.h"
 #include "vtkDataSetMapper.h"
-#include "vtkTransformFilter.h"
 #include "vtkTransform.h"
 #include "vtkLookupTable.h"
 #include "vtkDataSetSurfaceFilter.h"
 #include "vtkGeometryFilter.h"
-#include "vtkGlyph3D.h"
+#include "vtkGlyph3DMapper.h"
 #include "vtkCubeSource.h"
 #include "vtkSphereSource.h"
 #include "vtkImplicitPlaneWidget.h"
@@ -52,9 +53,13 @@
 #include "vtkPolyData.h"
 #include "vtkPointData.h"
 #include "vtkCommand.h"
+#include "vtkCallbackCommand.h"
 #include <vtkVolume.h>
 #include <vtkVolumeProperty.h>
-#include <vtkSmartVolumeMapper.h>
+#include <vtkMultiBlockVolumeMapper.h>
+#include <vtkMultiBlockDataSet.h>
+#include <vtkExtractVOI.h>
+#include <vtkDataArray.h>
 #include <vtkImageImport.h>
 #include <vtkImageData.h>
 #include <vtkColorTransferFunction.h>
@@ -63,6 +68,7 @@
 #include <ColorMap.h>
 #include <AffineTransformHelper.h>
 #include <itkTransform.h>
+#include <itkMultiThreaderBase.h>
 
 #include <vnl/vnl_cross.h>
 #include <chrono>
@@ -88,6 +94,10 @@ bool operator != (const CameraState &c1, const CameraState &c2)
 
 Generic3DRenderer::Generic3DRenderer()
 {
+  // The scene describes everything that is drawn, so views only render when
+  // it has been modified
+  this->SetTrackSceneChanges(true);
+
   // Create a picker
   m_Picker = vtkSmartPointer<Window3DPicker>::New();
 
@@ -121,31 +131,28 @@ Generic3DRenderer::Generic3DRenderer()
 
   // ------------------ SPRAYPAINT ----------------------------
 
-  // Create a glyph filter which handles spray paint
+  // Create a glyph mapper which handles spray paint. The sphere is drawn
+  // once per point by instancing, so adding a point does not regenerate
+  // the geometry of all the other glyphs
   vtkSmartPointer<vtkSphereSource> cube = vtkSmartPointer<vtkSphereSource>::New();
-  m_SprayGlyphFilter = vtkSmartPointer<vtkGlyph3D>::New();
-  m_SprayGlyphFilter->SetSourceConnection(cube->GetOutputPort());
-  m_SprayGlyphFilter->SetScaleModeToDataScalingOff();
-  m_SprayGlyphFilter->SetScaleFactor(1.4);
+  cube->SetRadius(0.7);
+  m_SprayGlyphMapper = vtkSmartPointer<vtkGlyph3DMapper>::New();
+  m_SprayGlyphMapper->SetSourceConnection(cube->GetOutputPort());
+  m_SprayGlyphMapper->ScalingOff();
+  m_SprayGlyphMapper->ScalarVisibilityOff();
 
-  // Create a transform filter for the glyph filter
+  // The points are in voxel coordinates, mapped to the world by the actor
   m_SprayTransform = vtkSmartPointer<vtkTransform>::New();
-  vtkSmartPointer<vtkTransformFilter> tf_glyph = vtkSmartPointer<vtkTransformFilter>::New();
-  tf_glyph->SetTransform(m_SprayTransform.GetPointer());
-  tf_glyph->SetInputConnection(m_SprayGlyphFilter->GetOutputPort());
 
   // Create the spray paint property
   m_SprayProperty = vtkSmartPointer<vtkProperty>::New();
   m_SprayProperty->SetShading(VTK_FLAT);
 
-  // Create a mapper, etc for the glyph filter and add to the renderer
-  vtkSmartPointer<vtkPolyDataMapper> mapper_spray = vtkSmartPointer<vtkPolyDataMapper>::New();
-  mapper_spray->SetInputConnection(tf_glyph->GetOutputPort());
-
   // Create and add an actor for the spray
   m_SprayActor = vtkSmartPointer<vtkActor>::New();
-  m_SprayActor->SetMapper(mapper_spray);
+  m_SprayActor->SetMapper(m_SprayGlyphMapper);
   m_SprayActor->SetProperty(m_SprayProperty);
+  m_SprayActor->SetUserTransform(m_SprayTransform);
 
   // ------------------ SCALPEL ----------------------------
 
@@ -205,6 +212,10 @@ void Generic3DRenderer::SetModel(Generic3DModel *model)
   // Respond to changes in image dimension - these require big updates
   Rebroadcast(app, MainImageDimensionsChangeEvent(), ModelUpdateEvent());
 
+  // A reorientation only moves the axes, the camera and the spray glyphs.
+  // The meshes are moved when they are next updated
+  Rebroadcast(app, MainImagePoseChangeEvent(), ModelUpdateEvent());
+
   // Respond to changes to the segmentation. These are ignored unless we are
   // in continous update mode, in which case the renderers are rebuilt
   // Rebroadcast(app, SegmentationChangeEvent(), ModelUpdateEvent());
@@ -274,7 +285,7 @@ void Generic3DRenderer::SetModel(Generic3DModel *model)
   this->UpdateCamera(true);
 
   // Hook up the spray pipeline
-  m_SprayGlyphFilter->SetInputData(m_Model->GetSprayPoints());
+  m_SprayGlyphMapper->SetInputData(m_Model->GetSprayPoints());
 
   // Set the model in the picker
   m_Picker->SetModel(m_Model);
@@ -323,8 +334,17 @@ void Generic3DRenderer::UpdateMeshAssembly()
 	// Add meshes in the actor map to the renderer
 	auto actorMap = m_ActorPool->GetActorMap();
 
-  for (auto it = actorMap->begin(); it != actorMap->end(); ++it)
-    m_Renderer->AddActor(it->second);
+  // Many label meshes are drawn in one batch, since one actor per label
+  // makes interaction sluggish. Meshes colored by data arrays keep their own
+  // actors, since their colors are mapped from the arrays.
+  m_UseMergedActor = actorMap->size() >= MERGED_ACTOR_MIN_LABELS
+      && dynamic_cast<LabelMeshDisplayMappingPolicy *>(dmp);
+
+  if (m_UseMergedActor)
+    m_Renderer->AddActor(m_ActorPool->GetMergedActor());
+  else
+    for (auto it = actorMap->begin(); it != actorMap->end(); ++it)
+      m_Renderer->AddActor(it->second);
 
 	ApplyDisplayMappingPolicyChange();
 
@@ -343,6 +363,10 @@ void Generic3DRenderer::ApplyDisplayMappingPolicyChange()
   MeshDisplayMappingPolicy* dmp = active_layer->GetMeshDisplayMappingPolicy();
 	dmp->UpdateAppearance(m_ActorPool, m_CrntActorMapTimePoint);
 
+  // Carry the new colors and visibility over to the merged actor
+  if (m_UseMergedActor)
+    m_ActorPool->UpdateMergedActor();
+
   // Update legend
   dmp->ConfigureLegend(m_ScalarBarActor);
 }
@@ -357,6 +381,9 @@ void Generic3DRenderer::ResetMeshAssembly()
   for(auto it_actor = actorMap->begin(); it_actor != actorMap->end(); it_actor++)
     this->m_Renderer->RemoveActor(it_actor->second);
 
+  this->m_Renderer->RemoveActor(m_ActorPool->GetMergedActor());
+  m_UseMergedActor = false;
+
   m_ActorPool->RecycleAll();
 
   InvokeEvent(ModelUpdateEvent());
@@ -687,6 +714,15 @@ void Generic3DRenderer::SetRenderWindow(vtkRenderWindow *rwin)
   rwin->GetInteractor()->SetPicker(m_Picker);
   m_ScalpelPlaneWidget->SetInteractor(rwin->GetInteractor());
 
+  // Choose the level of detail of the volumes before each render
+  if(m_StartRenderTag)
+    rwin->RemoveObserver(m_StartRenderTag);
+  vtkNew<vtkCallbackCommand> cmd;
+  cmd->SetClientData(this);
+  cmd->SetCallback([](vtkObject *, unsigned long, void *self, void *)
+    { static_cast<Generic3DRenderer *>(self)->OnRenderWindowStartRender(); });
+  m_StartRenderTag = rwin->AddObserver(vtkCommand::StartEvent, cmd);
+
   // Why is this necessary?
   // rwin->SetMultiSamples(4);
   // rwin->SetLineSmoothing(1);
@@ -722,30 +758,82 @@ void Generic3DRenderer::UpdateMeshAppearance()
     else
       prop->SetOpacity(0.0);
     }
+
+  if (m_UseMergedActor)
+    m_ActorPool->UpdateMergedActor();
 }
 
 
 
+/**
+ * A rectangular block of the volume-rendered image. Bricks overlap by one
+ * voxel so that trilinear interpolation is continuous across brick faces.
+ * The intensity range of each brick is used to skip bricks that are fully
+ * transparent under the current transfer function, so that only non-empty
+ * bricks are copied and uploaded to the GPU.
+ */
+struct VolumeBrick
+{
+  // Extent of the brick in the imported VTK image
+  int Extent[6];
+
+  // Range of finite intensities in the brick (Min > Max if there are none)
+  double Min, Max;
+
+  // Whether the brick is visible under the current opacity curve
+  bool Visible = false;
+
+  // Image data for the brick, only allocated while it is visible
+  vtkSmartPointer<vtkImageData> Data;
+};
+
 class VolumeAssembly : public itk::Object
 {
 public:
   irisITKObjectMacro(VolumeAssembly, itk::Object)
 
+  // Size of the volume rendering bricks, in voxels
+  static constexpr int BRICK_SIZE = 128;
+
   // Minipipeline used to import ITK data
   ScalarImageWrapperBase::VTKImporterMiniPipeline ImportPipeline;
 
   // VTK assembly
   vtkSmartPointer<vtkVolume> Volume;
-  vtkSmartPointer<vtkSmartVolumeMapper> Mapper;
+  vtkSmartPointer<vtkMultiBlockVolumeMapper> Mapper;
+  vtkSmartPointer<vtkMultiBlockDataSet> Blocks;
   vtkSmartPointer<vtkColorTransferFunction> ColorCurve;
   vtkSmartPointer<vtkVolumeProperty> Property;
   vtkSmartPointer<vtkPiecewiseFunction> OpacityCurve;
   vtkSmartPointer<vtkPiecewiseFunction> GradientCurve;
   vtkSmartPointer<vtkRenderer> Renderer;
 
+  // The bricks covering the image
+  std::vector<VolumeBrick> Bricks;
+
+  // Coarser copy of the image that is rendered while the camera moves, and
+  // the pyramid level it comes from (zero when the image itself is used)
+  ScalarImageWrapperBase::VTKImporterMiniPipeline LowResImportPipeline;
+  vtkSmartPointer<vtkMultiBlockDataSet> LowResBlocks;
+  unsigned int LowResLevel = 0;
+  bool Interactive = false;
+
+  // Ray sampling distance at full quality, in the units of the VTK image
+  double SampleDistance = 1.0;
+
+  // Samples of the opacity curve, used to determine brick visibility
+  std::vector<double> OpacitySamples;
+  double OpacitySampleMin = 0.0, OpacitySampleMax = 0.0;
+
   // Update time on the curve
   itk::ModifiedTimeType CurveUpdateTime = 0;
-  itk::ModifiedTimeType TransformUpdateTime = 0;
+
+  // Versions of the wrapper state that the transform and the bricks were
+  // computed from, so that neither is rebuilt for changes it does not
+  // depend on (e.g., the bricks when the layer is moved)
+  unsigned long TransformGeometryVersion = 0;
+  unsigned long BrickVoxelDataVersion = 0;
+  unsigned int BrickTimePoint = 0;
 
 protected:
   VolumeAssembly() {}
@@ -769,6 +857,9 @@ void Generic3DRenderer::UpdateVolumeCurves(ImageWrapperBase *layer, VolumeAssemb
 
   va->ColorCurve->RemoveAllPoints();
   va->OpacityCurve->RemoveAllPoints();
+  va->OpacitySamples.resize(k + 1);
+  va->OpacitySampleMin = imin;
+  va->OpacitySampleMax = imax;
   for(unsigned int j = 0; j <= k; j++)
     {
     double t = j * 1.0 / k;
@@ -779,12 +870,269 @@ void Generic3DRenderer::UpdateVolumeCurves(ImageWrapperBase *layer, VolumeAssemb
 
     // Here we apply additional ramp to the alpha
     double x_ramp = (x < 0) ? 0.0 : (x > 1.0) ? 1.0 : x;
-    va->OpacityCurve->AddPoint(i, rgba[3] * x_ramp / 255.);
+    va->OpacitySamples[j] = rgba[3] * x_ramp / 255.;
+    va->OpacityCurve->AddPoint(i, va->OpacitySamples[j]);
     }
 
   va->CurveUpdateTime = std::max(cmap->GetMTime(), curve->GetMTime());
 }
 
+namespace Generic3DRenderer_impl
+{
+// Compute the range of finite values in a subextent of a VTK image
+template <class T>
+void ComputeBrickRange(vtkImageData *image, T *, VolumeBrick &brick)
+{
+  double vmin = std::numeric_limits<double>::infinity();
+  double vmax = -std::numeric_limits<double>::infinity();
+  const int *e = brick.Extent;
+  for(int z = e[4]; z <= e[5]; z++)
+    {
+    for(int y = e[2]; y <= e[3]; y++)
+      {
+      // Scan a row of the brick, NaNs fail both comparisons and are skipped
+      const T *p = static_cast<const T *>(image->GetScalarPointer(e[0], y, z));
+      for(int x = e[0]; x <= e[1]; x++, p++)
+        {
+        double v = static_cast<double>(*p);
+        if(v < vmin) vmin = v;
+        if(v > vmax) vmax = v;
+        }
+      }
+    }
+
+  brick.Min = vmin;
+  brick.Max = vmax;
+}
+}
+
+void Generic3DRenderer::UpdateVolumeBricks(ImageWrapperBase *layer, VolumeAssembly *va)
+{
+  auto *sw = layer->GetDefaultScalarRepresentation();
+
+  // Make sure the imported image is current
+  va->ImportPipeline.importer->Update();
+  vtkImageData *image = va->ImportPipeline.importer->GetOutput();
+
+  // Partition the image extent into bricks, overlapping by one voxel
+  int ext[6];
+  image->GetExtent(ext);
+  int nb[3];
+  for(int d = 0; d < 3; d++)
+    nb[d] = std::max(1, (ext[2*d+1] - ext[2*d] + VolumeAssembly::BRICK_SIZE - 1) / VolumeAssembly::BRICK_SIZE);
+
+  va->Bricks.clear();
+  va->Bricks.resize(nb[0] * nb[1] * nb[2]);
+  for(int bz = 0, ib = 0; bz < nb[2]; bz++)
+    {
+    for(int by = 0; by < nb[1]; by++)
+      {
+      for(int bx = 0; bx < nb[0]; bx++, ib++)
+        {
+        int b[3] = { bx, by, bz };
+        VolumeBrick &brick = va->Bricks[ib];
+        for(int d = 0; d < 3; d++)
+          {
+          brick.Extent[2*d] = ext[2*d] + b[d] * VolumeAssembly::BRICK_SIZE;
+          brick.Extent[2*d+1] = std::min(ext[2*d+1], brick.Extent[2*d] + VolumeAssembly::BRICK_SIZE);
+          }
+        }
+      }
+    }
+
+  // Compute the intensity range of each brick in parallel
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, va->Bricks.size(), [&](itk::SizeValueType k)
+  {
+    switch(image->GetScalarType())
+      {
+      vtkTemplateMacro(Generic3DRenderer_impl::ComputeBrickRange(
+                         image, static_cast<VTK_TT *>(nullptr), va->Bricks[k]));
+      }
+  }, nullptr);
+
+  // Sample each voxel about twice along the rays
+  double *spacing = image->GetSpacing();
+  va->SampleDistance = 0.5 * std::min(spacing[0], std::min(spacing[1], spacing[2]));
+  va->Mapper->SetSampleDistance(va->SampleDistance);
+
+  // The coarser copy of the old image is no longer valid
+  va->LowResImportPipeline = ScalarImageWrapperBase::VTKImporterMiniPipeline();
+  va->LowResBlocks = nullptr;
+  va->Interactive = false;
+
+  // Force the visibility of the bricks to be recomputed
+  va->Blocks = nullptr;
+  va->BrickTimePoint = sw->GetTimePointIndex();
+  va->BrickVoxelDataVersion = sw->GetVoxelDataVersion(va->BrickTimePoint);
+  UpdateVolumeBrickVisibility(va);
+}
+
+void Generic3DRenderer::UpdateVolumeBrickVisibility(VolumeAssembly *va)
+{
+  // Determine which bricks have non-zero opacity somewhere in their range.
+  // The opacity curve is piecewise linear between the samples, so it suffices
+  // to check the samples bracketing the range of each brick.
+  int k = (int) va->OpacitySamples.size() - 1;
+  double smin = va->OpacitySampleMin, smax = va->OpacitySampleMax;
+  bool changed = false;
+  unsigned int n_visible = 0;
+  for(VolumeBrick &brick : va->Bricks)
+    {
+    bool visible = false;
+    if(brick.Min <= brick.Max && k >= 0)
+      {
+      int j0 = 0, j1 = k;
+      if(smax > smin)
+        {
+        j0 = (int) std::floor(k * (brick.Min - smin) / (smax - smin));
+        j1 = (int) std::ceil(k * (brick.Max - smin) / (smax - smin));
+        j0 = std::max(0, std::min(k, j0));
+        j1 = std::max(0, std::min(k, j1));
+        }
+      for(int j = j0; j <= j1 && !visible; j++)
+        visible = va->OpacitySamples[j] > 0.0;
+      }
+
+    if(visible != brick.Visible)
+      {
+      brick.Visible = visible;
+      changed = true;
+      }
+    if(visible)
+      n_visible++;
+    }
+
+  // Nothing to do if the set of visible bricks has not changed
+  if(!changed && va->Blocks)
+    return;
+
+  // When every brick is visible, render the imported image directly without
+  // making a copy of it
+  va->Blocks = vtkSmartPointer<vtkMultiBlockDataSet>::New();
+  if(n_visible == va->Bricks.size())
+    {
+    for(VolumeBrick &brick : va->Bricks)
+      brick.Data = nullptr;
+    va->Blocks->SetBlock(0, va->ImportPipeline.importer->GetOutput());
+    }
+  else
+    {
+    unsigned int i_block = 0;
+    for(VolumeBrick &brick : va->Bricks)
+      {
+      if(brick.Visible)
+        {
+        if(!brick.Data)
+          {
+          vtkNew<vtkExtractVOI> voi;
+          voi->SetInputData(va->ImportPipeline.importer->GetOutput());
+          voi->SetVOI(brick.Extent);
+          voi->Update();
+          brick.Data = voi->GetOutput();
+          }
+        va->Blocks->SetBlock(i_block++, brick.Data);
+        }
+      else
+        {
+        brick.Data = nullptr;
+        }
+      }
+    }
+
+  if(!va->Interactive)
+    va->Mapper->SetInputDataObject(va->Blocks);
+  va->Volume->SetVisibility(n_visible > 0);
+}
+
+void Generic3DRenderer::UpdateVolumeLevelOfDetail(ImageWrapperBase *layer, VolumeAssembly *va)
+{
+  if(!m_VolumeInteractive)
+    {
+    // Back to the full resolution bricks and the fine sampling
+    if(va->Interactive)
+      {
+      va->Interactive = false;
+      va->Mapper->SetInputDataObject(va->Blocks);
+      va->Mapper->SetSampleDistance(va->SampleDistance);
+      }
+    return;
+    }
+
+  // Doubling the sampling distance halves the number of samples per ray, and
+  // each pyramid level halves it again. Take the finest level that should be
+  // fast enough, given the time taken by the last full quality render
+  DefaultBehaviorSettings *dbs =
+      m_Model->GetParentUI()->GetDriver()->GetGlobalState()->GetDefaultBehaviorSettings();
+  double budget = 1.0 / dbs->GetVolumeRenderingTargetFrameRate();
+  unsigned int level = 0;
+  for(double t = 0.5 * m_VolumeStillRenderTime; t > budget && level < 8; t *= 0.5)
+    level++;
+
+  if(!va->Interactive || level != va->LowResLevel)
+    {
+    // The pyramid only exists for large scalar images, and may still be
+    // under construction, in which case a finer level is used
+    va->LowResImportPipeline = ScalarImageWrapperBase::VTKImporterMiniPipeline();
+    va->LowResBlocks = nullptr;
+    auto *sw = layer->GetDefaultScalarRepresentation();
+    for(; level > 0; level--)
+      {
+      va->LowResImportPipeline = sw->CreateVTKImporterPipelineForPyramidLevel(level);
+      if(va->LowResImportPipeline.importer)
+        break;
+      }
+
+    // The level shares the voxels of the pyramid, and is small enough to be
+    // rendered as a single block
+    if(va->LowResImportPipeline.importer)
+      {
+      va->LowResImportPipeline.importer->Update();
+      va->LowResBlocks = vtkSmartPointer<vtkMultiBlockDataSet>::New();
+      va->LowResBlocks->SetBlock(0, va->LowResImportPipeline.importer->GetOutput());
+      }
+
+    va->LowResLevel = level;
+    va->Interactive = true;
+    va->Mapper->SetInputDataObject(va->LowResBlocks ? va->LowResBlocks : va->Blocks);
+    va->Mapper->SetSampleDistance(va->SampleDistance * (2 << level));
+    }
+}
+
+void Generic3DRenderer::OnRenderWindowStartRender()
+{
+  // The interaction styles raise the update rate of the window while the
+  // camera moves, and set it back to the still rate when they are done
+  vtkRenderWindowInteractor *rwi = m_RenderWindow->GetInteractor();
+  if(!rwi)
+    return;
+
+  bool interactive = m_RenderWindow->GetDesiredUpdateRate() > rwi->GetStillUpdateRate();
+  if(interactive && !m_VolumeInteractive)
+    m_VolumeStillRenderTime = m_Renderer->GetLastRenderTimeInSeconds();
+  m_VolumeInteractive = interactive;
+
+  // Meshes that have a preview use it until the camera stops
+  m_ActorPool->SetUsePreviews(interactive);
+
+  // Ask for the preferred frame rate for the next interaction
+  DefaultBehaviorSettings *dbs =
+      m_Model->GetParentUI()->GetDriver()->GetGlobalState()->GetDefaultBehaviorSettings();
+  rwi->SetDesiredUpdateRate(dbs->GetVolumeRenderingTargetFrameRate());
+
+  IRISApplication *app = m_Model->GetParentUI()->GetDriver();
+  if(!app->IsMainImageLoaded())
+    return;
+
+  for(LayerIterator li = app->GetCurrentImageData()->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
+      !li.IsAtEnd(); ++li)
+    {
+    VolumeAssembly *va = dynamic_cast<VolumeAssembly *>(li.GetLayer()->GetUserData("volume"));
+    if(va)
+      this->UpdateVolumeLevelOfDetail(li.GetLayer(), va);
+    }
+}
+
 void Generic3DRenderer::UpdateVolumeTransform(ImageWrapperBase *layer, VolumeAssembly *va)
 {
   auto *sw = layer->GetDefaultScalarRepresentation();
@@ -802,10 +1150,8 @@ void Generic3DRenderer::UpdateVolumeTransform(ImageWrapperBase *layer, VolumeAss
   tran->DeepCopy(vtk2nii.data_block());
   va->Volume->SetUserMatrix(tran);
 
-  // Update the timestamp
-  va->TransformUpdateTime = sw->GetMTime();
-  if(sw->GetITKTransform())
-    va->TransformUpdateTime = std::max(va->TransformUpdateTime, sw->GetITKTransform()->GetMTime());
+  // Record the geometry the transform was computed from
+  va->TransformGeometryVersion = sw->GetGeometryVersion();
 }
 
 
@@ -844,8 +1190,7 @@ void Generic3DRenderer::UpdateVolumeRendering()
       {
       va = VolumeAssembly::New();
       va->ImportPipeline = layer->GetDefaultScalarRepresentation()->CreateVTKImporterPipeline();
-      va->Mapper = vtkSmartPointer<vtkSmartVolumeMapper>::New();
-      va->Mapper->SetInputConnection(va->ImportPipeline.importer->GetOutputPort());
+      va->Mapper = vtkSmartPointer<vtkMultiBlockVolumeMapper>::New();
 
       va->ColorCurve = vtkSmartPointer<vtkColorTransferFunction>::New();
       va->OpacityCurve = vtkSmartPointer<vtkPiecewiseFunction>::New();
@@ -875,7 +1220,8 @@ void Generic3DRenderer::UpdateVolumeRendering()
       this->m_Renderer->AddViewProp(va->Volume);
       layer->SetUserData("volume", va);
 
-      va->ImportPipeline.importer->Update();
+      // Compute the bricks and upload the non-empty ones
+      this->UpdateVolumeBricks(layer, va);
 
       // Update the volume transform
       this->UpdateVolumeTransform(layer, va);
@@ -888,11 +1234,18 @@ void Generic3DRenderer::UpdateVolumeRendering()
          sw->GetColorMap()->GetMTime() > va->CurveUpdateTime)
         {
         UpdateVolumeCurves(layer, va);
+        UpdateVolumeBrickVisibility(va);
+        }
+
+      // Check if the image data has changed, requiring bricks to be recomputed
+      unsigned int tp = sw->GetTimePointIndex();
+      if(tp != va->BrickTimePoint || sw->GetVoxelDataVersion(tp) != va->BrickVoxelDataVersion)
+        {
+        UpdateVolumeBricks(layer, va);
         }
 
       // Check if the transform needs updating
-      if((sw->GetImageBase()->GetMTime() > va->TransformUpdateTime) ||
-         (sw->GetITKTransform() && sw->GetITKTransform()->GetMTime() > va->TransformUpdateTime))
+      if(sw->GetGeometryVersion() != va->TransformGeometryVersion)
         {
         UpdateVolumeTransform(layer, va);
         }
@@ -922,6 +1275,7 @@ void Generic3DRenderer::OnUpdate()
 
   // Define a bunch of local flags to make this code easier to read
   bool main_changed = m_EventBucket->HasEvent(MainImageDimensionsChangeEvent());
+  bool pose_changed = m_EventBucket->HasEvent(MainImagePoseChangeEvent());
   bool labels_props_changed = m_EventBucket->HasEvent(SegmentationLabelChangeEvent());
   bool cursor_moved = m_EventBucket->HasEvent(CursorUpdateEvent());
   bool active_label_changed = m_EventBucket->HasEvent(
@@ -1003,7 +1357,7 @@ void Generic3DRenderer::OnUpdate()
     }
 
   // Deal with axes
-  if(main_changed || cursor_moved)
+  if(main_changed || pose_changed || cursor_moved)
     {
     UpdateAxisRendering();
     need_render = true;
@@ -1022,14 +1376,14 @@ void Generic3DRenderer::OnUpdate()
     DeleteSavedCameraState();
     need_render = true;
     }
-  else if(cursor_moved)
+  else if(cursor_moved || pose_changed)
     {
     UpdateCamera(false);
     need_render = true;
     }
 
   // Deal with the spray paint appearance and shape
-  if(main_changed || labels_props_changed || active_label_changed)
+  if(main_changed || pose_changed || labels_props_changed || active_label_changed)
     {
     UpdateSprayGlyphAppearanceAndShape();
     UpdateScalpelPlaneAppearance();
@@ -1066,6 +1420,11 @@ void Generic3DRenderer::OnUpdate()
     UpdateColorLegendAppearance();
     }
 
+  // The color legend follows the label colors and the layer color maps,
+  // which are not part of the scene
+  if(color_bar_visiblity_changed || labels_props_changed || layer_mapping_changed)
+    this->InvalidateRender();
+
   // Force rendering to occur
   if (need_render)
     this->GetRenderWindow()->Render();
@@ -16,7 +16,7 @@ class vtkPropAssembly;
 class vtkProperty;
 class vtkTransform;
 class vtkImplicitPlaneWidget;
-class vtkGlyph3D;
+class vtkGlyph3DMapper;
 class vtkTransformPolyDataFilter;
 class vtkCubeSource;
 class vtkCoordinate;
@@ -140,12 +140,18 @@ protected:
   unsigned long m_CrntActorMapLayerId = 0;
   unsigned int m_CrntActorMapTimePoint = 0;
 
+  // Whether the label meshes are drawn through the merged actor of the pool
+  bool m_UseMergedActor = false;
+
+  // Number of label meshes from which on they are drawn as a single batch
+  static constexpr unsigned int MERGED_ACTOR_MIN_LABELS = 16;
+
   // Line sources for drawing the crosshairs
   vtkSmartPointer<vtkLineSource> m_AxisLineSource[3];
   vtkSmartPointer<vtkActor> m_AxisActor[3];
 
-  // Glyph filter used to render spray paint stuff
-  vtkSmartPointer<vtkGlyph3D> m_SprayGlyphFilter;
+  // Instanced glyph mapper used to render spray paint stuff
+  vtkSmartPointer<vtkGlyph3DMapper> m_SprayGlyphMapper;
 
   // The property controlling the spray paint
   vtkSmartPointer<vtkProperty> m_SprayProperty;
@@ -177,6 +183,23 @@ protected:
 
   void UpdateVolumeCurves(ImageWrapperBase *layer, VolumeAssembly *va);
   void UpdateVolumeTransform(ImageWrapperBase *layer, VolumeAssembly *va);
+  void UpdateVolumeBricks(ImageWrapperBase *layer, VolumeAssembly *va);
+  void UpdateVolumeBrickVisibility(VolumeAssembly *va);
+  void UpdateVolumeLevelOfDetail(ImageWrapperBase *layer, VolumeAssembly *va);
+
+  // Called before each render of the window. While the camera is moved, the
+  // interactor asks for renders at its desired update rate, and the volumes
+  // are switched to a coarser level of the image pyramid and sampled more
+  // sparsely, and the heavy meshes are replaced by their previews. The render
+  // that follows the release of the mouse button is done at the still update
+  // rate and restores full quality.
+  void OnRenderWindowStartRender();
+
+  // Whether the volumes are rendered at the interactive level of detail, and
+  // how long the last full quality render took
+  bool m_VolumeInteractive = false;
+  double m_VolumeStillRenderTime = 0.0;
+  unsigned long m_StartRenderTag = 0;
 
   ImageMeshLayers *m_MeshLayers;
 };
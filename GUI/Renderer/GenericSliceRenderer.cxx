@@ -38,10 +38,21 @@
 #include "LayerAssociation.h"
 #include "SliceWindowCoordinator.h"
 #include "PaintbrushSettingsModel.h"
+#include "DisplayMappingPolicy.h"
+#include "IntensityCurveInterface.h"
+#include "ColorMap.h"
 #include <itkImageLinearConstIteratorWithIndex.h>
 
 
 #include <vtkTexture.h>
+#include <vtkImageData.h>
+#include <vtkImageImport.h>
+#include <vtkImageBlend.h>
+#include <vtkExtractVOI.h>
+#include <vtkInformation.h>
+#include <vtkStreamingDemandDrivenPipeline.h>
+#include <vtkShaderProperty.h>
+#include <vtkUniforms.h>
 #include <vtkTexturedActor2D.h>
 #include <vtkRenderer.h>
 #include <vtkActor2D.h>
@@ -285,6 +296,12 @@ GenericSliceRenderer::SetModel(GenericSliceModel *model)
 
 	Rebroadcast(m_Model->GetParentUI()->GetGlobalDisplaySettings()->GetGreyInterpolationModeModel(),
 							ValueChangedEvent(), ModelUpdateEvent());
+
+  Rebroadcast(m_Model->GetParentUI()->GetGlobalDisplaySettings()->GetFlagGPUColorMappingModel(),
+              ValueChangedEvent(), ModelUpdateEvent());
+
+  Rebroadcast(m_Model->GetParentUI()->GetGlobalDisplaySettings()->GetFlagCPUCompositingModel(),
+              ValueChangedEvent(), ModelUpdateEvent());
 }
 
 void GenericSliceRenderer::UpdateSceneAppearanceSettings()
@@ -354,17 +371,43 @@ void GenericSliceRenderer::OnUpdate()
       m_EventBucket->HasEvent(ValueChangedEvent(),
                               m_Model->GetDriver()->GetGlobalState()->GetSelectedSegmentationLayerIdModel());
 
+  // Switching GPU color mapping on or off requires new layer assemblies
+  bool gpu_color_mapping_changed =
+      m_EventBucket->HasEvent(ValueChangedEvent(),
+                              m_Model->GetParentUI()->GetGlobalDisplaySettings()->GetFlagGPUColorMappingModel());
+
+  // Switching CPU compositing on or off changes the actors in each viewport
+  bool cpu_compositing_changed =
+      m_EventBucket->HasEvent(ValueChangedEvent(),
+                              m_Model->GetParentUI()->GetGlobalDisplaySettings()->GetFlagCPUCompositingModel());
+
+  if(gpu_color_mapping_changed)
+    {
+    for(LayerIterator it = m_Model->GetImageData()->GetLayers(); !it.IsAtEnd(); ++it)
+      it.GetLayer()->SetUserData(m_KeyLayerTextureAssembly, nullptr);
+    layers_changed = true;
+    }
+
   if(layers_changed)
     {
     this->UpdateLayerAssemblies();
     }
 
-  if(layers_changed || layer_layout_changed || selected_layer_changed || selected_segmentation_changed)
+  // Zooming may switch a layer to another level of its pyramid, whose
+  // display slices are smaller than those of the other layers
+  bool cpu_compositing_outdated = false;
+  if(!(layers_changed || layer_layout_changed || selected_layer_changed || selected_segmentation_changed
+       || cpu_compositing_changed))
+    cpu_compositing_outdated = this->IsCPUCompositingOutdated();
+
+  if(layers_changed || layer_layout_changed || selected_layer_changed || selected_segmentation_changed
+     || cpu_compositing_changed || cpu_compositing_outdated)
     {
     this->UpdateRendererLayout();
     }
 
-	if(layers_changed || layer_mapping_changed || segmentation_opacity_changed || layer_visibility_changed || display_setting_changed)
+	if(layers_changed || layer_mapping_changed || segmentation_opacity_changed || layer_visibility_changed || display_setting_changed
+     || cpu_compositing_changed || cpu_compositing_outdated)
     {
     this->UpdateLayerApperances();
     }
@@ -374,7 +417,8 @@ void GenericSliceRenderer::OnUpdate()
     this->UpdateSceneAppearanceSettings();
     }
 
-  if(layers_changed || layer_layout_changed || zoom_pan_changed || layer_mapping_changed || layer_visibility_changed || appearance_settings_changed)
+  if(layers_changed || layer_layout_changed || zoom_pan_changed || layer_mapping_changed || layer_visibility_changed || appearance_settings_changed
+     || cpu_compositing_changed || cpu_compositing_outdated)
     {
     this->UpdateRendererCameras();
     this->UpdateZoomPanThumbnail();
@@ -427,17 +471,29 @@ void GenericSliceRenderer::UpdateLayerAssemblies()
       lta->m_Importer = vtkSmartPointer<vtkImageImport>::New();
       ConnectITKExporterToVTKImporter(exporter.GetPointer(), lta->m_Importer);
 
-      lta->m_Texture = vtkSmartPointer<vtkTexture>::New();
-      lta->m_Texture->SetInputConnection(lta->m_Importer->GetOutputPort());
-
       // Get the corners of the slice
       auto sc = m_Model->GetSliceCorners();
       auto c0 = sc.first, c1 = sc.second;
 
-      // Create a polydata for the image
+      // Create a polydata for the image, which crops the texture to the
+      // tiles in view
       lta->m_ImageRect = vtkSmartPointer<TexturedRectangleAssembly>::New();
       lta->m_ImageRect->SetCorners(c0[0], c0[1], c1[0], c1[1]);
+
+      lta->m_Texture = vtkSmartPointer<vtkTexture>::New();
+      lta->m_Texture->SetInputConnection(
+            lta->m_ImageRect->AddTiledInput(lta->m_Importer->GetOutputPort()));
       lta->m_ImageRect->GetActor()->SetTexture(lta->m_Texture);
+
+      // The thumbnail pipeline only executes if the layer is the main layer
+      lta->m_ThumbnailExtract = vtkSmartPointer<vtkExtractVOI>::New();
+      lta->m_ThumbnailExtract->SetInputConnection(lta->m_Importer->GetOutputPort());
+      lta->m_ThumbnailTexture = vtkSmartPointer<vtkTexture>::New();
+      lta->m_ThumbnailTexture->SetInputConnection(lta->m_ThumbnailExtract->GetOutputPort());
+
+      // Apply the intensity curve and color map on the GPU if requested
+      if(m_Model->GetParentUI()->GetGlobalDisplaySettings()->GetFlagGPUColorMapping())
+        this->SetupGPUColorMapping(layer, lta);
       }
     }
 
@@ -490,9 +546,9 @@ void GenericSliceRenderer::UpdateLayerAssemblies()
   // Update the appearance settings
   this->UpdateSceneAppearanceSettings();
 
-  // Assign the main image texture to the zoom thumbnail
-  m_ZoomThumbnail->GetActor()->SetTexture(
-        id->IsMainLoaded() ? GetLayerTextureAssembly(id->GetMain())->m_Texture : nullptr);
+  // The texture of the zoom thumbnail is assigned in UpdateZoomPanThumbnail()
+  if(!id->IsMainLoaded())
+    m_ZoomThumbnail->GetActor()->SetTexture(nullptr);
 }
 
 GenericSliceRenderer::LayerTextureAssembly *
@@ -553,6 +609,29 @@ void GenericSliceRenderer::UpdateZoomPanThumbnail()
     auto size = m_Model->GetZoomThumbnailSize();
 
     m_ZoomThumbnail->SetCorners(pos[0], pos[1], pos[0]+size[0], pos[1]+size[1]);
+
+    // The thumbnail is small, so a very large slice is subsampled to fit in
+    // a single tile
+    auto *lta = GetLayerTextureAssembly(m_Model->GetDriver()->GetCurrentImageData()->GetMain());
+    if(lta && !lta->m_GPUColorMapping && lta->m_ImageRect->IsWholeImageInTexture())
+      {
+      // The whole slice is already in the texture of the layer, which is the
+      // same image that the thumbnail pipeline would produce, so the
+      // thumbnail draws it rather than uploading a copy
+      m_ZoomThumbnail->GetActor()->SetTexture(lta->m_Texture);
+      }
+    else if(lta && lta->m_ThumbnailExtract)
+      {
+      lta->m_ThumbnailExtract->UpdateInformation();
+      int ext[6];
+      lta->m_ThumbnailExtract->GetInputInformation(0, 0)->Get(
+            vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), ext);
+      int rate = TexturedRectangleAssembly::ComputeSampleRate(
+            ext[1] - ext[0] + 1, ext[3] - ext[2] + 1, TexturedRectangleAssembly::TILE_SIZE);
+      lta->m_ThumbnailExtract->SetVOI(ext);
+      lta->m_ThumbnailExtract->SetSampleRate(rate, rate, 1);
+      m_ZoomThumbnail->GetActor()->SetTexture(lta->m_ThumbnailTexture);
+      }
     m_ZoomThumbnail->GetActor()->SetVisibility(
           m_Model->IsThumbnailOn() &&
           m_Model->GetParentUI()->GetAppearanceSettings()->GetOverallVisibility());
@@ -600,14 +679,22 @@ void GenericSliceRenderer::UpdateRendererLayout()
   // Create a sorted structure of layers that are rendered on top of the base
   std::map<double, vtkActor *> depth_map;
   std::map<double, BaseLayerAssembly *> depth_map_bla;
+  std::map<double, std::pair<ImageWrapperBase *, LayerRole> > depth_map_layers;
   for(LayerIterator it = m_Model->GetImageData()->GetLayers(); !it.IsAtEnd(); ++it)
     {
+    // Layers are only composited in the viewports set up below
+    auto *bla = GetBaseLayerAssembly(it.GetLayer());
+    if(bla)
+      {
+      bla->m_CompositedLayers.clear();
+      bla->m_CompositingCandidates.clear();
+      }
+
     // Don't display segmentation layer if it is not the selected one
     if(it.GetRole() == LABEL_ROLE && it.GetLayer()->GetUniqueId() != ssid)
       continue;
 
     auto *lta = GetLayerTextureAssembly(it.GetLayer());
-    auto *bla = GetBaseLayerAssembly(it.GetLayer());
     if(lta)
       {
       auto *actor = lta->m_ImageRect->GetActor();
@@ -615,6 +702,7 @@ void GenericSliceRenderer::UpdateRendererLayout()
       if(z > 0.0)
         {
         depth_map[z] = actor;
+        depth_map_layers[z] = std::make_pair(it.GetLayer(), it.GetRole());
         if (bla)
           {
           depth_map_bla[z] = bla;
@@ -633,6 +721,10 @@ void GenericSliceRenderer::UpdateRendererLayout()
   // Get the dimensions of the render window
   Vector2ui szWin = m_Model->GetSizeReporter()->GetViewportSize();
 
+  // Whether to blend the layers on the CPU
+  bool cpu_compositing =
+      m_Model->GetParentUI()->GetGlobalDisplaySettings()->GetFlagCPUCompositing();
+
   // Draw each viewport in turn. For now, the number of z-layers is hard-coded at 2
   for(unsigned int k = 0; k < vpl.vpList.size(); k++)
     {
@@ -664,20 +756,36 @@ void GenericSliceRenderer::UpdateRendererLayout()
     // Set up the actors shown in this renderer
     renderer->RemoveAllViewProps();
 
-    // Add the base layer actor
-    renderer->AddActor(GetLayerTextureAssembly(layer)->m_ImageRect->GetActor());
-
     // Some stuff only gets added to the main renderer
     if(vp.isThumbnail)
       {
-      // Add the thumbnail highlight
+      // Add the base layer actor and the thumbnail highlight
+      renderer->AddActor(GetLayerTextureAssembly(layer)->m_ImageRect->GetActor());
       renderer->AddActor(bla->m_ThumbnailDecoratorActor);
       }
     else
       {
-      // Add the overlay layer actors
-      for(auto it : depth_map)
-        renderer->AddActor(it.second);
+      // The base layer and the layers on top of it, bottom to top
+      std::vector<std::pair<ImageWrapperBase *, LayerRole> > layers;
+      if(cpu_compositing)
+        {
+        layers.push_back(std::make_pair(layer, MAIN_ROLE));
+        for(auto it : depth_map_layers)
+          layers.push_back(it.second);
+        }
+
+      if(cpu_compositing && this->SetupCPUCompositing(bla, layers))
+        {
+        // A single actor draws all the layers
+        renderer->AddActor(bla->m_CompositeRect->GetActor());
+        }
+      else
+        {
+        // Add the base layer actor and the overlay layer actors
+        renderer->AddActor(GetLayerTextureAssembly(layer)->m_ImageRect->GetActor());
+        for(auto it : depth_map)
+          renderer->AddActor(it.second);
+        }
 
       for(auto kv : depth_map_bla)
         {
@@ -753,42 +861,269 @@ void GenericSliceRenderer::UpdateRendererCameras()
         // Map the corners of the slice into the viewport coordinates
         auto sc = m_Model->GetSliceCornersInWindowCoordinates();
         lta->m_ImageRect->SetCorners(sc.first[0], sc.first[1], sc.second[0], sc.second[1]);
+        lta->m_ImageRect->SetVisibleRegion(0, 0, sz[0], sz[1]);
         }
       else
         {
-        // Nonorthogonal slicing means we render into the whole viewport
+        // Nonorthogonal slicing means we render into the whole viewport,
+        // and the slice is sampled at the resolution of the viewport
         lta->m_ImageRect->SetCorners(0, 0, sz[0], sz[1]);
+        lta->m_ImageRect->SetVisibleRegion(0, 0, sz[0], sz[1]);
         }
       }
+
+    // Composited layers are all sliced orthogonally
+    if(bla && bla->m_CompositeRect)
+      {
+      auto sz = m_Model->GetViewportLayout().vpList.front().size;
+      auto sc = m_Model->GetSliceCornersInWindowCoordinates();
+      bla->m_CompositeRect->SetCorners(sc.first[0], sc.first[1], sc.second[0], sc.second[1]);
+      bla->m_CompositeRect->SetVisibleRegion(0, 0, sz[0], sz[1]);
+      }
     }
 }
 
+double GenericSliceRenderer::GetLayerOpacity(ImageWrapperBase *layer, LayerRole role)
+{
+  // Does this layer use transparency?
+  if(role == LABEL_ROLE)
+    return m_Model->GetDriver()->GetGlobalState()->GetSegmentationAlpha();
+  else if(layer->IsSticky())
+    return layer->GetAlpha();
+  return 1.0;
+}
+
 void GenericSliceRenderer::UpdateLayerApperances()
 {
   // Iterate over the layers
   for(LayerIterator it = m_Model->GetImageData()->GetLayers(); !it.IsAtEnd(); ++it)
     {
-    // Does this layer use transparency?
-    double alpha = 1.0;
-    if(it.GetRole() == LABEL_ROLE)
-      alpha = m_Model->GetDriver()->GetGlobalState()->GetSegmentationAlpha();
-    else if(it.GetLayer()->IsSticky())
-      alpha = it.GetLayer()->GetAlpha();
+    double alpha = this->GetLayerOpacity(it.GetLayer(), it.GetRole());
 
     auto *lta = GetLayerTextureAssembly(it.GetLayer());
     if(lta)
 			{
 			// Configure the texture interpolation
 			const GlobalDisplaySettings *gds = m_Model->GetParentUI()->GetGlobalDisplaySettings();
-			if (gds->GetGreyInterpolationMode() == GlobalDisplaySettings::LINEAR)
-				lta->m_Texture->InterpolateOn();
-			else
-				lta->m_Texture->InterpolateOff();
+			bool linear = (gds->GetGreyInterpolationMode() == GlobalDisplaySettings::LINEAR);
+			lta->m_Texture->SetInterpolate(linear);
+
+			// Refresh the lookup table used by the shader
+			if (lta->m_GPUColorMapping)
+				{
+				lta->m_IntensityTexture->SetInterpolate(linear);
+				this->UpdateGPUColorMapping(it.GetLayer(), lta);
+				}
 
 			// Set the alpha for the actor
 			lta->m_ImageRect->GetActor()->GetProperty()->SetOpacity(alpha);
 			}
+
+    auto *bla = GetBaseLayerAssembly(it.GetLayer());
+    if(bla && bla->m_CompositedLayers.size())
+      this->UpdateCPUCompositing(bla);
+    }
+}
+
+bool GenericSliceRenderer::SetupCPUCompositing(
+    BaseLayerAssembly *bla,
+    const std::vector<std::pair<ImageWrapperBase *, LayerRole> > &layers)
+{
+  bla->m_CompositedLayers.clear();
+  bla->m_CompositingCandidates = layers;
+
+  if(!this->AreDisplaySlicesOnSameGrid(layers))
+    return false;
+
+  if(!bla->m_Blend)
+    {
+    bla->m_Blend = vtkSmartPointer<vtkImageBlend>::New();
+    bla->m_CompositeRect = vtkSmartPointer<TexturedRectangleAssembly>::New();
+    bla->m_CompositeTexture = vtkSmartPointer<vtkTexture>::New();
+    bla->m_CompositeTexture->SetInputConnection(
+          bla->m_CompositeRect->AddTiledInput(bla->m_Blend->GetOutputPort()));
+    bla->m_CompositeRect->GetActor()->SetTexture(bla->m_CompositeTexture);
+
+    auto sc = m_Model->GetSliceCornersInWindowCoordinates();
+    bla->m_CompositeRect->SetCorners(sc.first[0], sc.first[1], sc.second[0], sc.second[1]);
+    }
+
+  // Blend the display slices in the drawing order. The blend filter is
+  // multithreaded over the slice and only reruns when one of the slices or
+  // opacities changes.
+  bla->m_Blend->RemoveAllInputs();
+  for(auto &l : layers)
+    bla->m_Blend->AddInputConnection(GetLayerTextureAssembly(l.first)->m_Importer->GetOutputPort());
+
+  bla->m_CompositedLayers = layers;
+  this->UpdateCPUCompositing(bla);
+  return true;
+}
+
+bool GenericSliceRenderer::AreDisplaySlicesOnSameGrid(
+    const std::vector<std::pair<ImageWrapperBase *, LayerRole> > &layers)
+{
+  // The slices of non-orthogonally sliced layers are on the viewport grid,
+  // and those of orthogonally sliced layers on the image grid, or on the grid
+  // of a pyramid level when a large layer is zoomed out. vtkImageBlend
+  // blends by voxel index, so the slices must all have the same size.
+  itk::Size<2> size;
+  for(unsigned int i = 0; i < layers.size(); i++)
+    {
+    ImageWrapperBase *layer = layers[i].first;
+    if(!layer->IsSlicingOrthogonal() || !GetLayerTextureAssembly(layer))
+      return false;
+
+    auto *ds = layer->GetDisplaySlice(m_Model->GetId()).GetPointer();
+    ds->UpdateOutputInformation();
+    if(i == 0)
+      size = ds->GetLargestPossibleRegion().GetSize();
+    else if(size != ds->GetLargestPossibleRegion().GetSize())
+      return false;
+    }
+
+  return true;
+}
+
+bool GenericSliceRenderer::IsCPUCompositingOutdated()
+{
+  if(!m_Model->GetParentUI()->GetGlobalDisplaySettings()->GetFlagCPUCompositing())
+    return false;
+
+  for(LayerIterator it = m_Model->GetImageData()->GetLayers(); !it.IsAtEnd(); ++it)
+    {
+    auto *bla = GetBaseLayerAssembly(it.GetLayer());
+    if(bla && bla->m_CompositingCandidates.size()
+       && this->AreDisplaySlicesOnSameGrid(bla->m_CompositingCandidates)
+          != (bla->m_CompositedLayers.size() > 0))
+      return true;
+    }
+
+  return false;
+}
+
+void GenericSliceRenderer::UpdateCPUCompositing(BaseLayerAssembly *bla)
+{
+  for(unsigned int i = 0; i < bla->m_CompositedLayers.size(); i++)
+    {
+    auto &l = bla->m_CompositedLayers[i];
+    bla->m_Blend->SetOpacity(i, this->GetLayerOpacity(l.first, l.second));
+    }
+
+  const GlobalDisplaySettings *gds = m_Model->GetParentUI()->GetGlobalDisplaySettings();
+  bla->m_CompositeTexture->SetInterpolate(gds->GetGreyInterpolationMode() == GlobalDisplaySettings::LINEAR);
+}
+
+void GenericSliceRenderer::SetupGPUColorMapping(ImageWrapperBase *layer, LayerTextureAssembly *lta)
+{
+  // Only curve and color map based display mappings can be applied on the GPU
+  auto *policy = dynamic_cast<AbstractCachingAndColorMapDisplayMappingPolicy *>(
+                   layer->GetDisplayMapping());
+  if(!policy)
+    return;
+
+  // Get the native intensity slice, cast to float
+  auto *slice = layer->CreateCastToFloatSlicePipeline("GPUColorMapping", m_Model->GetId());
+  if(!slice)
+    return;
+
+  // Configure the texture pipeline for the intensity slice. The scalars are
+  // uploaded as they are, without mapping them through a VTK lookup table
+  SmartPtr<LayerTextureAssembly::FloatVTKExporter> exporter = LayerTextureAssembly::FloatVTKExporter::New();
+  exporter->SetInput(slice);
+
+  lta->m_IntensityExporter = exporter.GetPointer();
+  lta->m_IntensityImporter = vtkSmartPointer<vtkImageImport>::New();
+  ConnectITKExporterToVTKImporter(exporter.GetPointer(), lta->m_IntensityImporter);
+
+  lta->m_IntensityTexture = vtkSmartPointer<vtkTexture>::New();
+  lta->m_IntensityTexture->SetInputConnection(
+        lta->m_ImageRect->AddTiledInput(lta->m_IntensityImporter->GetOutputPort()));
+  lta->m_IntensityTexture->SetColorModeToDirectScalars();
+
+  // The lookup table combining the intensity curve and the color map
+  lta->m_LUTImage = vtkSmartPointer<vtkImageData>::New();
+  lta->m_LUTImage->SetDimensions(GPU_LUT_SIZE, 1, 1);
+  lta->m_LUTImage->AllocateScalars(VTK_UNSIGNED_CHAR, 4);
+
+  lta->m_LUTTexture = vtkSmartPointer<vtkTexture>::New();
+  lta->m_LUTTexture->SetInputData(lta->m_LUTImage);
+  lta->m_LUTTexture->SetColorModeToDirectScalars();
+  lta->m_LUTTexture->InterpolateOn();
+  lta->m_LUTTexture->RepeatOff();
+  lta->m_LUTTexture->EdgeClampOn();
+
+  // The actor samples both textures and does the mapping in the shader. The
+  // CPU-mapped texture is still used by the zoom thumbnail.
+  vtkActor *actor = lta->m_ImageRect->GetActor();
+  actor->SetTexture(nullptr);
+  actor->GetProperty()->SetTexture("intensityTex", lta->m_IntensityTexture);
+  actor->GetProperty()->SetTexture("colorLUT", lta->m_LUTTexture);
+  actor->GetShaderProperty()->AddFragmentShaderReplacement(
+        "//VTK::TCoord::Impl", true,
+        "float xNative = texture(intensityTex, tcoordVCVSOutput).r;\n"
+        "vec4 lutColor;\n"
+        "if(isnan(xNative))\n"
+        "  lutColor = colorNaN;\n"
+        "else if(zeroOutOfRange != 0 && xNative == nativeZero)\n"
+        "  lutColor = vec4(0.0);\n"
+        "else\n"
+        "  {\n"
+        "  float u = xNative * lutScale + lutShift;\n"
+        "  if(u < 0.0)\n"
+        "    lutColor = colorBelow;\n"
+        "  else if(u > 1.0)\n"
+        "    lutColor = colorAbove;\n"
+        "  else\n"
+        "    lutColor = texture(colorLUT, vec2(u * lutCoordScale + lutCoordShift, 0.5));\n"
+        "  }\n"
+        "gl_FragData[0] = vec4(lutColor.rgb, lutColor.a * opacity);\n",
+        false);
+
+  lta->m_GPUColorMapping = true;
+}
+
+void GenericSliceRenderer::UpdateGPUColorMapping(ImageWrapperBase *layer, LayerTextureAssembly *lta)
+{
+  auto *policy = dynamic_cast<AbstractCachingAndColorMapDisplayMappingPolicy *>(
+                   layer->GetDisplayMapping());
+  IntensityCurveInterface *curve = policy->GetIntensityCurve();
+  ColorMap *cm = policy->GetColorMap();
+  auto ncm = policy->GetNativeCurveMapping();
+
+  // Sample the curve and the color map over the range of the curve, outside
+  // of which the colors are constant
+  auto [t0, t1] = curve->GetRange();
+  unsigned char *p = static_cast<unsigned char *>(lta->m_LUTImage->GetScalarPointer());
+  for(int k = 0; k < GPU_LUT_SIZE; k++, p += 4)
+    {
+    double t = t0 + (t1 - t0) * k / (GPU_LUT_SIZE - 1.0);
+    auto rgba = DefaultColorMapTraits::apply(cm, curve->Evaluate(t), ncm.IgnoreAlpha);
+    for(int c = 0; c < 4; c++)
+      p[c] = rgba[c];
     }
+  lta->m_LUTImage->Modified();
+
+  DefaultColorMapTraits::DisplayPixelType rgba[3];
+  DefaultColorMapTraits::get_outside_and_nan_values(cm, ncm.IgnoreAlpha, rgba[0], rgba[1], rgba[2]);
+  float colors[3][4];
+  for(int i = 0; i < 3; i++)
+    for(int c = 0; c < 4; c++)
+      colors[i][c] = rgba[i][c] / 255.0f;
+
+  // Map native intensity to the [0 1] range of the lookup table, and from
+  // there to the centers of the first and last texels
+  double dt = (t1 > t0) ? t1 - t0 : 1.0;
+  vtkUniforms *uniforms = lta->m_ImageRect->GetActor()->GetShaderProperty()->GetFragmentCustomUniforms();
+  uniforms->SetUniformf("lutScale", ncm.Scale / dt);
+  uniforms->SetUniformf("lutShift", (ncm.Shift - t0) / dt);
+  uniforms->SetUniformf("lutCoordScale", (GPU_LUT_SIZE - 1.0) / GPU_LUT_SIZE);
+  uniforms->SetUniformf("lutCoordShift", 0.5 / GPU_LUT_SIZE);
+  uniforms->SetUniformf("nativeZero", ncm.NativeZero);
+  uniforms->SetUniformi("zeroOutOfRange", ncm.ZeroOutOfRange ? 1 : 0);
+  uniforms->SetUniform4f("colorBelow", colors[0]);
+  uniforms->SetUniform4f("colorAbove", colors[1]);
+  uniforms->SetUniform4f("colorNaN", colors[2]);
 }
 
 const GenericSliceRenderer::ViewportType *
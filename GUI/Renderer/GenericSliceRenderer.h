@@ -36,6 +36,7 @@
 
 class vtkTexture;
 class vtkImageImport;
+class vtkImageData;
 class vtkActor;
 class vtkActor2D;
 class vtkPolyData;
@@ -46,6 +47,8 @@ class vtkContextActor;
 class vtkContextScene;
 class vtkContextTransform;
 class vtkAbstractContextItem;
+class vtkImageBlend;
+class vtkExtractVOI;
 
 namespace itk {
 template <typename TInputImage> class VTKImageExport;
@@ -169,6 +172,20 @@ protected:
     // Rectangle highlighting the thumbnail
     vtkSmartPointer<vtkContextActor> m_ThumbnailDecoratorActor;
 
+    // When layers are composited on the CPU, the display slices of the base
+    // layer and of the layers drawn on top of it are blended into a single
+    // texture, drawn by a single actor
+    vtkSmartPointer<vtkImageBlend> m_Blend;
+    vtkSmartPointer<vtkTexture> m_CompositeTexture;
+    vtkSmartPointer<TexturedRectangleAssembly> m_CompositeRect;
+
+    // The layers blended into the composite texture, bottom to top
+    std::vector<std::pair<ImageWrapperBase *, LayerRole> > m_CompositedLayers;
+
+    // The layers that would be composited in this tile, whether or not they
+    // are, so that the choice can be revisited when their slices change size
+    std::vector<std::pair<ImageWrapperBase *, LayerRole> > m_CompositingCandidates;
+
   protected:
     BaseLayerAssembly() {}
     virtual ~BaseLayerAssembly() {}
@@ -184,6 +201,7 @@ protected:
     irisITKObjectMacro(GenericSliceRenderer::LayerTextureAssembly, AbstractModel)
 
     typedef itk::VTKImageExport<ImageWrapperBase::DisplaySliceType> VTKExporter;
+    typedef itk::VTKImageExport<ImageWrapperBase::FloatSliceType> FloatVTKExporter;
 
     // Exporter from ITK to VTK
     SmartPtr<itk::Object> m_Exporter;
@@ -191,12 +209,27 @@ protected:
     // Importer from ITK to VTK
     vtkSmartPointer<vtkImageImport> m_Importer;
 
-    // Texture algorithm
+    // Texture algorithm. Only the tiles of the slice that are in view are
+    // uploaded, see TexturedRectangleAssembly::SetVisibleRegion()
     vtkSmartPointer<vtkTexture> m_Texture;
 
     // Actor used to draw the layer
     vtkSmartPointer<TexturedRectangleAssembly> m_ImageRect;
 
+    // The zoom thumbnail shows the whole slice, subsampled to a tile
+    vtkSmartPointer<vtkExtractVOI> m_ThumbnailExtract;
+    vtkSmartPointer<vtkTexture> m_ThumbnailTexture;
+
+    // When the intensity curve and color map are applied on the GPU, the
+    // actor draws the native intensity slice, uploaded as a float texture,
+    // through a small lookup table texture in the fragment shader
+    bool m_GPUColorMapping = false;
+    SmartPtr<itk::Object> m_IntensityExporter;
+    vtkSmartPointer<vtkImageImport> m_IntensityImporter;
+    vtkSmartPointer<vtkTexture> m_IntensityTexture;
+    vtkSmartPointer<vtkImageData> m_LUTImage;
+    vtkSmartPointer<vtkTexture> m_LUTTexture;
+
   protected:
     LayerTextureAssembly() {}
     virtual ~LayerTextureAssembly() {}
@@ -229,9 +262,39 @@ protected:
   // Update the appearance of various props in the scene
   void UpdateLayerApperances();
 
+  // Number of entries in the lookup tables used for GPU color mapping
+  static constexpr int GPU_LUT_SIZE = 1024;
+
+  // Switch a layer's actor to GPU color mapping, if its display mapping allows
+  void SetupGPUColorMapping(ImageWrapperBase *layer, LayerTextureAssembly *lta);
+
+  // Upload the lookup table and shader parameters for GPU color mapping
+  void UpdateGPUColorMapping(ImageWrapperBase *layer, LayerTextureAssembly *lta);
+
   // Update the z-position of various layers
   void UpdateLayerDepth();
 
+  // Opacity with which a layer is drawn over the base layer
+  double GetLayerOpacity(ImageWrapperBase *layer, LayerRole role);
+
+  // Whether the display slices of the layers are sampled on the same grid,
+  // so that they can be blended pixel by pixel
+  bool AreDisplaySlicesOnSameGrid(
+      const std::vector<std::pair<ImageWrapperBase *, LayerRole> > &layers);
+
+  // Whether the layers composited in some tile no longer share a grid, or
+  // the layers of a tile that could not be composited now do
+  bool IsCPUCompositingOutdated();
+
+  // Set up the blending of layers into a single texture for a base layer.
+  // Returns false if the layers can not be composited on the CPU
+  bool SetupCPUCompositing(
+      BaseLayerAssembly *bla,
+      const std::vector<std::pair<ImageWrapperBase *, LayerRole> > &layers);
+
+  // Update the blending opacities and interpolation of a composite texture
+  void UpdateCPUCompositing(BaseLayerAssembly *bla);
+
   // Update the zoom pan thumbnail appearance
   void UpdateZoomPanThumbnail();
 
@@ -0,0 +1,91 @@
+#include "LabelSliceProfileRenderer.h"
+#include "SegmentationStatistics.h"
+#include "ColorLabelTable.h"
+
+#include <vtkChartXY.h>
+#include <vtkPlot.h>
+#include <vtkDoubleArray.h>
+#include <vtkTable.h>
+#include <vtkContextScene.h>
+#include <vtkAxis.h>
+#include <vtkChartLegend.h>
+#include <vtkRenderWindow.h>
+#include <vtkTextProperty.h>
+
+LabelSliceProfileRenderer::LabelSliceProfileRenderer()
+{
+  // Set up the scene for rendering
+  m_Chart = vtkSmartPointer<vtkChartXY>::New();
+  m_Chart->SetShowLegend(true);
+  m_Chart->GetLegend()->SetDragEnabled(false);
+  m_Chart->GetAxis(vtkAxis::BOTTOM)->SetTitle("Slice");
+  m_Chart->GetAxis(vtkAxis::LEFT)->SetTitle("Area (mm2)");
+  m_Chart->GetAxis(vtkAxis::BOTTOM)->GetLabelProperties()->SetFontSize(9);
+  m_Chart->GetAxis(vtkAxis::LEFT)->GetLabelProperties()->SetFontSize(9);
+
+  // Add the chart to the renderer
+  this->GetScene()->AddItem(m_Chart);
+
+  m_PlotTable = vtkSmartPointer<vtkTable>::New();
+
+  // Set the background to white
+  this->SetBackgroundColor(Vector3d(1.0, 1.0, 1.0));
+}
+
+void LabelSliceProfileRenderer::SetRenderWindow(vtkRenderWindow *rwin)
+{
+  Superclass::SetRenderWindow(rwin);
+  rwin->SetMultiSamples(0);
+  rwin->SetLineSmoothing(1);
+  rwin->SetPolygonSmoothing(1);
+}
+
+void LabelSliceProfileRenderer::SetProfile(const SegmentationStatistics &stats,
+                                           const ColorLabelTable &clt)
+{
+  const SegmentationStatistics::SliceProfileMap &profile = stats.GetSliceProfile();
+  double area = stats.GetSliceProfileVoxelArea();
+
+  // The table is rebuilt, with the slice number in the first column and the
+  // area of a label in each of the others
+  m_Chart->ClearPlots();
+  m_PlotTable = vtkSmartPointer<vtkTable>::New();
+
+  size_t nslices = profile.size() ? profile.begin()->second.size() : 0;
+  vtkSmartPointer<vtkDoubleArray> slices = vtkSmartPointer<vtkDoubleArray>::New();
+  slices->SetName("Slice");
+  slices->SetNumberOfValues(nslices);
+  for(size_t i = 0; i < nslices; i++)
+    slices->SetValue(i, i);
+  m_PlotTable->AddColumn(slices);
+
+  vtkIdType col = 1;
+  for(const auto &it : profile)
+    {
+    const ColorLabel &cl = clt.GetColorLabel(it.first);
+    vtkSmartPointer<vtkDoubleArray> values = vtkSmartPointer<vtkDoubleArray>::New();
+    values->SetName(cl.GetLabel());
+    values->SetNumberOfValues(nslices);
+    for(size_t i = 0; i < nslices; i++)
+      values->SetValue(i, it.second[i] * area);
+    m_PlotTable->AddColumn(values);
+
+    vtkPlot *plot = m_Chart->AddPlot(vtkChart::LINE);
+    plot->SetInputData(m_PlotTable, 0, col++);
+    plot->SetColor(cl.GetRGB(0), cl.GetRGB(1), cl.GetRGB(2), 255);
+    plot->SetWidth(1.5);
+    }
+
+  const char *axis_names[] = { "X", "Y", "Z" };
+  int axis = stats.GetSliceProfileAxis();
+  std::string title = std::string("Slice (") + (axis >= 0 ? axis_names[axis] : "") + ")";
+  m_Chart->GetAxis(vtkAxis::BOTTOM)->SetTitle(title.c_str());
+
+  m_Chart->RecalculateBounds();
+  this->InvokeEvent(ModelUpdateEvent());
+}
+
+void LabelSliceProfileRenderer::OnDevicePixelRatioChange(int old_ratio, int new_ratio)
+{
+  this->UpdateChartDevicePixelRatio(m_Chart, old_ratio, new_ratio);
+}
@@ -0,0 +1,37 @@
+#ifndef LABELSLICEPROFILERENDERER_H
+#define LABELSLICEPROFILERENDERER_H
+
+#include "AbstractVTKSceneRenderer.h"
+
+class vtkChartXY;
+class vtkTable;
+class SegmentationStatistics;
+class ColorLabelTable;
+
+/**
+ * Renderer used to plot the area of each label in each slice of a
+ * segmentation, computed by SegmentationStatistics::ComputeSliceProfile(),
+ * with one curve per label in the color of the label
+ */
+class LabelSliceProfileRenderer : public AbstractVTKSceneRenderer
+{
+public:
+  irisITKObjectMacro(LabelSliceProfileRenderer, AbstractVTKSceneRenderer)
+
+  void SetRenderWindow(vtkRenderWindow *rwin) override;
+
+  /** Plot the slice profile held by the statistics, or nothing if it is empty */
+  void SetProfile(const SegmentationStatistics &stats, const ColorLabelTable &clt);
+
+  virtual void OnDevicePixelRatioChange(int old_ratio, int new_ratio) ITK_OVERRIDE;
+
+protected:
+  LabelSliceProfileRenderer();
+  virtual ~LabelSliceProfileRenderer() {}
+
+  // Rendering stuff
+  vtkSmartPointer<vtkChartXY> m_Chart;
+  vtkSmartPointer<vtkTable> m_PlotTable;
+};
+
+#endif // LABELSLICEPROFILERENDERER_H
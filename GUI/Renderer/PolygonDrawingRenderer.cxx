@@ -141,20 +141,29 @@ public:
         }
       }
 
-    // draw the vertices as points
+    // draw the vertices as points, with one call for the selected and one
+    // for the other control vertices
+    auto *aeControl = (state == PolygonDrawingModel::DRAWING_STATE) ? aeDraw : aeEdit;
+    m_ControlPoints[0].clear();
+    m_ControlPoints[1].clear();
     for(it = vx.begin(); it!=vx.end();++it)
       {
       if(it->control)
         {
-        auto *elt = it->selected
-                    ? aeEditSelect
-                    : (state == PolygonDrawingModel::DRAWING_STATE
-                       ? aeDraw
-                       : aeEdit);
+        auto &pts = m_ControlPoints[it->selected ? 1 : 0];
+        pts.push_back((float) it->x);
+        pts.push_back((float) it->y);
+        }
+      }
 
+    for(int k = 0; k < 2; k++)
+      {
+      if(m_ControlPoints[k].size())
+        {
+        auto *elt = k ? aeEditSelect : aeControl;
         painter->GetPen()->SetColorF(elt->GetColor().data_block());
         painter->GetPen()->SetWidth(elt->GetLineThickness() * 2 * vppr);
-        painter->DrawPoint(it->x, it->y);
+        painter->DrawPoints(m_ControlPoints[k].data(), (int) m_ControlPoints[k].size() / 2);
         }
       }
 
@@ -190,6 +199,10 @@ protected:
 
   PolygonDrawingModel *m_PolygonModel;
 
+  // Coordinates of the unselected and selected control vertices, kept
+  // between paints to avoid reallocating them
+  std::vector<float> m_ControlPoints[2];
+
 };
 
 vtkStandardNewMacro(PolygonContextItem);
@@ -36,61 +36,90 @@
 #define __PolygonScanConvert_h_
 
 #include "itkImage.h"
-#include "itkImageRegionIteratorWithIndex.h"
-#include <vtkPolygon.h>
-#include <vtkPoints.h>
-#include <vtkSmartPointer.h>
-#include <vtkContourTriangulator.h>
-
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+/**
+ * Even-odd scan conversion of a closed 2D polygon. The vertices are given in
+ * pixel units, with pixel (i,j) covering [i,i+1) x [j,j+1), and a pixel is
+ * inside the polygon if its center is.
+ *
+ * Rather than testing every pixel against the polygon, the edges crossing
+ * the center of each row are intersected with it, and the pixels between
+ * pairs of crossings are emitted as spans.
+ */
 template<class TImage, class TVertex, class TVertexIterator>
 class PolygonScanConvert
 {
 public:
-  static void RasterizeFilled(TVertexIterator first, unsigned int n, TImage *image)
-  {
-    // Create a vtkPolygol
-    vtkSmartPointer<vtkPolygon> polygon = vtkPolygon::New();
-
 
-    // typedef itk::PolyLineParametricPath<TImage::ImageDimension> InputPolylineType;
-    // typedef typename InputPolylineType::VertexType VertexType;
-    // SmartPtr<InputPolylineType> path = InputPolylineType::New();
-
-    // Get the image region
-    // itk::ImageRegion<2> region = image->GetBufferedRegion();
+  /**
+   * Call fn_span(y, x_begin, x_end) for every run of pixels [x_begin, x_end)
+   * in row y of the region inside the polygon. The spans come in the order
+   * of increasing y and x.
+   */
+  template <class TSpanFunctor>
+  static void RasterizeSpans(TVertexIterator first, unsigned int n,
+                             const itk::ImageRegion<2> &region,
+                             TSpanFunctor fn_span)
+  {
+    if(n < 3)
+      return;
 
-    // Add points to the path
+    std::vector< std::pair<double, double> > vtx;
+    vtx.reserve(n);
     for (unsigned int i = 0; i < n; ++i, ++first)
-      polygon->GetPoints()->InsertNextPoint((*first)[0], (*first)[1], 0.0);
-
-    // Get the raw point data
-    double *point_data =
-        static_cast<double*>(polygon->GetPoints()->GetData()->GetVoidPointer(0));
-    int np = polygon->GetPoints()->GetNumberOfPoints();
+      vtx.push_back(std::make_pair((double) (*first)[0], (double) (*first)[1]));
 
-    // Get the normal and bounds
-    double normal[3];
-    polygon->ComputeNormal(np, point_data, normal);
+    long x_min = region.GetIndex()[0], x_max = x_min + (long) region.GetSize()[0];
+    long y_min = region.GetIndex()[1], y_max = y_min + (long) region.GetSize()[1];
 
-    double bounds[6];
-    polygon->GetPoints()->GetBounds(bounds);
+    // Find where each edge crosses the centers of the rows. An edge covers
+    // the rows whose center is in [y_lo, y_hi), so that each vertex is only
+    // counted once by the two edges that share it.
+    std::vector< std::pair<long, double> > xings;
+    for (unsigned int i = 0; i < n; ++i)
+      {
+      const std::pair<double, double> &a = vtx[i], &b = vtx[(i + 1) % n];
+      if(a.second == b.second)
+        continue;
+
+      double y_lo = std::min(a.second, b.second), y_hi = std::max(a.second, b.second);
+      long r0 = std::max(y_min, (long) std::ceil(y_lo - 0.5));
+      long r1 = std::min(y_max, (long) std::ceil(y_hi - 0.5));
+      double slope = (b.first - a.first) / (b.second - a.second);
+      for(long r = r0; r < r1; r++)
+        xings.push_back(std::make_pair(r, a.first + (r + 0.5 - a.second) * slope));
+      }
 
-    // Go through the image and test each point
-    typedef itk::ImageRegionIteratorWithIndex<TImage> IteratorType;
-    IteratorType it(image, image->GetBufferedRegion());
-    for(; !it.IsAtEnd(); ++it)
+    // Pair up the crossings in each row
+    std::sort(xings.begin(), xings.end());
+    for(size_t k = 0; k + 1 < xings.size(); k += 2)
       {
-      double x[3];
-      x[0] = it.GetIndex()[0] + 0.5;
-      x[1] = it.GetIndex()[1] + 0.5;
-      x[2] = 0.0;
-
-      if(polygon->PointInPolygon(x, np, point_data, bounds, normal) == 1)
-        it.Set(1);
-      else
-        it.Set(0);
+      long r = xings[k].first;
+      long c0 = std::max(x_min, (long) std::ceil(xings[k].second - 0.5));
+      long c1 = std::min(x_max, (long) std::ceil(xings[k+1].second - 0.5));
+      if(c0 < c1)
+        fn_span(r, c0, c1);
       }
   }
+
+  /** Fill the image with 1 inside the polygon and 0 outside */
+  static void RasterizeFilled(TVertexIterator first, unsigned int n, TImage *image)
+  {
+    image->FillBuffer(0);
+    RasterizeSpans(first, n, image->GetBufferedRegion(),
+                   [image](long y, long x_begin, long x_end)
+      {
+      typename TImage::IndexType idx;
+      idx[0] = x_begin; idx[1] = y;
+      typename TImage::PixelType *p =
+          image->GetBufferPointer() + image->ComputeOffset(idx);
+      std::fill(p, p + (x_end - x_begin), 1);
+      });
+  }
 };
 
 
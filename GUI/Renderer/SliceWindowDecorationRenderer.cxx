@@ -10,12 +10,14 @@
 #include "GenericImageData.h"
 #include "GenericSliceContextItem.h"
 #include "TimePointProperties.h"
+#include "SNAPProfiler.h"
 #include <vtkObjectFactory.h>
 #include <vtkContext2D.h>
 #include <vtkTransform2D.h>
 #include <vtkTextProperty.h>
 #include <vtkContextScene.h>
 #include <vtkPen.h>
+#include <iomanip>
 
 
 class GlobalDecorationContextItem : public GenericSliceContextItem
@@ -57,6 +59,8 @@ public:
         nickname += " [Max]";
       else if(mode.SelectedScalarRep == SCALAR_REP_AVERAGE)
         nickname += " [Avg]";
+      else if(mode.SelectedScalarRep == SCALAR_REP_JACOBIAN)
+        nickname += " [Jac]";
       else
         {
         std::ostringstream oss;
@@ -340,6 +344,52 @@ public:
           elt->GetColor(), elt->GetAlpha());
   }
 
+  void DrawProfilerOverlay(vtkContext2D *painter)
+  {
+    // Use the ruler appearance, but draw even if the ruler is hidden
+    auto *as = m_Model->GetParentUI()->GetAppearanceSettings();
+    auto *elt = as->GetUIElement(SNAPAppearanceSettings::RULER);
+
+    Vector2ui vp_pos, vp_size;
+    m_Model->GetNonThumbnailViewport(vp_pos, vp_size);
+    int w = vp_size[0] / GetVPPR(), h = vp_size[1] / GetVPPR();
+
+    // One line per stage and per counter
+    std::list<std::string> lines;
+    for(auto &s : SNAPProfiler::GetTimingStatistics())
+      {
+      std::ostringstream oss;
+      oss << std::fixed << std::setprecision(2) << s.Name << " " << s.Mean
+          << " ms (last " << s.Last << ", max " << s.Max << ")";
+      lines.push_back(oss.str());
+      }
+    for(auto &s : SNAPProfiler::GetCounterStatistics())
+      {
+      std::ostringstream oss;
+      oss << std::fixed << std::setprecision(0) << s.Name << " " << s.Last
+          << std::setprecision(1) << " (mean " << s.Mean << ")";
+      lines.push_back(oss.str());
+      }
+
+    auto *rps = AbstractRenderer::GetPlatformSupport();
+    auto font_info = rps->MakeFont((int) (elt->GetFontSize() * GetVPPR()),
+                                   AbstractRendererPlatformSupport::TYPEWRITER);
+
+    // Stack the lines in the top right corner
+    int margin = elt->GetFontSize() / 3;
+    int line_height = (int) (font_info.pixel_size * 1.34 / GetVPPR());
+    int v_offset = margin;
+    for(auto &line : lines)
+      {
+      this->DrawStringRect(painter, line,
+            0, h - line_height - v_offset, w - margin, line_height, font_info,
+            AbstractRendererPlatformSupport::RIGHT,
+            AbstractRendererPlatformSupport::TOP,
+            elt->GetColor(), elt->GetAlpha());
+      v_offset += line_height;
+      }
+  }
+
   virtual bool Paint(vtkContext2D *painter) override
   {
     // Push an identity transform in logical pixel units
@@ -353,6 +403,9 @@ public:
     DrawNicknames(painter);
     DrawOrientationLabels(painter);
 
+    if(SNAPProfiler::IsEnabled())
+      DrawProfilerOverlay(painter);
+
     painter->PopMatrix();
     return true;
   }
@@ -12,6 +12,11 @@
 #include <vtkTexturedActor2D.h>
 #include <vtkProperty.h>
 #include <vtkProperty2D.h>
+#include <vtkExtractVOI.h>
+#include <vtkInformation.h>
+#include <vtkStreamingDemandDrivenPipeline.h>
+#include <algorithm>
+#include <cmath>
 
 void TexturedRectangleAssemblyBase::SetCorners(double x0, double y0, double x1, double y1)
 {
@@ -60,6 +65,85 @@ TexturedRectangleAssembly::TexturedRectangleAssembly()
   m_Actor->GetProperty()->SetColor(1.0, 1.0, 1.0);
 }
 
+void TexturedRectangleAssembly::SetCorners(double x0, double y0, double x1, double y1)
+{
+  m_Corners[0] = x0; m_Corners[1] = y0; m_Corners[2] = x1; m_Corners[3] = y1;
+  Superclass::SetCorners(x0, y0, x1, y1);
+}
+
+vtkAlgorithmOutput *TexturedRectangleAssembly::AddTiledInput(vtkAlgorithmOutput *port)
+{
+  vtkNew<vtkExtractVOI> extract;
+  extract->SetInputConnection(port);
+  m_TileExtractors.push_back(extract.GetPointer());
+  return extract->GetOutputPort();
+}
+
+int TexturedRectangleAssembly::ComputeSampleRate(int w, int h, int max_size)
+{
+  int rate = 1;
+  while(w > rate * max_size || h > rate * max_size)
+    rate *= 2;
+  return rate;
+}
+
+// Find the range of pixels [i0, i1) of an axis of n pixels that are visible,
+// aligned to the tiles. Axes that fit in a tile are not cropped.
+static void ComputeVisibleTileRange(double c0, double c1, double v0, double v1,
+                                    int n, int tile, int &i0, int &i1)
+{
+  i0 = 0; i1 = n;
+  if(n <= tile || c0 == c1)
+    return;
+
+  double u0 = (v0 - c0) / (c1 - c0), u1 = (v1 - c0) / (c1 - c0);
+  if(u0 > u1)
+    std::swap(u0, u1);
+
+  i0 = std::max(0, std::min(n - 1, (int) std::floor(u0 * n)));
+  i1 = std::max(i0 + 1, std::min(n, (int) std::ceil(u1 * n)));
+  i0 = (i0 / tile) * tile;
+  i1 = std::min(n, ((i1 + tile - 1) / tile) * tile);
+}
+
+void TexturedRectangleAssembly::SetVisibleRegion(double x0, double y0, double x1, double y1)
+{
+  if(m_TileExtractors.empty())
+    return;
+
+  // Get the extent of the whole image
+  vtkExtractVOI *first = m_TileExtractors.front();
+  first->UpdateInformation();
+  int ext[6];
+  first->GetInputInformation(0, 0)->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), ext);
+  int nx = ext[1] - ext[0] + 1, ny = ext[3] - ext[2] + 1;
+  if(nx <= 0 || ny <= 0)
+    return;
+
+  int i0, i1, j0, j1;
+  ComputeVisibleTileRange(m_Corners[0], m_Corners[2], x0, x1, nx, TILE_SIZE, i0, i1);
+  ComputeVisibleTileRange(m_Corners[1], m_Corners[3], y0, y1, ny, TILE_SIZE, j0, j1);
+
+  // Subsample if the visible tiles do not fit in a texture. The last sample
+  // along each axis then covers a few pixels past the edge of the image.
+  int rate = ComputeSampleRate(i1 - i0, j1 - j0, MAX_TEXTURE_SIZE);
+  int ie = i0 + ((i1 - i0 - 1) / rate + 1) * rate;
+  int je = j0 + ((j1 - j0 - 1) / rate + 1) * rate;
+  m_WholeImageInTexture = (rate == 1 && i0 == 0 && j0 == 0 && i1 == nx && j1 == ny);
+
+  // The filters only execute again if the region or the rate changes
+  for(auto &extract : m_TileExtractors)
+    {
+    extract->SetVOI(ext[0] + i0, ext[0] + i1 - 1, ext[2] + j0, ext[2] + j1 - 1, ext[4], ext[5]);
+    extract->SetSampleRate(rate, rate, 1);
+    }
+
+  // Shrink the rectangle to the extracted pixels
+  double dx = (m_Corners[2] - m_Corners[0]) / nx, dy = (m_Corners[3] - m_Corners[1]) / ny;
+  Superclass::SetCorners(m_Corners[0] + i0 * dx, m_Corners[1] + j0 * dy,
+                         m_Corners[0] + ie * dx, m_Corners[1] + je * dy);
+}
+
 TexturedRectangleAssembly2D::TexturedRectangleAssembly2D()
 {
   // Create the main image actor
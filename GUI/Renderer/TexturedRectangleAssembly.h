@@ -3,8 +3,11 @@
 
 #include <vtkObject.h>
 #include <vtkSmartPointer.h>
+#include <vector>
 
 class vtkActor;
+class vtkAlgorithmOutput;
+class vtkExtractVOI;
 class vtkTexturedActor2D;
 class vtkPolyDataMapper;
 class vtkPolyDataMapper2D;
@@ -31,6 +34,17 @@ protected:
 
 };
 
+/**
+ * @brief A textured rectangle drawn by a 3D actor.
+ *
+ * Images larger than a tile can be connected through AddTiledInput(). Only
+ * the tiles that intersect the region set by SetVisibleRegion() are then
+ * extracted and uploaded, and the rectangle is shrunk to cover them. The
+ * region is aligned to tiles, so that panning within the same tiles does
+ * not upload the texture again. If the visible tiles exceed the maximum
+ * texture size, which happens when a very large slice is zoomed out, the
+ * texture is subsampled.
+ */
 class TexturedRectangleAssembly : public TexturedRectangleAssemblyBase
 {
 public:
@@ -39,12 +53,52 @@ public:
 
   vtkActor *GetActor() const { return m_Actor; }
 
+  /** Size of the tiles, and the largest texture uploaded, in pixels */
+  static constexpr int TILE_SIZE = 1024;
+  static constexpr int MAX_TEXTURE_SIZE = 8192;
+
+  /** Set the corners of the whole image */
+  void SetCorners(double x0, double y0, double x1, double y1);
+
+  /**
+   * Crop an image input to the visible tiles. The returned port should be
+   * connected to the texture. All the inputs added are cropped alike, and
+   * must have the same dimensions.
+   */
+  vtkAlgorithmOutput *AddTiledInput(vtkAlgorithmOutput *port);
+
+  /** Set the region in view, in the coordinates of the corners */
+  void SetVisibleRegion(double x0, double y0, double x1, double y1);
+
+  /**
+   * Whether the texture holds the whole image at full resolution, i.e., the
+   * visible tiles cover the image and it is not subsampled. The texture can
+   * then stand in for any other texture of the same image that is not
+   * subsampled either, e.g., a thumbnail of a small slice.
+   */
+  bool IsWholeImageInTexture() const { return m_WholeImageInTexture; }
+
+  /**
+   * Subsampling rate that brings an image of w by h pixels within the given
+   * size, a power of two
+   */
+  static int ComputeSampleRate(int w, int h, int max_size);
+
 protected:
 
   TexturedRectangleAssembly();
 
   vtkSmartPointer<vtkPolyDataMapper> m_Mapper;
   vtkSmartPointer<vtkActor> m_Actor;
+
+  // Corners of the whole image
+  double m_Corners[4] = { 0.0, 0.0, 100.0, 100.0 };
+
+  // Filters cropping the inputs to the visible tiles
+  std::vector<vtkSmartPointer<vtkExtractVOI> > m_TileExtractors;
+
+  // Set by SetVisibleRegion()
+  bool m_WholeImageInTexture = true;
 };
 
 
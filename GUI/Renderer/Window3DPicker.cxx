@@ -21,12 +21,8 @@ public:
   int operator()(LabelType label) const
   {
     assert(m_LabelTable);
-    if(m_LabelTable->IsColorLabelValid(label))
-      {
-      const ColorLabel &cl = m_LabelTable->GetColorLabel(label);
-      return (cl.IsVisible() && cl.IsVisibleIn3D()) ? 1 : 0;
-      }
-    else return 0;
+    return (m_LabelTable->IsColorLabelValid(label)
+            && m_LabelTable->IsLabelVisibleIn3D(label)) ? 1 : 0;
   }
 
 private:
@@ -4,6 +4,8 @@
 #include <iomanip>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -195,7 +197,7 @@ ColorLabelTable
   m_LabelMap = inputMap;
 
   // Fire the event
-  this->Modified();
+  this->RecordTableChange();
   InvokeEvent(SegmentationLabelConfigurationChangeEvent());
 }
 
@@ -297,7 +299,7 @@ ColorLabelTable
     }
 
   // Fire the event
-  this->Modified();
+  this->RecordTableChange();
   InvokeEvent(SegmentationLabelConfigurationChangeEvent());
 }
 
@@ -344,7 +346,7 @@ ColorLabelTable
   m_LabelMap[0] = this->GetDefaultColorLabel(0);
 
   // Fire the event
-  this->Modified();
+  this->RecordTableChange();
   InvokeEvent(SegmentationLabelConfigurationChangeEvent());
 }
 
@@ -362,7 +364,7 @@ ColorLabelTable
     }
 
   // Fire the event
-  this->Modified();
+  this->RecordTableChange();
   InvokeEvent(SegmentationLabelConfigurationChangeEvent());
 }
 
@@ -379,26 +381,18 @@ ColorLabelTable
     {
     // Label is being validated. If it does not exist, insert the default
     m_LabelMap[id] = this->GetDefaultColorLabel(id);
-    this->Modified();
+    this->RecordLabelChange(id);
     InvokeEvent(SegmentationLabelConfigurationChangeEvent());
     }
   else if (!flag && it != m_LabelMap.end())
     {
     // The label is being invalidated - just delete it
     m_LabelMap.erase(it);
-    this->Modified();
+    this->RecordLabelChange(id);
     InvokeEvent(SegmentationLabelConfigurationChangeEvent());
     }
 }
 
-bool
-ColorLabelTable
-::IsColorLabelValid(LabelType id) const
-{
-  assert(id < MAX_COLOR_LABELS);
-  return (m_LabelMap.find(id) != m_LabelMap.end());
-}
-
 
 size_t 
 ColorLabelTable
@@ -453,19 +447,107 @@ void ColorLabelTable::SetColorLabel(size_t id, const ColorLabel &label)
   if(it == m_LabelMap.end())
     {
     m_LabelMap[id] = label;
-    InvokeEvent(SegmentationLabelConfigurationChangeEvent());    
+    this->RecordLabelChange((LabelType) id);
+    InvokeEvent(SegmentationLabelConfigurationChangeEvent());
     }
   else
     {
     it->second = label;
     it->second.GetTimeStamp().Modified();
+    this->RecordLabelChange((LabelType) id);
     InvokeEvent(SegmentationLabelPropertyChangeEvent());
     }
+}
 
+void ColorLabelTable::RecordTableChange()
+{
+  this->UpdateDenseTable();
+  this->Modified();
+  m_Journal.clear();
+  m_JournalStartTime = this->GetMTime();
+}
 
-
+void ColorLabelTable::RecordLabelChange(LabelType id)
+{
+  this->UpdateDenseEntry(id);
   this->Modified();
- }
+
+  // Drop the older half of the journal when it is full
+  if(m_Journal.size() >= MAX_JOURNAL_SIZE)
+    {
+    size_t n_drop = m_Journal.size() / 2;
+    m_JournalStartTime = m_Journal[n_drop - 1].first;
+    m_Journal.erase(m_Journal.begin(), m_Journal.begin() + n_drop);
+    }
+
+  m_Journal.push_back(std::make_pair(this->GetMTime(), id));
+}
+
+void ColorLabelTable::UpdateDenseEntry(LabelType id)
+{
+  DenseLabelEntry &e = m_DenseTable[id];
+  ValidLabelConstIterator it = m_LabelMap.find(id);
+  if(it != m_LabelMap.end())
+    {
+    it->second.GetRGBAVector(e.rgba);
+    e.flags = LABEL_VALID
+        | (it->second.IsVisible() ? LABEL_VISIBLE : 0)
+        | (it->second.IsVisibleIn3D() ? LABEL_VISIBLE_IN_3D : 0);
+    }
+  else if(id == 0)
+    {
+    ColorLabel deflab = this->GetDefaultColorLabel(0);
+    deflab.GetRGBAVector(e.rgba);
+    e.flags = 0;
+    }
+  else
+    {
+    parse_color(m_ColorList[(id-1) % m_ColorListSize], e.rgba[0], e.rgba[1], e.rgba[2]);
+    e.rgba[3] = 255;
+    e.flags = LABEL_VISIBLE | LABEL_VISIBLE_IN_3D;
+    }
+}
+
+void ColorLabelTable::UpdateDenseTable()
+{
+  m_DenseTable.resize(DISPLAY_COLOR_TABLE_SIZE);
+
+  // Labels that are not valid have the default colors, which cycle through
+  // the color list, and are visible
+  std::vector<DenseLabelEntry> defaults(m_ColorListSize);
+  for(size_t k = 0; k < m_ColorListSize; k++)
+    {
+    DenseLabelEntry &e = defaults[k];
+    parse_color(m_ColorList[k], e.rgba[0], e.rgba[1], e.rgba[2]);
+    e.rgba[3] = 255;
+    e.flags = LABEL_VISIBLE | LABEL_VISIBLE_IN_3D;
+    }
+
+  for(size_t id = 1; id < DISPLAY_COLOR_TABLE_SIZE; id++)
+    m_DenseTable[id] = defaults[(id - 1) % m_ColorListSize];
+
+  // Apply the valid labels
+  this->UpdateDenseEntry(0);
+  for(auto &it : m_LabelMap)
+    this->UpdateDenseEntry(it.first);
+}
+
+bool ColorLabelTable
+::GetLabelsChangedSince(itk::ModifiedTimeType time, std::set<LabelType> &labels) const
+{
+  if(time < m_JournalStartTime)
+    return false;
+
+  // The journal is sorted by time
+  auto it = std::upper_bound(
+        m_Journal.begin(), m_Journal.end(), time,
+        [](itk::ModifiedTimeType t, const std::pair<itk::ModifiedTimeType, LabelType> &e)
+        { return t < e.first; });
+
+  for(; it != m_Journal.end(); ++it)
+    labels.insert(it->second);
+  return true;
+}
 
 const ColorLabel ColorLabelTable::GetColorLabel(size_t id) const
 {
@@ -477,6 +559,20 @@ const ColorLabel ColorLabelTable::GetColorLabel(size_t id) const
     return it->second;
 }
 
+void ColorLabelTable::GetDisplayColorTable(unsigned char *rgba) const
+{
+  for(size_t id = 0; id < DISPLAY_COLOR_TABLE_SIZE; id++)
+    this->GetDisplayColor((LabelType) id, rgba + 4 * id);
+}
+
+void ColorLabelTable::GetDisplayColor(LabelType id, unsigned char *rgba) const
+{
+  // Hidden labels are displayed in the color of the clear label
+  const DenseLabelEntry &e = m_DenseTable[id];
+  const unsigned char *c = (id == 0 || (e.flags & LABEL_VISIBLE)) ? e.rgba : m_DenseTable[0].rgba;
+  std::copy(c, c + 4, rgba);
+}
+
 LabelType ColorLabelTable::GetFirstValidLabel() const
 {
   if(m_LabelMap.size() > 1)
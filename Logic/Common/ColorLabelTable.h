@@ -42,6 +42,8 @@
 #include "SNAPEvents.h"
 #include "itkObjectFactory.h"
 #include "itkTimeStamp.h"
+#include <set>
+#include <vector>
 
 /**
  * \class ColorLabelTable
@@ -102,7 +104,64 @@ public:
   /** Generate a default color label at index i */
   static ColorLabel GetDefaultColorLabel(LabelType id);
 
-  bool IsColorLabelValid(LabelType id) const;
+  /** Number of entries in the display color table, one per label value */
+  static constexpr size_t DISPLAY_COLOR_TABLE_SIZE = 0x10000;
+
+  /**
+   * Fill an array of DISPLAY_COLOR_TABLE_SIZE RGBA colors with the color in
+   * which each label value is displayed. Labels that are not visible are
+   * displayed in the color of the clear label.
+   */
+  void GetDisplayColorTable(unsigned char *rgba) const;
+
+  /** Get the RGBA color in which a single label value is displayed */
+  void GetDisplayColor(LabelType id, unsigned char *rgba) const;
+
+  /**
+   * Get the labels that were added, modified or removed after the given time,
+   * which is compared with the modified time of the table. Returns false if
+   * the changes are not known label by label, i.e., if the whole table was
+   * replaced or reset since then, in which case the caller should rebuild
+   * everything it derives from the table.
+   */
+  bool GetLabelsChangedSince(itk::ModifiedTimeType time, std::set<LabelType> &labels) const;
+
+  bool IsColorLabelValid(LabelType id) const
+    {
+    assert(id < MAX_COLOR_LABELS);
+    return m_DenseTable[id].flags & LABEL_VALID;
+    }
+
+  /**
+   * The properties of a label value, as stored in the dense table. The table
+   * covers the whole range of LabelType and is kept in sync with the map of
+   * valid labels, so that per-voxel code can look up labels in constant time
+   * without copying ColorLabel objects. Labels that are not valid have their
+   * default color and are visible.
+   */
+  struct DenseLabelEntry
+    {
+    unsigned char rgba[4];
+    unsigned char flags;
+    };
+
+  enum DenseLabelFlags {
+    LABEL_VALID = 0x01, LABEL_VISIBLE = 0x02, LABEL_VISIBLE_IN_3D = 0x04 };
+
+  /** Get the entry of a label value in the dense table */
+  const DenseLabelEntry &GetDenseLabelEntry(LabelType id) const
+    { return m_DenseTable[id]; }
+
+  /** Whether a label value is visible, in constant time */
+  bool IsLabelVisible(LabelType id) const
+    { return m_DenseTable[id].flags & LABEL_VISIBLE; }
+
+  /** Whether a label value is visible and visible in 3D, in constant time */
+  bool IsLabelVisibleIn3D(LabelType id) const
+    {
+    const unsigned char mask = LABEL_VISIBLE | LABEL_VISIBLE_IN_3D;
+    return (m_DenseTable[id].flags & mask) == mask;
+    }
 
   /** Sets the color label valid or invalid. During invalidation, the label
    * reverts to default values */
@@ -127,6 +186,27 @@ protected:
   // The main data array
   ValidLabelMap m_LabelMap;
 
+  // Dense table with an entry for every label value
+  std::vector<DenseLabelEntry> m_DenseTable;
+
+  // Recompute the dense table entry of a label, or of all labels
+  void UpdateDenseEntry(LabelType id);
+  void UpdateDenseTable();
+
+  // Journal of the changes to individual labels, in the order in which they
+  // were made, with the modified time of the table after each change. Changes
+  // made before m_JournalStartTime are not in the journal.
+  std::vector<std::pair<itk::ModifiedTimeType, LabelType> > m_Journal;
+  itk::ModifiedTimeType m_JournalStartTime = 0;
+
+  // Maximum number of changes kept in the journal
+  static constexpr size_t MAX_JOURNAL_SIZE = 0x4000;
+
+  // Update the modified time and the journal after a change to the whole
+  // table, or to a single label
+  void RecordTableChange();
+  void RecordLabelChange(LabelType id);
+
   // A flat array of color labels
   // ColorLabel m_Label[MAX_COLOR_LABELS], m_DefaultLabel[MAX_COLOR_LABELS];
 
@@ -253,18 +253,43 @@ ColorMap
       }
     }
 
+  // Count the points up to the start of each search bin
+  m_SearchStart.resize(SEARCH_BINS);
+  size_t k = 0;
+  for(unsigned int b = 0; b < SEARCH_BINS; b++)
+    {
+    double t_bin = b * 1.0 / SEARCH_BINS;
+    while(k < n && m_CMPoints[k].m_Index <= t_bin)
+      k++;
+    m_SearchStart[b] = (unsigned int) k;
+    }
+
   // Update state
   this->Modified();
 }
 
-ColorMap::RGBAType
+size_t
 ColorMap
-::MapIndexToRGBA(double j) const
+::GetSearchStart(double j) const
+{
+  if(!(j >= 0.0) || m_SearchStart.empty())
+    return 0;
+
+  // Use the bin before the one containing j, so that rounding in the bin
+  // computation can not place j before the start of the bin. The search
+  // must also be able to reach the special case of the last point below
+  double x = j * SEARCH_BINS;
+  size_t b = x >= SEARCH_BINS ? SEARCH_BINS - 1 : (size_t) x;
+  size_t lb = m_SearchStart[b > 0 ? b - 1 : 0];
+  return std::min(lb, m_CMPoints.size() - 1);
+}
+
+size_t
+ColorMap
+::FindInterpolant(double j, size_t lb) const
 {
-  // We use simple linear search because most colormaps
-  // are tiny and the overhead of binary search is not worth it
-  size_t n = m_CMPoints.size(), lb;
-  for(lb = 0; lb < n; lb++)
+  size_t n = m_CMPoints.size();
+  for(; lb < n; lb++)
     {
     double t = m_CMPoints[lb].m_Index;
 
@@ -277,11 +302,13 @@ ColorMap
     if(j < t || (lb == (n-1) && j == t))
       break;
     }
+  return lb;
+}
 
-  // Get the interpolants
-  const InterpolantData &ic = m_Interpolants[lb];
-
-  // Compute the output value
+ColorMap::RGBAType
+ColorMap
+::Interpolate(const InterpolantData &ic, double j)
+{
   RGBAType c;
   c[0] = (unsigned char)(ic.intercept[0] + ic.slope[0] * j);
   c[1] = (unsigned char)(ic.intercept[1] + ic.slope[1] * j);
@@ -290,6 +317,37 @@ ColorMap
   return c;
 }
 
+ColorMap::RGBAType
+ColorMap
+::MapIndexToRGBA(double j) const
+{
+  // Most colormaps are tiny, so a linear search is used, but it starts at
+  // the last point before the bin of j rather than at the first point
+  size_t lb = this->FindInterpolant(j, this->GetSearchStart(j));
+  return Interpolate(m_Interpolants[lb], j);
+}
+
+void
+ColorMap
+::MapIndicesToRGBA(const double *j, size_t n, RGBAType *out) const
+{
+  // When the values are increasing, the search for each value can start at
+  // the interpolant found for the previous value
+  size_t lb = 0;
+  double j_last = 0.0;
+  for(size_t i = 0; i < n; i++)
+    {
+    if(i == 0 || !(j[i] >= j_last))
+      lb = this->GetSearchStart(j[i]);
+    else
+      lb = std::min(lb, m_CMPoints.size() - 1);
+
+    lb = this->FindInterpolant(j[i], lb);
+    out[i] = Interpolate(m_Interpolants[lb], j[i]);
+    j_last = j[i];
+    }
+}
+
 void
 ColorMap
 ::PrintSelf(std::ostream & os, itk::Indent indent) const
@@ -623,6 +681,7 @@ void ColorMap::CopyInformation(const itk::DataObject *source)
   m_CMPreset = cm_source->m_CMPreset;
   m_CMPoints = cm_source->m_CMPoints;
   m_Interpolants = cm_source->m_Interpolants;
+  m_SearchStart = cm_source->m_SearchStart;
   m_NANColor = cm_source->m_NANColor;
   this->Modified();
 }
@@ -120,6 +120,13 @@ public:
      */
   RGBAType MapIndexToRGBA(double j) const;
 
+  /**
+   * Map an array of values to RGBA tuples. The result is the same as calling
+   * MapIndexToRGBA for each value, but this is faster when the values are
+   * sorted, as when filling a lookup table.
+   */
+  void MapIndicesToRGBA(const double *j, size_t n, RGBAType *out) const;
+
   /**
    * This method initializes the color map to one of the system presets. It
    * is also possible to call this method with COLORMAP_CUSTOM as the parameter,
@@ -204,6 +211,21 @@ private:
   typedef std::vector<InterpolantData> InterpolantVector;
   InterpolantVector m_Interpolants;
 
+  // For each of a set of equal bins of [0,1], the number of points whose
+  // index is less than or equal to the start of the bin. The search for the
+  // interpolant of a value starts there instead of at the first point
+  enum { SEARCH_BINS = 256 };
+  std::vector<unsigned int> m_SearchStart;
+
+  // Find the interpolant of a value, starting the search at point lb
+  size_t FindInterpolant(double j, size_t lb) const;
+
+  // The point at which to start the search for the interpolant of a value
+  size_t GetSearchStart(double j) const;
+
+  // Apply an interpolant
+  static RGBAType Interpolate(const InterpolantData &ic, double j);
+
   // Enum for saving presets
   static RegistryEnumMap<SystemPreset> m_ColorMapPresetEnumMap;
 };
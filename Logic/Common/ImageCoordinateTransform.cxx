@@ -107,6 +107,15 @@ ImageCoordinateTransform
 
   // The operation sign(i) applied to m_Mapping
   m_AxesDirection = other->m_AxesDirection;
+
+  // The rows of the matrix as permutation and signs
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    m_InputAxis[i] = other->m_InputAxis[i];
+    m_InputSign[i] = other->m_InputSign[i];
+    }
+
+  this->Modified();
 }
 
 void
@@ -122,6 +131,20 @@ ImageCoordinateTransform
   m_AxesIndex[2] = (unsigned int) fabs(map[2]);
 
   m_AxesDirection = to_int(T * Vector3d(1.0));
+
+  // Find the nonzero entry of each row, used to apply the transform without
+  // a matrix multiplication
+  for(unsigned int r = 0; r < 3; r++)
+    {
+    m_InputAxis[r] = 0;
+    for(unsigned int c = 1; c < 3; c++)
+      if(fabs(m_Transform(r,c)) > fabs(m_Transform(r,m_InputAxis[r])))
+        m_InputAxis[r] = c;
+    m_InputSign[r] = m_Transform(r,m_InputAxis[r]) < 0 ? -1.0 : 1.0;
+    }
+
+  // All the ways of setting the transform end here
+  this->Modified();
 }
 
 
@@ -148,18 +171,6 @@ void ImageCoordinateTransform::ComputeProduct(const Self *t1, Self *result) cons
   result->ComputeSecondaryVectors();
 }
 
-Vector3d ImageCoordinateTransform::TransformPoint(const Vector3d &x) const
-{
-  return m_Transform * x + m_Offset;
-}
-
-Vector3d
-ImageCoordinateTransform
-::TransformVector(const Vector3d &x) const
-{
-  return m_Transform * x;
-}
-
 Vector3ui
 ImageCoordinateTransform
 ::TransformSize(const Vector3ui &sz) const
@@ -89,11 +89,38 @@ public:
   /** Multiply by another transform */
   void ComputeProduct(const Self *t1, Self *result) const;
                                                                       
-  /** Apply transform to a vector */
-  Vector3d TransformVector(const Vector3d &x) const;
+  /**
+   * Apply transform to a vector. Since the matrix is a signed permutation,
+   * each output coordinate is a signed copy of one input coordinate
+   */
+  Vector3d TransformVector(const Vector3d &x) const
+  {
+    return Vector3d(m_InputSign[0] * x[m_InputAxis[0]],
+                    m_InputSign[1] * x[m_InputAxis[1]],
+                    m_InputSign[2] * x[m_InputAxis[2]]);
+  }
 
   /** Apply transform to a point. */
-  Vector3d TransformPoint(const Vector3d &x) const;
+  Vector3d TransformPoint(const Vector3d &x) const
+  {
+    return Vector3d(m_InputSign[0] * x[m_InputAxis[0]] + m_Offset[0],
+                    m_InputSign[1] * x[m_InputAxis[1]] + m_Offset[1],
+                    m_InputSign[2] * x[m_InputAxis[2]] + m_Offset[2]);
+  }
+
+  /** Apply transform to an array of n points. The arrays may be the same */
+  void TransformPoints(const Vector3d *x, Vector3d *y, size_t n) const
+  {
+    for(size_t i = 0; i < n; i++)
+      y[i] = this->TransformPoint(x[i]);
+  }
+
+  /** Apply transform to an array of n vectors. The arrays may be the same */
+  void TransformVectors(const Vector3d *x, Vector3d *y, size_t n) const
+  {
+    for(size_t i = 0; i < n; i++)
+      y[i] = this->TransformVector(x[i]);
+  }
 
   /** Apply to an integer voxel index */
   Vector3ui TransformVoxelIndex(const Vector3ui &xVoxel) const;
@@ -133,6 +160,11 @@ protected:
   // The operation sign(i) applied to m_Mapping
   Vector3i m_AxesDirection;
 
+  // For each output coordinate, the input coordinate that it comes from and
+  // the sign it is multiplied by (the nonzero entry in each row of the matrix)
+  unsigned int m_InputAxis[3];
+  double m_InputSign[3];
+
   // Compute the internal vectors once the matrix and offset have been computed
   void ComputeSecondaryVectors();
 };
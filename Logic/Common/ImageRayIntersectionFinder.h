@@ -36,7 +36,70 @@
 #define __ImageRayIntersectionFinder_h_
 
 #include "SNAPCommon.h"
+#include "RLEImage.h"
 #include <vnl/vnl_matrix_fixed.h>
+#include <vector>
+
+/**
+ * \class ImageRayOccupancyMask
+ * \brief A pyramid of occupancy bitmasks used to skip empty space when
+ * casting rays through an image.
+ *
+ * The image is divided into cubic blocks at several levels (8, 32 and 128
+ * voxels wide), and a bit is set for each block that contains at least one
+ * voxel that satisfies the hit tester. A ray that enters a block with no
+ * hits can jump to the exit of the block, and the coarsest empty block is
+ * used. For run-length encoded images, the mask is built from the runs.
+ *
+ * The mask depends on both the image and the hit tester, so it must be
+ * rebuilt when either changes.
+ */
+class ImageRayOccupancyMask
+{
+public:
+  ImageRayOccupancyMask() {}
+
+  /** Build the mask for an image and a hit tester */
+  template <class TImage, class THitTester>
+  void Build(const TImage *image, const THitTester &tester);
+
+  /** Build the mask for a run-length encoded image, one run at a time */
+  template <class TPixel, class CounterType, class THitTester>
+  void Build(const RLEImage<TPixel, 3, CounterType> *image, const THitTester &tester);
+
+  /**
+   * Get the width of the largest block containing the voxel that has no
+   * hits, or zero if the voxel's finest block contains a hit
+   */
+  unsigned int GetEmptyBlockSize(const itk::Index<3> &idx) const;
+
+  /** Has the mask been built */
+  bool IsBuilt() const { return m_Levels.size() > 0; }
+
+private:
+
+  struct Level
+  {
+    unsigned int Shift;
+    long Size[3];
+    std::vector<bool> Bits;
+
+    std::vector<bool>::reference Bit(long x, long y, long z)
+      { return Bits[((z >> Shift) * Size[1] + (y >> Shift)) * Size[0] + (x >> Shift)]; }
+
+    bool Bit(long x, long y, long z) const
+      { return Bits[((z >> Shift) * Size[1] + (y >> Shift)) * Size[0] + (x >> Shift)]; }
+  };
+
+  // Allocate the levels for an image of given size
+  void Initialize(const itk::Size<3> &size);
+
+  // Fill the coarser levels from the finest one
+  void FillCoarseLevels();
+
+  // Levels from finest to coarsest
+  std::vector<Level> m_Levels;
+};
 
 /**
  * \class ImageRayIntersectionFinder
@@ -53,9 +116,17 @@ public:
   /** Image type */
   typedef TImage ImageType;
 
+  ImageRayIntersectionFinder() : m_OccupancyMask(NULL) {}
+
   /** Set the hit-test functor to evaluate for hits */
   irisSetMacro(HitTester,THitTester);
 
+  /**
+   * Set an optional occupancy mask, built from the same image and hit tester,
+   * which allows the ray to skip over empty parts of the image
+   */
+  irisSetMacro(OccupancyMask, const ImageRayOccupancyMask *);
+
   /**
    * Compute the intersection (index of the first pixel in the
    * image that the ray crosses and which satisfies the THitTester's
@@ -69,6 +140,9 @@ public:
 private:
   /** The hit tester used internally */
   THitTester m_HitTester;
+
+  /** The occupancy mask, may be NULL */
+  const ImageRayOccupancyMask *m_OccupancyMask;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
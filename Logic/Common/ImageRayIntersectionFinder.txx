@@ -34,6 +34,116 @@
 =========================================================================*/
 
 #include "itkImage.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include <algorithm>
+
+inline void
+ImageRayOccupancyMask
+::Initialize(const itk::Size<3> &size)
+{
+  // Block widths of 8, 32 and 128 voxels
+  static const unsigned int shifts[] = { 3, 5, 7 };
+
+  m_Levels.clear();
+  m_Levels.resize(3);
+  for(unsigned int k = 0; k < 3; k++)
+    {
+    Level &level = m_Levels[k];
+    level.Shift = shifts[k];
+    for(unsigned int d = 0; d < 3; d++)
+      level.Size[d] = ((long) size[d] + (1l << level.Shift) - 1) >> level.Shift;
+    level.Bits.assign(level.Size[0] * level.Size[1] * level.Size[2], false);
+    }
+}
+
+inline void
+ImageRayOccupancyMask
+::FillCoarseLevels()
+{
+  const Level &fine = m_Levels.front();
+  for(unsigned int k = 1; k < m_Levels.size(); k++)
+    {
+    Level &level = m_Levels[k];
+    for(long z = 0; z < fine.Size[2]; z++)
+      for(long y = 0; y < fine.Size[1]; y++)
+        for(long x = 0; x < fine.Size[0]; x++)
+          {
+          long xi = x << fine.Shift, yi = y << fine.Shift, zi = z << fine.Shift;
+          if(fine.Bit(xi, yi, zi))
+            level.Bit(xi, yi, zi) = true;
+          }
+    }
+}
+
+template <class TImage, class THitTester>
+void
+ImageRayOccupancyMask
+::Build(const TImage *image, const THitTester &tester)
+{
+  typename TImage::RegionType region = image->GetBufferedRegion();
+  this->Initialize(region.GetSize());
+
+  Level &fine = m_Levels.front();
+  itk::ImageRegionConstIteratorWithIndex<TImage> it(image, region);
+  for(; !it.IsAtEnd(); ++it)
+    {
+    if(tester(it.Get()))
+      {
+      typename TImage::IndexType idx = it.GetIndex() - region.GetIndex();
+      fine.Bit(idx[0], idx[1], idx[2]) = true;
+      }
+    }
+
+  this->FillCoarseLevels();
+}
+
+template <class TPixel, class CounterType, class THitTester>
+void
+ImageRayOccupancyMask
+::Build(const RLEImage<TPixel, 3, CounterType> *image, const THitTester &tester)
+{
+  typedef RLEImage<TPixel, 3, CounterType> ImageType;
+  typename ImageType::RegionType region = image->GetBufferedRegion();
+  this->Initialize(region.GetSize());
+
+  // Mark the blocks covered by each run that is a hit
+  Level &fine = m_Levels.front();
+  const typename ImageType::BufferType *buffer = image->GetBuffer();
+  typename ImageType::BufferType::IndexType bi;
+  for(long z = 0; z < (long) region.GetSize(2); z++)
+    {
+    bi[1] = region.GetIndex(2) + z;
+    for(long y = 0; y < (long) region.GetSize(1); y++)
+      {
+      bi[0] = region.GetIndex(1) + y;
+      long x = 0;
+      for(const auto &seg : buffer->GetPixel(bi))
+        {
+        if(tester(seg.second))
+          {
+          for(long xb = x >> fine.Shift; xb <= (x + seg.first - 1) >> fine.Shift; xb++)
+            fine.Bit(xb << fine.Shift, y, z) = true;
+          }
+        x += seg.first;
+        }
+      }
+    }
+
+  this->FillCoarseLevels();
+}
+
+inline unsigned int
+ImageRayOccupancyMask
+::GetEmptyBlockSize(const itk::Index<3> &idx) const
+{
+  // Search from the coarsest level down
+  for(int k = (int) m_Levels.size() - 1; k >= 0; k--)
+    {
+    if(!m_Levels[k].Bit(idx[0], idx[1], idx[2]))
+      return 1u << m_Levels[k].Shift;
+    }
+  return 0;
+}
 
 template <class TImage, class THitTester>
 int
@@ -98,6 +208,29 @@ ImageRayIntersectionFinder<TImage, THitTester>
     lIndex[1] = (int)py;
     lIndex[2] = (int)pz;
 
+    // If the voxel lies in an empty block, jump to the exit of the block
+    if(m_OccupancyMask)
+      {
+      long bs = m_OccupancyMask->GetEmptyBlockSize(lIndex);
+      if(bs > 0)
+        {
+        double p[3] = { px, py, pz }, t = 1e100;
+        for(unsigned int d = 0; d < 3; d++)
+          {
+          double b0 = (lIndex[d] / bs) * bs, b1 = b0 + bs;
+          if(ray[d] > 0)
+            t = std::min(t, (b1 - p[d]) / ray[d]);
+          else if(ray[d] < 0)
+            t = std::min(t, (p[d] - b0) / -ray[d]);
+          }
+        t += 1e-6;
+        px += t * rx;
+        py += t * ry;
+        pz += t * rz;
+        continue;
+        }
+      }
+
     // Get the pixel
     typename ImageType::PixelType hitPixel = image->GetPixel(lIndex);
 
@@ -0,0 +1,121 @@
+#include "MemoryAccounting.h"
+#include <vector>
+
+size_t MemoryAccounting::Usage::GetTotal() const
+{
+  size_t total = 0;
+  for(int i = 0; i < NUMBER_OF_CATEGORIES; i++)
+    total += Bytes[i];
+  return total;
+}
+
+MemoryAccounting::Usage &MemoryAccounting::Usage::operator += (const Usage &other)
+{
+  for(int i = 0; i < NUMBER_OF_CATEGORIES; i++)
+    Bytes[i] += other.Bytes[i];
+  return *this;
+}
+
+void MemoryAccounting::Registration::Set(UsageFunction usage, ReclaimFunction reclaim)
+{
+  this->Reset();
+  m_Id = MemoryAccounting::GetInstance()->Register(usage, reclaim);
+}
+
+void MemoryAccounting::Registration::Reset()
+{
+  if(m_Id)
+    {
+    MemoryAccounting::GetInstance()->Unregister(m_Id);
+    m_Id = 0;
+    }
+}
+
+MemoryAccounting *MemoryAccounting::GetInstance()
+{
+  // Never destroyed, since clients held in static objects may unregister
+  // after static destructors have run
+  static MemoryAccounting *instance = new MemoryAccounting();
+  return instance;
+}
+
+unsigned long MemoryAccounting::Register(UsageFunction usage, ReclaimFunction reclaim)
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  Client &client = m_Clients[++m_LastId];
+  client.UsageFn = usage;
+  client.ReclaimFn = reclaim;
+  return m_LastId;
+}
+
+void MemoryAccounting::Unregister(unsigned long id)
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  m_Clients.erase(id);
+}
+
+MemoryAccounting::Usage MemoryAccounting::GetTotalUsage() const
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  Usage usage;
+  for(auto &it : m_Clients)
+    if(it.second.UsageFn)
+      it.second.UsageFn(usage);
+  return usage;
+}
+
+void MemoryAccounting::SetBudget(size_t bytes)
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  m_Budget = bytes;
+}
+
+size_t MemoryAccounting::GetBudget() const
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  return m_Budget;
+}
+
+bool MemoryAccounting::EnforceBudget()
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  if(!m_Budget)
+    return true;
+
+  for(int level = 0; level < NUMBER_OF_RECLAIM_LEVELS; level++)
+    {
+    if(this->GetTotalUsage().GetTotal() <= m_Budget)
+      return true;
+
+    // Clients may register or unregister while releasing memory, so visit
+    // the ones that were registered when this level started
+    std::vector<unsigned long> ids;
+    for(auto &it : m_Clients)
+      ids.push_back(it.first);
+
+    for(unsigned long id : ids)
+      {
+      auto it = m_Clients.find(id);
+      if(it != m_Clients.end() && it->second.ReclaimFn)
+        it->second.ReclaimFn((ReclaimLevel) level);
+      }
+    }
+
+  return this->GetTotalUsage().GetTotal() <= m_Budget;
+}
+
+const char *MemoryAccounting::GetCategoryName(Category cat)
+{
+  switch(cat)
+    {
+    case IMAGE_DATA: return "Image data";
+    case MAPPED_IMAGE_DATA: return "Image data mapped from disk";
+    case DISPLAY_SLICES: return "Display slices";
+    case MULTIRES_PYRAMIDS: return "Multiresolution pyramids";
+    case SLICE_CACHES: return "Slice caches";
+    case UNDO_HISTORY: return "Undo history";
+    case MESHES: return "Meshes";
+    case BUFFER_POOL: return "Slice buffer pool";
+    default: return "Other";
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * A process-wide registry of the memory held by the layers and caches of
+ * SNAP. Image wrappers (including their undo history), mesh wrappers and the
+ * shared caches register a function that reports the bytes they hold, broken
+ * down by category, and a function that releases memory on request.
+ *
+ * When a budget is set, EnforceBudget() asks the clients to release memory,
+ * in order of increasing cost, until the total falls within the budget:
+ * first the caches that are refilled as needed, then derived data and
+ * compressed undo history, and finally inactive time points that can be read
+ * back from disk and undo history that can be spilled to a file.
+ *
+ * The usage and reclaim functions are called with the registry locked, from
+ * the thread that calls GetTotalUsage() or EnforceBudget(), which should be
+ * the main thread that also owns the wrappers.
+ */
+class MemoryAccounting
+{
+public:
+  /** What the memory is used for */
+  enum Category
+  {
+    IMAGE_DATA = 0,
+    MAPPED_IMAGE_DATA,
+    DISPLAY_SLICES,
+    MULTIRES_PYRAMIDS,
+    SLICE_CACHES,
+    UNDO_HISTORY,
+    MESHES,
+    BUFFER_POOL,
+    NUMBER_OF_CATEGORIES
+  };
+
+  /** Number of bytes used in each category */
+  struct Usage
+  {
+    size_t Bytes[NUMBER_OF_CATEGORIES] = {};
+
+    size_t GetTotal() const;
+    Usage &operator += (const Usage &other);
+  };
+
+  /** How much effort to spend on releasing memory, from least to most */
+  enum ReclaimLevel
+  {
+    // Drop caches that are refilled when needed
+    RECLAIM_CACHES = 0,
+
+    // Drop data derived from the images and compress the undo history
+    RECLAIM_DERIVED_DATA,
+
+    // Release inactive time points and spill the undo history to disk
+    RECLAIM_PAGE_OUT,
+
+    NUMBER_OF_RECLAIM_LEVELS
+  };
+
+  typedef std::function<void (Usage &)> UsageFunction;
+  typedef std::function<void (ReclaimLevel)> ReclaimFunction;
+
+  /**
+   * The registration of a client with the registry, which is withdrawn when
+   * this object is destroyed. Clients keep it as a member, and should reset
+   * it before the members used by its functions are destroyed.
+   */
+  class Registration
+  {
+  public:
+    Registration() {}
+    ~Registration() { this->Reset(); }
+
+    /** Register the functions, replacing any registered before */
+    void Set(UsageFunction usage, ReclaimFunction reclaim);
+
+    /** Withdraw the registration */
+    void Reset();
+
+  private:
+    Registration(const Registration &) = delete;
+    Registration &operator = (const Registration &) = delete;
+
+    unsigned long m_Id = 0;
+  };
+
+  static MemoryAccounting *GetInstance();
+
+  /** Total memory used by all of the clients */
+  Usage GetTotalUsage() const;
+
+  /** Set the budget in bytes, zero for no budget */
+  void SetBudget(size_t bytes);
+  size_t GetBudget() const;
+
+  /**
+   * Release memory until the total usage is within the budget, if there is
+   * one. Returns false if the usage still exceeds the budget.
+   */
+  bool EnforceBudget();
+
+  /** A short description of a category, for display */
+  static const char *GetCategoryName(Category cat);
+
+protected:
+  MemoryAccounting() {}
+
+  unsigned long Register(UsageFunction usage, ReclaimFunction reclaim);
+  void Unregister(unsigned long id);
+
+  struct Client
+  {
+    UsageFunction UsageFn;
+    ReclaimFunction ReclaimFn;
+  };
+
+  // Clients by registration id, so that they are visited in creation order
+  std::map<unsigned long, Client> m_Clients;
+  unsigned long m_LastId = 0;
+  size_t m_Budget = 0;
+
+  // Recursive, since reclaiming memory may create or release clients
+  mutable std::recursive_mutex m_Mutex;
+};
+
+#endif // MEMORYACCOUNTING_H
@@ -0,0 +1,114 @@
+#include "ProgressToken.h"
+#include "itkProcessObject.h"
+#include <algorithm>
+
+ProgressToken::ProgressToken()
+  : m_Node(std::make_shared<Node>())
+{
+  m_Node->Cancelled = std::make_shared<std::atomic<bool> >(false);
+}
+
+void ProgressToken::SetProgress(double progress)
+{
+  progress = std::min(1.0, std::max(0.0, progress));
+  m_Node->Progress.store((unsigned int) (progress * PROGRESS_SCALE), std::memory_order_relaxed);
+}
+
+void ProgressToken::AddProgress(double delta)
+{
+  // The sum may overshoot, it is clamped when read
+  if(delta > 0.0)
+    m_Node->Progress.fetch_add(
+          (unsigned int) (std::min(1.0, delta) * PROGRESS_SCALE), std::memory_order_relaxed);
+}
+
+double ProgressToken::GetProgress() const
+{
+  return ComputeProgress(m_Node.get());
+}
+
+double ProgressToken::ComputeProgress(const Node *node)
+{
+  std::lock_guard<std::mutex> guard(node->ChildMutex);
+  if(node->Children.empty())
+    {
+    unsigned int p = node->Progress.load(std::memory_order_relaxed);
+    return std::min(p, PROGRESS_SCALE) * (1.0 / PROGRESS_SCALE);
+    }
+
+  double total = 0.0, weight = 0.0;
+  for(auto &child : node->Children)
+    {
+    total += child->Weight * ComputeProgress(child.get());
+    weight += child->Weight;
+    }
+  return weight > 0.0 ? total / weight : 0.0;
+}
+
+ProgressToken ProgressToken::CreateChild(double weight)
+{
+  auto child = std::make_shared<Node>();
+  child->Weight = weight;
+  child->Cancelled = m_Node->Cancelled;
+
+  std::lock_guard<std::mutex> guard(m_Node->ChildMutex);
+  m_Node->Children.push_back(child);
+  return ProgressToken(child);
+}
+
+void ProgressToken::Reset()
+{
+  ResetNode(m_Node.get());
+  *m_Node->Cancelled = false;
+}
+
+void ProgressToken::ResetNode(Node *node)
+{
+  std::lock_guard<std::mutex> guard(node->ChildMutex);
+  node->Progress = 0;
+  for(auto &child : node->Children)
+    ResetNode(child.get());
+}
+
+void ProgressToken::Cancel() const
+{
+  *m_Node->Cancelled = true;
+}
+
+bool ProgressToken::IsCancelled() const
+{
+  return *m_Node->Cancelled;
+}
+
+std::atomic<bool> &ProgressToken::GetCancelFlag() const
+{
+  return *m_Node->Cancelled;
+}
+
+void ProgressToken::Update(itk::ProcessObject *source)
+{
+  this->SetProgress(source->GetProgress());
+  if(this->IsCancelled() && !source->GetAbortGenerateData())
+    source->AbortGenerateDataOn();
+}
+
+SmartPtr<itk::Command> ProgressToken::CreateCommand() const
+{
+  SmartPtr<ProgressTokenCommand> cmd = ProgressTokenCommand::New();
+  cmd->SetToken(*this);
+  SmartPtr<itk::Command> ret = cmd.GetPointer();
+  return ret;
+}
+
+void ProgressTokenCommand::Execute(itk::Object *caller, const itk::EventObject &)
+{
+  if(itk::ProcessObject *po = dynamic_cast<itk::ProcessObject *>(caller))
+    m_Token.Update(po);
+}
+
+void ProgressTokenCommand::Execute(const itk::Object *caller, const itk::EventObject &)
+{
+  // A const object can not be asked to abort, only its progress is copied
+  if(const itk::ProcessObject *po = dynamic_cast<const itk::ProcessObject *>(caller))
+    m_Token.SetProgress(po->GetProgress());
+}
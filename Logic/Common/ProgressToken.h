@@ -0,0 +1,118 @@
+#ifndef PROGRESSTOKEN_H
+#define PROGRESSTOKEN_H
+
+#include "SNAPCommon.h"
+#include "itkCommand.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace itk { class ProcessObject; }
+
+/**
+ * A handle on the progress and cancellation state of a long operation,
+ * shared by the code doing the work and the code displaying it.
+ *
+ * The worker only stores its progress in an atomic counter, whichever
+ * thread it runs on, and never calls into the GUI. The GUI samples the
+ * progress when it repaints, e.g., from a timer, so that a filter that
+ * reports progress thousands of times per second costs no more than one
+ * that reports it rarely.
+ *
+ * An operation made of several steps creates a child token for each step,
+ * with a weight, before the steps start. The progress of a token with
+ * children is the weighted average of the progress of the children. All
+ * the tokens of an operation share the same cancellation flag. When an ITK
+ * filter reports progress through a token that has been cancelled, the
+ * filter is asked to abort, and its Update() throws itk::ProcessAborted.
+ *
+ * Copies of a token refer to the same state.
+ */
+class ProgressToken
+{
+public:
+  ProgressToken();
+
+  /** Set the progress of this step, between 0 and 1 */
+  void SetProgress(double progress);
+
+  /** Add to the progress of this step */
+  void AddProgress(double delta);
+
+  /** Progress of the operation (or step), between 0 and 1 */
+  double GetProgress() const;
+
+  /**
+   * Create a token for a step of this operation. The weights of the steps
+   * do not need to add up to one.
+   */
+  ProgressToken CreateChild(double weight);
+
+  /** Zero the progress of this token and its steps, and clear cancellation */
+  void Reset();
+
+  /** Request the operation to stop */
+  void Cancel() const;
+  bool IsCancelled() const;
+
+  /** The flag itself, for code that polls an atomic<bool> */
+  std::atomic<bool> &GetCancelFlag() const;
+
+  /**
+   * Copy the progress of an ITK process object, and ask it to abort if the
+   * operation has been cancelled
+   */
+  void Update(itk::ProcessObject *source);
+
+  /** Create a command that calls Update() with the object it observes */
+  SmartPtr<itk::Command> CreateCommand() const;
+
+private:
+  // Progress is stored in fixed point, so that updates are lock-free
+  static constexpr unsigned int PROGRESS_SCALE = 1u << 20;
+
+  struct Node
+  {
+    std::atomic<unsigned int> Progress { 0 };
+    double Weight = 1.0;
+
+    // Only changed while the operation is being set up
+    std::vector<std::shared_ptr<Node> > Children;
+    mutable std::mutex ChildMutex;
+
+    std::shared_ptr<std::atomic<bool> > Cancelled;
+  };
+
+  ProgressToken(std::shared_ptr<Node> node) : m_Node(node) {}
+
+  static double ComputeProgress(const Node *node);
+  static void ResetNode(Node *node);
+
+  std::shared_ptr<Node> m_Node;
+};
+
+/**
+ * A command that forwards the progress of the ITK object it observes to a
+ * progress token. It can be added as an observer of the Start, Progress and
+ * End events of a filter, or passed to code that takes a progress command.
+ */
+class ProgressTokenCommand : public itk::Command
+{
+public:
+  irisITKObjectMacro(ProgressTokenCommand, itk::Command)
+
+  void SetToken(const ProgressToken &token) { m_Token = token; }
+  const ProgressToken &GetToken() const { return m_Token; }
+
+  void Execute(itk::Object *caller, const itk::EventObject &event) override;
+  void Execute(const itk::Object *caller, const itk::EventObject &event) override;
+
+protected:
+  ProgressTokenCommand() {}
+  virtual ~ProgressTokenCommand() {}
+
+  ProgressToken m_Token;
+};
+
+#endif // PROGRESSTOKEN_H
@@ -346,6 +346,15 @@ GlobalDisplaySettings::GlobalDisplaySettings()
   m_FlagRemindLayoutSettingsModel =
       NewSimpleProperty("FlagRemindLayoutSettings", true);
 
+  m_FlagGPUColorMappingModel =
+      NewSimpleProperty("FlagGPUColorMapping", false);
+
+  m_FlagCPUCompositingModel =
+      NewSimpleProperty("FlagCPUCompositing", false);
+
+  m_FlagProfilingOverlayModel =
+      NewSimpleProperty("FlagProfilingOverlay", false);
+
   m_LayerLayoutModel =
       NewSimpleEnumProperty("LayerLayout", LAYOUT_STACKED, emap_layer_layout);
 }
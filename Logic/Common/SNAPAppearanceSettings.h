@@ -118,6 +118,9 @@ public:
   irisRangedPropertyAccessMacro(ZoomThumbnailSizeInPercent, double)
   irisRangedPropertyAccessMacro(ZoomThumbnailMaximumSize, int)
   irisSimplePropertyAccessMacro(GreyInterpolationMode, UIGreyInterpolation)
+  irisSimplePropertyAccessMacro(FlagGPUColorMapping, bool)
+  irisSimplePropertyAccessMacro(FlagCPUCompositing, bool)
+  irisSimplePropertyAccessMacro(FlagProfilingOverlay, bool)
   irisSimplePropertyAccessMacro(FlagLayoutPatientAnteriorShownLeft, bool)
   irisSimplePropertyAccessMacro(FlagLayoutPatientRightShownLeft, bool)
   irisSimplePropertyAccessMacro(FlagRemindLayoutSettings, bool)
@@ -142,6 +145,9 @@ protected:
   SmartPtr<ConcreteSimpleBooleanProperty> m_FlagLayoutPatientAnteriorShownLeftModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_FlagLayoutPatientRightShownLeftModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_FlagRemindLayoutSettingsModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_FlagGPUColorMappingModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_FlagCPUCompositingModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_FlagProfilingOverlayModel;
 
   typedef ConcretePropertyModel<UIGreyInterpolation, TrivialDomain> ConcreteInterpolationModel;
   SmartPtr<ConcreteInterpolationModel> m_GreyInterpolationModeModel;
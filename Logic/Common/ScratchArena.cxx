@@ -0,0 +1,68 @@
+#include "ScratchArena.h"
+#include <new>
+
+namespace
+{
+const std::align_val_t SCRATCH_ALIGNMENT = std::align_val_t(64);
+}
+
+ScratchArena &ScratchArena::GetForThread()
+{
+  thread_local ScratchArena arena;
+  return arena;
+}
+
+int ScratchArena::GetSizeClass(size_t bytes)
+{
+  int k = 0;
+  while(k < NUMBER_OF_CLASSES - 1 && (size_t(1) << (MIN_SIZE_BITS + k)) < bytes)
+    k++;
+  return k;
+}
+
+void *ScratchArena::Acquire(size_t bytes, size_t &capacity)
+{
+  int k = GetSizeClass(bytes);
+  capacity = size_t(1) << (MIN_SIZE_BITS + k);
+
+  std::vector<void *> &pool = m_FreeBlocks[k];
+  if(!pool.empty())
+    {
+    void *block = pool.back();
+    pool.pop_back();
+    m_RetainedBytes -= capacity;
+    return block;
+    }
+
+  return ::operator new(capacity, SCRATCH_ALIGNMENT);
+}
+
+void ScratchArena::Release(void *block, size_t capacity)
+{
+  // Keep the block unless the arena already holds a lot of memory
+  if(m_RetainedBytes + capacity <= MAX_RETAINED_BYTES)
+    {
+    m_FreeBlocks[GetSizeClass(capacity)].push_back(block);
+    m_RetainedBytes += capacity;
+    }
+  else
+    {
+    ::operator delete(block, SCRATCH_ALIGNMENT);
+    }
+}
+
+void ScratchArena::Trim()
+{
+  for(auto &pool : m_FreeBlocks)
+    {
+    for(void *block : pool)
+      ::operator delete(block, SCRATCH_ALIGNMENT);
+    pool.clear();
+    }
+  m_RetainedBytes = 0;
+}
+
+ScratchArena::~ScratchArena()
+{
+  this->Trim();
+}
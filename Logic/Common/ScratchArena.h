@@ -0,0 +1,140 @@
+#ifndef SCRATCHARENA_H
+#define SCRATCHARENA_H
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * A per-thread pool of temporary buffers, so that the threaded filters that
+ * need scratch memory for each region or scanline do not allocate it anew
+ * every time they run.
+ *
+ * Blocks come in power of two size classes, starting at 64 bytes, and a
+ * released block is kept for the next request of its class. Each thread has
+ * its own arena, so no locking is needed. The workers of TaskScheduler and
+ * of the ITK thread pool live as long as the program (or until the number
+ * of threads is reduced), so after the first few updates the buffers are
+ * all taken from the arenas. An arena is freed when its thread exits.
+ *
+ * The arena is normally used through ScratchBuffer.
+ */
+class ScratchArena
+{
+public:
+  /** The arena of the calling thread */
+  static ScratchArena &GetForThread();
+
+  /**
+   * Get a block of at least the given number of bytes, aligned to 64 bytes.
+   * The size of the block is returned in capacity.
+   */
+  void *Acquire(size_t bytes, size_t &capacity);
+
+  /** Return a block obtained with Acquire(), along with its capacity */
+  void Release(void *block, size_t capacity);
+
+  /** Number of bytes held in free blocks */
+  size_t GetRetainedBytes() const { return m_RetainedBytes; }
+
+  /** Free all the blocks that are not in use */
+  void Trim();
+
+  ~ScratchArena();
+
+private:
+  ScratchArena() {}
+  ScratchArena(const ScratchArena &) = delete;
+  void operator = (const ScratchArena &) = delete;
+
+  // Block sizes are 2^(MIN_SIZE_BITS + k)
+  enum { MIN_SIZE_BITS = 6, NUMBER_OF_CLASSES = 40 };
+
+  // Free blocks above this total are returned to the system
+  static const size_t MAX_RETAINED_BYTES = 256ul << 20;
+
+  static int GetSizeClass(size_t bytes);
+
+  std::vector<void *> m_FreeBlocks[NUMBER_OF_CLASSES];
+  size_t m_RetainedBytes = 0;
+};
+
+/**
+ * A temporary array of plain values taken from the arena of the thread that
+ * creates it. The contents are not initialized. The buffer must be destroyed
+ * (and resized) by the thread that created it, which is the case for local
+ * variables and for the members of objects local to a threaded function.
+ */
+template <class T>
+class ScratchBuffer
+{
+public:
+  static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+                "ScratchBuffer only holds plain values");
+
+  ScratchBuffer() {}
+  explicit ScratchBuffer(size_t n) { this->Resize(n); }
+  ScratchBuffer(size_t n, const T &value) { this->Assign(n, value); }
+  ~ScratchBuffer() { this->Clear(); }
+
+  ScratchBuffer(ScratchBuffer &&other) { this->Swap(other); }
+  ScratchBuffer &operator = (ScratchBuffer &&other) { this->Swap(other); return *this; }
+
+  /** Make room for n values. The previous contents are not kept */
+  void Resize(size_t n)
+  {
+    if(n * sizeof(T) > m_Capacity)
+      {
+      this->Clear();
+      m_Arena = &ScratchArena::GetForThread();
+      m_Data = static_cast<T *>(m_Arena->Acquire(n * sizeof(T), m_Capacity));
+      }
+    m_Size = n;
+  }
+
+  /** Make room for n values and set them all to value */
+  void Assign(size_t n, const T &value)
+  {
+    this->Resize(n);
+    for(size_t i = 0; i < n; i++)
+      m_Data[i] = value;
+  }
+
+  /** Return the memory to the arena */
+  void Clear()
+  {
+    if(m_Data)
+      m_Arena->Release(m_Data, m_Capacity);
+    m_Data = nullptr;
+    m_Size = m_Capacity = 0;
+  }
+
+  T *data() { return m_Data; }
+  const T *data() const { return m_Data; }
+  size_t size() const { return m_Size; }
+
+  T &operator[](size_t i) { return m_Data[i]; }
+  const T &operator[](size_t i) const { return m_Data[i]; }
+
+  T *begin() { return m_Data; }
+  T *end() { return m_Data + m_Size; }
+
+private:
+  ScratchBuffer(const ScratchBuffer &) = delete;
+  void operator = (const ScratchBuffer &) = delete;
+
+  void Swap(ScratchBuffer &other)
+  {
+    std::swap(m_Data, other.m_Data);
+    std::swap(m_Size, other.m_Size);
+    std::swap(m_Capacity, other.m_Capacity);
+    std::swap(m_Arena, other.m_Arena);
+  }
+
+  T *m_Data = nullptr;
+  size_t m_Size = 0, m_Capacity = 0;
+  ScratchArena *m_Arena = nullptr;
+};
+
+#endif // SCRATCHARENA_H
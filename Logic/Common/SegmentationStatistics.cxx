@@ -36,38 +36,47 @@
 #include "GenericImageData.h"
 #include "IRISApplication.h"
 #include "ImageCollectionConstIteratorWithIndex.h"
+#include "FormattedTable.h"
+#include "TaskScheduler.h"
+#include "SNAPLatencyMonitor.h"
+
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <sstream>
 
 #include <iostream>
 #include <iomanip>
+#include <cmath>
 
 
 using namespace std;
 
 
-// TODO: improve efficiency by using filters to integrate label intensities
 void
 SegmentationStatistics
-::Compute(IRISApplication *app)
+::CollectLayers(GenericImageData *id,
+                vector<ScalarImageWrapperBase *> &layers,
+                vector<string> &columns,
+                vector<LayerKey> *keys)
 {
-  // Get the current image data
-  GenericImageData *id = app->GetCurrentImageData();
-
-  // Get the selected segmentation layer
-  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
-
-  // A list of image sources
-  vector<ScalarImageWrapperBase *> layers;
-
-  // Clear the list of column names
-  m_ImageStatisticsColumnNames.clear();
-
   // Find all the images available for statistics computation
   for(LayerIterator it(id, MAIN_ROLE | OVERLAY_ROLE); !it.IsAtEnd(); ++it)
     {
+    ImageWrapperBase *layer = it.GetLayer();
+    if(keys)
+      {
+      LayerKey key = { layer->GetUniqueId(),
+                       layer->GetImage4DBase()->GetMTime(),
+                       layer->GetTimePointIndex() };
+      keys->push_back(key);
+      }
+
     ScalarImageWrapperBase *lscalar = it.GetLayerAsScalar();
     if(lscalar)
       {
-      m_ImageStatisticsColumnNames.push_back(lscalar->GetNickname());
+      columns.push_back(lscalar->GetNickname());
       layers.push_back(lscalar);
       }
     else
@@ -79,21 +88,90 @@ SegmentationStatistics
         oss << lvector->GetNickname();
         if(lvector->GetNumberOfComponents() > 1)
           oss << " [" << j << "]";
-        m_ImageStatisticsColumnNames.push_back(oss.str());
+        columns.push_back(oss.str());
         layers.push_back(lvector->GetScalarRepresentation(
               SCALAR_REP_COMPONENT, j));
         }
       }
     }
+}
+
+// TODO: improve efficiency by using filters to integrate label intensities
+void
+SegmentationStatistics
+::Compute(IRISApplication *app)
+{
+  SNAP_LATENCY_SCOPE(SNAPLatencyMonitor::STATISTICS);
+
+  // Get the current image data
+  GenericImageData *id = app->GetCurrentImageData();
+
+  // Get the selected segmentation layer
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+
+  // A list of image sources
+  vector<ScalarImageWrapperBase *> layers;
+
+  // Keys identifying the gray images and their contents
+  vector<LayerKey> gray_keys;
+
+  // Clear the list of column names
+  m_ImageStatisticsColumnNames.clear();
+  CollectLayers(id, layers, m_ImageStatisticsColumnNames, &gray_keys);
 
   // Get the number of gray image layers
   size_t ngray = layers.size();
 
+  // Key identifying the segmentation layer and time point
+  LayerKey seg_key = { seg->GetUniqueId(), 0, seg->GetTimePointIndex() };
+
+  // Try to update the statistics incrementally
+  if(m_CacheValid && seg_key == m_CachedSegmentationKey && gray_keys == m_CachedGrayKeys
+     && this->UpdateFromLabelChanges(seg, layers))
+    {
+    m_CachedJournalSerial = seg->GetLabelChangeJournalEnd();
+    }
+  else
+    {
+    // Start journaling label changes so that the next call is incremental
+    seg->SetLabelChangeJournalEnabled(true);
+    m_CachedSegmentationKey = seg_key;
+    m_CachedGrayKeys = gray_keys;
+    m_CachedJournalSerial = seg->GetLabelChangeJournalEnd();
+
+    this->ComputeFromScratch(seg, layers, -1);
+    }
+
+  // Intensity statistics are not available with non-orthogonal slicing, in
+  // which case the sums are NaN and must be recomputed next time
+  m_CacheValid = true;
+  for(EntryMap::iterator it = m_Stats.begin(); it != m_Stats.end(); ++it)
+    for(size_t j = 0; j < ngray; j++)
+      if(std::isnan(it->second.sum[j]))
+        m_CacheValid = false;
+
+  // Compute the size of a voxel, in mm^3
+  const double *spacing = 
+    id->GetMain()->GetImageBase()->GetSpacing().GetDataPointer();
+  this->ComputeMeansAndVolumes(layers, spacing[0] * spacing[1] * spacing[2]);
+}
+
+void
+SegmentationStatistics
+::ComputeFromScratch(LabelImageWrapper *seg,
+                     vector<ScalarImageWrapperBase *> &layers, int tp)
+{
+  size_t ngray = layers.size();
+
   // Clear and initialize the statistics table
   m_Stats.clear();
 
   // Start the label image iteration
-  LabelImageWrapper::ConstIterator itLabel = seg->GetImageConstIterator();
+  LabelImageWrapper::ConstIterator itLabel = tp < 0
+      ? seg->GetImageConstIterator()
+      : LabelImageWrapper::ConstIterator(
+          seg->GetImageByTimePoint(tp),
+          seg->GetImageBase()->GetLargestPossibleRegion());
   itk::ImageRegion<3> region = itLabel.GetRegion();
 
   // Cache the entry to avoid many calls to std::map
@@ -111,7 +189,7 @@ SegmentationStatistics
     if(label != runLabel)
       {
       // Record the statistics from the last run
-      this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
+      this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry, tp);
 
       // Change the cached entry
       runLabel = label;
@@ -125,18 +203,18 @@ SegmentationStatistics
     }
 
   // Record the statistics from the last run
-  this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
+  this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry, tp);
+}
 
-  // Compute the size of a voxel, in mm^3
-  const double *spacing = 
-    id->GetMain()->GetImageBase()->GetSpacing().GetDataPointer();
-  double volVoxel = spacing[0] * spacing[1] * spacing[2];
-  
+void
+SegmentationStatistics
+::ComputeMeansAndVolumes(vector<ScalarImageWrapperBase *> &layers, double volVoxel)
+{
   // Compute the mean and standard deviation
   for(EntryMap::iterator it = m_Stats.begin(); it != m_Stats.end(); ++it)
     {
     Entry &entry = it->second;
-    for(size_t j = 0; j < ngray; j++)
+    for(size_t j = 0; j < layers.size(); j++)
       {
       // Map to native format
       double mean = entry.sum[j] / entry.nvalid[j];
@@ -152,19 +230,179 @@ SegmentationStatistics
     }
 }
 
+void
+SegmentationStatistics
+::ComputeAllTimePoints(IRISApplication *app, const TimePointCallback &callback)
+{
+  GenericImageData *id = app->GetCurrentImageData();
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+
+  vector<ScalarImageWrapperBase *> layers;
+  vector<string> columns;
+  CollectLayers(id, layers, columns, NULL);
+
+  const double *spacing =
+    id->GetMain()->GetImageBase()->GetSpacing().GetDataPointer();
+  double volVoxel = spacing[0] * spacing[1] * spacing[2];
+
+  // Layers with a single time point are used with every time point of the
+  // segmentation. Accessing the voxels of each layer once here decompresses
+  // them, which the workers can not do concurrently
+  unsigned int ntp = seg->GetNumberOfTimePoints();
+  itk::ImageRegion<3> region = seg->GetImageBase()->GetLargestPossibleRegion();
+  double dummy = 0.0;
+  for(unsigned int tp = 0; tp < ntp; tp++)
+    seg->GetImageByTimePoint(tp);
+  for(auto *layer : layers)
+    layer->GetRunLengthIntensityStatistics(region, region.GetIndex(), 0,
+                                           &dummy, &dummy, &dummy, 0);
+
+  // Each time point is a single pass over the runs of the labels, which
+  // integrates all of the gray layers
+  auto computeTimePoint = [seg, layers, columns, volVoxel](unsigned int tp)
+    {
+    SegmentationStatistics stats;
+    stats.m_ImageStatisticsColumnNames = columns;
+    vector<ScalarImageWrapperBase *> tpLayers = layers;
+    stats.ComputeFromScratch(seg, tpLayers, (int) tp);
+    stats.ComputeMeansAndVolumes(tpLayers, volVoxel);
+    return stats;
+    };
+
+  // Keep a few time points ahead of the one being handed to the callback
+  TaskScheduler *scheduler = TaskScheduler::GetInstance();
+  unsigned int window = 2 * scheduler->GetNumberOfThreads();
+  std::deque<std::future<SegmentationStatistics> > pending;
+  unsigned int next = 0;
+  try
+    {
+    for(unsigned int tp = 0; tp < ntp; tp++)
+      {
+      for(; next < ntp && next < tp + window; next++)
+        pending.push_back(scheduler->Submit(
+                            TaskScheduler::USER_COMPUTE,
+                            [computeTimePoint, next]() { return computeTimePoint(next); }));
+
+      SegmentationStatistics stats = pending.front().get();
+      pending.pop_front();
+      callback(tp, stats);
+      }
+    }
+  catch(...)
+    {
+    // The tasks still queued refer to the layers
+    for(auto &f : pending)
+      f.wait();
+    throw;
+    }
+}
+
+void
+SegmentationStatistics
+::ExportAllTimePoints(IRISApplication *app, ostream &oss, const string &colsep)
+{
+  const ColorLabelTable &clt = *app->GetColorLabelTable();
+  ComputeAllTimePoints(app, [&](unsigned int tp, const SegmentationStatistics &stats)
+    {
+    if(tp == 0)
+      {
+      oss << "Time Point" << colsep;
+      ExportHeader(oss, colsep, stats.m_ImageStatisticsColumnNames);
+      }
+
+    std::ostringstream prefix;
+    prefix << (tp + 1) << colsep;
+    stats.ExportRows(oss, colsep, clt, prefix.str());
+    });
+}
+
+void
+SegmentationStatistics
+::ExportAllTimePoints(IRISApplication *app, FormattedTable &table)
+{
+  // The table is filled from tab-separated rows
+  std::ostringstream oss;
+  ExportAllTimePoints(app, oss, "\t");
+
+  std::istringstream iss(oss.str());
+  std::string line;
+  while(std::getline(iss, line))
+    {
+    std::istringstream lss(line);
+    std::string field;
+    while(std::getline(lss, field, '\t'))
+      table << field;
+    table.EndRow();
+    }
+}
+bool SegmentationStatistics
+::UpdateFromLabelChanges(LabelImageWrapper *seg, vector<ScalarImageWrapperBase *> &layers)
+{
+  // Get the changes since the statistics were last computed
+  LabelImageWrapper::LabelChangeRunList runs;
+  if(!seg->GetLabelChangesSince(m_CachedJournalSerial, runs))
+    return false;
+
+  size_t ngray = layers.size();
+  itk::ImageRegion<3> region = seg->GetImageBase()->GetLargestPossibleRegion();
+
+  // Statistics of the gray images over a single run
+  Entry runEntry;
+  for(auto &run : runs)
+    {
+    runEntry.count = 0;
+    runEntry.resize(ngray);
+    this->RecordRunLength(ngray, layers, region, run.Start, run.Length, &runEntry);
+
+    // Move the voxels in the run from the old label to the new label
+    Entry &e_old = m_Stats[run.OldLabel];
+    if(e_old.count < (unsigned long) run.Length)
+      return false;
+
+    e_old.count -= run.Length;
+    e_old.nvalid -= runEntry.nvalid;
+    e_old.sum -= runEntry.sum;
+    e_old.sumsq -= runEntry.sumsq;
+
+    Entry &e_new = m_Stats[run.NewLabel];
+    if(e_new.count == 0)
+      e_new.resize(ngray);
+
+    e_new.count += run.Length;
+    e_new.nvalid += runEntry.nvalid;
+    e_new.sum += runEntry.sum;
+    e_new.sumsq += runEntry.sumsq;
+    }
+
+  // Remove labels that are no longer present, except for the clear label,
+  // which is always included in the table
+  for(EntryMap::iterator it = m_Stats.begin(); it != m_Stats.end(); )
+    {
+    if(it->first != 0 && it->second.count == 0)
+      it = m_Stats.erase(it);
+    else
+      ++it;
+    }
+
+  return true;
+}
+
 void SegmentationStatistics
 ::RecordRunLength(size_t ngray, vector<ScalarImageWrapperBase *> &layers,
                   itk::ImageRegion<3> &region, itk::Index<3> &runStart,
-                  long runLength, Entry *cachedEntry)
+                  long runLength, Entry *cachedEntry, int tp)
 {
-  // Record the statistics from the last run
+  // Record the statistics from the last run. Layers with fewer time points
+  // than the segmentation, e.g., a 3D overlay, use their last one
   for(size_t j = 0; j < ngray; j++)
     {
+    int tpLayer = tp < 0 ? tp : std::min(tp, (int) layers[j]->GetNumberOfTimePoints() - 1);
     layers[j]->GetRunLengthIntensityStatistics(
           region, runStart, runLength,
           cachedEntry->nvalid.data_block() + j,
           cachedEntry->sum.data_block() + j,
-          cachedEntry->sumsq.data_block() + j);
+          cachedEntry->sumsq.data_block() + j,
+          tpLayer);
     }
 
   cachedEntry->count += runLength;
@@ -212,6 +450,265 @@ void SegmentationStatistics
     */
 }
 
+bool
+SegmentationStatistics
+::ComputeConfusion(LabelImageWrapper *seg, LabelImageWrapper *other, ConfusionMap &result)
+{
+  result.clear();
+  typedef LabelImageWrapper::ImageType LabelImageType;
+  const LabelImageType *img_a = seg->GetImage(), *img_b = other->GetImage();
+  itk::ImageRegion<3> region = img_a->GetBufferedRegion();
+  if(region != img_b->GetBufferedRegion())
+    return false;
+
+  // Each chunk of lines counts into its own map, which is then added to the
+  // result. Successive runs often have the same pair of labels, so the last
+  // entry is cached to avoid many calls to std::map
+  LabelImageType::BufferType *buf_a = img_a->GetBuffer(), *buf_b = img_b->GetBuffer();
+  LabelImageType::BufferType::RegionType lines = buf_a->GetBufferedRegion();
+  long ny = lines.GetSize(0), nlines = lines.GetNumberOfPixels();
+  std::mutex mutex;
+  TaskScheduler::GetInstance()->ParallelFor(
+        TaskScheduler::USER_COMPUTE, 0, nlines, [&](long first, long last)
+    {
+    ConfusionMap counts;
+    std::pair<LabelType, LabelType> cached_key(0, 0);
+    unsigned long *cached = &counts[cached_key];
+
+    for(long k = first; k < last; k++)
+      {
+      LabelImageType::BufferType::IndexType bi = lines.GetIndex();
+      bi[0] += k % ny;
+      bi[1] += k / ny;
+      const LabelImageType::RLLine &la = buf_a->GetPixel(bi), &lb = buf_b->GetPixel(bi);
+
+      // Walk the runs of both lines together
+      auto ia = la.begin(), ib = lb.begin();
+      long left_a = ia != la.end() ? ia->first : 0, left_b = ib != lb.end() ? ib->first : 0;
+      while(ia != la.end() && ib != lb.end())
+        {
+        long n = std::min(left_a, left_b);
+        std::pair<LabelType, LabelType> key(ia->second, ib->second);
+        if(key != cached_key)
+          {
+          cached_key = key;
+          cached = &counts[key];
+          }
+        *cached += n;
+
+        if((left_a -= n) == 0 && ++ia != la.end())
+          left_a = ia->first;
+        if((left_b -= n) == 0 && ++ib != lb.end())
+          left_b = ib->first;
+        }
+      }
+
+    std::lock_guard<std::mutex> guard(mutex);
+    for(const auto &c : counts)
+      if(c.second)
+        result[c.first] += c.second;
+    });
+
+  return true;
+}
+
+bool
+SegmentationStatistics
+::ComputeOverlap(LabelImageWrapper *seg, LabelImageWrapper *other)
+{
+  m_Overlap.clear();
+  if(!other)
+    return true;
+
+  ConfusionMap confusion;
+  if(!ComputeConfusion(seg, other, confusion))
+    return false;
+
+  for(const auto &c : confusion)
+    {
+    m_Overlap[c.first.first].count += c.second;
+    m_Overlap[c.first.second].other_count += c.second;
+    if(c.first.first == c.first.second)
+      m_Overlap[c.first.first].common_count += c.second;
+    }
+
+  const double *spacing = seg->GetImageBase()->GetSpacing().GetDataPointer();
+  double volVoxel = spacing[0] * spacing[1] * spacing[2];
+  for(auto &it : m_Overlap)
+    {
+    OverlapEntry &e = it.second;
+    double total = (double) e.count + e.other_count;
+    e.dice = total > 0 ? 2.0 * e.common_count / total : 0.0;
+    e.jaccard = total > e.common_count ? e.common_count / (total - e.common_count) : 0.0;
+    e.volume_difference_mm3 = ((double) e.other_count - (double) e.count) * volVoxel;
+    }
+
+  return true;
+}
+
+void
+SegmentationStatistics
+::ComputeSliceProfile(LabelImageWrapper *seg, int axis)
+{
+  SNAP_LATENCY_SCOPE(SNAPLatencyMonitor::STATISTICS);
+
+  LayerKey seg_key = { seg->GetUniqueId(), 0, seg->GetTimePointIndex() };
+  bool same = m_SliceProfileAxis == axis && seg_key == m_SliceProfileKey;
+  if(!same || !this->UpdateSliceProfileFromLabelChanges(seg))
+    {
+    // Start journaling label changes so that the next call is incremental
+    seg->SetLabelChangeJournalEnabled(true);
+    m_SliceProfileKey = seg_key;
+    m_SliceProfileAxis = axis;
+    this->ComputeSliceProfileFromScratch(seg, axis);
+    }
+  m_SliceProfileJournalSerial = seg->GetLabelChangeJournalEnd();
+
+  const double *spacing = seg->GetImageBase()->GetSpacing().GetDataPointer();
+  m_SliceProfileVoxelArea = spacing[(axis + 1) % 3] * spacing[(axis + 2) % 3];
+}
+
+void
+SegmentationStatistics
+::ClearSliceProfile()
+{
+  m_SliceProfile.clear();
+  m_SliceProfileAxis = -1;
+}
+
+void
+SegmentationStatistics
+::ComputeSliceProfileFromScratch(LabelImageWrapper *seg, int axis)
+{
+  m_SliceProfile.clear();
+
+  typedef LabelImageWrapper::ImageType LabelImageType;
+  const LabelImageType *img = seg->GetImage();
+  LabelImageType::BufferType *buf = img->GetBuffer();
+  LabelImageType::BufferType::RegionType lines = buf->GetBufferedRegion();
+  long nslices = img->GetBufferedRegion().GetSize(axis);
+  long ny = lines.GetSize(0), nlines = lines.GetNumberOfPixels();
+
+  // Each chunk of lines counts into a profile of its own, which is then added
+  // to the result. Along a line (axis 0) a run adds one voxel to each of the
+  // slices it crosses, so the changes in the count from one slice to the next
+  // are recorded instead, and added up at the end
+  std::mutex mutex;
+  TaskScheduler::GetInstance()->ParallelFor(
+        TaskScheduler::USER_COMPUTE, 0, nlines, [&](long first, long last)
+    {
+    std::map<LabelType, std::vector<long> > counts;
+    LabelType cached_label = 0;
+    std::vector<long> *cached = NULL;
+
+    for(long k = first; k < last; k++)
+      {
+      LabelImageType::BufferType::IndexType bi = lines.GetIndex();
+      long y = k % ny, z = k / ny;
+      bi[0] += y;
+      bi[1] += z;
+      const LabelImageType::RLLine &line = buf->GetPixel(bi);
+
+      long x = 0;
+      for(const auto &run : line)
+        {
+        if(run.second != 0)
+          {
+          if(!cached || run.second != cached_label)
+            {
+            cached_label = run.second;
+            cached = &counts[cached_label];
+            if(cached->empty())
+              cached->resize(nslices + 1, 0);
+            }
+
+          if(axis == 0)
+            {
+            (*cached)[x] += 1;
+            (*cached)[x + run.first] -= 1;
+            }
+          else
+            {
+            (*cached)[axis == 1 ? y : z] += run.first;
+            }
+          }
+        x += run.first;
+        }
+      }
+
+    std::lock_guard<std::mutex> guard(mutex);
+    for(auto &c : counts)
+      {
+      std::vector<unsigned long> &profile = m_SliceProfile[c.first];
+      if(profile.empty())
+        profile.resize(nslices, 0);
+
+      long sum = 0;
+      for(long i = 0; i < nslices; i++)
+        profile[i] += (axis == 0) ? (sum += c.second[i]) : c.second[i];
+      }
+    });
+}
+
+bool
+SegmentationStatistics
+::UpdateSliceProfileFromLabelChanges(LabelImageWrapper *seg)
+{
+  LabelImageWrapper::LabelChangeRunList runs;
+  if(!seg->GetLabelChangesSince(m_SliceProfileJournalSerial, runs))
+    return false;
+
+  itk::ImageRegion<3> region = seg->GetImageBase()->GetLargestPossibleRegion();
+  size_t nslices = region.GetSize(m_SliceProfileAxis);
+  long origin = region.GetIndex(m_SliceProfileAxis);
+  if(m_SliceProfile.size() && m_SliceProfile.begin()->second.size() != nslices)
+    return false;
+
+  // Move the voxels in each run from the old to the new label. Runs go along
+  // axis 0, so they either cross the slices or lie in one of them
+  for(auto &run : runs)
+    {
+    LabelType labels[] = { run.OldLabel, run.NewLabel };
+    for(int j = 0; j < 2; j++)
+      {
+      if(labels[j] == 0)
+        continue;
+
+      std::vector<unsigned long> &profile = m_SliceProfile[labels[j]];
+      if(profile.empty())
+        profile.resize(nslices, 0);
+
+      long start = run.Start[m_SliceProfileAxis] - origin;
+      long n = (m_SliceProfileAxis == 0) ? run.Length : 1;
+      unsigned long delta = (m_SliceProfileAxis == 0) ? 1 : run.Length;
+      if(start < 0 || start + n > (long) nslices)
+        return false;
+
+      for(long i = start; i < start + n; i++)
+        {
+        if(j == 1)
+          profile[i] += delta;
+        else if(profile[i] >= delta)
+          profile[i] -= delta;
+        else
+          return false;
+        }
+      }
+    }
+
+  // Remove the labels that are no longer present
+  for(SliceProfileMap::iterator it = m_SliceProfile.begin(); it != m_SliceProfile.end(); )
+    {
+    if(std::all_of(it->second.begin(), it->second.end(),
+                   [](unsigned long c) { return c == 0; }))
+      it = m_SliceProfile.erase(it);
+    else
+      ++it;
+    }
+
+  return true;
+}
+
 void 
 SegmentationStatistics
 ::ExportLegacy(ostream &fout, const ColorLabelTable &clt)
@@ -258,6 +755,14 @@ SegmentationStatistics
 
 void SegmentationStatistics
 ::Export(ostream &oss, const string &colsep, const ColorLabelTable &clt)
+{
+  ExportHeader(oss, colsep, m_ImageStatisticsColumnNames, m_Overlap.size() > 0);
+  ExportRows(oss, colsep, clt, "");
+}
+
+void SegmentationStatistics
+::ExportHeader(ostream &oss, const string &colsep, const vector<string> &columns,
+               bool overlap)
 {
   // Write out the header
   oss << "Label Id" << colsep;
@@ -266,24 +771,36 @@ void SegmentationStatistics
   oss << "Volume (mm^3)";
 
   // Print the list of column names
-  for(int i = 0; i < m_ImageStatisticsColumnNames.size(); i++)
+  for(int i = 0; i < columns.size(); i++)
     {
-    std::string colname = m_ImageStatisticsColumnNames[i];
+    std::string colname = columns[i];
     itksys::SystemTools::ReplaceString(colname, colsep.c_str(), " ");
 
     oss << colsep << "Image mean (" << colname << ")";
     oss << colsep << "Image stdev (" << colname << ")";
     }
 
+  if(overlap)
+    {
+    oss << colsep << "Dice";
+    oss << colsep << "Jaccard";
+    oss << colsep << "Volume difference (mm^3)";
+    }
+
   // Endline
   oss << std::endl;
+}
 
+void SegmentationStatistics
+::ExportRows(ostream &oss, const string &colsep, const ColorLabelTable &clt,
+             const string &prefix) const
+{
   // Write each row
-  for(EntryMap::iterator it = m_Stats.begin(); it != m_Stats.end(); ++it)
+  for(EntryMap::const_iterator it = m_Stats.begin(); it != m_Stats.end(); ++it)
     {
     LabelType i = it->first;
-    Entry &entry = it->second;
-    oss << i << colsep;
+    const Entry &entry = it->second;
+    oss << prefix << i << colsep;
 
     std::string label(clt.GetColorLabel(i).GetLabel());
     itksys::SystemTools::ReplaceString(label, colsep.c_str(), " ");
@@ -298,6 +815,15 @@ void SegmentationStatistics
       oss << colsep << entry.stdev[j];
       }
 
+    if(m_Overlap.size())
+      {
+      OverlapMap::const_iterator ito = m_Overlap.find(i);
+      OverlapEntry ov = ito != m_Overlap.end() ? ito->second : OverlapEntry();
+      oss << colsep << ov.dice;
+      oss << colsep << ov.jaccard;
+      oss << colsep << ov.volume_difference_mm3;
+      }
+
     oss << std::endl;
     }
 }
@@ -40,11 +40,14 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <functional>
 
 class GenericImageData;
+class FormattedTable;
 class ColorLabelTable;
 class ScalarImageWrapperBase;
 class IRISApplication;
+class LabelImageWrapper;
 
 namespace itk {
   template <unsigned int VDim> class ImageRegion;
@@ -82,9 +85,53 @@ public:
   /* A light-weight struct storing voxel count for each label */
   typedef std::map<LabelType, unsigned long> LabelVoxelCount;
 
-  /* Compute statistics from a segmentation image */
+  /* Number of voxels with each pair of labels (first image, second image) */
+  typedef std::map<std::pair<LabelType, LabelType>, unsigned long> ConfusionMap;
+
+  /* Overlap of a label between the segmentation and another segmentation */
+  struct OverlapEntry {
+    unsigned long count, other_count, common_count;
+    double dice, jaccard, volume_difference_mm3;
+    OverlapEntry()
+      : count(0), other_count(0), common_count(0),
+        dice(0), jaccard(0), volume_difference_mm3(0) {}
+  };
+
+  typedef std::map<LabelType, OverlapEntry> OverlapMap;
+
+  /* Number of voxels with each label (other than clear) in each slice */
+  typedef std::map<LabelType, std::vector<unsigned long> > SliceProfileMap;
+
+  /**
+   * Compute statistics from a segmentation image. If the statistics were
+   * computed previously for the same segmentation and the same gray images,
+   * and the segmentation has only been modified through undoable updates
+   * since then, the statistics are updated from the journal of label changes
+   * kept by the segmentation layer, rather than recomputed from scratch.
+   */
   void Compute(IRISApplication *app);
   
+  /** Called with the statistics of each time point, in order */
+  typedef std::function<void (unsigned int, const SegmentationStatistics &)>
+    TimePointCallback;
+
+  /**
+   * Compute statistics from every time point of the selected segmentation,
+   * each with the gray images at the same time point. The time points are
+   * computed concurrently, a few more than there are threads at a time, and
+   * the callback receives them in order on the calling thread, so that they
+   * can be written out without keeping all of them in memory.
+   */
+  static void ComputeAllTimePoints(IRISApplication *app, const TimePointCallback &callback);
+
+  /* Export the statistics of all time points to a CSV or text file, with the
+   * time point (starting at 1) in the first column */
+  static void ExportAllTimePoints(IRISApplication *app, std::ostream &oss,
+                                  const std::string &colsep);
+
+  /* Export the statistics of all time points to a table */
+  static void ExportAllTimePoints(IRISApplication *app, FormattedTable &table);
+
   /* Export to a text file using legacy format */
   void ExportLegacy(std::ostream &oss, const ColorLabelTable &clt);
 
@@ -100,6 +147,48 @@ public:
   /* A light-weight method only compute voxel counts for each label*/
   void GetVoxelCount(LabelVoxelCount &result, IRISApplication *app) const;
 
+  /**
+   * Count the voxels with each pair of labels in the current time points of
+   * two segmentations, merging the runs of their lines in parallel. Returns
+   * false if the segmentations do not have the same size.
+   */
+  static bool ComputeConfusion(LabelImageWrapper *seg, LabelImageWrapper *other,
+                               ConfusionMap &result);
+
+  /**
+   * Compare the segmentation with another one, computing the Dice and
+   * Jaccard overlap and the volume difference of each label. The overlap is
+   * exported with the statistics until it is cleared by passing nullptr.
+   * Returns false if the segmentations do not have the same size.
+   */
+  bool ComputeOverlap(LabelImageWrapper *seg, LabelImageWrapper *other);
+
+  const OverlapMap &GetOverlap() const
+    { return m_Overlap; }
+
+  /**
+   * Count the voxels of each label in every slice perpendicular to an image
+   * axis (0, 1 or 2) at the current time point of the segmentation, e.g., to
+   * find slices that were skipped in a manual segmentation. The counts are
+   * taken from the runs of the label image, several lines at a time. If the
+   * profile was computed before for the same segmentation and axis, it is
+   * updated from the journal of label changes instead, like Compute().
+   */
+  void ComputeSliceProfile(LabelImageWrapper *seg, int axis);
+
+  /* Clear the slice profile and stop updating it */
+  void ClearSliceProfile();
+
+  const SliceProfileMap &GetSliceProfile() const
+    { return m_SliceProfile; }
+
+  int GetSliceProfileAxis() const
+    { return m_SliceProfileAxis; }
+
+  /* Area of a voxel face in the slices of the profile, in mm^2 */
+  double GetSliceProfileVoxelArea() const
+    { return m_SliceProfileVoxelArea; }
+
 private:
 
   // Label statistics
@@ -107,14 +196,72 @@ private:
 
   // Column information
   std::vector<std::string> m_ImageStatisticsColumnNames;
-  
+
+  // Overlap with another segmentation, empty if not compared
+  OverlapMap m_Overlap;
+
+  // Identifies a gray image layer used to compute the statistics
+  struct LayerKey
+  {
+    unsigned long id, mtime, tp;
+    bool operator == (const LayerKey &other) const
+      { return id == other.id && mtime == other.mtime && tp == other.tp; }
+  };
+
+  // State needed to update the statistics incrementally
+  LayerKey m_CachedSegmentationKey;
+  std::vector<LayerKey> m_CachedGrayKeys;
+  unsigned long m_CachedJournalSerial = 0;
+  bool m_CacheValid = false;
+
+  // Slice profile, and the state needed to update it incrementally
+  SliceProfileMap m_SliceProfile;
+  int m_SliceProfileAxis = -1;
+  double m_SliceProfileVoxelArea = 0.0;
+  LayerKey m_SliceProfileKey;
+  unsigned long m_SliceProfileJournalSerial = 0;
+
+  // Count the slice profile from the runs of the image
+  void ComputeSliceProfileFromScratch(LabelImageWrapper *seg, int axis);
+
+  // Update the slice profile from a list of label changes
+  bool UpdateSliceProfileFromLabelChanges(LabelImageWrapper *seg);
+
+  // Find the gray images for statistics computation, and their column names
+  static void CollectLayers(GenericImageData *id,
+                            std::vector<ScalarImageWrapperBase *> &layers,
+                            std::vector<std::string> &columns,
+                            std::vector<LayerKey> *keys);
+
+  // Compute the statistics from all the voxels of a time point, or of the
+  // current time point if tp is negative
+  void ComputeFromScratch(LabelImageWrapper *seg,
+                          std::vector<ScalarImageWrapperBase *> &layers, int tp);
+
+  // Compute the means, deviations and volumes from the sums
+  void ComputeMeansAndVolumes(std::vector<ScalarImageWrapperBase *> &layers,
+                              double volVoxel);
+
+  // Write the header and the rows of an export
+  static void ExportHeader(std::ostream &oss, const std::string &colsep,
+                           const std::vector<std::string> &columns,
+                           bool overlap = false);
+  void ExportRows(std::ostream &oss, const std::string &colsep,
+                  const ColorLabelTable &clt, const std::string &prefix) const;
+
+  // Update the statistics from a list of label changes
+  bool UpdateFromLabelChanges(
+      LabelImageWrapper *seg,
+      std::vector<ScalarImageWrapperBase *> &layers);
+
   void RecordRunLength(
       size_t ngray,
       std::vector<ScalarImageWrapperBase *> &layers,
       itk::ImageRegion<3> &region,
       itk::Index<3> &runStart,
       long runLength,
-      Entry *cachedEntry);
+      Entry *cachedEntry,
+      int tp = -1);
 };
 
 #endif
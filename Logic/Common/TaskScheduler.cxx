@@ -0,0 +1,198 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+TaskScheduler *TaskScheduler::GetInstance()
+{
+  // Never destroyed, since the workers may still be running when static
+  // destructors are called
+  static TaskScheduler *instance = new TaskScheduler();
+  return instance;
+}
+
+TaskScheduler::TaskScheduler()
+{
+  m_NumberOfThreads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void TaskScheduler::SetNumberOfThreads(unsigned int n)
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  m_NumberOfThreads = n ? n : std::max(1u, std::thread::hardware_concurrency());
+
+  // Workers are started when tasks are queued, but the extra ones must be
+  // told to retire
+  if(m_NumberOfWorkers > m_NumberOfThreads)
+    m_Condition.notify_all();
+  else if(m_NumberOfWorkers > 0)
+    this->UpdateWorkers();
+}
+
+unsigned int TaskScheduler::GetNumberOfThreads() const
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  return m_NumberOfThreads;
+}
+
+void TaskScheduler::UpdateWorkers()
+{
+  // Workers are detached, they retire on their own when there are too many
+  while(m_NumberOfWorkers < m_NumberOfThreads)
+    {
+    std::thread(&TaskScheduler::WorkerLoop, this).detach();
+    m_NumberOfWorkers++;
+    }
+}
+
+void TaskScheduler::Enqueue(Priority priority, std::function<void ()> &&fn,
+                            const CancellationToken &token)
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  m_Queues[priority].push_back(Task { std::move(fn), token });
+  this->UpdateWorkers();
+  m_Condition.notify_one();
+}
+
+void TaskScheduler::Cancel(const CancellationToken &token)
+{
+  token.Cancel();
+
+  // The tasks are destroyed outside of the lock, since that releases the
+  // data they hold and makes their futures ready
+  std::vector<Task> removed;
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    for(auto &queue : m_Queues)
+      {
+      auto it = std::stable_partition(queue.begin(), queue.end(),
+                                      [&token](const Task &t) { return !(t.Token == token); });
+      std::move(it, queue.end(), std::back_inserter(removed));
+      queue.erase(it, queue.end());
+      }
+  }
+}
+
+void TaskScheduler::WorkerLoop()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while(true)
+    {
+    if(m_NumberOfWorkers > m_NumberOfThreads)
+      {
+      m_NumberOfWorkers--;
+      return;
+      }
+
+    // Take the oldest task of the most urgent class. Speculative tasks leave
+    // one of the workers free for the others
+    int priority = -1;
+    for(int p = 0; p < NUMBER_OF_PRIORITIES && priority < 0; p++)
+      {
+      if(m_Queues[p].empty())
+        continue;
+      if(p == SPECULATIVE && m_NumberOfThreads > 1
+         && m_RunningSpeculative + 1 >= m_NumberOfThreads)
+        continue;
+      priority = p;
+      }
+
+    if(priority < 0)
+      {
+      m_Condition.wait(lock);
+      continue;
+      }
+
+    Task task = std::move(m_Queues[priority].front());
+    m_Queues[priority].pop_front();
+    if(priority == SPECULATIVE)
+      m_RunningSpeculative++;
+
+    lock.unlock();
+    if(!task.Token.IsCancelled())
+      task.Run();
+    task = Task();
+    lock.lock();
+
+    if(priority == SPECULATIVE)
+      {
+      // A speculative task that was held back may now run
+      m_RunningSpeculative--;
+      if(m_Queues[SPECULATIVE].size())
+        m_Condition.notify_one();
+      }
+    }
+}
+
+void TaskScheduler::ParallelFor(Priority priority, long begin, long end,
+                                const std::function<void (long, long)> &fn)
+{
+  if(end <= begin)
+    return;
+
+  // Split the range in a few chunks per thread, so that threads that start
+  // late or that get the short chunks pick up the remaining ones
+  long n = end - begin;
+  long threads = (long) this->GetNumberOfThreads();
+  long grain = std::max(1l, (n + 4 * (threads + 1) - 1) / (4 * (threads + 1)));
+  long chunks = (n + grain - 1) / grain;
+  if(chunks == 1)
+    {
+    fn(begin, end);
+    return;
+    }
+
+  // The state is shared with the helper tasks, which may start after the
+  // loop is done. They only use the function after claiming a chunk, and
+  // the loop does not return before all chunks are done
+  struct State
+  {
+    std::atomic<long> Next { 0 }, Remaining { 0 };
+    std::atomic<bool> Failed { false };
+    std::exception_ptr Error;
+    std::mutex Mutex;
+    std::condition_variable Done;
+  };
+
+  auto state = std::make_shared<State>();
+  state->Remaining = chunks;
+  const std::function<void (long, long)> *body = &fn;
+
+  auto work = [state, body, begin, end, grain, chunks]()
+    {
+    for(long k = state->Next++; k < chunks; k = state->Next++)
+      {
+      if(!state->Failed)
+        {
+        try
+          {
+          (*body)(begin + k * grain, std::min(end, begin + (k + 1) * grain));
+          }
+        catch(...)
+          {
+          std::lock_guard<std::mutex> guard(state->Mutex);
+          if(!state->Failed.exchange(true))
+            state->Error = std::current_exception();
+          }
+        }
+
+      if(--state->Remaining == 0)
+        {
+        std::lock_guard<std::mutex> guard(state->Mutex);
+        state->Done.notify_all();
+        }
+      }
+    };
+
+  long helpers = std::min(threads, chunks - 1);
+  for(long i = 0; i < helpers; i++)
+    this->Enqueue(priority, work, CancellationToken());
+
+  work();
+
+  std::unique_lock<std::mutex> lock(state->Mutex);
+  state->Done.wait(lock, [&state]() { return state->Remaining == 0; });
+  if(state->Error)
+    std::rethrow_exception(state->Error);
+}
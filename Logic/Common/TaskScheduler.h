@@ -0,0 +1,140 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+/**
+ * A process-wide pool of worker threads that runs the background work of
+ * SNAP: building multiresolution pyramids, prefetching time points,
+ * computing meshes, registration and saving layers, as well as the parallel
+ * loops of the slicers.
+ *
+ * Tasks are queued by priority. Workers always take the oldest task of the
+ * most urgent class, so that interactive slicing is served first, then the
+ * computations that the user is waiting for, and speculative prefetching
+ * and caching only uses the cores that are otherwise idle. Speculative tasks
+ * never occupy all the workers, so a long prefetch can not delay the others.
+ *
+ * A task may be given a cancellation token. Cancelling the token removes
+ * the task from the queue if it has not started (its future then holds a
+ * std::future_error), and a running task can poll the token to stop early.
+ *
+ * The number of workers follows the --threads option. Unlike the futures
+ * returned by std::async, the futures of the scheduler do not wait for the
+ * task when they are destroyed: the owner of a task that refers to its
+ * members must wait for it, or cancel it, before they are destroyed.
+ */
+class TaskScheduler
+{
+public:
+  /** Priority classes, from most to least urgent */
+  enum Priority
+  {
+    // Work that an interaction is waiting for, e.g., extracting a slice
+    INTERACTIVE = 0,
+
+    // Computations requested by the user, e.g., meshes or registration
+    USER_COMPUTE,
+
+    // Work that may never be needed, e.g., pyramids and prefetching
+    SPECULATIVE,
+
+    NUMBER_OF_PRIORITIES
+  };
+
+  /**
+   * A flag shared between the owner of a task and the task itself. Copies
+   * of a token refer to the same flag.
+   */
+  class CancellationToken
+  {
+  public:
+    CancellationToken() : m_Flag(std::make_shared<std::atomic<bool> >(false)) {}
+
+    void Cancel() const { *m_Flag = true; }
+    bool IsCancelled() const { return *m_Flag; }
+
+    /** The flag itself, for code that polls an atomic<bool> */
+    std::atomic<bool> &GetFlag() const { return *m_Flag; }
+
+    bool operator == (const CancellationToken &other) const
+    { return m_Flag == other.m_Flag; }
+
+  private:
+    std::shared_ptr<std::atomic<bool> > m_Flag;
+  };
+
+  static TaskScheduler *GetInstance();
+
+  /**
+   * Set the number of worker threads. Zero selects the number of cores. The
+   * calling thread of ParallelFor() also works, so with one worker thread
+   * at most one task runs in the background.
+   */
+  void SetNumberOfThreads(unsigned int n);
+  unsigned int GetNumberOfThreads() const;
+
+  /** Queue a task and get a future for its result */
+  template <class TFunction>
+  std::future<typename std::invoke_result<typename std::decay<TFunction>::type &>::type>
+  Submit(Priority priority, TFunction &&fn,
+         const CancellationToken &token = CancellationToken())
+  {
+    typedef typename std::invoke_result<typename std::decay<TFunction>::type &>::type ResultType;
+    auto task = std::make_shared<std::packaged_task<ResultType()> >(
+          std::forward<TFunction>(fn));
+    std::future<ResultType> future = task->get_future();
+    this->Enqueue(priority, [task]() { (*task)(); }, token);
+    return future;
+  }
+
+  /**
+   * Cancel a token, and remove the tasks that were submitted with it and
+   * have not started yet
+   */
+  void Cancel(const CancellationToken &token);
+
+  /**
+   * Call fn(first, last) on consecutive subranges of [begin, end) in
+   * parallel, and return once all of them are done. The calling thread
+   * processes subranges too, so the loop completes even when all of the
+   * workers are busy. The first exception thrown by fn is rethrown.
+   */
+  void ParallelFor(Priority priority, long begin, long end,
+                   const std::function<void (long, long)> &fn);
+
+protected:
+  TaskScheduler();
+
+  void Enqueue(Priority priority, std::function<void ()> &&fn,
+               const CancellationToken &token);
+
+  // Start or retire workers to match the number of threads
+  void UpdateWorkers();
+
+  void WorkerLoop();
+
+  struct Task
+  {
+    std::function<void ()> Run;
+    CancellationToken Token;
+  };
+
+  std::deque<Task> m_Queues[NUMBER_OF_PRIORITIES];
+
+  unsigned int m_NumberOfThreads = 0, m_NumberOfWorkers = 0;
+  unsigned int m_RunningSpeculative = 0;
+
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_Condition;
+};
+
+#endif // TASKSCHEDULER_H
@@ -14,6 +14,20 @@ DefaultBehaviorSettings::DefaultBehaviorSettings()
 
   m_AutoContrastModel = NewSimpleProperty("AutoContrast", false);
 
+  m_MemoryMapImagesModel = NewSimpleProperty("MemoryMapImages", false);
+  m_LazyLoad4DImagesModel = NewSimpleProperty("LazyLoad4DImages", false);
+  m_BrickedSlicingModel = NewSimpleProperty("BrickedSlicing", false);
+  m_TimeMajorCopyModel = NewSimpleProperty("TimeMajorCopy", false);
+  m_CompressGreyImagesModel = NewSimpleProperty("CompressGreyImages", false);
+  m_CacheDerivedDataModel = NewSimpleProperty("CacheDerivedData", false);
+  m_ShareDecodedImagesModel = NewSimpleProperty("ShareDecodedImages", false);
+
+  RegistryEnumMap<FloatImageStorage> remStorage;
+  remStorage.AddPair(FLOAT_STORAGE_NATIVE, "Native");
+  remStorage.AddPair(FLOAT_STORAGE_INT16, "Int16");
+  remStorage.AddPair(FLOAT_STORAGE_UINT8, "UInt8");
+  m_FloatOverlayStorageModel = NewSimpleEnumProperty("FloatOverlayStorage", FLOAT_STORAGE_NATIVE, remStorage);
+
   // Permissions
   RegistryEnumMap<UpdateCheckingPermission> remUpdate;
   remUpdate.AddPair(UPDATE_NO, "No");
@@ -33,4 +47,13 @@ DefaultBehaviorSettings::DefaultBehaviorSettings()
   // Paintbrush defaults
   m_PaintbrushDefaultInitialSizeModel = NewRangedProperty("PaintbrushDefaultInitialSize", 8, 1, 10000, 1);
   m_PaintbrushDefaultMaximumSizeModel = NewRangedProperty("PaintbrushDefaultMaximumSize", 40, 10, 10000, 1);
+
+  // Continuous mesh update throttling
+  m_ContinuousMeshUpdateMaxLoadModel = NewRangedProperty("ContinuousMeshUpdateMaxLoad", 50, 10, 100, 10);
+
+  // Interactive volume rendering
+  m_VolumeRenderingTargetFrameRateModel = NewRangedProperty("VolumeRenderingTargetFrameRate", 15, 1, 60, 1);
+
+  // Memory budget, not enforced by default
+  m_MemoryBudgetModel = NewRangedProperty("MemoryBudget", 0, 0, 1024 * 1024, 256);
 }
@@ -22,6 +22,39 @@ public:
   irisSimplePropertyAccessMacro(SyncPan, bool)
   irisSimplePropertyAccessMacro(AutoContrast, bool)
 
+  // Map uncompressed images from disk instead of reading them into memory,
+  // so that opening them is immediate and voxels are paged in as needed
+  irisSimplePropertyAccessMacro(MemoryMapImages, bool)
+
+  // Map uncompressed 4D images from disk instead of reading them into memory,
+  // so that only the voxels of recently viewed time points stay resident
+  irisSimplePropertyAccessMacro(LazyLoad4DImages, bool)
+
+  // Keep a bricked copy of large images so that sagittal slices are read as
+  // fast as axial ones, at the cost of twice the memory
+  irisSimplePropertyAccessMacro(BrickedSlicing, bool)
+
+  // Keep a copy of 4D images with the time points of each voxel stored
+  // together, so that the time series at the cursor is read at once
+  irisSimplePropertyAccessMacro(TimeMajorCopy, bool)
+
+  // Keep the voxels of grey images compressed in memory while they are only
+  // viewed, restoring them when they are processed
+  irisSimplePropertyAccessMacro(CompressGreyImages, bool)
+
+  // Keep the statistics computed from the voxels of image files (intensity
+  // digest, histogram and range) on disk, so that reopening an image skips
+  // the pass over its voxels
+  irisSimplePropertyAccessMacro(CacheDerivedData, bool)
+
+  // Share the voxels of image files with the other SNAP sessions that open
+  // the same files, decoding compressed files only once
+  irisSimplePropertyAccessMacro(ShareDecodedImages, bool)
+
+  // Keep floating point overlays (probability maps, PET) quantized to 16 or 8
+  // bit integers in memory instead of storing them as float
+  irisSimplePropertyAccessMacro(FloatOverlayStorage, FloatImageStorage)
+
   // Permissions
   enum UpdateCheckingPermission {
     UPDATE_YES, UPDATE_NO, UPDATE_UNKNOWN
@@ -43,6 +76,19 @@ public:
   irisRangedPropertyAccessMacro(PaintbrushDefaultInitialSize, int)
   irisRangedPropertyAccessMacro(PaintbrushDefaultMaximumSize, int)
 
+  // Share of the time (percent) that continuous 3D mesh updates may keep a
+  // background thread busy; updates are spaced out to respect it
+  irisRangedPropertyAccessMacro(ContinuousMeshUpdateMaxLoad, int)
+
+  // Frame rate that volume rendering aims for while the 3D camera is moving.
+  // A coarser level of the image and a larger sampling distance are used
+  // until the camera stops
+  irisRangedPropertyAccessMacro(VolumeRenderingTargetFrameRate, int)
+
+  // Memory budget (MB) for the layers and caches, zero for no budget. When
+  // the budget is exceeded, caches are dropped and layer data is demoted
+  irisRangedPropertyAccessMacro(MemoryBudget, int)
+
 protected:
 
   // Default behaviors
@@ -53,6 +99,15 @@ protected:
   SmartPtr<ConcreteSimpleBooleanProperty> m_SyncZoomModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_SyncPanModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_AutoContrastModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_MemoryMapImagesModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_LazyLoad4DImagesModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_BrickedSlicingModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_TimeMajorCopyModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_CompressGreyImagesModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_CacheDerivedDataModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_ShareDecodedImagesModel;
+
+  SmartPtr<ConcretePropertyModel<FloatImageStorage> > m_FloatOverlayStorageModel;
 
   // Permissions
   SmartPtr<ConcretePropertyModel<UpdateCheckingPermission> > m_CheckForUpdatesModel;
@@ -67,6 +122,12 @@ protected:
   SmartPtr<ConcreteRangedIntProperty> m_PaintbrushDefaultInitialSizeModel;
   SmartPtr<ConcreteRangedIntProperty> m_PaintbrushDefaultMaximumSizeModel;
 
+  SmartPtr<ConcreteRangedIntProperty> m_ContinuousMeshUpdateMaxLoadModel;
+
+  SmartPtr<ConcreteRangedIntProperty> m_VolumeRenderingTargetFrameRateModel;
+
+  SmartPtr<ConcreteRangedIntProperty> m_MemoryBudgetModel;
+
   // Constructor
   DefaultBehaviorSettings();
 };
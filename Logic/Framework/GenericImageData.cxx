@@ -47,12 +47,14 @@
 #include <algorithm>
 #include <list>
 #include <map>
+#include <set>
 #include <iostream>
 #include "SNAPEventListenerCallbacks.h"
 #include "GenericImageData.h"
 #include "Rebroadcaster.h"
 #include "LayerIterator.h"
 #include "GuidedNativeImageIO.h"
+#include "DerivedDataCache.h"
 #include "ImageAnnotationData.h"
 #include "RLERegionOfInterestImageFilter.h"
 #include "TimePointProperties.h"
@@ -151,6 +153,7 @@ public:
   /** Function that actually creates the wrapper */
   template<typename TWrapperTraits, bool TLinearMapping> ImageWrapperBasePointer CreateFromTraits();
   template<typename TComponent, bool TLinearMapping> ImageWrapperBasePointer Create();
+  ImageWrapperBasePointer CreateQuantized(FloatImageStorage storage);
 
 private:
   GuidedNativeImageIO *io;
@@ -177,17 +180,22 @@ GenericImageDataWrapperCreator::CreateFromTraits()
   // Create a main wrapper of fixed type.
   SmartPtr<WrapperType> wrapper = WrapperType::New();
 
-  // Assign the image to the wrapper
-  wrapper->SetDisplayGeometry(*display_geometry);
-  wrapper->SetImage4D(image, ref_space, transform);
-
-  // Create a mapper to native intensity
-  if(TLinearMapping)
+  // Map the quantized values back to native intensity. This is set before the
+  // image so that the histogram and display range are computed in native units
+  if constexpr(TLinearMapping)
     {
     LinearInternalToNativeIntensityMapping mapper(
           rescaler.GetNativeScale(), rescaler.GetNativeShift());
+    wrapper->SetNativeMapping(mapper);
     }
 
+  // Assign the image to the wrapper
+  wrapper->SetDisplayGeometry(*display_geometry);
+  wrapper->SetImage4D(image, ref_space, transform);
+
+  // Reuse the statistics computed when the same file was last opened
+  wrapper->SetDerivedDataCacheKey(DerivedDataCache::ComputeKey(io->GetFileNameOfNativeImage()));
+
   // Return the wrapper
   return wrapper.GetPointer();
 }
@@ -209,6 +217,16 @@ GenericImageDataWrapperCreator::Create()
     }
 }
 
+typename GenericImageDataWrapperCreator::ImageWrapperBasePointer
+GenericImageDataWrapperCreator::CreateQuantized(FloatImageStorage storage)
+{
+  // The image is rescaled to the range of the compact type
+  if(storage == FLOAT_STORAGE_UINT8)
+    return CreateFromTraits<QuantizedImageWrapperTraits<unsigned char>::ScalarTraits, true>();
+  else
+    return CreateFromTraits<QuantizedImageWrapperTraits<short>::ScalarTraits, true>();
+}
+
 SmartPtr<ImageWrapperBase>
 GenericImageData::CreateAnatomicWrapper(GuidedNativeImageIO *io, ITKTransformType *transform)
 {
@@ -221,6 +239,11 @@ GenericImageData::CreateAnatomicWrapper(GuidedNativeImageIO *io, ITKTransformTyp
   // The object used to create the wrapper of correct type
   GenericImageDataWrapperCreator c(io, refSpace, transform, &m_DisplayGeometry);
 
+  // Scalar images that would be stored as floating point may be quantized
+  FloatImageStorage storage = io->GetFloatImageStorage();
+  bool quantize = storage != FLOAT_STORAGE_NATIVE
+                  && io->GetNumberOfComponentsInNativeImage() == 1;
+
   // Create the wrapper to match native type
   switch(io->GetComponentTypeInNativeImage())
     {
@@ -228,8 +251,12 @@ GenericImageData::CreateAnatomicWrapper(GuidedNativeImageIO *io, ITKTransformTyp
     case itk::IOComponentEnum::CHAR:   out_wrapper = c.Create<char, false>();            break;
     case itk::IOComponentEnum::USHORT: out_wrapper = c.Create<unsigned short, false>();  break;
     case itk::IOComponentEnum::SHORT:  out_wrapper = c.Create<short, false>();           break;
-    case itk::IOComponentEnum::DOUBLE:  out_wrapper = c.Create<double, false>();         break;
-    default: out_wrapper = c.Create<float, false>();                                     break;
+    case itk::IOComponentEnum::DOUBLE:
+      out_wrapper = quantize ? c.CreateQuantized(storage) : c.Create<double, false>();
+      break;
+    default:
+      out_wrapper = quantize ? c.CreateQuantized(storage) : c.Create<float, false>();
+      break;
     }
 
   // Additional configuration for the wrapper
@@ -375,6 +402,13 @@ GenericImageData
         m_MainImageWrapper->IsInitialized(),
         "Main image not initialized in GenericImageData::CompressSegmentation");
 
+  return CompressSegmentation(io, this->GetMain()->GetImage4DBase());
+}
+
+SmartPtr<GenericImageData::LabelImage4DType>
+GenericImageData
+::CompressSegmentation(GuidedNativeImageIO *io, const itk::ImageBase<4> *reference)
+{
   // This is the uncompressed representation of the segmentation
   typedef itk::Image<LabelType, 4> UncompressedImage4DType;
 
@@ -396,9 +430,9 @@ GenericImageData
   imgLabel->DisconnectPipeline();
 
   // The header of the label image is made to match that of the grey image
-  imgLabel->SetOrigin(this->GetMain()->GetImage4DBase()->GetOrigin());
-  imgLabel->SetSpacing(this->GetMain()->GetImage4DBase()->GetSpacing());
-  imgLabel->SetDirection(this->GetMain()->GetImage4DBase()->GetDirection());
+  imgLabel->SetOrigin(reference->GetOrigin());
+  imgLabel->SetSpacing(reference->GetSpacing());
+  imgLabel->SetDirection(reference->GetDirection());
 
   // Return the image
   return imgLabel;
@@ -575,10 +609,20 @@ GenericImageData
       // We can simply use modulo to make this work
       unsigned int tp = time_point % lit.GetLayer()->GetNumberOfTimePoints();
       lit.GetLayer()->SetTimePointIndex(tp);
+      lit.GetLayer()->PrefetchTimePointSlices(TIME_POINT_PREFETCH_COUNT);
       }
     }
 }
 
+void
+GenericImageData
+::PrefetchAdjacentSlices(unsigned int dim, int step, unsigned int n_ahead)
+{
+  for(LayerIterator lit(this, MAIN_ROLE | OVERLAY_ROLE); !lit.IsAtEnd(); ++lit)
+    if(lit.GetLayer() && lit.GetLayer()->IsInitialized())
+      lit.GetLayer()->PrefetchAdjacentSlices(dim, step, n_ahead);
+}
+
 void GenericImageData::SetDisplayGeometry(const IRISDisplayGeometry &dispGeom)
 {
   m_DisplayGeometry = dispGeom;
@@ -698,6 +742,28 @@ std::list<ImageWrapperBase *> GenericImageData::FindLayersByRole(int role_filter
   return retval;
 }
 
+void GenericImageData::ProbeLayersUnderCursor(int role_filter, LayerProbeMap &probes)
+{
+  std::set<unsigned long> probed;
+  for(LayerIterator it = this->GetLayers(role_filter); !it.IsAtEnd(); ++it)
+    {
+    if(it.GetLayer()->IsInitialized())
+      {
+      LayerProbe &probe = probes[it.GetLayer()->GetUniqueId()];
+      it.GetLayer()->GetVoxelUnderCursorDisplayedValueAndAppearance(
+            probe.Value, probe.Appearance);
+      probed.insert(it.GetLayer()->GetUniqueId());
+      }
+    }
+
+  for(auto it = probes.begin(); it != probes.end(); )
+    {
+    if(probed.count(it->first))
+      ++it;
+    else
+      it = probes.erase(it);
+    }
+}
 
 int GenericImageData::GetNumberOfOverlays()
 {
@@ -176,6 +176,23 @@ public:
    */
   std::list<ImageWrapperBase *> FindLayersByRole(int role_filter = ALL_ROLES);
 
+  /** Value and appearance of the voxel under the cursor in one layer */
+  struct LayerProbe
+  {
+    vnl_vector<double> Value;
+    ImageWrapperBase::DisplayPixelType Appearance;
+  };
+  typedef std::map<unsigned long, LayerProbe> LayerProbeMap;
+
+  /**
+   * Sample the displayed value and appearance of the voxel under the cursor
+   * in all initialized layers with the given roles, in one pass over the
+   * layers. The probes are keyed by layer id. Existing entries are reused so
+   * that their storage is not reallocated on every cursor move, and entries
+   * for layers that are gone are removed.
+   */
+  void ProbeLayersUnderCursor(int role_filter, LayerProbeMap &probes);
+
   int GetNumberOfOverlays();
 
   /**
@@ -307,10 +324,23 @@ public:
   virtual void SetCrosshairs(const Vector3ui &crosshairs);
 
   /**
-   * Set the time point selected
+   * Set the time point selected. The slices of the next few time points
+   * are then computed in the background, so that stepping forward through
+   * time (cine playback) does not wait on slicing.
    */
   virtual void SetTimePoint(unsigned int time_point);
 
+  /** How many time points ahead of the current one are sliced in advance */
+  static constexpr unsigned int TIME_POINT_PREFETCH_COUNT = 4;
+
+  /**
+   * Compute, in the background, the next n_ahead slices in display direction
+   * dim of the anatomical layers, step voxels apart. This is used to keep
+   * ahead of the user scrolling through slices. Segmentation and other
+   * layers that are edited in place are sliced on demand.
+   */
+  virtual void PrefetchAdjacentSlices(unsigned int dim, int step, unsigned int n_ahead);
+
   /**
    * Set the display to anatomy coordinate mapping, and propagate it to
    * all of the loaded layers
@@ -347,6 +377,11 @@ public:
 
   // Helper method used to compress a loaded segmentation into an RLE 4D image
   SmartPtr<LabelImage4DType> CompressSegmentation(GuidedNativeImageIO *io);
+
+  // Same, with the header taken from a reference image rather than the main
+  // image. This does not access the layers, so it can run in a background thread
+  static SmartPtr<LabelImage4DType> CompressSegmentation(
+      GuidedNativeImageIO *io, const itk::ImageBase<4> *reference);
 protected:
 
   GenericImageData();
@@ -94,6 +94,9 @@ GlobalState
   m_PaintbrushSettings.chase = false;
   m_PaintbrushSettings.watershed.level = 0.2;
   m_PaintbrushSettings.watershed.smooth_iterations = 15;
+  m_PaintbrushSettings.flood_fill.use_intensity_window = false;
+  m_PaintbrushSettings.flood_fill.lower = 0.0;
+  m_PaintbrushSettings.flood_fill.upper = 0.0;
 
 
   m_PolygonDrawingContextMenuModel = NewSimpleConcreteProperty(false);
@@ -93,7 +93,8 @@ enum PaintbrushMode
 {
   PAINTBRUSH_RECTANGULAR = 0,
   PAINTBRUSH_ROUND = 1,
-  PAINTBRUSH_WATERSHED = 2
+  PAINTBRUSH_WATERSHED = 2,
+  PAINTBRUSH_FLOOD_FILL = 3
 };
   
 enum DisplayPanel
@@ -146,6 +147,16 @@ struct PaintbrushWatershedSettings
 
 };
 
+/** Flood fill settings for paintbrush */
+struct PaintbrushFloodFillSettings
+{
+  // Whether the fill is limited to an intensity range of the grey image
+  bool use_intensity_window;
+
+  // The intensity range, in native units
+  double lower, upper;
+};
+
 /** Paintbrush settings */
 struct PaintbrushSettings
 {
@@ -156,6 +167,7 @@ struct PaintbrushSettings
   bool chase;
 
   PaintbrushWatershedSettings watershed;
+  PaintbrushFloodFillSettings flood_fill;
 };
 
 /** Annotation settings */
@@ -42,11 +42,13 @@
 #include "IRISApplication.h"
 #include "GlobalState.h"
 #include "GuidedNativeImageIO.h"
+#include "DerivedDataCache.h"
 #include "IRISImageData.h"
 #include "IRISVectorTypesToITKConversion.h"
 #include "SNAPImageData.h"
 #include "MeshManager.h"
 #include "MeshExportSettings.h"
+#include "MultiLabelMeshPipeline.h"
 #include "SegmentationStatistics.h"
 #include "RLEImageRegionIterator.h"
 #include "itkPasteImageFilter.h"
@@ -60,9 +62,7 @@
 #include "itkFlipImageFilter.h"
 #include "itkConstantBoundaryCondition.h"
 #include <itksys/SystemTools.hxx>
-#include "vtkAppendPolyData.h"
-#include "vtkUnsignedShortArray.h"
-#include "vtkPointData.h"
+#include "vtkPolyData.h"
 #include "SNAPRegistryIO.h"
 #include "Rebroadcaster.h"
 #include "HistoryManager.h"
@@ -84,14 +84,27 @@
 #include "LabelUseHistory.h"
 #include "ImageAnnotationData.h"
 #include "SegmentationUpdateIterator.h"
+#include "RLEConnectedComponents.h"
+#include "SegmentationRecoveryJournal.h"
 #include "AffineTransformHelper.h"
 #include "TimePointProperties.h"
 #include "ImageMeshLayers.h"
 #include "StandaloneMeshWrapper.h"
 #include "AllPurposeProgressAccumulator.h"
+#include "MemoryAccounting.h"
+#include "ProgressToken.h"
+#include "TaskScheduler.h"
+#include "SNAPLatencyMonitor.h"
+#include "itkImageDuplicator.h"
 
 #include <stdio.h>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
 #include <iomanip>
 
 IRISApplication
@@ -101,6 +114,13 @@ IRISApplication
   m_SystemInterface = new SystemInterface();
   m_HistoryManager = m_SystemInterface->GetHistoryManager();
 
+  // Cache parsed DICOM headers in the user's data directory
+  GuidedNativeImageIO::SetDicomHeaderCacheDirectory(
+        m_SystemInterface->GetDicomHeaderCacheDirectory());
+
+  // Cache statistics of image files there too, if the user enables it
+  DerivedDataCache::SetDirectory(m_SystemInterface->GetDerivedDataCacheDirectory());
+
   // Create a color map preset manager
   m_ColorMapPresetManager = ColorMapPresetManager::New();
   m_ColorMapPresetManager->Initialize(m_SystemInterface);
@@ -122,6 +142,9 @@ IRISApplication
   // Set the current IRIS pointer
   m_CurrentImageData = m_IRISImageData.GetPointer();
 
+  // The recovery journal is created when the main image is loaded
+  m_RecoveryJournal = NULL;
+
   // Listen to events from wrappers and image data objects and refire them
   // as our own events.
   Rebroadcaster::RebroadcastAsSourceEvent(m_IRISImageData, WrapperChangeEvent(), this);
@@ -161,6 +184,10 @@ IRISApplication
   m_LastUsedRFClassifierComponents = 0;
 
   m_PreprocessingMode = PREPROCESS_NONE;
+  m_DeferredSpeedMode = PREPROCESS_NONE;
+  m_SpeedPreprocessingMode = PREPROCESS_NONE;
+  m_SpeedActiveScalarLayer = NULL;
+  m_DeferredAutoContrastLayers = NULL;
 
   // Initialize the mesh management object
   m_MeshManager = MeshManager::New();
@@ -193,6 +220,7 @@ GetImageToAnatomyRAI()
 IRISApplication
 ::~IRISApplication() 
 {
+  delete m_RecoveryJournal;
   delete m_SystemInterface;
 }
 
@@ -203,33 +231,53 @@ IRISApplication
 {
   assert(m_IRISImageData->IsMainLoaded());
 
-  // Create the SNAP image data object
-  m_SNAPImageData->InitializeToROI(m_IRISImageData, roi, progressCommand);
-  
+  // The speed image of the last segmentation may still be in progress
+  this->EndDeferredSpeedVolume();
+
   // Override the interpolator in ROI for label interpolation, or we will get
   // nonsense
   SNAPSegmentationROISettings roiLabel = roi;
   roiLabel.SetInterpolationMethod(NEAREST_NEIGHBOR);
 
-  // Get chunk of the label image. Only the selected segmentation layer gets sent to SNAP
+  // Get chunk of the label image. Only the selected segmentation layer gets
+  // sent to SNAP. This is done concurrently with the extraction of the
+  // anatomical layers below, which report the progress
   LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
-  LabelImageType::Pointer imgNewLabel = seg->DeepCopyRegion(roiLabel,progressCommand);
+  std::future<LabelImageType::Pointer> futureLabel = std::async(
+        std::launch::async, [seg, roiLabel]()
+        { return seg->DeepCopyRegion(roiLabel, nullptr); });
+
+  // Create the SNAP image data object
+  m_SNAPImageData->InitializeToROI(m_IRISImageData, roi, progressCommand);
+
+  LabelImageType::Pointer imgNewLabel = futureLabel.get();
 
   // Filter the segmentation image to only allow voxels of 0 intensity and 
-  // of the current drawing color
+  // of the current drawing color. This is done on the runs of each line
   LabelType passThroughLabel = m_GlobalState->GetDrawingColorLabel();
+  bool keepLabel = roi.IsSeedWithCurrentSegmentation();
 
-  typedef itk::ImageRegionIterator<LabelImageType> IteratorType;
-  IteratorType itLabel(imgNewLabel,imgNewLabel->GetBufferedRegion());
-  unsigned int nCopied = 0;
-  while(!itLabel.IsAtEnd())
+  typedef LabelImageType::RLLine RLLine;
+  std::atomic<unsigned long> nCopied(0);
+  imgNewLabel->ParallelForEachLine(
+        imgNewLabel->GetBufferedRegion(),
+        [passThroughLabel, keepLabel, &nCopied](RLLine &line, const LabelImageType::IndexType &)
     {
-    if(itLabel.Get() != passThroughLabel || !roi.IsSeedWithCurrentSegmentation())
-      itLabel.Set((LabelType) 0);
-    else
-      nCopied++;
-    ++itLabel;
-    }
+    RLLine out;
+    unsigned long nLine = 0;
+    for(const auto &run : line)
+      {
+      LabelType value = (keepLabel && run.second == passThroughLabel) ? passThroughLabel : 0;
+      if(value)
+        nLine += run.first;
+      if(out.size() && out.back().second == value)
+        out.back().first += run.first;
+      else
+        out.push_back(std::make_pair(run.first, value));
+      }
+    line.swap(out);
+    nCopied += nLine;
+    });
 
   // Record whether the segmentation has any values that are not zero
   m_GlobalState->SetSnakeInitializedWithManualSegmentation(nCopied > 0);
@@ -289,6 +337,10 @@ IRISApplication
   // Send the speed image to the image data
   m_SNAPImageData->GetSpeed()->UpdateTimePoint(newSpeedImage);
 
+  // The speed image can not be computed for other time points
+  m_SpeedPreprocessingMode = PREPROCESS_NONE;
+  m_SpeedActiveScalarLayer = NULL;
+
   // Save the snake mode 
   m_GlobalState->SetSnakeType(snakeMode);
 
@@ -323,6 +375,9 @@ void IRISApplication::UnloadSegmentation(ImageWrapperBase *seg)
      m_IRISImageData->GetFirstSegmentationLayer()->GetUniqueId());
     }
 
+  // The journal follows the selected segmentation
+  this->AttachSegmentationRecoveryJournal();
+
   // Fire the appropriate event
   InvokeEvent(SegmentationChangeEvent());
 }
@@ -335,6 +390,7 @@ void IRISApplication::AddBlankSegmentation()
   // Add the blank layer and set it as selected
   LabelImageWrapper *new_seg = m_IRISImageData->AddBlankSegmentation();
   m_GlobalState->SetSelectedSegmentationLayerId(new_seg->GetUniqueId());
+  this->AttachSegmentationRecoveryJournal();
 
   // Fire the appropriate event
   InvokeEvent(SegmentationChangeEvent());
@@ -422,29 +478,24 @@ IRISApplication
 
 void IRISApplication::SetColorLabelsInSegmentationAsValid(LabelImageWrapper *seg_wrapper)
 {
-  // Iterate over the RLEs in the label image
+  // Scan the RLE lines of the label image in parallel, flagging each label
+  // that occurs in the image
   typedef LabelImageWrapperTraits::Image4DType LabelImage4DType;
-  typedef itk::ImageRegionConstIterator<LabelImage4DType::BufferType> RLLineIter;
-  RLLineIter rlit(seg_wrapper->GetImage4D()->GetBuffer(),
-                  seg_wrapper->GetImage4D()->GetBuffer()->GetBufferedRegion());
+  LabelImage4DType *image = seg_wrapper->GetImage4D();
+  std::vector<std::atomic<bool>> found(
+        (size_t) std::numeric_limits<LabelType>::max() + 1);
 
-  LabelType last_label = 0;
-  for(; !rlit.IsAtEnd(); ++rlit)
+  image->ParallelForEachLine(
+        image->GetBufferedRegion(),
+        [&found](const LabelImage4DType::RLLine &line, const LabelImage4DType::IndexType &)
     {
-    // Get the line
-    const LabelImageType::RLLine &line = rlit.Value();
-
-    // Iterate over the entries
     for(unsigned int i = 0; i < line.size(); i++)
-      {
-      LabelType label = line[i].second;
-      if(label != last_label)
-        {
-        m_ColorLabelTable->SetColorLabelValid(label, true);
-        last_label = label;
-        }
-      }
-    }
+      found[line[i].second] = true;
+    });
+
+  for(size_t label = 0; label < found.size(); label++)
+    if(found[label])
+      m_ColorLabelTable->SetColorLabelValid((LabelType) label, true);
 }
 
 
@@ -517,6 +568,9 @@ IRISApplication
   // Iterate over the RLEs in the label image
   this->SetColorLabelsInSegmentationAsValid(seg_wrapper);
 
+  // Start the journal over with the loaded segmentation
+  this->AttachSegmentationRecoveryJournal();
+
   // Let the GUI know that segmentation changed
   InvokeEvent(SegmentationChangeEvent());
 
@@ -563,9 +617,40 @@ IRISApplication
     double zSlice,
     const std::string &undoTitle)
 {
+  // Drawing parameters
+  bool invert = m_GlobalState->GetPolygonInvert();
+
   // Turn the 2D region of the drawing into a 3D region in the segmentation
   IRISApplication::SliceBinaryImageType::RegionType r_draw = drawing->GetBufferedRegion();
 
+  // Unless the drawing is inverted, only the pixels that were drawn can change
+  // the segmentation, so the update can be limited to their bounding box
+  if(!invert)
+    {
+    long x0 = r_draw.GetSize()[0], x1 = -1, y0 = r_draw.GetSize()[1], y1 = -1;
+    const SliceBinaryImageType::PixelType *p = drawing->GetBufferPointer();
+    for(long y = 0; y < (long) r_draw.GetSize()[1]; y++)
+      {
+      for(long x = 0; x < (long) r_draw.GetSize()[0]; x++, p++)
+        {
+        if(*p)
+          {
+          x0 = std::min(x0, x); x1 = std::max(x1, x);
+          y0 = std::min(y0, y); y1 = std::max(y1, y);
+          }
+        }
+      }
+
+    if(x1 < 0)
+      return 0;
+
+    SliceBinaryImageType::IndexType i_lo = r_draw.GetIndex(), i_hi = r_draw.GetIndex();
+    i_lo[0] += x0; i_lo[1] += y0;
+    i_hi[0] += x1; i_hi[1] += y1;
+    r_draw.SetIndex(i_lo);
+    r_draw.SetUpperIndex(i_hi);
+    }
+
   // Array of corners of the drawing region
   Vector2ui corners[4];
   corners[0][0] = r_draw.GetIndex()[0];
@@ -612,9 +697,6 @@ IRISApplication
                                    m_GlobalState->GetDrawingColorLabel(),
                                    m_GlobalState->GetDrawOverFilter());
 
-  // Drawing parameters
-  bool invert = m_GlobalState->GetPolygonInvert();
-
   // Inverse transform
   ImageCoordinateTransform::Pointer xfmImageToSlice = ImageCoordinateTransform::New();
   xfmSliceToImage->ComputeInverse(xfmImageToSlice);
@@ -690,14 +772,22 @@ IRISApplication
 ::UpdateIRISWithSnapImageData(CommandType *progressCommand)
 {
   assert(IsSnakeModeActive());
+  this->MergeLevelSetWithIRIS(m_SNAPImageData->GetSnake()->GetImage(),
+                              progressCommand, "Automatic Segmentation");
+}
 
+void
+IRISApplication
+::MergeLevelSetWithIRIS(const LevelSetImageWrapper::ImageType *levelset,
+                        CommandType *progressCommand, const char *undoName)
+{
   // Get pointers to the source and destination images
   typedef LevelSetImageWrapper::ImageType SourceImageType;
   typedef LabelImageWrapper::ImageType TargetImageType;
 
   // If the voxel size of the image does not match the voxel size of the 
   // main image, we need to resample the region  
-  SourceImageType::ConstPointer source = m_SNAPImageData->GetSnake()->GetImage();
+  SourceImageType::ConstPointer source = levelset;
 
   // The target segmentation is whatever was last selected in IRIS, which we stored
   // in a local variable before entering SNAP mode
@@ -776,35 +866,44 @@ IRISApplication
     source = fltSample->GetOutput();
     }  
 
-  // Creat the source iterator
-  typedef itk::ImageRegionConstIterator<SourceImageType> SourceIteratorType;
-  SourceIteratorType itSource(source,source->GetLargestPossibleRegion());
-
-  // Create the smart target iterator
-  SegmentationUpdateIterator itTarget(
+  // Create the run-length writer for the target segmentation
+  SegmentationRunWriter writer(
         iris_seg, roi.GetROI(),
         m_GlobalState->GetDrawingColorLabel(), m_GlobalState->GetDrawOverFilter());
 
   // Inversion state
   bool invert = m_GlobalState->GetPolygonInvert();
 
-  // Go through both iterators, copy the new over the old
-  while(!itSource.IsAtEnd())
+  // Threshold each line of the level set into runs of foreground and
+  // background, and merge them into the target segmentation
+  const itk::ImageRegion<3> &rSource = source->GetBufferedRegion();
+  const float *pSource = source->GetBufferPointer();
+  unsigned int nx = rSource.GetSize(0);
+  SegmentationRunWriter::UpdateLine update;
+  for(unsigned int z = 0; z < rSource.GetSize(2); z++)
     {
-    // Get the level set value
-    float voxSNAP = itSource.Value();
-    if((!invert && voxSNAP <= 0) || (invert && voxSNAP >= 0))
-      itTarget.PaintAsForeground();
-    else
-      itTarget.PaintAsBackground();
+    for(unsigned int y = 0; y < rSource.GetSize(1); y++, pSource += nx)
+      {
+      update.clear();
+      for(unsigned int x = 0; x < nx; x++)
+        {
+        float voxSNAP = pSource[x];
+        SegmentationUpdateIterator::UpdateType type =
+            ((!invert && voxSNAP <= 0) || (invert && voxSNAP >= 0))
+            ? SegmentationUpdateIterator::FOREGROUND
+            : SegmentationUpdateIterator::BACKGROUND;
+        if(update.size() && update.back().second == type)
+          update.back().first++;
+        else
+          update.push_back(std::make_pair(1u, type));
+        }
 
-    // Iterate
-    ++itSource;
-    ++itTarget;
+      writer.PaintLine(roi.GetROI().GetIndex(1) + y, roi.GetROI().GetIndex(2) + z, update);
+      }
     }
 
   // Finalize the segmentation and store undo point
-  if(itTarget.Finalize("Automatic Segmentation"))
+  if(writer.Finalize(undoName))
     {
     RecordCurrentLabelUse();
     InvokeEvent(SegmentationChangeEvent());
@@ -840,6 +939,9 @@ IRISApplication
     {
     this->GetCurrentImageData()->SetTimePoint(time_point);
 
+    // Time points that are no longer viewed may be paged out
+    this->EnforceMemoryBudget();
+
     // Fire the appropriate event
     InvokeEvent(CursorUpdateEvent());
     InvokeEvent(CursorTimePointUpdateEvent());
@@ -847,6 +949,23 @@ IRISApplication
     }
 }
 
+void
+IRISApplication
+::EnforceMemoryBudget()
+{
+  // Grey images whose voxels were restored for processing are compressed
+  // again once they are no longer in use
+  LayerIterator it = this->GetCurrentImageData()->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
+  for(; !it.IsAtEnd(); ++it)
+    if(it.GetLayer()->IsCompressedStorage())
+      it.GetLayer()->CompressImageData();
+
+  size_t budget_mb = (size_t) m_GlobalState->GetDefaultBehaviorSettings()->GetMemoryBudget();
+  MemoryAccounting *ma = MemoryAccounting::GetInstance();
+  ma->SetBudget(budget_mb * 1024 * 1024);
+  ma->EnforceBudget();
+}
+
 unsigned int
 IRISApplication
 ::GetCursorTimePoint() const
@@ -877,6 +996,28 @@ IRISApplication
         m_GlobalState->GetDrawOverFilter());
 }
 
+void
+IRISApplication
+::ReloadGreyImageWrapperFromFile(ImageWrapperBase *wrapper)
+{
+  SmartPtr<ReloadAnatomicWrapperDelegate> delegate = ReloadAnatomicWrapperDelegate::New();
+  IRISWarningList wl;
+  delegate->Initialize(this, wrapper);
+  delegate->ValidateHeader(wl);
+  delegate->UpdateWrapper();
+}
+
+void
+IRISApplication
+::ReloadSegmentationWrapperFromFile(ImageWrapperBase *wrapper)
+{
+  SmartPtr<ReloadSegmentationWrapperDelegate> delegate = ReloadSegmentationWrapperDelegate::New();
+  IRISWarningList wl;
+  delegate->Initialize(this, wrapper);
+  delegate->ValidateHeader(wl);
+  delegate->UpdateWrapper();
+}
+
 void
 IRISApplication
 ::ClearUndoPoints()
@@ -927,6 +1068,9 @@ IRISApplication
   assert(m_SNAPImageData->IsMainLoaded() &&
          m_CurrentImageData != m_SNAPImageData);
 
+  this->EndDeferredSpeedVolume();
+  m_SpeedPreprocessingMode = PREPROCESS_NONE;
+  m_SpeedActiveScalarLayer = NULL;
   m_SNAPImageData->UnloadAll();
 }
 
@@ -1047,16 +1191,23 @@ IRISApplication
   // Find the slicer that slices along that direction
   typedef ImageWrapperBase::DisplaySliceType SliceType;
   SmartPtr<SliceType> imgGrey = NULL;
+  ImageWrapperBase *main = m_CurrentImageData->GetMain();
+  size_t iDisplay = 0;
   for(size_t i = 0; i < 3; i++)
     {
-    if(iSliceImg == m_CurrentImageData->GetMain()->GetDisplaySliceImageAxis(i))
+    if(iSliceImg == main->GetDisplaySliceImageAxis(i))
       {
-      imgGrey = m_CurrentImageData->GetMain()->GetDisplaySlice(i);
+      imgGrey = main->GetDisplaySlice(i);
+      iDisplay = i;
       break;
       }
     }
   assert(imgGrey);
 
+  // The whole slice is exported, even if only the part in view is displayed
+  bool restricted = main->IsSlicingRestrictedToViewport(iDisplay);
+  main->SetSlicingRestrictedToViewport(iDisplay, false);
+
   // Flip the image in the Y direction
   typedef itk::FlipImageFilter<SliceType> FlipFilter;
   FlipFilter::Pointer fltFlip = FlipFilter::New();
@@ -1072,6 +1223,173 @@ IRISApplication
   writer->SetInput(fltFlip->GetOutput());
   writer->SetFileName(file);
   writer->Update();
+
+  main->SetSlicingRestrictedToViewport(iDisplay, restricted);
+}
+
+// Substitute the integer fields (%d, %4d or %04d) of a file name pattern
+static std::string FormatSeriesFileName(const std::string &pattern,
+                                        const std::vector<unsigned int> &values)
+{
+  std::ostringstream oss;
+  size_t k = 0;
+  for(size_t i = 0; i < pattern.size(); i++)
+    {
+    if(pattern[i] != '%')
+      {
+      oss << pattern[i];
+      continue;
+      }
+
+    if(i + 1 < pattern.size() && pattern[i + 1] == '%')
+      {
+      oss << '%';
+      i++;
+      continue;
+      }
+
+    size_t j = i + 1;
+    bool zero = j < pattern.size() && pattern[j] == '0';
+    int width = 0;
+    for(; j < pattern.size() && isdigit(pattern[j]); j++)
+      width = 10 * width + (pattern[j] - '0');
+
+    if(j >= pattern.size() || pattern[j] != 'd' || k >= values.size())
+      throw IRISException("Invalid file name pattern '%s'", pattern.c_str());
+
+    oss << std::setfill(zero ? '0' : ' ') << std::setw(width) << values[k++];
+    i = j;
+    }
+
+  if(k < values.size())
+    throw IRISException("The file name pattern '%s' must have %d integer fields",
+                        pattern.c_str(), (int) values.size());
+
+  return oss.str();
+}
+
+void
+IRISApplication
+::ExportSliceSeries(AnatomicalDirection iSliceAnat,
+                    unsigned int first, unsigned int last,
+                    bool allTimePoints, const char *pattern,
+                    ProgressToken *progress)
+{
+  size_t iSliceImg =
+    GetImageDirectionForAnatomicalDirection(iSliceAnat);
+
+  // Find the slicer that slices along that direction
+  typedef ImageWrapperBase::DisplaySliceType SliceType;
+  ImageWrapperBase *main = m_CurrentImageData->GetMain();
+  size_t iDisplay = 0;
+  for(size_t i = 0; i < 3; i++)
+    if(iSliceImg == main->GetDisplaySliceImageAxis(i))
+      iDisplay = i;
+
+  unsigned int nSlices = main->GetSize()[iSliceImg];
+  if(first > last || last >= nSlices)
+    throw IRISException("Slice range %d to %d is outside of the image", first, last);
+
+  // Check the pattern before anything is written
+  std::vector<unsigned int> fields(allTimePoints ? 2 : 1, 1);
+  FormatSeriesFileName(pattern, fields);
+
+  // The slices are extracted by moving the main image to each of them, and
+  // its state is restored at the end
+  ImageWrapperBase::IndexType idxOld = main->GetSliceIndex();
+  unsigned int tpOld = main->GetTimePointIndex();
+  bool restricted = main->IsSlicingRestrictedToViewport(iDisplay);
+  main->SetSlicingRestrictedToViewport(iDisplay, false);
+
+  unsigned int tpFirst = allTimePoints ? 0 : tpOld;
+  unsigned int tpLast = allTimePoints ? main->GetNumberOfTimePoints() - 1 : tpOld;
+  double frameProgress = 1.0 / ((last - first + 1.0) * (tpLast - tpFirst + 1.0));
+
+  // The slicing pipeline runs on this thread, and a few frames more than
+  // there are workers are encoded at a time
+  TaskScheduler *scheduler = TaskScheduler::GetInstance();
+  size_t window = 2 * scheduler->GetNumberOfThreads();
+  std::deque<std::future<void> > pending;
+  try
+    {
+    for(unsigned int tp = tpFirst; tp <= tpLast; tp++)
+      {
+      main->SetTimePointIndex(tp);
+      for(unsigned int s = first; s <= last; s++)
+        {
+        if(progress && progress->IsCancelled())
+          break;
+
+        ImageWrapperBase::IndexType idx = idxOld;
+        idx[iSliceImg] = s;
+        main->SetSliceIndex(idx);
+
+        // The slice buffer is reused by the pipeline, so the encoder gets a copy
+        SmartPtr<SliceType> slice = main->GetDisplaySlice(iDisplay);
+        slice->Update();
+        typedef itk::ImageDuplicator<SliceType> Duplicator;
+        SmartPtr<Duplicator> dup = Duplicator::New();
+        dup->SetInputImage(slice);
+        dup->Update();
+        SmartPtr<SliceType> frame = dup->GetOutput();
+
+        fields[0] = s + 1;
+        if(allTimePoints)
+          fields[1] = tp + 1;
+        std::string fn = FormatSeriesFileName(pattern, fields);
+
+        if(pending.size() >= window)
+          {
+          pending.front().get();
+          pending.pop_front();
+          }
+
+        pending.push_back(scheduler->Submit(
+                            TaskScheduler::USER_COMPUTE,
+                            [frame, fn, progress, frameProgress]()
+          {
+          // Flip the image in the Y direction
+          typedef itk::FlipImageFilter<SliceType> FlipFilter;
+          FlipFilter::Pointer fltFlip = FlipFilter::New();
+          fltFlip->SetInput(frame);
+
+          FlipFilter::FlipAxesArrayType arrFlips;
+          arrFlips[0] = false; arrFlips[1] = true;
+          fltFlip->SetFlipAxes(arrFlips);
+
+          typedef itk::ImageFileWriter<SliceType> WriterType;
+          WriterType::Pointer writer = WriterType::New();
+          writer->SetInput(fltFlip->GetOutput());
+          writer->SetFileName(fn);
+          writer->Update();
+
+          if(progress)
+            progress->AddProgress(frameProgress);
+          }));
+        }
+      }
+
+    while(pending.size())
+      {
+      pending.front().get();
+      pending.pop_front();
+      }
+    }
+  catch(...)
+    {
+    // The frames still being written refer to the progress token
+    for(auto &f : pending)
+      f.wait();
+
+    main->SetTimePointIndex(tpOld);
+    main->SetSliceIndex(idxOld);
+    main->SetSlicingRestrictedToViewport(iDisplay, restricted);
+    throw;
+    }
+
+  main->SetTimePointIndex(tpOld);
+  main->SetSliceIndex(idxOld);
+  main->SetSlicingRestrictedToViewport(iDisplay, restricted);
 }
 
 void 
@@ -1101,91 +1419,75 @@ IRISApplication
   fout.close();
 }
 
-
-
 void
 IRISApplication
-::ExportSegmentationMesh(const MeshExportSettings &sets, itk::Command *progress) 
+::ExportSegmentationStatisticsForAllTimePoints(const char *file)
 {
-  // Update the list of VTK meshes
-  m_MeshManager->UpdateVTKMeshes(progress, this->GetSelectedSegmentationLayer()->GetTimePointIndex());
+  // Open the selected file for writing
+  std::ofstream fout(file);
+  if(!fout.good())
+    throw itk::ExceptionObject(__FILE__, __LINE__,
+                               "File can not be opened for writing");
 
-  // Get the list of available labels
-  MeshManager::MeshCollection meshes = m_MeshManager->GetMeshes(
-        this->GetSelectedSegmentationLayer()->GetTimePointIndex());
-  MeshManager::MeshCollection::iterator it;
+  // The rows are written as the time points are computed
+  std::string fn(file);
+  bool csv = fn.size() >= 4 && itksys::SystemTools::LowerCase(fn.substr(fn.size() - 4)) == ".csv";
+  SegmentationStatistics::ExportAllTimePoints(this, fout, csv ? "," : "\t");
 
-  // If in SNAP mode, just save the first mesh
-  if(m_SNAPImageData->IsMainLoaded())
-    {
-    if(meshes.size() != 1)
-      throw IRISException("Unexpected number of meshes in SNAP mode");
+  if(!fout.good())
+    throw itk::ExceptionObject(__FILE__, __LINE__,
+                               "File can not be written");
+}
 
-    // Get the VTK mesh for the label
-    it = meshes.begin();
-    vtkPolyData *mesh = it->second;
 
-    // Export the mesh
-    GuidedMeshIO io;
-    Registry rFormat = sets.GetMeshFormat();
-    io.SaveMesh(sets.GetMeshFileName().c_str(), rFormat, mesh);
-    }
 
-  // If only one mesh is to be exported, life is easy
-  else if(sets.GetFlagSingleLabel())
-    {
-    // Get the VTK mesh for the label
-    it = meshes.find(sets.GetExportLabel());
-    if(it == meshes.end())
-      throw IRISException("Missing mesh for the selected label");
+// The files written by a mesh export, one job per file. The time point
+// number is appended to the file names, unless it is negative.
+static std::vector<std::function<void ()> >
+GetMeshExportJobs(const MeshExportSettings &sets,
+                  const MeshManager::MeshCollection &meshes, int tp)
+{
+  std::vector<std::function<void ()> > jobs;
+  Registry rFormat = sets.GetMeshFormat();
 
-    vtkPolyData *mesh = it->second;
+  // Take apart the filename
+  std::string full = itksys::SystemTools::CollapseFullPath(sets.GetMeshFileName().c_str());
+  std::string path = itksys::SystemTools::GetFilenamePath(full.c_str());
+  std::string file = itksys::SystemTools::GetFilenameWithoutExtension(full.c_str());
+  std::string extn = itksys::SystemTools::GetFilenameExtension(full.c_str());
+  std::string tpsuffix = tp < 0 ? std::string() : Registry::Key("_t%03d", tp + 1);
 
-    // Export the mesh
-    GuidedMeshIO io;
-    Registry rFormat = sets.GetMeshFormat();
-    io.SaveMesh(sets.GetMeshFileName().c_str(), rFormat, mesh);
-    }
-  else if(sets.GetFlagSingleScene())
+  if(sets.GetFlagSingleLabel() || sets.GetFlagSingleScene())
     {
-    // Create an append filter
-    vtkSmartPointer<vtkAppendPolyData> append = vtkSmartPointer<vtkAppendPolyData>::New();
-
-    for(it = meshes.begin(); it != meshes.end(); it++)
+    std::string fn = tp < 0 ? sets.GetMeshFileName() : path + "/" + file + tpsuffix + extn;
+    if(sets.GetFlagSingleLabel())
       {
       // Get the VTK mesh for the label
-      vtkPolyData *mesh = it->second;
-      vtkSmartPointer<vtkUnsignedShortArray> scalar =
-          vtkSmartPointer<vtkUnsignedShortArray>::New();
-
-      scalar->SetNumberOfComponents(1);
-
-      scalar->Allocate(mesh->GetNumberOfPoints());
-      for(int j = 0; j < mesh->GetNumberOfPoints(); j++)
-        scalar->InsertNextTuple1(it->first);
+      // A label may be missing from some of the time points
+      auto it = meshes.find(sets.GetExportLabel());
+      if(it == meshes.end())
+        {
+        if(tp >= 0)
+          return jobs;
+        throw IRISException("Missing mesh for the selected label");
+        }
 
-      mesh->GetPointData()->SetScalars(scalar);
-      append->AddInputData(mesh);
+      vtkSmartPointer<vtkPolyData> mesh = it->second;
+      jobs.push_back([fn, rFormat, mesh]() mutable {
+        GuidedMeshIO io;
+        io.SaveMesh(fn.c_str(), rFormat, mesh);
+      });
+      }
+    else
+      {
+      jobs.push_back([fn, rFormat, meshes]() mutable {
+        GuidedMeshIO io;
+        io.SaveMeshScene(fn.c_str(), rFormat, meshes);
+      });
       }
-
-    append->Update();
-
-    // Export the mesh
-    GuidedMeshIO io;
-    Registry rFormat = sets.GetMeshFormat();
-    io.SaveMesh(sets.GetMeshFileName().c_str(), rFormat, append->GetOutput());
-
-    // Remove the scalars from the meshes
-    for(it = meshes.begin(); it != meshes.end(); it++)
-      it->second->GetPointData()->SetScalars(NULL);
     }
   else
     {
-    // Take apart the filename
-    std::string full = itksys::SystemTools::CollapseFullPath(sets.GetMeshFileName().c_str());
-    std::string path = itksys::SystemTools::GetFilenamePath(full.c_str());
-    std::string file = itksys::SystemTools::GetFilenameWithoutExtension(full.c_str());
-    std::string extn = itksys::SystemTools::GetFilenameExtension(full.c_str());
     std::string prefix = file;
 
     // Are the last 5 characters of the filename numeric?
@@ -1196,138 +1498,535 @@ IRISApplication
         prefix = file.substr(0, file.length()-5);
       }
 
-    // Loop, saving each mesh into a filename
-    for(it = meshes.begin(); it != meshes.end(); it++)
+    // One file for each mesh
+    for(auto it = meshes.begin(); it != meshes.end(); it++)
       {
-      // Get the VTK mesh for the label
-      vtkPolyData *mesh = it->second;
-
       // Generate filename
       char outfn[4096];
-      snprintf(outfn, 4096, "%s/%s%05d%s", path.c_str(), prefix.c_str(), it->first, extn.c_str());
-
-      // Export the mesh
-      GuidedMeshIO io;
-      Registry rFormat = sets.GetMeshFormat();
-      io.SaveMesh(outfn, rFormat, mesh);
+      snprintf(outfn, 4096, "%s/%s%05d%s%s", path.c_str(), prefix.c_str(), it->first,
+               tpsuffix.c_str(), extn.c_str());
+
+      std::string fn = outfn;
+      vtkSmartPointer<vtkPolyData> mesh = it->second;
+      jobs.push_back([fn, rFormat, mesh]() mutable {
+        GuidedMeshIO io;
+        io.SaveMesh(fn.c_str(), rFormat, mesh);
+      });
       }
     }
+
+  return jobs;
 }
 
-size_t
+void
 IRISApplication
-::ReplaceLabel(LabelType drawing, LabelType drawover)
+::ExportSegmentationMesh(const MeshExportSettings &sets, itk::Command *progress) 
 {
-  // Create an update iterator
-  SegmentationUpdateIterator it(this->GetSelectedSegmentationLayer(),
-                                this->GetSelectedSegmentationLayer()->GetBufferedRegion(),
-                                drawing, DrawOverFilter(PAINT_OVER_ONE, drawover));
+  unsigned int tp = this->GetSelectedSegmentationLayer()->GetTimePointIndex();
 
-  // Perform iteration
-  for(; !it.IsAtEnd(); ++it)
-    it.PaintAsForeground();
-
-  // Register that the image has been updated
-  if(it.Finalize("Replace label"))
+  if(sets.GetFlagAllTimePoints() && !m_SNAPImageData->IsMainLoaded()
+     && this->GetSelectedSegmentationLayer()->GetNumberOfTimePoints() > 1)
     {
-    this->InvokeEvent(SegmentationChangeEvent());
+    this->ExportSegmentationMeshForAllTimePoints(sets, progress);
+    return;
     }
 
-  return it.GetNumberOfChangedVoxels();
-}
+  // Update the list of VTK meshes, unless the cached ones are up to date
+  if(m_MeshManager->IsMeshDirty(tp))
+    m_MeshManager->UpdateVTKMeshes(progress, tp);
 
-// TODO: This information should be cached at the segmentation layer level
-// by keeping track of label counts after every update operation.
-size_t
-IRISApplication
-::GetNumberOfVoxelsWithLabel(LabelType label)
-{
-  // Number of voxels matching current label
-  size_t nvoxels = 0;
+  // Get the list of available labels
+  MeshManager::MeshCollection meshes = m_MeshManager->GetMeshes(tp);
 
-  // We must iterate over all the label images
-  for(LayerIterator it = this->GetCurrentImageData()->GetLayers(LABEL_ROLE);
-      !it.IsAtEnd(); ++it)
+  // If in SNAP mode, just save the first mesh
+  if(m_SNAPImageData->IsMainLoaded())
     {
-    LabelImageWrapper *wrapper = dynamic_cast<LabelImageWrapper *>(it.GetLayer());
-    const LabelImageType *seg = wrapper->GetImage();
+    if(meshes.size() != 1)
+      throw IRISException("Unexpected number of meshes in SNAP mode");
 
-    // Get the number of voxels
-    for(LabelImageWrapper::ConstIterator it(seg, seg->GetBufferedRegion());
-        !it.IsAtEnd(); ++it)
-      {
-      if(it.Get() == label)
-        ++nvoxels;
-      }
+    // Get the VTK mesh for the label
+    vtkPolyData *mesh = meshes.begin()->second;
+
+    // Export the mesh
+    GuidedMeshIO io;
+    Registry rFormat = sets.GetMeshFormat();
+    io.SaveMesh(sets.GetMeshFileName().c_str(), rFormat, mesh);
+    return;
     }
 
-  return nvoxels;
-}
+  // The files are written concurrently
+  std::vector<std::future<void> > writes;
+  for(auto &job : GetMeshExportJobs(sets, meshes, -1))
+    writes.push_back(TaskScheduler::GetInstance()->Submit(TaskScheduler::USER_COMPUTE, job));
 
+  // Wait for all the writers before reporting the first error
+  for(auto &w : writes)
+    w.wait();
+  for(auto &w : writes)
+    w.get();
+}
 
-int
+void
 IRISApplication
-::RelabelSegmentationWithCutPlane(const Vector3d &normal, double intercept) 
+::ExportSegmentationMeshForAllTimePoints(const MeshExportSettings &sets, itk::Command *progress)
 {
-  // Get the label image
   LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
-  
-  // Create the smart target iterator
-  SegmentationUpdateIterator it(
-        seg, seg->GetBufferedRegion(),
-        m_GlobalState->GetDrawingColorLabel(), m_GlobalState->GetDrawOverFilter());
-
-  // Adjust the intercept by 0.5 for voxel offset
-  intercept -= 0.5 * (normal[0] + normal[1] + normal[2]);
-
-  // Iterate over the image, relabeling labels on one side of the plane
-  while(!it.IsAtEnd())
+  unsigned int nt = seg->GetNumberOfTimePoints();
+  TaskScheduler *ts = TaskScheduler::GetInstance();
+  unsigned int threads = ts->GetNumberOfThreads();
+
+  // Each time point is handled by a task, which updates its meshes if they
+  // are out of date and then writes them. Once there are enough time points
+  // to keep all the threads busy, the meshes of a time point are computed
+  // one after the other rather than concurrently.
+  bool serial = nt >= threads;
+
+  // The tasks report progress to tokens, which are read on this thread and
+  // passed on to the progress command, in time points
+  ProgressToken token;
+  SmartPtr<TrivalProgressSource> tracker = TrivalProgressSource::New();
+  if(progress)
+    tracker->AddObserverToProgressEvents(progress);
+  tracker->StartProgress(nt);
+  double reported = 0.0;
+
+  struct TimePointExport
+  {
+    ProgressToken Progress;
+    std::future<void> Done;
+  };
+
+  // The number of time points in flight is limited, so that only the
+  // meshes of these time points are held for writing
+  std::deque<TimePointExport> window;
+  TaskScheduler::CancellationToken cancel;
+  unsigned int next = 0;
+  std::exception_ptr error;
+
+  while((next < nt || window.size()) && !error)
     {
-    // Compute the distance to the plane
-    itk::Index<3> index = it.GetIndex();
-    double distance = 
-      index[0]*normal[0] + 
-      index[1]*normal[1] + 
-      index[2]*normal[2] - intercept;
+    while(next < nt && window.size() < 2 * threads)
+      {
+      // Cached meshes are reused if they are up to date
+      unsigned int tp = next++;
+      bool dirty = m_MeshManager->IsMeshDirty(tp);
+      SmartPtr<MultiLabelMeshPipeline> pipeline = m_MeshManager->PrepareMeshPipeline(tp);
+
+      TimePointExport tpe;
+      tpe.Progress = token.CreateChild(1.0);
+      if(!pipeline)
+        {
+        tpe.Progress.SetProgress(1.0);
+        window.push_back(std::move(tpe));
+        continue;
+        }
 
-    // Check the side of the plane
-    if(distance > 0)
-      it.PaintAsForegroundPreserveClear();
+      ProgressToken tpprog = tpe.Progress;
+      tpe.Done = ts->Submit(TaskScheduler::USER_COMPUTE,
+                            [sets, pipeline, tpprog, tp, dirty, serial]() mutable
+        {
+        if(dirty)
+          {
+          bool parallel = pipeline->GetParallelUpdate();
+          pipeline->SetParallelUpdate(parallel && !serial);
+          try
+            {
+            pipeline->UpdateMeshes(tpprog.CreateCommand());
+            }
+          catch(...)
+            {
+            pipeline->SetParallelUpdate(parallel);
+            throw;
+            }
+          pipeline->SetParallelUpdate(parallel);
+          }
 
-    // Next voxel
-    ++it;
-    }
+        for(auto &job : GetMeshExportJobs(sets, pipeline->GetMeshCollection(), (int) tp))
+          job();
+        tpprog.SetProgress(1.0);
+        }, cancel);
+      window.push_back(std::move(tpe));
+      }
 
-  // Finalize
+    // Wait for the oldest time point, reporting progress meanwhile
+    TimePointExport &front = window.front();
+    if(front.Done.valid())
+      {
+      while(front.Done.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready)
+        {
+        double p = token.GetProgress() * nt;
+        if(p > reported)
+          tracker->AddProgress(p - reported);
+        reported = std::max(p, reported);
+        }
 
+      try
+        {
+        front.Done.get();
+        }
+      catch(...)
+        {
+        error = std::current_exception();
+        }
+      }
+    window.pop_front();
+    }
 
-  // Store the undo point if needed
-  if(it.Finalize("3D scalpel"))
+  // After an error, the time points that have not started are dropped, and
+  // the running ones are waited for, since they use the mesh pipelines
+  if(error)
     {
-    RecordCurrentLabelUse();
-    InvokeEvent(SegmentationChangeEvent());
+    ts->Cancel(cancel);
+    for(auto &tpe : window)
+      if(tpe.Done.valid())
+        tpe.Done.wait();
+    tracker->EndProgress();
+    std::rethrow_exception(error);
     }
 
-  return it.GetNumberOfChangedVoxels();
+  tracker->AddProgress(std::max(0.0, nt - reported));
+  tracker->EndProgress();
 }
 
-int 
+size_t
 IRISApplication
-::GetRayIntersectionWithSegmentation(const Vector3d &point, 
-                                     const Vector3d &ray, Vector3i &hit) const
+::ReplaceLabel(LabelType drawing, LabelType drawover)
 {
-  // Get the label wrapper
-  LabelImageWrapper *xLabelWrapper = this->GetSelectedSegmentationLayer();
-  assert(xLabelWrapper->IsInitialized());
-
-  itk::Index<3> lIndex;
-  Vector3ui lSize = xLabelWrapper->GetSize();
+  // Create a run writer. Replacing the label is the same as painting over
+  // the whole image in the paint-over-one mode
+  LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
+  itk::ImageRegion<3> region = seg->GetBufferedRegion();
+  SegmentationRunWriter writer(seg, region, drawing, DrawOverFilter(PAINT_OVER_ONE, drawover));
 
-  double delta[3][3] = {{0.,0.,0.},{0.,0.,0.},{0.,0.,0.}}, dratio[3] = {0., 0., 0.};
-  int    signrx, signry, signrz;
+  SegmentationRunWriter::UpdateLine update(
+        1, std::make_pair((unsigned int) region.GetSize(0), SegmentationUpdateIterator::FOREGROUND));
+  writer.PaintAllLines(update);
 
-  double rx = ray[0];
-  double ry = ray[1];
+  // Register that the image has been updated
+  if(writer.Finalize("Replace label"))
+    {
+    this->InvokeEvent(SegmentationChangeEvent());
+    }
+
+  return writer.GetNumberOfChangedVoxels();
+}
+
+size_t
+IRISApplication
+::KeepLargestConnectedComponent(LabelType label, bool fully_connected)
+{
+  return this->RemoveConnectedComponents(
+        label, fully_connected, true, 0, "Keep largest component");
+}
+
+size_t
+IRISApplication
+::RemoveSmallConnectedComponents(LabelType label, size_t min_voxels, bool fully_connected)
+{
+  return this->RemoveConnectedComponents(
+        label, fully_connected, false, min_voxels, "Remove islands");
+}
+
+size_t
+IRISApplication
+::RemoveConnectedComponents(LabelType label, bool fully_connected,
+                            bool keep_largest, size_t min_voxels,
+                            const char *undo_text)
+{
+  LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
+  if(!seg || label == 0)
+    return 0;
+
+  // Find the components from the runs of the current time point
+  typedef RLEConnectedComponents<LabelType> ComponentsType;
+  itk::ImageRegion<3> region = seg->GetBufferedRegion();
+  ComponentsType cc;
+  cc.Compute(seg->GetImage(), region, label, fully_connected);
+
+  long largest = cc.GetLargestComponent();
+  const std::vector<itk::SizeValueType> &sizes = cc.GetComponentSizes();
+  std::vector<bool> remove(sizes.size());
+  bool any = false;
+  for(size_t i = 0; i < sizes.size(); i++)
+    {
+    remove[i] = keep_largest ? (long) i != largest : sizes[i] < min_voxels;
+    any |= remove[i];
+    }
+  if(!any)
+    return 0;
+
+  // Clear the runs of the removed components. Painting the background with
+  // the label as the active label only clears voxels of that label
+  SegmentationRunWriter writer(seg, region, label, DrawOverFilter(PAINT_OVER_ALL, 0));
+  long width = region.GetSize(0);
+  writer.PaintAllLinesWith(
+        [&cc, &remove, width](const itk::Index<3> &idx, SegmentationRunWriter::UpdateLine &update)
+    {
+    update.clear();
+    long x = 0;
+    for(auto *run = cc.LineBegin(idx[1], idx[2]); run != cc.LineEnd(idx[1], idx[2]); ++run)
+      {
+      if(!remove[run->Component])
+        continue;
+      if(run->Begin > x)
+        update.push_back(std::make_pair((unsigned int) (run->Begin - x), SegmentationUpdateIterator::SKIP));
+      update.push_back(std::make_pair((unsigned int) (run->End - run->Begin), SegmentationUpdateIterator::BACKGROUND));
+      x = run->End;
+      }
+    if(x < width)
+      update.push_back(std::make_pair((unsigned int) (width - x), SegmentationUpdateIterator::SKIP));
+    });
+
+  if(writer.Finalize(undo_text))
+    {
+    this->InvokeEvent(SegmentationChangeEvent());
+    }
+
+  return writer.GetNumberOfChangedVoxels();
+}
+
+size_t
+IRISApplication
+::FloodFillSegmentation(const Vector3ui &seed, int slice_axis,
+                        ScalarImageWrapperBase *grey,
+                        double lower, double upper,
+                        bool reverse, const char *undo_text)
+{
+  LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
+  if(!seg)
+    return 0;
+
+  itk::ImageRegion<3> region = seg->GetBufferedRegion();
+  itk::Index<3> idxSeed = to_itkIndex(seed);
+  if(!region.IsInside(idxSeed))
+    return 0;
+
+  if(slice_axis >= 0 && slice_axis < 3)
+    {
+    region.SetIndex(slice_axis, idxSeed[slice_axis]);
+    region.SetSize(slice_axis, 1);
+    }
+
+  // The region to fill is made of the voxels of the seed label, and nothing
+  // changes if that is already the drawing label
+  LabelType drawing = m_GlobalState->GetDrawingColorLabel();
+  LabelType seed_label = seg->GetImage()->GetPixel(idxSeed);
+  if(reverse ? seed_label != drawing : seed_label == drawing)
+    return 0;
+
+  // The intensity window is applied to the internal values of the grey
+  // image, which must be sampled on the grid of the segmentation
+  if(grey)
+    {
+    if(grey->GetSize() != seg->GetSize())
+      return 0;
+
+    const AbstractNativeIntensityMapping *nim = grey->GetNativeIntensityMapping();
+    double a = nim->MapNativeToInternal(lower), b = nim->MapNativeToInternal(upper);
+    lower = std::min(a, b);
+    upper = std::max(a, b);
+
+    // The seed itself must be in the window. This first call also makes
+    // the concurrent calls below safe
+    std::vector<std::pair<long, long> > spans;
+    if(!grey->GetRunLengthIntensityWindowSpans(region, idxSeed, 1, lower, upper, spans)
+       || spans.empty())
+      return 0;
+    }
+
+  // Find the spans of the seed label, split by the intensity window, and
+  // join them into connected components. In 3D this is done in parallel
+  // over slabs of slices
+  typedef RLEConnectedComponents<LabelType> ComponentsType;
+  ComponentsType cc;
+  long x_origin = seg->GetBufferedRegion().GetIndex(0);
+  cc.Compute(seg->GetImage(), region, seed_label, false,
+             [grey, &region, lower, upper, x_origin](long y, long z, long begin, long end, auto &&emit)
+    {
+    if(!grey)
+      {
+      emit(begin, end);
+      return;
+      }
+
+    std::vector<std::pair<long, long> > spans;
+    itk::Index<3> start = {{ x_origin + begin, y, z }};
+    grey->GetRunLengthIntensityWindowSpans(region, start, end - begin, lower, upper, spans);
+    for(const auto &span : spans)
+      emit(begin + span.first, begin + span.second);
+    });
+
+  long component = cc.GetComponentAt(idxSeed);
+  if(component < 0)
+    return 0;
+
+  // Only the bounding box of the filled spans is painted, which keeps the
+  // undo delta small when the fill covers a small part of the image
+  itk::Index<3> lo, hi;
+  bool any = false;
+  for(long z = region.GetIndex(2); z < region.GetIndex(2) + (long) region.GetSize(2); z++)
+    {
+    for(long y = region.GetIndex(1); y < region.GetIndex(1) + (long) region.GetSize(1); y++)
+      {
+      for(auto *run = cc.LineBegin(y, z); run != cc.LineEnd(y, z); ++run)
+        {
+        if(run->Component != (itk::SizeValueType) component)
+          continue;
+        itk::Index<3> a = {{ x_origin + run->Begin, y, z }};
+        itk::Index<3> b = {{ x_origin + run->End, y + 1, z + 1 }};
+        for(unsigned int d = 0; d < 3; d++)
+          {
+          lo[d] = any ? std::min(lo[d], a[d]) : a[d];
+          hi[d] = any ? std::max(hi[d], b[d]) : b[d];
+          }
+        any = true;
+        }
+      }
+    }
+
+  itk::ImageRegion<3> box;
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    box.SetIndex(d, lo[d]);
+    box.SetSize(d, hi[d] - lo[d]);
+    }
+
+  // Paint the spans of the component over the bounding box
+  SegmentationRunWriter writer(seg, box, drawing, m_GlobalState->GetDrawOverFilter());
+  SegmentationUpdateIterator::UpdateType paint_type = reverse
+      ? SegmentationUpdateIterator::BACKGROUND
+      : SegmentationUpdateIterator::FOREGROUND;
+  long x_begin = lo[0] - x_origin, x_end = hi[0] - x_origin;
+  writer.PaintAllLinesWith(
+        [&cc, component, paint_type, x_begin, x_end](
+        const itk::Index<3> &idx, SegmentationRunWriter::UpdateLine &update)
+    {
+    update.clear();
+    long x = x_begin;
+    for(auto *run = cc.LineBegin(idx[1], idx[2]); run != cc.LineEnd(idx[1], idx[2]); ++run)
+      {
+      if(run->Component != (itk::SizeValueType) component)
+        continue;
+      if(run->Begin > x)
+        update.push_back(std::make_pair((unsigned int) (run->Begin - x), SegmentationUpdateIterator::SKIP));
+      update.push_back(std::make_pair((unsigned int) (run->End - run->Begin), paint_type));
+      x = run->End;
+      }
+    if(x < x_end)
+      update.push_back(std::make_pair((unsigned int) (x_end - x), SegmentationUpdateIterator::SKIP));
+    });
+
+  if(!writer.Finalize(undo_text))
+    return 0;
+
+  if(!undo_text)
+    seg->StoreIntermediateUndoDelta(writer.RelinquishDelta());
+
+  this->InvokeEvent(SegmentationChangeEvent());
+  return writer.GetNumberOfChangedVoxels();
+}
+
+size_t
+IRISApplication
+::GetNumberOfVoxelsWithLabel(LabelType label)
+{
+  // Number of voxels matching current label
+  size_t nvoxels = 0;
+
+  // Add up the label counts cached by all the label images
+  for(LayerIterator it = this->GetCurrentImageData()->GetLayers(LABEL_ROLE);
+      !it.IsAtEnd(); ++it)
+    {
+    LabelImageWrapper *wrapper = dynamic_cast<LabelImageWrapper *>(it.GetLayer());
+    nvoxels += wrapper->GetNumberOfVoxelsWithLabel(label);
+    }
+
+  return nvoxels;
+}
+
+
+int
+IRISApplication
+::RelabelSegmentationWithCutPlane(const Vector3d &normal, double intercept) 
+{
+  // Get the label image
+  LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
+  
+  // Create the run writer for the target segmentation
+  itk::ImageRegion<3> region = seg->GetBufferedRegion();
+  SegmentationRunWriter writer(
+        seg, region,
+        m_GlobalState->GetDrawingColorLabel(), m_GlobalState->GetDrawOverFilter());
+
+  // Adjust the intercept by 0.5 for voxel offset
+  intercept -= 0.5 * (normal[0] + normal[1] + normal[2]);
+
+  // Relabel the voxels in front of the plane. Along each line, the distance
+  // to the plane is linear in x, so the voxels in front form a single span
+  // whose ends are found analytically
+  long x0 = region.GetIndex(0), x1 = x0 + region.GetSize(0);
+  writer.PaintAllLinesWith(
+        [&](const itk::Index<3> &index, SegmentationRunWriter::UpdateLine &update)
+    {
+    // The distance at x is x * normal[0] + c
+    double c = index[1] * normal[1] + index[2] * normal[2] - intercept;
+    auto in_front = [&](long x) { return x * normal[0] + c > 0; };
+
+    // Find the span [xa, xb) of voxels in front of the plane
+    long xa = x0, xb = x1;
+    if(normal[0] > 0)
+      {
+      xa = std::max(x0, std::min(x1, (long) std::floor(-c / normal[0]) + 1));
+      while(xa > x0 && in_front(xa - 1)) xa--;
+      while(xa < x1 && !in_front(xa)) xa++;
+      }
+    else if(normal[0] < 0)
+      {
+      xb = std::max(x0, std::min(x1, (long) std::ceil(-c / normal[0])));
+      while(xb < x1 && in_front(xb)) xb++;
+      while(xb > x0 && !in_front(xb - 1)) xb--;
+      }
+    else if(c <= 0)
+      {
+      xb = x0;
+      }
+
+    update.clear();
+    if(xa > x0)
+      update.push_back(std::make_pair((unsigned int)(std::min(xa, xb) - x0), SegmentationUpdateIterator::SKIP));
+    if(xb > xa)
+      update.push_back(std::make_pair((unsigned int)(xb - xa), SegmentationUpdateIterator::FOREGROUND_PRESERVE_CLEAR));
+    if(x1 > std::max(xa, xb))
+      update.push_back(std::make_pair((unsigned int)(x1 - std::max(xa, xb)), SegmentationUpdateIterator::SKIP));
+    });
+
+  // Store the undo point if needed
+  if(writer.Finalize("3D scalpel"))
+    {
+    RecordCurrentLabelUse();
+    InvokeEvent(SegmentationChangeEvent());
+    }
+
+  return writer.GetNumberOfChangedVoxels();
+}
+
+int 
+IRISApplication
+::GetRayIntersectionWithSegmentation(const Vector3d &point, 
+                                     const Vector3d &ray, Vector3i &hit) const
+{
+  // Get the label wrapper
+  LabelImageWrapper *xLabelWrapper = this->GetSelectedSegmentationLayer();
+  assert(xLabelWrapper->IsInitialized());
+
+  itk::Index<3> lIndex;
+  Vector3ui lSize = xLabelWrapper->GetSize();
+
+  double delta[3][3] = {{0.,0.,0.},{0.,0.,0.},{0.,0.,0.}}, dratio[3] = {0., 0., 0.};
+  int    signrx, signry, signrz;
+
+  double rx = ray[0];
+  double ry = ray[1];
   double rz = ray[2];
 
   double rlen = rx*rx+ry*ry+rz*rz;
@@ -1378,16 +2077,13 @@ IRISApplication
 
     LabelType hitlabel = xLabelWrapper->GetVoxel(lIndex);
 
-    if (m_ColorLabelTable->IsColorLabelValid(hitlabel))
+    if (m_ColorLabelTable->IsColorLabelValid(hitlabel)
+        && m_ColorLabelTable->IsLabelVisible(hitlabel))
       {
-      ColorLabel cl = m_ColorLabelTable->GetColorLabel(hitlabel);
-      if(cl.IsVisible())
-        {
-        hit[0] = lIndex[0];
-        hit[1] = lIndex[1];
-        hit[2] = lIndex[2];
-        return 1;
-        }
+      hit[0] = lIndex[0];
+      hit[1] = lIndex[1];
+      hit[2] = lIndex[2];
+      return 1;
       }
 
     // BEGIN : walk along ray to border of next voxel touched by ray
@@ -1584,6 +2280,12 @@ void
 IRISApplication
 ::AutoContrastLayerOnLoad(ImageWrapperBase *layer)
 {
+  if(m_DeferredAutoContrastLayers)
+    {
+    m_DeferredAutoContrastLayers->push_back(layer);
+    return;
+    }
+
   // Get a pointer to the policy for this layer
   AbstractContinuousImageDisplayMappingPolicy *policy =
       dynamic_cast<AbstractContinuousImageDisplayMappingPolicy *>(
@@ -1691,6 +2393,9 @@ IRISApplication
 
   // Reset timepoint properties
   m_IRISImageData->GetTimePointProperties()->CreateNewData();
+
+  // Start recording the changes to the segmentation
+  this->StartSegmentationRecoveryJournal();
 }
 
 void IRISApplication::LoadMetaDataAssociatedWithLayer(
@@ -1824,6 +2529,9 @@ IRISApplication
   // Reset the automatic segmentation ROI
   m_GlobalState->SetSegmentationROI(GlobalState::RegionType());
 
+  // The session ends normally, so its journal is no longer needed
+  this->StopSegmentationRecoveryJournal();
+
   // Unload the main image
   m_CurrentImageData->UnloadMainImage();
 
@@ -1840,6 +2548,72 @@ IRISApplication
   InvokeEvent(MainImageDimensionsChangeEvent());
 }
 
+/**
+ * A command that records the progress of an ITK process object that runs in
+ * a worker thread, so that it can be picked up by another thread
+ */
+class AtomicProgressRecorderCommand : public itk::Command
+{
+public:
+  irisITKObjectMacro(AtomicProgressRecorderCommand, itk::Command)
+
+  void Execute(Object *caller, const itk::EventObject &event) override
+  {
+    this->Execute((const Object *) caller, event);
+  }
+
+  void Execute(const Object *caller, const itk::EventObject &event) override
+  {
+    const itk::ProcessObject *po = dynamic_cast<const itk::ProcessObject *>(caller);
+    if(po && itk::ProgressEvent().CheckEvent(&event))
+      m_Progress = po->GetProgress();
+  }
+
+  double GetProgress() const { return m_Progress; }
+
+protected:
+  AtomicProgressRecorderCommand() : m_Progress(0.0) {}
+  virtual ~AtomicProgressRecorderCommand() {}
+
+  std::atomic<double> m_Progress;
+};
+
+/**
+ * Read the image data in a worker thread. The calling thread waits for the
+ * read to complete, and meanwhile relays the progress to progressCmd. This
+ * keeps the GUI event loop serviced by the progress reporter during long
+ * reads, since all progress events are still fired from the calling thread.
+ * An event is fired on every wait, even when the progress has not moved
+ * (e.g., a compressed file is decoded in a single call), so that the event
+ * loop is serviced for the whole read.
+ */
+static void ReadNativeImageDataInBackground(GuidedNativeImageIO *io, itk::Command *progressCmd)
+{
+  SmartPtr<AtomicProgressRecorderCommand> recorder = AtomicProgressRecorderCommand::New();
+  SmartPtr<TrivalProgressSource> tracker = TrivalProgressSource::New();
+  tracker->AddObserverToProgressEvents(progressCmd);
+  tracker->StartProgress(1.0);
+
+  std::future<void> result = std::async(std::launch::async, [io, recorder]()
+    {
+    io->ReadNativeImageData(recorder);
+    });
+
+  // Relay progress until the read is done. The progress of some readers may
+  // restart (e.g., DICOM), so only forward progress is reported
+  double reported = 0.0;
+  while(result.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready)
+    {
+    double progress = std::max(std::min(recorder->GetProgress(), 1.0), reported);
+    tracker->AddProgress(progress - reported);
+    reported = progress;
+    }
+
+  // Rethrow any exception from the reader
+  result.get();
+  tracker->EndProgress();
+}
+
 ImageWrapperBase *
 IRISApplication
 ::OpenImageViaDelegate(const char *fname,
@@ -1848,6 +2622,7 @@ IRISApplication
 											 Registry *ioHints,
 											 ImageReadingProgressAccumulator *irAccum)
 {
+  SNAP_LATENCY_SCOPE(SNAPLatencyMonitor::IMAGE_LOAD);
   Registry regAssoc;
 
 	SmartPtr<itk::Command> headerProgCmd = DoNothingCommandSingleton::GetInstance().GetCommand();
@@ -1890,20 +2665,48 @@ IRISApplication
   // Unload the current image data
   del->UnloadCurrentImage();
 
-  // Read the image body
-	io->ReadNativeImageData(dataProgCmd);
+  // Read the image body in a worker thread
+  ReadNativeImageDataInBackground(io, dataProgCmd);
+
+  // Validate the image and put it in the right place
+  ImageWrapperBase *layer = this->AddImageViaDelegate(io, del, wl, *ioHints);
+
+	miscProgSrc->AddProgress(0.9);
+
+  return layer;
+}
 
+ImageWrapperBase *
+IRISApplication
+::AddImageViaDelegate(GuidedNativeImageIO *io,
+                      AbstractOpenImageDelegate *del,
+                      IRISWarningList &wl,
+                      const Registry &ioHints)
+{
   // Validate the image data
   del->ValidateImage(io, wl);
 
+  // Reuse the statistics of images opened before if requested
+  DerivedDataCache::SetEnabled(m_GlobalState->GetDefaultBehaviorSettings()->GetCacheDerivedData());
+
   // Put the image in the right place
   ImageWrapperBase *layer = del->UpdateApplicationWithImage(io);
 
-	miscProgSrc->AddProgress(0.9);
-
   // Store the IO hints inside of the image - in case it ever gets added
   // to a project
-  layer->SetIOHints(*ioHints);
+  layer->SetIOHints(ioHints);
+
+  // Use the bricked layout for slicing if requested
+  layer->SetBrickedSlicing(m_GlobalState->GetDefaultBehaviorSettings()->GetBrickedSlicing());
+
+  // Keep a time-major copy of 4D images for sampling time series if requested
+  layer->SetTimeMajorCopy(m_GlobalState->GetDefaultBehaviorSettings()->GetTimeMajorCopy());
+
+  // Keep grey images compressed if requested
+  layer->SetCompressedStorage(m_GlobalState->GetDefaultBehaviorSettings()->GetCompressGreyImages());
+
+  // Make room for the new layer if it does not fit the memory budget
+  this->EnforceMemoryBudget();
 
   return layer;
 }
@@ -2023,9 +2826,9 @@ void IRISApplication
     }
 }
 
-void IRISApplication
-::OpenImage(const char *fname, LayerRole role, IRISWarningList &wl,
-            Registry *meta_data_reg, Registry *io_hints_reg, bool additive)
+SmartPtr<AbstractOpenImageDelegate>
+IRISApplication
+::CreateOpenImageDelegate(LayerRole role, Registry *meta_data_reg, bool additive)
 {
   // Pointer to the delegate
   SmartPtr<AbstractOpenImageDelegate> delegate;
@@ -2053,6 +2856,16 @@ void IRISApplication
   if(meta_data_reg)
     delegate->SetMetaDataRegistry(meta_data_reg);
 
+  return delegate;
+}
+
+void IRISApplication
+::OpenImage(const char *fname, LayerRole role, IRISWarningList &wl,
+            Registry *meta_data_reg, Registry *io_hints_reg, bool additive)
+{
+  SmartPtr<AbstractOpenImageDelegate> delegate =
+      this->CreateOpenImageDelegate(role, meta_data_reg, additive);
+
   // Load via delegate, providing the IO hints
   this->OpenImageViaDelegate(fname, delegate, wl, io_hints_reg);
 }
@@ -2255,7 +3068,7 @@ IRISApplication
 }
 
 void IRISApplication::OpenProject(
-    const std::string &proj_file, IRISWarningList &warn)
+    const std::string &proj_file, IRISWarningList &warn, itk::Command *progress)
 {
   // Load the registry file
   Registry preg;
@@ -2273,10 +3086,18 @@ void IRISApplication::OpenProject(
   // If the locations are different, we will attempt to find relative paths first
   bool moved = (project_save_dir != project_dir);
 
-  // Read all the layers
+  // Check all the layers before loading any of them
+  struct ProjectLayer
+  {
+    Registry *Folder;
+    LayerRole Role;
+    std::string FileName;
+    Registry IOHints;
+    bool HasIOHints;
+  };
+  std::vector<ProjectLayer> layers;
+
   std::string key;
-  bool main_loaded = false;
-  int n_segs_loaded = 0;
   for(int i = 0;
       preg.HasFolder(key = Registry::Key("Layers.Layer[%03d]", i));
       i++)
@@ -2301,8 +3122,6 @@ void IRISApplication::OpenProject(
     // Get the filenames for the layer
     std::string layer_file_full = folder["AbsolutePath"][""];
 
-    std::string generated_file_full;
-
     // If the project has moved, try finding a relative location
     if(moved)
       {
@@ -2314,33 +3133,158 @@ void IRISApplication::OpenProject(
 
     // Load the IO hints for the image from the project - but only if this
     // folder is actually present (otherwise some projects from before 2016
-    // will not load hints)
-    Registry *io_hints = NULL;
-    if(folder.HasFolder("IOHints"))
-      io_hints = &folder.Folder("IOHints");
+    // will not load hints). The layers read in the background get a copy
+    ProjectLayer pl;
+    pl.Folder = &folder;
+    pl.Role = role;
+    pl.FileName = layer_file_full;
+    pl.HasIOHints = folder.HasFolder("IOHints");
+    if(pl.HasIOHints)
+      pl.IOHints = folder.Folder("IOHints");
+    layers.push_back(pl);
+    }
 
-    // TODO: this is spaggetti code
-    bool load_additive = false;
-    if(role == LABEL_ROLE && n_segs_loaded > 0)
-      load_additive = true;
+  // If main has not been loaded, throw an exception
+  if(layers.empty())
+    throw IRISException("Empty or invalid project (main image not found in the project file).");
 
-    // Load the image and its metadata
-    OpenImage(layer_file_full.c_str(), role, warn, &folder, io_hints, load_additive);
+  // Each layer counts for the same amount of progress
+  SmartPtr<TrivalProgressSource> tracker = TrivalProgressSource::New();
+  if(progress)
+    tracker->AddObserverToProgressEvents(progress);
+  tracker->StartProgress(layers.size());
 
-    // Check if the main has been loaded
-    if(role == MAIN_ROLE)
+  // Load the main image first, so that it can be shown while the others load
+  ProjectLayer &main_layer = layers.front();
+  try
+    {
+    OpenImage(main_layer.FileName.c_str(), MAIN_ROLE, warn, main_layer.Folder,
+              main_layer.HasIOHints ? &main_layer.IOHints : NULL, false);
+    }
+  catch(...)
+    {
+    tracker->EndProgress();
+    throw;
+    }
+  tracker->AddProgress(1.0);
+
+  // The other layers only depend on the geometry of the main image, so they
+  // are read concurrently. Each of them is added once the layers before it
+  // in the project have been added, which keeps the order of the project
+  struct LayerRead
+  {
+    SmartPtr<AbstractOpenImageDelegate> Delegate;
+    SmartPtr<GuidedNativeImageIO> IO;
+    SmartPtr<AtomicProgressRecorderCommand> Recorder;
+    std::future<void> Done;
+  };
+  std::vector<LayerRead> reads(layers.size());
+
+  TaskScheduler *ts = TaskScheduler::GetInstance();
+  TaskScheduler::CancellationToken cancel;
+  int n_segs = 0;
+  for(unsigned int i = 1; i < layers.size(); i++)
+    {
+    ProjectLayer &pl = layers[i];
+
+    // Without hints in the project, the hints come from the associations
+    if(!pl.HasIOHints)
       {
-      main_loaded = true;      
+      Registry regAssoc;
+      m_SystemInterface->FindRegistryAssociatedWithFile(pl.FileName.c_str(), regAssoc);
+      pl.IOHints = regAssoc.Folder("Files.Grey");
       }
-    else if(role == LABEL_ROLE)
+
+    // TODO: this is spaggetti code
+    bool load_additive = (pl.Role == LABEL_ROLE && n_segs++ > 0);
+
+    LayerRead &lr = reads[i];
+    lr.Delegate = this->CreateOpenImageDelegate(pl.Role, pl.Folder, load_additive);
+    lr.IO = GuidedNativeImageIO::New();
+    lr.Delegate->ConfigureImageIO(lr.IO);
+    lr.Recorder = AtomicProgressRecorderCommand::New();
+
+    // The task only uses what it holds, so it may outlive this method if an
+    // earlier layer fails to load
+    SmartPtr<GuidedNativeImageIO> io = lr.IO;
+    SmartPtr<AtomicProgressRecorderCommand> recorder = lr.Recorder;
+    std::string fname = pl.FileName;
+    auto hints = std::make_shared<Registry>(pl.IOHints);
+    lr.Done = ts->Submit(TaskScheduler::USER_COMPUTE, [io, recorder, fname, hints]()
+      {
+      io->ReadNativeImageHeader(fname.c_str(), *hints, nullptr);
+      io->ReadNativeImageData(recorder);
+      }, cancel);
+    }
+
+  // Overlays are added first, and their contrast is fitted afterwards, so
+  // that their statistics can be computed concurrently
+  std::vector<ImageWrapperBase *> auto_contrast_layers;
+  m_DeferredAutoContrastLayers = &auto_contrast_layers;
+
+  try
+    {
+    for(unsigned int i = 1; i < layers.size(); i++)
       {
-      n_segs_loaded++;
+      LayerRead &lr = reads[i];
+
+      // Relay the progress of the read until it is done
+      double reported = 0.0;
+      while(lr.Done.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready)
+        {
+        double p = std::min(lr.Recorder->GetProgress(), 1.0);
+        if(p > reported)
+          {
+          tracker->AddProgress(0.9 * (p - reported));
+          reported = p;
+          }
+        }
+
+      // Rethrow any exception from the reader
+      lr.Done.get();
+
+      // Add the layer in the same way as OpenImageViaDelegate
+      lr.Delegate->ValidateHeader(lr.IO, warn);
+      lr.Delegate->UnloadCurrentImage();
+      this->AddImageViaDelegate(lr.IO, lr.Delegate, warn, layers[i].IOHints);
+
+      // Release the native image
+      lr = LayerRead();
+      tracker->AddProgress(1.0 - 0.9 * reported);
       }
     }
+  catch(...)
+    {
+    // Do not wait for the other layers
+    ts->Cancel(cancel);
+    m_DeferredAutoContrastLayers = NULL;
+    tracker->EndProgress();
+    throw;
+    }
 
-  // If main has not been loaded, throw an exception
-  if(!main_loaded)
-    throw IRISException("Empty or invalid project (main image not found in the project file).");
+  m_DeferredAutoContrastLayers = NULL;
+
+  // Compute the statistics of the overlays in parallel, then fit the contrast
+  std::vector<AbstractContinuousImageDisplayMappingPolicy *> policies;
+  for(ImageWrapperBase *layer : auto_contrast_layers)
+    {
+    AbstractContinuousImageDisplayMappingPolicy *policy =
+        dynamic_cast<AbstractContinuousImageDisplayMappingPolicy *>(layer->GetDisplayMapping());
+    if(policy && policy->IsContrastInDefaultState())
+      policies.push_back(policy);
+    }
+
+  ts->ParallelFor(TaskScheduler::USER_COMPUTE, 0, (long) policies.size(),
+                  [&policies](long first, long last)
+    {
+    for(long k = first; k < last; k++)
+      policies[k]->GetTDigest()->Update();
+    });
+
+  for(AbstractContinuousImageDisplayMappingPolicy *policy : policies)
+    policy->AutoFitContrast();
+
+  tracker->EndProgress();
 
   // Load Mesh Layers
   GetCurrentImageData()->GetMeshLayers()->
@@ -2392,7 +3336,7 @@ bool IRISApplication::IsProjectFile(const char *filename)
   // that this is a real registry, and then some minimal check to see that
   // this is a project file
 
-  if (!Registry::IsXML(filename))
+  if (!Registry::IsXML(filename) && !Registry::IsBinary(filename))
     return false;
 
   try
@@ -2595,6 +3539,7 @@ void IRISApplication::SetSnakeMode(SnakeType mode)
     m_GlobalState->SetSnakeType(mode);
 
     // Set the speed to invalud
+    this->EndDeferredSpeedVolume();
     m_GlobalState->SetSpeedValid(false);
 
     // Set the snake parameters. TODO: see how we did this in the old
@@ -2616,7 +3561,7 @@ SnakeType IRISApplication::GetSnakeMode() const
 
 void IRISApplication::LeaveGMMPreprocessingMode()
 {
-  m_GMMPreviewWrapper->DetachInputsAndOutputs(m_SNAPImageData);
+  this->DetachPreviewWrapper(PREPROCESS_GMM);
 
   // Before deleting the clustering engine, we store the mixture model
   // The smart pointer mechanism makes sure the mixture model lives on
@@ -2720,7 +3665,7 @@ void IRISApplication::EnterRandomForestPreprocessingMode()
 
 void IRISApplication::LeaveRandomForestPreprocessingMode()
 {
-  m_RandomForestPreviewWrapper->DetachInputsAndOutputs(m_SNAPImageData);
+  this->DetachPreviewWrapper(PREPROCESS_RF);
 
   // Before deleting the classification engine, we store the classifier
   // The smart pointer mechanism makes sure the classifier lives on
@@ -2749,15 +3694,16 @@ void IRISApplication::EnterPreprocessingMode(PreprocessingMode mode)
   if(mode == m_PreprocessingMode)
     return;
 
+  // Going back to preprocessing discards a speed image still in progress
+  if(mode != PREPROCESS_NONE)
+    this->EndDeferredSpeedVolume();
+
   // Detach the current mode
   switch(m_PreprocessingMode)
     {
     case PREPROCESS_THRESHOLD:
-      m_ThresholdPreviewWrapper->DetachInputsAndOutputs(m_SNAPImageData);
-      break;
-
     case PREPROCESS_EDGE:
-      m_EdgePreviewWrapper->DetachInputsAndOutputs(m_SNAPImageData);
+      this->DetachPreviewWrapper(m_PreprocessingMode);
       break;
 
     case PREPROCESS_GMM:
@@ -2856,10 +3802,299 @@ IRISApplication
   if(wrapper)
     {
     wrapper->ComputeOutputVolume(progress);
+    this->RecordSpeedPreprocessingMode(wrapper);
+    m_GlobalState->SetSpeedValid(true);
+    }
+}
+
+void
+IRISApplication
+::ApplyCurrentPreprocessingModeToSpeedVolumeLazily()
+{
+  AbstractSlicePreviewFilterWrapper *wrapper =
+      this->GetPreprocessingFilterPreviewer(m_PreprocessingMode);
+
+  if(wrapper)
+    {
+    this->EndDeferredSpeedVolume();
+    wrapper->BeginDeferredOutputVolume();
+    if(wrapper->IsOutputVolumePending())
+      {
+      m_DeferredSpeedMode = m_PreprocessingMode;
+      m_SNAPImageData->SetSpeedSource(wrapper);
+      }
+    this->RecordSpeedPreprocessingMode(wrapper);
     m_GlobalState->SetSpeedValid(true);
     }
 }
 
+void
+IRISApplication
+::RecordSpeedPreprocessingMode(AbstractSlicePreviewFilterWrapper *wrapper)
+{
+  m_SpeedPreprocessingMode = m_PreprocessingMode;
+  m_SpeedActiveScalarLayer = wrapper->GetActiveScalarLayer();
+}
+
+void
+IRISApplication
+::RecomputeSpeedVolume()
+{
+  // The pipeline is attached as when entering the mode, but the clustering
+  // and classification engines are not recreated: the mixture model or the
+  // classifier that computed the speed image is used as it is
+  SpeedImageWrapper *speed = m_SNAPImageData->GetSpeed();
+  switch(m_SpeedPreprocessingMode)
+    {
+    case PREPROCESS_THRESHOLD:
+      m_ThresholdPreviewWrapper->AttachInputs(m_SNAPImageData);
+      m_ThresholdPreviewWrapper->AttachOutputWrapper(speed);
+      break;
+    case PREPROCESS_EDGE:
+      m_EdgePreviewWrapper->AttachInputs(m_SNAPImageData);
+      m_EdgePreviewWrapper->AttachOutputWrapper(speed);
+      break;
+    case PREPROCESS_GMM:
+      m_GMMPreviewWrapper->AttachInputs(m_SNAPImageData);
+      m_GMMPreviewWrapper->AttachOutputWrapper(speed);
+      m_GMMPreviewWrapper->SetParameters(m_LastUsedMixtureModel);
+      break;
+    case PREPROCESS_RF:
+      m_RandomForestPreviewWrapper->AttachInputs(m_SNAPImageData);
+      m_RandomForestPreviewWrapper->AttachOutputWrapper(speed);
+      m_RandomForestPreviewWrapper->SetParameters(m_LastUsedRFClassifier);
+      break;
+    default:
+      throw IRISException("The speed image can not be computed again");
+    }
+
+  AbstractSlicePreviewFilterWrapper *wrapper =
+      this->GetPreprocessingFilterPreviewer(m_SpeedPreprocessingMode);
+  if(m_SpeedActiveScalarLayer)
+    wrapper->SetActiveScalarLayer(m_SpeedActiveScalarLayer);
+  wrapper->ComputeOutputVolume(NULL);
+  this->DetachPreviewWrapper(m_SpeedPreprocessingMode);
+}
+
+bool
+IRISApplication
+::CanPropagateActiveContourToTimePoints()
+{
+  return IsSnakeModeActive()
+      && m_IRISImageData->GetMain()->GetNumberOfTimePoints() > 1
+      && m_SpeedPreprocessingMode != PREPROCESS_NONE
+      && m_SNAPImageData->IsSpeedLoaded()
+      && m_SNAPImageData->IsSnakeLoaded();
+}
+
+void
+IRISApplication
+::PropagateActiveContourToTimePoints(unsigned int nIterations)
+{
+  assert(this->CanPropagateActiveContourToTimePoints());
+
+  typedef SNAPImageData::FloatImageType FloatImageType;
+  typedef SNAPImageData::SpeedImageType SpeedImageType;
+
+  // The speed image of the current time point is no longer needed
+  this->EndDeferredSpeedVolume();
+
+  SNAPSegmentationROISettings roi = m_GlobalState->GetSegmentationROISettings();
+  SnakeParameters parameters = m_GlobalState->GetSnakeParameters();
+  unsigned int tpCurrent = m_IRISImageData->GetMain()->GetTimePointIndex();
+  unsigned int nt = m_IRISImageData->GetMain()->GetNumberOfTimePoints();
+
+  // The contour at the current time point is the initialization of the level
+  // set at the others, with the same inside and outside values as bubbles
+  const FloatImageType *snake = m_SNAPImageData->GetSnake()->GetImage();
+  FloatImageType::Pointer seed = FloatImageType::New();
+  seed->CopyInformation(snake);
+  seed->SetRegions(snake->GetBufferedRegion());
+  seed->Allocate();
+  std::transform(snake->GetBufferPointer(),
+                 snake->GetBufferPointer() + snake->GetPixelContainer()->Size(),
+                 seed->GetBufferPointer(),
+                 [](float v) { return v <= 0.0f ? -4.0f : 4.0f; });
+
+  // The speed images are computed on this thread, since they use the
+  // pipelines attached to the SNAP layers. Each level set is evolved on the
+  // scheduler as soon as its speed image is ready
+  TaskScheduler *ts = TaskScheduler::GetInstance();
+  std::vector<std::pair<unsigned int, std::future<FloatImageType::Pointer> > > results;
+  try
+    {
+    for(unsigned int tp = 0; tp < nt; tp++)
+      {
+      if(tp == tpCurrent)
+        continue;
+
+      // Copy the ROI of the anatomical layers at this time point into the
+      // SNAP layers, which were extracted in the same order
+      m_IRISImageData->SetTimePoint(tp);
+      LayerIterator itSource = m_IRISImageData->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
+      LayerIterator itTarget = m_SNAPImageData->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
+      for(; !itSource.IsAtEnd() && !itTarget.IsAtEnd(); ++itSource, ++itTarget)
+        {
+        SmartPtr<ImageWrapperBase> roiLayer = itSource.GetLayer()->ExtractROI(roi, NULL);
+        itTarget.GetLayer()->UpdateTimePointFromWrapper(roiLayer);
+        }
+
+      this->RecomputeSpeedVolume();
+
+      typedef itk::ImageDuplicator<SpeedImageType> DuplicatorType;
+      DuplicatorType::Pointer dup = DuplicatorType::New();
+      dup->SetInputImage(m_SNAPImageData->GetSpeed()->GetImage());
+      dup->Update();
+      SpeedImageType::Pointer speed = dup->GetOutput();
+
+      results.push_back(std::make_pair(tp, ts->Submit(
+        TaskScheduler::USER_COMPUTE, [seed, speed, parameters, nIterations]()
+        {
+        FloatImageType::Pointer phi = FloatImageType::New();
+        phi->CopyInformation(seed);
+        phi->SetRegions(seed->GetBufferedRegion());
+        phi->Allocate();
+        std::copy(seed->GetBufferPointer(),
+                  seed->GetBufferPointer() + seed->GetPixelContainer()->Size(),
+                  phi->GetBufferPointer());
+
+        // The evolution is not played back, so no snapshots are kept
+        SNAPLevelSetDriver3d driver(phi, speed, parameters);
+        driver.SetSnapshotInterval(0);
+        driver.Run(nIterations);
+
+        FloatImageType::Pointer result = driver.GetOutput();
+        return result;
+        })));
+      }
+
+    // Merge the results in the order of the time points, each with its own
+    // undo point
+    for(auto &r : results)
+      {
+      FloatImageType::Pointer result = r.second.get();
+      m_IRISImageData->SetTimePoint(r.first);
+      this->MergeLevelSetWithIRIS(result, NULL, "Propagated Automatic Segmentation");
+      }
+    }
+  catch(...)
+    {
+    // The tasks only hold copies of the images, they may finish on their own
+    m_IRISImageData->SetTimePoint(tpCurrent);
+    throw;
+    }
+
+  m_IRISImageData->SetTimePoint(tpCurrent);
+}
+
+bool
+IRISApplication
+::IsSpeedVolumePending()
+{
+  return m_DeferredSpeedMode != PREPROCESS_NONE;
+}
+
+void
+IRISApplication
+::DetachPreviewWrapper(PreprocessingMode mode)
+{
+  if(mode == m_DeferredSpeedMode)
+    return;
+
+  switch(mode)
+    {
+    case PREPROCESS_THRESHOLD:
+      m_ThresholdPreviewWrapper->DetachInputsAndOutputs(m_SNAPImageData);
+      break;
+    case PREPROCESS_EDGE:
+      m_EdgePreviewWrapper->DetachInputsAndOutputs(m_SNAPImageData);
+      break;
+    case PREPROCESS_GMM:
+      m_GMMPreviewWrapper->DetachInputsAndOutputs(m_SNAPImageData);
+      break;
+    case PREPROCESS_RF:
+      m_RandomForestPreviewWrapper->DetachInputsAndOutputs(m_SNAPImageData);
+      break;
+    default:
+      break;
+    }
+}
+
+void
+IRISApplication
+::EndDeferredSpeedVolume()
+{
+  AbstractSlicePreviewFilterWrapper *wrapper =
+      this->GetPreprocessingFilterPreviewer(m_DeferredSpeedMode);
+  if(!wrapper)
+    return;
+
+  // An incomplete speed image is discarded, and the level set must not be
+  // evolving on it. A complete one is left to the level set, which finds
+  // that the pipeline reports no missing slabs once it is disconnected
+  if(wrapper->IsOutputVolumePending())
+    {
+    m_SNAPImageData->StopEvolution();
+    m_SNAPImageData->SetSpeedSource(NULL);
+    m_GlobalState->SetSpeedValid(false);
+    }
+
+  // The pipeline stays attached if its mode is the current one
+  PreprocessingMode mode = m_DeferredSpeedMode;
+  m_DeferredSpeedMode = PREPROCESS_NONE;
+  if(mode != m_PreprocessingMode)
+    this->DetachPreviewWrapper(mode);
+}
+
+bool
+IRISApplication
+::ComputeNextSpeedVolumeTile()
+{
+  // The speed image applied lazily comes first
+  PreprocessingMode mode = m_DeferredSpeedMode != PREPROCESS_NONE
+      ? m_DeferredSpeedMode : m_PreprocessingMode;
+
+  AbstractSlicePreviewFilterWrapper *wrapper =
+      this->GetPreprocessingFilterPreviewer(mode);
+
+  if(!wrapper)
+    return false;
+
+  // Once the speed image applied lazily is complete, its pipeline is
+  // disconnected. The active contour may have computed the last slabs
+  bool deferred = (mode == m_DeferredSpeedMode);
+  if(deferred && !wrapper->IsOutputVolumePending())
+    {
+    this->EndDeferredSpeedVolume();
+    return false;
+    }
+
+  try
+    {
+    bool more = wrapper->ComputeNextBackgroundTile();
+    if(deferred && !more)
+      this->EndDeferredSpeedVolume();
+    return more;
+    }
+  catch(itk::ExceptionObject &)
+    {
+    // Errors are reported when the speed volume is actually applied, or
+    // when the active contour needs the failed slab
+    return false;
+    }
+}
+
+bool
+IRISApplication
+::ContinueSpeedPreview()
+{
+  AbstractSlicePreviewFilterWrapper *wrapper =
+      this->GetPreprocessingFilterPreviewer(
+        m_DeferredSpeedMode != PREPROCESS_NONE ? m_DeferredSpeedMode : m_PreprocessingMode);
+
+  return wrapper && wrapper->ContinuePreview();
+}
+
 IRISApplication::BubbleArray&
 IRISApplication::GetBubbleArray()
 {
@@ -2874,7 +4109,116 @@ bool IRISApplication::InitializeActiveContourPipeline()
         m_BubbleArray, m_GlobalState->GetDrawingColorLabel());
 }
 
+void
+IRISApplication
+::StartSegmentationRecoveryJournal()
+{
+  this->StopSegmentationRecoveryJournal();
+
+  std::string fn;
+  try
+    {
+    fn = m_SystemInterface->GetRecoveryJournalAssociatedWithFile(
+          m_IRISImageData->GetMain()->GetFileName());
+    }
+  catch(IRISException &)
+    {
+    // Without a place to keep the journal, the session is not recorded
+    return;
+    }
+
+  // A journal that is still there was left behind by a session that did not
+  // end normally. It is set aside before the new journal overwrites it
+  std::string fn_prev = fn + ".recover";
+  std::string fn_found = itksys::SystemTools::FileExists(fn.c_str(), true)
+                         ? fn : fn + ".tmp";
+  if(itksys::SystemTools::FileExists(fn_found.c_str(), true))
+    {
+    std::remove(fn_prev.c_str());
+    std::rename(fn_found.c_str(), fn_prev.c_str());
+    }
+
+  m_PreviousRecoveryJournal =
+      itksys::SystemTools::FileExists(fn_prev.c_str(), true) ? fn_prev : std::string();
+
+  m_RecoveryJournal = new SegmentationRecoveryJournal(fn);
+  this->AttachSegmentationRecoveryJournal();
+}
+
+void
+IRISApplication
+::AttachSegmentationRecoveryJournal()
+{
+  if(!m_RecoveryJournal)
+    return;
+
+  LabelImageWrapper *selected = dynamic_cast<LabelImageWrapper *>(
+        m_IRISImageData->FindLayer(
+          m_GlobalState->GetSelectedSegmentationLayerId(), false, LABEL_ROLE));
 
+  // Only one segmentation is recorded at a time
+  for(LayerIterator it = m_IRISImageData->GetLayers(LABEL_ROLE); !it.IsAtEnd(); ++it)
+    {
+    LabelImageWrapper *wrapper = dynamic_cast<LabelImageWrapper *>(it.GetLayer());
+    if(wrapper && wrapper != selected && wrapper->GetRecoveryJournal() == m_RecoveryJournal)
+      wrapper->SetRecoveryJournal(NULL);
+    }
 
+  // This starts the journal over with a checkpoint of the segmentation
+  if(selected)
+    selected->SetRecoveryJournal(m_RecoveryJournal);
+}
 
+void
+IRISApplication
+::StopSegmentationRecoveryJournal()
+{
+  if(!m_RecoveryJournal)
+    return;
 
+  for(LayerIterator it = m_IRISImageData->GetLayers(LABEL_ROLE); !it.IsAtEnd(); ++it)
+    {
+    LabelImageWrapper *wrapper = dynamic_cast<LabelImageWrapper *>(it.GetLayer());
+    if(wrapper && wrapper->GetRecoveryJournal() == m_RecoveryJournal)
+      wrapper->SetRecoveryJournal(NULL);
+    }
+
+  m_RecoveryJournal->Discard();
+  delete m_RecoveryJournal;
+  m_RecoveryJournal = NULL;
+}
+
+bool
+IRISApplication
+::IsSegmentationRecoveryAvailable() const
+{
+  return m_PreviousRecoveryJournal.length() > 0;
+}
+
+bool
+IRISApplication
+::RecoverSegmentationFromJournal()
+{
+  if(IsSnakeModeActive() || !IsSegmentationRecoveryAvailable())
+    return false;
+
+  LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
+  if(!seg || !seg->RestoreFromRecoveryJournal(m_PreviousRecoveryJournal))
+    return false;
+
+  // The labels in the recovered segmentation should be shown as valid
+  this->SetColorLabelsInSegmentationAsValid(seg);
+  this->DiscardSegmentationRecovery();
+
+  InvokeEvent(SegmentationChangeEvent());
+  return true;
+}
+
+void
+IRISApplication
+::DiscardSegmentationRecovery()
+{
+  if(m_PreviousRecoveryJournal.length())
+    std::remove(m_PreviousRecoveryJournal.c_str());
+  m_PreviousRecoveryJournal.clear();
+}
@@ -71,7 +71,9 @@ struct IRISDisplayGeometry;
 class LabelUseHistory;
 class ImageAnnotationData;
 class LabelImageWrapper;
+class SegmentationRecoveryJournal;
 class ImageReadingProgressAccumulator;
+class ProgressToken;
 
 template <class TPixel, class TLabel, int VDim> class RandomForestClassifier;
 template <class TPixel, class TLabel, int VDim> class RFClassificationEngine;
@@ -389,6 +391,36 @@ public:
     */
   void ApplyCurrentPreprocessingModeToSpeedVolume(itk::Command *progress = 0);
 
+  /**
+    Same as ApplyCurrentPreprocessingModeToSpeedVolume, but returns at once:
+    the speed image is computed slab by slab, where the active contour needs
+    it, and the rest by ComputeNextSpeedVolumeTile. The pipeline of the mode
+    stays attached after leaving preprocessing mode, until the speed image
+    is complete, so the slice views keep showing the preview. The SpeedValid
+    flag is set to true right away.
+    */
+  void ApplyCurrentPreprocessingModeToSpeedVolumeLazily();
+
+  /**
+    Whether a speed image applied lazily is still being computed
+    */
+  bool IsSpeedVolumePending();
+
+  /**
+    Computes the next tile of the speed image for the current preprocessing
+    mode ahead of time, so that ApplyCurrentPreprocessingModeToSpeedVolume
+    has little left to do. Call this when the application is idle. Returns
+    true if there are more tiles to compute.
+    */
+  bool ComputeNextSpeedVolumeTile();
+
+  /**
+    In preprocessing preview mode, mark the slices of the speed image whose
+    preview is still incomplete for update. Returns true if there were any,
+    in which case the views should be redrawn.
+    */
+  bool ContinueSpeedPreview();
+
   /**
     Get the current preprocessing mode
     */
@@ -419,6 +451,27 @@ public:
    */
   void UpdateIRISWithSnapImageData(CommandType *progressCommand = NULL);
 
+  /**
+   * Whether the active contour can be propagated to the other time points of
+   * the main image, i.e., the image has several time points and the speed
+   * image was computed by one of the preprocessing modes, so that it can be
+   * computed again from the voxels of the other time points.
+   */
+  bool CanPropagateActiveContourToTimePoints();
+
+  /**
+   * Segment the other time points of the main image with the active contour,
+   * and update the IRIS segmentation of each of them. The contour evolved at
+   * the current time point seeds the level set at the other time points,
+   * which are evolved for nIterations with the same parameters. The speed
+   * images are computed one time point after the other, while the level sets
+   * of the time points computed before evolve concurrently on the task
+   * scheduler. Afterwards the SNAP layers hold the voxels of the last time
+   * point, so this is called once the segmentation is finished, before the
+   * SNAP image data is released.
+   */
+  void PropagateActiveContourToTimePoints(unsigned int nIterations);
+
   /**
    * Get the segmentation label data
    */
@@ -488,6 +541,14 @@ public:
    */
   void SetCursorTimePoint(unsigned int time_point, bool force = false);
 
+  /**
+   * Apply the memory budget from the default behavior settings. If the
+   * layers and caches use more memory than that, caches are dropped and
+   * layer data is demoted (see MemoryAccounting). Called after images are
+   * loaded and the time point changes.
+   */
+  void EnforceMemoryBudget();
+
   /**
    * Get the current time point
    */
@@ -505,9 +566,29 @@ public:
    */
   void ExportSlice(AnatomicalDirection iSliceAnatomy, const char *file);
 
+  /**
+   * Export a range of slices of the main image, as ExportSlice() does. The
+   * file names are made from a pattern with a printf-style integer field for
+   * the slice number (from 1), e.g., "axial_%04d.png", and a second one for
+   * the time point (from 1) when all time points are exported. The slices
+   * are extracted by the slicing pipeline without rendering, and are encoded
+   * and written in parallel. The cursor and the time point are not changed.
+   */
+  void ExportSliceSeries(AnatomicalDirection iSliceAnatomy,
+                         unsigned int first, unsigned int last,
+                         bool allTimePoints, const char *pattern,
+                         ProgressToken *progress = NULL);
+
   /** Export voxel statistis to a file */
   void ExportSegmentationStatistics(const char *file);
 
+  /**
+   * Export voxel statistics for every time point of the segmentation to a
+   * file, comma separated if the file name ends with .csv, tab separated
+   * otherwise
+   */
+  void ExportSegmentationStatisticsForAllTimePoints(const char *file);
+
   /**
    * Export the 3D mesh to a file, using settings passed in the
    * MeshExportSettings structure.
@@ -527,6 +608,38 @@ public:
    */
   size_t ReplaceLabel(LabelType drawing, LabelType drawover);
 
+  /**
+   * Clear the voxels of a label that are not in its largest connected
+   * component, as one undo step. With full connectivity, voxels that touch
+   * at an edge or a corner are connected, otherwise only voxels that share
+   * a face. Returns the number of voxels changed.
+   */
+  size_t KeepLargestConnectedComponent(LabelType label, bool fully_connected = false);
+
+  /**
+   * Clear the connected components of a label that have fewer than
+   * min_voxels voxels, as one undo step. Returns the number of voxels changed.
+   */
+  size_t RemoveSmallConnectedComponents(LabelType label, size_t min_voxels,
+                                        bool fully_connected = false);
+
+  /**
+   * Flood fill the selected segmentation from a seed voxel: the connected
+   * region of voxels that have the label of the seed is painted with the
+   * current drawing label, subject to the draw-over mode. In reverse mode,
+   * the region of the drawing label that contains the seed is cleared. With
+   * a slice axis between 0 and 2, the region is limited to the slice through
+   * the seed along that axis, otherwise it is found in 3D. If a grey image
+   * is given, only its voxels with native intensities between lower and
+   * upper are filled. The change is stored as an undo point with undo_text,
+   * or only added to the pending undo deltas if undo_text is NULL. Returns
+   * the number of voxels changed.
+   */
+  size_t FloodFillSegmentation(const Vector3ui &seed, int slice_axis,
+                               ScalarImageWrapperBase *grey,
+                               double lower, double upper,
+                               bool reverse, const char *undo_text);
+
   /**
     Number of voxels of a given label in the segmentation.
     */
@@ -649,9 +762,14 @@ public:
   void SaveProject(const std::string &proj_file);
 
   /**
-   * Open an existing project.
+   * Open an existing project. The main image is loaded first, and then the
+   * other layers are read concurrently and added in project order as they
+   * become available. The progress command receives the progress of the
+   * whole operation, and is called from this thread, so a GUI can show the
+   * main image while the other layers load.
    */
-  void OpenProject(const std::string &proj_file, IRISWarningList &warn);
+  void OpenProject(const std::string &proj_file, IRISWarningList &warn,
+                   itk::Command *progress = NULL);
 
   /**
    * Get Moved File Path from the absolute file path in the original project file
@@ -694,15 +812,32 @@ public:
   void RecordCurrentLabelUse();
 
   /**
-   * Reload a grey image wrapper from the source file on the disk
+   * Reload a grey image wrapper from the source file on the disk. Only the
+   * time points that differ from the file are replaced
    */
   void ReloadGreyImageWrapperFromFile(ImageWrapperBase *wrapper);
 
   /**
-   * Reload a segmentation image wrapper from the source file on the disk
+   * Reload a segmentation image wrapper from the source file on the disk.
+   * Only the time points that differ from the file are replaced
    */
   void ReloadSegmentationWrapperFromFile(ImageWrapperBase *wrapper);
 
+  /**
+   * Crash recovery. While the main image is loaded, the changes to the
+   * selected segmentation are recorded in a journal associated with the main
+   * image file, which is deleted when the image is unloaded. A journal left
+   * behind by a session that ended abnormally is set aside when the image is
+   * loaded again, and can then be replayed into the selected segmentation.
+   */
+  bool IsSegmentationRecoveryAvailable() const;
+
+  /** Replay the journal of the previous session into the selected segmentation */
+  bool RecoverSegmentationFromJournal();
+
+  /** Delete the journal of the previous session */
+  void DiscardSegmentationRecovery();
+
 
 protected:
 
@@ -712,6 +847,16 @@ protected:
   // Map cursor from one image data to another
   void TransferCursor(GenericImageData *source, GenericImageData *target);
 
+  // Export the meshes of every time point of the segmentation
+  void ExportSegmentationMeshForAllTimePoints(const MeshExportSettings &sets,
+                                              itk::Command *progress);
+
+  // Clear the connected components of a label in the selected segmentation
+  // that have fewer than min_voxels voxels, or all but the largest one
+  size_t RemoveConnectedComponents(LabelType label, bool fully_connected,
+                                   bool keep_largest, size_t min_voxels,
+                                   const char *undo_text);
+
   // Image data objects
   GenericImageData *m_CurrentImageData;
   SmartPtr<IRISImageData> m_IRISImageData;
@@ -796,6 +941,14 @@ protected:
   // The currently hooked up preprocessing filter preview wrapper
   PreprocessingMode m_PreprocessingMode;
 
+  // The mode whose pipeline is computing the speed image lazily, if any
+  PreprocessingMode m_DeferredSpeedMode;
+
+  // The mode that computed the current speed image, and its scalar layer,
+  // with which the speed of other time points is computed
+  PreprocessingMode m_SpeedPreprocessingMode;
+  ScalarImageWrapperBase *m_SpeedActiveScalarLayer;
+
   // Array of bubbles
   BubbleArray m_BubbleArray;
 
@@ -808,6 +961,26 @@ protected:
   // Create layer-specific segmentation settings (threshold settings, e.g.)
   void CreateSegmentationSettings(ImageWrapperBase *wrapper, LayerRole role);
 
+  // Disconnect the preview pipeline of a mode, unless it is still busy
+  // computing the speed image lazily
+  void DetachPreviewWrapper(PreprocessingMode mode);
+
+  // Stop computing the speed image lazily and disconnect the pipeline. If
+  // the speed image is not complete, it is marked as invalid
+  void EndDeferredSpeedVolume();
+
+  // Remember the mode used to compute the speed image
+  void RecordSpeedPreprocessingMode(AbstractSlicePreviewFilterWrapper *wrapper);
+
+  // Compute the speed image again from the SNAP layers, with the mode that
+  // computed it before, attaching its pipeline only for the computation
+  void RecomputeSpeedVolume();
+
+  // Merge a level set over the ROI with the IRIS segmentation at its
+  // current time point
+  void MergeLevelSetWithIRIS(const LevelSetImageWrapper::ImageType *levelset,
+                             CommandType *progressCommand, const char *undoName);
+
   // Helper functions for GMM mode enter/exit
   void EnterGMMPreprocessingMode();
   void LeaveGMMPreprocessingMode();
@@ -831,9 +1004,39 @@ protected:
   // Auto-adjust contrast of a layer on load
   void AutoContrastLayerOnLoad(ImageWrapperBase *layer);
 
+  // While the layers of a project are added, the layers to auto-adjust are
+  // collected here instead, so that their statistics are computed together
+  std::vector<ImageWrapperBase *> *m_DeferredAutoContrastLayers;
+
+  // Create the default delegate for opening an image in a particular role
+  SmartPtr<AbstractOpenImageDelegate> CreateOpenImageDelegate(
+      LayerRole role, Registry *meta_data_reg, bool additive);
+
+  // Validate an image whose data has been read, and add it to the
+  // application through the delegate
+  ImageWrapperBase *AddImageViaDelegate(GuidedNativeImageIO *io,
+                                        AbstractOpenImageDelegate *del,
+                                        IRISWarningList &wl,
+                                        const Registry &ioHints);
+
   // -------------- Saving IRIS state during SNAP mode --------------------
   unsigned long m_SavedIRISSelectedSegmentationLayerId;
 
+  // -------------- Crash recovery ----------------------------------------
+  SegmentationRecoveryJournal *m_RecoveryJournal;
+
+  // The journal left behind by the previous session, if any
+  std::string m_PreviousRecoveryJournal;
+
+  // Create the journal for the main image, setting aside an existing one
+  void StartSegmentationRecoveryJournal();
+
+  // Record the changes to the selected segmentation layer in the journal
+  void AttachSegmentationRecoveryJournal();
+
+  // Delete the journal when the main image is unloaded
+  void StopSegmentationRecoveryJournal();
+
 };
 
 #endif // __IRISApplication_h_
@@ -8,6 +8,9 @@ namespace annot
 /** Global annotation Id counter */
 unsigned long GlobalAnnotationIndex = 0;
 
+/** Global counter of changes to the position and visibility of annotations */
+unsigned long GlobalAnnotationGeometryTime = 0;
+
 Vector3ui AbstractAnnotation::GetColor3ui() const
 {
   return to_unsigned_int(this->GetColor() * 255.0 + 0.5);
@@ -40,6 +43,34 @@ bool AbstractAnnotation::IsVisible(int plane) const
   return true;
 }
 
+void AbstractAnnotation::SetVisibleInAllSlices(bool value)
+{
+  m_VisibleInAllSlices = value;
+  GeometryModified();
+}
+
+void AbstractAnnotation::SetVisibleInAllPlanes(bool value)
+{
+  m_VisibleInAllPlanes = value;
+  GeometryModified();
+}
+
+void AbstractAnnotation::SetPlane(int plane)
+{
+  m_Plane = plane;
+  GeometryModified();
+}
+
+unsigned long AbstractAnnotation::GetGeometryTime()
+{
+  return GlobalAnnotationGeometryTime;
+}
+
+void AbstractAnnotation::GeometryModified()
+{
+  ++GlobalAnnotationGeometryTime;
+}
+
 void AbstractAnnotation::Save(Registry &folder)
 {
   folder["Selected"] << m_Selected;
@@ -58,6 +89,7 @@ void AbstractAnnotation::Load(Registry &folder)
   m_Plane = folder["Plane"][0];
   m_Color = folder["Color"][Vector3d(1.0, 0.0, 0.0)];
   folder["Tags"].GetList(m_Tags);
+  GeometryModified();
 }
 
 unsigned long AbstractAnnotation::GetUniqueId() const
@@ -86,6 +118,12 @@ Vector3d LineSegmentAnnotation::GetAnchorPoint(int plane) const
   return (m_Segment.first + m_Segment.second) * 0.5;
 }
 
+void LineSegmentAnnotation::SetSegment(const LineSegment &segment)
+{
+  m_Segment = segment;
+  GeometryModified();
+}
+
 void LineSegmentAnnotation::Save(Registry &folder)
 {
   Superclass::Save(folder);
@@ -107,6 +145,7 @@ void LineSegmentAnnotation::MoveBy(const Vector3d &offset)
 {
   m_Segment.first += offset;
   m_Segment.second += offset;
+  GeometryModified();
 }
 
 Vector3d LineSegmentAnnotation::GetCenter() const
@@ -126,9 +165,16 @@ Vector3d LandmarkAnnotation::GetAnchorPoint(int plane) const
   return m_Landmark.Pos;
 }
 
+void LandmarkAnnotation::SetLandmark(const Landmark &landmark)
+{
+  m_Landmark = landmark;
+  GeometryModified();
+}
+
 void LandmarkAnnotation::MoveBy(const Vector3d &offset)
 {
   m_Landmark.Pos += offset;
+  GeometryModified();
 }
 
 Vector3d LandmarkAnnotation::GetCenter() const
@@ -156,15 +202,23 @@ void LandmarkAnnotation::Load(Registry &folder)
 
 }
 
+ImageAnnotationData::ImageAnnotationData()
+{
+  m_IndexGeometryTime = 0;
+  m_IndexValid = false;
+}
+
 void ImageAnnotationData::AddAnnotation(ImageAnnotationData::AbstractAnnotation *annot)
 {
   SmartPtr<AbstractAnnotation> myannot = annot;
   m_Annotations.push_back(myannot);
+  m_IndexValid = false;
 }
 
 void ImageAnnotationData::Reset()
 {
   m_Annotations.clear();
+  m_IndexValid = false;
 }
 
 void ImageAnnotationData::SaveAnnotations(Registry &reg)
@@ -198,6 +252,7 @@ void ImageAnnotationData::LoadAnnotations(Registry &reg)
 
   // Clear the annotations
   m_Annotations.clear();
+  m_IndexValid = false;
 
   // Read the list of annotations
   int n_annot = reg["Annotations.ArraySize"][0];
@@ -228,6 +283,71 @@ void ImageAnnotationData::LoadAnnotations(Registry &reg)
     }
 }
 
+void ImageAnnotationData::UpdateIndex() const
+{
+  if(m_IndexValid
+     && m_IndexGeometryTime == AbstractAnnotation::GetGeometryTime()
+     && m_IndexedAnnotations.size() == m_Annotations.size())
+    return;
+
+  m_IndexedAnnotations.clear();
+  m_IndexedAnnotations.reserve(m_Annotations.size());
+  for(int plane = 0; plane < 3; plane++)
+    {
+    m_Index[plane].Slices.clear();
+    m_Index[plane].AllSlices.clear();
+    }
+
+  // This follows the logic of AbstractAnnotation::IsVisible
+  for(AnnotationConstIterator it = m_Annotations.begin(); it != m_Annotations.end(); ++it)
+    {
+    AbstractAnnotation *a = *it;
+    unsigned int pos = (unsigned int) m_IndexedAnnotations.size();
+    m_IndexedAnnotations.push_back(a);
+
+    for(int plane = 0; plane < 3; plane++)
+      {
+      if(!a->GetVisibleInAllPlanes() && plane != a->GetPlane())
+        continue;
+
+      if(a->GetVisibleInAllSlices())
+        m_Index[plane].AllSlices.push_back(pos);
+      else
+        m_Index[plane].Slices[a->GetSliceIndex(plane)].push_back(pos);
+      }
+    }
+
+  m_IndexGeometryTime = AbstractAnnotation::GetGeometryTime();
+  m_IndexValid = true;
+}
+
+void ImageAnnotationData::FindVisibleAnnotations(
+    int plane, int slice, AnnotationVector &result) const
+{
+  result.clear();
+  if(plane < 0 || plane > 2)
+    return;
+
+  this->UpdateIndex();
+
+  // Merge the annotations in the slice with those shown in all slices,
+  // keeping the list order (which is also the drawing order)
+  const PlaneIndex &pi = m_Index[plane];
+  auto it_slice = pi.Slices.find(slice);
+  static const std::vector<unsigned int> empty;
+  const std::vector<unsigned int> &in_slice = (it_slice != pi.Slices.end()) ? it_slice->second : empty;
+
+  result.reserve(in_slice.size() + pi.AllSlices.size());
+  auto a = in_slice.begin(), b = pi.AllSlices.begin();
+  while(a != in_slice.end() || b != pi.AllSlices.end())
+    {
+    if(b == pi.AllSlices.end() || (a != in_slice.end() && *a < *b))
+      result.push_back(m_IndexedAnnotations[*a++]);
+    else
+      result.push_back(m_IndexedAnnotations[*b++]);
+    }
+}
+
 template<class TAnnotPtr>
 ImageAnnotationIterator<TAnnotPtr>
 ::ImageAnnotationIterator(const ImageAnnotationData *data)
@@ -5,6 +5,8 @@
 #include <utility>
 #include <string>
 #include <list>
+#include <unordered_map>
+#include <vector>
 #include "itkDataObject.h"
 #include "itkObjectFactory.h"
 #include "TagList.h"
@@ -42,13 +44,16 @@ public:
   irisGetSetMacro(Selected, bool)
 
   /** Whether this annotation is visible in all slices or just its own slice */
-  irisGetSetMacro(VisibleInAllSlices, bool)
+  irisGetMacro(VisibleInAllSlices, bool)
+  virtual void SetVisibleInAllSlices(bool value);
 
   /** Whether this annotation is visible in all ortho planes or just its own plane */
-  irisGetSetMacro(VisibleInAllPlanes, bool)
+  irisGetMacro(VisibleInAllPlanes, bool)
+  virtual void SetVisibleInAllPlanes(bool value);
 
   /** The image dimension to which this annotation belongs, or -1 if it's non-planar */
-  irisGetSetMacro(Plane, int)
+  irisGetMacro(Plane, int)
+  virtual void SetPlane(int plane);
 
   /** Get the color of the annotation */
   irisGetSetMacro(Color, const Vector3d &)
@@ -90,11 +95,21 @@ public:
   /** Get the unique id of this tag */
   virtual unsigned long GetUniqueId() const;
 
+  /**
+   * A counter that is incremented whenever any annotation changes position,
+   * plane or visibility. It tells ImageAnnotationData when its slice index
+   * is out of date.
+   */
+  static unsigned long GetGeometryTime();
+
 protected:
 
   AbstractAnnotation();
   ~AbstractAnnotation() {}
 
+  /** Called by the subclasses when the position of the annotation changes */
+  static void GeometryModified();
+
   // Unique Id of this annotation, may not be zero
   unsigned long m_UniqueId;
 
@@ -120,7 +135,8 @@ public:
 
   typedef LineSegment                   ObjectType;
 
-  irisGetSetMacro(Segment, const LineSegment &)
+  irisGetMacro(Segment, const LineSegment &)
+  virtual void SetSegment(const LineSegment &segment);
 
   virtual void Save(Registry &folder) ITK_OVERRIDE;
   virtual void Load(Registry &folder) ITK_OVERRIDE;
@@ -156,7 +172,8 @@ public:
 
   typedef Landmark                   ObjectType;
 
-  irisGetSetMacro(Landmark, const Landmark &)
+  irisGetMacro(Landmark, const Landmark &)
+  virtual void SetLandmark(const Landmark &landmark);
 
   virtual void MoveBy(const Vector3d &offset) ITK_OVERRIDE;
   virtual Vector3d GetCenter() const ITK_OVERRIDE;
@@ -193,6 +210,7 @@ public:
   typedef std::list<AnnotationPtr> AnnotationList;
   typedef AnnotationList::iterator AnnotationIterator;
   typedef AnnotationList::const_iterator AnnotationConstIterator;
+  typedef std::vector<AbstractAnnotation *> AnnotationVector;
 
   irisITKObjectMacro(ImageAnnotationData, itk::DataObject)
 
@@ -207,11 +225,40 @@ public:
   void SaveAnnotations(Registry &reg);
   void LoadAnnotations(Registry &reg);
 
+  /**
+   * Find the annotations that are visible in a given plane and slice (as
+   * defined by AbstractAnnotation::IsVisible), in list order. The lookup only
+   * touches the annotations in that slice, using an index of the annotations
+   * by plane and slice. The index is rebuilt on the next lookup after
+   * annotations are added, removed or moved.
+   */
+  void FindVisibleAnnotations(int plane, int slice, AnnotationVector &result) const;
+
 protected:
-  ImageAnnotationData() {}
+  ImageAnnotationData();
   ~ImageAnnotationData() {}
 
   AnnotationList m_Annotations;
+
+  // Annotations in one plane, as positions in m_IndexedAnnotations
+  struct PlaneIndex
+  {
+    // Annotations shown only in their own slice, by slice
+    std::unordered_map<int, std::vector<unsigned int> > Slices;
+
+    // Annotations shown in all slices
+    std::vector<unsigned int> AllSlices;
+  };
+
+  void UpdateIndex() const;
+
+  // The index is built lazily and kept up to date by checking the geometry
+  // time and the number of annotations (annotations may be removed through
+  // the list returned by GetAnnotations)
+  mutable PlaneIndex m_Index[3];
+  mutable AnnotationVector m_IndexedAnnotations;
+  mutable unsigned long m_IndexGeometryTime;
+  mutable bool m_IndexValid;
 };
 
 /** Iterator that searches for annotations */
@@ -4,6 +4,9 @@
 #include "HistoryManager.h"
 #include "IRISImageData.h"
 #include "ImageWrapperTraits.h"
+#include "GlobalState.h"
+#include "DefaultBehaviorSettings.h"
+#include "SNAPLatencyMonitor.h"
 #include <itkImageIOBase.h>
 #include <itkImageBase.h>
 
@@ -36,6 +39,19 @@ void LoadAnatomicImageDelegate
     }
 }
 
+void LoadAnatomicImageDelegate
+::ConfigureImageIO(GuidedNativeImageIO *io)
+{
+  // Uncompressed images, or only the large 4D ones, may be paged in from disk
+  // as they are viewed
+  DefaultBehaviorSettings *dbs = m_Driver->GetGlobalState()->GetDefaultBehaviorSettings();
+  io->SetUseMemoryMapping(dbs->GetMemoryMapImages());
+  io->SetUseMemoryMappingFor4D(dbs->GetLazyLoad4DImages());
+
+  // Sessions that open the same file may share its decoded voxels
+  io->SetShareDecodedData(dbs->GetShareDecodedImages());
+}
+
 
 /* =============================
    MAIN Image
@@ -66,6 +82,8 @@ void
 LoadMainImageDelegate
 ::ConfigureImageIO(GuidedNativeImageIO *io)
 {
+  Superclass::ConfigureImageIO(io);
+
   if (m_Load4DAsMultiComponent)
     io->SetLoad4DAsMultiComponent(true);
   else if (m_LoadMultiComponentAs4D)
@@ -123,6 +141,17 @@ LoadOverlayImageDelegate
   */
 }
 
+void
+LoadOverlayImageDelegate
+::ConfigureImageIO(GuidedNativeImageIO *io)
+{
+  Superclass::ConfigureImageIO(io);
+
+  // Floating point overlays may be kept in a compact quantized form
+  DefaultBehaviorSettings *dbs = m_Driver->GetGlobalState()->GetDefaultBehaviorSettings();
+  io->SetFloatImageStorage(dbs->GetFloatOverlayStorage());
+}
+
 LoadOverlayImageDelegate::LoadOverlayImageDelegate()
 {
   this->m_HistoryName = "AnatomicImage";
@@ -333,23 +362,29 @@ void DefaultSaveImageDelegate
 ::SaveImage(const std::string &fname, GuidedNativeImageIO *io,
             Registry &reg, IRISWarningList &wl)
 {
-  try
-    {
-    m_SaveSuccessful = false;
-    m_Wrapper->WriteToFile(fname.c_str(), reg);
-    m_SaveSuccessful = true;
+  SNAP_LATENCY_SCOPE(SNAPLatencyMonitor::IMAGE_SAVE);
+  this->WriteImage(fname, reg);
+  this->FinishSaving(fname);
+}
 
-    m_Wrapper->SetFileName(fname);
-    for(std::list<std::string>::const_iterator it = m_HistoryNames.begin();
-        it != m_HistoryNames.end(); ++it)
-      {
-      m_Driver->GetHistoryManager()->UpdateHistory(*it, fname, m_Track);
-      }
-    }
-  catch(std::exception &exc)
+void DefaultSaveImageDelegate
+::WriteImage(const std::string &fname, Registry &reg)
+{
+  m_SaveSuccessful = false;
+  m_Wrapper->WriteToFile(fname.c_str(), reg);
+}
+
+void DefaultSaveImageDelegate
+::FinishSaving(const std::string &fname)
+{
+  m_SaveSuccessful = true;
+
+  m_Wrapper->SetFileName(fname);
+  for(std::list<std::string>::const_iterator it = m_HistoryNames.begin();
+      it != m_HistoryNames.end(); ++it)
     {
-    throw exc;
-   }
+    m_Driver->GetHistoryManager()->UpdateHistory(*it, fname, m_Track);
+    }
 }
 
 const char *DefaultSaveImageDelegate::GetCurrentFilename()
@@ -409,6 +444,25 @@ AbstractReloadWrapperDelegate
 }
 
 
+void
+AbstractReloadWrapperDelegate
+::UpdateWrapper()
+{
+  if(!m_ApplyImage)
+    this->ReadImage();
+
+  bool replaced = m_ApplyImage();
+  m_ApplyImage = nullptr;
+
+  m_Driver->SetCursorPosition(m_Driver->GetCursorPosition(), true);
+
+  // A replaced image needs the renderers to rebuild their assemblies, while
+  // updated time points are simply redrawn
+  if(replaced)
+    m_Driver->InvokeEvent(LayerChangeEvent());
+}
+
+
 /* =============================
    RELOAD anatomic wrapper
    ============================= */
@@ -416,43 +470,54 @@ AbstractReloadWrapperDelegate
 
 void
 ReloadAnatomicWrapperDelegate
-::UpdateWrapper()
+::ReadImage()
 {
   m_IO->ReadNativeImageData();
 
+  // Quantized floating point images are rescaled to their compact type again
+  typedef QuantizedImageWrapperTraits<short>::ScalarTraits Quantized16Traits;
+  typedef QuantizedImageWrapperTraits<unsigned char>::ScalarTraits Quantized8Traits;
+  if(dynamic_cast<Quantized16Traits::WrapperType *>(m_Wrapper.GetPointer()))
+    {
+    ReadImageWithTraits<Quantized16Traits>();
+    return;
+    }
+  if(dynamic_cast<Quantized8Traits::WrapperType *>(m_Wrapper.GetPointer()))
+    {
+    ReadImageWithTraits<Quantized8Traits>();
+    return;
+    }
+
   // this logic tracks GenericImageData::CreateAnatomicWrapper
   switch(m_IO->GetComponentTypeInNativeImage())
     {
-    case itk::IOComponentEnum::UCHAR:  UpdateWrapperInternal<unsigned char>(); break;
-    case itk::IOComponentEnum::CHAR:   UpdateWrapperInternal<char>(); break;
-    case itk::IOComponentEnum::USHORT: UpdateWrapperInternal<unsigned short>(); break;
-    case itk::IOComponentEnum::SHORT:  UpdateWrapperInternal<short>(); break;
-    default: UpdateWrapperInternal<float>(); break;
+    case itk::IOComponentEnum::UCHAR:  ReadImageInternal<unsigned char>(); break;
+    case itk::IOComponentEnum::CHAR:   ReadImageInternal<char>(); break;
+    case itk::IOComponentEnum::USHORT: ReadImageInternal<unsigned short>(); break;
+    case itk::IOComponentEnum::SHORT:  ReadImageInternal<short>(); break;
+    default: ReadImageInternal<float>(); break;
     }
 }
 
 template<typename TPixel>
 void
 ReloadAnatomicWrapperDelegate
-::UpdateWrapperInternal()
+::ReadImageInternal()
 {
   if (m_IO->GetNumberOfComponentsInNativeImage() > 1)
-    UpdateWrapperWithTraits<AnatomicImageWrapperTraits<TPixel>>();
+    ReadImageWithTraits<AnatomicImageWrapperTraits<TPixel>>();
   else
-    UpdateWrapperWithTraits<AnatomicScalarImageWrapperTraits<TPixel>>();
+    ReadImageWithTraits<AnatomicScalarImageWrapperTraits<TPixel>>();
 }
 
 template<typename TTraits>
 void
 ReloadAnatomicWrapperDelegate
-::UpdateWrapperWithTraits()
+::ReadImageWithTraits()
 {
   using WrapperType = typename TTraits::WrapperType;
   using Image4DType = typename WrapperType::Image4DType;
 
-  RescaleNativeImageToIntegralType<Image4DType> rescaler;
-  typename Image4DType::Pointer image4d = rescaler(m_IO);
-
   auto anatomicWrapper = dynamic_cast<WrapperType*>(m_Wrapper.GetPointer());
 
   if (!anatomicWrapper)
@@ -463,9 +528,25 @@ ReloadAnatomicWrapperDelegate
     throw IRISException("Error reloading image from file: %s", oss.str().c_str());
     }
 
-  anatomicWrapper->SetImage4D(image4d);
-  m_Driver->SetCursorPosition(m_Driver->GetCursorPosition(), true);
-  m_Driver->InvokeEvent(LayerChangeEvent()); // important, to trigger renderer rebuild assemblies
+  RescaleNativeImageToIntegralType<Image4DType> rescaler;
+  SmartPtr<Image4DType> image4d = rescaler(m_IO);
+  double scale = rescaler.GetNativeScale(), shift = rescaler.GetNativeShift();
+
+  // The wrapper is kept alive by m_Wrapper
+  m_ApplyImage = [anatomicWrapper, image4d, scale, shift]()
+    {
+    // The range of the data may have changed, and with it the quantization
+    typedef typename TTraits::NativeIntensityMapping NativeMapping;
+    if constexpr(std::is_same<NativeMapping, LinearInternalToNativeIntensityMapping>::value)
+      {
+      NativeMapping mapping(scale, shift);
+      if(mapping != anatomicWrapper->GetNativeMapping())
+        anatomicWrapper->SetNativeMapping(mapping);
+      }
+
+    anatomicWrapper->UpdateChangedTimePoints(image4d);
+    return anatomicWrapper->GetImage4D() == image4d.GetPointer();
+    };
 }
 
 
@@ -476,7 +557,7 @@ ReloadAnatomicWrapperDelegate
 
 void
 ReloadSegmentationWrapperDelegate
-::UpdateWrapper()
+::ReadImage()
 {
   m_IO->ReadNativeImageData();
 
@@ -486,9 +567,14 @@ ReloadSegmentationWrapperDelegate
     throw IRISException("Error reloading segmentation from file: Error casting to LabelIamgeWrapper!");
     }
 
+  // The header is taken from the wrapper, which is kept alive by m_Wrapper,
+  // since the main image may be unloaded while the file is being read
+  SmartPtr<LabelImageWrapper::Image4DType> labelImage =
+      GenericImageData::CompressSegmentation(m_IO, labelWrapper->GetImage4DBase());
 
-  auto labelImage = m_Driver->GetIRISImageData()->CompressSegmentation(m_IO);
-  labelWrapper->SetImage4D(labelImage);
-  m_Driver->SetCursorPosition(m_Driver->GetCursorPosition(), true);
-  m_Driver->InvokeEvent(LayerChangeEvent()); // important, to trigger renderer rebuild assemblies
+  m_ApplyImage = [labelWrapper, labelImage]()
+    {
+    labelWrapper->UpdateChangedTimePoints(labelImage);
+    return labelWrapper->GetImage4D() == labelImage.GetPointer();
+    };
 }
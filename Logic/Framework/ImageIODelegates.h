@@ -7,6 +7,7 @@
 #include "IRISException.h"
 #include "GuidedNativeImageIO.h"
 #include <vector>
+#include <functional>
 
 class IRISApplication;
 class IRISWarningList;
@@ -84,6 +85,8 @@ public:
 
   virtual void ValidateHeader(GuidedNativeImageIO *io, IRISWarningList &wl) ITK_OVERRIDE;
 
+  virtual void ConfigureImageIO(GuidedNativeImageIO *io) ITK_OVERRIDE;
+
 protected:
   LoadAnatomicImageDelegate() {}
   virtual ~LoadAnatomicImageDelegate() {}
@@ -133,6 +136,7 @@ public:
   void UnloadCurrentImage() ITK_OVERRIDE;
   ImageWrapperBase * UpdateApplicationWithImage(GuidedNativeImageIO *io) ITK_OVERRIDE;
   void ValidateHeader(GuidedNativeImageIO *io, IRISWarningList &wl) ITK_OVERRIDE;
+  void ConfigureImageIO(GuidedNativeImageIO *io) ITK_OVERRIDE;
   virtual bool IsOverlay() const ITK_OVERRIDE { return true; }
 
 protected:
@@ -188,6 +192,19 @@ public:
       Registry &reg,
       IRISWarningList &wl) = 0;
 
+  /**
+   * Some delegates can split saving into two stages: WriteImage(), which
+   * only writes the file and can be called on a worker thread (so several
+   * layers can be written concurrently), and FinishSaving(), which must be
+   * called on the main thread afterwards to update the filename, history,
+   * etc. Calling both is equivalent to SaveImage().
+   */
+  virtual bool CanWriteInBackground() { return false; }
+
+  virtual void WriteImage(const std::string &fname, Registry &reg) {}
+
+  virtual void FinishSaving(const std::string &fname) {}
+
   virtual const char *GetCurrentFilename() = 0;
 
   virtual const char *GetHistoryName() = 0;
@@ -237,6 +254,12 @@ public:
       Registry &reg,
       IRISWarningList &wl) ITK_OVERRIDE;
 
+  virtual bool CanWriteInBackground() ITK_OVERRIDE { return true; }
+
+  virtual void WriteImage(const std::string &fname, Registry &reg) ITK_OVERRIDE;
+
+  virtual void FinishSaving(const std::string &fname) ITK_OVERRIDE;
+
   virtual const char *GetCurrentFilename() ITK_OVERRIDE;
 
 protected:
@@ -267,7 +290,23 @@ public:
   }
 
   virtual void ValidateHeader(IRISWarningList &wl); // whether the file can be reloaded
-  virtual void UpdateWrapper() = 0; // reload and update wrapper
+
+  /**
+   * Read the voxels from the file and convert them to the type of the
+   * wrapper. The wrapper is not modified, so this may be called from a
+   * background thread once the header has been validated
+   */
+  virtual void ReadImage() = 0;
+
+  /**
+   * Update the wrapper with the image read from the file, reading it first if
+   * ReadImage() has not been called. Only the time points that differ from
+   * the file are replaced, so the views keep what they have computed for the
+   * others
+   */
+  virtual void UpdateWrapper();
+
+  irisGetMacro(Wrapper, ImageWrapperBase *)
 
 protected:
   AbstractReloadWrapperDelegate() { m_IO = GuidedNativeImageIO::New(); }
@@ -277,6 +316,10 @@ protected:
   SmartPtr<ImageWrapperBase> m_Wrapper;
   std::string m_Filename;
   SmartPtr<GuidedNativeImageIO> m_IO;
+
+  // Swaps the image read by ReadImage() into the wrapper. Returns true if
+  // the image was replaced as a whole rather than time point by time point
+  std::function<bool ()> m_ApplyImage;
 };
 
 /**
@@ -288,14 +331,14 @@ public:
 
   irisITKObjectMacro(ReloadAnatomicWrapperDelegate, AbstractReloadWrapperDelegate)
 
-  void UpdateWrapper() ITK_OVERRIDE; // reload and update wrapper
+  void ReadImage() ITK_OVERRIDE;
 
 protected:
   ReloadAnatomicWrapperDelegate() {}
   virtual ~ReloadAnatomicWrapperDelegate() {}
 
-  template<typename TPixel> void UpdateWrapperInternal();
-  template<typename TTraits> void UpdateWrapperWithTraits();
+  template<typename TPixel> void ReadImageInternal();
+  template<typename TTraits> void ReadImageWithTraits();
 };
 
 /**
@@ -307,7 +350,7 @@ public:
 
   irisITKObjectMacro(ReloadSegmentationWrapperDelegate, AbstractReloadWrapperDelegate)
 
-  void UpdateWrapper() ITK_OVERRIDE; // reload and update wrapper
+  void ReadImage() ITK_OVERRIDE;
 
 protected:
   ReloadSegmentationWrapperDelegate() {}
@@ -61,7 +61,32 @@
 
 #include "SlicePreviewFilterWrapper.h"
 #include "PreprocessingFilterConfigTraits.h"
+#include "itkImageAlgorithm.h"
+#include "itkImageDuplicator.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <mutex>
+
+/**
+ * Copy a region of an image into a new image of the same type, keeping the
+ * index of the region, so that the copy lines up with the source image.
+ */
+template <class TImage>
+static typename TImage::Pointer
+ExtractActiveRegion(TImage *image, const typename TImage::RegionType &region)
+{
+  typename TImage::Pointer copy = TImage::New();
+  copy->CopyInformation(image);
+  copy->SetRegions(region);
+  copy->Allocate();
+  itk::ImageAlgorithm::Copy(image, copy.GetPointer(), region, region);
+  return copy;
+}
 
+// Inside/outside values of the level set initialization
+static const float INSIDE_VALUE = -4.0, OUTSIDE_VALUE = 4.0;
 
 SNAPImageData
 ::SNAPImageData()
@@ -76,6 +101,20 @@ SNAPImageData
 
   m_CompressedAlternateLabelImage = NULL;
 
+  // Evolve the level set in an adaptive region by default
+  m_AdaptiveActiveRegion = true;
+  m_ElapsedIterationsBeforeGrowth = 0;
+
+  m_EvolutionBufferReady = false;
+  m_EvolutionBufferIterations = m_DisplayedIterations = 0;
+  m_SnakeParametersPending = false;
+  m_EvolutionConverged = false;
+
+  // The speed image is computed all at once unless there is a source
+  m_SpeedSource = NULL;
+  m_EvolutionAwaitsSpeed = false;
+  m_EvolutionStepSize = 1;
+
   // Initialize Mesh Layers storage
   m_MeshLayers = ImageMeshLayers::New();
   m_MeshLayers->Initialize(this);
@@ -87,6 +126,9 @@ SNAPImageData
 SNAPImageData
 ::~SNAPImageData() 
 {
+  // The worker uses the driver. Its errors no longer matter
+  try { StopEvolution(); } catch(...) {}
+
   if(m_LevelSetDriver)
     delete m_LevelSetDriver;
 
@@ -157,9 +199,6 @@ SNAPImageData
 {
   assert(IsSpeedLoaded());
 
-  // Inside/outside values
-  const float INSIDE_VALUE = -4.0, OUTSIDE_VALUE = 4.0;
-  
   // Store the label color
   m_SnakeColorLabel = labelColor;
 
@@ -188,39 +227,51 @@ SNAPImageData
   // data, not an image into a needless copy of an IRIS region.
   LabelImageType::RegionType region = imgInput->GetBufferedRegion();
 
-  // Create iterators to perform the copy
-  typedef itk::ImageRegionConstIterator<LabelImageType> SourceIterator;
   typedef itk::ImageRegionIteratorWithIndex<FloatImageType> TargetIterator;
-  SourceIterator itSource(imgInput,region);
-  TargetIterator itTarget(imgLevelSet,region);
 
   // During the copy loop, compute the extents of the initialization
   Vector3i bbLower = region.GetSize();
   Vector3i bbUpper = region.GetIndex();
 
   unsigned long nInitVoxels = 0;
+  std::mutex mutex;
 
   // Convert the input label image into a binary function whose 0 level set
-  // is the boundary of the current label's region
-  while(!itSource.IsAtEnd())
-    {
-    if(itSource.Value() == m_SnakeColorLabel)
+  // is the boundary of the current label's region. The runs of the label
+  // image are filled one line at a time, with the lines divided among threads
+  float *pLevelSet = imgLevelSet->GetBufferPointer();
+  imgInput->ParallelForEachLine(
+        region, [&](LabelImageType::RLLine &line, const LabelImageType::IndexType &idx)
+  {
+    float *pLine = pLevelSet + imgLevelSet->ComputeOffset(idx);
+    long x = 0, xFirst = -1, xLast = -1;
+    unsigned long n = 0;
+    for(const auto &seg : line)
       {
-      // Expand the bounding box accordingly
-      Vector3i point = itTarget.GetIndex();
-      bbLower = vector_min(bbLower,point);
-      bbUpper = vector_max(bbUpper,point);
-      
-      // Increase the number of initialization voxels
-      nInitVoxels++;
-
-      // Set the target value to inside
-      itTarget.Value() = INSIDE_VALUE;
+      if(seg.second == m_SnakeColorLabel)
+        {
+        // Set the target values to inside
+        std::fill(pLine + x, pLine + x + seg.first, (float) INSIDE_VALUE);
+        if(xFirst < 0)
+          xFirst = x;
+        xLast = x + seg.first - 1;
+        n += seg.first;
+        }
+      x += seg.first;
       }
 
-    // Go to the next pixel
-    ++itTarget; ++itSource;
-    }
+    if(n > 0)
+      {
+      // Expand the bounding box accordingly
+      Vector3i lower((int) (idx[0] + xFirst), (int) idx[1], (int) idx[2]);
+      Vector3i upper((int) (idx[0] + xLast), (int) idx[1], (int) idx[2]);
+
+      std::lock_guard<std::mutex> guard(mutex);
+      bbLower = vector_min(bbLower,lower);
+      bbUpper = vector_max(bbUpper,upper);
+      nInitVoxels += n;
+      }
+  });
 
   // Fill in the bubbles by computing their
   for(unsigned int iBubble=0; iBubble < bubbles.size(); iBubble++)
@@ -270,26 +321,40 @@ SNAPImageData
     bbLower = vector_min(bbLower,Vector3i(idxLower));
     bbUpper = vector_max(bbUpper,Vector3i(idxUpper));
 
-    // Create an iterator with an index to fill out the bubble
-    TargetIterator itThisBubble(imgLevelSet, regBubble);
-
     // Need the squared radius for this
     float r2 = bubbles[iBubble].radius * bubbles[iBubble].radius;
 
-    // Fill in the bubble
-    while(!itThisBubble.IsAtEnd())
+    // Fill in the bubble, one slice of its bounding box per job
+    if(regBubble.GetNumberOfPixels() == 0)
+      continue;
+
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray(0, regBubble.GetSize(2), [&](itk::SizeValueType z)
       {
-      PointType pt; 
-      imgLevelSet->TransformIndexToPhysicalPoint(itThisBubble.GetIndex(),pt);
-      
-      if(pt.SquaredEuclideanDistanceTo(ptCenter) <= r2)
+      FloatImageType::RegionType regSlice = regBubble;
+      regSlice.SetIndex(2, regBubble.GetIndex(2) + z);
+      regSlice.SetSize(2, 1);
+
+      // Create an iterator with an index to fill out the bubble
+      TargetIterator itThisBubble(imgLevelSet, regSlice);
+      unsigned long n = 0;
+      while(!itThisBubble.IsAtEnd())
         {
-        itThisBubble.Value() = INSIDE_VALUE;
-        nInitVoxels++;
+        PointType pt;
+        imgLevelSet->TransformIndexToPhysicalPoint(itThisBubble.GetIndex(),pt);
+
+        if(pt.SquaredEuclideanDistanceTo(ptCenter) <= r2)
+          {
+          itThisBubble.Value() = INSIDE_VALUE;
+          n++;
+          }
+
+        ++itThisBubble;
         }
 
-      ++itThisBubble;
-      }
+      std::lock_guard<std::mutex> guard(mutex);
+      nInitVoxels += n;
+      }, nullptr);
     }
 
   // Mark the image updated
@@ -305,6 +370,33 @@ SNAPImageData
     return false;
     }
 
+  // In the adaptive mode, the level set only evolves in a box around the
+  // initialization with a margin of one chunk. If the box covers the whole
+  // ROI, the level set is evolved in place as usual
+  m_ActiveRegion = region;
+  if(m_AdaptiveActiveRegion)
+    {
+    FloatImageType::IndexType idxActive;
+    FloatImageType::SizeType szActive;
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      idxActive[d] = bbLower[d] - ACTIVE_REGION_CHUNK;
+      szActive[d] = 1 + bbUpper[d] - bbLower[d] + 2 * ACTIVE_REGION_CHUNK;
+      }
+    m_ActiveRegion = FloatImageType::RegionType(idxActive, szActive);
+    m_ActiveRegion.Crop(region);
+    }
+
+  m_InitialActiveRegion = m_ActiveRegion;
+  m_InitialActiveLevelSet = NULL;
+  if(m_ActiveRegion != region)
+    m_InitialActiveLevelSet = ExtractActiveRegion(imgLevelSet.GetPointer(), m_ActiveRegion);
+  m_ElapsedIterationsBeforeGrowth = 0;
+  m_EvolutionAwaitsSpeed = false;
+
+  // The speed may still be computed lazily
+  ComputeSpeedInRegion(m_ActiveRegion);
+
   // Make sure that the correct color label is being used
   // TODO: restore this functionality once you figure out how to display
   // level set representations properly !!!
@@ -361,9 +453,6 @@ void
 SNAPImageData
 ::InitalizeSnakeDriver(const SnakeParameters &p) 
 {
-  // Create a new level set driver, deleting the current one if it's there
-  if (m_LevelSetDriver) { delete m_LevelSetDriver; }
-    
   // This is a good place to check that the parameters are valid
   if(p.GetSnakeType()  == SnakeParameters::REGION_SNAKE)
     {
@@ -387,17 +476,7 @@ SNAPImageData
   m_LevelSetPipelineMutex.lock();
 
   // Initialize the snake driver and pass the parameters
-  m_LevelSetDriver = new SNAPLevelSetDriver3d(
-    m_SnakeWrapper->GetModifiableImage(),
-    m_SpeedWrapper->GetModifiableImage(),
-    m_CurrentSnakeParameters,
-    m_ExternalAdvectionField);
-
-  // Copy the output pixels from the level set filter to the snake image wrapper.
-  // The ITK pattern is to do the opposite, i.e., graft the image onto the level
-  // set filter, but the particular filter used for level set propagation,
-  // ParallelSparseFieldLevelSetImageFilter is not coded to support this.
-  m_SnakeWrapper->SetPixelContainer(m_LevelSetDriver->GetOutput()->GetPixelContainer());
+  CreateLevelSetDriver();
 
 
   // Finish thread-safe section
@@ -412,6 +491,123 @@ SNAPImageData
         (unsigned char)(255 * m_Parent->GetGlobalState()->GetSegmentationAlpha()));
 }
 
+void
+SNAPImageData
+::CreateLevelSetDriver()
+{
+  // Create a new level set driver, deleting the current one if it's there
+  if (m_LevelSetDriver) { delete m_LevelSetDriver; }
+
+  if(m_InitialActiveLevelSet)
+    {
+    // The driver evolves a copy of the active region of the snake image,
+    // and only sees the same region of the speed and advection images
+    FloatImageType::Pointer imgLevelSet =
+        ExtractActiveRegion(GetEvolvingSnakeImage(), m_ActiveRegion);
+    SpeedImageType::Pointer imgSpeed =
+        ExtractActiveRegion(m_SpeedWrapper->GetModifiableImage(), m_ActiveRegion);
+    VectorImagePointer imgAdvection;
+    if(m_ExternalAdvectionField)
+      imgAdvection = ExtractActiveRegion(m_ExternalAdvectionField.GetPointer(), m_ActiveRegion);
+
+    m_LevelSetDriver = new SNAPLevelSetDriver3d(
+      imgLevelSet, imgSpeed, m_CurrentSnakeParameters, imgAdvection);
+    }
+  else
+    {
+    m_LevelSetDriver = new SNAPLevelSetDriver3d(
+      m_SnakeWrapper->GetModifiableImage(),
+      m_SpeedWrapper->GetModifiableImage(),
+      m_CurrentSnakeParameters,
+      m_ExternalAdvectionField);
+
+    // Copy the output pixels from the level set filter to the snake image wrapper.
+    // The ITK pattern is to do the opposite, i.e., graft the image onto the level
+    // set filter, but the particular filter used for level set propagation,
+    // ParallelSparseFieldLevelSetImageFilter is not coded to support this.
+    m_SnakeWrapper->SetPixelContainer(m_LevelSetDriver->GetOutput()->GetPixelContainer());
+    }
+}
+
+void
+SNAPImageData
+::ComputeSpeedInRegion(const LevelSetImageType::RegionType &region)
+{
+  if(m_SpeedSource && !m_SpeedSource->IsOutputRegionComputed(region))
+    m_SpeedSource->ComputeOutputRegion(region);
+}
+
+bool
+SNAPImageData
+::UpdateActiveRegion(bool computeSpeed)
+{
+  // Nothing to do unless the driver works on a copy of part of the ROI
+  if(!m_InitialActiveLevelSet)
+    return false;
+
+  // Copy the evolving level set into the snake image
+  FloatImageType *phi = m_LevelSetDriver->GetOutput();
+  FloatImageType *imgSnake = GetEvolvingSnakeImage();
+  itk::ImageAlgorithm::Copy(phi, imgSnake, m_ActiveRegion, m_ActiveRegion);
+
+  // Check each face of the active region that is not on the boundary of the
+  // ROI for inside voxels within the guard distance
+  FloatImageType::RegionType roi = imgSnake->GetBufferedRegion();
+  FloatImageType::IndexType idxGrown = m_ActiveRegion.GetIndex();
+  FloatImageType::SizeType szGrown = m_ActiveRegion.GetSize();
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    for(unsigned int side = 0; side < 2; side++)
+      {
+      long lower = m_ActiveRegion.GetIndex(d);
+      long upper = lower + (long) m_ActiveRegion.GetSize(d);
+      if((side == 0 && lower <= roi.GetIndex(d)) ||
+         (side == 1 && upper >= roi.GetIndex(d) + (long) roi.GetSize(d)))
+        continue;
+
+      FloatImageType::RegionType slab = m_ActiveRegion;
+      long guard = std::min((long) ACTIVE_REGION_GUARD, upper - lower);
+      slab.SetSize(d, guard);
+      if(side == 1)
+        slab.SetIndex(d, upper - guard);
+
+      bool reached = false;
+      for(itk::ImageRegionConstIterator<FloatImageType> it(phi, slab);
+          !it.IsAtEnd() && !reached; ++it)
+        reached = it.Get() <= 0.0f;
+
+      if(reached)
+        {
+        szGrown[d] += ACTIVE_REGION_CHUNK;
+        if(side == 0)
+          idxGrown[d] -= ACTIVE_REGION_CHUNK;
+        }
+      }
+    }
+
+  FloatImageType::RegionType grown(idxGrown, szGrown);
+  grown.Crop(roi);
+  if(grown == m_ActiveRegion)
+    return false;
+
+  // The speed may not be computed in the grown region yet
+  if(m_SpeedSource && !m_SpeedSource->IsOutputRegionComputed(grown))
+    {
+    if(!computeSpeed)
+      {
+      m_EvolutionAwaitsSpeed = true;
+      return false;
+      }
+    m_SpeedSource->ComputeOutputRegion(grown);
+    }
+
+  // Restart the driver on the larger region from the current contour
+  m_ElapsedIterationsBeforeGrowth += m_LevelSetDriver->GetElapsedIterations();
+  m_ActiveRegion = grown;
+  CreateLevelSetDriver();
+  return true;
+}
+
 void 
 SNAPImageData
 ::RunSegmentation(unsigned int nIterations)
@@ -419,6 +615,9 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
+  // The worker thread must not be running the driver
+  StopEvolution();
+
   // Pass through to the level set driver
 
   // Enter a thread-safe section
@@ -426,6 +625,10 @@ SNAPImageData
 
   // clock_t c1 = clock();
   m_LevelSetDriver->Run(nIterations);
+
+  // In the adaptive mode, bring the snake image up to date and expand the
+  // region in which the level set evolves if needed
+  UpdateActiveRegion();
   
   // The wrapper has to be notified that pixels have been updated
   m_SnakeWrapper->PixelsModified();
@@ -446,8 +649,13 @@ bool
 SNAPImageData
 ::IsEvolutionConverged()
 {
+  // While the worker runs, use the state it reported after its last step
+  if(IsEvolutionRunning())
+    return m_EvolutionConverged;
+
   // Make the method reentrant
   std::lock_guard<std::mutex> guard(m_LevelSetPipelineMutex);
+  std::lock_guard<std::mutex> evolutionGuard(m_EvolutionMutex);
 
   return m_LevelSetDriver->IsEvolutionConverged();
 }
@@ -459,17 +667,98 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
+  // The worker thread must not be running the driver
+  StopEvolution();
+
   // Enter a thread-safe section
   m_LevelSetPipelineMutex.lock();
 
-  // Pass through to the level set driver
-  m_LevelSetDriver->Restart();
-    
-  // Copy the output pixels from the level set filter to the snake image wrapper.
-  // The ITK pattern is to do the opposite, i.e., graft the image onto the level
-  // set filter, but the particular filter used for level set propagation,
-  // ParallelSparseFieldLevelSetImageFilter is not coded to support this.
-  m_SnakeWrapper->SetPixelContainer(m_LevelSetDriver->GetOutput()->GetPixelContainer());
+  if(m_InitialActiveLevelSet)
+    {
+    // The driver may have been recreated on a grown region, so restore the
+    // initialization and the initial active region and start over
+    ResetActiveRegion();
+    m_SnakeWrapper->PixelsModified();
+    }
+  else
+    {
+    // Pass through to the level set driver
+    m_LevelSetDriver->Restart();
+
+    // Copy the output pixels from the level set filter to the snake image wrapper.
+    // The ITK pattern is to do the opposite, i.e., graft the image onto the level
+    // set filter, but the particular filter used for level set propagation,
+    // ParallelSparseFieldLevelSetImageFilter is not coded to support this.
+    m_SnakeWrapper->SetPixelContainer(m_LevelSetDriver->GetOutput()->GetPixelContainer());
+    }
+
+  // Leave a thread-safe section
+  m_LevelSetPipelineMutex.unlock();
+
+  // Fire the update event
+  this->InvokeEvent(LevelSetImageChangeEvent());
+}
+
+void
+SNAPImageData
+::ResetActiveRegion()
+{
+  // Outside of the initial region, the initialization is all outside
+  FloatImageType *imgSnake = m_SnakeWrapper->GetModifiableImage();
+  imgSnake->FillBuffer(OUTSIDE_VALUE);
+  itk::ImageAlgorithm::Copy(m_InitialActiveLevelSet.GetPointer(), imgSnake,
+                            m_InitialActiveRegion, m_InitialActiveRegion);
+  m_ActiveRegion = m_InitialActiveRegion;
+  m_ElapsedIterationsBeforeGrowth = 0;
+  CreateLevelSetDriver();
+}
+
+void
+SNAPImageData
+::GoToSegmentationIteration(unsigned int iteration)
+{
+  // Should be in level set mode
+  assert(m_LevelSetDriver);
+
+  // The worker thread must not be running the driver
+  StopEvolution();
+
+  // Enter a thread-safe section
+  m_LevelSetPipelineMutex.lock();
+
+  if(m_InitialActiveLevelSet)
+    {
+    // Each growth of the active region starts a new driver, and the snapshots
+    // of the earlier ones are gone, so going back before the last growth has
+    // to start over from the initialization
+    if(iteration < m_ElapsedIterationsBeforeGrowth)
+      ResetActiveRegion();
+
+    // Going forward, check the active region every few iterations, before
+    // the contour, which moves less than a voxel per iteration, crosses the
+    // guard band
+    while(GetElapsedSegmentationIterations() != iteration)
+      {
+      unsigned int target = iteration - m_ElapsedIterationsBeforeGrowth;
+      unsigned int now = m_LevelSetDriver->GetElapsedIterations();
+      if(target > now)
+        target = std::min(target, now + (unsigned int) ACTIVE_REGION_GUARD);
+
+      m_LevelSetDriver->GoToIteration(target);
+      if(!UpdateActiveRegion() && m_LevelSetDriver->GetElapsedIterations() == now)
+        break;
+      }
+    }
+  else
+    {
+    m_LevelSetDriver->GoToIteration(iteration);
+
+    // The filter may have reallocated its output when it was restarted
+    m_SnakeWrapper->SetPixelContainer(m_LevelSetDriver->GetOutput()->GetPixelContainer());
+    }
+
+  // The wrapper has to be notified that pixels have been updated
+  m_SnakeWrapper->PixelsModified();
 
   // Leave a thread-safe section
   m_LevelSetPipelineMutex.unlock();
@@ -485,6 +774,9 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
+  // The worker thread must not be running the driver
+  StopEvolution();
+
   // Enter a thread-safe section
   m_LevelSetPipelineMutex.lock();
 
@@ -505,15 +797,254 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
-  // Pass through to the level set driver
-  m_LevelSetDriver->SetSnakeParameters(parameters);
+  // While the evolution runs, the worker picks up the parameters before its
+  // next step (or StopEvolution() does, if the worker is finishing)
+  {
+    std::lock_guard<std::mutex> guard(m_PendingSnakeParametersMutex);
+    m_PendingSnakeParameters = parameters;
+    m_SnakeParametersPending = true;
+  }
+
+  if(!IsEvolutionRunning())
+    {
+    std::lock_guard<std::mutex> guard(m_EvolutionMutex);
+    ApplyPendingSnakeParameters();
+    }
+}
+
+void
+SNAPImageData
+::ApplyPendingSnakeParameters()
+{
+  if(!m_SnakeParametersPending)
+    return;
+
+  // Pass through to the level set driver, and remember the parameters in
+  // case the driver has to be recreated for a larger active region
+  std::lock_guard<std::mutex> guard(m_PendingSnakeParametersMutex);
+  m_LevelSetDriver->SetSnakeParameters(m_PendingSnakeParameters);
+  m_CurrentSnakeParameters = m_PendingSnakeParameters;
+  m_SnakeParametersPending = false;
 }
 
 unsigned int 
 SNAPImageData::
 GetElapsedSegmentationIterations() const
 {
-  return m_LevelSetDriver->GetElapsedIterations();
+  // While the worker runs, report the iteration of the displayed level set
+  if(IsEvolutionRunning())
+    return m_DisplayedIterations;
+
+  return m_ElapsedIterationsBeforeGrowth + m_LevelSetDriver->GetElapsedIterations();
+}
+
+SNAPImageData::FloatImageType *
+SNAPImageData
+::GetEvolvingSnakeImage()
+{
+  return m_EvolutionBuffer
+      ? m_EvolutionBuffer.GetPointer()
+      : m_SnakeWrapper->GetModifiableImage();
+}
+
+void
+SNAPImageData
+::StartEvolution(unsigned int nIterations)
+{
+  // Should be in level set mode
+  assert(m_LevelSetDriver);
+
+  if(IsEvolutionRunning())
+    return;
+
+  std::lock_guard<std::mutex> guard(m_LevelSetPipelineMutex);
+
+  // If the last run stopped at the end of the computed speed, compute more
+  // of it and grow the active region first
+  if(m_EvolutionAwaitsSpeed)
+    {
+    m_EvolutionAwaitsSpeed = false;
+    UpdateActiveRegion();
+    }
+
+  // The second buffer starts as a copy of the snake image. In the adaptive
+  // mode this is what it holds outside of the active region
+  typedef itk::ImageDuplicator<FloatImageType> Duplicator;
+  SmartPtr<Duplicator> dup = Duplicator::New();
+  dup->SetInputImage(m_SnakeWrapper->GetModifiableImage());
+  dup->Update();
+  m_EvolutionBuffer = dup->GetOutput();
+
+  // Otherwise the snake image shares the pixels of the driver output, and
+  // has to be given pixels of its own
+  if(!m_InitialActiveLevelSet)
+    {
+    SmartPtr<Duplicator> dupSnake = Duplicator::New();
+    dupSnake->SetInputImage(m_EvolutionBuffer);
+    dupSnake->Update();
+    m_SnakeWrapper->SetPixelContainer(dupSnake->GetOutput()->GetPixelContainer());
+    }
+
+  m_EvolutionBufferReady = false;
+  m_DisplayedIterations = GetElapsedSegmentationIterations();
+  m_EvolutionConverged = m_LevelSetDriver->IsEvolutionConverged();
+  m_EvolutionStepSize = nIterations;
+  m_EvolutionToken = TaskScheduler::CancellationToken();
+  m_EvolutionFuture = TaskScheduler::GetInstance()->Submit(
+        TaskScheduler::USER_COMPUTE,
+        [this, nIterations]() { this->EvolutionLoop(nIterations); },
+        m_EvolutionToken);
+}
+
+void
+SNAPImageData
+::EvolutionLoop(unsigned int nIterations)
+{
+  while(!m_EvolutionToken.IsCancelled())
+    {
+    std::lock_guard<std::mutex> guard(m_EvolutionMutex);
+    ApplyPendingSnakeParameters();
+    unsigned int before = m_LevelSetDriver->GetElapsedIterations();
+    m_LevelSetDriver->Run(nIterations);
+    bool halted = m_LevelSetDriver->GetElapsedIterations() == before;
+    m_EvolutionConverged = m_LevelSetDriver->IsEvolutionConverged();
+
+    std::lock_guard<std::mutex> bufferGuard(m_EvolutionBufferMutex);
+    if(m_InitialActiveLevelSet)
+      {
+      // The active region is checked after every step, so the copy into
+      // the buffer is made anyway
+      UpdateActiveRegion(false);
+      }
+    else if(!m_EvolutionBufferReady || halted)
+      {
+      // Only copy the level set once the previous copy has been displayed,
+      // so that the copies are made at most at the display rate
+      FloatImageType *phi = m_LevelSetDriver->GetOutput();
+      itk::ImageAlgorithm::Copy(phi, m_EvolutionBuffer.GetPointer(),
+                                phi->GetBufferedRegion(), phi->GetBufferedRegion());
+      }
+    else
+      {
+      continue;
+      }
+
+    m_EvolutionBufferReady = true;
+    m_EvolutionBufferIterations =
+        m_ElapsedIterationsBeforeGrowth + m_LevelSetDriver->GetElapsedIterations();
+
+    if(halted || m_EvolutionAwaitsSpeed)
+      break;
+    }
+}
+
+bool
+SNAPImageData
+::IsEvolutionRunning() const
+{
+  return m_EvolutionFuture.valid()
+      && m_EvolutionFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+bool
+SNAPImageData
+::UpdateEvolutionDisplay()
+{
+  if(!m_EvolutionFuture.valid())
+    return false;
+
+  // Once the worker is done, take the final state of the level set. If it
+  // stopped to wait for the speed, the evolution goes on
+  if(!IsEvolutionRunning())
+    {
+    bool resume = m_EvolutionAwaitsSpeed;
+    StopEvolution();
+    if(!resume)
+      return false;
+
+    StartEvolution(m_EvolutionStepSize);
+    this->InvokeEvent(LevelSetImageChangeEvent());
+    return true;
+    }
+
+  // The mesh pipeline may be reading the snake image, in which case the
+  // swap is left to the next update
+  std::unique_lock<std::mutex> pipelineLock(m_LevelSetPipelineMutex, std::try_to_lock);
+  if(!pipelineLock.owns_lock())
+    return true;
+
+  {
+    std::lock_guard<std::mutex> guard(m_EvolutionBufferMutex);
+    if(!m_EvolutionBufferReady)
+      return true;
+
+    // Swap the pixels of the snake image and of the buffer
+    SmartPtr<FloatImageType::PixelContainer> front =
+        m_SnakeWrapper->GetModifiableImage()->GetPixelContainer();
+    m_SnakeWrapper->SetPixelContainer(m_EvolutionBuffer->GetPixelContainer());
+    m_EvolutionBuffer->SetPixelContainer(front);
+
+    m_EvolutionBufferReady = false;
+    m_DisplayedIterations = m_EvolutionBufferIterations;
+  }
+
+  m_SnakeWrapper->PixelsModified();
+  pipelineLock.unlock();
+
+  // Fire the update event
+  this->InvokeEvent(LevelSetImageChangeEvent());
+  return true;
+}
+
+void
+SNAPImageData
+::StopEvolution()
+{
+  if(!m_EvolutionFuture.valid())
+    return;
+
+  // Wait for the worker to finish its current step. A worker that never
+  // started leaves a broken promise behind. Other errors are passed on once
+  // the snake image has been restored
+  TaskScheduler::GetInstance()->Cancel(m_EvolutionToken);
+  std::exception_ptr error;
+  try
+    {
+    m_EvolutionFuture.get();
+    }
+  catch(std::future_error &)
+    {
+    }
+  catch(...)
+    {
+    error = std::current_exception();
+    }
+
+  std::lock_guard<std::mutex> guard(m_LevelSetPipelineMutex);
+
+  // Parameters set while the worker was finishing its last step
+  ApplyPendingSnakeParameters();
+
+  if(m_InitialActiveLevelSet)
+    {
+    // Bring the snake image up to date in the active region, which grows
+    // but never shrinks while evolving
+    itk::ImageAlgorithm::Copy(m_LevelSetDriver->GetOutput(),
+                              m_SnakeWrapper->GetModifiableImage(),
+                              m_ActiveRegion, m_ActiveRegion);
+    }
+  else
+    {
+    // Share the pixels of the driver output again
+    m_SnakeWrapper->SetPixelContainer(m_LevelSetDriver->GetOutput()->GetPixelContainer());
+    }
+
+  m_EvolutionBuffer = NULL;
+  m_EvolutionBufferReady = false;
+  m_SnakeWrapper->PixelsModified();
+
+  if(error)
+    std::rethrow_exception(error);
 }
 
 SNAPLevelSetDriver<3>::LevelSetFunctionType *
@@ -580,6 +1111,19 @@ SNAPImageData
   // Get the source main wrapper
   ImageWrapperBase *srcMain = source->GetMain();
 
+  // The overlays are extracted concurrently with the main image. Only the
+  // main image reports progress, since the progress command is serviced on
+  // this thread
+  std::vector<std::pair<ImageWrapperBase *, std::future<SmartPtr<ImageWrapperBase> > > > overlays;
+  for(LayerIterator lit = source->GetLayers(OVERLAY_ROLE);
+      !lit.IsAtEnd(); ++lit)
+    {
+    ImageWrapperBase *srcOvl = lit.GetLayer();
+    overlays.push_back(std::make_pair(srcOvl, std::async(
+                         std::launch::async, [srcOvl, roi]()
+                         { return srcOvl->ExtractROI(roi, nullptr); })));
+    }
+
   // Extract the ROI into a generic type
   SmartPtr<ImageWrapperBase> roiMain = srcMain->ExtractROI(roi, progressCommand);
 
@@ -589,19 +1133,16 @@ SNAPImageData
   // Copy metadata
   this->CopyLayerMetadata(this->GetMain(), source->GetMain());
 
-  // Repeat all of this for the overlays
-  for(LayerIterator lit = source->GetLayers(OVERLAY_ROLE);
-      !lit.IsAtEnd(); ++lit)
+  // Add the overlays in their original order
+  for(auto &ovl : overlays)
     {
-    // Do the same for all the anatomic wrappers
-    SmartPtr<ImageWrapperBase> roiOvl =
-        lit.GetLayer()->ExtractROI(roi, progressCommand);
+    SmartPtr<ImageWrapperBase> roiOvl = ovl.second.get();
 
     // Add the overlay
     this->AddOverlayInternal(roiOvl);
 
     // Copy metadata
-    this->CopyLayerMetadata(this->GetLastOverlay(), lit.GetLayer());
+    this->CopyLayerMetadata(this->GetLastOverlay(), ovl.first);
     }
 
   // Destroy the alternate image if there is none or if the ROI settings have changed
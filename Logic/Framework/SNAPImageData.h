@@ -52,6 +52,10 @@
 #include "SNAPLevelSetFunction.h"
 #include "itkImageAdaptor.h"
 #include "UndoDataManager.h"
+#include "TaskScheduler.h"
+#include <atomic>
+#include <future>
+#include <mutex>
 
 namespace itk {
   class Command;
@@ -59,6 +63,7 @@ namespace itk {
 }
 
 class SNAPSegmentationROISettings;
+class AbstractSlicePreviewFilterWrapper;
 
 
 /**
@@ -166,6 +171,34 @@ public:
   /** Revert the segmentation to the beginning */
   void RestartSegmentation();
 
+  /**
+   * Bring the segmentation to its state after a number of iterations, going
+   * back or forward from the snapshots kept by the level set driver
+   */
+  void GoToSegmentationIteration(unsigned int iteration);
+
+  /**
+   * Start evolving the level set continuously on a worker thread, nIterations
+   * at a time. The snake image is not touched by the worker: the evolving
+   * level set is copied into a second buffer whenever the previous copy has
+   * been displayed, and UpdateEvolutionDisplay() swaps the buffers. The
+   * other segmentation methods stop the evolution before they proceed.
+   */
+  void StartEvolution(unsigned int nIterations);
+
+  /** Stop the evolution, and show the level set in the snake image */
+  void StopEvolution();
+
+  /** Whether the level set is evolving on the worker thread */
+  bool IsEvolutionRunning() const;
+
+  /**
+   * Show the latest copy of the evolving level set in the snake image, at
+   * the display rate. Returns false once the evolution has stopped by
+   * itself, e.g., because it converged.
+   */
+  bool UpdateEvolutionDisplay();
+
   /** Check for convergence */
   bool IsEvolutionConverged();
 
@@ -174,6 +207,26 @@ public:
    * to reinitialize the level set driver if the Solver parameter changes */
   void SetSegmentationParameters(const SnakeParameters &parameters);
 
+  /**
+   * In the adaptive active region mode (default), the level set is evolved
+   * only in a box around the initialization rather than in the whole ROI.
+   * The box grows by ACTIVE_REGION_CHUNK voxels on each side that the
+   * contour comes close to. Takes effect on the next InitializeSegmentation.
+   */
+  irisGetSetMacro(AdaptiveActiveRegion, bool)
+
+  /**
+   * Set the preprocessing pipeline that computes the speed image, when the
+   * speed is computed lazily, slab by slab. The level set only evolves in
+   * regions where the speed is computed: missing slabs are computed when
+   * the active region is initialized or grows. The worker thread can not
+   * run the pipeline, so when the active region outgrows the speed during
+   * StartEvolution(), the worker stops, and UpdateEvolutionDisplay()
+   * computes the speed and resumes the evolution.
+   */
+  void SetSpeedSource(AbstractSlicePreviewFilterWrapper *source)
+    { m_SpeedSource = source; }
+
   /** Check if the segmentation is active */
   bool IsSegmentationActive() const
     { return m_LevelSetDriver != NULL; }
@@ -242,6 +295,40 @@ protected:
    * user input.  */
   void InitalizeSnakeDriver(const SnakeParameters &param);
 
+  /** Create the level set driver for the current active region. The level
+   * set pipeline mutex must be held by the caller */
+  void CreateLevelSetDriver();
+
+  /** Go back to the initial active region and its initialization */
+  void ResetActiveRegion();
+
+  /** In the adaptive mode, copy the evolving level set from the driver into
+   * the snake image, and grow the active region if the contour has come
+   * close to its boundary. Returns true if the region has grown. The level
+   * set pipeline mutex, or while the worker evolves the level set, the two
+   * evolution mutexes, must be held by the caller. If the speed is not
+   * computed in the grown region, it is computed if computeSpeed is true,
+   * and otherwise the region is left as is and m_EvolutionAwaitsSpeed set */
+  bool UpdateActiveRegion(bool computeSpeed = true);
+
+  /** Compute the speed image in a region, if it is computed lazily */
+  void ComputeSpeedInRegion(const LevelSetImageType::RegionType &region);
+
+  /** The image that the evolution updates: the snake image, or the second
+   * buffer while the evolution runs on the worker thread */
+  FloatImageType *GetEvolvingSnakeImage();
+
+  /** Body of the worker thread started by StartEvolution() */
+  void EvolutionLoop(unsigned int nIterations);
+
+  /** Pass parameters set while the worker runs on to the level set driver.
+   * The caller must hold m_EvolutionMutex, or the worker must be done */
+  void ApplyPendingSnakeParameters();
+
+  /** The active region grows in chunks of this many voxels, once the
+   * contour is within ACTIVE_REGION_GUARD voxels of its boundary */
+  enum { ACTIVE_REGION_CHUNK = 32, ACTIVE_REGION_GUARD = 4 };
+
   /** A callback used internally to communicate with the LevelSetDriver */
   void IntermediatePauseCallback(
     itk::Object *object,const itk::EventObject &event);
@@ -298,6 +385,44 @@ protected:
   // Current ROI settings
   SNAPSegmentationROISettings m_ROISettings;
 
+  // Whether the level set evolves in an adaptive active region
+  bool m_AdaptiveActiveRegion;
+
+  // The region in which the level set driver currently operates. When it is
+  // smaller than the ROI, m_InitialActiveLevelSet holds the initialization
+  // over m_InitialActiveRegion, which is used to restart the segmentation
+  LevelSetImageType::RegionType m_ActiveRegion, m_InitialActiveRegion;
+  SmartPtr<FloatImageType> m_InitialActiveLevelSet;
+
+  // Iterations run by drivers discarded when the active region grew
+  unsigned int m_ElapsedIterationsBeforeGrowth;
+
+  // The worker thread evolving the level set, and its cancellation token
+  std::future<void> m_EvolutionFuture;
+  TaskScheduler::CancellationToken m_EvolutionToken;
+
+  // While the worker runs, m_EvolutionMutex guards the level set driver, and
+  // m_EvolutionBufferMutex guards the second buffer and the fields below
+  std::mutex m_EvolutionMutex, m_EvolutionBufferMutex;
+  SmartPtr<FloatImageType> m_EvolutionBuffer;
+  bool m_EvolutionBufferReady;
+  unsigned int m_EvolutionBufferIterations, m_DisplayedIterations;
+
+  // The worker holds m_EvolutionMutex for a whole step and takes it again
+  // right away, so the GUI thread does not wait for it. Parameters are left
+  // in this slot, which the worker applies between steps, and the worker
+  // reports whether the evolution has converged after every step
+  std::mutex m_PendingSnakeParametersMutex;
+  SnakeParameters m_PendingSnakeParameters;
+  std::atomic<bool> m_SnakeParametersPending, m_EvolutionConverged;
+
+  // Pipeline computing the speed lazily, whether the worker stopped to let
+  // it compute the speed in a grown active region, and the iterations per
+  // step of the worker, so that it can be resumed
+  AbstractSlicePreviewFilterWrapper *m_SpeedSource;
+  bool m_EvolutionAwaitsSpeed;
+  unsigned int m_EvolutionStepSize;
+
 
   void SwapLabelImageWithCompressedAlternative();
 };
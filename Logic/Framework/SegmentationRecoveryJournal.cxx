@@ -0,0 +1,621 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Language:  C++
+
+  Copyright (c) 2024 Paul A. Yushkevich
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#include "SegmentationRecoveryJournal.h"
+#include <itk_zlib.h>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+// The file starts with the magic string and version, followed by the number
+// of time points and the image size
+const char JOURNAL_MAGIC[8] = { 'S', 'N', 'A', 'P', 'R', 'J', 'N', 'L' };
+const unsigned int JOURNAL_VERSION = 1;
+
+inline void journal_put_varint(std::vector<unsigned char> &raw, unsigned long long v)
+{
+  while(v >= 0x80)
+    {
+    raw.push_back((unsigned char)(v | 0x80));
+    v >>= 7;
+    }
+  raw.push_back((unsigned char) v);
+}
+
+inline void journal_put_value(std::vector<unsigned char> &raw, LabelType v)
+{
+  const unsigned char *pv = reinterpret_cast<const unsigned char *>(&v);
+  raw.insert(raw.end(), pv, pv + sizeof(LabelType));
+}
+
+template <typename T>
+inline void journal_put_fixed(std::vector<unsigned char> &raw, T v)
+{
+  const unsigned char *pv = reinterpret_cast<const unsigned char *>(&v);
+  raw.insert(raw.end(), pv, pv + sizeof(T));
+}
+
+// Reads back the serialized stream, failing on any attempt to read past its end
+class JournalReader
+{
+public:
+  JournalReader(const std::vector<unsigned char> &raw)
+    : m_Ptr(raw.data()), m_End(raw.data() + raw.size()) {}
+
+  bool GetVarint(unsigned long long &v)
+  {
+    v = 0;
+    for(unsigned int shift = 0; m_Ptr < m_End && shift < 64; shift += 7)
+      {
+      unsigned char b = *m_Ptr++;
+      v |= ((unsigned long long)(b & 0x7f)) << shift;
+      if(!(b & 0x80))
+        return true;
+      }
+    return false;
+  }
+
+  bool GetValue(LabelType &v)
+  {
+    if(m_End - m_Ptr < (long) sizeof(LabelType))
+      return false;
+    memcpy(&v, m_Ptr, sizeof(LabelType));
+    m_Ptr += sizeof(LabelType);
+    return true;
+  }
+
+  bool AtEnd() const { return m_Ptr == m_End; }
+
+private:
+  const unsigned char *m_Ptr, *m_End;
+};
+
+}
+
+SegmentationRecoveryJournal
+::SegmentationRecoveryJournal(const std::string &filename)
+  : m_FileName(filename)
+{
+  m_Writer = std::thread(&SegmentationRecoveryJournal::WriterLoop, this);
+}
+
+SegmentationRecoveryJournal
+::~SegmentationRecoveryJournal()
+{
+  {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Stop = true;
+  }
+  m_QueueChanged.notify_all();
+  m_Writer.join();
+
+  if(m_File)
+    fclose(m_File);
+}
+
+void
+SegmentationRecoveryJournal
+::CopyLines(LabelImageType *image, std::vector<RLLine> &lines)
+{
+  LabelImageType::BufferType *buffer = image->GetBuffer();
+  const RLLine *p = buffer->GetBufferPointer();
+  lines.assign(p, p + buffer->GetBufferedRegion().GetNumberOfPixels());
+}
+
+void
+SegmentationRecoveryJournal
+::Restart(const ImageList &images)
+{
+  Job job;
+  job.Type = Job::RESTART;
+  job.Size = images.size() ? images[0]->GetBufferedRegion().GetSize() : itk::Size<3>();
+  job.Checkpoints.resize(images.size());
+
+  size_t n_runs = 0;
+  for(unsigned int tp = 0; tp < images.size(); tp++)
+    {
+    CopyLines(images[tp], job.Checkpoints[tp]);
+    for(const RLLine &line : job.Checkpoints[tp])
+      n_runs += line.size();
+    }
+
+  // Jobs that were not written yet are superseded by the restart
+  {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Queue.clear();
+  }
+
+  m_CheckpointRuns = n_runs;
+  m_DeltaRuns = 0;
+  this->Enqueue(std::move(job));
+}
+
+void
+SegmentationRecoveryJournal
+::AppendCheckpoint(unsigned int tp, LabelImageType *image)
+{
+  Job job;
+  job.Type = Job::CHECKPOINT;
+  job.TimePoint = tp;
+  job.Checkpoints.resize(1);
+  CopyLines(image, job.Checkpoints[0]);
+
+  // The checkpoint adds to the journal without superseding the other time points
+  for(const RLLine &line : job.Checkpoints[0])
+    m_DeltaRuns += line.size();
+
+  this->Enqueue(std::move(job));
+}
+
+void
+SegmentationRecoveryJournal
+::AppendDelta(unsigned int tp, Delta *delta, bool reverse)
+{
+  Job job;
+  job.Type = Job::DELTA;
+  job.TimePoint = tp;
+  job.Reverse = reverse;
+  job.Tiles.resize(delta->GetNumberOfTiles());
+
+  for(size_t k = 0; k < delta->GetNumberOfTiles(); k++)
+    {
+    TileRecord &tile = job.Tiles[k];
+    tile.Region = delta->GetTileRegion(k);
+
+    size_t i0 = delta->GetTileFirstRLE(k), i1 = i0 + delta->GetTileNumberOfRLEs(k);
+    tile.RLEs.reserve(i1 - i0);
+    for(size_t i = i0; i < i1; i++)
+      tile.RLEs.push_back(std::make_pair(delta->GetRLELength(i), delta->GetRLEValue(i)));
+
+    m_DeltaRuns += i1 - i0;
+    }
+
+  this->Enqueue(std::move(job));
+}
+
+bool
+SegmentationRecoveryJournal
+::IsCompactionNeeded() const
+{
+  return m_DeltaRuns > std::max(MIN_COMPACTION_RUNS, 2 * m_CheckpointRuns);
+}
+
+void
+SegmentationRecoveryJournal
+::Enqueue(Job &&job)
+{
+  {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Queue.push_back(std::move(job));
+  }
+  m_QueueChanged.notify_all();
+}
+
+void
+SegmentationRecoveryJournal
+::Flush()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_QueueChanged.wait(lock, [this]() { return m_Queue.empty() && !m_Busy; });
+}
+
+void
+SegmentationRecoveryJournal
+::Discard()
+{
+  {
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_Queue.clear();
+  m_QueueChanged.wait(lock, [this]() { return !m_Busy; });
+
+  // The writer is idle and holds the lock, so the file can be closed here
+  if(m_File)
+    fclose(m_File);
+  m_File = nullptr;
+  }
+
+  std::remove(m_FileName.c_str());
+  m_CheckpointRuns = m_DeltaRuns = 0;
+}
+
+bool
+SegmentationRecoveryJournal
+::HasWriteFailed() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_WriteFailed;
+}
+
+void
+SegmentationRecoveryJournal
+::WriterLoop()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while(true)
+    {
+    m_QueueChanged.wait(lock, [this]() { return m_Stop || !m_Queue.empty(); });
+
+    // Pending records are still written when stopping
+    if(m_Queue.empty())
+      break;
+
+    Job job = std::move(m_Queue.front());
+    m_Queue.pop_front();
+    m_Busy = true;
+
+    lock.unlock();
+    this->WriteJob(job);
+    lock.lock();
+
+    m_Busy = false;
+    m_QueueChanged.notify_all();
+    }
+}
+
+void
+SegmentationRecoveryJournal
+::WriteJob(Job &job)
+{
+  std::vector<unsigned char> raw;
+
+  if(job.Type == Job::RESTART)
+    {
+    if(m_File)
+      fclose(m_File);
+    m_File = nullptr;
+
+    // Write the new journal next to the old one, so that the old one stays
+    // usable until the new one is complete
+    std::string fn_new = m_FileName + ".tmp";
+    FILE *f = fopen(fn_new.c_str(), "wb");
+    bool ok = (f != nullptr);
+    if(ok)
+      {
+      raw.insert(raw.end(), JOURNAL_MAGIC, JOURNAL_MAGIC + sizeof(JOURNAL_MAGIC));
+      journal_put_fixed<unsigned int>(raw, JOURNAL_VERSION);
+      journal_put_fixed<unsigned int>(raw, (unsigned int) job.Checkpoints.size());
+      for(unsigned int d = 0; d < 3; d++)
+        journal_put_fixed<unsigned long long>(raw, job.Size[d]);
+      ok = fwrite(raw.data(), 1, raw.size(), f) == raw.size();
+      }
+
+    for(unsigned int tp = 0; ok && tp < job.Checkpoints.size(); tp++)
+      {
+      raw.clear();
+      for(const RLLine &line : job.Checkpoints[tp])
+        {
+        journal_put_varint(raw, line.size());
+        for(const auto &seg : line)
+          {
+          journal_put_varint(raw, seg.first);
+          journal_put_value(raw, seg.second);
+          }
+        }
+      ok = this->WriteRecord(f, RECORD_CHECKPOINT, tp, raw);
+      }
+
+    if(f)
+      ok = (fclose(f) == 0) && ok;
+
+    // Replace the old journal and keep appending to the new one
+    if(ok)
+      {
+      std::remove(m_FileName.c_str());
+      ok = std::rename(fn_new.c_str(), m_FileName.c_str()) == 0;
+      }
+    if(ok)
+      ok = (m_File = fopen(m_FileName.c_str(), "ab")) != nullptr;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_WriteFailed = !ok;
+    return;
+    }
+
+  // Records are only appended to a journal that was started successfully
+  if(!m_File)
+    return;
+
+  unsigned int type;
+  if(job.Type == Job::CHECKPOINT)
+    {
+    type = RECORD_CHECKPOINT;
+    for(const RLLine &line : job.Checkpoints[0])
+      {
+      journal_put_varint(raw, line.size());
+      for(const auto &seg : line)
+        {
+        journal_put_varint(raw, seg.first);
+        journal_put_value(raw, seg.second);
+        }
+      }
+    }
+  else
+    {
+    type = job.Reverse ? RECORD_DELTA_REVERSE : RECORD_DELTA;
+    journal_put_varint(raw, job.Tiles.size());
+    for(const TileRecord &tile : job.Tiles)
+      {
+      for(unsigned int d = 0; d < 3; d++)
+        journal_put_varint(raw, (unsigned long long) tile.Region.GetIndex(d));
+      for(unsigned int d = 0; d < 3; d++)
+        journal_put_varint(raw, tile.Region.GetSize(d));
+      journal_put_varint(raw, tile.RLEs.size());
+      for(const auto &rle : tile.RLEs)
+        {
+        journal_put_varint(raw, rle.first);
+        journal_put_value(raw, rle.second);
+        }
+      }
+    }
+
+  if(!this->WriteRecord(m_File, type, job.TimePoint, raw))
+    {
+    fclose(m_File);
+    m_File = nullptr;
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_WriteFailed = true;
+    }
+}
+
+bool
+SegmentationRecoveryJournal
+::WriteRecord(FILE *f, unsigned int type, unsigned int tp,
+              const std::vector<unsigned char> &raw)
+{
+  // Compress the record using the fastest zlib setting
+  uLongf n_packed = compressBound((uLong) raw.size());
+  std::vector<unsigned char> record(24 + n_packed);
+  if(compress2(record.data() + 24, &n_packed, raw.data(), (uLong) raw.size(), 1) != Z_OK)
+    return false;
+
+  // The record header gives the type, time point and both sizes of the data
+  unsigned long long sizes[2] = { raw.size(), n_packed };
+  memcpy(record.data(), &type, 4);
+  memcpy(record.data() + 4, &tp, 4);
+  memcpy(record.data() + 8, sizes, 16);
+  record.resize(24 + n_packed);
+
+  // A record is written in one piece and flushed, so that a crash can at
+  // most cut off the last record
+  return fwrite(record.data(), 1, record.size(), f) == record.size() && fflush(f) == 0;
+}
+
+bool
+SegmentationRecoveryJournal
+::Replay(const std::string &filename, const ImageList &images)
+{
+  // If the journal was being compacted, the new journal may not have been
+  // moved into place yet
+  FILE *f = fopen(filename.c_str(), "rb");
+  if(!f)
+    f = fopen((filename + ".tmp").c_str(), "rb");
+  if(!f || images.empty())
+    {
+    if(f)
+      fclose(f);
+    return false;
+    }
+
+  // Check the header against the images
+  char magic[8];
+  unsigned int version = 0, n_tp = 0;
+  unsigned long long size[3];
+  bool ok = fread(magic, 1, 8, f) == 8
+            && memcmp(magic, JOURNAL_MAGIC, 8) == 0
+            && fread(&version, 4, 1, f) == 1 && version == JOURNAL_VERSION
+            && fread(&n_tp, 4, 1, f) == 1 && n_tp == images.size()
+            && fread(size, 8, 3, f) == 3;
+
+  for(unsigned int tp = 0; ok && tp < n_tp; tp++)
+    {
+    itk::ImageRegion<3> region = images[tp]->GetBufferedRegion();
+    for(unsigned int d = 0; d < 3; d++)
+      ok = ok && region.GetSize(d) == size[d];
+    }
+
+  if(!ok)
+    {
+    fclose(f);
+    return false;
+    }
+
+  long nx = (long) size[0], ny = (long) size[1], nz = (long) size[2];
+  std::vector<std::vector<RLLine> > lines(n_tp);
+  std::vector<bool> have_checkpoint(n_tp, false);
+  std::vector<LabelType> row(nx);
+
+  // Read the records until the end of the file or the first incomplete record
+  std::vector<unsigned char> packed, raw;
+  while(true)
+    {
+    unsigned char header[24];
+    if(fread(header, 1, 24, f) != 24)
+      break;
+
+    unsigned int type, tp;
+    unsigned long long sizes[2];
+    memcpy(&type, header, 4);
+    memcpy(&tp, header + 4, 4);
+    memcpy(sizes, header + 8, 16);
+    if(tp >= n_tp)
+      break;
+
+    packed.resize(sizes[1]);
+    raw.resize(sizes[0]);
+    uLongf n_raw = (uLongf) sizes[0];
+    if(fread(packed.data(), 1, packed.size(), f) != packed.size()
+       || uncompress(raw.data(), &n_raw, packed.data(), (uLong) packed.size()) != Z_OK
+       || n_raw != sizes[0])
+      break;
+
+    JournalReader reader(raw);
+    if(type == RECORD_CHECKPOINT)
+      {
+      // Decode all the lines, each of which must span the image width
+      std::vector<RLLine> cp(ny * nz);
+      bool valid = true;
+      for(RLLine &line : cp)
+        {
+        unsigned long long n_runs, len, total = 0;
+        valid = reader.GetVarint(n_runs) && n_runs > 0 && n_runs <= (unsigned long long) nx;
+        for(unsigned long long r = 0; valid && r < n_runs; r++)
+          {
+          LabelType value;
+          valid = reader.GetVarint(len) && reader.GetValue(value);
+          line.push_back(std::make_pair((LabelImageType::RLSegment::first_type) len, value));
+          total += len;
+          }
+        if(!valid || total != (unsigned long long) nx)
+          {
+          valid = false;
+          break;
+          }
+        }
+
+      if(!valid || !reader.AtEnd())
+        break;
+
+      lines[tp].swap(cp);
+      have_checkpoint[tp] = true;
+      }
+    else if(type == RECORD_DELTA || type == RECORD_DELTA_REVERSE)
+      {
+      if(!have_checkpoint[tp])
+        break;
+
+      // Decode the tiles before applying any of them
+      unsigned long long n_tiles, v;
+      std::vector<TileRecord> tiles;
+      bool valid = reader.GetVarint(n_tiles);
+      for(unsigned long long t = 0; valid && t < n_tiles; t++)
+        {
+        TileRecord tile;
+        for(unsigned int d = 0; valid && d < 3; d++)
+          if((valid = reader.GetVarint(v)))
+            tile.Region.SetIndex(d, (itk::IndexValueType) v);
+        for(unsigned int d = 0; valid && d < 3; d++)
+          if((valid = reader.GetVarint(v)))
+            tile.Region.SetSize(d, (itk::SizeValueType) v);
+
+        // The tile must lie inside the image and its runs must cover it
+        for(unsigned int d = 0; valid && d < 3; d++)
+          valid = tile.Region.GetIndex(d) >= 0
+                  && tile.Region.GetIndex(d) + (long long) tile.Region.GetSize(d) <= (long long) size[d];
+
+        unsigned long long n_rles, total = 0;
+        valid = valid && reader.GetVarint(n_rles);
+        for(unsigned long long i = 0; valid && i < n_rles; i++)
+          {
+          LabelType value;
+          if((valid = reader.GetVarint(v) && reader.GetValue(value)))
+            {
+            tile.RLEs.push_back(std::make_pair((size_t) v, value));
+            total += v;
+            }
+          }
+
+        valid = valid && total == tile.Region.GetNumberOfPixels();
+        tiles.push_back(std::move(tile));
+        }
+
+      if(!valid || !reader.AtEnd())
+        break;
+
+      // Apply the tiles, only expanding the lines that the delta changes
+      bool reverse = (type == RECORD_DELTA_REVERSE);
+      for(const TileRecord &tile : tiles)
+        {
+        long x0 = tile.Region.GetIndex(0), sx = tile.Region.GetSize(0);
+        size_t ri = 0, r_left = tile.RLEs.size() ? tile.RLEs[0].first : 0;
+        for(long z = tile.Region.GetIndex(2); z < tile.Region.GetIndex(2) + (long) tile.Region.GetSize(2); z++)
+          {
+          for(long y = tile.Region.GetIndex(1); y < tile.Region.GetIndex(1) + (long) tile.Region.GetSize(1); y++)
+            {
+            RLLine &line = lines[tp][y + z * ny];
+            bool expanded = false;
+            for(long x = 0; x < sx; )
+              {
+              if(r_left == 0)
+                {
+                r_left = tile.RLEs[++ri].first;
+                continue;
+                }
+
+              long n = std::min((long) r_left, sx - x);
+              LabelType d = tile.RLEs[ri].second;
+              if(d != 0)
+                {
+                if(!expanded)
+                  {
+                  long k = 0;
+                  for(const auto &seg : line)
+                    for(long q = 0; q < (long) seg.first; q++)
+                      row[k++] = seg.second;
+                  expanded = true;
+                  }
+
+                for(long q = x0 + x; q < x0 + x + n; q++)
+                  row[q] = reverse ? (LabelType)(row[q] - d) : (LabelType)(row[q] + d);
+                }
+              x += n;
+              r_left -= n;
+              }
+
+            // Encode the changed line back into runs
+            if(expanded)
+              {
+              line.clear();
+              for(long k = 0; k < nx; k++)
+                {
+                if(line.size() && line.back().second == row[k])
+                  line.back().first++;
+                else
+                  line.push_back(std::make_pair(1, row[k]));
+                }
+              }
+            }
+          }
+        }
+      }
+    else break;
+    }
+
+  fclose(f);
+
+  // Every time point must have been recovered
+  for(unsigned int tp = 0; tp < n_tp; tp++)
+    if(!have_checkpoint[tp])
+      return false;
+
+  for(unsigned int tp = 0; tp < n_tp; tp++)
+    {
+    RLLine *p = images[tp]->GetBuffer()->GetBufferPointer();
+    for(size_t i = 0; i < lines[tp].size(); i++)
+      p[i].swap(lines[tp][i]);
+    images[tp]->Modified();
+    }
+
+  return true;
+}
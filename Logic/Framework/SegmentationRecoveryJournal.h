@@ -0,0 +1,161 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Language:  C++
+
+  Copyright (c) 2024 Paul A. Yushkevich
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#ifndef SEGMENTATIONRECOVERYJOURNAL_H
+#define SEGMENTATIONRECOVERYJOURNAL_H
+
+#include "SNAPCommon.h"
+#include "UndoDataManager.h"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * \class SegmentationRecoveryJournal
+ * \brief An append-only file of segmentation changes used to recover work
+ * after a crash.
+ *
+ * The journal starts with a checkpoint of every time point of a segmentation
+ * (the runs of each image line), followed by the undo deltas applied to the
+ * segmentation, in the forward direction for edits and redo and in the reverse
+ * direction for undo. When the deltas outgrow the checkpoint, the journal is
+ * compacted by writing a fresh checkpoint to a new file that replaces the old
+ * one.
+ *
+ * The calling thread only copies the runs of the deltas and images. The
+ * encoding, compression and writing happen on a worker thread, so recording a
+ * change costs time proportional to the number of runs in it.
+ */
+class SegmentationRecoveryJournal
+{
+public:
+  typedef RLEImage<LabelType> LabelImageType;
+  typedef LabelImageType::RLLine RLLine;
+  typedef UndoDelta<LabelType> Delta;
+  typedef std::vector<LabelImageType *> ImageList;
+
+  /** Create a journal that writes to the given file */
+  SegmentationRecoveryJournal(const std::string &filename);
+
+  /** Finish pending writes and close the file. The file is kept. */
+  ~SegmentationRecoveryJournal();
+
+  const std::string &GetFileName() const { return m_FileName; }
+
+  /**
+   * Start the journal over with a checkpoint of all the time points of a
+   * segmentation. All the previous records are discarded.
+   */
+  void Restart(const ImageList &images);
+
+  /** Append a checkpoint of a single time point */
+  void AppendCheckpoint(unsigned int tp, LabelImageType *image);
+
+  /** Append a delta that was applied to a time point. The delta must be unpacked */
+  void AppendDelta(unsigned int tp, Delta *delta, bool reverse);
+
+  /** Whether the deltas recorded since the last restart warrant a compaction */
+  bool IsCompactionNeeded() const;
+
+  /** Wait for all the pending records to be written */
+  void Flush();
+
+  /** Stop writing and delete the journal file */
+  void Discard();
+
+  /** Whether a write to the journal file has failed */
+  bool HasWriteFailed() const;
+
+  /**
+   * Replay the journal stored in a file into the time points of a segmentation.
+   * Records that were cut short by a crash are ignored. Returns false and leaves
+   * the images unchanged if the file is missing or does not match the images.
+   */
+  static bool Replay(const std::string &filename, const ImageList &images);
+
+protected:
+
+  // A tile of a delta copied by the calling thread
+  struct TileRecord
+  {
+    itk::ImageRegion<3> Region;
+    std::vector<std::pair<size_t, LabelType> > RLEs;
+  };
+
+  // A unit of work for the writer thread
+  struct Job
+  {
+    enum Kind { RESTART, CHECKPOINT, DELTA } Type;
+    unsigned int TimePoint = 0;
+    bool Reverse = false;
+
+    // Size of the images (restart only)
+    itk::Size<3> Size;
+
+    // Lines of each checkpointed time point (restart and checkpoint)
+    std::vector<std::vector<RLLine> > Checkpoints;
+
+    // Tiles of the delta
+    std::vector<TileRecord> Tiles;
+  };
+
+  // Record types in the file
+  enum RecordType { RECORD_CHECKPOINT = 1, RECORD_DELTA = 2, RECORD_DELTA_REVERSE = 3 };
+
+  // Copy the lines of an image
+  static void CopyLines(LabelImageType *image, std::vector<RLLine> &lines);
+
+  // Queue a job for the writer thread
+  void Enqueue(Job &&job);
+
+  // The writer thread loop and the handling of a single job
+  void WriterLoop();
+  void WriteJob(Job &job);
+  bool WriteRecord(FILE *f, unsigned int type, unsigned int tp,
+                   const std::vector<unsigned char> &raw);
+
+  std::string m_FileName;
+
+  // The journal file, accessed by the writer thread, or under the lock while
+  // the writer is idle
+  FILE *m_File = nullptr;
+
+  // Job queue shared with the writer thread
+  std::deque<Job> m_Queue;
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_QueueChanged;
+  bool m_Busy = false, m_Stop = false, m_WriteFailed = false;
+  std::thread m_Writer;
+
+  // Number of runs in the last checkpoint and in the deltas recorded since
+  size_t m_CheckpointRuns = 0, m_DeltaRuns = 0;
+
+  // Compaction is considered once the deltas hold this many runs
+  static constexpr size_t MIN_COMPACTION_RUNS = 4000000;
+};
+
+#endif // SEGMENTATIONRECOVERYJOURNAL_H
@@ -63,9 +63,12 @@ public:
   typedef UndoDataManager<LabelType>::Delta                    UndoDelta;
 
   enum UpdateType {
-    FOREGROUND, BACKGROUND, SKIP
+    FOREGROUND, BACKGROUND, SKIP, FOREGROUND_PRESERVE_CLEAR
   };
 
+  // Size of the tiles into which undo deltas are split
+  static constexpr unsigned int UNDO_TILE_SIZE = 32;
+
   SegmentationUpdateIterator(LabelImageWrapper *seg_wrapper,
                              const RegionType &region,
                              LabelType active_label,
@@ -110,6 +113,12 @@ public:
     return m_Iterator.GetIndex();
   }
 
+  /** The label currently held by the voxel */
+  LabelType GetLabel()
+  {
+    return m_Iterator.Get();
+  }
+
   /**
    * Paint with a specified label - respecting the draw-over mask
    */
@@ -126,6 +135,7 @@ public:
         m_VoxelDelta += new_label - lOld;
         m_Iterator.Set(new_label);
         m_ChangedVoxels++;
+        RecordLabelChange(lOld, new_label);
         }
       }
   }
@@ -157,6 +167,7 @@ public:
         m_VoxelDelta += m_ActiveLabel - lOld;
         m_Iterator.Set(m_ActiveLabel);
         m_ChangedVoxels++;
+        RecordLabelChange(lOld, m_ActiveLabel);
         }
       }
   }
@@ -173,6 +184,7 @@ public:
       m_VoxelDelta += 0 - lOld;
       m_Iterator.Set(0);
       m_ChangedVoxels++;
+      RecordLabelChange(lOld, 0);
       }
   }
 
@@ -189,6 +201,7 @@ public:
       m_VoxelDelta += new_label - lOld;
       m_Iterator.Set(new_label);
       m_ChangedVoxels++;
+      RecordLabelChange(lOld, new_label);
       }
   }
 
@@ -215,6 +228,7 @@ public:
       m_VoxelDelta += new_label - lOld;
       m_Iterator.Set(new_label);
       m_ChangedVoxels++;
+      RecordLabelChange(lOld, new_label);
       }
   }
 
@@ -235,7 +249,10 @@ public:
     m_Delta->FinishEncoding();
     if(m_ChangedVoxels > 0)
       {
-      m_Wrapper->PixelsModified();
+      // Only keep the parts of the region that actually changed
+      m_Delta->SplitIntoTiles(UNDO_TILE_SIZE);
+
+      m_Wrapper->PixelsModifiedWithDelta(m_Delta, &m_LabelCountChanges);
       if(undo_string)
         m_Wrapper->StoreUndoPoint(undo_string, RelinquishDelta());
       return true;
@@ -265,6 +282,13 @@ public:
 
 protected:
 
+  // Keep track of the change in the number of voxels with each label
+  void RecordLabelChange(LabelType lOld, LabelType lNew)
+  {
+    m_LabelCountChanges[lOld]--;
+    m_LabelCountChanges[lNew]++;
+  }
+
   // The label image wrapper to which segmentation is applied
   LabelImageWrapper *m_Wrapper;
 
@@ -291,7 +315,271 @@ protected:
 
   // Number of voxels actually modified
   unsigned long m_ChangedVoxels;
+
+  // Changes to the label counts made by the update
+  LabelImageWrapper::LabelCountChanges m_LabelCountChanges;
 };
 
 
+/**
+ * \class SegmentationRunWriter
+ * \brief Paints runs of updates into the segmentation one line at a time.
+ *
+ * This is the run-length counterpart of SegmentationUpdateIterator, with
+ * the same painting rules as PaintAsForeground() and PaintAsBackground().
+ * The update for each line of the region is given as runs of FOREGROUND,
+ * BACKGROUND, FOREGROUND_PRESERVE_CLEAR (as PaintAsForegroundPreserveClear)
+ * and SKIP voxels, which are merged directly with the runs of
+ * the corresponding line of the RLE segmentation image, so the cost scales
+ * with the number of runs rather than voxels. The undo delta is encoded as
+ * runs in the same pass. The lines must be painted in raster order.
+ */
+class SegmentationRunWriter
+{
+public:
+  typedef itk::Index<3>                                        IndexType;
+  typedef itk::ImageRegion<3>                                  RegionType;
+  typedef LabelImageWrapper::ImageType                         LabelImageType;
+  typedef LabelImageType::RLLine                               RLLine;
+  typedef UndoDataManager<LabelType>::Delta                    UndoDelta;
+  typedef SegmentationUpdateIterator::UpdateType               UpdateType;
+
+  /** Runs of the update along a line: (length, update type) */
+  typedef std::vector<std::pair<unsigned int, UpdateType> >    UpdateLine;
+
+  SegmentationRunWriter(LabelImageWrapper *seg_wrapper,
+                        const RegionType &region,
+                        LabelType active_label,
+                        DrawOverFilter draw_over)
+    : m_Wrapper(seg_wrapper),
+      m_Region(region),
+      m_ActiveLabel(active_label),
+      m_DrawOver(draw_over),
+      m_ChangedVoxels(0)
+  {
+    m_Delta = new UndoDelta();
+    m_Delta->SetRegion(region);
+  }
+
+  ~SegmentationRunWriter()
+  {
+    if(m_Delta)
+      delete m_Delta;
+  }
+
+  /**
+   * Paint the line of the region that passes through (y, z). The update
+   * runs must add up to the width of the region.
+   */
+  void PaintLine(long y, long z, const UpdateLine &update)
+  {
+    LabelImageType::BufferType::IndexType bi;
+    bi[0] = y; bi[1] = z;
+    RLLine &line = m_Wrapper->GetModifiableImage()->GetBuffer()->GetPixel(bi);
+
+    m_ChangedVoxels += this->MergeLine(
+          line, update,
+          [this](LabelType d, long n) { m_Delta->Encode(d, n); },
+          m_LabelCountChanges);
+  }
+
+  /**
+   * Apply the same update to every line of the region. This is used for
+   * bulk operations over the whole image, such as replacing a label.
+   */
+  void PaintAllLines(const UpdateLine &update)
+  {
+    this->PaintAllLinesWith([&update](const IndexType &, UpdateLine &line_update)
+      { line_update = update; });
+  }
+
+  /**
+   * Paint every line of the region, with the update for each line computed
+   * by calling generator(index, update), where index is the first voxel of
+   * the line in the region. The lines are processed in parallel, each one
+   * producing its own piece of the undo delta, and the pieces are then
+   * encoded in raster order. The generator is called concurrently from
+   * several threads. Should not be mixed with calls to PaintLine().
+   */
+  template <class TGenerator>
+  void PaintAllLinesWith(TGenerator generator)
+  {
+    struct LineResult
+    {
+      std::vector<std::pair<long, LabelType> > Delta;
+      LabelImageWrapper::LabelCountChanges CountChanges;
+      unsigned long ChangedVoxels = 0;
+    };
+
+    long ny = m_Region.GetSize(1);
+    std::vector<LineResult> results(ny * m_Region.GetSize(2));
+
+    m_Wrapper->GetModifiableImage()->ParallelForEachLine(
+          m_Region, [&](RLLine &line, const LabelImageType::IndexType &idx)
+      {
+      LineResult &r = results[(idx[1] - m_Region.GetIndex(1)) + ny * (idx[2] - m_Region.GetIndex(2))];
+
+      IndexType idx_region = idx;
+      idx_region[0] = m_Region.GetIndex(0);
+      UpdateLine update;
+      generator(idx_region, update);
+
+      r.ChangedVoxels = this->MergeLine(
+            line, update,
+            [&r](LabelType d, long n)
+              {
+              if(r.Delta.size() && r.Delta.back().second == d)
+                r.Delta.back().first += n;
+              else
+                r.Delta.push_back(std::make_pair(n, d));
+              },
+            r.CountChanges);
+      });
+
+    for(const auto &r : results)
+      {
+      for(const auto &d : r.Delta)
+        m_Delta->Encode(d.second, d.first);
+      for(const auto &c : r.CountChanges)
+        m_LabelCountChanges[c.first] += c.second;
+      m_ChangedVoxels += r.ChangedVoxels;
+      }
+  }
+
+  /**
+   * Finish encoding, mark the label wrapper as modified if any voxels were
+   * changed and store an undo point if an undo string is specified. Same as
+   * SegmentationUpdateIterator::Finalize().
+   */
+  bool Finalize(const char *undo_string = nullptr)
+  {
+    m_Delta->FinishEncoding();
+    if(m_ChangedVoxels > 0)
+      {
+      m_Delta->SplitIntoTiles(SegmentationUpdateIterator::UNDO_TILE_SIZE);
+
+      m_Wrapper->PixelsModifiedWithDelta(m_Delta, &m_LabelCountChanges);
+      if(undo_string)
+        m_Wrapper->StoreUndoPoint(undo_string, RelinquishDelta());
+      return true;
+      }
+    return false;
+  }
+
+  // Keep delta from being deleted
+  UndoDelta *RelinquishDelta()
+  {
+    UndoDelta *delta = m_Delta;
+    m_Delta = NULL;
+    return delta;
+  }
+
+  // Get the number of changed voxels
+  unsigned long GetNumberOfChangedVoxels() const
+  {
+    return m_ChangedVoxels;
+  }
+
+protected:
+
+  // Merge the update with the runs of a line of the segmentation, passing
+  // the undo delta runs to the encoder. Returns the number of changed voxels
+  template <class TEncoder>
+  unsigned long MergeLine(RLLine &line, const UpdateLine &update, TEncoder encode,
+                          LabelImageWrapper::LabelCountChanges &count_changes) const
+  {
+    // Extent of the region along the line, relative to the start of the line
+    long x0 = m_Region.GetIndex(0) - m_Wrapper->GetImage()->GetBufferedRegion().GetIndex(0);
+    long x1 = x0 + m_Region.GetSize(0);
+
+    RLLine out;
+    out.reserve(line.size() + update.size());
+    auto append = [&out](long count, LabelType value)
+      {
+      if(out.size() && out.back().second == value)
+        out.back().first += count;
+      else
+        out.push_back(std::make_pair(count, value));
+      };
+
+    // Walk the runs of the line and of the update together
+    auto itUpdate = update.begin();
+    long updateLeft = itUpdate != update.end() ? itUpdate->first : 0;
+    long x = 0;
+    unsigned long changed = 0;
+    for(const auto &seg : line)
+      {
+      long segEnd = x + seg.first;
+      LabelType lOld = seg.second;
+
+      // Part of the run before the region
+      if(x < x0)
+        {
+        long n = std::min(segEnd, x0) - x;
+        append(n, lOld);
+        x += n;
+        }
+
+      // Part of the run inside the region, split by the update runs
+      while(x < segEnd && x < x1)
+        {
+        while(updateLeft == 0)
+          updateLeft = (++itUpdate)->first;
+
+        long n = std::min(std::min(segEnd, x1) - x, updateLeft);
+        LabelType lNew = NewLabel(itUpdate->second, lOld);
+        append(n, lNew);
+        encode((LabelType)(lNew - lOld), n);
+        if(lNew != lOld)
+          {
+          changed += n;
+          count_changes[lOld] -= n;
+          count_changes[lNew] += n;
+          }
+
+        x += n;
+        updateLeft -= n;
+        }
+
+      // Part of the run after the region
+      if(x < segEnd)
+        {
+        append(segEnd - x, lOld);
+        x = segEnd;
+        }
+      }
+
+    // Unchanged lines keep sharing their runs with other time points and copies
+    if(changed)
+      line.swap(out);
+    return changed;
+  }
+
+  LabelType NewLabel(UpdateType type, LabelType lOld) const
+  {
+    if(type == SegmentationUpdateIterator::FOREGROUND
+       || (type == SegmentationUpdateIterator::FOREGROUND_PRESERVE_CLEAR && lOld != 0))
+      {
+      if(m_DrawOver.CoverageMode == PAINT_OVER_ALL ||
+         (m_DrawOver.CoverageMode == PAINT_OVER_ONE && lOld == m_DrawOver.DrawOverLabel) ||
+         (m_DrawOver.CoverageMode == PAINT_OVER_VISIBLE && lOld != 0))
+        return m_ActiveLabel;
+      }
+    else if(type == SegmentationUpdateIterator::BACKGROUND)
+      {
+      if(m_ActiveLabel != 0 && lOld == m_ActiveLabel)
+        return 0;
+      }
+    return lOld;
+  }
+
+  LabelImageWrapper *m_Wrapper;
+  RegionType m_Region;
+  LabelType m_ActiveLabel;
+  DrawOverFilter m_DrawOver;
+  UndoDelta *m_Delta;
+  unsigned long m_ChangedVoxels;
+  LabelImageWrapper::LabelCountChanges m_LabelCountChanges;
+};
+
 #endif // SegmentationUpdateIterator
@@ -37,6 +37,8 @@
 
 #include <vector>
 #include <list>
+#include <cstdio>
+#include <cassert>
 
 #include <RLEImage.h>
 
@@ -44,6 +46,16 @@
  * The Delta class represents a difference between two images used in
  * the Undo system. It only supports linear traversal of images and
  * stores differences in an RLE (run length encoding) format.
+ *
+ * A delta can be split into tiles, so that localized edits over a large
+ * region only record (and replay) the parts of the region that changed.
+ * Each tile covers a sub-region and a contiguous range of RLEs that follow
+ * the raster order of that sub-region. A delta that has not been split
+ * consists of a single tile covering the whole region.
+ *
+ * To keep long undo histories affordable, a delta can be packed into a
+ * compressed byte stream and the stream can in turn be spilled to a file.
+ * The RLE getters may only be used while the delta is unpacked.
  */
 template <typename TPixel>
 class UndoDelta
@@ -61,20 +73,82 @@ public:
 
   void Encode(const TPixel &value);
 
+  /** Encode a run of identical values */
+  void Encode(const TPixel &value, size_t count);
+
   void FinishEncoding();
 
-  size_t GetNumberOfRLEs()
-  { return m_Array.size(); }
+  size_t GetNumberOfRLEs() const
+  { return m_Storage == IN_MEMORY ? m_Array.size() : m_PackedRLECount; }
 
   TPixel GetRLEValue(size_t i)
-  { return m_Array[i].second; }
+  { assert(m_Storage == IN_MEMORY); return m_Array[i].second; }
 
   size_t GetRLELength(size_t i)
-  { return m_Array[i].first; }
+  { assert(m_Storage == IN_MEMORY); return m_Array[i].first; }
+
+  /** Compress the RLE array into a byte stream and release the array */
+  void Pack();
+
+  /** Restore the RLE array, reading it back from the spill file if needed */
+  void Unpack(FILE *spill_file);
+
+  /** Move the packed byte stream to the end of the spill file. The delta
+   * must be packed first. Returns false if the write failed, in which case
+   * the delta is left packed in memory. */
+  bool Spill(FILE *spill_file);
+
+  bool IsPacked() const
+  { return m_Storage != IN_MEMORY; }
+
+  bool IsSpilled() const
+  { return m_Storage == SPILLED; }
+
+  /** Number of bytes of RLE data this delta currently holds in memory */
+  size_t GetMemorySize() const
+  { return m_Array.capacity() * sizeof(RLEPair) + m_PackedData.capacity()
+           + m_Tiles.capacity() * sizeof(Tile); }
 
   unsigned long GetUniqueID() const
   { return m_UniqueID; }
 
+  size_t GetNumberOfTiles() const
+  { return m_Tiles.size() ? m_Tiles.size() : 1; }
+
+  const RegionType &GetTileRegion(size_t k) const
+  { return m_Tiles.size() ? m_Tiles[k].Region : m_Region; }
+
+  size_t GetTileFirstRLE(size_t k) const
+  { return m_Tiles.size() ? m_Tiles[k].FirstRLE : 0; }
+
+  size_t GetTileNumberOfRLEs(size_t k) const
+  { return m_Tiles.size() ? m_Tiles[k].NumberOfRLEs : GetNumberOfRLEs(); }
+
+  /** Bounding box of the tiles, outside of which the delta is zero */
+  RegionType GetTileBoundingRegion() const
+  {
+    RegionType bb = GetTileRegion(0);
+    for(size_t k = 1; k < m_Tiles.size(); k++)
+      {
+      for(unsigned int d = 0; d < 3; d++)
+        {
+        itk::IndexValueType i0 = std::min(bb.GetIndex(d), m_Tiles[k].Region.GetIndex(d));
+        itk::IndexValueType i1 = std::max(bb.GetIndex(d) + (itk::IndexValueType) bb.GetSize(d),
+                                          m_Tiles[k].Region.GetIndex(d) + (itk::IndexValueType) m_Tiles[k].Region.GetSize(d));
+        bb.SetIndex(d, i0);
+        bb.SetSize(d, i1 - i0);
+        }
+      }
+    return bb;
+  }
+
+  /**
+   * Split the encoded delta into cubic tiles of the given size, keeping only
+   * the tiles that contain non-zero changes. Must be called after
+   * FinishEncoding(). Has no effect if the changes are not localized.
+   */
+  void SplitIntoTiles(unsigned int tile_size);
+
   UndoDelta & operator = (const UndoDelta &other);
 
 protected:
@@ -84,9 +158,26 @@ protected:
   size_t m_CurrentLength;
   TPixel m_LastValue;
 
+  // Where the RLE data currently lives
+  enum StorageState { IN_MEMORY, PACKED, SPILLED };
+  StorageState m_Storage;
+
+  // Compressed RLE stream (when packed) and its location in the spill file
+  std::vector<unsigned char> m_PackedData;
+  size_t m_PackedRLECount, m_PackedSize, m_UnpackedSize;
+  long long m_SpillOffset;
+
   // The delta is associated with an image region
   RegionType m_Region;
 
+  // Sub-regions of the region that the RLEs cover, empty if not split
+  struct Tile
+  {
+    RegionType Region;
+    size_t FirstRLE, NumberOfRLEs;
+  };
+  std::vector<Tile> m_Tiles;
+
   // Each delta is assigned a unique ID at creation
   unsigned long m_UniqueID;
   static unsigned long m_UniqueIDCounter;
@@ -124,6 +215,12 @@ public:
     void DeleteDeltas();
     size_t GetNumberOfRLEs() const;
     const DList &GetDeltas() const { return m_Deltas; }
+
+    /** Storage management for the deltas in this commit */
+    void Pack();
+    void Unpack(FILE *spill_file);
+    bool Spill(FILE *spill_file);
+    size_t GetMemorySize() const;
   protected:
     DList m_Deltas;
     std::string m_Name;
@@ -131,6 +228,8 @@ public:
 
   UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize);
 
+  ~UndoDataManager();
+
   /** Add a delta to the staging list. The staging list must be committed */
   void AddDeltaToStaging(Delta *delta);
 
@@ -149,8 +248,39 @@ public:
   size_t GetNumberOfCommits()
     { return m_CommitList.size(); }
 
+  /**
+   * Number of commits on either side of the current position that are kept
+   * uncompressed, so that undo/redo close to the current state stays fast.
+   * Commits further away are compressed.
+   */
+  void SetNumberOfUnpackedCommits(size_t n);
+  size_t GetNumberOfUnpackedCommits() const
+    { return m_NumberOfUnpackedCommits; }
+
+  /**
+   * Maximum number of bytes of undo data kept in memory. When compressed
+   * commits exceed this budget, the ones furthest from the current position
+   * are spilled to a temporary file and read back when needed.
+   */
+  void SetMemoryBudget(size_t bytes);
+  size_t GetMemoryBudget() const
+    { return m_MemoryBudget; }
+
+  /** Number of bytes of undo data currently held in memory */
+  size_t GetMemorySize() const;
+
+  /**
+   * Compress all the commits except the ones next to the current position,
+   * and if spill is set, also move them to the spill file regardless of the
+   * memory budget. Used to free memory when the application runs short.
+   */
+  void ReleaseMemory(bool spill);
+
 private:
 
+  // Compress and spill commits according to the position and memory budget
+  void UpdateCommitStorage();
+
   // Current staging list - where deltas are added
   DList m_StagingList;
 
@@ -163,6 +293,10 @@ private:
   CList m_CommitList;
   CIterator m_Position;
   size_t m_TotalSize, m_MinCommits, m_MaxTotalSize;
+
+  // Storage settings and the temporary file that spilled commits go to
+  size_t m_NumberOfUnpackedCommits, m_MemoryBudget;
+  FILE *m_SpillFile;
 };
 
 #endif // __UndoDataManager_h_
@@ -33,6 +33,34 @@
 
 =========================================================================*/
 
+#include <algorithm>
+#include <cstring>
+#include <itk_zlib.h>
+#include "IRISException.h"
+
+// 64-bit file positioning for the undo spill file
+inline int undo_fseek(FILE *f, long long offset)
+{
+#ifdef _WIN32
+  return _fseeki64(f, offset, SEEK_SET);
+#else
+  return fseeko(f, (off_t) offset, SEEK_SET);
+#endif
+}
+
+inline long long undo_fend(FILE *f)
+{
+#ifdef _WIN32
+  if(_fseeki64(f, 0, SEEK_END) != 0)
+    return -1;
+  return _ftelli64(f);
+#else
+  if(fseeko(f, 0, SEEK_END) != 0)
+    return -1;
+  return (long long) ftello(f);
+#endif
+}
+
 template<typename TPixel> unsigned long UndoDelta<TPixel>::m_UniqueIDCounter = 0;
 
 template<typename TPixel>
@@ -41,6 +69,9 @@ UndoDelta<TPixel>
 {
   m_CurrentLength = 0;
   m_UniqueID = m_UniqueIDCounter++;
+  m_Storage = IN_MEMORY;
+  m_PackedRLECount = m_PackedSize = m_UnpackedSize = 0;
+  m_SpillOffset = -1;
 }
 
 template<typename TPixel>
@@ -65,6 +96,31 @@ UndoDelta<TPixel>
     }
 }
 
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Encode(const TPixel &value, size_t count)
+{
+  if(count == 0)
+    return;
+
+  if(m_CurrentLength == 0)
+    {
+    m_LastValue = value;
+    m_CurrentLength = count;
+    }
+  else if(value == m_LastValue)
+    {
+    m_CurrentLength += count;
+    }
+  else
+    {
+    m_Array.push_back(std::make_pair(m_CurrentLength, m_LastValue));
+    m_CurrentLength = count;
+    m_LastValue = value;
+    }
+}
+
 template<typename TPixel>
 void
 UndoDelta<TPixel>
@@ -79,13 +135,240 @@ UndoDelta<TPixel> &
 UndoDelta<TPixel>
 ::operator = (const UndoDelta<TPixel> &other)
 {
+  // Spilled data belongs to the other delta's manager, so copy it unpacked
+  assert(other.m_Storage != SPILLED);
   m_Array = other.m_Array;
   m_CurrentLength = other.m_CurrentLength;
   m_LastValue = other.m_LastValue;
   m_Region = other.m_Region;
+  m_Tiles = other.m_Tiles;
+  m_Storage = other.m_Storage;
+  m_PackedData = other.m_PackedData;
+  m_PackedRLECount = other.m_PackedRLECount;
+  m_PackedSize = other.m_PackedSize;
+  m_UnpackedSize = other.m_UnpackedSize;
+  m_SpillOffset = -1;
   return *this;
 }
 
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::SplitIntoTiles(unsigned int tile_size)
+{
+  assert(m_Storage == IN_MEMORY && m_Tiles.empty() && tile_size > 0);
+
+  // Dimensions of the region and of the tile grid
+  size_t sz[3], nt[3];
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    sz[d] = m_Region.GetSize(d);
+    nt[d] = (sz[d] + tile_size - 1) / tile_size;
+    }
+  size_t n_tiles = nt[0] * nt[1] * nt[2];
+  if(n_tiles <= 1)
+    return;
+
+  // Mark the tiles that contain non-zero runs, one image row at a time
+  std::vector<bool> touched(n_tiles, false);
+  std::vector<size_t> run_start(m_Array.size());
+  size_t n_touched = 0, offset = 0;
+  for(size_t i = 0; i < m_Array.size(); i++)
+    {
+    run_start[i] = offset;
+    size_t end = offset + m_Array[i].first;
+    if(m_Array[i].second != 0)
+      {
+      for(size_t q = offset; q < end; )
+        {
+        size_t x = q % sz[0], row = q / sz[0];
+        size_t y = row % sz[1], z = row / sz[1];
+        size_t q_end = std::min(end, q + sz[0] - x);
+        size_t t_row = ((z / tile_size) * nt[1] + y / tile_size) * nt[0];
+        for(size_t tx = x / tile_size; tx <= (x + q_end - q - 1) / tile_size; tx++)
+          {
+          if(!touched[t_row + tx])
+            {
+            touched[t_row + tx] = true;
+            n_touched++;
+            }
+          }
+        q = q_end;
+        }
+      }
+    offset = end;
+    }
+
+  // Tiling only pays off if the changes are localized
+  if(n_touched == 0 || n_touched * 2 > n_tiles)
+    return;
+
+  // Re-encode the delta tile by tile
+  RLEArray tiled;
+  std::vector<Tile> tiles;
+  tiles.reserve(n_touched);
+  size_t t = 0;
+  for(size_t tz = 0; tz < nt[2]; tz++)
+    for(size_t ty = 0; ty < nt[1]; ty++)
+      for(size_t tx = 0; tx < nt[0]; tx++, t++)
+        {
+        if(!touched[t])
+          continue;
+
+        size_t t_idx[3] = { tx * tile_size, ty * tile_size, tz * tile_size };
+        Tile tile;
+        for(unsigned int d = 0; d < 3; d++)
+          {
+          tile.Region.SetIndex(d, m_Region.GetIndex(d) + t_idx[d]);
+          tile.Region.SetSize(d, std::min((size_t) tile_size, sz[d] - t_idx[d]));
+          }
+        tile.FirstRLE = tiled.size();
+
+        size_t w_tile = tile.Region.GetSize(0);
+        for(size_t z = t_idx[2]; z < t_idx[2] + tile.Region.GetSize(2); z++)
+          {
+          for(size_t y = t_idx[1]; y < t_idx[1] + tile.Region.GetSize(1); y++)
+            {
+            // Locate the run containing the start of this tile row
+            size_t p = (z * sz[1] + y) * sz[0] + t_idx[0];
+            size_t i = std::upper_bound(run_start.begin(), run_start.end(), p) - run_start.begin() - 1;
+            for(size_t w = w_tile; w > 0; i++)
+              {
+              size_t n = std::min(run_start[i] + m_Array[i].first - p, w);
+              TPixel value = m_Array[i].second;
+              if(tiled.size() > tile.FirstRLE && tiled.back().second == value)
+                tiled.back().first += n;
+              else
+                tiled.push_back(std::make_pair(n, value));
+              p += n;
+              w -= n;
+              }
+            }
+          }
+
+        tile.NumberOfRLEs = tiled.size() - tile.FirstRLE;
+        tiles.push_back(tile);
+        }
+
+  tiled.shrink_to_fit();
+  m_Array.swap(tiled);
+  m_Tiles.swap(tiles);
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Pack()
+{
+  if(m_Storage != IN_MEMORY)
+    return;
+
+  // Serialize the runs: run lengths as variable-length integers (most runs
+  // are short) followed by the raw bytes of the value
+  std::vector<unsigned char> raw;
+  raw.reserve(m_Array.size() * (2 + sizeof(TPixel)));
+  for(const RLEPair &rle : m_Array)
+    {
+    size_t len = rle.first;
+    while(len >= 0x80)
+      {
+      raw.push_back((unsigned char)(len | 0x80));
+      len >>= 7;
+      }
+    raw.push_back((unsigned char) len);
+
+    const unsigned char *pv = reinterpret_cast<const unsigned char *>(&rle.second);
+    raw.insert(raw.end(), pv, pv + sizeof(TPixel));
+    }
+
+  // Compress the stream using the fastest zlib setting
+  uLongf n_packed = compressBound((uLong) raw.size());
+  std::vector<unsigned char> packed(n_packed);
+  if(compress2(packed.data(), &n_packed, raw.data(), (uLong) raw.size(), 1) != Z_OK)
+    return;
+  packed.resize(n_packed);
+  packed.shrink_to_fit();
+
+  m_PackedData.swap(packed);
+  m_PackedSize = n_packed;
+  m_UnpackedSize = raw.size();
+  m_PackedRLECount = m_Array.size();
+  RLEArray().swap(m_Array);
+  m_Storage = PACKED;
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Unpack(FILE *spill_file)
+{
+  if(m_Storage == IN_MEMORY)
+    return;
+
+  // Read the packed stream back from the spill file
+  if(m_Storage == SPILLED)
+    {
+    m_PackedData.resize(m_PackedSize);
+    if(!spill_file
+       || undo_fseek(spill_file, m_SpillOffset) != 0
+       || fread(m_PackedData.data(), 1, m_PackedSize, spill_file) != m_PackedSize)
+      throw IRISException("Failed to read undo data from temporary file");
+    m_Storage = PACKED;
+    m_SpillOffset = -1;
+    }
+
+  // Decompress
+  std::vector<unsigned char> raw(m_UnpackedSize);
+  uLongf n_raw = (uLongf) m_UnpackedSize;
+  if(uncompress(raw.data(), &n_raw, m_PackedData.data(), (uLong) m_PackedSize) != Z_OK
+     || n_raw != m_UnpackedSize)
+    throw IRISException("Failed to decompress undo data");
+
+  // Parse the runs
+  RLEArray array;
+  array.reserve(m_PackedRLECount);
+  size_t pos = 0;
+  while(pos < n_raw)
+    {
+    size_t len = 0;
+    for(unsigned int shift = 0; pos < n_raw; shift += 7)
+      {
+      unsigned char b = raw[pos++];
+      len |= ((size_t)(b & 0x7f)) << shift;
+      if(!(b & 0x80))
+        break;
+      }
+
+    TPixel value;
+    std::memcpy(&value, raw.data() + pos, sizeof(TPixel));
+    pos += sizeof(TPixel);
+    array.push_back(std::make_pair(len, value));
+    }
+
+  m_Array.swap(array);
+  std::vector<unsigned char>().swap(m_PackedData);
+  m_Storage = IN_MEMORY;
+}
+
+template<typename TPixel>
+bool
+UndoDelta<TPixel>
+::Spill(FILE *spill_file)
+{
+  if(m_Storage != PACKED || !spill_file)
+    return false;
+
+  // Append the packed stream to the end of the file
+  long long offset = undo_fend(spill_file);
+  if(offset < 0 || fwrite(m_PackedData.data(), 1, m_PackedSize, spill_file) != m_PackedSize)
+    return false;
+
+  m_SpillOffset = offset;
+  std::vector<unsigned char>().swap(m_PackedData);
+  m_Storage = SPILLED;
+  return true;
+}
+
 
 template<typename TPixel>
 UndoDataManager<TPixel>
@@ -94,9 +377,112 @@ UndoDataManager<TPixel>
   this->m_MinCommits = nMinCommits;
   this->m_MaxTotalSize = nMaxTotalSize;
   this->m_TotalSize = 0;
+  this->m_NumberOfUnpackedCommits = 8;
+  this->m_MemoryBudget = 256 * 1024 * 1024;
+  this->m_SpillFile = NULL;
   m_Position = m_CommitList.begin();
 }
 
+template<typename TPixel>
+UndoDataManager<TPixel>
+::~UndoDataManager()
+{
+  this->Clear();
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::SetNumberOfUnpackedCommits(size_t n)
+{
+  // The commit being undone or redone must stay unpacked
+  m_NumberOfUnpackedCommits = std::max(n, (size_t) 1);
+  this->UpdateCommitStorage();
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::SetMemoryBudget(size_t bytes)
+{
+  m_MemoryBudget = bytes;
+  this->UpdateCommitStorage();
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>
+::GetMemorySize() const
+{
+  size_t n = 0;
+  for(CConstIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it)
+    n += it->GetMemorySize();
+  return n;
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::ReleaseMemory(bool spill)
+{
+  // Apply the strictest storage settings once, then restore them. Commits
+  // are only unpacked when they are needed, so they stay compressed
+  size_t n_unpacked = m_NumberOfUnpackedCommits, budget = m_MemoryBudget;
+  m_NumberOfUnpackedCommits = std::min(n_unpacked, (size_t) 1);
+  if(spill)
+    m_MemoryBudget = 0;
+
+  this->UpdateCommitStorage();
+
+  m_NumberOfUnpackedCommits = n_unpacked;
+  m_MemoryBudget = budget;
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::UpdateCommitStorage()
+{
+  // Distance of each commit from the current position, i.e., the number of
+  // undo or redo operations after which the commit would be needed
+  size_t pos = std::distance(m_CommitList.begin(), m_Position);
+  std::vector<std::pair<size_t, CIterator> > far_commits;
+  size_t mem = 0, i = 0;
+  for(CIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it, ++i)
+    {
+    size_t dist = (i < pos) ? pos - i - 1 : i - pos;
+    if(dist >= m_NumberOfUnpackedCommits)
+      {
+      it->Pack();
+      far_commits.push_back(std::make_pair(dist, it));
+      }
+    mem += it->GetMemorySize();
+    }
+
+  if(mem <= m_MemoryBudget)
+    return;
+
+  // Spill the commits furthest from the current position first
+  std::sort(far_commits.begin(), far_commits.end(),
+            [](const std::pair<size_t, CIterator> &a, const std::pair<size_t, CIterator> &b)
+              { return a.first > b.first; });
+
+  for(auto &fc : far_commits)
+    {
+    if(mem <= m_MemoryBudget)
+      break;
+
+    // The temporary file is created on first use and removed when closed
+    if(!m_SpillFile && !(m_SpillFile = tmpfile()))
+      break;
+
+    size_t before = fc.second->GetMemorySize();
+    if(!fc.second->Spill(m_SpillFile))
+      break;
+    mem -= before - fc.second->GetMemorySize();
+    }
+}
+
 template<typename TPixel>
 void
 UndoDataManager<TPixel>
@@ -114,6 +500,13 @@ UndoDataManager<TPixel>
 
   // Clear the staging list
   m_StagingList.clear();
+
+  // Discard the spilled data
+  if(m_SpillFile)
+    {
+    fclose(m_SpillFile);
+    m_SpillFile = NULL;
+    }
 }
 
 template<typename TPixel>
@@ -171,6 +564,9 @@ UndoDataManager<TPixel>
   m_Position = m_CommitList.end();
   m_TotalSize += n_new_rles;
 
+  // Older commits get compressed and possibly spilled to disk
+  this->UpdateCommitStorage();
+
   // Return the number of RLEs
   return n_new_rles;
 }
@@ -194,6 +590,10 @@ UndoDataManager<TPixel>
   // Move the position one delta to the beginning
   m_Position--;
 
+  // Make sure the deltas are in memory
+  m_Position->Unpack(m_SpillFile);
+  this->UpdateCommitStorage();
+
   // Return the current delta
   return *m_Position;
 }
@@ -214,11 +614,15 @@ UndoDataManager<TPixel>
   // Can't be at the beginning
   assert(IsRedoPossible());
 
+  // Make sure the deltas are in memory
+  m_Position->Unpack(m_SpillFile);
+
   // Return the delta at the current position
   const Commit &commit = *m_Position;
 
   // Move the position one delta to the end
   m_Position++;
+  this->UpdateCommitStorage();
 
   // Return the current delta
   return commit;
@@ -263,3 +667,43 @@ UndoDataManager<TPixel>::Commit::GetNumberOfRLEs() const
     }
   return n;
 }
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>::Commit::Pack()
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit)
+      (*dit)->Pack();
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>::Commit::Unpack(FILE *spill_file)
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit)
+      (*dit)->Unpack(spill_file);
+}
+
+template<typename TPixel>
+bool
+UndoDataManager<TPixel>::Commit::Spill(FILE *spill_file)
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit && (*dit)->IsPacked() && !(*dit)->IsSpilled())
+      if(!(*dit)->Spill(spill_file))
+        return false;
+  return true;
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>::Commit::GetMemorySize() const
+{
+  size_t n = 0;
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit)
+      n += (*dit)->GetMemorySize();
+  return n;
+}
@@ -0,0 +1,286 @@
+#include "DerivedDataCache.h"
+#include <itksys/Directory.hxx>
+#include <itksys/SystemTools.hxx>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+std::string DerivedDataCache::m_Directory;
+std::atomic<bool> DerivedDataCache::m_Enabled(false);
+std::atomic<size_t> DerivedDataCache::m_BlockBudget((size_t) 32 << 30);
+
+// The directory is set on the main thread, and read by the tasks that compute
+// the derived data
+static std::mutex DerivedDataCacheMutex;
+
+// Entries start with this tag, which changes when the layout changes
+static const char DerivedDataCacheTag[] = "SNAPDerivedData1";
+static const char DerivedDataBlockTag[] = "SNAPDerivedBlock1";
+
+// Suffix of the files of block entries, which are subject to the budget
+static const char DerivedDataBlockSuffix[] = ".block";
+
+/** Extend a 64-bit FNV-1a hash with a block of bytes */
+static uint64_t HashBytes(uint64_t hash, const char *data, size_t n)
+{
+  for(size_t i = 0; i < n; i++)
+    {
+    hash ^= (unsigned char) data[i];
+    hash *= 1099511628211ull;
+    }
+  return hash;
+}
+
+static std::string HashToString(uint64_t hash)
+{
+  char code[32];
+  snprintf(code, sizeof(code), "%016llx", (unsigned long long) hash);
+  return code;
+}
+
+void DerivedDataCache::SetDirectory(const std::string &dir)
+{
+  std::lock_guard<std::mutex> guard(DerivedDataCacheMutex);
+  m_Directory = dir;
+}
+
+std::string DerivedDataCache::GetDirectory()
+{
+  std::lock_guard<std::mutex> guard(DerivedDataCacheMutex);
+  return m_Directory;
+}
+
+DerivedDataCache::Key DerivedDataCache::ComputeKey(const std::string &filename)
+{
+  if(!m_Enabled)
+    return Key();
+  return ComputeFileKey(filename);
+}
+
+DerivedDataCache::Key DerivedDataCache::ComputeFileKey(const std::string &filename)
+{
+  Key key;
+  if(GetDirectory().empty())
+    return key;
+
+  std::string path = itksys::SystemTools::CollapseFullPath(filename);
+  itksys::SystemTools::ConvertToUnixSlashes(path);
+  if(!itksys::SystemTools::FileExists(path.c_str(), true))
+    return key;
+
+  // Hash blocks spread evenly over the file, including its first and last
+  // block, which is cheap even for very large files
+  unsigned long size = itksys::SystemTools::FileLength(path);
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if(!in.good())
+    return key;
+
+  const unsigned long block_size = 65536, n_blocks = 16;
+  std::vector<char> block(block_size);
+  uint64_t hash = 14695981039346656037ull;
+  for(unsigned long i = 0; i < n_blocks; i++)
+    {
+    unsigned long offset = size > block_size
+                           ? (unsigned long) ((size - block_size) * (double) i / (n_blocks - 1))
+                           : 0;
+    in.seekg(offset);
+    in.read(block.data(), block_size);
+    hash = HashBytes(hash, block.data(), (size_t) in.gcount());
+    in.clear();
+    if(size <= block_size)
+      break;
+    }
+
+  key.EntryName = HashToString(HashBytes(14695981039346656037ull, path.data(), path.size()));
+  key.Identity = path + "\n" + std::to_string(size) + "\n"
+                 + std::to_string(itksys::SystemTools::ModifiedTime(path)) + "\n"
+                 + HashToString(hash);
+  return key;
+}
+
+std::string DerivedDataCache::GetEntryFileName(const Key &key, const char *product)
+{
+  return GetDirectory() + "/" + key.EntryName + "." + product;
+}
+
+bool DerivedDataCache::Read(const Key &key, const char *product, std::string &data)
+{
+  if(!key.IsValid())
+    return false;
+
+  std::ifstream in(GetEntryFileName(key, product).c_str(), std::ios::binary);
+  if(!in.good())
+    return false;
+
+  // The entry may be for another version of the file
+  char tag[sizeof(DerivedDataCacheTag)];
+  uint64_t n_identity = 0, n_data = 0;
+  in.read(tag, sizeof(tag));
+  in.read((char *) &n_identity, sizeof(n_identity));
+  if(!in.good() || std::string(tag, sizeof(tag)) != std::string(DerivedDataCacheTag, sizeof(tag))
+     || n_identity != key.Identity.size())
+    return false;
+
+  std::string identity(n_identity, '\0');
+  in.read(&identity[0], n_identity);
+  in.read((char *) &n_data, sizeof(n_data));
+  if(!in.good() || identity != key.Identity)
+    return false;
+
+  data.resize(n_data);
+  in.read(&data[0], n_data);
+  return (uint64_t) in.gcount() == n_data;
+}
+
+void DerivedDataCache::Write(const Key &key, const char *product, const std::string &data)
+{
+  std::string dir = GetDirectory();
+  if(!key.IsValid() || dir.empty() || !itksys::SystemTools::MakeDirectory(dir.c_str()))
+    return;
+
+  // Write to a temporary file and rename it, so that a reader never sees a
+  // partial entry
+  std::string fn = GetEntryFileName(key, product), fn_temp = fn + ".tmp";
+  {
+    std::ofstream out(fn_temp.c_str(), std::ios::binary);
+    uint64_t n_identity = key.Identity.size(), n_data = data.size();
+    out.write(DerivedDataCacheTag, sizeof(DerivedDataCacheTag));
+    out.write((const char *) &n_identity, sizeof(n_identity));
+    out.write(key.Identity.data(), n_identity);
+    out.write((const char *) &n_data, sizeof(n_data));
+    out.write(data.data(), n_data);
+    if(!out.good())
+      {
+      out.close();
+      itksys::SystemTools::RemoveFile(fn_temp);
+      return;
+      }
+  }
+
+  if(!itksys::SystemTools::RenameFile(fn_temp, fn))
+    itksys::SystemTools::RemoveFile(fn_temp);
+}
+
+void DerivedDataCache::PruneBlocks(const std::string &dir, size_t n_bytes)
+{
+  itksys::Directory d;
+  if(!d.Load(dir))
+    return;
+
+  // The blocks that were least recently stored or used go first
+  struct Entry { std::string File; long Time; unsigned long Size; };
+  std::vector<Entry> entries;
+  size_t total = 0, n_suffix = sizeof(DerivedDataBlockSuffix) - 1;
+  for(unsigned long i = 0; i < d.GetNumberOfFiles(); i++)
+    {
+    std::string name = d.GetFile(i);
+    if(name.size() <= n_suffix || name.compare(name.size() - n_suffix, n_suffix, DerivedDataBlockSuffix))
+      continue;
+    std::string fn = dir + "/" + name;
+    Entry e { fn, itksys::SystemTools::ModifiedTime(fn), itksys::SystemTools::FileLength(fn) };
+    total += e.Size;
+    entries.push_back(e);
+    }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.Time < b.Time; });
+
+  // Files that are mapped by another process stay on disk until they are
+  // unmapped on POSIX systems, and can not be removed on Windows
+  for(const Entry &e : entries)
+    {
+    if(total + n_bytes <= m_BlockBudget)
+      break;
+    if(itksys::SystemTools::RemoveFile(e.File))
+      total -= e.Size;
+    }
+}
+
+bool DerivedDataCache::WriteBlock(const Key &key, const char *product, const std::string &header,
+                                  const void *data, size_t n_bytes, size_t alignment)
+{
+  std::string dir = GetDirectory();
+  if(!key.IsValid() || dir.empty() || n_bytes > m_BlockBudget
+     || !itksys::SystemTools::MakeDirectory(dir.c_str()))
+    return false;
+
+  PruneBlocks(dir, n_bytes);
+
+  std::string fn = GetEntryFileName(key, product) + DerivedDataBlockSuffix, fn_temp = fn + ".tmp";
+  {
+    std::ofstream out(fn_temp.c_str(), std::ios::binary);
+    uint64_t n_identity = key.Identity.size(), n_header = header.size();
+    uint64_t head_size = sizeof(DerivedDataBlockTag) + 4 * sizeof(uint64_t) + n_identity + n_header;
+    uint64_t offset = alignment > 1 ? ((head_size + alignment - 1) / alignment) * alignment : head_size;
+    uint64_t n_data = n_bytes;
+
+    out.write(DerivedDataBlockTag, sizeof(DerivedDataBlockTag));
+    out.write((const char *) &n_identity, sizeof(n_identity));
+    out.write(key.Identity.data(), n_identity);
+    out.write((const char *) &n_header, sizeof(n_header));
+    out.write(header.data(), n_header);
+    out.write((const char *) &offset, sizeof(offset));
+    out.write((const char *) &n_data, sizeof(n_data));
+
+    std::vector<char> pad(offset - head_size, 0);
+    out.write(pad.data(), pad.size());
+    out.write((const char *) data, n_bytes);
+    if(!out.good())
+      {
+      out.close();
+      itksys::SystemTools::RemoveFile(fn_temp);
+      return false;
+      }
+  }
+
+  if(!itksys::SystemTools::RenameFile(fn_temp, fn))
+    {
+    itksys::SystemTools::RemoveFile(fn_temp);
+    return false;
+    }
+  return true;
+}
+
+bool DerivedDataCache::FindBlock(const Key &key, const char *product, std::string &header,
+                                 std::string &filename, size_t &offset, size_t &n_bytes)
+{
+  if(!key.IsValid())
+    return false;
+
+  std::string fn = GetEntryFileName(key, product) + DerivedDataBlockSuffix;
+  std::ifstream in(fn.c_str(), std::ios::binary);
+  if(!in.good())
+    return false;
+
+  char tag[sizeof(DerivedDataBlockTag)];
+  uint64_t n_identity = 0, n_header = 0, data_offset = 0, n_data = 0;
+  in.read(tag, sizeof(tag));
+  in.read((char *) &n_identity, sizeof(n_identity));
+  if(!in.good() || std::string(tag, sizeof(tag)) != std::string(DerivedDataBlockTag, sizeof(tag))
+     || n_identity != key.Identity.size())
+    return false;
+
+  std::string identity(n_identity, '\0');
+  in.read(&identity[0], n_identity);
+  in.read((char *) &n_header, sizeof(n_header));
+  if(!in.good() || identity != key.Identity || n_header > 65536)
+    return false;
+
+  header.assign(n_header, '\0');
+  in.read(&header[0], n_header);
+  in.read((char *) &data_offset, sizeof(data_offset));
+  in.read((char *) &n_data, sizeof(n_data));
+  if(!in.good() || (uint64_t) itksys::SystemTools::FileLength(fn) < data_offset + n_data)
+    return false;
+
+  // Blocks in use are the last to be pruned
+  itksys::SystemTools::Touch(fn, false);
+
+  filename = fn;
+  offset = (size_t) data_offset;
+  n_bytes = (size_t) n_data;
+  return true;
+}
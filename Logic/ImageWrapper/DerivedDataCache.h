@@ -0,0 +1,91 @@
+#ifndef DERIVEDDATACACHE_H
+#define DERIVEDDATACACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+/**
+ * An on-disk cache of data computed from the voxels of image files, such as
+ * the intensity digests from which the histogram and the intensity range are
+ * derived, so that reopening a large image does not take another pass over
+ * its voxels.
+ *
+ * The entries for a file are named after a hash of its full path, and hold
+ * the identity of the file they were computed from: its path, size,
+ * modification time and a hash of blocks sampled across its contents. An
+ * entry is only used while the file has the same identity. Reading and
+ * writing entries fails quietly, since they can always be computed again.
+ *
+ * Large entries, such as the decoded voxels of compressed images, are stored
+ * as blocks that are memory-mapped rather than read, so that the instances
+ * of SNAP that open the same file share one copy of the voxels in memory.
+ * An entry is replaced by renaming a new file over it, which leaves the
+ * mappings of the old one intact.
+ */
+class DerivedDataCache
+{
+public:
+  /** Identifies the entries computed from one version of one file */
+  struct Key
+  {
+    std::string EntryName, Identity;
+    bool IsValid() const { return !EntryName.empty(); }
+  };
+
+  /** The directory of the cache, created when the first entry is written */
+  static void SetDirectory(const std::string &dir);
+  static std::string GetDirectory();
+
+  /** Whether keys are computed, i.e., whether new images use the cache */
+  static void SetEnabled(bool flag) { m_Enabled = flag; }
+  static bool IsEnabled() { return m_Enabled; }
+
+  /**
+   * Compute the key for a file. The key is not valid if the cache is
+   * disabled or if the file is not a regular file (e.g., a DICOM directory)
+   */
+  static Key ComputeKey(const std::string &filename);
+
+  /** Compute the key for a file, even if the cache is disabled */
+  static Key ComputeFileKey(const std::string &filename);
+
+  /** Read the data stored for a key under a product name, e.g., "tdigest" */
+  static bool Read(const Key &key, const char *product, std::string &data);
+
+  /** Store the data for a key under a product name */
+  static void Write(const Key &key, const char *product, const std::string &data);
+
+  /**
+   * Store a large block of data for a key, along with a small header that
+   * describes it. The block starts at a multiple of the alignment in the
+   * entry file. Before the block is stored, the oldest block entries are
+   * removed to keep the total size of the blocks under the block budget.
+   * Returns false if the block could not be stored.
+   */
+  static bool WriteBlock(const Key &key, const char *product, const std::string &header,
+                         const void *data, size_t n_bytes, size_t alignment = 4096);
+
+  /**
+   * Find a block stored for a key: returns its header, the entry file and
+   * the offset and size of the block in the file, for mapping
+   */
+  static bool FindBlock(const Key &key, const char *product, std::string &header,
+                        std::string &filename, size_t &offset, size_t &n_bytes);
+
+  /** Total size in bytes allowed for the block entries */
+  static void SetBlockBudget(size_t bytes) { m_BlockBudget = bytes; }
+  static size_t GetBlockBudget() { return m_BlockBudget; }
+
+private:
+  static std::string GetEntryFileName(const Key &key, const char *product);
+
+  // Remove the oldest block entries until n_bytes more fit in the budget
+  static void PruneBlocks(const std::string &dir, size_t n_bytes);
+
+  static std::string m_Directory;
+  static std::atomic<bool> m_Enabled;
+  static std::atomic<size_t> m_BlockBudget;
+};
+
+#endif // DERIVEDDATACACHE_H
@@ -17,6 +17,7 @@
 #include "Rebroadcaster.h"
 #include "TDigestImageFilter.h"
 #include "ColorLookupTable.h"
+#include "NativeIntensityMappingPolicy.h"
 
 /* ===============================================================
     ColorLabelTableDisplayMappingPolicy implementation
@@ -50,6 +51,7 @@ ColorLabelTableDisplayMappingPolicy<TWrapperTraits>
     {
     m_RGBAFilter[i] = RGBAFilterType::New();
     m_RGBAFilter[i]->SetInput(wrapper->GetSlice(i));
+    m_RGBAFilter[i]->SetSliceUpdateHistory(wrapper->GetSlicer(i));
     m_RGBAFilter[i]->SetColorTable(NULL);
     }
 
@@ -78,7 +80,8 @@ ColorLabelTableDisplayMappingPolicy<TWrapperTraits>
 {
   DisplayPixelType pix;
   ColorLabelTable *table = this->m_RGBAFilter[0]->GetColorTable();
-  table->GetColorLabel(*val).GetRGBAVector(pix.GetDataPointer());
+  const unsigned char *rgba = table->GetDenseLabelEntry(*val).rgba;
+  std::copy(rgba, rgba + 4, pix.GetDataPointer());
   return pix;
 }
 
@@ -170,7 +173,10 @@ CachingCurveAndColorMapDisplayMappingPolicy<TWrapperTraits>
   m_LookupTableFilter->SetImageMaxInput(m_Wrapper->GetImageMaxObject());
 
   for(unsigned int i=0; i<3; i++)
+    {
     m_IntensityFilter[i]->SetInput(m_Wrapper->GetSlice(i));
+    m_IntensityFilter[i]->SetSliceUpdateHistory(m_Wrapper->GetSlicer(i));
+    }
 }
 
 template<class TWrapperTraits>
@@ -241,6 +247,44 @@ CachingCurveAndColorMapDisplayMappingPolicy<TWrapperTraits>
   return m_Wrapper->GetTDigest();
 }
 
+template<class TWrapperTraits>
+typename CachingCurveAndColorMapDisplayMappingPolicy<TWrapperTraits>::NativeCurveMapping
+CachingCurveAndColorMapDisplayMappingPolicy<TWrapperTraits>
+::GetNativeCurveMapping()
+{
+  // The range of internal intensities spanned by the lookup table, which is
+  // either the image range or the reference range
+  typedef typename LookupTableFilterType::MinMaxObjectType MinMaxObjectType;
+  MinMaxObjectType *omin = const_cast<MinMaxObjectType *>(m_LookupTableFilter->GetImageMinInput());
+  MinMaxObjectType *omax = const_cast<MinMaxObjectType *>(m_LookupTableFilter->GetImageMaxInput());
+  omin->Update();
+  omax->Update();
+  double imin = omin->Get(), imax = omax->Get();
+
+  // The curve domain is the normalized internal range, the same in native units
+  const AbstractNativeIntensityMapping *nim = m_Wrapper->GetNativeIntensityMapping();
+  double nmin = nim->MapInternalToNative(imin), nmax = nim->MapInternalToNative(imax);
+
+  NativeCurveMapping m;
+  m.Scale = (nmax == nmin) ? 1.0 : 1.0 / (nmax - nmin);
+  m.Shift = -nmin * m.Scale;
+  m.NativeZero = nim->MapInternalToNative(0.0);
+  m.IgnoreAlpha = m_LookupTableFilter->GetIgnoreAlpha();
+
+  // Same test for zero as ColorLookupTable::CheckRange - for floating point
+  // images, the table only spans the range of the curve
+  double lo = imin, hi = imax;
+  if(std::is_floating_point<ComponentType>::value)
+    {
+    auto range = m_IntensityCurveVTK->GetRange();
+    lo = range.first * (imax - imin) + imin;
+    hi = range.second * (imax - imin) + imin;
+    }
+  m.ZeroOutOfRange = !(0.0 >= lo && 0.0 <= hi);
+
+  return m;
+}
+
 template<class TWrapperTraits>
 typename CachingCurveAndColorMapDisplayMappingPolicy<TWrapperTraits>::DisplaySlicePointer
 CachingCurveAndColorMapDisplayMappingPolicy<TWrapperTraits>
@@ -568,9 +612,6 @@ void
 MultiChannelDisplayMappingPolicy<TWrapperTraits>
 ::UpdateImagePointer(ImageType *image)
 {
-  // Component wrappers
-  typedef typename WrapperType::ComponentWrapperType ComponentWrapperType;
-
   // Initialize the display slice selectors
   for(unsigned int i=0; i<3; i++)
     m_DisplaySliceSelector[i] = DisplaySliceSelector::New();
@@ -586,17 +627,13 @@ MultiChannelDisplayMappingPolicy<TWrapperTraits>
           m_Wrapper->GetComponentWrapper(0)->GetIntensityCurve());
     m_LUTGenerator->SetIgnoreAlpha(!m_Wrapper->IsSticky());
 
-    // Initialize the filters that apply the LUT
+    // Initialize the filters that apply the LUT. These read the vector slice
+    // of the wrapper directly, rather than a separate slice per component
     for(unsigned int i=0; i<3; i++)
       {
       m_RGBMapper[i] = ApplyLUTFilter::New();
       m_RGBMapper[i]->SetLookupTable(m_LUTGenerator->GetLookupTable());
-
-      for(unsigned int j=0; j<3; j++)
-        {
-        ComponentWrapperType *comp = m_Wrapper->GetComponentWrapper(j);
-        m_RGBMapper[i]->SetInput(j, comp->GetSlice(i));
-        }
+      m_RGBMapper[i]->SetInput(m_Wrapper->GetSlice(i));
 
       // Add this filter as the input to the selector
       m_DisplaySliceSelector[i]->AddSelectableInput(
@@ -962,6 +999,8 @@ public:
   typedef VectorDerivedQuantityImageWrapperTraits<MaxFunctor> MaxWrapperTraits;
   typedef typename VectorToScalarImageAccessorTypes<TPixel>::MeanFunctor MeanFunctor;
   typedef VectorDerivedQuantityImageWrapperTraits<MeanFunctor> MeanWrapperTraits;
+  typedef typename VectorToScalarImageAccessorTypes<TPixel>::JacobianFunctor JacobianFunctor;
+  typedef VectorDerivedQuantityImageWrapperTraits<JacobianFunctor> JacobianWrapperTraits;
 };
 
 #define DisplayMappingPolicyInstantiateMacro(type) \
@@ -970,7 +1009,8 @@ public:
   template class CachingCurveAndColorMapDisplayMappingPolicy<typename DisplayMappingPolicyTypes<type>::ComponentWrapperTraits>; \
   template class CachingCurveAndColorMapDisplayMappingPolicy<typename DisplayMappingPolicyTypes<type>::MagnitudeWrapperTraits>; \
   template class CachingCurveAndColorMapDisplayMappingPolicy<typename DisplayMappingPolicyTypes<type>::MaxWrapperTraits>; \
-  template class CachingCurveAndColorMapDisplayMappingPolicy<typename DisplayMappingPolicyTypes<type>::MeanWrapperTraits>;
+  template class CachingCurveAndColorMapDisplayMappingPolicy<typename DisplayMappingPolicyTypes<type>::MeanWrapperTraits>; \
+  template class CachingCurveAndColorMapDisplayMappingPolicy<typename DisplayMappingPolicyTypes<type>::JacobianWrapperTraits>;
 
 DisplayMappingPolicyInstantiateMacro(unsigned char)
 DisplayMappingPolicyInstantiateMacro(char)
@@ -978,3 +1018,7 @@ DisplayMappingPolicyInstantiateMacro(unsigned short)
 DisplayMappingPolicyInstantiateMacro(short)
 DisplayMappingPolicyInstantiateMacro(float)
 DisplayMappingPolicyInstantiateMacro(double)
+
+// Floating point images stored in compact integral types
+template class CachingCurveAndColorMapDisplayMappingPolicy<AnatomicScalarImageWrapperTraits<short, true> >;
+template class CachingCurveAndColorMapDisplayMappingPolicy<AnatomicScalarImageWrapperTraits<unsigned char, true> >;
@@ -5,6 +5,7 @@
 #include "MeshWrapperBase.h"
 #include "itkDataObject.h"
 #include "itkObjectFactory.h"
+#include "itkVectorImage.h"
 #include "IntensityToColorLookupTableImageFilter.h"
 #include "MultiChannelDisplayMode.h"
 
@@ -177,6 +178,22 @@ public:
   irisITKAbstractObjectMacro(AbstractCachingAndColorMapDisplayMappingPolicy,
                              AbstractContinuousImageDisplayMappingPolicy)
 
+  /**
+   * Parameters needed to apply the intensity curve and the color map to
+   * native intensity slices outside of this policy, i.e., on the GPU. The
+   * domain of the intensity curve is t = Scale * x + Shift, where x is the
+   * native intensity. Voxels equal to NativeZero are drawn as transparent
+   * black when ZeroOutOfRange is set, mirroring the lookup table filters.
+   */
+  struct NativeCurveMapping
+  {
+    double Scale, Shift;
+    double NativeZero;
+    bool ZeroOutOfRange;
+    bool IgnoreAlpha;
+  };
+
+  virtual NativeCurveMapping GetNativeCurveMapping() = 0;
 };
 
 
@@ -229,6 +246,8 @@ public:
 
   virtual TDigest *GetTDigest() override;
 
+  virtual NativeCurveMapping GetNativeCurveMapping() override;
+
   /**
    * Get the display slice in a given direction.  To change the
    * display slice, call parent's MoveToSlice() method
@@ -485,7 +504,8 @@ protected:
   ~MultiChannelDisplayMappingPolicy();
 
   typedef IntensityToColorLookupTableImageFilter<ImageType, VectorToRGBColorMapTraits> GenerateLUTFilter;
-  typedef RGBALookupTableIntensityMappingFilter<InputSliceType> ApplyLUTFilter;
+  typedef itk::VectorImage<InternalPixelType, 2> VectorSliceType;
+  typedef RGBALookupTableIntensityMappingFilter<VectorSliceType> ApplyLUTFilter;
   // typedef itk::Image<unsigned char, 1>                         LookupTableType;
 
 
@@ -52,6 +52,7 @@
 #include "itkSiemensVisionImageIO.h"
 #include "itkVTKImageIO.h"
 #include "itkVoxBoCUBImageIO.h"
+#include "itkZarrImageIO.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkImageSeriesReader.h"
@@ -77,7 +78,21 @@
 
 #include <itk_zlib.h>
 #include "itkImportImageFilter.h"
+#include "itkByteSwapper.h"
+#include "MemoryMappedImageContainer.h"
+#include "MemoryAccounting.h"
+#include "DerivedDataCache.h"
+#include "TaskScheduler.h"
+#include "itksys/SystemTools.hxx"
+#include <fstream>
+#include <cstring>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include "itksys/Base64.h"
 
 
@@ -109,6 +124,7 @@ GuidedNativeImageIO
   {"Siemens Vision", "ima",             false, false, true,  true},
   {"VoxBo CUB", "cub,cub.gz",           true,  false, true,  true},
   {"VTK Image", "vtk",                  true,  false, true,  true},
+  {"OME-Zarr", "zarr",                  false, false, true,  true},
   {"Generic ITK Image", "",             true,  true,  true,  true},
   {"INVALID FORMAT", "",                false, false, false, false}};
 
@@ -259,6 +275,25 @@ void transpose_toms513(R *a, INT nx, INT ny, char *move, INT move_size, R *buf)
     }
 }
 
+/*
+ * Transpose the rows x cols matrix of elements stored in row-major order in
+ * the buffer, in place. Besides the matrix, this only needs (rows + cols) / 2
+ * bytes for the cycle-following algorithm above. The index arithmetic is
+ * unsigned, so that it stays exact for buffers of billions of elements.
+ */
+template <typename TElement>
+void transpose_in_place(TElement *a, size_t rows, size_t cols)
+{
+  if(rows < 2 || cols < 2)
+    return;
+
+  unsigned long long move_size = (rows + cols) / 2;
+  std::vector<char> move(move_size);
+  TElement buf[2];
+  transpose_toms513<TElement, unsigned long long>(
+        a, rows, cols, move.data(), move_size, buf);
+}
+
 bool GuidedNativeImageIO::FileFormatDescriptor
 ::TestFilename(std::string fname)
 {
@@ -413,6 +448,16 @@ GuidedNativeImageIO
 		case FORMAT_SIEMENS:    m_IOBase = itk::SiemensVisionImageIO::New(); break;
 		case FORMAT_VTK:        m_IOBase = itk::VTKImageIO::New();           break;
 		case FORMAT_VOXBO_CUB:  m_IOBase = itk::VoxBoCUBImageIO::New();      break;
+    case FORMAT_ZARR:
+      {
+      // Chunked stores may be far larger than memory. If there is a memory
+      // budget, the finest scale that fits in half of it is read.
+      itk::ZarrImageIO::Pointer zarrIO = itk::ZarrImageIO::New();
+      zarrIO->SetScaleLevel((unsigned int) folder["Zarr.ScaleLevel"][0]);
+      zarrIO->SetMaximumBytes(MemoryAccounting::GetInstance()->GetBudget() / 2);
+      m_IOBase = zarrIO;
+      }
+      break;
 		case FORMAT_DICOM_DIR:
 		case FORMAT_DICOM_DIR_4DCTA:
     case FORMAT_ECHO_CARTESIAN_DICOM:
@@ -879,14 +924,13 @@ GuidedNativeImageIO
     ne *= pcSize[i];
 
   ElementIdType neTP = ne / nt; // # of Elements per Time Point
-  ElementType *bufferMC = new ElementType[ne];
 
-  auto *buffer4D = image4D->GetPixelContainer()->GetBufferPointer();
-
-  // reorder voxels from 4d to multi-component
-  for (ElementIdType i = 0; i < nt; ++i)
-    for (ElementIdType j = 0; j < neTP; ++j)
-      bufferMC[j * nt + i] = buffer4D[i * neTP + j];
+  // reorder voxels from 4d to multi-component, which is a transpose of the
+  // nt x neTP matrix of voxels. This is done in place, so that very large
+  // images do not need a second buffer. These images are never memory-mapped
+  // (see MapNativeImageData), so the buffer can be modified.
+  typename NativeImageType::PixelContainer::Pointer pc = image4D->GetPixelContainer();
+  transpose_in_place<ElementType>(pc->GetBufferPointer(), nt, neTP);
 
 
   // Modify Header
@@ -900,7 +944,7 @@ GuidedNativeImageIO
   auto imageMC = NativeImageType::New();
 
   UpdateImageHeader<NativeImageType>(imageMC);
-  imageMC->GetPixelContainer()->SetImportPointer(bufferMC, ne, true);
+  imageMC->SetPixelContainer(pc);
 
   return imageMC;
 }
@@ -923,14 +967,13 @@ GuidedNativeImageIO
     }
 
   ne = neTP * nc; // # of Elements per Time Point
-  ElementType *buffer4D = new ElementType[ne];
-
-  auto *bufferMC = imageMC->GetPixelContainer()->GetBufferPointer();
+  itkAssertOrThrowMacro(imageMC->GetPixelContainer()->Size() == ne,
+                        "Unexpected buffer size in ConvertMultiComponentLoadTo4D");
 
-  // reorder voxels from multi-component to 4d
-  for (ElementIdType i = 0; i < nc; ++i)
-    for (ElementIdType j = 0; j < neTP; ++j)
-      buffer4D[i * neTP + j] = bufferMC[j * nc + i];
+  // reorder voxels from multi-component to 4d, transposing the neTP x nc
+  // matrix of voxels in place, as in Convert4DLoadToMultiComponent
+  typename NativeImageType::PixelContainer::Pointer pc = imageMC->GetPixelContainer();
+  transpose_in_place<ElementType>(pc->GetBufferPointer(), neTP, nc);
 
   // Modify Header
   // -- backup origin, spacing and direction
@@ -967,7 +1010,7 @@ GuidedNativeImageIO
   auto image4D = NativeImageType::New();
 
   UpdateImageHeader<NativeImageType>(image4D);
-  image4D->GetPixelContainer()->SetImportPointer(buffer4D, ne, true); // imageMC will take care of this memory
+  image4D->SetPixelContainer(pc);
   return image4D;
 }
 
@@ -987,6 +1030,9 @@ GuidedNativeImageIO
 	typedef itk::Image<TScalar, 4> GreyImage4DType;
 	typedef itk::ImageSeriesReader<GreyImageType> SeriesReaderType;
 
+  // Whether only the load region has been read from the file
+  bool region_read = false;
+
   // There is a special handler for the DICOM case!
   if(m_FileFormat == FORMAT_DICOM_DIR && m_DICOMFiles.size() > 1)
     {
@@ -1085,97 +1131,104 @@ GuidedNativeImageIO
     } 
 	else if (m_FileFormat == FORMAT_DICOM_DIR_4DCTA)
 		{
-		typename SeriesReaderType::Pointer reader = SeriesReaderType::New();
-		reader->SetImageIO(m_IOBase);
-
 		SmartPtr<TrivalProgressSource> progSrc = TrivalProgressSource::New();
     progSrc->AddObserverToProgressEvents(progressCmd);
     progSrc->StartProgress(1.0);
 
-		const float weightReading = 0.7, weightLoading = 0.25, weightMisc = 0.05;
-		float readingDelta = weightReading/m_DicomFilesToFrameMap.size();
+		const float weightReading = 0.95, weightMisc = 0.05;
 
-		std::map<unsigned int, typename GreyImageType::Pointer> frameContainer;
-
-		// read image frame by frame
+		// The files of each frame, in the order of the frames
+		std::vector<MFDS::FilenamesList> frames;
 		for (auto &kv : m_DicomFilesToFrameMap)
 			{
 			MFDS::FilenamesList fnlist;
 			for (auto &df : kv.second)
 				fnlist.push_back(df.m_Filename);
-
-			reader->SetFileNames(fnlist);
-			reader->Update();
-
-			typename GreyImageType::Pointer crntImg = GreyImageType::New();
-			DeepCopyImage<GreyImageType>(crntImg, reader->GetOutput());
-			frameContainer[kv.first] = crntImg;
-
-			progSrc->AddProgress(readingDelta);
-			}
-
-		// assemble 3d images into the 4d native image
-		// -- set first 3 dimensions
-		typename GreyImage4DType::PointType origin4d;
-		typename GreyImage4DType::DirectionType direction4d;
-		typename GreyImage4DType::SpacingType spacing4d;
-		typename GreyImage4DType::RegionType region4d;
-
-		auto first3dImg = frameContainer[1];
-
-		for (int i = 0; i < 3; ++i)
-			{
-			origin4d[i] = first3dImg->GetOrigin()[i];
-			for (int j = 0; j < 3; ++j)
-				direction4d(i,j) = first3dImg->GetDirection()(i,j);
-			spacing4d[i] = first3dImg->GetSpacing()[i];
-			region4d.SetIndex(i, first3dImg->GetLargestPossibleRegion().GetIndex()[i]);
-			region4d.SetSize(i, first3dImg->GetLargestPossibleRegion().GetSize()[i]);
+			frames.push_back(fnlist);
 			}
 
-		origin4d[3] = 0;
-
-		// Flip all image to RAS
-		if (first3dImg->GetDirection()(2,2) == 1)
-			direction4d(2,2) = -1;
-
-		direction4d(0,3) = 0;
-		direction4d(1,3) = 0;
-		direction4d(2,3) = 0;
-		direction4d(3,3) = 1;
-
-		spacing4d[3] = 0.05; // hardcode 50ms for now, should be extracted from the images
+		if (frames.empty())
+			throw IRISException("Error: DICOM series not found. No frames were found in the 4D DICOM series.");
 
-		// region Corner Index: [x, x, x, 0], Size: [x, x, x, nt]
-		region4d.SetIndex(3, 0);
-		region4d.SetSize(3, frameContainer.size()); // number of time points
+		// Read the header of the first frame to set up the 4d native image. The
+		// frames are then decoded directly into its buffer
+		typename SeriesReaderType::Pointer reader = SeriesReaderType::New();
+		reader->SetImageIO(m_IOBase);
+		reader->SetFileNames(frames.front());
+		reader->UpdateOutputInformation();
 
 		typename GreyImage4DType::Pointer image4D = GreyImage4DType::New();
-		image4D->SetOrigin(origin4d);
-		image4D->SetDirection(direction4d);
-		image4D->SetSpacing(spacing4d);
-		image4D->SetRegions(region4d);
-		image4D->SetNumberOfComponentsPerPixel(first3dImg->GetNumberOfComponentsPerPixel());
+		Set4DCTAImageHeader(image4D, reader->GetOutput(), frames.size());
 		image4D->Allocate();
 
-		itk::ImageRegionIterator<GreyImage4DType> it4d(image4D, image4D->GetLargestPossibleRegion());
-
-		float loadingDelta = weightLoading/frameContainer.size();
+		size_t frameSize = reader->GetOutput()->GetLargestPossibleRegion().GetNumberOfPixels();
+		TScalar *buffer4D = image4D->GetBufferPointer();
 
-		for (size_t i = 0; i < frameContainer.size(); ++i)
+		// Decode the frames in parallel. Each frame has its own reader and IO
+		// object, and the output of the reader is the part of the 4d buffer
+		// that holds the frame
+		typedef itk::ImportImageContainer<itk::SizeValueType, TScalar> FrameContainerType;
+		std::atomic<size_t> nextFrame(0), framesDone(0);
+		typename SeriesReaderType::Pointer firstFrameReader;
+		auto decode = [&]()
 			{
-			auto crntTP = i + 1;
-			auto crntImg = frameContainer[crntTP];
-
-			itk::ImageRegionConstIterator<GreyImageType> it3d(crntImg, crntImg->GetLargestPossibleRegion());
-			while (!it3d.IsAtEnd())
+			for (size_t f = nextFrame++; f < frames.size(); f = nextFrame++)
 				{
-				it4d.Set(it3d.Get());
-				++it3d;
-				++it4d;
+				try
+					{
+					typename SeriesReaderType::Pointer frameReader = SeriesReaderType::New();
+					frameReader->SetImageIO(itk::GDCMImageIO::New());
+					frameReader->SetFileNames(frames[f]);
+					frameReader->ReleaseDataBeforeUpdateFlagOff();
+
+					TScalar *slot = buffer4D + f * frameSize;
+					typename FrameContainerType::Pointer container = FrameContainerType::New();
+					container->SetImportPointer(slot, frameSize, false);
+					frameReader->GetOutput()->SetPixelContainer(container);
+					frameReader->Update();
+
+					GreyImageType *frame = frameReader->GetOutput();
+					if (frame->GetBufferedRegion().GetNumberOfPixels() != frameSize)
+						throw IRISException("Error: Frames of the 4D DICOM series have different sizes.");
+
+					// In case the reader did not use the container it was given
+					if (frame->GetBufferPointer() != slot)
+						std::copy(frame->GetBufferPointer(), frame->GetBufferPointer() + frameSize, slot);
+
+					if (f == 0)
+						firstFrameReader = frameReader;
+					}
+				catch (...)
+					{
+					// Stop the other workers from taking more frames
+					nextFrame = frames.size();
+					throw;
+					}
+				framesDone++;
+				}
+			};
+
+		size_t nWorkers = std::max(1u, std::thread::hardware_concurrency());
+		nWorkers = std::min(nWorkers, frames.size());
+		std::vector<std::future<void> > workers;
+		for (size_t i = 0; i < nWorkers; i++)
+			workers.push_back(std::async(std::launch::async, decode));
+
+		// Report progress from this thread while the frames are decoded
+		float readingDelta = weightReading / frames.size();
+		size_t framesReported = 0;
+		for (auto &w : workers)
+			{
+			while (w.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready)
+				{
+				for (; framesReported < framesDone; framesReported++)
+					progSrc->AddProgress(readingDelta);
 				}
-			progSrc->AddProgress(loadingDelta);
 			}
+		for (auto &w : workers)
+			w.get();
+		for (; framesReported < frames.size(); framesReported++)
+			progSrc->AddProgress(readingDelta);
 
 		// Convert the image into VectorImage format. Do this in-place to avoid
 		// allocating memory pointlessly
@@ -1186,7 +1239,7 @@ GuidedNativeImageIO
 
 		// Copy the metadata from the first scan in the series
 		const typename SeriesReaderType::DictionaryArrayType *darr =
-			reader->GetMetaDataDictionaryArray();
+			firstFrameReader->GetMetaDataDictionaryArray();
 		if(darr->size() > 0)
 			m_NativeImage->SetMetaDataDictionary(*((*darr)[0]));
 
@@ -1237,8 +1290,6 @@ GuidedNativeImageIO
 				}
 			ecd_org.Fill(0);
 
-			unsigned long len = ecd_dim[0] * ecd_dim[1] * ecd_dim[2] * ecd_dim[3];
-
 			const gdcm::ByteValue *bv = de.GetByteValue();
 
 			// Start loading image
@@ -1259,102 +1310,33 @@ GuidedNativeImageIO
 
 			ecdProgSrc->AddProgress(0.1);
 
-			// -- Extract the buffer from file
-			char *ecd_buffer = (char*)malloc(len);
-			bv->GetBuffer(ecd_buffer, len);
-
-			// -- Pass buffer into ecd_image
-			typedef typename NativeImageType::PixelContainer PixConType;
-			typename PixConType::Pointer pPixCon = PixConType::New();
-			pPixCon->SetImportPointer(reinterpret_cast<TScalar*>(ecd_buffer), len, true);
-			ecd_image->SetPixelContainer(pPixCon);
-
-			ecdProgSrc->AddProgress(0.3);
-
-			// Read and Import Dictionary
-			// -- Choose and import basic information into the metadata dictionary
-
-			// -- Following code segment loading metadata dictionary is from itkGDCMImageIO.cxx
-			// -- Modified to adapt to 4D Echocardiography Cartesian DICOM (ECD) Image
-
-			gdcm::Reader ecd_meta_reader;
-			ecd_meta_reader.SetFileName(FileName);
-			typedef itk::ImageIOBase::SizeValueType SizeValueType;
-			itk::MetaDataDictionary &dico = m_IOBase->GetMetaDataDictionary();
-			gdcm::StringFilter strF;
-			strF.SetFile(ecd_meta_reader.GetFile());
-
-			if (!ecd_meta_reader.ReadUpToTag(data))
-				std::cerr << "Can not read:" << FileName << std::endl;
-			else
+			// -- Copy the frames from the data element straight into the image
+			// buffer, several frames at a time. The element may be shorter than
+			// the header says, in which case the rest of the image is zero
+			size_t frame_bytes = sizeof(TScalar) * ecd_dim[0] * ecd_dim[1] * ecd_dim[2];
+			size_t avail_bytes = bv ? bv->GetLength() : 0;
+			const char *src = bv ? bv->GetPointer() : nullptr;
+			char *trg = reinterpret_cast<char *>(ecd_image->GetBufferPointer());
+			TaskScheduler::GetInstance()->ParallelFor(
+						TaskScheduler::USER_COMPUTE, 0, (long) ecd_dim[3],
+						[=](long first, long last)
 				{
-				const gdcm::File &file = ecd_meta_reader.GetFile();
-				const gdcm::DataSet &ds = file.GetDataSet();
-
-				// Iterate through tags for metadata
-				for (auto it = ds.Begin(); it != ds.End(); ++it)
+				for(long t = first; t < last; t++)
 					{
-
-					const gdcm::DataElement &de = *it;
-					const gdcm::Tag &tag = de.GetTag();
-
-					// Customized reading of following attributes for the non-standard 4D ECD image
-					// -- Depth (z-axis dimension)
-					if (tag == gdcm::Tag(0x3001, 0x1001))
-						{
-						itk::EncapsulateMetaData<std::string>(dico, "Depth", strF.ToString(tag));
-						continue;
-						}
-
-					// -- Delta Z (physical delta in z direction)
-					if (tag == gdcm::Tag(0x3001, 0x1003))
-						{
-						itk::EncapsulateMetaData<std::string>(dico, "Physical Delta Z", strF.ToString(tag));
-						continue;
-						}
-
-					// Otherwise read public tags as normal
-					gdcm::VR vr = gdcm::DataSetHelper::ComputeVR(file, ds, tag);
-
-					if (vr & (gdcm::VR::OB | gdcm::VR::OF | gdcm::VR::OW | gdcm::VR::SQ | gdcm::VR::UN))
-						{
-						// itkAssertInDebugAndIgnoreInReleaseMacro( vr & gdcm::VR::VRBINARY );
-						/*
-						 * Old behavior was to skip SQ, Pixel Data element. I decided that it is not safe to mime64
-						 * VR::UN element. There used to be a bug in gdcm 1.2.0 and VR:UN element.
-						 */
-						if ((tag.IsPublic()) && vr != gdcm::VR::SQ &&
-								tag != gdcm::Tag(0x7fe0, 0x0010) /* && vr != gdcm::VR::UN*/)
-							{
-							const gdcm::ByteValue * bv = de.GetByteValue();
-							if (bv)
-								{
-								// base64 streams have to be a multiple of 4 bytes in length
-								int encodedLengthEstimate = 2 * bv->GetLength();
-								encodedLengthEstimate = ((encodedLengthEstimate / 4) + 1) * 4;
-
-								auto * bin = new char[encodedLengthEstimate];
-								auto   encodedLengthActual =
-									static_cast<unsigned int>(itksysBase64_Encode((const unsigned char *)bv->GetPointer(),
-																																static_cast<SizeValueType>(bv->GetLength()),
-																																(unsigned char *)bin,
-																																static_cast<int>(0)));
-								std::string encodedValue(bin, encodedLengthActual);
-								itk::EncapsulateMetaData<std::string>(dico, tag.PrintAsPipeSeparatedString(), encodedValue);
-								delete[] bin;
-								}
-							}
-						}
-					else /* if ( vr & gdcm::VR::VRASCII ) */
-						{
-						// Only copying field from the public DICOM dictionary
-						if (tag.IsPublic())
-							itk::EncapsulateMetaData<std::string>(dico, tag.PrintAsPipeSeparatedString(), strF.ToString(tag));
-						}
+					size_t offset = t * frame_bytes;
+					size_t n = offset < avail_bytes ? std::min(frame_bytes, avail_bytes - offset) : 0;
+					if(n)
+						memcpy(trg + offset, src + offset, n);
+					if(n < frame_bytes)
+						memset(trg + offset + n, 0, frame_bytes - n);
 					}
-				}
+				});
+
+			ecdProgSrc->AddProgress(0.3);
 
-			ecd_image->SetMetaDataDictionary(dico);
+			// Read and Import Dictionary
+			ReadEchoCartesianDicomMetaData(FileName);
+			ecd_image->SetMetaDataDictionary(m_IOBase->GetMetaDataDictionary());
 
 			m_NativeImage = ecd_image;
 
@@ -1379,12 +1361,52 @@ GuidedNativeImageIO
     typename NativeImageType::Pointer image = NativeImageType::New();
 
     UpdateImageHeader<NativeImageType>(image);
-    image->Allocate();
+
+    // In load region mode, read just the voxels in the region if the IO can
+    // stream them from the file
+    LoadRegionExtent ext;
+    typename NativeImageType::SizeType fsz = image->GetLargestPossibleRegion().GetSize();
+    itk::Size<3> dims3 = {{fsz[0], fsz[1], fsz[2]}};
+    region_read = m_NDimBeforeFolding <= 4 && m_IOBase->CanStreamRead()
+        && this->ComputeLoadRegionExtent(dims3, ext);
+
+    // Map the voxels from the file if possible, otherwise allocate a buffer
+    bool mapped = false;
+    if(!region_read)
+      {
+      bool use_mapping = m_UseMemoryMapping || m_ShareDecodedData
+          || (m_UseMemoryMappingFor4D && m_NativeDimensions[3] > 1);
+      mapped = use_mapping && this->MapNativeImageData<TScalar>(image);
+
+      // Another instance may have decoded this file already
+      if(!mapped && m_ShareDecodedData)
+        mapped = this->MapSharedDecodedData<TScalar>(image, false);
+      if(!mapped)
+        image->Allocate();
+      }
 
     regularImageReadingProgSrc->AddProgress(0.1);
 
-    // Read the image into the buffer
-		m_IOBase->Read(image->GetBufferPointer());
+    // Read the image into the buffer. Large uncompressed files are read in
+    // slabs, so that the progress of the read can be reported
+    size_t n_bytes = image->GetPixelContainer()->Size() * sizeof(TScalar);
+    if(region_read)
+      image = this->ReadNativeRegion<TScalar>(image, ext);
+    else if(!mapped && this->CanReadNativeDataInSlabs(n_bytes))
+      {
+      this->ReadNativeDataInSlabs<TScalar>(image, regularImageReadingProgSrc, 0.8);
+
+      if(m_ShareDecodedData)
+        this->MapSharedDecodedData<TScalar>(image, true);
+      }
+    else if(!mapped)
+      {
+      m_IOBase->Read(image->GetBufferPointer());
+
+      // Let the other instances map the decoded voxels, and map them here too
+      if(m_ShareDecodedData)
+        this->MapSharedDecodedData<TScalar>(image, true);
+      }
 
     // For seq.nrrd, convert the component dimension to the sequence dimension
     if (m_FileFormat == FORMAT_NRRD_SEQ && m_NCompBeforeFolding > 1 &&
@@ -1400,7 +1422,7 @@ GuidedNativeImageIO
 
     m_NativeImage = image;
 
-		regularImageReadingProgSrc->AddProgress(0.9);
+    regularImageReadingProgSrc->EndProgress();
 
 
     // If the image is 4-dimensional or more, we must perform an in-place transpose
@@ -1447,11 +1469,174 @@ GuidedNativeImageIO
   // Disconnect the image from the readers, allowing them to be deleted
   // m_NativeImage->DisconnectPipeline();
 
+  // In load region mode, crop the images that had to be read in full
+  if(m_LoadRegionSet)
+    {
+    NativeImageType *native = dynamic_cast<NativeImageType *>(m_NativeImage.GetPointer());
+    if(native)
+      {
+      LoadRegionExtent ext;
+      typename NativeImageType::SizeType fsz = native->GetBufferedRegion().GetSize();
+      itk::Size<3> dims3 = {{fsz[0], fsz[1], fsz[2]}};
+      if(!region_read && this->ComputeLoadRegionExtent(dims3, ext))
+        m_NativeImage = this->CropNativeRegion<TScalar>(native, ext);
+      }
+
+    // Report the dimensions of the image that was loaded
+    for(unsigned int d = 0; d < 3; d++)
+      m_NativeDimensions[d] = m_NativeImage->GetBufferedRegion().GetSize()[d];
+    }
+
   // Sometimes images have negative voxel spacing, which SNAP does not recognize
+  RegularizeNativeImageSpacing();
+}
+
+void
+GuidedNativeImageIO
+::Set4DCTAImageHeader(
+    itk::ImageBase<4> *image4D, const itk::ImageBase<3> *first3dImg, unsigned int n_frames)
+{
+  // -- set first 3 dimensions
+  itk::ImageBase<4>::PointType origin4d;
+  itk::ImageBase<4>::DirectionType direction4d;
+  itk::ImageBase<4>::SpacingType spacing4d;
+  itk::ImageBase<4>::RegionType region4d;
+
+  for (int i = 0; i < 3; ++i)
+    {
+    origin4d[i] = first3dImg->GetOrigin()[i];
+    for (int j = 0; j < 3; ++j)
+      direction4d(i,j) = first3dImg->GetDirection()(i,j);
+    spacing4d[i] = first3dImg->GetSpacing()[i];
+    region4d.SetIndex(i, first3dImg->GetLargestPossibleRegion().GetIndex()[i]);
+    region4d.SetSize(i, first3dImg->GetLargestPossibleRegion().GetSize()[i]);
+    }
+
+  origin4d[3] = 0;
+
+  // Flip all image to RAS
+  if (first3dImg->GetDirection()(2,2) == 1)
+    direction4d(2,2) = -1;
+
+  direction4d(0,3) = 0;
+  direction4d(1,3) = 0;
+  direction4d(2,3) = 0;
+  direction4d(3,3) = 1;
+
+  spacing4d[3] = 0.05; // hardcode 50ms for now, should be extracted from the images
+
+  // region Corner Index: [x, x, x, 0], Size: [x, x, x, nt]
+  region4d.SetIndex(3, 0);
+  region4d.SetSize(3, n_frames); // number of time points
+
+  image4D->SetOrigin(origin4d);
+  image4D->SetDirection(direction4d);
+  image4D->SetSpacing(spacing4d);
+  image4D->SetRegions(region4d);
+  image4D->SetNumberOfComponentsPerPixel(first3dImg->GetNumberOfComponentsPerPixel());
+}
+
+bool
+GuidedNativeImageIO
+::ReadEchoCartesianDicomMetaData(const char *fname)
+{
+	// The metadata is read up to the pixel data tag
+	const gdcm::Tag data(0x7fe0, 0x0010);
+
+	// -- Choose and import basic information into the metadata dictionary
+
+	// -- Following code segment loading metadata dictionary is from itkGDCMImageIO.cxx
+	// -- Modified to adapt to 4D Echocardiography Cartesian DICOM (ECD) Image
+
+	gdcm::Reader ecd_meta_reader;
+	ecd_meta_reader.SetFileName(fname);
+	typedef itk::ImageIOBase::SizeValueType SizeValueType;
+	itk::MetaDataDictionary &dico = m_IOBase->GetMetaDataDictionary();
+	gdcm::StringFilter strF;
+	strF.SetFile(ecd_meta_reader.GetFile());
+
+	bool ok = ecd_meta_reader.ReadUpToTag(data);
+	if (!ok)
+		std::cerr << "Can not read:" << fname << std::endl;
+	else
+		{
+		const gdcm::File &file = ecd_meta_reader.GetFile();
+		const gdcm::DataSet &ds = file.GetDataSet();
+
+		// Iterate through tags for metadata
+		for (auto it = ds.Begin(); it != ds.End(); ++it)
+			{
+
+			const gdcm::DataElement &de = *it;
+			const gdcm::Tag &tag = de.GetTag();
+
+			// Customized reading of following attributes for the non-standard 4D ECD image
+			// -- Depth (z-axis dimension)
+			if (tag == gdcm::Tag(0x3001, 0x1001))
+				{
+				itk::EncapsulateMetaData<std::string>(dico, "Depth", strF.ToString(tag));
+				continue;
+				}
+
+			// -- Delta Z (physical delta in z direction)
+			if (tag == gdcm::Tag(0x3001, 0x1003))
+				{
+				itk::EncapsulateMetaData<std::string>(dico, "Physical Delta Z", strF.ToString(tag));
+				continue;
+				}
+
+			// Otherwise read public tags as normal
+			gdcm::VR vr = gdcm::DataSetHelper::ComputeVR(file, ds, tag);
+
+			if (vr & (gdcm::VR::OB | gdcm::VR::OF | gdcm::VR::OW | gdcm::VR::SQ | gdcm::VR::UN))
+				{
+				// itkAssertInDebugAndIgnoreInReleaseMacro( vr & gdcm::VR::VRBINARY );
+				/*
+				 * Old behavior was to skip SQ, Pixel Data element. I decided that it is not safe to mime64
+				 * VR::UN element. There used to be a bug in gdcm 1.2.0 and VR:UN element.
+				 */
+				if ((tag.IsPublic()) && vr != gdcm::VR::SQ &&
+						tag != gdcm::Tag(0x7fe0, 0x0010) /* && vr != gdcm::VR::UN*/)
+					{
+					const gdcm::ByteValue * bv = de.GetByteValue();
+					if (bv)
+						{
+						// base64 streams have to be a multiple of 4 bytes in length
+						int encodedLengthEstimate = 2 * bv->GetLength();
+						encodedLengthEstimate = ((encodedLengthEstimate / 4) + 1) * 4;
+
+						auto * bin = new char[encodedLengthEstimate];
+						auto   encodedLengthActual =
+							static_cast<unsigned int>(itksysBase64_Encode((const unsigned char *)bv->GetPointer(),
+																														static_cast<SizeValueType>(bv->GetLength()),
+																														(unsigned char *)bin,
+																														static_cast<int>(0)));
+						std::string encodedValue(bin, encodedLengthActual);
+						itk::EncapsulateMetaData<std::string>(dico, tag.PrintAsPipeSeparatedString(), encodedValue);
+						delete[] bin;
+						}
+					}
+				}
+			else /* if ( vr & gdcm::VR::VRASCII ) */
+				{
+				// Only copying field from the public DICOM dictionary
+				if (tag.IsPublic())
+					itk::EncapsulateMetaData<std::string>(dico, tag.PrintAsPipeSeparatedString(), strF.ToString(tag));
+				}
+			}
+		}
+
+	return ok;
+}
+
+void
+GuidedNativeImageIO
+::RegularizeNativeImageSpacing()
+{
   // Check if voxel spacings need to be regularized
-  typename NativeImageType::DirectionType direction = m_NativeImage->GetDirection();
-  typename NativeImageType::SpacingType spacing = m_NativeImage->GetSpacing();
-  typename NativeImageType::DirectionType factor;
+  ImageBase::DirectionType direction = m_NativeImage->GetDirection();
+  ImageBase::SpacingType spacing = m_NativeImage->GetSpacing();
+  ImageBase::DirectionType factor;
   factor.SetIdentity();
   bool needRegularization = false;
   for (int i = 0; i < 4; ++i)
@@ -1471,6 +1656,403 @@ GuidedNativeImageIO
     }
 }
 
+
+bool
+GuidedNativeImageIO
+::GetNiftiDataOffset(size_t &offset)
+{
+  // Only single-file, uncompressed NIfTI can be mapped
+  std::string fn = itksys::SystemTools::LowerCase(m_NativeFileName);
+  if(fn.size() < 4 || fn.substr(fn.size() - 4) != ".nii")
+    return false;
+
+  // Read the fixed part of the header (sized for NIfTI-2)
+  char hdr[540];
+  std::ifstream ifs(m_NativeFileName.c_str(), std::ios::binary);
+  if(!ifs.read(hdr, sizeof(hdr)) && ifs.gcount() < 348)
+    return false;
+
+  // Get the header size, which also identifies the version. Headers that
+  // are not in the native byte order are not mapped
+  int sizeof_hdr;
+  memcpy(&sizeof_hdr, hdr, sizeof(int));
+
+  // Data that is scaled on read can not be mapped either
+  double slope, inter;
+  if(sizeof_hdr == 348)
+    {
+    float f_offset, f_slope, f_inter;
+    memcpy(&f_offset, hdr + 108, sizeof(float));
+    memcpy(&f_slope, hdr + 112, sizeof(float));
+    memcpy(&f_inter, hdr + 116, sizeof(float));
+    offset = (size_t) f_offset;
+    slope = f_slope; inter = f_inter;
+    }
+  else if(sizeof_hdr == 540 && ifs.gcount() == 540)
+    {
+    long long ll_offset;
+    memcpy(&ll_offset, hdr + 168, sizeof(long long));
+    memcpy(&slope, hdr + 176, sizeof(double));
+    memcpy(&inter, hdr + 184, sizeof(double));
+    offset = (size_t) ll_offset;
+    }
+  else return false;
+
+  return (slope == 0.0 || slope == 1.0) && inter == 0.0 && offset >= (size_t) sizeof_hdr;
+}
+
+template <typename TScalar>
+bool
+GuidedNativeImageIO
+::MapNativeImageData(itk::VectorImage<TScalar, 4> *image)
+{
+  // Only plain scalar images are mapped. Multi-component and higher-dimensional
+  // images are reorganized after reading
+  if(image->GetNumberOfComponentsPerPixel() != 1 || m_NDimBeforeFolding > 4
+     || m_LoadMultiComponentAs4D || m_Load4DAsMultiComponent)
+    return false;
+
+  // The voxels on disk must be in the native byte order
+  bool little = itk::ByteSwapper<TScalar>::SystemIsLittleEndian();
+  if(sizeof(TScalar) > 1 && m_IOBase->GetByteOrder() !=
+     (little ? itk::IOByteOrderEnum::LittleEndian : itk::IOByteOrderEnum::BigEndian))
+    return false;
+
+  // The IO must not be converting the data on the fly
+  size_t n_elements = image->GetLargestPossibleRegion().GetNumberOfPixels();
+  size_t n_bytes = n_elements * sizeof(TScalar);
+  if(m_IOBase->GetImageSizeInBytes() != n_bytes)
+    return false;
+
+  long long file_size = MemoryMappedFileRegion::GetFileSize(m_NativeFileName.c_str());
+  if(file_size < (long long) n_bytes)
+    return false;
+
+  // Find where the data starts in the file
+  size_t offset = 0;
+  if(m_FileFormat == FORMAT_NIFTI)
+    {
+    if(!this->GetNiftiDataOffset(offset))
+      return false;
+    }
+  else if(m_FileFormat == FORMAT_MHA)
+    {
+    // The data must be uncompressed and stored at the end of the .mha file
+    itk::MetaImageIO *mio = dynamic_cast<itk::MetaImageIO *>(m_IOBase.GetPointer());
+    if(!mio || mio->GetMetaImagePointer()->CompressedData()
+       || strcmp(mio->GetMetaImagePointer()->ElementDataFileName(), "LOCAL"))
+      return false;
+    offset = (size_t) (file_size - n_bytes);
+    }
+  else if(m_FileFormat == FORMAT_RAW)
+    {
+    typedef itk::RawImageIO<TScalar, 3> RawIOType;
+    RawIOType *rio = dynamic_cast<RawIOType *>(m_IOBase.GetPointer());
+    if(!rio)
+      return false;
+    offset = rio->GetHeaderSize();
+    }
+  else return false;
+
+  if(offset + n_bytes > (size_t) file_size)
+    return false;
+
+  // Map the data into a pixel container
+  typedef MemoryMappedImageContainer<TScalar> MappedContainer;
+  typename MappedContainer::Pointer pc = MappedContainer::New();
+  if(!pc->MapFile(m_NativeFileName.c_str(), offset, n_elements))
+    return false;
+
+  image->SetPixelContainer(pc);
+  return true;
+}
+
+template <typename TScalar>
+bool
+GuidedNativeImageIO
+::MapSharedDecodedData(itk::VectorImage<TScalar, 4> *image, bool store)
+{
+  // The voxels are shared in the layout they are read in, so images that are
+  // reorganized after reading are not shared
+  if(m_NDimBeforeFolding > 4 || m_LoadMultiComponentAs4D || m_Load4DAsMultiComponent
+     || (m_FileFormat == FORMAT_NRRD_SEQ && m_NCompBeforeFolding > 1))
+    return false;
+
+  // Only regular files have a key, so DICOM series are not shared
+  DerivedDataCache::Key key = DerivedDataCache::ComputeFileKey(m_NativeFileName);
+  if(!key.IsValid())
+    return false;
+
+  // The header describes the voxels, since the same file may be read in
+  // another way by another version of the reader
+  size_t n_elements = image->GetBufferedRegion().GetNumberOfPixels()
+                      * image->GetNumberOfComponentsPerPixel();
+  std::ostringstream oss;
+  oss << m_IOBase->GetComponentTypeAsString(m_IOBase->GetComponentType())
+      << " " << sizeof(TScalar) << " " << image->GetNumberOfComponentsPerPixel();
+  for(unsigned int d = 0; d < 4; d++)
+    oss << " " << image->GetBufferedRegion().GetSize(d);
+  std::string header = oss.str();
+
+  if(store && !DerivedDataCache::WriteBlock(
+       key, "voxels", header, image->GetBufferPointer(), n_elements * sizeof(TScalar)))
+    return false;
+
+  std::string found_header, filename;
+  size_t offset = 0, n_bytes = 0;
+  if(!DerivedDataCache::FindBlock(key, "voxels", found_header, filename, offset, n_bytes)
+     || found_header != header || n_bytes != n_elements * sizeof(TScalar))
+    return false;
+
+  // Map the voxels into a pixel container, which replaces the buffer they
+  // were read into if they were just stored
+  typedef MemoryMappedImageContainer<TScalar> MappedContainer;
+  typename MappedContainer::Pointer pc = MappedContainer::New();
+  if(!pc->MapFile(filename.c_str(), offset, n_elements))
+    return false;
+
+  image->SetPixelContainer(pc);
+  return true;
+}
+
+void
+GuidedNativeImageIO
+::SetLoadRegion(const Vector3i &index, const Vector3i &size, int subsample)
+{
+  m_LoadRegionSet = true;
+  m_LoadRegionIndex = index;
+  m_LoadRegionSize = size;
+  m_LoadRegionSubsample = std::max(subsample, 1);
+}
+
+void
+GuidedNativeImageIO
+::ClearLoadRegion()
+{
+  m_LoadRegionSet = false;
+  m_LoadRegionIndex.fill(0);
+  m_LoadRegionSize.fill(0);
+  m_LoadRegionSubsample = 1;
+}
+
+bool
+GuidedNativeImageIO
+::ComputeLoadRegionExtent(const itk::Size<3> &dims, LoadRegionExtent &ext) const
+{
+  if(!m_LoadRegionSet)
+    return false;
+
+  ext.Step = (unsigned int) m_LoadRegionSubsample;
+  bool whole = (ext.Step == 1);
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    long n = (long) dims[d];
+    long lo = 0, hi = n;
+    if(m_LoadRegionSize[d] > 0)
+      {
+      lo = std::min(std::max((long) m_LoadRegionIndex[d], 0L), n);
+      hi = std::min(lo + (long) m_LoadRegionSize[d], n);
+      }
+
+    if(hi <= lo)
+      throw IRISException("Error: The region to load lies outside of the image. "
+                          "The image has %ld voxels along axis %d.", n, d);
+
+    ext.Start[d] = lo;
+    ext.Size[d] = hi - lo;
+    ext.OutputSize[d] = (ext.Size[d] + ext.Step - 1) / ext.Step;
+    if(lo > 0 || hi < n)
+      whole = false;
+    }
+
+  return !whole;
+}
+
+void
+GuidedNativeImageIO
+::SetLoadRegionImageHeader(
+    itk::ImageBase<4> *image, const itk::ImageBase<4> *full, const LoadRegionExtent &ext)
+{
+  // The first voxel of the region keeps its position in space
+  itk::ImageBase<4>::IndexType corner = full->GetLargestPossibleRegion().GetIndex();
+  for(unsigned int d = 0; d < 3; d++)
+    corner[d] += ext.Start[d];
+
+  itk::ImageBase<4>::PointType origin;
+  full->TransformIndexToPhysicalPoint(corner, origin);
+
+  itk::ImageBase<4>::SpacingType spacing = full->GetSpacing();
+  itk::ImageBase<4>::SizeType size = full->GetLargestPossibleRegion().GetSize();
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    spacing[d] *= ext.Step;
+    size[d] = ext.OutputSize[d];
+    }
+
+  itk::ImageBase<4>::IndexType index = {{0, 0, 0, 0}};
+  itk::ImageBase<4>::RegionType region(index, size);
+
+  image->SetOrigin(origin);
+  image->SetSpacing(spacing);
+  image->SetDirection(full->GetDirection());
+  image->SetMetaDataDictionary(full->GetMetaDataDictionary());
+  image->SetRegions(region);
+}
+
+template <typename TScalar>
+typename itk::VectorImage<TScalar, 4>::Pointer
+GuidedNativeImageIO
+::ReadNativeRegion(const itk::VectorImage<TScalar, 4> *header, const LoadRegionExtent &ext)
+{
+  typedef itk::VectorImage<TScalar, 4> NativeImageType;
+  typename NativeImageType::Pointer image = NativeImageType::New();
+  SetLoadRegionImageHeader(image, header, ext);
+
+  size_t nc = header->GetNumberOfComponentsPerPixel();
+  image->SetVectorLength(nc);
+  image->Allocate();
+
+  // The region is read one slice at a time, skipping the slices between the
+  // ones that are kept. With subsampling, each slice is read into a buffer
+  // and every n-th voxel of every n-th row is kept.
+  size_t nd = std::min(m_NDimBeforeFolding, (size_t) 4);
+  size_t nt = header->GetLargestPossibleRegion().GetSize()[3];
+  size_t sx = ext.Size[0], sy = ext.Size[1], step = ext.Step;
+  std::vector<TScalar> slice(step > 1 ? sx * sy * nc : 0);
+  TScalar *out = image->GetBufferPointer();
+
+  for(size_t t = 0; t < nt; t++)
+    {
+    for(size_t kz = 0; kz < ext.OutputSize[2]; kz++)
+      {
+      itk::ImageIORegion::IndexValueType idx[4] =
+        { ext.Start[0], ext.Start[1], (itk::ImageIORegion::IndexValueType)(ext.Start[2] + kz * step),
+          (itk::ImageIORegion::IndexValueType) t };
+      itk::ImageIORegion::SizeValueType sz[4] = { sx, sy, 1, 1 };
+
+      itk::ImageIORegion ioRegion(nd);
+      for(size_t d = 0; d < nd; d++)
+        {
+        ioRegion.SetIndex(d, idx[d]);
+        ioRegion.SetSize(d, sz[d]);
+        }
+      m_IOBase->SetIORegion(ioRegion);
+
+      if(step == 1)
+        {
+        m_IOBase->Read(out);
+        out += sx * sy * nc;
+        }
+      else
+        {
+        m_IOBase->Read(slice.data());
+        for(size_t ky = 0; ky < ext.OutputSize[1]; ky++)
+          {
+          const TScalar *row = slice.data() + ky * step * sx * nc;
+          for(size_t kx = 0; kx < ext.OutputSize[0]; kx++, out += nc)
+            std::copy(row + kx * step * nc, row + (kx * step + 1) * nc, out);
+          }
+        }
+      }
+    }
+
+  return image;
+}
+
+bool
+GuidedNativeImageIO
+::CanReadNativeDataInSlabs(size_t n_bytes) const
+{
+  if(m_NDimBeforeFolding < 3 || m_NDimBeforeFolding > 4 || !m_IOBase->CanStreamRead()
+     || n_bytes <= 2 * READ_SLAB_BYTES || m_IOBase->GetImageSizeInBytes() != n_bytes)
+    return false;
+
+  // A compressed file is smaller than its voxels
+  long long file_size = MemoryMappedFileRegion::GetFileSize(m_NativeFileName.c_str());
+  return file_size >= (long long) n_bytes;
+}
+
+template <typename TScalar>
+void
+GuidedNativeImageIO
+::ReadNativeDataInSlabs(itk::VectorImage<TScalar, 4> *image,
+                        TrivalProgressSource *progress, double weight)
+{
+  size_t nd = m_NDimBeforeFolding;
+  size_t dims[4] = { 1, 1, 1, 1 };
+  for(size_t d = 0; d < nd; d++)
+    dims[d] = m_IOBase->GetDimensions(d);
+
+  // The slices are stored one after the other in the file and in the buffer
+  size_t n_slices = dims[2] * dims[3];
+  size_t slice_elements = image->GetPixelContainer()->Size() / n_slices;
+  size_t slab = std::max((size_t) 1, READ_SLAB_BYTES / (slice_elements * sizeof(TScalar)));
+  TScalar *out = image->GetBufferPointer();
+
+  itk::ImageIORegion ioRegion(nd);
+  for(size_t t = 0; t < dims[3]; t++)
+    {
+    for(size_t z = 0; z < dims[2]; z += slab)
+      {
+      size_t nz = std::min(slab, dims[2] - z);
+      for(size_t d = 0; d < nd; d++)
+        {
+        ioRegion.SetIndex(d, d == 2 ? z : (d == 3 ? t : 0));
+        ioRegion.SetSize(d, d == 2 ? nz : (d == 3 ? 1 : dims[d]));
+        }
+      m_IOBase->SetIORegion(ioRegion);
+      m_IOBase->Read(out);
+      out += nz * slice_elements;
+
+      progress->AddProgress(weight * nz / n_slices);
+      }
+    }
+
+  // Leave the IO set up to read the whole image
+  for(size_t d = 0; d < nd; d++)
+    {
+    ioRegion.SetIndex(d, 0);
+    ioRegion.SetSize(d, dims[d]);
+    }
+  m_IOBase->SetIORegion(ioRegion);
+}
+
+template <typename TScalar>
+typename itk::VectorImage<TScalar, 4>::Pointer
+GuidedNativeImageIO
+::CropNativeRegion(const itk::VectorImage<TScalar, 4> *input, const LoadRegionExtent &ext)
+{
+  typedef itk::VectorImage<TScalar, 4> NativeImageType;
+  typename NativeImageType::Pointer image = NativeImageType::New();
+  SetLoadRegionImageHeader(image, input, ext);
+
+  size_t nc = input->GetNumberOfComponentsPerPixel();
+  image->SetVectorLength(nc);
+  image->Allocate();
+
+  typename NativeImageType::SizeType dims = input->GetBufferedRegion().GetSize();
+  size_t step = ext.Step;
+  const TScalar *in = input->GetBufferPointer();
+  TScalar *out = image->GetBufferPointer();
+
+  for(size_t t = 0; t < dims[3]; t++)
+    {
+    for(size_t kz = 0; kz < ext.OutputSize[2]; kz++)
+      {
+      size_t z = ext.Start[2] + kz * step;
+      for(size_t ky = 0; ky < ext.OutputSize[1]; ky++)
+        {
+        size_t y = ext.Start[1] + ky * step;
+        const TScalar *row = in + (((t * dims[2] + z) * dims[1] + y) * dims[0] + ext.Start[0]) * nc;
+        for(size_t kx = 0; kx < ext.OutputSize[0]; kx++, out += nc)
+          std::copy(row + kx * step * nc, row + (kx * step + 1) * nc, out);
+        }
+      }
+    }
+
+  return image;
+}
+
 void
 GuidedNativeImageIO
 ::SaveNativeImage(const char *FileName, Registry &folder)
@@ -1513,7 +2095,18 @@ GuidedNativeImageIO
   
   writer->SetFileName(FileName);
   if(m_IOBase)
+    {
     writer->SetImageIO(m_IOBase);
+
+    // The folder may ask for a compression level, e.g., for fast exports
+    if(folder.HasEntry("CompressionLevel"))
+      {
+      int level = folder["CompressionLevel"][-1];
+      writer->SetUseCompression(true);
+      if(level >= 0)
+        writer->SetCompressionLevel(level);
+      }
+    }
   writer->SetInput(image);
   writer->Update();
 }
@@ -1567,6 +2160,92 @@ GuidedNativeImageIO
  * ADAPTER OBJECTS TO CAST NATIVE IMAGE TO GIVEN IMAGE
  ****************************************************************************/
 
+// Values converted one at a time before the conversion goes parallel
+static const size_t CAST_SERIAL_BLOCK = 1 << 16;
+
+/**
+ * Convert n values from src to trg with a functor, in parallel. The two
+ * buffers may be the same memory, in which case values of different sizes
+ * are converted in waves: when the values shrink, a wave starts after the
+ * converted values and only writes over native values that have been read,
+ * and when they grow, going down from the end of the buffer. The inner
+ * loops work on plain pointers with a copy of the functor, so that they
+ * can be vectorized.
+ */
+template <typename TNative, typename TOutput, typename TFunctor>
+void ConvertNativeBuffer(TNative *src, TOutput *trg, size_t n, const TFunctor &functor)
+{
+  auto convert = [src, trg, &functor](long first, long last)
+    {
+    TFunctor f = functor;
+    TNative *pn = src + first;
+    for(TOutput *pt = trg + first; pt < trg + last; pt++, pn++)
+      f(pn, pt);
+    };
+
+  TaskScheduler *ts = TaskScheduler::GetInstance();
+  size_t szNative = sizeof(TNative), szTarget = sizeof(TOutput);
+  if(szNative == szTarget || (void *) src != (void *) trg)
+    {
+    ts->ParallelFor(TaskScheduler::USER_COMPUTE, 0, (long) n, convert);
+    }
+  else if(szTarget < szNative)
+    {
+    // [s, e) may be converted together once [0, s) is done if e * szTarget
+    // <= s * szNative, so the waves grow geometrically
+    size_t s = std::min(n, CAST_SERIAL_BLOCK);
+    convert(0, (long) s);
+    while(s < n)
+      {
+      size_t e = std::min(n, s * szNative / szTarget);
+      ts->ParallelFor(TaskScheduler::USER_COMPUTE, (long) s, (long) e, convert);
+      s = e;
+      }
+    }
+  else
+    {
+    // [e, s) may be converted together once [s, n) is done if e * szTarget
+    // >= s * szNative. The first values are converted in descending order
+    size_t s = n;
+    while(s > CAST_SERIAL_BLOCK)
+      {
+      size_t e = (s * szNative + szTarget - 1) / szTarget;
+      ts->ParallelFor(TaskScheduler::USER_COMPUTE, (long) e, (long) s, convert);
+      s = e;
+      }
+
+    TFunctor f = functor;
+    if(s > 0)
+      for(size_t i = s; i-- > 0; )
+        f(src + i, trg + i);
+    }
+}
+
+/**
+ * Compute the range of the values in a buffer, in parallel
+ */
+template <typename TNative>
+void ComputeNativeBufferRange(const TNative *buffer, size_t n, TNative &vmin, TNative &vmax)
+{
+  std::mutex mutex;
+  vmin = vmax = buffer[0];
+  TaskScheduler::GetInstance()->ParallelFor(
+        TaskScheduler::USER_COMPUTE, 0, (long) n, [&](long first, long last)
+    {
+    TNative lo = buffer[first], hi = buffer[first];
+    for(const TNative *p = buffer + first + 1; p < buffer + last; ++p)
+      {
+      TNative val = *p;
+      lo = val < lo ? val : lo;
+      hi = val > hi ? val : hi;
+      }
+
+    std::lock_guard<std::mutex> guard(mutex);
+    vmin = std::min(vmin, lo);
+    vmax = std::max(vmax, hi);
+    });
+}
+
 template<class TOutputImage>
 typename RescaleNativeImageToIntegralType<TOutputImage>::OutputImageType *
 RescaleNativeImageToIntegralType<TOutputImage>::operator()(
@@ -1713,17 +2392,10 @@ RescaleNativeImageToIntegralType<TOutputImage>
     // Scan over all the image components. Avoid using iterators here because of
     // unnecessary overhead for vector images.
     TNative *ib_begin = input->GetBufferPointer();
-    TNative *ib_end = ib_begin + input->GetPixelContainer()->Size();
-
-    TNative imin_nat = *ib_begin, imax_nat = *ib_begin;
+    size_t ib_size = input->GetPixelContainer()->Size();
 
-    // Iterate over all the components in the input image
-    for(TNative *buffer = ib_begin + 1; buffer < ib_end; ++buffer)
-      {
-      TNative val = *buffer;
-      if(val < imin_nat) imin_nat = val;
-      if(val > imax_nat) imax_nat = val;
-      }
+    TNative imin_nat, imax_nat;
+    ComputeNativeBufferRange(ib_begin, ib_size, imin_nat, imax_nat);
 
     // Cast the values to double
     double imin = static_cast<double>(imin_nat), imax = static_cast<double>(imax_nat);
@@ -1737,16 +2409,24 @@ RescaleNativeImageToIntegralType<TOutputImage>
       bool isint = false;
       if(1.0 * omin <= imin && 1.0 * omax >= imax && ncomp == 1)
         {
-        isint = true;
+        std::atomic<bool> fractional(false);
 
         // Another pass through the image? Why is this necessary?
-        for(TNative *buffer = ib_begin; buffer < ib_end; ++buffer)
+        TaskScheduler::GetInstance()->ParallelFor(
+              TaskScheduler::USER_COMPUTE, 0, (long) ib_size, [&](long first, long last)
           {
-          TNative vin = *buffer;
-          TNative vcmp = static_cast<TNative>(static_cast<OutputComponentType>(vin + 0.5));
-          if(vin != vcmp)
-            { isint = false; break; }
-          }
+          // Chunks that start after a fractional value was found are skipped
+          if(fractional.load(std::memory_order_relaxed))
+            return;
+          for(TNative *buffer = ib_begin + first; buffer < ib_begin + last; ++buffer)
+            {
+            TNative vin = *buffer;
+            TNative vcmp = static_cast<TNative>(static_cast<OutputComponentType>(vin + 0.5));
+            if(vin != vcmp)
+              { fractional = true; return; }
+            }
+          });
+        isint = !fractional;
         }
 
       // If underlying data is really integer, no scale or shift is necessary
@@ -1766,8 +2446,10 @@ RescaleNativeImageToIntegralType<TOutputImage>
         {
         // Compute the scaling factor to map image into output range
 
-        // Does the input range include zero?
-        if(imin <= 0 && imax >= 0)
+        // Does the input range include zero? For an unsigned output type
+        // zero can only map to zero if the input range starts at zero, which
+        // is handled below
+        if(imin <= 0 && imax >= 0 && std::is_signed<OutputComponentType>::value)
           {
           // If so, there will be no shift, allowing zero to map to zero
           scale = std::min((double) omax, -1.0 * (double) omin) * 1.0 / std::max(imax, -imin);
@@ -1907,6 +2589,20 @@ CastNativeImage<TOutputImage,TCastFunctor>
   // Bytes needed to store the data in target format
   size_t nbTarget = input->GetPixelContainer()->Size() * szTarget;
 
+  // Memory-mapped data can not be converted in place, so we convert into a
+  // new buffer. The mapping is released along with the native image
+  unsigned long nval =  nvoxels * ncomp;
+  if(dynamic_cast<MemoryMappedImageContainer<TNative> *>(ipc))
+    {
+    OutputComponentType *ob = new OutputComponentType[nval];
+    ConvertNativeBuffer(ipc->GetImportPointer(), ob, nval, m_Functor);
+
+    SmartPtr<OutPixCon> pc = OutPixCon::New();
+    pc->SetImportPointer(ob, nval, true);
+    m_Output->SetPixelContainer(pc);
+    return;
+    }
+
   // This memory is no longer owned by the input
   ipc->SetContainerManageMemory(false);
 
@@ -1930,22 +2626,9 @@ CastNativeImage<TOutputImage,TCastFunctor>
   // same than the target image, we want to proceed in ascending order, since each
   // input element will be replaced by one or more output elements. But if the
   // native image is smaller, we want to proceed from the end of the memory
-  // block in a descending order, so that the native data is not overridden
-  unsigned long nval =  nvoxels * ncomp;
-  if(szTarget > szNative)
-    {
-    TNative *pn = ib + nval - 1;
-    OutputComponentType *pt = ob + nval - 1;
-    for(; pt >= ob; pt--, pn--)
-      m_Functor(pn, pt);
-    }
-  else
-    {
-    TNative *pn = ib;
-    OutputComponentType *pt = ob;
-    for(; pt < ob + nval; pt++, pn++)
-      m_Functor(pn, pt);
-    }
+  // block in a descending order, so that the native data is not overridden.
+  // The conversion takes care of this while splitting the work among threads
+  ConvertNativeBuffer(ib, ob, nval, m_Functor);
 
   // If needed, squeeze the memory
   if(nbTarget < nbNative)
@@ -1965,6 +2648,14 @@ GuidedNativeImageIO::FileFormat
 GuidedNativeImageIO::GuessFormatForFileName(
     const std::string &fname, bool checkMagic)
 {
+  // Zarr stores are directories, which may be named arbitrarily
+  if(itksys::SystemTools::FileIsDirectory(fname))
+    {
+    itk::ZarrImageIO::Pointer zarrIO = itk::ZarrImageIO::New();
+    if(zarrIO->CanReadFile(fname.c_str()))
+      return FORMAT_ZARR;
+    }
+
   if(checkMagic)
     {
     // Read the first few bytes from the file. We use zlib to automatically
@@ -2067,6 +2758,123 @@ const gdcm::Tag GuidedNativeImageIO::m_tagSliceThickness(0x0018, 0x0050);
 
 #include "gdcmDirectory.h"
 #include "gdcmImageReader.h"
+#include "itkMultiThreaderBase.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+std::string GuidedNativeImageIO::m_DicomHeaderCacheDirectory;
+
+/** Information extracted from the header of a single file in a DICOM directory */
+struct DicomFileHeaderInfo
+{
+  // Whether the file could be read as DICOM
+  bool Valid = false;
+
+  // File modification time and size, used to validate cache entries
+  long MTime = 0;
+  unsigned long Size = 0;
+
+  // Series id from the refined grouping tags and other series information
+  std::string SeriesId, Description, SeriesNumber;
+  int Rows = 0, Columns = 0;
+};
+
+typedef std::map<std::string, DicomFileHeaderInfo> DicomFileHeaderCache;
+
+/** Name of the header cache file for a DICOM directory */
+static std::string GetDicomHeaderCacheFileName(const std::string &dir)
+{
+  // The cache filename is a hash (64-bit FNV-1a) of the directory path
+  std::string path = itksys::SystemTools::CollapseFullPath(dir);
+  itksys::SystemTools::ConvertToUnixSlashes(path);
+  uint64_t hash = 14695981039346656037ull;
+  for(unsigned char c : path)
+    {
+    hash ^= c;
+    hash *= 1099511628211ull;
+    }
+
+  char code[32];
+  snprintf(code, sizeof(code), "%016llx", (unsigned long long) hash);
+  return GuidedNativeImageIO::GetDicomHeaderCacheDirectory() + "/" + code + ".xml";
+}
+
+/** Read the header cache for a DICOM directory, failing quietly */
+static void ReadDicomHeaderCache(const std::string &dir, DicomFileHeaderCache &cache)
+{
+  std::string fn = GetDicomHeaderCacheFileName(dir);
+  if(!itksys::SystemTools::FileExists(fn.c_str(), true))
+    return;
+
+  try
+    {
+    Registry r;
+    r.ReadFromXMLFile(fn.c_str());
+    if(r["Directory"][""] != dir)
+      return;
+
+    int n = r["Files.ArraySize"][0];
+    for(int i = 0; i < n; i++)
+      {
+      Registry &f = r.Folder(r.Key("Files.Entry[%d]", i));
+      DicomFileHeaderInfo &hdr = cache[f["Name"][""]];
+      hdr.Valid = f["Valid"][false];
+      hdr.MTime = std::atol(f["MTime"]["0"]);
+      hdr.Size = std::strtoul(f["Size"]["0"], nullptr, 10);
+      hdr.SeriesId = f["SeriesId"][""];
+      hdr.Description = f["SeriesDescription"][""];
+      hdr.SeriesNumber = f["SeriesNumber"][""];
+      hdr.Rows = f["Rows"][0];
+      hdr.Columns = f["Columns"][0];
+      }
+    }
+  catch(...)
+    {
+    cache.clear();
+    }
+}
+
+/** Write the header cache for a DICOM directory, failing quietly */
+static void WriteDicomHeaderCache(
+    const std::string &dir,
+    const std::vector<std::string> &filenames,
+    const std::vector<DicomFileHeaderInfo> &headers)
+{
+  try
+    {
+    if(!itksys::SystemTools::MakeDirectory(
+         GuidedNativeImageIO::GetDicomHeaderCacheDirectory().c_str()))
+      return;
+
+    Registry r;
+    r["Directory"] << dir;
+    r["Files.ArraySize"] << (int) filenames.size();
+    for(size_t i = 0; i < filenames.size(); i++)
+      {
+      const DicomFileHeaderInfo &hdr = headers[i];
+      Registry &f = r.Folder(r.Key("Files.Entry[%d]", (int) i));
+      f["Name"] << filenames[i];
+      f["Valid"] << hdr.Valid;
+      f["MTime"] << std::to_string(hdr.MTime);
+      f["Size"] << std::to_string(hdr.Size);
+      if(hdr.Valid)
+        {
+        f["SeriesId"] << hdr.SeriesId;
+        f["SeriesDescription"] << hdr.Description;
+        f["SeriesNumber"] << hdr.SeriesNumber;
+        f["Rows"] << hdr.Rows;
+        f["Columns"] << hdr.Columns;
+        }
+      }
+
+    r.WriteToXMLFile(GetDicomHeaderCacheFileName(dir).c_str());
+    }
+  catch(...)
+    {
+    }
+}
 
 void
 GuidedNativeImageIO
@@ -2096,10 +2904,6 @@ GuidedNativeImageIO
   tags_all.insert(m_tagDesc);
   tags_all.insert(m_tagSeriesInstanceUID);
 
-  //--Dev: Add to read list
-  std::set<std::string> sliceLocSet;
-  std::map<std::string, std::set<std::string>> sliceMap;
-
   // Clear the information about the last parse
   m_LastDicomParseResult.Reset();
   m_LastDicomParseResult.Directory = dir;
@@ -2110,12 +2914,29 @@ GuidedNativeImageIO
   // Load the directory - this should be quick
   dirList.Load(dir, false);
   gdcm::Directory::FilenamesType const &filenames = dirList.GetFilenames();
-  for(gdcm::Directory::FilenamesType::const_iterator it = filenames.begin();
-    it != filenames.end(); ++it)
+
+  // Load the headers cached from an earlier parse of this directory
+  bool use_cache = m_DicomHeaderCacheDirectory.length() > 0;
+  DicomFileHeaderCache cache;
+  if(use_cache)
+    ReadDicomHeaderCache(dir, cache);
+
+  // Parse the header of a single file, unless it is in the cache
+  auto parse_header = [&](const std::string &fn, DicomFileHeaderInfo &hdr)
     {
-    // Process each filename in the directory
+    hdr.MTime = itksys::SystemTools::ModifiedTime(fn);
+    hdr.Size = itksys::SystemTools::FileLength(fn);
+
+    auto it_cache = cache.find(fn);
+    if(it_cache != cache.end()
+       && it_cache->second.MTime == hdr.MTime && it_cache->second.Size == hdr.Size)
+      {
+      hdr = it_cache->second;
+      return false;
+      }
+
     gdcm::Reader reader;
-    reader.SetFileName(it->c_str());
+    reader.SetFileName(fn.c_str());
 
     // Try reading this file. Fail quietly.
     bool read = false;
@@ -2123,8 +2944,9 @@ GuidedNativeImageIO
     catch(...) {}
 
     // If nothing read, keep going
+    hdr.Valid = read;
     if(!read)
-      continue;
+      return true;
 
     // Create a string filter to get tags
     gdcm::StringFilter sf;
@@ -2135,7 +2957,7 @@ GuidedNativeImageIO
     std::string full_id = uid;
 
     // Iterate over the tags in the refine list
-		for(size_t iTag = 0u; iTag < tags_refine.size(); iTag++)
+    for(size_t iTag = 0u; iTag < tags_refine.size(); iTag++)
       {
       // Read the tag value
       std::string s = sf.ToString(tags_refine[iTag]);
@@ -2162,9 +2984,61 @@ GuidedNativeImageIO
         }
       }
 
+    hdr.SeriesId = full_id;
+    hdr.Description = sf.ToString(m_tagDesc);
+    hdr.SeriesNumber = sf.ToString(m_tagSeriesNumber);
+    hdr.Rows = std::atoi(sf.ToString(m_tagRows).c_str());
+    hdr.Columns = std::atoi(sf.ToString(m_tagCols).c_str());
+    return true;
+    };
+
+  // The headers are parsed by a pool of threads, since on network file systems
+  // most of the time is spent waiting for the files to be opened
+  std::vector<DicomFileHeaderInfo> headers(filenames.size());
+  std::vector<char> parsed(filenames.size(), 0);
+  std::atomic<size_t> next_file(0);
+  std::atomic<bool> cache_dirty(cache.size() != filenames.size());
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  auto worker = [&]()
+    {
+    for(size_t i = next_file++; i < filenames.size(); i = next_file++)
+      {
+      if(parse_header(filenames[i], headers[i]))
+        cache_dirty = true;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      parsed[i] = 1;
+      cv.notify_one();
+      }
+    };
+
+  size_t n_threads = std::min(
+        (size_t) itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),
+        filenames.size());
+  std::vector<std::thread> threads;
+  for(size_t i = 0; i < n_threads; i++)
+    threads.emplace_back(worker);
+
+  // The parsed headers are added to the result in the order of the directory
+  // listing on this thread, so that the result can be queried on the fly from
+  // the progress callback
+  for(size_t k = 0; k < filenames.size(); k++)
+    {
+      {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&]() { return parsed[k] != 0; });
+      }
+
+    // If nothing read, keep going
+    const DicomFileHeaderInfo &hdr = headers[k];
+    if(!hdr.Valid)
+      continue;
+
     // The info for the current series
     DicomDirectoryParseResult::DicomSeriesInfo &series_info
-        = m_LastDicomParseResult.SeriesMap[full_id];
+        = m_LastDicomParseResult.SeriesMap[hdr.SeriesId];
 
     // The registry for the current series
     Registry &r = series_info.MetaData;
@@ -2172,15 +3046,15 @@ GuidedNativeImageIO
     // Have we found this ID before?
     if(r.IsEmpty())
       {
-      r["SeriesId"] << full_id;
+      r["SeriesId"] << hdr.SeriesId;
 
       // Read series description
-      r["SeriesDescription"] << sf.ToString(m_tagDesc);
-      r["SeriesNumber"] << sf.ToString(m_tagSeriesNumber);
+      r["SeriesDescription"] << hdr.Description;
+      r["SeriesNumber"] << hdr.SeriesNumber;
 
       // Read the dimensions
-      r["Rows"] << std::atoi(sf.ToString(m_tagRows).c_str());
-      r["Columns"] << std::atoi(sf.ToString(m_tagCols).c_str());
+      r["Rows"] << hdr.Rows;
+      r["Columns"] << hdr.Columns;
       r["NumberOfImages"] << 1;
       }
     else
@@ -2195,13 +3069,20 @@ GuidedNativeImageIO
     r["Dimensions"] << oss.str();
 
     // Update the filelist
-    series_info.FileList.push_back(*it);
+    series_info.FileList.push_back(filenames[k]);
 
     // Indicate some progress
     if(progressCommand)
       progressCommand->Execute(this, itk::ProgressEvent());
     }
 
+  for(auto &t : threads)
+    t.join();
+
+  // Store the headers for the next time this directory is parsed
+  if(use_cache && cache_dirty)
+    WriteDicomHeaderCache(dir, filenames, headers);
+
   // Complain if no series have been found
   if(m_LastDicomParseResult.SeriesMap.size() == 0)
     throw IRISException(
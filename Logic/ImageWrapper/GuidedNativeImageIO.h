@@ -52,6 +52,8 @@ namespace itk
   class ImageIOBase;
 }
 
+class TrivalProgressSource;
+
 
 /**
  * \class GuidedNativeImageIO
@@ -73,7 +75,7 @@ public:
     FORMAT_ECHO_CARTESIAN_DICOM, // A Echocardiography Cartesian DICOM
     FORMAT_GE4, FORMAT_GE5, FORMAT_GIPL,
     FORMAT_MHA, FORMAT_MINC, FORMAT_NIFTI, FORMAT_NRRD_SEQ, FORMAT_NRRD, FORMAT_RAW, FORMAT_SIEMENS,
-    FORMAT_VOXBO_CUB, FORMAT_VTK, FORMAT_GENERIC_ITK,
+    FORMAT_VOXBO_CUB, FORMAT_VTK, FORMAT_ZARR, FORMAT_GENERIC_ITK,
     FORMAT_COUNT};
 
   enum RawPixelType {
@@ -270,10 +272,25 @@ public:
    *   - SeriesFiles (an array with filenames)
    *
    * To obtain the result of the parsing call GetLastDicomParseRegistry()
+   *
+   * The file headers are read by multiple threads, and are cached on disk if
+   * a cache directory has been set with SetDicomHeaderCacheDirectory()
    */
   void ParseDicomDirectory(
       const std::string &dir, itk::Command *progressCommand = NULL);
 
+  /**
+   * Set the directory where the headers parsed by ParseDicomDirectory are
+   * cached between sessions. Each cached header is reused as long as the
+   * modification time and size of the file are unchanged. The cache is
+   * disabled if the directory is empty (default).
+   */
+  static void SetDicomHeaderCacheDirectory(const std::string &dir)
+    { m_DicomHeaderCacheDirectory = dir; }
+
+  static const std::string &GetDicomHeaderCacheDirectory()
+    { return m_DicomHeaderCacheDirectory; }
+
   /**
    * Get the result of the last parse operation. This should be safe to
    * call from the callback of progressCommand in ParseDicomDirectory(),
@@ -299,6 +316,68 @@ public:
     m_LoadMultiComponentAs4D = !value;
   }
 
+  /**
+   * When enabled, uncompressed NIfTI (.nii), MetaImage (.mha) and raw images
+   * whose voxels are stored on disk in the in-memory layout are memory-mapped
+   * instead of being read into a buffer. Voxels are then paged in from disk as
+   * they are accessed. If the native type matches the type of the wrapper, the
+   * wrapper keeps the mapped pages as its pixel buffer. The file should not be
+   * overwritten while the image is loaded in this mode.
+   */
+  void SetUseMemoryMapping(bool value)
+    { m_UseMemoryMapping = value; }
+
+  /**
+   * Same as SetUseMemoryMapping, but only applies to images with more than
+   * one time point. Wrappers of mapped 4D images release the pages of time
+   * points that have not been viewed recently, so memory use is bounded by
+   * the time points being looked at rather than the size of the file.
+   */
+  void SetUseMemoryMappingFor4D(bool value)
+    { m_UseMemoryMappingFor4D = value; }
+
+  /**
+   * When enabled, the voxels of an image file are shared with the other
+   * instances of SNAP that open the same file on this host. Files that can
+   * be memory-mapped are mapped, so the instances share the pages of the
+   * file. Other files (e.g., compressed NIfTI) are decoded once, and the
+   * decoded voxels are stored in the derived data cache, from which every
+   * instance maps them. The mappings are copy-on-write, so changes to the
+   * voxels stay private to each instance.
+   */
+  void SetShareDecodedData(bool value)
+    { m_ShareDecodedData = value; }
+
+  /**
+   * Load only a box of voxels from the image file, keeping every n-th voxel
+   * along each axis within the box. This is used to open a downsampled
+   * overview of a very large image, and then to load the structure of
+   * interest at full resolution. Formats whose ImageIO supports streaming
+   * (NIfTI, MetaImage, TIFF, VoxBo, Zarr) read only the voxels in the box
+   * from disk. Other formats are read whole and cropped in memory. The box is
+   * clipped to the image, and a size of zero along an axis keeps the full
+   * extent. The origin and spacing of the loaded image are adjusted so that
+   * it stays aligned with the full image.
+   */
+  void SetLoadRegion(const Vector3i &index, const Vector3i &size, int subsample = 1);
+
+  /** Load the whole image (default) */
+  void ClearLoadRegion();
+
+  /** Whether a load region or a subsampling factor is set */
+  bool IsLoadRegionSet() const
+    { return m_LoadRegionSet; }
+
+  /**
+   * How scalar images with floating point voxels (probability maps, PET)
+   * should be stored by the wrappers created from this IO. By default they
+   * keep the native type, but they can also be quantized to 16 or 8 bit
+   * integers with a linear mapping to the native intensities, which halves
+   * or quarters their memory footprint.
+   */
+  irisSetMacro(FloatImageStorage, FloatImageStorage)
+  irisGetMacro(FloatImageStorage, FloatImageStorage)
+
   /**
    * If header already exists, return it. Otherwise read the header and return it.
    * This is needed because sometimes an io object is passed to a method, and it may not be
@@ -320,6 +399,88 @@ protected:
   /** Templated function that reads a scalar image in its native datatype */
 	template <typename TScalar> void DoReadNative(const char *fname, Registry &folder, itk::Command *ProgressCmd = nullptr);
 
+  /**
+   * Try to memory-map the voxels of the image file into the native image,
+   * returning false if the file is not suitable for mapping
+   */
+  template <typename TScalar> bool MapNativeImageData(itk::VectorImage<TScalar, 4> *image);
+
+  /**
+   * Try to map the decoded voxels of the image file from the derived data
+   * cache into the native image. With store set, the voxels that have just
+   * been read into the image are stored in the cache first, and mapped back
+   * in place of the buffer they were read into.
+   */
+  template <typename TScalar> bool MapSharedDecodedData(itk::VectorImage<TScalar, 4> *image, bool store);
+
+  /** Compute the offset of the voxel data in an uncompressed NIfTI file */
+  bool GetNiftiDataOffset(size_t &offset);
+
+  /** The part of the file read in load region mode */
+  struct LoadRegionExtent
+  {
+    // Box of voxels in the file, and the step between the voxels read
+    itk::Index<3> Start;
+    itk::Size<3> Size;
+    unsigned int Step;
+
+    // Number of voxels along each axis of the loaded image
+    itk::Size<3> OutputSize;
+  };
+
+  /**
+   * Clip the load region to an image of the given size, returning false if
+   * no load region is set or if it covers the whole image at full resolution
+   */
+  bool ComputeLoadRegionExtent(const itk::Size<3> &dims, LoadRegionExtent &ext) const;
+
+  /** Set the geometry of a loaded region, given the geometry of the full image */
+  static void SetLoadRegionImageHeader(
+      itk::ImageBase<4> *image, const itk::ImageBase<4> *full, const LoadRegionExtent &ext);
+
+  /** Read the load region using the streaming interface of the ImageIO */
+  template <typename TScalar>
+  typename itk::VectorImage<TScalar, 4>::Pointer
+  ReadNativeRegion(const itk::VectorImage<TScalar, 4> *header, const LoadRegionExtent &ext);
+
+  /**
+   * Whether the voxels can be read from the file a few slices at a time,
+   * i.e., the IO can stream and the file is not compressed (streaming from a
+   * compressed file decompresses it from the start for every slab)
+   */
+  bool CanReadNativeDataInSlabs(size_t n_bytes) const;
+
+  /**
+   * Read all of the voxels into the buffer of the image a few slices at a
+   * time, adding progress to the source after each slab
+   */
+  template <typename TScalar>
+  void ReadNativeDataInSlabs(itk::VectorImage<TScalar, 4> *image,
+                             TrivalProgressSource *progress, double weight);
+
+  // Size of the slabs read by ReadNativeDataInSlabs
+  static constexpr size_t READ_SLAB_BYTES = 16ul << 20;
+
+  /** Extract the load region from an image read in full */
+  template <typename TScalar>
+  typename itk::VectorImage<TScalar, 4>::Pointer
+  CropNativeRegion(const itk::VectorImage<TScalar, 4> *image, const LoadRegionExtent &ext);
+
+  /*
+   * The following steps of DoReadNative do not depend on the pixel type, and
+   * are kept out of the template so that they are compiled only once
+   */
+
+  /** Set the header of a 4D CTA image from its first frame and number of frames */
+  static void Set4DCTAImageHeader(
+      itk::ImageBase<4> *image4D, const itk::ImageBase<3> *first, unsigned int n_frames);
+
+  /** Read the metadata of a 4D Echocardiography Cartesian DICOM into m_IOBase */
+  bool ReadEchoCartesianDicomMetaData(const char *fname);
+
+  /** Make negative voxel spacings of the native image positive */
+  void RegularizeNativeImageSpacing();
+
   /** Templated function that reads a scalar image in its native datatype */
   template <typename TScalar> void DoSaveNative(const char *fname, Registry &folder);
 
@@ -453,10 +614,28 @@ protected:
   static const gdcm::Tag m_tagSequenceName;
   static const gdcm::Tag m_tagSliceThickness;
 
+  /** Location of the DICOM header cache */
+  static std::string m_DicomHeaderCacheDirectory;
+
   /** Flags for delegate specific configurations */
   bool m_LoadMultiComponentAs4D = false;
   bool m_Load4DAsMultiComponent = false;
 
+  /** Whether uncompressed images may be memory-mapped */
+  bool m_UseMemoryMapping = false;
+  bool m_UseMemoryMappingFor4D = false;
+
+  /** Whether decoded voxels are shared with other instances */
+  bool m_ShareDecodedData = false;
+
+  /** Box of voxels to load and subsampling factor, see SetLoadRegion */
+  bool m_LoadRegionSet = false;
+  Vector3i m_LoadRegionIndex = Vector3i(0), m_LoadRegionSize = Vector3i(0);
+  int m_LoadRegionSubsample = 1;
+
+  /** In-memory storage of floating point scalar images */
+  FloatImageStorage m_FloatImageStorage = FLOAT_STORAGE_NATIVE;
+
 };
 
 
@@ -71,10 +71,15 @@
 #include "RLEImageRegionConstIterator.h"
 #include "TDigestImageFilter.h"
 #include "AllPurposeProgressAccumulator.h"
+#include "MemoryMappedImageContainer.h"
+#include "FastAffineResampleImageFilter.h"
+#include "SNAPEventListenerCallbacks.h"
 
 #include <vnl/vnl_inverse.h>
 #include <iostream>
 #include <cassert>
+#include <chrono>
+#include <algorithm>
 
 #include <itksys/SystemTools.hxx>
 
@@ -117,6 +122,93 @@ void CopyInformationFrom4DToTimePoint(Image4DType *image_4d, ImageType *image_tp
   image_tp->SetNumberOfComponentsPerPixel(image_4d->GetNumberOfComponentsPerPixel());
 }
 
+/**
+ The region of a time point of a 4D image
+ */
+template <class Image4DType>
+itk::ImageRegion<3> GetTimePointRegion(const Image4DType *image_4d)
+{
+  itk::ImageRegion<3> region;
+  for(unsigned int j = 0; j < 3; j++)
+    {
+    region.SetSize(j, image_4d->GetBufferedRegion().GetSize()[j]);
+    region.SetIndex(j, image_4d->GetBufferedRegion().GetIndex()[j]);
+    }
+  return region;
+}
+
+/**
+ Find the bounding box of the rows (lines along x) of a time point that differ
+ between two buffers of the same size. Each row holds row_length consecutive
+ elements, and the rows of a time point are stored one z slice after another.
+ The slices are compared in parallel. Returns false if no row differs.
+ */
+template <class TElement>
+bool FindChangedRowRegion(const TElement *current, const TElement *incoming,
+                          const itk::ImageRegion<3> &buffered, size_t row_length,
+                          itk::ImageRegion<3> &changed)
+{
+  long ny = buffered.GetSize()[1], nz = buffered.GetSize()[2];
+  std::vector<long> y_first(nz, ny), y_last(nz, -1);
+  TaskScheduler::GetInstance()->ParallelFor(
+        TaskScheduler::USER_COMPUTE, 0, nz, [&](long z0, long z1)
+    {
+    for(long z = z0; z < z1; z++)
+      {
+      for(long y = 0; y < ny; y++)
+        {
+        size_t offset = (z * ny + y) * row_length;
+        if(!std::equal(current + offset, current + offset + row_length, incoming + offset))
+          {
+          y_first[z] = std::min(y_first[z], y);
+          y_last[z] = y;
+          }
+        }
+      }
+    });
+
+  long y0 = ny, y1 = -1, z0 = nz, z1 = -1;
+  for(long z = 0; z < nz; z++)
+    {
+    if(y_last[z] < 0)
+      continue;
+    y0 = std::min(y0, y_first[z]);
+    y1 = std::max(y1, y_last[z]);
+    z0 = std::min(z0, z);
+    z1 = z;
+    }
+
+  if(z1 < 0)
+    return false;
+
+  changed = buffered;
+  changed.SetIndex(1, buffered.GetIndex()[1] + y0);
+  changed.SetIndex(2, buffered.GetIndex()[2] + z0);
+  changed.SetSize(1, y1 - y0 + 1);
+  changed.SetSize(2, z1 - z0 + 1);
+  return true;
+}
+
+/**
+ Copy the rows of a region found by FindChangedRowRegion from one buffer to
+ the other
+ */
+template <class TElement>
+void CopyRowRegion(TElement *current, const TElement *incoming,
+                   const itk::ImageRegion<3> &buffered, size_t row_length,
+                   const itk::ImageRegion<3> &changed)
+{
+  long ny = buffered.GetSize()[1];
+  long y0 = changed.GetIndex()[1] - buffered.GetIndex()[1];
+  long z0 = changed.GetIndex()[2] - buffered.GetIndex()[2];
+  for(long z = z0; z < z0 + (long) changed.GetSize()[2]; z++)
+    {
+    size_t offset = (z * ny + y0) * row_length;
+    size_t length = changed.GetSize()[1] * row_length;
+    std::copy(incoming + offset, incoming + offset + length, current + offset);
+    }
+}
+
 
 /* ================================================================================
  * IMAGE-LEVEL PARTIAL SPECIALIZATION CODE
@@ -239,6 +331,55 @@ public:
                         image_4d->GetNameOfClass());
   }
 
+  static bool MaterializeDerivedQuantity(Image4DType *image_4d, itk::Object *itkNotUsed(source))
+  {
+    throw IRISException("MaterializeDerivedQuantity unsupported for class %s",
+                        image_4d->GetNameOfClass());
+    return false;
+  }
+
+  // Releasing memory is optional, so this is not an error
+  static bool ReleaseTimePointData(Image4DType *itkNotUsed(image_4d), unsigned int itkNotUsed(tp))
+  {
+    return false;
+  }
+
+  // Image adaptors hold no data of their own, they share the source buffer
+  static void AddBufferMemoryUsage(Image4DType *itkNotUsed(image_4d),
+                                   MemoryAccounting::Usage &itkNotUsed(usage))
+  {
+  }
+
+  // Sharing the storage of repeated data is optional
+  static void ShareRepeatedData(Image4DType *itkNotUsed(image_4d))
+  {
+  }
+
+  // Without direct access to the voxels, images are replaced as a whole
+  static bool CanUpdateTimePointsInPlace(Image4DType *itkNotUsed(image_4d))
+  {
+    return false;
+  }
+
+  static bool FindChangedTimePointRegion(Image4DType *image_4d,
+                                         Image4DType *itkNotUsed(source),
+                                         unsigned int itkNotUsed(tp),
+                                         itk::ImageRegion<3> &itkNotUsed(region))
+  {
+    throw IRISException("FindChangedTimePointRegion unsupported for class %s",
+                        image_4d->GetNameOfClass());
+    return true;
+  }
+
+  static void CopyTimePointRegion(Image4DType *image_4d,
+                                  Image4DType *itkNotUsed(source),
+                                  unsigned int itkNotUsed(tp),
+                                  const itk::ImageRegion<3> &itkNotUsed(region))
+  {
+    throw IRISException("CopyTimePointRegion unsupported for class %s",
+                        image_4d->GetNameOfClass());
+  }
+
   static PatchOffsetTable GetPatchOffsetTable(TImage *image, const itk::Size<3> &)
   {
     throw IRISException("GetPatchOffsetTable unsupported for class %s", image->GetNameOfClass());
@@ -343,6 +484,43 @@ public:
             element_product((to_double(vROIIndex) - 0.5), vOldSpacing) +
             vNewSpacing * 0.5);
 
+      // Nearest neighbor and linear resampling with an affine transform is
+      // done by the fast resampler, which steps through the input along each
+      // output line instead of transforming each voxel
+      if constexpr (ImageType::ImageDimension == 3)
+        {
+        typedef itk::MatrixOffsetTransformBase<double, 3, 3> AffineTransformType;
+        const AffineTransformType *affine = dynamic_cast<const AffineTransformType *>(transform);
+        InterpolationMethod method = roi.GetInterpolationMethod();
+        if(affine && (method == NEAREST_NEIGHBOR || method == TRILINEAR))
+          {
+          typedef FastAffineResampleImageFilter<ImageType, ImageType> FastFilterType;
+          typename FastFilterType::Pointer fltFast = FastFilterType::New();
+          fltFast->SetInput(image);
+          fltFast->SetTransform(affine);
+          fltFast->SetUseNearestNeighbor(method == NEAREST_NEIGHBOR);
+
+          typename FastFilterType::SpacingType spacing;
+          typename FastFilterType::PointType origin;
+          for(unsigned int d = 0; d < 3; d++)
+            {
+            spacing[d] = vNewSpacing[d];
+            origin[d] = vNewOrigin[d];
+            }
+
+          fltFast->SetSize(to_itkSize(roi.GetResampleDimensions()));
+          fltFast->SetOutputSpacing(spacing);
+          fltFast->SetOutputOrigin(origin);
+          fltFast->SetOutputDirection(refspace->GetDirection());
+
+          if(progressCommand)
+            fltFast->AddObserver(itk::AnyEvent(),progressCommand);
+
+          fltFast->Update();
+          return fltFast->GetOutput();
+          }
+        }
+
       // Create a filter for resampling the image
       typedef itk::ResampleImageFilter<ImageType,ImageType> ResampleFilterType;
       typename ResampleFilterType::Pointer fltSample = ResampleFilterType::New();
@@ -414,6 +592,69 @@ public:
     image_4d->SetPixelContainer(container);
   }
 
+  static bool ReleaseTimePointData(Image4DType *image_4d, unsigned int tp)
+  {
+    // Only memory-mapped data can be released, since it can be read back
+    typedef MemoryMappedImageContainer<InternalPixelType> MappedContainer;
+    MappedContainer *mpc = dynamic_cast<MappedContainer *>(image_4d->GetPixelContainer());
+    if(!mpc)
+      return false;
+
+    unsigned int nt = image_4d->GetBufferedRegion().GetSize()[TImage::ImageDimension];
+    size_t elements_per_volume = mpc->Size() / nt;
+    mpc->ReleaseElements(elements_per_volume * tp, elements_per_volume);
+    return true;
+  }
+
+  // Memory-mapped voxels may be read back from the file after it has changed
+  static bool CanUpdateTimePointsInPlace(Image4DType *image_4d)
+  {
+    typedef MemoryMappedImageContainer<InternalPixelType> MappedContainer;
+    return dynamic_cast<MappedContainer *>(image_4d->GetPixelContainer()) == nullptr;
+  }
+
+  // Rows of a time point hold the components of consecutive voxels along x
+  static size_t GetTimePointRowLength(Image4DType *image_4d, const itk::ImageRegion<3> &buffered)
+  {
+    unsigned int nt = image_4d->GetBufferedRegion().GetSize()[TImage::ImageDimension];
+    return image_4d->GetPixelContainer()->Size() / (nt * buffered.GetSize()[1] * buffered.GetSize()[2]);
+  }
+
+  static bool FindChangedTimePointRegion(Image4DType *image_4d, Image4DType *source,
+                                         unsigned int tp, itk::ImageRegion<3> &region)
+  {
+    itk::ImageRegion<3> buffered = GetTimePointRegion(image_4d);
+    size_t row_length = GetTimePointRowLength(image_4d, buffered);
+    size_t offset = tp * buffered.GetSize()[1] * buffered.GetSize()[2] * row_length;
+    return FindChangedRowRegion(image_4d->GetBufferPointer() + offset,
+                                source->GetBufferPointer() + offset,
+                                buffered, row_length, region);
+  }
+
+  static void CopyTimePointRegion(Image4DType *image_4d, Image4DType *source,
+                                  unsigned int tp, const itk::ImageRegion<3> &region)
+  {
+    itk::ImageRegion<3> buffered = GetTimePointRegion(image_4d);
+    size_t row_length = GetTimePointRowLength(image_4d, buffered);
+    size_t offset = tp * buffered.GetSize()[1] * buffered.GetSize()[2] * row_length;
+    CopyRowRegion(image_4d->GetBufferPointer() + offset,
+                  source->GetBufferPointer() + offset,
+                  buffered, row_length, region);
+  }
+
+  static void AddBufferMemoryUsage(Image4DType *image_4d, MemoryAccounting::Usage &usage)
+  {
+    // Memory-mapped data is backed by the file and can be paged out
+    typedef MemoryMappedImageContainer<InternalPixelType> MappedContainer;
+    typename Image4DType::PixelContainer *pc = image_4d->GetPixelContainer();
+    if(!pc)
+      return;
+
+    MemoryAccounting::Category cat = dynamic_cast<MappedContainer *>(pc)
+        ? MemoryAccounting::MAPPED_IMAGE_DATA : MemoryAccounting::IMAGE_DATA;
+    usage.Bytes[cat] += pc->Capacity() * sizeof(InternalPixelType);
+  }
+
   static PatchOffsetTable GetPatchOffsetTable(TImage *image, const itk::Size<3> &radius)
   {
     // Create an iterator over the output image
@@ -649,6 +890,60 @@ public:
     image->FillBuffer(p);
   }
 
+  static void AddBufferMemoryUsage(Image4DType *image_4d, MemoryAccounting::Usage &usage)
+  {
+    // The buffer is an image of lines, each referring to a vector of runs
+    // that may be shared with other lines. Each line is charged its share of
+    // the runs, so that shared runs are counted once overall
+    typedef typename Image4DType::BufferType BufferType;
+    typedef typename Image4DType::RLLine RLLine;
+    BufferType *buffer = image_4d->GetBuffer();
+    if(!buffer || !buffer->GetPixelContainer())
+      return;
+
+    size_t n_lines = buffer->GetPixelContainer()->Size();
+    double bytes = buffer->GetPixelContainer()->Capacity() * sizeof(RLLine);
+    const RLLine *lines = buffer->GetBufferPointer();
+    for(size_t i = 0; i < n_lines; i++)
+      if(lines[i].capacity())
+        bytes += lines[i].capacity() * sizeof(typename RLLine::value_type)
+            / (double) lines[i].GetNumberOfReferences();
+    usage.Bytes[MemoryAccounting::IMAGE_DATA] += (size_t) bytes;
+  }
+
+  // Identical lines of the time points and single-valued lines share runs
+  static void ShareRepeatedData(Image4DType *image_4d)
+  {
+    image_4d->ShareRepeatedLines();
+  }
+
+  static bool CanUpdateTimePointsInPlace(Image4DType *itkNotUsed(image_4d))
+  {
+    return true;
+  }
+
+  // Each row is a single run-length encoded line. Copying a line only refers
+  // to the runs of the source line
+  static bool FindChangedTimePointRegion(Image4DType *image_4d, Image4DType *source,
+                                         unsigned int tp, itk::ImageRegion<3> &region)
+  {
+    itk::ImageRegion<3> buffered = GetTimePointRegion(image_4d);
+    size_t offset = tp * buffered.GetSize()[1] * buffered.GetSize()[2];
+    return FindChangedRowRegion(image_4d->GetBuffer()->GetBufferPointer() + offset,
+                                source->GetBuffer()->GetBufferPointer() + offset,
+                                buffered, 1, region);
+  }
+
+  static void CopyTimePointRegion(Image4DType *image_4d, Image4DType *source,
+                                  unsigned int tp, const itk::ImageRegion<3> &region)
+  {
+    itk::ImageRegion<3> buffered = GetTimePointRegion(image_4d);
+    size_t offset = tp * buffered.GetSize()[1] * buffered.GetSize()[2];
+    CopyRowRegion(image_4d->GetBuffer()->GetBufferPointer() + offset,
+                  source->GetBuffer()->GetBufferPointer() + offset,
+                  buffered, 1, region);
+  }
+
   template <class TSavedImage> static void Write(TSavedImage *image, const char *fname, Registry &hints)
   {
     //use specialized RoI filter to convert to itk::Image
@@ -673,6 +968,134 @@ public:
     writer->Update();
   }
 
+  /**
+   * Nearest neighbor resampling of a run-length encoded image with an affine
+   * transform that maps each output line onto a single input line, stepping
+   * forward along it. In that case each output line is built directly from
+   * the runs of the input line, with the output length of each run computed
+   * in closed form, so the image is never decompressed. Returns NULL if
+   * the transform does not keep the lines aligned.
+   */
+  static SmartPtr<ImageType> ResampleRunsNearestNeighbor(
+      ImageType *image,
+      const itk::MatrixOffsetTransformBase<double, 3, 3> *transform,
+      const itk::Size<3> &size,
+      const Vector3d &spacing,
+      const Vector3d &origin,
+      const typename ImageType::DirectionType &direction)
+  {
+    typedef vnl_matrix_fixed<double, 3, 3> MatrixType;
+    typedef vnl_vector_fixed<double, 3> VectorType;
+    typedef typename ImageType::RLLine RLLine;
+    typedef typename ImageType::BufferType BufferType;
+
+    // Map from output index to input continuous index, as in the
+    // FastAffineResampleImageFilter
+    MatrixType out_ds = direction.GetVnlMatrix();
+    for(unsigned int j = 0; j < 3; j++)
+      out_ds.set_column(j, out_ds.get_column(j) * spacing[j]);
+
+    MatrixType in_ds = image->GetDirection().GetVnlMatrix();
+    for(unsigned int j = 0; j < 3; j++)
+      in_ds.set_column(j, in_ds.get_column(j) * image->GetSpacing()[j]);
+    MatrixType in_ds_inv = vnl_inverse(in_ds);
+
+    VectorType in_origin, tran_offset;
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      in_origin[d] = image->GetOrigin()[d];
+      tran_offset[d] = transform->GetOffset()[d];
+      }
+
+    MatrixType A = transform->GetMatrix().GetVnlMatrix();
+    MatrixType M = in_ds_inv * A * out_ds;
+    VectorType b = in_ds_inv * (A * origin + tran_offset - in_origin);
+
+    // Output lines must run forward along input lines
+    const double eps = 1e-6;
+    double step = M(0,0);
+    if(step < eps || std::fabs(M(1,0)) > eps || std::fabs(M(2,0)) > eps)
+      return NULL;
+
+    // Make the index relative to the buffered region of the input
+    typename ImageType::RegionType rIn = image->GetBufferedRegion();
+    for(unsigned int d = 0; d < 3; d++)
+      b[d] -= rIn.GetIndex(d);
+
+    // Create the output image, initialized to zero
+    SmartPtr<ImageType> output = ImageType::New();
+    typename ImageType::RegionType rOut;
+    rOut.SetSize(size);
+    output->SetRegions(rOut);
+    typename ImageType::SpacingType outSpacing;
+    typename ImageType::PointType outOrigin;
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      outSpacing[d] = spacing[d];
+      outOrigin[d] = origin[d];
+      }
+    output->SetSpacing(outSpacing);
+    output->SetOrigin(outOrigin);
+    output->SetDirection(direction);
+    output->Allocate();
+
+    const BufferType *inBuffer = image->GetBuffer();
+    long nyIn = rIn.GetSize(1), nzIn = rIn.GetSize(2);
+    long nx = size[0];
+
+    output->ParallelForEachLine(rOut,
+      [&](RLLine &line, const typename ImageType::IndexType &idx)
+      {
+      // Input continuous index of the first voxel of the line
+      double cix[3];
+      for(unsigned int d = 0; d < 3; d++)
+        cix[d] = b[d] + M(d,1) * idx[1] + M(d,2) * idx[2];
+
+      // Lines that fall outside of the input keep their zero fill
+      long y = (long) std::floor(cix[1] + 0.5), z = (long) std::floor(cix[2] + 0.5);
+      if(y < 0 || y >= nyIn || z < 0 || z >= nzIn)
+        return;
+
+      // The first output voxel that rounds to input x >= e
+      double x0 = cix[0];
+      auto first = [&](long e) -> long
+        {
+        double t = std::ceil((e - 0.5 - x0) / step);
+        return t <= 0.0 ? 0 : (t >= nx ? nx : (long) t);
+        };
+
+      RLLine out;
+      auto append = [&out](PixelType value, long count)
+        {
+        if(count <= 0)
+          return;
+        if(out.size() && out.back().second == value)
+          out.back().first += count;
+        else
+          out.push_back(std::make_pair(count, value));
+        };
+
+      typename BufferType::IndexType bi;
+      bi[0] = y; bi[1] = z;
+      const RLLine &in = inBuffer->GetPixel(bi);
+
+      long i = first(0), xe = 0;
+      append(PixelType(0), i);
+      for(const auto &seg : in)
+        {
+        xe += seg.first;
+        long i_end = first(xe);
+        append(seg.second, i_end - i);
+        i = i_end;
+        }
+      append(PixelType(0), nx - i);
+
+      line.swap(out);
+      });
+
+    return output;
+  }
+
   template <class TInterpolateFunction>
   static SmartPtr<ImageType> DeepCopyImageRegion(
       ImageType *image,
@@ -711,6 +1134,22 @@ public:
               element_product((to_double(vROIIndex) - 0.5), vOldSpacing) +
               vNewSpacing * 0.5);
 
+          // Nearest neighbor resampling that keeps the lines aligned is done
+          // on the runs directly, without decompressing the image
+          if constexpr (VDim == 3)
+            {
+            typedef itk::MatrixOffsetTransformBase<double, 3, 3> AffineTransformType;
+            const AffineTransformType *affine = dynamic_cast<const AffineTransformType *>(transform);
+            if(affine && roi.GetInterpolationMethod() == NEAREST_NEIGHBOR)
+              {
+              SmartPtr<ImageType> result = ResampleRunsNearestNeighbor(
+                    image, affine, to_itkSize(roi.GetResampleDimensions()),
+                    vNewSpacing, vNewOrigin, ref_space->GetDirection());
+              if(result)
+                return result;
+              }
+            }
+
           //use specialized RoI filter to convert the region to be resampled to itk::Image
           typedef itk::RegionOfInterestImageFilter<ImageType, UncompressedType> outConverterType;
           typename outConverterType::Pointer outConv = outConverterType::New();
@@ -892,6 +1331,12 @@ public:
   {
     img->GetPixelAccessor().SetSourceNativeMapping(scale, shift);
   }
+
+  static bool MaterializeDerivedQuantity(ImageAdaptor4DType *img, itk::Object *source)
+  {
+    return img->GetPixelAccessor().Materialize(
+          source, img->GetBufferPointer(), img->GetBufferedRegion().GetNumberOfPixels());
+  }
 };
 
 
@@ -965,14 +1410,21 @@ ImageWrapper<TTraits>
   // Initialize the t-digest filter
   m_TDigestFilter = TDigestFilterType::New();
 
+  // Keep track of display mapping changes for the thumbnail cache
+  AddListener(this, WrapperDisplayMappingChangeEvent(), this, &Self::OnDisplayMappingChange);
+
   // Update the image geometry to default value
   this->UpdateImageGeometry();
+
+  // Report memory usage once the wrapper is fully constructed
+  this->RegisterMemoryUsage();
 }
 
 template<class TTraits>
 ImageWrapper<TTraits>
 ::~ImageWrapper()
 {
+  m_MemoryRegistration.Reset();
   Reset();
   delete m_IOHints;
 }
@@ -1024,17 +1476,60 @@ void
 ImageWrapper<TTraits>
 ::SetDirectionMatrix(const vnl_matrix<double> &direction)
 {
-  // Update the direction matrix in the image
+  // Update the direction matrix in the image. When the image is its own
+  // reference space, the direction goes into the header of each time point,
+  // so that the time point selection keeps it when it runs again
   typename ImageType::DirectionType matrix(direction);
-  m_ReferenceSpace->SetDirection(matrix);
+  if(m_ReferenceSpace == m_ImageBase)
+    this->SetImageHeaderDirection(matrix);
+  else
+    m_ReferenceSpace->SetDirection(matrix);
 
-  // Update the NIFTI/RAS transform
+  // Only the coordinate transforms and the slicers need updating, the voxels
+  // are the same
   this->UpdateNiftiTransforms();
-
-  // Update the image geometry
   this->UpdateImageGeometry();
 }
 
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::SetImageHeaderDirection(const typename ImageType::DirectionType &direction)
+{
+  // The prefetch thread and the pyramid build may be reading the headers. A
+  // pyramid that is still being built would also get the old header
+  this->ResetTimePointSliceCache();
+  if constexpr(MULTIRES_SUPPORTED)
+    {
+    if(m_PyramidFuture.valid())
+      this->ResetMultiResolutionPyramid();
+    }
+
+  // The 4D image has the direction in the upper left block
+  typename Image4DType::DirectionType dir_4d = m_Image4D->GetDirection();
+  for(unsigned int r = 0; r < 3; r++)
+    for(unsigned int c = 0; c < 3; c++)
+      dir_4d[r][c] = direction[r][c];
+
+  itk::ModifiedTimeType mtime_4d = m_Image4D->GetMTime();
+  m_Image4D->SetDirection(dir_4d);
+  m_TDigestFilter->InputHeaderModified(mtime_4d);
+
+  for(unsigned int tp = 0; tp < m_ImageTimePoints.size(); tp++)
+    {
+    itk::ModifiedTimeType mtime_tp = m_ImageTimePoints[tp]->GetMTime();
+    m_ImageTimePoints[tp]->SetDirection(direction);
+    this->OnTimePointHeaderModified(tp, mtime_tp);
+    }
+
+  // The pyramid levels keep their voxels
+  for(ImagePointer level : m_Pyramid)
+    level->SetDirection(direction);
+
+  // The output of the time point selection gets the new header
+  m_TimePointSelectFilter->Update();
+}
+
 template<class TTraits>
 void
 ImageWrapper<TTraits>
@@ -1045,6 +1540,10 @@ ImageWrapper<TTraits>
         m_Image && source->GetImageBase(),
         "Both target and source must have images in ImageWrapper::CopyImageCoordinateTransform")
 
+  // The pyramid levels and cached slices have the geometry of the old image
+  this->ResetMultiResolutionPyramid();
+  this->ResetTimePointSliceCache();
+
   // Set the new meta-data on the image, applying to all time points
   for(ImagePointer img : m_ImageTimePoints)
     {
@@ -1079,6 +1578,7 @@ const typename ImageWrapper<TTraits>::ImageType *
 ImageWrapper<TTraits>
 ::GetImage() const
 {
+  const_cast<Self *>(this)->DecompressImageData();
   m_TimePointSelectFilter->Update();
   return m_Image;
 }
@@ -1303,72 +1803,6 @@ ImageWrapper<TTraits>
 }
 
 
-template<class TTraits>
-bool
-ImageWrapper<TTraits>
-::CompareGeometry(
-    ImageBaseType *image1,
-    ImageBaseType *image2,
-    double tol)
-{
-  // If one of the images is NULL return false
-  if(!image1 || !image2)
-    return false;
-
-  // Check if the images have same dimensions
-  bool same_size = (image1->GetBufferedRegion() == image2->GetBufferedRegion());
-
-  // Now test the 3D geometry of the image to see if it occupies the same space
-  bool same_space = true;
-
-  for(int i = 0; i < 3; i++)
-    {
-    if(fabs(image1->GetOrigin()[i] - image2->GetOrigin()[i]) > tol)
-      same_space = false;
-    if(fabs(image1->GetSpacing()[i] - image2->GetSpacing()[i]) > tol)
-      same_space = false;
-    for(int j = 0; j < 3; j++)
-      {
-      if(fabs(image1->GetDirection()[i][j] - image2->GetDirection()[i][j]) > tol)
-        same_space = false;
-      }
-    }
-
-  return same_size && same_space;
-}
-
-template<class TTraits>
-bool
-ImageWrapper<TTraits>
-::CanOrthogonalSlicingBeUsed(
-    ImageType *image, ImageBaseType *referenceSpace, ITKTransformType *transform)
-{
-  // For orthogonal slicing to be usable, two conditions must be met
-  //   1. The reference space and the new image must have the same geometry
-  //   2. The transform must be identity
-
-  // Additionally, orthogonal slicing becomes quite expensive for very large images
-  // because the slice extracted is much larger that the screen region onto which
-  // it is then mapped. So we can heuristically set a maximum size after which we
-  // do not use orthogonal slicing
-  const int max_ortho_dim = 1024;
-
-  // Check if the images have same dimensions
-  double tol = 1e-5;
-  bool same_geom = CompareGeometry(image, referenceSpace, tol);
-
-  // Use helper class to check for identity
-  bool is_identity = AffineTransformHelper::IsIdentity(transform);
-
-  // Check if any of the image dimensions are above the max
-  bool is_large = false;
-  for(unsigned int d = 0; d < 3; d++)
-    if(image->GetBufferedRegion().GetSize()[d] > max_ortho_dim)
-      is_large = true;
-
-  return same_geom && is_identity && (!is_large);
-}
-
 template<class TTraits>
 void
 ImageWrapper<TTraits>
@@ -1377,9 +1811,20 @@ ImageWrapper<TTraits>
     ImageBaseType *referenceSpace,
     ITKTransformType *transform)
 {
+  // The pyramid, cached slices and copies of the voxels refer to the previous image
+  this->ResetMultiResolutionPyramid();
+  this->ResetTimePointSliceCache();
+  this->ResetTimeMajorCopy();
+  this->DiscardCompressedImageData();
+
   // Assign the pointer to the 4D image
   m_Image4D = image_4d;
 
+  // Let repeated data, e.g., the lines that a segmentation's time points
+  // have in common, share storage before the time points are set up
+  typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+  Specialization::ShareRepeatedData(image_4d);
+
   // The time dimension is the last dimension
   unsigned int nt = image_4d->GetBufferedRegion().GetSize()[3];
 
@@ -1393,7 +1838,6 @@ ImageWrapper<TTraits>
     ImagePointer ip = ImageType::New();
 
     // Set the buffer pointer
-    typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
     Specialization::ConfigureTimePointImageFromImage4D(image_4d, ip.GetPointer(), i);
 
     // Append image to the array
@@ -1403,6 +1847,14 @@ ImageWrapper<TTraits>
     m_TimePointSelectFilter->AddSelectableInput(i, ip);
     }
 
+  // No time point has been modified or released yet
+  m_ModifiedTimePoints.assign(nt, false);
+  m_ResidentTimePoints.clear();
+
+  // Everything computed from the previous image is out of date
+  m_VoxelDataVersions.assign(nt, ImageWrapperBase::NewStateVersion());
+  m_GeometryVersion = ImageWrapperBase::NewStateVersion();
+
   // Update the selected time point in the selector
   m_TimePointSelectFilter->SetSelectedInput(m_TimePointIndex);
 
@@ -1569,6 +2021,11 @@ ImageWrapper<TTraits>
         idest->GetBufferedRegion() == image->GetBufferedRegion(),
         "Source/Destination region mismatch in ImageWrapper::UpdateTimePoint")
 
+  // The prefetch thread may be reading the time point
+  this->ResetTimePointSliceCache();
+  this->DecompressImageData();
+  m_ModifiedTimePoints[time_point] = true;
+
   // Use iterators to perform update
   ConstIterator it_src(image, image->GetBufferedRegion());
   Iterator it_dest(m_ImageTimePoints[time_point], image->GetBufferedRegion());
@@ -1582,6 +2039,81 @@ ImageWrapper<TTraits>
   // Set modification (we are not keeping track of number of updated voxels because of
   // potential added overhead
   PixelsModified();
+  m_VoxelDataVersions[time_point] = ImageWrapperBase::NewStateVersion();
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::UpdateTimePointFromWrapper(const ImageWrapperBase *source)
+{
+  const Self *src = dynamic_cast<const Self *>(source);
+  itkAssertOrThrowMacro(
+        src, "Source wrapper type mismatch in ImageWrapper::UpdateTimePointFromWrapper")
+
+  const_cast<Self *>(src)->DecompressImageData();
+  this->UpdateTimePoint(src->m_Image);
+}
+
+template<class TTraits>
+std::vector<unsigned int>
+ImageWrapper<TTraits>
+::UpdateChangedTimePoints(Image4DType *image_4d)
+{
+  typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+  this->DecompressImageData();
+
+  // An image of a different size is simply swapped in
+  unsigned int nt = m_ImageTimePoints.size();
+  std::vector<unsigned int> changed_tp;
+  if(image_4d->GetBufferedRegion() != m_Image4D->GetBufferedRegion()
+     || image_4d->GetNumberOfComponentsPerPixel() != m_Image4D->GetNumberOfComponentsPerPixel()
+     || !Specialization::CanUpdateTimePointsInPlace(m_Image4D))
+    {
+    this->SetImage4D(image_4d);
+    for(unsigned int tp = 0; tp < m_ImageTimePoints.size(); tp++)
+      changed_tp.push_back(tp);
+    return changed_tp;
+    }
+
+  // Compare first, while the background tasks may still be reading
+  std::vector<itk::ImageRegion<3> > changed(nt);
+  for(unsigned int tp = 0; tp < nt; tp++)
+    if(Specialization::FindChangedTimePointRegion(m_Image4D, image_4d, tp, changed[tp]))
+      changed_tp.push_back(tp);
+
+  if(changed_tp.empty())
+    return changed_tp;
+
+  // The prefetched slices of the changed time points will not match their
+  // new modified time, the others remain valid. The pyramid only covers the
+  // current time point
+  this->CollectTimePointPrefetch();
+  if(std::find(changed_tp.begin(), changed_tp.end(), m_TimePointIndex) != changed_tp.end())
+    this->ResetMultiResolutionPyramid();
+
+  for(unsigned int tp : changed_tp)
+    {
+    ImageType *tp_image = m_ImageTimePoints[tp];
+    itk::ModifiedTimeType before = tp_image->GetMTime();
+    Specialization::CopyTimePointRegion(m_Image4D, image_4d, tp, changed[tp]);
+    tp_image->Modified();
+    m_TDigestFilter->TimePointModified(tp);
+    m_VoxelDataVersions[tp] = ImageWrapperBase::NewStateVersion();
+
+    // Only the changed rows of the current slices are extracted again
+    if(tp == m_TimePointIndex)
+      for(unsigned int i = 0; i < 3; i++)
+        m_Slicers[i]->AddInputModifiedRegion(tp_image, before, tp_image->GetMTime(), changed[tp]);
+    }
+
+  // The voxels match the file again
+  m_Image4D->Modified();
+  m_ImageSaveTime.Modified();
+
+  // The views are redrawn, without rebuilding them as for a new image
+  this->InvokeEvent(WrapperImageChangeEvent());
+  return changed_tp;
 }
 
 template<class TTraits>
@@ -1636,6 +2168,10 @@ ImageWrapper<TTraits>
   m_ImageSpaceMatchesReferenceSpace =
       CanOrthogonalSlicingBeUsed(m_Image, m_ReferenceSpace, m_AffineTransform);
 
+  // Oblique slicing reads the voxels of the image directly
+  if(!m_ImageSpaceMatchesReferenceSpace)
+    this->DecompressImageData();
+
   // Update the transform
   for(int i = 0; i < 3; i++)
     {
@@ -1644,6 +2180,9 @@ ImageWrapper<TTraits>
     m_Slicers[i]->SetOrthogonalTransform(m_ImageGeometry->GetImageToDisplayTransform(i));
     }
 
+  // The transform is part of the geometry, even if the reference space is the same
+  m_GeometryVersion = ImageWrapperBase::NewStateVersion();
+
   // Fire an update event
   this->InvokeEvent(WrapperDisplayMappingChangeEvent());
 }
@@ -1669,12 +2208,20 @@ void
 ImageWrapper<TTraits>
 ::Reset()
 {
+  this->ResetMultiResolutionPyramid();
+  this->ResetTimePointSliceCache();
+  this->ResetTimeMajorCopy();
+  this->DiscardCompressedImageData();
+
   if (m_Initialized)
     {
     for(ImagePointer img : m_ImageTimePoints)
       img->ReleaseData();
 
     m_ImageTimePoints.clear();
+    m_ModifiedTimePoints.clear();
+    m_VoxelDataVersions.clear();
+    m_ResidentTimePoints.clear();
     if(m_ReferenceSpace == m_ImageBase)
       m_ReferenceSpace = nullptr;
     m_ImageBase = nullptr;
@@ -1705,10 +2252,12 @@ ImageWrapper<TTraits>
         "Voxel index outside of range")
 
   // Update the pixel
+  this->DecompressImageData();
   m_Image->SetPixel(index, value);
 
   // The 4D image must receive the modified event
   m_Image4D->Modified();
+  m_VoxelDataVersions[m_TimePointIndex] = ImageWrapperBase::NewStateVersion();
 }
 
 template<class TTraits>
@@ -1723,6 +2272,17 @@ ImageWrapper<TTraits>
   if(time_point < 0)
     time_point = m_TimePointIndex;
 
+  // Read compressed voxels without restoring the whole image
+  if constexpr(COMPRESSION_SUPPORTED)
+    {
+    if(m_ImageDataCompressed)
+      {
+      PixelType value;
+      m_BrickedBuffer->GetVoxel(index, &value);
+      return value;
+      }
+    }
+
   // Simply use ITK's GetPixel method
   return m_ImageTimePoints[time_point]->GetPixel(index);
   }
@@ -1743,6 +2303,7 @@ ImageWrapper<TTraits>
     const IndexType &idx, const PatchOffsetTable &offset_table, double *out_patch) const
 {
   typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+  const_cast<Self *>(this)->DecompressImageData();
   Specialization::SamplePatchAsDouble(m_Image, idx, offset_table, out_patch);
 }
 
@@ -1820,12 +2381,18 @@ ImageWrapper<TTraits>
       PixelType p = m_Slicers[0]->GetPreviewImage()->GetPixel(index);
       Specialization::ExportToComponentArray(p, nc, arr);
       }
+    else if(const ComponentType *series =
+            tp_end - tp_begin > 1 ? this->GetTimeMajorVoxel(index) : nullptr)
+      {
+      // The time series of the voxel is stored contiguously
+      std::copy(series + tp_begin * nc, series + tp_end * nc, arr);
+      }
     else
       {
       // The simple case when no interpolation is required
       for(unsigned int tp = tp_begin; tp < tp_end; tp++, arr+=nc)
         {
-        PixelType p = m_ImageTimePoints[tp]->GetPixel(index);
+        PixelType p = this->GetVoxel(index, tp);
         Specialization::ExportToComponentArray(p, nc, arr);
         }
       }
@@ -1854,6 +2421,8 @@ void
 ImageWrapper<TTraits>
 ::SetNativeMapping(NativeIntensityMapping nim)
 {
+  // The digest is computed again from the voxels
+  this->DecompressImageData();
   m_NativeMapping = nim;
 
   // Propagate the mapping to the tdigest
@@ -1872,6 +2441,7 @@ typename ImageWrapper<TTraits>::ConstIterator
 ImageWrapper<TTraits>
 ::GetImageConstIterator() const
 {
+  const_cast<Self *>(this)->DecompressImageData();
   ConstIterator it(m_Image,m_Image->GetLargestPossibleRegion());
   it.GoToBegin();
   return it;
@@ -1882,6 +2452,7 @@ typename ImageWrapper<TTraits>::Iterator
 ImageWrapper<TTraits>
 ::GetImageIterator()
 {
+  this->DecompressImageData();
   Iterator it(m_Image,m_Image->GetLargestPossibleRegion());
   it.GoToBegin();
   return it;
@@ -1895,9 +2466,27 @@ ImageWrapper<TTraits>
   // Save the cursor position
   m_SliceIndex = cursor;
 
-  // Select the appropriate slice for each slicer
+  // Select the appropriate slice for each slicer. If the slice changes, hand
+  // the slicer the new slice if it was prefetched
   for(unsigned int i = 0; i < 3; i++)
+    {
+    TimePointSliceKey key_before;
+    bool orthogonal = m_Slicers[i]->GetOrthogonalSliceKey(key_before);
+
     m_Slicers[i]->SetSliceIndex(cursor);
+
+    TimePointSliceEntry query;
+    if(orthogonal && m_Slicers[i]->GetOrthogonalSliceKey(query.Key)
+       && !(query.Key == key_before))
+      {
+      this->PollTimePointPrefetch();
+      query.TimePoint = m_TimePointIndex;
+      query.Dimension = i;
+      query.SourceMTime = m_ImageTimePoints[m_TimePointIndex]->GetMTime();
+      const TimePointSliceEntry *entry = this->FindTimePointSlice(query);
+      m_Slicers[i]->SetPrecomputedSlice(entry ? entry->Slice.GetPointer() : nullptr, query.Key);
+      }
+    }
 }
 
 template<class TTraits>
@@ -1914,39 +2503,480 @@ ImageWrapper<TTraits>
     {
     m_TimePointIndex = index;
 
+    // The pyramid is only kept for the current time point
+    this->ResetMultiResolutionPyramid();
+
     // Update the image selector
     m_TimePointSelectFilter->SetSelectedInput(index);
     m_TimePointSelectFilter->Update();
+
+    // Keep the voxels of recently viewed time points in memory
+    this->UpdateResidentTimePoints(index);
+
+    // Hand the slicers any slices of the new time point that were prefetched,
+    // and clear the ones handed over for a previous time point
+    this->CollectTimePointPrefetch();
+    for(unsigned int i = 0; i < 3; i++)
+      {
+      TimePointSliceEntry query;
+      query.TimePoint = index;
+      query.Dimension = i;
+      query.SourceMTime = m_ImageTimePoints[index]->GetMTime();
+
+      const TimePointSliceEntry *entry = nullptr;
+      if(m_Slicers[i]->GetOrthogonalSliceKey(query.Key))
+        entry = this->FindTimePointSlice(query);
+
+      m_Slicers[i]->SetPrecomputedSlice(entry ? entry->Slice.GetPointer() : nullptr, query.Key);
+      }
     }
 }
 
 template<class TTraits>
-const typename ImageWrapper<TTraits>::ImagePointer
-ImageWrapper<TTraits>::GetImageByTimePoint(unsigned int timepoint) const
+void
+ImageWrapper<TTraits>
+::UpdateResidentTimePoints(unsigned int tp)
 {
-  itkAssertOrThrowMacro(
-        timepoint < m_ImageTimePoints.size(),
-        "Requested time point out of range")
+  m_ResidentTimePoints.remove(tp);
+  m_ResidentTimePoints.push_front(tp);
 
-  return m_ImageTimePoints[timepoint];
+  // Release the least recently viewed time point. Modified time points are
+  // kept since releasing them would revert them to the contents of the file.
+  typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+  while(m_ResidentTimePoints.size() > TIME_POINT_RESIDENT_WINDOW)
+    {
+    unsigned int evicted = m_ResidentTimePoints.back();
+    m_ResidentTimePoints.pop_back();
+    if(!m_ModifiedTimePoints[evicted])
+      Specialization::ReleaseTimePointData(m_Image4D, evicted);
+    }
 }
 
 template<class TTraits>
 void
 ImageWrapper<TTraits>
-::SetDisplayViewportGeometry(unsigned int index,
-    const ImageBaseType *viewport_image)
+::PrefetchTimePointSlices(unsigned int n_ahead)
 {
-  m_Slicers[index]->SetObliqueReferenceImage(viewport_image);
+  unsigned int nt = m_ImageTimePoints.size();
+  if(!m_Initialized || nt < 2)
+    return;
+
+  // If the previous prefetch is still busy, the caller is stepping faster
+  // than slices can be computed ahead
+  if(!this->PollTimePointPrefetch())
+    return;
+
+  // The slicers are configured here, since the main pipeline must not be
+  // touched from the background thread
+  TimePointSliceList jobs;
+  std::vector<typename SlicerType::OrthogonalSlicerType::Pointer> slicers;
+  for(unsigned int k = 1; k <= std::min(n_ahead, nt - 1); k++)
+    {
+    unsigned int tp = (m_TimePointIndex + k) % nt;
+    for(unsigned int i = 0; i < 3; i++)
+      {
+      TimePointSliceEntry job;
+      job.TimePoint = tp;
+      job.Dimension = i;
+      job.SourceMTime = m_ImageTimePoints[tp]->GetMTime();
+      if(!m_Slicers[i]->GetOrthogonalSliceKey(job.Key) || this->FindTimePointSlice(job))
+        continue;
+
+      slicers.push_back(m_Slicers[i]->CreateOrthogonalSlicer(m_ImageTimePoints[tp]));
+      jobs.push_back(job);
+      }
+    }
+
+  this->LaunchTimePointPrefetch(jobs, slicers);
 }
 
 template<class TTraits>
-TDigestDataObject *
-ImageWrapper<TTraits>::GetTDigest()
-{
+void
+ImageWrapper<TTraits>
+::PrefetchAdjacentSlices(unsigned int dim, int step, unsigned int n_ahead)
+{
+  if(!m_Initialized || step == 0 || !this->PollTimePointPrefetch())
+    return;
+
+  TimePointSliceEntry current;
+  current.TimePoint = m_TimePointIndex;
+  current.Dimension = dim;
+  current.SourceMTime = m_ImageTimePoints[m_TimePointIndex]->GetMTime();
+  if(!m_Slicers[dim]->GetOrthogonalSliceKey(current.Key))
+    return;
+
+  // Slice indices ahead of the current one, in the direction of scrolling
+  long n_slices = m_ImageTimePoints[m_TimePointIndex]->GetLargestPossibleRegion().GetSize(current.Key.Axis);
+  TimePointSliceList jobs;
+  std::vector<typename SlicerType::OrthogonalSlicerType::Pointer> slicers;
+  for(unsigned int k = 1; k <= n_ahead; k++)
+    {
+    long index = (long) current.Key.Index + (long) k * step;
+    if(index < 0 || index >= n_slices)
+      break;
+
+    TimePointSliceEntry job = current;
+    job.Key.Index = (unsigned int) index;
+    if(this->FindTimePointSlice(job))
+      continue;
+
+    typename SlicerType::OrthogonalSlicerType::Pointer slicer =
+        m_Slicers[dim]->CreateOrthogonalSlicer(m_ImageTimePoints[m_TimePointIndex]);
+    slicer->SetSliceIndex(job.Key.Index);
+
+    // Compressed voxels are only held by the bricked buffer
+    if(m_ImageDataCompressed)
+      slicer->SetBrickedBuffer(m_BrickedBuffer);
+    slicers.push_back(slicer);
+    jobs.push_back(job);
+    }
+
+  this->LaunchTimePointPrefetch(jobs, slicers);
+}
+
+template<class TTraits>
+bool
+ImageWrapper<TTraits>
+::PollTimePointPrefetch()
+{
+  if(m_TimePointPrefetchFuture.valid())
+    {
+    if(m_TimePointPrefetchFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return false;
+    this->CollectTimePointPrefetch();
+    }
+  return true;
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::LaunchTimePointPrefetch(
+    const TimePointSliceList &jobs,
+    const std::vector<typename SlicerType::OrthogonalSlicerType::Pointer> &slicers)
+{
+  if(jobs.empty())
+    return;
+
+  m_TimePointPrefetchFuture = TaskScheduler::GetInstance()->Submit(
+        TaskScheduler::SPECULATIVE, [jobs, slicers]() mutable
+    {
+    for(unsigned int j = 0; j < jobs.size(); j++)
+      {
+      slicers[j]->Update();
+      jobs[j].Slice = slicers[j]->GetOutput();
+      jobs[j].Slice->DisconnectPipeline();
+      }
+    slicers.clear();
+    return jobs;
+    });
+}
+
+template<class TTraits>
+const typename ImageWrapper<TTraits>::TimePointSliceEntry *
+ImageWrapper<TTraits>
+::FindTimePointSlice(const TimePointSliceEntry &entry) const
+{
+  for(const TimePointSliceEntry &e : m_TimePointSliceCache)
+    {
+    if(e.TimePoint == entry.TimePoint && e.Dimension == entry.Dimension
+       && e.Key == entry.Key && e.SourceMTime == entry.SourceMTime)
+      return &e;
+    }
+  return nullptr;
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::CollectTimePointPrefetch()
+{
+  if(!m_TimePointPrefetchFuture.valid())
+    return;
+
+  TimePointSliceList fetched;
+  try
+    {
+    fetched = m_TimePointPrefetchFuture.get();
+    }
+  catch(std::exception &)
+    {
+    // Prefetching is only an optimization, the slices will be computed
+    // normally when the time point is shown
+    }
+
+  // Replace the oldest entries
+  for(TimePointSliceEntry &e : fetched)
+    {
+    if(m_TimePointSliceCache.size() < TIME_POINT_SLICE_CACHE_SIZE)
+      {
+      m_TimePointSliceCache.push_back(e);
+      }
+    else
+      {
+      m_TimePointSliceCache[m_TimePointSliceCacheNext] = e;
+      m_TimePointSliceCacheNext = (m_TimePointSliceCacheNext + 1) % TIME_POINT_SLICE_CACHE_SIZE;
+      }
+    }
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::ResetTimePointSliceCache()
+{
+  // The thread must be done before the image data it is reading can change
+  if(m_TimePointPrefetchFuture.valid())
+    m_TimePointPrefetchFuture.wait();
+  m_TimePointPrefetchFuture = std::future<TimePointSliceList>();
+
+  m_TimePointSliceCache.clear();
+  m_TimePointSliceCacheNext = 0;
+}
+
+template<class TTraits>
+const typename ImageWrapper<TTraits>::ImagePointer
+ImageWrapper<TTraits>::GetImageByTimePoint(unsigned int timepoint) const
+{
+  itkAssertOrThrowMacro(
+        timepoint < m_ImageTimePoints.size(),
+        "Requested time point out of range")
+
+  const_cast<Self *>(this)->DecompressImageData();
+  return m_ImageTimePoints[timepoint];
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::SetDisplayViewportGeometry(unsigned int index,
+    const ImageBaseType *viewport_image)
+{
+  m_Slicers[index]->SetObliqueReferenceImage(viewport_image);
+
+  // When zoomed out, slice a coarser level of the pyramid (if available)
+  if constexpr(MULTIRES_SUPPORTED)
+    {
+    this->UpdateMultiResolutionPyramid();
+    const ImageType *source = this->GetSamplingImage(viewport_image);
+    m_Slicers[index]->SetLowResolutionImage(source != m_Image ? source : nullptr);
+    }
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::SetObliqueSlicingSubsampling(unsigned int factor)
+{
+  for(unsigned int i = 0; i < 3; i++)
+    m_Slicers[i]->SetObliqueSubsamplingFactor(factor);
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::SetSlicingRestrictedToViewport(unsigned int index, bool flag)
+{
+  m_Slicers[index]->SetRestrictToViewport(flag);
+}
+
+template<class TTraits>
+bool
+ImageWrapper<TTraits>
+::IsSlicingRestrictedToViewport(unsigned int index) const
+{
+  return m_Slicers[index]->GetRestrictToViewport();
+}
+
+/**
+ * Downsample a scalar image by a factor of two along each dimension by box
+ * averaging. The output covers the same physical extent as the input. Returns
+ * a null pointer if the operation is canceled.
+ */
+template <class TImage>
+SmartPtr<TImage>
+DownsampleImageByTwo(const TImage *src, const std::atomic<bool> &cancel)
+{
+  typedef typename TImage::PixelType PixelType;
+  auto sz = src->GetBufferedRegion().GetSize();
+
+  typename TImage::SizeType out_sz;
+  typename TImage::SpacingType out_spacing;
+  itk::Vector<double, 3> origin_shift;
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    out_sz[d] = (sz[d] + 1) / 2;
+    out_spacing[d] = src->GetSpacing()[d] * sz[d] / out_sz[d];
+    origin_shift[d] = 0.5 * (out_spacing[d] - src->GetSpacing()[d]);
+    }
+
+  SmartPtr<TImage> out = TImage::New();
+  out->SetRegions(typename TImage::RegionType(out_sz));
+  out->SetSpacing(out_spacing);
+  out->SetOrigin(src->GetOrigin() + src->GetDirection() * origin_shift);
+  out->SetDirection(src->GetDirection());
+  out->Allocate();
+
+  const PixelType *p = src->GetBufferPointer();
+  PixelType *q = out->GetBufferPointer();
+  size_t nx_src = sz[0], ny_src = sz[1], nz_src = sz[2];
+  size_t line = nx_src, plane = nx_src * ny_src;
+  for(size_t z = 0; z < out_sz[2]; z++)
+    {
+    if(cancel)
+      return nullptr;
+
+    size_t nz = std::min((size_t) 2, nz_src - 2 * z);
+    for(size_t y = 0; y < out_sz[1]; y++)
+      {
+      size_t ny = std::min((size_t) 2, ny_src - 2 * y);
+      for(size_t x = 0; x < out_sz[0]; x++, q++)
+        {
+        size_t nx = std::min((size_t) 2, nx_src - 2 * x);
+        const PixelType *p0 = p + 2 * (z * plane + y * line + x);
+        double sum = 0.0;
+        for(size_t k = 0; k < nz; k++)
+          for(size_t j = 0; j < ny; j++)
+            for(size_t i = 0; i < nx; i++)
+              sum += p0[k * plane + j * line + i];
+
+        double mean = sum / (nx * ny * nz);
+        if constexpr(std::is_integral<PixelType>::value)
+          *q = static_cast<PixelType>(std::floor(mean + 0.5));
+        else
+          *q = static_cast<PixelType>(mean);
+        }
+      }
+    }
+
+  return out;
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::UpdateMultiResolutionPyramid()
+{
+  if constexpr(MULTIRES_SUPPORTED)
+    {
+    if(!m_Initialized || m_Pyramid.size())
+      return;
+
+    // Collect the result of the background build once it is done
+    if(m_PyramidFuture.valid())
+      {
+      if(m_PyramidFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+        try
+          {
+          m_Pyramid = m_PyramidFuture.get();
+          }
+        catch(std::exception &)
+          {
+          // Not enough memory for the pyramid, keep using the full-resolution image
+          m_Pyramid.clear();
+          }
+        }
+      return;
+      }
+
+    // Only large images benefit from the pyramid. It is not built again once
+    // it has been dropped to stay within the memory budget, and it can not be
+    // built from compressed voxels
+    if(m_PyramidSuspended || m_ImageDataCompressed)
+      return;
+
+    ImagePointer source = m_ImageTimePoints[m_TimePointIndex];
+    if(source->GetBufferedRegion().GetNumberOfPixels() < MULTIRES_MIN_VOXELS)
+      return;
+
+    TaskScheduler::CancellationToken cancel = m_PyramidCancel;
+    auto build = [source, cancel]()
+      {
+      ImagePyramid pyramid;
+      ImagePointer level = source;
+      auto sz = level->GetBufferedRegion().GetSize();
+      while(std::max(sz[0], std::max(sz[1], sz[2])) > MULTIRES_MIN_SIZE)
+        {
+        level = DownsampleImageByTwo<ImageType>(level, cancel.GetFlag());
+        if(!level)
+          return ImagePyramid();
+        pyramid.push_back(level);
+        sz = level->GetBufferedRegion().GetSize();
+        }
+      return pyramid;
+      };
+    m_PyramidFuture = TaskScheduler::GetInstance()->Submit(
+          TaskScheduler::SPECULATIVE, build, cancel);
+    }
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::ResetMultiResolutionPyramid()
+{
+  // Stop the background build, the task must be done before the image
+  // data it is reading can be released. If it has not started, cancelling
+  // removes it from the queue
+  if(m_PyramidFuture.valid())
+    {
+    TaskScheduler::GetInstance()->Cancel(m_PyramidCancel);
+    m_PyramidFuture.wait();
+    m_PyramidFuture = std::future<ImagePyramid>();
+    m_PyramidCancel = TaskScheduler::CancellationToken();
+    }
+
+  m_Pyramid.clear();
+  for(unsigned int i = 0; i < 3; i++)
+    m_Slicers[i]->SetLowResolutionImage(nullptr);
+}
+
+template<class TTraits>
+const typename ImageWrapper<TTraits>::ImageType *
+ImageWrapper<TTraits>
+::GetSamplingImage(const ImageBaseType *ref_space) const
+{
+  if(m_Pyramid.empty() || !ref_space)
+    return m_Image;
+
+  // Find the image axis that is closest to the normal of the reference space
+  auto dir_img = m_Image->GetDirection().GetVnlMatrix();
+  auto normal = dir_img.transpose() * ref_space->GetDirection().GetVnlMatrix().get_column(2);
+  unsigned int normal_axis = 0;
+  for(unsigned int d = 1; d < 3; d++)
+    if(std::fabs(normal[d]) > std::fabs(normal[normal_axis]))
+      normal_axis = d;
+
+  double target = std::min(ref_space->GetSpacing()[0], ref_space->GetSpacing()[1]);
+
+  // Find the coarsest level that still has at least one voxel per sample
+  const ImageType *source = m_Image;
+  for(const ImagePointer &level : m_Pyramid)
+    {
+    for(unsigned int d = 0; d < 3; d++)
+      if(d != normal_axis && level->GetSpacing()[d] > target)
+        return source;
+    source = level;
+    }
+
+  return source;
+}
+
+template<class TTraits>
+TDigestDataObject *
+ImageWrapper<TTraits>::GetTDigest()
+{
   return m_TDigestFilter->GetTDigest();
 }
 
+template<class TTraits>
+void
+ImageWrapper<TTraits>::SetDerivedDataCacheKey(const DerivedDataCache::Key &key)
+{
+  m_TDigestFilter->SetCacheKey(key);
+}
+
 template<class TTraits>
 const typename ImageWrapper<TTraits>::MinMaxObjectType *
 ImageWrapper<TTraits>::GetImageMinObject()
@@ -1984,6 +3014,7 @@ ImageWrapper<TTraits>
   //   2. Image direction matrix
   //   3. Display to anatomy transforms (m_DisplayGeometry)
   // This method must be called whenever one of these parameters changes.
+  m_GeometryVersion = ImageWrapperBase::NewStateVersion();
 
   // Create an image coordinate geometry based on the current state
   if(m_ReferenceSpace)
@@ -2044,8 +3075,18 @@ void
 ImageWrapper<TTraits>
 ::PixelsModified()
 {
-  // Update the 4D image
+  // The digest is about to read the voxels
+  this->DecompressImageData();
+
+  // Update the 4D image. Only the digest of this time point needs updating
   m_Image4D->Modified();
+  m_TDigestFilter->TimePointModified(m_TimePointIndex);
+
+  // The pyramid and cached slices no longer match the image
+  this->ResetMultiResolutionPyramid();
+  this->ResetTimePointSliceCache();
+  m_ModifiedTimePoints[m_TimePointIndex] = true;
+  m_VoxelDataVersions[m_TimePointIndex] = ImageWrapperBase::NewStateVersion();
 
   // Update the current time point. Note that we don't update m_Image,
   // which is the output of the time point selection pipeline and thus
@@ -2053,21 +3094,42 @@ ImageWrapper<TTraits>
   m_ImageTimePoints[m_TimePointIndex]->Modified();
   }
 
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::PixelsModifiedInRegion(const itk::ImageRegion<3> &region)
+{
+  ImageType *tp_image = m_ImageTimePoints[m_TimePointIndex];
+  itk::ModifiedTimeType before = tp_image->GetMTime();
+  this->PixelsModified();
+
+  // The slicers read the voxels of the current time point through m_Image,
+  // which shares the pixel container of the time point image
+  for(unsigned int i = 0; i < 3; i++)
+    m_Slicers[i]->AddInputModifiedRegion(tp_image, before, tp_image->GetMTime(), region);
+}
+
 template<class TTraits>
 void ImageWrapper<TTraits>
 ::SetPixelContainer(typename ImageType::PixelContainer *container)
 {
+  this->DecompressImageData();
   itkAssertOrThrowMacro(
         container->Size() == m_Image4D->GetPixelContainer()->Size(),
         "Source array size does not match target array size in SetPixelContainer");
 
+  // The prefetch thread may be reading the old container
+  this->ResetTimePointSliceCache();
+
   typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
   Specialization::UpdatePixelContainer(m_Image4D, container);
   for(unsigned int tp = 0; tp < m_ImageTimePoints.size(); tp++)
     Specialization::ConfigureTimePointImageFromImage4D(m_Image4D, m_ImageTimePoints[tp], tp);
   m_TimePointSelectFilter->Update();
 
+  // All of the time points have new voxels
   this->PixelsModified();
+  m_VoxelDataVersions.assign(m_ImageTimePoints.size(), ImageWrapperBase::NewStateVersion());
 }
 
 template<class TTraits>
@@ -2252,6 +3314,7 @@ ImageWrapper<TTraits>
 ::WriteToFileInInternalFormat(const char *filename, Registry &hints)
 {
   typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+  this->DecompressImageData();
 
   // Write either in 4D or in 3D
   if(this->GetNumberOfTimePoints() > 1)
@@ -2297,6 +3360,7 @@ ImageWrapper<TTraits>
 {
   typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
   Registry reg;
+  this->DecompressImageData();
   Specialization::Write(m_Image, filename, reg);
   }
 
@@ -2355,156 +3419,150 @@ ImageWrapper<TTraits>
   return m_Slicers[0]->GetPreviewImage() != NULL;
 }
 
-struct RemoveTransparencyFunctor
-{
-  typedef ImageWrapperBase::DisplayPixelType PixelType;
-  PixelType operator()(const PixelType &p)
-  {
-    PixelType pnew = p;
-    pnew[3] = 255;
-    return pnew;
-  }
-};
-
 template<class TTraits>
 typename ImageWrapper<TTraits>::DisplaySlicePointer
 ImageWrapper<TTraits>
 ::MakeThumbnail(unsigned int maxdim)
 {
-  // Determine which axis to use for thumbnail generation. Each axis is assigned
-  // a penalty based on the following
-  //   - Type 1 penalty is 1 if one of the slice dimensions is 1, 0 otherwise
-  //   - Type 2 penalty is 0 if slice aspect ratio is < 2.0, otherwise equal to the aspect ratio
-  //   - Type 3 penalty is the angle with the axial direction
-  using penalty = std::tuple<bool, double, double>;
-  using axis_info = std::tuple<penalty, int>;
-  std::vector<axis_info> axis_score;
+  // Create the reference space for the thumbnail slice
+  ThumbnailReferencePointer ref_slice = ImageWrapperBase::ConstructThumbnailReferenceSpace(
+        this->GetImageBase(), this->GetImageGeometry(), maxdim);
 
-  auto direction = this->GetImageBase()->GetDirection().GetVnlMatrix();
-  for(int i = 0; i < 3; i++)
+  // Reuse the last thumbnail if nothing that it depends on has changed
+  ThumbnailCache &tc = m_ThumbnailCache;
+  Vector3d ref_origin, ref_spacing_vec;
+  for(unsigned int d = 0; d < 3; d++)
     {
-    int j = (i + 1) % 3, k = (i + 2) % 3;
-    auto sz_j = this->GetSize()[j], sz_k = this->GetSize()[k];
-    double ext_j = sz_j * this->GetImageBase()->GetSpacing()[j];
-    double ext_k = sz_k * this->GetImageBase()->GetSpacing()[k];
+    ref_origin[d] = ref_slice->GetOrigin()[d];
+    ref_spacing_vec[d] = ref_slice->GetSpacing()[d];
+    }
+  vnl_matrix_fixed<double, 3, 3> ref_direction = ref_slice->GetDirection().GetVnlMatrix();
+  unsigned long voxel_version = this->GetVoxelDataVersion(m_TimePointIndex);
+  unsigned long geometry_version = this->GetGeometryVersion();
+  if(tc.Thumbnail && tc.MaxDim == maxdim && tc.TimePoint == m_TimePointIndex
+     && tc.VoxelDataVersion == voxel_version
+     && tc.GeometryVersion == geometry_version
+     && tc.DisplayMappingVersion == m_DisplayMappingVersion
+     && tc.Origin == ref_origin && tc.Spacing == ref_spacing_vec
+     && tc.Direction == ref_direction)
+    {
+    return tc.Thumbnail;
+    }
 
-    // Is the slice 1D?
-    bool is_one_d = (sz_j == 1) || (sz_k == 1);
+  // Sample the display slice. This uses the pyramid if it has been built
+  this->UpdateMultiResolutionPyramid();
+  DisplaySlicePointer thumb_image = this->SampleArbitraryDisplaySlice(ref_slice);
 
-    // Is the aspect ratio off?
-    double aspect_ratio = ext_j < ext_k ? ext_j / ext_k : ext_k / ext_j;
-    double ar_penalty = (aspect_ratio > 0.5) ? 0.0 : (0.5 - aspect_ratio);
+  // Flip the slice for display and make it opaque
+  DisplaySlicePointer result = ImageWrapperBase::FinalizeThumbnail(thumb_image);
+
+  tc.Thumbnail = result;
+  tc.MaxDim = maxdim;
+  tc.TimePoint = m_TimePointIndex;
+  tc.VoxelDataVersion = voxel_version;
+  tc.GeometryVersion = geometry_version;
+  tc.DisplayMappingVersion = m_DisplayMappingVersion;
+  tc.Origin = ref_origin;
+  tc.Spacing = ref_spacing_vec;
+  tc.Direction = ref_direction;
+  return result;
+}
 
-    // Angle with the axial direction
-    auto y = direction.get_column(i);
-    y.normalize();
-    double cos_alpha = y[2];
-    double sin_alpha = sqrt(1 - cos_alpha * cos_alpha);
+/** Number of bytes allocated for the pixels of an image */
+template <class TImage>
+static size_t GetImageBufferBytes(const TImage *image)
+{
+  if(!image || !image->GetPixelContainer())
+    return 0;
+  return image->GetPixelContainer()->Capacity()
+      * sizeof(typename TImage::PixelContainer::Element);
+}
 
-    // Create penalty
-    axis_score.push_back(std::make_tuple(std::make_tuple(is_one_d, ar_penalty, sin_alpha), i));
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::GetMemoryUsage(MemoryAccounting::Usage &usage) const
+{
+  if(!m_Initialized)
+    return;
+
+  typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+  Specialization::AddBufferMemoryUsage(m_Image4D, usage);
+
+  // Slices extracted from the image and mapped to display colors
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    usage.Bytes[MemoryAccounting::DISPLAY_SLICES] +=
+        GetImageBufferBytes(m_Slicers[i]->GetOutput())
+        + GetImageBufferBytes(m_DisplayMapping->GetDisplaySlice(i).GetPointer());
     }
 
-  // Sort based on penalty
-  std::sort(axis_score.begin(), axis_score.end());
-  int thumb_z_axis = std::get<1>(axis_score[0]);
+  if constexpr(MULTIRES_SUPPORTED)
+    {
+    for(const ImagePointer &level : m_Pyramid)
+      usage.Bytes[MemoryAccounting::MULTIRES_PYRAMIDS] += GetImageBufferBytes(level.GetPointer());
+    }
 
-  // Now that we have sorted this out, we need to find the display axis that best matches
-  // the selected direction and use the geometry of that display axis to set up the thumbnail
-  // plane. This will make the thumbnail more consistent with what is viewed on the screen
-  int display_axis = -1;
-  for(int i = 0; i < 3; i++)
+  for(const TimePointSliceEntry &entry : m_TimePointSliceCache)
+    usage.Bytes[MemoryAccounting::SLICE_CACHES] += GetImageBufferBytes(entry.Slice.GetPointer());
+  usage.Bytes[MemoryAccounting::SLICE_CACHES] +=
+      GetImageBufferBytes(m_ThumbnailCache.Thumbnail.GetPointer());
+  if(m_BrickedBuffer)
+    usage.Bytes[MemoryAccounting::SLICE_CACHES] += m_BrickedBuffer->GetNumberOfBytes();
+  usage.Bytes[MemoryAccounting::SLICE_CACHES] += m_TimeMajorData.size() * sizeof(ComponentType);
+
+  // The compressed voxels take the place of the image buffer
+  if(m_ImageDataCompressed)
     {
-    auto *d_to_i = this->GetImageGeometry()->GetDisplayToImageTransform(i);
-    unsigned int z_coord_for_display_axis = d_to_i->GetCoordinateIndexZeroBased(2);
-    if(z_coord_for_display_axis == thumb_z_axis)
-      {
-      display_axis = i;
-      break;
-      }
+    usage.Bytes[MemoryAccounting::IMAGE_DATA] += m_BrickedBuffer->GetNumberOfCompressedBytes();
+    usage.Bytes[MemoryAccounting::MULTIRES_PYRAMIDS] += GetImageBufferBytes(m_CompressedOverview.GetPointer());
     }
-  auto d_to_i = this->GetImageGeometry()->GetDisplayToImageTransform(display_axis);
-
-  // Now that we have done this, we need to create a reference image that matches the slice
-  // direction. We already know the axis in image space of the slicing direction, but now
-  // we need to determine how the x and y axes of the thumbnail will map to the other
-  // image axes
-  int thumb_x_axis = d_to_i->GetCoordinateIndexZeroBased(0);
-  int thumb_y_axis = d_to_i->GetCoordinateIndexZeroBased(1);
-  double thumb_x_dir = d_to_i->GetCoordinateOrientation(0);
-  double thumb_y_dir = d_to_i->GetCoordinateOrientation(1);
-
-  // Compute the spacing of the referene slice
-  double spc_x = this->GetSize()[thumb_x_axis] * this->GetImageBase()->GetSpacing()[thumb_x_axis] / maxdim;
-  double spc_y = this->GetSize()[thumb_y_axis] * this->GetImageBase()->GetSpacing()[thumb_y_axis] / maxdim;
-  double spc_max = std::max(spc_x, spc_y);
-  typename ImageBaseType::SpacingType ref_spacing;
-  ref_spacing[0] = spc_max;
-  ref_spacing[1] = spc_max;
-  ref_spacing[2] = this->GetImageBase()->GetSpacing()[thumb_z_axis];
-
-  // Compute the direction matrix of the reference slice. The direction matrix should be the
-  // corresponding column from the image direction matrix, but the sign may be flipped.
-  auto ref_direction = direction;
-  ref_direction.set_identity();
-  ref_direction.set_column(0, direction.get_column(thumb_x_axis) * thumb_x_dir);
-  ref_direction.set_column(1, direction.get_column(thumb_y_axis) * thumb_y_dir);
-  ref_direction.set_column(2, direction.get_column(thumb_z_axis));
-
-  // Compute the origin of the reference slice. Here we want the center of the thumbnail
-  // to match the center of the image.
-  auto origin_img = this->GetImageBase()->GetOrigin().GetVnlVector();
-  Vector3d offset_ctr;
-  for(unsigned int d = 0; d < 3; d++)
-    offset_ctr[d] = 0.5 * this->GetImageBase()->GetSpacing()[d] * (this->GetSize()[d] - 1);
-  Vector3d center_img = origin_img + direction * offset_ctr;
-
-  // Compute the origin for the thumb
-  Vector3d ref_offset_ctr;
-  ref_offset_ctr[0] = 0.5 * ref_spacing[0] * (maxdim - 1);
-  ref_offset_ctr[1] = 0.5 * ref_spacing[1] * (maxdim - 1);
-  ref_offset_ctr[2] = 0;
-  Vector3d ref_origin = center_img - ref_direction * ref_offset_ctr;
-
-  // Create the reference space
-  using RefType = itk::Image<unsigned char, 3>;
-  typename RefType::Pointer ref_slice = RefType::New();
-  ref_slice->SetSpacing(ref_spacing);
-  ref_slice->SetOrigin(to_itkPoint(ref_origin));
-
-  typename ImageBaseType::DirectionType ref_direction_itk;
-  ref_direction_itk = ref_direction;
-  ref_slice->SetDirection(ref_direction_itk);
-
-  // The size of the viewport is fairly easy
-  typename ImageBaseType::RegionType ref_region;
-  ref_region.SetSize(0, maxdim); ref_region.SetSize(1, maxdim); ref_region.SetSize(2, 1);
-  ref_slice->SetRegions(ref_region);
-
-  // Sample the display slice
-  DisplaySlicePointer thumb_image = this->SampleArbitraryDisplaySlice(ref_slice);
+}
 
-  // Background color for thumbnails
-  unsigned char defrgb[] = {0,0,0,255};
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::ReclaimMemory(MemoryAccounting::ReclaimLevel level)
+{
+  if(!m_Initialized)
+    return;
 
-  // For thumbnails, the image needs to be flipped
-  typedef itk::FlipImageFilter<DisplaySliceType> FlipFilter;
-  SmartPtr<FlipFilter> flipper = FlipFilter::New();
-  flipper->SetInput(thumb_image);
-  typename FlipFilter::FlipAxesArrayType flipaxes;
-  flipaxes[0] = false; flipaxes[1] = true;
-  flipper->SetFlipAxes(flipaxes);
+  if(level == MemoryAccounting::RECLAIM_CACHES)
+    {
+    this->ResetTimePointSliceCache();
+    m_ThumbnailCache.Thumbnail = nullptr;
 
-  // We also need to replace the transparency
-  typedef itk::UnaryFunctorImageFilter<
-      DisplaySliceType, DisplaySliceType, RemoveTransparencyFunctor> OpaqueFilter;
-  SmartPtr<OpaqueFilter> opaquer = OpaqueFilter::New();
-  opaquer->SetInput(flipper->GetOutput());
+    // Rebuilt by the next slice along x (or the next slice of compressed voxels)
+    if(m_BrickedBuffer)
+      m_BrickedBuffer->Release();
 
-  // Return the result
-  opaquer->Update();
-  DisplaySlicePointer result = opaquer->GetOutput();
-  return result;
+    // Rebuilt by the next query of the time series
+    this->ResetTimeMajorCopy();
+    }
+  else if(level == MemoryAccounting::RECLAIM_DERIVED_DATA)
+    {
+    // Voxels restored for processing are compressed again if possible
+    this->CompressImageData();
+
+    // Slicing falls back to the full-resolution image
+    if(m_Pyramid.size() || m_PyramidFuture.valid())
+      {
+      this->ResetMultiResolutionPyramid();
+      m_PyramidSuspended = true;
+      }
+    }
+  else if(level == MemoryAccounting::RECLAIM_PAGE_OUT)
+    {
+    // Keep only the current time point resident, modified time points can
+    // not be released since they would revert to the contents of the file
+    typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+    for(unsigned int tp = 0; tp < m_ImageTimePoints.size(); tp++)
+      if(tp != m_TimePointIndex && !m_ModifiedTimePoints[tp])
+        Specialization::ReleaseTimePointData(m_Image4D, tp);
+
+    m_ResidentTimePoints.clear();
+    m_ResidentTimePoints.push_front(m_TimePointIndex);
+    }
 }
 
 /*
@@ -2677,6 +3735,29 @@ ImageWrapper<TTraits>
   return img->GetTimeStamp() > m_ImageSaveTime;
 }
 
+template<class TTraits>
+unsigned long
+ImageWrapper<TTraits>
+::GetVoxelDataVersion(unsigned int tp) const
+{
+  unsigned long version = tp < m_VoxelDataVersions.size() ? m_VoxelDataVersions[tp] : 0;
+
+  // Versions only increase, so the larger one is the latest change
+  if(m_ParentWrapper)
+    version = std::max(version, m_ParentWrapper->GetVoxelDataVersion(tp));
+  return version;
+}
+
+template<class TTraits>
+unsigned long
+ImageWrapper<TTraits>
+::GetGeometryVersion() const
+{
+  if(m_ParentWrapper)
+    return std::max(m_GeometryVersion, m_ParentWrapper->GetGeometryVersion());
+  return m_GeometryVersion;
+}
+
 
 template<class TTraits>
 void
@@ -2689,6 +3770,20 @@ ImageWrapper<TTraits>
     Specialization::ConfigureTimePointImageFromImage4D(m_Image4D, m_ImageTimePoints[j], j);
 }
 
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::MaterializeDerivedQuantity(itk::Object *source)
+{
+  typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+  if(Specialization::MaterializeDerivedQuantity(m_Image4D, source))
+    {
+    // The time point images hold copies of the accessor of the 4D image
+    for(unsigned int j = 0; j < m_ImageTimePoints.size(); j++)
+      Specialization::ConfigureTimePointImageFromImage4D(m_Image4D, m_ImageTimePoints[j], j);
+    }
+}
+
 template<class TTraits>
 SmartPtr<ImageWrapperBase>
 ImageWrapper<TTraits>
@@ -2798,6 +3893,7 @@ ImageWrapper<TTraits>
   // If the image in this wrapper is not the same as the reference space,
   // we must force resampling to occur
   bool force_resampling = !this->IsSlicingOrthogonal();
+  const_cast<Self *>(this)->DecompressImageData();
 
   // We use partial template specialization here because region copy is
   // only supported for images that are concrete (Image, VectorImage)
@@ -2817,6 +3913,7 @@ ImageWrapper<TTraits>
   // If the image in this wrapper is not the same as the reference space,
   // we must force resampling to occur
   bool force_resampling = !this->IsSlicingOrthogonal();
+  const_cast<Self *>(this)->DecompressImageData();
 
   Image4DPointer outImg = Image4DType::New();
   const unsigned int nT = this->GetNumberOfTimePoints();
@@ -3080,6 +4177,7 @@ ImageWrapper<TTraits>
   typedef CreateCastToTargetTypePipelinePartialSpecializationTraits<
       ImageType, FloatImageType, NativeIntensityMapping, IsLinear::value, !IsVector::value> Specialization;
 
+  this->DecompressImageData();
   auto p = Specialization::CreatePipeline(this->m_Image, this->m_NativeMapping);
 
   if(p.second)
@@ -3098,6 +4196,7 @@ ImageWrapper<TTraits>
   // Create a pipeline that maps us to the matching image
   typedef CreateCastToTargetTypePipelinePartialSpecializationTraits<
       ImageType, FloatVectorImageType, NativeIntensityMapping, IsLinear::value, IsVector::value> Specialization;
+  this->DecompressImageData();
   auto p = Specialization::CreatePipeline(this->m_Image, this->m_NativeMapping);
 
   // Now, if MatchingFloatImage is not a FloatVectorImageType, we have to create a filter that
@@ -3145,6 +4244,46 @@ ImageWrapper<TTraits>::CreateCastToFloatVectorSlicePipeline(const char *key, uns
   }
 
 
+template<class TTraits>
+SmartPtr<typename ImageWrapper<TTraits>::FloatVectorImageType>
+ImageWrapper<TTraits>::CreateFloatVectorPyramidLevel(unsigned int level)
+{
+  SmartPtr<FloatVectorImageType> out;
+  if constexpr(MULTIRES_SUPPORTED)
+    {
+    this->UpdateMultiResolutionPyramid();
+    if(level == 0 || level > m_Pyramid.size())
+      return out;
+
+    const ImageType *src = m_Pyramid[level - 1];
+    out = FloatVectorImageType::New();
+    out->CopyInformation(src);
+    out->SetRegions(src->GetBufferedRegion());
+    out->SetNumberOfComponentsPerPixel(1);
+    out->Allocate();
+
+    const ComponentType *p = src->GetBufferPointer();
+    float *q = out->GetBufferPointer();
+    size_t n = src->GetBufferedRegion().GetNumberOfPixels();
+    for(size_t i = 0; i < n; i++)
+      q[i] = (float) m_NativeMapping(p[i]);
+    }
+  return out;
+}
+
+template<class TTraits>
+typename ImageWrapper<TTraits>::ConcreteImageType *
+ImageWrapper<TTraits>::GetConcretePyramidLevel(unsigned int level)
+{
+  if constexpr(MULTIRES_SUPPORTED && std::is_same<ImageType, ConcreteImageType>::value)
+    {
+    this->UpdateMultiResolutionPyramid();
+    if(level > 0 && level <= m_Pyramid.size())
+      return m_Pyramid[level - 1];
+    }
+  return nullptr;
+}
+
 template<class TTraits>
 void ImageWrapper<TTraits>::AddInternalPipeline(const MiniPipeline &mp, const char *key, int index)
 {
@@ -3168,6 +4307,339 @@ void ImageWrapper<TTraits>::ReleaseInternalPipeline(const char *key, int index)
   }
 
 
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::SetBrickedSlicing(bool flag)
+{
+  // Only images with a plain buffer can be copied to a bricked layout
+  if constexpr(IRISSlicerDirectCopyHelper<ImageType, SliceType>::Enabled)
+    {
+    // The bricked buffer holds the compressed voxels, and is only dropped
+    // once they are restored
+    if(m_ImageDataCompressed)
+      {
+      m_BrickedBufferForCompression = !flag;
+      return;
+      }
+
+    if(flag == m_BrickedBuffer.IsNotNull())
+      return;
+
+    m_BrickedBuffer = flag ? BrickedBufferType::New() : nullptr;
+    for(unsigned int i = 0; i < 3; i++)
+      m_Slicers[i]->SetBrickedBuffer(m_BrickedBuffer);
+    }
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::SetTimeMajorCopy(bool flag)
+{
+  m_TimeMajorCopy = flag;
+  if(!flag)
+    this->ResetTimeMajorCopy();
+}
+
+template<class TTraits>
+const typename ImageWrapper<TTraits>::ComponentType *
+ImageWrapper<TTraits>
+::GetTimeMajorVoxel(const itk::Index<3> &index) const
+{
+  // Only images with a plain buffer can be copied in time-major order
+  if constexpr(IRISSlicerDirectCopyHelper<ImageType, SliceType>::Enabled && !TTraits::PipelineOutput)
+    {
+    unsigned int nt = m_ImageTimePoints.size();
+    if(!m_TimeMajorCopy || !m_Initialized || nt < TIME_MAJOR_MIN_TIME_POINTS)
+      return nullptr;
+
+    // The voxels of a time point may be modified through the time point
+    // image as well as through the 4D image
+    itk::ModifiedTimeType mtime = m_Image4D->GetMTime();
+    for(const ImagePointer &img : m_ImageTimePoints)
+      mtime = std::max(mtime, img->GetMTime());
+
+    // Collect the result of the background build once it is done
+    if(m_TimeMajorFuture.valid())
+      {
+      if(m_TimeMajorFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return nullptr;
+
+      try
+        {
+        m_TimeMajorData = m_TimeMajorFuture.get();
+        }
+      catch(std::exception &)
+        {
+        // Not enough memory for the copy, keep sampling the time points
+        TimeMajorBuffer().swap(m_TimeMajorData);
+        }
+      m_TimeMajorMTime = m_TimeMajorFutureMTime;
+      m_TimeMajorFuture = std::future<TimeMajorBuffer>();
+      }
+
+    unsigned int nc = this->GetNumberOfComponents();
+
+    // An empty copy that matches the image could not be built, and is not
+    // attempted again until the image changes
+    if(m_TimeMajorMTime == mtime)
+      {
+      if(m_TimeMajorData.empty())
+        return nullptr;
+      return m_TimeMajorData.data()
+          + m_ImageTimePoints[0]->ComputeOffset(index) * nt * nc;
+      }
+
+    // Memory-mapped voxels are only read from disk as time points are
+    // viewed, so they are not copied
+    typedef MemoryMappedImageContainer<InternalPixelType> MappedContainer;
+    typename Image4DType::PixelContainerPointer pc = m_Image4D->GetPixelContainer();
+    if(!pc || !pc->Size() || dynamic_cast<MappedContainer *>(pc.GetPointer()))
+      return nullptr;
+
+    // The task holds the pixel container, so it may keep running while the
+    // voxels are modified, in which case its result is not used
+    TimeMajorBuffer().swap(m_TimeMajorData);
+    m_TimeMajorFutureMTime = mtime;
+    size_t nvox = m_ImageTimePoints[0]->GetBufferedRegion().GetNumberOfPixels();
+    TaskScheduler::CancellationToken cancel = m_TimeMajorCancel;
+    auto build = [pc, nvox, nt, nc, cancel]()
+      {
+      // Transpose blocks of voxels, so that both the reads from each time
+      // point and the writes stay within a few pages
+      constexpr size_t block = 4096;
+      const InternalPixelType *src = pc->GetBufferPointer();
+      TimeMajorBuffer out(nvox * nt * nc);
+      for(size_t v0 = 0; v0 < nvox; v0 += block)
+        {
+        if(cancel.IsCancelled())
+          return TimeMajorBuffer();
+
+        size_t v1 = std::min(nvox, v0 + block);
+        for(unsigned int tp = 0; tp < nt; tp++)
+          {
+          const InternalPixelType *p = src + (tp * nvox + v0) * nc;
+          ComponentType *q = out.data() + (v0 * nt + tp) * nc;
+          for(size_t v = v0; v < v1; v++, p += nc, q += nt * nc)
+            std::copy(p, p + nc, q);
+          }
+        }
+      return out;
+      };
+    m_TimeMajorFuture = TaskScheduler::GetInstance()->Submit(
+          TaskScheduler::SPECULATIVE, build, cancel);
+    }
+
+  return nullptr;
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::ResetTimeMajorCopy() const
+{
+  // The task only holds the pixel container, so it does not need to be
+  // waited for. If it has not started, cancelling removes it from the queue
+  if(m_TimeMajorFuture.valid())
+    {
+    TaskScheduler::GetInstance()->Cancel(m_TimeMajorCancel);
+    m_TimeMajorFuture = std::future<TimeMajorBuffer>();
+    m_TimeMajorCancel = TaskScheduler::CancellationToken();
+    }
+
+  TimeMajorBuffer().swap(m_TimeMajorData);
+  m_TimeMajorMTime = 0;
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::SetCompressedStorage(bool flag)
+{
+  if constexpr(COMPRESSION_SUPPORTED)
+    {
+    if(flag == m_CompressedStorage)
+      return;
+
+    m_CompressedStorage = flag;
+    if(flag)
+      this->CompressImageData();
+    else
+      this->DecompressImageData();
+    }
+}
+
+template<class TTraits>
+bool
+ImageWrapper<TTraits>
+::CompressImageData()
+{
+  if constexpr(COMPRESSION_SUPPORTED)
+    {
+    if(m_ImageDataCompressed)
+      return true;
+
+    // Only single volumes that are sliced orthogonally can be sliced from
+    // the bricked buffer
+    if(!m_CompressedStorage || !m_Initialized || m_ImageTimePoints.size() != 1
+       || !this->IsSlicingOrthogonal() || m_Slicers[0]->GetPreviewImage())
+      return false;
+
+    // Memory-mapped voxels cost no memory of their own, and imported buffers
+    // can not be released
+    typedef MemoryMappedImageContainer<InternalPixelType> MappedContainer;
+    typename Image4DType::PixelContainer *pc = m_Image4D->GetPixelContainer();
+    if(!pc || !pc->Size() || !pc->GetContainerManageMemory() || dynamic_cast<MappedContainer *>(pc))
+      return false;
+
+    // Filters outside of the wrapper that reference the image may read its
+    // voxels at any time. The references held when the voxels are first
+    // compressed are those of the wrapper and of its display pipeline
+    ImageType *tp_image = m_ImageTimePoints[0];
+    int refs[3] = { m_Image->GetReferenceCount(), m_Image4D->GetReferenceCount(),
+                    tp_image->GetReferenceCount() };
+    for(unsigned int i = 0; i < 3; i++)
+      {
+      if(m_CompressionReferenceCounts[i] < 0)
+        m_CompressionReferenceCounts[i] = refs[i];
+      else if(refs[i] > m_CompressionReferenceCounts[i])
+        return false;
+      }
+
+    // The pyramid is built from the voxels in the background
+    if(m_PyramidFuture.valid())
+      {
+      if(m_PyramidFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+      this->UpdateMultiResolutionPyramid();
+      }
+
+    // The prefetch thread may be reading the voxels, and the digest of the
+    // intensities must be computed while they are available
+    this->ResetTimePointSliceCache();
+    m_TDigestFilter->GetTDigest()->Update();
+
+    // Sample every few voxels for thumbnails, which can not be sampled from
+    // the compressed voxels
+    typename ImageType::SizeType size = tp_image->GetBufferedRegion().GetSize();
+    unsigned long step = 1;
+    while(std::max(size[0], std::max(size[1], size[2])) > step * COMPRESSED_OVERVIEW_SIZE)
+      step *= 2;
+
+    ImagePointer overview = ImageType::New();
+    typename ImageType::SizeType ov_size;
+    typename ImageType::SpacingType ov_spacing = tp_image->GetSpacing();
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      ov_size[d] = (size[d] + step - 1) / step;
+      ov_spacing[d] *= step;
+      }
+    overview->SetRegions(ov_size);
+    overview->SetSpacing(ov_spacing);
+    overview->SetOrigin(tp_image->GetOrigin());
+    overview->SetDirection(tp_image->GetDirection());
+    overview->Allocate();
+
+    const InternalPixelType *src = tp_image->GetBufferPointer();
+    InternalPixelType *dst = overview->GetBufferPointer();
+    for(size_t z = 0; z < size[2]; z += step)
+      for(size_t y = 0; y < size[1]; y += step)
+        for(size_t x = 0; x < size[0]; x += step)
+          *dst++ = src[(z * size[1] + y) * size[0] + x];
+
+    // Compress into the bricked buffer, creating one if bricked slicing is off
+    bool own_buffer = m_BrickedBuffer.IsNull();
+    SmartPtr<BrickedBufferType> buffer = own_buffer ? BrickedBufferType::New() : m_BrickedBuffer;
+    if(!buffer->Compress(tp_image, src, 1))
+      return false;
+
+    m_BrickedBuffer = buffer;
+    m_BrickedBufferForCompression = own_buffer;
+    for(unsigned int i = 0; i < 3; i++)
+      m_Slicers[i]->SetBrickedBuffer(m_BrickedBuffer);
+
+    // Release the voxels. The time point image (and the current image, which
+    // shares its container) only referenced the buffer of the 4D image
+    pc->Initialize();
+    tp_image->GetPixelContainer()->SetImportPointer(nullptr, 0, false);
+    m_CompressedOverview = overview;
+    m_ImageDataCompressed = true;
+    return true;
+    }
+  else
+    {
+    return false;
+    }
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::DecompressImageData()
+{
+  if constexpr(COMPRESSION_SUPPORTED)
+    {
+    if(!m_ImageDataCompressed)
+      return;
+
+    // The prefetch thread may be reading the compressed voxels
+    this->ResetTimePointSliceCache();
+
+    // The image keeps its modified time, since its voxels do not change
+    typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+    typename Image4DType::PixelContainer *pc = m_Image4D->GetPixelContainer();
+    pc->Reserve(m_Image4D->GetBufferedRegion().GetNumberOfPixels());
+    bool intact = m_BrickedBuffer->Decompress(pc->GetBufferPointer());
+    Specialization::ConfigureTimePointImageFromImage4D(m_Image4D, m_ImageTimePoints[0], 0);
+
+    m_ImageDataCompressed = false;
+    m_CompressedOverview = nullptr;
+    if(m_BrickedBufferForCompression)
+      {
+      m_BrickedBuffer = nullptr;
+      m_BrickedBufferForCompression = false;
+      }
+    for(unsigned int i = 0; i < 3; i++)
+      m_Slicers[i]->SetBrickedBuffer(m_BrickedBuffer);
+
+    itkAssertOrThrowMacro(intact, "Compressed voxels are corrupt in ImageWrapper::DecompressImageData")
+    }
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::DiscardCompressedImageData()
+{
+  if(m_ImageDataCompressed)
+    {
+    m_BrickedBuffer->Discard();
+    if(m_BrickedBufferForCompression)
+      {
+      m_BrickedBuffer = nullptr;
+      for(unsigned int i = 0; i < 3; i++)
+        m_Slicers[i]->SetBrickedBuffer(nullptr);
+      }
+    }
+
+  m_ImageDataCompressed = false;
+  m_BrickedBufferForCompression = false;
+  m_CompressedOverview = nullptr;
+  for(unsigned int i = 0; i < 3; i++)
+    m_CompressionReferenceCounts[i] = -1;
+}
+
+template<class TTraits>
+const typename ImageWrapper<TTraits>::ImageType *
+ImageWrapper<TTraits>
+::GetThumbnailSamplingImage(const ImageBaseType *ref_space) const
+{
+  if(m_ImageDataCompressed && m_Pyramid.empty())
+    return m_CompressedOverview;
+  return this->GetSamplingImage(ref_space);
+}
+
 template<class TTraits>
 string ImageWrapper<TTraits>::GetPixelFormatDescription()
 {
@@ -3187,6 +4659,10 @@ string ImageWrapper<TTraits>::GetPixelFormatDescription()
   else
     oss << component_type << n_bits;
 
+  // Floating point data stored in a compact integral type
+  if(!m_NativeMapping.IsIdentity())
+    oss << " (quantized)";
+
   return oss.str();
 }
 
@@ -3198,6 +4674,7 @@ ImageWrapper<TTraits>::CreateCastToConcreteImagePipeline() const
   typedef CreateCastToTargetTypePipelinePartialSpecializationTraits<
       ImageType, ConcreteImageType, IdentityInternalToNativeIntensityMapping, false, true> Specialization;
   IdentityInternalToNativeIntensityMapping dummy_mapping;
+  const_cast<Self *>(this)->DecompressImageData();
   return Specialization::CreatePipeline(this->m_Image, dummy_mapping);
 }
 
@@ -3209,7 +4686,8 @@ ImageWrapper<TTraits>::CreateCastToConcreteImagePipeline() const
   template class ImageWrapper<typename ImageWrapperTraits<type>::ComponentTraits>; \
   template class ImageWrapper<typename ImageWrapperTraits<type>::MagnitudeTraits>; \
   template class ImageWrapper<typename ImageWrapperTraits<type>::MaxTraits>; \
-  template class ImageWrapper<typename ImageWrapperTraits<type>::MeanTraits>;
+  template class ImageWrapper<typename ImageWrapperTraits<type>::MeanTraits>; \
+  template class ImageWrapper<typename ImageWrapperTraits<type>::JacobianTraits>;
 
 ImageWrapperInstantiateMacro(unsigned char)
 ImageWrapperInstantiateMacro(char)
@@ -3218,6 +4696,9 @@ ImageWrapperInstantiateMacro(short)
 ImageWrapperInstantiateMacro(float)
 ImageWrapperInstantiateMacro(double)
 
+template class ImageWrapper<QuantizedImageWrapperTraits<short>::ScalarTraits>;
+template class ImageWrapper<QuantizedImageWrapperTraits<unsigned char>::ScalarTraits>;
+
 template class ImageWrapper<SpeedImageWrapperTraits>;
 template class ImageWrapper<LabelImageWrapperTraits>;
 template class ImageWrapper<LevelSetImageWrapperTraits>;
@@ -39,11 +39,16 @@
 #include "RLEImageScanlineIterator.h"
 #include "ImageWrapperBase.h"
 #include "ImageCoordinateGeometry.h"
+#include "TaskScheduler.h"
+#include "DerivedDataCache.h"
 #include <itkVectorImage.h>
 #include <itkRGBAPixel.h>
 #include <DisplayMappingPolicy.h>
 #include <itkSimpleDataObjectDecorator.h>
 #include <array>
+#include <atomic>
+#include <future>
+#include <list>
 #include <vector>
 
 // Forward declarations to IRIS classes
@@ -406,13 +411,13 @@ public:
    * write operations to the image, only a const pointer is returned in the public method.
    */
   virtual const Image4DType *GetImage4D() const
-    { return m_Image4D; }
+    { const_cast<Self *>(this)->DecompressImageData(); return m_Image4D; }
 
   /**
    * Get an image for modification. After making modifications, PixelsModified() should be
    * called in order for slicing and other pipelines to be updated
    */
-  virtual ImageType *GetModifiableImage() { return m_Image; }
+  virtual ImageType *GetModifiableImage() { this->DecompressImageData(); return m_Image; }
 
   /**
    * This function should be called whenever the pixels in the image returned via GetModifableImage
@@ -420,6 +425,13 @@ public:
    */
   void PixelsModified();
 
+  /**
+   * Same as PixelsModified(), when it is known that only the pixels of the
+   * current time point within the given region were modified. This allows
+   * the slicing pipelines to only regenerate the affected parts of the slices
+   */
+  void PixelsModifiedInRegion(const itk::ImageRegion<3> &region);
+
   /**
    * Replace the pixel data in the wrapped 4D image with a new data array. This method should be
    * used in very rare circumstances where it is not possible/desirable to update the pixels in
@@ -443,12 +455,22 @@ public:
   /** Set the current time index */
   virtual void SetTimePointIndex(unsigned int index) ITK_OVERRIDE;
 
+  virtual void PrefetchTimePointSlices(unsigned int n_ahead) ITK_OVERRIDE;
+
+  virtual void PrefetchAdjacentSlices(unsigned int dim, int step, unsigned int n_ahead) ITK_OVERRIDE;
+
   const ImageBaseType* GetDisplayViewportGeometry(unsigned int index) const;
 
   virtual void SetDisplayViewportGeometry(
       unsigned int index,
       const ImageBaseType *viewport_image) ITK_OVERRIDE;
 
+  virtual void SetObliqueSlicingSubsampling(unsigned int factor) ITK_OVERRIDE;
+
+  virtual void SetSlicingRestrictedToViewport(unsigned int index, bool flag) ITK_OVERRIDE;
+
+  virtual bool IsSlicingRestrictedToViewport(unsigned int index) const ITK_OVERRIDE;
+
   /**
     Compute the image t-digest, from which the quantiles of the image can be
     approximated. The t-digest is a fast algorithm for approximating image
@@ -461,6 +483,13 @@ public:
     */
   virtual TDigestDataObject *GetTDigest() ITK_OVERRIDE;
 
+  /**
+   * Keep the t-digest of the image in the derived data cache, under the key
+   * of the file the image was just read from. This must be called after the
+   * image is assigned, and the digest is only cached until it is modified.
+   */
+  void SetDerivedDataCacheKey(const DerivedDataCache::Key &key);
+
   typedef itk::SimpleDataObjectDecorator<ComponentType> MinMaxObjectType;
 
   /** Legacy code returning image min as an object. TODO: refactor this out */
@@ -518,6 +547,17 @@ public:
    */
   virtual void UpdateTimePoint(ImageType *image, int time_point = -1);
 
+  /**
+   * Replace the voxels of the time points that differ from those of an image
+   * of the same size, e.g., the file that the image was read from after it
+   * was rewritten. The rows of each time point are compared and only those
+   * that changed are copied, so the cached slices, pyramid and digest of the
+   * other time points are kept. An image of a different size, or memory-mapped
+   * voxels, are replaced as with SetImage4D(). Afterwards the image has no
+   * unsaved changes. Returns the time points that changed.
+   */
+  virtual std::vector<unsigned int> UpdateChangedTimePoints(Image4DType *image_4d);
+
   /**
    * Update the transform between the coordinate space of this image and the program's
    * main reference space
@@ -548,6 +588,9 @@ public:
   virtual SmartPtr<ImageWrapperBase> ExtractROI4D(
       const SNAPSegmentationROISettings &roi, itk::Command *progressCommand) const ITK_OVERRIDE;
 
+  /** Copy the voxels of the current time point of a wrapper of the same type */
+  virtual void UpdateTimePointFromWrapper(const ImageWrapperBase *source) ITK_OVERRIDE;
+
 
   /**
    * This method is used to perform a deep copy of a region of this image 
@@ -681,10 +724,26 @@ public:
   virtual void WriteToFile(const char *filename, Registry &hints) ITK_OVERRIDE;
 
   /**
-   * Create a thumbnail from the image and write it to a .png file
+   * Create a thumbnail from the image and write it to a .png file. The last
+   * thumbnail is cached and returned again until the image, the time point,
+   * the display mapping or the thumbnail geometry change.
    */
   DisplaySlicePointer MakeThumbnail(unsigned int maxdim) ITK_OVERRIDE;
 
+  /**
+   * Report the image buffer, the slices, the pyramid and the slice caches
+   * (including the bricked copy) of the wrapper to the memory accounting
+   */
+  void GetMemoryUsage(MemoryAccounting::Usage &usage) const ITK_OVERRIDE;
+
+  /**
+   * Release memory to stay within the memory budget: the slice caches, then
+   * the pyramid (which is then no longer built for this image), and finally
+   * the unmodified time points other than the current one, if they can be
+   * read back from disk.
+   */
+  void ReclaimMemory(MemoryAccounting::ReclaimLevel level) ITK_OVERRIDE;
+
   /**
    * Save metadata to a Registry file. The metadata are data that are not
    * contained in the image header are need to be restored when the image
@@ -713,6 +772,16 @@ public:
    */
   virtual bool HasUnsavedChanges(unsigned int tp) const ITK_OVERRIDE;
 
+  /**
+   * Versions of the voxels of a time point, of the geometry and of the
+   * display mapping. A wrapper derived from a vector wrapper also changes
+   * version when its parent does.
+   */
+  virtual unsigned long GetVoxelDataVersion(unsigned int tp) const ITK_OVERRIDE;
+  virtual unsigned long GetGeometryVersion() const ITK_OVERRIDE;
+  virtual unsigned long GetDisplayMappingVersion() const ITK_OVERRIDE
+    { return m_DisplayMappingVersion; }
+
   /**
    * This method is only used when this wrapper is around an image adaptor
    * (e.g., magnitude of component vector) and we need to update the native
@@ -721,6 +790,13 @@ public:
    */
   void SetSourceNativeMapping(double scale, double shift);
 
+  /**
+   * Also only used for wrappers around derived quantity adaptors. Computes
+   * the derived quantity for the whole image, so that it is not recomputed on
+   * every access. The values are kept until the source image is modified.
+   */
+  void MaterializeDerivedQuantity(itk::Object *source);
+
   /**
     * Get the image from a specific timepoint
     */
@@ -758,6 +834,8 @@ public:
   /** Create a pipeline for casting an image slice to floating point vector image */
   virtual FloatVectorSliceType* CreateCastToFloatVectorSlicePipeline(const char *key, unsigned int slice) ITK_OVERRIDE;
 
+  virtual SmartPtr<FloatVectorImageType> CreateFloatVectorPyramidLevel(unsigned int level) ITK_OVERRIDE;
+
   /**
    * Release the filters and images in an internally managed pipeline. Passing -1 for
    * the index will release all the indices for this key
@@ -767,6 +845,40 @@ public:
   /** Get the format of the image for display */
   virtual std::string GetPixelFormatDescription() ITK_OVERRIDE;
 
+  /**
+   * Keep a bricked copy of the image for the slicers to extract slices along
+   * x. This has no effect on images that are not stored in a plain buffer.
+   */
+  virtual void SetBrickedSlicing(bool flag) ITK_OVERRIDE;
+  virtual bool IsBrickedSlicing() const ITK_OVERRIDE
+    { return m_BrickedBuffer.IsNotNull() && !m_BrickedBufferForCompression; }
+
+  /**
+   * Keep the voxels compressed in memory while the image is only viewed.
+   * This has no effect on images that are not plain scalar images, and the
+   * voxels are only compressed when the conditions of CompressImageData hold.
+   */
+  virtual void SetCompressedStorage(bool flag) ITK_OVERRIDE;
+  virtual bool IsCompressedStorage() const ITK_OVERRIDE { return m_CompressedStorage; }
+
+  /**
+   * Compress the voxels into the bricked buffer, from which the slicers then
+   * read their slices, and release the image buffer. This is only done for
+   * single volumes held in memory that are sliced orthogonally, and not while
+   * filters outside of the wrapper reference the image. Any access to the
+   * image itself restores its voxels.
+   */
+  virtual bool CompressImageData() ITK_OVERRIDE;
+  virtual bool IsImageDataCompressed() const ITK_OVERRIDE { return m_ImageDataCompressed; }
+
+  /**
+   * Keep a time-major copy of 4D images, from which the time series at the
+   * cursor is sampled. This has no effect on images that are not stored in
+   * a plain buffer in memory, or that have few time points.
+   */
+  virtual void SetTimeMajorCopy(bool flag) ITK_OVERRIDE;
+  virtual bool IsTimeMajorCopy() const ITK_OVERRIDE { return m_TimeMajorCopy; }
+
 
 protected:
 
@@ -845,6 +957,185 @@ protected:
   /** The associated slicer filters */
   std::array<SlicerPointer, 3> m_Slicers;
 
+  /**
+   * Multiresolution pyramid of the current time point, used to slice large
+   * images that are viewed zoomed out, and to sample thumbnails. Each level
+   * halves the resolution of the previous one (finest level first) while
+   * covering the same physical extent. The pyramid is only kept for plain
+   * scalar images that are not pipeline outputs, and is built lazily, in a
+   * background thread, once the image has at least MULTIRES_MIN_VOXELS voxels.
+   */
+  typedef std::vector<ImagePointer> ImagePyramid;
+  ImagePyramid m_Pyramid;
+  std::future<ImagePyramid> m_PyramidFuture;
+  TaskScheduler::CancellationToken m_PyramidCancel;
+
+  // Set when the pyramid is dropped to stay within the memory budget
+  bool m_PyramidSuspended = false;
+
+  // Bricked copy of the image shared by the slicers, null unless enabled
+  typedef typename SlicerType::BrickedBufferType BrickedBufferType;
+  SmartPtr<BrickedBufferType> m_BrickedBuffer;
+
+  // Whether the voxels are kept compressed when possible, whether they are
+  // compressed now (held by the bricked buffer), and whether the bricked
+  // buffer only exists to hold them
+  bool m_CompressedStorage = false;
+  bool m_ImageDataCompressed = false;
+  bool m_BrickedBufferForCompression = false;
+
+  // Number of references to the current image, the 4D image and the time
+  // point image when the voxels were first compressed. More references mean
+  // that filters outside of the wrapper use the image. Negative if unknown
+  int m_CompressionReferenceCounts[3] = { -1, -1, -1 };
+
+  // Subsampled copy of the image for sampling thumbnails while the voxels
+  // are compressed
+  ImagePointer m_CompressedOverview;
+
+  /**
+   * Copy of the voxels of a 4D image with the time points of each voxel
+   * stored together ([voxel][time point][component]), so that sampling the
+   * time series of a voxel reads a single run of memory instead of one cache
+   * line per time point. It is built in the background when the time series
+   * is first sampled, and is only used while the image and its time points
+   * have the modified time it was built from (m_TimeMajorMTime).
+   */
+  typedef std::vector<ComponentType> TimeMajorBuffer;
+  bool m_TimeMajorCopy = false;
+  mutable TimeMajorBuffer m_TimeMajorData;
+  mutable itk::ModifiedTimeType m_TimeMajorMTime = 0, m_TimeMajorFutureMTime = 0;
+  mutable std::future<TimeMajorBuffer> m_TimeMajorFuture;
+  mutable TaskScheduler::CancellationToken m_TimeMajorCancel;
+
+  static constexpr unsigned int TIME_MAJOR_MIN_TIME_POINTS = 16;
+
+  /**
+   * Get the components of all time points of a voxel from the time-major
+   * copy, or nullptr if it is not available (yet). This starts the build
+   * of the copy, or collects it if it has completed.
+   */
+  const ComponentType *GetTimeMajorVoxel(const itk::Index<3> &index) const;
+
+  /** Discard the time-major copy, canceling its background build */
+  void ResetTimeMajorCopy() const;
+
+  static constexpr bool COMPRESSION_SUPPORTED =
+      std::is_same<ImageType, itk::Image<ComponentType, 3> >::value
+      && std::is_same<SliceType, itk::Image<ComponentType, 2> >::value
+      && !TTraits::PipelineOutput;
+  static constexpr unsigned long COMPRESSED_OVERVIEW_SIZE = 128;
+
+  /** Restore the voxels of the image if they are compressed */
+  void DecompressImageData();
+
+  /** Drop the compressed voxels, when the image is replaced */
+  void DiscardCompressedImageData();
+
+  /** Image from which thumbnails are sampled (see GetSamplingImage) */
+  const ImageType *GetThumbnailSamplingImage(const ImageBaseType *ref_space) const;
+
+  static constexpr bool MULTIRES_SUPPORTED =
+      std::is_same<ImageType, PreviewImageType>::value && !TTraits::PipelineOutput;
+  static constexpr unsigned long MULTIRES_MIN_VOXELS = 1ul << 26;
+  static constexpr unsigned long MULTIRES_MIN_SIZE = 256;
+
+  /**
+   * Start building the pyramid if needed, or collect the result of a build
+   * that has completed in the background
+   */
+  void UpdateMultiResolutionPyramid();
+
+  /** Discard the pyramid, canceling the background build if it is running */
+  void ResetMultiResolutionPyramid();
+
+  /**
+   * Set the direction in the header of the 4D image, the time point images
+   * and the pyramid, without touching the voxels. The digests are told that
+   * only the header has changed, and so is OnTimePointHeaderModified(), so
+   * that what was computed from the voxels does not have to be computed again
+   */
+  void SetImageHeaderDirection(const typename ImageType::DirectionType &direction);
+
+  /**
+   * Called when the header of a time point image has been changed without
+   * changing its voxels, with the MTime of the image before the change. State
+   * that was up to date with that MTime can be marked up to date again.
+   */
+  virtual void OnTimePointHeaderModified(unsigned int itkNotUsed(tp),
+                                         itk::ModifiedTimeType itkNotUsed(mtime_before)) {}
+
+  /**
+   * Get the coarsest image in the pyramid whose in-plane spacing does not
+   * exceed the in-plane spacing of the reference space. The through-plane
+   * axis is taken to be the image axis closest to the reference space normal.
+   * Returns the full-resolution image if there is no suitable pyramid level.
+   */
+  const ImageType *GetSamplingImage(const ImageBaseType *ref_space) const;
+
+  /**
+   * Ring cache of orthogonal slices computed ahead of time, filled by
+   * PrefetchTimePointSlices (other time points) and PrefetchAdjacentSlices
+   * (other slice indices). An entry is only used if the slicing parameters
+   * and the time point image have not changed since it was computed.
+   */
+  typedef typename SlicerType::OrthogonalSliceKey TimePointSliceKey;
+  struct TimePointSliceEntry
+  {
+    unsigned int TimePoint, Dimension;
+    TimePointSliceKey Key;
+    itk::ModifiedTimeType SourceMTime;
+    SlicePointer Slice;
+  };
+  typedef std::vector<TimePointSliceEntry> TimePointSliceList;
+  TimePointSliceList m_TimePointSliceCache;
+  unsigned int m_TimePointSliceCacheNext = 0;
+  std::future<TimePointSliceList> m_TimePointPrefetchFuture;
+
+  static constexpr unsigned int TIME_POINT_SLICE_CACHE_SIZE = 32;
+
+  /** Find a cached slice matching the time point, dimension and key of entry */
+  const TimePointSliceEntry *FindTimePointSlice(const TimePointSliceEntry &entry) const;
+
+  /** Wait for the background prefetch, if any, and add its slices to the cache */
+  void CollectTimePointPrefetch();
+
+  /**
+   * Collect the background prefetch if it has finished. Returns false if it
+   * is still running, since only one prefetch runs at a time.
+   */
+  bool PollTimePointPrefetch();
+
+  /** Compute the slices for the jobs in a background thread */
+  void LaunchTimePointPrefetch(
+      const TimePointSliceList &jobs,
+      const std::vector<typename SlicerType::OrthogonalSlicerType::Pointer> &slicers);
+
+  /** Discard the cached slices, waiting for the background prefetch */
+  void ResetTimePointSliceCache();
+
+  /**
+   * Time points whose voxels were accessed most recently, most recent first.
+   * When the image data is memory-mapped from disk, the voxels of time points
+   * that fall out of this window are released from physical memory, unless
+   * the time point has been modified (m_ModifiedTimePoints).
+   */
+  std::list<unsigned int> m_ResidentTimePoints;
+  std::vector<bool> m_ModifiedTimePoints;
+
+  /**
+   * The version of the voxels of each time point, and of the geometry. They
+   * take a new value from NewStateVersion() whenever the voxels of the time
+   * point, or the header, reference space or transform, change.
+   */
+  std::vector<unsigned long> m_VoxelDataVersions;
+  unsigned long m_GeometryVersion = ImageWrapperBase::NewStateVersion();
+
+  static constexpr unsigned int TIME_POINT_RESIDENT_WINDOW = 8;
+
+  /** Mark a time point as the most recently accessed one */
+  void UpdateResidentTimePoints(unsigned int tp);
+
   /**
    * Is the image wrapper initialized? That is a prerequisite for all
    * operations.
@@ -900,6 +1191,25 @@ protected:
    */
   SmartPtr<TDigestFilterType> m_TDigestFilter;
 
+  /**
+   * The last thumbnail, and the versions of the wrapper state it was made
+   * from. The display mapping version changes on every display mapping change.
+   */
+  struct ThumbnailCache
+  {
+    DisplaySlicePointer Thumbnail;
+    unsigned int MaxDim = 0, TimePoint = 0;
+    unsigned long VoxelDataVersion = 0, GeometryVersion = 0;
+    unsigned long DisplayMappingVersion = 0;
+    Vector3d Origin, Spacing;
+    vnl_matrix_fixed<double, 3, 3> Direction;
+  };
+
+  ThumbnailCache m_ThumbnailCache;
+  unsigned long m_DisplayMappingVersion = ImageWrapperBase::NewStateVersion();
+
+  void OnDisplayMappingChange() { m_DisplayMappingVersion = ImageWrapperBase::NewStateVersion(); }
+
   /**
    * Internally cached transform from image coordinates to RAS (NIFTI) physical coordinates.
    * This is derived from the origin, spacing, and direction cosine matrix in the image header.
@@ -968,14 +1278,6 @@ protected:
   // An internal array to store intensity samples for SampleIntensityAtReferenceIndex function
   mutable vnl_vector<ComponentType> m_IntensitySamplingArray;
 
-  // Compare the geometry (size and header) of two images. Returns true if the headers are
-  // within tolerance of each other.
-  static bool CompareGeometry(ImageBaseType *image1, ImageBaseType *image2, double tol = 0.0);
-
-  // Check if the orthogonal slicer can be used for the given image, ref space and transform
-  static bool CanOrthogonalSlicingBeUsed(
-      ImageType *image, ImageBaseType *referenceSpace, ITKTransformType *transform);
-
   /** Write the image to disk with whatever the internal format is */
   virtual void WriteToFileInInternalFormat(const char *filename, Registry &hints) ITK_OVERRIDE;
 
@@ -1004,6 +1306,13 @@ protected:
     Create a mini-pipeline that casts the current time point to the concrete image type
     */
   virtual std::pair<MiniPipeline, ConcreteImageType*> CreateCastToConcreteImagePipeline() const;
+
+  /**
+   * Get a level of the multiresolution pyramid as a concrete image (level k
+   * has 2^k times fewer voxels along each axis), or NULL if there is no such
+   * level (yet)
+   */
+  ConcreteImageType *GetConcretePyramidLevel(unsigned int level);
 };
 
 #endif // __ImageWrapper_h_
@@ -1,6 +1,23 @@
 #include "ImageWrapperBase.h"
 #include "itkImageBase.h"
 #include "IRISException.h"
+#include "ImageCoordinateGeometry.h"
+#include "AffineTransformHelper.h"
+#include "IRISVectorTypesToITKConversion.h"
+#include <itkFlipImageFilter.h>
+#include <itkUnaryFunctorImageFilter.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <tuple>
+
+unsigned long
+ImageWrapperBase
+::NewStateVersion()
+{
+  static std::atomic<unsigned long> counter(0);
+  return ++counter;
+}
 
 vnl_matrix_fixed<double, 4, 4>
 ImageWrapperBase
@@ -51,6 +68,251 @@ ImageWrapperBase
   return vox2nii * vtk2vox;
   }
 
+bool
+ImageWrapperBase
+::CompareGeometry(
+    const ImageBaseType *image1,
+    const ImageBaseType *image2,
+    double tol)
+{
+  // If one of the images is NULL return false
+  if(!image1 || !image2)
+    return false;
+
+  // Check if the images have same dimensions
+  bool same_size = (image1->GetBufferedRegion() == image2->GetBufferedRegion());
+
+  // Now test the 3D geometry of the image to see if it occupies the same space
+  bool same_space = true;
+
+  for(int i = 0; i < 3; i++)
+    {
+    if(fabs(image1->GetOrigin()[i] - image2->GetOrigin()[i]) > tol)
+      same_space = false;
+    if(fabs(image1->GetSpacing()[i] - image2->GetSpacing()[i]) > tol)
+      same_space = false;
+    for(int j = 0; j < 3; j++)
+      {
+      if(fabs(image1->GetDirection()[i][j] - image2->GetDirection()[i][j]) > tol)
+        same_space = false;
+      }
+    }
+
+  return same_size && same_space;
+}
+
+bool
+ImageWrapperBase
+::CanOrthogonalSlicingBeUsed(
+    const ImageBaseType *image, const ImageBaseType *referenceSpace,
+    ITKTransformType *transform)
+{
+  // For orthogonal slicing to be usable, the image and the reference space
+  // must have the same size, and the transform must map each voxel of the
+  // reference space onto the same voxel of the image. This is checked in voxel
+  // units rather than by comparing the headers and testing the transform for
+  // identity, so that header differences far smaller than a voxel (rounding
+  // in the file headers) and transforms that undo a difference between the
+  // headers do not force the image to be interpolated.
+
+  // Additionally, orthogonal slicing becomes quite expensive for very large images
+  // because the slice extracted is much larger that the screen region onto which
+  // it is then mapped. So we can heuristically set a maximum size after which we
+  // do not use orthogonal slicing
+  const unsigned int max_ortho_dim = 1024;
+
+  // Largest displacement of a voxel, in voxels
+  const double tol_voxel = 1e-3;
+
+  if(!image || !referenceSpace || !transform || !transform->IsLinear())
+    return false;
+
+  // Check if the images have same dimensions
+  const ImageBaseType::RegionType &region = image->GetBufferedRegion();
+  if(region != referenceSpace->GetBufferedRegion())
+    return false;
+
+  // Check if any of the image dimensions are above the max
+  for(unsigned int d = 0; d < 3; d++)
+    if(region.GetSize()[d] > max_ortho_dim)
+      return false;
+
+  // The mapping between the voxels is affine, so if the corners of the
+  // region map onto themselves, all voxels do
+  for(unsigned int corner = 0; corner < 8; corner++)
+    {
+    itk::ContinuousIndex<double, 3> cix_ref, cix_img;
+    for(unsigned int d = 0; d < 3; d++)
+      cix_ref[d] = region.GetIndex(d) + ((corner >> d) & 1) * (region.GetSize(d) - 1.0);
+
+    itk::Point<double, 3> x_ref, x_img;
+    referenceSpace->TransformContinuousIndexToPhysicalPoint(cix_ref, x_ref);
+    x_img = transform->TransformPoint(x_ref);
+    image->TransformPhysicalPointToContinuousIndex(x_img, cix_img);
+
+    for(unsigned int d = 0; d < 3; d++)
+      if(!(std::fabs(cix_img[d] - cix_ref[d]) <= tol_voxel))
+        return false;
+    }
+
+  return true;
+}
+
+ImageWrapperBase::ThumbnailReferencePointer
+ImageWrapperBase
+::ConstructThumbnailReferenceSpace(
+    const ImageBaseType *image, const ImageCoordinateGeometry *geometry,
+    unsigned int maxdim)
+{
+  // Determine which axis to use for thumbnail generation. Each axis is assigned
+  // a penalty based on the following
+  //   - Type 1 penalty is 1 if one of the slice dimensions is 1, 0 otherwise
+  //   - Type 2 penalty is 0 if slice aspect ratio is < 2.0, otherwise equal to the aspect ratio
+  //   - Type 3 penalty is the angle with the axial direction
+  using penalty = std::tuple<bool, double, double>;
+  using axis_info = std::tuple<penalty, int>;
+  std::vector<axis_info> axis_score;
+
+  SizeType size = image->GetBufferedRegion().GetSize();
+  auto direction = image->GetDirection().GetVnlMatrix();
+  for(int i = 0; i < 3; i++)
+    {
+    int j = (i + 1) % 3, k = (i + 2) % 3;
+    auto sz_j = size[j], sz_k = size[k];
+    double ext_j = sz_j * image->GetSpacing()[j];
+    double ext_k = sz_k * image->GetSpacing()[k];
+
+    // Is the slice 1D?
+    bool is_one_d = (sz_j == 1) || (sz_k == 1);
+
+    // Is the aspect ratio off?
+    double aspect_ratio = ext_j < ext_k ? ext_j / ext_k : ext_k / ext_j;
+    double ar_penalty = (aspect_ratio > 0.5) ? 0.0 : (0.5 - aspect_ratio);
+
+    // Angle with the axial direction
+    auto y = direction.get_column(i);
+    y.normalize();
+    double cos_alpha = y[2];
+    double sin_alpha = sqrt(1 - cos_alpha * cos_alpha);
+
+    // Create penalty
+    axis_score.push_back(std::make_tuple(std::make_tuple(is_one_d, ar_penalty, sin_alpha), i));
+    }
+
+  // Sort based on penalty
+  std::sort(axis_score.begin(), axis_score.end());
+  int thumb_z_axis = std::get<1>(axis_score[0]);
+
+  // Now that we have sorted this out, we need to find the display axis that best matches
+  // the selected direction and use the geometry of that display axis to set up the thumbnail
+  // plane. This will make the thumbnail more consistent with what is viewed on the screen
+  int display_axis = -1;
+  for(int i = 0; i < 3; i++)
+    {
+    auto *d_to_i = geometry->GetDisplayToImageTransform(i);
+    unsigned int z_coord_for_display_axis = d_to_i->GetCoordinateIndexZeroBased(2);
+    if(z_coord_for_display_axis == thumb_z_axis)
+      {
+      display_axis = i;
+      break;
+      }
+    }
+  auto d_to_i = geometry->GetDisplayToImageTransform(display_axis);
+
+  // Now that we have done this, we need to create a reference image that matches the slice
+  // direction. We already know the axis in image space of the slicing direction, but now
+  // we need to determine how the x and y axes of the thumbnail will map to the other
+  // image axes
+  int thumb_x_axis = d_to_i->GetCoordinateIndexZeroBased(0);
+  int thumb_y_axis = d_to_i->GetCoordinateIndexZeroBased(1);
+  double thumb_x_dir = d_to_i->GetCoordinateOrientation(0);
+  double thumb_y_dir = d_to_i->GetCoordinateOrientation(1);
+
+  // Compute the spacing of the referene slice
+  double spc_x = size[thumb_x_axis] * image->GetSpacing()[thumb_x_axis] / maxdim;
+  double spc_y = size[thumb_y_axis] * image->GetSpacing()[thumb_y_axis] / maxdim;
+  double spc_max = std::max(spc_x, spc_y);
+  ImageBaseType::SpacingType ref_spacing;
+  ref_spacing[0] = spc_max;
+  ref_spacing[1] = spc_max;
+  ref_spacing[2] = image->GetSpacing()[thumb_z_axis];
+
+  // Compute the direction matrix of the reference slice. The direction matrix should be the
+  // corresponding column from the image direction matrix, but the sign may be flipped.
+  auto ref_direction = direction;
+  ref_direction.set_identity();
+  ref_direction.set_column(0, direction.get_column(thumb_x_axis) * thumb_x_dir);
+  ref_direction.set_column(1, direction.get_column(thumb_y_axis) * thumb_y_dir);
+  ref_direction.set_column(2, direction.get_column(thumb_z_axis));
+
+  // Compute the origin of the reference slice. Here we want the center of the thumbnail
+  // to match the center of the image.
+  Vector3d origin_img, offset_ctr;
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    origin_img[d] = image->GetOrigin()[d];
+    offset_ctr[d] = 0.5 * image->GetSpacing()[d] * (size[d] - 1);
+    }
+  Vector3d center_img = origin_img + direction * offset_ctr;
+
+  // Compute the origin for the thumb
+  Vector3d ref_offset_ctr;
+  ref_offset_ctr[0] = 0.5 * ref_spacing[0] * (maxdim - 1);
+  ref_offset_ctr[1] = 0.5 * ref_spacing[1] * (maxdim - 1);
+  ref_offset_ctr[2] = 0;
+  Vector3d ref_origin = center_img - ref_direction * ref_offset_ctr;
+
+  // Create the reference space
+  ThumbnailReferencePointer ref_slice = ThumbnailReferenceType::New();
+  ref_slice->SetSpacing(ref_spacing);
+  ref_slice->SetOrigin(to_itkPoint(ref_origin));
+
+  ImageBaseType::DirectionType ref_direction_itk;
+  ref_direction_itk = ref_direction;
+  ref_slice->SetDirection(ref_direction_itk);
+
+  // The size of the viewport is fairly easy
+  ImageBaseType::RegionType ref_region;
+  ref_region.SetSize(0, maxdim); ref_region.SetSize(1, maxdim); ref_region.SetSize(2, 1);
+  ref_slice->SetRegions(ref_region);
+
+  return ref_slice;
+}
+
+struct RemoveTransparencyFunctor
+{
+  typedef ImageWrapperBase::DisplayPixelType PixelType;
+  PixelType operator()(const PixelType &p)
+  {
+    PixelType pnew = p;
+    pnew[3] = 255;
+    return pnew;
+  }
+};
+
+ImageWrapperBase::DisplaySlicePointer
+ImageWrapperBase
+::FinalizeThumbnail(DisplaySliceType *slice)
+{
+  // For thumbnails, the image needs to be flipped
+  typedef itk::FlipImageFilter<DisplaySliceType> FlipFilter;
+  SmartPtr<FlipFilter> flipper = FlipFilter::New();
+  flipper->SetInput(slice);
+  FlipFilter::FlipAxesArrayType flipaxes;
+  flipaxes[0] = false; flipaxes[1] = true;
+  flipper->SetFlipAxes(flipaxes);
+
+  // We also need to replace the transparency
+  typedef itk::UnaryFunctorImageFilter<
+      DisplaySliceType, DisplaySliceType, RemoveTransparencyFunctor> OpaqueFilter;
+  SmartPtr<OpaqueFilter> opaquer = OpaqueFilter::New();
+  opaquer->SetInput(flipper->GetOutput());
+  opaquer->Update();
+
+  DisplaySlicePointer result = opaquer->GetOutput();
+  return result;
+}
+
 ScalarRepresentationIterator
 ::ScalarRepresentationIterator(const VectorImageWrapperBase *wrapper)
   : m_Depth(NUMBER_OF_SCALAR_REPS, 1)
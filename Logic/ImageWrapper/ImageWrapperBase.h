@@ -52,6 +52,7 @@ enum ScalarRepresentation
   SCALAR_REP_MAGNITUDE,
   SCALAR_REP_MAX,
   SCALAR_REP_AVERAGE,
+  SCALAR_REP_JACOBIAN,
   NUMBER_OF_SCALAR_REPS
 };
 
@@ -93,6 +94,10 @@ public:
   typedef itk::ImageBase<3> ImageBaseType;
   typedef itk::ImageBase<4> Image4DBaseType;
 
+  // Reference space in which thumbnails are sampled
+  typedef itk::Image<unsigned char, 3>                   ThumbnailReferenceType;
+  typedef SmartPtr<ThumbnailReferenceType>            ThumbnailReferencePointer;
+
   // Floating point images and sources to which data may be cast
   typedef itk::Image<float, 3>                                  FloatImageType;
   typedef itk::VectorImage<float, 3>                      FloatVectorImageType;
@@ -200,6 +205,21 @@ public:
   /** Set the current time index */
   virtual void SetTimePointIndex(unsigned int index) = 0;
 
+  /**
+   * Compute, in a background thread, the current slices of the next few time
+   * points, so that stepping through time points (e.g., cine playback) does
+   * not have to wait for slicing. Does nothing for 3D images.
+   */
+  virtual void PrefetchTimePointSlices(unsigned int n_ahead) = 0;
+
+  /**
+   * Compute, in a background thread, the next few slices of the current time
+   * point in display direction dim, step voxels apart along the slicing axis,
+   * so that scrolling through the image does not have to wait for slicing.
+   * The image must not be modified in place while the prefetch is running.
+   */
+  virtual void PrefetchAdjacentSlices(unsigned int dim, int step, unsigned int n_ahead) = 0;
+
   /**
    * Set the viewport rectangle onto which the three display slices
    * will be rendered
@@ -208,6 +228,20 @@ public:
       unsigned int index,
       const ImageBaseType *viewport_image) = 0;
 
+  /**
+   * Set the subsampling factor used when slicing obliquely. Factors above
+   * one produce coarse slices quickly, for previews during interaction
+   */
+  virtual void SetObliqueSlicingSubsampling(unsigned int factor) = 0;
+
+  /**
+   * Only generate the part of display slice index that is in the viewport,
+   * when slicing orthogonally. This should only be enabled when the slice is
+   * not displayed whole anywhere else.
+   */
+  virtual void SetSlicingRestrictedToViewport(unsigned int index, bool flag) = 0;
+  virtual bool IsSlicingRestrictedToViewport(unsigned int index) const = 0;
+
 
   /** Return some image info independently of pixel type */
   irisVirtualGetMacro(ImageBase, ImageBaseType *)
@@ -273,6 +307,13 @@ public:
   virtual SmartPtr<ImageWrapperBase> ExtractROI4D(
       const SNAPSegmentationROISettings &roi, itk::Command *progressCommand) const = 0;
 
+  /**
+   * Copy the voxels of the current time point of another wrapper of the same
+   * type and size, e.g., a region of interest extracted from another time
+   * point, into the current time point of this wrapper
+   */
+  virtual void UpdateTimePointFromWrapper(const ImageWrapperBase *source) = 0;
+
   /** Transform a voxel index into a spatial position */
   virtual Vector3d TransformVoxelIndexToLPSCoordinates(const Vector3i &iVoxel) const = 0;
 
@@ -354,11 +395,15 @@ public:
 
   /** Compute statistics over a run of voxels in the image starting at the index
    * startIdx. Appends the statistics to a running sum and sum of squared. The
-   * statistics are returned in internal (not native mapped) format */
+   * statistics are returned in internal (not native mapped) format. The run
+   * is taken from the given time point, or from the current one if negative.
+   * Concurrent calls are safe once a call has been made from one thread,
+   * which decompresses the image data if needed */
   virtual void GetRunLengthIntensityStatistics(
       const itk::ImageRegion<3> &region,
       const itk::Index<3> &startIdx, long runlength,
-      double *out_nvalid, double *out_sum, double *out_sumsq) const = 0;
+      double *out_nvalid, double *out_sum, double *out_sumsq,
+      int time_point = -1) const = 0;
 
   /**
    * This method returns a vector of values for the voxel under the cursor.
@@ -440,6 +485,25 @@ public:
    */
   virtual bool HasUnsavedChanges(unsigned int tp) const = 0;
 
+  /**
+   * Versions of the state of the wrapper, for the objects that are computed
+   * from it to record what they were built from. Unlike the modified times of
+   * the images, which change whenever any time point or the pipeline is
+   * touched, each version only changes with its own part of the state: the
+   * voxels of one time point, the geometry (header, reference space and
+   * transform) and the display mapping. Versions are taken from a counter
+   * shared by all wrappers, so a version never repeats, also after the image
+   * is replaced. Voxel versions rely on the writers calling PixelsModified()
+   * or PixelsModifiedInRegion() after changing the voxels, as they must do
+   * for the slices to be updated anyway.
+   */
+  virtual unsigned long GetVoxelDataVersion(unsigned int tp) const = 0;
+  virtual unsigned long GetGeometryVersion() const = 0;
+  virtual unsigned long GetDisplayMappingVersion() const = 0;
+
+  /** Take the next version from the counter shared by all wrappers */
+  static unsigned long NewStateVersion();
+
   /**
    * Save metadata to a Registry file. The metadata are data that are not
    * contained in the image header are need to be restored when the image
@@ -472,6 +536,35 @@ public:
     vnl_vector<double> v_origin,
     vnl_vector<double> v_spacing);
 
+  /**
+   * Compare the geometry (size and header) of two images. Returns true if the
+   * headers are within tolerance of each other.
+   */
+  static bool CompareGeometry(
+    const ImageBaseType *image1, const ImageBaseType *image2, double tol = 0.0);
+
+  /**
+   * Check if the orthogonal slicer can be used for the given image, reference
+   * space and transform, i.e., if the transform maps the voxels of the
+   * reference space onto the voxels of the image with the same index, to
+   * within a small fraction of a voxel
+   */
+  static bool CanOrthogonalSlicingBeUsed(
+    const ImageBaseType *image, const ImageBaseType *referenceSpace,
+    ITKTransformType *transform);
+
+  /**
+   * Construct the reference space for the thumbnail of an image, a single slice
+   * of maxdim x maxdim pixels oriented like the display slice that is closest
+   * to the best slicing direction of the image.
+   */
+  static ThumbnailReferencePointer ConstructThumbnailReferenceSpace(
+    const ImageBaseType *image, const ImageCoordinateGeometry *geometry,
+    unsigned int maxdim);
+
+  /** Flip a sampled thumbnail slice for display and make it opaque */
+  static DisplaySlicePointer FinalizeThumbnail(DisplaySliceType *slice);
+
   /**
    * Set an ITK transform between this image and a reference image.
    */
@@ -515,6 +608,15 @@ public:
   /** Create a pipeline for casting an image slice to floating point vector image */
   virtual FloatVectorSliceType* CreateCastToFloatVectorSlicePipeline(const char *key, unsigned int slice) = 0;
 
+  /**
+   * Copy a level of the multiresolution pyramid kept for display into a new
+   * floating point vector image, in native intensity units. Level k has 2^k
+   * times fewer voxels along each axis than the image. Returns NULL if there
+   * is no such level (yet), e.g., for small images, vector images or images
+   * whose pyramid is still being built.
+   */
+  virtual SmartPtr<FloatVectorImageType> CreateFloatVectorPyramidLevel(unsigned int level) = 0;
+
   /**
    * Release the filters and images in an internally managed pipeline. Passing -1 for
    * the index will release all the indices for this key
@@ -524,6 +626,36 @@ public:
   /** Get the format of the image for display */
   virtual std::string GetPixelFormatDescription() = 0;
 
+  /**
+   * Keep a bricked copy of the image for extracting slices along the x axis,
+   * trading memory for faster sagittal slicing of large images
+   */
+  virtual void SetBrickedSlicing(bool flag) = 0;
+  virtual bool IsBrickedSlicing() const = 0;
+
+  /**
+   * Keep the voxels of the image compressed in memory while it is only
+   * viewed, trading some slicing speed for memory. The voxels are restored
+   * when the image is processed, and compressed again by CompressImageData.
+   */
+  virtual void SetCompressedStorage(bool flag) = 0;
+  virtual bool IsCompressedStorage() const = 0;
+
+  /**
+   * Compress the voxels of the image if compressed storage is enabled and
+   * the image is not in use. Returns true if the voxels are compressed.
+   */
+  virtual bool CompressImageData() = 0;
+  virtual bool IsImageDataCompressed() const = 0;
+
+  /**
+   * Keep a copy of 4D images with the time points of each voxel stored
+   * together, trading memory for faster sampling of the time series at the
+   * cursor
+   */
+  virtual void SetTimeMajorCopy(bool flag) = 0;
+  virtual bool IsTimeMajorCopy() const = 0;
+
 protected:
 
   /** Write the image to disk with whatever the internal format is */
@@ -590,11 +722,33 @@ public:
    */
   virtual VTKImporterMiniPipeline CreateVTKImporterPipeline() const = 0;
 
+  /**
+   * Create a mini-pipeline that imports a level of the multiresolution
+   * pyramid to VTK (see CreateFloatVectorPyramidLevel). The imported image
+   * is placed so that the VTK to NIFTI transform of the full image applies
+   * to it as well. The importer is NULL if there is no such level (yet).
+   */
+  virtual VTKImporterMiniPipeline CreateVTKImporterPipelineForPyramidLevel(unsigned int level) = 0;
+
   /** Is volume rendering turned on for this layer */
   virtual bool IsVolumeRenderingEnabled() const = 0;
 
   /** Turn on volume rendering for this layer */
   virtual void SetVolumeRenderingEnabled(bool state) = 0;
+
+  /**
+   * Find the parts of a run of voxels starting at the index startIdx whose
+   * intensity is between lower and upper, in internal (not native mapped)
+   * format. The parts are appended to spans as (begin, end) offsets from the
+   * start of the run. Returns false if the intensities can not be read along
+   * the run, i.e., when slicing is not orthogonal. Concurrent calls are safe
+   * once a call has been made from one thread.
+   */
+  virtual bool GetRunLengthIntensityWindowSpans(
+      const itk::ImageRegion<3> &region,
+      const itk::Index<3> &startIdx, long runlength,
+      double lower, double upper,
+      std::vector<std::pair<long, long> > &spans) const = 0;
 };
 
 
@@ -313,6 +313,20 @@ public:
   typedef VectorDerivedQuantityImageWrapperTraits<MaxFunctor> MaxTraits;
   typedef VectorToScalarMeanFunctor<TPixel, float> MeanFunctor;
   typedef VectorDerivedQuantityImageWrapperTraits<MeanFunctor> MeanTraits;
+  typedef VectorToScalarJacobianFunctor<TPixel, float> JacobianFunctor;
+  typedef VectorDerivedQuantityImageWrapperTraits<JacobianFunctor> JacobianTraits;
+};
+
+/**
+ * Traits of scalar images whose floating point data is stored in a compact
+ * integral type (short or unsigned char) with a linear mapping to the native
+ * intensities, see GuidedNativeImageIO::SetFloatImageStorage
+ */
+template<class TPixel>
+class QuantizedImageWrapperTraits
+{
+public:
+  typedef AnatomicScalarImageWrapperTraits<TPixel, true> ScalarTraits;
 };
 
 // Some global typedefs
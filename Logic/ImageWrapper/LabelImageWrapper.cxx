@@ -42,7 +42,29 @@
 =========================================================================*/
 #include "LabelImageWrapper.h"
 #include "UndoDataManager.h"
+#include "SegmentationRecoveryJournal.h"
 #include "Rebroadcaster.h"
+#include "itkMultiThreaderBase.h"
+#include <mutex>
+
+// Expand a region to the bounding box of itself and another region
+static void ExpandRegion(itk::ImageRegion<3> &region, const itk::ImageRegion<3> &other)
+{
+  if(region.GetNumberOfPixels() == 0)
+    {
+    region = other;
+    return;
+    }
+
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    itk::IndexValueType i0 = std::min(region.GetIndex(d), other.GetIndex(d));
+    itk::IndexValueType i1 = std::max(region.GetIndex(d) + (itk::IndexValueType) region.GetSize(d),
+                                      other.GetIndex(d) + (itk::IndexValueType) other.GetSize(d));
+    region.SetIndex(d, i0);
+    region.SetSize(d, i1 - i0);
+    }
+}
 
 LabelImageWrapper::LabelImageWrapper()
 {
@@ -50,6 +72,8 @@ LabelImageWrapper::LabelImageWrapper()
 
 LabelImageWrapper::~LabelImageWrapper()
 {
+  // The undo managers are reported to the memory accounting
+  m_MemoryRegistration.Reset();
   for(auto p : m_TimePointUndoManagers)
     delete p;
 }
@@ -65,10 +89,26 @@ void LabelImageWrapper::UpdateWrappedImages(
   for(auto p : m_TimePointUndoManagers)
     delete p;
 
-  // Set up new undo managers
+  // Set up new undo managers. Older commits are compressed and spilled to
+  // disk, so the history is mostly bounded by the memory budget
   m_TimePointUndoManagers.resize(this->GetNumberOfTimePoints());
   for(auto &p : m_TimePointUndoManagers)
-    p = new UndoManagerType(4, 200000);
+    {
+    p = new UndoManagerType(4, 20000000);
+    p->SetMemoryBudget(256 * 1024 * 1024 / this->GetNumberOfTimePoints());
+    }
+
+  // Reset the label change journals
+  m_TimePointLabelChangeJournals.clear();
+  m_TimePointLabelChangeJournals.resize(this->GetNumberOfTimePoints());
+
+  // Reset the label counts
+  m_TimePointLabelCounts.clear();
+  m_TimePointLabelCounts.resize(this->GetNumberOfTimePoints());
+
+  // The recovery journal starts over with the new images
+  if(m_RecoveryJournal)
+    this->RestartRecoveryJournal();
 
   // Modified event on the image is rebroadcast as the WrapperImageChangeEvent
   Rebroadcaster::Rebroadcast(image_4d, itk::ModifiedEvent(), this, WrapperImageChangeEvent());
@@ -78,6 +118,20 @@ void LabelImageWrapper::UpdateWrappedImages(
     Rebroadcaster::Rebroadcast(img, itk::ModifiedEvent(), this, WrapperImageChangeEvent());
 }
 
+std::vector<unsigned int>
+LabelImageWrapper::UpdateChangedTimePoints(Image4DType *image_4d)
+{
+  std::vector<unsigned int> changed = Superclass::UpdateChangedTimePoints(image_4d);
+  for(unsigned int tp : changed)
+    m_TimePointUndoManagers[tp]->Clear();
+
+  // The recovery journal starts over from the reloaded images
+  if(changed.size() && m_RecoveryJournal)
+    this->RestartRecoveryJournal();
+
+  return changed;
+}
+
 void LabelImageWrapper::StoreIntermediateUndoDelta(UndoManagerDelta *delta)
 {
   UndoManagerType *um = m_TimePointUndoManagers[m_TimePointIndex];
@@ -94,6 +148,13 @@ void LabelImageWrapper::StoreUndoPoint(const char *text, UndoManagerDelta *delta
 
   // Commit the deltas
   um->CommitStaging(text);
+
+  // Changes made without a delta are checkpointed at the undo point
+  if(m_RecoveryJournal && !this->IsRecoveryJournalInSync())
+    this->UpdateRecoveryJournal(false);
+
+  // The undo history has grown
+  MemoryAccounting::GetInstance()->EnforceBudget();
 }
 
 void LabelImageWrapper::ClearUndoPoints()
@@ -124,32 +185,61 @@ void LabelImageWrapper::Undo()
   // The label image that will undergo undo
   typedef itk::ImageRegionIterator<ImageType> IteratorType;
 
+  // Check if the changes can be journaled
+  bool journal_in_sync = this->IsLabelChangeJournalInSync();
+  bool counts_in_sync = this->AreLabelCountsInSync();
+  bool recovery_in_sync = this->IsRecoveryJournalInSync();
+  LabelCountChanges count_changes;
+
+  // The bounding box of the changes
+  itk::ImageRegion<3> modified;
+
   // Iterate over all the deltas in reverse order
   UndoManagerType::DList::const_reverse_iterator dit = commit.GetDeltas().rbegin();
   for(; dit != commit.GetDeltas().rend(); ++dit)
     {
     // Apply the changes in the current delta
     UndoManagerType::Delta *delta = *dit;
+    ExpandRegion(modified, delta->GetTileBoundingRegion());
 
-    // Iterator for the relevant region in the label image
-    IteratorType lit(m_Image, delta->GetRegion());
-
-    // Iterate over the rles in the delta
-    for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
+    // Iterate over the tiles of the delta
+    for(size_t k = 0; k < delta->GetNumberOfTiles(); k++)
       {
-      size_t n = delta->GetRLELength(i);
-      LabelType d = delta->GetRLEValue(i);
-      for(size_t j = 0; j < n; j++)
+      // Iterator for the relevant region in the label image
+      IteratorType lit(m_Image, delta->GetTileRegion(k));
+
+      // Iterate over the rles in the tile
+      size_t i0 = delta->GetTileFirstRLE(k), i1 = i0 + delta->GetTileNumberOfRLEs(k);
+      for(size_t i = i0; i < i1; i++)
         {
-        if(d != 0)
-          lit.Set(lit.Get() - d);
-        ++lit;
+        size_t n = delta->GetRLELength(i);
+        LabelType d = delta->GetRLEValue(i);
+        for(size_t j = 0; j < n; j++)
+          {
+          if(d != 0)
+            {
+            LabelType l_old = lit.Get(), l_new = l_old - d;
+            lit.Set(l_new);
+            count_changes[l_old]--;
+            count_changes[l_new]++;
+            }
+          ++lit;
+          }
         }
       }
+
+    // Record the changes made by this delta
+    if(journal_in_sync)
+      this->AppendLabelChanges(delta, true);
+    if(recovery_in_sync)
+      m_RecoveryJournal->AppendDelta(m_TimePointIndex, delta, true);
     }
 
   // Set modified flags
-  this->PixelsModified();
+  this->PixelsModifiedInRegion(modified);
+  this->UpdateLabelChangeJournal(journal_in_sync);
+  this->UpdateLabelCounts(counts_in_sync, &count_changes);
+  this->UpdateRecoveryJournal(recovery_in_sync);
 }
 
 bool LabelImageWrapper::IsRedoPossible()
@@ -168,32 +258,61 @@ void LabelImageWrapper::Redo()
   // The label image that will undergo redo
   typedef itk::ImageRegionIterator<ImageType> IteratorType;
 
+  // Check if the changes can be journaled
+  bool journal_in_sync = this->IsLabelChangeJournalInSync();
+  bool counts_in_sync = this->AreLabelCountsInSync();
+  bool recovery_in_sync = this->IsRecoveryJournalInSync();
+  LabelCountChanges count_changes;
+
+  // The bounding box of the changes
+  itk::ImageRegion<3> modified;
+
   // Iterate over all the deltas in reverse order
   UndoManagerType::DList::const_iterator dit = commit.GetDeltas().begin();
   for(; dit != commit.GetDeltas().end(); ++dit)
     {
     // Apply the changes in the current delta
     UndoManagerType::Delta *delta = *dit;
+    ExpandRegion(modified, delta->GetTileBoundingRegion());
 
-    // Iterator for the relevant region in the label image
-    IteratorType lit(m_Image, delta->GetRegion());
-
-    // Iterate over the rles in the delta
-    for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
+    // Iterate over the tiles of the delta
+    for(size_t k = 0; k < delta->GetNumberOfTiles(); k++)
       {
-      size_t n = delta->GetRLELength(i);
-      LabelType d = delta->GetRLEValue(i);
-      for(size_t j = 0; j < n; j++)
+      // Iterator for the relevant region in the label image
+      IteratorType lit(m_Image, delta->GetTileRegion(k));
+
+      // Iterate over the rles in the tile
+      size_t i0 = delta->GetTileFirstRLE(k), i1 = i0 + delta->GetTileNumberOfRLEs(k);
+      for(size_t i = i0; i < i1; i++)
         {
-        if(d != 0)
-          lit.Set(lit.Get() + d);
-        ++lit;
+        size_t n = delta->GetRLELength(i);
+        LabelType d = delta->GetRLEValue(i);
+        for(size_t j = 0; j < n; j++)
+          {
+          if(d != 0)
+            {
+            LabelType l_old = lit.Get(), l_new = l_old + d;
+            lit.Set(l_new);
+            count_changes[l_old]--;
+            count_changes[l_new]++;
+            }
+          ++lit;
+          }
         }
       }
+
+    // Record the changes made by this delta
+    if(journal_in_sync)
+      this->AppendLabelChanges(delta, false);
+    if(recovery_in_sync)
+      m_RecoveryJournal->AppendDelta(m_TimePointIndex, delta, false);
     }
 
   // Set modified flags
-  this->PixelsModified();
+  this->PixelsModifiedInRegion(modified);
+  this->UpdateLabelChangeJournal(journal_in_sync);
+  this->UpdateLabelCounts(counts_in_sync, &count_changes);
+  this->UpdateRecoveryJournal(recovery_in_sync);
 }
 
 const
@@ -216,3 +335,323 @@ LabelImageWrapper::CompressImage() const
   new_cumulative->FinishEncoding();
   return new_cumulative;
 }
+
+void LabelImageWrapper::SetLabelChangeJournalEnabled(bool flag)
+{
+  if(flag == m_LabelChangeJournalEnabled)
+    return;
+
+  // Start the journals from scratch, in sync with the current images
+  m_LabelChangeJournalEnabled = flag;
+  for(unsigned int tp = 0; tp < m_TimePointLabelChangeJournals.size(); tp++)
+    {
+    LabelChangeJournal &j = m_TimePointLabelChangeJournals[tp];
+    j.FirstSerial += j.Runs.size() + 1;
+    j.Runs.clear();
+    j.ImageMTime = m_ImageTimePoints[tp]->GetMTime();
+    }
+}
+
+unsigned long LabelImageWrapper::GetLabelChangeJournalEnd() const
+{
+  if(m_TimePointIndex >= m_TimePointLabelChangeJournals.size())
+    return 0;
+
+  const LabelChangeJournal &j = m_TimePointLabelChangeJournals[m_TimePointIndex];
+  return j.FirstSerial + j.Runs.size();
+}
+
+bool LabelImageWrapper::GetLabelChangesSince(unsigned long serial, LabelChangeRunList &runs) const
+{
+  runs.clear();
+  if(!m_LabelChangeJournalEnabled || !this->IsLabelChangeJournalInSync())
+    return false;
+
+  // The changes since serial must still be in the journal
+  const LabelChangeJournal &j = m_TimePointLabelChangeJournals[m_TimePointIndex];
+  if(serial < j.FirstSerial || serial > j.FirstSerial + j.Runs.size())
+    return false;
+
+  runs.assign(j.Runs.begin() + (serial - j.FirstSerial), j.Runs.end());
+  return true;
+}
+
+bool LabelImageWrapper::IsLabelChangeJournalInSync() const
+{
+  if(!m_LabelChangeJournalEnabled || m_TimePointIndex >= m_TimePointLabelChangeJournals.size())
+    return false;
+
+  const LabelChangeJournal &j = m_TimePointLabelChangeJournals[m_TimePointIndex];
+  return j.ImageMTime == m_ImageTimePoints[m_TimePointIndex]->GetMTime();
+}
+
+void LabelImageWrapper::AppendLabelChanges(UndoManagerDelta *delta, bool reverse)
+{
+  LabelChangeJournal &j = m_TimePointLabelChangeJournals[m_TimePointIndex];
+  ImageType *image = m_ImageTimePoints[m_TimePointIndex];
+
+  // Each tile of the delta is stored in the order of voxels in its region
+  for(size_t t = 0; t < delta->GetNumberOfTiles(); t++)
+    {
+    const itk::ImageRegion<3> &region = delta->GetTileRegion(t);
+    long nx = region.GetSize(0), ny = region.GetSize(1);
+    long offset = 0;
+
+    size_t i0 = delta->GetTileFirstRLE(t), i1 = i0 + delta->GetTileNumberOfRLEs(t);
+    for(size_t i = i0; i < i1; i++)
+      {
+      long n = delta->GetRLELength(i);
+      PixelType d = delta->GetRLEValue(i);
+      if(d != 0)
+        {
+        // Break the run up into pieces that lie along a single image row
+        for(long k = offset; k < offset + n; )
+          {
+          itk::Index<3> idx = region.GetIndex();
+          idx[0] += k % nx;
+          idx[1] += (k / nx) % ny;
+          idx[2] += k / (nx * ny);
+          long len = std::min(offset + n - k, nx - (k % nx));
+
+          itk::ImageRegion<3> row(idx, {{ (itk::SizeValueType) len, 1, 1 }});
+          itk::ImageRegionConstIterator<ImageType> it(image, row);
+          for(long q = 0; q < len; q++, ++it)
+            {
+            // The label has already been updated, so recover the old one
+            PixelType l_new = it.Get();
+            PixelType l_old = reverse ? (PixelType)(l_new + d) : (PixelType)(l_new - d);
+
+            // Extend the last run if possible
+            if(q > 0)
+              {
+              LabelChangeRun &last = j.Runs.back();
+              if(last.OldLabel == l_old && last.NewLabel == l_new)
+                {
+                last.Length++;
+                continue;
+                }
+              }
+
+            LabelChangeRun run;
+            run.Start = idx; run.Start[0] += q;
+            run.Length = 1;
+            run.OldLabel = l_old;
+            run.NewLabel = l_new;
+            j.Runs.push_back(run);
+            }
+
+          k += len;
+          }
+        }
+      offset += n;
+      }
+    }
+
+  // Keep the journal from growing without bound
+  while(j.Runs.size() > LABEL_CHANGE_JOURNAL_MAX_RUNS)
+    {
+    j.Runs.pop_front();
+    j.FirstSerial++;
+    }
+}
+
+void LabelImageWrapper::UpdateLabelChangeJournal(bool was_in_sync)
+{
+  if(!m_LabelChangeJournalEnabled)
+    return;
+
+  LabelChangeJournal &j = m_TimePointLabelChangeJournals[m_TimePointIndex];
+  if(!was_in_sync)
+    {
+    // Changes were made that we did not see. Clients holding earlier serial
+    // numbers will have to rescan the image.
+    j.FirstSerial += j.Runs.size() + 1;
+    j.Runs.clear();
+    }
+  j.ImageMTime = m_ImageTimePoints[m_TimePointIndex]->GetMTime();
+}
+
+void LabelImageWrapper::PixelsModifiedWithDelta(
+    UndoManagerDelta *delta, const LabelCountChanges *count_changes)
+{
+  bool journal_in_sync = this->IsLabelChangeJournalInSync();
+  if(journal_in_sync)
+    this->AppendLabelChanges(delta, false);
+
+  bool counts_in_sync = this->AreLabelCountsInSync();
+
+  bool recovery_in_sync = this->IsRecoveryJournalInSync();
+  if(recovery_in_sync)
+    m_RecoveryJournal->AppendDelta(m_TimePointIndex, delta, false);
+
+  this->PixelsModifiedInRegion(delta->GetTileBoundingRegion());
+  this->UpdateLabelChangeJournal(journal_in_sync);
+  this->UpdateLabelCounts(counts_in_sync, count_changes);
+  this->UpdateRecoveryJournal(recovery_in_sync);
+}
+
+bool LabelImageWrapper::AreLabelCountsInSync() const
+{
+  if(m_TimePointIndex >= m_TimePointLabelCounts.size())
+    return false;
+
+  const LabelCounts &lc = m_TimePointLabelCounts[m_TimePointIndex];
+  return lc.Valid && lc.ImageMTime == m_ImageTimePoints[m_TimePointIndex]->GetMTime();
+}
+
+void LabelImageWrapper::UpdateLabelCounts(
+    bool was_in_sync, const LabelCountChanges *count_changes)
+{
+  if(m_TimePointIndex >= m_TimePointLabelCounts.size())
+    return;
+
+  LabelCounts &lc = m_TimePointLabelCounts[m_TimePointIndex];
+  if(!was_in_sync || !count_changes)
+    {
+    lc.Valid = false;
+    return;
+    }
+
+  for(const auto &it : *count_changes)
+    lc.Counts[it.first] += it.second;
+  lc.ImageMTime = m_ImageTimePoints[m_TimePointIndex]->GetMTime();
+}
+
+unsigned long LabelImageWrapper::GetNumberOfVoxelsWithLabel(PixelType label) const
+{
+  if(m_TimePointIndex >= m_TimePointLabelCounts.size())
+    return 0;
+
+  LabelCounts &lc = m_TimePointLabelCounts[m_TimePointIndex];
+  if(!this->AreLabelCountsInSync())
+    {
+    // Count the runs of all labels, one slice per job
+    const ImageType *image = m_ImageTimePoints[m_TimePointIndex];
+    const ImageType::BufferType *buffer = image->GetBuffer();
+    itk::ImageRegion<2> r_lines = buffer->GetBufferedRegion();
+
+    std::mutex mutex;
+    lc.Counts.clear();
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray(0, r_lines.GetSize(1), [&](itk::SizeValueType z)
+      {
+      std::unordered_map<PixelType, unsigned long> counts;
+      itk::Index<2> bi;
+      bi[1] = r_lines.GetIndex(1) + z;
+      for(itk::SizeValueType y = 0; y < r_lines.GetSize(0); y++)
+        {
+        bi[0] = r_lines.GetIndex(0) + y;
+        for(const auto &seg : buffer->GetPixel(bi))
+          counts[seg.second] += seg.first;
+        }
+
+      std::lock_guard<std::mutex> guard(mutex);
+      for(const auto &it : counts)
+        lc.Counts[it.first] += it.second;
+      }, nullptr);
+
+    lc.ImageMTime = image->GetMTime();
+    lc.Valid = true;
+    }
+
+  auto it = lc.Counts.find(label);
+  return it == lc.Counts.end() ? 0 : it->second;
+}
+
+void LabelImageWrapper::SetRecoveryJournal(SegmentationRecoveryJournal *journal)
+{
+  m_RecoveryJournal = journal;
+  if(m_RecoveryJournal)
+    this->RestartRecoveryJournal();
+}
+
+void LabelImageWrapper::RestartRecoveryJournal()
+{
+  SegmentationRecoveryJournal::ImageList images(m_ImageTimePoints.size());
+  m_RecoveryJournalImageMTimes.resize(m_ImageTimePoints.size());
+  for(unsigned int tp = 0; tp < m_ImageTimePoints.size(); tp++)
+    {
+    images[tp] = m_ImageTimePoints[tp];
+    m_RecoveryJournalImageMTimes[tp] = m_ImageTimePoints[tp]->GetMTime();
+    }
+
+  m_RecoveryJournal->Restart(images);
+}
+
+bool LabelImageWrapper::IsRecoveryJournalInSync() const
+{
+  if(!m_RecoveryJournal || m_TimePointIndex >= m_RecoveryJournalImageMTimes.size())
+    return false;
+
+  return m_RecoveryJournalImageMTimes[m_TimePointIndex]
+      == m_ImageTimePoints[m_TimePointIndex]->GetMTime();
+}
+
+void LabelImageWrapper::UpdateRecoveryJournal(bool was_in_sync)
+{
+  if(!m_RecoveryJournal || m_TimePointIndex >= m_RecoveryJournalImageMTimes.size())
+    return;
+
+  // A long journal is replaced by a checkpoint of all the time points
+  if(m_RecoveryJournal->IsCompactionNeeded())
+    {
+    this->RestartRecoveryJournal();
+    return;
+    }
+
+  // Changes were made that the journal did not see
+  ImageType *image = m_ImageTimePoints[m_TimePointIndex];
+  if(!was_in_sync)
+    m_RecoveryJournal->AppendCheckpoint(m_TimePointIndex, image);
+
+  m_RecoveryJournalImageMTimes[m_TimePointIndex] = image->GetMTime();
+}
+
+void LabelImageWrapper::OnTimePointHeaderModified(
+    unsigned int tp, itk::ModifiedTimeType mtime_before)
+{
+  itk::ModifiedTimeType mtime = m_ImageTimePoints[tp]->GetMTime();
+
+  if(tp < m_TimePointLabelChangeJournals.size()
+     && m_TimePointLabelChangeJournals[tp].ImageMTime == mtime_before)
+    m_TimePointLabelChangeJournals[tp].ImageMTime = mtime;
+
+  if(tp < m_TimePointLabelCounts.size()
+     && m_TimePointLabelCounts[tp].ImageMTime == mtime_before)
+    m_TimePointLabelCounts[tp].ImageMTime = mtime;
+
+  if(tp < m_RecoveryJournalImageMTimes.size()
+     && m_RecoveryJournalImageMTimes[tp] == mtime_before)
+    m_RecoveryJournalImageMTimes[tp] = mtime;
+}
+
+bool LabelImageWrapper::RestoreFromRecoveryJournal(const std::string &filename)
+{
+  SegmentationRecoveryJournal::ImageList images(m_ImageTimePoints.begin(), m_ImageTimePoints.end());
+  if(!SegmentationRecoveryJournal::Replay(filename, images))
+    return false;
+
+  // The history does not apply to the restored images
+  this->ClearUndoPointsForAllTimePoints();
+  this->PixelsModified();
+  if(m_RecoveryJournal)
+    this->RestartRecoveryJournal();
+  return true;
+}
+
+void LabelImageWrapper::GetMemoryUsage(MemoryAccounting::Usage &usage) const
+{
+  Superclass::GetMemoryUsage(usage);
+  for(auto um : m_TimePointUndoManagers)
+    usage.Bytes[MemoryAccounting::UNDO_HISTORY] += um->GetMemorySize();
+}
+
+void LabelImageWrapper::ReclaimMemory(MemoryAccounting::ReclaimLevel level)
+{
+  Superclass::ReclaimMemory(level);
+  if(level == MemoryAccounting::RECLAIM_DERIVED_DATA || level == MemoryAccounting::RECLAIM_PAGE_OUT)
+    {
+    for(auto um : m_TimePointUndoManagers)
+      um->ReleaseMemory(level == MemoryAccounting::RECLAIM_PAGE_OUT);
+    }
+}
@@ -3,10 +3,15 @@
 
 #include "ImageWrapperTraits.h"
 #include "ScalarImageWrapper.h"
+#include <deque>
+#include <map>
+#include <unordered_map>
 
 template <typename TPixel> class UndoDataManager;
 template <typename TPixel> class UndoDelta;
 class SegmentationUpdateIterator;
+class SegmentationRunWriter;
+class SegmentationRecoveryJournal;
 
 class LabelImageWrapper : public ScalarImageWrapper<LabelImageWrapperTraits>
 {
@@ -33,6 +38,10 @@ public:
 
   // We are friends with the SegmentationUpdateIterator
   friend class SegmentationUpdateIterator;
+  friend class SegmentationRunWriter;
+
+  /** Changes to the number of voxels with each label made by an update */
+  typedef std::map<PixelType, long> LabelCountChanges;
 
   /**
    * We override the SetImage method to reset the undo manager when an image is
@@ -42,6 +51,12 @@ public:
                                    ImageBaseType *refSpace = NULL,
                                    ITKTransformType *tran = NULL) ITK_OVERRIDE;
 
+  /**
+   * The undo points of the time points that are replaced by this method no
+   * longer apply to them, and are cleared
+   */
+  virtual std::vector<unsigned int> UpdateChangedTimePoints(Image4DType *image_4d) ITK_OVERRIDE;
+
   /**
    * Store an intermediate delta without committing it as an undo point
    * Multiple deltas can be stored and then committed with StoreUndoPoint()
@@ -83,16 +98,164 @@ public:
    * array created in this call. */
   UndoManagerDelta *CompressImage() const;
 
+  /**
+   * A run of voxels along the x axis whose label was changed from OldLabel
+   * to NewLabel by an update that produced an undo delta.
+   */
+  struct LabelChangeRun
+  {
+    itk::Index<3> Start;
+    long Length;
+    PixelType OldLabel, NewLabel;
+  };
+
+  typedef std::vector<LabelChangeRun> LabelChangeRunList;
+
+  /**
+   * Enable the label change journal. When enabled, each update performed
+   * through the SegmentationUpdateIterator, as well as undo and redo, is
+   * recorded as a list of label change runs for the current time point. This
+   * allows clients such as SegmentationStatistics to update summaries of the
+   * label image in time proportional to the number of changed voxels.
+   */
+  void SetLabelChangeJournalEnabled(bool flag);
+  bool GetLabelChangeJournalEnabled() const { return m_LabelChangeJournalEnabled; }
+
+  /** Serial number one past the last recorded label change run */
+  unsigned long GetLabelChangeJournalEnd() const;
+
+  /**
+   * Get the label change runs recorded for the current time point since the
+   * given serial number (obtained from GetLabelChangeJournalEnd). Returns
+   * false if the journal does not account for all the changes to the image
+   * since then (e.g., the image was modified without an undo delta, or the
+   * journal was trimmed), in which case the caller must rescan the image.
+   */
+  bool GetLabelChangesSince(unsigned long serial, LabelChangeRunList &runs) const;
+
+  /**
+   * Get the number of voxels with the given label at the current time point.
+   * The counts of all labels are computed from the runs of the image in one
+   * multithreaded pass, and are then kept up to date by the updates made
+   * through the SegmentationUpdateIterator and SegmentationRunWriter, and by
+   * undo and redo. The image is only rescanned if it was modified otherwise.
+   */
+  unsigned long GetNumberOfVoxelsWithLabel(PixelType label) const;
+
+  /**
+   * Record the changes to this segmentation in a crash recovery journal. The
+   * journal is restarted with a checkpoint of all the time points, and then
+   * receives the undo deltas of the updates, undo and redo. Changes made
+   * without an undo delta are recorded as a checkpoint of the time point at
+   * the next undo point. The journal is not owned by the wrapper; pass NULL
+   * to stop recording.
+   */
+  void SetRecoveryJournal(SegmentationRecoveryJournal *journal);
+  SegmentationRecoveryJournal *GetRecoveryJournal() const { return m_RecoveryJournal; }
+
+  /**
+   * Replace the contents of all the time points with the segmentation
+   * recorded in a recovery journal file. The undo history is cleared. Returns
+   * false if the journal does not match this segmentation.
+   */
+  bool RestoreFromRecoveryJournal(const std::string &filename);
+
+  /** Adds the undo history of all the time points to the memory usage */
+  void GetMemoryUsage(MemoryAccounting::Usage &usage) const ITK_OVERRIDE;
+
+  /**
+   * In addition to the image memory, compresses the undo history, and then
+   * moves it to the spill file, when the memory budget is exceeded
+   */
+  void ReclaimMemory(MemoryAccounting::ReclaimLevel level) ITK_OVERRIDE;
+
 protected:
 
   LabelImageWrapper();
   ~LabelImageWrapper();
 
+  // The journal of label changes for a single time point
+  struct LabelChangeJournal
+  {
+    // The recorded runs, and the serial number of the first run
+    std::deque<LabelChangeRun> Runs;
+    unsigned long FirstSerial = 0;
+
+    // The modified time of the time point image after the last recorded change
+    itk::ModifiedTimeType ImageMTime = 0;
+  };
+
+  // Is the journal in sync with the image at the current time point, i.e.,
+  // have all the changes to the image been journaled
+  bool IsLabelChangeJournalInSync() const;
+
+  // Decode a delta (applied in forward or reverse direction) into label
+  // change runs. This must be called after the delta has been applied
+  void AppendLabelChanges(UndoManagerDelta *delta, bool reverse);
+
+  // Called after PixelsModified() to record the new image time stamp, or to
+  // restart the journal if it was out of sync before the change
+  void UpdateLabelChangeJournal(bool was_in_sync);
+
+  // Called by the SegmentationUpdateIterator in place of PixelsModified().
+  // The label count changes are optional, without them the counts will be
+  // recomputed on the next query
+  void PixelsModifiedWithDelta(UndoManagerDelta *delta,
+                               const LabelCountChanges *count_changes = nullptr);
+
+  // The number of voxels with each label for a single time point
+  struct LabelCounts
+  {
+    std::unordered_map<PixelType, unsigned long> Counts;
+
+    // The modified time of the time point image when the counts were taken
+    itk::ModifiedTimeType ImageMTime = 0;
+    bool Valid = false;
+  };
+
+  // Are the label counts for the current time point up to date
+  bool AreLabelCountsInSync() const;
+
+  // Called after PixelsModified() to apply the changes to the label counts,
+  // if they were up to date before the changes were made
+  void UpdateLabelCounts(bool was_in_sync, const LabelCountChanges *count_changes);
+
+  // Has every change to the current time point been recorded in the recovery
+  // journal
+  bool IsRecoveryJournalInSync() const;
+
+  // Called after PixelsModified() to record the new image time stamp, or to
+  // checkpoint the time point if it was out of sync before the change. Also
+  // compacts the journal when it grows too long
+  void UpdateRecoveryJournal(bool was_in_sync);
+
+  // Start the recovery journal over from the current images
+  void RestartRecoveryJournal();
+
+  // The label change journal, the label counts and the recovery journal only
+  // depend on the voxels, so a header change leaves them in sync
+  void OnTimePointHeaderModified(unsigned int tp, itk::ModifiedTimeType mtime_before) ITK_OVERRIDE;
+
   // Undo data manager, stores 'deltas', i.e., differences between states of the segmentation
   // image. These deltas are compressed, allowing us to store a bunch of
   // undo steps with little cost in performance or memory. We currently associate each time
   // point with its own undo manager
   std::vector<UndoManagerType *> m_TimePointUndoManagers;
+
+  // Label change journal for each time point
+  std::vector<LabelChangeJournal> m_TimePointLabelChangeJournals;
+  bool m_LabelChangeJournalEnabled = false;
+
+  // Label counts for each time point, computed on demand
+  mutable std::vector<LabelCounts> m_TimePointLabelCounts;
+
+  // Crash recovery journal and the modified times of the time point images
+  // when they were last recorded in it
+  SegmentationRecoveryJournal *m_RecoveryJournal = nullptr;
+  std::vector<itk::ModifiedTimeType> m_RecoveryJournalImageMTimes;
+
+  // Maximum number of runs kept in each journal
+  static const size_t LABEL_CHANGE_JOURNAL_MAX_RUNS = 1000000;
 };
 
 #endif // LABELIMAGEWRAPPER_H
@@ -20,13 +20,23 @@
 #include "itkRGBAPixel.h"
 #include "itkImageToImageFilter.h"
 #include "ColorLabelTable.h"
+#include "SliceUpdateHistory.h"
+#include "SliceBufferPool.h"
 
 #include <itkRGBAPixel.h>
 #include <itkNumericTraitsRGBAPixel.h>
+#include <itkMultiThreaderBase.h>
+#include <algorithm>
+#include <set>
+#include <vector>
 
 /**
  * \class LabelToRGBAFilter
  * \brief Simple filter that maps label image to RGB color image
+ *
+ * The display color of every label value is kept in a flat lookup table that
+ * is only refilled when the color table changes. Runs of identical labels
+ * are filled with a single color, and bands of lines are mapped in parallel.
  */
 class LabelToRGBAFilter: 
   public itk::ImageToImageFilter<
@@ -70,8 +80,25 @@ public:
     return m_ColorTable;
   }
 
+  /**
+   * Set the filter producing the input slice, if it keeps track of the
+   * changed parts of the slice. Then, when the color table has not changed,
+   * only the changed part of the slice is mapped to colors.
+   */
+  void SetSliceUpdateHistory(const SliceUpdateHistory *history)
+  {
+    m_SliceUpdateHistory = history;
+  }
+
 protected:
 
+  LabelToRGBAFilter() : m_ColorTable(NULL), m_SliceUpdateHistory(NULL)
+    {
+    // Keep the output between updates, so that its buffer is reused and the
+    // colors of the unchanged parts of the slice remain valid
+    this->ReleaseDataBeforeUpdateFlagOff();
+    }
+
   void PrintSelf(std::ostream& os, itk::Indent indent) const ITK_OVERRIDE
     { os << indent << "LabelToRGBAFilter"; }
   
@@ -83,44 +110,127 @@ protected:
     OutputImageType::Pointer outputPtr = this->GetOutput();
 
     // Get the number of pixels in the input
-    size_t n = inputPtr->GetBufferedRegion().GetNumberOfPixels();
+    const InputImageType::RegionType &region = inputPtr->GetBufferedRegion();
+    size_t n = region.GetNumberOfPixels();
+
+    // Rebuild the color lookup table if the color table changed
+    bool colors_changed = this->UpdateColorLookupTable();
+
+    // If only a part of the slice changed since the last update, and the
+    // output still holds the colors of the rest of it, only map that part
+    InputImageType::RegionType changed = region;
+    if(m_SliceUpdateHistory && outputPtr->GetBufferedRegion() == region && !colors_changed
+       && m_SliceUpdateHistory->GetSliceRegionModifiedSince(m_LastSliceVersion, changed))
+      {
+      if(!changed.Crop(region))
+        changed = InputImageType::RegionType();
+      }
+    else
+      {
+      changed = region;
+      }
 
     // Allocate output if needed
     if(outputPtr->GetBufferedRegion().GetNumberOfPixels() != n)
       {
       outputPtr->SetBufferedRegion(inputPtr->GetBufferedRegion());
-      outputPtr->Allocate();
+      AllocatePooledImage(outputPtr.GetPointer());
       }
 
-    // Get the clear label
-    const ColorLabel &clear = m_ColorTable->GetColorLabel(0);
-    const ColorLabel *cllast = &clear;
+    // Map the changed region in bands of lines, in parallel
+    size_t stride = region.GetSize(0), w = changed.GetSize(0), h = changed.GetSize(1);
+    size_t offset = (changed.GetIndex(0) - region.GetIndex(0))
+                    + (changed.GetIndex(1) - region.GetIndex(1)) * stride;
+    const LabelType *xin = inputPtr->GetBufferPointer() + offset;
+    OutputPixelType *xout = outputPtr->GetBufferPointer() + offset;
+
+    size_t band = std::max((size_t) 1, (size_t) MIN_PIXELS_PER_BAND / std::max(w, (size_t) 1));
+    size_t n_bands = (h + band - 1) / band;
+    auto map_band = [&](size_t k)
+      {
+      size_t j1 = std::min(h, (k + 1) * band);
+      for(size_t j = k * band; j < j1; j++)
+        this->MapLine(xin + j * stride, xout + j * stride, w);
+      };
+
+    if(n_bands > 1)
+      {
+      itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+      mt->ParallelizeArray(0, n_bands, map_band, nullptr);
+      }
+    else if(n_bands == 1)
+      {
+      map_band(0);
+      }
 
-    // Keep track of the last pixel - this reduces the amount of color label
-    // lookups, taking advantage of the fact that segmentations are homogeneous
-    InputPixelType last_pixel = 0;
+    if(m_SliceUpdateHistory)
+      m_LastSliceVersion = m_SliceUpdateHistory->GetSliceVersion();
+    }
 
-    // Simple loop
-    const LabelType *xin = inputPtr->GetBufferPointer(), *xinend = xin + n;
-    OutputPixelType *xout = outputPtr->GetBufferPointer();
-    for(; xin < xinend; ++xin, ++xout)
+  /**
+   * Fill the lookup table of display colors from the color table, if the
+   * color table changed since it was last filled. Returns true if it did.
+   */
+  bool UpdateColorLookupTable()
+    {
+    if(m_ColorLUT.size() && m_ColorLUTSource == m_ColorTable)
       {
-      if(*xin != last_pixel)
+      if(m_ColorLUTMTime == m_ColorTable->GetMTime())
+        return false;
+
+      // Refill only the entries of the labels that changed. Hidden labels
+      // take the color of the clear label, so a change to it affects all.
+      std::set<LabelType> changed;
+      if(m_ColorTable->GetLabelsChangedSince(m_ColorLUTMTime, changed) && !changed.count(0))
         {
-        last_pixel = *xin;
-        const ColorLabel &cl = m_ColorTable->GetColorLabel(last_pixel);
-        if(cl.IsVisible())
-          cllast = &cl;
-        else
-          cllast = &clear;
+        for(LabelType id : changed)
+          m_ColorTable->GetDisplayColor(id, m_ColorLUT[id].GetDataPointer());
+        m_ColorLUTMTime = m_ColorTable->GetMTime();
+        return true;
         }
+      }
 
-      cllast->GetRGBAVector(xout->GetDataPointer());
+    m_ColorLUT.resize(ColorLabelTable::DISPLAY_COLOR_TABLE_SIZE);
+    m_ColorTable->GetDisplayColorTable(m_ColorLUT.front().GetDataPointer());
+    m_ColorLUTSource = m_ColorTable;
+    m_ColorLUTMTime = m_ColorTable->GetMTime();
+    return true;
+    }
+
+  /** Map a line of pixels to colors, one run of identical labels at a time */
+  void MapLine(const LabelType *xin, OutputPixelType *xout, size_t n) const
+    {
+    const OutputPixelType *lut = m_ColorLUT.data();
+    const LabelType *xinend = xin + n;
+    while(xin < xinend)
+      {
+      // Find the end of the run of the current label
+      const LabelType *run = xin + 1;
+      while(run < xinend && *run == *xin)
+        ++run;
+
+      // Fill the run with the color of the label
+      std::fill(xout, xout + (run - xin), lut[*xin]);
+      xout += run - xin;
+      xin = run;
       }
     }
 
+  // Lines are mapped in parallel in bands of at least this many pixels
+  static constexpr size_t MIN_PIXELS_PER_BAND = 0x8000;
+
 private:
   ColorLabelTable *m_ColorTable;
+
+  // The source of the input slice, and the state of the input and the color
+  // table when the output was last generated
+  const SliceUpdateHistory *m_SliceUpdateHistory;
+  unsigned long m_LastSliceVersion = 0;
+
+  // Display color of every label value, and the table it was filled from
+  std::vector<OutputPixelType> m_ColorLUT;
+  const ColorLabelTable *m_ColorLUTSource = NULL;
+  itk::ModifiedTimeType m_ColorLUTMTime = 0;
 };
 
 #endif
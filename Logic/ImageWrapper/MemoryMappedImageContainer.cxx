@@ -0,0 +1,140 @@
+#include "MemoryMappedImageContainer.h"
+
+#if defined(WIN32)
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+void *MemoryMappedFileRegion::Map(const char *filename, size_t offset, size_t length)
+{
+  this->Unmap();
+  if(length == 0)
+    return nullptr;
+
+#if defined(WIN32)
+
+  // Mapping offsets must be aligned to the allocation granularity
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  size_t align = offset % si.dwAllocationGranularity;
+
+  HANDLE hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(hFile == INVALID_HANDLE_VALUE)
+    return nullptr;
+
+  HANDLE hMap = CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  if(!hMap)
+    {
+    CloseHandle(hFile);
+    return nullptr;
+    }
+
+  unsigned long long start = offset - align;
+  void *base = MapViewOfFile(hMap, FILE_MAP_COPY,
+                             (DWORD) (start >> 32), (DWORD) (start & 0xffffffff),
+                             length + align);
+  if(!base)
+    {
+    CloseHandle(hMap);
+    CloseHandle(hFile);
+    return nullptr;
+    }
+
+  m_FileHandle = hFile;
+  m_MappingHandle = hMap;
+
+#else
+
+  // Mapping offsets must be aligned to the page size
+  size_t align = offset % (size_t) sysconf(_SC_PAGE_SIZE);
+
+  int fd = open(filename, O_RDONLY);
+  if(fd < 0)
+    return nullptr;
+
+  // The mapping keeps its own reference to the file
+  void *base = mmap(nullptr, length + align, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, (off_t) (offset - align));
+  close(fd);
+  if(base == MAP_FAILED)
+    return nullptr;
+
+#endif
+
+  m_Base = base;
+  m_MappedLength = length + align;
+  m_Align = align;
+  return static_cast<char *>(base) + align;
+}
+
+void MemoryMappedFileRegion::Release(size_t offset, size_t length)
+{
+  if(!m_Base)
+    return;
+
+#if defined(WIN32)
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  size_t page = si.dwPageSize;
+#else
+  size_t page = (size_t) sysconf(_SC_PAGE_SIZE);
+#endif
+
+  // Only whole pages inside the range are released, so that neighboring
+  // data sharing a page is unaffected
+  size_t start = m_Align + offset, end = start + length;
+  if(end > m_MappedLength)
+    end = m_MappedLength;
+  start = ((start + page - 1) / page) * page;
+  end = (end / page) * page;
+  if(end <= start)
+    return;
+
+  char *p = static_cast<char *>(m_Base) + start;
+#if defined(WIN32)
+  // Unlocking pages that are not locked removes them from the working set.
+  // Modified copy-on-write pages go to the paging file, so nothing is lost
+  VirtualUnlock(p, end - start);
+#else
+  madvise(p, end - start, MADV_DONTNEED);
+#endif
+}
+
+void MemoryMappedFileRegion::Unmap()
+{
+  if(!m_Base)
+    return;
+
+#if defined(WIN32)
+  UnmapViewOfFile(m_Base);
+  CloseHandle((HANDLE) m_MappingHandle);
+  CloseHandle((HANDLE) m_FileHandle);
+  m_MappingHandle = m_FileHandle = nullptr;
+#else
+  munmap(m_Base, m_MappedLength);
+#endif
+
+  m_Base = nullptr;
+  m_MappedLength = 0;
+  m_Align = 0;
+}
+
+long long MemoryMappedFileRegion::GetFileSize(const char *filename)
+{
+#if defined(WIN32)
+  WIN32_FILE_ATTRIBUTE_DATA fad;
+  if(!GetFileAttributesExA(filename, GetFileExInfoStandard, &fad))
+    return -1;
+  return ((long long) fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+#else
+  struct stat st;
+  if(stat(filename, &st) != 0)
+    return -1;
+  return (long long) st.st_size;
+#endif
+}
@@ -0,0 +1,105 @@
+#ifndef MEMORYMAPPEDIMAGECONTAINER_H
+#define MEMORYMAPPEDIMAGECONTAINER_H
+
+#include <itkImportImageContainer.h>
+#include <itkObjectFactory.h>
+#include <cstddef>
+
+/**
+ * A read-only view of a region of a file, mapped into memory with copy-on-write
+ * semantics. Pages are read from disk only when they are first accessed, and
+ * writes to the mapped memory are never propagated to the file.
+ */
+class MemoryMappedFileRegion
+{
+public:
+  MemoryMappedFileRegion() {}
+  ~MemoryMappedFileRegion() { this->Unmap(); }
+
+  MemoryMappedFileRegion(const MemoryMappedFileRegion &) = delete;
+  MemoryMappedFileRegion &operator = (const MemoryMappedFileRegion &) = delete;
+
+  /**
+   * Map length bytes starting at byte offset in the file. Returns a pointer
+   * to the first mapped byte, or nullptr if the mapping could not be created.
+   */
+  void *Map(const char *filename, size_t offset, size_t length);
+
+  /** Release the mapping */
+  void Unmap();
+
+  /**
+   * Drop the pages that lie entirely within length bytes starting at byte
+   * offset (relative to the pointer returned by Map) from physical memory.
+   * They are read from the file again when next accessed. On POSIX systems
+   * this discards any writes made to these pages.
+   */
+  void Release(size_t offset, size_t length);
+
+  /** Get the size of a file in bytes, or -1 if the file can not be accessed */
+  static long long GetFileSize(const char *filename);
+
+protected:
+  // Start and length of the mapping, aligned to the page size
+  void *m_Base = nullptr;
+  size_t m_MappedLength = 0;
+
+  // Offset of the requested data from the start of the mapping
+  size_t m_Align = 0;
+
+  // Platform-specific handles
+  void *m_FileHandle = nullptr, *m_MappingHandle = nullptr;
+};
+
+/**
+ * A pixel container whose buffer is a memory-mapped region of an image file.
+ * GuidedNativeImageIO uses it for uncompressed images whose voxels are stored
+ * on disk exactly as they would be in memory, so that reading the image does
+ * not require allocating and filling a buffer up front. The mapping is released
+ * when the container is destroyed.
+ *
+ * Note that the container does not own a heap buffer, so code that manipulates
+ * the import pointer of pixel containers directly (e.g., realloc) must check
+ * for this class.
+ */
+template <typename TElement>
+class MemoryMappedImageContainer
+    : public itk::ImportImageContainer<itk::SizeValueType, TElement>
+{
+public:
+  typedef MemoryMappedImageContainer                                 Self;
+  typedef itk::ImportImageContainer<itk::SizeValueType, TElement>   Superclass;
+  typedef itk::SmartPointer<Self>                                 Pointer;
+  typedef itk::SmartPointer<const Self>                      ConstPointer;
+
+  itkNewMacro(Self)
+  itkTypeMacro(MemoryMappedImageContainer, ImportImageContainer)
+
+  /**
+   * Map n_elements starting at byte offset in the file into this container.
+   * Returns false if the mapping failed, in which case the container is empty.
+   */
+  bool MapFile(const char *filename, size_t offset, size_t n_elements)
+  {
+    void *ptr = m_Region.Map(filename, offset, n_elements * sizeof(TElement));
+    if(!ptr)
+      return false;
+
+    this->SetImportPointer(static_cast<TElement *>(ptr), n_elements, false);
+    return true;
+  }
+
+  /** Drop n_elements starting at element first from physical memory */
+  void ReleaseElements(size_t first, size_t n_elements)
+  {
+    m_Region.Release(first * sizeof(TElement), n_elements * sizeof(TElement));
+  }
+
+protected:
+  MemoryMappedImageContainer() {}
+  ~MemoryMappedImageContainer() override {}
+
+  MemoryMappedFileRegion m_Region;
+};
+
+#endif // MEMORYMAPPEDIMAGECONTAINER_H
@@ -128,6 +128,10 @@ UpdateActorMap(ActorPool *pool, unsigned int timepoint)
 
     // Keep the actor in the map
     actorMap->insert(std::make_pair(it_mesh->first, actor));
+
+    // Heavy meshes are drawn coarsely while the camera moves
+    if (vtkPolyData *preview = it_mesh->second->GetPreviewPolyData())
+      pool->SetPreview(it_mesh->first, it_mesh->second->GetPolyData(), preview);
     }// end of updating actors
   }
 
@@ -216,6 +220,10 @@ UpdateAppearance(ActorPool *pool, unsigned int)
     mapper->SetLookupTable(m_LookupTable);
     mapper->UseLookupTableScalarRangeOn();
 
+    // Map the scalars through a color texture in the shader, so that a
+    // change of lookup table does not recolor every vertex on the CPU
+    mapper->SetInterpolateScalarsBeforeMapping(prop->GetType() == MeshDataType::POINT_DATA);
+
     // -- point/cell data specific logic
     if (prop->GetType() == MeshDataType::POINT_DATA)
       {
@@ -313,6 +321,14 @@ UpdateLUT()
 	dmin = prop->GetMin(activeComp);
 	dmax = prop->GetMax(activeComp);
 
+  // -- Skip rebuilding the table if nothing it depends on has changed
+  LUTState state = { prop, activeComp, dmin, dmax,
+                     m_ColorMap.GetPointer(), m_ColorMap->GetMTime(),
+                     m_IntensityCurve.GetPointer(), m_IntensityCurve->GetMTime() };
+  if (state == m_LUTState)
+    return;
+  m_LUTState = state;
+
 	// -- Find contrast range (ratio)
   double rMin, tMin, rMax, tMax;
 	m_IntensityCurve->GetControlPoint(0, rMin, tMin);
@@ -4,6 +4,7 @@
 #include "DisplayMappingPolicy.h"
 #include "ColorLabelTable.h"
 #include "itkCommand.h"
+#include "vtkType.h"
 
 class vtkScalarBarActor;
 class vtkLookupTable;
@@ -124,6 +125,28 @@ public:
 protected:
   GenericMeshDisplayMappingPolicy();
   virtual ~GenericMeshDisplayMappingPolicy();
+
+  // What the lookup table was last built from
+  struct LUTState
+  {
+    void *Property = nullptr;
+    vtkIdType Component = -1;
+    double Min = 0, Max = 0;
+    void *ColorMap = nullptr;
+    unsigned long ColorMapMTime = 0;
+    void *Curve = nullptr;
+    unsigned long CurveMTime = 0;
+
+    bool operator == (const LUTState &o) const
+    {
+      return Property == o.Property && Component == o.Component
+          && Min == o.Min && Max == o.Max
+          && ColorMap == o.ColorMap && ColorMapMTime == o.ColorMapMTime
+          && Curve == o.Curve && CurveMTime == o.CurveMTime;
+    }
+  };
+
+  LUTState m_LUTState;
 };
 
 /**
@@ -67,6 +67,7 @@ MultiChannelDisplayMode::GetScalarRepNames()
     namemap.AddPair(SCALAR_REP_MAGNITUDE, "Magnitude");
     namemap.AddPair(SCALAR_REP_MAX, "Maximum");
     namemap.AddPair(SCALAR_REP_AVERAGE, "Average");
+    namemap.AddPair(SCALAR_REP_JACOBIAN, "Jacobian");
     }
   return namemap;
 }
@@ -1,5 +1,6 @@
 #include "ScalarImageHistogram.h"
 #include <algorithm>
+#include <cmath>
 #include "TDigestImageFilter.h"
 
 ScalarImageHistogram::ScalarImageHistogram()
@@ -112,6 +113,36 @@ ScalarImageHistogram
     }
 }
 
+void
+ScalarImageHistogram
+::ComputeFromFineHistogram(const Self *fine, double vmin, double vmax, size_t nBins)
+{
+  this->Initialize(vmin, vmax, nBins);
+
+  // Groups of fine bins map exactly onto the bins of this histogram
+  size_t nFine = fine->m_Bins.size();
+  double tol = 1e-9 * std::abs(vmax - vmin);
+  if(fine->m_FirstBinStart == vmin && std::abs(fine->GetBinMax(nFine - 1) - vmax) <= tol
+     && nFine % nBins == 0)
+    {
+    size_t group = nFine / nBins;
+    for(size_t i = 0; i < nFine; i++)
+      if(fine->m_Bins[i])
+        this->AddSamplesToBin(i / group, fine->m_Bins[i]);
+    return;
+    }
+
+  for(size_t i = 0; i < nFine; i++)
+    {
+    if(fine->m_Bins[i])
+      {
+      int index = (int) (m_Scale * (fine->GetBinMin(i) - m_FirstBinStart));
+      index = std::min(std::max(index, 0), m_BinCount - 1);
+      this->AddSamplesToBin(index, fine->m_Bins[i]);
+      }
+    }
+}
+
 void ScalarImageHistogram::ApplyIntensityTransform(double scale, double shift)
 {
   m_FirstBinStart = scale * m_FirstBinStart + shift;
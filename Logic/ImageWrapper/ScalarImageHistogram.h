@@ -23,6 +23,18 @@ public:
 
   void Initialize(double vmin, double vmax, size_t nBins);
   void AddSample(double v);
+
+  /** Add a number of samples directly to a bin */
+  void AddSamplesToBin(size_t iBin, unsigned long n);
+
+  /**
+   * Compute the histogram with the given range and number of bins from a
+   * histogram with finer bins, without going back to the image. The samples
+   * of each fine bin are placed by the bin's lower edge. When the fine
+   * histogram spans the same range with a multiple of the number of bins,
+   * the result is the same as adding the samples directly.
+   */
+  void ComputeFromFineHistogram(const Self *fine, double vmin, double vmax, size_t nBins);
   double GetBinMin(size_t iBin) const;
   double GetBinMax(size_t iBin) const;
   double GetBinCenter(size_t iBin) const;
@@ -92,4 +104,12 @@ inline void ScalarImageHistogram::AddSample(double v)
 
 
 
+inline void ScalarImageHistogram::AddSamplesToBin(size_t iBin, unsigned long n)
+{
+  unsigned long k = (m_Bins[iBin] += n);
+  if(m_MaxFrequency < k)
+    m_MaxFrequency = k;
+  m_TotalSamples += n;
+}
+
 #endif // SCALARIMAGEHISTOGRAM_H
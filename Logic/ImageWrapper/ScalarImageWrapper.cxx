@@ -185,11 +185,14 @@ ScalarImageWrapper<TTraits>
 ::GetRunLengthIntensityStatistics(
     const itk::ImageRegion<3> &region,
     const itk::Index<3> &startIdx, long runlength,
-    double *out_nvalid, double *out_sum, double *out_sumsq) const
+    double *out_nvalid, double *out_sum, double *out_sumsq,
+    int time_point) const
 {
   if(this->IsSlicingOrthogonal())
     {
-    ConstIterator it(this->m_Image, region);
+    const ImageType *image = time_point < 0
+        ? this->GetImage() : this->GetImageByTimePoint(time_point).GetPointer();
+    ConstIterator it(image, region);
     it.SetIndex(startIdx);
 
     // Perform the integration
@@ -212,6 +215,43 @@ ScalarImageWrapper<TTraits>
     }
 }
 
+template<class TTraits>
+bool
+ScalarImageWrapper<TTraits>
+::GetRunLengthIntensityWindowSpans(
+    const itk::ImageRegion<3> &region,
+    const itk::Index<3> &startIdx, long runlength,
+    double lower, double upper,
+    std::vector<std::pair<long, long> > &spans) const
+{
+  if(!this->IsSlicingOrthogonal())
+    return false;
+
+  ConstIterator it(this->GetImage(), region);
+  it.SetIndex(startIdx);
+
+  // NaN voxels are never in the window
+  long begin = -1;
+  for(long q = 0; q < runlength; q++, ++it)
+    {
+    double p = (double) it.Get();
+    if(p >= lower && p <= upper)
+      {
+      if(begin < 0)
+        begin = q;
+      }
+    else if(begin >= 0)
+      {
+      spans.push_back(std::make_pair(begin, q));
+      begin = -1;
+      }
+    }
+  if(begin >= 0)
+    spans.push_back(std::make_pair(begin, runlength));
+
+  return true;
+}
+
 /**
   Get the RGBA apperance of the voxel at the intersection of the three
   display slices.
@@ -243,7 +283,7 @@ ScalarImageWrapper<TTraits>
   using ThumbSlicer = typename SlicerType::NonOrthogonalSlicerType;
   typename ThumbSlicer::Pointer thumb_slicer = ThumbSlicer::New();
   thumb_slicer->SetReferenceImage(ref_space);
-  thumb_slicer->SetInput(this->GetImage());
+  thumb_slicer->SetInput(this->GetThumbnailSamplingImage(ref_space));
 
   // The affine transform is set to identity
   typedef itk::IdentityTransform<double, 3> IdTransformType;
@@ -300,6 +340,43 @@ ScalarImageWrapper<TTraits>::CreateVTKImporterPipeline() const
   return pip;
   }
 
+template<class TTraits>
+typename ScalarImageWrapper<TTraits>::VTKImporterMiniPipeline
+ScalarImageWrapper<TTraits>::CreateVTKImporterPipelineForPyramidLevel(unsigned int level)
+{
+  VTKImporterMiniPipeline pip;
+  typedef typename Superclass::ConcreteImageType ConcreteImageType;
+  ConcreteImageType *src = this->GetConcretePyramidLevel(level);
+  if(!src)
+    return pip;
+
+  // The VTK image of the full image has the origin and spacing of the ITK
+  // image but no direction. Place the level in that space by expressing its
+  // origin relative to the full image along the image axes
+  const ImageBaseType *full = this->GetImageBase();
+  auto offset = src->GetOrigin() - full->GetOrigin();
+  typename ConcreteImageType::PointType origin = full->GetOrigin();
+  for(unsigned int d = 0; d < 3; d++)
+    for(unsigned int j = 0; j < 3; j++)
+      origin[d] += full->GetDirection()(j, d) * offset[j];
+
+  // Share the voxels of the level, only the geometry differs
+  SmartPtr<ConcreteImageType> image = ConcreteImageType::New();
+  image->Graft(src);
+  image->SetOrigin(origin);
+
+  typedef itk::VTKImageExport<ConcreteImageType> Exporter;
+  SmartPtr<Exporter> exporter = Exporter::New();
+  exporter->SetInput(image);
+
+  vtkNew<vtkImageImport> importer;
+  ConnectITKExporterToVTKImporter(exporter.GetPointer(), importer, true, true, false);
+
+  pip.exporter = exporter.GetPointer();
+  pip.importer = importer;
+  return pip;
+}
+
 #include "itkRepresentImageAsVectorImageFilter.h"
 
 template<class TTraits>
@@ -376,7 +453,8 @@ ScalarImageWrapper<TTraits>
   template class ScalarImageWrapper<typename ImageWrapperTraits<type>::ComponentTraits>; \
   template class ScalarImageWrapper<typename ImageWrapperTraits<type>::MagnitudeTraits>; \
   template class ScalarImageWrapper<typename ImageWrapperTraits<type>::MaxTraits>; \
-  template class ScalarImageWrapper<typename ImageWrapperTraits<type>::MeanTraits>;
+  template class ScalarImageWrapper<typename ImageWrapperTraits<type>::MeanTraits>; \
+  template class ScalarImageWrapper<typename ImageWrapperTraits<type>::JacobianTraits>;
 
 ScalarImageWrapperInstantiateMacro(unsigned char)
 ScalarImageWrapperInstantiateMacro(char)
@@ -385,6 +463,9 @@ ScalarImageWrapperInstantiateMacro(short)
 ScalarImageWrapperInstantiateMacro(float)
 ScalarImageWrapperInstantiateMacro(double)
 
+template class ScalarImageWrapper<QuantizedImageWrapperTraits<short>::ScalarTraits>;
+template class ScalarImageWrapper<QuantizedImageWrapperTraits<unsigned char>::ScalarTraits>;
+
 template class ScalarImageWrapper<LabelImageWrapperTraits>;
 template class ScalarImageWrapper<SpeedImageWrapperTraits>;
 template class ScalarImageWrapper<LevelSetImageWrapperTraits>;
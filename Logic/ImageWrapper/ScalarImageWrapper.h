@@ -126,7 +126,16 @@ public:
   virtual void GetRunLengthIntensityStatistics(
       const itk::ImageRegion<3> &region,
       const itk::Index<3> &startIdx, long runlength,
-      double *out_nvalid, double *out_sum, double *out_sumsq) const ITK_OVERRIDE;
+      double *out_nvalid, double *out_sum, double *out_sumsq,
+      int time_point = -1) const ITK_OVERRIDE;
+
+  /** Find the parts of a run of voxels whose internal intensity is in the
+   * window from lower to upper */
+  virtual bool GetRunLengthIntensityWindowSpans(
+      const itk::ImageRegion<3> &region,
+      const itk::Index<3> &startIdx, long runlength,
+      double lower, double upper,
+      std::vector<std::pair<long, long> > &spans) const ITK_OVERRIDE;
 
   /**
    * This method returns a vector of values for the voxel under the cursor.
@@ -187,6 +196,9 @@ public:
    */
   VTKImporterMiniPipeline CreateVTKImporterPipeline() const ITK_OVERRIDE;
 
+  /** Create a mini-pipeline that imports a level of the pyramid to VTK */
+  VTKImporterMiniPipeline CreateVTKImporterPipelineForPyramidLevel(unsigned int level) ITK_OVERRIDE;
+
   /**
    * A reimplementation of CreateCastToFloatVectorPipeline that presents the
    * scalar float image as a float vector image
@@ -4,11 +4,15 @@
 #include <itkDataObject.h>
 #include <itkNumericTraits.h>
 #include "SNAPCommon.h"
+#include "DerivedDataCache.h"
 #include <itkSimpleDataObjectDecorator.h>
 #include <digestible/digestible.h>
 #include <itkVectorImage.h>
 #include <itkImageToImageFilter.h>
 #include <itkImageSink.h>
+#include <vnl/vnl_vector_fixed.h>
+#include <vnl/vnl_matrix_fixed.h>
+#include <vector>
 
 /**
  * A wrapper around the t-digest data structure that can be used in ITK
@@ -25,6 +29,42 @@ public:
   float GetCDF(float value) const { return m_Digest.cumulative_distribution(value); }
   unsigned GetTotalWeight() const { return m_Digest.size(); }
 
+  typedef vnl_vector_fixed<double, 3> Vec3;
+  typedef vnl_matrix_fixed<double, 3, 3> Mat3;
+
+  /**
+   * Spatial moments of the (intensity-transformed) image for one time point,
+   * in voxel index coordinates: the total mass, the center of mass and the
+   * covariance about the center of mass.
+   */
+  struct SpatialMoments
+  {
+    double Mass;
+    Vec3 Center;
+    Mat3 Covariance;
+  };
+
+  /**
+   * Get the spatial moments for a time point. These are accumulated in the
+   * same pass as the digest, so they are available at no cost after Update().
+   * Returns false if the time point is out of range or the mass is not positive
+   */
+  bool GetSpatialMoments(unsigned int time_point, SpatialMoments &moments) const;
+
+  /**
+   * Raw moment sums for one time point. Sums over voxels are kept both weighted
+   * by intensity and unweighted, so that the intensity transform can be applied
+   * afterwards. Voxels with non-finite values are left out.
+   */
+  struct MomentSums
+  {
+    double Count = 0.0, Mass = 0.0;
+    Vec3 CountFirst = Vec3(0.0), MassFirst = Vec3(0.0);
+    Mat3 CountSecond = Mat3(0.0), MassSecond = Mat3(0.0);
+
+    void Add(const MomentSums &other);
+  };
+
   template <class TInputImage> friend class TDigestImageFilter;
 
   static constexpr int DIGEST_SIZE = 1000;
@@ -40,8 +80,11 @@ protected:
   // The number of NaN pixels
   unsigned long m_NaNCount = 0;
 
+  // Moment sums for each time point
+  std::vector<MomentSums> m_MomentSums;
+
   // Intensity transform
-  double m_TransformScale, m_TransformShift;
+  double m_TransformScale = 1.0, m_TransformShift = 0.0;
 };
 
 /**
@@ -120,6 +163,32 @@ public:
    */
   void SetLog2SamplingRate(int log_2_sampling_rate);
 
+  /**
+   * Notify the filter that only the voxels of the given time point have
+   * changed, after the input image has been marked as modified. The digest of
+   * each time point is kept, and on the next update only the time points that
+   * changed are digested again before the digests are merged. If the input is
+   * modified without such a notification, all time points are digested again.
+   */
+  void TimePointModified(unsigned int tp);
+
+  /**
+   * Notify the filter that only the header of the input (e.g., its direction)
+   * has changed, which leaves the digests as they are. The MTime of the input
+   * before the change is passed, and the digests (or the cached ones) that
+   * were up to date with it are considered up to date with the new MTime.
+   */
+  void InputHeaderModified(itk::ModifiedTimeType mtime_before);
+
+  /**
+   * Keep the digests of the time points in the derived data cache under the
+   * given key, which identifies the file the input was read from. The key
+   * applies to the input as it is now: when the digests are computed before
+   * the input is modified, they are read from the cache if it has them, and
+   * stored in it otherwise. An invalid key turns the caching off.
+   */
+  void SetCacheKey(const DerivedDataCache::Key &key);
+
   /**
    * Get the t-digest output, wrapped as an itk::DataObject. Before using this object
    * call Update() on it.
@@ -163,6 +232,34 @@ private:
   // Mutex for combining digests
   std::mutex m_Mutex;
 
+  // The partial results for one time point, which are merged into the output
+  typedef typename TDigestDataObject::TDigest DigestType;
+  struct TimePointDigest
+  {
+    DigestType Digest = DigestType(TDigestDataObject::DIGEST_SIZE);
+    unsigned long NaNCount = 0;
+    TDigestDataObject::MomentSums Moments;
+    bool Valid = false;
+  };
+
+  std::vector<TimePointDigest> m_TimePointDigests;
+
+  // The input region that the time point digests cover, the modified time of
+  // the input when they were last brought up to date, and the modified time
+  // of the input when a time point change was last reported
+  RegionType m_DigestedRegion;
+  itk::ModifiedTimeType m_DigestedInputMTime = 0, m_NotifiedInputMTime = 0;
+
+  // The cache key, and the modified time of the input it applies to
+  DerivedDataCache::Key m_CacheKey;
+  itk::ModifiedTimeType m_CacheInputMTime = 0;
+  bool m_StoreInCache = false;
+
+  // Write the time point digests to a string and read them back for the
+  // current input, returning false if they do not match it
+  std::string SerializeTimePointDigests() const;
+  bool DeserializeTimePointDigests(const std::string &data);
+
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
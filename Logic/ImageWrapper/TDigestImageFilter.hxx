@@ -1,6 +1,7 @@
 #ifndef TDIGESTIMAGEFILTER_HXX
 #define TDIGESTIMAGEFILTER_HXX
 
+#include <algorithm>
 #include <type_traits>
 #include <cmath>
 #include "TDigestImageFilter.h"
@@ -8,6 +9,7 @@
 #include <itkVectorImage.h>
 #include <random>
 #include <chrono>
+#include <sstream>
 
 // Type-specific functions are placed in their own namespace
 namespace TDigestImageFilter_impl {
@@ -54,6 +56,58 @@ constexpr void skip_value(const TValue &value, TValue &skip_min, TValue &skip_ma
     }
 };
 
+// Add the voxels in a buffer to the moment sums, advancing the index of the
+// first voxel in the buffer through the region in iterator order
+template <class TValue, class TIndex, class TRegion>
+void add_moments(const TValue *buffer, int n_pixels, unsigned int ncomp,
+                 TIndex &idx, const TRegion &region, long tp_origin,
+                 std::vector<TDigestDataObject::MomentSums> &sums)
+{
+  constexpr unsigned int Dim = TIndex::Dimension;
+  constexpr unsigned int SDim = Dim < 3 ? Dim : 3;
+  for(int p = 0; p < n_pixels; p++, buffer += ncomp)
+    {
+    // The voxel intensity is the mean over components
+    double v = 0.0;
+    for(unsigned int k = 0; k < ncomp; k++)
+      v += buffer[k];
+    v /= ncomp;
+
+    if(std::isfinite(v))
+      {
+      unsigned int t = 0;
+      if constexpr (Dim > 3)
+        t = idx[3] - tp_origin;
+
+      auto &S = sums[t];
+      double x[3] = { 0.0, 0.0, 0.0 };
+      for(unsigned int d = 0; d < SDim; d++)
+        x[d] = idx[d];
+
+      S.Count += 1.0;
+      S.Mass += v;
+      for(unsigned int a = 0; a < 3; a++)
+        {
+        S.CountFirst[a] += x[a];
+        S.MassFirst[a] += v * x[a];
+        for(unsigned int b = a; b < 3; b++)
+          {
+          S.CountSecond(a,b) += x[a] * x[b];
+          S.MassSecond(a,b) += v * x[a] * x[b];
+          }
+        }
+      }
+
+    // Advance the index in the same order as the image iterator
+    for(unsigned int d = 0; d < Dim; d++)
+      {
+      if(++idx[d] < region.GetIndex(d) + (long) region.GetSize(d))
+        break;
+      idx[d] = region.GetIndex(d);
+      }
+    }
+}
+
 template <class TImage, class TDigest>
 class Helper
 {
@@ -147,6 +201,45 @@ public:
 
 using namespace TDigestImageFilter_impl;
 
+inline void
+TDigestDataObject::MomentSums::Add(const MomentSums &other)
+{
+  Count += other.Count;
+  Mass += other.Mass;
+  CountFirst += other.CountFirst;
+  MassFirst += other.MassFirst;
+  CountSecond += other.CountSecond;
+  MassSecond += other.MassSecond;
+}
+
+inline bool
+TDigestDataObject::GetSpatialMoments(unsigned int time_point, SpatialMoments &moments) const
+{
+  if(time_point >= m_MomentSums.size())
+    return false;
+
+  // Apply the intensity transform to the sums
+  const MomentSums &S = m_MomentSums[time_point];
+  double a = m_TransformScale, b = m_TransformShift;
+  double mass = a * S.Mass + b * S.Count;
+  if(!(mass > 0.0))
+    return false;
+
+  Vec3 first = a * S.MassFirst + b * S.CountFirst;
+  Mat3 second = a * S.MassSecond + b * S.CountSecond;
+
+  moments.Mass = mass;
+  moments.Center = first / mass;
+  for(unsigned int i = 0; i < 3; i++)
+    for(unsigned int j = i; j < 3; j++)
+      {
+      moments.Covariance(i,j) = second(i,j) / mass - moments.Center[i] * moments.Center[j];
+      moments.Covariance(j,i) = moments.Covariance(i,j);
+      }
+
+  return true;
+}
+
 template <class TInputImage>
 TDigestImageFilter<TInputImage>
 ::TDigestImageFilter()
@@ -184,10 +277,180 @@ void
 TDigestImageFilter<TInputImage>
 ::SetLog2SamplingRate(int log_2_sampling_rate)
 {
-  this->m_Log2SamplingRate = log_2_sampling_rate;
+  if(this->m_Log2SamplingRate != log_2_sampling_rate)
+    {
+    // The time point digests were sampled at the old rate
+    this->m_Log2SamplingRate = log_2_sampling_rate;
+    m_TimePointDigests.clear();
+    this->Modified();
+    }
+}
+
+template <class TInputImage>
+void
+TDigestImageFilter<TInputImage>
+::TimePointModified(unsigned int tp)
+{
+  if(tp < m_TimePointDigests.size())
+    m_TimePointDigests[tp].Valid = false;
+
+  // Remember the state of the input that this change accounts for
+  if(this->GetInput())
+    m_NotifiedInputMTime = this->GetInput()->GetMTime();
   this->Modified();
 }
 
+template <class TInputImage>
+void
+TDigestImageFilter<TInputImage>
+::InputHeaderModified(itk::ModifiedTimeType mtime_before)
+{
+  if(!this->GetInput())
+    return;
+
+  itk::ModifiedTimeType mtime = this->GetInput()->GetMTime();
+  if(m_DigestedInputMTime == mtime_before)
+    m_DigestedInputMTime = mtime;
+  if(m_NotifiedInputMTime == mtime_before)
+    m_NotifiedInputMTime = mtime;
+  if(m_CacheInputMTime == mtime_before)
+    m_CacheInputMTime = mtime;
+}
+
+template <class TInputImage>
+void
+TDigestImageFilter<TInputImage>
+::SetCacheKey(const DerivedDataCache::Key &key)
+{
+  m_CacheKey = key;
+  m_CacheInputMTime = this->GetInput() ? this->GetInput()->GetMTime() : 0;
+}
+
+// Helpers for writing plain values to the cache entries
+namespace TDigestImageFilter_impl {
+
+template <class T> void write_pod(std::ostream &os, const T &value)
+{
+  os.write((const char *) &value, sizeof(T));
+}
+
+template <class T> bool read_pod(std::istream &is, T &value)
+{
+  is.read((char *) &value, sizeof(T));
+  return is.good();
+}
+
+} // namespace
+
+template <class TInputImage>
+std::string
+TDigestImageFilter<TInputImage>
+::SerializeTimePointDigests() const
+{
+  // The header describes the input, so that a digest of the same file read
+  // with another pixel type or sampling rate is not used
+  std::ostringstream os;
+  write_pod(os, (unsigned int) sizeof(ComponentType));
+  write_pod(os, (unsigned char) std::is_floating_point<ComponentType>::value);
+  write_pod(os, (unsigned char) std::is_signed<ComponentType>::value);
+  write_pod(os, (unsigned int) this->GetInput()->GetNumberOfComponentsPerPixel());
+  write_pod(os, m_Log2SamplingRate);
+  for(unsigned int d = 0; d < InputImageDimension; d++)
+    {
+    write_pod(os, (long) m_DigestedRegion.GetIndex(d));
+    write_pod(os, (unsigned long) m_DigestedRegion.GetSize(d));
+    }
+
+  write_pod(os, (unsigned int) m_TimePointDigests.size());
+  for(const TimePointDigest &tpd : m_TimePointDigests)
+    {
+    write_pod(os, tpd.NaNCount);
+    write_pod(os, tpd.Moments);
+
+    // The centroids, and the extremes, which the centroids may not reach
+    auto centroids = tpd.Digest.get();
+    write_pod(os, tpd.Digest.min());
+    write_pod(os, tpd.Digest.max());
+    write_pod(os, (unsigned int) centroids.size());
+    for(const auto &c : centroids)
+      {
+      write_pod(os, c.first);
+      write_pod(os, c.second);
+      }
+    }
+
+  return os.str();
+}
+
+template <class TInputImage>
+bool
+TDigestImageFilter<TInputImage>
+::DeserializeTimePointDigests(const std::string &data)
+{
+  std::istringstream is(data);
+  const TInputImage *img = this->GetInput();
+  const RegionType &region = img->GetBufferedRegion();
+
+  unsigned int comp_size, ncomp, n_tp;
+  unsigned char comp_float, comp_signed;
+  int log2_sampling;
+  if(!read_pod(is, comp_size) || comp_size != sizeof(ComponentType)
+     || !read_pod(is, comp_float) || comp_float != std::is_floating_point<ComponentType>::value
+     || !read_pod(is, comp_signed) || comp_signed != std::is_signed<ComponentType>::value
+     || !read_pod(is, ncomp) || ncomp != img->GetNumberOfComponentsPerPixel()
+     || !read_pod(is, log2_sampling) || log2_sampling != m_Log2SamplingRate)
+    return false;
+
+  for(unsigned int d = 0; d < InputImageDimension; d++)
+    {
+    long index; unsigned long size;
+    if(!read_pod(is, index) || index != region.GetIndex(d)
+       || !read_pod(is, size) || size != region.GetSize(d))
+      return false;
+    }
+
+  std::vector<TimePointDigest> digests;
+  if(!read_pod(is, n_tp) || n_tp != (InputImageDimension > 3 ? region.GetSize(3) : 1))
+    return false;
+
+  digests.resize(n_tp);
+  for(TimePointDigest &tpd : digests)
+    {
+    float vmin, vmax;
+    unsigned int n_centroids;
+    if(!read_pod(is, tpd.NaNCount) || !read_pod(is, tpd.Moments)
+       || !read_pod(is, vmin) || !read_pod(is, vmax) || !read_pod(is, n_centroids))
+      return false;
+
+    // Insert the centroids. The extreme centroids give up a unit of weight
+    // to the extreme values, so that the range is restored exactly
+    for(unsigned int i = 0; i < n_centroids; i++)
+      {
+      float mean; unsigned weight;
+      if(!read_pod(is, mean) || !read_pod(is, weight))
+        return false;
+
+      if(i == 0 && mean != vmin && weight > 1)
+        {
+        tpd.Digest.insert(vmin);
+        weight--;
+        }
+      if(i + 1 == n_centroids && mean != vmax && weight > 1)
+        {
+        tpd.Digest.insert(vmax);
+        weight--;
+        }
+      tpd.Digest.insert(mean, weight);
+      }
+
+    tpd.Digest.merge();
+    tpd.Valid = true;
+    }
+
+  m_TimePointDigests = std::move(digests);
+  return true;
+}
+
 /*
 template< class TInputImage >
 void
@@ -209,7 +472,31 @@ TDigestImageFilter<TInputImage>
 ::StreamedGenerateData(unsigned int inputRequestedRegionNumber)
 {
   auto t_start = std::chrono::steady_clock::now();
-  Superclass::StreamedGenerateData(inputRequestedRegionNumber);
+
+  // Only the time points whose digests are out of date are visited. Each is
+  // split among the threads separately, so that every piece of work falls
+  // within a single time point
+  const RegionType &requested = this->GetInput()->GetRequestedRegion();
+  for(unsigned int tp = 0; tp < m_TimePointDigests.size(); tp++)
+    {
+    if(m_TimePointDigests[tp].Valid)
+      continue;
+
+    RegionType tp_region = this->GetInput()->GetBufferedRegion();
+    if constexpr (InputImageDimension > 3)
+      {
+      tp_region.SetIndex(3, tp_region.GetIndex(3) + tp);
+      tp_region.SetSize(3, 1);
+      }
+    if(!tp_region.Crop(requested))
+      continue;
+
+    this->GetMultiThreader()->template ParallelizeImageRegion<InputImageDimension>(
+          tp_region,
+          [this](const RegionType &region) { this->ThreadedStreamedGenerateData(region); },
+          nullptr);
+    }
+
   auto t_stop = std::chrono::steady_clock::now();
   auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(t_stop - t_start);
 
@@ -231,8 +518,47 @@ void
 TDigestImageFilter<TInputImage>
 ::BeforeStreamedGenerateData()
 {
-  m_TDigestDataObject->m_Digest.reset();
-  m_TDigestDataObject->m_NaNCount = 0;
+  const TInputImage *img = this->GetInput();
+  const RegionType &region = img->GetBufferedRegion();
+  unsigned int n_tp = 1;
+  if constexpr (InputImageDimension > 3)
+    n_tp = region.GetSize(3);
+
+  // All time points are digested again if the input changed in a way that
+  // was not reported through TimePointModified()
+  itk::ModifiedTimeType mtime = img->GetMTime();
+  if((mtime != m_DigestedInputMTime && mtime != m_NotifiedInputMTime)
+     || region != m_DigestedRegion || m_TimePointDigests.size() != n_tp)
+    {
+    m_TimePointDigests.clear();
+    m_TimePointDigests.resize(n_tp);
+    }
+
+  // When no time point has been digested yet, the digests of an input that
+  // was read from a file may be in the cache
+  bool cached = m_CacheKey.IsValid() && mtime == m_CacheInputMTime
+                && std::none_of(m_TimePointDigests.begin(), m_TimePointDigests.end(),
+                                [](const TimePointDigest &tpd) { return tpd.Valid; });
+  std::string data;
+  bool restored = cached && DerivedDataCache::Read(m_CacheKey, "tdigest", data)
+                  && this->DeserializeTimePointDigests(data);
+
+  // Digests that are computed from scratch are stored in the cache
+  m_StoreInCache = cached && !restored;
+
+  // Clear the digests that are about to be recomputed
+  for(auto &tpd : m_TimePointDigests)
+    {
+    if(!tpd.Valid)
+      {
+      tpd.Digest.reset();
+      tpd.NaNCount = 0;
+      tpd.Moments = TDigestDataObject::MomentSums();
+      }
+    }
+
+  // One set of moment sums per time point
+  m_TDigestDataObject->m_MomentSums.assign(n_tp, TDigestDataObject::MomentSums());
 }
 
 template< class TInputImage >
@@ -247,6 +573,14 @@ TDigestImageFilter<TInputImage>
   typename TDigestDataObject::TDigest thread_digest(TDigestDataObject::DIGEST_SIZE);
   unsigned long thread_nan_count = 0;
 
+  // Moment sums for this thread, indexed relative to the first time point
+  unsigned int ncomp = img->GetNumberOfComponentsPerPixel();
+  long tp_origin = 0;
+  if constexpr (InputImageDimension > 3)
+    tp_origin = img->GetBufferedRegion().GetIndex(3);
+  std::vector<TDigestDataObject::MomentSums> thread_moments(m_TDigestDataObject->m_MomentSums.size());
+  IndexType idx;
+
   // An iterator used to parse the image
   typedef itk::ImageRegionConstIterator<TInputImage> Iterator;
   Iterator it(img, region);
@@ -275,7 +609,9 @@ TDigestImageFilter<TInputImage>
     while(!it.IsAtEnd())
       {
       // Copy a chunk of the image to the buffer
+      idx = it.GetIndex();
       HelperType::to_buffer(it, buffer, buffer_size, buffer_read);
+      add_moments(buffer, buffer_read / ncomp, ncomp, idx, region, tp_origin, thread_moments);
 
       // Digest the buffer
       for(int i = 0; i < buffer_read; i++)
@@ -298,7 +634,9 @@ TDigestImageFilter<TInputImage>
     while(!it.IsAtEnd())
       {
       // Copy a chunk of the image to the buffer
+      idx = it.GetIndex();
       HelperType::to_buffer(it, buffer, buffer_size, buffer_read);
+      add_moments(buffer, buffer_read / ncomp, ncomp, idx, region, tp_origin, thread_moments);
 
       // Use the entire buffer to determine min/max and number of nans
       for(int i = 0; i < buffer_read; i++)
@@ -327,14 +665,21 @@ TDigestImageFilter<TInputImage>
   // Complete the digest
   thread_digest.merge();
 
-  // Use mutex to update the global heaps
+  // Use mutex to update the digest of the time point this region lies in
   std::lock_guard<std::mutex> guard(m_Mutex);
+  unsigned int tp = 0;
+  if constexpr (InputImageDimension > 3)
+    tp = region.GetIndex(3) - tp_origin;
+  TimePointDigest &tpd = m_TimePointDigests[tp];
 
-  // Add current digest so the main digest
-  m_TDigestDataObject->m_Digest.insert(thread_digest);
+  // Add current digest to the time point digest
+  tpd.Digest.insert(thread_digest);
 
-  // Update global nan count
-  m_TDigestDataObject->m_NaNCount += thread_nan_count;
+  // Update the nan count
+  tpd.NaNCount += thread_nan_count;
+
+  // Add the moment sums
+  tpd.Moments.Add(thread_moments[tp]);
 }
 
 template< class TInputImage >
@@ -342,6 +687,27 @@ void
 TDigestImageFilter<TInputImage>
 ::AfterStreamedGenerateData()
 {
+  // The time point digests are now up to date, merge them into the output
+  m_TDigestDataObject->m_Digest.reset();
+  m_TDigestDataObject->m_NaNCount = 0;
+  for(unsigned int tp = 0; tp < m_TimePointDigests.size(); tp++)
+    {
+    TimePointDigest &tpd = m_TimePointDigests[tp];
+    tpd.Valid = true;
+    m_TDigestDataObject->m_Digest.insert(tpd.Digest);
+    m_TDigestDataObject->m_NaNCount += tpd.NaNCount;
+    m_TDigestDataObject->m_MomentSums[tp] = tpd.Moments;
+    }
+
+  m_DigestedRegion = this->GetInput()->GetBufferedRegion();
+  m_DigestedInputMTime = this->GetInput()->GetMTime();
+
+  if(m_StoreInCache)
+    {
+    DerivedDataCache::Write(m_CacheKey, "tdigest", this->SerializeTimePointDigests());
+    m_StoreInCache = false;
+    }
+
   // Mark the output as modified (do we need to?)
   m_TDigestDataObject->Modified();
 
@@ -5,6 +5,7 @@
 #include <itkSimpleDataObjectDecorator.h>
 #include <itkNumericTraits.h>
 #include <ScalarImageHistogram.h>
+#include <map>
 
 /**
  * This ITK-style filter computes the histogram of an ITK scalar image. It
@@ -13,6 +14,13 @@
  * determining the range of the histogram. The histogram in this filter is
  * constructed from equal size bins between the input min and max, and the
  * number of bins is a power of two.
+ *
+ * The image is scanned into a fine base histogram (one bin per value for
+ * integer images with a moderate range), from which the output histogram is
+ * derived. The base histogram is cached for each input image that the filter
+ * has seen, so changing the number of bins, or switching the input back to
+ * the image of a time point that was histogrammed before, does not rescan
+ * the image unless it was modified.
  */
 template <class TInputImage>
 class ThreadedHistogramImageFilter :
@@ -114,8 +122,29 @@ private:
   // Intensity transform
   double m_TransformScale, m_TransformShift;
 
-  // Per-thread histograms
-  std::vector< HistogramPointer > m_ThreadHistogram;
+  // Fine histogram of an input image
+  struct BaseHistogram
+  {
+    itk::ModifiedTimeType ImageMTime = 0;
+    RegionType Region;
+    PixelType Min, Max;
+    HistogramPointer Histogram;
+  };
+
+  // Scan the input into a base histogram
+  void ComputeBaseHistogram(PixelType pxmin, PixelType pxmax, BaseHistogram &base);
+
+  // Base histograms of the input images, indexed by image
+  std::map<const TInputImage *, BaseHistogram> m_BaseHistograms;
+
+  // Number of bins in the base histogram of non-integer images
+  static constexpr unsigned int BASE_BINS = 0x10000;
+
+  // Largest range of an integer image histogrammed with one bin per value
+  static constexpr unsigned long MAX_VALUE_BINS = 0x40000;
+
+  // Number of base histograms kept
+  static constexpr size_t MAX_CACHED_BASE_HISTOGRAMS = 16;
 
   // The output histogram
   HistogramPointer m_OutputHistogram;
@@ -2,8 +2,13 @@
 #define THREADEDHISTOGRAMIMAGEFILTER_HXX
 
 #include "ThreadedHistogramImageFilter.h"
+#include "ScratchArena.h"
 #include <itkProgressReporter.h>
 #include <itkImageRegionConstIterator.h>
+#include <itkImageScanlineConstIterator.h>
+#include <itkMultiThreaderBase.h>
+#include <algorithm>
+#include <limits>
 
 template <class TInputImage>
 ThreadedHistogramImageFilter<TInputImage>
@@ -94,6 +99,81 @@ ThreadedHistogramImageFilter<TInputImage>
   // Nothing to be done for the histogram output
 }
 
+template< class TInputImage >
+void
+ThreadedHistogramImageFilter<TInputImage>
+::ComputeBaseHistogram(PixelType pxmin, PixelType pxmax, BaseHistogram &base)
+{
+  const TInputImage *input = this->GetInput();
+  RegionType region = input->GetBufferedRegion();
+
+  // Integer images with a moderate range get one bin per value, so that the
+  // samples are binned without any floating point arithmetic
+  double range = (double) pxmax - (double) pxmin;
+  bool per_value = std::numeric_limits<PixelType>::is_integer && range < MAX_VALUE_BINS;
+  size_t n_bins = per_value ? (size_t) range + 1 : BASE_BINS;
+  double scale = range > 0 ? n_bins / range : 0.0;
+
+  // The region is split into slabs along the last dimension, and each slab
+  // is counted into its own bins, so the threads never share a counter
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  const unsigned int last = InputImageDimension - 1;
+  itk::SizeValueType n_last = region.GetSize(last);
+  size_t n_slabs = std::max<size_t>(1, std::min<size_t>(mt->GetNumberOfWorkUnits(), n_last));
+
+  // The bins of all slabs are in one scratch buffer, owned by this thread
+  ScratchBuffer<unsigned long> counts(n_slabs * n_bins, 0);
+
+  mt->ParallelizeArray(0, n_slabs, [&](itk::SizeValueType k)
+    {
+    RegionType slab = region;
+    slab.SetIndex(last, region.GetIndex(last) + (n_last * k) / n_slabs);
+    slab.SetSize(last, (n_last * (k + 1)) / n_slabs - (n_last * k) / n_slabs);
+
+    unsigned long *c = counts.data() + k * n_bins;
+    long long top = (long long) n_bins - 1;
+
+    // The inner loop is instantiated separately for each way of binning
+    auto count = [&](auto to_bin)
+      {
+      for(itk::ImageScanlineConstIterator<TInputImage> it(input, slab); !it.IsAtEnd(); it.NextLine())
+        {
+        for(; !it.IsAtEndOfLine(); ++it)
+          {
+          long long index = to_bin(it.Get());
+          c[index < 0 ? 0 : (index > top ? top : index)]++;
+          }
+        }
+      };
+
+    if(per_value)
+      count([pxmin](PixelType v) { return (long long) v - (long long) pxmin; });
+    else
+      count([pxmin, scale](PixelType v) { return (long long) (scale * (v - pxmin)); });
+    }, nullptr);
+
+  // Merge the slab counts
+  unsigned long *total = counts.data();
+  for(size_t k = 1; k < n_slabs; k++)
+    for(size_t i = 0; i < n_bins; i++)
+      total[i] += counts[k * n_bins + i];
+
+  base.Histogram = HistogramType::New();
+  if(per_value)
+    base.Histogram->Initialize(pxmin, (double) pxmin + n_bins, n_bins);
+  else
+    base.Histogram->Initialize(pxmin, pxmax, n_bins);
+
+  for(size_t i = 0; i < n_bins; i++)
+    if(total[i])
+      base.Histogram->AddSamplesToBin(i, total[i]);
+
+  base.ImageMTime = std::max(input->GetMTime(), input->GetUpdateMTime());
+  base.Region = region;
+  base.Min = pxmin;
+  base.Max = pxmax;
+}
+
 template< class TInputImage >
 void
 ThreadedHistogramImageFilter<TInputImage>
@@ -105,33 +185,29 @@ ThreadedHistogramImageFilter<TInputImage>
   PixelType pxmin = m_InputMin->Get();
   PixelType pxmax = m_InputMax->Get();
 
-  // Initialize the output
-  m_OutputHistogram->Initialize(pxmin, pxmax, m_Bins);
-
-  // A mutex to control updating the output histogram
-  std::mutex histo_mutex;
-
-  // Parrallel block
-  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
-  mt->ParallelizeImageRegion<Self::OutputImageDimension>(
-        this->GetOutput()->GetBufferedRegion(),
-        [this, pxmin, pxmax, &histo_mutex](const RegionType &region)
+  // Find the base histogram of this input, making room for it if needed
+  const TInputImage *input = this->GetInput();
+  if(m_BaseHistograms.find(input) == m_BaseHistograms.end()
+     && m_BaseHistograms.size() >= MAX_CACHED_BASE_HISTOGRAMS)
     {
-    // Create a thread-local histogram
-    HistogramType::Pointer local_hist = HistogramType::New();
-    local_hist->Initialize(pxmin, pxmax, m_Bins);
+    auto oldest = std::min_element(
+          m_BaseHistograms.begin(), m_BaseHistograms.end(),
+          [](const auto &a, const auto &b) { return a.second.ImageMTime < b.second.ImageMTime; });
+    m_BaseHistograms.erase(oldest);
+    }
 
-    // Compute the histogram
-    for(itk::ImageRegionConstIterator< TInputImage > it(this->GetInput(), region);
-        !it.IsAtEnd(); ++it)
-      {
-      local_hist->AddSample(it.Get());
-      }
+  // The image is only scanned if it changed since its base histogram was made
+  BaseHistogram &base = m_BaseHistograms[input];
+  if(!base.Histogram
+     || base.ImageMTime != std::max(input->GetMTime(), input->GetUpdateMTime())
+     || base.Region != input->GetBufferedRegion()
+     || base.Min != pxmin || base.Max != pxmax)
+    {
+    this->ComputeBaseHistogram(pxmin, pxmax, base);
+    }
 
-    // In a reentrant block, update the main histogram
-    std::lock_guard<std::mutex> guard(histo_mutex);
-    m_OutputHistogram->AddCompatibleHistogram(local_hist);
-    }, nullptr);
+  // Derive the output from the base histogram
+  m_OutputHistogram->ComputeFromFineHistogram(base.Histogram, pxmin, pxmax, m_Bins);
 
   // Apply the transform to the histogram
   m_OutputHistogram->ApplyIntensityTransform(m_TransformScale, m_TransformShift);
@@ -38,6 +38,7 @@ template <class TTraits>
 VectorImageWrapper<TTraits>
 ::VectorImageWrapper()
 {
+  m_MaterializeDerivedComponents = true;
 }
 
 template <class TTraits>
@@ -63,11 +64,14 @@ VectorImageWrapper<TTraits>
 ::GetRunLengthIntensityStatistics(
     const itk::ImageRegion<3> &region,
     const itk::Index<3> &startIdx, long runlength,
-    double *out_nvalid, double *out_sum, double *out_sumsq) const
+    double *out_nvalid, double *out_sum, double *out_sumsq,
+    int time_point) const
 {
   if(this->IsSlicingOrthogonal())
     {
-    ConstIterator it(this->m_Image, region);
+    const ImageType *image = time_point < 0
+        ? this->m_Image : this->GetImageByTimePoint(time_point).GetPointer();
+    ConstIterator it(image, region);
     it.SetIndex(startIdx);
     size_t nc = this->GetNumberOfComponents();
 
@@ -217,6 +221,10 @@ VectorImageWrapper<TTraits>
       {
       SetNativeMappingInDerivedWrapper<MeanFunctor>(it->second, mapping);
       }
+    else if(idx.first == SCALAR_REP_JACOBIAN)
+      {
+      SetNativeMappingInDerivedWrapper<JacobianFunctor>(it->second, mapping);
+      }
     }
 }
 
@@ -238,6 +246,38 @@ VectorImageWrapper<TTraits>
   dw->SetSourceNativeMapping(mapping.GetScale(), mapping.GetShift());
 }
 
+template <class TTraits>
+template <class TFunctor>
+void
+VectorImageWrapper<TTraits>
+::MaterializeDerivedWrapper(ScalarImageWrapperBase *w)
+{
+  typedef VectorDerivedQuantityImageWrapperTraits<TFunctor> WrapperTraits;
+  typedef typename WrapperTraits::WrapperType DerivedWrapper;
+
+  DerivedWrapper *dw = dynamic_cast<DerivedWrapper *>(w);
+  dw->MaterializeDerivedQuantity(this->m_Image4D);
+}
+
+template <class TTraits>
+void
+VectorImageWrapper<TTraits>
+::UpdateMaterializedRepresentation(ScalarRepresentation type, ScalarImageWrapperBase *w)
+{
+  // Derived values are stored as float, which only pays off when they are
+  // no larger than the vectors they are computed from
+  if(!m_MaterializeDerivedComponents || !w || !this->IsInitialized()
+     || sizeof(float) > this->GetNumberOfComponents() * sizeof(InternalPixelType))
+    return;
+
+  if(type == SCALAR_REP_MAGNITUDE)
+    MaterializeDerivedWrapper<MagnitudeFunctor>(w);
+  else if(type == SCALAR_REP_MAX)
+    MaterializeDerivedWrapper<MaxFunctor>(w);
+  else if(type == SCALAR_REP_AVERAGE)
+    MaterializeDerivedWrapper<MeanFunctor>(w);
+}
+
 template <class TTraits>
 template <class TFunctor>
 SmartPtr<ScalarImageWrapperBase>
@@ -250,6 +290,7 @@ VectorImageWrapper<TTraits>
 
   SmartPtr<AdaptorType> adaptor = AdaptorType::New();
   adaptor->SetImage(image_4d);
+  adaptor->GetPixelAccessor().SetSourceGeometry(image_4d);
 
   SmartPtr<DerivedWrapper> wrapper = DerivedWrapper::New();
   wrapper->InitializeToWrapper(this, adaptor, refSpace, transform);
@@ -322,6 +363,9 @@ VectorImageWrapper<TTraits>
   m_ScalarReps[std::make_pair(SCALAR_REP_AVERAGE, 0)]
       = this->template CreateDerivedWrapper<MeanFunctor>(image_4d, referenceSpace, transform);
 
+  m_ScalarReps[std::make_pair(SCALAR_REP_JACOBIAN, 0)]
+      = this->template CreateDerivedWrapper<JacobianFunctor>(image_4d, referenceSpace, transform);
+
   /*
 
     // Make sure intensity curve is shared by the components
@@ -389,7 +433,9 @@ VectorImageWrapper<TTraits>
     ScalarRepresentation type,
     int index)
 {
-  return m_ScalarReps[std::make_pair(type, index)];
+  ScalarImageWrapperBase *rep = m_ScalarReps[std::make_pair(type, index)];
+  this->UpdateMaterializedRepresentation(type, rep);
+  return rep;
 }
 
 template <class TTraits>
@@ -459,6 +505,34 @@ VectorImageWrapper<TTraits>
     }
 }
 
+template <class TTraits>
+void
+VectorImageWrapper<TTraits>
+::SetObliqueSlicingSubsampling(unsigned int factor)
+{
+  Superclass::SetObliqueSlicingSubsampling(factor);
+
+  // Propagate to owned scalar wrappers
+  for(ScalarRepIterator it = m_ScalarReps.begin(); it != m_ScalarReps.end(); ++it)
+    {
+    it->second->SetObliqueSlicingSubsampling(factor);
+    }
+}
+
+template <class TTraits>
+void
+VectorImageWrapper<TTraits>
+::SetSlicingRestrictedToViewport(unsigned int index, bool flag)
+{
+  Superclass::SetSlicingRestrictedToViewport(index, flag);
+
+  // Propagate to owned scalar wrappers
+  for(ScalarRepIterator it = m_ScalarReps.begin(); it != m_ScalarReps.end(); ++it)
+    {
+    it->second->SetSlicingRestrictedToViewport(index, flag);
+    }
+}
+
 template <class TTraits>
 void
 VectorImageWrapper<TTraits>
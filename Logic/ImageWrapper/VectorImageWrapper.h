@@ -148,7 +148,8 @@ public:
   virtual void GetRunLengthIntensityStatistics(
       const itk::ImageRegion<3> &region,
       const itk::Index<3> &startIdx, long runlength,
-      double *out_nvalid, double *out_sum, double *out_sumsq) const ITK_OVERRIDE;
+      double *out_nvalid, double *out_sum, double *out_sumsq,
+      int time_point = -1) const ITK_OVERRIDE;
 
   /**
    * This method returns a vector of values for the voxel under the cursor.
@@ -178,11 +179,25 @@ public:
 
   virtual void SetDisplayViewportGeometry(unsigned int index, const ImageBaseType *viewport_image) ITK_OVERRIDE;
 
+  virtual void SetObliqueSlicingSubsampling(unsigned int factor) ITK_OVERRIDE;
+
+  virtual void SetSlicingRestrictedToViewport(unsigned int index, bool flag) ITK_OVERRIDE;
+
   virtual void SetDirectionMatrix(const vnl_matrix<double> &direction) ITK_OVERRIDE;
 
   virtual void CopyImageCoordinateTransform(const ImageWrapperBase *source) ITK_OVERRIDE;
 
   virtual void SetSticky(bool value) ITK_OVERRIDE;
+
+  /**
+   * Whether the derived scalar representations (magnitude, max, average) are
+   * computed once for the whole image when they are requested, rather than
+   * for every access. This is only done when the cache takes no more memory
+   * than the vector image itself. The cached values are discarded when the
+   * image is modified and recomputed on the next request.
+   */
+  irisGetSetMacro(MaterializeDerivedComponents, bool)
+
 protected:
 
   /**
@@ -217,6 +232,14 @@ protected:
   void SetNativeMappingInDerivedWrapper(
       ScalarImageWrapperBase *w, NativeIntensityMapping &mapping);
 
+  template <class TFunctor>
+  void MaterializeDerivedWrapper(ScalarImageWrapperBase *w);
+
+  // Compute the derived quantity of a scalar representation if enabled
+  void UpdateMaterializedRepresentation(ScalarRepresentation type, ScalarImageWrapperBase *w);
+
+  bool m_MaterializeDerivedComponents;
+
   // Array of derived quantities
   typedef SmartPtr<ScalarImageWrapperBase> ScalarWrapperPointer;
   typedef std::pair<ScalarRepresentation, int> ScalarRepIndex;
@@ -230,6 +253,7 @@ protected:
   typedef VectorToScalarMagnitudeFunctor<InternalPixelType,float> MagnitudeFunctor;
   typedef VectorToScalarMaxFunctor<InternalPixelType, float> MaxFunctor;
   typedef VectorToScalarMeanFunctor<InternalPixelType,float> MeanFunctor;
+  typedef VectorToScalarJacobianFunctor<InternalPixelType,float> JacobianFunctor;
 
 };
 
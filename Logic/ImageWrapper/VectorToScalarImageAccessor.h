@@ -3,6 +3,14 @@
 
 #include "itkDefaultVectorPixelAccessor.h"
 #include "itkVectorImageToImageAdaptor.h"
+#include "itkMultiThreaderBase.h"
+#include "itkCommand.h"
+#include "vnl/vnl_inverse.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 
 namespace itk
@@ -11,9 +19,80 @@ template <class TImage, class TAccessor> class ImageAdaptor;
 template <class TPixel, unsigned int Vdim> class VectorImage;
 }
 
+/**
+ * The values of a derived quantity, computed once for every pixel of a
+ * vector image buffer. The cache observes the source image and stops being
+ * used as soon as the source is modified, at which point the accessor goes
+ * back to computing the quantity on the fly.
+ */
+template <class TInternal, class TExternal>
+class VectorDerivedQuantityCache
+{
+public:
+  VectorDerivedQuantityCache(itk::Object *source, const TInternal *begin,
+                             unsigned int vector_length, size_t n_pixels)
+    : m_Source(source), m_Begin(begin), m_VectorLength(vector_length),
+      m_Values(n_pixels), m_Valid(false)
+  {
+    m_Tag = source->AddObserver(
+          itk::ModifiedEvent(), [this](const itk::EventObject &) { m_Valid = false; });
+  }
+
+  ~VectorDerivedQuantityCache()
+  {
+    m_Source->RemoveObserver(m_Tag);
+  }
+
+  /** Compute the values in parallel using a functor on the raw components */
+  template <class TFunctor>
+  void Compute(const TFunctor &functor)
+  {
+    const size_t block = 0x10000;
+    size_t n_blocks = (m_Values.size() + block - 1) / block;
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray(0, n_blocks, [&](size_t b)
+      {
+      size_t k1 = std::min(m_Values.size(), (b + 1) * block);
+      const TInternal *p = m_Begin + b * block * m_VectorLength;
+      for(size_t k = b * block; k < k1; k++, p += m_VectorLength)
+        m_Values[k] = functor.Get(p, m_VectorLength);
+      }, nullptr);
+    m_Valid = true;
+  }
+
+  bool IsValid() const { return m_Valid; }
+
+  /** Look up the value of a pixel given as in DefaultVectorPixelAccessor */
+  bool Lookup(const TInternal *buffer, size_t offset, TExternal &value) const
+  {
+    std::ptrdiff_t shift = buffer - m_Begin;
+    if(!m_Valid || shift < 0)
+      return false;
+
+    size_t k = shift / m_VectorLength + offset;
+    if(k >= m_Values.size())
+      return false;
+
+    value = m_Values[k];
+    return true;
+  }
+
+protected:
+  // The image whose buffer is cached; held so the observer can be removed
+  itk::Object::Pointer m_Source;
+  unsigned long m_Tag;
+
+  const TInternal *m_Begin;
+  unsigned int m_VectorLength;
+  std::vector<TExternal> m_Values;
+  std::atomic<bool> m_Valid;
+};
+
 /**
  * An accessor very similar to itk::VectorImageToImageAccessor that allows us
- * to extract certain computed quantities from the vectors, such as magnitude
+ * to extract certain computed quantities from the vectors, such as magnitude.
+ * The quantities may optionally be materialized for the whole buffer, so that
+ * slicing, histograms and statistics do not recompute them for every access.
  */
 template <class TFunctor>
 class VectorToScalarImageAccessor
@@ -26,6 +105,7 @@ public:
   typedef itk::SizeValueType SizeValueType;
   typedef itk::VariableLengthVector<ExternalType> ActualPixelType;
   typedef unsigned int VectorLengthType;
+  typedef VectorDerivedQuantityCache<InternalType, ExternalType> CacheType;
 
   inline void Set(ActualPixelType output, const ExternalType &input) const
     { output.Fill(input); }
@@ -42,12 +122,25 @@ public:
 
   inline ExternalType Get(const InternalType &input,
                           const SizeValueType offset) const
-    { return Get(Superclass::Get(input, offset)); }
+    {
+    if constexpr(TFunctor::UsesNeighbors)
+      {
+      return m_Functor.GetFromBuffer(&input, offset);
+      }
+    else
+      {
+      ExternalType value;
+      if(m_Cache && m_Cache->Lookup(&input, offset, value))
+        return value;
+      return Get(Superclass::Get(input, offset));
+      }
+    }
 
   void SetVectorLength(VectorLengthType l)
     {
     m_Functor.SetVectorLength(l);
     Superclass::SetVectorLength(l);
+    m_Cache.reset();
     }
 
   VectorLengthType GetVectorLength() const
@@ -62,10 +155,43 @@ public:
   void SetSourceNativeMapping(double scale, double shift)
   {
     m_Functor.SetSourceNativeMapping(scale, shift);
+    m_Cache.reset();
+  }
+
+  /**
+   * Pass the size, spacing, direction and buffer of the 4D source image to
+   * the functor, for the quantities that depend on the neighbors of a pixel
+   */
+  template <class TImage4D>
+  void SetSourceGeometry(TImage4D *image)
+  {
+    m_Functor.SetSourceGeometry(image);
+    m_Cache.reset();
+  }
+
+  /**
+   * Compute the derived quantity for the n_pixels vectors starting at begin,
+   * which is the buffer of the image source. Returns false if the values are
+   * already cached and the source has not been modified since.
+   */
+  bool Materialize(itk::Object *source, const InternalType *begin, size_t n_pixels)
+  {
+    if(m_Cache && m_Cache->IsValid())
+      return false;
+
+    m_Cache = std::make_shared<CacheType>(source, begin, GetVectorLength(), n_pixels);
+    m_Cache->Compute(m_Functor);
+    return true;
   }
 
+  /** Stop using materialized values */
+  void ReleaseMaterialized() { m_Cache.reset(); }
+
 protected:
   TFunctor m_Functor;
+
+  // Materialized values, shared between the copies of the accessor
+  std::shared_ptr<CacheType> m_Cache;
 };
 
 /**
@@ -86,6 +212,13 @@ public:
 
   virtual ~AbstractVectorToDerivedQuantityFunctor() {}
 
+  // Whether the quantity depends on the neighbors of the pixel, in which case
+  // the functor is given the buffer and offset of the pixel, see below
+  static constexpr bool UsesNeighbors = false;
+
+  // Only needed by the functors that use the neighbors
+  template <class TImage4D> void SetSourceGeometry(TImage4D *) {}
+
   virtual void SetSourceNativeMapping(double scale, double shift)
   {
     m_Shift = shift;
@@ -202,6 +335,162 @@ public:
   }
 };
 
+/**
+ * The determinant of the Jacobian of x -> x + u(x), where the vectors u are
+ * displacements in physical units, as in the warps written by greedy and
+ * ANTs. Two component vectors are taken to be in-plane displacements.
+ *
+ * Since the value depends on the neighbors of a pixel, the accessor passes
+ * the buffer and the offset of the pixel, which locate it in the 4D source
+ * image. The derivatives are central differences, one-sided at the edges of
+ * the image. The values are computed a slice at a time, the first time a
+ * pixel of the slice is accessed, and kept until the mapping or the geometry
+ * of the source changes. So only the slices that are shown are computed.
+ */
+template <class TInputPixel, class TOutputPixel>
+class VectorToScalarJacobianFunctor : public AbstractVectorToDerivedQuantityFunctor
+{
+public:
+  typedef TInputPixel InputPixelType;
+  typedef TOutputPixel OutputPixelType;
+
+  static constexpr bool UsesNeighbors = true;
+
+  // Without the neighbors there is nothing to compute, so the transform is
+  // taken to preserve volume. These are only used if the values are
+  // materialized, which is never done for this quantity
+  OutputPixelType Get(const itk::VariableLengthVector<InputPixelType> &) const
+  {
+    return 1;
+  }
+
+  OutputPixelType Get(const InputPixelType *, int) const
+  {
+    return 1;
+  }
+
+  template <class TImage4D>
+  void SetSourceGeometry(TImage4D *image)
+  {
+    auto size = image->GetBufferedRegion().GetSize();
+    vnl_matrix_fixed<double, 3, 3> dir_spc;
+    for(unsigned int a = 0; a < 3; a++)
+      {
+      m_Size[a] = size[a];
+      for(unsigned int b = 0; b < 3; b++)
+        dir_spc(a, b) = image->GetDirection()(a, b) * image->GetSpacing()[b];
+      }
+    m_NumberOfVolumes = size[3];
+    m_Begin = image->GetBufferPointer();
+
+    // Derivative of the voxel index with respect to the physical position
+    m_PhysicalToIndex = vnl_inverse(dir_spc);
+    this->ParametersUpdated();
+  }
+
+  virtual void ParametersUpdated() override
+  {
+    // Start over with an empty cache, shared by the copies of the functor
+    m_Cache = std::make_shared<SliceCache>(m_Size[2] * m_NumberOfVolumes);
+  }
+
+  OutputPixelType GetFromBuffer(const InputPixelType *buffer, size_t offset) const
+  {
+    size_t n_slice = m_Size[0] * m_Size[1], n_vol = n_slice * m_Size[2];
+    if(n_vol == 0)
+      return 1;
+
+    if(m_Begin && buffer >= m_Begin)
+      {
+      size_t k = (buffer - m_Begin) / m_Length + offset, slice = k / n_slice;
+      if(slice < m_Cache->NumberOfSlices)
+        return this->GetSlice(slice)[k % n_slice];
+      }
+
+    // The buffer is not the one the geometry was taken from, but is laid out
+    // in the same way, so the value is computed directly
+    const InputPixelType *volume = buffer + (offset - offset % n_vol) * m_Length;
+    size_t r = offset % n_vol;
+    return this->Compute(volume, r % m_Size[0], (r / m_Size[0]) % m_Size[1], r / n_slice);
+  }
+
+protected:
+
+  struct SliceCache
+  {
+    SliceCache(size_t n)
+      : NumberOfSlices(n), Slices(new std::atomic<const OutputPixelType *>[n]()), Storage(n) {}
+
+    size_t NumberOfSlices;
+    std::unique_ptr<std::atomic<const OutputPixelType *>[]> Slices;
+
+    // Storage of the computed slices, guarded by the mutex
+    std::vector<std::unique_ptr<OutputPixelType[]> > Storage;
+    std::mutex Mutex;
+  };
+
+  const OutputPixelType *GetSlice(size_t slice) const
+  {
+    const OutputPixelType *values = m_Cache->Slices[slice].load(std::memory_order_acquire);
+    if(values)
+      return values;
+
+    std::lock_guard<std::mutex> guard(m_Cache->Mutex);
+    std::unique_ptr<OutputPixelType[]> &storage = m_Cache->Storage[slice];
+    if(!storage)
+      {
+      size_t nx = m_Size[0], ny = m_Size[1], nz = m_Size[2];
+      size_t t = slice / nz, z = slice % nz;
+      const InputPixelType *volume = m_Begin + t * nz * ny * nx * m_Length;
+      storage.reset(new OutputPixelType[nx * ny]);
+      for(size_t y = 0; y < ny; y++)
+        for(size_t x = 0; x < nx; x++)
+          storage[y * nx + x] = this->Compute(volume, x, y, z);
+      m_Cache->Slices[slice].store(storage.get(), std::memory_order_release);
+      }
+    return storage.get();
+  }
+
+  OutputPixelType Compute(const InputPixelType *volume, size_t x, size_t y, size_t z) const
+  {
+    size_t idx[] = { x, y, z };
+    size_t stride[] = { m_Length, m_Length * m_Size[0], m_Length * m_Size[0] * m_Size[1] };
+    const InputPixelType *p = volume + x * stride[0] + y * stride[1] + z * stride[2];
+    unsigned int nc = std::min(m_Length, 3u);
+
+    // Derivatives of the displacement with respect to the voxel index
+    double grad[3][3] = { { 0.0 } };
+    for(unsigned int b = 0; b < 3; b++)
+      {
+      const InputPixelType *p0 = idx[b] > 0 ? p - stride[b] : p;
+      const InputPixelType *p1 = idx[b] + 1 < m_Size[b] ? p + stride[b] : p;
+      int steps = (p0 != p) + (p1 != p);
+      for(unsigned int a = 0; a < nc && steps; a++)
+        grad[a][b] = m_Scale * ((double) p1[a] - (double) p0[a]) / steps;
+      }
+
+    // The Jacobian is the identity plus the gradient in physical space
+    double jac[3][3];
+    for(unsigned int a = 0; a < 3; a++)
+      for(unsigned int c = 0; c < 3; c++)
+        {
+        jac[a][c] = (a == c) ? 1.0 : 0.0;
+        for(unsigned int b = 0; b < 3; b++)
+          jac[a][c] += grad[a][b] * m_PhysicalToIndex(b, c);
+        }
+
+    return static_cast<OutputPixelType>(
+          jac[0][0] * (jac[1][1] * jac[2][2] - jac[1][2] * jac[2][1])
+        - jac[0][1] * (jac[1][0] * jac[2][2] - jac[1][2] * jac[2][0])
+        + jac[0][2] * (jac[1][0] * jac[2][1] - jac[1][1] * jac[2][0]));
+  }
+
+  size_t m_Size[3] = { 0, 0, 0 }, m_NumberOfVolumes = 0;
+  const InputPixelType *m_Begin = nullptr;
+  vnl_matrix_fixed<double, 3, 3> m_PhysicalToIndex = vnl_matrix_fixed<double, 3, 3>().set_identity();
+  std::shared_ptr<SliceCache> m_Cache = std::make_shared<SliceCache>(0);
+};
+
 /**
  * A helper class for template instantiation and accessing types involved in vector
  * to scalar reduction in image wrappers
@@ -225,6 +514,10 @@ public:
   typedef VectorToScalarMeanFunctor<TPixel, float> MeanFunctor;
   typedef VectorToScalarImageAccessor<MeanFunctor> MeanImageAccessor;
   typedef itk::ImageAdaptor<VectorImageType, MeanImageAccessor> MeanImageAdaptor;
+
+  typedef VectorToScalarJacobianFunctor<TPixel, float> JacobianFunctor;
+  typedef VectorToScalarImageAccessor<JacobianFunctor> JacobianImageAccessor;
+  typedef itk::ImageAdaptor<VectorImageType, JacobianImageAccessor> JacobianImageAdaptor;
 };
 
 
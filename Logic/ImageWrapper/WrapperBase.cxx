@@ -28,3 +28,11 @@ WrapperBase::GetUniqueId() const
 {
   return m_UniqueId;
 }
+
+void
+WrapperBase::RegisterMemoryUsage()
+{
+  m_MemoryRegistration.Set(
+        [this](MemoryAccounting::Usage &usage) { this->GetMemoryUsage(usage); },
+        [this](MemoryAccounting::ReclaimLevel level) { this->ReclaimMemory(level); });
+}
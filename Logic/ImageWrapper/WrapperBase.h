@@ -5,6 +5,7 @@
 #include "SNAPEvents.h"
 #include "itkObject.h"
 #include "TagList.h"
+#include "MemoryAccounting.h"
 
 class AbstractDisplayMappingPolicy;
 class TDigestDataObject;
@@ -103,6 +104,18 @@ public:
     */
   virtual TDigestDataObject *GetTDigest() = 0;
 
+  /**
+   * Add the memory held by the wrapper to the usage, by category. This is
+   * how the wrapper reports to the MemoryAccounting registry.
+   */
+  virtual void GetMemoryUsage(MemoryAccounting::Usage &usage) const = 0;
+
+  /**
+   * Release the memory that can be recovered at the given level, when the
+   * memory budget is exceeded. By default, nothing is released
+   */
+  virtual void ReclaimMemory(MemoryAccounting::ReclaimLevel itkNotUsed(level)) {}
+
   //  End of virtual methods
   //------------------------------------------
 
@@ -122,6 +135,15 @@ protected:
 
   unsigned long m_UniqueId;
 
+  /**
+   * Register the wrapper with the MemoryAccounting registry. Subclasses call
+   * this at the end of their constructor, and reset m_MemoryRegistration at
+   * the start of their destructor.
+   */
+  void RegisterMemoryUsage();
+
+  MemoryAccounting::Registration m_MemoryRegistration;
+
 };
 
 #endif // WRAPPERBASE_H
@@ -45,6 +45,12 @@
  * \class SNAPAdvectionFieldImageFilter
  * \brief A filter used to compute the advection field in the SNAP level set
  * equation. 
+ *
+ * The field is the gradient of the input, computed with central differences
+ * as in itk::GradientImageFilter, multiplied by the input raised to the
+ * power given by the exponent. It is computed in a single threaded pass, and
+ * the value at a single voxel can be computed with ComputeVectorAtIndex, so
+ * that the field can also be evaluated without storing it.
  */
 template <class TInputImage, class TOutputValueType=float>
 class SNAPAdvectionFieldImageFilter: 
@@ -78,6 +84,8 @@ public:
     VectorType, 
     itkGetStaticConstMacro(ImageDimension)>              OutputImageType;
   typedef itk::SmartPointer<OutputImageType>               OutputImagePointer;
+  typedef typename OutputImageType::RegionType              OutputRegionType;
+  typedef typename InputImageType::IndexType                       IndexType;
   
   
   typedef itk::ImageToImageFilter<InputImageType,OutputImageType>  Superclass;
@@ -90,6 +98,14 @@ public:
 
   /** Get the power of g() by which the gradient is scaled */
   itkGetMacro(Exponent,unsigned int);
+
+  /**
+   * Compute the advection field at a voxel of the buffered region of an
+   * image. Voxels outside of the buffered region are treated as copies of the
+   * nearest boundary voxel.
+   */
+  static VectorType ComputeVectorAtIndex(
+    const InputImageType *image, const IndexType &idx, unsigned int exponent);
     
 protected:
 
@@ -97,8 +113,11 @@ protected:
   virtual ~SNAPAdvectionFieldImageFilter() {};
   void PrintSelf(std::ostream& os, itk::Indent indent) const ITK_OVERRIDE;
   
-  /** Generate Data */
-  void GenerateData( void ) ITK_OVERRIDE;
+  /** The gradient needs a one voxel margin around the output region */
+  void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+  /** Compute the field over a region of the output */
+  void DynamicThreadedGenerateData(const OutputRegionType &region) ITK_OVERRIDE;
 
 private:
 
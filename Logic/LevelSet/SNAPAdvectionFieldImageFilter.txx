@@ -34,60 +34,87 @@
   PURPOSE.  See the above copyright notices for more information. 
 
 =========================================================================*/
-#include "itkGradientImageFilter.h"
-#include "itkMultiplyImageFilter.h"
+#include "itkImageRegionIteratorWithIndex.h"
 
 template<class TInputImage, class TOutputValueType>
 SNAPAdvectionFieldImageFilter<TInputImage,TOutputValueType>
 ::SNAPAdvectionFieldImageFilter()
 {
   m_Exponent = 0;
+  this->DynamicMultiThreadingOn();
 }
 
 template<class TInputImage, class TOutputValueType>
 void
 SNAPAdvectionFieldImageFilter<TInputImage,TOutputValueType>
-::GenerateData()
+::GenerateInputRequestedRegion()
 {
-  // Get the input and output pointers
-  typename InputImageType::ConstPointer imgInput = this->GetInput();
-  typename OutputImageType::Pointer imgOutput = this->GetOutput();
-
-  // Allocate the output image
-  imgOutput->SetBufferedRegion(imgOutput->GetRequestedRegion());
-  imgOutput->Allocate();
-
-  // Create a new gradient filter
-  typedef itk::GradientImageFilter<
-    InputImageType,TOutputValueType,TOutputValueType> GradientFilter;
-  typename GradientFilter::Pointer fltGradient = GradientFilter::New();
-  fltGradient->SetInput(imgInput);
-  fltGradient->ReleaseDataFlagOn();
-
-  // A pointer to the pipeline tail
-  typename itk::ImageSource<OutputImageType>::Pointer 
-    fltPipeEnd = fltGradient.GetPointer();
-  
-  // Attach the appropriate number of multiplicative filters
-  typedef itk::MultiplyImageFilter<
-    OutputImageType,InputImageType,OutputImageType> MultiplyFilter;
-  
-  for(unsigned int i=0;i<m_Exponent;i++)
+  Superclass::GenerateInputRequestedRegion();
+
+  InputImageType *input = const_cast<InputImageType *>(this->GetInput());
+  if(!input)
+    return;
+
+  // Pad the requested region by the radius of the derivative operator
+  typename InputImageType::RegionType region = input->GetRequestedRegion();
+  region.PadByRadius(1);
+  region.Crop(input->GetLargestPossibleRegion());
+  input->SetRequestedRegion(region);
+}
+
+template<class TInputImage, class TOutputValueType>
+typename SNAPAdvectionFieldImageFilter<TInputImage,TOutputValueType>::VectorType
+SNAPAdvectionFieldImageFilter<TInputImage,TOutputValueType>
+::ComputeVectorAtIndex(
+    const InputImageType *image, const IndexType &idx, unsigned int exponent)
+{
+  const typename InputImageType::RegionType &region = image->GetBufferedRegion();
+  const typename InputImageType::PixelType *p =
+      image->GetBufferPointer() + image->ComputeOffset(idx);
+  const itk::OffsetValueType *stride = image->GetOffsetTable();
+  TOutputValueType g = static_cast<TOutputValueType>(*p);
+
+  // Central differences in index space. The voxels beyond the boundary are
+  // copies of the boundary voxels, as with the zero flux Neumann boundary
+  // condition used by itk::GradientImageFilter
+  VectorType local;
+  for(unsigned int d = 0; d < ImageDimension; d++)
     {
-    typename MultiplyFilter::Pointer fltMulti = MultiplyFilter::New();
-    fltMulti->SetInput1(fltPipeEnd->GetOutput());
-    fltMulti->SetInput2(imgInput);
-    fltMulti->ReleaseDataFlagOn();
-    fltPipeEnd = fltMulti;
+    itk::IndexValueType first = region.GetIndex(d);
+    itk::IndexValueType last = first + region.GetSize(d) - 1;
+    TOutputValueType gm = idx[d] > first ? static_cast<TOutputValueType>(p[-stride[d]]) : g;
+    TOutputValueType gp = idx[d] < last ? static_cast<TOutputValueType>(p[stride[d]]) : g;
+    local[d] = static_cast<TOutputValueType>(0.5 * (gp - gm) / image->GetSpacing()[d]);
     }
-  
-  // Call the filter's GenerateData()
-  fltPipeEnd->GraftOutput(imgOutput);
-  fltPipeEnd->Update();
 
-  // graft the mini-pipeline output back onto this filter's output.
-  // this is needed to get the appropriate regions passed back.
-  this->GraftOutput( fltPipeEnd->GetOutput() );
+  // Map the gradient to physical space
+  VectorType grad;
+  for(unsigned int i = 0; i < ImageDimension; i++)
+    {
+    TOutputValueType sum = 0;
+    for(unsigned int j = 0; j < ImageDimension; j++)
+      sum += image->GetDirection()[i][j] * local[j];
+    grad[i] = sum;
+    }
+
+  // Scale by the power of g
+  for(unsigned int k = 0; k < exponent; k++)
+    grad *= g;
+
+  return grad;
+}
+
+template<class TInputImage, class TOutputValueType>
+void
+SNAPAdvectionFieldImageFilter<TInputImage,TOutputValueType>
+::DynamicThreadedGenerateData(const OutputRegionType &region)
+{
+  const InputImageType *input = this->GetInput();
+  OutputImageType *output = this->GetOutput();
+
+  itk::ImageRegionIteratorWithIndex<OutputImageType> it(output, region);
+  for(; !it.IsAtEnd(); ++it)
+    it.Set(ComputeVectorAtIndex(input, it.GetIndex(), m_Exponent));
 }
 
 template<class TInputImage, class TOutputValueType>
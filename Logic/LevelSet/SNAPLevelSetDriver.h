@@ -39,6 +39,7 @@
 
 #include "SnakeParameters.h"
 #include "SNAPLevelSetFunction.h"
+#include <vector>
 // #include "SNAPLevelSetStopAndGoFilter.h"
 
 template <class TFilter> class LevelSetExtensionFilter;
@@ -105,6 +106,14 @@ public:
  * level set evolution is implemented in ITK.  This gives the software a bit of 
  * modularity.  As far as SNAP cares, the public methods declared in this class are
  * the only ways to control level set evolution.
+ *
+ * Every few iterations, the driver keeps a compressed snapshot of the narrow
+ * band of the level set: the sign of every voxel, and the values of the
+ * voxels in the layers of the sparse field. GoToIteration() restores the
+ * nearest snapshot and runs the few remaining iterations, so that the
+ * evolution can be played back and forth without starting over. When the
+ * snapshots exceed their memory budget, every other one is dropped and the
+ * interval between them doubles.
  */
 template <unsigned int VDimension> 
 class SNAPLevelSetDriver : public SNAPLevelSetDriverBase
@@ -168,6 +177,30 @@ public:
   /** Get the number of elapsed iterations */
   unsigned int GetElapsedIterations() const;
 
+  /**
+   * Bring the level set to the state it had (or will have) after a number of
+   * iterations. Going back restores the last snapshot before that iteration
+   * and runs forward from it, going forward runs from the current iteration
+   * or from a later snapshot. The sparse field layers are rebuilt from the
+   * restored band, which the evolution does not depend on, except for the
+   * dense solver, for which values outside of the band are lost.
+   */
+  void GoToIteration(unsigned int iteration);
+
+  /** The iterations at which snapshots are held, in increasing order */
+  std::vector<unsigned int> GetSnapshotIterations() const;
+
+  /** Number of iterations between snapshots, 0 to disable them */
+  void SetSnapshotInterval(unsigned int interval);
+  unsigned int GetSnapshotInterval() const { return m_SnapshotInterval; }
+
+  /** Memory, in bytes, that the compressed snapshots may use */
+  void SetSnapshotMemoryBudget(size_t bytes);
+  size_t GetSnapshotMemoryBudget() const { return m_SnapshotMemoryBudget; }
+
+  /** Memory, in bytes, used by the compressed snapshots */
+  size_t GetSnapshotMemoryUsage() const;
+
   /** Clean up the snake's state */
   void CleanUp();
 
@@ -207,8 +240,52 @@ private:
   /** Assign the values of snake parameters to a snake function */
   void AssignParametersToPhi(const SnakeParameters &parms, bool firstTime);
 
+  /** Voxels with values within this distance of zero are in the layers */
+  static constexpr float SNAPSHOT_BAND = 3.5f;
+
+  /** Value given to the voxels outside of the layers when restoring */
+  static constexpr float SNAPSHOT_OUTSIDE = 4.0f;
+
+  /** A compressed copy of the narrow band after some iteration */
+  struct Snapshot
+  {
+    unsigned int Iteration;
+    size_t BandSize;
+    std::vector<unsigned char> Data;
+  };
+
+  /** Snapshots in increasing order of iteration */
+  std::vector<Snapshot> m_Snapshots;
+
+  unsigned int m_SnapshotInterval;
+  size_t m_SnapshotMemoryBudget;
+
+  /** Image into which snapshots are restored, used as the filter input */
+  FloatImagePointer m_SnapshotImage;
+
+  /**
+   * Iterations elapsed before the filter was started from its current input,
+   * i.e., the iteration of the restored snapshot
+   */
+  unsigned int m_IterationOffset;
+
   /** Internal routines */
   void DoCreateLevelSetFilter();
+
+  /** Start the level set filter over from an input image */
+  void DoRestartFilter(FloatImageType *input, unsigned int iteration);
+
+  /** Compress the band of the current level set into a snapshot */
+  void TakeSnapshot();
+
+  /** Decompress a snapshot into the snapshot image */
+  bool RestoreSnapshot(const Snapshot &snap);
+
+  /** Drop the snapshots after an iteration, which are no longer valid */
+  void DiscardSnapshotsAfter(unsigned int iteration);
+
+  /** Thin out the snapshots until they fit in the memory budget */
+  void EnforceSnapshotBudget();
 };
 
 // Type definitions
@@ -49,7 +49,13 @@
 #include "itkNarrowBandLevelSetImageFilter.h"
 #include "itkDenseFiniteDifferenceImageFilter.h"
 #include "LevelSetExtensionFilter.h"
+#include "TiledSparseFieldLevelSetImageFilter.h"
+#include "itkSparseFieldLevelSetImageFilter.h"
 #include "itkImageDuplicator.h"
+#include "BrickCompression.h"
+#include "SNAPLatencyMonitor.h"
+#include <algorithm>
+#include <cmath>
 
 #include "itkParallelSparseFieldLevelSetImageFilter.h"
 
@@ -112,6 +118,12 @@ SNAPLevelSetDriver<VDimension>
                      const SnakeParameters &sparms,
                      VectorImageType *externalAdvection)
 {
+  // Snapshots every few iterations, with room for a few hundred of them on
+  // typical images
+  m_SnapshotInterval = 10;
+  m_SnapshotMemoryBudget = 256 << 20;
+  m_IterationOffset = 0;
+
   // Create the level set function
   m_LevelSetFunction = LevelSetFunctionType::New();
 
@@ -201,6 +213,44 @@ SNAPLevelSetDriver<VDimension>
     // a filter
     m_LevelSetFilter = filter.GetPointer();
 
+    // Perform the special configuration tasks on the filter
+    filter->SetInput(m_InitializationCopyImage);
+    filter->SetNumberOfLayers(3);
+    filter->SetIsoSurfaceValue(0.0f);
+    filter->SetDifferenceFunction(m_LevelSetFunction);
+    }
+  else if(m_Parameters.GetSolver() == SnakeParameters::TILED_SPARSE_FIELD_SOLVER)
+    {
+    // Sparse field solver that evaluates the band in parallel over tiles
+    typedef TiledSparseFieldLevelSetImageFilter<
+        FloatImageType, FloatImageType> LevelSetFilterType;
+
+    typedef typename LevelSetFilterType::Pointer LevelSetFilterPointer;
+    LevelSetFilterPointer filter = LevelSetFilterType::New();
+
+    // Cast this specific filter down to the lowest common denominator that is
+    // a filter
+    m_LevelSetFilter = filter.GetPointer();
+
+    // Perform the special configuration tasks on the filter
+    filter->SetInput(m_InitializationCopyImage);
+    filter->SetNumberOfLayers(3);
+    filter->SetIsoSurfaceValue(0.0f);
+    filter->SetDifferenceFunction(m_LevelSetFunction);
+    }
+  else if(m_Parameters.GetSolver() == SnakeParameters::SPARSE_FIELD_SOLVER)
+    {
+    // The serial sparse field solver, which the tiled solver must agree with
+    typedef itk::SparseFieldLevelSetImageFilter<
+        FloatImageType, FloatImageType> LevelSetFilterType;
+
+    typedef typename LevelSetFilterType::Pointer LevelSetFilterPointer;
+    LevelSetFilterPointer filter = LevelSetFilterType::New();
+
+    // Cast this specific filter down to the lowest common denominator that is
+    // a filter
+    m_LevelSetFilter = filter.GetPointer();
+
     // Perform the special configuration tasks on the filter
     filter->SetInput(m_InitializationCopyImage);
     filter->SetNumberOfLayers(3);
@@ -250,6 +300,11 @@ SNAPLevelSetDriver<VDimension>
     throw itk::ExceptionObject(__FILE__,__LINE__,"Unknown level set solver requested");
     }
 
+  // The new filter starts over from the initialization, and the snapshots
+  // taken with the old solver no longer apply
+  m_IterationOffset = 0;
+  m_Snapshots.clear();
+
   // This code is common to all filters. It causes the filter to initialize
   // the necessary memory and sets the iteration counter to 0
   m_LevelSetFilter->SetManualReinitialization(true);
@@ -266,6 +321,18 @@ void
 SNAPLevelSetDriver<VDimension>
 ::Restart()
 { 
+  // The snapshots remain valid, since the parameters have not changed
+  DoRestartFilter(m_InitializationCopyImage, 0);
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::DoRestartFilter(FloatImageType *input, unsigned int iteration)
+{
+  m_LevelSetFilter->SetInput(input);
+  m_IterationOffset = iteration;
+
   // Tell the filter to reinitialize next time that an update will 
   // be performed, and set the number of iterations to 0
   m_LevelSetFilter->SetStateToUninitialized();
@@ -282,14 +349,233 @@ void
 SNAPLevelSetDriver<VDimension>
 ::Run(unsigned int nIterations)
 {
-  // Increment the number of iterations 
-  unsigned int nElapsed = m_LevelSetFilter->GetElapsedIterations();
-  m_LevelSetFilter->SetNumberOfIterations(nElapsed + nIterations);
+  // Each call is one step of the evolution as the user sees it
+  SNAP_LATENCY_SCOPE(SNAPLatencyMonitor::SNAKE_ITERATION);
+
+  // Run up to each multiple of the snapshot interval in turn, so that the
+  // snapshots are taken on the way
+  unsigned int target = GetElapsedIterations() + nIterations;
+  while(GetElapsedIterations() < target)
+    {
+    unsigned int now = GetElapsedIterations(), next = target;
+    if(m_SnapshotInterval)
+      next = std::min(target, (now / m_SnapshotInterval + 1) * m_SnapshotInterval);
+
+    // Increment the number of iterations 
+    unsigned int nElapsed = m_LevelSetFilter->GetElapsedIterations();
+    m_LevelSetFilter->SetNumberOfIterations(nElapsed + next - now);
   
-  // Update the largest possible region. The slicer may be changing the 
-  // requested region on this image, so it's important that we always 
-  // update the entire image
-  m_LevelSetFilter->UpdateLargestPossibleRegion();
+    // Update the largest possible region. The slicer may be changing the 
+    // requested region on this image, so it's important that we always 
+    // update the entire image
+    m_LevelSetFilter->UpdateLargestPossibleRegion();
+
+    // The filter may halt early, e.g., when it converges
+    if(GetElapsedIterations() < next)
+      break;
+
+    if(m_SnapshotInterval && next % m_SnapshotInterval == 0)
+      TakeSnapshot();
+    }
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::GoToIteration(unsigned int iteration)
+{
+  unsigned int now = GetElapsedIterations();
+  if(iteration == now)
+    return;
+
+  // Find the last snapshot at or before the requested iteration
+  const Snapshot *start = NULL;
+  for(const Snapshot &snap : m_Snapshots)
+    if(snap.Iteration <= iteration)
+      start = &snap;
+
+  unsigned int from = start ? start->Iteration : 0;
+  if(iteration < now || from > now)
+    {
+    if(start && RestoreSnapshot(*start))
+      DoRestartFilter(m_SnapshotImage, from);
+    else
+      DoRestartFilter(m_InitializationCopyImage, 0);
+    }
+
+  Run(iteration - GetElapsedIterations());
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::TakeSnapshot()
+{
+  unsigned int iteration = GetElapsedIterations();
+  for(const Snapshot &snap : m_Snapshots)
+    if(snap.Iteration == iteration)
+      return;
+
+  // The sign of each voxel and whether it is in the band are stored as bit
+  // masks, followed by the values in the band with their bytes grouped by
+  // significance, which all compress well
+  FloatImageType *phi = m_LevelSetFilter->GetOutput();
+  const float *p = phi->GetBufferPointer();
+  size_t n = phi->GetPixelContainer()->Size(), nBits = (n + 7) / 8;
+
+  std::vector<unsigned char> raw(2 * nBits, 0);
+  std::vector<float> band;
+  for(size_t i = 0; i < n; i++)
+    {
+    if(p[i] < 0.0f)
+      raw[i >> 3] |= (unsigned char) (1 << (i & 7));
+    if(std::fabs(p[i]) < SNAPSHOT_BAND)
+      {
+      raw[nBits + (i >> 3)] |= (unsigned char) (1 << (i & 7));
+      band.push_back(p[i]);
+      }
+    }
+
+  size_t nBand = band.size();
+  raw.resize(2 * nBits + sizeof(float) * nBand);
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(band.data());
+  for(size_t j = 0; j < nBand; j++)
+    for(size_t b = 0; b < sizeof(float); b++)
+      raw[2 * nBits + b * nBand + j] = bytes[j * sizeof(float) + b];
+
+  Snapshot snap;
+  snap.Iteration = iteration;
+  snap.BandSize = nBand;
+  if(!BrickCompression::Encode(raw.data(), raw.size(), snap.Data))
+    return;
+
+  auto it = std::find_if(m_Snapshots.begin(), m_Snapshots.end(),
+                         [iteration](const Snapshot &s) { return s.Iteration > iteration; });
+  m_Snapshots.insert(it, std::move(snap));
+  EnforceSnapshotBudget();
+}
+
+template<unsigned int VDimension>
+bool
+SNAPLevelSetDriver<VDimension>
+::RestoreSnapshot(const Snapshot &snap)
+{
+  if(!m_SnapshotImage)
+    {
+    m_SnapshotImage = FloatImageType::New();
+    m_SnapshotImage->CopyInformation(m_InitializationCopyImage);
+    m_SnapshotImage->SetRegions(m_InitializationCopyImage->GetBufferedRegion());
+    m_SnapshotImage->Allocate();
+    }
+
+  size_t n = m_SnapshotImage->GetPixelContainer()->Size(), nBits = (n + 7) / 8;
+  std::vector<unsigned char> raw(2 * nBits + sizeof(float) * snap.BandSize);
+  if(!BrickCompression::Decode(snap.Data, raw.data(), raw.size()))
+    return false;
+
+  // Voxels outside of the band are given the value of the voxels beyond the
+  // outermost layer, which is all the sparse field filter looks at
+  float *p = m_SnapshotImage->GetBufferPointer();
+  size_t j = 0;
+  for(size_t i = 0; i < n; i++)
+    {
+    bool inside = (raw[i >> 3] >> (i & 7)) & 1;
+    bool inBand = (raw[nBits + (i >> 3)] >> (i & 7)) & 1;
+    if(inBand && j < snap.BandSize)
+      {
+      float v;
+      unsigned char *bytes = reinterpret_cast<unsigned char *>(&v);
+      for(size_t b = 0; b < sizeof(float); b++)
+        bytes[b] = raw[2 * nBits + b * snap.BandSize + j];
+      p[i] = v;
+      j++;
+      }
+    else
+      {
+      p[i] = inside ? -SNAPSHOT_OUTSIDE : SNAPSHOT_OUTSIDE;
+      }
+    }
+
+  m_SnapshotImage->Modified();
+  return j == snap.BandSize;
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::DiscardSnapshotsAfter(unsigned int iteration)
+{
+  m_Snapshots.erase(
+        std::remove_if(m_Snapshots.begin(), m_Snapshots.end(),
+                       [iteration](const Snapshot &s) { return s.Iteration > iteration; }),
+        m_Snapshots.end());
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::EnforceSnapshotBudget()
+{
+  // Keep only the snapshots at multiples of twice the interval, which are
+  // every other one if none have been dropped before
+  while(m_SnapshotInterval && GetSnapshotMemoryUsage() > m_SnapshotMemoryBudget)
+    {
+    unsigned int interval = m_SnapshotInterval * 2;
+    if(interval < m_SnapshotInterval)
+      {
+      m_Snapshots.clear();
+      break;
+      }
+
+    m_SnapshotInterval = interval;
+    m_Snapshots.erase(
+          std::remove_if(m_Snapshots.begin(), m_Snapshots.end(),
+                         [interval](const Snapshot &s) { return s.Iteration % interval != 0; }),
+          m_Snapshots.end());
+    }
+}
+
+template<unsigned int VDimension>
+std::vector<unsigned int>
+SNAPLevelSetDriver<VDimension>
+::GetSnapshotIterations() const
+{
+  std::vector<unsigned int> iterations;
+  for(const Snapshot &snap : m_Snapshots)
+    iterations.push_back(snap.Iteration);
+  return iterations;
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::SetSnapshotInterval(unsigned int interval)
+{
+  m_SnapshotInterval = interval;
+  if(interval)
+    EnforceSnapshotBudget();
+  else
+    m_Snapshots.clear();
+}
+
+template<unsigned int VDimension>
+void
+SNAPLevelSetDriver<VDimension>
+::SetSnapshotMemoryBudget(size_t bytes)
+{
+  m_SnapshotMemoryBudget = bytes;
+  EnforceSnapshotBudget();
+}
+
+template<unsigned int VDimension>
+size_t
+SNAPLevelSetDriver<VDimension>
+::GetSnapshotMemoryUsage() const
+{
+  size_t total = 0;
+  for(const Snapshot &snap : m_Snapshots)
+    total += snap.Data.size();
+  return total;
 }
 
 template<unsigned int VDimension>
@@ -310,7 +596,7 @@ unsigned int
 SNAPLevelSetDriver<VDimension>
 ::GetElapsedIterations() const
 {
-  return m_LevelSetFilter->GetElapsedIterations();
+  return m_IterationOffset + m_LevelSetFilter->GetElapsedIterations();
 }
 
 template<unsigned int VDimension>
@@ -342,6 +628,10 @@ SNAPLevelSetDriver<VDimension>
   // has changed, then it's destructive, otherwise it's passive
   bool destructive = sparms.GetSolver() != m_Parameters.GetSolver();
 
+  // The evolution past the current iteration will be different
+  if(sparms != m_Parameters)
+    DiscardSnapshotsAfter(GetElapsedIterations());
+
   // First of all, pass the parameters to the phi function, which may or
   // may not cause it to recompute it's images
   AssignParametersToPhi(sparms,false);
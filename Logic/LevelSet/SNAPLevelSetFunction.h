@@ -317,15 +317,16 @@ private:
   /** The speed image g() computed externally with user interaction */
   SpeedImagePointer m_SpeedImage;
 
-  /** The advection field (possibly scaled by speed image g() */
+  /** The external advection field. When there is none, the gradient of the
+      speed image (possibly scaled by g()) is evaluated where it is needed,
+      so that it does not have to be stored for the whole image */
   VectorImagePointer m_AdvectionField;
 
   /** Flag, specifyting that the advection image is loaded externally */
   bool m_UseExternalAdvectionField;
 
-  /** Gradient filter used to produce the advection field */
+  /** Gradient filter whose formula is used for the advection field */
   typedef SNAPAdvectionFieldImageFilter<SpeedImageType,float> AdvectionFilterType;
-  typename AdvectionFilterType::Pointer m_AdvectionFilter;
 
   /** Instances of the interpolators */
   typename SpeedImageInterpolatorType::Pointer m_SpeedInterpolator;
@@ -333,6 +334,10 @@ private:
 
   /** The constant time step */
   TimeStepType m_TimeStepFactor;
+
+  /** Evaluate the advection field computed from the speed image at a point */
+  VectorType InterpolateAdvectionField(
+    const IndexType &idx, const FloatOffsetType &offset) const;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
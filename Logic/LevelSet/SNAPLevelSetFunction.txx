@@ -39,6 +39,8 @@
 #include "itkMultiplyImageFilter.h"
 #include "itkNumericTraits.h"
 
+#include <algorithm>
+#include <cmath>
 #include <map>
 
 template <class TSpeedImageType, class TImageType>
@@ -57,8 +59,6 @@ SNAPLevelSetFunction<TSpeedImageType,TImageType>
 
   m_SpeedInterpolator = SpeedImageInterpolatorType::New();
   m_AdvectionFieldInterpolator = VectorInterpolatorType::New();
-  
-  m_AdvectionFilter = AdvectionFilterType::New();
 }
 
 template <class TSpeedImageType, class TImageType>
@@ -75,7 +75,6 @@ SNAPLevelSetFunction<TSpeedImageType,TImageType>
 {
   m_SpeedImage = pointer;
   m_SpeedInterpolator->SetInputImage(m_SpeedImage);
-  m_AdvectionFilter->SetInput(m_SpeedImage);
 }
 
 template <class TSpeedImageType, class TImageType>
@@ -84,21 +83,14 @@ SNAPLevelSetFunction<TSpeedImageType,TImageType>
 ::CalculateInternalImages()
 {
   
-  // There is still the business of the advection image to attend to
-  // Compute \f$ \nabla g() \f$ (will be cached from run to run)
-  if(!m_UseExternalAdvectionField)
-    {
-    assert(m_AdvectionSpeedExponent >= 0);
-    m_AdvectionFilter->SetExponent((unsigned int)m_AdvectionSpeedExponent);
-    m_AdvectionFilter->Update();
-    m_AdvectionField = 
-      reinterpret_cast< VectorImageType* > (
-        m_AdvectionFilter->GetOutput());
-    }
+  // There is still the business of the advection image to attend to. The
+  // field \f$ g^k \nabla g() \f$ is not precomputed, it is evaluated in
+  // AdvectionField() from the speed image
+  assert(m_AdvectionSpeedExponent >= 0);
 
   // Set up the advection interpolator
-  // if(m_AdvectionSpeedExponent != 0)
-  m_AdvectionFieldInterpolator->SetInputImage(m_AdvectionField);
+  if(m_UseExternalAdvectionField)
+    m_AdvectionFieldInterpolator->SetInputImage(m_AdvectionField);
 }
 
 template <class TSpeedImageType, class TImageType>
@@ -115,13 +107,20 @@ SNAPLevelSetFunction<TSpeedImageType,TImageType>
   for (unsigned i = 0; i < ImageDimension; ++i)
     cdx[i] = static_cast<double>(idx[i]) - offset[i];
 
-  if ( m_AdvectionFieldInterpolator->IsInsideBuffer(cdx) )
+  if(m_UseExternalAdvectionField)
     {
-    avec = m_AdvectionFieldInterpolator->EvaluateAtContinuousIndex(cdx);
+    if ( m_AdvectionFieldInterpolator->IsInsideBuffer(cdx) )
+      {
+      avec = m_AdvectionFieldInterpolator->EvaluateAtContinuousIndex(cdx);
+      }
+    else
+      {
+      avec = m_AdvectionField->GetPixel(idx);
+      }
     }
   else
     {
-    avec = m_AdvectionField->GetPixel(idx);
+    avec = this->InterpolateAdvectionField(idx, offset);
     }
 
   for(unsigned i = 0; i < ImageDimension; i++)
@@ -130,6 +129,70 @@ SNAPLevelSetFunction<TSpeedImageType,TImageType>
   return avec;
 }
 
+template <class TSpeedImageType, class TImageType>
+typename SNAPLevelSetFunction<TSpeedImageType,TImageType>::VectorType
+SNAPLevelSetFunction<TSpeedImageType,TImageType>
+::InterpolateAdvectionField(const IndexType &idx, const FloatOffsetType &offset) const
+{
+  typedef typename AdvectionFilterType::VectorType FieldVectorType;
+  unsigned int exponent = (unsigned int) m_AdvectionSpeedExponent;
+  VectorType avec;
+
+  ContinuousIndexType cdx;
+  for(unsigned int i = 0; i < ImageDimension; i++)
+    cdx[i] = static_cast<double>(idx[i]) - offset[i];
+
+  // Outside of the buffer, use the value at the voxel itself
+  if(!m_SpeedInterpolator->IsInsideBuffer(cdx))
+    {
+    FieldVectorType v = AdvectionFilterType::ComputeVectorAtIndex(m_SpeedImage, idx, exponent);
+    for(unsigned int i = 0; i < ImageDimension; i++)
+      avec[i] = v[i];
+    return avec;
+    }
+
+  // Linear interpolation between the values at the corners of the voxel
+  // containing the point, with neighbors beyond the buffer clamped to it,
+  // as in itk::VectorLinearInterpolateImageFunction
+  const typename SpeedImageType::RegionType &region = m_SpeedImage->GetBufferedRegion();
+  IndexType base;
+  double frac[ImageDimension];
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    {
+    base[d] = (itk::IndexValueType) std::floor(cdx[d]);
+    frac[d] = cdx[d] - base[d];
+    }
+
+  avec.Fill(0);
+  for(unsigned int corner = 0; corner < (1u << ImageDimension); corner++)
+    {
+    double w = 1.0;
+    IndexType cidx = base;
+    for(unsigned int d = 0; d < ImageDimension; d++)
+      {
+      if(corner & (1u << d))
+        {
+        w *= frac[d];
+        itk::IndexValueType last = region.GetIndex(d) + region.GetSize(d) - 1;
+        cidx[d] = std::min(base[d] + 1, last);
+        }
+      else
+        {
+        w *= 1.0 - frac[d];
+        }
+      }
+
+    if(w == 0.0)
+      continue;
+
+    FieldVectorType v = AdvectionFilterType::ComputeVectorAtIndex(m_SpeedImage, cidx, exponent);
+    for(unsigned int i = 0; i < ImageDimension; i++)
+      avec[i] += w * v[i];
+    }
+
+  return avec;
+}
+
 template <class TSpeedImageType, class TImageType>
 void
 SNAPLevelSetFunction<TSpeedImageType, TImageType>
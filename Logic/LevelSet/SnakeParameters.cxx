@@ -62,7 +62,7 @@ SnakeParameters
   p.m_AdvectionWeight = 2.0;
   p.m_AdvectionSpeedExponent = 0;       
 
-  p.m_Solver = PARALLEL_SPARSE_FIELD_SOLVER;
+  p.m_Solver = TILED_SPARSE_FIELD_SOLVER;
 
   return p;
 }
@@ -92,7 +92,7 @@ SnakeParameters
   p.m_AdvectionWeight = 0;
   p.m_AdvectionSpeedExponent = 0;       
 
-  p.m_Solver = PARALLEL_SPARSE_FIELD_SOLVER;
+  p.m_Solver = TILED_SPARSE_FIELD_SOLVER;
 
   return p;
 }
@@ -122,7 +122,7 @@ SnakeParameters
   p.m_AdvectionWeight = 0;
   p.m_AdvectionSpeedExponent = 0;       
 
-  p.m_Solver = PARALLEL_SPARSE_FIELD_SOLVER;
+  p.m_Solver = TILED_SPARSE_FIELD_SOLVER;
 
   return p;
 }
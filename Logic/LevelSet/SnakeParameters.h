@@ -62,7 +62,8 @@ public:
 
   enum SolverType {
     PARALLEL_SPARSE_FIELD_SOLVER, SPARSE_FIELD_SOLVER,
-    NARROW_BAND_SOLVER, LEGACY_SOLVER, DENSE_SOLVER
+    NARROW_BAND_SOLVER, LEGACY_SOLVER, DENSE_SOLVER,
+    TILED_SPARSE_FIELD_SOLVER
   };
 
 
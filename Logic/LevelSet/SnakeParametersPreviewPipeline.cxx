@@ -49,6 +49,9 @@
 #include "vtkImageImport.h"
 #include "vtkPolyData.h"
 #include <vtkPoints2D.h>
+#include <vtkSmartPointer.h>
+#include <algorithm>
+#include <chrono>
 
 #include "SNAPLevelSetDriver.h"
 #include "PolygonScanConvert.h"
@@ -201,10 +204,10 @@ public:
         m_CurrentCurve->InsertNextPoint(pt1[0] + 0.5,pt1[1] + 0.5);
         m_CurrentCurve->InsertNextPoint(pt2[0] + 0.5,pt2[1] + 0.5);
         }
-      }
 
-    m_VTKImporter->Delete();
-    m_VTKContour->Delete();
+      m_VTKImporter->Delete();
+      m_VTKContour->Delete();
+      }
     }
 
   // Change the speed image passed as the input to the level set
@@ -295,13 +298,42 @@ void
 SnakeParametersPreviewPipeline
 ::AnimationCallback()
 {
-  // Call the callback on the demo loop
-  m_DemoLoop->OnTimerEvent();
+  // If the previous step is still running, skip this tick
+  if(m_DemoStep.valid())
+    {
+    if(m_DemoStep.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return;
+
+    // Collect the contour computed by the step, unless the demo was
+    // restarted while it was running
+    m_DemoStep.get();
+    if(!m_DemoRestart)
+      m_DemoContour->DeepCopy(m_DemoLoop->GetEvolvingContour());
+    }
+
+  // Pass the inputs that changed since the last step to the demo loop. Only
+  // the latest values matter, so a slider that is being dragged does not
+  // queue up work for the demo loop
+  if(m_DemoSpeedModified)
+    m_DemoLoop->SetSpeedImage(m_SpeedImage);
+  if(m_DemoContourModified)
+    m_DemoLoop->SetInitialContour(m_SampledPoints);
+  if(m_DemoParametersModified)
+    m_DemoLoop->SetSnakeParameters(m_Parameters);
+  if(m_DemoRestart)
+    m_DemoLoop->Restart();
+  m_DemoSpeedModified = m_DemoContourModified = false;
+  m_DemoParametersModified = m_DemoRestart = false;
+
+  // Run the next step in the background
+  LevelSetPreview2d *loop = m_DemoLoop;
+  m_DemoStep = std::async(std::launch::async, [loop]() { loop->OnTimerEvent(); });
 }
 
 void SnakeParametersPreviewPipeline::AnimationRestart()
 {
-  m_DemoLoop->Restart();
+  m_DemoRestart = true;
+  m_DemoContour->Reset();
 }
 
 SnakeParametersPreviewPipeline
@@ -317,6 +349,8 @@ SnakeParametersPreviewPipeline
   m_SpeedModified = false;
   m_ParametersModified = false;
   m_QuickUpdate = false;
+  m_ImageSamplesModified = false;
+  m_SplineBasisControlPoints = 0;
 
   // Initialize the parameters
   m_Parameters = SnakeParameters::GetDefaultEdgeParameters();
@@ -328,11 +362,18 @@ SnakeParametersPreviewPipeline
 
   // Create a new demo loop
   m_DemoLoop = new LevelSetPreview2d;
+  m_DemoContour = vtkSmartPointer<vtkPoints2D>::New();
+  m_DemoSpeedModified = m_DemoContourModified = false;
+  m_DemoParametersModified = m_DemoRestart = false;
 }
 
 SnakeParametersPreviewPipeline
 ::~SnakeParametersPreviewPipeline()
 {
+  // Let the running step of the demo loop finish
+  if(m_DemoStep.valid())
+    m_DemoStep.wait();
+
   delete m_DemoLoop;
 }
 
@@ -378,23 +419,44 @@ SnakeParametersPreviewPipeline
     {
     // Set the modified flag
     m_SpeedModified = true;
+    m_ImageSamplesModified = true;
     m_SpeedImage = image;
 
-    // Create a filter to compute a gradient image
-    typedef itk::GradientImageFilter<ShortImageType> GradientFilter;
-    GradientFilter::Pointer filter = GradientFilter::New();
+    // The gradient is only computed once for each speed image, since the
+    // model switches between the edge and the region example images
+    m_GradientImage = NULL;
+    for(const GradientCacheEntry &entry : m_GradientCache)
+      if(entry.Speed == image && entry.Speed->GetMTime() < entry.Gradient->GetMTime())
+        m_GradientImage = entry.Gradient;
 
-    filter->SetInput(m_SpeedImage);
-    filter->Update();
-    m_GradientImage = filter->GetOutput();
+    if(m_GradientImage.IsNull())
+      {
+      // Create a filter to compute a gradient image
+      typedef itk::GradientImageFilter<ShortImageType> GradientFilter;
+      GradientFilter::Pointer filter = GradientFilter::New();
+
+      filter->SetInput(m_SpeedImage);
+      filter->Update();
+      m_GradientImage = filter->GetOutput();
+      m_GradientImage->DisconnectPipeline();
+
+      GradientCacheEntry entry;
+      entry.Speed = image;
+      entry.Gradient = m_GradientImage;
+      m_GradientCache.erase(
+            std::remove_if(m_GradientCache.begin(), m_GradientCache.end(),
+                           [image](const GradientCacheEntry &e) { return e.Speed == image; }),
+            m_GradientCache.end());
+      m_GradientCache.push_back(entry);
+      }
 
     // Pass the image to the display functor
     m_DisplayMapper->SetInput(m_SpeedImage);
     DisplayImageType *di = m_DisplayMapper->GetOutput();
     di->Update();
 
-    // Pass the speed image to the preview object
-    m_DemoLoop->SetSpeedImage(image);
+    // Pass the speed image to the preview object on the next demo step
+    m_DemoSpeedModified = true;
     }
 }
 
@@ -420,8 +482,8 @@ SnakeParametersPreviewPipeline
   m_Parameters = clean;
   m_ParametersModified = true;
 
-  // Pass the parameters to the demo loop
-  m_DemoLoop->SetSnakeParameters(m_Parameters);
+  // Pass the parameters to the demo loop on the next demo step
+  m_DemoParametersModified = true;
 }
 
 void
@@ -448,13 +510,14 @@ SnakeParametersPreviewPipeline
     {
     if(m_ControlsModified)
       {
-      m_DemoLoop->SetInitialContour(GetSampledPoints());
+      m_DemoContourModified = true;
       // UpdateLevelSet(context);
       }
-    if(m_ParametersModified || m_ControlsModified)
+    if(m_ParametersModified || m_ControlsModified || m_SpeedModified)
       {
       UpdateForces();
       m_ParametersModified = false;
+      m_SpeedModified = false;
       }
     }
 
@@ -467,20 +530,14 @@ SnakeParametersPreviewPipeline
 
 void
 SnakeParametersPreviewPipeline
-::UpdateContour()
+::UpdateSplineBasis()
 {
-  // Create a b-spline object
-  typedef itk::BSplineInterpolationWeightFunction<double,1,3> FunctionType;
-  FunctionType::Pointer function = FunctionType::New();
-
-  // Used to compute spline derivatives
+  // Used to compute the spline and its derivatives
   itk::BSplineKernelFunction<3>::Pointer kf3 = itk::BSplineKernelFunction<3>::New();
   itk::BSplineKernelFunction<2>::Pointer kf2 = itk::BSplineKernelFunction<2>::New();
   itk::BSplineKernelFunction<2>::Pointer kf1 = itk::BSplineKernelFunction<2>::New();
 
-  // Initialize the sampled point array
-  m_SampledPoints.clear();
-  m_SampledPoints.reserve(m_NumberOfSampledPoints);
+  m_SplineBasis.clear();
 
   int uMax = m_ControlPoints.size() - 3;
   for(double t = 0; t < 1.0; t += 0.005)
@@ -492,27 +549,55 @@ SnakeParametersPreviewPipeline
     int sidx = (int) floor(s - 1);
     double u = s - sidx;
 
+    // Compute the weights of the position and derivatives of the b-spline
+    SplineBasisSample sample;
+    sample.t = t;
+    for(int k=0; k < 4; k++)
+      {
+      sample.w[k] = kf3->Evaluate(u);
+      sample.wu[k] = kf2->Evaluate(u+0.5) - kf2->Evaluate(u-0.5);
+      sample.wuu[k] = kf1->Evaluate(u+1) + kf1->Evaluate(u-1) - 2 * kf1->Evaluate(u);
+      sample.index[k] = (uMax + sidx + k) % uMax;
+      u-=1.0;
+      }
+
+    m_SplineBasis.push_back(sample);
+    }
+}
+
+void
+SnakeParametersPreviewPipeline
+::UpdateContour()
+{
+  // The weights only change with the number of control points
+  if(m_SplineBasis.empty() || m_SplineBasisControlPoints != m_ControlPoints.size())
+    {
+    UpdateSplineBasis();
+    m_SplineBasisControlPoints = m_ControlPoints.size();
+    }
+
+  // Initialize the sampled point array
+  m_SampledPoints.clear();
+  m_SampledPoints.reserve(m_SplineBasis.size());
+
+  for(const SplineBasisSample &sample : m_SplineBasis)
+    {
     // Compute the position and derivatives of the b-spline
     Vector2d x(0.0f,0.0f);
     Vector2d xu(0.0f,0.0f);
     Vector2d xuu(0.0f,0.0f);
     for(int k=0; k < 4; k++)
       {
-      double w = kf3->Evaluate(u);
-      double wu = kf2->Evaluate(u+0.5) - kf2->Evaluate(u-0.5);
-      double wuu = kf1->Evaluate(u+1) + kf1->Evaluate(u-1) - 2 * kf1->Evaluate(u);
-      u-=1.0;
-
-      int idx = (uMax + sidx + k) % uMax;
-      x += w * m_ControlPoints[idx];
-      xu += wu * m_ControlPoints[idx];
-      xuu += wuu * m_ControlPoints[idx];
+      const Vector2d &cp = m_ControlPoints[sample.index[k]];
+      x += sample.w[k] * cp;
+      xu += sample.wu[k] * cp;
+      xuu += sample.wuu[k] * cp;
       }
 
     // Create and save the point
     SampledPoint pt;
     pt.x = x;
-    pt.t = t;
+    pt.t = sample.t;
     xu.normalize();
     pt.n = Vector2d(-xu[1],xu[0]);
     pt.PropagationForce = pt.CurvatureForce = pt.AdvectionForce = 0.0;
@@ -521,6 +606,9 @@ SnakeParametersPreviewPipeline
 
     m_SampledPoints.push_back(pt);
     }
+
+  // The image samples must follow the curve
+  m_ImageSamplesModified = true;
 }
 
 void
@@ -537,7 +625,7 @@ SnakeParametersPreviewPipeline
 
 void
 SnakeParametersPreviewPipeline
-::UpdateForces()
+::UpdateImageSamples()
 {
   // Image interpolator types
   typedef itk::LinearInterpolateImageFunction<
@@ -556,29 +644,47 @@ SnakeParametersPreviewPipeline
   // Get the image dimensions
   itk::Size<2> idim = m_SpeedImage->GetBufferedRegion().GetSize();
 
-  // Compute the geometry of each point
+  m_ImageSamples.resize(m_SampledPoints.size());
   for(unsigned int i = 0; i < m_SampledPoints.size(); i++)
     {
-    // A reference so we can access the point in shorthand
-    SampledPoint &p = m_SampledPoints[i];
+    const SampledPoint &p = m_SampledPoints[i];
 
-    // We're done computing the geometric properties of the curve.  Now, let's
-    // compute the image-related quantities.  First, convert the point to image
-    // coordinates
+    // Convert the point to image coordinates
     LerpType::ContinuousIndexType idx;
     idx[0] = idim[0] * p.x[0];
     idx[1] = idim[1] * p.x[1];
 
-    // Get the value of the g function
+    // Get the value of the g function. Scale to [-1 1] range because speed is
+    // represented as a short internally
     double g = sLerp->EvaluateAtContinuousIndex(idx);
-
-    // Scale to [-1 1] range because speed is represented as a short internally
     g /= 0x7fff;
 
-    // Get the value of the gradient
+    // Get the value of the gradient, projected on the normal
     VectorLerpType::OutputType gradG = gLerp->EvaluateAtContinuousIndex(idx);
     gradG /= 0x7fff;
 
+    m_ImageSamples[i].g = g;
+    m_ImageSamples[i].gradNormal = p.n[0] * gradG[0] + p.n[1] * gradG[1];
+    }
+
+  m_ImageSamplesModified = false;
+}
+
+void
+SnakeParametersPreviewPipeline
+::UpdateForces()
+{
+  // The image samples only change with the curve or the speed image
+  if(m_ImageSamplesModified || m_ImageSamples.size() != m_SampledPoints.size())
+    UpdateImageSamples();
+
+  // Compute the forces acting on each point
+  for(unsigned int i = 0; i < m_SampledPoints.size(); i++)
+    {
+    // A reference so we can access the point in shorthand
+    SampledPoint &p = m_SampledPoints[i];
+    double g = m_ImageSamples[i].g;
+
     // Compute the propagation force component of the curve evolution
     p.PropagationForce = m_Parameters.GetPropagationWeight()
       * pow(g,m_Parameters.GetPropagationSpeedExponent());
@@ -589,7 +695,7 @@ SnakeParametersPreviewPipeline
 
     // Compute the advection force component of the curve evolution
     p.AdvectionForce = - m_Parameters.GetAdvectionWeight()
-      * (p.n[0] * gradG[0] + p.n[1] * gradG[1])
+      * m_ImageSamples[i].gradNormal
       * pow(g,m_Parameters.GetAdvectionSpeedExponent());
     }
 }
@@ -600,5 +706,5 @@ vtkPoints2D *
 SnakeParametersPreviewPipeline
 ::GetDemoLoopContour()
 {
-  return m_DemoLoop->GetEvolvingContour();
+  return m_DemoContour;
 }
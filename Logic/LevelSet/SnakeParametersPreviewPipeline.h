@@ -42,6 +42,8 @@
 #include "SnakeParameters.h"
 #include "ColorMap.h"
 #include "ImageWrapperTraits.h"
+#include "vtkSmartPointer.h"
+#include <future>
 
 template <class TSpeedImageType, class TImageType> class SNAPLevelSetFunction;
 template<class TFilter> class LevelSetExtensionFilter;
@@ -69,6 +71,11 @@ class LevelSetPreview2d;
  * class computes a b-spline curve based on those control points, creates a
  * level set embedding of the curve, and computes various level set evolution
  * forces acting on the curve.
+ *
+ * The intermediate results are cached, so that changing the snake parameters
+ * only recomputes the forces from cached image samples, and moving a control
+ * point only recomputes the curve from cached B-spline weights. The steps of
+ * the demo loop run in a background thread.
  */
 class SnakeParametersPreviewPipeline
 {
@@ -144,14 +151,18 @@ public:
   /** Get a list of densely interpolated points on the curve (for drawing) */
   irisGetMacro(SampledPoints,const SampledPointList &);
 
-  /** Get the demo loop contour */
+  /** Get the demo loop contour, as of the last completed step */
   vtkPoints2D *GetDemoLoopContour();
 
   /** Get the color image corresponding to the speed image */
   DisplayImageType *GetDisplayImage()  
     { return m_DisplayMapper->GetOutput(); }
 
-  /** Set the idle callback function that FLTK should call in demo mode */
+  /**
+   * Advance the demo loop, called on a timer in demo mode. This collects the
+   * contour of the previous step if it has completed, passes any changed
+   * inputs to the demo loop, and starts the next step in the background.
+   */
   void AnimationCallback();
 
   /** Have the animation restart on the next callback */
@@ -185,16 +196,50 @@ private:
   /** A list of sampled points */
   SampledPointList m_SampledPoints;
 
+  // The B-spline weights of a sampled point, which only depend on the number
+  // of control points
+  struct SplineBasisSample
+  {
+    double t;
+    int index[4];
+    double w[4], wu[4], wuu[4];
+  };
+
+  std::vector<SplineBasisSample> m_SplineBasis;
+  size_t m_SplineBasisControlPoints;
+
+  // The quantities of the speed image at a sampled point, which do not depend
+  // on the snake parameters
+  struct ImageSample
+  {
+    double g;
+    double gradNormal;
+  };
+
+  std::vector<ImageSample> m_ImageSamples;
+
+  // Gradients of the speed images passed to the pipeline
+  struct GradientCacheEntry
+  {
+    itk::SmartPointer<ShortImageType> Speed;
+    VectorImagePointer Gradient;
+  };
+
+  std::vector<GradientCacheEntry> m_GradientCache;
+
   // Flags indicating which part of the pipeline should be refreshed
   bool m_ControlsModified;
   bool m_SpeedModified;
   bool m_ParametersModified;
   bool m_QuickUpdate;
+  bool m_ImageSamplesModified;
     
   // Internal components of the Update method
   void UpdateLevelSetFunction();
+  void UpdateSplineBasis();
   void UpdateContour();
   void UpdateLevelSet();
+  void UpdateImageSamples();
   void UpdateForces();
 
   // A filter used to convert the speed image to a color image to display on the screen
@@ -224,6 +269,17 @@ private:
 
   // Demo loop object
   LevelSetPreview2d *m_DemoLoop;
+
+  // The step of the demo loop running in the background
+  std::future<void> m_DemoStep;
+
+  // Copy of the contour of the last completed step, for display
+  vtkSmartPointer<vtkPoints2D> m_DemoContour;
+
+  // Inputs that changed since they were last passed to the demo loop. They
+  // are only passed on while no step is running
+  bool m_DemoSpeedModified, m_DemoContourModified;
+  bool m_DemoParametersModified, m_DemoRestart;
 };
 
 
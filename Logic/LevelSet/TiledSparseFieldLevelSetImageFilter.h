@@ -0,0 +1,128 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Module:    $RCSfile: TiledSparseFieldLevelSetImageFilter.h,v $
+  Language:  C++
+  Copyright (c) 2007 Paul A. Yushkevich
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#ifndef __TiledSparseFieldLevelSetImageFilter_h_
+#define __TiledSparseFieldLevelSetImageFilter_h_
+
+#include "itkSparseFieldLevelSetImageFilter.h"
+#include "itkNeighborhoodIterator.h"
+#include <vector>
+
+/**
+ * \class TiledSparseFieldLevelSetImageFilter
+ * \brief A sparse field level set filter that computes the update for the
+ * active layer in parallel over spatial tiles of the narrow band.
+ *
+ * The parallel sparse field filter in ITK splits the image into one slab per
+ * thread along the last axis and synchronizes the threads several times per
+ * iteration, which scales poorly when the band occupies only a few slabs.
+ * This filter keeps the serial layer bookkeeping of the sparse field filter
+ * and only parallelizes CalculateChange(), where nearly all of the time is
+ * spent evaluating the level set function. The active layer nodes are binned
+ * into cubic tiles of TileSize voxels on a side, and the tiles, largest
+ * first, are handed out to the work units from a shared queue, so a work unit
+ * that finishes early picks up the remaining tiles of the others.
+ *
+ * The update buffer is still filled in active layer order, so the update
+ * values are the same as those computed by the serial filter.
+ */
+template <class TInputImage, class TOutputImage>
+class ITK_EXPORT TiledSparseFieldLevelSetImageFilter
+  : public itk::SparseFieldLevelSetImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef TiledSparseFieldLevelSetImageFilter Self;
+  typedef itk::SparseFieldLevelSetImageFilter<TInputImage, TOutputImage> Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+
+  /** Some typedefs from the parent class */
+  typedef typename Superclass::TimeStepType TimeStepType;
+  typedef typename Superclass::ValueType ValueType;
+  typedef typename Superclass::IndexType IndexType;
+  typedef typename Superclass::LayerType LayerType;
+  typedef typename Superclass::LayerNodeType LayerNodeType;
+  typedef typename Superclass::OutputImageType OutputImageType;
+  typedef typename Superclass::FiniteDifferenceFunctionType FiniteDifferenceFunctionType;
+
+  itkStaticConstMacro(ImageDimension, unsigned int, Superclass::ImageDimension);
+
+  /** Run-time type information. */
+  itkTypeMacro(TiledSparseFieldLevelSetImageFilter,
+               itk::SparseFieldLevelSetImageFilter)
+
+  /** New object of this type */
+  itkNewMacro(Self)
+
+  /** Size of the tiles into which the narrow band is split, in voxels */
+  itkSetMacro(TileSize, unsigned int)
+  itkGetConstMacro(TileSize, unsigned int)
+
+  /** Below this many active nodes per work unit, the serial code is used */
+  itkSetMacro(MinimumNodesPerWorkUnit, unsigned int)
+  itkGetConstMacro(MinimumNodesPerWorkUnit, unsigned int)
+
+protected:
+  TiledSparseFieldLevelSetImageFilter();
+  ~TiledSparseFieldLevelSetImageFilter() {}
+  void PrintSelf(std::ostream &s, itk::Indent indent) const ITK_OVERRIDE;
+
+  /** Compute the update at each active layer node, in parallel over tiles */
+  virtual TimeStepType CalculateChange() ITK_OVERRIDE;
+
+  /** Bin the active layer nodes into tiles and order the tiles by size */
+  void BuildTiles();
+
+  /** Compute the update for the active nodes of one tile */
+  void CalculateChangeForTile(
+      unsigned int tile,
+      itk::NeighborhoodIterator<OutputImageType> &it,
+      void *globalData, ValueType minNorm);
+
+private:
+  TiledSparseFieldLevelSetImageFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  unsigned int m_TileSize;
+  unsigned int m_MinimumNodesPerWorkUnit;
+
+  /** The active layer nodes, in list order (the order of the update buffer) */
+  std::vector<const LayerNodeType *> m_ActiveNodes;
+
+  /** Positions in m_ActiveNodes, grouped by tile */
+  std::vector<unsigned int> m_TileNodes;
+
+  /** For each tile, the range [first, last) of its entries in m_TileNodes,
+   * with the largest tiles listed first */
+  std::vector<std::pair<unsigned int, unsigned int> > m_Tiles;
+
+  /** Per-tile node counts over the tile grid, kept to avoid reallocation */
+  std::vector<unsigned int> m_TileGridCount;
+};
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "TiledSparseFieldLevelSetImageFilter.txx"
+#endif
+
+#endif // __TiledSparseFieldLevelSetImageFilter_h_
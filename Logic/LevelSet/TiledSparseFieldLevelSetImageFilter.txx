@@ -0,0 +1,230 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Module:    $RCSfile: TiledSparseFieldLevelSetImageFilter.txx,v $
+  Language:  C++
+  Copyright (c) 2007 Paul A. Yushkevich
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#ifndef __TiledSparseFieldLevelSetImageFilter_txx_
+#define __TiledSparseFieldLevelSetImageFilter_txx_
+
+#include "TiledSparseFieldLevelSetImageFilter.h"
+#include "itkMultiThreaderBase.h"
+#include "itkMath.h"
+#include <algorithm>
+#include <atomic>
+
+template <class TInputImage, class TOutputImage>
+TiledSparseFieldLevelSetImageFilter<TInputImage,TOutputImage>
+::TiledSparseFieldLevelSetImageFilter()
+{
+  m_TileSize = 16;
+  m_MinimumNodesPerWorkUnit = 256;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+TiledSparseFieldLevelSetImageFilter<TInputImage,TOutputImage>
+::BuildTiles()
+{
+  // Record the active layer nodes in list order. The update buffer is
+  // indexed in this order, because that is how ApplyUpdate() reads it.
+  const LayerType *active = this->m_Layers[0];
+  m_ActiveNodes.clear();
+  m_ActiveNodes.reserve(active->Size());
+  for(typename LayerType::ConstIterator it = active->Begin(); it != active->End(); ++it)
+    m_ActiveNodes.push_back(&(*it));
+
+  // Dimensions of the tile grid over the requested region
+  typename OutputImageType::RegionType region = this->m_OutputImage->GetRequestedRegion();
+  unsigned int gridSize[ImageDimension];
+  size_t nGrid = 1;
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    {
+    gridSize[d] = (region.GetSize(d) + m_TileSize - 1) / m_TileSize;
+    nGrid *= gridSize[d];
+    }
+
+  // Count the nodes in each tile of the grid
+  unsigned int nNodes = (unsigned int) m_ActiveNodes.size();
+  std::vector<unsigned int> nodeTile(nNodes);
+  m_TileGridCount.assign(nGrid + 1, 0);
+  for(unsigned int i = 0; i < nNodes; i++)
+    {
+    const IndexType &idx = m_ActiveNodes[i]->m_Value;
+    unsigned int key = 0;
+    for(int d = ImageDimension - 1; d >= 0; d--)
+      key = key * gridSize[d] + (idx[d] - region.GetIndex(d)) / m_TileSize;
+    nodeTile[i] = key;
+    m_TileGridCount[key + 1]++;
+    }
+
+  // Turn the counts into offsets and list the non-empty tiles
+  m_Tiles.clear();
+  for(size_t k = 0; k < nGrid; k++)
+    {
+    if(m_TileGridCount[k + 1] > 0)
+      m_Tiles.push_back(std::make_pair(m_TileGridCount[k],
+                                       m_TileGridCount[k] + m_TileGridCount[k + 1]));
+    m_TileGridCount[k + 1] += m_TileGridCount[k];
+    }
+
+  // Scatter the nodes into their tiles, keeping the list order within a tile
+  m_TileNodes.resize(nNodes);
+  for(unsigned int i = 0; i < nNodes; i++)
+    m_TileNodes[m_TileGridCount[nodeTile[i]]++] = i;
+
+  // Hand out the largest tiles first so that the small ones even out the
+  // load at the end of the iteration
+  std::stable_sort(m_Tiles.begin(), m_Tiles.end(),
+                   [](const std::pair<unsigned int, unsigned int> &a,
+                      const std::pair<unsigned int, unsigned int> &b)
+                   { return a.second - a.first > b.second - b.first; });
+}
+
+template <class TInputImage, class TOutputImage>
+void
+TiledSparseFieldLevelSetImageFilter<TInputImage,TOutputImage>
+::CalculateChangeForTile(
+    unsigned int tile,
+    itk::NeighborhoodIterator<OutputImageType> &it,
+    void *globalData, ValueType minNorm)
+{
+  const typename FiniteDifferenceFunctionType::Pointer df = this->GetDifferenceFunction();
+  typename FiniteDifferenceFunctionType::FloatOffsetType offset;
+  bool interpolate = this->GetInterpolateSurfaceLocation();
+
+  for(unsigned int j = m_Tiles[tile].first; j < m_Tiles[tile].second; j++)
+    {
+    unsigned int i = m_TileNodes[j];
+    it.SetLocation(m_ActiveNodes[i]->m_Value);
+
+    // This is the same computation as in the ITK sparse field filter: the
+    // offset to the zero level set is estimated from phi and its gradient
+    ValueType centerValue = it.GetCenterPixel();
+    if(interpolate && itk::Math::NotExactlyEquals(centerValue, itk::NumericTraits<ValueType>::ZeroValue()))
+      {
+      ValueType norm_grad_phi_squared = 0.0;
+      for(unsigned int d = 0; d < ImageDimension; d++)
+        {
+        ValueType forwardValue = it.GetNext(d);
+        ValueType backwardValue = it.GetPrevious(d);
+
+        if(forwardValue * backwardValue >= 0)
+          {
+          // Neighbors are same sign OR at least one neighbor is zero
+          ValueType dx_forward = forwardValue - centerValue;
+          ValueType dx_backward = centerValue - backwardValue;
+          offset[d] = itk::Math::abs(dx_forward) > itk::Math::abs(dx_backward)
+              ? dx_forward : dx_backward;
+          }
+        else
+          {
+          // Neighbors are opposite sign, pick the direction of the 0 surface
+          offset[d] = forwardValue * centerValue < 0
+              ? forwardValue - centerValue : centerValue - backwardValue;
+          }
+
+        norm_grad_phi_squared += offset[d] * offset[d];
+        }
+
+      for(unsigned int d = 0; d < ImageDimension; d++)
+        offset[d] = (offset[d] * centerValue) / (norm_grad_phi_squared + minNorm);
+
+      this->m_UpdateBuffer[i] = df->ComputeUpdate(it, globalData, offset);
+      }
+    else
+      {
+      this->m_UpdateBuffer[i] = df->ComputeUpdate(it, globalData);
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+typename TiledSparseFieldLevelSetImageFilter<TInputImage,TOutputImage>::TimeStepType
+TiledSparseFieldLevelSetImageFilter<TInputImage,TOutputImage>
+::CalculateChange()
+{
+  // Small bands are not worth the overhead of tiling
+  unsigned int nWork = this->GetNumberOfWorkUnits();
+  if(nWork < 2 || this->m_Layers[0]->Size() < nWork * m_MinimumNodesPerWorkUnit)
+    return Superclass::CalculateChange();
+
+  const typename FiniteDifferenceFunctionType::Pointer df = this->GetDifferenceFunction();
+
+  ValueType minNorm = 1.0e-6;
+  if(this->GetUseImageSpacing())
+    {
+    double minSpacing = itk::NumericTraits<double>::max();
+    for(unsigned int d = 0; d < ImageDimension; d++)
+      minSpacing = std::min(minSpacing, this->GetInput()->GetSpacing()[d]);
+    minNorm *= minSpacing;
+    }
+
+  // Split the band into tiles and size the update buffer for random access
+  this->BuildTiles();
+  this->m_UpdateBuffer.clear();
+  this->m_UpdateBuffer.resize(m_ActiveNodes.size());
+
+  // Each work unit takes tiles off the shared queue until it is empty, and
+  // collects the statistics for the time step in its own global data
+  std::atomic<unsigned int> nextTile(0);
+  std::vector<TimeStepType> workTimeStep(nWork, 0.0);
+  this->GetMultiThreader()->ParallelizeArray(0, nWork, [&](itk::SizeValueType w)
+  {
+    itk::NeighborhoodIterator<OutputImageType> it(
+          df->GetRadius(), this->m_OutputImage, this->m_OutputImage->GetRequestedRegion());
+    if(!this->m_BoundsCheckingActive)
+      it.NeedToUseBoundaryConditionOff();
+
+    void *globalData = df->GetGlobalDataPointer();
+    bool worked = false;
+    for(unsigned int t = nextTile++; t < m_Tiles.size(); t = nextTile++)
+      {
+      this->CalculateChangeForTile(t, it, globalData, minNorm);
+      worked = true;
+      }
+
+    if(worked)
+      workTimeStep[w] = df->ComputeGlobalTimeStep(globalData);
+    df->ReleaseGlobalDataPointer(globalData);
+  }, nullptr);
+
+  // The time step is the smallest one proposed. Work units that saw no change
+  // propose a zero step, which must not stop the evolution, so they are
+  // ignored unless no work unit saw any change.
+  TimeStepType timeStep = 0.0;
+  for(unsigned int w = 0; w < nWork; w++)
+    if(workTimeStep[w] > 0.0 && (timeStep == 0.0 || workTimeStep[w] < timeStep))
+      timeStep = workTimeStep[w];
+
+  return timeStep;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+TiledSparseFieldLevelSetImageFilter<TInputImage,TOutputImage>
+::PrintSelf(std::ostream &os, itk::Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "TileSize: " << m_TileSize << std::endl;
+  os << indent << "MinimumNodesPerWorkUnit: " << m_MinimumNodesPerWorkUnit << std::endl;
+}
+
+#endif // __TiledSparseFieldLevelSetImageFilter_txx_
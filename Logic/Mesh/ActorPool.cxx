@@ -1,6 +1,41 @@
 #include "ActorPool.h"
 #include "vtkActor.h"
+#include "vtkLODActor.h"
+#include "vtkPolyData.h"
 #include "vtkPolyDataMapper.h"
+#include "vtkAppendPolyData.h"
+#include "vtkQuadricClustering.h"
+#include "vtkUnsignedCharArray.h"
+#include "vtkCellData.h"
+#include "vtkProperty.h"
+
+ActorPool::
+ActorPool()
+{
+  m_MergedAppend = vtkSmartPointer<vtkAppendPolyData>::New();
+  m_MergedCoarseAppend = vtkSmartPointer<vtkAppendPolyData>::New();
+
+  // The meshes carry their own colors, which are mapped directly
+  vtkNew<vtkPolyDataMapper> mapper, coarse_mapper;
+  for(vtkPolyDataMapper *m : { mapper.GetPointer(), coarse_mapper.GetPointer() })
+    {
+    m->SetScalarModeToUseCellData();
+    m->SetColorModeToDirectScalars();
+    }
+  mapper->SetInputConnection(m_MergedAppend->GetOutputPort());
+  coarse_mapper->SetInputConnection(m_MergedCoarseAppend->GetOutputPort());
+
+  // The coarse mesh is picked by the LOD actor when the full mesh can't be
+  // drawn within the time allocated during interaction
+  m_MergedActor = vtkSmartPointer<vtkLODActor>::New();
+  m_MergedActor->SetMapper(mapper);
+  m_MergedActor->AddLODMapper(coarse_mapper);
+}
+
+ActorPool::
+~ActorPool()
+{
+}
 
 vtkActor*
 ActorPool::
@@ -32,6 +67,7 @@ RecycleAll()
     }
 
   m_ActorMap.clear();
+  m_Previews.clear();
 }
 
 void
@@ -48,6 +84,119 @@ CreateNewActors(unsigned int n)
     }
 }
 
+vtkActor *
+ActorPool::
+GetMergedActor()
+{
+  return m_MergedActor;
+}
+
+void
+ActorPool::
+UpdateMergedPiece(MergedPiece &piece, vtkActor *actor)
+{
+  vtkPolyData *source = vtkPolyData::SafeDownCast(actor->GetMapper()->GetInput());
+
+  // The coarse mesh only has to be rebuilt when the mesh changes
+  if(piece.Source != source || piece.SourceMTime != source->GetMTime())
+    {
+    piece.Source = source;
+    piece.SourceMTime = source->GetMTime();
+
+    piece.Full = vtkSmartPointer<vtkPolyData>::New();
+    piece.Full->ShallowCopy(source);
+
+    // Cluster the vertices on a coarse grid fitted to the mesh bounds
+    vtkNew<vtkQuadricClustering> cluster;
+    cluster->SetInputData(source);
+    cluster->AutoAdjustNumberOfDivisionsOn();
+    cluster->SetNumberOfDivisions(32, 32, 32);
+    cluster->Update();
+    piece.Coarse = cluster->GetOutput();
+    }
+
+  // Paint the label's color on all the cells
+  double *rgb = actor->GetProperty()->GetColor();
+  unsigned char rgba[4] = {
+    (unsigned char)(255 * rgb[0]), (unsigned char)(255 * rgb[1]),
+    (unsigned char)(255 * rgb[2]), (unsigned char)(255 * actor->GetProperty()->GetOpacity()) };
+
+  for(vtkPolyData *pd : { piece.Full.GetPointer(), piece.Coarse.GetPointer() })
+    {
+    vtkNew<vtkUnsignedCharArray> colors;
+    colors->SetName("LabelColors");
+    colors->SetNumberOfComponents(4);
+    colors->SetNumberOfTuples(pd->GetNumberOfCells());
+    for(vtkIdType i = 0; i < pd->GetNumberOfCells(); i++)
+      colors->SetTypedTuple(i, rgba);
+    pd->GetCellData()->SetScalars(colors);
+    }
+}
+
+void
+ActorPool::
+UpdateMergedActor()
+{
+  m_MergedAppend->RemoveAllInputs();
+  m_MergedCoarseAppend->RemoveAllInputs();
+
+  for (auto it = m_ActorMap.begin(); it != m_ActorMap.end(); ++it)
+    {
+    vtkActor *actor = it->second;
+    if(!actor->GetVisibility() || actor->GetProperty()->GetOpacity() <= 0.0
+       || !actor->GetMapper()->GetInput())
+      continue;
+
+    MergedPiece &piece = m_MergedPieces[it->first];
+    this->UpdateMergedPiece(piece, actor);
+    m_MergedAppend->AddInputData(piece.Full);
+    m_MergedCoarseAppend->AddInputData(piece.Coarse);
+    }
+
+  // Forget the labels that are no longer in the map
+  for (auto it = m_MergedPieces.begin(); it != m_MergedPieces.end();)
+    {
+    if (m_ActorMap.count(it->first) == 0)
+      it = m_MergedPieces.erase(it);
+    else
+      ++it;
+    }
+
+  // Nothing to draw
+  m_MergedActor->SetVisibility(m_MergedAppend->GetNumberOfInputConnections(0) > 0);
+}
+
+void
+ActorPool::
+SetPreview(LabelType id, vtkPolyData *full, vtkPolyData *preview)
+{
+  auto it = m_ActorMap.find(id);
+  if (it == m_ActorMap.end())
+    return;
+
+  PreviewPair &pair = m_Previews[id];
+  pair.Full = full;
+  pair.Preview = preview;
+  it->second->GetMapper()->SetInputDataObject(m_UsePreviews ? preview : full);
+}
+
+void
+ActorPool::
+SetUsePreviews(bool use_previews)
+{
+  if (use_previews == m_UsePreviews)
+    return;
+
+  m_UsePreviews = use_previews;
+  for (auto &kv : m_Previews)
+    {
+    auto it = m_ActorMap.find(kv.first);
+    if (it != m_ActorMap.end())
+      it->second->GetMapper()->SetInputDataObject(
+            use_previews ? kv.second.Preview : kv.second.Full);
+    }
+}
+
 void
 ActorPool::
 Print(std::ostream &os) const
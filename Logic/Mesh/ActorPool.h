@@ -8,7 +8,10 @@
 #include <stack>
 
 class vtkActor;
+class vtkLODActor;
+class vtkPolyData;
 class vtkPolyDataMapper;
+class vtkAppendPolyData;
 
 class ActorPool : public itk::Object
 {
@@ -38,9 +41,34 @@ public:
   /** Print status */
   void Print(std::ostream &os) const;
 
+  /**
+   * Get the actor that draws all the actors in the map in a single batch.
+   * The actors in the map remain the place where the mesh, color, opacity
+   * and visibility of each label are kept, but only the merged actor needs
+   * to be added to the renderer. During interaction, a coarser mesh built by
+   * quadric clustering is drawn instead.
+   */
+  vtkActor *GetMergedActor();
+
+  /** Rebuild the merged actor from the current state of the actor map */
+  void UpdateMergedActor();
+
+  /**
+   * Give the actor of a mesh a coarse version of the mesh, which its mapper
+   * draws instead of the full mesh while previews are in use. The previews
+   * are forgotten when the actors are recycled.
+   */
+  void SetPreview(LabelType id, vtkPolyData *full, vtkPolyData *preview);
+
+  /** Switch the actors that have a preview between it and the full mesh */
+  void SetUsePreviews(bool use_previews);
+
+  bool GetUsePreviews() const
+  { return m_UsePreviews; }
+
 protected:
-  ActorPool() {}
-  virtual ~ActorPool() {}
+  ActorPool();
+  virtual ~ActorPool();
 
   // Create batch of new actors and add it to the reserve
   void CreateNewActors(unsigned int n);
@@ -53,5 +81,32 @@ protected:
 
   // Actual Storage of all actors
   ActorStorage m_ActorStorage;
+
+  // A label's contribution to the merged actor. The full and coarse meshes
+  // share the points of the source mesh and only add a color array
+  struct MergedPiece
+  {
+    vtkPolyData *Source = nullptr;
+    unsigned long SourceMTime = 0;
+    vtkSmartPointer<vtkPolyData> Full, Coarse;
+  };
+
+  // Make the pieces of a label mesh for the merged actor
+  void UpdateMergedPiece(MergedPiece &piece, vtkActor *actor);
+
+  std::map<LabelType, MergedPiece> m_MergedPieces;
+
+  // The full and coarse meshes of the actors that have a preview
+  struct PreviewPair
+  {
+    vtkSmartPointer<vtkPolyData> Full, Preview;
+  };
+
+  std::map<LabelType, PreviewPair> m_Previews;
+  bool m_UsePreviews = false;
+
+  // Merged actor, with a full resolution and a level of detail mapper
+  vtkSmartPointer<vtkLODActor> m_MergedActor;
+  vtkSmartPointer<vtkAppendPolyData> m_MergedAppend, m_MergedCoarseAppend;
 };
 #endif // ACTORPOOL_H
@@ -10,6 +10,21 @@
 #include <vtkSTLWriter.h>
 #include <vtkBYUWriter.h>
 #include <vtkTriangleFilter.h>
+#include <vtkXMLPolyDataWriter.h>
+#include <vtkPLYWriter.h>
+#include <vtkAppendPolyData.h>
+#include <vtkUnsignedShortArray.h>
+#include <vtkPointData.h>
+#include <vtkCellArray.h>
+#include <vtkByteSwap.h>
+#include <vtkNew.h>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <thread>
 
 GuidedMeshIO
 ::GuidedMeshIO()
@@ -24,6 +39,7 @@ GuidedMeshIO::m_EnumFileFormat =
   { FORMAT_STL, "STL Mesh" },
   { FORMAT_VRML, "VRML Scene" },
   { FORMAT_VTP, "VTP Mesh" },
+  { FORMAT_PLY, "PLY Mesh" },
   { FORMAT_COUNT, "INVALID FORMAT" }
 };
 
@@ -36,7 +52,8 @@ GuidedMeshIO::m_MeshFormatDescriptorMap =
   { FORMAT_STL, { "STL Mesh",   {".stl"},         false,  true } },
   { FORMAT_VRML,{ "VRML Scene", {".vrml"},        false,  true } },
   { FORMAT_VTK, { "VTK Mesh",   {".vtk"},         true,   true } },
-  { FORMAT_VTP, { "VTP Mesh",   {".vtp"},         true,   false } }
+  { FORMAT_VTP, { "VTP Mesh",   {".vtp"},         true,   true } },
+  { FORMAT_PLY, { "PLY Mesh",   {".ply"},         false,  true } }
 };
 
 
@@ -111,6 +128,7 @@ GuidedMeshIO
 {
   // Read the format specification from the registry folder
   FileFormat format = GetFileFormat(folder);
+  bool binary = folder["Binary"][true];
 
   // Create the appropriate mesh writer for the format
   if(format == FORMAT_VTK)
@@ -119,9 +137,42 @@ GuidedMeshIO
     writer->SetInputData(mesh);
     writer->SetFileName(FileName);
     writer->SetHeader(GetSlicerCoordSysComment().c_str());
+    if(binary)
+      writer->SetFileTypeToBinary();
     writer->Update();
     writer->Delete();
     }
+  else if(format == FORMAT_VTP)
+    {
+    // Appended raw data, compressed, is the most compact and the fastest to
+    // read back
+    vtkNew<vtkXMLPolyDataWriter> writer;
+    writer->SetInputData(mesh);
+    writer->SetFileName(FileName);
+    if(binary)
+      {
+      writer->SetDataModeToAppended();
+      writer->EncodeAppendedDataOff();
+      writer->SetCompressorTypeToZLib();
+      }
+    else
+      writer->SetDataModeToAscii();
+    writer->Write();
+    }
+  else if(format == FORMAT_PLY)
+    {
+    vtkNew<vtkTriangleFilter> tri;
+    vtkNew<vtkPLYWriter> writer;
+    tri->SetInputData(mesh);
+    writer->SetInputConnection(tri->GetOutputPort());
+    writer->SetFileName(FileName);
+    writer->AddComment(GetSlicerCoordSysComment());
+    if(binary)
+      writer->SetFileTypeToBinary();
+    else
+      writer->SetFileTypeToASCII();
+    writer->Update();
+    }
   else if(format == FORMAT_STL)
     {
     vtkTriangleFilter *tri = vtkTriangleFilter::New();
@@ -130,6 +181,8 @@ GuidedMeshIO
     writer->SetInputConnection(tri->GetOutputPort());
     writer->SetFileName(FileName);
     writer->SetHeader(GetSlicerCoordSysComment().c_str());
+    if(binary)
+      writer->SetFileTypeToBinary();
     writer->Update();
     writer->Delete();
     tri->Delete();
@@ -149,6 +202,185 @@ GuidedMeshIO
     throw itk::ExceptionObject("Illegal format specified for saving image");
 }
 
+void
+GuidedMeshIO
+::SaveMeshScene(const char *FileName, Registry &folder, const MeshCollection &meshes)
+{
+  FileFormat format = GetFileFormat(folder);
+  if(format == FORMAT_VTK)
+    {
+    this->WriteLegacyVTKScene(FileName, meshes, folder["Binary"][true]);
+    return;
+    }
+
+  // Other writers need a single mesh. The label array is added to shallow
+  // copies, so that the meshes can be shared with the renderer meanwhile
+  vtkNew<vtkAppendPolyData> append;
+  for(const auto &it : meshes)
+    {
+    vtkSmartPointer<vtkPolyData> copy = vtkSmartPointer<vtkPolyData>::New();
+    copy->ShallowCopy(it.second);
+
+    vtkSmartPointer<vtkUnsignedShortArray> scalar =
+        vtkSmartPointer<vtkUnsignedShortArray>::New();
+    scalar->SetNumberOfComponents(1);
+    scalar->SetNumberOfTuples(copy->GetNumberOfPoints());
+    scalar->FillComponent(0, it.first);
+    copy->GetPointData()->SetScalars(scalar);
+
+    append->AddInputData(copy);
+    }
+
+  append->Update();
+  this->SaveMesh(FileName, folder, append->GetOutput());
+}
+
+namespace
+{
+
+// Write values in the encoding of legacy VTK files: big endian binary, or
+// text with a few values per line
+template <class TValue>
+void WriteLegacyValues(std::ostream &out, const std::vector<TValue> &values, bool binary)
+{
+  if(values.empty())
+    return;
+
+  if(binary)
+    {
+    if constexpr(sizeof(TValue) == 4)
+      vtkByteSwap::SwapWrite4BERange(values.data(), values.size(), &out);
+    else
+      vtkByteSwap::SwapWrite2BERange(values.data(), values.size(), &out);
+    }
+  else
+    {
+    for(size_t i = 0; i < values.size(); i++)
+      out << +values[i] << ((i % 9 == 8) ? "\n" : " ");
+    }
+}
+
+}
+
+void
+GuidedMeshIO
+::WriteLegacyVTKScene(const char *FileName, const MeshCollection &meshes, bool binary)
+{
+  // The sizes of all the sections are in their headers, so they are added up
+  // first, and each mesh is then written in turn, with its point ids offset
+  // by the number of points of the meshes before it
+  vtkIdType n_points = 0;
+  bool normals = !meshes.empty();
+  vtkIdType n_cells[4] = { 0, 0, 0, 0 }, n_ids[4] = { 0, 0, 0, 0 };
+  const char *cell_section[4] = { "VERTICES", "LINES", "POLYGONS", "TRIANGLE_STRIPS" };
+
+  auto cells = [](vtkPolyData *mesh, int k)
+    {
+    return k == 0 ? mesh->GetVerts() : k == 1 ? mesh->GetLines()
+                  : k == 2 ? mesh->GetPolys() : mesh->GetStrips();
+    };
+
+  for(const auto &it : meshes)
+    {
+    vtkPolyData *mesh = it.second;
+    n_points += mesh->GetNumberOfPoints();
+    normals = normals && mesh->GetPointData()->GetNormals();
+    for(int k = 0; k < 4; k++)
+      {
+      n_cells[k] += cells(mesh, k)->GetNumberOfCells();
+      n_ids[k] += cells(mesh, k)->GetNumberOfCells()
+                  + cells(mesh, k)->GetNumberOfConnectivityIds();
+      }
+    }
+
+  if(n_points > std::numeric_limits<int>::max())
+    throw itk::ExceptionObject(__FILE__, __LINE__, "Mesh scene is too large for the VTK format");
+
+  std::ofstream out(FileName, std::ios::out | std::ios::binary);
+  if(!out.good())
+    throw itk::ExceptionObject(__FILE__, __LINE__, "File can not be written");
+
+  out << "# vtk DataFile Version 3.0\n"
+      << GetSlicerCoordSysComment() << "\n"
+      << (binary ? "BINARY" : "ASCII") << "\n"
+      << "DATASET POLYDATA\n";
+
+  out << "POINTS " << n_points << " float\n";
+  for(const auto &it : meshes)
+    {
+    vtkPolyData *mesh = it.second;
+    std::vector<float> xyz(3 * mesh->GetNumberOfPoints());
+    for(vtkIdType i = 0; i < mesh->GetNumberOfPoints(); i++)
+      {
+      double *p = mesh->GetPoint(i);
+      for(int d = 0; d < 3; d++)
+        xyz[3 * i + d] = (float) p[d];
+      }
+    WriteLegacyValues(out, xyz, binary);
+    }
+  out << "\n";
+
+  for(int k = 0; k < 4; k++)
+    {
+    if(n_cells[k] == 0)
+      continue;
+
+    out << cell_section[k] << " " << n_cells[k] << " " << n_ids[k] << "\n";
+    int offset = 0;
+    for(const auto &it : meshes)
+      {
+      vtkCellArray *ca = cells(it.second, k);
+      std::vector<int> ids;
+      ids.reserve(ca->GetNumberOfCells() + ca->GetNumberOfConnectivityIds());
+
+      vtkIdType npts;
+      const vtkIdType *pts;
+      for(ca->InitTraversal(); ca->GetNextCell(npts, pts); )
+        {
+        ids.push_back((int) npts);
+        for(vtkIdType j = 0; j < npts; j++)
+          ids.push_back((int) (pts[j] + offset));
+        }
+
+      WriteLegacyValues(out, ids, binary);
+      offset += (int) it.second->GetNumberOfPoints();
+      }
+    out << "\n";
+    }
+
+  // The label of each point, and the normals if all the meshes have them
+  out << "POINT_DATA " << n_points << "\n"
+      << "SCALARS Label unsigned_short 1\n"
+      << "LOOKUP_TABLE default\n";
+  for(const auto &it : meshes)
+    {
+    std::vector<unsigned short> labels(it.second->GetNumberOfPoints(), it.first);
+    WriteLegacyValues(out, labels, binary);
+    }
+  out << "\n";
+
+  if(normals)
+    {
+    out << "NORMALS Normals float\n";
+    for(const auto &it : meshes)
+      {
+      vtkDataArray *nrm = it.second->GetPointData()->GetNormals();
+      std::vector<float> xyz(3 * nrm->GetNumberOfTuples());
+      for(vtkIdType i = 0; i < nrm->GetNumberOfTuples(); i++)
+        {
+        double *n = nrm->GetTuple3(i);
+        for(int d = 0; d < 3; d++)
+          xyz[3 * i + d] = (float) n[d];
+        }
+      WriteLegacyValues(out, xyz, binary);
+      }
+    out << "\n";
+    }
+
+  if(!out.good())
+    throw itk::ExceptionObject(__FILE__, __LINE__, "File can not be written");
+}
+
 void
 GuidedMeshIO::LoadMesh(const char *FileName, FileFormat format,
                        SmartPtr<MeshWrapperBase> wrapper, unsigned int tp, LabelType id)
@@ -160,21 +392,84 @@ GuidedMeshIO::LoadMesh(const char *FileName, FileFormat format,
     {
       // Apply IO logic of the delegate
       vtkSmartPointer<vtkPolyData> polyData = ioDelegate->ReadPolyData(FileName);
+      delete ioDelegate;
 
-      // Set polydata into the wrapper
-      wrapper->SetMesh(polyData, tp, id);
+      auto preview = PolyDataWrapper::CreatePreviewPolyData(polyData);
+      this->InstallMesh(polyData, preview, FileName, format, wrapper, tp, id);
+    }
+  else
+    throw itk::ExceptionObject("Illegal format specified for loading mesh file");
+}
 
-      // Get poly data wrapper loaded
-      auto polyDataWrapper = wrapper->GetMesh(tp, id);
+void
+GuidedMeshIO::LoadMeshes(const std::vector<MeshFileRequest> &requests,
+                         SmartPtr<MeshWrapperBase> wrapper)
+{
+  std::vector<vtkSmartPointer<vtkPolyData> > meshes(requests.size());
+  std::vector<vtkSmartPointer<vtkPolyData> > previews(requests.size());
+  std::vector<std::exception_ptr> errors(requests.size());
 
-      polyDataWrapper->SetFileName(FileName);
+  // Each worker takes the next file in the list until all are read
+  std::atomic<size_t> next_file(0);
+  auto worker = [&]()
+    {
+    for (size_t i = next_file++; i < requests.size(); i = next_file++)
+      {
+      try
+        {
+        std::unique_ptr<AbstractMeshIODelegate> ioDelegate(
+              AbstractMeshIODelegate::GetDelegate(requests[i].Format));
+        if (!ioDelegate)
+          throw itk::ExceptionObject("Illegal format specified for loading mesh file");
+        meshes[i] = ioDelegate->ReadPolyData(requests[i].FileName.c_str());
 
-      polyDataWrapper->SetFileFormat(format);
+        // Heavy meshes get their preview on the same thread
+        previews[i] = PolyDataWrapper::CreatePreviewPolyData(meshes[i]);
+        }
+      catch (...)
+        {
+        errors[i] = std::current_exception();
+        }
+      }
+    };
 
-      delete ioDelegate;
-    }
-  else
-    throw itk::ExceptionObject("Illegal format specified for loading mesh file");
+  size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+  if (n_threads > requests.size())
+    n_threads = requests.size();
+
+  std::vector<std::future<void> > workers;
+  for (size_t k = 1; k < n_threads; k++)
+    workers.push_back(std::async(std::launch::async, worker));
+  worker();
+  for (auto &w : workers)
+    w.wait();
+
+  for (auto &err : errors)
+    if (err)
+      std::rethrow_exception(err);
+
+  // The wrapper is not thread safe, so the meshes are added here
+  for (size_t i = 0; i < requests.size(); i++)
+    this->InstallMesh(meshes[i], previews[i], requests[i].FileName.c_str(), requests[i].Format,
+                      wrapper, requests[i].TimePoint, requests[i].Id);
+}
+
+void
+GuidedMeshIO::InstallMesh(vtkPolyData *polyData, vtkPolyData *preview,
+                          const char *FileName, FileFormat format,
+                          MeshWrapperBase *wrapper, unsigned int tp, LabelType id)
+{
+  // Set polydata into the wrapper
+  wrapper->SetMesh(polyData, tp, id);
+
+  // Get poly data wrapper loaded
+  auto polyDataWrapper = wrapper->GetMesh(tp, id);
+
+  polyDataWrapper->SetFileName(FileName);
+
+  polyDataWrapper->SetFileFormat(format);
+
+  polyDataWrapper->SetPreviewPolyData(preview);
 }
 
 std::string
@@ -44,7 +44,10 @@
 #define __GuidedMeshIO_h_
 
 #include "Registry.h"
+#include "vtkSmartPointer.h"
+#include <map>
 #include <set>
+#include <vector>
 
 class vtkPolyData;
 class MeshWrapperBase;
@@ -60,7 +63,7 @@ public:
   virtual ~GuidedMeshIO() { /*To avoid compiler warning.*/ }
   
   enum FileFormat {
-    FORMAT_VTK=0, FORMAT_STL, FORMAT_BYU, FORMAT_VRML, FORMAT_VTP, FORMAT_COUNT };
+    FORMAT_VTK=0, FORMAT_STL, FORMAT_BYU, FORMAT_VRML, FORMAT_VTP, FORMAT_PLY, FORMAT_COUNT };
 
   struct MeshFormatDescriptor
   {
@@ -87,13 +90,46 @@ public:
   /** Get format from extension */
   static FileFormat GetFormatByExtension(std::string extension);
 
-  /** Save an image using the Registry folder to specify parameters */
+  /**
+   * Save a mesh using the Registry folder to specify parameters. The formats
+   * that have a binary encoding use it, unless the "Binary" entry of the
+   * folder is false. Separate objects may save meshes concurrently.
+   */
   void SaveMesh(const char *FileName, Registry &folder, vtkPolyData *mesh);
 
+  /** Meshes of a segmentation, by label */
+  typedef std::map<LabelType, vtkSmartPointer<vtkPolyData> > MeshCollection;
+
+  /**
+   * Save the meshes of several labels as a single scene, with a point array
+   * holding the label of each point. In the VTK format the meshes are
+   * streamed to the file one after the other, rather than appended into one
+   * mesh first. The meshes themselves are not modified.
+   */
+  void SaveMeshScene(const char *FileName, Registry &folder, const MeshCollection &meshes);
+
   /** Load a mesh */
   void LoadMesh(const char *FileName, FileFormat format,
                 SmartPtr<MeshWrapperBase> wrapper, unsigned int tp, LabelType id);
 
+  /** A mesh file to be loaded into a wrapper */
+  struct MeshFileRequest
+  {
+    std::string FileName;
+    FileFormat Format;
+    unsigned int TimePoint;
+    LabelType Id;
+  };
+
+  /**
+   * Load a series of meshes, e.g. one per time point. The files are decoded
+   * concurrently, and the meshes are then added to the wrapper in order on
+   * the calling thread. If any file fails to load, the first error is thrown
+   * and no meshes are added.
+   */
+  void LoadMeshes(const std::vector<MeshFileRequest> &requests,
+                  SmartPtr<MeshWrapperBase> wrapper);
+
   /** Get the error message if the IO is not successful */
   std::string GetErrorMessage() const;
 
@@ -127,6 +163,14 @@ protected:
   const std::string slicer_coord_sys_string = "SPACE=RAS";
 
   std::string GetSlicerCoordSysComment() const;
+
+  // Write a scene in the legacy VTK format without copying the meshes
+  void WriteLegacyVTKScene(const char *FileName, const MeshCollection &meshes, bool binary);
+
+  // Add a loaded mesh and its preview (which may be null) to the wrapper
+  void InstallMesh(vtkPolyData *polyData, vtkPolyData *preview,
+                   const char *FileName, FileFormat format,
+                   MeshWrapperBase *wrapper, unsigned int tp, LabelType id);
 };
 
 #endif
@@ -176,6 +176,25 @@ ImageMeshLayers
   return 0;
 }
 
+SegmentationMeshAssembly *
+ImageMeshLayers
+::BeginActiveMeshLayerBackgroundUpdate()
+{
+  if (m_IsSNAP)
+    return nullptr;
+
+  auto segImg = m_ImageData->GetParent()->GetSelectedSegmentationLayer();
+
+  SegmentationMeshWrapper *segMesh = nullptr;
+  if (m_ImageToMeshMap.count(segImg->GetUniqueId()))
+    segMesh = static_cast<SegmentationMeshWrapper*>(m_ImageToMeshMap[segImg->GetUniqueId()]);
+  else
+    segMesh = AddSegmentationMeshLayer(segImg);
+
+  // The segmentation is at the cursor time point
+  return segMesh->BeginBackgroundUpdate();
+}
+
 void
 ImageMeshLayers
 ::AddLayerFromFiles(std::vector<std::string> &fn_list, FileFormat format,
@@ -196,15 +215,18 @@ ImageMeshLayers
   wrapper->SetFileName(*fn_list.begin());
 
   // Load one file per time point until final time point is reached
+  std::vector<GuidedMeshIO::MeshFileRequest> requests;
   for (auto &fn : fn_list)
     {
     if (tp >= nt)
       break;
 
-    // Execute loading
-    IO.LoadMesh(fn.c_str(), format, baseWrapper, tp++, 0u);
+    requests.push_back({ fn, format, (unsigned int) tp++, 0u });
     }
 
+  // Execute loading
+  IO.LoadMeshes(requests, baseWrapper);
+
   // Install the wrapper to the application
   this->AddLayer(baseWrapper);
 }
@@ -12,6 +12,7 @@ class MeshLayerIterator;
 class GenericImageData;
 class LabelImageWrapper;
 class SegmentationMeshWrapper;
+class SegmentationMeshAssembly;
 class LevelSetMeshWrapper;
 
 /**
@@ -90,6 +91,13 @@ public:
    */
   int UpdateActiveMeshLayer(itk::Command *progressCmd);
 
+  /** Prepare a background update of the segmentation mesh layer for the
+   *  selected segmentation, at the cursor time point. Returns the assembly
+   *  to update on the worker thread, or nullptr if the active layer can only
+   *  be updated with UpdateActiveMeshLayer() (e.g. level set meshes)
+   */
+  SegmentationMeshAssembly *BeginActiveMeshLayerBackgroundUpdate();
+
   /** Return the active layer Modified Time */
   unsigned long GetActiveMeshMTime();
 
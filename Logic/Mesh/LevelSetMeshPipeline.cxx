@@ -41,6 +41,12 @@
 #include "LevelSetMeshPipeline.h"
 #include "VTKMeshPipeline.h"
 #include "MeshOptions.h"
+#include <vtkAppendPolyData.h>
+#include <vtkCleanPolyData.h>
+#include <vtkPoints.h>
+#include <algorithm>
+#include <cstring>
+#include <utility>
 
 LevelSetMeshPipeline
 ::LevelSetMeshPipeline()
@@ -52,6 +58,23 @@ LevelSetMeshPipeline
   m_MeshOptions = MeshOptions::New();
   m_MeshOptions->SetUseGaussianSmoothing(false);
   m_VTKPipeline->SetMeshOptions(m_MeshOptions);
+
+  // Create the filter that contours the tiles, configured like the contour
+  // filter of the VTK pipeline
+  m_TileContourFilter = vtkSmartPointer<vtkFlyingEdges3D>::New();
+  m_TileContourFilter->ComputeNormalsOn();
+  m_TileContourFilter->ComputeScalarsOff();
+  m_TileContourFilter->ComputeGradientsOff();
+  m_TileContourFilter->SetNumberOfContours(1);
+  m_TileContourFilter->SetValue(0, 0.0f);
+
+  // The meshes of neighboring tiles share the points on the common faces,
+  // which are merged after the meshes are joined
+  m_AppendFilter = vtkSmartPointer<vtkAppendPolyData>::New();
+  m_CleanFilter = vtkSmartPointer<vtkCleanPolyData>::New();
+  m_CleanFilter->SetInputConnection(m_AppendFilter->GetOutputPort());
+  m_CleanFilter->PointMergingOn();
+  m_CleanFilter->SetTolerance(0.0);
 }
 
 LevelSetMeshPipeline
@@ -81,13 +104,65 @@ void
 LevelSetMeshPipeline
 ::UpdateMesh(std::mutex *mutex)
 {
+  if(!m_InputImage)
+    return;
+
+  // Divide the image into tiles if it has changed
+  if(m_InputImage.GetPointer() != m_TiledImage
+     || m_InputImage->GetBufferedRegion() != m_TiledRegion)
+    this->InitializeTiles();
+
+  // Find the tiles whose voxels have changed, and copy the voxels of those
+  // that cross the zero level set. Only this part accesses the image data.
+  std::vector<std::pair<size_t, vtkSmartPointer<vtkImageData> > > changed;
+  if(mutex) mutex->lock();
+  for(size_t i = 0; i < m_Tiles.size(); i++)
+    {
+    Tile &tile = m_Tiles[i];
+    bool crossing;
+    unsigned long long hash = this->ScanTile(tile, crossing, nullptr);
+    if(tile.Valid && tile.Hash == hash)
+      continue;
+
+    tile.Hash = hash;
+    tile.Valid = true;
+    tile.Mesh = nullptr;
+
+    if(crossing)
+      {
+      const RegionType &r = tile.Voxels;
+      vtkSmartPointer<vtkImageData> voxels = vtkSmartPointer<vtkImageData>::New();
+      voxels->SetExtent(r.GetIndex(0), r.GetIndex(0) + r.GetSize(0) - 1,
+                        r.GetIndex(1), r.GetIndex(1) + r.GetSize(1) - 1,
+                        r.GetIndex(2), r.GetIndex(2) + r.GetSize(2) - 1);
+      voxels->AllocateScalars(VTK_FLOAT, 1);
+      this->ScanTile(tile, crossing, voxels);
+      changed.push_back(std::make_pair(i, voxels));
+      }
+    }
+  if(mutex) mutex->unlock();
+
+  // Contour the tiles that have changed
+  for(auto &it : changed)
+    this->ContourTile(m_Tiles[it.first], it.second);
+
+  // Join the meshes of the tiles
+  m_AppendFilter->RemoveAllInputs();
+  for(Tile &tile : m_Tiles)
+    if(tile.Mesh)
+      m_AppendFilter->AddInputData(tile.Mesh);
+
   // We need to generate a new mesh object. Otherwise, if there is concurrent
   // rendering and mesh computation, the mesh would be accessed by two threads
   // at the same time, which is a problem.
   m_Mesh = vtkSmartPointer<vtkPolyData>::New();
 
-  // Run the pipeline
-  m_VTKPipeline->ComputeMesh(m_Mesh, mutex);
+  // Run the rest of the pipeline on the joined contour
+  if(m_AppendFilter->GetNumberOfInputConnections(0) > 0)
+    {
+    m_CleanFilter->Update();
+    m_VTKPipeline->ComputeMeshFromContour(m_CleanFilter->GetOutput(), m_Mesh);
+    }
 
   // Set the modified flag so that we can use the MTime() of this object for dirty checks
   this->Modified();
@@ -103,6 +178,175 @@ LevelSetMeshPipeline
 ::SetImage(const InputImageType *image)
 {
   // Hook the input into the pipeline
+  m_InputImage = image;
   m_VTKPipeline->SetImage(image);
 }
 
+void
+LevelSetMeshPipeline
+::InitializeTiles()
+{
+  m_Tiles.clear();
+  m_TiledImage = m_InputImage.GetPointer();
+  m_TiledRegion = m_InputImage->GetBufferedRegion();
+
+  // The cells of the image lie between the voxels
+  unsigned int n_cells[3], n_tiles[3];
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    unsigned int sz = m_TiledRegion.GetSize(d);
+    n_cells[d] = sz > 1 ? sz - 1 : 0;
+    n_tiles[d] = (n_cells[d] + TILE_SIZE - 1) / TILE_SIZE;
+    }
+
+  for(unsigned int k = 0; k < n_tiles[2]; k++)
+    {
+    for(unsigned int j = 0; j < n_tiles[1]; j++)
+      {
+      for(unsigned int i = 0; i < n_tiles[0]; i++)
+        {
+        unsigned int t[3] = { i, j, k };
+        RegionType::IndexType idx;
+        RegionType::SizeType size;
+        for(unsigned int d = 0; d < 3; d++)
+          {
+          idx[d] = m_TiledRegion.GetIndex(d) + t[d] * TILE_SIZE;
+          size[d] = std::min(TILE_SIZE, n_cells[d] - t[d] * TILE_SIZE);
+          }
+
+        Tile tile;
+        tile.Cells = RegionType(idx, size);
+
+        // The voxels at the corners of the cells, and a margin around them
+        for(unsigned int d = 0; d < 3; d++)
+          size[d]++;
+        tile.Voxels = RegionType(idx, size);
+        tile.Voxels.PadByRadius(1);
+        tile.Voxels.Crop(m_TiledRegion);
+
+        m_Tiles.push_back(tile);
+        }
+      }
+    }
+}
+
+unsigned long long
+LevelSetMeshPipeline
+::ScanTile(const Tile &tile, bool &crossing, vtkImageData *image)
+{
+  // FNV-1a hash of the bit patterns of the voxel values
+  unsigned long long hash = 14695981039346656037ULL;
+  bool has_inside = false, has_outside = false;
+
+  const RegionType &r = tile.Voxels;
+  size_t nx = r.GetSize(0);
+  float *p_copy = image ? static_cast<float *>(image->GetScalarPointer()) : nullptr;
+
+  RegionType::IndexType idx = r.GetIndex();
+  for(unsigned int z = 0; z < r.GetSize(2); z++)
+    {
+    idx[2] = r.GetIndex(2) + z;
+    for(unsigned int y = 0; y < r.GetSize(1); y++)
+      {
+      idx[1] = r.GetIndex(1) + y;
+      const float *p = m_InputImage->GetBufferPointer() + m_InputImage->ComputeOffset(idx);
+      for(size_t x = 0; x < nx; x++)
+        {
+        unsigned int bits;
+        memcpy(&bits, p + x, sizeof(float));
+        hash = (hash ^ bits) * 1099511628211ULL;
+        if(p[x] < 0.0f)
+          has_inside = true;
+        else
+          has_outside = true;
+        }
+
+      if(p_copy)
+        {
+        memcpy(p_copy, p, nx * sizeof(float));
+        p_copy += nx;
+        }
+      }
+    }
+
+  crossing = has_inside && has_outside;
+  return hash;
+}
+
+void
+LevelSetMeshPipeline
+::ContourTile(Tile &tile, vtkImageData *voxels)
+{
+  tile.Mesh = nullptr;
+
+  // The image has unit spacing and zero origin, so that the contour is in
+  // voxel index coordinates, and the points on the faces shared with other
+  // tiles are computed the same way in both tiles
+  voxels->SetOrigin(0.0, 0.0, 0.0);
+  voxels->SetSpacing(1.0, 1.0, 1.0);
+  m_TileContourFilter->SetInputData(voxels);
+  m_TileContourFilter->Update();
+
+  vtkPolyData *contour = m_TileContourFilter->GetOutput();
+  vtkPoints *pts = contour->GetPoints();
+  vtkCellArray *in_polys = contour->GetPolys();
+  if(!pts || !in_polys)
+    return;
+
+  // Keep the triangles whose centroid lies in the cells of the tile. The
+  // others belong to the cells of the margin, which other tiles contour
+  double lo[3], hi[3];
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    lo[d] = tile.Cells.GetIndex(d);
+    hi[d] = lo[d] + tile.Cells.GetSize(d);
+    }
+
+  vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+  vtkIdType npts;
+  const vtkIdType *ids;
+  for(in_polys->InitTraversal(); in_polys->GetNextCell(npts, ids); )
+    {
+    double c[3] = { 0.0, 0.0, 0.0 }, x[3];
+    for(vtkIdType i = 0; i < npts; i++)
+      {
+      pts->GetPoint(ids[i], x);
+      for(unsigned int d = 0; d < 3; d++)
+        c[d] += x[d];
+      }
+
+    bool inside = true;
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      c[d] /= npts;
+      if(c[d] < lo[d] || c[d] >= hi[d])
+        inside = false;
+      }
+
+    if(inside)
+      polys->InsertNextCell(npts, ids);
+    }
+
+  if(polys->GetNumberOfCells() == 0)
+    return;
+
+  // The output of the contour filter is replaced on the next update, so the
+  // points and normals are copied. Unused points are removed when the
+  // meshes are joined
+  vtkSmartPointer<vtkPoints> mesh_pts = vtkSmartPointer<vtkPoints>::New();
+  mesh_pts->DeepCopy(pts);
+
+  tile.Mesh = vtkSmartPointer<vtkPolyData>::New();
+  tile.Mesh->SetPoints(mesh_pts);
+  tile.Mesh->SetPolys(polys);
+
+  vtkDataArray *nrm = contour->GetPointData()->GetNormals();
+  if(nrm)
+    {
+    vtkSmartPointer<vtkDataArray> mesh_nrm;
+    mesh_nrm.TakeReference(nrm->NewInstance());
+    mesh_nrm->DeepCopy(nrm);
+    tile.Mesh->GetPointData()->SetNormals(mesh_nrm);
+    }
+}
+
@@ -40,7 +40,9 @@
 #include "vtkSmartPointer.h"
 #include "itkObject.h"
 #include "itkObjectFactory.h"
+#include "itkImageRegion.h"
 #include <mutex>
+#include <vector>
 
 // Forward reference to itk classes
 namespace itk {
@@ -51,13 +53,23 @@ namespace itk {
 class MeshOptions;
 class VTKMeshPipeline;
 class vtkPolyData;
+class vtkImageData;
+class vtkFlyingEdges3D;
+class vtkAppendPolyData;
+class vtkCleanPolyData;
 
 /**
  * \class LevelSetMeshPipeline
  * \brief A pipeline used to compute a mesh of the zero level set in SNAP.
  *
  * This pipeline takes a floating point image computed by the level
- * set filter and uses a contour algorithm to get a triangular mesh
+ * set filter and uses a contour algorithm to get a triangular mesh.
+ *
+ * The image is contoured in tiles, and the mesh of each tile is kept until
+ * the voxels of the tile change. Away from the zero level set, the sparse
+ * field level set filter keeps the image at constant values, so during the
+ * evolution only the tiles on the moving front are contoured again, and
+ * tiles without a sign change are not contoured at all.
  */
 class LevelSetMeshPipeline : public itk::Object
 {
@@ -96,12 +108,54 @@ private:
   // Type definitions for the various filters used by this object
   typedef InputImageType InternalImageType;
   typedef itk::SmartPointer<InternalImageType> InternalImagePointer;
+  typedef itk::ImageRegion<3> RegionType;
+
+  // Number of voxel cells along each side of a tile
+  static constexpr unsigned int TILE_SIZE = 32;
+
+  // A tile of the image with the mesh computed for it
+  struct Tile
+  {
+    // The cells of the tile, given by the voxel at their lower corner
+    RegionType Cells;
+
+    // The voxels read to contour the tile, including a margin of one voxel
+    // for the gradient computation
+    RegionType Voxels;
+
+    // Hash of the voxel values when the mesh was computed
+    unsigned long long Hash = 0;
+    bool Valid = false;
+
+    // The mesh of the tile, null if the tile has no zero crossing
+    vtkSmartPointer<vtkPolyData> Mesh;
+  };
+
+  // Divide the image into tiles
+  void InitializeTiles();
+
+  // Read the voxels of a tile. Returns the hash of the values and whether
+  // they change sign. If image is not null, the voxels are copied into it
+  unsigned long long ScanTile(const Tile &tile, bool &crossing, vtkImageData *image);
+
+  // Contour the voxels of a tile, keeping the triangles in the tile's cells
+  void ContourTile(Tile &tile, vtkImageData *voxels);
+
+  // The tiles, and the image and region they were created for
+  std::vector<Tile> m_Tiles;
+  const InputImageType *m_TiledImage = nullptr;
+  RegionType m_TiledRegion;
+
+  // Filters used to contour the tiles and to join their meshes
+  vtkSmartPointer<vtkFlyingEdges3D> m_TileContourFilter;
+  vtkSmartPointer<vtkAppendPolyData> m_AppendFilter;
+  vtkSmartPointer<vtkCleanPolyData> m_CleanFilter;
   
   // Current set of mesh options
   SmartPtr<MeshOptions> m_MeshOptions;
 
   // The input image
-  InputImagePointer m_InputImage;
+  itk::SmartPointer<const InputImageType> m_InputImage;
 
   // The VTK pipeline
   VTKMeshPipeline *m_VTKPipeline;
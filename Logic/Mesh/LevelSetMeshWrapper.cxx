@@ -1,6 +1,7 @@
 #include "LevelSetMeshWrapper.h"
 #include "MeshWrapperBase.h"
 #include "Rebroadcaster.h"
+#include "SNAPLatencyMonitor.h"
 
 //--------------------------------------------
 //  LevelSetMeshAssembly Implementation
@@ -157,6 +158,8 @@ void
 LevelSetMeshWrapper
 ::UpdateMeshes(LevelSetImageWrapper *lsImg, unsigned int timepoint, LabelType id, std::mutex *mutex)
 {
+  SNAP_LATENCY_SCOPE(SNAPLatencyMonitor::MESH_UPDATE);
+
   if (!m_MeshAssemblyMap.count(timepoint))
     {
     CreateNewAssembly(lsImg, timepoint);
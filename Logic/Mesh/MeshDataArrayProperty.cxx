@@ -3,6 +3,8 @@
 #include "ColorMap.h"
 #include "Rebroadcaster.h"
 #include "TDigestImageFilter.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
 
 // ========================================
 //  AbstractMeshDataArrayProperty Implementation
@@ -263,35 +265,29 @@ MeshLayerDataArrayProperty
 	InvokeEvent(WrapperHistogramChangeEvent());
 }
 
-inline double GetMagnitude(double *vector, size_t len)
-{
-	size_t crnt = 0;
-	double sum = 0;
-	while (crnt < len)
-		{
-			float t = *vector;
-			sum += t * t;
-			++vector;
-			++crnt;
-		}
-
-	return sqrt(sum);
-}
-
-
 TDigestDataObject*
 MeshLayerDataArrayProperty::
 GetTDigest()
 {
-  std::vector<double> tmpdata;
-  long n = 0;
+	// get active component
+	vtkIdType activeVecComp = -1;
+	if (this->GetActiveVectorMode() == VectorMode::COMPONENT)
+		activeVecComp = this->GetActiveComponentId();
 
+  // The values only change with the selected component and the data arrays,
+  // so the t-digest is reused as long as these stay the same
+  long n = 0;
+  vtkMTimeType data_mtime = 0;
   for (auto cit = m_DataPointerList.cbegin(); cit != m_DataPointerList.cend(); ++cit)
     {
-    auto array = *cit;
-    n += array->GetNumberOfTuples();
+    n += (*cit)->GetNumberOfTuples();
+    data_mtime = std::max(data_mtime, (*cit)->GetMTime());
     }
 
+  if (m_TDigestValid && m_TDigestComponent == activeVecComp
+      && m_TDigestDataMTime == data_mtime && m_TDigestArrayCount == m_DataPointerList.size())
+    return m_TDigestFilter->GetTDigest();
+
   DataArrayImageType::Pointer img = DataArrayImageType::New();
 
   DataArrayImageType::IndexType start;
@@ -307,47 +303,45 @@ GetTDigest()
   img->SetRegions(region);
   img->Allocate();
 
-  DataArrayImageType::IndexType idx;
-  idx[0] = 0;
+  // Copy the values of each array into its own part of the image in parallel
+  std::vector<vtkDataArray *> arrays(m_DataPointerList.begin(), m_DataPointerList.end());
+  std::vector<long> offsets(arrays.size() + 1, 0);
+  for (size_t a = 0; a < arrays.size(); ++a)
+    offsets[a + 1] = offsets[a] + arrays[a]->GetNumberOfTuples();
 
-	// get active component
-	vtkIdType activeVecComp = -1;
-	if (this->GetActiveVectorMode() == VectorMode::COMPONENT)
-		activeVecComp = this->GetActiveComponentId();
-
-  for (auto cit = m_DataPointerList.cbegin(); cit != m_DataPointerList.cend(); ++cit)
+  double *buffer = img->GetBufferPointer();
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, arrays.size(), [&](size_t a)
     {
-    auto array = *cit;
-    auto nTuple = array->GetNumberOfTuples();
-    for (auto i = 0; i < nTuple; ++i)
+    vtkDataArray *array = arrays[a];
+    vtkIdType nTuple = array->GetNumberOfTuples();
+    int nc = array->GetNumberOfComponents();
+    double *out = buffer + offsets[a];
+    for (vtkIdType i = 0; i < nTuple; ++i)
       {
-			double v = 0;
-			if (activeVecComp == -1) // use magnitude
-				{
-				size_t nc = array->GetNumberOfComponents();
-				double *vec  = new double[nc];
-				for (size_t c = 0; c < nc; ++c)
-					vec[c] = array->GetComponent(i, c);
-				v = GetMagnitude(vec, nc);
-				delete [] vec;
-				}
-			else
-				v = array->GetComponent(i, activeVecComp);
-      img->SetPixel(idx, v);
-      idx[0]++;
-
-      if (idx[0] >= n)
-        break;
+      if (activeVecComp == -1) // use magnitude
+        {
+        double sum = 0;
+        for (int c = 0; c < nc; ++c)
+          {
+          double t = array->GetComponent(i, c);
+          sum += t * t;
+          }
+        out[i] = sqrt(sum);
+        }
+      else
+        out[i] = array->GetComponent(i, activeVecComp);
       }
-    if (idx[0] >= n)
-      break;
-    }
+    }, nullptr);
 
-  // TODO: this method recomputes the t-digest on every call. This should not be necessary; the
-  // ITK pipeline mechanichs could be used to perform lazy updating. There is also duplication
-  // of the data because the tmpimage is held in memory as long as the filter exists.
+  // The tmpimage is held in memory as long as the filter exists
   m_TDigestFilter->SetInput(img);
   m_TDigestFilter->Update();
 
+  m_TDigestValid = true;
+  m_TDigestComponent = activeVecComp;
+  m_TDigestDataMTime = data_mtime;
+  m_TDigestArrayCount = m_DataPointerList.size();
+
   return m_TDigestFilter->GetTDigest();
 }
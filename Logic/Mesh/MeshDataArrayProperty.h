@@ -236,6 +236,12 @@ protected:
   // TDigest filter used to compute min/max and histogram
   SmartPtr<TDigestFilter> m_TDigestFilter;
 
+  // What the current t-digest was computed from
+  bool m_TDigestValid = false;
+  vtkIdType m_TDigestComponent = -1;
+  vtkMTimeType m_TDigestDataMTime = 0;
+  size_t m_TDigestArrayCount = 0;
+
   std::list<vtkDataArray*> m_DataPointerList;
 
   // Active Vector Mode
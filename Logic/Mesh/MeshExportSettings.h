@@ -65,6 +65,13 @@ public:
   irisGetMacro(ExportLabel, LabelType);
   irisSetMacro(ExportLabel, LabelType);
 
+  /**
+   * Export the meshes of every time point of a 4D segmentation, each to its
+   * own file(s), with the time point number appended to the file name
+   */
+  irisGetMacro(FlagAllTimePoints, bool);
+  irisSetMacro(FlagAllTimePoints, bool);
+
   virtual ~MeshExportSettings() {}
 
 private:
@@ -73,6 +80,7 @@ private:
   bool m_FlagSingleLabel;
   bool m_FlagSingleScene;
   LabelType m_ExportLabel;
+  bool m_FlagAllTimePoints = false;
 };
 
 #endif // __MeshExportSettings_h_
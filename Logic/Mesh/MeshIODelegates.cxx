@@ -54,6 +54,7 @@ AbstractMeshIODelegate::GetDelegate(GuidedMeshIO::FileFormat fmt)
       case GuidedMeshIO::FORMAT_BYU:
       case GuidedMeshIO::FORMAT_STL:
       case GuidedMeshIO::FORMAT_VRML:
+      case GuidedMeshIO::FORMAT_PLY:
       default:
         break;
     }
@@ -174,19 +174,11 @@ MeshManager
     }
   else
     {
-    // Get the mesh pipeline associated with the level set image wrapper
-    LabelImageWrapper *wrapper = m_Driver->GetSelectedSegmentationLayer();
-    MultiLabelMeshPipeline *pipeline = this->GetMultiLabelMeshPipeline(wrapper, timepoint, true);
+    // Get the mesh pipeline associated with the segmentation time point
+    SmartPtr<MultiLabelMeshPipeline> pipeline = this->PrepareMeshPipeline(timepoint);
     if(!pipeline)
       return;
 
-    // Make sure the pipeline has the right image
-    LabelImageWrapper::ImagePointer imgpt = wrapper->GetImageByTimePoint(timepoint);
-    pipeline->SetImage(imgpt);
-
-      // Pass the options to the pipeline
-    pipeline->SetMeshOptions(m_GlobalState->GetMeshOptions());
-
     // Update the meshes
     pipeline->UpdateMeshes(command);
     }
@@ -195,6 +187,29 @@ MeshManager
   this->Modified();
 }
 
+SmartPtr<MultiLabelMeshPipeline>
+MeshManager
+::PrepareMeshPipeline(unsigned int timepoint)
+{
+  if(m_Driver->IsSnakeModeLevelSetActive())
+    return nullptr;
+
+  LabelImageWrapper *wrapper = m_Driver->GetSelectedSegmentationLayer();
+  SmartPtr<MultiLabelMeshPipeline> pipeline =
+      this->GetMultiLabelMeshPipeline(wrapper, timepoint, true);
+  if(!pipeline)
+    return nullptr;
+
+  // Make sure the pipeline has the right image
+  LabelImageWrapper::ImagePointer imgpt = wrapper->GetImageByTimePoint(timepoint);
+  pipeline->SetImage(imgpt);
+
+  // Pass the options to the pipeline
+  pipeline->SetMeshOptions(m_GlobalState->GetMeshOptions());
+
+  return pipeline;
+}
+
 MeshManager::MeshCollection MeshManager::GetMeshes(unsigned int timepoint)
 {
   // Empty collection that is returned by default
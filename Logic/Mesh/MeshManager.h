@@ -97,6 +97,15 @@ public:
    */
   itk::ModifiedTimeType GetBuildTime(unsigned int timepoint);
 
+  /**
+   * Get the mesh pipeline of a time point of the selected segmentation,
+   * creating it if needed, with its image and the current mesh options. The
+   * pipelines of different time points may then be updated concurrently.
+   * Returns NULL in snake mode or when the segmentation is not properly 3D.
+   * This method itself must be called from the main thread.
+   */
+  SmartPtr<MultiLabelMeshPipeline> PrepareMeshPipeline(unsigned int timepoint);
+
 protected:
 
   MeshManager();
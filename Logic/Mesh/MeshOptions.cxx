@@ -74,6 +74,10 @@ MeshOptions
     NewSimpleProperty("MeshSmoothingFeatureEdgeSmoothing", false);
   m_MeshSmoothingBoundarySmoothingModel = 
     NewSimpleProperty("MeshSmoothingBoundarySmoothing", false);
+
+  // GPU extraction is optional
+  m_UseGPUExtractionModel =
+    NewSimpleProperty("UseGPUExtraction", false);
 }
 
 /*
@@ -69,6 +69,9 @@ public:
   irisSimplePropertyAccessMacro(MeshSmoothingFeatureEdgeSmoothing,bool)
   irisSimplePropertyAccessMacro(MeshSmoothingBoundarySmoothing,bool)
 
+  // Extract the meshes on the GPU, in builds that support it
+  irisSimplePropertyAccessMacro(UseGPUExtraction,bool)
+
 protected:
   MeshOptions();
 
@@ -95,6 +98,8 @@ private:
   SmartPtr<ConcreteRangedFloatProperty> m_MeshSmoothingFeatureAngleModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_MeshSmoothingFeatureEdgeSmoothingModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_MeshSmoothingBoundarySmoothingModel;
+
+  SmartPtr<ConcreteSimpleBooleanProperty> m_UseGPUExtractionModel;
 };
 
 #endif // __MeshOptions_h_
@@ -6,6 +6,9 @@
 #include <vtkPointData.h>
 #include <vtkCellData.h>
 #include <vtkDataSetAttributes.h>
+#include <vtkNew.h>
+#include <vtkQuadricClustering.h>
+#include <vtkStaticPointLocator.h>
 #include <itksys/SystemTools.hxx>
 
 // ========================================
@@ -14,6 +17,7 @@
 void PolyDataWrapper::SetPolyData(vtkPolyData *polydata)
 {
   m_PolyData = polydata;
+  m_PreviewPolyData = nullptr;
   UpdateDataArrayProperties();
   this->Modified();
 }
@@ -25,6 +29,43 @@ PolyDataWrapper::GetPolyData()
   return m_PolyData;
 }
 
+vtkSmartPointer<vtkPolyData>
+PolyDataWrapper::CreatePreviewPolyData(vtkPolyData *mesh)
+{
+  if (!mesh || mesh->GetNumberOfCells() < PREVIEW_MIN_CELLS)
+    return nullptr;
+
+  // Cluster the vertices on a grid fitted to the mesh bounds, which takes
+  // time linear in the size of the mesh and leaves a few hundred thousand
+  // triangles. The cells that are kept carry their data with them.
+  vtkNew<vtkQuadricClustering> cluster;
+  cluster->SetInputData(mesh);
+  cluster->AutoAdjustNumberOfDivisionsOn();
+  cluster->SetNumberOfDivisions(256, 256, 256);
+  cluster->CopyCellDataOn();
+  cluster->Update();
+
+  vtkSmartPointer<vtkPolyData> preview = cluster->GetOutput();
+
+  // The clustered points are new, so they take the point data of the
+  // closest point of the full mesh, which keeps the coloring by data arrays
+  vtkPointData *pd_src = mesh->GetPointData();
+  if (pd_src->GetNumberOfArrays() > 0 && preview->GetNumberOfPoints() > 0)
+    {
+    vtkNew<vtkStaticPointLocator> locator;
+    locator->SetDataSet(mesh);
+    locator->BuildLocator();
+
+    vtkIdType n = preview->GetNumberOfPoints();
+    vtkPointData *pd_dst = preview->GetPointData();
+    pd_dst->CopyAllocate(pd_src, n);
+    for (vtkIdType i = 0; i < n; i++)
+      pd_dst->CopyData(pd_src, locator->FindClosestPoint(preview->GetPoint(i)), i);
+    }
+
+  return preview;
+}
+
 void
 PolyDataWrapper::UpdateDataArrayProperties()
 {
@@ -195,11 +236,20 @@ MeshAssembly
 
 MeshWrapperBase::MeshWrapperBase()
 {
-
+  this->RegisterMemoryUsage();
 }
 
 MeshWrapperBase::~MeshWrapperBase()
 {
+  m_MemoryRegistration.Reset();
+}
+
+void
+MeshWrapperBase::GetMemoryUsage(MemoryAccounting::Usage &usage) const
+{
+  for (auto &kv : m_MeshAssemblyMap)
+    usage.Bytes[MemoryAccounting::MESHES] +=
+        (size_t) (kv.second->GetTotalMemoryInMB() * 1024.0 * 1024.0);
 }
 
 void
@@ -447,6 +497,7 @@ MeshWrapperBase
   auto folder_assembly = folder.Folder("MeshTimePoints");
   bool fnSet = false;
   bool has_poly = false;
+  std::vector<GuidedMeshIO::MeshFileRequest> requests;
 
   for (unsigned int tp = 1; tp <= nT; ++tp)
     {
@@ -477,7 +528,7 @@ MeshWrapperBase
           .GetEnum(GuidedMeshIO::GetEnumFileFormat(), FileFormat::FORMAT_COUNT);
 
       // Load with tp = j-1. The storeing of time point index is zero-based
-      io.LoadMesh(poly_file_full.c_str(), format, this, tp - 1, crnt_poly);
+      requests.push_back({ poly_file_full, format, tp - 1, (LabelType) crnt_poly });
 
       ++crnt_poly;
       has_poly = true;
@@ -487,6 +538,9 @@ MeshWrapperBase
 
   if (!has_poly)
     throw IRISException("Mesh polydata not found in the workspace file!");
+
+  // Read all the files at once
+  io.LoadMeshes(requests, this);
 }
 
 void
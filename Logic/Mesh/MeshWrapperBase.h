@@ -46,6 +46,29 @@ public:
 
   vtkPolyData *GetPolyData();
 
+  /**
+   * A coarse copy of the mesh that is drawn instead of it while the camera
+   * moves, or nullptr if the mesh is small enough to be drawn as it is. The
+   * full mesh is still the one that is exported and probed. The preview is
+   * dropped when the mesh is replaced.
+   */
+  vtkPolyData *GetPreviewPolyData()
+  { return m_PreviewPolyData; }
+
+  void SetPreviewPolyData(vtkPolyData *preview)
+  { m_PreviewPolyData = preview; }
+
+  /**
+   * Build the preview of a mesh, with the same point and cell data arrays,
+   * or return nullptr if the mesh has fewer than PREVIEW_MIN_CELLS cells.
+   * This does not touch any wrapper, so it may be called from the threads
+   * that read the meshes.
+   */
+  static vtkSmartPointer<vtkPolyData> CreatePreviewPolyData(vtkPolyData *mesh);
+
+  /** Number of cells from which on a mesh gets a preview */
+  static constexpr vtkIdType PREVIEW_MIN_CELLS = 2000000;
+
   MeshDataArrayPropertyMap &GetPointDataProperties()
   { return m_PointDataProperties; }
 
@@ -80,6 +103,9 @@ protected:
   // The actual storage of a poly data object
   vtkSmartPointer<vtkPolyData> m_PolyData;
 
+  // The coarse mesh drawn during interaction, if any
+  vtkSmartPointer<vtkPolyData> m_PreviewPolyData;
+
   // Point Data Properties
   MeshDataArrayPropertyMap m_PointDataProperties;
 
@@ -263,6 +289,9 @@ public:
     */
   virtual TDigestDataObject *GetTDigest() override;
 
+  /** Report the polydata of all the time points to the memory accounting */
+  void GetMemoryUsage(MemoryAccounting::Usage &usage) const override;
+
   /** Save the layer to registry */
   virtual void SaveToRegistry(Registry &folder);
 
@@ -45,24 +45,37 @@
 #include "VTKMeshPipeline.h"
 #include "MeshOptions.h"
 #include "vtkUnsignedShortArray.h"
+#include "vtkPointData.h"
+#include "vtkTransform.h"
+#include "vtkTransformPolyDataFilter.h"
+#include <vnl/vnl_inverse.h>
 
 // ITK includes
 #include "itkBinaryThresholdImageFilter.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 
 MultiLabelMeshPipeline
 ::MultiLabelMeshPipeline()
 {
-  // Initialize the region of interest filter
+  // Initialize the region of interest filter. The buffers of this filter
+  // and the thresholding filter are kept while a batch of labels is meshed,
+  // so that each label reuses them, and released at the end of the batch
   m_ROIFilter = ROIFilter::New();
-  m_ROIFilter->ReleaseDataFlagOn();
 
   // Define the binary thresholding filter that will map the image onto the 
   // range -1 to 1
   m_ThrehsoldFilter = ThresholdFilter::New();
   m_ThrehsoldFilter->SetInput(m_ROIFilter->GetOutput());
-  m_ThrehsoldFilter->ReleaseDataFlagOn();
   m_ThrehsoldFilter->SetInsideValue(1.0f);
   m_ThrehsoldFilter->SetOutsideValue(-1.0f);
 
@@ -73,6 +86,10 @@ MultiLabelMeshPipeline
   // Set the initial mesh options
   m_MeshOptions = MeshOptions::New();
   m_VTKPipeline->SetMeshOptions(m_MeshOptions);
+
+  m_ParallelUpdate = true;
+  m_IncrementalUpdateValid = false;
+  m_MeshNiftiSform.set_identity();
 }
 
 MultiLabelMeshPipeline
@@ -96,6 +113,7 @@ MultiLabelMeshPipeline
 
     // Clear the cached stuff
     m_MeshInfo.clear();
+    m_IncrementalUpdateValid = false;
     }
 }
 
@@ -203,6 +221,9 @@ void MultiLabelMeshPipeline::UpdateMeshInfoHelper(
 
 void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
 {
+  // The meshes that are kept must be in the coordinates of the new header
+  this->UpdateMeshGeometry();
+
   // Create a temporary table of mesh info
   MeshInfoMap meshmap;
 
@@ -258,12 +279,9 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
       it++;
     }
 
-  // Deal with progress accumulation
-  SmartPtr<AllPurposeProgressAccumulator> progress = AllPurposeProgressAccumulator::New();
-  progress->AddObserver(itk::ProgressEvent(), progressCommand);
-
   // Next we check which meshes are new or updated and mark them as needing to
   // be recomputed
+  std::vector<LabelType> dirty_labels;
   for(MeshInfoMap::const_iterator it = meshmap.begin(); it != meshmap.end(); ++it)
     {
     // Get the cached mesh info for this label
@@ -278,51 +296,131 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
       info.BoundingBox[0] = it->second.BoundingBox[0];
       info.BoundingBox[1] = it->second.BoundingBox[1];
       info.Mesh = NULL;
-
-      //auto src = m_VTKPipeline->GetProgressAccumulator();
-
-      // Capture progress from this mesh
-      progress->RegisterSource(m_VTKPipeline->GetProgressAccumulator(), info.Count);
+      dirty_labels.push_back(it->first);
       }
     }
 
-  // Now compute the meshes
-  for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end(); it++)
+  // Compute the meshes that need to be updated
+  this->ComputeMeshes(dirty_labels, progressCommand);
+
+  // The mesh info is now in sync with the image and can be updated
+  // incrementally from label changes
+  m_IncrementalUpdateValid = true;
+}
+
+bool
+MultiLabelMeshPipeline
+::UpdateMeshes(itk::Command *progressCommand, const LabelChangeRunList &changes)
+{
+  // We need a mesh info table computed by a full update
+  if(!m_IncrementalUpdateValid)
+    return false;
+
+  // The meshes that are kept must be in the coordinates of the new header
+  this->UpdateMeshGeometry();
+
+  // Update the voxel counts and extents of the labels affected by the changes.
+  // We can't update the checksum for these labels, so it is reset, forcing the
+  // next full update to recompute their meshes.
+  std::set<LabelType> dirty_set;
+  for(const auto &run : changes)
     {
-    if(it->second.Mesh == NULL)
+    if(run.OldLabel != 0)
       {
-      // Create the mesh
-      MeshInfo &mi = it->second;
-      mi.Mesh = vtkSmartPointer<vtkPolyData>::New();
+      MeshInfoMap::iterator it = m_MeshInfo.find(run.OldLabel);
+      if(it == m_MeshInfo.end() || it->second.Count < (unsigned long) run.Length)
+        {
+        // The table is inconsistent with the changes, so give up
+        m_IncrementalUpdateValid = false;
+        return false;
+        }
+
+      // The bounding box of the old label is left as is. It may be larger than
+      // needed, but still contains all the voxels with the label
+      it->second.Count -= run.Length;
+      dirty_set.insert(run.OldLabel);
+      }
 
-      // TODO: make this more elegant
-      InputImageType::RegionType bbWiderRegion;
-      for(int d = 0; d < 3; d++)
+    if(run.NewLabel != 0)
+      {
+      itk::Index<3> run_end = run.Start; run_end[0] += run.Length - 1;
+      MeshInfo &info = m_MeshInfo[run.NewLabel];
+      if(info.Count == 0)
         {
-        unsigned long len =
-            (unsigned long) (1 + mi.BoundingBox[1][d] - mi.BoundingBox[0][d]);
-        bbWiderRegion.SetIndex(d, mi.BoundingBox[0][d]);
-        bbWiderRegion.SetSize(d, len);
+        info.BoundingBox[0] = run.Start;
+        info.BoundingBox[1] = run_end;
         }
-      bbWiderRegion.PadByRadius(5);
-      bbWiderRegion.Crop(m_InputImage->GetLargestPossibleRegion());
+      else
+        {
+        for(int d = 0; d < 3; d++)
+          {
+          if(run.Start[d] < info.BoundingBox[0][d])
+            info.BoundingBox[0][d] = run.Start[d];
+          if(run_end[d] > info.BoundingBox[1][d])
+            info.BoundingBox[1][d] = run_end[d];
+          }
+        }
+      info.Count += run.Length;
+      dirty_set.insert(run.NewLabel);
+      }
+    }
+
+  // Remove the labels that are gone and mark the others for recomputation
+  std::vector<LabelType> dirty_labels;
+  for(LabelType label : dirty_set)
+    {
+    MeshInfo &info = m_MeshInfo[label];
+    if(info.Count == 0)
+      {
+      m_MeshInfo.erase(label);
+      }
+    else
+      {
+      info.CheckSum = 0;
+      info.Mesh = NULL;
+      dirty_labels.push_back(label);
+      }
+    }
 
-      // Pass the region to the ROI filter and propagate the filter
-      m_ROIFilter->SetInput(m_InputImage);
-      m_ROIFilter->SetRegionOfInterest(bbWiderRegion);
-      m_ROIFilter->Update();
+  // Compute the meshes that need to be updated
+  this->ComputeMeshes(dirty_labels, progressCommand);
+  return true;
+}
 
-      // Set the parameters for the thresholding filter
-      m_ThrehsoldFilter->SetLowerThreshold(it->first);
-      m_ThrehsoldFilter->SetUpperThreshold(it->first);
-      m_ThrehsoldFilter->UpdateLargestPossibleRegion();
+void
+MultiLabelMeshPipeline
+::ComputeMeshes(const std::vector<LabelType> &dirty_labels, itk::Command *progressCommand)
+{
+  // Deal with progress accumulation
+  SmartPtr<AllPurposeProgressAccumulator> progress = AllPurposeProgressAccumulator::New();
+  progress->AddObserver(itk::ProgressEvent(), progressCommand);
 
-      // Graft the polydata to the last filter in the pipeline
-      m_VTKPipeline->SetImage(m_ThrehsoldFilter->GetOutput());
-      m_VTKPipeline->ComputeMesh(it->second.Mesh);
+  // Which of the meshes have been completed
+  std::vector<char> done(dirty_labels.size(), 0);
+  m_Aborted = false;
 
-      // Update progress
-      progress->StartNextRun(m_VTKPipeline->GetProgressAccumulator());
+  // Compute the meshes concurrently if there is more than one to compute.
+  // When the pipeline runs on the GPU, the labels are sent to the device one
+  // at a time, since each of them already uses all of it
+  if(m_ParallelUpdate && dirty_labels.size() > 1 && !m_VTKPipeline->IsUsingGPU()
+     && itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads() > 1)
+    {
+    this->ComputeMeshesInParallel(dirty_labels, progress, done);
+    }
+  else
+    {
+    this->ComputeMeshesInSeries(dirty_labels, progress, done);
+    }
+
+  // Forget the labels that were not completed because of an abort, so that
+  // they are recomputed by the next update
+  for(unsigned int i = 0; i < dirty_labels.size(); i++)
+    {
+    if(!done[i])
+      {
+      m_MeshInfo.erase(dirty_labels[i]);
+      m_IncrementalUpdateValid = false;
+      m_Aborted = true;
       }
     }
 
@@ -333,7 +431,275 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
   this->Modified();
 }
 
-void 
+void
+MultiLabelMeshPipeline
+::ComputeMeshesInSeries(
+    const std::vector<LabelType> &dirty_labels,
+    AllPurposeProgressAccumulator *progress,
+    std::vector<char> &done)
+{
+  // Capture progress from each mesh
+  for(LabelType label : dirty_labels)
+    progress->RegisterSource(m_VTKPipeline->GetProgressAccumulator(), m_MeshInfo[label].Count);
+
+  // Now compute the meshes
+  for(unsigned int i = 0; i < dirty_labels.size() && !this->IsAbortRequested(); i++)
+    {
+    LabelType label = dirty_labels[i];
+
+    // Create the mesh
+    MeshInfo &mi = m_MeshInfo[label];
+    mi.Mesh = vtkSmartPointer<vtkPolyData>::New();
+
+    // Pass the region to the ROI filter and propagate the filter
+    m_ROIFilter->SetInput(m_InputImage);
+    m_ROIFilter->SetRegionOfInterest(this->GetMeshRegion(mi));
+    m_ROIFilter->Update();
+
+    // Set the parameters for the thresholding filter
+    m_ThrehsoldFilter->SetLowerThreshold(label);
+    m_ThrehsoldFilter->SetUpperThreshold(label);
+    m_ThrehsoldFilter->UpdateLargestPossibleRegion();
+
+    // Graft the polydata to the last filter in the pipeline
+    m_VTKPipeline->SetImage(m_ThrehsoldFilter->GetOutput());
+    m_VTKPipeline->ComputeMesh(mi.Mesh);
+
+    // A mesh finished after an abort is discarded, since the caller may no
+    // longer want it
+    if(!this->IsAbortRequested())
+      {
+      done[i] = 1;
+      if(m_MeshCompletedCallback)
+        m_MeshCompletedCallback(label, mi.Mesh);
+      }
+
+    // Update progress
+    progress->StartNextRun(m_VTKPipeline->GetProgressAccumulator());
+    }
+
+  // Release the buffers shared by the labels
+  m_ROIFilter->GetOutput()->ReleaseData();
+  m_ThrehsoldFilter->GetOutput()->ReleaseData();
+  m_VTKPipeline->ReleaseBuffers();
+}
+
+MultiLabelMeshPipeline::InputImageType::RegionType
+MultiLabelMeshPipeline
+::GetMeshRegion(const MeshInfo &mi) const
+{
+  // TODO: make this more elegant
+  InputImageType::RegionType bbWiderRegion;
+  for(int d = 0; d < 3; d++)
+    {
+    unsigned long len =
+        (unsigned long) (1 + mi.BoundingBox[1][d] - mi.BoundingBox[0][d]);
+    bbWiderRegion.SetIndex(d, mi.BoundingBox[0][d]);
+    bbWiderRegion.SetSize(d, len);
+    }
+  bbWiderRegion.PadByRadius(5);
+  bbWiderRegion.Crop(m_InputImage->GetLargestPossibleRegion());
+  return bbWiderRegion;
+}
+
+void
+MultiLabelMeshPipeline
+::ComputeMeshesInParallel(
+    const std::vector<LabelType> &labels,
+    AllPurposeProgressAccumulator *progress,
+    std::vector<char> &done)
+{
+  // Allocate the meshes up front, so that the worker threads do not touch
+  // the mesh info map
+  std::vector<MeshInfo *> tasks;
+  unsigned long total_voxels = 0;
+  for(LabelType label : labels)
+    {
+    MeshInfo *mi = &m_MeshInfo[label];
+    mi->Mesh = vtkSmartPointer<vtkPolyData>::New();
+    total_voxels += mi->Count;
+    tasks.push_back(mi);
+    }
+
+  // Progress is reported from the calling thread as meshes are completed,
+  // with each mesh weighted by its number of voxels
+  SmartPtr<TrivalProgressSource> tracker = TrivalProgressSource::New();
+  progress->RegisterSource(tracker, 1.0);
+  tracker->StartProgress(total_voxels);
+
+  // Shared state between the workers and the calling thread
+  std::atomic<size_t> next_task(0);
+  std::mutex mutex, input_mutex;
+  std::condition_variable cv;
+  size_t n_done = 0;
+  unsigned long done_voxels = 0;
+  std::exception_ptr error;
+
+  auto worker = [&]()
+    {
+    // Each thread has its own copy of the pipeline
+    ROIFilterPointer roi = ROIFilter::New();
+    ThresholdFilterPointer thresh = ThresholdFilter::New();
+    thresh->SetInput(roi->GetOutput());
+    thresh->SetInsideValue(1.0f);
+    thresh->SetOutsideValue(-1.0f);
+
+    VTKMeshPipeline vtk_pipeline;
+    vtk_pipeline.SetMeshOptions(m_MeshOptions);
+
+    // Binary image handed to the VTK pipeline. It is not connected to the
+    // ITK pipeline, but shares its buffer with the output of the threshold
+    // filter, which is grafted back before each update so that the buffer
+    // is reused for all the labels processed by this thread
+    InternalImagePointer binary = InternalImageType::New();
+
+    for(size_t i = next_task++; i < tasks.size(); i = next_task++)
+      {
+      // Skip the remaining labels after an abort, but still count them as
+      // processed so that the progress loop below terminates
+      if(this->IsAbortRequested())
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        n_done++;
+        cv.notify_one();
+        continue;
+        }
+
+      MeshInfo *mi = tasks[i];
+      LabelType label = labels[i];
+      try
+        {
+        // The ITK pipeline updates the requested region of the shared input,
+        // so it is run one thread at a time. The VTK pipeline gets the
+        // unconnected binary image so that it does not reach back to the input.
+          {
+          std::lock_guard<std::mutex> lock(input_mutex);
+          roi->SetInput(m_InputImage);
+          roi->SetRegionOfInterest(this->GetMeshRegion(*mi));
+          thresh->SetLowerThreshold(label);
+          thresh->SetUpperThreshold(label);
+          thresh->GraftOutput(binary);
+          thresh->UpdateLargestPossibleRegion();
+          binary->Graft(thresh->GetOutput());
+          }
+
+        vtk_pipeline.SetImage(binary);
+        vtk_pipeline.ComputeMesh(mi->Mesh);
+
+        if(!this->IsAbortRequested())
+          {
+          done[i] = 1;
+          if(m_MeshCompletedCallback)
+            m_MeshCompletedCallback(label, mi->Mesh);
+          }
+        }
+      catch(...)
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!error)
+          error = std::current_exception();
+        }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      n_done++;
+      done_voxels += mi->Count;
+      cv.notify_one();
+      }
+    };
+
+  // Start the worker threads
+  size_t n_threads = std::min(
+        (size_t) itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),
+        tasks.size());
+  std::vector<std::thread> threads;
+  for(size_t i = 0; i < n_threads; i++)
+    threads.emplace_back(worker);
+
+  // Report progress until all the meshes are done
+  unsigned long reported_voxels = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true)
+    {
+    cv.wait(lock, [&]() { return done_voxels > reported_voxels || n_done == tasks.size(); });
+    unsigned long delta = done_voxels - reported_voxels;
+    reported_voxels = done_voxels;
+    bool finished = (n_done == tasks.size());
+
+    lock.unlock();
+    if(delta > 0)
+      tracker->AddProgress(delta);
+    if(finished)
+      break;
+    lock.lock();
+    }
+
+  for(auto &t : threads)
+    t.join();
+
+  tracker->EndProgress();
+
+  // Pass on the first error encountered by the workers
+  if(error)
+    {
+    for(LabelType label : labels)
+      m_MeshInfo[label].Mesh = NULL;
+    std::rethrow_exception(error);
+    }
+}
+
+void
+MultiLabelMeshPipeline
+::UpdateMeshGeometry()
+{
+  vnl_matrix_fixed<double, 4, 4> sform = ImageWrapperBase::ConstructNiftiSform(
+        m_InputImage->GetDirection().GetVnlMatrix().as_ref(),
+        m_InputImage->GetOrigin().GetVnlVector(),
+        m_InputImage->GetSpacing().GetVnlVector());
+
+  if(sform == m_MeshNiftiSform)
+    return;
+
+  // Transform from the old RAS coordinates to the new ones. If it flips the
+  // orientation, the normals are flipped like VTKMeshPipeline does for new
+  // meshes, since the old meshes had them flipped for the old transform
+  vnl_matrix_fixed<double, 4, 4> delta = sform * vnl_inverse(m_MeshNiftiSform);
+  vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
+  transform->SetMatrix(delta.data_block());
+  bool flip = transform->GetMatrix()->Determinant() < 0;
+
+  for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end(); ++it)
+    {
+    if(!it->second.Mesh)
+      continue;
+
+    vtkSmartPointer<vtkTransformPolyDataFilter> filter =
+        vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+    filter->SetInputData(it->second.Mesh);
+    filter->SetTransform(transform);
+    filter->Update();
+
+    vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+    mesh->ShallowCopy(filter->GetOutput());
+
+    vtkDataArray *nrm = mesh->GetPointData()->GetNormals();
+    if(flip && nrm)
+      {
+      for(vtkIdType i = 0; i < nrm->GetNumberOfTuples(); i++)
+        for(int j = 0; j < nrm->GetNumberOfComponents(); j++)
+          nrm->SetComponent(i, j, -nrm->GetComponent(i, j));
+      nrm->Modified();
+      }
+
+    it->second.Mesh = mesh;
+    if(m_MeshCompletedCallback)
+      m_MeshCompletedCallback(it->first, mesh);
+    }
+
+  m_MeshNiftiSform = sform;
+  this->Modified();
+}
+
+void
 MultiLabelMeshPipeline
 ::SetImage(const InputImageType *image)
 {
@@ -341,6 +707,7 @@ MultiLabelMeshPipeline
     {
     m_InputImage = image;
     m_MeshInfo.clear();
+    m_IncrementalUpdateValid = false;
     }
 }
 
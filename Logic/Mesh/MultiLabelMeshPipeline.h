@@ -42,8 +42,12 @@
 #include "itksys/MD5.h"
 #include "itkObjectFactory.h"
 #include "ImageWrapperTraits.h"
+#include "LabelImageWrapper.h"
 #include "RLERegionOfInterestImageFilter.h"
 #include "RLEImageScanlineIterator.h"
+#include <vnl/vnl_matrix_fixed.h>
+#include <atomic>
+#include <functional>
 
 
 // Forward reference to itk classes
@@ -132,6 +136,43 @@ public:
   /** Update the meshes */
   void UpdateMeshes(itk::Command *progressCommand);
 
+  /** List of label changes made to the input image */
+  typedef LabelImageWrapper::LabelChangeRunList LabelChangeRunList;
+
+  /**
+   * Update the meshes given the list of label changes made to the input image
+   * since the last update. Only the meshes of the labels involved in the
+   * changes are recomputed, and the image is not scanned. Returns false if the
+   * incremental update is not possible (e.g., no full update has been done
+   * since the image or mesh options were changed), in which case the caller
+   * should call UpdateMeshes(progressCommand).
+   */
+  bool UpdateMeshes(itk::Command *progressCommand, const LabelChangeRunList &changes);
+
+  /**
+   * When enabled (default), UpdateMeshes computes the meshes for different
+   * labels concurrently, each thread using its own mesh pipeline
+   */
+  irisGetSetMacro(ParallelUpdate, bool)
+
+  /**
+   * Optional flag that, when raised by another thread, makes UpdateMeshes
+   * stop before the next label. Labels whose meshes were not completed are
+   * dropped from the mesh info, so that the next update recomputes them.
+   */
+  irisGetSetMacro(AbortFlag, const std::atomic<bool> *)
+
+  /** Whether the last call to UpdateMeshes was stopped by the abort flag */
+  irisIsMacro(Aborted)
+
+  /**
+   * Optional callback invoked for each mesh as soon as it is computed. With
+   * parallel updates, it is called from the worker threads.
+   */
+  typedef std::function<void(LabelType, vtkPolyData *)> MeshCompletedCallback;
+  void SetMeshCompletedCallback(const MeshCompletedCallback &cb)
+    { m_MeshCompletedCallback = cb; }
+
   /** Get the collection of computed meshes */
   std::map<LabelType, vtkSmartPointer<vtkPolyData> > GetMeshCollection();
 
@@ -184,6 +225,52 @@ private:
   // The VTK pipeline
   VTKMeshPipeline *           m_VTKPipeline;
 
+  // Whether meshes are computed in parallel
+  bool                        m_ParallelUpdate;
+
+  // Whether the mesh info is in sync with the image for incremental updates
+  bool                        m_IncrementalUpdateValid;
+
+  // Cancellation support
+  const std::atomic<bool> *   m_AbortFlag = nullptr;
+  bool                        m_Aborted = false;
+
+  // Notification of completed meshes
+  MeshCompletedCallback       m_MeshCompletedCallback;
+
+  // Voxel to RAS transform of the input header that the meshes are in
+  vnl_matrix_fixed<double, 4, 4> m_MeshNiftiSform;
+
+  // Move the meshes to the RAS coordinates of the current input header, if
+  // the header has changed (e.g., the image was reoriented) since they were
+  // computed. The voxels are the same, so the meshes are transformed rather
+  // than computed again. Each moved mesh is a new object, reported to the
+  // completed mesh callback, since the old one may be on display
+  void UpdateMeshGeometry();
+
+  bool IsAbortRequested() const { return m_AbortFlag && *m_AbortFlag; }
+
+  // Compute the meshes for the given labels and mark the pipeline modified
+  void ComputeMeshes(
+      const std::vector<LabelType> &labels, itk::Command *progressCommand);
+
+  // Get the region used to extract the mesh for a label
+  InputImageType::RegionType GetMeshRegion(const MeshInfo &mi) const;
+
+  // Compute the meshes for the given labels one after the other. The entries
+  // of done are set for the labels whose meshes were completed
+  void ComputeMeshesInSeries(
+      const std::vector<LabelType> &labels,
+      AllPurposeProgressAccumulator *progress,
+      std::vector<char> &done);
+
+  // Compute the meshes for the given labels using a pool of threads. The
+  // entries of done are set for the labels whose meshes were completed
+  void ComputeMeshesInParallel(
+      const std::vector<LabelType> &labels,
+      AllPurposeProgressAccumulator *progress,
+      std::vector<char> &done);
+
   // Helper routine for the update command
   void UpdateMeshInfoHelper(
       MeshInfo *current_meshinfo,
@@ -1,6 +1,7 @@
 #include "SegmentationMeshWrapper.h"
 #include "MeshWrapperBase.h"
 #include "Rebroadcaster.h"
+#include "SNAPLatencyMonitor.h"
 
 //--------------------------------------------
 //  SegmentationMeshAssembly Implementation
@@ -33,8 +34,136 @@ UpdateMeshAssembly(itk::Command *progress, ImagePointer img, MeshOptions *option
 
   // Run the UpdateMesh for the current tp assembly
   m_Pipeline->UpdateMeshes(progress);
+  m_SourceMTime = img->GetMTime();
+  m_OptionsMTime = options->GetMTime();
+
+  // We don't know where the journal stands relative to this update, so the
+  // next journal-based update must start from scratch
+  m_LabelChangeJournalSerial = (unsigned long) -1;
+
+  // Post Update. Update mesh assmebly
+  this->UpdateMeshCollection();
+}
+
+void
+SegmentationMeshAssembly::
+UpdateMeshAssembly(itk::Command *progress, LabelImageWrapper *seg, MeshOptions *options)
+{
+  this->BeginBackgroundUpdate(seg, options);
+  this->ComputeBackgroundUpdate(progress, nullptr);
+  this->InstallCompletedMeshes();
+  this->EndBackgroundUpdate();
+}
+
+void
+SegmentationMeshAssembly::
+BeginBackgroundUpdate(LabelImageWrapper *seg, MeshOptions *options)
+{
+  // Journal label changes so that later updates can be incremental
+  seg->SetLabelChangeJournalEnabled(true);
+
+  // Copy the run-length lines of the segmentation. The copy is kept between
+  // updates so that the pipeline sees the same image and can be incremental
+  const LabelImageWrapper::ImageType *src = seg->GetImage();
+  if(!m_Snapshot)
+    m_Snapshot = LabelImageWrapper::ImageType::New();
+  m_Snapshot->CopyInformation(src);
+  m_Snapshot->SetRegions(src->GetLargestPossibleRegion());
+  m_Snapshot->Allocate();
+
+  auto *src_lines = src->GetBuffer()->GetBufferPointer();
+  auto n_lines = src->GetBuffer()->GetPixelContainer()->Size();
+  std::copy(src_lines, src_lines + n_lines, m_Snapshot->GetBuffer()->GetBufferPointer());
+  m_Snapshot->Modified();
+
+  // Feed the pipeline. This resets the pipeline if the image or the options
+  // have changed, in which case the incremental update will fail
+  m_Pipeline->SetImage(m_Snapshot);
+  m_Pipeline->SetMeshOptions(options);
+
+  // Record the changes to the labels since the last update
+  m_SnapshotChanges.clear();
+  m_SnapshotIncremental = seg->GetLabelChangesSince(m_LabelChangeJournalSerial, m_SnapshotChanges);
+  m_SnapshotJournalEnd = seg->GetLabelChangeJournalEnd();
+  m_SnapshotMTime = src->GetMTime();
+  m_SnapshotOptionsMTime = options->GetMTime();
+}
+
+void
+SegmentationMeshAssembly::
+ComputeBackgroundUpdate(itk::Command *progress, const std::atomic<bool> *abort)
+{
+  // Hand over each mesh as soon as it is done
+  m_Pipeline->SetAbortFlag(abort);
+  m_Pipeline->SetMeshCompletedCallback(
+        [this](LabelType label, vtkPolyData *mesh)
+    {
+    std::lock_guard<std::mutex> lock(m_PendingMutex);
+    m_PendingMeshes[label] = mesh;
+    });
+
+  // Try updating only the labels that have changed
+  if(!m_SnapshotIncremental || !m_Pipeline->UpdateMeshes(progress, m_SnapshotChanges))
+    {
+    if(!abort || !*abort)
+      m_Pipeline->UpdateMeshes(progress);
+    }
+
+  m_BackgroundAborted = m_Pipeline->IsAborted() || (abort && *abort);
+  m_Pipeline->SetAbortFlag(nullptr);
+  m_Pipeline->SetMeshCompletedCallback(nullptr);
+}
+
+bool
+SegmentationMeshAssembly::
+InstallCompletedMeshes()
+{
+  std::map<LabelType, vtkSmartPointer<vtkPolyData> > completed;
+  {
+  std::lock_guard<std::mutex> lock(m_PendingMutex);
+  completed.swap(m_PendingMeshes);
+  }
+
+  if(completed.empty())
+    return false;
+
+  for (auto cit = completed.cbegin(); cit != completed.cend(); ++cit)
+    {
+    if (this->Exist(cit->first))
+      this->GetMesh(cit->first)->SetPolyData(cit->second);
+    else
+      {
+      auto polyWrapper = PolyDataWrapper::New();
+      polyWrapper->SetPolyData(cit->second);
+      this->AddMesh(polyWrapper, cit->first);
+      }
+    }
+
+  this->Modified();
+  return true;
+}
+
+void
+SegmentationMeshAssembly::
+EndBackgroundUpdate()
+{
+  // Keep the old meshes of the labels that were not reached. The source
+  // MTime is not advanced, so the assembly stays dirty
+  if(m_BackgroundAborted)
+    return;
+
+  m_LabelChangeJournalSerial = m_SnapshotJournalEnd;
+  m_SourceMTime = m_SnapshotMTime;
+  m_OptionsMTime = m_SnapshotOptionsMTime;
 
   // Post Update. Update mesh assmebly
+  this->UpdateMeshCollection();
+}
+
+void
+SegmentationMeshAssembly::
+UpdateMeshCollection()
+{
   auto collection = m_Pipeline->GetMeshCollection();
   // Process creation and update
   for (auto cit = collection.cbegin(); cit != collection.cend(); ++cit)
@@ -109,10 +238,9 @@ SegmentationMeshWrapper::IsMeshDirty(unsigned int timepoint)
   auto assembly = dynamic_cast<SegmentationMeshAssembly*>(GetMeshAssembly(timepoint));
   if (assembly)
     {
-    auto pipeMTime = assembly->GetMTime();
     auto optionMTime = m_MeshOptions->GetMTime();
 
-    if (imgMTime > pipeMTime || optionMTime >= pipeMTime)
+    if (imgMTime > assembly->GetSourceMTime() || optionMTime > assembly->GetOptionsMTime())
       return true;
     }
   else
@@ -136,6 +264,8 @@ CreateNewAssembly(unsigned int timepoint)
 void
 SegmentationMeshWrapper::UpdateMeshes(itk::Command *progressCmd, unsigned int timepoint)
 {
+  SNAP_LATENCY_SCOPE(SNAPLatencyMonitor::MESH_UPDATE);
+
   if (!m_MeshAssemblyMap.count(timepoint))
     {
     // If assembly not exist yet, create a new assembly
@@ -146,8 +276,30 @@ SegmentationMeshWrapper::UpdateMeshes(itk::Command *progressCmd, unsigned int ti
       static_cast<SegmentationMeshAssembly*>(m_MeshAssemblyMap[timepoint].GetPointer());
 
 
-  auto img = m_ImagePointer->GetImageByTimePoint(timepoint);
-  assembly->UpdateMeshAssembly(progressCmd, img, m_MeshOptions);
+  // The label change journal is kept for the current time point only
+  if(timepoint == m_ImagePointer->GetTimePointIndex())
+    {
+    assembly->UpdateMeshAssembly(progressCmd, m_ImagePointer, m_MeshOptions);
+    }
+  else
+    {
+    auto img = m_ImagePointer->GetImageByTimePoint(timepoint);
+    assembly->UpdateMeshAssembly(progressCmd, img, m_MeshOptions);
+    }
+}
+
+SegmentationMeshAssembly *
+SegmentationMeshWrapper::BeginBackgroundUpdate()
+{
+  unsigned int timepoint = m_ImagePointer->GetTimePointIndex();
+  if (!m_MeshAssemblyMap.count(timepoint))
+    CreateNewAssembly(timepoint);
+
+  SegmentationMeshAssembly *assembly =
+      static_cast<SegmentationMeshAssembly*>(m_MeshAssemblyMap[timepoint].GetPointer());
+
+  assembly->BeginBackgroundUpdate(m_ImagePointer, m_MeshOptions);
+  return assembly;
 }
 
 void
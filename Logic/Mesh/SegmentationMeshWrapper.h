@@ -6,6 +6,8 @@
 #include "MultiLabelMeshPipeline.h"
 #include "MeshOptions.h"
 #include "LabelImageWrapper.h"
+#include <atomic>
+#include <mutex>
 
 
 class SegmentationMeshAssembly : public MeshAssembly
@@ -18,11 +20,81 @@ public:
   MultiLabelMeshPipeline *GetPipeline();
 
   void UpdateMeshAssembly(itk::Command *progress, ImagePointer img, MeshOptions *options);
+
+  /**
+   * Update the assembly using the label change journal of the segmentation,
+   * which must be at the time point of this assembly. Only the meshes for the
+   * labels that changed since the last update are recomputed. Falls back to
+   * a full update if the journal does not cover all the changes.
+   */
+  void UpdateMeshAssembly(itk::Command *progress, LabelImageWrapper *seg, MeshOptions *options);
+
+  /**
+   * Prepare a background update of the assembly from the segmentation, which
+   * must be at the time point of this assembly. The segmentation is copied,
+   * so that it can be edited while the meshes are computed. Call this on the
+   * main thread, followed by ComputeBackgroundUpdate() on a worker thread.
+   */
+  void BeginBackgroundUpdate(LabelImageWrapper *seg, MeshOptions *options);
+
+  /**
+   * Compute the meshes for the copy made in BeginBackgroundUpdate(). This may
+   * run on a worker thread, and does not touch the meshes of the assembly.
+   * The computation stops early once the abort flag is raised.
+   */
+  void ComputeBackgroundUpdate(itk::Command *progress, const std::atomic<bool> *abort);
+
+  /**
+   * Swap the meshes completed so far by ComputeBackgroundUpdate() into the
+   * assembly. Call this on the main thread. Returns true if any meshes were
+   * swapped in.
+   */
+  bool InstallCompletedMeshes();
+
+  /**
+   * Finish the background update. Call this on the main thread once
+   * ComputeBackgroundUpdate() has returned. If the computation was aborted,
+   * the labels that were not reached keep their old meshes and the assembly
+   * remains out of date.
+   */
+  void EndBackgroundUpdate();
+
+  /** MTime of the segmentation the meshes were last brought up to date with */
+  irisGetMacro(SourceMTime, unsigned long)
+
+  /** MTime of the mesh options the meshes were last brought up to date with */
+  irisGetMacro(OptionsMTime, unsigned long)
+
+  /** MTime of the segmentation copied by BeginBackgroundUpdate() */
+  irisGetMacro(SnapshotMTime, unsigned long)
+
 protected:
   SegmentationMeshAssembly();
   virtual ~SegmentationMeshAssembly();
 
+  // Update the mesh collection from the pipeline
+  void UpdateMeshCollection();
+
   SmartPtr<MultiLabelMeshPipeline> m_Pipeline;
+
+  // Position in the segmentation's label change journal of the last update
+  unsigned long m_LabelChangeJournalSerial = 0;
+
+  // Segmentation and option MTimes the meshes are up to date with
+  unsigned long m_SourceMTime = 0, m_OptionsMTime = 0;
+
+  // Copy of the segmentation used by the background update, and the state
+  // of the segmentation at the time it was copied
+  ImagePointer m_Snapshot;
+  unsigned long m_SnapshotMTime = 0, m_SnapshotOptionsMTime = 0;
+  unsigned long m_SnapshotJournalEnd = 0;
+  bool m_SnapshotIncremental = false;
+  bool m_BackgroundAborted = false;
+  MultiLabelMeshPipeline::LabelChangeRunList m_SnapshotChanges;
+
+  // Meshes completed by the background update, not yet in the assembly
+  std::map<LabelType, vtkSmartPointer<vtkPolyData> > m_PendingMeshes;
+  std::mutex m_PendingMutex;
 };
 
 class SegmentationMeshWrapper : public MeshWrapperBase
@@ -62,6 +134,13 @@ public:
 
   void UpdateMeshes(itk::Command *progressCmd, unsigned int timepoint);
 
+  /**
+   * Prepare a background update of the meshes at the current time point of
+   * the segmentation, creating the assembly if needed. Returns the assembly,
+   * on which ComputeBackgroundUpdate() should be run next.
+   */
+  SegmentationMeshAssembly *BeginBackgroundUpdate();
+
   void Initialize(LabelImageWrapper *segImg, MeshOptions* meshOptions);
 
   /** Add a new blank segmentation mesh assembly to the assembly map*/
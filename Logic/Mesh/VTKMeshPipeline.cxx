@@ -67,9 +67,10 @@ VTKMeshPipeline
   // Pipe the importer into the exporter (that's a lot of code)
   ConnectITKExporterToVTKImporter(m_VTKExporter.GetPointer(), m_VTKImporter);
 
-  // Initialize the Gaussian filter
+  // Initialize the Gaussian filter. Its output is kept between updates, so
+  // the buffer is reused when meshing a series of labels
   m_VTKGaussianFilter = vtkImageGaussianSmooth::New();
-  m_VTKGaussianFilter->ReleaseDataFlagOn();
+  m_VTKGaussianFilter->ReleaseDataFlagOff();
   
   // Create and configure a filter for polygon smoothing
   m_PolygonSmoothingFilter = vtkSmoothPolyDataFilter::New();
@@ -79,24 +80,49 @@ VTKMeshPipeline
   m_StripperFilter = vtkStripper::New();
   m_StripperFilter->ReleaseDataFlagOn();
 
-  // Create and configure the marching cubes filter
-  m_MarchingCubesFilter = vtkMarchingCubes::New();
-  m_MarchingCubesFilter->ReleaseDataFlagOn();
-  m_MarchingCubesFilter->ComputeScalarsOff();
-  m_MarchingCubesFilter->ComputeGradientsOff();
-  m_MarchingCubesFilter->SetNumberOfContours(1);
-  m_MarchingCubesFilter->SetValue(0,0.0f);
+  // Create and configure the contour filter. Flying edges produces the same
+  // isosurface as marching cubes, but processes the volume in parallel
+  m_ContourFilter = vtkFlyingEdges3D::New();
+  m_ContourFilter->ReleaseDataFlagOn();
+  m_ContourFilter->ComputeNormalsOn();
+  m_ContourFilter->ComputeScalarsOff();
+  m_ContourFilter->ComputeGradientsOff();
+  m_ContourFilter->SetNumberOfContours(1);
+  m_ContourFilter->SetValue(0,0.0f);
+  m_ActiveContourFilter = m_ContourFilter;
 
   // Create the transform filter
   m_TransformFilter = vtkTransformPolyDataFilter::New();
   m_TransformFilter->ReleaseDataFlagOn();
 
-  // Create the transform
+  // Create the transforms
   m_Transform = vtkTransform::New();
+  m_IndexTransform = vtkTransform::New();
 
   // Create and configure a filter for triangle decimation
   m_DecimateFilter = vtkDecimatePro::New();
   m_DecimateFilter->ReleaseDataFlagOn();  
+
+#ifdef SNAP_USE_GPU
+  // The GPU Gaussian filter reads the input image through a GPU image
+  m_GPUImageSource = GPUImageSource::New();
+  m_GPUGaussianFilter = GPUGaussianFilter::New();
+  m_GPUGaussianFilter->SetInput(m_GPUImageSource->GetOutput());
+  m_GPUGaussianFilter->ReleaseDataFlagOn();
+  m_GPUGaussianFilter->SetUseImageSpacingOff();
+  m_GPUGaussianFilter->SetInternalNumberOfStreamDivisions(1);
+#endif
+
+#ifdef SNAP_USE_VTKM_MESHING
+  // Same contour as the flying edges filter, computed by VTK-m
+  m_GPUContourFilter = vtkmContour::New();
+  m_GPUContourFilter->ReleaseDataFlagOn();
+  m_GPUContourFilter->ComputeNormalsOn();
+  m_GPUContourFilter->ComputeScalarsOff();
+  m_GPUContourFilter->ComputeGradientsOff();
+  m_GPUContourFilter->SetNumberOfContours(1);
+  m_GPUContourFilter->SetValue(0,0.0f);
+#endif
 }
 
 VTKMeshPipeline
@@ -108,10 +134,28 @@ VTKMeshPipeline
   m_PolygonSmoothingFilter->Delete();
   m_StripperFilter->Delete();
 
-  m_MarchingCubesFilter->Delete();
+  m_ContourFilter->Delete();
   m_TransformFilter->Delete();
   m_Transform->Delete();
+  m_IndexTransform->Delete();
   m_DecimateFilter->Delete();
+
+#ifdef SNAP_USE_VTKM_MESHING
+  m_GPUContourFilter->Delete();
+#endif
+}
+
+bool
+VTKMeshPipeline
+::IsGPUExtractionAvailable()
+{
+#if defined(SNAP_USE_VTKM_MESHING)
+  return true;
+#elif defined(SNAP_USE_GPU)
+  return itk::IsGPUAvailable();
+#else
+  return false;
+#endif
 }
 
 void
@@ -128,9 +172,27 @@ VTKMeshPipeline
   vtkAlgorithmOutput *pipeImageTail = m_VTKImporter->GetOutputPort();
   vtkAlgorithmOutput *pipePolyTail = NULL;
 
+  // Which stages may run on the GPU
+  bool use_gpu = options->GetUseGPUExtraction() && IsGPUExtractionAvailable();
+  m_UsingGPU = false;
+
   // Route the pipeline according to the settings
   // 1. Check if Gaussian smoothing will be used
 
+#ifdef SNAP_USE_GPU
+  // The GPU filter smooths the ITK image, before it is exported to VTK. The
+  // standard deviation is in voxel units, as for the VTK filter
+  m_UseGPUGaussian =
+      use_gpu && options->GetUseGaussianSmoothing() && itk::IsGPUAvailable();
+  if(m_UseGPUGaussian)
+    {
+    float sigma = options->GetGaussianStandardDeviation();
+    m_GPUGaussianFilter->SetVariance(sigma * sigma);
+    m_GPUGaussianFilter->SetMaximumError(options->GetGaussianError());
+    m_UsingGPU = true;
+    }
+  else
+#endif
   if(options->GetUseGaussianSmoothing())
     {    
     // The Gaussian filter is enabled
@@ -150,12 +212,21 @@ VTKMeshPipeline
 
   // 2. Set input to the appropriate contour filter
 
-  // Marching cubes gets the tail
-  m_MarchingCubesFilter->SetInputConnection(pipeImageTail);
-  m_Progress->RegisterSource(m_MarchingCubesFilter, 10.0f);
-  pipePolyTail = m_MarchingCubesFilter->GetOutputPort();
+  // Contour filter gets the tail
+  vtkPolyDataAlgorithm *contour = m_ContourFilter;
+#ifdef SNAP_USE_VTKM_MESHING
+  if(use_gpu)
+    {
+    contour = m_GPUContourFilter;
+    m_UsingGPU = true;
+    }
+#endif
+  m_ActiveContourFilter = contour;
+  contour->SetInputConnection(pipeImageTail);
+  m_Progress->RegisterSource(contour, 10.0f);
+  pipePolyTail = contour->GetOutputPort();
 
-  // 2.5 Pipe marching cubes output to the transform
+  // 2.5 Pipe contour output to the transform
   m_TransformFilter->SetInputConnection(pipePolyTail);
   m_Progress->RegisterSource(m_TransformFilter, 1.0f);
   pipePolyTail = m_TransformFilter->GetOutputPort();
@@ -237,6 +308,14 @@ VTKMeshPipeline
     m_VTKExporter->GetCallbackUserData());
 
   // Update the ITK portion of the pipeline
+#ifdef SNAP_USE_GPU
+  if(m_UseGPUGaussian)
+    {
+    m_GPUImageSource->SetInput(m_InputImage);
+    m_VTKExporter->SetInput(m_GPUGaussianFilter->GetOutput());
+    }
+  else
+#endif
   m_VTKExporter->SetInput(m_InputImage);
   m_VTKImporter->Modified();
 
@@ -248,20 +327,59 @@ VTKMeshPipeline
   // Update the pipeline
   m_StripperFilter->Update();
 
+  // Flip the normals for left-handed image coordinates
+  this->FlipNormalsIfNeeded(m_StripperFilter->GetOutput());
+
+  // Disconnect pipeline
+  m_StripperFilter->SetOutput(NULL);
+}
+
+void
+VTKMeshPipeline
+::ComputeMeshFromContour(vtkPolyData *contour, vtkPolyData *outMesh)
+{
+  // Reset the progress meter
+  m_Progress->ResetProgress();
+
+  // Feed the contour to the transform filter in place of the contour filter
+  m_TransformFilter->SetInputData(contour);
+  m_TransformFilter->SetTransform(m_IndexTransform);
+
+  // Update the rest of the pipeline
+  m_StripperFilter->SetOutput(outMesh);
+  m_StripperFilter->Update();
+  this->FlipNormalsIfNeeded(m_StripperFilter->GetOutput());
+  m_StripperFilter->SetOutput(NULL);
+
+  // Reconnect the contour filter
+  m_TransformFilter->SetInputConnection(m_ActiveContourFilter->GetOutputPort());
+  m_TransformFilter->SetTransform(m_Transform);
+}
+
+void
+VTKMeshPipeline
+::FlipNormalsIfNeeded(vtkPolyData *mesh)
+{
   // In the case that the jacobian of the transform is negative,
   // flip the normals around
   if(m_Transform->GetMatrix()->Determinant() < 0)
     {
-    vtkPointData *pd = m_StripperFilter->GetOutput()->GetPointData();
-    vtkDataArray *nrm = pd->GetNormals();
+    vtkDataArray *nrm = mesh->GetPointData()->GetNormals();
+    if(!nrm)
+      return;
+
     for(size_t i = 0; i < (size_t)nrm->GetNumberOfTuples(); i++)
       for(size_t j = 0; j < (size_t)nrm->GetNumberOfComponents(); j++)
         nrm->SetComponent(i,j,-nrm->GetComponent(i,j));
     nrm->Modified();
     }
+}
 
-  // Disconnect pipeline
-  m_StripperFilter->SetOutput(NULL);
+void
+VTKMeshPipeline
+::ReleaseBuffers()
+{
+  m_VTKGaussianFilter->GetOutput()->ReleaseData();
 }
 
 void
@@ -281,6 +399,14 @@ VTKMeshPipeline
   // Update the VTK transform to match
   m_Transform->SetMatrix(vtk2nii.data_block());
 
+  // The same for voxel index coordinates
+  vnl_matrix_fixed<double, 4, 4> vox2nii =
+    ImageWrapperBase::ConstructNiftiSform(
+      image->GetDirection().GetVnlMatrix().as_ref(),
+      image->GetOrigin().GetVnlVector(),
+      image->GetSpacing().GetVnlVector());
+  m_IndexTransform->SetMatrix(vox2nii.data_block());
+
   // Pass the transform to the transform filter
   m_TransformFilter->SetTransform(m_Transform);
 }
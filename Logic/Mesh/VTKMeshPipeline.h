@@ -55,13 +55,23 @@
 #include <vtkSmoothPolyDataFilter.h>
 #include <vtkStripper.h>
 #include <vtkCallbackCommand.h>
-#include <vtkMarchingCubes.h>
+#include <vtkFlyingEdges3D.h>
 #include <vtkDecimatePro.h>
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkTransform.h>
 
 #include <mutex>
 
+#include "GPUSettings.h"
+#ifdef SNAP_USE_GPU
+#include "CPUImageToGPUImageFilter.h"
+#include <itkGPUDiscreteGaussianImageFilter.h>
+#include <itkOpenCLUtil.h>
+#endif
+#ifdef SNAP_USE_VTKM_MESHING
+#include <vtkmContour.h>
+#endif
+
 #ifndef vtkFloatingPointType
 # define vtkFloatingPointType vtkFloatingPointType
 typedef float vtkFloatingPointType;
@@ -92,6 +102,32 @@ public:
   /** Compute a mesh for a particular color label */
   void ComputeMesh(vtkPolyData *outData, std::mutex *mutex = nullptr);
 
+  /**
+   * Run the stages that follow the contour filter on a contour that was
+   * computed elsewhere. The points of the contour are given in voxel index
+   * coordinates of the input image, and the normals are gradient directions
+   * in the same coordinates.
+   */
+  void ComputeMeshFromContour(vtkPolyData *contour, vtkPolyData *outData);
+
+  /**
+   * Release the intermediate image buffers. These are otherwise kept between
+   * calls to ComputeMesh, so that meshing a series of labels does not
+   * allocate new buffers for each label.
+   */
+  void ReleaseBuffers();
+
+  /**
+   * Whether this build can extract meshes on the GPU (see UseGPUExtraction
+   * in MeshOptions). The contour is computed with VTK-m, if VTK was built
+   * with it, and the Gaussian smoothing with OpenCL, if a device is found.
+   * Either step falls back to the CPU filters when it can not use the GPU.
+   */
+  static bool IsGPUExtractionAvailable();
+
+  /** Whether the current mesh options make the pipeline use the GPU */
+  irisIsMacro(UsingGPU)
+
   /** Get the progress accumulator */
   AllPurposeProgressAccumulator *GetProgressAccumulator()
     { return m_Progress; }
@@ -130,14 +166,23 @@ private:
   // Triangle stripper
   vtkStripper *m_StripperFilter;  
   
-  // Marching cubes filter
-  vtkMarchingCubes *     m_MarchingCubesFilter;
+  // Contouring filter (multithreaded flying edges)
+  vtkFlyingEdges3D *     m_ContourFilter;
+
+  // The contour filter used with the current options
+  vtkPolyDataAlgorithm * m_ActiveContourFilter;
 
   // Transform filter used to map to RAS space
   vtkTransformPolyDataFilter *m_TransformFilter;
 
   // The transform used
   vtkTransform * m_Transform;
+
+  // The transform from voxel index coordinates, for ComputeMeshFromContour
+  vtkTransform * m_IndexTransform;
+
+  // Flip the normals of the output when the transform is a reflection
+  void FlipNormalsIfNeeded(vtkPolyData *mesh);
   
   // The triangle decimation driver
   vtkDecimatePro *               m_DecimateFilter;
@@ -145,6 +190,25 @@ private:
   // Progress event monitor
   AllPurposeProgressAccumulator::Pointer m_Progress;
 
+  // Whether some of the stages run on the GPU with the current options
+  bool m_UsingGPU = false;
+
+#ifdef SNAP_USE_GPU
+  // Gaussian smoothing on the GPU, done before the image is passed to VTK
+  typedef itk::GPUTraits<ImageType>::Type GPUImageType;
+  typedef CPUImageToGPUImageFilter<GPUImageType> GPUImageSource;
+  typedef itk::GPUDiscreteGaussianImageFilter<GPUImageType, GPUImageType> GPUGaussianFilter;
+
+  SmartPtr<GPUImageSource> m_GPUImageSource;
+  SmartPtr<GPUGaussianFilter> m_GPUGaussianFilter;
+  bool m_UseGPUGaussian = false;
+#endif
+
+#ifdef SNAP_USE_VTKM_MESHING
+  // Contouring filter running on the VTK-m device
+  vtkmContour * m_GPUContourFilter;
+#endif
+
 };
 
 #endif // __VTKMeshPipeline_h_
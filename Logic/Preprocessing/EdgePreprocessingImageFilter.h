@@ -38,15 +38,18 @@
 #include "itkCommand.h"
 #include "itkImageToImageFilter.h"
 #include "EdgePreprocessingSettings.h"
+#include <cmath>
 
 #include "GPUSettings.h"
 #ifdef SNAP_USE_GPU
 #include "CPUImageToGPUImageFilter.h"
 #include <itkGPUDiscreteGaussianImageFilter.h>
+#include <itkOpenCLUtil.h>
 #endif
 
 namespace itk {
   template <class TIn, class TOut> class DiscreteGaussianImageFilter;
+  template <class TIn, class TOut> class SmoothingRecursiveGaussianImageFilter;
   template <class TIn, class TOut> class GradientMagnitudeImageFilter;
   template <class TIn, class TOut, class Fun> class UnaryFunctorImageFilter;
   template <class TIn, class TOut> class CastImageFilter;
@@ -76,7 +79,7 @@ public:
   inline short operator()(const TInput &x)
   {
     float xNorm = (static_cast<float>(x)-m_IntensityBase)*m_IntensityScale;
-    float y = 1.0 / (1.0 + pow(xNorm * m_KappaFactor,m_Exponent));
+    float y = 1.0f / (1.0f + std::pow(xNorm * m_KappaFactor, m_Exponent));
     return static_cast<short> (y * 0x7fff);
   }
 
@@ -106,6 +109,12 @@ private:
  * 
  * This functor implements a Gaussian blur, followed by a gradient magnitude
  * operator, followed by a 'contrast enhancement' intensity remapping filter.
+ *
+ * On the CPU, the blur is computed with a recursive (IIR) Gaussian whose cost
+ * per voxel does not depend on the blur scale. The discrete Gaussian is used
+ * for images that are too thin along some axis for the recursive filter,
+ * e.g., 2D images. When SNAP is built with SNAP_USE_GPU, the blur runs on
+ * the GPU if an OpenCL device is available, and on the CPU otherwise.
  */
 template <typename TInputImage,typename TOutputImage>
 class EdgePreprocessingImageFilter: 
@@ -159,6 +168,7 @@ public:
     image. This should be computed by applying a gradient magnitude filter
     to the input image. Must be provided for the filter to work. */
   itkSetMacro(InputImageMaximumGradientMagnitude, double)
+  itkGetConstMacro(InputImageMaximumGradientMagnitude, double)
 
   /** Get the parameters pointer */
   EdgePreprocessingSettings *GetParameters();
@@ -178,6 +188,9 @@ protected:
    */
   void GenerateInputRequestedRegion() ITK_OVERRIDE;
 
+  /** Whether the recursive Gaussian can be applied to the input image */
+  bool CanUseRecursiveBlur() const;
+
 private:
 
   double m_InputImageMaximumGradientMagnitude;
@@ -187,6 +200,10 @@ private:
   typedef itk::DiscreteGaussianImageFilter<InternalImageType,
                                            InternalImageType>       BlurFilter;
 
+  typedef itk::SmoothingRecursiveGaussianImageFilter<InputImageType,
+                                                     InternalImageType>
+                                                          RecursiveBlurFilter;
+
 #ifdef SNAP_USE_GPU
   typedef CPUImageToGPUImageFilter<GPUInternalImageType>        GPUImageSource;
   typedef itk::GPUDiscreteGaussianImageFilter<GPUInternalImageType,
@@ -203,10 +220,14 @@ private:
 
   SmartPtr<CastFilter> m_CastFilter;
   SmartPtr<BlurFilter> m_BlurFilter;
+  SmartPtr<RecursiveBlurFilter> m_RecursiveBlurFilter;
   SmartPtr<GradMagFilter> m_GradMagFilter;
   SmartPtr<RemapFilter> m_RemapFilter;
 
 #ifdef SNAP_USE_GPU
+  // Whether an OpenCL device was found when the filter was created
+  bool m_UseGPU;
+
   SmartPtr<GPUImageSource> m_GPUImageSource;
   SmartPtr<GPUBlurFilter>  m_GPUBlurFilter;
 #endif
@@ -38,6 +38,7 @@
 
 #include <itkCastImageFilter.h>
 #include <itkDiscreteGaussianImageFilter.h>
+#include <itkSmoothingRecursiveGaussianImageFilter.h>
 #include <itkGradientMagnitudeImageFilter.h>
 #include <itkUnaryFunctorImageFilter.h>
 #include <IRISException.h>
@@ -56,7 +57,6 @@ EdgePreprocessingImageFilter<TInputImage,TOutputImage>
   m_CastFilter = CastFilter::New();
   m_CastFilter->ReleaseDataFlagOn();
 
-#ifndef SNAP_USE_GPU
   m_BlurFilter = BlurFilter::New();
   m_BlurFilter->SetInput(m_CastFilter->GetOutput());
   m_BlurFilter->ReleaseDataFlagOn();
@@ -65,10 +65,18 @@ EdgePreprocessingImageFilter<TInputImage,TOutputImage>
   // anyway. Too much streaming increases execution time unnecessarilty
   m_BlurFilter->SetMaximumError(0.1);
 
+  // The recursive blur casts the input itself
+  m_RecursiveBlurFilter = RecursiveBlurFilter::New();
+  m_RecursiveBlurFilter->ReleaseDataFlagOn();
+
+  // The input of the gradient filter is chosen in GenerateData
   m_GradMagFilter = GradMagFilter::New();
-  m_GradMagFilter->SetInput(m_BlurFilter->GetOutput());
   m_GradMagFilter->ReleaseDataFlagOn();
-#else
+
+#ifdef SNAP_USE_GPU
+  // Fall back to the CPU filters when there is no OpenCL device
+  m_UseGPU = itk::IsGPUAvailable();
+
   m_GPUImageSource = GPUImageSource::New();
   m_GPUImageSource->SetInput(m_CastFilter->GetOutput());
 
@@ -80,13 +88,6 @@ EdgePreprocessingImageFilter<TInputImage,TOutputImage>
   // anyway. Too much streaming increases execution time unnecessarilty
   m_GPUBlurFilter->SetInternalNumberOfStreamDivisions(1);
   m_GPUBlurFilter->SetMaximumError(0.1);
-  //m_ROIFilter = ROIFilter::New();
-  //m_ROIFilter->SetInput(m_GPUBlurFilter->GetOutput());
-
-  m_GradMagFilter = GradMagFilter::New();
-  m_GradMagFilter->SetInput(m_GPUBlurFilter->GetOutput());
-  //m_GradMagFilter->SetInput(m_ROIFilter->GetOutput());
-  m_GradMagFilter->ReleaseDataFlagOn();
 #endif
 
   m_RemapFilter = RemapFilter::New();
@@ -112,27 +113,43 @@ EdgePreprocessingImageFilter<TInputImage,TOutputImage>
   itk::ProgressAccumulator::Pointer pac = itk::ProgressAccumulator::New();
   pac->SetMiniPipelineFilter(this);
 
-#ifndef SNAP_USE_GPU
-  pac->RegisterInternalFilter(m_BlurFilter, 0.8);
-#else
-  pac->RegisterInternalFilter(m_GPUBlurFilter, 0.8);
-#endif
-
-    pac->RegisterInternalFilter(m_RemapFilter, 0.2);
-
-  // Configure the pipeline
-  m_CastFilter->SetInput(inputImage);
-
   // Configure the Gaussian
-#ifndef SNAP_USE_GPU
-  m_BlurFilter->SetUseImageSpacingOff();
-  m_BlurFilter->SetVariance(
-        settings->GetGaussianBlurScale() * settings->GetGaussianBlurScale());
-#else
-  m_GPUBlurFilter->SetUseImageSpacingOff();
-  m_GPUBlurFilter->SetVariance(
-        settings->GetGaussianBlurScale() * settings->GetGaussianBlurScale());
+#ifdef SNAP_USE_GPU
+  if(m_UseGPU)
+    {
+    pac->RegisterInternalFilter(m_GPUBlurFilter, 0.8);
+    m_CastFilter->SetInput(inputImage);
+    m_GPUBlurFilter->SetUseImageSpacingOff();
+    m_GPUBlurFilter->SetVariance(
+          settings->GetGaussianBlurScale() * settings->GetGaussianBlurScale());
+    m_GradMagFilter->SetInput(m_GPUBlurFilter->GetOutput());
+    }
+  else
 #endif
+  if(this->CanUseRecursiveBlur())
+    {
+    // The blur scale is given in voxel units, but the recursive filter takes
+    // the sigma in physical units
+    typename RecursiveBlurFilter::SigmaArrayType sigma;
+    for(unsigned int d = 0; d < ImageDimension; d++)
+      sigma[d] = settings->GetGaussianBlurScale() * inputImage->GetSpacing()[d];
+
+    pac->RegisterInternalFilter(m_RecursiveBlurFilter, 0.8);
+    m_RecursiveBlurFilter->SetInput(inputImage);
+    m_RecursiveBlurFilter->SetSigmaArray(sigma);
+    m_GradMagFilter->SetInput(m_RecursiveBlurFilter->GetOutput());
+    }
+  else
+    {
+    pac->RegisterInternalFilter(m_BlurFilter, 0.8);
+    m_CastFilter->SetInput(inputImage);
+    m_BlurFilter->SetUseImageSpacingOff();
+    m_BlurFilter->SetVariance(
+          settings->GetGaussianBlurScale() * settings->GetGaussianBlurScale());
+    m_GradMagFilter->SetInput(m_BlurFilter->GetOutput());
+    }
+
+  pac->RegisterInternalFilter(m_RemapFilter, 0.2);
 
   // Construct the functor
   // TODO: fixme!
@@ -183,6 +200,20 @@ EdgePreprocessingImageFilter<TInputImage,TOutputImage>
 }
 
 
+template<typename TInputImage,typename TOutputImage>
+bool
+EdgePreprocessingImageFilter<TInputImage,TOutputImage>
+::CanUseRecursiveBlur() const
+{
+  // The recursive filter needs at least four voxels along each axis
+  typename InputImageType::SizeType size =
+      this->GetInput()->GetLargestPossibleRegion().GetSize();
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    if(size[d] < 4)
+      return false;
+  return true;
+}
+
 template<typename TInputImage,typename TOutputImage>
 void 
 EdgePreprocessingImageFilter<TInputImage,TOutputImage>
@@ -1,9 +1,12 @@
 #include "EMGaussianMixtures.h"
 #include <iostream>
 #include <ctime>
+#include <cmath>
+#include <vnl/vnl_matrix.h>
 
 EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, int numOfClass)
-  :m_x(x), m_numOfData(dataSize), m_dimOfGaussian(dataDim), m_numOfGaussian(numOfClass), m_setPriorFlag(0), m_numOfIteration(0), m_fail(0)
+  :m_x(x), m_numOfData(dataSize), m_dimOfGaussian(dataDim), m_numOfGaussian(numOfClass), m_setPriorFlag(0), m_numOfIteration(0), m_fail(0),
+   m_batchFirst(0), m_batchSize(dataSize)
 {
   m_latent = new double*[dataSize];
   m_probs = new double[dataSize*numOfClass];
@@ -17,6 +20,14 @@ EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, in
     {
     m_log_pdf[i] = &m_probs2[i*numOfClass];
     }
+  m_x_soa.resize((size_t) dataSize * dataDim);
+  for (int i = 0; i < dataSize; i++)
+    {
+    for (int d = 0; d < dataDim; d++)
+      {
+      m_x_soa[(size_t) d * dataSize + i] = x[i][d];
+      }
+    }
   m_tmp1 = new double[numOfClass];
   m_tmp2 = new double[dataDim];
   m_tmp3 = new double[dataDim*dataDim];
@@ -33,15 +44,15 @@ EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, in
 
 EMGaussianMixtures::~EMGaussianMixtures()
 {
-  delete m_probs;
-  delete m_probs2;
-  delete m_latent;
-  delete m_log_pdf;
-  delete m_tmp1;
-  delete m_tmp2;
-  delete m_tmp3;
-  delete m_sum;
-  delete m_weight;
+  delete[] m_probs;
+  delete[] m_probs2;
+  delete[] m_latent;
+  delete[] m_log_pdf;
+  delete[] m_tmp1;
+  delete[] m_tmp2;
+  delete[] m_tmp3;
+  delete[] m_sum;
+  delete[] m_weight;
 }
 
 void EMGaussianMixtures::Reset(void)
@@ -194,15 +205,125 @@ double ** EMGaussianMixtures::UpdateOnce(void)
   return m_latent;
 }
 
-void EMGaussianMixtures::EvaluatePDF(void)
+double ** EMGaussianMixtures::UpdateOnceOnBatch(int first, int n)
 {
-  for (int i = 0; i < m_numOfData; i++)
+  int ng = m_numOfGaussian, nd = m_dimOfGaussian;
+
+  // Sufficient statistics of the current model, per unit of data: the
+  // weight, the weighted mean and the weighted second moment
+  std::vector<double> s0(ng);
+  std::vector<VectorType> s1(ng);
+  std::vector<MatrixType> s2(ng);
+  for (int j = 0; j < ng; j++)
     {
-    for (int j = 0; j < m_numOfGaussian; j++)
+    s0[j] = m_gmm->GetWeight(j);
+    if (s0[j] > 0)
+      {
+      const VectorType &mean = m_gmm->GetMean(j);
+      s1[j] = mean * s0[j];
+      s2[j] = (m_gmm->GetCovariance(j) + outer_product(mean, mean)) * s0[j];
+      }
+    else
       {
-      m_log_pdf[i][j] = m_gmm->EvaluateLogPDF(j, m_x[i]);
+      s1[j] = VectorType(nd, 0.0);
+      s2[j] = MatrixType(nd, nd, 0.0);
       }
     }
+
+  // Regular EM step on the batch alone
+  m_batchFirst = first;
+  m_batchSize = n;
+  EvaluatePDF();
+  m_logLikelihood = EvaluateLogLikelihood();
+  UpdateLatent();
+  UpdateMean();
+  UpdateCovariance();
+  if (m_setPriorFlag == 0)
+    {
+    UpdateWeight();
+    }
+  m_batchFirst = 0;
+  m_batchSize = m_numOfData;
+
+  // Blend the statistics of the batch in, with a step size that satisfies
+  // the usual conditions for the convergence of stochastic approximation
+  double eta = pow(m_numOfIteration + 2.0, -0.7);
+  ++m_numOfIteration;
+  for (int j = 0; j < ng; j++)
+    {
+    double b0 = m_sum[j] / n;
+    double t0 = (1.0 - eta) * s0[j] + eta * b0;
+    if (t0 <= 0)
+      {
+      // Neither the model nor the batch support this Gaussian, leave it as
+      // the batch estimate left it
+      continue;
+      }
+
+    VectorType t1 = s1[j] * (1.0 - eta);
+    MatrixType t2 = s2[j] * (1.0 - eta);
+    if (b0 > 0)
+      {
+      const VectorType &mean = m_gmm->GetMean(j);
+      t1 += mean * (eta * b0);
+      t2 += (m_gmm->GetCovariance(j) + outer_product(mean, mean)) * (eta * b0);
+      }
+
+    VectorType mean = t1 / t0;
+    MatrixType cov = t2 / t0 - outer_product(mean, mean);
+    m_gmm->SetGaussian(j, mean, cov);
+    if (m_setPriorFlag == 0)
+      {
+      m_gmm->SetWeight(j, t0);
+      }
+    }
+
+  return m_latent;
+}
+
+template <class TFunction>
+void EMGaussianMixtures::ParallelBlockSum(int m, TFunction f, double *result)
+{
+  int n_blocks = (m_batchSize + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  std::vector<double> acc((size_t) n_blocks * m, 0.0);
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, n_blocks, [&](itk::SizeValueType b)
+  {
+    int offset = b * BLOCK_SIZE;
+    f(m_batchFirst + offset, std::min(BLOCK_SIZE, m_batchSize - offset), acc.data() + b * m);
+  }, nullptr);
+
+  for (int k = 0; k < m; k++)
+    {
+    result[k] = 0;
+    }
+  for (int b = 0; b < n_blocks; b++)
+    {
+    for (int k = 0; k < m; k++)
+      {
+      result[k] += acc[(size_t) b * m + k];
+      }
+    }
+}
+
+void EMGaussianMixtures::EvaluatePDF(void)
+{
+  // Each block of samples is evaluated against each Gaussian in turn
+  ParallelBlockSum(0, [this](int first, int n, double *)
+  {
+    double log_pdf[BLOCK_SIZE], scratch[BLOCK_SIZE];
+    for (int j = 0; j < m_numOfGaussian; j++)
+      {
+      m_gmm->GetGaussian(j)->EvaluateLogPDF(
+            m_x_soa.data() + first, m_numOfData, n, log_pdf, scratch);
+      for (int i = 0; i < n; i++)
+        {
+        m_log_pdf[first + i][j] = log_pdf[i];
+        }
+      }
+  }, nullptr);
+
   if (m_setPriorFlag == 0)
     {
     for (int j = 0; j < m_numOfGaussian; j++)
@@ -279,40 +400,17 @@ void EMGaussianMixtures::UpdateLatent(void)
   
   if (m_setPriorFlag == 0)
     {
-    for (int i = 0; i < m_numOfData; i++)
-      {
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_latent[i][j] = ComputePosterior(m_numOfGaussian, m_log_pdf[i], m_weight, logw.data_block(), j);
-        m_sum[j] += m_latent[i][j];
-        }
-
-
-      /*
-      sum = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_tmp1[j] = m_weight[j] * m_pdf[i][j];
-        sum += m_tmp1[j];
-        }
-      if(sum == 0)
-        {
-        for (int j = 0; j < m_numOfGaussian; j++)
-          {
-          m_latent[i][j] = 1.0 / m_numOfGaussian;
-          m_sum[j] += m_latent[i][j];
-          }
-        }
-      else
+    ParallelBlockSum(m_numOfGaussian, [&](int first, int n, double *acc)
+    {
+      for (int i = first; i < first + n; i++)
         {
         for (int j = 0; j < m_numOfGaussian; j++)
           {
-          m_latent[i][j] = m_tmp1[j] / sum;
-          m_sum[j] += m_latent[i][j];
+          m_latent[i][j] = ComputePosterior(m_numOfGaussian, m_log_pdf[i], m_weight, logw.data_block(), j);
+          acc[j] += m_latent[i][j];
           }
         }
-        */
-      }
+    }, m_sum);
     }
   else
     {
@@ -337,90 +435,94 @@ void EMGaussianMixtures::UpdateLatent(void)
 
 void EMGaussianMixtures::UpdateMean(void)
 {
-  for (int i = 0; i < m_numOfGaussian; i++)
-    {
-    for (int j = 0; j < m_dimOfGaussian; j++)
+  // Accumulate the latent-weighted sum of the samples for every Gaussian
+  int nd = m_dimOfGaussian;
+  std::vector<double> wsum(m_numOfGaussian * nd);
+  ParallelBlockSum(m_numOfGaussian * nd, [&](int first, int n, double *acc)
+  {
+    for (int i = 0; i < m_numOfGaussian; i++)
       {
-      m_tmp2[j] = 0;
-      }
-    
-    for (int j = 0; j < m_numOfData; j++)
-      {
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      for (int k = 0; k < nd; k++)
         {
-        m_tmp2[k] += m_latent[j][i] * m_x[j][k];
+        const double *xk = m_x_soa.data() + (size_t) k * m_numOfData + first;
+        double a = 0;
+        for (int j = 0; j < n; j++)
+          {
+          a += m_latent[first + j][i] * xk[j];
+          }
+        acc[i * nd + k] = a;
         }
       }
+  }, wsum.data());
 
+  for (int i = 0; i < m_numOfGaussian; i++)
+    {
     // This can lead to a possible divide by zero situation. In case the sum
     // of latent variables for class i is zero, we set the mean of that class
     // to infinity
-    if(m_sum[i] > 0)
+    for (int j = 0; j < nd; j++)
       {
-      for (int j = 0; j < m_dimOfGaussian; j++)
-        {
-        m_tmp2[j] = m_tmp2[j] / m_sum[i];
-        }
-      }
-    else
-      {
-      for (int j = 0; j < m_dimOfGaussian; j++)
-        {
+      if(m_sum[i] > 0)
+        m_tmp2[j] = wsum[i * nd + j] / m_sum[i];
+      else
         m_tmp2[j] = - std::numeric_limits<double>::infinity();
-        }
       }
 
-
-    m_gmm->SetMean(i, VectorType(m_tmp2, m_dimOfGaussian));
+    m_gmm->SetMean(i, VectorType(m_tmp2, nd));
     }
 }
 
 void EMGaussianMixtures::UpdateCovariance(void)
 {
-  for (int i = 0; i < m_numOfGaussian; i++)
-    {
-    const VectorType &current_mean = m_gmm->GetMean(i);
-    
-    for (int j = 0; j < m_dimOfGaussian; j++)
-      {
-      for (int k = 0; k < m_dimOfGaussian; k++)
-        {
-        m_tmp3[j*m_dimOfGaussian+k] = 0;
-        }
-      }
-    
-    for (int j = 0; j < m_numOfData; j++)
+  // Accumulate the latent-weighted scatter matrix for every Gaussian. Only
+  // the upper triangle is accumulated, the matrix is symmetric.
+  int nd = m_dimOfGaussian, nd2 = nd * nd;
+  std::vector<double> wcov(m_numOfGaussian * nd2);
+  ParallelBlockSum(m_numOfGaussian * nd2, [&](int first, int n, double *acc)
+  {
+    std::vector<double> diff(nd * BLOCK_SIZE);
+    for (int i = 0; i < m_numOfGaussian; i++)
       {
-      for (int k = 0; k < m_dimOfGaussian; k++)
-        {
-        m_tmp2[k] = m_x[j][k] - current_mean[k];
-        }
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      const VectorType &current_mean = m_gmm->GetMean(i);
+      for (int k = 0; k < nd; k++)
         {
-        for (int l = 0; l < m_dimOfGaussian; l++)
+        const double *xk = m_x_soa.data() + (size_t) k * m_numOfData + first;
+        double *dk = diff.data() + k * BLOCK_SIZE;
+        for (int j = 0; j < n; j++)
           {
-          m_tmp3[k*m_dimOfGaussian+l] += m_tmp2[k] * m_tmp2[l] * m_latent[j][i];
+          dk[j] = xk[j] - current_mean[k];
           }
         }
-      }
 
-    if(m_sum[i] > 0)
-      {
-      for (int j = 0; j < m_dimOfGaussian*m_dimOfGaussian; j++)
+      for (int k = 0; k < nd; k++)
         {
-        m_tmp3[j] = m_tmp3[j] / m_sum[i];
+        const double *dk = diff.data() + k * BLOCK_SIZE;
+        for (int l = k; l < nd; l++)
+          {
+          const double *dl = diff.data() + l * BLOCK_SIZE;
+          double a = 0;
+          for (int j = 0; j < n; j++)
+            {
+            a += dk[j] * dl[j] * m_latent[first + j][i];
+            }
+          acc[i * nd2 + k * nd + l] = a;
+          }
         }
       }
-    else
+  }, wcov.data());
+
+  for (int i = 0; i < m_numOfGaussian; i++)
+    {
+    for (int k = 0; k < nd; k++)
       {
-      for (int j = 0; j < m_dimOfGaussian*m_dimOfGaussian; j++)
+      for (int l = k; l < nd; l++)
         {
-        m_tmp3[j] = 0.0;
+        double c = (m_sum[i] > 0) ? wcov[i * nd2 + k * nd + l] / m_sum[i] : 0.0;
+        m_tmp3[k * nd + l] = m_tmp3[l * nd + k] = c;
         }
       }
 
-
-    m_gmm->SetCovariance(i, MatrixType(m_tmp3, m_dimOfGaussian, m_dimOfGaussian));
+    m_gmm->SetCovariance(i, MatrixType(m_tmp3, nd, nd));
     }
 }
 
@@ -428,41 +530,38 @@ void EMGaussianMixtures::UpdateWeight(void)
 {
   for (int i = 0; i < m_numOfGaussian; i++)
     {
-    m_gmm->SetWeight(i, m_sum[i]/m_numOfData);
+    m_gmm->SetWeight(i, m_sum[i]/m_batchSize);
     }
 }
 
 double EMGaussianMixtures::EvaluateLogLikelihood(void)
 {
-  double tmp1 = 0;
-  double tmp2 = 0;
-  if (m_setPriorFlag == 0)
+  // Delta functions do not contribute to the likelihood
+  std::vector<bool> is_delta(m_numOfGaussian);
+  for (int j = 0; j < m_numOfGaussian; j++)
     {
-    for (int i = 0; i < m_numOfData; i++)
-      {
-      tmp1 = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        if(!m_gmm->GetGaussian(j)->isDeltaFunction())
-          tmp1 += m_weight[j] * exp(m_log_pdf[i][j]);
-        }
-      tmp2 += log(tmp1);
-      }
+    is_delta[j] = m_gmm->GetGaussian(j)->isDeltaFunction();
     }
-  else
-    {
-    for (int i = 0; i < m_numOfData; i++)
+
+  double log_likelihood = 0;
+  ParallelBlockSum(1, [&](int first, int n, double *acc)
+  {
+    for (int i = first; i < first + n; i++)
       {
-      tmp1 = 0;
+      double p = 0;
       for (int j = 0; j < m_numOfGaussian; j++)
         {
-        if(!m_gmm->GetGaussian(j)->isDeltaFunction())
-          tmp1 += m_prior[i][j] * exp(m_log_pdf[i][j]);
+        if(!is_delta[j])
+          {
+          double w = (m_setPriorFlag == 0) ? m_weight[j] : m_prior[i][j];
+          p += w * exp(m_log_pdf[i][j]);
+          }
         }
-      tmp2 += log(tmp1);
+      acc[0] += log(p);
       }
-    }
-  return tmp1;
+  }, &log_likelihood);
+
+  return log_likelihood;
 }
 
 void EMGaussianMixtures::PrintParameters(void)
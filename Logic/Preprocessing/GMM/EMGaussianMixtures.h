@@ -3,6 +3,7 @@
 
 #include "GaussianMixtureModel.h"
 #include "SNAPCommon.h"
+#include <vector>
 
 class EMGaussianMixtures
 {
@@ -31,22 +32,44 @@ public:
 
   double ** Update(void);
   double ** UpdateOnce(void);
+
+  /**
+   * One step of stepwise (online) EM on the samples [first, first+n). The
+   * sufficient statistics of the batch are blended into those of the current
+   * model with a step size that decays with the number of steps, so that
+   * successive batches refine the model without visiting all the samples on
+   * every iteration. The latent variables are only updated for the batch.
+   */
+  double ** UpdateOnceOnBatch(int first, int n);
   double EvaluateLogLikelihood(void);
   void PrintParameters(void);
 
   static double ComputePosterior(int nGauss, double *log_pdf, double *w, double *log_w, int j);
 
+  /** Number of samples processed together by a thread */
+  static constexpr int BLOCK_SIZE = 256;
+
 private:
   void EvaluatePDF(void);
   void UpdateLatent(void);
   void UpdateMean(void);
   void UpdateCovariance(void);
   void UpdateWeight(void);
+
+  // Calls f(first, n, acc) for each block of samples in parallel, where acc
+  // is an array of m zero-initialized accumulators for the block. The block
+  // accumulators are then added up, in order, into result.
+  template <class TFunction>
+  void ParallelBlockSum(int m, TFunction f, double *result);
   
   double **m_latent;
   double **m_log_pdf;
   double **m_prior;
   double **m_x;
+
+  // Copy of the samples in structure-of-arrays layout, i.e., component d of
+  // sample i is m_x_soa[d * m_numOfData + i]
+  std::vector<double> m_x_soa;
   double *m_probs;
   double *m_probs2;
   double *m_tmp1;
@@ -60,6 +83,11 @@ private:
   int m_maxIteration;
   int m_numOfIteration;
   int m_numOfData;
+
+  // The range of samples visited by the E and M steps, all of them except
+  // during UpdateOnceOnBatch()
+  int m_batchFirst;
+  int m_batchSize;
   int m_setPriorFlag;
   int m_fail;
   double m_precision;
@@ -51,6 +51,18 @@ void Gaussian::SetCovariance(const MatrixType &cov)
   m_DiagNormFac = VectorType(m_dimension);
   for(int i = 0; i < m_dimension; i++)
     m_DiagNormFac[i] = log(2 * vnl_math::pi * m_Lambda[i]);
+
+  // Precompute the whitening transform for the batch evaluation
+  m_Whitening = m_Vt;
+  m_LogNormFac = 0.0;
+  for(int i = 0; i < m_dimension; i++)
+    {
+    if(m_Lambda[i] != 0)
+      {
+      m_Whitening.scale_row(i, 1.0 / sqrt(m_Lambda[i]));
+      m_LogNormFac -= 0.5 * m_DiagNormFac[i];
+      }
+    }
 }
 
 double Gaussian::EvaluateLogPDF(VectorType &x, VectorType &xscratch)
@@ -95,6 +107,42 @@ double Gaussian::EvaluateLogPDF(VectorType &x, VectorType &xscratch)
   return 0.5 * logz;
 }
 
+void Gaussian::EvaluateLogPDF(const double *x, long stride, int n,
+                              double *log_pdf, double *scratch) const
+{
+  for(int k = 0; k < n; k++)
+    log_pdf[k] = m_LogNormFac;
+
+  for(int i = 0; i < m_dimension; i++)
+    {
+    // Compute the i-th whitened coordinate of all samples. The loops over the
+    // samples are kept simple so that the compiler can vectorize them.
+    const double *w = m_Whitening[i];
+    for(int k = 0; k < n; k++)
+      scratch[k] = 0.0;
+    for(int j = 0; j < m_dimension; j++)
+      {
+      const double *xj = x + j * stride;
+      double wj = w[j], mj = m_mean_vector[j];
+      for(int k = 0; k < n; k++)
+        scratch[k] += wj * (xj[k] - mj);
+      }
+
+    if(m_Lambda[i] == 0)
+      {
+      // Zero variance, p(x) = 0 unless the sample lies in the subspace
+      for(int k = 0; k < n; k++)
+        if(scratch[k] != 0)
+          log_pdf[k] = -std::numeric_limits<double>::infinity();
+      }
+    else
+      {
+      for(int k = 0; k < n; k++)
+        log_pdf[k] -= 0.5 * scratch[k] * scratch[k];
+      }
+    }
+}
+
 double Gaussian::EvaluatePDF(double *x)
 {
   // We got to exponentiate somewhere, so might as well do it here
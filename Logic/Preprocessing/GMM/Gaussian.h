@@ -26,6 +26,12 @@ public:
   // Evaluate log PDF with user-provided scratch buffer
   double EvaluateLogPDF(VectorType &x, VectorType &xscratch);
 
+  // Evaluate log PDF for n samples stored in structure-of-arrays layout, i.e.,
+  // component d of sample i is x[d * stride + i]. The scratch buffer must hold
+  // n values. This method does not modify the object and is thread-safe.
+  void EvaluateLogPDF(const double *x, long stride, int n,
+                      double *log_pdf, double *scratch) const;
+
   void PrintParameters();
 
   // Tests whether the Gaussian is a delta function (i.e., has zero total variance)
@@ -43,6 +49,12 @@ private:
   vnl_diag_matrix<double> m_Lambda;
   VectorType m_DiagNormFac;
 
+  // Rows of Vt scaled by 1/sqrt(lambda), so that the log PDF is a sum of
+  // squares of the whitened coordinates, and the matching normalization term.
+  // Rows with zero variance are left unscaled.
+  MatrixType m_Whitening;
+  double m_LogNormFac;
+
   // Mean-subtracted and rotated x vector; PCA-normalized z-vector
   // these vectors are used to avoid memory allocation
   VectorType m_x_vector;
@@ -2,6 +2,12 @@
 #include "math.h"
 #include "time.h"
 #include "stdlib.h"
+#include <itkMultiThreaderBase.h>
+#include <algorithm>
+#include <vector>
+
+// Number of samples processed together by a thread
+static constexpr int KMEANS_BLOCK_SIZE = 4096;
 
 KMeansPlusPlus::KMeansPlusPlus(double **x, int dataSize, int dataDim, int numOfClusters)
   :m_dataSize(dataSize), m_dataDim(dataDim), m_numOfClusters(numOfClusters)
@@ -44,13 +50,36 @@ void KMeansPlusPlus::Initialize(void)
   srand(time(0));
 
   m_centers[0] = (int)(((double) rand() / (double) RAND_MAX) * m_dataSize);
-  double distSum = 0;
-  for (int i = 0; i < m_dataSize; i++)
+
+  // The samples are processed in blocks in parallel. Each block keeps its own
+  // partial sums, which are added up in order afterwards.
+  int n_blocks = (m_dataSize + KMEANS_BLOCK_SIZE - 1) / KMEANS_BLOCK_SIZE;
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  auto parallel_for_blocks = [&](auto f)
+  {
+    mt->ParallelizeArray(0, n_blocks, [&](itk::SizeValueType b)
     {
-    m_xCenter[i] = m_centers[0];
-    m_distance[i] = Distance(m_x[i], m_x[m_centers[0]]);
-    distSum += m_distance[i];
-    }
+      int first = b * KMEANS_BLOCK_SIZE;
+      f((int) b, first, std::min(m_dataSize, first + KMEANS_BLOCK_SIZE));
+    }, nullptr);
+  };
+  std::vector<double> block_dist_sum(n_blocks);
+  std::vector<int> block_counter(n_blocks * m_numOfClusters);
+
+  parallel_for_blocks([&](int b, int first, int last)
+  {
+    double sum = 0;
+    for (int i = first; i < last; i++)
+      {
+      m_xCenter[i] = m_centers[0];
+      m_distance[i] = Distance(m_x[i], m_x[m_centers[0]]);
+      sum += m_distance[i];
+      }
+    block_dist_sum[b] = sum;
+  });
+  double distSum = 0;
+  for (int b = 0; b < n_blocks; b++)
+    distSum += block_dist_sum[b];
   m_xCounter[0] = m_dataSize;
 
   double probDist = 0;
@@ -72,54 +101,81 @@ void KMeansPlusPlus::Initialize(void)
 
     m_centers[i] = idx;
 
-    distSum = 0;
-    for (int j = 0; j < m_dataSize; j++)
-      {
-      if (m_distance[j] > Distance(m_x[j], m_x[m_centers[i]]))
+    // Reassign the samples that are closer to the new center
+    std::fill(block_counter.begin(), block_counter.end(), 0);
+    parallel_for_blocks([&](int b, int first, int last)
+    {
+      int *counter = block_counter.data() + b * m_numOfClusters;
+      double sum = 0;
+      for (int j = first; j < last; j++)
         {
-        ++m_xCounter[i];
-        for (int k = 0; k < i; k++)
+        double dist = Distance(m_x[j], m_x[m_centers[i]]);
+        if (m_distance[j] > dist)
           {
-          if (m_centers[k] == m_xCenter[j])
+          ++counter[i];
+          for (int k = 0; k < i; k++)
             {
-            --m_xCounter[k];
-            break;
+            if (m_centers[k] == m_xCenter[j])
+              {
+              --counter[k];
+              break;
+              }
             }
+          m_distance[j] = dist;
+          m_xCenter[j] = m_centers[i];
           }
-        m_distance[j] = Distance(m_x[j], m_x[m_centers[i]]);
-        m_xCenter[j] = m_centers[i];
+        sum += m_distance[j];
         }
-      distSum += m_distance[j];
-      }
-    }
+      block_dist_sum[b] = sum;
+    });
 
-  Gaussian::VectorType tmpMean(m_dataDim, 0.0);
-  for (int i = 0; i < m_numOfClusters; i++)
-    {
-    m_gmm->SetMean(i, tmpMean);
+    distSum = 0;
+    for (int b = 0; b < n_blocks; b++)
+      {
+      distSum += block_dist_sum[b];
+      for (int k = 0; k <= i; k++)
+        m_xCounter[k] += block_counter[b * m_numOfClusters + k];
+      }
     }
 
-  for (int i = 0; i < m_dataSize; i++)
-    {
-    for (int j = 0; j < m_numOfClusters; j++)
+  // Find the cluster of each sample, i.e., the first cluster whose center
+  // is the center the sample has been assigned to
+  std::vector<int> cluster(m_dataSize);
+  parallel_for_blocks([&](int b, int first, int last)
+  {
+    for (int i = first; i < last; i++)
       {
-      if (m_xCenter[i] == m_centers[j])
+      cluster[i] = -1;
+      for (int j = 0; j < m_numOfClusters; j++)
         {
-        tmpMean = m_gmm->GetMean(j);
-        for (int k = 0; k < m_dataDim; k++)
+        if (m_xCenter[i] == m_centers[j])
           {
-          tmpMean[k] = tmpMean[k] + m_x[i][k];
+          cluster[i] = j;
+          break;
           }
-        m_gmm->SetMean(j, tmpMean);
-        break;
         }
       }
-    }
-  // m_gmm->PrintParameters();
-  // getchar();
+  });
+
+  // Compute the cluster means
+  int nd = m_dataDim;
+  std::vector<double> block_mean_sum(n_blocks * m_numOfClusters * nd, 0.0);
+  parallel_for_blocks([&](int b, int first, int last)
+  {
+    double *msum = block_mean_sum.data() + b * m_numOfClusters * nd;
+    for (int i = first; i < last; i++)
+      if (cluster[i] >= 0)
+        for (int k = 0; k < nd; k++)
+          msum[cluster[i] * nd + k] += m_x[i][k];
+  });
+
+  Gaussian::VectorType tmpMean(m_dataDim, 0.0);
   for (int i = 0; i < m_numOfClusters; i++)
     {
-    tmpMean = m_gmm->GetMean(i);
+    tmpMean.fill(0.0);
+    for (int b = 0; b < n_blocks; b++)
+      for (int k = 0; k < nd; k++)
+        tmpMean[k] += block_mean_sum[(b * m_numOfClusters + i) * nd + k];
 
     if(m_xCounter[i] > 0)
       {
@@ -135,25 +191,30 @@ void KMeansPlusPlus::Initialize(void)
     m_gmm->SetMean(i, tmpMean);
     }
 
-  double *radius = new double[m_numOfClusters];
-  for (int i = 0; i < m_numOfClusters; i++)
-    {
-    radius[i] = 0;
-    }
-  for (int i = 0; i < m_dataSize; i++)
-    {
-    for (int j = 0; j < m_numOfClusters; j++)
+  // Compute the cluster radii
+  std::vector<double> block_radius(n_blocks * m_numOfClusters, 0.0);
+  parallel_for_blocks([&](int b, int first, int last)
+  {
+    double *r = block_radius.data() + b * m_numOfClusters;
+    for (int i = first; i < last; i++)
       {
-      if (m_xCenter[i] == m_centers[j])
+      if (cluster[i] >= 0)
         {
-        double dist = Distance(m_x[i], m_gmm->GetMean(j).data_block());
-        if (radius[j] < dist)
+        double dist = Distance(m_x[i], m_gmm->GetMean(cluster[i]).data_block());
+        if (r[cluster[i]] < dist)
           {
-          radius[j] = dist;
+          r[cluster[i]] = dist;
           }
-        break;
         }
       }
+  });
+
+  double *radius = new double[m_numOfClusters];
+  for (int i = 0; i < m_numOfClusters; i++)
+    {
+    radius[i] = 0;
+    for (int b = 0; b < n_blocks; b++)
+      radius[i] = std::max(radius[i], block_radius[b * m_numOfClusters + i]);
     }
 
   Gaussian::MatrixType tmpcovar(m_dataDim, m_dataDim, 0);
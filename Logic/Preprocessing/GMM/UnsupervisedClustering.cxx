@@ -7,33 +7,32 @@
 #include "ImageWrapperTraits.h"
 
 #include <algorithm>
+#include <random>
 
 UnsupervisedClustering::UnsupervisedClustering()
 {
   m_ClusteringEM = NULL;
+  m_ClusteringInitializer = NULL;
+  m_DataSource = NULL;
+  m_MixtureModel = NULL;
   m_NumberOfClusters = 3;
-  m_DataArray = NULL;
+  m_NumberOfComponents = 0;
+  m_NumberOfVoxels = 0;
   m_NumberOfSamples = 0;
+  m_MiniBatchSize = 0;
+  m_NextBatch = 0;
+  m_SamplesDirty = true;
+  m_SampledTimePoint = 0;
+  m_DataArray = NULL;
+  m_DataBuffer = NULL;
 }
 
 UnsupervisedClustering::~UnsupervisedClustering()
 {
-  if(m_ClusteringEM)
-    {
-    delete m_ClusteringEM;
-    delete m_ClusteringInitializer;
-    }
-
-  if(m_DataArray)
-    {
-    // Delete the main data buffer
-    delete m_DataArray[0];
-
-    // Delete the pointers into the buffer
-    delete m_DataArray;
-    }
-
-
+  delete m_ClusteringEM;
+  delete m_ClusteringInitializer;
+  delete[] m_DataBuffer;
+  delete[] m_DataArray;
 }
 
 
@@ -55,18 +54,10 @@ void UnsupervisedClustering::SetMixtureModel(GaussianMixtureModel *model)
   m_MixtureModel = m_ClusteringEM->GetGaussianMixtureModel();
 }
 
-#include "itkImageRandomConstIteratorWithIndex.hxx"
-
 void UnsupervisedClustering::SampleDataSource()
 {
-  if(m_DataArray)
-    {
-    // Delete the main data buffer
-    delete m_DataArray[0];
-
-    // Delete the pointers into the buffer
-    delete m_DataArray;
-    }
+  delete[] m_DataBuffer;
+  delete[] m_DataArray;
 
   // Figure out the number of data components
   unsigned int nComp = 0;
@@ -79,63 +70,81 @@ void UnsupervisedClustering::SampleDataSource()
 
   // Size the data array
   int nvox = m_DataSource->GetMain()->GetNumberOfVoxels();
-  int nsam = (m_NumberOfSamples == 0) ? nvox : m_NumberOfSamples;
+  int nsam = (m_NumberOfSamples == 0 || m_NumberOfSamples > nvox) ? nvox : m_NumberOfSamples;
 
   // Create data structure for the EM code
   m_DataArray = new double *[nsam];
-  double *buffer = new double[nsam * nComp];
-  for(int i = 0; i < nsam; i++, buffer+=nComp)
-    m_DataArray[i] = buffer;
+  m_DataBuffer = new double[(size_t) nsam * nComp];
 
-  // Create a random walk through the speed image, which should be initialized
-  // at this point. We iterate over the speed image because we can easily access
-  // its internal image (it's always a scalar image)
+  // We sample over the speed image, which should be initialized at this
+  // point, because we can easily access its internal image (it's always a
+  // scalar image)
   assert(m_DataSource->IsSpeedLoaded());
   typedef SpeedImageWrapper::ImageType SpeedImage;
-
   const SpeedImage *speed = m_DataSource->GetSpeed()->GetImage();
-  typedef itk::ImageRandomConstIteratorWithIndex<SpeedImage> RandomIter;
-  RandomIter itRand(speed, speed->GetBufferedRegion());
-  itRand.SetNumberOfSamples(nsam);
 
-  // Initialize the 'central' samples list
-  m_CenterSamples.clear();
-  m_CenterSamples.reserve(400);
-
-  // Define the center region
-  itk::ImageRegion<3> rcenter = speed->GetBufferedRegion();
-  rcenter.ShrinkByRadius(to_itkSize(Vector3d(rcenter.GetSize()) * 0.2));
-
-  // Do the random walk
-  int pVoxel = 0;
-  for(; !itRand.IsAtEnd(); ++itRand)
+  // Stratified sampling: the voxels, in raster order, are split into nsam
+  // strata of equal size and one voxel is drawn from each. This covers the
+  // image more evenly than independent draws, never picks a voxel twice, and
+  // visits the voxels in increasing order, so that only the sampled voxels
+  // are read. The seed is fixed so that the clustering is reproducible.
+  std::mt19937 rng(12345);
+  double stratum = nvox * 1.0 / nsam;
+  std::vector<itk::OffsetValueType> offsets(nsam);
+  for(int i = 0; i < nsam; i++)
     {
-    // Go to the next sample location
-    itk::Index<3> idx = itRand.GetIndex();
+    itk::OffsetValueType first = (itk::OffsetValueType) (i * stratum);
+    itk::OffsetValueType last = std::max(first + 1, (itk::OffsetValueType) ((i + 1) * stratum));
+    offsets[i] = std::uniform_int_distribution<itk::OffsetValueType>(first, last - 1)(rng);
+    }
 
-    // TODO: this is a really slow way to collect samples!
-    int iOffset = 0;
-    for(LayerIterator lit = m_DataSource->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
-        !lit.IsAtEnd(); ++lit)
+  // The samples are stored in random order, so that the EM code can take
+  // consecutive samples as a random batch
+  std::vector<int> rows(nsam);
+  for(int i = 0; i < nsam; i++)
+    rows[i] = i;
+  std::shuffle(rows.begin(), rows.end(), rng);
+  for(int i = 0; i < nsam; i++)
+    m_DataArray[rows[i]] = m_DataBuffer + (size_t) i * nComp;
+
+  // Read the samples, one layer at a time
+  std::vector<itk::Index<3> > index(nsam);
+  for(int i = 0; i < nsam; i++)
+    index[i] = speed->ComputeIndex(offsets[i]);
+
+  int iOffset = 0;
+  for(LayerIterator lit = m_DataSource->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
+      !lit.IsAtEnd(); ++lit)
+    {
+    ImageWrapperBase *iw = lit.GetLayer();
+    unsigned int nc = iw->GetNumberOfComponents(), tp = iw->GetTimePointIndex();
+    vnl_vector<double> svec(nc);
+    for(int i = 0; i < nsam; i++)
       {
-      ImageWrapperBase *iw = lit.GetLayer();
-      vnl_vector<double> svec(m_DataArray[pVoxel] + iOffset, iw->GetNumberOfComponents());
-      iw->SampleIntensityAtReferenceIndex(idx, iw->GetTimePointIndex(), false, svec);
-      iOffset += iw->GetNumberOfComponents();
+      iw->SampleIntensityAtReferenceIndex(index[i], tp, false, svec);
+      std::copy(svec.begin(), svec.end(), m_DataBuffer + (size_t) i * nComp + iOffset);
       }
+    iOffset += nc;
+    }
 
-    // Store as a 'central' sample if in the central 60% of the image
-    if(m_CenterSamples.size() < 400 && rcenter.IsInside(idx))
-      {
-      m_CenterSamples.push_back(pVoxel);
-      }
+  // Collect up to 400 samples in the central 60% of the image. The samples
+  // are taken in their random order, so they are spread over that region
+  m_CenterSamples.clear();
+  m_CenterSamples.reserve(400);
 
-    pVoxel++;
-    }
+  itk::ImageRegion<3> rcenter = speed->GetBufferedRegion();
+  rcenter.ShrinkByRadius(to_itkSize(Vector3d(rcenter.GetSize()) * 0.2));
 
-  m_NumberOfVoxels = nsam;
+  std::vector<int> sample_of_row(nsam);
+  for(int i = 0; i < nsam; i++)
+    sample_of_row[rows[i]] = i;
+  for(int r = 0; r < nsam && m_CenterSamples.size() < 400; r++)
+    if(rcenter.IsInside(index[sample_of_row[r]]))
+      m_CenterSamples.push_back(r);
 
+  m_NumberOfVoxels = nsam;
   m_NumberOfComponents = nComp;
+  m_SampledTimePoint = m_DataSource->GetMain()->GetTimePointIndex();
   m_SamplesDirty = false;
 }
 
@@ -156,6 +165,11 @@ void UnsupervisedClustering::SetNumberOfSamples(int nSamples)
     }
 }
 
+void UnsupervisedClustering::SetMiniBatchSize(int size)
+{
+  m_MiniBatchSize = std::max(0, size);
+}
+
 void UnsupervisedClustering::InitializeClusters()
 {
   this->InitializeEM();
@@ -167,14 +181,13 @@ void UnsupervisedClustering::InitializeEM()
   assert(m_DataSource);
 
   // Make sure samples exist
-  if(m_SamplesDirty || m_DataArray == NULL)
+  if(m_SamplesDirty || m_DataArray == NULL
+     || m_SampledTimePoint != m_DataSource->GetMain()->GetTimePointIndex())
     this->SampleDataSource();
 
-  if(m_ClusteringEM)
-    {
-    delete m_ClusteringEM;
-    delete m_ClusteringInitializer;
-    }
+  delete m_ClusteringEM;
+  delete m_ClusteringInitializer;
+  m_NextBatch = 0;
 
   // Allocate the EM algorithm
   m_ClusteringEM = new EMGaussianMixtures(
@@ -254,7 +267,19 @@ void UnsupervisedClustering::SortClustersByRelevance()
 
 void UnsupervisedClustering::Iterate()
 {
-  m_ClusteringEM->UpdateOnce();
+  int n = m_MiniBatchSize;
+  if(n > 0 && n < m_NumberOfVoxels)
+    {
+    // Visit the (shuffled) samples one batch after the other
+    if(m_NextBatch + n > m_NumberOfVoxels)
+      m_NextBatch = 0;
+    m_ClusteringEM->UpdateOnceOnBatch(m_NextBatch, n);
+    m_NextBatch += n;
+    }
+  else
+    {
+    m_ClusteringEM->UpdateOnce();
+    }
   m_MixtureModel->PrintParameters();
 }
 
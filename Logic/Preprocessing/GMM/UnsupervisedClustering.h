@@ -30,6 +30,18 @@ public:
 
   void SetNumberOfSamples(int nSamples);
 
+  /**
+   * Number of samples used by each iteration. When it is smaller than the
+   * number of samples, each iteration is a step of online EM on the next
+   * batch of samples, which is cheaper than a full iteration. Zero (the
+   * default) makes every iteration visit all of the samples.
+   */
+  irisGetMacro(MiniBatchSize, int)
+  void SetMiniBatchSize(int size);
+
+  /** Default batch size, used when the mini-batch mode is enabled in the GUI */
+  static constexpr int DEFAULT_MINI_BATCH_SIZE = 2048;
+
   void InitializeClusters();
 
   void Iterate();
@@ -52,10 +64,20 @@ protected:
 
   int m_NumberOfClusters, m_NumberOfComponents, m_NumberOfVoxels, m_NumberOfSamples;
 
+  // The batch size, and the first sample of the next batch
+  int m_MiniBatchSize, m_NextBatch;
+
   bool m_SamplesDirty;
 
-  // TODO: probably double is larger than we need
+  // The time point that the samples were drawn from. The samples are kept
+  // across changes to the number of clusters and re-initializations, and
+  // only drawn again when the data or the sampling parameters change
+  unsigned int m_SampledTimePoint;
+
+  // Pointers to the samples, in random order, so that any run of consecutive
+  // samples is a random batch. TODO: probably double is larger than we need
   double **m_DataArray;
+  double *m_DataBuffer;
 
   // A set of samples located near the center of the image, used to sort
   // initial clusters in terms of relevance to the user
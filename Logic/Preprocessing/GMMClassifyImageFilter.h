@@ -50,6 +50,7 @@ public:
 
   /** Set the mixture model */
   void SetMixtureModel(GaussianMixtureModel *model);
+  itkGetMacro(MixtureModel, GaussianMixtureModel *)
 
   /** We need to override this method because of multiple input types */
   void GenerateInputRequestedRegion() ITK_OVERRIDE;
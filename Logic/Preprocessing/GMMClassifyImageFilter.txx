@@ -3,8 +3,10 @@
 
 #include "GMMClassifyImageFilter.h"
 #include "itkImageRegionConstIterator.h"
+#include "itkImageScanlineIterator.h"
 #include "EMGaussianMixtures.h"
 #include "ImageCollectionConstIteratorWithIndex.h"
+#include "ScratchArena.h"
 
 template <class TInputImage, class TInputVectorImage, class TOutputImage>
 GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
@@ -113,6 +115,85 @@ GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
     w[i] = m_MixtureModel->GetWeight(i);
     }
 
+  // In the common case of scalar and vector float images, the feature
+  // vectors of a whole scanline are gathered from the input buffers into a
+  // structure-of-arrays block, and each Gaussian evaluates the block at once
+  std::vector<const InputImageType *> scalar_inputs;
+  std::vector<const InputVectorImageType *> vector_inputs;
+  bool fast_path = true;
+  for( itk::InputDataObjectIterator it( this ); !it.IsAtEnd(); it++ )
+    {
+    const InputImageType *input = dynamic_cast< const InputImageType * >( it.GetInput() );
+    const InputVectorImageType *vecInput = dynamic_cast< const InputVectorImageType * >( it.GetInput() );
+    scalar_inputs.push_back(input);
+    vector_inputs.push_back(vecInput);
+    if(!input && !vecInput)
+      fast_path = false;
+    }
+
+  if(fast_path)
+    {
+    int nGauss = m_MixtureModel->GetNumberOfGaussians();
+    int nComp = m_MixtureModel->GetNumberOfComponents();
+    int line_len = outputRegionForThread.GetSize(0);
+    ScratchBuffer<double> x_block(nComp * line_len), scratch(line_len);
+    ScratchBuffer<double> log_pdf_block(nGauss * line_len), log_pdf_k(nGauss);
+
+    itk::ImageScanlineIterator<TOutputImage> it_line(outputPtr, outputRegionForThread);
+    for(; !it_line.IsAtEnd(); it_line.NextLine())
+      {
+      // Gather the components of all inputs for this line
+      const auto &idx = it_line.GetIndex();
+      double *xd = x_block.data();
+      for(unsigned int i = 0; i < scalar_inputs.size(); i++)
+        {
+        if(scalar_inputs[i])
+          {
+          const auto *src = scalar_inputs[i]->GetBufferPointer()
+                            + scalar_inputs[i]->ComputeOffset(idx);
+          for(int j = 0; j < line_len; j++)
+            xd[j] = src[j];
+          xd += line_len;
+          }
+        else
+          {
+          const InputVectorImageType *vin = vector_inputs[i];
+          int nc = vin->GetNumberOfComponentsPerPixel();
+          const auto *src = vin->GetBufferPointer() + vin->ComputeOffset(idx) * nc;
+          for(int c = 0; c < nc; c++, xd += line_len)
+            for(int j = 0; j < line_len; j++)
+              xd[j] = src[j * nc + c];
+          }
+        }
+
+      // Evaluate each Gaussian for the whole line
+      for(int k = 0; k < nGauss; k++)
+        {
+        m_MixtureModel->GetGaussian(k)->EvaluateLogPDF(
+              x_block.data(), line_len, line_len,
+              log_pdf_block.data() + k * line_len, scratch.data());
+        }
+
+      // Evaluate the posterior probability robustly
+      for(int j = 0; j < line_len; j++, ++it_line)
+        {
+        for(int k = 0; k < nGauss; k++)
+          log_pdf_k[k] = log_pdf_block[k * line_len + j];
+
+        double pdiff = 0;
+        for(int k = 0; k < nGauss; k++)
+          {
+          pdiff += pfactor[k] * EMGaussianMixtures::ComputePosterior(
+                nGauss, log_pdf_k.data(), w.data_block(), log_w.data_block(), k);
+          }
+
+        it_line.Set((OutputPixelType)(pdiff * 0x7fff));
+        }
+      }
+
+    return;
+    }
+
   // Configure the input collection iterator
   itk::Size<ImageDimension> radius; radius.Fill(0);
   CollectionIter cit(radius, outputRegionForThread);
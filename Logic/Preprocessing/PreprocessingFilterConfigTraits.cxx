@@ -99,6 +99,22 @@ SmoothBinaryThresholdFilterConfigTraits
   // Parameters are associated with the layer, so there is nothing to do here
 }
 
+void
+SmoothBinaryThresholdFilterConfigTraits
+::HashParameters(SNAPImageData *sid, FilterType *filter, PreviewParameterHash &hash)
+{
+  ThresholdSettings *ts = filter->GetParameters();
+  if(ts)
+    {
+    hash.Add(ts->GetLowerThreshold());
+    hash.Add(ts->GetUpperThreshold());
+    hash.Add(ts->GetSmoothness());
+    hash.Add(ts->GetThresholdMode());
+    }
+  hash.Add(filter->GetInputImageMinimum());
+  hash.Add(filter->GetInputImageMaximum());
+}
+
 void SmoothBinaryThresholdFilterConfigTraits::SetActiveScalarLayer(
     ScalarImageWrapperBase *layer, SmoothBinaryThresholdFilterConfigTraits::FilterType *filter, int channel)
 {
@@ -154,6 +170,20 @@ EdgePreprocessingFilterConfigTraits
   filter->SetParameters(p);
 }
 
+void
+EdgePreprocessingFilterConfigTraits
+::HashParameters(SNAPImageData *sid, FilterType *filter, PreviewParameterHash &hash)
+{
+  EdgePreprocessingSettings *eps = filter->GetParameters();
+  if(eps)
+    {
+    hash.Add(eps->GetGaussianBlurScale());
+    hash.Add(eps->GetRemappingSteepness());
+    hash.Add(eps->GetRemappingExponent());
+    }
+  hash.Add(filter->GetInputImageMaximumGradientMagnitude());
+}
+
 
 
 void
@@ -202,6 +232,27 @@ GMMPreprocessingFilterConfigTraits
   filter->SetMixtureModel(p);
 }
 
+void
+GMMPreprocessingFilterConfigTraits
+::HashParameters(SNAPImageData *sid, FilterType *filter, PreviewParameterHash &hash)
+{
+  GaussianMixtureModel *gmm = filter->GetMixtureModel();
+  if(!gmm)
+    return;
+
+  hash.Add(gmm->GetNumberOfGaussians());
+  hash.Add(gmm->GetNumberOfComponents());
+  for(int i = 0; i < gmm->GetNumberOfGaussians(); i++)
+    {
+    const GaussianMixtureModel::VectorType &mean = gmm->GetMean(i);
+    const GaussianMixtureModel::MatrixType &cov = gmm->GetCovariance(i);
+    hash.AddArray(mean.data_block(), mean.size());
+    hash.AddArray(cov.data_block(), cov.size());
+    hash.Add(gmm->GetWeight(i));
+    hash.Add(gmm->IsForeground(i));
+    }
+}
+
 void
 RFPreprocessingFilterConfigTraits
 ::AttachInputs(SNAPImageData *sid, FilterType *filter, int channel)
@@ -248,6 +299,24 @@ RFPreprocessingFilterConfigTraits
   filter->SetClassifier(p);
 }
 
+void
+RFPreprocessingFilterConfigTraits
+::HashParameters(SNAPImageData *sid, FilterType *filter, PreviewParameterHash &hash)
+{
+  // The forest itself is identified by the serial number of the engine, and
+  // the settings that the user toggles between trainings are hashed
+  ParameterType *rfc = filter->GetClassifier();
+  if(!rfc)
+    return;
+
+  hash.Add(rfc);
+  hash.Add(sid->GetParent()->GetClassificationEngine()->GetClassifierSerial());
+  const ParameterType::WeightArray &wa = rfc->GetClassWeights();
+  hash.AddArray(wa.data(), wa.size());
+  hash.Add(rfc->GetBiasParameter());
+  hash.Add(rfc->GetForegroundClassLabel());
+}
+
 bool
 RFPreprocessingFilterConfigTraits
 ::IsPreviewable(FilterType *filter[])
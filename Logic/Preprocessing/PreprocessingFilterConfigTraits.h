@@ -44,6 +44,7 @@ template <class TInput, class TInputVector, class TOutput, class TLabel> class R
 
 class ThresholdSettings;
 class EdgePreprocessingSettings;
+class PreviewParameterHash;
 class GaussianMixtureModel;
 template <class TPixel, class TLabel, int VDim> class RandomForestClassifier;
 
@@ -93,6 +94,7 @@ public:
   static void AttachInputs(SNAPImageData *sid, FilterType *filter, int channel);
   static void DetachInputs(SNAPImageData *sid, FilterType *filter);
   static void SetParameters(ParameterType *p, FilterType *filter, int channel);
+  static void HashParameters(SNAPImageData *sid, FilterType *filter, PreviewParameterHash &hash);
   static bool GetDefaultPreviewMode() { return true; }
 
   // This filter always has preview ready
@@ -121,6 +123,7 @@ public:
   static void AttachInputs(SNAPImageData *sid, FilterType *filter, int channel);
   static void DetachInputs(SNAPImageData *sid, FilterType *filter);
   static void SetParameters(ParameterType *p, FilterType *filter, int channel);
+  static void HashParameters(SNAPImageData *sid, FilterType *filter, PreviewParameterHash &hash);
   static bool GetDefaultPreviewMode() { return true; }
 
   // This filter always has preview ready
@@ -151,6 +154,7 @@ public:
   static void AttachInputs(SNAPImageData *sid, FilterType *filter, int channel);
   static void DetachInputs(SNAPImageData *sid, FilterType *filter);
   static void SetParameters(ParameterType *p, FilterType *filter, int channel);
+  static void HashParameters(SNAPImageData *sid, FilterType *filter, PreviewParameterHash &hash);
   static bool GetDefaultPreviewMode() { return true; }
 
   // This filter always has preview ready
@@ -183,6 +187,7 @@ public:
   static void AttachInputs(SNAPImageData *sid, FilterType *filter, int channel);
   static void DetachInputs(SNAPImageData *sid, FilterType *filter);
   static void SetParameters(ParameterType *p, FilterType *filter, int channel);
+  static void HashParameters(SNAPImageData *sid, FilterType *filter, PreviewParameterHash &hash);
   static bool GetDefaultPreviewMode() { return true; }
 
   // This filter always has preview ready
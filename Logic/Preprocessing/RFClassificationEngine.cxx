@@ -5,6 +5,15 @@
 #include "ImageWrapper.h"
 #include "ImageCollectionConstIteratorWithIndex.h"
 #include "RLEImageRegionIterator.h"
+#include "PreprocessingFilterConfigTraits.h"
+#include "RandomForestClassifyImageFilter.h"
+#include "RandomForestClassifyImageFilter.txx"
+#include <itkMultiThreaderBase.h>
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkShiftScaleImageFilter.h>
+#include <algorithm>
+#include <fstream>
 
 // Includes from the random forest library
 #include "Library/classification.h"
@@ -20,6 +29,8 @@ RFClassificationEngine<TPixel,TLabel,VDim>::RFClassificationEngine()
   m_TreeDepth = 30;
   m_PatchRadius.Fill(0);
   m_UseCoordinateFeatures = false;
+  m_MaxSamplesPerClass = 0;
+  m_ClassifierSerial = 0;
 }
 
 template <class TPixel, class TLabel, int VDim>
@@ -39,6 +50,7 @@ void RFClassificationEngine<TPixel,TLabel,VDim>::SetDataSource(SNAPImageData *im
 
     // Reset the classifier
     m_Classifier->Reset();
+    m_ClassifierSerial++;
     }
 }
 
@@ -46,6 +58,7 @@ template <class TPixel, class TLabel, int VDim>
 void RFClassificationEngine<TPixel,TLabel,VDim>::ResetClassifier()
 {
   m_Classifier->Reset();
+  m_ClassifierSerial++;
 }
 
 template <class TPixel, class TLabel, int VDim>
@@ -59,33 +72,124 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   typedef itk::Image<float, 3> FloatImage;
   typedef itk::VectorImage<float, 3> FloatVectorImage;
 
-  // TODO: in the future, we should only recompute the sample when we know
-  // that the data has changed. However, currently, we are just going to
-  // compute a new sample every time
-
-  // Delete the sample
-  if(m_Sample)
-    delete m_Sample;
-
   // Get the segmentation image - which determines the samples
   // TODO: this is defaulting to the first image - is this correct?
   LabelImageWrapper *wrpSeg = m_DataSource->GetFirstSegmentationLayer();
-  const LabelImageWrapper::ImageType *imgSeg = wrpSeg->GetImage();
-  typedef itk::ImageRegionConstIteratorWithIndex<LabelImageWrapper::ImageType> LabelIter;
+  typedef LabelImageWrapper::ImageType LabelImageType;
+  const LabelImageType *imgSeg = wrpSeg->GetImage();
 
   // Shrink the buffered region by radius because we can't handle BCs
   itk::ImageRegion<3> reg = imgSeg->GetBufferedRegion();
   reg.ShrinkByRadius(m_PatchRadius);
 
+  // The labeled voxels are found by scanning the run-length lines of the
+  // segmentation in parallel. This visits the labeled voxels of a line that
+  // fall inside the region, in order of increasing x.
+  long x_begin = reg.GetIndex(0), x_end = reg.GetIndex(0) + (long) reg.GetSize(0);
+  long x_line = imgSeg->GetBufferedRegion().GetIndex(0);
+  auto for_each_labeled_voxel = [x_begin, x_end, x_line](
+      const LabelImageType::RLLine &line, auto callback)
+  {
+    long x = x_line;
+    for(auto &seg : line)
+      {
+      long x_next = x + seg.first;
+      if(seg.second)
+        for(long xi = std::max(x, x_begin); xi < std::min(x_next, x_end); xi++)
+          callback(xi, seg.second);
+      x = x_next;
+      }
+  };
+
+  // Each line of the region gets an entry in this array, which after the
+  // first pass holds the number of samples in the line, and is then turned
+  // into the position of the line's first sample
+  auto line_id = [&reg](const LabelImageType::IndexType &idx)
+  {
+    return (idx[1] - reg.GetIndex(1)) + (idx[2] - reg.GetIndex(2)) * reg.GetSize(1);
+  };
+  std::vector<unsigned long> line_offset(reg.GetSize(1) * reg.GetSize(2) + 1, 0);
+
   // We need to iterate throught the label image once to determine the
   // number of samples to allocate.
-  unsigned long nSamples = 0;
-  for(LabelIter lit(imgSeg, reg); !lit.IsAtEnd(); ++lit)
-    if(lit.Value())
-      nSamples++;
+  imgSeg->ParallelForEachLine(
+        reg, [&](LabelImageType::RLLine &line, const LabelImageType::IndexType &idx)
+  {
+    unsigned long n = 0;
+    for_each_labeled_voxel(line, [&n](long, LabelType) { n++; });
+    line_offset[line_id(idx) + 1] = n;
+  });
+
+  for(unsigned int i = 1; i < line_offset.size(); i++)
+    line_offset[i] += line_offset[i-1];
+
+  // Collect the labeled voxels, ordered by line, as though the region were
+  // traversed by a region iterator
+  struct LabeledVoxel
+  {
+    LabelImageType::IndexType index;
+    LabelType label;
+  };
+  std::vector<LabeledVoxel> voxels(line_offset.back());
+  imgSeg->ParallelForEachLine(
+        reg, [&](LabelImageType::RLLine &line, const LabelImageType::IndexType &line_idx)
+  {
+    unsigned long iSample = line_offset[line_id(line_idx)];
+    for_each_labeled_voxel(line, [&](long x, LabelType label)
+    {
+      LabeledVoxel &v = voxels[iSample++];
+      v.index = line_idx;
+      v.index[0] = x;
+      v.label = label;
+    });
+  });
+
+  // Voxels are identified by their offset in the segmentation image
+  const itk::ImageRegion<3> &reg_seg = imgSeg->GetBufferedRegion();
+  auto voxel_key = [&reg_seg](const LabelImageType::IndexType &idx)
+  {
+    return (unsigned long) (idx[0] - reg_seg.GetIndex(0))
+        + reg_seg.GetSize(0) * ((idx[1] - reg_seg.GetIndex(1))
+        + reg_seg.GetSize(1) * (idx[2] - reg_seg.GetIndex(2)));
+  };
+
+  // Optionally keep only a subset of the voxels of the larger classes. The
+  // voxels with the smallest hash of their offset are kept, which is a uniform
+  // sample that changes little as voxels are painted or erased, so that most
+  // of the retained samples can be taken from the cache below
+  if(m_MaxSamplesPerClass > 0)
+    {
+    auto voxel_hash = [&voxel_key](const LabeledVoxel &v)
+    {
+      unsigned long long z = voxel_key(v.index) + 0x9e3779b97f4a7c15ull;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      return z ^ (z >> 31);
+    };
+
+    std::map<LabelType, std::vector<unsigned long long> > class_hashes;
+    for(auto &v : voxels)
+      class_hashes[v.label].push_back(voxel_hash(v));
+
+    std::map<LabelType, unsigned long long> class_threshold;
+    for(auto &it : class_hashes)
+      {
+      std::vector<unsigned long long> &h = it.second;
+      if(h.size() > m_MaxSamplesPerClass)
+        {
+        std::nth_element(h.begin(), h.begin() + m_MaxSamplesPerClass - 1, h.end());
+        class_threshold[it.first] = h[m_MaxSamplesPerClass - 1];
+        }
+      }
 
-  // TODO: if the number of samples is greater than max number of training samples,
-  // we should choose a random subset of samples.
+    voxels.erase(std::remove_if(voxels.begin(), voxels.end(), [&](const LabeledVoxel &v)
+    {
+      auto it = class_threshold.find(v.label);
+      return it != class_threshold.end() && voxel_hash(v) > it->second;
+    }), voxels.end());
+    }
+
+  unsigned long nSamples = voxels.size();
 
   // Compute the patch size
   int patch_size = 1;
@@ -126,51 +230,93 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   // Allocate the patches
   int nColumns = m_UseCoordinateFeatures ? total_comp + 3 : total_comp;
 
+  // The features of a voxel only depend on the layers and on the patch
+  // settings. If these have not changed since the last training, the features
+  // of the voxels that were sampled then are copied from the old sample, and
+  // only the newly labeled voxels are sampled from the images
+  std::vector<unsigned long> cache_key;
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    cache_key.push_back(m_PatchRadius[d]);
+    cache_key.push_back(reg_seg.GetIndex(d));
+    cache_key.push_back(reg_seg.GetSize(d));
+    }
+  cache_key.push_back(m_UseCoordinateFeatures);
+  for(auto &sd : sample_data)
+    {
+    cache_key.push_back(sd.layer->GetUniqueId());
+    cache_key.push_back(sd.layer->GetImageBase()->GetMTime());
+    }
+
+  SampleType *old_sample = (m_Sample && cache_key == m_SampleCacheKey) ? m_Sample : NULL;
+
   // Create a new sample
-  m_Sample = new SampleType(nSamples, nColumns);
+  SampleType *sample = new SampleType(nSamples, nColumns);
 
-  // Allocate the sample storage and matrices that point to its storage
-  vnl_vector<double> current_sample(total_comp);
+  // Now fill out the samples in parallel blocks
+  const unsigned long block_size = 4096;
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, (nSamples + block_size - 1) / block_size, [&](itk::SizeValueType b)
+  {
+    // Each block needs its own patch buffer
+    std::vector<double> patch(total_comp);
 
-  // Now fill out the samples
-  int iSample = 0;
-  for(LabelIter lit(imgSeg, reg); !lit.IsAtEnd(); ++lit)
-    {
-    LabelType label = lit.Value();
-    if(label)
+    unsigned long first = (unsigned long) b * block_size;
+    unsigned long last = std::min(nSamples, first + block_size);
+    for(unsigned long iSample = first; iSample < last; iSample++)
       {
-      // Fill in the data
-      auto &column = m_Sample->data[iSample];
+      const LabelImageType::IndexType &idx = voxels[iSample].index;
+      auto &column = sample->data[iSample];
+
+      // Fill in the label
+      sample->label[iSample] = voxels[iSample].label;
+
+      // Copy the features from the old sample if the voxel was sampled before
+      if(old_sample)
+        {
+        auto itCached = m_SampleIndex.find(voxel_key(idx));
+        if(itCached != m_SampleIndex.end())
+          {
+          auto &old_column = old_sample->data[itCached->second];
+          for(int k = 0; k < nColumns; k++)
+            column[k] = old_column[k];
+          continue;
+          }
+        }
 
       // Sample from each image
       int k = 0;
       for(auto &sd : sample_data)
         {
         // Sample this patch
-        double *p = sd.sample_matrix.data_block();
-        sd.layer->SamplePatchAsDouble(lit.GetIndex(), sd.offset_table, p);
+        double *p = patch.data();
+        sd.layer->SamplePatchAsDouble(idx, sd.offset_table, p);
 
-        // This in-place transpose operation is required because the RF classes expect the
-        // sample to be ordered first by component and then by patch location, but the
+        // Copy data to actual sample. The RF classes expect the sample to be
+        // ordered first by component and then by patch location, but the
         // SamplePatchAsDouble samples first by patch location, then by component
-        if(sd.sample_matrix.rows() > 1)
-          sd.sample_matrix.inplace_transpose();
-
-        // Copy data to actual sample
-        for(unsigned int i = 0; i < sd.n_comp; i++)
-          column[k++] = (float) p[i];
+        unsigned int n_loc = sd.sample_matrix.rows(), n_cmp = sd.sample_matrix.cols();
+        for(unsigned int c = 0; c < n_cmp; c++)
+          for(unsigned int i = 0; i < n_loc; i++)
+            column[k++] = (float) p[i * n_cmp + c];
         }
 
       // Add the coordinate features if used
       if(m_UseCoordinateFeatures)
         for(int d = 0; d < 3; d++)
-          column[k++] = lit.GetIndex()[d];
-
-      // Fill in the label
-      m_Sample->label[iSample] = label;
-      ++iSample;
+          column[k++] = idx[d];
       }
-    }
+  }, nullptr);
+
+  // Replace the cached sample with the new one
+  if(m_Sample)
+    delete m_Sample;
+  m_Sample = sample;
+  m_SampleCacheKey = cache_key;
+  m_SampleIndex.clear();
+  m_SampleIndex.reserve(nSamples);
+  for(unsigned long iSample = 0; iSample < nSamples; iSample++)
+    m_SampleIndex[voxel_key(voxels[iSample].index)] = iSample;
 
   // Check that the sample has at least two distinct labels
   bool isValidSample = false;
@@ -226,8 +372,14 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
 
   // Prepare the classifier
   m_Classifier->Reset();
+  m_ClassifierSerial++;
 
   // Perform classifier training
+  // TODO: the random forest library builds the trees one after another, and
+  // RandomForestClassifyImageFilter evaluates the forest one voxel at a time
+  // on its pointer-based trees. Training the trees in parallel, and
+  // classifying scanlines in batches on a flattened copy of the trees, need
+  // changes to that library (Submodules/c3d/itkextras/RandomForest)
   classification.Learning(
         params, *m_Sample,
         *m_Classifier->GetForest(),
@@ -266,12 +418,6 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   // training is repeated
   m_Classifier->SetPatchRadius(m_PatchRadius);
   m_Classifier->SetUseCoordinateFeatures(m_UseCoordinateFeatures);
-
-  // TODO: get rid of this!
-  // Dump the classifier to a file
-  std::ofstream out_file("/tmp/debug.rf");
-  m_Classifier->Write(out_file);
-  out_file.close();
 }
 
 template <class TPixel, class TLabel, int VDim>
@@ -279,6 +425,7 @@ void RFClassificationEngine<TPixel,TLabel,VDim>::SetClassifier(ClassifierType *r
 {
   // Set the classifier
   m_Classifier = rf;
+  m_ClassifierSerial++;
 
   // Update the forest size
   m_ForestSize = m_Classifier->GetForest()->GetForestSize();
@@ -298,5 +445,143 @@ int RFClassificationEngine<TPixel,TLabel,VDim>::GetNumberOfComponents() const
   return ncomp;
 }
 
+// First line of classifier files, followed by the format version
+static const char *CLASSIFIER_FILE_MAGIC = "ITK-SNAP Random Forest Classifier";
+
+template <class TPixel, class TLabel, int VDim>
+void RFClassificationEngine<TPixel,TLabel,VDim>
+::WriteClassifier(const ClassifierType *rf, int n_components, const char *filename)
+{
+  if(!rf || !rf->IsValidClassifier())
+    throw IRISException("The classifier has not been trained");
+
+  std::ofstream out(filename, std::ios::binary);
+  if(!out.good())
+    throw IRISException("Can not open classifier file %s for writing", filename);
+
+  out << CLASSIFIER_FILE_MAGIC << std::endl;
+  out << "Version 1" << std::endl;
+  out << "Components " << n_components << std::endl;
+  rf->Write(out);
+
+  if(!out.good())
+    throw IRISException("Error writing classifier file %s", filename);
+}
+
+template <class TPixel, class TLabel, int VDim>
+SmartPtr<typename RFClassificationEngine<TPixel,TLabel,VDim>::ClassifierType>
+RFClassificationEngine<TPixel,TLabel,VDim>
+::ReadClassifier(const char *filename, int &n_components)
+{
+  std::ifstream in(filename, std::ios::binary);
+  if(!in.good())
+    throw IRISException("Can not open classifier file %s for reading", filename);
+
+  std::string magic, key;
+  int version = 0;
+  std::getline(in, magic);
+  in >> key >> version;
+  if(magic != CLASSIFIER_FILE_MAGIC || key != "Version" || version != 1)
+    throw IRISException("File %s is not an ITK-SNAP classifier file", filename);
+
+  in >> key >> n_components;
+  if(key != "Components" || n_components <= 0)
+    throw IRISException("Invalid header in classifier file %s", filename);
+  in.ignore(1);
+
+  SmartPtr<ClassifierType> rf = ClassifierType::New();
+  rf->Read(in);
+
+  if(in.fail() || !rf->IsValidClassifier())
+    throw IRISException("Error reading classifier file %s", filename);
+
+  return rf;
+}
+
+template <class TPixel, class TLabel, int VDim>
+void RFClassificationEngine<TPixel,TLabel,VDim>::SaveClassifier(const char *filename) const
+{
+  WriteClassifier(m_Classifier, this->GetNumberOfComponents(), filename);
+}
+
+template <class TPixel, class TLabel, int VDim>
+void RFClassificationEngine<TPixel,TLabel,VDim>::LoadClassifier(const char *filename)
+{
+  int n_components = 0;
+  SmartPtr<ClassifierType> rf = ReadClassifier(filename, n_components);
+
+  if(m_DataSource && n_components != this->GetNumberOfComponents())
+    throw IRISException("The classifier in %s was trained on images with %d components, "
+                        "but the loaded images have %d components",
+                        filename, n_components, this->GetNumberOfComponents());
+
+  this->SetClassifier(rf);
+  m_PatchRadius = rf->GetPatchRadius();
+  m_UseCoordinateFeatures = rf->GetUseCoordinateFeatures();
+}
+
+template <class TPixel, class TLabel, int VDim>
+void RFClassificationEngine<TPixel,TLabel,VDim>
+::ApplyClassifierToImages(ClassifierType *rf, int n_components,
+                          const std::vector<std::string> &input_files,
+                          const char *output_file, unsigned int n_tiles)
+{
+  typedef RFPreprocessingFilterConfigTraits::FilterType FilterType;
+  typedef RFPreprocessingFilterConfigTraits::FloatVectorImageType FloatVectorImageType;
+  typedef RFPreprocessingFilterConfigTraits::SpeedType SpeedImageType;
+  typedef itk::Image<float, 3> OutputImageType;
+
+  if(input_files.empty())
+    throw IRISException("No images given to the classifier");
+
+  // Read the inputs in full, since the classifier samples patches around
+  // each voxel. Scalar images are read as images with one component.
+  SmartPtr<FilterType> filter = FilterType::New();
+  itk::Size<3> size;
+  int total_comp = 0;
+  for(unsigned int i = 0; i < input_files.size(); i++)
+    {
+    typedef itk::ImageFileReader<FloatVectorImageType> ReaderType;
+    SmartPtr<ReaderType> reader = ReaderType::New();
+    reader->SetFileName(input_files[i]);
+    reader->Update();
+
+    SmartPtr<FloatVectorImageType> image = reader->GetOutput();
+    image->DisconnectPipeline();
+
+    itk::Size<3> sz = image->GetLargestPossibleRegion().GetSize();
+    if(i == 0)
+      size = sz;
+    else if(sz != size)
+      throw IRISException("Image %s does not have the dimensions of the main image %s",
+                          input_files[i].c_str(), input_files[0].c_str());
+
+    total_comp += image->GetNumberOfComponentsPerPixel();
+    filter->AddVectorImage(image);
+    }
+
+  if(total_comp != n_components)
+    throw IRISException("The classifier was trained on images with %d components, "
+                        "but the given images have %d components",
+                        n_components, total_comp);
+
+  filter->SetClassifier(rf);
+
+  // Map the internal speed values to the range [-1 1]
+  typedef itk::ShiftScaleImageFilter<SpeedImageType, OutputImageType> ScaleFilter;
+  SmartPtr<ScaleFilter> scale = ScaleFilter::New();
+  scale->SetInput(filter->GetOutput());
+  scale->SetScale(1.0 / 0x7fff);
+
+  // The writer requests the output one slab at a time
+  typedef itk::ImageFileWriter<OutputImageType> WriterType;
+  SmartPtr<WriterType> writer = WriterType::New();
+  writer->SetInput(scale->GetOutput());
+  writer->SetFileName(output_file);
+  writer->SetNumberOfStreamDivisions(std::max(1u, n_tiles));
+  writer->SetUseCompression(true);
+  writer->Update();
+}
+
 // Template instantiation
 template class RFClassificationEngine<float, LabelType, 3>;
@@ -5,6 +5,9 @@
 #include <itkObjectFactory.h>
 #include "SNAPCommon.h"
 #include <itkSize.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 template <class TPixel, class TLabel, int VDim> class RandomForestClassifier;
 template <class TData, class TLabel> class MLData;
@@ -43,6 +46,13 @@ public:
   /** Access the trained classifier */
   itkGetMacro(Classifier, ClassifierType *)
 
+  /**
+   * A number that changes whenever the classifier is trained, reset or
+   * replaced, i.e., whenever its forest changes. The class weights and the
+   * bias are not included
+   */
+  itkGetMacro(ClassifierSerial, unsigned long)
+
   /** Size of the random forest (main parameter) */
   itkGetMacro(ForestSize, int)
   itkSetMacro(ForestSize, int)
@@ -59,9 +69,52 @@ public:
   itkGetMacro(UseCoordinateFeatures, bool)
   itkSetMacro(UseCoordinateFeatures, bool)
 
+  /**
+   * Maximum number of training samples taken from each class, or zero if all
+   * of the labeled voxels are used. The samples are a fixed pseudo-random
+   * subset of the voxels of the class.
+   */
+  itkGetMacro(MaxSamplesPerClass, unsigned int)
+  itkSetMacro(MaxSamplesPerClass, unsigned int)
+
   /** Get the number of components passed to the classifier */
   int GetNumberOfComponents() const;
 
+  /**
+   * Save the trained classifier to a file. The file holds the forest, the
+   * patch radius, whether coordinate features are used, and the number of
+   * components of the data the classifier was trained on.
+   */
+  void SaveClassifier(const char *filename) const;
+
+  /**
+   * Load a classifier saved by SaveClassifier() and make it the current
+   * classifier. The feature settings of the engine are set to those of the
+   * classifier. An exception is thrown if the classifier was trained on a
+   * different number of components than the data source has.
+   */
+  void LoadClassifier(const char *filename);
+
+  /** Write a classifier file, see SaveClassifier() */
+  static void WriteClassifier(const ClassifierType *rf, int n_components, const char *filename);
+
+  /** Read a classifier file, returning the number of components it expects */
+  static SmartPtr<ClassifierType> ReadClassifier(const char *filename, int &n_components);
+
+  /**
+   * Apply a classifier to images read from files, without a GUI, and write
+   * the speed image, with values between -1 and 1, to a file. The images
+   * must be given in the order of the layers the classifier was trained on,
+   * i.e., the main image and then the overlays, and share the dimensions of
+   * the main image. The speed image is computed and written in n_tiles
+   * slabs, each of which is evaluated by all threads, so that only the
+   * inputs and one slab of the output are held in memory.
+   */
+  static void ApplyClassifierToImages(ClassifierType *rf, int n_components,
+                                      const std::vector<std::string> &input_files,
+                                      const char *output_file,
+                                      unsigned int n_tiles = 16);
+
 
 protected:
 
@@ -89,10 +142,23 @@ protected:
   // Are coordinates included as features
   bool m_UseCoordinateFeatures;
 
+  // Maximum number of samples per class
+  unsigned int m_MaxSamplesPerClass;
+
+  // Incremented whenever the forest changes
+  unsigned long m_ClassifierSerial;
+
   // Cached samples used to train the classifier
   typedef MLData<float, LabelType> SampleType;
   SampleType *m_Sample;
 
+  // Position of each voxel's features in the cached sample, keyed by the
+  // offset of the voxel in the segmentation image
+  std::unordered_map<unsigned long, unsigned long> m_SampleIndex;
+
+  // Layers and settings that the cached features were computed with
+  std::vector<unsigned long> m_SampleCacheKey;
+
 };
 
 #endif // RFCLASSIFICATIONENGINE_H
@@ -4,6 +4,11 @@
 #include "SNAPCommon.h"
 #include "itkDataObject.h"
 #include "itkObjectFactory.h"
+#include "itkImageRegion.h"
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+#include <vector>
 
 class ImageWrapperBase;
 class ScalarImageWrapperBase;
@@ -17,6 +22,42 @@ namespace itk {
 
 class SNAPImageData;
 
+/**
+  FNV-1a hash of the values that determine the output of a preview filter,
+  used to recognize preview slices that were computed before. Values are
+  hashed by their bit patterns.
+  */
+class PreviewParameterHash
+{
+public:
+  void AddBytes(const void *data, size_t n)
+  {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < n; i++)
+      m_Value = (m_Value ^ bytes[i]) * 1099511628211ULL;
+  }
+
+  template <class T> void Add(const T &value)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be hashed");
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    this->AddBytes(bytes, sizeof(T));
+  }
+
+  template <class T> void AddArray(const T *values, size_t n)
+  {
+    this->Add(n);
+    for(size_t i = 0; i < n; i++)
+      this->Add(values[i]);
+  }
+
+  unsigned long long GetValue() const { return m_Value; }
+
+private:
+  unsigned long long m_Value = 14695981039346656037ULL;
+};
+
 /**
   Abstract parent class for SlicePreviewFilterWrapper. Allows us to call
   some methods in the SlicePreviewFilterWrapper without knowing what traits
@@ -41,6 +82,43 @@ public:
   /** Compute the output volume (corresponds to the 'Apply' operation) */
   virtual void ComputeOutputVolume(itk::Command *progress) = 0;
 
+  /**
+   * Compute the next tiles of the output volume ahead of time, for the current
+   * parameters, until a small time budget is used up. This is meant to be
+   * called repeatedly when the application is idle. When the parameters change, the tiles computed so far are
+   * discarded and the computation restarts. Returns true if there are more
+   * tiles left to compute.
+   */
+  virtual bool ComputeNextBackgroundTile() = 0;
+
+  /**
+   * In preview mode, the slices in view are computed progressively, a few
+   * bands at a time. If some of the slices are incomplete, mark them for
+   * update and return true, so that the caller redraws the views.
+   */
+  virtual bool ContinuePreview() = 0;
+
+  /**
+   * Apply the filter lazily instead of computing the whole volume at once.
+   * The output volume is divided into slabs that are computed when the
+   * level set needs them (ComputeOutputRegion) or when the application is
+   * idle (ComputeNextBackgroundTile). Until all slabs are done, the slice
+   * views show the preview filters, and the parameters must not change.
+   */
+  virtual void BeginDeferredOutputVolume() = 0;
+
+  /** Whether some slabs of a deferred output volume are not computed yet */
+  virtual bool IsOutputVolumePending() const = 0;
+
+  /**
+   * Whether the output volume is computed in a region. This is true outside
+   * of a deferred computation, and may be called from any thread.
+   */
+  virtual bool IsOutputRegionComputed(const itk::ImageRegion<3> &region) const = 0;
+
+  /** Compute the slabs of a deferred output volume that touch a region */
+  virtual void ComputeOutputRegion(const itk::ImageRegion<3> &region) = 0;
+
   /** Select the active scalar layer (for filters that operate on only one) */
   virtual void SetActiveScalarLayer(ScalarImageWrapperBase *layer) = 0;
 
@@ -85,6 +163,12 @@ protected:
 
         This sets the parameters of the filter
 
+    static void HashParameters(InputDataType *sid, FilterType *filter,
+                               PreviewParameterHash &hash)
+
+        This adds all the parameters that affect the output of the filter,
+        other than its input images, to the hash
+
 
   What does this filter do? It creates an assembly consisting
   of three slice preview filters, and one whole-volume filter. The four
@@ -105,6 +189,35 @@ protected:
   the parameters of the preview filters have not been changed since the last
   time the whole speed volume was generated, the preview filters are deemed
   to be up to date, and no preprocessing operations take place.
+
+  In the slice views, the preview filters only compute the part of the
+  slice in the viewport. The part is computed in bands of lines, for at
+  most PREVIEW_TIME_BUDGET per redraw, and the remaining bands are computed
+  when ContinuePreview() is called while the application is idle. Changing
+  the parameters discards the remaining bands, so slow filters (e.g., the
+  random forest classifier with large patches) respond to the next change
+  without finishing the previous preview.
+
+  The whole volume can also be computed ahead of time, one tile at a time,
+  by calling ComputeNextBackgroundTile() when the application is idle. Each
+  call computes small tiles for at most BACKGROUND_TIME_BUDGET. The
+  tiles are stored in a separate buffer, so the speed image is not touched
+  until the 'Apply' operation, which then only needs to copy the buffer if
+  all the tiles are current. The tiles are computed on the calling thread,
+  since the parameter objects (mixture model, classifier) are modified in
+  place by the GUI.
+
+  The 'Apply' operation can also be deferred, so that the level set can
+  evolve before the whole speed volume is computed. The slabs are then
+  written straight into the speed image, those under the active region of
+  the level set first and the others when the application is idle. The
+  volume filter requests the padding that it needs from its inputs, so a
+  slab holds the same values as it would in the whole volume.
+
+  Each slice view also keeps the last PREVIEW_CACHE_SLICES preview slices it
+  assembled, keyed on a hash of the parameters (see HashParameters) and of
+  the input images of the preview filter, and on the slice. Toggling between
+  settings that were previewed before shows their preview right away.
   */
 template<class TFilterConfigTraits>
 class SlicePreviewFilterWrapper : public AbstractSlicePreviewFilterWrapper
@@ -161,6 +274,36 @@ public:
   /** Compute the output volume (corresponds to the 'Apply' operation) */
   void ComputeOutputVolume(itk::Command *progress) ITK_OVERRIDE;
 
+  /** Compute the next tiles of the output volume ahead of time */
+  bool ComputeNextBackgroundTile() ITK_OVERRIDE;
+
+  /** Mark the slices whose preview is incomplete for update */
+  bool ContinuePreview() ITK_OVERRIDE;
+
+  /** Start computing the output volume slab by slab */
+  void BeginDeferredOutputVolume() ITK_OVERRIDE;
+
+  /** Whether some slabs of the output volume are not computed yet */
+  bool IsOutputVolumePending() const ITK_OVERRIDE;
+
+  /** Whether the output volume is computed in a region */
+  bool IsOutputRegionComputed(const itk::ImageRegion<3> &region) const ITK_OVERRIDE;
+
+  /** Compute the slabs of the output volume that touch a region */
+  void ComputeOutputRegion(const itk::ImageRegion<3> &region) ITK_OVERRIDE;
+
+  /** Time spent computing the preview of a slice per redraw, in seconds */
+  static constexpr double PREVIEW_TIME_BUDGET = 0.02;
+
+  /** Approximate number of voxels in each tile computed ahead of time */
+  static constexpr unsigned long BACKGROUND_TILE_VOXELS = 1ul << 17;
+
+  /** Time spent computing tiles ahead of time per idle call, in seconds */
+  static constexpr double BACKGROUND_TIME_BUDGET = 0.02;
+
+  /** Number of preview slices kept for other parameters in each view */
+  static constexpr unsigned int PREVIEW_CACHE_SLICES = 8;
+
 protected:
 
   SlicePreviewFilterWrapper();
@@ -186,6 +329,52 @@ protected:
   bool m_PreviewMode;
 
   void UpdateOutputPipelineReadyStatus();
+
+  // Set up the slicers of the output wrapper to compute the preview of the
+  // slices progressively and to cache them, or to do neither
+  void SetProgressivePreview(bool flag);
+
+  // Key of the output of a preview filter for the current parameters and
+  // inputs. Returns false if the filter cannot be previewed.
+  bool GetPreviewKey(unsigned int index, unsigned long long &key);
+
+  // The data the inputs were attached from
+  InputDataType *m_InputData;
+
+  // Pipeline time of the volume filter, once its output information is current
+  itk::ModifiedTimeType GetVolumePipelineTime();
+
+  // Discard the tiles computed ahead of time
+  void ResetBackgroundTiles();
+
+  // Divide a region into blocks of about BACKGROUND_TILE_VOXELS
+  void SplitIntoTiles(const typename OutputImageType::RegionType &region,
+                      std::vector<typename OutputImageType::RegionType> &tiles);
+
+  // Compute a slab of the deferred output volume in the output image
+  void ComputeDeferredTile(unsigned int index);
+
+  // Stop a deferred computation, keeping the slabs computed so far
+  void ResetDeferredTiles();
+
+  // Buffer holding the tiles computed ahead of time, and the tile regions
+  SmartPtr<OutputImageType> m_BackgroundImage;
+  std::vector<typename OutputImageType::RegionType> m_BackgroundTiles;
+  unsigned int m_BackgroundTileIndex;
+
+  // Pipeline time for which the tiles were computed
+  itk::ModifiedTimeType m_BackgroundPipelineTime;
+
+  // Pipeline time for which the output volume was last computed
+  itk::ModifiedTimeType m_OutputPipelineTime;
+
+  // Slabs of a deferred output volume, and which of them are done. The
+  // level set worker thread checks the slabs, under the mutex
+  std::vector<typename OutputImageType::RegionType> m_DeferredTiles;
+  std::vector<bool> m_DeferredTileDone;
+  unsigned int m_DeferredTilesLeft;
+  itk::ModifiedTimeType m_DeferredPipelineTime;
+  mutable std::mutex m_DeferredMutex;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -9,6 +9,11 @@
 #include <AdaptiveSlicingPipeline.h>
 #include <ColorMap.h>
 #include <itkTimeProbe.h>
+#include <itkImageAlgorithm.h>
+#include <itkImageBase.h>
+#include <itkImageRegionSplitterMultidimensional.h>
+#include <algorithm>
+#include <chrono>
 
 
 template <class TFilterConfigTraits>
@@ -36,6 +41,14 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
 
   // Set the output wrapper to NULL
   m_OutputWrapper = NULL;
+  m_InputData = NULL;
+
+  // Nothing has been computed ahead of time
+  m_BackgroundTileIndex = 0;
+  m_BackgroundPipelineTime = 0;
+  m_OutputPipelineTime = 0;
+  m_DeferredTilesLeft = 0;
+  m_DeferredPipelineTime = 0;
 }
 
 template <class TFilterConfigTraits>
@@ -71,6 +84,7 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
   // Get the default scalar layer for the traits. If this is NULL, the method
   // does not expect an active layer to be specified (acts on all inputs)
   m_ActiveScalarLayer = Traits::GetDefaultScalarLayer(sid);
+  m_InputData = sid;
   for(int i = 0; i < 4; i++)
     {
     Traits::AttachInputs(sid, this->GetNthFilter(i), i);
@@ -114,12 +128,16 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
       // Disconnect wrapper from this pipeline
       m_OutputWrapper->GetSlicer(i)->SetPreviewImage(NULL);
       }
+    this->SetProgressivePreview(false);
 
     // Undo the graft
     m_VolumeStreamer->GraftOutput(m_VolumeStreamer->GetOutput());
     }
 
   m_OutputWrapper = NULL;
+  m_OutputPipelineTime = 0;
+  this->ResetBackgroundTiles();
+  this->ResetDeferredTiles();
 
   for(unsigned int i = 0; i < 4; i++)
     {
@@ -128,6 +146,7 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
     }
 
   m_ActiveScalarLayer = NULL;
+  m_InputData = NULL;
 }
 
 template <class TFilterConfigTraits>
@@ -143,13 +162,68 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
       m_OutputWrapper->AttachPreviewPipeline(
             m_PreviewFilter[0], m_PreviewFilter[1], m_PreviewFilter[2]);
 
+      // Compute the preview of the slices progressively
+      this->SetProgressivePreview(true);
+
       this->UpdateOutputPipelineReadyStatus();
       }
     else
       {
       m_OutputWrapper->DetachPreviewPipeline();
+      this->SetProgressivePreview(false);
+      }
+    }
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::SetProgressivePreview(bool flag)
+{
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    auto *slicer = m_OutputWrapper->GetSlicer(i);
+    slicer->SetUpdateTimeBudget(flag ? PREVIEW_TIME_BUDGET : 0.0);
+    if(flag)
+      {
+      slicer->SetPreviewCache(
+            [this, i](unsigned long long &key) { return this->GetPreviewKey(i, key); },
+            PREVIEW_CACHE_SLICES);
+      }
+    else
+      {
+      slicer->SetPreviewCache(nullptr, 0);
+      }
+    }
+}
+
+template <class TFilterConfigTraits>
+bool
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::GetPreviewKey(unsigned int index, unsigned long long &key)
+{
+  FilterType *array[] = {m_PreviewFilter[0], m_PreviewFilter[1], m_PreviewFilter[2]};
+  if(!m_InputData || !Traits::IsPreviewable(array))
+    return false;
+
+  FilterType *filter = m_PreviewFilter[index];
+  PreviewParameterHash hash;
+  Traits::HashParameters(m_InputData, filter, hash);
+
+  // The input images are identified by their pipeline modified times, which
+  // do not change when the preview filter requests other regions of them
+  for(const auto &input : filter->GetInputs())
+    {
+    auto *image = dynamic_cast<itk::ImageBase<3> *>(input.GetPointer());
+    if(image)
+      {
+      hash.Add(image);
+      hash.Add(image->GetSource() ? image->GetPipelineMTime() : image->GetMTime());
       }
     }
+
+  key = hash.GetValue();
+  return true;
 }
 
 template <class TFilterConfigTraits>
@@ -157,34 +231,323 @@ void
 SlicePreviewFilterWrapper<TFilterConfigTraits>
 ::ComputeOutputVolume(itk::Command *progress)
 {
-  // Attach the progress monitor
-  unsigned long tag = 0;
+  // If all the tiles have been computed ahead of time for the current
+  // parameters, the output volume only needs to be copied from the buffer
+  itk::ModifiedTimeType pipeline_time = this->GetVolumePipelineTime();
+  OutputImageType *target = m_OutputWrapper->GetModifiableImage();
+  if(m_BackgroundImage
+     && m_BackgroundPipelineTime == pipeline_time
+     && m_BackgroundTileIndex == m_BackgroundTiles.size()
+     && m_BackgroundImage->GetBufferedRegion() == target->GetBufferedRegion())
+    {
+    itk::ImageAlgorithm::Copy(m_BackgroundImage.GetPointer(), target,
+                              target->GetBufferedRegion(), target->GetBufferedRegion());
+    }
+  else
+    {
+    // Attach the progress monitor
+    unsigned long tag = 0;
 
-  if(progress)
-    tag = m_VolumeStreamer->AddObserver(itk::ProgressEvent(), progress);
+    if(progress)
+      tag = m_VolumeStreamer->AddObserver(itk::ProgressEvent(), progress);
 
-  // Temporarily graft the target volume as output of the filter
-  m_VolumeStreamer->GraftOutput(m_OutputWrapper->GetModifiableImage());
+    // Temporarily graft the target volume as output of the filter
+    m_VolumeStreamer->GraftOutput(target);
 
-  // Execute the preprocessing on the whole image extent
-  // itk::TimeProbe probe;
-  // probe.Start();
-  m_VolumeStreamer->UpdateLargestPossibleRegion();
-  // probe.Stop();
-  // std::cout << "Time Elapsed: " << probe.GetTotal() << std::endl;
+    // Execute the preprocessing on the whole image extent
+    // itk::TimeProbe probe;
+    // probe.Start();
+    m_VolumeStreamer->UpdateLargestPossibleRegion();
+    // probe.Stop();
+    // std::cout << "Time Elapsed: " << probe.GetTotal() << std::endl;
 
-  // Remove the progress monitor
-  if(progress)
-    m_VolumeStreamer->RemoveObserver(tag);
+    // Remove the progress monitor
+    if(progress)
+      m_VolumeStreamer->RemoveObserver(tag);
+
+    // Undo the graft
+    m_VolumeStreamer->GraftOutput(m_VolumeStreamer->GetOutput());
+    }
 
-  // Undo the graft
-  m_VolumeStreamer->GraftOutput(m_VolumeStreamer->GetOutput());
+  // The buffer is no longer needed, the output volume is current
+  this->ResetBackgroundTiles();
+  this->ResetDeferredTiles();
+  m_OutputPipelineTime = pipeline_time;
 
   // Update the m-time of the output image
   m_OutputWrapper->GetModifiableImage()->DisconnectPipeline();
   m_OutputWrapper->PixelsModified();
 }
 
+template <class TFilterConfigTraits>
+bool
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::ComputeNextBackgroundTile()
+{
+  // There must be an output and parameters that allow the filter to run
+  FilterType *array[] = {m_PreviewFilter[0], m_PreviewFilter[1], m_PreviewFilter[2]};
+  if(!m_OutputWrapper || !Traits::IsPreviewable(array))
+    return false;
+
+  // Tiles are computed until the time budget is used up, so that the
+  // calling thread stays responsive between the calls
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point t_start = Clock::now();
+  auto budget_left = [t_start]() {
+    std::chrono::duration<double> elapsed = Clock::now() - t_start;
+    return elapsed.count() < BACKGROUND_TIME_BUDGET;
+  };
+
+  // A deferred output volume is computed in place, in the order of the slabs
+  if(this->IsOutputVolumePending())
+    {
+    unsigned int i = 0;
+    do
+      {
+      while(m_DeferredTileDone[i])
+        i++;
+      this->ComputeDeferredTile(i);
+      }
+    while(this->IsOutputVolumePending() && budget_left());
+    return this->IsOutputVolumePending();
+    }
+
+  // Nothing to do if the output volume is already current
+  itk::ModifiedTimeType pipeline_time = this->GetVolumePipelineTime();
+  if(pipeline_time == m_OutputPipelineTime)
+    return false;
+
+  // If the parameters changed since the tiles were computed, start over
+  OutputImageType *target = m_OutputWrapper->GetModifiableImage();
+  if(!m_BackgroundImage || m_BackgroundPipelineTime != pipeline_time)
+    {
+    if(!m_BackgroundImage)
+      {
+      m_BackgroundImage = OutputImageType::New();
+      m_BackgroundImage->CopyInformation(target);
+      m_BackgroundImage->SetRegions(target->GetBufferedRegion());
+      m_BackgroundImage->Allocate();
+      }
+
+    // Divide the volume into slabs along the slowest dimension
+    this->SplitIntoTiles(target->GetBufferedRegion(), m_BackgroundTiles);
+    m_BackgroundTileIndex = 0;
+    m_BackgroundPipelineTime = pipeline_time;
+    }
+
+  // Run the volume filter on the next tiles and copy them to the buffer
+  OutputImageType *output = m_VolumeFilter->GetOutput();
+  while(m_BackgroundTileIndex < m_BackgroundTiles.size())
+    {
+    const typename OutputImageType::RegionType &tile = m_BackgroundTiles[m_BackgroundTileIndex++];
+    output->SetRequestedRegion(tile);
+    output->Update();
+    itk::ImageAlgorithm::Copy(output, m_BackgroundImage.GetPointer(), tile, tile);
+    if(!budget_left())
+      break;
+    }
+
+  return m_BackgroundTileIndex < m_BackgroundTiles.size();
+}
+
+template <class TFilterConfigTraits>
+bool
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::ContinuePreview()
+{
+  if(!m_OutputWrapper || !(m_PreviewMode || this->IsOutputVolumePending()))
+    return false;
+
+  bool pending = false;
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    auto *slicer = m_OutputWrapper->GetSlicer(i);
+    if(slicer->HasPendingViewportParts())
+      {
+      slicer->Modified();
+      pending = true;
+      }
+    }
+  return pending;
+}
+
+template <class TFilterConfigTraits>
+itk::ModifiedTimeType
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::GetVolumePipelineTime()
+{
+  m_VolumeFilter->GetOutput()->UpdateOutputInformation();
+  return m_VolumeFilter->GetOutput()->GetPipelineMTime();
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::ResetBackgroundTiles()
+{
+  m_BackgroundImage = NULL;
+  m_BackgroundTiles.clear();
+  m_BackgroundTileIndex = 0;
+  m_BackgroundPipelineTime = 0;
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::SplitIntoTiles(const typename OutputImageType::RegionType &region,
+                 std::vector<typename OutputImageType::RegionType> &tiles)
+{
+  unsigned int n_req = (unsigned int) std::max(
+        1ul, (unsigned long) (region.GetNumberOfPixels() / BACKGROUND_TILE_VOXELS));
+  auto splitter = itk::ImageRegionSplitterMultidimensional::New();
+  unsigned int n_tiles = splitter->GetNumberOfSplits(region, n_req);
+  tiles.clear();
+  for(unsigned int i = 0; i < n_tiles; i++)
+    {
+    typename OutputImageType::RegionType tile = region;
+    splitter->GetSplit(i, n_tiles, tile);
+    tiles.push_back(tile);
+    }
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::BeginDeferredOutputVolume()
+{
+  // Nothing to do if the output volume is already current
+  itk::ModifiedTimeType pipeline_time = this->GetVolumePipelineTime();
+  if(!m_OutputWrapper || pipeline_time == m_OutputPipelineTime)
+    return;
+
+  // If all the tiles were computed ahead of time, just copy them
+  OutputImageType *target = m_OutputWrapper->GetModifiableImage();
+  bool have_tiles = m_BackgroundImage
+      && m_BackgroundPipelineTime == pipeline_time
+      && m_BackgroundImage->GetBufferedRegion() == target->GetBufferedRegion();
+  if(have_tiles && m_BackgroundTileIndex == m_BackgroundTiles.size())
+    {
+    this->ComputeOutputVolume(NULL);
+    return;
+    }
+
+  // Otherwise use the same slabs, and keep the ones that are done
+  std::vector<typename OutputImageType::RegionType> tiles;
+  std::vector<bool> done;
+  if(have_tiles)
+    {
+    tiles = m_BackgroundTiles;
+    done.resize(tiles.size(), false);
+    for(unsigned int i = 0; i < m_BackgroundTileIndex; i++)
+      {
+      itk::ImageAlgorithm::Copy(m_BackgroundImage.GetPointer(), target, tiles[i], tiles[i]);
+      done[i] = true;
+      }
+    }
+  else
+    {
+    this->SplitIntoTiles(target->GetBufferedRegion(), tiles);
+    done.resize(tiles.size(), false);
+    }
+
+  this->ResetBackgroundTiles();
+
+  {
+    std::lock_guard<std::mutex> guard(m_DeferredMutex);
+    m_DeferredTiles = tiles;
+    m_DeferredTileDone = done;
+    m_DeferredTilesLeft = (unsigned int) std::count(done.begin(), done.end(), false);
+    m_DeferredPipelineTime = pipeline_time;
+  }
+
+  // The speed image is incomplete, so the views show the preview filters
+  // until all of the slabs are done, whether or not preview is on
+  m_OutputWrapper->AttachPreviewPipeline(
+        m_PreviewFilter[0], m_PreviewFilter[1], m_PreviewFilter[2]);
+  this->SetProgressivePreview(true);
+}
+
+template <class TFilterConfigTraits>
+bool
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::IsOutputVolumePending() const
+{
+  std::lock_guard<std::mutex> guard(m_DeferredMutex);
+  return m_DeferredTilesLeft > 0;
+}
+
+template <class TFilterConfigTraits>
+bool
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::IsOutputRegionComputed(const itk::ImageRegion<3> &region) const
+{
+  std::lock_guard<std::mutex> guard(m_DeferredMutex);
+  if(m_DeferredTilesLeft == 0)
+    return true;
+
+  for(unsigned int i = 0; i < m_DeferredTiles.size(); i++)
+    {
+    typename OutputImageType::RegionType overlap = m_DeferredTiles[i];
+    if(!m_DeferredTileDone[i] && overlap.Crop(region))
+      return false;
+    }
+  return true;
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::ComputeOutputRegion(const itk::ImageRegion<3> &region)
+{
+  // Only this thread adds slabs, so the list can be read without the lock
+  for(unsigned int i = 0; i < m_DeferredTiles.size() && this->IsOutputVolumePending(); i++)
+    {
+    typename OutputImageType::RegionType overlap = m_DeferredTiles[i];
+    if(!m_DeferredTileDone[i] && overlap.Crop(region))
+      this->ComputeDeferredTile(i);
+    }
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::ComputeDeferredTile(unsigned int index)
+{
+  // Run the volume filter on the slab and copy it into the output image.
+  // The level set does not read the slab until it is marked as done
+  const typename OutputImageType::RegionType &tile = m_DeferredTiles[index];
+  OutputImageType *output = m_VolumeFilter->GetOutput();
+  output->SetRequestedRegion(tile);
+  output->Update();
+  itk::ImageAlgorithm::Copy(output, m_OutputWrapper->GetModifiableImage(), tile, tile);
+
+  bool finished;
+  {
+    std::lock_guard<std::mutex> guard(m_DeferredMutex);
+    m_DeferredTileDone[index] = true;
+    finished = (--m_DeferredTilesLeft == 0);
+  }
+
+  // With the last slab, the output volume is current
+  if(finished)
+    {
+    m_OutputPipelineTime = m_DeferredPipelineTime;
+    m_OutputWrapper->PixelsModified();
+    }
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::ResetDeferredTiles()
+{
+  std::lock_guard<std::mutex> guard(m_DeferredMutex);
+  m_DeferredTiles.clear();
+  m_DeferredTileDone.clear();
+  m_DeferredTilesLeft = 0;
+  m_DeferredPipelineTime = 0;
+}
+
 template <class TFilterConfigTraits>
 typename SlicePreviewFilterWrapper<TFilterConfigTraits>::FilterType *
 SlicePreviewFilterWrapper<TFilterConfigTraits>
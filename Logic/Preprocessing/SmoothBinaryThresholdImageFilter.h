@@ -36,7 +36,10 @@
 #define __SmoothBinaryThresholdImageFilter_h_
 
 #include "itkUnaryFunctorImageFilter.h"
+#include "itkImageScanlineConstIterator.h"
 #include "ThresholdSettings.h"
+#include "SliceBufferPool.h"
+#include <vector>
 
 /**
  * A functor used for the smooth threshold operation on images.  
@@ -55,8 +58,8 @@ public:
   inline short operator()(const TInput &x);
 
   /** Compare two functor objects */
-  bool operator ==(const Self &z);
-  bool operator !=(const Self &x);
+  bool operator ==(const Self &z) const;
+  bool operator !=(const Self &x) const;
 
 private:
   // The lower threshold in intensity units
@@ -103,6 +106,9 @@ public:
   /** The functor type */
   typedef SmoothBinaryThresholdFunctor<InputPixelType>      FunctorType;
 
+  /** Region type */
+  typedef typename OutputImageType::RegionType          OutputRegionType;
+
   /** Standard class typedefs. */
   typedef SmoothBinaryThresholdImageFilter                         Self;
   typedef itk::UnaryFunctorImageFilter<InputImageType,
@@ -122,10 +128,12 @@ public:
   /** Set the minimum value of the input image. Must be provided for the
     filter to work */
   itkSetMacro(InputImageMinimum, double)
+  itkGetConstMacro(InputImageMinimum, double)
 
   /** Set the maximum value of the input image. Must be provided for the
     filter to work */
   itkSetMacro(InputImageMaximum, double)
+  itkGetConstMacro(InputImageMaximum, double)
 
   /** Assign threshold settings */
   void SetParameters(ThresholdSettings *settings);
@@ -141,9 +149,38 @@ protected:
 
   void GenerateData() ITK_OVERRIDE;
 
+  /**
+   * Apply the threshold function one scanline at a time. Intensities that
+   * are whole numbers in the range of the lookup table are mapped through the
+   * table, other intensities are passed to the functor.
+   */
+  void DynamicThreadedGenerateData(const OutputRegionType &region) ITK_OVERRIDE;
+
+  /** Tabulate the functor for the whole numbers in the input image range */
+  void UpdateLookupTable();
+
+  /**
+   * The output is allocated from the pool of slice buffers, since the preview
+   * filters are updated for a new slice region on every redraw
+   */
+  void AllocateOutputs() ITK_OVERRIDE;
+
   double m_InputImageMinimum, m_InputImageMaximum;
   
   SmartPtr<ThresholdSettings> m_Parameters;
+
+  // Values of the functor at the whole numbers between m_LookupTableMinimum
+  // and m_LookupTableMaximum. The table is empty if the input image range
+  // does not have whole number bounds or is too large to tabulate
+  std::vector<OutputPixelType> m_LookupTable;
+  double m_LookupTableMinimum, m_LookupTableMaximum;
+
+  // The functor the lookup table was computed for
+  FunctorType m_LookupTableFunctor;
+  bool m_LookupTableValid;
+
+  // Largest number of entries in the lookup table
+  static const size_t MAX_LOOKUP_TABLE_SIZE = 0x40000;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -46,6 +46,10 @@ SmoothBinaryThresholdImageFilter<TInputImage,TOutputImage>
 
   // Set the parameters (second input) to NULL
   m_Parameters = NULL;
+
+  // The lookup table is computed on the first update
+  m_LookupTableMinimum = m_LookupTableMaximum = 0;
+  m_LookupTableValid = false;
 }
 
 template<typename TInputImage,typename TOutputImage>
@@ -81,10 +85,115 @@ SmoothBinaryThresholdImageFilter<TInputImage,TOutputImage>
   this->GetFunctor().SetParameters(
         m_Parameters, m_InputImageMinimum, m_InputImageMaximum);
 
+  // Recompute the lookup table if the threshold or the image range changed
+  if(!m_LookupTableValid
+     || m_LookupTableFunctor != this->GetFunctor()
+     || m_LookupTableMinimum != m_InputImageMinimum
+     || m_LookupTableMaximum != m_InputImageMaximum)
+    {
+    this->UpdateLookupTable();
+    }
+
   // Execute the filter
   Superclass::GenerateData();
 }
 
+template<typename TInputImage,typename TOutputImage>
+void
+SmoothBinaryThresholdImageFilter<TInputImage,TOutputImage>
+::UpdateLookupTable()
+{
+  m_LookupTableFunctor = this->GetFunctor();
+  m_LookupTableMinimum = m_InputImageMinimum;
+  m_LookupTableMaximum = m_InputImageMaximum;
+  m_LookupTableValid = true;
+  m_LookupTable.clear();
+
+  // The table is only used when the range has whole number bounds, which is
+  // the case for images with integer intensities
+  double imin = m_InputImageMinimum, imax = m_InputImageMaximum;
+  if(!(imin <= imax) || floor(imin) != imin || floor(imax) != imax
+     || imax - imin + 1 > MAX_LOOKUP_TABLE_SIZE)
+    return;
+
+  size_t n = static_cast<size_t>(imax - imin) + 1;
+  m_LookupTable.resize(n);
+  for(size_t i = 0; i < n; i++)
+    {
+    InputPixelType x = static_cast<InputPixelType>(imin + i);
+    m_LookupTable[i] = m_LookupTableFunctor(x);
+    }
+}
+
+template<typename TInputImage,typename TOutputImage>
+void
+SmoothBinaryThresholdImageFilter<TInputImage,TOutputImage>
+::DynamicThreadedGenerateData(const OutputRegionType &region)
+{
+  const InputImageType *input = this->GetInput();
+  OutputImageType *output = this->GetOutput();
+
+  // Each thread uses its own copy of the functor
+  FunctorType functor = this->GetFunctor();
+
+  // Range of intensities handled by the lookup table
+  const OutputPixelType *lut = m_LookupTable.data();
+  long lut_origin = static_cast<long>(m_LookupTableMinimum);
+  InputPixelType lut_min = static_cast<InputPixelType>(m_LookupTableMinimum);
+  InputPixelType lut_max = static_cast<InputPixelType>(m_LookupTableMaximum);
+  bool use_lut = m_LookupTable.size() > 0;
+
+  itk::ImageScanlineConstIterator<TInputImage> inputIt(input, region);
+  size_t line_length = region.GetSize(0);
+  for(; !inputIt.IsAtEnd(); inputIt.NextLine())
+    {
+    const InputPixelType *p_in =
+        input->GetBufferPointer() + input->ComputeOffset(inputIt.GetIndex());
+    OutputPixelType *p_out =
+        output->GetBufferPointer() + output->ComputeOffset(inputIt.GetIndex());
+
+    if(use_lut)
+      {
+      for(size_t i = 0; i < line_length; i++)
+        {
+        InputPixelType x = p_in[i];
+        if(x >= lut_min && x <= lut_max)
+          {
+          // For integer input types the comparison below is always true
+          long k = static_cast<long>(x);
+          if(static_cast<InputPixelType>(k) == x)
+            {
+            p_out[i] = lut[k - lut_origin];
+            continue;
+            }
+          }
+        p_out[i] = functor(x);
+        }
+      }
+    else
+      {
+      for(size_t i = 0; i < line_length; i++)
+        p_out[i] = functor(p_in[i]);
+      }
+    }
+}
+
+template<typename TInputImage,typename TOutputImage>
+void
+SmoothBinaryThresholdImageFilter<TInputImage,TOutputImage>
+::AllocateOutputs()
+{
+  if(this->GetInPlace() && this->CanRunInPlace())
+    {
+    Superclass::AllocateOutputs();
+    return;
+    }
+
+  OutputImageType *output = this->GetOutput();
+  output->SetBufferedRegion(output->GetRequestedRegion());
+  AllocatePooledImage(output);
+}
+
 template<typename TInputImage,typename TOutputImage>
 ThresholdSettings *
 SmoothBinaryThresholdImageFilter<TInputImage,TOutputImage>
@@ -157,7 +266,7 @@ SmoothBinaryThresholdFunctor<TInput>
 template<class TInput>
 bool
 SmoothBinaryThresholdFunctor<TInput>
-::operator ==(const Self &z)
+::operator ==(const Self &z) const
 {
   return
       m_LowerThreshold == z.m_LowerThreshold &&
@@ -171,7 +280,7 @@ SmoothBinaryThresholdFunctor<TInput>
 template<class TInput>
 bool
 SmoothBinaryThresholdFunctor<TInput>
-::operator !=(const Self &z)
+::operator !=(const Self &z) const
 {
   return !(*this == z);
 }
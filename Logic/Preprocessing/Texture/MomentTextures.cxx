@@ -1,11 +1,9 @@
 #include "MomentTextures.h"
 #include "itkImage.h"
 #include "itkVectorImage.h"
-#include "itkImageRegionIteratorWithIndex.h"
-#include "itkNeighborhoodIterator.h"
-
-#define MIN(a,b) (((a)<(b))?(a):(b))
-#define MAX(a,b) (((a)>(b))?(a):(b))
+#include "itkImageRegionIterator.h"
+#include <algorithm>
+#include <vector>
 
 const int MAX_VAL=100000;
 
@@ -16,65 +14,219 @@ void
 MomentTextureFilter<TInputImage, TOutputImage>
 ::DynamicThreadedGenerateData(const RegionType & outputRegionForThread)
 {
-  // Iterator for the output region
-  typedef itk::ImageRegionIteratorWithIndex<OutputImageType> OutputIteratorType;
-  OutputIteratorType TexIt(this->GetOutput(), outputRegionForThread);
+  // The moments are computed from box sums of the powers of the intensity,
+  // which are separable. The sums are taken along x and y for one plane at a
+  // time, and then slid along z over a ring of planes. The neighborhood is
+  // clamped to the buffered region, like the Neumann boundary condition of the
+  // neighborhood iterator that was used before.
+  static_assert(ImageDimension == 3, "MomentTextureFilter requires 3D images");
 
-  // Neighborhood iterator for the input region
-  typedef itk::ConstNeighborhoodIterator<InputImageType> NeighborhoodIterator;
-  NeighborhoodIterator InpIt(m_Radius,this->GetInput(), outputRegionForThread);
+  if(outputRegionForThread.GetNumberOfPixels() == 0)
+    return;
 
-  // Accumulator array
-  vnl_vector<float> accumX(m_HighestDegree);
-  OutputPixelType out_pix(m_HighestDegree);
+  const InputImageType *input = this->GetInput();
+  const RegionType &buffered = input->GetBufferedRegion();
 
-  for( TexIt.GoToBegin(); !TexIt.IsAtEnd(); ++TexIt, ++InpIt)
+  // Channels of a plane: sums of the first D powers, then the minimum and the
+  // maximum. The min and max include zero, as they always have.
+  const int D = (int) m_HighestDegree, nc = D + 2;
+
+  long o[3], n[3], r[3], lo[3], hi[3];
+  for(int d = 0; d < 3; d++)
     {
-    // On the first pass through the neighborhood compute the mean intensity and
-    // the intensity range in the neighborhood
-    float accum=0.0;
-    float min=0; //Store minimum voxel intensity value
-    float max=0; //Store maximum voxel intensity value
+    o[d] = outputRegionForThread.GetIndex(d);
+    n[d] = (long) outputRegionForThread.GetSize(d);
+    r[d] = (long) m_Radius[d];
+    lo[d] = buffered.GetIndex(d);
+    hi[d] = lo[d] + (long) buffered.GetSize(d) - 1;
+    }
 
-    for(int j=0;j<InpIt.Size();j++)
+  auto clamp = [&lo, &hi](int d, long c)
+    { return c < lo[d] ? lo[d] : (c > hi[d] ? hi[d] : c); };
+
+  const long nx = n[0], ny = n[1], wh = nx * ny, nx_ext = nx + 2 * r[0];
+  const long ylo = clamp(1, o[1] - r[1]), yhi = clamp(1, o[1] + ny - 1 + r[1]);
+  const long nrows = yhi - ylo + 1;
+
+  std::vector<double> line(nx_ext * D), rows(nc * nrows * nx);
+
+  // Compute the x/y box sums and min/max of plane zc into a plane buffer
+  auto compute_plane = [&](long zc, double *plane)
+  {
+    // Pass along x for every source row that contributes to the output rows
+    for(long y = ylo; y <= yhi; y++)
       {
-      InputPixelType pix = InpIt.GetPixel(j);
-      accum += pix;
-      min=MIN(min, pix);
-      max=MAX(max, pix);
-      }
+      typename InputImageType::IndexType idx = {{ lo[0], y, zc }};
+      const InputPixelType *src = input->GetBufferPointer() + input->ComputeOffset(idx);
+      long row = y - ylo;
+      double *rmin = &rows[(D * nrows + row) * nx];
+      double *rmax = &rows[((D + 1) * nrows + row) * nx];
 
-    float range = max-min;
-    float mean = accum / InpIt.Size();
+      for(long k = 0; k < nx_ext; k++)
+        {
+        double v = src[clamp(0, o[0] - r[0] + k) - lo[0]], vj = v;
+        for(int j = 0; j < D; j++, vj *= v)
+          line[j * nx_ext + k] = vj;
+        }
 
-    // On the second pass, compute the moments
-    accumX.fill(0.0f);
-    for(int j=0;j<InpIt.Size();j++)
+      for(int j = 0; j < D; j++)
+        {
+        const double *pw = &line[j * nx_ext];
+        double *rsum = &rows[(j * nrows + row) * nx];
+        double acc = 0.0;
+        for(long k = 0; k <= 2 * r[0]; k++)
+          acc += pw[k];
+        rsum[0] = acc;
+        for(long i = 1; i < nx; i++)
+          {
+          acc += pw[i + 2 * r[0]] - pw[i - 1];
+          rsum[i] = acc;
+          }
+        }
+
+      for(long i = 0; i < nx; i++)
+        {
+        double mn = 0.0, mx = 0.0;
+        for(long k = i; k <= i + 2 * r[0]; k++)
+          {
+          mn = std::min(mn, line[k]);
+          mx = std::max(mx, line[k]);
+          }
+        rmin[i] = mn;
+        rmax[i] = mx;
+        }
+      }
+
+    // Pass along y into the plane
+    for(long i1 = 0; i1 < ny; i1++)
       {
-      InputPixelType pix = InpIt.GetPixel(j);
-      float norm_val = ((pix - mean) / range), norm_val_k = norm_val;
-      accumX[0] += norm_val;
-      for(int k = 1; k < m_HighestDegree; k++)
+      long y = o[1] + i1;
+      for(int c = 0; c < nc; c++)
         {
-        norm_val_k *= norm_val;
-        accumX[k] += norm_val_k;
+        double *out = plane + c * wh + i1 * nx;
+        const double *chan = &rows[c * nrows * nx];
+        if(c < D && i1 > 0)
+          {
+          // Slide the window down by one row
+          const double *prev = out - nx;
+          const double *add = chan + (clamp(1, y + r[1]) - ylo) * nx;
+          const double *sub = chan + (clamp(1, y - 1 - r[1]) - ylo) * nx;
+          for(long i = 0; i < nx; i++)
+            out[i] = prev[i] + add[i] - sub[i];
+          }
+        else
+          {
+          const double *first = chan + (clamp(1, y - r[1]) - ylo) * nx;
+          std::copy(first, first + nx, out);
+          for(long dy = 1 - r[1]; dy <= r[1]; dy++)
+            {
+            const double *src = chan + (clamp(1, y + dy) - ylo) * nx;
+            if(c < D)
+              for(long i = 0; i < nx; i++) out[i] += src[i];
+            else if(c == D)
+              for(long i = 0; i < nx; i++) out[i] = std::min(out[i], src[i]);
+            else
+              for(long i = 0; i < nx; i++) out[i] = std::max(out[i], src[i]);
+            }
+          }
         }
       }
+  };
+
+  // Ring of planes, large enough to hold the planes entering and leaving the
+  // sliding window along z
+  const long nring = 2 * r[2] + 2;
+  std::vector<double> ring(nring * nc * wh);
+  std::vector<long> ring_z(nring, lo[2] - 1);
+  auto get_plane = [&](long zc) -> const double *
+  {
+    long slot = (zc - lo[2]) % nring;
+    double *plane = &ring[slot * nc * wh];
+    if(ring_z[slot] != zc)
+      {
+      compute_plane(zc, plane);
+      ring_z[slot] = zc;
+      }
+    return plane;
+  };
+
+  // Binomial coefficients for converting raw moments to central moments
+  std::vector<double> binom((D + 1) * (D + 1), 0.0);
+  for(int q = 0; q <= D; q++)
+    {
+    binom[q * (D + 1)] = 1.0;
+    for(int j = 1; j <= q; j++)
+      binom[q * (D + 1) + j] = binom[(q - 1) * (D + 1) + j - 1]
+          + (j < q ? binom[(q - 1) * (D + 1) + j] : 0.0);
+    }
+
+  const double count = (2 * r[0] + 1) * (2 * r[1] + 1) * (2 * r[2] + 1);
+  std::vector<double> sums(D * wh), raw(D + 1);
+  OutputPixelType out_pix(m_HighestDegree);
 
-    // Scale the moments by neighborhood size
-    accumX /= InpIt.Size();
+  typedef itk::ImageRegionIterator<OutputImageType> OutputIteratorType;
+  OutputIteratorType TexIt(this->GetOutput(), outputRegionForThread);
 
-    // The first moment should just be the mean
-    accumX[0] = mean / range;
+  for(long i2 = 0; i2 < n[2]; i2++)
+    {
+    long z = o[2] + i2;
 
-    // Assign to the output voxel
-    for(int k = 0; k < m_HighestDegree; k++)
+    // Slide the running sums along z
+    if(i2 == 0)
+      {
+      std::fill(sums.begin(), sums.end(), 0.0);
+      for(long dz = -r[2]; dz <= r[2]; dz++)
+        {
+        const double *plane = get_plane(clamp(2, z + dz));
+        for(long k = 0; k < D * wh; k++)
+          sums[k] += plane[k];
+        }
+      }
+    else
       {
-      out_pix[k] = static_cast<OutputComponentType>(1000 * accumX[k]);
+      const double *sub = get_plane(clamp(2, z - 1 - r[2]));
+      const double *add = get_plane(clamp(2, z + r[2]));
+      for(long k = 0; k < D * wh; k++)
+        sums[k] += add[k] - sub[k];
       }
 
-    // Assign to the output voxel
-    TexIt.Set(out_pix);
+    // Gather the window planes for the min and max
+    std::vector<const double *> window;
+    for(long dz = -r[2]; dz <= r[2]; dz++)
+      window.push_back(get_plane(clamp(2, z + dz)));
+
+    for(long i = 0; i < wh; i++, ++TexIt)
+      {
+      double mn = window[0][D * wh + i], mx = window[0][(D + 1) * wh + i];
+      for(size_t w = 1; w < window.size(); w++)
+        {
+        mn = std::min(mn, window[w][D * wh + i]);
+        mx = std::max(mx, window[w][(D + 1) * wh + i]);
+        }
+
+      float range = (float) (mx - mn);
+      float mean = (float) (sums[i] / count);
+
+      // Raw moments about zero
+      raw[0] = 1.0;
+      for(int j = 1; j <= D; j++)
+        raw[j] = sums[(j - 1) * wh + i] / count;
+
+      // The first moment is just the mean, the rest are the central moments
+      // normalized by the range
+      out_pix[0] = static_cast<OutputComponentType>(1000 * (mean / range));
+      double range_q = range;
+      for(int q = 2; q <= D; q++)
+        {
+        double mu = 0.0, m_pow = 1.0;
+        for(int j = q; j >= 0; j--, m_pow *= -mean)
+          mu += binom[q * (D + 1) + j] * raw[j] * m_pow;
+        range_q *= range;
+        out_pix[q - 1] = static_cast<OutputComponentType>(1000 * (mu / range_q));
+        }
+
+      TexIt.Set(out_pix);
+      }
     }
 }
 
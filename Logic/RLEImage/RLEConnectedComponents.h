@@ -0,0 +1,320 @@
+#ifndef RLEConnectedComponents_h
+#define RLEConnectedComponents_h
+
+#include <algorithm>
+#include <vector>
+#include "RLEImage.h"
+#include <itkMultiThreaderBase.h>
+
+/** Connected components of the voxels of one value in a 3D RLE image,
+* computed from the runs without expanding them to voxels.
+*
+* The runs of the value in each line are the nodes of a union-find forest.
+* A run is joined with the runs that overlap it in the neighboring lines
+* that come before it (the previous line of the slice and the lines of the
+* previous slice), which takes a single sweep over the runs of both lines.
+* The slices are divided into slabs that are processed in parallel, since
+* the runs of a slab are only joined with runs of the same slab. The runs
+* in the first slice of each slab are then joined with those of the last
+* slice of the previous slab.
+*
+* With face connectivity (6 neighbors), runs are joined if they share a
+* column in the previous line of the slice or in the same line of the
+* previous slice. With full connectivity (26 neighbors), runs that touch
+* diagonally are joined too.
+*
+* The runs may be split further by a condition on the voxels, such as an
+* intensity window on another image, so that the components only contain
+* the voxels of the value that meet the condition.
+*/
+template< typename TPixel, typename CounterType = unsigned short >
+class RLEConnectedComponents
+{
+public:
+    typedef RLEImage<TPixel, 3, CounterType>         ImageType;
+    typedef typename ImageType::RegionType           RegionType;
+    typedef typename ImageType::RLLine               RLLine;
+    typedef itk::SizeValueType                       SizeValueType;
+
+    /** A run of the value, from Begin to End (exclusive) relative to the
+    * start of the line, and the component it belongs to */
+    struct Run
+    {
+        long Begin, End;
+        SizeValueType Component;
+    };
+
+    /** Find the components of the voxels equal to value in the region */
+    void Compute(const ImageType *image, const RegionType & region,
+                 TPixel value, bool fullyConnected = false)
+    {
+        this->Compute(image, region, value, fullyConnected,
+            [](long, long, long begin, long end, auto && emit) { emit(begin, end); });
+    }
+
+    /** Find the components of the voxels equal to value in the region that
+    * meet a condition. Each run of the value in the line through (y, z) is
+    * passed to split(y, z, begin, end, emit), which calls emit(b, e) for the
+    * parts of the run that meet the condition, in order along the line. The
+    * split function is called concurrently from several threads. */
+    template< typename TSplit >
+    void Compute(const ImageType *image, const RegionType & region,
+                 TPixel value, bool fullyConnected, TSplit split)
+    {
+        m_Region = region;
+        m_LineOrigin = image->GetBufferedRegion().GetIndex(0);
+        m_NumberOfLines = region.GetSize(1) * region.GetSize(2);
+        this->CollectRuns(image, value, split);
+        this->JoinRuns(fullyConnected);
+        this->LabelComponents();
+    }
+
+    SizeValueType GetNumberOfComponents() const { return m_ComponentSizes.size(); }
+
+    /** Number of voxels in each component, in the order in which the
+    * components are first met in raster order */
+    const std::vector<SizeValueType> & GetComponentSizes() const { return m_ComponentSizes; }
+
+    /** The component with the most voxels, or -1 if there are none */
+    long GetLargestComponent() const
+    {
+        if (m_ComponentSizes.empty())
+            return -1;
+        return std::max_element(m_ComponentSizes.begin(), m_ComponentSizes.end())
+            - m_ComponentSizes.begin();
+    }
+
+    /** The runs of the line through (y, z), in order along the line */
+    const Run * LineBegin(long y, long z) const
+    {
+        return m_Runs.data() + m_LineStart[this->LineNumber(y, z)];
+    }
+
+    const Run * LineEnd(long y, long z) const
+    {
+        return m_Runs.data() + m_LineStart[this->LineNumber(y, z) + 1];
+    }
+
+    /** The component of the voxel at an index of the region, or -1 if the
+    * voxel is not in any component */
+    long GetComponentAt(const itk::Index<3> & index) const
+    {
+        if (!m_Region.IsInside(index))
+            return -1;
+        long x = index[0] - m_LineOrigin;
+        const Run *end = this->LineEnd(index[1], index[2]);
+        const Run *run = std::upper_bound(this->LineBegin(index[1], index[2]), end, x,
+            [](long v, const Run & r) { return v < r.End; });
+        return (run != end && run->Begin <= x) ? (long) run->Component : -1;
+    }
+
+protected:
+    RegionType m_Region;
+    itk::IndexValueType m_LineOrigin = 0;
+    SizeValueType m_NumberOfLines = 0;
+
+    // Runs of all lines in raster order, and the first run of each line
+    std::vector<Run> m_Runs;
+    std::vector<SizeValueType> m_LineStart;
+
+    // Union-find forest. Each root is the run with the lowest index in its
+    // tree, so that a parent always comes before its children
+    std::vector<SizeValueType> m_Parent;
+
+    std::vector<SizeValueType> m_ComponentSizes;
+
+    SizeValueType LineNumber(long y, long z) const
+    {
+        return (y - m_Region.GetIndex(1))
+            + m_Region.GetSize(1) * (z - m_Region.GetIndex(2));
+    }
+
+    // Call visitor(begin, end) for the runs of the value in a line, merging
+    // adjacent runs of the value, clipped to the columns from x0 to x1
+    template< typename TVisitor >
+    static void ForEachRunOfValue(const RLLine & line, TPixel value,
+                                  long x0, long x1, TVisitor visitor)
+    {
+        long x = 0, begin = -1;
+        for (const auto & seg : line)
+        {
+            if (x >= x1)
+                break;
+            if (seg.second == value)
+            {
+                if (begin < 0)
+                    begin = x;
+            }
+            else if (begin >= 0)
+            {
+                if (x > x0)
+                    visitor(std::max(begin, x0), x);
+                begin = -1;
+            }
+            x += seg.first;
+        }
+        if (begin >= 0 && std::min(x, x1) > x0)
+            visitor(std::max(begin, x0), std::min(x, x1));
+    }
+
+    template< typename TSplit >
+    void CollectRuns(const ImageType *image, TPixel value, TSplit & split)
+    {
+        long x0 = m_Region.GetIndex(0) - m_LineOrigin;
+        long x1 = x0 + (long) m_Region.GetSize(0);
+
+        // The kept parts of the runs of each line are found once, and held
+        // per line until they are placed at the offsets given by the running
+        // sum of the counts
+        std::vector<std::vector<Run>> lineRuns(m_NumberOfLines);
+        image->ParallelForEachLine(m_Region, [&](RLLine & line, const itk::Index<3> & idx)
+        {
+            std::vector<Run> & runs = lineRuns[this->LineNumber(idx[1], idx[2])];
+            auto emit = [&runs](long begin, long end)
+            {
+                if (end > begin)
+                    runs.push_back(Run{ begin, end, 0 });
+            };
+            ForEachRunOfValue(line, value, x0, x1, [&](long begin, long end)
+            {
+                split((long) idx[1], (long) idx[2], begin, end, emit);
+            });
+        });
+
+        m_LineStart.assign(m_NumberOfLines + 1, 0);
+        for (SizeValueType i = 0; i < m_NumberOfLines; i++)
+            m_LineStart[i + 1] = m_LineStart[i] + lineRuns[i].size();
+
+        m_Runs.resize(m_LineStart[m_NumberOfLines]);
+        itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+        mt->ParallelizeArray(0, m_NumberOfLines, [&](SizeValueType i)
+        {
+            std::copy(lineRuns[i].begin(), lineRuns[i].end(), m_Runs.begin() + m_LineStart[i]);
+            std::vector<Run>().swap(lineRuns[i]);
+        }, nullptr);
+    }
+
+    SizeValueType Find(SizeValueType i)
+    {
+        SizeValueType root = i;
+        while (m_Parent[root] != root)
+            root = m_Parent[root];
+
+        // Point the runs along the path directly at the root
+        while (m_Parent[i] != root)
+        {
+            SizeValueType next = m_Parent[i];
+            m_Parent[i] = root;
+            i = next;
+        }
+        return root;
+    }
+
+    void Union(SizeValueType a, SizeValueType b)
+    {
+        a = this->Find(a);
+        b = this->Find(b);
+        if (a < b)
+            m_Parent[b] = a;
+        else if (b < a)
+            m_Parent[a] = b;
+    }
+
+    // Join the runs of line (y, z) with the overlapping runs of another line.
+    // With a gap of one, runs that only touch diagonally overlap too
+    void JoinLines(long y, long z, long yn, long zn, long gap)
+    {
+        const Run *a = this->LineBegin(y, z), *a_end = this->LineEnd(y, z);
+        const Run *b = this->LineBegin(yn, zn), *b_end = this->LineEnd(yn, zn);
+        while (a < a_end && b < b_end)
+        {
+            if (a->Begin < b->End + gap && b->Begin < a->End + gap)
+                this->Union(a - m_Runs.data(), b - m_Runs.data());
+
+            // Move past the run that ends first, it can not overlap any
+            // further runs of the other line
+            if (a->End < b->End)
+                a++;
+            else
+                b++;
+        }
+    }
+
+    // Join line (y, z) with its neighbors in the previous slice
+    void JoinWithPreviousSlice(long y, long z, bool fullyConnected)
+    {
+        if (fullyConnected)
+        {
+            long y0 = m_Region.GetIndex(1), y1 = y0 + (long) m_Region.GetSize(1);
+            for (long yn = std::max(y0, y - 1); yn < std::min(y1, y + 2); yn++)
+                this->JoinLines(y, z, yn, z - 1, 1);
+        }
+        else
+        {
+            this->JoinLines(y, z, y, z - 1, 0);
+        }
+    }
+
+    void JoinRuns(bool fullyConnected)
+    {
+        m_Parent.resize(m_Runs.size());
+        for (SizeValueType i = 0; i < m_Parent.size(); i++)
+            m_Parent[i] = i;
+
+        long y0 = m_Region.GetIndex(1), y1 = y0 + (long) m_Region.GetSize(1);
+        long z0 = m_Region.GetIndex(2), nz = (long) m_Region.GetSize(2);
+        long gap = fullyConnected ? 1 : 0;
+
+        // The slabs hold consecutive runs, so the threads update disjoint
+        // parts of the forest
+        itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+        long nSlabs = std::max(1l, std::min(nz, (long) mt->GetMaximumNumberOfThreads() * 4));
+        auto slabStart = [&](long s) { return z0 + (nz * s) / nSlabs; };
+
+        mt->ParallelizeArray(0, nSlabs, [&](itk::SizeValueType s)
+        {
+            for (long z = slabStart(s); z < slabStart(s + 1); z++)
+            {
+                for (long y = y0; y < y1; y++)
+                {
+                    if (y > y0)
+                        this->JoinLines(y, z, y - 1, z, gap);
+                    if (z > slabStart(s))
+                        this->JoinWithPreviousSlice(y, z, fullyConnected);
+                }
+            }
+        }, nullptr);
+
+        // Join the slabs
+        for (long s = 1; s < nSlabs; s++)
+        {
+            long z = slabStart(s);
+            if (z > slabStart(s - 1))
+                for (long y = y0; y < y1; y++)
+                    this->JoinWithPreviousSlice(y, z, fullyConnected);
+        }
+    }
+
+    void LabelComponents()
+    {
+        // Since parents come before their children, a single pass in order
+        // finds the root of every run
+        m_ComponentSizes.clear();
+        std::vector<SizeValueType> rootComponent(m_Runs.size());
+        for (SizeValueType i = 0; i < m_Runs.size(); i++)
+        {
+            SizeValueType root = m_Parent[i] = m_Parent[m_Parent[i]];
+            if (root == i)
+            {
+                rootComponent[i] = m_ComponentSizes.size();
+                m_ComponentSizes.push_back(0);
+            }
+
+            Run & run = m_Runs[i];
+            run.Component = rootComponent[root];
+            m_ComponentSizes[run.Component] += run.End - run.Begin;
+        }
+    }
+};
+
+#endif // RLEConnectedComponents_h
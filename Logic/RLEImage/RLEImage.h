@@ -3,8 +3,10 @@
 
 #include <utility> //std::pair
 #include <vector>
+#include "RLELine.h"
 #include <itkImageBase.h>
 #include <itkImage.h>
+#include <itkMultiThreaderBase.h>
 
 /** Run-Length Encoded image.
 * It saves memory for label images at the expense of processing times.
@@ -47,8 +49,9 @@ public:
     * second element is the pixel value. */
     typedef std::pair<CounterType, PixelType> RLSegment;
 
-    /** A Run-Length encoded line of pixels. */
-    typedef std::vector<RLSegment> RLLine;
+    /** A Run-Length encoded line of pixels. Copies of a line share its
+    * runs until one of them is modified. */
+    typedef RLELine<RLSegment> RLLine;
 
     /** Internal Pixel representation. Used to maintain a uniform API
     * with Image Adaptors and allow to keep a particular internal
@@ -196,6 +199,20 @@ public:
     * Automatically called when turning on OnTheFlyCleanup. */
     void CleanUp() const;
 
+    /** Calls visitor(line, index) for each run-length line of the region,
+    * with the lines divided among threads. The index is that of the first
+    * pixel of the line. The visitor may modify the line it is given, but
+    * must not access any other line. */
+    template< typename TVisitor >
+    void ParallelForEachLine(const RegionType & region, TVisitor visitor) const;
+
+    /** Lets the lines that hold the same runs share their storage: the lines
+    * equal to the corresponding line of the previous slab along the last
+    * dimension (the previous time point of a 4D image), and the lines made
+    * of a single run of the same value. Returns the number of lines that
+    * were made to share. */
+    SizeValueType ShareRepeatedLines();
+
     /** Should same-valued segments be merged on the fly?
     * On the fly merging usually provides better performance. */
     bool GetOnTheFlyCleanup() const { return m_OnTheFlyCleanup; }
@@ -3,6 +3,7 @@
 
 #include "RLEImage.h"
 #include "itkImageRegionConstIterator.h"
+#include <map>
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 inline typename RLEImage<TPixel, VImageDimension, CounterType>::BufferType::IndexType
@@ -71,7 +72,16 @@ void RLEImage<TPixel, VImageDimension, CounterType>
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 void RLEImage<TPixel, VImageDimension, CounterType>::CleanUpLine(RLLine & line) const
 {
-    CounterType x = 0;
+    // Lines without adjacent runs of the same value are left alone, so that
+    // they keep sharing their runs with their copies
+    const RLLine & in = line;
+    CounterType x = 1;
+    while (x < in.size() && in[x].second != in[x - 1].second)
+        x++;
+    if (x >= in.size())
+        return;
+
+    x = 0;
     RLLine out;
     out.reserve(this->GetLargestPossibleRegion().GetSize(0));
     do
@@ -86,13 +96,80 @@ void RLEImage<TPixel, VImageDimension, CounterType>::CleanUpLine(RLLine & line)
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 void RLEImage<TPixel, VImageDimension, CounterType>::CleanUp() const
 {
-    assert(!myBuffer.empty());
+    assert(myBuffer);
     if (this->GetLargestPossibleRegion().GetSize(0) == 0)
         return;
-#pragma omp parallel for
-    for (CounterType z = 0; z < myBuffer.size(); z++)
-        for (CounterType y = 0; y < myBuffer[0].size(); y++)
-            CleanUpLine(myBuffer[z][y]);
+    this->ParallelForEachLine(this->GetBufferedRegion(),
+        [this](RLLine & line, const IndexType &) { this->CleanUpLine(line); });
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+template< typename TVisitor >
+void RLEImage<TPixel, VImageDimension, CounterType>
+::ParallelForEachLine(const RegionType & region, TVisitor visitor) const
+{
+    typename BufferType::RegionType lineRegion = truncateRegion(region);
+    SizeValueType nLines = lineRegion.GetNumberOfPixels();
+    if (nLines == 0 || region.GetSize(0) == 0)
+        return;
+
+    BufferType *buffer = myBuffer.GetPointer();
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray(0, nLines, [&](SizeValueType k)
+    {
+        // Convert the line number to an index in the region
+        typename BufferType::IndexType bi = lineRegion.GetIndex();
+        for (unsigned int d = 0; d < VImageDimension - 1; d++)
+        {
+            bi[d] += k % lineRegion.GetSize(d);
+            k /= lineRegion.GetSize(d);
+        }
+
+        IndexType index;
+        index[0] = this->GetBufferedRegion().GetIndex(0);
+        for (unsigned int d = 0; d < VImageDimension - 1; d++)
+            index[d + 1] = bi[d];
+
+        visitor(buffer->GetPixel(bi), index);
+    }, nullptr);
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+typename RLEImage<TPixel, VImageDimension, CounterType>::SizeValueType
+RLEImage<TPixel, VImageDimension, CounterType>::ShareRepeatedLines()
+{
+    assert(myBuffer);
+    typename BufferType::RegionType lineRegion = myBuffer->GetBufferedRegion();
+    SizeValueType nLines = lineRegion.GetNumberOfPixels();
+    if (nLines == 0 || this->GetBufferedRegion().GetSize(0) == 0)
+        return 0;
+
+    // Number of lines in a slab along the last dimension
+    SizeValueType nSlab = nLines / lineRegion.GetSize(VImageDimension - 2);
+
+    // The most common lines hold a single run, e.g., the background lines of
+    // a segmentation, and are shared across the whole image
+    std::map<TPixel, RLLine> uniformLines;
+    RLLine *lines = myBuffer->GetBufferPointer();
+    SizeValueType nShared = 0;
+    for (SizeValueType i = 0; i < nLines; i++)
+    {
+        const RLLine & line = lines[i];
+        if (line.size() == 1)
+        {
+            auto it = uniformLines.find(line.front().second);
+            if (it == uniformLines.end())
+                uniformLines.insert(std::make_pair(line.front().second, line));
+            else if (!line.IsSharedWith(it->second))
+            {
+                lines[i] = it->second;
+                nShared++;
+            }
+        }
+        else if (i >= nSlab && lines[i].ShareIfEqual(lines[i - nSlab]))
+            nShared++;
+    }
+    return nShared;
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -103,7 +180,7 @@ SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & real
     itkAssertOrThrowMacro(this->GetBufferedRegion().GetSize(0)
         == this->GetLargestPossibleRegion().GetSize(0),
         "BufferedRegion must contain complete run-length lines!");
-    if (line[realIndex].second == value) //already correct value
+    if (static_cast<const RLLine &>(line)[realIndex].second == value) //already correct value, avoid copying shared runs
         return 0;
     else if (line[realIndex].first == 1) //single pixel segment
     {
@@ -219,7 +296,7 @@ GetPixel(const IndexType & index) const
         "BufferedRegion must contain complete run-length lines!");
     IndexValueType bri0 = this->GetBufferedRegion().GetIndex(0);
     typename BufferType::IndexType bi = truncateIndex(index);
-    RLLine & line = myBuffer->GetPixel(bi);
+    const RLLine & line = myBuffer->GetPixel(bi);
     IndexValueType t = 0;
     for (IndexValueType x = 0; x < line.size(); x++)
     {
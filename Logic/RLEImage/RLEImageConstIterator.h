@@ -262,7 +262,7 @@ public:
    * data, but it will NOT support ImageAdaptors. */
   const PixelType & Value(void) const
   {
-      RLLine & line = const_cast<Self *>(this)->bi.Value();
+      const RLLine & line = const_cast<Self *>(this)->bi.Value();
       return line[realIndex].second;
   }
 
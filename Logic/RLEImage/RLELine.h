@@ -0,0 +1,191 @@
+#ifndef RLELine_h
+#define RLELine_h
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/** A run-length encoded line whose runs are shared between copies.
+* Copying a line only adds a reference to its runs, and the runs are copied
+* the first time one of the copies is modified (copy on write). This lets
+* identical lines of different time points, of copies of an image and of the
+* checkpoints of the recovery journal share their storage.
+*
+* The interface follows that of std::vector. Reading never copies the runs:
+* the iterators are always const, and the insert and erase methods take
+* const iterators. Only the methods that modify the runs, including the
+* non-const operator[], front() and back(), make the runs private to this
+* line first. As with ordinary vectors, a line should only be modified by
+* one thread at a time, but copies of it may be modified concurrently.
+*/
+template< typename TSegment >
+class RLELine
+{
+public:
+    typedef std::vector<TSegment>                  VectorType;
+    typedef TSegment                               value_type;
+    typedef typename VectorType::size_type         size_type;
+    typedef typename VectorType::difference_type   difference_type;
+    typedef typename VectorType::const_iterator    const_iterator;
+    typedef const_iterator                         iterator;
+    typedef const TSegment &                       const_reference;
+    typedef TSegment &                             reference;
+
+    RLELine() {}
+
+    explicit RLELine(size_type n) : m_Runs(std::make_shared<VectorType>(n)) {}
+
+    template< typename TInputIterator >
+    RLELine(TInputIterator first, TInputIterator last)
+        : m_Runs(std::make_shared<VectorType>(first, last)) {}
+
+    size_type size() const { return m_Runs ? m_Runs->size() : 0; }
+    bool empty() const { return this->size() == 0; }
+    size_type capacity() const { return m_Runs ? m_Runs->capacity() : 0; }
+
+    const_iterator begin() const { return this->Runs().begin(); }
+    const_iterator end() const { return this->Runs().end(); }
+    const_iterator cbegin() const { return this->Runs().begin(); }
+    const_iterator cend() const { return this->Runs().end(); }
+
+    const TSegment & operator[](size_type i) const { return (*m_Runs)[i]; }
+    TSegment & operator[](size_type i) { return this->Modifiable()[i]; }
+
+    const TSegment & front() const { return m_Runs->front(); }
+    TSegment & front() { return this->Modifiable().front(); }
+    const TSegment & back() const { return m_Runs->back(); }
+    TSegment & back() { return this->Modifiable().back(); }
+
+    void push_back(const TSegment & segment) { this->Modifiable().push_back(segment); }
+
+    template< typename... TArgs >
+    void emplace_back(TArgs &&... args)
+    {
+        this->Modifiable().emplace_back(std::forward<TArgs>(args)...);
+    }
+
+    iterator insert(const_iterator pos, const TSegment & segment)
+    {
+        difference_type k = pos - this->begin();
+        VectorType & runs = this->Modifiable();
+        return runs.insert(runs.begin() + k, segment);
+    }
+
+    iterator insert(const_iterator pos, size_type n, const TSegment & segment)
+    {
+        difference_type k = pos - this->begin();
+        VectorType & runs = this->Modifiable();
+        return runs.insert(runs.begin() + k, n, segment);
+    }
+
+    /** The range must not come from this line */
+    template< typename TInputIterator >
+    iterator insert(const_iterator pos, TInputIterator first, TInputIterator last)
+    {
+        difference_type k = pos - this->begin();
+        VectorType & runs = this->Modifiable();
+        return runs.insert(runs.begin() + k, first, last);
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        difference_type k = pos - this->begin();
+        VectorType & runs = this->Modifiable();
+        return runs.erase(runs.begin() + k);
+    }
+
+    iterator erase(const_iterator first, const_iterator last)
+    {
+        difference_type k = first - this->begin(), n = last - first;
+        VectorType & runs = this->Modifiable();
+        return runs.erase(runs.begin() + k, runs.begin() + k + n);
+    }
+
+    /** Replace the runs with a range, allocating exactly as much as needed */
+    template< typename TInputIterator >
+    void assign(TInputIterator first, TInputIterator last)
+    {
+        m_Runs = std::make_shared<VectorType>(first, last);
+    }
+
+    /** Remove the runs, keeping the allocation unless it is shared */
+    void clear()
+    {
+        if (this->IsShared())
+            m_Runs.reset();
+        else if (m_Runs)
+            m_Runs->clear();
+    }
+
+    void reserve(size_type n)
+    {
+        if (n > this->capacity() || this->IsShared())
+        {
+            std::shared_ptr<VectorType> runs = std::make_shared<VectorType>();
+            runs->reserve(std::max(n, this->size()));
+            runs->assign(this->begin(), this->end());
+            m_Runs = runs;
+        }
+    }
+
+    void swap(RLELine & other) { m_Runs.swap(other.m_Runs); }
+
+    /** Whether other copies of the line refer to the same runs */
+    bool IsShared() const { return m_Runs && m_Runs.use_count() > 1; }
+
+    /** The number of lines that refer to the runs of this line */
+    long GetNumberOfReferences() const { return m_Runs.use_count(); }
+
+    /** Whether the two lines refer to the same runs */
+    bool IsSharedWith(const RLELine & other) const
+    {
+        return m_Runs == other.m_Runs;
+    }
+
+    /** Refer to the runs of the other line if it holds the same runs.
+    * Returns true if the runs were not already shared. */
+    bool ShareIfEqual(const RLELine & other)
+    {
+        if (m_Runs == other.m_Runs || this->Runs() != other.Runs())
+            return false;
+        m_Runs = other.m_Runs;
+        return true;
+    }
+
+    bool operator==(const RLELine & other) const
+    {
+        return m_Runs == other.m_Runs || this->Runs() == other.Runs();
+    }
+
+    bool operator!=(const RLELine & other) const { return !(*this == other); }
+
+private:
+    const VectorType & Runs() const
+    {
+        static const VectorType noRuns;
+        return m_Runs ? *m_Runs : noRuns;
+    }
+
+    // Make the runs private to this line before they are modified
+    VectorType & Modifiable()
+    {
+        if (!m_Runs)
+            m_Runs = std::make_shared<VectorType>();
+        else if (m_Runs.use_count() > 1)
+            m_Runs = std::make_shared<VectorType>(*m_Runs);
+        else
+        {
+            // The last other copy may have just been released by another
+            // thread, whose reads of the runs must complete before our
+            // writes begin
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *m_Runs;
+    }
+
+    std::shared_ptr<VectorType> m_Runs;
+};
+
+#endif //RLELine_h
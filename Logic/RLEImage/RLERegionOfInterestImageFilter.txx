@@ -316,7 +316,7 @@ void RegionOfInterestImageFilter<Image<TPixel, VImageDimension>,
             }
             temp.push_back(s);
         }
-        oIt.Value() = temp;
+        oIt.Value().assign(temp.begin(), temp.end()); //sized to fit, not sharing temp
         ++oIt;
     }
 }
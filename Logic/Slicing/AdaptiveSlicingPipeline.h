@@ -48,7 +48,11 @@
 #include "itkDataObjectDecorator.h"
 #include "IRISSlicer.h"
 #include "NonOrthogonalSlicer.h"
+#include "SliceUpdateHistory.h"
 #include "SNAPCommon.h"
+#include <functional>
+#include <list>
+#include <vector>
 
 class ImageCoordinateTransform;
 
@@ -69,7 +73,8 @@ template<typename TParametersValueType,
  */
 template <typename TInputImage, typename TOutputImage, typename TPreviewImage>
 class AdaptiveSlicingPipeline
-    : public itk::ImageToImageFilter<TInputImage, TOutputImage>
+    : public itk::ImageToImageFilter<TInputImage, TOutputImage>,
+      public SliceUpdateHistory
 {
 public:
   /** Standard class typedefs. */
@@ -131,6 +136,15 @@ public:
   itkSetInputMacro(PreviewImage, PreviewImageType)
   itkGetInputMacro(PreviewImage, PreviewImageType)
 
+  /**
+   * Optional reduced-resolution copy of the input covering the same physical
+   * extent. When set, the orthogonal slicer samples this image instead of the
+   * main input (unless a preview image is present). Oblique slicing always
+   * uses the main input.
+   */
+  itkSetInputMacro(LowResolutionImage, InputImageType)
+  itkGetInputMacro(LowResolutionImage, InputImageType)
+
   /** Orthogonal Transform input */
   itkSetDecoratedObjectInputMacro(OrthogonalTransform, OrthogonalTransformType)
   itkGetDecoratedObjectInputMacro(OrthogonalTransform, OrthogonalTransformType)
@@ -151,6 +165,121 @@ public:
   void SetUseNearestNeighbor(bool flag);
   bool GetUseNearestNeighbor() const;
 
+  /**
+   * Subsampling factor of the oblique slicer, used to produce fast, coarse
+   * previews of oblique slices (e.g., while a transform is being dragged).
+   * A value of one gives full-resolution slices.
+   */
+  void SetObliqueSubsamplingFactor(unsigned int factor);
+  unsigned int GetObliqueSubsamplingFactor() const;
+
+  /**
+   * When slicing orthogonally, only generate the part of the slice that
+   * falls into the viewport described by the oblique reference image, plus a
+   * margin. The rest of the slice is left as it was, so this should only be
+   * enabled when nothing else displays the whole slice. The parts of the
+   * slice generated for the current slicing parameters are kept, so that
+   * panning only generates the newly exposed parts. Only images that can be
+   * sliced in parts (not RLE images) are restricted.
+   */
+  void SetRestrictToViewport(bool flag);
+  itkGetConstMacro(RestrictToViewport, bool)
+
+  /**
+   * Time, in seconds, after which an update restricted to the viewport stops
+   * generating parts of the slice, leaving the rest for the next updates.
+   * This is used for expensive preview inputs, so that the slice fills in
+   * progressively and a change to the preview parameters takes effect
+   * without waiting for the whole viewport. Zero (the default) means that
+   * the viewport is always generated whole.
+   */
+  itkSetMacro(UpdateTimeBudget, double)
+  itkGetConstMacro(UpdateTimeBudget, double)
+
+  /** Whether parts of the viewport were left for the next updates */
+  bool HasPendingViewportParts() const
+    { return m_ViewportPendingParts.size() > 0; }
+
+  /**
+   * Function that gives a key for the contents of the preview image, i.e., a
+   * hash of the preview parameters and of the inputs of the preview filter.
+   * It returns false if there is no such key (e.g., the preview is not ready)
+   */
+  typedef std::function<bool (unsigned long long &)> PreviewKeyFunction;
+
+  /**
+   * Keep up to max_slices slices assembled in the viewport from the preview
+   * image, keyed on the preview key and the slice. When the preview key
+   * changes, the slice assembled so far is kept, and if a slice was assembled
+   * before for the new key, it is shown again with its parts that were
+   * generated, instead of starting over. An empty function clears the cache.
+   */
+  void SetPreviewCache(const PreviewKeyFunction &key_function, unsigned int max_slices);
+
+  /**
+   * Bricked copy of the input, used by the orthogonal slicer for slices along
+   * the x axis (see IRISSlicer::SetBrickedBuffer). The slices are the same
+   * with or without it, so this does not modify the pipeline.
+   */
+  typedef typename OrthogonalSlicerType::BrickedBufferType BrickedBufferType;
+  void SetBrickedBuffer(BrickedBufferType *buffer)
+    { m_OrthogonalSlicer->SetBrickedBuffer(buffer); }
+
+  /**
+   * Identifies the slice that the orthogonal slicer produces with a given
+   * set of parameters, so that slices of other images of the same geometry
+   * (e.g., other time points) can be computed ahead of time
+   */
+  struct OrthogonalSliceKey
+  {
+    unsigned int Axis = 0, Index = 0;
+    itk::ModifiedTimeType TransformMTime = 0;
+
+    bool operator == (const OrthogonalSliceKey &other) const
+    {
+      return Axis == other.Axis && Index == other.Index
+          && TransformMTime == other.TransformMTime;
+    }
+  };
+
+  /**
+   * Get the key of the slice for the current parameters. Returns false when
+   * the pipeline is not slicing the full-resolution input orthogonally, since
+   * then the slice cannot be computed from another image of the same geometry
+   */
+  bool GetOrthogonalSliceKey(OrthogonalSliceKey &key);
+
+  /**
+   * Create a standalone orthogonal slicer with the current parameters, that
+   * slices the given image instead of the input. The slicer shares no state
+   * with this pipeline, so it can be updated in a background thread.
+   */
+  typename OrthogonalSlicerType::Pointer CreateOrthogonalSlicer(const InputImageType *image);
+
+  /**
+   * Supply a slice of the input computed ahead of time. On the next update,
+   * if the slicing parameters still match the key, the slice is passed to
+   * the output instead of slicing the input. The slice is only used once.
+   */
+  void SetPrecomputedSlice(OutputImageType *slice, const OrthogonalSliceKey &key);
+
+  /**
+   * Report that the voxels of an image that shares its pixel container with
+   * the input changed only within a region, between two of the image's
+   * modified times. The orthogonal slicer uses this to only regenerate the
+   * part of the slice that crosses the region.
+   */
+  void AddInputModifiedRegion(const InputImageType *source,
+                              itk::ModifiedTimeType before,
+                              itk::ModifiedTimeType after,
+                              const InputImageRegionType &region);
+
+  virtual unsigned long GetSliceVersion() const ITK_OVERRIDE
+    { return m_SliceVersion; }
+
+  virtual bool GetSliceRegionModifiedSince(
+      unsigned long version, SliceRegionType &region) const ITK_OVERRIDE;
+
 protected:
 
   AdaptiveSlicingPipeline();
@@ -175,6 +304,76 @@ protected:
 
   IndexType m_SliceIndex;
 
+  OutputImagePointer m_PrecomputedSlice;
+  OrthogonalSliceKey m_PrecomputedSliceKey;
+
+  // Version of the output slice, and whether the last update only changed
+  // the given region of the previous version
+  unsigned long m_SliceVersion = 0;
+  bool m_LastUpdateIsPartial = false;
+  OutputImageRegionType m_LastUpdatedRegion;
+
+  // Version of the orthogonal slicer output grafted by the last update, or
+  // zero if the last update used a different source
+  unsigned long m_GraftedOrthogonalSliceVersion = 0;
+
+  // Slicing restricted to the viewport: the slice assembled from the parts
+  // generated so far, the part that is valid, and the modified time of the
+  // slicer and its inputs when it was generated
+  bool m_RestrictToViewport = false;
+  OutputImagePointer m_ViewportSlice;
+  OutputImageRegionType m_ViewportValidRegion;
+  itk::ModifiedTimeType m_ViewportSliceMTime = 0;
+  bool m_LastUpdateUsedViewportSlice = false;
+
+  // Progressive updates: the time allowed per update, and the parts of the
+  // valid region that are still to be generated
+  double m_UpdateTimeBudget = 0.0;
+  std::vector<OutputImageRegionType> m_ViewportPendingParts;
+
+  // Slices assembled for other preview keys, the most recently used first.
+  // A slice keeps its valid region and the parts still to be generated
+  struct ViewportCacheKey
+  {
+    unsigned long long Preview = 0;
+    OrthogonalSliceKey Slice;
+
+    bool operator == (const ViewportCacheKey &other) const
+      { return Preview == other.Preview && Slice == other.Slice; }
+  };
+
+  struct ViewportCacheEntry
+  {
+    ViewportCacheKey Key;
+    OutputImagePointer Slice;
+    OutputImageRegionType ValidRegion;
+    std::vector<OutputImageRegionType> PendingParts;
+  };
+
+  PreviewKeyFunction m_PreviewKeyFunction;
+  unsigned int m_PreviewCacheSize = 0;
+  std::list<ViewportCacheEntry> m_ViewportCache;
+
+  // Key of the slice being assembled, if it has one
+  ViewportCacheKey m_ViewportSliceKey;
+  bool m_ViewportSliceHasKey = false;
+
+  // Get the cache key for the current preview and slicing parameters
+  bool GetViewportCacheKey(ViewportCacheKey &key);
+
+  // Margin around the viewport, in slice pixels
+  static constexpr long VIEWPORT_MARGIN = 16;
+
+  // Progressive updates generate bands of lines of about this many pixels
+  static constexpr long VIEWPORT_BAND_PIXELS = 1l << 15;
+
+  // Find the part of the orthogonal slice in the viewport. Returns false if
+  // the slice is not restricted to the viewport.
+  bool ComputeViewportRegion(OutputImageRegionType &region);
+
+  // Generate the part of the orthogonal slice in the viewport
+  void GenerateViewportSlice(const OutputImageRegionType &region);
+
   void MapInputsToSlicers();  
 };
 
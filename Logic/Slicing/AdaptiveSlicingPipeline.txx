@@ -45,6 +45,12 @@
 
 #include "AdaptiveSlicingPipeline.h"
 #include "IRISVectorTypesToITKConversion.h"
+#include "SNAPProfiler.h"
+#include "itkImageAlgorithm.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
 
 template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
 AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
@@ -74,7 +80,13 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
 {
   if(m_UseOrthogonalSlicing)
     {
-    m_OrthogonalSlicer->SetInput(this->GetInput());
+    // The reduced-resolution image is only used when there is no preview,
+    // since the preview image is always at the resolution of the input
+    const InputImageType *low_res = this->GetLowResolutionImage();
+    if(this->GetPreviewImage())
+      low_res = nullptr;
+
+    m_OrthogonalSlicer->SetInput(low_res ? low_res : this->GetInput());
     m_OrthogonalSlicer->SetPreviewInput(
           const_cast<PreviewImageType *>(this->GetPreviewImage()));
 
@@ -98,9 +110,18 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
     m_OrthogonalSlicer->SetLineTraverseForward(
           tinv->GetCoordinateOrientation(1) > 0);
 
-    // Set the slice index
-    m_OrthogonalSlicer->SetSliceIndex(
-          m_SliceIndex[m_OrthogonalSlicer->GetSliceDirectionImageAxis()]);
+    // Set the slice index. For the reduced-resolution image, the index is
+    // mapped to the coarse voxel that contains the center of the fine voxel
+    unsigned int slice_axis = m_OrthogonalSlicer->GetSliceDirectionImageAxis();
+    long slice_index = m_SliceIndex[slice_axis];
+    if(low_res)
+      {
+      long n_fine = this->GetInput()->GetLargestPossibleRegion().GetSize()[slice_axis];
+      long n_coarse = low_res->GetLargestPossibleRegion().GetSize()[slice_axis];
+      slice_index = (long) std::floor((slice_index + 0.5) * n_coarse / n_fine);
+      slice_index = std::max(0l, std::min(slice_index, n_coarse - 1));
+      }
+    m_OrthogonalSlicer->SetSliceIndex(slice_index);
     }
   else
     {
@@ -171,20 +192,468 @@ void
 AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
 ::GenerateData()
 {
+  SNAP_PROFILE_SCOPE("Slicing");
+
   // Get the outer filter's output
   OutputImageType *output = this->GetOutput();
 
+  // Use a slice computed ahead of time if it matches the current parameters
+  if(m_PrecomputedSlice)
+    {
+    OutputImagePointer slice = m_PrecomputedSlice;
+    m_PrecomputedSlice = nullptr;
+
+    OrthogonalSliceKey key;
+    if(this->GetOrthogonalSliceKey(key) && key == m_PrecomputedSliceKey
+       && slice->GetLargestPossibleRegion() == output->GetLargestPossibleRegion())
+      {
+      output->Graft(slice);
+      m_SliceVersion++;
+      m_LastUpdateIsPartial = false;
+      m_GraftedOrthogonalSliceVersion = 0;
+      m_LastUpdateUsedViewportSlice = false;
+      return;
+      }
+    }
+
+  // Only generate the part of the slice in view, if requested
+  OutputImageRegionType viewport;
+  if(m_UseOrthogonalSlicing && this->ComputeViewportRegion(viewport))
+    {
+    this->GenerateViewportSlice(viewport);
+    m_SliceVersion++;
+    return;
+    }
+  m_LastUpdateUsedViewportSlice = false;
+
   // Use appropriate sub-pipeline
   if(m_UseOrthogonalSlicing)
     {
     m_OrthogonalSlicer->Update();
     output->Graft(m_OrthogonalSlicer->GetOutput());
+
+    // The change to the output is only known if the last update also grafted
+    // the output of the orthogonal slicer, and the slicer has not updated
+    // more than once since then
+    unsigned long v_prev = m_GraftedOrthogonalSliceVersion;
+    unsigned long v = m_OrthogonalSlicer->GetSliceVersion();
+    m_LastUpdateIsPartial = false;
+    if(v_prev && v == v_prev)
+      {
+      m_LastUpdateIsPartial = true;
+      m_LastUpdatedRegion = OutputImageRegionType();
+      }
+    else if(v_prev && v == v_prev + 1)
+      {
+      m_LastUpdateIsPartial = m_OrthogonalSlicer->GetLastUpdatedRegion(m_LastUpdatedRegion);
+      }
+    m_GraftedOrthogonalSliceVersion = v;
     }
   else
     {
     m_ObliqueSlicer->Update();
     output->Graft(m_ObliqueSlicer->GetOutput());
+    m_LastUpdateIsPartial = false;
+    m_GraftedOrthogonalSliceVersion = 0;
+    }
+
+  m_SliceVersion++;
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+bool
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::ComputeViewportRegion(OutputImageRegionType &region)
+{
+  // The reduced-resolution input is always sliced whole
+  const InputImageType *input = this->GetInput();
+  const NonOrthogonalSliceReferenceSpace *ref = this->GetObliqueReferenceImage();
+  if(!OrthogonalSlicerType::SupportsPartialSlices || !m_RestrictToViewport
+     || !ref || m_OrthogonalSlicer->GetInput() != input)
+    return false;
+
+  // Map the corners of the viewport into the slice
+  typename NonOrthogonalSliceReferenceSpace::SizeType vsz = ref->GetLargestPossibleRegion().GetSize();
+  unsigned int axis[2] = { m_OrthogonalSlicer->GetPixelDirectionImageAxis(),
+                           m_OrthogonalSlicer->GetLineDirectionImageAxis() };
+  bool forward[2] = { m_OrthogonalSlicer->GetPixelTraverseForward(),
+                      m_OrthogonalSlicer->GetLineTraverseForward() };
+  typename InputImageType::SizeType isz = input->GetLargestPossibleRegion().GetSize();
+
+  double lo[2] = { 1e100, 1e100 }, hi[2] = { -1e100, -1e100 };
+  for(unsigned int c = 0; c < 4; c++)
+    {
+    itk::ContinuousIndex<double, InputImageDimension> cv, ci;
+    cv.Fill(0.0);
+    cv[0] = (c & 1) ? vsz[0] - 0.5 : -0.5;
+    cv[1] = (c & 2) ? vsz[1] - 0.5 : -0.5;
+
+    itk::Point<double, InputImageDimension> p;
+    ref->TransformContinuousIndexToPhysicalPoint(cv, p);
+    input->TransformPhysicalPointToContinuousIndex(p, ci);
+
+    for(unsigned int d = 0; d < 2; d++)
+      {
+      double u = forward[d] ? ci[axis[d]] : isz[axis[d]] - 1 - ci[axis[d]];
+      lo[d] = std::min(lo[d], u);
+      hi[d] = std::max(hi[d], u);
+      }
+    }
+
+  // Pixels whose extent overlaps the viewport, plus the margin
+  const OutputImageRegionType &lpr = this->GetOutput()->GetLargestPossibleRegion();
+  for(unsigned int d = 0; d < 2; d++)
+    {
+    long i0 = (long) std::floor(std::max(lo[d], -1e9) + 0.5) - VIEWPORT_MARGIN;
+    long i1 = (long) std::floor(std::min(hi[d], 1e9) + 0.5) + VIEWPORT_MARGIN;
+    region.SetIndex(d, i0);
+    region.SetSize(d, (itk::SizeValueType) std::max(0l, i1 - i0 + 1));
+    }
+
+  // The viewport may be entirely outside of the slice
+  if(!region.Crop(lpr))
+    {
+    region.SetIndex(lpr.GetIndex());
+    region.SetSize(0, 0);
+    region.SetSize(1, 0);
+    }
+  return true;
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::GenerateViewportSlice(const OutputImageRegionType &region)
+{
+  OutputImageType *output = this->GetOutput();
+  const OutputImageType *sliced = m_OrthogonalSlicer->GetOutput();
+  const OutputImageRegionType &lpr = output->GetLargestPossibleRegion();
+
+  // The parts generated so far remain valid as long as the slicer and its
+  // inputs are not modified. The preview image is modified whenever a part
+  // of it is generated, so only a change to its pipeline counts.
+  itk::ModifiedTimeType mtime = m_OrthogonalSlicer->GetMTime();
+  const InputImageType *input = this->GetInput();
+  mtime = std::max(mtime, std::max(input->GetMTime(), input->GetPipelineMTime()));
+  if(const PreviewImageType *preview = this->GetPreviewImage())
+    mtime = std::max(mtime, preview->GetPipelineMTime());
+
+  // With a preview cache, the slice only starts over when its key changes.
+  // The slice assembled so far is then kept in the cache, and the slice
+  // assembled before for the new key, if any, is taken out of it.
+  ViewportCacheKey key;
+  bool has_key = this->GetViewportCacheKey(key);
+  bool same_key = has_key && m_ViewportSliceHasKey && key == m_ViewportSliceKey;
+  bool restored = false;
+  unsigned int ncomp = sliced->GetNumberOfComponentsPerPixel();
+
+  if(!m_ViewportSlice || m_ViewportSlice->GetLargestPossibleRegion() != lpr
+     || m_ViewportSlice->GetNumberOfComponentsPerPixel() != ncomp)
+    {
+    m_ViewportSlice = nullptr;
+    }
+  else if(mtime != m_ViewportSliceMTime && !same_key)
+    {
+    ViewportCacheEntry entry;
+    for(auto it = m_ViewportCache.begin(); has_key && it != m_ViewportCache.end(); ++it)
+      {
+      if(it->Key == key)
+        {
+        entry = *it;
+        m_ViewportCache.erase(it);
+        break;
+        }
+      }
+
+    bool kept = has_key && m_ViewportSliceHasKey && m_ViewportValidRegion.GetNumberOfPixels() > 0;
+    if(kept)
+      {
+      ViewportCacheEntry current;
+      current.Key = m_ViewportSliceKey;
+      current.Slice = m_ViewportSlice;
+      current.ValidRegion = m_ViewportValidRegion;
+      current.PendingParts = m_ViewportPendingParts;
+      m_ViewportCache.push_front(current);
+      if(m_ViewportCache.size() > m_PreviewCacheSize)
+        m_ViewportCache.pop_back();
+      }
+
+    if(entry.Slice && entry.Slice->GetLargestPossibleRegion() == lpr
+       && entry.Slice->GetNumberOfComponentsPerPixel() == ncomp)
+      {
+      m_ViewportSlice = entry.Slice;
+      m_ViewportValidRegion = entry.ValidRegion;
+      m_ViewportPendingParts = entry.PendingParts;
+      restored = true;
+      }
+    else
+      {
+      if(kept)
+        m_ViewportSlice = nullptr;
+      m_ViewportValidRegion = OutputImageRegionType();
+      m_ViewportPendingParts.clear();
+      }
+    }
+
+  if(!m_ViewportSlice)
+    {
+    m_ViewportSlice = OutputImageType::New();
+    m_ViewportSlice->CopyInformation(sliced);
+    m_ViewportSlice->SetNumberOfComponentsPerPixel(ncomp);
+    m_ViewportSlice->SetRegions(lpr);
+    m_ViewportSlice->Allocate();
+    m_ViewportValidRegion = OutputImageRegionType();
+    m_ViewportPendingParts.clear();
     }
+  m_ViewportSliceKey = key;
+  m_ViewportSliceHasKey = has_key;
+
+  // Find the parts of the viewport that have not been generated. When the
+  // viewport overlaps the valid region, the valid region grows to include
+  // the viewport, so that panning only generates the strips exposed on the
+  // sides. Otherwise, the valid region starts over.
+  OutputImageRegionType &valid = m_ViewportValidRegion;
+  std::vector<OutputImageRegionType> parts;
+  OutputImageRegionType overlap = region;
+  if(region.GetNumberOfPixels() == 0)
+    {
+    // Nothing is in view
+    }
+  else if(valid.GetNumberOfPixels() == 0 || !overlap.Crop(valid))
+    {
+    parts.push_back(region);
+    valid = region;
+    }
+  else if(!valid.IsInside(region))
+    {
+    long v0[2], v1[2], b0[2], b1[2];
+    for(unsigned int d = 0; d < 2; d++)
+      {
+      v0[d] = (long) valid.GetIndex(d);
+      v1[d] = v0[d] + (long) valid.GetSize(d);
+      b0[d] = std::min(v0[d], (long) region.GetIndex(d));
+      b1[d] = std::max(v1[d], (long) region.GetIndex(d) + (long) region.GetSize(d));
+      }
+
+    // The bounding box minus the valid region, as up to four strips: the
+    // lines below and above it, then the pixels left and right of it
+    long strips[4][4] = {
+      { b0[0], b0[1], b1[0], v0[1] },
+      { b0[0], v1[1], b1[0], b1[1] },
+      { b0[0], v0[1], v0[0], v1[1] },
+      { v1[0], v0[1], b1[0], v1[1] } };
+    for(auto &s : strips)
+      {
+      if(s[2] > s[0] && s[3] > s[1])
+        {
+        OutputImageRegionType part;
+        part.SetIndex(0, s[0]); part.SetIndex(1, s[1]);
+        part.SetSize(0, s[2] - s[0]); part.SetSize(1, s[3] - s[1]);
+        parts.push_back(part);
+        }
+      }
+
+    valid.SetIndex(0, b0[0]); valid.SetIndex(1, b0[1]);
+    valid.SetSize(0, b1[0] - b0[0]); valid.SetSize(1, b1[1] - b0[1]);
+    }
+
+  // The parts left over by the previous update come first
+  parts.insert(parts.begin(), m_ViewportPendingParts.begin(), m_ViewportPendingParts.end());
+  m_ViewportPendingParts.clear();
+
+  // Generate the missing parts and copy them into the assembled slice. With
+  // a time budget, the parts are generated in bands of lines, and the bands
+  // left when the time runs out are kept for the next update
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point t_start = Clock::now();
+  OutputImageRegionType updated;
+  for(size_t k = 0; k < parts.size(); k++)
+    {
+    OutputImageRegionType part = parts[k];
+    if(m_UpdateTimeBudget > 0.0)
+      {
+      long lines = std::max(1l, VIEWPORT_BAND_PIXELS / std::max(1l, (long) part.GetSize(0)));
+      if((long) part.GetSize(1) > lines)
+        {
+        OutputImageRegionType rest = part;
+        rest.SetIndex(1, part.GetIndex(1) + lines);
+        rest.SetSize(1, part.GetSize(1) - lines);
+        part.SetSize(1, lines);
+        parts.insert(parts.begin() + k + 1, rest);
+        }
+      }
+
+    m_OrthogonalSlicer->GetOutput()->SetRequestedRegion(part);
+    m_OrthogonalSlicer->Update();
+    itk::ImageAlgorithm::Copy(m_OrthogonalSlicer->GetOutput(), m_ViewportSlice.GetPointer(), part, part);
+
+    if(updated.GetNumberOfPixels() == 0)
+      {
+      updated = part;
+      }
+    else
+      {
+      for(unsigned int d = 0; d < 2; d++)
+        {
+        long i0 = std::min((long) updated.GetIndex(d), (long) part.GetIndex(d));
+        long i1 = std::max((long) updated.GetIndex(d) + (long) updated.GetSize(d),
+                           (long) part.GetIndex(d) + (long) part.GetSize(d));
+        updated.SetIndex(d, i0);
+        updated.SetSize(d, i1 - i0);
+        }
+      }
+
+    std::chrono::duration<double> elapsed = Clock::now() - t_start;
+    if(m_UpdateTimeBudget > 0.0 && elapsed.count() > m_UpdateTimeBudget)
+      {
+      m_ViewportPendingParts.assign(parts.begin() + k + 1, parts.end());
+      break;
+      }
+    }
+  m_ViewportSliceMTime = mtime;
+
+  output->Graft(m_ViewportSlice);
+
+  // Downstream filters that saw the previous version of the assembled slice
+  // only need to process the generated parts, unless the slice was taken
+  // from the cache. The pixels outside the valid region are stale, but they
+  // are out of view.
+  m_LastUpdateIsPartial = m_LastUpdateUsedViewportSlice && !restored;
+  m_LastUpdatedRegion = updated;
+  m_LastUpdateUsedViewportSlice = true;
+  m_GraftedOrthogonalSliceVersion = 0;
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::SetRestrictToViewport(bool flag)
+{
+  if(flag != m_RestrictToViewport)
+    {
+    m_RestrictToViewport = flag;
+    this->Modified();
+    }
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::SetPreviewCache(const PreviewKeyFunction &key_function, unsigned int max_slices)
+{
+  m_PreviewKeyFunction = key_function;
+  m_PreviewCacheSize = key_function ? max_slices : 0;
+  m_ViewportCache.clear();
+  m_ViewportSliceHasKey = false;
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+bool
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::GetViewportCacheKey(ViewportCacheKey &key)
+{
+  if(!m_PreviewKeyFunction || !m_PreviewCacheSize
+     || !this->GetPreviewImage() || !this->GetOrthogonalTransformInput())
+    return false;
+
+  key.Slice.Axis = m_OrthogonalSlicer->GetSliceDirectionImageAxis();
+  key.Slice.Index = m_OrthogonalSlicer->GetSliceIndex();
+  key.Slice.TransformMTime = this->GetOrthogonalTransformInput()->GetMTime();
+  return m_PreviewKeyFunction(key.Preview);
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::AddInputModifiedRegion(const InputImageType *source,
+                         itk::ModifiedTimeType before,
+                         itk::ModifiedTimeType after,
+                         const InputImageRegionType &region)
+{
+  m_OrthogonalSlicer->AddInputModifiedRegion(source, before, after, region);
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+bool
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::GetSliceRegionModifiedSince(unsigned long version, SliceRegionType &region) const
+{
+  if(version == m_SliceVersion)
+    {
+    region = SliceRegionType();
+    return true;
+    }
+  else if(version + 1 == m_SliceVersion && m_LastUpdateIsPartial)
+    {
+    region = m_LastUpdatedRegion;
+    return true;
+    }
+  return false;
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+bool
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::GetOrthogonalSliceKey(OrthogonalSliceKey &key)
+{
+  if(!m_UseOrthogonalSlicing || !this->GetInput() || !this->GetOrthogonalTransformInput()
+     || this->GetPreviewImage() || this->GetLowResolutionImage())
+    return false;
+
+  // Make sure the slicer reflects the current parameters
+  this->MapInputsToSlicers();
+
+  key.Axis = m_OrthogonalSlicer->GetSliceDirectionImageAxis();
+  key.Index = m_OrthogonalSlicer->GetSliceIndex();
+  key.TransformMTime = this->GetOrthogonalTransformInput()->GetMTime();
+  return true;
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+typename AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>::OrthogonalSlicerType::Pointer
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::CreateOrthogonalSlicer(const InputImageType *image)
+{
+  this->MapInputsToSlicers();
+
+  typename OrthogonalSlicerType::Pointer slicer = OrthogonalSlicerType::New();
+  slicer->SetInput(image);
+  slicer->SetSliceDirectionImageAxis(m_OrthogonalSlicer->GetSliceDirectionImageAxis());
+  slicer->SetLineDirectionImageAxis(m_OrthogonalSlicer->GetLineDirectionImageAxis());
+  slicer->SetPixelDirectionImageAxis(m_OrthogonalSlicer->GetPixelDirectionImageAxis());
+  slicer->SetPixelTraverseForward(m_OrthogonalSlicer->GetPixelTraverseForward());
+  slicer->SetLineTraverseForward(m_OrthogonalSlicer->GetLineTraverseForward());
+  slicer->SetSliceIndex(m_OrthogonalSlicer->GetSliceIndex());
+  return slicer;
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::SetPrecomputedSlice(OutputImageType *slice, const OrthogonalSliceKey &key)
+{
+  m_PrecomputedSlice = slice;
+  m_PrecomputedSliceKey = key;
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::SetObliqueSubsamplingFactor(unsigned int factor)
+{
+  if(factor != m_ObliqueSlicer->GetSubsamplingFactor())
+    {
+    m_ObliqueSlicer->SetSubsamplingFactor(factor);
+    this->Modified();
+    }
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+unsigned int
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::GetObliqueSubsamplingFactor() const
+{
+  return m_ObliqueSlicer->GetSubsamplingFactor();
 }
 
 #endif // ADAPTIVESLICINGPIPELINE_TXX
@@ -0,0 +1,52 @@
+#include "BrickCompression.h"
+#include <itk_zlib.h>
+#include <cstring>
+
+namespace BrickCompression
+{
+
+enum BlockType { BLOCK_RAW = 0, BLOCK_DEFLATED = 1 };
+
+bool Encode(const unsigned char *data, size_t n, std::vector<unsigned char> &out)
+{
+  uLongf n_packed = compressBound((uLong) n);
+  out.resize(1 + n_packed);
+  if(compress2(out.data() + 1, &n_packed, data, (uLong) n, 1) != Z_OK)
+    return false;
+
+  // Incompressible data (e.g., noise in floating point images) is kept as is
+  if(n_packed < n)
+    {
+    out[0] = BLOCK_DEFLATED;
+    out.resize(1 + n_packed);
+    }
+  else
+    {
+    out[0] = BLOCK_RAW;
+    out.resize(1 + n);
+    memcpy(out.data() + 1, data, n);
+    }
+
+  out.shrink_to_fit();
+  return true;
+}
+
+bool Decode(const std::vector<unsigned char> &block, unsigned char *data, size_t n)
+{
+  if(block.empty())
+    return false;
+
+  if(block[0] == BLOCK_RAW)
+    {
+    if(block.size() != n + 1)
+      return false;
+    memcpy(data, block.data() + 1, n);
+    return true;
+    }
+
+  uLongf n_unpacked = (uLongf) n;
+  return uncompress(data, &n_unpacked, block.data() + 1, (uLong) (block.size() - 1)) == Z_OK
+      && n_unpacked == n;
+}
+
+}
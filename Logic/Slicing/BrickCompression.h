@@ -0,0 +1,28 @@
+#ifndef BRICKCOMPRESSION_H
+#define BRICKCOMPRESSION_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Lossless coding of small blocks of voxel data, such as the bricks of a
+ * BrickedImageBuffer. The block is deflated with the fastest zlib setting,
+ * and is stored as is if that does not make it smaller. The first byte of the
+ * coded block records which of the two was done.
+ *
+ * Blocks compress much better if neighboring values are replaced by their
+ * differences and the bytes of the values are grouped by significance before
+ * coding, which the caller is expected to do.
+ */
+namespace BrickCompression
+{
+
+/** Code n bytes of data into the output, returns false if zlib fails */
+bool Encode(const unsigned char *data, size_t n, std::vector<unsigned char> &out);
+
+/** Decode a block into exactly n bytes, returns false if the block is corrupt */
+bool Decode(const std::vector<unsigned char> &block, unsigned char *data, size_t n);
+
+}
+
+#endif // BRICKCOMPRESSION_H
@@ -0,0 +1,569 @@
+#ifndef BRICKEDIMAGEBUFFER_H
+#define BRICKEDIMAGEBUFFER_H
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkMultiThreaderBase.h>
+#include <itkImageBase.h>
+#include "BrickCompression.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A copy of the voxels of a 3D image in a bricked layout, used by the
+ * orthogonal slicer to extract slices along the x axis. In the standard
+ * x-fastest layout, such slices read a single voxel from every cache line, so
+ * they are several times slower than slices along z. Here, the image is split
+ * into bricks of 16^3 voxels, and the voxels in each brick are stored in
+ * Morton (z-curve) order, so that every cache line holds a small cube of
+ * voxels and slices in all three directions read memory equally well.
+ *
+ * The copy is made when first needed and is rebuilt when the source image is
+ * modified or replaced by another image (e.g., another time point). It costs
+ * as much memory as the image itself, so it is optional, and it is released
+ * with the other caches when memory runs low.
+ *
+ * The buffer can also hold the only copy of the voxels, compressed brick by
+ * brick (see Compress). The image that owns the voxels then releases its own
+ * buffer, and the slicers read all their slices from here: the layer of
+ * bricks crossed by a slice is decompressed when first needed and kept in a
+ * small least recently used cache, so that scrolling decompresses each layer
+ * once per 16 slices.
+ */
+template <class TComponent>
+class BrickedImageBuffer : public itk::Object
+{
+public:
+  typedef BrickedImageBuffer                                   Self;
+  typedef itk::Object                                    Superclass;
+  typedef itk::SmartPointer<Self>                           Pointer;
+  typedef itk::SmartPointer<const Self>                ConstPointer;
+
+  itkNewMacro(Self)
+  itkTypeMacro(BrickedImageBuffer, itk::Object)
+
+  // Bricks have 2^BrickBits voxels on each side
+  static constexpr unsigned int BrickBits = 4;
+  static constexpr unsigned int BrickSize = 1u << BrickBits;
+  static constexpr size_t BrickVoxels = size_t(1) << (3 * BrickBits);
+
+  // Number of decompressed layers of bricks kept for slicing
+  static constexpr unsigned int LayerCacheSize = 6;
+
+  /**
+   * The voxels of one slice: the offset (in components) of a voxel from the
+   * base pointer is the sum of the offsets of its two in-plane coordinates in
+   * the tables of the in-plane axes. The slice remains valid while this
+   * object is held, even if the buffer releases its caches meanwhile.
+   */
+  struct Slice
+  {
+    const TComponent *Base = nullptr;
+    const size_t *Offsets[3] = { nullptr, nullptr, nullptr };
+    std::shared_ptr<const std::vector<TComponent> > Layer;
+  };
+
+  /**
+   * Make sure that the bricked copy matches the given image buffer, which
+   * holds ncomp components per voxel in x-fastest order, building it if
+   * necessary. The modified time of the image identifies its contents. This
+   * does nothing while the buffer holds compressed voxels, since the image
+   * has no voxels of its own then.
+   */
+  void Update(const itk::ImageBase<3> *image, const TComponent *buffer, unsigned int ncomp)
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    if(m_Compressed)
+      return;
+
+    typename itk::ImageBase<3>::SizeType size = image->GetBufferedRegion().GetSize();
+    if(buffer == m_Source && image->GetMTime() == m_SourceMTime
+       && size == m_Size && ncomp == m_Components)
+      return;
+
+    m_Source = buffer;
+    m_SourceMTime = image->GetMTime();
+    m_Size = size;
+    m_Components = ncomp;
+    this->Build(buffer);
+  }
+
+  /**
+   * Release the bricked copy, which is rebuilt on the next update, or the
+   * decompressed layers if the voxels are held compressed
+   */
+  void Release()
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    this->ReleaseCaches();
+    if(!m_Compressed)
+      {
+      std::vector<TComponent>().swap(m_Data);
+      for(unsigned int a = 0; a < 3; a++)
+        std::vector<size_t>().swap(m_AxisOffsets[a]);
+      m_Source = nullptr;
+      m_SourceMTime = 0;
+      }
+  }
+
+  /**
+   * Compress the voxels of an image buffer in x-fastest order, brick by
+   * brick, so that the caller can release the buffer. Integer values are
+   * replaced by their differences along the Morton order, and the bytes of
+   * the values are grouped by significance, before the bricks are deflated.
+   * Returns false, leaving the buffer as it was, if compression fails.
+   */
+  bool Compress(const itk::ImageBase<3> *image, const TComponent *buffer, unsigned int ncomp)
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    this->ReleaseCaches();
+    std::vector<TComponent>().swap(m_Data);
+    m_Source = nullptr;
+    m_SourceMTime = 0;
+    m_Size = image->GetBufferedRegion().GetSize();
+    m_Components = ncomp;
+    this->ComputeLayout();
+
+    std::vector<std::vector<unsigned char> > bricks(m_NumberOfBricks);
+    std::atomic<bool> ok(true);
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray(0, m_NumberOfBricks, [&](itk::SizeValueType b)
+      {
+      std::vector<TComponent> voxels(BrickVoxels * m_Components, TComponent(0));
+      this->ForEachBrickVoxel(b, [&](size_t morton, size_t image_offset)
+        {
+        std::copy(buffer + image_offset, buffer + image_offset + m_Components,
+                  voxels.data() + morton);
+        });
+      if(!this->EncodeBrick(voxels, bricks[b]))
+        ok = false;
+      }, nullptr);
+
+    if(!ok)
+      {
+      this->ClearLayout();
+      return false;
+      }
+
+    m_Bricks.swap(bricks);
+    m_Compressed = true;
+    return true;
+  }
+
+  /**
+   * Decompress the voxels into an image buffer in x-fastest order and
+   * discard the compressed copy. Returns false if a brick is corrupt.
+   */
+  bool Decompress(TComponent *buffer)
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    if(!m_Compressed)
+      return false;
+
+    std::atomic<bool> ok(true);
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray(0, m_NumberOfBricks, [&](itk::SizeValueType b)
+      {
+      std::vector<TComponent> voxels(BrickVoxels * m_Components);
+      if(!this->DecodeBrick(m_Bricks[b], voxels))
+        {
+        ok = false;
+        return;
+        }
+      this->ForEachBrickVoxel(b, [&](size_t morton, size_t image_offset)
+        {
+        std::copy(voxels.data() + morton, voxels.data() + morton + m_Components,
+                  buffer + image_offset);
+        });
+      }, nullptr);
+
+    this->ReleaseCaches();
+    std::vector<std::vector<unsigned char> >().swap(m_Bricks);
+    this->ClearLayout();
+    m_Compressed = false;
+    return ok;
+  }
+
+  /** Discard the compressed voxels, if any, and the bricked copy */
+  void Discard()
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    this->ReleaseCaches();
+    std::vector<std::vector<unsigned char> >().swap(m_Bricks);
+    std::vector<TComponent>().swap(m_Data);
+    this->ClearLayout();
+    m_Compressed = false;
+    m_Source = nullptr;
+    m_SourceMTime = 0;
+  }
+
+  /** Whether the buffer holds the compressed voxels of the image */
+  bool IsCompressed() const
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_Compressed;
+  }
+
+  /** Number of components per voxel of the buffered image */
+  unsigned int GetNumberOfComponents() const
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_Components;
+  }
+
+  /**
+   * Get the voxels of the slice with the given index along an axis. For the
+   * bricked copy, this requires an update with the image beforehand.
+   */
+  Slice GetSlice(unsigned int axis, size_t index)
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    Slice slice;
+    if(!m_Compressed)
+      {
+      slice.Base = m_Data.data() + m_AxisOffsets[axis][index];
+      for(unsigned int a = 0; a < 3; a++)
+        slice.Offsets[a] = m_AxisOffsets[a].data();
+      }
+    else
+      {
+      slice.Layer = this->GetLayer(axis, index >> BrickBits);
+      slice.Base = slice.Layer->data() + m_LayerOffsets[axis][axis][index];
+      for(unsigned int a = 0; a < 3; a++)
+        slice.Offsets[a] = m_LayerOffsets[axis][a].data();
+      }
+    return slice;
+  }
+
+  /** Copy the components of a voxel from the compressed voxels */
+  void GetVoxel(const itk::Index<3> &index, TComponent *out)
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+
+    // Use a decompressed layer that contains the voxel, if there is one
+    for(const Layer &layer : m_Layers)
+      {
+      if(layer.Index == size_t(index[layer.Axis]) >> BrickBits)
+        {
+        const TComponent *p = layer.Data->data();
+        for(unsigned int a = 0; a < 3; a++)
+          p += m_LayerOffsets[layer.Axis][a][index[a]];
+        std::copy(p, p + m_Components, out);
+        return;
+        }
+      }
+
+    // Otherwise decompress the brick that contains it
+    size_t brick = 0, within = 0;
+    for(unsigned int a = 0; a < 3; a++)
+      {
+      brick += (size_t(index[a]) >> BrickBits) * m_BrickStride[a];
+      within += SpreadBits(index[a] & (BrickSize - 1)) << a;
+      }
+    if(brick != m_VoxelBrickIndex)
+      {
+      m_VoxelBrick.resize(BrickVoxels * m_Components);
+      if(!this->DecodeBrick(m_Bricks[brick], m_VoxelBrick))
+        {
+        std::fill(out, out + m_Components, TComponent(0));
+        m_VoxelBrickIndex = (size_t) -1;
+        return;
+        }
+      m_VoxelBrickIndex = brick;
+      }
+    const TComponent *p = m_VoxelBrick.data() + within * m_Components;
+    std::copy(p, p + m_Components, out);
+  }
+
+  /** Bricked voxel data, addressed using the axis offsets */
+  const TComponent *GetBufferPointer() const { return m_Data.data(); }
+
+  /**
+   * The offset (in components) of the voxel data in the bricked buffer is the
+   * sum of the offsets of the voxel's x, y and z coordinates in these tables
+   */
+  const size_t *GetAxisOffsets(unsigned int axis) const { return m_AxisOffsets[axis].data(); }
+
+  /**
+   * Number of bytes held by the bricked copy, or by the decompressed layers
+   * and offset tables, not counting the compressed voxels
+   */
+  size_t GetNumberOfBytes() const
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    size_t bytes = m_Data.capacity() * sizeof(TComponent);
+    for(unsigned int a = 0; a < 3; a++)
+      {
+      bytes += m_AxisOffsets[a].capacity() * sizeof(size_t);
+      for(unsigned int b = 0; b < 3; b++)
+        bytes += m_LayerOffsets[a][b].capacity() * sizeof(size_t);
+      }
+    for(const Layer &layer : m_Layers)
+      bytes += layer.Data->capacity() * sizeof(TComponent);
+    bytes += m_VoxelBrick.capacity() * sizeof(TComponent);
+    return bytes;
+  }
+
+  /** Number of bytes held by the compressed voxels */
+  size_t GetNumberOfCompressedBytes() const
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    size_t bytes = m_Bricks.capacity() * sizeof(std::vector<unsigned char>);
+    for(const std::vector<unsigned char> &brick : m_Bricks)
+      bytes += brick.capacity();
+    return bytes;
+  }
+
+protected:
+  BrickedImageBuffer() {}
+  ~BrickedImageBuffer() {}
+
+  // Spread the bits of a coordinate within a brick so that the bits of the
+  // three coordinates interleave
+  static size_t SpreadBits(size_t v)
+  {
+    size_t r = 0;
+    for(unsigned int b = 0; b < BrickBits; b++)
+      r |= ((v >> b) & 1) << (3 * b);
+    return r;
+  }
+
+  void Build(const TComponent *buffer)
+  {
+    // Bricks are laid out in x-fastest order, whole bricks even at the edges
+    size_t n_bricks[3], brick_stride[3];
+    for(unsigned int a = 0; a < 3; a++)
+      n_bricks[a] = (m_Size[a] + BrickSize - 1) / BrickSize;
+    brick_stride[0] = 1;
+    brick_stride[1] = n_bricks[0];
+    brick_stride[2] = n_bricks[0] * n_bricks[1];
+
+    size_t brick_voxels = size_t(1) << (3 * BrickBits);
+    for(unsigned int a = 0; a < 3; a++)
+      {
+      m_AxisOffsets[a].resize(m_Size[a]);
+      for(size_t i = 0; i < m_Size[a]; i++)
+        m_AxisOffsets[a][i] = m_Components *
+            ((i >> BrickBits) * brick_stride[a] * brick_voxels + (SpreadBits(i & (BrickSize - 1)) << a));
+      }
+
+    m_Data.resize(n_bricks[0] * n_bricks[1] * n_bricks[2] * brick_voxels * m_Components);
+
+    // Scatter the voxels, one z-slice per work unit
+    size_t nx = m_Size[0], ny = m_Size[1], nc = m_Components;
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray(0, m_Size[2], [&](itk::SizeValueType z)
+      {
+      const TComponent *src = buffer + z * nx * ny * nc;
+      for(size_t y = 0; y < ny; y++)
+        {
+        TComponent *dst = m_Data.data() + m_AxisOffsets[2][z] + m_AxisOffsets[1][y];
+        for(size_t x = 0; x < nx; x++, src += nc)
+          std::copy(src, src + nc, dst + m_AxisOffsets[0][x]);
+        }
+      }, nullptr);
+  }
+
+  // Compute the brick counts and the offset tables used with compressed voxels
+  void ComputeLayout()
+  {
+    for(unsigned int a = 0; a < 3; a++)
+      m_BrickCount[a] = (m_Size[a] + BrickSize - 1) / BrickSize;
+    m_BrickStride[0] = 1;
+    m_BrickStride[1] = m_BrickCount[0];
+    m_BrickStride[2] = m_BrickCount[0] * m_BrickCount[1];
+    m_NumberOfBricks = m_BrickStride[2] * m_BrickCount[2];
+
+    // Within a layer of bricks normal to an axis, the bricks are laid out in
+    // the order of the other two axes, and the slice axis only selects the
+    // voxels within the bricks
+    for(unsigned int sa = 0; sa < 3; sa++)
+      {
+      size_t layer_stride[3] = { 0, 0, 0 };
+      size_t stride = 1;
+      for(unsigned int a = 0; a < 3; a++)
+        {
+        if(a != sa)
+          {
+          layer_stride[a] = stride;
+          stride *= m_BrickCount[a];
+          }
+        }
+
+      for(unsigned int a = 0; a < 3; a++)
+        {
+        m_LayerOffsets[sa][a].resize(m_Size[a]);
+        for(size_t i = 0; i < m_Size[a]; i++)
+          m_LayerOffsets[sa][a][i] = m_Components *
+              ((i >> BrickBits) * layer_stride[a] * BrickVoxels + (SpreadBits(i & (BrickSize - 1)) << a));
+        }
+      }
+  }
+
+  void ClearLayout()
+  {
+    for(unsigned int a = 0; a < 3; a++)
+      for(unsigned int b = 0; b < 3; b++)
+        std::vector<size_t>().swap(m_LayerOffsets[a][b]);
+    m_NumberOfBricks = 0;
+  }
+
+  void ReleaseCaches()
+  {
+    m_Layers.clear();
+    std::vector<TComponent>().swap(m_VoxelBrick);
+    m_VoxelBrickIndex = (size_t) -1;
+  }
+
+  // Visit the voxels of a brick that lie inside the image, passing the
+  // position of the voxel in the brick and in the image buffer (both in
+  // components)
+  template <class TFunction>
+  void ForEachBrickVoxel(size_t brick, TFunction f) const
+  {
+    size_t b[3] = { brick % m_BrickCount[0],
+                    (brick / m_BrickCount[0]) % m_BrickCount[1],
+                    brick / m_BrickStride[2] };
+    size_t x0 = b[0] * BrickSize, y0 = b[1] * BrickSize, z0 = b[2] * BrickSize;
+    size_t x1 = std::min(x0 + BrickSize, size_t(m_Size[0]));
+    size_t y1 = std::min(y0 + BrickSize, size_t(m_Size[1]));
+    size_t z1 = std::min(z0 + BrickSize, size_t(m_Size[2]));
+    size_t nc = m_Components;
+    for(size_t z = z0; z < z1; z++)
+      {
+      for(size_t y = y0; y < y1; y++)
+        {
+        size_t morton_yz = (SpreadBits(y - y0) << 1) | (SpreadBits(z - z0) << 2);
+        size_t offset = ((z * m_Size[1] + y) * m_Size[0] + x0) * nc;
+        for(size_t x = x0; x < x1; x++, offset += nc)
+          f((morton_yz | SpreadBits(x - x0)) * nc, offset);
+        }
+      }
+  }
+
+  // Code a brick of voxels in Morton order
+  bool EncodeBrick(const std::vector<TComponent> &voxels, std::vector<unsigned char> &out) const
+  {
+    size_t n = voxels.size(), nc = m_Components;
+    std::vector<unsigned char> shuffled(n * sizeof(TComponent));
+    for(size_t i = 0; i < n; i++)
+      {
+      TComponent v = voxels[i];
+      if constexpr(std::is_integral<TComponent>::value)
+        {
+        typedef typename std::make_unsigned<TComponent>::type UType;
+        if(i >= nc)
+          v = static_cast<TComponent>(static_cast<UType>(v) - static_cast<UType>(voxels[i - nc]));
+        }
+      const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&v);
+      for(size_t k = 0; k < sizeof(TComponent); k++)
+        shuffled[k * n + i] = bytes[k];
+      }
+    return BrickCompression::Encode(shuffled.data(), shuffled.size(), out);
+  }
+
+  // Decode a brick of voxels, which must have the size of a brick
+  bool DecodeBrick(const std::vector<unsigned char> &in, std::vector<TComponent> &voxels) const
+  {
+    size_t n = voxels.size(), nc = m_Components;
+    std::vector<unsigned char> shuffled(n * sizeof(TComponent));
+    if(!BrickCompression::Decode(in, shuffled.data(), shuffled.size()))
+      return false;
+
+    for(size_t i = 0; i < n; i++)
+      {
+      TComponent v;
+      unsigned char *bytes = reinterpret_cast<unsigned char *>(&v);
+      for(size_t k = 0; k < sizeof(TComponent); k++)
+        bytes[k] = shuffled[k * n + i];
+      if constexpr(std::is_integral<TComponent>::value)
+        {
+        typedef typename std::make_unsigned<TComponent>::type UType;
+        if(i >= nc)
+          v = static_cast<TComponent>(static_cast<UType>(v) + static_cast<UType>(voxels[i - nc]));
+        }
+      voxels[i] = v;
+      }
+    return true;
+  }
+
+  // A decompressed layer of bricks normal to an axis
+  struct Layer
+  {
+    unsigned int Axis;
+    size_t Index;
+    std::shared_ptr<const std::vector<TComponent> > Data;
+  };
+
+  // Get a decompressed layer from the cache, or decompress it
+  std::shared_ptr<const std::vector<TComponent> > GetLayer(unsigned int axis, size_t index)
+  {
+    for(auto it = m_Layers.begin(); it != m_Layers.end(); ++it)
+      {
+      if(it->Axis == axis && it->Index == index)
+        {
+        m_Layers.splice(m_Layers.begin(), m_Layers, it);
+        return m_Layers.front().Data;
+        }
+      }
+
+    // The bricks of the layer, in the order of the other two axes
+    unsigned int a1 = axis == 0 ? 1 : 0, a2 = axis == 2 ? 1 : 2;
+    size_t n1 = m_BrickCount[a1], n_layer = n1 * m_BrickCount[a2];
+    auto data = std::make_shared<std::vector<TComponent> >(n_layer * BrickVoxels * m_Components);
+    size_t brick_elements = BrickVoxels * m_Components;
+
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray(0, n_layer, [&](itk::SizeValueType k)
+      {
+      size_t brick = index * m_BrickStride[axis]
+          + (k % n1) * m_BrickStride[a1] + (k / n1) * m_BrickStride[a2];
+      std::vector<TComponent> voxels(brick_elements);
+      if(this->DecodeBrick(m_Bricks[brick], voxels))
+        std::copy(voxels.begin(), voxels.end(), data->begin() + k * brick_elements);
+      }, nullptr);
+
+    Layer layer;
+    layer.Axis = axis;
+    layer.Index = index;
+    layer.Data = data;
+    m_Layers.push_front(layer);
+    if(m_Layers.size() > LayerCacheSize)
+      m_Layers.pop_back();
+    return data;
+  }
+
+  std::vector<TComponent> m_Data;
+  std::vector<size_t> m_AxisOffsets[3];
+
+  // The buffer and state of the image that the copy was made from
+  const TComponent *m_Source = nullptr;
+  itk::ModifiedTimeType m_SourceMTime = 0;
+  typename itk::ImageBase<3>::SizeType m_Size = {{0, 0, 0}};
+  unsigned int m_Components = 0;
+
+  // Compressed voxels, one coded block per brick in x-fastest brick order
+  bool m_Compressed = false;
+  std::vector<std::vector<unsigned char> > m_Bricks;
+  size_t m_BrickCount[3] = { 0, 0, 0 }, m_BrickStride[3] = { 0, 0, 0 };
+  size_t m_NumberOfBricks = 0;
+
+  // Offset tables of the layers normal to each axis (first index)
+  std::vector<size_t> m_LayerOffsets[3][3];
+
+  // Recently decompressed layers, most recent first, and the last brick
+  // decompressed to read a single voxel
+  std::list<Layer> m_Layers;
+  std::vector<TComponent> m_VoxelBrick;
+  size_t m_VoxelBrickIndex = (size_t) -1;
+
+  mutable std::mutex m_Mutex;
+};
+
+#endif // BRICKEDIMAGEBUFFER_H
@@ -1,31 +1,164 @@
 #include "ColorLookupTable.h"
 #include "itkRGBAPixel.h"
+#include <algorithm>
 
 template<class TInputPixel, class TDisplayPixel>
-void ColorLookupTable<TInputPixel, TDisplayPixel>
-::Initialize(TInputPixel image_min, TInputPixel image_max, double t0, double t1)
+size_t ColorLookupTable<TInputPixel, TDisplayPixel>
+::InitializeRange(TInputPixel image_min, TInputPixel image_max, double t0, double t1)
 {
   if constexpr(std::is_floating_point<TInputPixel>::value)
   {
-    m_LUT.resize(1 + FLOAT_LUT_MAX);
     m_StartValue = (TInputPixel) (t0 * (image_max - image_min) + image_min);
     m_EndValue = (TInputPixel) (t1 * (image_max - image_min) + image_min);
     m_IntensityToLUTIndexScaleFactor = (m_EndValue == m_StartValue) ?
                                        1.0 : FLOAT_LUT_MAX / (m_EndValue - m_StartValue);
     m_LUTIndexToCurveDomainScale = (t1 - t0) / FLOAT_LUT_MAX;
     m_LUTIndexToCurveDomainShift = t0;
+    return 1 + FLOAT_LUT_MAX;
   }
   else
   {
-    m_LUT.resize(1 + image_max - image_min);
     m_StartValue = image_min;
     m_EndValue = image_max;
     m_IntensityToLUTIndexScaleFactor = 1.0;
     m_LUTIndexToCurveDomainScale = (image_max == image_min) ? 1.0 : 1.0 / (image_max - image_min);
     m_LUTIndexToCurveDomainShift = 0;
+    return 1 + image_max - image_min;
   }
 }
 
+template<class TInputPixel, class TDisplayPixel>
+void ColorLookupTable<TInputPixel, TDisplayPixel>
+::Initialize(TInputPixel image_min, TInputPixel image_max, double t0, double t1)
+{
+  size_t size = this->InitializeRange(image_min, image_max, t0, t1);
+
+  // The storage can be reused unless another LUT shares it
+  if(m_LUT && m_LUT.use_count() == 1)
+    m_LUT->resize(size);
+  else
+    m_LUT = std::make_shared<TableType>(size);
+}
+
+template<class TInputPixel, class TDisplayPixel>
+void ColorLookupTable<TInputPixel, TDisplayPixel>
+::InitializeShared(TInputPixel image_min, TInputPixel image_max, double t0, double t1,
+                   const std::shared_ptr<TableType> &table)
+{
+  this->InitializeRange(image_min, image_max, t0, t1);
+  m_LUT = table;
+}
+
+template<class TInputPixel, class TDisplayPixel>
+void ColorLookupTable<TInputPixel, TDisplayPixel>
+::MakeTableUnique()
+{
+  if(m_LUT && m_LUT.use_count() > 1)
+    m_LUT = std::make_shared<TableType>(*m_LUT);
+}
+
+template<class TInputPixel, class TDisplayPixel>
+inline void ColorLookupTable<TInputPixel, TDisplayPixel>
+::MapStridedIntensities(const TInputPixel *x, size_t n, size_t in_stride,
+                        TDisplayPixel *out, size_t out_stride,
+                        const TDisplayPixel *zero_value) const
+{
+  const TDisplayPixel *lut = m_LUT->data();
+  bool remap_zero = zero_value && !this->CheckRange(0);
+
+  if constexpr(std::is_floating_point<TInputPixel>::value)
+    {
+    // The intensities are processed in blocks. The first pass computes the
+    // LUT index and the class of each intensity using selects only, so that
+    // it compiles to SIMD code. The second pass gathers from the table, and
+    // the last pass, which only runs if the block has intensities outside of
+    // the table (or NaN, or remapped zero), patches in their colors.
+    enum { IN_RANGE = 0, IS_NAN, BELOW, ABOVE, ZERO };
+    const TInputPixel start = m_StartValue, end = m_EndValue;
+    const double scale = m_IntensityToLUTIndexScaleFactor;
+    const int max_index = (int) m_LUT->size() - 1;
+    TDisplayPixel special[5];
+    special[IN_RANGE] = m_ColorBelow;
+    special[IS_NAN] = m_ColorNaN;
+    special[BELOW] = m_ColorBelow;
+    special[ABOVE] = m_ColorAbove;
+    special[ZERO] = remap_zero ? *zero_value : m_ColorBelow;
+
+    const size_t block_size = 256;
+    int index[block_size];
+    unsigned char cls[block_size];
+    for(size_t j0 = 0; j0 < n; j0 += block_size)
+      {
+      size_t nb = std::min(block_size, n - j0);
+      const TInputPixel *xb = x + j0 * in_stride;
+      TDisplayPixel *ob = out + j0 * out_stride;
+
+      unsigned char any = 0;
+      for(size_t j = 0; j < nb; j++)
+        {
+        TInputPixel v = xb[j * in_stride];
+
+        // Clamp to the mapped range, NaN goes to the start
+        TInputPixel vc = (v >= start) ? v : start;
+        vc = (vc <= end) ? vc : end;
+        int k = (int)((vc - start) * scale);
+        index[j] = (k < max_index) ? k : max_index;
+
+        unsigned char c = (v < start) ? BELOW : IN_RANGE;
+        c = (v > end) ? ABOVE : c;
+        c = (v != v) ? IS_NAN : c;
+        c = (remap_zero && v == 0) ? ZERO : c;
+        cls[j] = c;
+        any |= c;
+        }
+
+      for(size_t j = 0; j < nb; j++)
+        ob[j * out_stride] = lut[index[j]];
+
+      if(any)
+        {
+        for(size_t j = 0; j < nb; j++)
+          if(cls[j])
+            ob[j * out_stride] = special[cls[j]];
+        }
+      }
+    }
+  else
+    {
+    const int start = (int) m_StartValue;
+    if(remap_zero)
+      {
+      const TDisplayPixel zero = *zero_value;
+      for(size_t j = 0; j < n; j++, x += in_stride, out += out_stride)
+        *out = (*x == 0) ? zero : lut[(int) *x - start];
+      }
+    else
+      {
+      for(size_t j = 0; j < n; j++, x += in_stride, out += out_stride)
+        *out = lut[(int) *x - start];
+      }
+    }
+}
+
+template<class TInputPixel, class TDisplayPixel>
+void ColorLookupTable<TInputPixel, TDisplayPixel>
+::MapIntensitiesToDisplay(const TInputPixel *x, size_t n,
+                          TDisplayPixel *out, size_t out_stride,
+                          const TDisplayPixel *zero_value) const
+{
+  // Constant input stride lets the compiler keep the contiguous loads
+  this->MapStridedIntensities(x, n, 1, out, out_stride, zero_value);
+}
+
+template<class TInputPixel, class TDisplayPixel>
+void ColorLookupTable<TInputPixel, TDisplayPixel>
+::MapInterleavedIntensitiesToDisplay(const TInputPixel *x, size_t n, size_t in_stride,
+                                     TDisplayPixel *out, size_t out_stride,
+                                     const TDisplayPixel *zero_value) const
+{
+  this->MapStridedIntensities(x, n, in_stride, out, out_stride, zero_value);
+}
+
 // Template instantiation
 #define ColorLookupTableInstantiateMacro(type) \
   template class ColorLookupTable<type, itk::RGBAPixel<unsigned char> >; \
@@ -5,11 +5,13 @@
 #include "itkDataObject.h"
 #include <type_traits>
 #include <cmath>
+#include <memory>
 
 /**
  * This class defines a lookup table that is used to map from raw intensity to
  * a color value. It is just a vector of RGBA pixels with some extra metadata
- * to specify range and color for NaN values.
+ * to specify range and color for NaN values. The vector itself may be shared
+ * between lookup tables that have the same contents.
  */
 template <class TInputPixel, class TDisplayPixel> class ColorLookupTable
     : public itk::DataObject
@@ -17,6 +19,9 @@ template <class TInputPixel, class TDisplayPixel> class ColorLookupTable
 public:
   irisITKObjectMacro(ColorLookupTable, itk::DataObject)
 
+  // Storage of the table entries
+  typedef std::vector<TDisplayPixel> TableType;
+
   // Maximum size of the LUT for floating point data
   static constexpr int FLOAT_LUT_MAX = 10000;
 
@@ -32,6 +37,19 @@ public:
    */
   void Initialize(TInputPixel image_min, TInputPixel image_max, double t0, double t1);
 
+  /**
+   * Same as Initialize, but instead of allocating its own storage, the LUT
+   * uses a table that was computed for the same parameters elsewhere
+   */
+  void InitializeShared(TInputPixel image_min, TInputPixel image_max, double t0, double t1,
+                        const std::shared_ptr<TableType> &table);
+
+  /** The storage of the table, for sharing with other LUTs */
+  const std::shared_ptr<TableType> &GetTable() const { return m_LUT; }
+
+  /** Make a private copy of the table if it is shared, before modifying it */
+  void MakeTableUnique();
+
   /** Map an intensity value from the image to the display type, no range check for char/short */
   inline TDisplayPixel MapIntensityToDisplay(const TInputPixel &x) const
     {
@@ -44,14 +62,33 @@ public:
       else if(x > m_EndValue)
         return m_ColorAbove;
       else
-        return m_LUT[(int)((x - m_StartValue) * m_IntensityToLUTIndexScaleFactor)];
+        return (*m_LUT)[(int)((x - m_StartValue) * m_IntensityToLUTIndexScaleFactor)];
       }
     else
       {
-      return m_LUT[x - m_StartValue];
+      return (*m_LUT)[x - m_StartValue];
       }
     }
 
+  /**
+   * Map a contiguous run of n intensities to display values, writing them to
+   * the output with a given stride (in units of TDisplayPixel). If zero_value
+   * is not null and zero falls outside of the mapped range, zero intensities
+   * are mapped to *zero_value. The loops are written so that the compiler can
+   * vectorize the table gather.
+   */
+  void MapIntensitiesToDisplay(const TInputPixel *x, size_t n,
+                               TDisplayPixel *out, size_t out_stride,
+                               const TDisplayPixel *zero_value = nullptr) const;
+
+  /**
+   * Same as above, but the intensities are read with a stride, e.g., one
+   * component of an interleaved multi-component scanline
+   */
+  void MapInterleavedIntensitiesToDisplay(const TInputPixel *x, size_t n, size_t in_stride,
+                                          TDisplayPixel *out, size_t out_stride,
+                                          const TDisplayPixel *zero_value = nullptr) const;
+
   /** Perform a range check (is intensity in the mapped range) - normally not required */
   bool CheckRange(const TInputPixel &x) const
     {
@@ -59,7 +96,7 @@ public:
     }
 
   /** Get the size of the LUT */
-  unsigned int GetSize() const { return m_LUT.size(); }
+  unsigned int GetSize() const { return m_LUT ? m_LUT->size() : 0; }
 
   /** Get the size of the LUT */
   double GetIntensityCurveDomainValueForIndex(unsigned int index) const
@@ -67,8 +104,14 @@ public:
     return index * m_LUTIndexToCurveDomainScale + m_LUTIndexToCurveDomainShift;
     }
 
+  /** Get the (fractional) LUT index for a value in the intensity curve domain */
+  double GetIndexForIntensityCurveDomainValue(double t) const
+    {
+    return (t - m_LUTIndexToCurveDomainShift) / m_LUTIndexToCurveDomainScale;
+    }
+
   /** Set the value of the LUT entry */
-  void SetLUTValue(unsigned int index, const TDisplayPixel &value) { m_LUT[index] = value; }
+  void SetLUTValue(unsigned int index, const TDisplayPixel &value) { (*m_LUT)[index] = value; }
 
   /** Color used for intensities below the covered range */
   itkGetConstMacro(ColorBelow, TDisplayPixel)
@@ -93,8 +136,16 @@ protected:
   ColorLookupTable() {}
   virtual ~ColorLookupTable() {}
 
+  // Shared implementation of the mapping of runs of intensities
+  inline void MapStridedIntensities(const TInputPixel *x, size_t n, size_t in_stride,
+                                    TDisplayPixel *out, size_t out_stride,
+                                    const TDisplayPixel *zero_value) const;
+
+  // Compute the range metadata and return the number of table entries
+  size_t InitializeRange(TInputPixel image_min, TInputPixel image_max, double t0, double t1);
+
   // The table itself
-  std::vector<TDisplayPixel> m_LUT;
+  std::shared_ptr<TableType> m_LUT;
 
   // Colors for the values outside of the specified range
   TDisplayPixel m_ColorBelow, m_ColorAbove, m_ColorNaN;
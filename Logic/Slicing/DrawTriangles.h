@@ -335,158 +335,262 @@ void DrawBinaryTrianglesSheetFilled(
  */
 
 #include "IRISVectorTypes.h"
+#include "itkMultiThreaderBase.h"
 #include <vnl/vnl_cross.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
 
 namespace cpu_voxelizer {
 
 static constexpr float float_error = 0.000001;
 
-// Mesh voxelization method
-template <class TImage, class TUpdateFunctor>
-void DrawBinaryTrianglesSheetFilled(
-    TImage *image, int *dim, double **vertex_table, int num_triangles, const TUpdateFunctor &fn_update)
+/**
+ * The test of whether a triangle overlaps the unit box of a voxel, which
+ * spans [x,x+1] x [y,y+1] x [z,z+1] for voxel (x,y,z). The properties of the
+ * triangle used by the test are computed once, when it is constructed, along
+ * with the bounding box of the voxels it may overlap.
+ */
+struct TriangleBoxOverlapTest
 {
-  unsigned int debug_n_triangles = 0;
-  unsigned int debug_n_voxels_tested = 0;
-  unsigned int debug_n_voxels_marked = 0;
-
-  // Box dimensions
-  Vector3d delta_p(1.0, 1.0, 1.0);
-
-  // Critical point
-  // Vector3d c(0.0, 0.0, 0.0);
-  Vector3i grid_max(dim[0]-1, dim[1]-1, dim[2]-1);
-
-  // Iterate over the triangles
-  for(int i = 0; i < num_triangles; i++)
-    {
-    debug_n_triangles++;
-
+  Vector3d n;
+  double d1 = 0.0, d2 = 0.0;
+  Vector2d n_xy_e[3], n_yz_e[3], n_zx_e[3];
+  double d_xy_e[3], d_yz_e[3], d_zx_e[3];
+  Vector3i bbox_min, bbox_max;
+
+  TriangleBoxOverlapTest(const double *p0, const double *p1, const double *p2, const Vector3i &grid_max)
+  {
     // Vertices
-    Vector3d v0(vertex_table[i*3+0][0],vertex_table[i*3+0][1],vertex_table[i*3+0][2]);
-    Vector3d v1(vertex_table[i*3+1][0],vertex_table[i*3+1][1],vertex_table[i*3+1][2]);
-    Vector3d v2(vertex_table[i*3+2][0],vertex_table[i*3+2][1],vertex_table[i*3+2][2]);
+    Vector3d v[3] = { Vector3d(p0[0], p0[1], p0[2]), Vector3d(p1[0], p1[1], p1[2]), Vector3d(p2[0], p2[1], p2[2]) };
 
     // Edge vectors
-    Vector3d e0 = v1 - v0;
-    Vector3d e1 = v2 - v1;
-    Vector3d e2 = v0 - v2;
+    Vector3d e[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
 
     // Normal vector
-    Vector3d n = vnl_cross_3d(e0, e1).normalize();
-    Vector3i t_bbox_grid_min, t_bbox_grid_max;
+    n = vnl_cross_3d(e[0], e[1]).normalize();
 
     // Precompute d1/d2 constants for plane intersection check
-    double d1 = 0.0, d2 = 0.0;
     for(unsigned int k = 0; k < 3; k++)
       {
       // Compute extents for the voxel grid for this triangle
-      t_bbox_grid_min[k] = std::clamp(std::min((int) v0[k], std::min((int) v1[k], (int) v2[k])), 0, grid_max[k]);
-      t_bbox_grid_max[k] = std::clamp(std::max((int) v0[k], std::max((int) v1[k], (int) v2[k])), 0, grid_max[k]);
+      bbox_min[k] = std::clamp(std::min((int) v[0][k], std::min((int) v[1][k], (int) v[2][k])), 0, grid_max[k]);
+      bbox_max[k] = std::clamp(std::max((int) v[0][k], std::max((int) v[1][k], (int) v[2][k])), 0, grid_max[k]);
 
       // Compute critical point for plane intersection check
       if(n[k] > 0.0)
         {
-        d1 -= n[k] * (v0[k] - 1.0);
-        d2 -= n[k] * v0[k];
+        d1 -= n[k] * (v[0][k] - 1.0);
+        d2 -= n[k] * v[0][k];
         }
       else
         {
-        d1 -= n[k] * v0[k];
-        d2 -= n[k] * (v0[k] - 1.0);
+        d1 -= n[k] * v[0][k];
+        d2 -= n[k] * (v[0][k] - 1.0);
         }
       }
 
     // PREPARE PROJECTION TEST PROPERTIES
-    // XY plane
-    Vector2d n_xy_e0(-1.0 * e0[1], e0[0]);
-    Vector2d n_xy_e1(-1.0 * e1[1], e1[0]);
-    Vector2d n_xy_e2(-1.0 * e2[1], e2[0]);
-    if (n[2] < 0.0)
+    for(unsigned int j = 0; j < 3; j++)
       {
-      n_xy_e0 = -n_xy_e0;
-      n_xy_e1 = -n_xy_e1;
-      n_xy_e2 = -n_xy_e2;
+      // XY plane
+      n_xy_e[j] = Vector2d(-1.0 * e[j][1], e[j][0]);
+      if (n[2] < 0.0)
+        n_xy_e[j] = -n_xy_e[j];
+      d_xy_e[j] = (-1.0 * dot_product(n_xy_e[j], Vector2d(v[j][0], v[j][1]))) + std::max(0.0, n_xy_e[j][0]) + std::max(0.0, n_xy_e[j][1]);
+
+      // YZ plane
+      n_yz_e[j] = Vector2d(-1.0 * e[j][2], e[j][1]);
+      if (n[0] < 0.0)
+        n_yz_e[j] = -n_yz_e[j];
+      d_yz_e[j] = (-1.0 * dot_product(n_yz_e[j], Vector2d(v[j][1], v[j][2]))) + std::max(0.0, n_yz_e[j][0]) + std::max(0.0, n_yz_e[j][1]);
+
+      // ZX plane
+      n_zx_e[j] = Vector2d(-1.0 * e[j][0], e[j][2]);
+      if (n[1] < 0.0)
+        n_zx_e[j] = -n_zx_e[j];
+      d_zx_e[j] = (-1.0 * dot_product(n_zx_e[j], Vector2d(v[j][2], v[j][0]))) + std::max(0.0, n_zx_e[j][0]) + std::max(0.0, n_zx_e[j][1]);
       }
+  }
 
-    double d_xy_e0 = (-1.0 * dot_product(n_xy_e0, Vector2d(v0[0], v0[1]))) + std::max(0.0, n_xy_e0[0]) + std::max(0.0, n_xy_e0[1]);
-    double d_xy_e1 = (-1.0 * dot_product(n_xy_e1, Vector2d(v1[0], v1[1]))) + std::max(0.0, n_xy_e1[0]) + std::max(0.0, n_xy_e1[1]);
-    double d_xy_e2 = (-1.0 * dot_product(n_xy_e2, Vector2d(v2[0], v2[1]))) + std::max(0.0, n_xy_e2[0]) + std::max(0.0, n_xy_e2[1]);
+  bool Overlaps(int x, int y, int z) const
+  {
+    // TRIANGLE PLANE THROUGH BOX TEST
+    Vector3d p(x,y,z);
+    double nDOTp = dot_product(n, p);
+    if (((nDOTp + d1) * (nDOTp + d2)) > 0.0)
+      return false;
 
-    // YZ plane
-    Vector2d n_yz_e0(-1.0 * e0[2], e0[1]);
-    Vector2d n_yz_e1(-1.0 * e1[2], e1[1]);
-    Vector2d n_yz_e2(-1.0 * e2[2], e2[1]);
-    if (n[0] < 0.0)
-      {
-      n_yz_e0 = -n_yz_e0;
-      n_yz_e1 = -n_yz_e1;
-      n_yz_e2 = -n_yz_e2;
-      }
-    double d_yz_e0 = (-1.0 * dot_product(n_yz_e0, Vector2d(v0[1], v0[2]))) + std::max(0.0, n_yz_e0[0]) + std::max(0.0, n_yz_e0[1]);
-    double d_yz_e1 = (-1.0 * dot_product(n_yz_e1, Vector2d(v1[1], v1[2]))) + std::max(0.0, n_yz_e1[0]) + std::max(0.0, n_yz_e1[1]);
-    double d_yz_e2 = (-1.0 * dot_product(n_yz_e2, Vector2d(v2[1], v2[2]))) + std::max(0.0, n_yz_e2[0]) + std::max(0.0, n_yz_e2[1]);
-
-    // ZX plane
-    Vector2d n_zx_e0(-1.0 * e0[0], e0[2]);
-    Vector2d n_zx_e1(-1.0 * e1[0], e1[2]);
-    Vector2d n_zx_e2(-1.0 * e2[0], e2[2]);
-    if (n[1] < 0.0)
+    // PROJECTION TESTS
+    Vector2d p_xy(p[0], p[1]), p_yz(p[1], p[2]), p_zx(p[2], p[0]);
+    for(unsigned int j = 0; j < 3; j++)
       {
-      n_zx_e0 = -n_zx_e0;
-      n_zx_e1 = -n_zx_e1;
-      n_zx_e2 = -n_zx_e2;
+      if ((dot_product(n_xy_e[j], p_xy) + d_xy_e[j]) < 0.0) return false;
+      if ((dot_product(n_yz_e[j], p_yz) + d_yz_e[j]) < 0.0) return false;
+      if ((dot_product(n_zx_e[j], p_zx) + d_zx_e[j]) < 0.0) return false;
       }
-    double d_xz_e0 = (-1.0 * dot_product(n_zx_e0, Vector2d(v0[2], v0[0]))) + std::max(0.0, n_zx_e0[0]) + std::max(0.0, n_zx_e0[1]);
-    double d_xz_e1 = (-1.0 * dot_product(n_zx_e1, Vector2d(v1[2], v1[0]))) + std::max(0.0, n_zx_e1[0]) + std::max(0.0, n_zx_e1[1]);
-    double d_xz_e2 = (-1.0 * dot_product(n_zx_e2, Vector2d(v2[2], v2[0]))) + std::max(0.0, n_zx_e2[0]) + std::max(0.0, n_zx_e2[1]);
+
+    return true;
+  }
+};
+
+// Mesh voxelization method
+template <class TImage, class TUpdateFunctor>
+void DrawBinaryTrianglesSheetFilled(
+    TImage *image, int *dim, double **vertex_table, int num_triangles, const TUpdateFunctor &fn_update)
+{
+  // Critical point
+  // Vector3d c(0.0, 0.0, 0.0);
+  Vector3i grid_max(dim[0]-1, dim[1]-1, dim[2]-1);
+
+  // Iterate over the triangles
+  for(int i = 0; i < num_triangles; i++)
+    {
+    TriangleBoxOverlapTest tri(vertex_table[i*3+0], vertex_table[i*3+1], vertex_table[i*3+2], grid_max);
 
     // test possible grid boxes for overlap
-    for (int z = t_bbox_grid_min[2]; z <= t_bbox_grid_max[2]; z++)
+    for (int z = tri.bbox_min[2]; z <= tri.bbox_max[2]; z++)
       {
       unsigned int offset_z = z * image->GetOffsetTable()[2];
-      for (int y = t_bbox_grid_min[1]; y <= t_bbox_grid_max[1]; y++)
+      for (int y = tri.bbox_min[1]; y <= tri.bbox_max[1]; y++)
         {
         unsigned int offset_y = offset_z + y * image->GetOffsetTable()[1];
-        for (int x = t_bbox_grid_min[0]; x <= t_bbox_grid_max[0]; x++)
+        for (int x = tri.bbox_min[0]; x <= tri.bbox_max[0]; x++)
           {
-          unsigned int offset_x = offset_y + x * image->GetOffsetTable()[0];
-          debug_n_voxels_tested++;
-
-          // TRIANGLE PLANE THROUGH BOX TEST
-          Vector3d p(x,y,z);
-          double nDOTp = dot_product(n, p);
-          if (((nDOTp + d1) * (nDOTp + d2)) > 0.0) { continue; }
-
-          // PROJECTION TESTS
-          // XY
-          Vector2d p_xy(p[0], p[1]);
-          if ((dot_product(n_xy_e0, p_xy) + d_xy_e0) < 0.0) { continue; }
-          if ((dot_product(n_xy_e1, p_xy) + d_xy_e1) < 0.0) { continue; }
-          if ((dot_product(n_xy_e2, p_xy) + d_xy_e2) < 0.0) { continue; }
-
-          // YZ
-          Vector2d p_yz(p[1], p[2]);
-          if ((dot_product(n_yz_e0, p_yz) + d_yz_e0) < 0.0) { continue; }
-          if ((dot_product(n_yz_e1, p_yz) + d_yz_e1) < 0.0) { continue; }
-          if ((dot_product(n_yz_e2, p_yz) + d_yz_e2) < 0.0) { continue; }
-
-          // XZ
-          Vector2d p_zx(p[2], p[0]);
-          if ((dot_product(n_zx_e0, p_zx) + d_xz_e0) < 0.0) { continue; }
-          if ((dot_product(n_zx_e1, p_zx) + d_xz_e1) < 0.0) { continue; }
-          if ((dot_product(n_zx_e2, p_zx) + d_xz_e2) < 0.0) { continue; }
-
-          // Got to this point - voxel will be marked
-          debug_n_voxels_marked += 1;
-
           // Mark the voxel
-          fn_update(image, offset_x);
+          if(tri.Overlaps(x, y, z))
+            fn_update(image, offset_y + x * image->GetOffsetTable()[0]);
+          }
         }
       }
     }
+}
+
+/**
+ * Multithreaded voxelization of triangles straight into the run-length lines
+ * of an RLE image, whose buffered region is taken to start at the voxel
+ * coordinate zero. The image is divided into tiles (a range of slices and a
+ * range of rows), which are filled in parallel, each one with the triangles
+ * whose bounding box crosses it. Every line of the image is replaced.
+ *
+ * The voxels that overlap the triangles are set to the label, as in
+ * DrawBinaryTrianglesSheetFilled. They are marked in a bit-packed table of
+ * the voxels of the tile, which is then encoded as runs.
+ */
+template <class TRLEImage>
+void DrawTrianglesIntoRLEImage(
+    TRLEImage *image, double **vertex_table, int num_triangles,
+    typename TRLEImage::PixelType label)
+{
+  typedef typename TRLEImage::RLLine RLLine;
+  typedef typename TRLEImage::RLSegment RLSegment;
+  typedef typename TRLEImage::PixelType PixelType;
+
+  int nx = image->GetBufferedRegion().GetSize(0);
+  int ny = image->GetBufferedRegion().GetSize(1);
+  int nz = image->GetBufferedRegion().GetSize(2);
+  if(nx == 0 || ny == 0 || nz == 0)
+    return;
+  Vector3i grid_max(nx - 1, ny - 1, nz - 1);
+
+  // Divide the image into several tiles per thread, to balance the load
+  int n_target = 8 * itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+  int n_slabs = std::min(nz, n_target);
+  int n_bands = std::min(ny, (n_target + n_slabs - 1) / n_slabs);
+  int tz = (nz + n_slabs - 1) / n_slabs, ty = (ny + n_bands - 1) / n_bands;
+  n_slabs = (nz + tz - 1) / tz;
+  n_bands = (ny + ty - 1) / ty;
+
+  // Range of the voxels that a triangle may touch along dimension k
+  auto voxel_range = [&](int i, unsigned int k, int &lo, int &hi)
+    {
+    double vmin = vertex_table[i*3][k], vmax = vmin;
+    for(unsigned int j = 1; j < 3; j++)
+      {
+      vmin = std::min(vmin, vertex_table[i*3+j][k]);
+      vmax = std::max(vmax, vertex_table[i*3+j][k]);
+      }
+    lo = std::clamp((int) vmin, 0, grid_max[k]);
+    hi = std::clamp((int) vmax, 0, grid_max[k]);
+    };
 
+  // Assign the triangles to the tiles that their bounding boxes cross
+  std::vector<std::vector<int> > bins(n_slabs * n_bands);
+  for(int i = 0; i < num_triangles; i++)
+    {
+    int y0, y1, z0, z1;
+    voxel_range(i, 1, y0, y1);
+    voxel_range(i, 2, z0, z1);
+    for(int s = z0 / tz; s <= z1 / tz; s++)
+      for(int b = y0 / ty; b <= y1 / ty; b++)
+        bins[s * n_bands + b].push_back(i);
     }
+
+  RLLine *lines = image->GetBuffer()->GetBufferPointer();
+  auto append = [](RLLine &line, long count, PixelType value)
+    {
+    if(count <= 0)
+      return;
+    if(line.size() && line.back().second == value)
+      line.back().first += count;
+    else
+      line.push_back(RLSegment(count, value));
+    };
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, n_slabs * n_bands, [&](int tile)
+    {
+    int z0 = (tile / n_bands) * tz, z1 = std::min(z0 + tz, nz);
+    int y0 = (tile % n_bands) * ty, y1 = std::min(y0 + ty, ny);
+    const std::vector<int> &bin = bins[tile];
+
+    // Mark the overlapping voxels in a table with a whole number of words
+    // per line, so that the runs can be found a word at a time
+    int wpl = (nx + 63) / 64;
+    std::vector<uint64_t> bits((size_t) wpl * (y1 - y0) * (z1 - z0), 0);
+    for(int i : bin)
+      {
+      TriangleBoxOverlapTest tri(vertex_table[i*3+0], vertex_table[i*3+1], vertex_table[i*3+2], grid_max);
+      for (int z = std::max(tri.bbox_min[2], z0); z <= std::min(tri.bbox_max[2], z1 - 1); z++)
+        for (int y = std::max(tri.bbox_min[1], y0); y <= std::min(tri.bbox_max[1], y1 - 1); y++)
+          {
+          uint64_t *row = &bits[((size_t) (z - z0) * (y1 - y0) + (y - y0)) * wpl];
+          for (int x = tri.bbox_min[0]; x <= tri.bbox_max[0]; x++)
+            if(tri.Overlaps(x, y, z))
+              row[x >> 6] |= uint64_t(1) << (x & 63);
+          }
+      }
+
+    for(int z = z0; z < z1; z++)
+      for(int y = y0; y < y1; y++)
+        {
+        const uint64_t *row = &bits[((size_t) (z - z0) * (y1 - y0) + (y - y0)) * wpl];
+        auto bit = [row](int x) { return (bool) ((row[x >> 6] >> (x & 63)) & 1); };
+        RLLine line;
+        for(int x = 0; x < nx; )
+          {
+          bool on = bit(x);
+          uint64_t fill = on ? ~uint64_t(0) : uint64_t(0);
+          int x_end = x + 1;
+          while(x_end < nx)
+            {
+            if((x_end & 63) == 0 && row[x_end >> 6] == fill)
+              x_end += 64;
+            else if(bit(x_end) == on)
+              x_end++;
+            else
+              break;
+            }
+          x_end = std::min(x_end, nx);
+          append(line, x_end - x, on ? label : PixelType(0));
+          x = x_end;
+          }
+        lines[y + (size_t) z * ny].swap(line);
+        }
+    }, nullptr);
+
+  image->Modified();
 }
 
 } // namespace
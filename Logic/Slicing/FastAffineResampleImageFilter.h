@@ -0,0 +1,107 @@
+#ifndef FASTAFFINERESAMPLEIMAGEFILTER_H
+#define FASTAFFINERESAMPLEIMAGEFILTER_H
+
+#include "NonOrthogonalSlicer.h"
+#include "itkMatrixOffsetTransformBase.h"
+
+/**
+ * A replacement for itk::ResampleImageFilter for the case of an affine
+ * transform and nearest neighbor or linear interpolation, used when a layer
+ * is resliced into the reference space.
+ *
+ * Because the transform is affine, the continuous index of the input image
+ * changes by a constant step along each line of the output image. So instead
+ * of mapping every output voxel through the transform, the filter computes
+ * the start and step of each line and samples the whole line at once using
+ * the same worker traits (and the vectorized scanline code in
+ * FastLinearInterpolator) as the NonOrthogonalSlicer. The output is
+ * processed in slabs by the ITK threader.
+ *
+ * Samples outside of the input image are set to zero.
+ */
+template <typename TInputImage, typename TOutputImage,
+          typename TWorkerTraits = DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage> >
+class FastAffineResampleImageFilter
+    : public itk::ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef FastAffineResampleImageFilter                            Self;
+  typedef itk::ImageToImageFilter<TInputImage, TOutputImage>  Superclass;
+  typedef itk::SmartPointer<Self>                                Pointer;
+  typedef itk::SmartPointer<const Self>                     ConstPointer;
+
+  typedef TInputImage                                     InputImageType;
+  typedef typename InputImageType::RegionType       InputImageRegionType;
+
+  typedef TOutputImage                                   OutputImageType;
+  typedef typename OutputImageType::RegionType     OutputImageRegionType;
+  typedef typename OutputImageType::InternalPixelType OutputComponentType;
+  typedef typename OutputImageType::SizeType                    SizeType;
+  typedef typename OutputImageType::SpacingType              SpacingType;
+  typedef typename OutputImageType::PointType                  PointType;
+  typedef typename OutputImageType::DirectionType          DirectionType;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self)
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(FastAffineResampleImageFilter, ImageToImageFilter)
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TInputImage::ImageDimension);
+
+  /** Transform, mapping output physical points to input physical points */
+  typedef itk::MatrixOffsetTransformBase<double, ImageDimension, ImageDimension> TransformType;
+
+  itkSetConstObjectMacro(Transform, TransformType)
+  itkGetConstObjectMacro(Transform, TransformType)
+
+  /** Output image geometry */
+  itkSetMacro(Size, SizeType)
+  itkGetConstReferenceMacro(Size, SizeType)
+  itkSetMacro(OutputSpacing, SpacingType)
+  itkGetConstReferenceMacro(OutputSpacing, SpacingType)
+  itkSetMacro(OutputOrigin, PointType)
+  itkGetConstReferenceMacro(OutputOrigin, PointType)
+  itkSetMacro(OutputDirection, DirectionType)
+  itkGetConstReferenceMacro(OutputDirection, DirectionType)
+
+  /** Interpolation type */
+  itkSetMacro(UseNearestNeighbor, bool)
+  itkGetMacro(UseNearestNeighbor, bool)
+
+protected:
+
+  FastAffineResampleImageFilter();
+  ~FastAffineResampleImageFilter() {}
+
+  virtual void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
+  virtual void DynamicThreadedGenerateData(const OutputImageRegionType& outputRegionForThread) ITK_OVERRIDE;
+
+  virtual void VerifyInputInformation() const ITK_OVERRIDE { }
+
+  virtual void GenerateOutputInformation() ITK_OVERRIDE;
+
+  virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+  typename TransformType::ConstPointer m_Transform;
+
+  SizeType m_Size;
+  SpacingType m_OutputSpacing;
+  PointType m_OutputOrigin;
+  DirectionType m_OutputDirection;
+
+  bool m_UseNearestNeighbor;
+
+  // Affine map from output index to input continuous index, computed once
+  // before the threads start
+  vnl_matrix_fixed<double, ImageDimension, ImageDimension> m_IndexMatrix;
+  vnl_vector_fixed<double, ImageDimension> m_IndexOffset;
+};
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "FastAffineResampleImageFilter.txx"
+#endif
+
+#endif // FASTAFFINERESAMPLEIMAGEFILTER_H
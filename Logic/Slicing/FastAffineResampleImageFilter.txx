@@ -0,0 +1,124 @@
+#ifndef FASTAFFINERESAMPLEIMAGEFILTER_TXX
+#define FASTAFFINERESAMPLEIMAGEFILTER_TXX
+
+#include "FastAffineResampleImageFilter.h"
+#include "ImageRegionConstIteratorWithIndexOverride.h"
+#include <vnl/vnl_inverse.h>
+
+template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
+FastAffineResampleImageFilter<TInputImage, TOutputImage, TWorkerTraits>
+::FastAffineResampleImageFilter()
+  : m_UseNearestNeighbor(false)
+{
+  m_Size.Fill(0);
+  m_OutputSpacing.Fill(1.0);
+  m_OutputOrigin.Fill(0.0);
+  m_OutputDirection.SetIdentity();
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
+void
+FastAffineResampleImageFilter<TInputImage, TOutputImage, TWorkerTraits>
+::GenerateOutputInformation()
+{
+  OutputImageType *output = this->GetOutput();
+
+  OutputImageRegionType out_region;
+  out_region.SetSize(m_Size);
+
+  output->SetSpacing(m_OutputSpacing);
+  output->SetOrigin(m_OutputOrigin);
+  output->SetDirection(m_OutputDirection);
+  output->SetLargestPossibleRegion(out_region);
+  output->SetNumberOfComponentsPerPixel(this->GetInput()->GetNumberOfComponentsPerPixel());
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
+void
+FastAffineResampleImageFilter<TInputImage, TOutputImage, TWorkerTraits>
+::GenerateInputRequestedRegion()
+{
+  // Request the entire input image
+  InputImageType *inputPtr = const_cast<InputImageType *>(this->GetInput());
+  if(inputPtr)
+    inputPtr->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
+void
+FastAffineResampleImageFilter<TInputImage, TOutputImage, TWorkerTraits>
+::BeforeThreadedGenerateData()
+{
+  const InputImageType *input = this->GetInput();
+  typedef vnl_matrix_fixed<double, ImageDimension, ImageDimension> MatrixType;
+  typedef vnl_vector_fixed<double, ImageDimension> VectorType;
+
+  // Output index to output physical point
+  MatrixType out_ds = m_OutputDirection.GetVnlMatrix();
+  for(unsigned int j = 0; j < ImageDimension; j++)
+    out_ds.set_column(j, out_ds.get_column(j) * m_OutputSpacing[j]);
+
+  // Input physical point to input index, relative to the start of the buffer
+  MatrixType in_ds = input->GetDirection().GetVnlMatrix();
+  for(unsigned int j = 0; j < ImageDimension; j++)
+    in_ds.set_column(j, in_ds.get_column(j) * input->GetSpacing()[j]);
+  MatrixType in_ds_inv = vnl_inverse(in_ds);
+
+  VectorType out_origin, in_origin, tran_offset;
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    {
+    out_origin[d] = m_OutputOrigin[d];
+    in_origin[d] = input->GetOrigin()[d];
+    tran_offset[d] = m_Transform->GetOffset()[d];
+    }
+
+  MatrixType tran_matrix = m_Transform->GetMatrix().GetVnlMatrix();
+
+  // Compose: cix = in_ds_inv * (A * (out_origin + out_ds * idx) + b - in_origin)
+  m_IndexMatrix = in_ds_inv * tran_matrix * out_ds;
+  m_IndexOffset = in_ds_inv * (tran_matrix * out_origin + tran_offset - in_origin);
+
+  // Make the index relative to the buffered region of the input
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    m_IndexOffset[d] -= input->GetBufferedRegion().GetIndex(d);
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
+void
+FastAffineResampleImageFilter<TInputImage, TOutputImage, TWorkerTraits>
+::DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
+{
+  InputImageType *input = const_cast<InputImageType *>(this->GetInput());
+  OutputImageType *output = this->GetOutput();
+
+  // The interpolating worker, one per chunk of work
+  TWorkerTraits worker(input);
+
+  // Step of the continuous index along an output line
+  double step[ImageDimension];
+  for(unsigned int d = 0; d < ImageDimension; d++)
+    step[d] = m_IndexMatrix(d, 0);
+
+  typedef itk::ImageLinearIteratorWithIndex<OutputImageType> IterBase;
+  typedef IteratorExtender<IterBase> IterType;
+  int line_len = outputRegionForThread.GetSize(0);
+  double cix[ImageDimension];
+
+  for(IterType it(output, outputRegionForThread); !it.IsAtEnd(); it.NextLine())
+    {
+    OutputComponentType *out_ptr = it.GetPixelPointer(output);
+
+    // Continuous index of the first voxel of the line
+    typename OutputImageType::IndexType idx = it.GetIndex();
+    for(unsigned int d = 0; d < ImageDimension; d++)
+      {
+      cix[d] = m_IndexOffset[d];
+      for(unsigned int j = 0; j < ImageDimension; j++)
+        cix[d] += m_IndexMatrix(d, j) * idx[j];
+      }
+
+    worker.ProcessScanline(cix, step, line_len, m_UseNearestNeighbor, &out_ptr);
+    }
+}
+
+#endif // FASTAFFINERESAMPLEIMAGEFILTER_TXX
@@ -29,6 +29,8 @@
 
 #include "itkVectorImage.h"
 #include "itkNumericTraits.h"
+#include <algorithm>
+#include <cstddef>
 
 template <class TFloat, class TInputComponentType>
 struct FastLinearInterpolatorOutputTraits
@@ -188,6 +190,18 @@ public:
   InOut InterpolateNearestNeighbor(RealType *cix, OutputComponentType *out)
     { return Superclass::INSIDE; }
 
+  void InterpolateScanline(const RealType *cix, const RealType *step, int n, bool use_nn,
+                           OutputComponentType *out, InOut *status)
+    {
+    RealType p[VDim];
+    for(int k = 0; k < n; k++, out += this->nSampled)
+      {
+      for(unsigned int d = 0; d < VDim; d++)
+        p[d] = cix[d] + k * step[d];
+      status[k] = use_nn ? InterpolateNearestNeighbor(p, out) : Interpolate(p, out);
+      }
+    }
+
   TFloat GetMask() { return 0.0; }
 
   TFloat GetMaskAndGradient(RealType *mask_gradient) { return 0.0; }
@@ -404,6 +418,94 @@ public:
     else return Superclass::OUTSIDE;
   }
 
+  /**
+   * Batched interpolation along a scanline. The samples are taken at positions
+   * cix + k * step, for k = 0 ... n-1, which is how the slicers traverse the
+   * lines of an oblique slice. For each sample, nSampled components are written
+   * to out and the inside/outside status is written to status.
+   *
+   * The samples are processed in chunks. In the first pass over a chunk, the
+   * voxel offsets, interpolation weights and inside flags are computed without
+   * branching, so that the compiler can vectorize the loop. In the second pass,
+   * samples that are fully inside the image are interpolated directly from the
+   * buffer, and the (rare) samples near the image border fall back on the
+   * single-voxel code.
+   */
+  void InterpolateScanline(const RealType *cix, const RealType *step, int n, bool use_nn,
+                           OutputComponentType *out, InOut *status)
+  {
+    const std::ptrdiff_t sx = this->nComp;
+    const std::ptrdiff_t sy = sx * xsize;
+    const std::ptrdiff_t sz = sy * ysize;
+    const RealType shift = use_nn ? 0.5 : 0.0;
+
+    std::ptrdiff_t off[ScanlineChunkSize];
+    RealType wx[ScanlineChunkSize], wy[ScanlineChunkSize], wz[ScanlineChunkSize];
+    unsigned char inside[ScanlineChunkSize];
+
+    for(int k0 = 0; k0 < n; k0 += ScanlineChunkSize)
+      {
+      int nk = std::min(n - k0, (int) ScanlineChunkSize);
+
+      // First pass: compute offsets and weights
+      for(int k = 0; k < nk; k++)
+        {
+        RealType px = cix[0] + (k0 + k) * step[0] + shift;
+        RealType py = cix[1] + (k0 + k) * step[1] + shift;
+        RealType pz = cix[2] + (k0 + k) * step[2] + shift;
+        RealType fx0 = floor(px), fy0 = floor(py), fz0 = floor(pz);
+        int ix = (int) fx0, iy = (int) fy0, iz = (int) fz0;
+        wx[k] = px - fx0; wy[k] = py - fy0; wz[k] = pz - fz0;
+
+        // For linear interpolation all eight corners must be inside, for
+        // nearest neighbor only the rounded voxel must be inside
+        int margin = use_nn ? 0 : 1;
+        inside[k] = (ix >= 0) & (ix + margin < xsize)
+            & (iy >= 0) & (iy + margin < ysize)
+            & (iz >= 0) & (iz + margin < zsize);
+        off[k] = inside[k] ? ix * sx + iy * sy + iz * sz : 0;
+        }
+
+      // Second pass: sample the image
+      for(int k = 0; k < nk; k++, out += this->nSampled)
+        {
+        if(inside[k])
+          {
+          const InputComponentType *dp = this->buffer + off[k];
+          if(use_nn)
+            {
+            for(int iComp = 0; iComp < this->nSampled; iComp++)
+              out[iComp] = dp[iComp];
+            }
+          else
+            {
+            RealType ax = wx[k], ay = wy[k], az = wz[k];
+            for(int iComp = 0; iComp < this->nSampled; iComp++, dp++)
+              {
+              OutputComponentType dx00 = Superclass::lerp(ax, dp[0], dp[sx]);
+              OutputComponentType dx10 = Superclass::lerp(ax, dp[sy], dp[sy+sx]);
+              OutputComponentType dx01 = Superclass::lerp(ax, dp[sz], dp[sz+sx]);
+              OutputComponentType dx11 = Superclass::lerp(ax, dp[sz+sy], dp[sz+sy+sx]);
+              OutputComponentType dxy0 = Superclass::lerp(ay, dx00, dx10);
+              OutputComponentType dxy1 = Superclass::lerp(ay, dx01, dx11);
+              out[iComp] = Superclass::lerp(az, dxy0, dxy1);
+              }
+            }
+          status[k0 + k] = Superclass::INSIDE;
+          }
+        else
+          {
+          RealType p[3];
+          for(int d = 0; d < 3; d++)
+            p[d] = cix[d] + (k0 + k) * step[d];
+          status[k0 + k] = use_nn
+              ? this->InterpolateNearestNeighbor(p, out)
+              : this->Interpolate(p, out);
+          }
+        }
+      }
+  }
+
 
   template <class THistContainer>
   void PartialVolumeHistogramSample(RealType *cix, const InputComponentType *fixptr, THistContainer &hist)
@@ -559,6 +661,9 @@ public:
 
 protected:
 
+  // Number of samples processed at once by InterpolateScanline
+  enum { ScanlineChunkSize = 64 };
+
   inline const InputComponentType *border_check(int X, int Y, int Z, RealType &mask)
   {
     if(X >= 0 && X < xsize && Y >= 0 && Y < ysize && Z >= 0 && Z < zsize)
@@ -42,6 +42,8 @@
 #include <itkImageSliceConstIteratorWithIndex.h>
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkImageLinearIteratorWithIndex.h>
+#include "SliceBufferPool.h"
+#include "BrickedImageBuffer.h"
 
 /**
  * \class IRISSlicer
@@ -138,6 +140,40 @@ public:
   itkGetMacro(BypassMainInput, bool)
   itkSetMacro(BypassMainInput, bool)
 
+  /**
+   * Report that the voxels of an image that shares its pixel container with
+   * the input changed only within a region, between two of the image's
+   * modified times. Partial updates are only implemented for run-length
+   * encoded images, so the report is ignored here.
+   */
+  void AddInputModifiedRegion(const InputImageType *, itk::ModifiedTimeType,
+                              itk::ModifiedTimeType, const InputImageRegionType &) {}
+
+  /** Number of times the output slice has been generated */
+  itkGetConstMacro(SliceVersion, unsigned long)
+
+  /**
+   * Whether the last update only regenerated a part of the output slice,
+   * and if so, which part. The slice is always regenerated in full here.
+   */
+  bool GetLastUpdatedRegion(OutputImageRegionType &) const { return false; }
+
+  /**
+   * Set a bricked copy of the input, shared with the other slicers of the
+   * same image, that is used to extract slices along the x axis. The copy is
+   * brought up to date with the input when such a slice is generated. It is
+   * only used for images that store their pixels natively and that are
+   * sliced into the same pixel type. Set to NULL to disable. If the buffer
+   * holds the compressed voxels of the input, which then has no voxels of
+   * its own, the slices in all directions are read from the buffer.
+   */
+  typedef BrickedImageBuffer<InputComponentType> BrickedBufferType;
+  void SetBrickedBuffer(BrickedBufferType *buffer);
+  BrickedBufferType *GetBrickedBuffer() const { return m_BrickedBuffer; }
+
+  /** Whether a part of the slice can be requested as the output region */
+  static constexpr bool SupportsPartialSlices = true;
+
 protected:
   IRISSlicer();
   virtual ~IRISSlicer() {};
@@ -156,19 +192,34 @@ protected:
 
   void GenerateInputRequestedRegion() ITK_OVERRIDE;
 
+  /** Allocate the output slice from the pool of slice buffers */
+  void AllocateOutputs() ITK_OVERRIDE;
+
   /**
    * This method maps an input region to an output region
    */
   virtual void CallCopyOutputRegionToInputRegion(InputImageRegionType &destRegion,
                               const OutputImageRegionType &srcRegion) ITK_OVERRIDE;
 
-  /** 
-   * IRISSlicer is not implemented as a multithreaded filter.
-   * \sa ImageToImageFilter::GenerateData()  
+  /**
+   * Decide which of the inputs (main or preview) the slice is taken from. This
+   * is done once before the output is split into row bands for threading.
+   */
+  void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
+  /** Release the slice of the bricked buffer read by the threads */
+  void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+  /**
+   * Each thread copies a band of rows (lines) of the output slice. The bands
+   * are produced by the default image region splitter, which splits along the
+   * last output dimension, i.e., along the line direction.
+   * \sa ImageToImageFilter::DynamicThreadedGenerateData()
    */
-  virtual void GenerateData() ITK_OVERRIDE;
+  void DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread) ITK_OVERRIDE;
 
-  template <class TSourceImage> void DoGenerateData(const TSourceImage *source);
+  template <class TSourceImage>
+  void DoGenerateData(const TSourceImage *source, const OutputImageRegionType &region);
 
 private:
   IRISSlicer(const Self&); //purposely not implemented
@@ -194,6 +245,18 @@ private:
 
   // Whether the main input should always be bypassed
   bool m_BypassMainInput;
+
+  // Whether the current update reads from the preview input (set before
+  // the threaded portion of the update)
+  bool m_UsePreviewInputForUpdate;
+
+  // Bricked copy of the input, and whether the current update reads from it
+  typename BrickedBufferType::Pointer m_BrickedBuffer;
+  bool m_UseBrickedBufferForUpdate = false;
+  typename BrickedBufferType::Slice m_BrickedSlice;
+
+  // Number of times the output has been generated
+  unsigned long m_SliceVersion;
   
   // The worker methods in this filter
   // void CopySliceLineForwardPixelForward(InputIteratorType, OutputImageType *);
@@ -285,6 +348,41 @@ public:
   itkGetMacro(BypassMainInput, bool)
   itkSetMacro(BypassMainInput, bool)
 
+  /**
+   * Report that the voxels of an image that shares its pixel container with
+   * the input changed only within a region, between two of the image's
+   * modified times (before and after the change). As long as all the changes
+   * to the image since the last update are reported, the next update only
+   * decompresses the lines of the slice that cross the modified regions.
+   * This does not modify the filter.
+   */
+  void AddInputModifiedRegion(const InputImageType *source,
+                              itk::ModifiedTimeType before,
+                              itk::ModifiedTimeType after,
+                              const InputImageRegionType &region);
+
+  /** Number of times the output slice has been generated */
+  itkGetConstMacro(SliceVersion, unsigned long)
+
+  /**
+   * Whether the last update only regenerated a part of the output slice,
+   * and if so, which part (possibly empty). The rest of the slice is the same
+   * as after the previous update.
+   */
+  bool GetLastUpdatedRegion(OutputImageRegionType &region) const;
+
+  /**
+   * Run-length encoded images are not bricked, since that would undo their
+   * compression. Slices along x find the runs containing the slice using an
+   * index of the runs of each line instead.
+   */
+  typedef BrickedImageBuffer<InputComponentType> BrickedBufferType;
+  void SetBrickedBuffer(BrickedBufferType *) {}
+  BrickedBufferType *GetBrickedBuffer() const { return nullptr; }
+
+  /** Whole lines are always decompressed, so the whole slice is generated */
+  static constexpr bool SupportsPartialSlices = false;
+
 protected:
 
   IRISSlicer();
@@ -304,6 +402,9 @@ protected:
 
   void GenerateInputRequestedRegion() ITK_OVERRIDE;
 
+  /** Allocate the output slice from the pool of slice buffers */
+  void AllocateOutputs() ITK_OVERRIDE;
+
   /**
     * This method maps an input region to an output region
     */
@@ -362,6 +463,57 @@ private:
   // Whether the main input should always be bypassed
   bool m_BypassMainInput;
 
+  // A change to the input reported with AddInputModifiedRegion
+  struct InputChange
+  {
+    itk::ModifiedTimeType BeforeMTime, AfterMTime;
+    InputImageRegionType Region;
+  };
+
+  // The image whose changes are reported, the changes reported since the
+  // last update, and the modified time of the image when it was last sliced
+  typename InputImageType::ConstPointer m_ChangeSource;
+  std::vector<InputChange> m_InputChanges;
+  itk::ModifiedTimeType m_ChangeSourceMTimeAtUpdate = 0;
+
+  // When the last slice was generated, and from which parameters
+  itk::TimeStamp m_UpdateTime;
+  OutputImageRegionType m_UpdateOutputRegion;
+
+  // Version of the slice, and the part of it regenerated by the last update
+  unsigned long m_SliceVersion = 0;
+  bool m_LastUpdateIsPartial = false;
+  OutputImageRegionType m_LastUpdatedRegion;
+
+  // Maximum number of changes kept between updates
+  static constexpr size_t MAX_INPUT_CHANGES = 256;
+
+  // Find the region of the input modified since the last update, if known
+  bool GetInputRegionModifiedSinceUpdate(const InputImageType *input,
+                                         InputImageRegionType &region);
+
+  // Map a region of the input onto the output slice
+  OutputImageRegionType MapInputRegionToOutputRegion(const InputImageRegionType &region);
+
+  // For slices along x, the run of each line (y, z) that contained the last
+  // slice and the x coordinate where that run starts, so that nearby slices
+  // are found without searching. Lines with many runs also keep the x where
+  // each run ends, built when first needed, so that the run containing any
+  // other slice is found by binary search. The entries of the lines crossed
+  // by reported changes are reset when the image is edited, and all entries
+  // when the image is replaced or changed in an unknown way.
+  struct LineRunIndex
+  {
+    unsigned int Run = 0, Start = 0;
+    std::vector<unsigned int> RunEnds;
+  };
+  std::vector<LineRunIndex> m_RunIndex;
+  const void *m_RunIndexBuffer = nullptr;
+  itk::ModifiedTimeType m_RunIndexMTime = 0;
+
+  // Lines with at least this many runs are searched using the run ends
+  static constexpr size_t RUN_INDEX_MIN_RUNS = 16;
+
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -83,6 +83,14 @@ IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
   m_SliceIndex = 0;
 
   m_BypassMainInput = false;
+  m_UsePreviewInputForUpdate = false;
+  m_SliceVersion = 0;
+
+  // The output slice is split into bands of lines for multithreading
+  this->DynamicMultiThreadingOn();
+
+  // Keep the output slice between updates, so that its buffer is reused
+  this->ReleaseDataBeforeUpdateFlagOff();
 }
 
 template <class TInputImage, class TOutputImage, class TPreviewImage>
@@ -221,10 +229,84 @@ IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
     }
 }
 
+template <class TInputImage, class TOutputImage, class TPreviewImage>
+void
+IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
+::AllocateOutputs()
+{
+  // Reuse the buffer of the previous slice if it is large enough, otherwise
+  // get one from the pool of slice buffers
+  OutputImageType *output = this->GetOutput();
+  output->SetBufferedRegion(output->GetRequestedRegion());
+  AllocatePooledImage(output);
+}
+
 #include "itkImageLinearIteratorWithIndex.h"
 #include "itkImageRegionConstIterator.h"
 #include "itkImageConstIterator.h"
 #include "itkImageFileWriter.h"
+#include <algorithm>
+
+/**
+ * Helper used to copy entire lines of voxels directly from the input buffer
+ * into the output buffer, bypassing the pixel accessors and the output
+ * iterator. This is only possible when the source image stores its pixels
+ * natively (i.e., it is not an adaptor) and the output has the same pixel
+ * type. For all other combinations, Enabled is false and the slicer falls
+ * back on the accessor-based code.
+ */
+template <class TSourceImage, class TOutputImage>
+class IRISSlicerDirectCopyHelper
+{
+public:
+  static constexpr bool Enabled = false;
+
+  template <class TSourceComponent, class TOutputComponent>
+  static void CopyLine(const TSourceComponent *, long, long, unsigned int, TOutputComponent *) {}
+};
+
+template <class TPixel>
+class IRISSlicerDirectCopyHelper< itk::Image<TPixel, 3>, itk::Image<TPixel, 2> >
+{
+public:
+  static constexpr bool Enabled = true;
+
+  static void CopyLine(const TPixel *src, long stride, long n, unsigned int, TPixel *out)
+  {
+    // Slicing along z (and along y with x as the pixel axis) reads contiguous
+    // voxels, which can be block-copied. Otherwise we gather with a stride.
+    if(stride == 1)
+      {
+      std::copy(src, src + n, out);
+      }
+    else
+      {
+      for(long i = 0; i < n; i++, src += stride)
+        out[i] = *src;
+      }
+  }
+};
+
+template <class TPixel>
+class IRISSlicerDirectCopyHelper< itk::VectorImage<TPixel, 3>, itk::VectorImage<TPixel, 2> >
+{
+public:
+  static constexpr bool Enabled = true;
+
+  static void CopyLine(const TPixel *src, long stride, long n, unsigned int ncomp, TPixel *out)
+  {
+    if(stride == static_cast<long>(ncomp))
+      {
+      std::copy(src, src + n * ncomp, out);
+      }
+    else
+      {
+      for(long i = 0; i < n; i++, src += stride, out += ncomp)
+        std::copy(src, src + ncomp, out);
+      }
+  }
+};
+
 
 // This method is templated to allow preview input and actual input to be different
 // types
@@ -232,19 +314,21 @@ template <class TInputImage, class TOutputImage, class TPreviewImage>
 template <class TSourceImage>
 void
 IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
-::DoGenerateData(const TSourceImage *inputPtr)
+::DoGenerateData(const TSourceImage *inputPtr, const OutputImageRegionType &region)
 {
   typedef typename TSourceImage::AccessorFunctorType AccessorFunctorType;
   typedef typename TSourceImage::AccessorType AccessorType;
   typedef typename TSourceImage::OffsetValueType OffsetType;
   typedef typename TSourceImage::InternalPixelType ComponentType;
+  typedef IRISSlicerDirectCopyHelper<TSourceImage, OutputImageType> DirectCopyHelper;
+
+  // Nothing to do for an empty band
+  if(region.GetNumberOfPixels() == 0)
+    return;
 
   // The output image
   OutputImageType *outputPtr = this->GetOutput();
 
-  // Allocate (why is this necessary?)
-  this->AllocateOutputs();
-
   // Get the image dimensions
   typename InputImageType::SizeType szVol = inputPtr->GetBufferedRegion().GetSize();
 
@@ -260,24 +344,30 @@ IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
   stride_image *= ncomp;
 
   // Determine the strides for the pixel step and line step
-  int sPixel = (m_PixelTraverseForward ? 1 : -1) *
-    stride_image[m_PixelDirectionImageAxis];
-  int sLine = (m_LineTraverseForward ? 1 : -1) *
-    stride_image[m_LineDirectionImageAxis];
+  long sPixel = (m_PixelTraverseForward ? 1 : -1) *
+    static_cast<long>(stride_image[m_PixelDirectionImageAxis]);
+  long sLine = (m_LineTraverseForward ? 1 : -1) *
+    static_cast<long>(stride_image[m_LineDirectionImageAxis]);
+
+  // The band of the slice handled by this thread, relative to the slice corner
+  const OutputImageRegionType &slice_region = outputPtr->GetLargestPossibleRegion();
+  long iPixelOffset = region.GetIndex(0) - slice_region.GetIndex(0);
+  long iLineOffset = region.GetIndex(1) - slice_region.GetIndex(1);
+  long nPixels = region.GetSize(0), nLines = region.GetSize(1);
 
   // We never take full line-strides, because as we iterate, we
   // take n pixel-strides before needing to worry about changing
   // the line. Therefore, we compute the step needed to go to the
   // start of next line after taking n pixel-strides
-  int sRowOfPixels = sPixel * szVol[m_PixelDirectionImageAxis];
-  int sLineDelta = sLine - sRowOfPixels;
+  long sRowOfPixels = sPixel * nPixels;
+  long sLineDelta = sLine - sRowOfPixels;
 
   // Determine the first voxel that we will traverse
   Vector3i xStartVoxel;
-  xStartVoxel[m_PixelDirectionImageAxis] =
-    m_PixelTraverseForward ? 0 : szVol[m_PixelDirectionImageAxis] - 1;
-  xStartVoxel[m_LineDirectionImageAxis] =
-    m_LineTraverseForward ? 0 : szVol[m_LineDirectionImageAxis] - 1;
+  xStartVoxel[m_PixelDirectionImageAxis] = m_PixelTraverseForward
+      ? iPixelOffset : szVol[m_PixelDirectionImageAxis] - 1 - iPixelOffset;
+  xStartVoxel[m_LineDirectionImageAxis] = m_LineTraverseForward
+      ? iLineOffset : szVol[m_LineDirectionImageAxis] - 1 - iLineOffset;
   xStartVoxel[m_SliceDirectionImageAxis] =
     szVol[m_SliceDirectionImageAxis] == 1 ? 0 : m_SliceIndex;
 
@@ -290,9 +380,63 @@ IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
   // Get pointers to input and output data
   const ComponentType *pSource = inputPtr->GetBufferPointer();
 
+  // Fast path: copy whole lines between the raw buffers
+  if constexpr(DirectCopyHelper::Enabled)
+    {
+    // Position of the first output component for this band
+    long sOutLine = ncomp * static_cast<long>(outputPtr->GetBufferedRegion().GetSize(0));
+    OutputComponentType *pOut = outputPtr->GetBufferPointer()
+        + ncomp * outputPtr->ComputeOffset(region.GetIndex());
+
+    // Slices along x are gathered from the bricked copy of the input, where
+    // neighboring voxels in any direction share cache lines
+    if constexpr(std::is_same<TSourceImage, InputImageType>::value)
+      {
+      if(m_UseBrickedBufferForUpdate)
+        {
+        // The input has no voxels while they are held compressed by the
+        // bricked buffer, so the component count is taken from the buffer
+        ncomp = m_BrickedBuffer->GetNumberOfComponents();
+        sOutLine = ncomp * static_cast<long>(outputPtr->GetBufferedRegion().GetSize(0));
+        pOut = outputPtr->GetBufferPointer() + ncomp * outputPtr->ComputeOffset(region.GetIndex());
+
+        const size_t *offPixel = m_BrickedSlice.Offsets[m_PixelDirectionImageAxis];
+        const size_t *offLine = m_BrickedSlice.Offsets[m_LineDirectionImageAxis];
+        const ComponentType *pBricks = m_BrickedSlice.Base;
+
+        long dPixel = m_PixelTraverseForward ? 1 : -1;
+        long dLine = m_LineTraverseForward ? 1 : -1;
+        long l = xStartVoxel[m_LineDirectionImageAxis];
+        for(long j = 0; j < nLines; j++, l += dLine, pOut += sOutLine)
+          {
+          const ComponentType *pLine = pBricks + offLine[l];
+          OutputComponentType *o = pOut;
+          long p = xStartVoxel[m_PixelDirectionImageAxis];
+          if(ncomp == 1)
+            {
+            for(long i = 0; i < nPixels; i++, p += dPixel)
+              *o++ = pLine[offPixel[p]];
+            }
+          else
+            {
+            for(long i = 0; i < nPixels; i++, p += dPixel, o += ncomp)
+              std::copy(pLine + offPixel[p], pLine + offPixel[p] + ncomp, o);
+            }
+          }
+        return;
+        }
+      }
+
+    pSource += iStart;
+    for(long j = 0; j < nLines; j++, pSource += sLine, pOut += sOutLine)
+      DirectCopyHelper::CopyLine(pSource, sPixel, nPixels, ncomp, pOut);
+
+    return;
+    }
+
   // Set up the output iterator
   typedef itk::ImageLinearIteratorWithIndex<OutputImageType> OutIterType;
-  OutIterType it_out(outputPtr, outputPtr->GetBufferedRegion());
+  OutIterType it_out(outputPtr, region);
 
   // Get the pixel accessor functor - for unified access to voxels
   AccessorType accessor = inputPtr->GetPixelAccessor();
@@ -327,23 +471,70 @@ IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
 template <class TInputImage, class TOutputImage, class TPreviewImage>
 void
 IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
-::GenerateData()
+::BeforeThreadedGenerateData()
 {
-  // Here's the input and output
+  // Here's the input
   const InputImageType *inputPtr = this->GetInput();
 
   // Decide if we want to use the preview input instead
   const PreviewImageType *preview =
       (PreviewImageType *) this->GetInputs()[1].GetPointer();
 
-  if(preview &&
-     (m_BypassMainInput || preview->GetMTime() > inputPtr->GetMTime()))
+  m_UsePreviewInputForUpdate =
+      preview && (m_BypassMainInput || preview->GetMTime() > inputPtr->GetMTime());
+
+  // Slices along x are read from the bricked copy of the input, which is
+  // brought up to date here, before the threads start reading it. When the
+  // bricked buffer holds the compressed voxels of the input, all slices are
+  // read from it, and this decompresses the layer of bricks they cross
+  m_UseBrickedBufferForUpdate = false;
+  if constexpr(IRISSlicerDirectCopyHelper<InputImageType, OutputImageType>::Enabled)
+    {
+    typename InputImageType::SizeType szVol = inputPtr->GetBufferedRegion().GetSize();
+    size_t nvoxels = inputPtr->GetBufferedRegion().GetNumberOfPixels();
+    if(m_BrickedBuffer && !m_UsePreviewInputForUpdate && nvoxels > 0)
+      {
+      bool compressed = m_BrickedBuffer->IsCompressed();
+      if(compressed || m_SliceDirectionImageAxis == 0)
+        {
+        if(!compressed)
+          {
+          unsigned int ncomp = static_cast<unsigned int>(inputPtr->GetPixelContainer()->Size() / nvoxels);
+          m_BrickedBuffer->Update(inputPtr, inputPtr->GetBufferPointer(), ncomp);
+          }
+        unsigned int index = szVol[m_SliceDirectionImageAxis] == 1 ? 0 : m_SliceIndex;
+        m_BrickedSlice = m_BrickedBuffer->GetSlice(m_SliceDirectionImageAxis, index);
+        m_UseBrickedBufferForUpdate = true;
+        }
+      }
+    }
+
+  m_SliceVersion++;
+}
+
+template <class TInputImage, class TOutputImage, class TPreviewImage>
+void
+IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
+::AfterThreadedGenerateData()
+{
+  // Let go of the decompressed layer, so that the buffer can release it
+  m_BrickedSlice = typename BrickedBufferType::Slice();
+}
+
+template <class TInputImage, class TOutputImage, class TPreviewImage>
+void
+IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
+::DynamicThreadedGenerateData(const OutputImageRegionType &outputRegionForThread)
+{
+  if(m_UsePreviewInputForUpdate)
     {
-    this->DoGenerateData(preview);
+    const PreviewImageType *preview =
+        (PreviewImageType *) this->GetInputs()[1].GetPointer();
+    this->DoGenerateData(preview, outputRegionForThread);
     }
   else
     {
-    this->DoGenerateData(inputPtr);
+    this->DoGenerateData(this->GetInput(), outputRegionForThread);
     }
 }
 
@@ -370,6 +561,18 @@ IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
   this->SetNthInput(1, input);
 }
 
+template <class TInputImage, class TOutputImage, class TPreviewImage>
+void
+IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
+::SetBrickedBuffer(BrickedBufferType *buffer)
+{
+  if(m_BrickedBuffer != buffer)
+    {
+    m_BrickedBuffer = buffer;
+    this->Modified();
+    }
+}
+
 template <class TInputImage, class TOutputImage, class TPreviewImage>
 typename IRISSlicer<TInputImage, TOutputImage,TPreviewImage>::PreviewImageType *
 IRISSlicer<TInputImage, TOutputImage, TPreviewImage>
@@ -32,6 +32,8 @@
   PURPOSE.  See the above copyright notices for more information.
 
 =========================================================================*/
+#include <algorithm>
+#include "TaskScheduler.h"
 #include "itkDefaultPixelAccessor.h"
 #include "itkDefaultPixelAccessorFunctor.h"
 #include "itkImageAdaptor.h"
@@ -64,6 +66,10 @@ IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
 
   // Initialize to a zero slice index
   m_SliceIndex = 0;
+
+  // Keep the output slice between updates, so that its buffer is reused and
+  // the parts of it that did not change remain valid
+  this->ReleaseDataBeforeUpdateFlagOff();
 }
 
 template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
@@ -194,6 +200,128 @@ void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
     }
 }
 
+template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
+void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
+::AllocateOutputs()
+{
+  // Reuse the buffer of the previous slice if it is large enough, otherwise
+  // get one from the pool of slice buffers
+  OutputImageType *output = this->GetOutput();
+  output->SetBufferedRegion(output->GetRequestedRegion());
+  AllocatePooledImage(output);
+}
+
+template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
+void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
+::AddInputModifiedRegion(const InputImageType *source,
+                         itk::ModifiedTimeType before,
+                         itk::ModifiedTimeType after,
+                         const InputImageRegionType &region)
+{
+  // Changes to a different image start a new history
+  if (source != m_ChangeSource.GetPointer())
+    {
+    m_ChangeSource = source;
+    m_InputChanges.clear();
+    m_ChangeSourceMTimeAtUpdate = 0;
+    }
+
+  // Too many changes between updates are not worth keeping track of
+  if (m_InputChanges.size() >= MAX_INPUT_CHANGES)
+    {
+    m_InputChanges.clear();
+    m_ChangeSourceMTimeAtUpdate = 0;
+    return;
+    }
+
+  m_InputChanges.push_back(InputChange { before, after, region });
+}
+
+template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
+bool IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
+::GetInputRegionModifiedSinceUpdate(const InputImageType *input, InputImageRegionType &region)
+{
+  // The reported image must hold the voxels being sliced, and must have been
+  // sliced before with the same parameters into the same output buffer
+  if (!m_ChangeSource || !m_ChangeSourceMTimeAtUpdate
+      || input->GetBuffer()->GetBufferPointer() != m_ChangeSource->GetBuffer()->GetBufferPointer()
+      || input->GetBufferedRegion() != m_ChangeSource->GetBufferedRegion()
+      || this->GetMTime() > m_UpdateTime.GetMTime()
+      || this->GetOutput()->GetBufferedRegion() != m_UpdateOutputRegion)
+    return false;
+
+  // Follow the reported changes from the time of the last update. If any
+  // change to the image was not reported, the chain is broken.
+  itk::ModifiedTimeType t = m_ChangeSourceMTimeAtUpdate;
+  bool empty = true;
+  for (const InputChange &change : m_InputChanges)
+    {
+    if (change.AfterMTime <= m_ChangeSourceMTimeAtUpdate)
+      continue;
+    if (change.BeforeMTime != t)
+      return false;
+
+    if (empty)
+      {
+      region = change.Region;
+      empty = false;
+      }
+    else
+      {
+      // Bounding box of the two regions
+      for (unsigned int d = 0; d < 3; d++)
+        {
+        itk::IndexValueType i0 = std::min(region.GetIndex(d), change.Region.GetIndex(d));
+        itk::IndexValueType i1 = std::max(region.GetIndex(d) + (itk::IndexValueType) region.GetSize(d),
+                                          change.Region.GetIndex(d) + (itk::IndexValueType) change.Region.GetSize(d));
+        region.SetIndex(d, i0);
+        region.SetSize(d, i1 - i0);
+        }
+      }
+    t = change.AfterMTime;
+    }
+
+  if (t != m_ChangeSource->GetMTime())
+    return false;
+
+  // An empty region means that nothing changed
+  if (empty)
+    region = InputImageRegionType();
+  else if (!region.Crop(input->GetBufferedRegion()))
+    region = InputImageRegionType();
+  return true;
+}
+
+template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
+typename IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>::OutputImageRegionType
+IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
+::MapInputRegionToOutputRegion(const InputImageRegionType &region)
+{
+  // This is the inverse of CallCopyOutputRegionToInputRegion
+  const InputImageRegionType &lpr = this->GetInput()->GetLargestPossibleRegion();
+  unsigned int axes[2] = { m_PixelDirectionImageAxis, m_LineDirectionImageAxis };
+  bool forward[2] = { m_PixelTraverseForward, m_LineTraverseForward };
+
+  OutputImageRegionType out;
+  for (unsigned int d = 0; d < 2; d++)
+    {
+    long i = region.GetIndex(axes[d]), n = region.GetSize(axes[d]);
+    out.SetSize(d, n);
+    out.SetIndex(d, forward[d] ? i : (long) lpr.GetSize(axes[d]) - (i + n));
+    }
+  return out;
+}
+
+template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
+bool IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
+::GetLastUpdatedRegion(OutputImageRegionType &region) const
+{
+  if (!m_LastUpdateIsPartial)
+    return false;
+  region = m_LastUpdatedRegion;
+  return true;
+}
+
 #include "RLEImageRegionConstIterator.h"
 
 #define sign(forward) (forward ? 1 : -1)
@@ -224,6 +352,44 @@ void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
   szVol[1] = inputPtr->GetBufferedRegion().GetSize(1);
   szVol[2] = inputPtr->GetBufferedRegion().GetSize(2);
 
+  // The range of lines (y, z) that need to be decompressed. If the only
+  // changes to the input since the last update are known, only the lines
+  // crossing the modified region are decompressed into the previous slice.
+  long y0 = 0, y1 = szVol[1], z0 = 0, z1 = szVol[2];
+  InputImageRegionType modified;
+  m_LastUpdateIsPartial = false;
+  bool modifiedKnown = inputPtr == this->GetInput()
+      && this->GetInputRegionModifiedSinceUpdate(inputPtr, modified);
+  if (modifiedKnown)
+    {
+    long i_slice = m_SliceIndex - inputPtr->GetBufferedRegion().GetIndex(m_SliceDirectionImageAxis);
+    long m0 = modified.GetIndex(m_SliceDirectionImageAxis) - inputPtr->GetBufferedRegion().GetIndex(m_SliceDirectionImageAxis);
+    long m1 = m0 + (long) modified.GetSize(m_SliceDirectionImageAxis);
+
+    m_LastUpdateIsPartial = true;
+    if (i_slice < m0 || i_slice >= m1)
+      {
+      // The slice does not cross the modified voxels
+      y1 = y0; z1 = z0;
+      m_LastUpdatedRegion = OutputImageRegionType();
+      }
+    else
+      {
+      // Whole lines along x are decompressed
+      y0 = modified.GetIndex(1) - inputPtr->GetBufferedRegion().GetIndex(1);
+      y1 = y0 + (long) modified.GetSize(1);
+      z0 = modified.GetIndex(2) - inputPtr->GetBufferedRegion().GetIndex(2);
+      z1 = z0 + (long) modified.GetSize(2);
+
+      InputImageRegionType updated = modified;
+      updated.SetIndex(0, inputPtr->GetBufferedRegion().GetIndex(0));
+      updated.SetSize(0, szVol[0]);
+      updated.SetIndex(m_SliceDirectionImageAxis, m_SliceIndex);
+      updated.SetSize(m_SliceDirectionImageAxis, 1);
+      m_LastUpdatedRegion = this->MapInputRegionToOutputRegion(updated);
+      }
+    }
+
   // Also cast the output size to long
   long szSlice[2];
   szSlice[0] = outputPtr->GetBufferedRegion().GetSize(0);
@@ -241,78 +407,164 @@ void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
 
   if (m_SliceDirectionImageAxis == 2) //slicing along z
     {
-#pragma omp parallel for
-    for (int y = 0; y < szVol[1]; y++)
+    TaskScheduler::GetInstance()->ParallelFor(TaskScheduler::INTERACTIVE, y0, y1,
+                                              [&](long first, long last)
       {
-      typename InputImageType::BufferType::IndexType lineIndex = { { y, (int) m_SliceIndex } };
-      const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-      if (m_LineDirectionImageAxis == 1) //y is line coordinate
+      for (int y = (int) first; y < last; y++)
         {
-        assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
-        uncompressLine(line, outSlice + s_line*y*szVol[0], s_pixel * 1);
-        }
-      else if (m_LineDirectionImageAxis == 0) //x is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
-        uncompressLine(line, outSlice + s_pixel*y, s_line*szVol[1]);
+        typename InputImageType::BufferType::IndexType lineIndex = { { y, (int) m_SliceIndex } };
+        const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
+        if (m_LineDirectionImageAxis == 1) //y is line coordinate
+          {
+          assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
+          uncompressLine(line, outSlice + s_line*y*szVol[0], s_pixel * 1);
+          }
+        else if (m_LineDirectionImageAxis == 0) //x is line coordinate
+          {
+          assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
+          uncompressLine(line, outSlice + s_pixel*y, s_line*szVol[1]);
+          }
+        else
+          throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 2!", __FUNCTION__);
         }
-      else
-        throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 2!", __FUNCTION__);
-      }
+      });
     }
   else if (m_SliceDirectionImageAxis == 1) //slicing along y
     {
-#pragma omp parallel for
-    for (int z = 0; z < szVol[2]; z++)
+    TaskScheduler::GetInstance()->ParallelFor(TaskScheduler::INTERACTIVE, z0, z1,
+                                              [&](long first, long last)
       {
-      typename InputImageType::BufferType::IndexType lineIndex = { { (int) m_SliceIndex, z } };
-      const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-      if (m_LineDirectionImageAxis == 2) //z is line coordinate
+      for (int z = (int) first; z < last; z++)
         {
-        assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
-        uncompressLine(line, outSlice + s_line*z*szVol[0], s_pixel * 1);
-        }
-      else if (m_LineDirectionImageAxis == 0) //x is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
-        uncompressLine(line, outSlice + s_pixel*z, s_line*szVol[2]);
+        typename InputImageType::BufferType::IndexType lineIndex = { { (int) m_SliceIndex, z } };
+        const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
+        if (m_LineDirectionImageAxis == 2) //z is line coordinate
+          {
+          assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
+          uncompressLine(line, outSlice + s_line*z*szVol[0], s_pixel * 1);
+          }
+        else if (m_LineDirectionImageAxis == 0) //x is line coordinate
+          {
+          assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
+          uncompressLine(line, outSlice + s_pixel*z, s_line*szVol[2]);
+          }
+        else
+          throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 1!", __FUNCTION__);
         }
-      else
-        throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 1!", __FUNCTION__);
-      }
+      });
     }
   else //slicing along x, the low-preformance case
     {
     assert(m_SliceDirectionImageAxis == 0);
-#pragma omp parallel for
-    for (int z = 0; z < szVol[2]; z++)
-      for (int y = 0; y < szVol[1]; y++)
+
+    // Offsets of the output voxel of line (y, z)
+    long o_y, o_z;
+    if (m_LineDirectionImageAxis == 2) //z is line coordinate
+      {
+      assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
+      o_y = s_pixel; o_z = s_line * szVol[1];
+      }
+    else if (m_LineDirectionImageAxis == 1) //y is line coordinate
+      {
+      assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
+      o_y = s_line * szVol[2]; o_z = s_pixel;
+      }
+    else
+      throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 0!", __FUNCTION__);
+
+    // Bring the run index up to date. If the changes since the index was
+    // last used are known, only the entries of the lines they cross are
+    // reset, otherwise the whole index is.
+    size_t n_lines = (size_t) szVol[1] * szVol[2];
+    const void *buffer = inputPtr->GetBuffer()->GetBufferPointer();
+    if (m_RunIndex.size() != n_lines || m_RunIndexBuffer != buffer)
+      {
+      m_RunIndex.clear();
+      m_RunIndex.resize(n_lines);
+      m_RunIndexBuffer = buffer;
+      }
+    else if (m_RunIndexMTime != inputPtr->GetMTime())
+      {
+      if (modifiedKnown && m_RunIndexMTime == m_ChangeSourceMTimeAtUpdate)
         {
-        typename InputImageType::BufferType::IndexType lineIndex = { { y, z } };
-        const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-        int t = 0;
-        for (int x = 0; x < line.size(); x++)
+        long my0 = modified.GetIndex(1) - inputPtr->GetBufferedRegion().GetIndex(1);
+        long mz0 = modified.GetIndex(2) - inputPtr->GetBufferedRegion().GetIndex(2);
+        long my1 = my0 + (long) modified.GetSize(1), mz1 = mz0 + (long) modified.GetSize(2);
+        for (long z = std::max(mz0, 0l); z < std::min(mz1, szVol[2]); z++)
+          for (long y = std::max(my0, 0l); y < std::min(my1, szVol[1]); y++)
+            m_RunIndex[(size_t) z * szVol[1] + y] = LineRunIndex();
+        }
+      else
+        {
+        m_RunIndex.clear();
+        m_RunIndex.resize(n_lines);
+        }
+      }
+    m_RunIndexMTime = inputPtr->GetMTime();
+
+    unsigned int x = m_SliceIndex;
+    TaskScheduler::GetInstance()->ParallelFor(TaskScheduler::INTERACTIVE, z0, z1,
+                                              [&](long first, long last)
+      {
+      for (int z = (int) first; z < last; z++)
+        for (int y = y0; y < y1; y++)
           {
-          t += line[x].first;
-          if (t > m_SliceIndex)
+          typename InputImageType::BufferType::IndexType lineIndex = { { y, z } };
+          const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
+          LineRunIndex &e = m_RunIndex[(size_t) z * szVol[1] + y];
+          if (x < e.Start || x >= e.Start + line[e.Run].first)
             {
-            if (m_LineDirectionImageAxis == 2) //z is line coordinate
+            if (line.size() >= RUN_INDEX_MIN_RUNS)
               {
-              assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
-              *(outSlice + s_line*z*szVol[1] + s_pixel *y) = line[x].second;;
+              // Binary search for the first run ending after the slice
+              if (e.RunEnds.empty())
+                {
+                e.RunEnds.resize(line.size());
+                unsigned int end = 0;
+                for (size_t r = 0; r < line.size(); r++)
+                  e.RunEnds[r] = (end += line[r].first);
+                }
+              e.Run = std::upper_bound(e.RunEnds.begin(), e.RunEnds.end(), x) - e.RunEnds.begin();
+              e.Start = e.Run ? e.RunEnds[e.Run - 1] : 0;
               }
-            else if (m_LineDirectionImageAxis == 1) //y is line coordinate
+            else
               {
-              assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
-              *(outSlice + s_pixel*z + s_line *y*szVol[2]) = line[x].second;
+              // Few runs, move from the run of the previous slice
+              while (e.Start > x)
+                {
+                e.Run--;
+                e.Start -= line[e.Run].first;
+                }
+              while (e.Start + line[e.Run].first <= x)
+                {
+                e.Start += line[e.Run].first;
+                e.Run++;
+                }
               }
-            else
-              throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 0!", __FUNCTION__);
-            break;
             }
+          *(outSlice + o_y * y + o_z * z) = line[e.Run].second;
           }
-        }
+      });
+    }
+
+  // Record the state of the input for the next update. Changes reported up
+  // to now are reflected in the slice.
+  m_InputChanges.clear();
+  if (m_ChangeSource && inputPtr == this->GetInput()
+      && inputPtr->GetBuffer()->GetBufferPointer() == m_ChangeSource->GetBuffer()->GetBufferPointer())
+    {
+    m_ChangeSourceMTimeAtUpdate = m_ChangeSource->GetMTime();
+    }
+  else
+    {
+    // The reported image is no longer the one being sliced
+    m_ChangeSource = nullptr;
+    m_ChangeSourceMTimeAtUpdate = 0;
     }
+
+  m_UpdateOutputRegion = outputPtr->GetBufferedRegion();
+  m_UpdateTime.Modified();
+  m_SliceVersion++;
 }
 
 //template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
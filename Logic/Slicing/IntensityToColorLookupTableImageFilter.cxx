@@ -7,6 +7,9 @@
 #include "itkVectorImage.h"
 #include "VectorToScalarImageAccessor.h"
 #include "itkMultiThreaderBase.h"
+#include "SNAPProfiler.h"
+#include <algorithm>
+#include <cmath>
 
 /* ===============================================================
     AbstractLookupTableImageFilter implementation
@@ -83,6 +86,8 @@ void
 IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>
 ::GenerateData()
 {
+  SNAP_PROFILE_SCOPE("DisplayMapping.LookupTable");
+
   // Allocate the image output
   this->AllocateOutputs();
 
@@ -101,40 +106,115 @@ IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>
   // Range of the curve (a pair)
   auto [tmin, tmax] = curve->GetRange();
 
-  // Initialize the LUT
+  // Current control points of the curve
+  std::vector<std::pair<double, double> > cp(curve->GetControlPointCount());
+  for(unsigned int k = 0; k < cp.size(); k++)
+    curve->GetControlPoint(k, cp[k].first, cp[k].second);
+
+  // Check whether the LUT from the last update can be reused, i.e., only the
+  // curve's control points changed. For floating point images the LUT spans
+  // the curve range, so that must not change either.
+  bool reuse =
+      m_CacheValid && curve == m_CachedCurve && colormap == m_CachedColorMap
+      && (!colormap || colormap->GetMTime() == m_CachedColorMapMTime)
+      && m_IgnoreAlpha == m_CachedIgnoreAlpha
+      && imin == m_CachedMin && imax == m_CachedMax
+      && cp.size() == m_CachedControlPoints.size()
+      && (!std::is_floating_point<ComponentType>::value
+          || (tmin == m_CachedTMin && tmax == m_CachedTMax));
+
+  // The values that determine the contents of the LUT. Layers with the same
+  // display mapping share a single table, registered under these values
+  std::vector<double> key = this->ComputeTableKey(colormap, imin, imax, tmin, tmax, cp);
+  TableCacheType *cache = TableCacheType::GetInstance();
   LookupTableType *lut = this->GetLookupTable();
-  lut->Initialize(imin, imax, tmin, tmax);
 
-  // Get the region representing the LUT, for multithreading
-  unsigned int lut_size = lut->GetSize();
+  // Region of the LUT that must be computed
+  unsigned int lut_size, i_first = 0, i_end = 0;
+  if(m_CacheValid && lut->GetTable() && key == m_CachedKey)
+    {
+    // Inputs were modified, but the contents are the same
+    lut_size = lut->GetSize();
+    }
+  else if(auto shared = cache->Find(key))
+    {
+    // Another layer has already computed this table
+    lut->InitializeShared(imin, imax, tmin, tmax, shared);
+    lut_size = lut->GetSize();
+    }
+  else
+    {
+    // If no other layer uses the current table, it is modified in place and
+    // may no longer be found under the old key. Otherwise it is copied.
+    if(m_CacheValid && lut->GetTable() && lut->GetTable().use_count() == 1)
+      cache->Unregister(m_CachedKey, lut->GetTable().get());
+
+    // Initialize the LUT
+    if(reuse)
+      lut->MakeTableUnique();
+    else
+      lut->Initialize(imin, imax, tmin, tmax);
+
+    // Get the region representing the LUT, for multithreading
+    lut_size = lut->GetSize();
+    i_end = lut_size;
+    if(reuse && lut_size == m_CachedSize)
+      this->ComputeModifiedLUTRange(cp, i_first, i_end);
+    }
+
+  // Store the state for the next update
+  m_CacheValid = true;
+  m_CachedCurve = curve;
+  m_CachedColorMap = colormap;
+  m_CachedColorMapMTime = colormap ? colormap->GetMTime() : 0;
+  m_CachedIgnoreAlpha = m_IgnoreAlpha;
+  m_CachedMin = imin; m_CachedMax = imax;
+  m_CachedTMin = tmin; m_CachedTMax = tmax;
+  m_CachedSize = lut_size;
+  m_CachedControlPoints = cp;
+  m_CachedKey = key;
 
   // Multi-threaded computation
   itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
   itk::ImageRegion<1> lut_region;
-  lut_region.SetSize(0, lut_size);
-  mt->ParallelizeImageRegion<1>(lut_region,
+  lut_region.SetIndex(0, i_first);
+  lut_region.SetSize(0, i_end - i_first);
+  if(i_end > i_first)
+    mt->ParallelizeImageRegion<1>(lut_region,
         [this, curve, colormap, lut](const auto &thread_region)
     {
-    // Iterate over the range of LUT entries we are computing
+    // Iterate over the range of LUT entries we are computing, in blocks
+    const int block_size = 256;
+    double x[block_size];
+    DisplayPixelType rgb[block_size];
     int i0 = (int) thread_region.GetIndex()[0];
     int i1 = i0 + (int) thread_region.GetSize()[0];
-    for(int i = i0; i < i1; i++)
+    for(int ib = i0; ib < i1; ib += block_size)
       {
-      // This is the t coordinate of the intensity curve to loop up
-      double t = lut->GetIntensityCurveDomainValueForIndex(i);
+      int n = std::min(block_size, i1 - ib);
+      for(int k = 0; k < n; k++)
+        {
+        // This is the t coordinate of the intensity curve to loop up
+        double t = lut->GetIntensityCurveDomainValueForIndex(ib + k);
 
-      // Get the corresponding color map index
-      double x = curve->Evaluate(t);
+        // Get the corresponding color map index
+        x[k] = curve->Evaluate(t);
+        }
 
       // Finally, we use the color map to send this to RGBA or if there
-      // is no color map, just scale it to the 0-255 range.
-      DisplayPixelType rgb = TColorMapTraits::apply(colormap, x, m_IgnoreAlpha);
+      // is no color map, just scale it to the 0-255 range. The intensity
+      // curve is monotonic, so the color map indices are sorted
+      TColorMapTraits::apply_array(colormap, x, n, rgb, m_IgnoreAlpha);
 
       // Assign to colormap
-      lut->SetLUTValue(i, rgb);
+      for(int k = 0; k < n; k++)
+        lut->SetLUTValue(ib + k, rgb[k]);
       }
     }, nullptr);
 
+  // Make the table available to other layers
+  cache->Register(key, lut->GetTable());
+
   // Set outside/nan colors
   DisplayPixelType color_below, color_above, color_nan;
   TColorMapTraits::get_outside_and_nan_values(colormap, m_IgnoreAlpha, color_below, color_above, color_nan);
@@ -143,6 +223,91 @@ IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>
   lut->SetColorNaN(color_nan);
   }
 
+template <class TInputImage, class TColorMapTraits>
+std::vector<double>
+IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>
+::ComputeTableKey(const ColorMap *colormap, ComponentType imin, ComponentType imax,
+                  double tmin, double tmax,
+                  const std::vector<std::pair<double, double> > &cp) const
+{
+  // The component type determines the size and domain of the table
+  std::vector<double> key;
+  key.reserve(10 + 2 * cp.size() + (colormap ? 10 * colormap->GetNumberOfCMPoints() : 0));
+  key.push_back(std::is_floating_point<ComponentType>::value ? 1.0 : 0.0);
+  key.push_back((double) sizeof(ComponentType));
+  key.push_back((double) imin);
+  key.push_back((double) imax);
+  key.push_back(tmin);
+  key.push_back(tmax);
+  key.push_back(m_IgnoreAlpha ? 1.0 : 0.0);
+
+  // The intensity curve is determined by its control points
+  key.push_back((double) cp.size());
+  for(const auto &p : cp)
+    {
+    key.push_back(p.first);
+    key.push_back(p.second);
+    }
+
+  // The color map is determined by its points
+  key.push_back(colormap ? (double) colormap->GetNumberOfCMPoints() : -1.0);
+  if(colormap)
+    {
+    for(size_t k = 0; k < colormap->GetNumberOfCMPoints(); k++)
+      {
+      ColorMap::CMPoint p = colormap->GetCMPoint(k);
+      key.push_back(p.m_Index);
+      key.push_back((double) p.m_Type);
+      for(int side = 0; side < 2; side++)
+        for(int c = 0; c < 4; c++)
+          key.push_back((double) p.m_RGBA[side][c]);
+      }
+    }
+
+  return key;
+}
+
+template <class TInputImage, class TColorMapTraits>
+void
+IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>
+::ComputeModifiedLUTRange(const std::vector<std::pair<double, double> > &cp,
+                          unsigned int &i0, unsigned int &i1)
+{
+  // Find the first and last control points that moved
+  int n = (int) cp.size(), k0 = n, k1 = -1;
+  for(int k = 0; k < n; k++)
+    {
+    if(cp[k] != m_CachedControlPoints[k])
+      {
+      k0 = std::min(k0, k);
+      k1 = k;
+      }
+    }
+
+  // Nothing changed
+  if(k1 < 0)
+    {
+    i0 = i1 = 0;
+    return;
+    }
+
+  // Moving a control point of the spline changes the tangents at that point
+  // and its neighbors (including the end tangents, which depend on the
+  // second point), so the curve only changes between the second neighbors on
+  // either side, as they were before and after the move
+  int ka = std::max(k0 - 2, 0), kb = std::min(k1 + 2, n - 1);
+  double ta = std::min(cp[ka].first, m_CachedControlPoints[ka].first);
+  double tb = std::max(cp[kb].first, m_CachedControlPoints[kb].first);
+
+  // Map to the range of LUT entries
+  const LookupTableType *lut = this->GetLookupTable();
+  double fa = std::floor(lut->GetIndexForIntensityCurveDomainValue(ta));
+  double fb = std::ceil(lut->GetIndexForIntensityCurveDomainValue(tb)) + 1;
+  double size = lut->GetSize();
+  i0 = (unsigned int) std::min(std::max(fa, 0.0), size);
+  i1 = (unsigned int) std::min(std::max(fb, 0.0), size);
+}
+
 template<class TInputImage, class TColorMapTraits>
 typename IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>::DataObjectPointer
 IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>
@@ -182,7 +347,8 @@ IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>::GetLookupT
   template class IntensityToColorLookupTableImageFilter<typename VectorToScalarImageAccessorTypes<type>::ComponentImageAdaptor, DefaultColorMapTraits>; \
   template class IntensityToColorLookupTableImageFilter<typename VectorToScalarImageAccessorTypes<type>::MagnitudeImageAdaptor, DefaultColorMapTraits>; \
   template class IntensityToColorLookupTableImageFilter<typename VectorToScalarImageAccessorTypes<type>::MaxImageAdaptor, DefaultColorMapTraits>; \
-  template class IntensityToColorLookupTableImageFilter<typename VectorToScalarImageAccessorTypes<type>::MeanImageAdaptor, DefaultColorMapTraits>;
+  template class IntensityToColorLookupTableImageFilter<typename VectorToScalarImageAccessorTypes<type>::MeanImageAdaptor, DefaultColorMapTraits>; \
+  template class IntensityToColorLookupTableImageFilter<typename VectorToScalarImageAccessorTypes<type>::JacobianImageAdaptor, DefaultColorMapTraits>;
 
 LookupTableImageFilterInstantiateMacro(unsigned char)
 LookupTableImageFilterInstantiateMacro(char)
@@ -6,10 +6,11 @@
 #include <itkVectorImage.h>
 #include <itkSimpleDataObjectDecorator.h>
 #include "ColorMap.h"
+#include "ColorLookupTable.h"
+#include "SharedLookupTableCache.h"
 
 class ColorMap;
 class IntensityCurveInterface;
-template <class TInputPixel, class TDisplayPixel> class ColorLookupTable;
 
 
 /**
@@ -31,6 +32,15 @@ public:
     return p;
   }
 
+  static void apply_array(const ColorMapType *cm, const double *x, size_t n,
+                          DisplayPixelType *out, bool ignore_alpha)
+  {
+    cm->MapIndicesToRGBA(x, n, out);
+    if(ignore_alpha)
+      for(size_t i = 0; i < n; i++)
+        out[i][3] = 255;
+  }
+
   static void get_outside_and_nan_values(
       const ColorMapType *cm, bool ignore_alpha,
       DisplayPixelType &lower, DisplayPixelType &upper, DisplayPixelType &nan)
@@ -61,6 +71,13 @@ public:
     return (DisplayPixelType) 255.0 * x;
   }
 
+  static void apply_array(const ColorMapType *cm, const double *x, size_t n,
+                          DisplayPixelType *out, bool ignore_alpha)
+  {
+    for(size_t i = 0; i < n; i++)
+      out[i] = apply(cm, x[i], ignore_alpha);
+  }
+
   static void get_outside_and_nan_values(
       const ColorMapType *cm,  bool ignore_alpha,
       DisplayPixelType &lower, DisplayPixelType &upper, DisplayPixelType &nan)
@@ -113,6 +130,7 @@ public:
   // Output LUT
   using DisplayPixelType = typename TColorMapTraits::DisplayPixelType;
   using LookupTableType = ColorLookupTable<ComponentType, DisplayPixelType>;
+  using TableCacheType = SharedLookupTableCache<typename LookupTableType::TableType>;
 
   // The type of the min/max inputs. The are usually InputPixelType, but may
   // be different, i.e., for VectorImage it's InternalPixelType.
@@ -195,6 +213,32 @@ protected:
 
   // Whether transparency is used or ignored
   bool m_IgnoreAlpha = false;
+
+  // Inputs of the last LUT computation. When only the intensity curve control
+  // points have changed, only the affected range of the LUT is recomputed
+  bool m_CacheValid = false;
+  const IntensityCurveInterface *m_CachedCurve = nullptr;
+  const ColorMap *m_CachedColorMap = nullptr;
+  itk::ModifiedTimeType m_CachedColorMapMTime = 0;
+  bool m_CachedIgnoreAlpha = false;
+  ComponentType m_CachedMin, m_CachedMax;
+  double m_CachedTMin, m_CachedTMax;
+  unsigned int m_CachedSize = 0;
+  std::vector<std::pair<double, double> > m_CachedControlPoints;
+
+  // Key under which the current table is shared with other filters
+  std::vector<double> m_CachedKey;
+
+  // List the values that determine the contents of the LUT
+  std::vector<double> ComputeTableKey(
+      const ColorMap *colormap, ComponentType imin, ComponentType imax,
+      double tmin, double tmax,
+      const std::vector<std::pair<double, double> > &cp) const;
+
+  // Compute the range of LUT entries [i0, i1) that must be recomputed
+  void ComputeModifiedLUTRange(
+      const std::vector<std::pair<double, double> > &cp,
+      unsigned int &i0, unsigned int &i1);
 };
 
 #endif // INTENSITYTOCOLORLOOKUPTABLEIMAGEFILTER_H
@@ -1,7 +1,10 @@
 #include "LookupTableIntensityMappingFilter.h"
 #include "RLEImageRegionIterator.h"
 #include <itkRGBAPixel.h>
+#include <itkImageScanlineConstIterator.h>
 #include "ColorLookupTable.h"
+#include "SNAPProfiler.h"
+#include "SliceBufferPool.h"
 
 template<class TInputImage, class TOutputImage>
 LookupTableIntensityMappingFilter<TInputImage, TOutputImage>
@@ -10,6 +13,61 @@ LookupTableIntensityMappingFilter<TInputImage, TOutputImage>
   // The image and the LUT are inputs
   this->SetNumberOfIndexedInputs(1);
   this->AddRequiredInputName("LookupTable");
+
+  // Keep the output buffer between updates, so that redraws reuse it
+  this->ReleaseDataBeforeUpdateFlagOff();
+}
+
+template<class TInputImage, class TOutputImage>
+void
+LookupTableIntensityMappingFilter<TInputImage, TOutputImage>
+::GenerateData()
+{
+  SNAP_PROFILE_SCOPE("DisplayMapping");
+
+  // If only a part of the slice changed since the last update, and the
+  // output still holds the colors of the rest of it, only map that part
+  OutputImageType *output = this->GetOutput();
+  const OutputRegionType &region = output->GetRequestedRegion();
+  itk::ModifiedTimeType lut_mtime = this->GetLookupTable()->GetMTime();
+  typename SliceUpdateHistory::SliceRegionType changed;
+  if(m_SliceUpdateHistory && output->GetBufferedRegion() == region
+     && this->GetInput()->GetBufferedRegion() == region
+     && lut_mtime == m_LastLookupTableMTime
+     && m_SliceUpdateHistory->GetSliceRegionModifiedSince(m_LastSliceVersion, changed))
+    {
+    OutputRegionType part;
+    for(unsigned int d = 0; d < 2; d++)
+      {
+      part.SetIndex(d, changed.GetIndex(d));
+      part.SetSize(d, changed.GetSize(d));
+      }
+    if(part.Crop(region))
+      {
+      this->GetMultiThreader()->template ParallelizeImageRegion<OutputImageType::ImageDimension>(
+            part, [this](const OutputRegionType &r) { this->DynamicThreadedGenerateData(r); },
+            nullptr);
+      }
+    }
+  else
+    {
+    Superclass::GenerateData();
+    }
+
+  if(m_SliceUpdateHistory)
+    m_LastSliceVersion = m_SliceUpdateHistory->GetSliceVersion();
+  m_LastLookupTableMTime = lut_mtime;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+LookupTableIntensityMappingFilter<TInputImage, TOutputImage>
+::AllocateOutputs()
+{
+  // The output slice is allocated from the pool of slice buffers
+  OutputImageType *output = this->GetOutput();
+  output->SetBufferedRegion(output->GetRequestedRegion());
+  AllocatePooledImage(output);
 }
 
 template<class TInputImage, class TOutputImage>
@@ -24,38 +82,24 @@ LookupTableIntensityMappingFilter<TInputImage, TOutputImage>
   // Get the range of intensities mapped that the LUT handles
   const LookupTableType *lut = this->GetLookupTable();
 
-  // Define the iterators
-  itk::ImageRegionConstIterator<TInputImage> inputIt(input, region);
-  itk::ImageRegionIterator<TOutputImage> outputIt(output, region);
-
   // Does zero map out of the LUT's range? We may get inputs of zero from
   // the non-orthogonal slicer (data outside of image range) that would fall
   // outside of the colormap. This is really a poor way to handle this but
   // there is not a good alternative solution right now.
   // TODO: fix this.
-  bool zero_out_of_range = !lut->CheckRange(0);
+  OutputPixelType zero_out;
+  zero_out.Fill(0);
 
-  // Perform the intensity mapping using the LUT (no bounds checking!)
-  while( !inputIt.IsAtEnd() )
+  // Perform the intensity mapping using the LUT one scanline at a time
+  itk::ImageScanlineConstIterator<TInputImage> inputIt(input, region);
+  size_t line_length = region.GetSize(0);
+  for(; !inputIt.IsAtEnd(); inputIt.NextLine())
     {
-    // Get the input intensity
-    InputPixelType xin = inputIt.Get();
-    OutputPixelType xout;
-
-    if(zero_out_of_range && xin == 0)
-      {
-      // Special case: intensity is actually outside of the min/max range
-      xout.Fill(0);
-      }
-    else
-      {
-      xout = lut->MapIntensityToDisplay(xin);
-      }
-
-    outputIt.Set(xout);
-
-    ++inputIt;
-    ++outputIt;
+    const InputPixelType *p_in =
+        input->GetBufferPointer() + input->ComputeOffset(inputIt.GetIndex());
+    OutputPixelType *p_out =
+        output->GetBufferPointer() + output->ComputeOffset(inputIt.GetIndex());
+    lut->MapIntensitiesToDisplay(p_in, line_length, p_out, 1, &zero_out);
     }
 }
 
@@ -2,6 +2,7 @@
 #define LOOKUPTABLEINTENSITYMAPPINGFILTER_H
 
 #include "SNAPCommon.h"
+#include "SliceUpdateHistory.h"
 #include <itkImageToImageFilter.h>
 #include <itkSimpleDataObjectDecorator.h>
 #include <itkVectorImage.h>
@@ -50,6 +51,20 @@ public:
   /** Get the intensity remapping curve - for contrast adjustment */
   itkGetInputMacro(LookupTable, LookupTableType)
 
+  /**
+   * Set the filter producing the input slice, if it keeps track of the
+   * changed parts of the slice. Then, when the lookup table has not changed,
+   * only the changed part of the slice is mapped.
+   */
+  void SetSliceUpdateHistory(const SliceUpdateHistory *history)
+    { m_SliceUpdateHistory = history; }
+
+  /** Time the whole mapping, rather than each work unit */
+  void GenerateData() ITK_OVERRIDE;
+
+  /** Allocate the output from the pool of slice buffers */
+  void AllocateOutputs() ITK_OVERRIDE;
+
   /** The actual work */
   void DynamicThreadedGenerateData(const OutputRegionType &region) ITK_OVERRIDE;
 
@@ -60,6 +75,12 @@ protected:
 
   LookupTableIntensityMappingFilter();
   virtual ~LookupTableIntensityMappingFilter() {}
+
+  // The source of the input slice, and the state of the input and of the
+  // lookup table when the output was last generated
+  const SliceUpdateHistory *m_SliceUpdateHistory = nullptr;
+  unsigned long m_LastSliceVersion = 0;
+  itk::ModifiedTimeType m_LastLookupTableMTime = 0;
 };
 
 
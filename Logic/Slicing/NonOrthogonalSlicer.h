@@ -48,6 +48,9 @@
 #include "itkDataObjectDecorator.h"
 #include "itkVectorImage.h"
 #include "itkImageAdaptor.h"
+#include "SliceBufferPool.h"
+#include "ScratchArena.h"
+#include <vector>
 
 using itk::DataObjectDecorator;
 using itk::ProcessObject;
@@ -75,6 +78,8 @@ public:
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
 
+  inline void ProcessScanline(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr);
+
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -87,7 +92,11 @@ protected:
   int m_NumComponents;
 
   // Temporary buffer
-  double *m_Buffer;
+  ScratchBuffer<double> m_Buffer;
+
+  // Temporary buffers for scanline interpolation, from the thread's arena
+  ScratchBuffer<double> m_ScanlineBuffer;
+  ScratchBuffer<typename Interpolator::InOut> m_ScanlineStatus;
 };
 
 
@@ -108,6 +117,7 @@ public:
   ~DefaultNonOrthogonalSlicerWorkerTraits();
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+  inline void ProcessScanline(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr);
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -124,6 +134,10 @@ protected:
 
   // Temporary buffer
   double m_BufferValue;
+
+  // Temporary buffers for scanline interpolation, from the thread's arena
+  ScratchBuffer<double> m_ScanlineBuffer;
+  ScratchBuffer<typename Interpolator::InOut> m_ScanlineStatus;
 };
 
 
@@ -146,6 +160,7 @@ public:
   ~DefaultNonOrthogonalSlicerWorkerTraits();
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+  inline void ProcessScanline(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr);
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -158,7 +173,11 @@ protected:
   int m_NumComponents;
 
   // Temporary buffer for interpolation
-  double *m_Buffer;
+  ScratchBuffer<double> m_Buffer;
+
+  // Temporary buffers for scanline interpolation, from the thread's arena
+  ScratchBuffer<double> m_ScanlineBuffer;
+  ScratchBuffer<typename Interpolator::InOut> m_ScanlineStatus;
 
   // Temporary buffer for computing the derived quantity
   typename InternalImageType::PixelType m_VectorPixel;
@@ -188,6 +207,8 @@ public:
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
 
+  inline void ProcessScanline(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr);
+
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -255,6 +276,14 @@ public:
   itkSetMacro(UseNearestNeighbor, bool)
   itkGetMacro(UseNearestNeighbor, bool)
 
+  /**
+   * Subsampling factor for fast previews. When greater than one, only every
+   * n-th voxel of every n-th line of the slice is sampled and the samples
+   * are replicated into the skipped voxels.
+   */
+  itkSetMacro(SubsamplingFactor, unsigned int)
+  itkGetMacro(SubsamplingFactor, unsigned int)
+
 protected:
 
   NonOrthogonalSlicer();
@@ -270,7 +299,24 @@ protected:
 
   virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
 
+  /** Allocate the output slice from the pool of slice buffers */
+  virtual void AllocateOutputs() ITK_OVERRIDE;
+
   bool m_UseNearestNeighbor;
+
+  unsigned int m_SubsamplingFactor;
+
+  // Sample a line of the slice, starting at the continuous index cix with the
+  // given step, skipping the samples that fall outside of the image
+  void SampleLine(TWorkerTraits &worker, double *cix, const double *step, int n,
+                  bool use_nn, OutputComponentType **out_ptr);
+
+  // Check if all n samples of a line fall on voxel centers of the input, to
+  // within a small fraction of a voxel, as they do when the reference space
+  // differs from the input by whole voxel shifts, flips or permutations of
+  // the axes. If so, the start and the step are rounded to whole voxels, and
+  // the line can be sampled without interpolation.
+  static bool SnapLineToVoxelGrid(double *cix, double *step, int n);
 };
 
 
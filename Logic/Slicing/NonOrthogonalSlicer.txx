@@ -50,8 +50,10 @@
 template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
 NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
 ::NonOrthogonalSlicer()
-    : m_UseNearestNeighbor(true)
+    : m_UseNearestNeighbor(true), m_SubsamplingFactor(1)
 {
+  // Keep the output slice between updates, so that its buffer is reused
+  this->ReleaseDataBeforeUpdateFlagOff();
 }
 
 template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
@@ -105,6 +107,125 @@ NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
     inputPtr->SetRequestedRegionToLargestPossibleRegion();
 }
 
+template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
+void
+NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
+::AllocateOutputs()
+{
+  // Reuse the buffer of the previous slice if it is large enough, otherwise
+  // get one from the pool of slice buffers
+  OutputImageType *output = this->GetOutput();
+  output->SetBufferedRegion(output->GetRequestedRegion());
+  AllocatePooledImage(output);
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
+void
+NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
+::SampleLine(TWorkerTraits &worker, double *cix, const double *step, int n,
+             bool use_nn, OutputComponentType **out_ptr)
+{
+  // Get the extents of the image cube that can be sampled
+  const InputImageType *input = this->GetInput();
+  double cixCubeStart[InputImageDimension], cixCubeEnd[InputImageDimension];
+  for(int d = 0; d < InputImageDimension; d++)
+    {
+    cixCubeStart[d] = input->GetBufferedRegion().GetIndex()[d] - 0.5;
+    cixCubeEnd[d] =
+        input->GetBufferedRegion().GetIndex()[d] +
+        input->GetBufferedRegion().GetSize()[d] - 0.5;
+    }
+
+  // Determine the starting and ending indices for the line
+  int kStart = 0, kEnd = n - 1;
+  bool skipLine = false;
+  for(int d = 0; d < InputImageDimension; d++)
+    {
+    double x0 = cixCubeStart[d], x1 = cixCubeEnd[d], dx = step[d], x = cix[d];
+
+    // TODO: this may behave badly for small voxel sizes
+    if(fabs(dx) < 1.0e-5)
+      {
+      if((x < x0 && x < x1) || (x > x0 && x > x1))
+        {
+        skipLine = true;
+        break;
+        }
+      }
+    else
+      {
+      double z0 = (x0 - x) / dx, z1 = (x1 - x) / dx;
+      if(z1 > z0)
+        {
+        kStart = std::max(kStart, (int) floor(z0));
+        kEnd = std::min(kEnd, (int) ceil(z1));
+        }
+      else
+        {
+        kStart = std::max(kStart, (int) floor(z1));
+        kEnd = std::min(kEnd, (int) ceil(z0));
+        }
+      }
+    }
+
+  if(kStart >= n || kEnd <= 0)
+    skipLine = true;
+
+  // This should not happen but it does, must be a bug in the code
+  if(kEnd <= kStart)
+    skipLine = true;
+
+  // Deal with skipped lines
+  if(skipLine)
+    {
+    worker.SkipVoxels(n, out_ptr);
+    }
+  else
+    {
+    // Skip the starting voxels
+    if(kStart > 0)
+      {
+      // Skip the voxels
+      worker.SkipVoxels(kStart, out_ptr);
+
+      // Update the sample location
+      for(int d = 0; d < InputImageDimension; d++)
+        cix[d] += kStart * step[d];
+      }
+
+    // Process the voxels that cross the image cube as a single batch
+    worker.ProcessScanline(cix, const_cast<double *>(step), kEnd - kStart + 1,
+                           use_nn, out_ptr);
+
+    // Process the rest
+    if(kEnd < n - 1)
+      {
+      worker.SkipVoxels((n - 1) - kEnd, out_ptr);
+      }
+    }
+}
+
+template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
+bool
+NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
+::SnapLineToVoxelGrid(double *cix, double *step, int n)
+{
+  const double tol = 1.0e-3;
+  for(int d = 0; d < InputImageDimension; d++)
+    {
+    if(!(fabs(cix[d] - std::round(cix[d])) <= tol)
+       || !(fabs(step[d] - std::round(step[d])) * n <= tol))
+      return false;
+    }
+
+  for(int d = 0; d < InputImageDimension; d++)
+    {
+    cix[d] = std::round(cix[d]);
+    step[d] = std::round(step[d]);
+    }
+  return true;
+}
+
 template <typename TInputImage, typename TOutputImage, typename TWorkerTraits>
 void
 NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
@@ -126,25 +247,18 @@ NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
   typedef itk::ImageLinearIteratorWithIndex<OutputImageType> IterBase;
   typedef IteratorExtender<IterBase> IterType;
 
-  // Determine the appropriate float/double type for the interpolator.
-  typedef typename itk::NumericTraits<OutputComponentType>::MeasurementVectorType::ValueType FloatType;
-
-  // Get the extents of the image cube that can be sampled
-  itk::ContinuousIndex<double, InputImageDimension> cixCubeStart, cixCubeEnd;
-  for(int d = 0; d < InputImageDimension; d++)
-    {
-    cixCubeStart[d] = input->GetBufferedRegion().GetIndex()[d] - 0.5;
-    cixCubeEnd[d] =
-        input->GetBufferedRegion().GetIndex()[d] +
-        input->GetBufferedRegion().GetSize()[d] - 0.5;
-    }
-
   // Create a fast interpolator for the input image - via the traits, allowing for
   // partial specialization for imageadapters and other such things
   TWorkerTraits worker(input);
 
-  // Whether to use nn
-  bool use_nn = this->GetUseNearestNeighbor();
+  // When subsampling, every f-th voxel is sampled into a short buffer and
+  // replicated, and lines in between repeat the line before them
+  int f = std::max(1u, m_SubsamplingFactor);
+  int ncomp = std::is_same<OutputPixelType, OutputComponentType>::value
+      ? 1 : this->GetOutput()->GetNumberOfComponentsPerPixel();
+  int n_sub = (line_len + f - 1) / f;
+  ScratchBuffer<OutputComponentType> sub_buffer(f > 1 ? n_sub * ncomp : 0);
+  const OutputComponentType *prevLinePtr = nullptr;
 
   // Loop over the lines in the input image
   for(IterType it(this->GetOutput(), outputRegionForThread); !it.IsAtEnd(); it.NextLine())
@@ -155,15 +269,23 @@ NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
     // Get the index of the first pixel - this is in 2D
     typename OutputImageType::IndexType outIndex = it.GetIndex();
 
+    // Repeat the previous line for lines skipped by subsampling
+    if(f > 1 && prevLinePtr && (outIndex[1] % f) != 0)
+      {
+      std::copy(prevLinePtr, prevLinePtr + line_len * ncomp, outPixelPtr);
+      prevLinePtr = outPixelPtr;
+      continue;
+      }
+
     // Get the 3D index of the first pixel of the line
     typename ReferenceImageBaseType::IndexType idxStart;
     idxStart.Fill(0.0);
     for(int d = 0; d < SliceDimension; d++)
       idxStart[d] = outIndex[d];
 
-    // Get the 3D index of the second pixel of the line
+    // Get the 3D index of the next sampled pixel of the line
     typename ReferenceImageBaseType::IndexType idxNext = idxStart;
-    idxNext[0] += 1;
+    idxNext[0] += f;
 
     // Convert to a physical point relative to refernece image
     typename ReferenceImageBaseType::PointType pRefStart, pRefNext;
@@ -183,79 +305,34 @@ NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
     for(int d = 0; d < InputImageDimension; d++)
       cixStep[d] = cixNext[d] - cixSample[d];
 
-    // Determine the starting and ending indices for the line
-    int kStart = 0, kEnd = line_len - 1;
-    bool skipLine = false;
-    for(int d = 0; d < InputImageDimension; d++)
-      {
-      double x0 = cixCubeStart[d], x1 = cixCubeEnd[d], dx = cixStep[d], x = cixSample[d];
-
-      // TODO: this may behave badly for small voxel sizes
-      if(fabs(dx) < 1.0e-5)
-        {
-        if((x < x0 && x < x1) || (x > x0 && x > x1))
-          {
-          skipLine = true;
-          break;
-          }
-        }
-      else
-        {
-        double z0 = (x0 - x) / dx, z1 = (x1 - x) / dx;
-        if(z1 > z0)
-          {
-          kStart = std::max(kStart, (int) floor(z0));
-          kEnd = std::min(kEnd, (int) ceil(z1));
-          }
-        else
-          {
-          kStart = std::max(kStart, (int) floor(z1));
-          kEnd = std::min(kEnd, (int) ceil(z0));
-          }
-        }
-      }
-
-    if(kStart >= line_len || kEnd <= 0)
-      skipLine = true;
+    // Lines that run from voxel to voxel of the input are read without
+    // interpolation
+    bool use_nn = this->GetUseNearestNeighbor()
+        || SnapLineToVoxelGrid(cixSample.GetDataPointer(), cixStep.GetDataPointer(),
+                               f == 1 ? line_len : n_sub);
 
-    // This should not happen but it does, must be a bug in the code
-    if(kEnd <= kStart)
-      skipLine = true;
-
-    // Deal with skipped lines
-    if(skipLine)
+    if(f == 1)
       {
-      worker.SkipVoxels(line_len, &outPixelPtr);
+      this->SampleLine(worker, cixSample.GetDataPointer(), cixStep.GetDataPointer(),
+                       line_len, use_nn, &outPixelPtr);
       }
     else
       {
-      // Skip the starting voxels
-      if(kStart > 0)
-        {
-        // Skip the voxels
-        worker.SkipVoxels(kStart, &outPixelPtr);
+      // Sample the subsampled line and replicate each sample f times
+      OutputComponentType *subPtr = sub_buffer.data();
+      this->SampleLine(worker, cixSample.GetDataPointer(), cixStep.GetDataPointer(),
+                       n_sub, use_nn, &subPtr);
 
-        // Update the sample location
-        for(int d = 0; d < InputImageDimension; d++)
-          cixSample[d] += kStart * cixStep[d];
-        }
-
-      // Process the voxels that cross the image cube
-      for(int i = kStart; i <= kEnd; i++)
-        {
-        worker.ProcessVoxel(cixSample.GetDataPointer(), use_nn, &outPixelPtr);
-
-        // Update the sample location
-        for(int d = 0; d < InputImageDimension; d++)
-          cixSample[d] += cixStep[d];
-        }
-
-      // Process the rest
-      if(kEnd < line_len - 1)
+      OutputComponentType *dst = outPixelPtr;
+      for(int i = 0; i < line_len; i++)
         {
-        worker.SkipVoxels((line_len - 1) - kEnd, &outPixelPtr);
+        const OutputComponentType *src = sub_buffer.data() + (i / f) * ncomp;
+        for(int k = 0; k < ncomp; k++)
+          *dst++ = src[k];
         }
       }
+
+    prevLinePtr = it.GetPixelPointer(this->GetOutput());
     }
 }
 
@@ -271,14 +348,13 @@ DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
   : m_Interpolator(image)
 {
   m_NumComponents = m_Interpolator.GetPointerIncrement();
-  m_Buffer = new double[m_NumComponents];
+  m_Buffer.Resize(m_NumComponents);
 }
 
 template <class TInputImage, class TOutputImage>
 DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
 ::~DefaultNonOrthogonalSlicerWorkerTraits()
 {
-  delete m_Buffer;
 }
 
 template <class TInputImage, class TOutputImage>
@@ -289,8 +365,8 @@ DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
   // Perform the interpolation
   typename Interpolator::InOut status =
       use_nn
-      ? m_Interpolator.InterpolateNearestNeighbor(cix,  m_Buffer)
-      : m_Interpolator.Interpolate(cix, m_Buffer);
+      ? m_Interpolator.InterpolateNearestNeighbor(cix, m_Buffer.data())
+      : m_Interpolator.Interpolate(cix, m_Buffer.data());
 
   if(status == Interpolator::INSIDE || status == Interpolator::BORDER)
     {
@@ -303,6 +379,37 @@ DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
     }
 }
 
+template <class TInputImage, class TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
+::ProcessScanline(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  // Make sure the temporary buffers can hold the whole line
+  if(m_ScanlineStatus.size() < (size_t) n)
+    {
+    m_ScanlineStatus.Resize(n);
+    m_ScanlineBuffer.Resize(n * m_NumComponents);
+    }
+
+  // Perform the interpolation for all the samples
+  m_Interpolator.InterpolateScanline(cix, step, n, use_nn,
+                                     m_ScanlineBuffer.data(), m_ScanlineStatus.data());
+
+  const double *p = m_ScanlineBuffer.data();
+  for(int i = 0; i < n; i++, p += m_NumComponents)
+    {
+    if(m_ScanlineStatus[i] == Interpolator::INSIDE || m_ScanlineStatus[i] == Interpolator::BORDER)
+      {
+      for(int k = 0; k < m_NumComponents; k++)
+        *(*out_ptr)++ = static_cast<OutputComponentType>(p[k]);
+      }
+    else
+      {
+      SkipVoxels(1, out_ptr);
+      }
+    }
+}
+
 template <class TInputImage, class TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
@@ -363,6 +470,32 @@ DefaultNonOrthogonalSlicerWorkerTraits<
     *(*out_ptr)++ = 0;
 }
 
+template <typename TPixelType, unsigned int Dimension, typename TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<
+  itk::VectorImageToImageAdaptor<TPixelType, Dimension>,
+  TOutputImage>
+::ProcessScanline(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  // Only a single component is sampled
+  if(m_ScanlineStatus.size() < (size_t) n)
+    {
+    m_ScanlineStatus.Resize(n);
+    m_ScanlineBuffer.Resize(n);
+    }
+
+  m_Interpolator.InterpolateScanline(cix, step, n, use_nn,
+                                     m_ScanlineBuffer.data(), m_ScanlineStatus.data());
+
+  for(int i = 0; i < n; i++)
+    {
+    if(m_ScanlineStatus[i] == Interpolator::INSIDE)
+      *(*out_ptr)++ = static_cast<OutputComponentType>(m_ScanlineBuffer[i]);
+    else
+      *(*out_ptr)++ = 0;
+    }
+}
+
 template <typename TPixelType, unsigned int Dimension, typename TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<
@@ -388,7 +521,7 @@ DefaultNonOrthogonalSlicerWorkerTraits<
     m_Adaptor(adaptor)
 {
   m_NumComponents = m_Interpolator.GetPointerIncrement();
-  m_Buffer = new double[m_NumComponents];
+  m_Buffer.Resize(m_NumComponents);
 }
 
 template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
@@ -397,7 +530,6 @@ DefaultNonOrthogonalSlicerWorkerTraits<
   TOutputImage>
 ::~DefaultNonOrthogonalSlicerWorkerTraits()
 {
-  delete m_Buffer;
 }
 
 template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
@@ -410,8 +542,8 @@ DefaultNonOrthogonalSlicerWorkerTraits<
   // Perform the interpolation
   typename Interpolator::InOut status =
       use_nn
-      ? m_Interpolator.InterpolateNearestNeighbor(cix, m_Buffer)
-      : m_Interpolator.Interpolate(cix, m_Buffer);
+      ? m_Interpolator.InterpolateNearestNeighbor(cix, m_Buffer.data())
+      : m_Interpolator.Interpolate(cix, m_Buffer.data());
 
   const typename InternalImageType::PixelType &vpref = m_VectorPixel;
 
@@ -431,6 +563,42 @@ DefaultNonOrthogonalSlicerWorkerTraits<
     }
 }
 
+template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<
+  itk::ImageAdaptor<itk::VectorImage<TPixelType, Dimension>, TAccessor>,
+  TOutputImage>
+::ProcessScanline(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  // Interpolate all the components for the whole line
+  if(m_ScanlineStatus.size() < (size_t) n)
+    {
+    m_ScanlineStatus.Resize(n);
+    m_ScanlineBuffer.Resize(n * m_NumComponents);
+    }
+
+  m_Interpolator.InterpolateScanline(cix, step, n, use_nn,
+                                     m_ScanlineBuffer.data(), m_ScanlineStatus.data());
+
+  // Apply the accessor to each interpolated vector
+  const double *p = m_ScanlineBuffer.data();
+  for(int i = 0; i < n; i++, p += m_NumComponents)
+    {
+    if(m_ScanlineStatus[i] == Interpolator::INSIDE)
+      {
+      for(int k = 0; k < m_NumComponents; k++)
+        m_VectorPixel[k] = static_cast<OutputComponentType>(p[k]);
+
+      *(*out_ptr)++ =
+          m_Adaptor->GetPixelAccessor().Get(m_VectorPixel.GetDataPointer());
+      }
+    else
+      {
+      *(*out_ptr)++ = 0;
+      }
+    }
+}
+
 template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<
@@ -480,6 +648,21 @@ DefaultNonOrthogonalSlicerWorkerTraits<RLEImage<TPixel, Dimension, TCounter>, TO
     }
 }
 
+template <typename TPixel, unsigned int Dimension, typename TCounter, typename TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<RLEImage<TPixel, Dimension, TCounter>, TOutputImage>
+::ProcessScanline(double *cix, double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  // There is no batched access to RLE images, so sample one voxel at a time
+  double p[Dimension];
+  for(int i = 0; i < n; i++)
+    {
+    for(unsigned int k = 0; k < Dimension; k++)
+      p[k] = cix[k] + i * step[k];
+    this->ProcessVoxel(p, use_nn, out_ptr);
+    }
+}
+
 template <typename TPixel, unsigned int Dimension, typename TCounter, typename TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<RLEImage<TPixel, Dimension, TCounter>, TOutputImage>
@@ -1,14 +1,40 @@
 #include "RGBALookupTableIntensityMappingFilter.h"
 #include "RLEImageRegionIterator.h"
 #include "ColorLookupTable.h"
+#include "SNAPProfiler.h"
+#include "SliceBufferPool.h"
+#include <itkImageScanlineConstIterator.h>
 
 template<class TInputImage>
 RGBALookupTableIntensityMappingFilter<TInputImage>
 ::RGBALookupTableIntensityMappingFilter()
 {
-  // Multiple images are indexed inputs
-  this->SetNumberOfRequiredInputs(3);
+  // The vector slice is the only indexed input
+  this->SetNumberOfRequiredInputs(1);
   this->AddRequiredInputName("LookupTable");
+
+  // Keep the output buffer between updates, so that redraws reuse it
+  this->ReleaseDataBeforeUpdateFlagOff();
+}
+
+template<class TInputImage>
+void
+RGBALookupTableIntensityMappingFilter<TInputImage>
+::GenerateData()
+{
+  SNAP_PROFILE_SCOPE("DisplayMapping");
+  Superclass::GenerateData();
+}
+
+template<class TInputImage>
+void
+RGBALookupTableIntensityMappingFilter<TInputImage>
+::AllocateOutputs()
+{
+  // The output slice is allocated from the pool of slice buffers
+  OutputImageType *output = this->GetOutput();
+  output->SetBufferedRegion(output->GetRequestedRegion());
+  AllocatePooledImage(output);
 }
 
 template<class TInputImage>
@@ -16,10 +42,10 @@ void
 RGBALookupTableIntensityMappingFilter<TInputImage>
 ::DynamicThreadedGenerateData(const OutputImageRegionType &region)
 {
-  // Get all the inputs
-  std::vector<const InputImageType *> inputs(3);
-  for(int d = 0; d < 3; d++)
-    inputs[d] = this->GetInput(d);
+  // Get the input, whose components are interleaved
+  const InputImageType *input = this->GetInput();
+  const size_t nc = input->GetNumberOfComponentsPerPixel();
+  itkAssertOrThrowMacro(nc == 3, "RGB display mapping requires a three-component slice")
 
   // Get the output
   OutputImageType *output = this->GetOutput(0);
@@ -34,41 +60,38 @@ RGBALookupTableIntensityMappingFilter<TInputImage>
   // TODO: fix this.
   bool zero_out_of_range = !lut->CheckRange(0);
 
-  // Define the iterators
-  typedef itk::ImageRegionConstIterator<InputImageType> InputIteratorType;
-  InputIteratorType it0(inputs[0], region);
-  InputIteratorType it1(inputs[1], region);
-  InputIteratorType it2(inputs[2], region);
-
-  itk::ImageRegionIterator<OutputImageType> outputIt(output, region);
-
-  // Perform the intensity mapping using the LUT (no bounds checking!)
-  while( !outputIt.IsAtEnd() )
+  // Zero intensities are mapped to zero when they fall outside of the LUT
+  // range, which also keeps the integer lookups within bounds
+  const OutputComponentType zero_out = 0;
+  const OutputComponentType *p_zero =
+      std::is_floating_point<InputPixelType>::value ? nullptr : &zero_out;
+
+  // Perform the intensity mapping using the LUT one scanline at a time,
+  // writing each channel of the interleaved input into its component of the
+  // RGBA output
+  itk::ImageScanlineConstIterator<InputImageType> it(input, region);
+  size_t line_length = region.GetSize(0);
+  for(; !it.IsAtEnd(); it.NextLine())
     {
-    OutputPixelType xout;
+    const InputPixelType *p_in =
+        input->GetBufferPointer() + nc * input->ComputeOffset(it.GetIndex());
 
-    InputPixelType xin0 = it0.Get();
-    InputPixelType xin1 = it1.Get();
-    InputPixelType xin2 = it2.Get();
+    OutputPixelType *p_out = output->GetBufferPointer() + output->ComputeOffset(it.GetIndex());
+    OutputComponentType *p_comp = p_out->GetDataPointer();
+    for(size_t d = 0; d < nc; d++)
+      lut->MapInterleavedIntensitiesToDisplay(p_in + d, line_length, nc, p_comp + d, 4, p_zero);
 
+    // Set alpha = 1, except that pixels where all channels are zero are
+    // transparent black if zero is out of range
     // TODO: we need to handle out of bounds voxels in non-orthogonal slicing
     // better than this, i.e., via a special value reserved for such voxels.
-    // Right now, defaulting to zero is a DISASTER!
-    if(zero_out_of_range && xin0 == 0 && xin1 == 0 && xin2 == 0)
-      {
-      xout.Fill(0);
-      }
-    else
+    for(size_t j = 0; j < line_length; j++, p_in += nc)
       {
-      xout[0] = lut->MapIntensityToDisplay(xin0);
-      xout[1] = lut->MapIntensityToDisplay(xin1);
-      xout[2] = lut->MapIntensityToDisplay(xin2);
-      xout[3] = 255; // alpha = 1
+      if(zero_out_of_range && p_in[0] == 0 && p_in[1] == 0 && p_in[2] == 0)
+        p_out[j].Fill(0);
+      else
+        p_out[j][3] = 255;
       }
-
-    outputIt.Set(xout);
-    ++it0; ++it1; ++it2;
-    ++outputIt;
     }
 }
 
@@ -105,7 +128,7 @@ RGBALookupTableIntensityMappingFilter<TInputImage>
 
 // Template instantiation
 #define RGBALookupTableIntensityMappingFilterInstantiateMacro(type) \
-  template class RGBALookupTableIntensityMappingFilter<itk::Image<type, 2> >;
+  template class RGBALookupTableIntensityMappingFilter<itk::VectorImage<type, 2> >;
 
 RGBALookupTableIntensityMappingFilterInstantiateMacro(unsigned char)
 RGBALookupTableIntensityMappingFilterInstantiateMacro(char)
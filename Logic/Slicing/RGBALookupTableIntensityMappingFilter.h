@@ -4,13 +4,16 @@
 #include "SNAPCommon.h"
 #include "itkRGBAPixel.h"
 #include <itkImageToImageFilter.h>
+#include <itkVectorImage.h>
 
 template <class TInputPixel, class TDisplayPixel> class ColorLookupTable;
 
 
 /**
- * This filter takes multiple input channels and a common lookup table, and
- * generates an image of pixels of a certain vector type, e.g., RGBAPixel.
+ * This filter takes a three-component vector image slice and a common lookup
+ * table, and generates an image of pixels of a certain vector type, e.g.,
+ * RGBAPixel. The interleaved components are read in a single pass over the
+ * slice, so the channels do not have to be sliced separately.
  */
 template<class TInputImage>
 class RGBALookupTableIntensityMappingFilter :
@@ -28,7 +31,7 @@ public:
   typedef itk::SmartPointer<const Self>                          ConstPointer;
 
   typedef TInputImage                                          InputImageType;
-  typedef typename InputImageType::PixelType                   InputPixelType;
+  typedef typename InputImageType::InternalPixelType           InputPixelType;
 
   typedef typename OutputPixelType::ComponentType         OutputComponentType;
 
@@ -47,6 +50,12 @@ public:
   /** Get the intensity remapping curve - for contrast adjustment */
   itkGetInputMacro(LookupTable, LookupTableType)
 
+  /** Time the whole mapping, rather than each work unit */
+  void GenerateData() ITK_OVERRIDE;
+
+  /** Allocate the output from the pool of slice buffers */
+  void AllocateOutputs() ITK_OVERRIDE;
+
   /** The actual work */
   void DynamicThreadedGenerateData(const OutputImageRegionType &region) ITK_OVERRIDE;
 
@@ -0,0 +1,118 @@
+#ifndef SHAREDLOOKUPTABLECACHE_H
+#define SHAREDLOOKUPTABLECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A process-wide cache of lookup tables, shared between the display mapping
+ * pipelines of different layers. Each table is keyed by the complete list of
+ * values that determine its contents (intensity range, curve control points,
+ * color map points, etc.), and the cache is indexed by a hash of that list.
+ *
+ * The cache only holds weak references. A table lives as long as some lookup
+ * table object uses it, so the memory used by the tables scales with the
+ * number of distinct display mappings rather than the number of layers.
+ */
+template <class TTable>
+class SharedLookupTableCache
+{
+public:
+  typedef std::vector<double> KeyType;
+  typedef std::shared_ptr<TTable> TablePointer;
+
+  static SharedLookupTableCache *GetInstance()
+  {
+    // Never destroyed, like the SliceBufferPool
+    static SharedLookupTableCache *instance = new SharedLookupTableCache();
+    return instance;
+  }
+
+  /** Find a live table with the given key, or return null */
+  TablePointer Find(const KeyType &key)
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    auto range = m_Entries.equal_range(Hash(key));
+    for(auto it = range.first; it != range.second; )
+      {
+      TablePointer table = it->second.table.lock();
+      if(!table)
+        it = m_Entries.erase(it);
+      else if(it->second.key == key)
+        return table;
+      else
+        ++it;
+      }
+    return TablePointer();
+  }
+
+  /** Make a table available to other users under the given key */
+  void Register(const KeyType &key, const TablePointer &table)
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    size_t hash = Hash(key);
+    auto range = m_Entries.equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it)
+      {
+      if(it->second.key == key)
+        {
+        it->second.table = table;
+        return;
+        }
+      }
+    m_Entries.insert(std::make_pair(hash, Entry{ key, table }));
+  }
+
+  /**
+   * Withdraw a table registered under the given key, i.e., before its
+   * contents are modified. Entries that refer to other tables are kept.
+   */
+  void Unregister(const KeyType &key, const TTable *table)
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    auto range = m_Entries.equal_range(Hash(key));
+    for(auto it = range.first; it != range.second; )
+      {
+      TablePointer entry = it->second.table.lock();
+      if(!entry || (it->second.key == key && entry.get() == table))
+        it = m_Entries.erase(it);
+      else
+        ++it;
+      }
+  }
+
+  /** FNV-1a hash of the key values */
+  static size_t Hash(const KeyType &key)
+  {
+    uint64_t h = 14695981039346656037ull;
+    for(double v : key)
+      {
+      // Avoid distinct hashes of equal keys that differ in the sign of zero
+      uint64_t bits;
+      v = (v == 0.0) ? 0.0 : v;
+      std::memcpy(&bits, &v, sizeof(bits));
+      for(int b = 0; b < 8; b++, bits >>= 8)
+        h = (h ^ (bits & 0xff)) * 1099511628211ull;
+      }
+    return (size_t) h;
+  }
+
+protected:
+  SharedLookupTableCache() {}
+
+  struct Entry
+  {
+    KeyType key;
+    std::weak_ptr<TTable> table;
+  };
+
+  std::unordered_multimap<size_t, Entry> m_Entries;
+  std::mutex m_Mutex;
+};
+
+#endif // SHAREDLOOKUPTABLECACHE_H
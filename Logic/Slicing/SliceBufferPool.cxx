@@ -0,0 +1,89 @@
+#include "SliceBufferPool.h"
+#include <new>
+
+SliceBufferPool *SliceBufferPool::GetInstance()
+{
+  // The pool is never destroyed, because images held in static objects may
+  // release their buffers after static destructors have run
+  static SliceBufferPool *instance = new SliceBufferPool();
+  return instance;
+}
+
+SliceBufferPool::SliceBufferPool()
+{
+  m_MemoryRegistration.Set(
+        [this](MemoryAccounting::Usage &usage)
+          { usage.Bytes[MemoryAccounting::BUFFER_POOL] += this->GetSpareBytes(); },
+        [this](MemoryAccounting::ReclaimLevel level)
+          { if(level == MemoryAccounting::RECLAIM_CACHES) this->Purge(); });
+}
+
+size_t SliceBufferPool::GetSizeClass(size_t bytes)
+{
+  // Small buffers share the smallest class
+  const size_t min_class = 256;
+  if(bytes <= min_class)
+    return min_class;
+
+  // Find the power of two below the size, and round up to a quarter of it
+  size_t base = min_class;
+  while(base * 2 < bytes)
+    base *= 2;
+
+  size_t step = base / 4;
+  return ((bytes + step - 1) / step) * step;
+}
+
+void *SliceBufferPool::Acquire(size_t bytes)
+{
+  size_t sz = GetSizeClass(bytes);
+    {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    auto it = m_Spare.find(sz);
+    if(it != m_Spare.end() && it->second.size())
+      {
+      void *buffer = it->second.back();
+      it->second.pop_back();
+      m_SpareBytes -= sz;
+      return buffer;
+      }
+    }
+
+  return ::operator new(sz);
+}
+
+void SliceBufferPool::Release(void *buffer, size_t bytes)
+{
+  if(!buffer)
+    return;
+
+  size_t sz = GetSizeClass(bytes);
+    {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    std::vector<void *> &spare = m_Spare[sz];
+    if(spare.size() < MAX_SPARE_PER_CLASS && m_SpareBytes + sz <= MAX_SPARE_BYTES)
+      {
+      spare.push_back(buffer);
+      m_SpareBytes += sz;
+      return;
+      }
+    }
+
+  ::operator delete(buffer);
+}
+
+void SliceBufferPool::Purge()
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  for(auto &it : m_Spare)
+    for(void *buffer : it.second)
+      ::operator delete(buffer);
+  m_Spare.clear();
+  m_SpareBytes = 0;
+}
+
+size_t SliceBufferPool::GetSpareBytes() const
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  return m_SpareBytes;
+}
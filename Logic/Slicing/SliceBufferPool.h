@@ -0,0 +1,123 @@
+#ifndef SLICEBUFFERPOOL_H
+#define SLICEBUFFERPOOL_H
+
+#include <itkImportImageContainer.h>
+#include <itkObjectFactory.h>
+#include "MemoryAccounting.h"
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+ * A process-wide pool of pixel buffers for the temporary images produced by
+ * the slicing and display pipelines. Buffers are grouped into size classes
+ * (four classes per power of two), and a buffer that is released is kept for
+ * the next request of the same class instead of being returned to the heap.
+ * Since the slices of each view have their own size, the classes act as
+ * arenas for the views, and views of the same size share their buffers.
+ *
+ * The number of bytes kept in spare buffers is bounded, so the pool does not
+ * hold on to the memory of slices that are no longer displayed.
+ */
+class SliceBufferPool
+{
+public:
+  static SliceBufferPool *GetInstance();
+
+  /** Get a buffer of at least the given number of bytes */
+  void *Acquire(size_t bytes);
+
+  /** Return a buffer obtained from Acquire with the same number of bytes */
+  void Release(void *buffer, size_t bytes);
+
+  /** Free all the spare buffers */
+  void Purge();
+
+  /** Number of bytes held in spare buffers */
+  size_t GetSpareBytes() const;
+
+  /** The number of bytes actually allocated for a request */
+  static size_t GetSizeClass(size_t bytes);
+
+protected:
+  SliceBufferPool();
+  ~SliceBufferPool() { this->Purge(); }
+
+  // Spare buffers of each size class
+  std::map<size_t, std::vector<void *> > m_Spare;
+  size_t m_SpareBytes = 0;
+  mutable std::mutex m_Mutex;
+
+  // Bounds on the spare buffers kept per size class and overall
+  static constexpr size_t MAX_SPARE_PER_CLASS = 8;
+  static constexpr size_t MAX_SPARE_BYTES = 256 * 1024 * 1024;
+
+  // The spare buffers are reported to the memory accounting, and are the
+  // first to go when the memory budget is exceeded
+  MemoryAccounting::Registration m_MemoryRegistration;
+};
+
+/**
+ * A pixel container that allocates its buffer from the SliceBufferPool. It is
+ * meant for images of plain pixel types (scalars, RGBA, vector components)
+ * whose elements do not need to be destroyed.
+ */
+template <typename TElement>
+class PooledImageContainer
+    : public itk::ImportImageContainer<itk::SizeValueType, TElement>
+{
+public:
+  typedef PooledImageContainer                                       Self;
+  typedef itk::ImportImageContainer<itk::SizeValueType, TElement>   Superclass;
+  typedef itk::SmartPointer<Self>                                 Pointer;
+  typedef itk::SmartPointer<const Self>                      ConstPointer;
+  typedef typename Superclass::ElementIdentifier         ElementIdentifier;
+
+  itkNewMacro(Self)
+  itkTypeMacro(PooledImageContainer, ImportImageContainer)
+
+protected:
+  PooledImageContainer() {}
+
+  // The destructor of the parent calls its own deallocation, so the buffer
+  // must be handed back to the pool here
+  ~PooledImageContainer() override { this->DeallocateManagedMemory(); }
+
+  TElement *AllocateElements(ElementIdentifier size, bool UseValueInitialization = false) const override
+  {
+    TElement *data = static_cast<TElement *>(
+          SliceBufferPool::GetInstance()->Acquire(size * sizeof(TElement)));
+    if(UseValueInitialization)
+      std::fill_n(data, size, TElement());
+    return data;
+  }
+
+  void DeallocateManagedMemory() override
+  {
+    if(this->GetImportPointer() && this->GetContainerManageMemory())
+      SliceBufferPool::GetInstance()->Release(
+            this->GetImportPointer(), this->Capacity() * sizeof(TElement));
+
+    this->Superclass::SetImportPointer(nullptr);
+    this->SetCapacity(0);
+    this->SetSize(0);
+  }
+};
+
+/**
+ * Allocate the buffered region of an image using a pooled pixel container.
+ * If the image already has a pooled container, the container is reused, and
+ * its buffer is only replaced if it is too small for the region.
+ */
+template <class TImage>
+void AllocatePooledImage(TImage *image, bool initialize = false)
+{
+  typedef PooledImageContainer<typename TImage::PixelContainer::Element> ContainerType;
+  if(!dynamic_cast<ContainerType *>(image->GetPixelContainer()))
+    image->SetPixelContainer(ContainerType::New());
+  image->Allocate(initialize);
+}
+
+#endif // SLICEBUFFERPOOL_H
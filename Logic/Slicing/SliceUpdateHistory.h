@@ -0,0 +1,51 @@
+/*=========================================================================
+
+  Program:   ITK-SNAP
+  Language:  C++
+
+  Copyright (c) 2024 Paul A. Yushkevich
+
+  This file is part of ITK-SNAP
+
+  ITK-SNAP is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+=========================================================================*/
+#ifndef SLICEUPDATEHISTORY_H
+#define SLICEUPDATEHISTORY_H
+
+#include <itkImageRegion.h>
+
+/**
+ * Interface of a filter that keeps track of which part of its output slice
+ * changed between updates, used by downstream filters to only process the
+ * changed part of the slice.
+ */
+class SliceUpdateHistory
+{
+public:
+  typedef itk::ImageRegion<2> SliceRegionType;
+
+  virtual ~SliceUpdateHistory() {}
+
+  /** Number of times the output slice has been generated */
+  virtual unsigned long GetSliceVersion() const = 0;
+
+  /**
+   * Get the region of the output slice that changed since an earlier
+   * version of the slice. Returns false if this is not known.
+   */
+  virtual bool GetSliceRegionModifiedSince(unsigned long version, SliceRegionType &region) const = 0;
+};
+
+#endif // SLICEUPDATEHISTORY_H
@@ -0,0 +1,190 @@
+#include "ImageHeaderIndex.h"
+#include "Registry.h"
+#include "IRISException.h"
+#include "itkImageIOBase.h"
+#include "itksys/SystemTools.hxx"
+#include <sstream>
+
+#ifdef WIN32
+  #include <process.h>
+#else
+  #include <unistd.h>
+#endif
+
+using namespace std;
+using itksys::SystemTools;
+
+ImageHeaderIndex *ImageHeaderIndex::GetInstance()
+{
+  // Never destroyed, so worker threads may still use it during exit
+  static ImageHeaderIndex *instance = new ImageHeaderIndex();
+  return instance;
+}
+
+bool ImageHeaderIndex::GetFileStamp(const string &path, long &mtime, unsigned long &length)
+{
+  // Directories (e.g., DICOM series) have no meaningful stamp
+  if(!SystemTools::FileExists(path, true))
+    return false;
+
+  mtime = SystemTools::ModifiedTime(path);
+  length = SystemTools::FileLength(path);
+  return true;
+}
+
+void ImageHeaderIndex::ReadRecords(const string &filename, map<string, Record> &records)
+{
+  if(!SystemTools::FileExists(filename, true))
+    return;
+
+  Registry reg;
+  reg.ReadFromXMLFile(filename.c_str());
+
+  int n = reg["Images.ArraySize"][0];
+  for(int i = 0; i < n; i++)
+    {
+    Registry &f = reg.Folder(Registry::Key("Images.Image[%06d]", i));
+    string path = f["Path"][""];
+    if(!path.length())
+      continue;
+
+    Record &rec = records[path];
+    rec.ModifiedTime = (long) f["ModifiedTime"][0.0];
+    rec.Length = (unsigned long) f["Length"][0.0];
+    rec.Header.Dimensions = f.Folder("Dimensions").GetArray(0u);
+    rec.Header.Spacing = f.Folder("Spacing").GetArray(0.0);
+    rec.Header.Origin = f.Folder("Origin").GetArray(0.0);
+    rec.Header.Direction = f.Folder("Direction").GetArray(0.0);
+    rec.Header.Checksum = f["Checksum"][""];
+    }
+}
+
+void ImageHeaderIndex::SetFileName(const string &filename)
+{
+  string fn = SystemTools::CollapseFullPath(filename);
+  map<string, Record> records;
+  ReadRecords(fn, records);
+
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  m_FileName = fn;
+  m_Records.swap(records);
+  m_Modified.clear();
+}
+
+bool ImageHeaderIndex::IsEnabled() const
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  return m_FileName.length() > 0;
+}
+
+bool ImageHeaderIndex::Find(const string &path, Entry &entry) const
+{
+  long mtime; unsigned long length;
+  string fn = SystemTools::CollapseFullPath(path);
+  if(!GetFileStamp(fn, mtime, length))
+    return false;
+
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  auto it = m_Records.find(fn);
+  if(it == m_Records.end() || it->second.ModifiedTime != mtime || it->second.Length != length)
+    return false;
+
+  entry = it->second.Header;
+  return true;
+}
+
+void ImageHeaderIndex::StoreRecord(const string &path, itk::ImageIOBase *io, const string *checksum)
+{
+  long mtime; unsigned long length;
+  string fn = SystemTools::CollapseFullPath(path);
+  if(!GetFileStamp(fn, mtime, length))
+    return;
+
+  Record rec;
+  rec.ModifiedTime = mtime;
+  rec.Length = length;
+
+  unsigned int nd = io->GetNumberOfDimensions();
+  for(unsigned int k = 0; k < nd; k++)
+    {
+    rec.Header.Dimensions.push_back((unsigned int) io->GetDimensions(k));
+    rec.Header.Spacing.push_back(io->GetSpacing(k));
+    rec.Header.Origin.push_back(io->GetOrigin(k));
+    vector<double> dir = io->GetDirection(k);
+    rec.Header.Direction.insert(rec.Header.Direction.end(), dir.begin(), dir.end());
+    }
+
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  if(!m_FileName.length())
+    return;
+
+  // Keep the checksum of an unchanged file when only the header is stored
+  Record &stored = m_Records[fn];
+  if(checksum)
+    rec.Header.Checksum = *checksum;
+  else if(stored.ModifiedTime == mtime && stored.Length == length)
+    rec.Header.Checksum = stored.Header.Checksum;
+
+  stored = rec;
+  m_Modified.insert(fn);
+}
+
+void ImageHeaderIndex::Store(const string &path, itk::ImageIOBase *io)
+{
+  this->StoreRecord(path, io, NULL);
+}
+
+void ImageHeaderIndex::StoreChecksum(const string &path, itk::ImageIOBase *io, const string &checksum)
+{
+  this->StoreRecord(path, io, &checksum);
+}
+
+void ImageHeaderIndex::Save()
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  if(!m_FileName.length() || m_Modified.empty())
+    return;
+
+  // Other processes may have saved entries since the file was read. Merge
+  // them with ours, giving precedence to the entries added by this process
+  map<string, Record> records;
+  ReadRecords(m_FileName, records);
+  for(const string &path : m_Modified)
+    records[path] = m_Records[path];
+
+  Registry reg;
+  int i = 0;
+  for(auto &it : records)
+    {
+    Registry &f = reg.Folder(Registry::Key("Images.Image[%06d]", i++));
+    f["Path"] << it.first;
+    f["ModifiedTime"] << it.second.ModifiedTime;
+    f["Length"] << it.second.Length;
+    f.Folder("Dimensions").PutArray(it.second.Header.Dimensions);
+    f.Folder("Spacing").PutArray(it.second.Header.Spacing);
+    f.Folder("Origin").PutArray(it.second.Header.Origin);
+    f.Folder("Direction").PutArray(it.second.Header.Direction);
+    if(it.second.Header.Checksum.length())
+      f["Checksum"] << it.second.Header.Checksum;
+    }
+  reg["Images.ArraySize"] << i;
+
+  // Write to a file of our own and move it in place, so that concurrent
+  // readers never see a partially written index
+  ostringstream oss;
+#ifdef WIN32
+  oss << m_FileName << "." << _getpid() << ".tmp";
+#else
+  oss << m_FileName << "." << getpid() << ".tmp";
+#endif
+  string fn_temp = oss.str();
+  reg.WriteToXMLFile(fn_temp.c_str(), "ITK-SNAP image header index");
+  if(!SystemTools::RenameFile(fn_temp, m_FileName))
+    {
+    SystemTools::RemoveFile(fn_temp);
+    throw IRISException("Unable to write image header index %s", m_FileName.c_str());
+    }
+
+  m_Records.swap(records);
+  m_Modified.clear();
+}
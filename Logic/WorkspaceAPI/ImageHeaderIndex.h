@@ -0,0 +1,85 @@
+#ifndef IMAGEHEADERINDEX_H
+#define IMAGEHEADERINDEX_H
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace itk { class ImageIOBase; }
+
+/**
+ * An index of the header information of image files, kept in a file so that
+ * it persists across invocations of the workspace tool. For each image it
+ * stores the dimensions, spacing, origin and direction read from the header,
+ * and the MD5 hash of the image data once it has been computed, so commands
+ * on large cohorts of workspaces do not need to open the images again.
+ *
+ * Entries are keyed by the absolute path of the image, and are only used
+ * while the size and modification time of the file are unchanged. The index
+ * is thread-safe, and when it is saved, it is merged with the entries that
+ * other processes have saved to the same file in the meantime.
+ */
+class ImageHeaderIndex
+{
+public:
+  /** Header information of an image file */
+  struct Entry
+  {
+    std::vector<unsigned int> Dimensions;
+    std::vector<double> Spacing, Origin, Direction;
+
+    // MD5 hash of the image data, empty if not known
+    std::string Checksum;
+  };
+
+  static ImageHeaderIndex *GetInstance();
+
+  /** Use the given index file, reading the entries it contains if it exists */
+  void SetFileName(const std::string &filename);
+
+  /** Whether an index file has been specified */
+  bool IsEnabled() const;
+
+  /** Find a valid entry for the image file, return false if there is none */
+  bool Find(const std::string &path, Entry &entry) const;
+
+  /** Store the header of an image read by the image IO */
+  void Store(const std::string &path, itk::ImageIOBase *io);
+
+  /** Store the checksum of the image data, along with the header */
+  void StoreChecksum(const std::string &path, itk::ImageIOBase *io, const std::string &checksum);
+
+  /** Write new entries to the index file, if there are any */
+  void Save();
+
+protected:
+  ImageHeaderIndex() {}
+
+  struct Record
+  {
+    long ModifiedTime = 0;
+    unsigned long Length = 0;
+    Entry Header;
+  };
+
+  // Get the size and modification time of a file, false if not a plain file
+  static bool GetFileStamp(const std::string &path, long &mtime, unsigned long &length);
+
+  // Read the index file into the given map
+  static void ReadRecords(const std::string &filename, std::map<std::string, Record> &records);
+
+  // Add a record for the header read by the IO, keeping a known checksum
+  void StoreRecord(const std::string &path, itk::ImageIOBase *io, const std::string *checksum);
+
+  std::string m_FileName;
+  std::map<std::string, Record> m_Records;
+
+  // Paths whose records have been added or changed since the file was read
+  std::set<std::string> m_Modified;
+
+  mutable std::mutex m_Mutex;
+};
+
+#endif // IMAGEHEADERINDEX_H
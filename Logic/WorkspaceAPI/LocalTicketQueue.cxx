@@ -0,0 +1,296 @@
+#include "LocalTicketQueue.h"
+#include "WorkspaceAPI.h"
+#include "IRISException.h"
+#include "json/json.h"
+#include "itksys/Directory.hxx"
+#include "itksys/SystemTools.hxx"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifdef WIN32
+  #include <process.h>
+#else
+  #include <unistd.h>
+#endif
+
+using namespace std;
+using itksys::SystemTools;
+
+static const char *LOCAL_QUEUE_SCHEME = "file://";
+
+bool LocalTicketQueue::IsQueueURL(const string &url)
+{
+  return url.compare(0, strlen(LOCAL_QUEUE_SCHEME), LOCAL_QUEUE_SCHEME) == 0;
+}
+
+LocalTicketQueue::LocalTicketQueue(const string &url)
+{
+  string path = IsQueueURL(url) ? url.substr(strlen(LOCAL_QUEUE_SCHEME)) : url;
+
+  // Strip the slash before a drive letter, as in file:///C:/queue
+  if(path.size() > 2 && path[0] == '/' && path[2] == ':')
+    path = path.substr(1);
+
+  m_Root = SystemTools::CollapseFullPath(path);
+}
+
+bool LocalTicketQueue::IsValid() const
+{
+  return SystemTools::FileIsDirectory(m_Root + "/services");
+}
+
+string LocalTicketQueue::GetTicketsDirectory() const
+{
+  return m_Root + "/tickets";
+}
+
+string LocalTicketQueue::GetTicketDirectory(int ticket_id) const
+{
+  char buffer[32];
+  snprintf(buffer, 32, "/%08d", ticket_id);
+  return this->GetTicketsDirectory() + buffer;
+}
+
+bool LocalTicketQueue::ReadJSON(const string &file, Json::Value &value)
+{
+  ifstream ifs(file.c_str());
+  if(!ifs.good())
+    return false;
+
+  Json::Reader json_reader;
+  return json_reader.parse(ifs, value, false);
+}
+
+void LocalTicketQueue::WriteJSON(const string &file, const Json::Value &value)
+{
+  // Write to a file of our own and move it in place, so that the runner
+  // never sees a partially written file
+  ostringstream oss;
+#ifdef WIN32
+  oss << file << "." << _getpid() << ".tmp";
+#else
+  oss << file << "." << getpid() << ".tmp";
+#endif
+  string fn_temp = oss.str();
+
+  {
+    ofstream ofs(fn_temp.c_str());
+    Json::StyledStreamWriter writer;
+    writer.write(ofs, value);
+    if(!ofs.good())
+      {
+      ofs.close();
+      SystemTools::RemoveFile(fn_temp);
+      throw IRISException("Unable to write %s", file.c_str());
+      }
+  }
+
+  if(!SystemTools::RenameFile(fn_temp, file))
+    {
+    SystemTools::RemoveFile(fn_temp);
+    throw IRISException("Unable to write %s", file.c_str());
+    }
+}
+
+vector<int> LocalTicketQueue::GetTicketIds() const
+{
+  vector<int> ids;
+  itksys::Directory d;
+  if(!d.Load(this->GetTicketsDirectory()))
+    return ids;
+
+  for(unsigned long i = 0; i < d.GetNumberOfFiles(); i++)
+    {
+    string name = d.GetFile(i);
+    if(name.empty() || name.find_first_not_of("0123456789") != string::npos)
+      continue;
+    int id = atoi(name.c_str());
+    if(SystemTools::FileExists(this->GetTicketDirectory(id) + "/ticket.json", true))
+      ids.push_back(id);
+    }
+
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+bool LocalTicketQueue::GetServiceListing(Json::Value &root) const
+{
+  itksys::Directory d;
+  if(!d.Load(m_Root + "/services"))
+    return false;
+
+  Json::Value &result = root["result"];
+  result = Json::Value(Json::arrayValue);
+  for(unsigned long i = 0; i < d.GetNumberOfFiles(); i++)
+    {
+    string name = d.GetFile(i);
+    Json::Value service;
+    if(SystemTools::GetFilenameLastExtension(name) == ".json"
+       && ReadJSON(m_Root + "/services/" + name, service))
+      {
+      // The githash defaults to the name of the file
+      if(!service.isMember("githash"))
+        service["githash"] = SystemTools::GetFilenameWithoutLastExtension(name);
+      result.append(service);
+      }
+    }
+
+  return true;
+}
+
+bool LocalTicketQueue::GetServiceDetail(const string &githash, Json::Value &root) const
+{
+  return ReadJSON(m_Root + "/services/" + githash + ".json", root);
+}
+
+bool LocalTicketQueue::GetTicketListing(Json::Value &root) const
+{
+  if(!SystemTools::FileIsDirectory(this->GetTicketsDirectory()))
+    return false;
+
+  Json::Value &result = root["result"];
+  result = Json::Value(Json::arrayValue);
+  for(int id : this->GetTicketIds())
+    {
+    Json::Value ticket;
+    if(ReadJSON(this->GetTicketDirectory(id) + "/ticket.json", ticket))
+      {
+      ticket["id"] = id;
+      result.append(ticket);
+      }
+    }
+
+  return true;
+}
+
+bool LocalTicketQueue::GetTicketDetail(int ticket_id, long last_log, Json::Value &root) const
+{
+  string dir = this->GetTicketDirectory(ticket_id);
+  Json::Value ticket;
+  if(!ReadJSON(dir + "/ticket.json", ticket))
+    return false;
+
+  Json::Value &result = root["result"];
+  result["progress"] = ticket.get("progress", 0.0).asDouble();
+
+  // The position of a ready ticket is the number of ready tickets before it
+  int queue_position = 0;
+  if(ticket.get("status", "").asString() == "ready")
+    {
+    for(int id : this->GetTicketIds())
+      {
+      Json::Value other;
+      if(id < ticket_id && ReadJSON(this->GetTicketDirectory(id) + "/ticket.json", other)
+         && other.get("status", "").asString() == "ready")
+        queue_position++;
+      }
+    }
+  result["queue_position"] = queue_position;
+
+  // Log entries newer than last_log. Attachments given as paths relative to
+  // the ticket directory are turned into file URLs
+  Json::Value log;
+  Json::Value &new_log = result["log"];
+  new_log = Json::Value(Json::arrayValue);
+  if(ReadJSON(dir + "/log.json", log))
+    {
+    for(Json::Value entry : log)
+      {
+      if(entry.get("id", 0).asLargestInt() <= last_log)
+        continue;
+
+      for(Json::Value &att : entry["attachments"])
+        {
+        string url = att.get("url", "").asString();
+        if(url.size() && url.find("://") == string::npos)
+          {
+          string path = SystemTools::CollapseFullPath(url, dir);
+          att["url"] = string(LOCAL_QUEUE_SCHEME) + (path[0] == '/' ? "" : "/") + path;
+          }
+        }
+
+      new_log.append(entry);
+      }
+    }
+
+  return true;
+}
+
+int LocalTicketQueue::CreateTicket(WorkspaceAPI &ws, const string &githash) const
+{
+  Json::Value service;
+  if(!this->GetServiceDetail(githash, service))
+    throw IRISException("Service %s is not available in %s", githash.c_str(), m_Root.c_str());
+
+  // Take the next free ticket number
+  vector<int> ids = this->GetTicketIds();
+  int ticket_id = ids.size() ? ids.back() + 1 : 1;
+  string dir;
+  for(;; ticket_id++)
+    {
+    dir = this->GetTicketDirectory(ticket_id);
+    if(!SystemTools::FileExists(dir))
+      break;
+    }
+
+  if(!SystemTools::MakeDirectory(dir + "/input"))
+    throw IRISException("Unable to create ticket directory %s", dir.c_str());
+
+  Json::Value ticket;
+  ticket["id"] = ticket_id;
+  ticket["service"] = service.get("name", githash).asString();
+  ticket["githash"] = githash;
+  ticket["status"] = "init";
+  ticket["progress"] = 0.0;
+  WriteJSON(dir + "/ticket.json", ticket);
+
+  // Save the workspace with the absolute paths of the layers, which are
+  // used by the runner because the workspace has not moved
+  char ws_file[4096];
+  snprintf(ws_file, 4096, "%s/input/ticket_%08d.itksnap", dir.c_str(), ticket_id);
+  ws.SetAllLayerPathsToActualPaths();
+  ws.SaveAsXMLFile(ws_file);
+
+  // Now the runner may take the ticket
+  ticket["status"] = "ready";
+  WriteJSON(dir + "/ticket.json", ticket);
+
+  return ticket_id;
+}
+
+string LocalTicketQueue::GetResultWorkspace(int ticket_id) const
+{
+  itksys::Directory d;
+  string dir = this->GetTicketDirectory(ticket_id) + "/results";
+  if(d.Load(dir))
+    {
+    for(unsigned long i = 0; i < d.GetNumberOfFiles(); i++)
+      {
+      string name = d.GetFile(i);
+      if(SystemTools::GetFilenameLastExtension(name) == ".itksnap")
+        return dir + "/" + name;
+      }
+    }
+
+  return string();
+}
+
+void LocalTicketQueue::DeleteTicket(int ticket_id) const
+{
+  string dir = this->GetTicketDirectory(ticket_id);
+  if(SystemTools::FileIsDirectory(dir) && !SystemTools::RemoveADirectory(dir))
+    throw IRISException("Unable to remove ticket directory %s", dir.c_str());
+}
+
+vector<string> LocalTicketQueue::GetWatchPaths(int ticket_id) const
+{
+  vector<string> paths;
+  paths.push_back(this->GetTicketsDirectory());
+  if(ticket_id >= 0)
+    paths.push_back(this->GetTicketDirectory(ticket_id));
+  return paths;
+}
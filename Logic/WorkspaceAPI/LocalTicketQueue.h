@@ -0,0 +1,100 @@
+#ifndef LOCALTICKETQUEUE_H
+#define LOCALTICKETQUEUE_H
+
+#include <string>
+#include <vector>
+
+namespace Json { class Value; }
+class WorkspaceAPI;
+
+/**
+ * A distributed segmentation service queue that lives in a directory, e.g.,
+ * on a file system shared with a compute cluster, instead of on a web server.
+ * It is selected with a server URL of the form file:///path/to/queue.
+ *
+ * Submitting a workspace does not upload the images. The ticket workspace
+ * refers to the layer files where they are, so the machines that run the
+ * services must see them at the same absolute paths. Results are opened from
+ * the queue directory where the service wrote them, and the queue can be
+ * watched for changes rather than polled. The layout of the directory is
+ *
+ *   services/<githash>.json          service description, as returned by
+ *                                    api/services/<githash>/detail, plus the
+ *                                    name, githash, version and shortdesc
+ *   tickets/<id>/ticket.json         { "id", "service", "status", "progress" }
+ *   tickets/<id>/log.json            array of log entries { "id", "category",
+ *                                    "atime", "message", "attachments" }
+ *   tickets/<id>/input/*.itksnap     the workspace submitted by the user
+ *   tickets/<id>/results/*.itksnap   the workspace produced by the service
+ *
+ * where <id> is the ticket number with eight digits. A runner claims tickets
+ * whose status is "ready", and keeps ticket.json and log.json up to date,
+ * replacing them (write and rename) rather than rewriting them in place.
+ *
+ * The Get functions produce the same JSON documents as the web API, so that
+ * they can be read by the same code.
+ */
+class LocalTicketQueue
+{
+public:
+  /** Whether a server URL refers to a local queue */
+  static bool IsQueueURL(const std::string &url);
+
+  /** Create the queue for a file:// URL */
+  LocalTicketQueue(const std::string &url);
+
+  /** Whether the queue directory exists and has a list of services */
+  bool IsValid() const;
+
+  /** The directories of the queue */
+  const std::string &GetRootDirectory() const { return m_Root; }
+  std::string GetTicketsDirectory() const;
+  std::string GetTicketDirectory(int ticket_id) const;
+
+  /** Same as api/services?format=json */
+  bool GetServiceListing(Json::Value &root) const;
+
+  /** Same as api/services/<githash>/detail */
+  bool GetServiceDetail(const std::string &githash, Json::Value &root) const;
+
+  /** Same as api/tickets?format=json */
+  bool GetTicketListing(Json::Value &root) const;
+
+  /** Same as api/tickets/<id>/detail?since=<last_log> */
+  bool GetTicketDetail(int ticket_id, long last_log, Json::Value &root) const;
+
+  /**
+   * Create a ticket for the service with the given githash. The workspace is
+   * saved into the ticket with absolute layer paths, and the ticket is marked
+   * as ready. Returns the ticket id.
+   */
+  int CreateTicket(WorkspaceAPI &ws, const std::string &githash) const;
+
+  /** The result workspace of a ticket, or an empty string if there is none */
+  std::string GetResultWorkspace(int ticket_id) const;
+
+  /** Remove a ticket and all of its files */
+  void DeleteTicket(int ticket_id) const;
+
+  /**
+   * The directories to watch for changes to the ticket listing and, if
+   * ticket_id is not negative, to the status and log of that ticket. Since
+   * the files are replaced, their directory changes when they do.
+   */
+  std::vector<std::string> GetWatchPaths(int ticket_id) const;
+
+protected:
+
+  // Read a JSON file, returns false if it is missing or invalid
+  static bool ReadJSON(const std::string &file, Json::Value &value);
+
+  // Write a JSON file so that readers never see it half written
+  static void WriteJSON(const std::string &file, const Json::Value &value);
+
+  // The ids of all the tickets, in ascending order
+  std::vector<int> GetTicketIds() const;
+
+  std::string m_Root;
+};
+
+#endif // LOCALTICKETQUEUE_H
@@ -13,6 +13,14 @@ using itksys::SystemTools;
 #define CURL_STATICLIB
 #endif
 #include <curl/curl.h>
+#include <atomic>
+#include <mutex>
+
+#ifdef WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace RESTClient_internal
 {
@@ -34,6 +42,128 @@ int progress_callback(void *clientp,
   return 0;
 }
 
+/**
+ * The data shared by all RESTClient objects: TLS sessions, DNS lookups and,
+ * in recent versions of CURL, open connections. The models make many short
+ * requests from worker threads, each with its own RESTClient, and sharing
+ * lets them reuse a connection instead of doing a new TLS handshake.
+ */
+class SharedCurlData
+{
+public:
+  static CURLSH *GetShare()
+  {
+    static SharedCurlData instance;
+    return instance.m_Share;
+  }
+
+private:
+  SharedCurlData()
+  {
+    m_Share = curl_share_init();
+    curl_share_setopt(m_Share, CURLSHOPT_LOCKFUNC, &SharedCurlData::Lock);
+    curl_share_setopt(m_Share, CURLSHOPT_UNLOCKFUNC, &SharedCurlData::Unlock);
+    curl_share_setopt(m_Share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(m_Share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(m_Share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    curl_share_setopt(m_Share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+  }
+
+  ~SharedCurlData()
+  {
+    curl_share_cleanup(m_Share);
+  }
+
+  static void Lock(CURL *, curl_lock_data data, curl_lock_access, void *userp)
+  {
+    static_cast<SharedCurlData *>(userp)->m_Mutex[data % N_LOCKS].lock();
+  }
+
+  static void Unlock(CURL *, curl_lock_data data, void *userp)
+  {
+    static_cast<SharedCurlData *>(userp)->m_Mutex[data % N_LOCKS].unlock();
+  }
+
+  enum { N_LOCKS = 8 };
+  CURLSH *m_Share;
+  std::mutex m_Mutex[N_LOCKS];
+};
+
+/** Errors after which a transfer is worth retrying */
+bool is_transient_error(CURLcode res)
+{
+  switch(res)
+    {
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+      return true;
+    default:
+      return false;
+    }
+}
+
+/** State of a download to a file, which may be resumed after an error */
+struct FileDownload
+{
+  CURL *Curl;
+  FILE *File;
+  long Start;
+  curl_off_t Resume;
+  bool Checked;
+};
+
+/** State of a range request */
+struct RangeDownload
+{
+  CURL *Curl;
+  std::string *Data;
+  long long Total;
+  bool Checked, Rejected;
+};
+
+/** Write callback for range requests, which refuses any reply but 206 */
+size_t range_write_callback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+  RangeDownload *rd = static_cast<RangeDownload *>(userp);
+  if(!rd->Checked)
+    {
+    long code = 0;
+    curl_easy_getinfo(rd->Curl, CURLINFO_RESPONSE_CODE, &code);
+    rd->Rejected = (code != 206L);
+    rd->Checked = true;
+    }
+
+  // Stop a server that ignores the range from sending the whole file
+  if(rd->Rejected)
+    return 0;
+
+  rd->Data->append((char *) contents, size * nmemb);
+  return size * nmemb;
+}
+
+/** Header callback for range requests, which finds the size of the file */
+size_t range_header_callback(char *buffer, size_t size, size_t nitems, void *userp)
+{
+  RangeDownload *rd = static_cast<RangeDownload *>(userp);
+  std::string line(buffer, size * nitems);
+  const char *key = "content-range:";
+  if(line.length() > strlen(key)
+     && itksys::SystemTools::LowerCase(line.substr(0, strlen(key))) == key)
+    {
+    // Content-Range: bytes first-last/total
+    size_t slash = line.find('/');
+    if(slash != std::string::npos && line[slash + 1] != '*')
+      rd->Total = atoll(line.c_str() + slash + 1);
+    }
+  return size * nitems;
+}
+
 } // namespace
 
 using namespace std;
@@ -43,11 +173,16 @@ RESTClient::RESTClient()
   // Initialize CURL
   m_Curl = curl_easy_init();
 
-  // Sharing business
-  m_Share = curl_share_init();
-  curl_share_setopt((CURLSH *)m_Share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  // Share sessions and connections with other clients
+  m_Share = RESTClient_internal::SharedCurlData::GetShare();
   curl_easy_setopt(m_Curl, CURLOPT_SHARE, m_Share);
 
+  // Use HTTP/2 where the server supports it, and keep idle connections alive
+#ifdef CURL_HTTP_VERSION_2TLS
+  curl_easy_setopt(m_Curl, CURLOPT_HTTP_VERSION, (long) CURL_HTTP_VERSION_2TLS);
+#endif
+  curl_easy_setopt(m_Curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
   // Error buffer
   m_ErrorBuffer = new char[CURL_ERROR_SIZE];
   m_ErrorBuffer[0] = 0;
@@ -57,6 +192,13 @@ RESTClient::RESTClient()
   m_MessageBuffer[0] = 0;
   m_OutputFile = NULL;
   m_ReceiveCookieMode = false;
+  m_MaximumRetries = 3;
+  m_ContentLength = -1;
+
+  // Give up on stalled connections (e.g., a dropped VPN) so that the transfer
+  // can be retried, rather than waiting forever
+  curl_easy_setopt(m_Curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(m_Curl, CURLOPT_LOW_SPEED_TIME, 60L);
 
   m_CallbackInfo.first = NULL;
   m_CallbackInfo.second = NULL;
@@ -65,7 +207,6 @@ RESTClient::RESTClient()
 RESTClient::~RESTClient()
 {
   curl_easy_cleanup(m_Curl);
-  curl_share_cleanup((CURLSH *)m_Share);
   delete m_ErrorBuffer;
 }
 
@@ -85,10 +226,9 @@ bool RESTClient::Authenticate(const char *baseurl, const char *token)
   ostringstream o_url; o_url << baseurl << "/api/login";
   curl_easy_setopt(m_Curl, CURLOPT_URL, o_url.str().c_str());
 
-  // Store the URL for the future
-  ofstream f_url(this->GetServerURLFile().c_str());
-  f_url << baseurl;
-  f_url.close();
+  // Store the URL for the future, and use it for the requests of this client
+  RESTClient::StoreServerURL(baseurl);
+  m_ServerURL = baseurl;
 
   // Data to post
   char post_buffer[1024];
@@ -96,7 +236,7 @@ bool RESTClient::Authenticate(const char *baseurl, const char *token)
   curl_easy_setopt(m_Curl, CURLOPT_POSTFIELDS, post_buffer);
 
   // Cookie file
-  string cookie_jar = this->GetCookieFile();
+  string cookie_jar = this->GetCookieFile(m_ServerURL);
   curl_easy_setopt(m_Curl, CURLOPT_COOKIEJAR, cookie_jar.c_str());
 
   // Capture output
@@ -118,9 +258,39 @@ bool RESTClient::Authenticate(const char *baseurl, const char *token)
 void RESTClient::SetServerURL(const char *baseurl)
 {
   // Store the URL for the future
-  ofstream f_url(RESTClient::GetServerURLFile().c_str());
+  RESTClient::StoreServerURL(baseurl);
+}
+
+void RESTClient::StoreServerURL(const char *baseurl)
+{
+  // Write to a file of our own and move it in place, so that clients in other
+  // threads never read a partially written URL
+  static std::atomic<unsigned long> counter(0);
+  string sfile = RESTClient::GetServerURLFile();
+  ostringstream oss;
+#ifdef WIN32
+  oss << sfile << "." << _getpid() << "_" << ++counter << ".tmp";
+#else
+  oss << sfile << "." << getpid() << "_" << ++counter << ".tmp";
+#endif
+  string fn_temp = oss.str();
+
+  ofstream f_url(fn_temp.c_str());
   f_url << baseurl;
   f_url.close();
+
+  if(f_url.fail() || !SystemTools::RenameFile(fn_temp, sfile))
+    {
+    SystemTools::RemoveFile(fn_temp);
+    throw IRISException("Unable to store the server URL in %s", sfile.c_str());
+    }
+}
+
+const std::string &RESTClient::GetClientServerURL()
+{
+  if(m_ServerURL.empty())
+    m_ServerURL = RESTClient::GetServerURL();
+  return m_ServerURL;
 }
 
 void RESTClient::SetReceiveCookieMode(bool mode)
@@ -202,11 +372,11 @@ bool RESTClient::PostVA(const char *rel_url, const char *post_string, std::va_li
     url_filled = std::string(url_buffer);
 
   // The URL to post to
-  string url = this->GetServerURL() + "/" + url_filled;
+  string url = this->GetClientServerURL() + "/" + url_filled;
   curl_easy_setopt(m_Curl, CURLOPT_URL, url.c_str());
 
   // The cookie JAR
-  string cookie_jar = this->GetCookieFile();
+  string cookie_jar = this->GetCookieFile(m_ServerURL);
   if(m_ReceiveCookieMode)
     curl_easy_setopt(m_Curl, CURLOPT_COOKIEJAR, cookie_jar.c_str());
   else
@@ -227,8 +397,8 @@ bool RESTClient::PostVA(const char *rel_url, const char *post_string, std::va_li
     }
   else
     {
-    curl_easy_setopt(m_Curl, CURLOPT_WRITEFUNCTION, RESTClient::WriteToFileCallback);
-    curl_easy_setopt(m_Curl, CURLOPT_WRITEDATA, m_OutputFile);
+    // Let the server compress the file in transit if it can
+    curl_easy_setopt(m_Curl, CURLOPT_ACCEPT_ENCODING, "");
 
     // Set the callback functions
     if(m_CallbackInfo.first)
@@ -241,19 +411,115 @@ bool RESTClient::PostVA(const char *rel_url, const char *post_string, std::va_li
     }
 
   // Make request
-  CURLcode res = curl_easy_perform(m_Curl);
-
-  if(res != CURLE_OK)
-    throw IRISException("CURL library error: %s\n%s", curl_easy_strerror(res), m_ErrorBuffer);
+  this->PerformWithRetries();
 
   // Capture the response code
   m_HTTPCode = 0L;
   curl_easy_getinfo(m_Curl, CURLINFO_RESPONSE_CODE, &m_HTTPCode);
 
+  // A resumed download ends with a partial content code
+  if(m_HTTPCode == 206L)
+    m_HTTPCode = 200L;
+
   // Get the code
   return m_HTTPCode == 200L;
 }
 
+void RESTClient::PerformWithRetries()
+{
+  // For downloads to a file, keep track of what has been written so far
+  RESTClient_internal::FileDownload dl;
+  if(m_OutputFile)
+    {
+    dl.Curl = m_Curl;
+    dl.File = m_OutputFile;
+    dl.Start = ftell(m_OutputFile);
+    dl.Resume = 0;
+    dl.Checked = false;
+    curl_easy_setopt(m_Curl, CURLOPT_WRITEFUNCTION, RESTClient::WriteToFileCallback);
+    curl_easy_setopt(m_Curl, CURLOPT_WRITEDATA, &dl);
+    }
+
+  for(int attempt = 0; ; attempt++)
+    {
+    CURLcode res = curl_easy_perform(m_Curl);
+    if(res == CURLE_OK)
+      break;
+
+    if(attempt >= m_MaximumRetries || !RESTClient_internal::is_transient_error(res))
+      {
+      curl_easy_setopt(m_Curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t) 0);
+      throw IRISException("CURL library error: %s\n%s", curl_easy_strerror(res), m_ErrorBuffer);
+      }
+
+    // Ask for the rest of the file. If the server does not honor the range,
+    // the write callback starts the file over
+    if(m_OutputFile)
+      {
+      fflush(m_OutputFile);
+      dl.Resume = ftell(m_OutputFile) - dl.Start;
+      dl.Checked = false;
+      curl_easy_setopt(m_Curl, CURLOPT_RESUME_FROM_LARGE, dl.Resume);
+      }
+    }
+
+  curl_easy_setopt(m_Curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t) 0);
+}
+
+bool RESTClient::GetRange(const char *url, long long offset, long long length, std::string &data)
+{
+  // Absolute URLs are used as they are, without the session cookie
+  string full_url = url;
+  if(full_url.compare(0, 7, "http://") && full_url.compare(0, 8, "https://"))
+    {
+    full_url = this->GetClientServerURL() + "/" + url;
+    string cookie_jar = this->GetCookieFile(m_ServerURL);
+    curl_easy_setopt(m_Curl, CURLOPT_COOKIEFILE, cookie_jar.c_str());
+    }
+  curl_easy_setopt(m_Curl, CURLOPT_URL, full_url.c_str());
+  curl_easy_setopt(m_Curl, CURLOPT_HTTPGET, 1L);
+
+  // The range refers to the bytes of the file, so it must not be re-encoded
+  char range[64];
+  snprintf(range, 64, "%lld-%lld", offset, offset + length - 1);
+  curl_easy_setopt(m_Curl, CURLOPT_RANGE, range);
+  curl_easy_setopt(m_Curl, CURLOPT_ACCEPT_ENCODING, NULL);
+
+  RESTClient_internal::RangeDownload rd;
+  rd.Curl = m_Curl;
+  rd.Data = &data;
+  curl_easy_setopt(m_Curl, CURLOPT_WRITEFUNCTION, RESTClient_internal::range_write_callback);
+  curl_easy_setopt(m_Curl, CURLOPT_WRITEDATA, &rd);
+  curl_easy_setopt(m_Curl, CURLOPT_HEADERFUNCTION, RESTClient_internal::range_header_callback);
+  curl_easy_setopt(m_Curl, CURLOPT_HEADERDATA, &rd);
+
+  // Ranges are small, so they are requested again from the start on errors
+  CURLcode res;
+  for(int attempt = 0; ; attempt++)
+    {
+    data.clear();
+    rd.Total = -1;
+    rd.Checked = rd.Rejected = false;
+    res = curl_easy_perform(m_Curl);
+    if(res == CURLE_OK || attempt >= m_MaximumRetries
+       || !RESTClient_internal::is_transient_error(res))
+      break;
+    }
+
+  curl_easy_setopt(m_Curl, CURLOPT_RANGE, NULL);
+  curl_easy_setopt(m_Curl, CURLOPT_HEADERFUNCTION, NULL);
+  curl_easy_setopt(m_Curl, CURLOPT_HEADERDATA, NULL);
+
+  m_HTTPCode = 0L;
+  curl_easy_getinfo(m_Curl, CURLINFO_RESPONSE_CODE, &m_HTTPCode);
+  m_ContentLength = rd.Total;
+
+  if(res != CURLE_OK && !rd.Rejected)
+    throw IRISException("CURL library error: %s\n%s", curl_easy_strerror(res), m_ErrorBuffer);
+
+  return !rd.Rejected && m_HTTPCode == 206L;
+}
+
 void RESTClient::SetProgressCallback(void *cb_data, ProgressCallbackFunction fn)
 {
   m_CallbackInfo = make_pair(cb_data, fn);
@@ -270,11 +536,11 @@ bool RESTClient::UploadFile(
   vsnprintf(url_buffer, 4096, rel_url, args);
 
   // The URL to post to
-  string url = this->GetServerURL() + "/" + url_buffer;
+  string url = this->GetClientServerURL() + "/" + url_buffer;
   curl_easy_setopt(m_Curl, CURLOPT_URL, url.c_str());
 
   // The cookie JAR
-  string cookie_jar = this->GetCookieFile();
+  string cookie_jar = this->GetCookieFile(m_ServerURL);
   curl_easy_setopt(m_Curl, CURLOPT_COOKIEFILE, cookie_jar.c_str());
 
   // Get the full path and just the name from the filename
@@ -340,11 +606,8 @@ bool RESTClient::UploadFile(
     curl_easy_setopt(m_Curl, CURLOPT_NOPROGRESS, 0);
     }
 
-  // Make request
-  CURLcode res = curl_easy_perform(m_Curl);
-
-  if(res != CURLE_OK)
-	throw IRISException("CURL library error: %s\n%s", curl_easy_strerror(res), m_ErrorBuffer);
+  // Make request. The form is sent again from the start after an error
+  this->PerformWithRetries();
 
   // Get the upload statistics
   double upload_size, upload_time;
@@ -401,11 +664,9 @@ string RESTClient::GetDataDirectory()
   return ddir;
 }
 
-string RESTClient::GetCookieFile()
+string RESTClient::GetCookieFile(const string &server)
 {
   // MD5 encode the server
-  string server = RESTClient::GetServerURL();
-
   char hex_code[33];
   hex_code[32] = 0;
   itksysMD5 *md5 = itksysMD5_New();
@@ -458,8 +719,20 @@ size_t RESTClient::WriteCallback(void *contents, size_t size, size_t nmemb, void
 
 size_t RESTClient::WriteToFileCallback(void *contents, size_t size, size_t nmemb, void *userp)
 {
-  FILE *file = static_cast<FILE *>(userp);
-  return fwrite(contents, size, nmemb, file);
+  RESTClient_internal::FileDownload *dl = static_cast<RESTClient_internal::FileDownload *>(userp);
+
+  // When resuming, the server sends either the rest of the file (206) or the
+  // whole file again, in which case we write over what we already have
+  if(!dl->Checked)
+    {
+    long code = 0;
+    curl_easy_getinfo(dl->Curl, CURLINFO_RESPONSE_CODE, &code);
+    if(dl->Resume > 0 && code != 206L)
+      fseek(dl->File, dl->Start, SEEK_SET);
+    dl->Checked = true;
+    }
+
+  return fwrite(contents, size, nmemb, dl->File);
 }
 
 
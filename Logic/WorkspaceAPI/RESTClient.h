@@ -8,6 +8,11 @@
 /**
  * This class encapsulates the client side of the ALFABIS RESTful API.
  * It uses HTTP and CURL to communicate with the server
+ *
+ * Each thread should use its own client. A client takes the server URL when
+ * it makes its first request (or authenticates) and keeps it, so that all of
+ * its requests go to the same server, with the matching session cookie, even
+ * if another thread calls SetServerURL() in the meantime.
  */
 class RESTClient
 {
@@ -19,6 +24,13 @@ public:
 
   void SetVerbose(bool verbose);
 
+  /**
+   * Set how many times a transfer is retried after a network error (default 3).
+   * Downloads to a file resume from where they stopped if the server honors
+   * range requests; other requests are repeated from the start.
+   */
+  void SetMaximumRetries(int n) { m_MaximumRetries = n; }
+
   /**
    * Set a FILE * to which to write the output of the Get/Post. This overrides
    * the default behaviour to capture the output in a string that can be accessed
@@ -35,10 +47,14 @@ public:
 
   /**
    * This call will set the server URL for subsequent calls. Subsequent calls will fail
-   * unless there is a cookie (session) present for the selected URL
+   * unless there is a cookie (session) present for the selected URL. Clients that
+   * have already made requests keep using their server
    */
   static void SetServerURL(const char *baseurl);
 
+  /** The server URL set with SetServerURL() or with ITKSNAP_WT_DSS_SERVER */
+  static std::string GetServerURL();
+
   /**
    * Call this function prior to post if you want to open up the cookie jar to receive
    * cookies from the server. This is done automatically by the Authenticate function
@@ -73,6 +89,18 @@ public:
    */
   void SetProgressCallback(void *cb_data, ProgressCallbackFunction fn);
 
+  /**
+   * Get length bytes of a file, starting at byte offset, with an HTTP range
+   * request. The URL may be relative to the server or absolute. Returns false
+   * if the request fails or the server does not honor the range, in which
+   * case the transfer is stopped rather than downloading the whole file. The
+   * total size of the file is then available from GetContentLength().
+   */
+  bool GetRange(const char *url, long long offset, long long length, std::string &data);
+
+  /** Total size of the file reported with the last range request, or -1 */
+  long long GetContentLength() const { return m_ContentLength; }
+
   bool UploadFile(const char *rel_url, const char *filename,
     std::map<std::string,std::string> extra_fields, ...);
 
@@ -89,7 +117,7 @@ protected:
   /** The CURL handle */
   void *m_Curl;
 
-  /** The sharing handle */
+  /** The sharing handle, common to all clients */
   void *m_Share;
 
   /** Optional file for output */
@@ -101,6 +129,12 @@ protected:
   /** HTTP Code received */
   long m_HTTPCode;
 
+  /** Number of retries after a network error */
+  int m_MaximumRetries;
+
+  /** Size of the file reported by the last range request */
+  long long m_ContentLength;
+
   /** Message buffer */
   char m_MessageBuffer[1024];
 
@@ -115,18 +149,28 @@ protected:
   /** Callback stuff */
   std::pair<void *, ProgressCallbackFunction> m_CallbackInfo;
 
+  /** The server used by this client, empty until the first request */
+  std::string m_ServerURL;
+
+  /** The server of this client, taken from GetServerURL() on first use */
+  const std::string &GetClientServerURL();
+
   static std::string GetDataDirectory();
 
-  static std::string GetCookieFile();
+  static std::string GetCookieFile(const std::string &server);
 
-  static std::string GetServerURLFile();
+  /** Store the server URL so that other clients and programs find it */
+  static void StoreServerURL(const char *baseurl);
 
-  static std::string GetServerURL();
+  static std::string GetServerURLFile();
 
   static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp);
 
   static size_t WriteToFileCallback(void *contents, size_t size, size_t nmemb, void *userp);
 
+  /** Perform the request, retrying after network errors */
+  void PerformWithRetries();
+
 
 
 };
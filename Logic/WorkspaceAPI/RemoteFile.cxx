@@ -0,0 +1,124 @@
+#include "RemoteFile.h"
+#include "IRISException.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+RemoteFile::RemoteFile(const string &url, size_t block_size, size_t max_blocks)
+  : m_URL(url), m_BlockSize(block_size), m_MaxBlocks(max_blocks)
+{
+}
+
+void RemoteFile::FetchBlocks(long long first, long long last)
+{
+  string data;
+  long long offset = first * (long long) m_BlockSize;
+  long long length = (last - first + 1) * (long long) m_BlockSize;
+  if(m_Size >= 0)
+    length = std::min(length, m_Size - offset);
+
+  if(!m_Client.GetRange(m_URL.c_str(), offset, length, data))
+    throw IRISException("Server does not support partial downloads of %s", m_URL.c_str());
+
+  m_BytesTransferred += data.size();
+  if(m_Client.GetContentLength() >= 0)
+    m_Size = m_Client.GetContentLength();
+
+  for(long long b = first; b <= last; b++)
+    {
+    size_t pos = (size_t) ((b - first) * (long long) m_BlockSize);
+    Block &block = m_Blocks[b];
+    block.Data = pos < data.size() ? data.substr(pos, m_BlockSize) : string();
+    block.LastUse = ++m_UseCounter;
+    }
+}
+
+void RemoteFile::TrimCache()
+{
+  if(m_Blocks.size() <= m_MaxBlocks)
+    return;
+
+  // Find the use time below which blocks are dropped
+  vector<unsigned long> uses;
+  for(auto &it : m_Blocks)
+    uses.push_back(it.second.LastUse);
+  size_t n_drop = m_Blocks.size() - m_MaxBlocks;
+  std::nth_element(uses.begin(), uses.begin() + (n_drop - 1), uses.end());
+  unsigned long threshold = uses[n_drop - 1];
+
+  for(auto it = m_Blocks.begin(); it != m_Blocks.end(); )
+    it = (it->second.LastUse <= threshold) ? m_Blocks.erase(it) : std::next(it);
+}
+
+long long RemoteFile::GetSize()
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  if(m_Size < 0)
+    this->FetchBlocks(0, 0);
+  return m_Size;
+}
+
+size_t RemoteFile::Read(long long offset, size_t length, void *buffer)
+{
+  std::lock_guard<std::mutex> guard(m_Mutex);
+  if(!length)
+    return 0;
+
+  // The blocks holding the requested bytes
+  long long b0 = offset / (long long) m_BlockSize;
+  long long b1 = (offset + (long long) length - 1) / (long long) m_BlockSize;
+
+  // Fetch each run of missing blocks with one request
+  for(long long b = b0; b <= b1; )
+    {
+    if(m_Blocks.count(b) || (m_Size >= 0 && b * (long long) m_BlockSize >= m_Size))
+      {
+      b++;
+      continue;
+      }
+    long long e = b;
+    while(e + 1 <= b1 && !m_Blocks.count(e + 1))
+      e++;
+    this->FetchBlocks(b, e);
+    b = e + 1;
+    }
+
+  // Copy the data from the blocks
+  size_t done = 0;
+  char *out = static_cast<char *>(buffer);
+  for(long long b = b0; b <= b1; b++)
+    {
+    auto it = m_Blocks.find(b);
+    if(it == m_Blocks.end())
+      break;
+
+    it->second.LastUse = ++m_UseCounter;
+    long long block_start = b * (long long) m_BlockSize;
+    size_t from = (size_t) std::max(0ll, offset + (long long) done - block_start);
+    if(from >= it->second.Data.size())
+      break;
+
+    size_t n = std::min(it->second.Data.size() - from, length - done);
+    memcpy(out + done, it->second.Data.data() + from, n);
+    done += n;
+    if(done == length)
+      break;
+    }
+
+  this->TrimCache();
+  return done;
+}
+
+size_t RemoteFile::WritePrefix(const string &filename, size_t n)
+{
+  vector<char> buffer(n);
+  size_t n_read = this->Read(0, n, buffer.data());
+
+  ofstream ofs(filename.c_str(), ios::binary);
+  if(!ofs.write(buffer.data(), n_read))
+    throw IRISException("Unable to write file %s", filename.c_str());
+  return n_read;
+}
@@ -0,0 +1,70 @@
+#ifndef REMOTEFILE_H
+#define REMOTEFILE_H
+
+#include "RESTClient.h"
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * Random access to a file on a web server (e.g., a DSS ticket file) with
+ * HTTP range requests, so that reading the header of an image, or some of
+ * its slices, does not require downloading the whole file. The file is read
+ * in blocks, which are cached. Reads that need several missing blocks fetch
+ * them with a single request, and the least recently used blocks are dropped
+ * when the cache is full.
+ *
+ * Servers that do not honor range requests are reported with an exception,
+ * after which the caller should download the whole file instead.
+ */
+class RemoteFile
+{
+public:
+  /** Open a URL relative to the DSS server, or an absolute URL */
+  RemoteFile(const std::string &url, size_t block_size = 65536, size_t max_blocks = 1024);
+
+  /** Size of the file in bytes */
+  long long GetSize();
+
+  /**
+   * Read length bytes starting at offset into the buffer. Returns the number
+   * of bytes read, which is smaller than length at the end of the file.
+   */
+  size_t Read(long long offset, size_t length, void *buffer);
+
+  /** Write the first n bytes of the file (or the whole file) to a local file */
+  size_t WritePrefix(const std::string &filename, size_t n);
+
+  /** Number of bytes received from the server so far */
+  long long GetBytesTransferred() const { return m_BytesTransferred; }
+
+protected:
+  // Fetch blocks first to last (inclusive) with one request
+  void FetchBlocks(long long first, long long last);
+
+  // Drop the least recently used blocks until the cache fits
+  void TrimCache();
+
+  std::string m_URL;
+  size_t m_BlockSize, m_MaxBlocks;
+  long long m_Size = -1;
+  long long m_BytesTransferred = 0;
+
+  // Cached blocks by index, with the time they were last used
+  struct Block
+  {
+    std::string Data;
+    unsigned long LastUse = 0;
+  };
+  std::map<long long, Block> m_Blocks;
+  unsigned long m_UseCounter = 0;
+
+  RESTClient m_Client;
+  std::mutex m_Mutex;
+
+private:
+  RemoteFile(const RemoteFile &) = delete;
+  RemoteFile &operator = (const RemoteFile &) = delete;
+};
+
+#endif // REMOTEFILE_H
@@ -1,27 +1,80 @@
 #include "WorkspaceAPI.h"
 #include "IRISException.h"
 #include "itksys/MD5.h"
-#include "itksys/Directory.hxx"
 #include "itksys/SystemTools.hxx"
 #include "itksys/RegularExpression.hxx"
 #include "FormattedTable.h"
 #include "GuidedNativeImageIO.h"
+#include "ImageHeaderIndex.h"
 #include "ColorLabelTable.h"
 #include "MultiChannelDisplayMode.h"
 #include "RESTClient.h"
+#include "RemoteFile.h"
 #include "itkCommand.h"
 #include "GuidedMeshIO.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <future>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 using namespace std;
 using itksys::SystemTools;
 using itksys::RegularExpression;
-using itksys::Directory;
 
+/** Read a string from a folder without adding the entry if it is missing */
+static string GetEntryString(const Registry &folder, const string &key)
+{
+  const RegistryValue *value = folder.FindEntry(key);
+  return value && !value->IsNull() ? value->GetInternalString() : string();
+}
 
-void WorkspaceAPI::ReadFromXMLFile(const char *proj_file)
+/** Read a number from a folder without adding the entry if it is missing */
+template <class T>
+static T GetEntryValue(const Registry &folder, const string &key, T default_value)
 {
-  // Read the contents of the project from the file
-  m_Registry.ReadFromXMLFile(proj_file);
+  const RegistryValue *value = folder.FindEntry(key);
+  return value ? GetValueWithDefault(value->GetInternalString(), value->IsNull(), default_value)
+               : default_value;
+}
+
+/**
+ * A name next to a file for writing it before it is moved in place, so that
+ * the readers of the file never see it half written. Every call gets a new
+ * name, since several threads may save the same file.
+ */
+static string GetTemporaryFileNameFor(const string &fn)
+{
+  static std::atomic<unsigned long> counter(0);
+  ostringstream oss;
+#ifdef WIN32
+  oss << fn << "." << _getpid() << "_" << ++counter << ".tmp";
+#else
+  oss << fn << "." << getpid() << "_" << ++counter << ".tmp";
+#endif
+  return oss.str();
+}
+
+
+void WorkspaceAPI::ReadFromXMLFile(const char *proj_file, const StringList *folders)
+{
+  // Read the contents of the project from the file. Binary workspaces can
+  // be read partially; the top-level entries, such as SaveLocation, are
+  // always read.
+  if(folders && Registry::IsBinary(proj_file))
+    m_Registry.ReadFromBinaryFile(proj_file, folders);
+  else
+    m_Registry.ReadFromXMLFile(proj_file);
 
   // Get the full name of the project file
   m_WorkspaceFilePath = SystemTools::CollapseFullPath(proj_file);
@@ -37,6 +90,16 @@ void WorkspaceAPI::ReadFromXMLFile(const char *proj_file)
 }
 
 void WorkspaceAPI::SaveAsXMLFile(const char *proj_file)
+{
+  this->SaveAs(proj_file, false);
+}
+
+void WorkspaceAPI::SaveAsBinaryFile(const char *proj_file)
+{
+  this->SaveAs(proj_file, true);
+}
+
+void WorkspaceAPI::SaveAs(const char *proj_file, bool binary)
 {
   // Get the full name of the project file
   string proj_file_full = SystemTools::CollapseFullPath(proj_file);
@@ -53,8 +116,27 @@ void WorkspaceAPI::SaveAsXMLFile(const char *proj_file)
   // Update all the paths
   this->SetAllLayerPathsToActualPaths();
 
-  // Write the registry
-  m_Registry.WriteToXMLFile(proj_file_full.c_str());
+  // Write the registry to a file of our own and move it in place of the
+  // workspace, which other threads or programs may be reading
+  string fn_temp = GetTemporaryFileNameFor(proj_file_full);
+  try
+    {
+    if(binary)
+      m_Registry.WriteToBinaryFile(fn_temp.c_str());
+    else
+      m_Registry.WriteToXMLFile(fn_temp.c_str());
+    }
+  catch(...)
+    {
+    SystemTools::RemoveFile(fn_temp);
+    throw;
+    }
+
+  if(!SystemTools::RenameFile(fn_temp, proj_file_full))
+    {
+    SystemTools::RemoveFile(fn_temp);
+    throw IRISException("Unable to save workspace to %s", proj_file_full.c_str());
+    }
 
   // Update the internal values
   m_Moved = false;
@@ -63,6 +145,11 @@ void WorkspaceAPI::SaveAsXMLFile(const char *proj_file)
   m_WorkspaceFilePath = proj_file_full;
 }
 
+std::shared_ptr<const WorkspaceAPI> WorkspaceAPI::GetSnapshot() const
+{
+  return std::make_shared<const WorkspaceAPI>(*this);
+}
+
 int WorkspaceAPI::GetNumberOfLayers() const
 {
   // Unfortunately we have to count the folders each time we want to return the number
@@ -111,56 +198,84 @@ Registry &WorkspaceAPI::GetMeshLayerFolder(const string &layer_key)
   return GetLayerFolder(layer_key);
 }
 
+const Registry &WorkspaceAPI::GetLayerFolder(int layer_index) const
+{
+  string key = Registry::Key("Layers.Layer[%03d]", layer_index);
+  const Registry *folder = m_Registry.FindFolder(key);
+  if(!folder)
+    throw IRISException("Layer folder %s does not exist", key.c_str());
+  return *folder;
+}
+
+const Registry &WorkspaceAPI::GetMeshLayerFolder(int layer_index) const
+{
+  string key = Registry::Key("MeshLayers.Layer[%03d]", layer_index);
+  const Registry *folder = m_Registry.FindFolder(key);
+  if(!folder)
+    throw IRISException("Mesh layer folder %s does not exist", key.c_str());
+  return *folder;
+}
+
+const Registry &WorkspaceAPI::GetLayerFolder(const string &layer_key) const
+{
+  const Registry *folder = layer_key.length() ? m_Registry.FindFolder(layer_key) : NULL;
+  if(!folder)
+    throw IRISException("Layer folder %s does not exist", layer_key.c_str());
+  return *folder;
+}
+
+const Registry &WorkspaceAPI::GetMeshLayerFolder(const string &layer_key) const
+{
+  return GetLayerFolder(layer_key);
+}
+
 
-bool WorkspaceAPI::IsKeyValidLayer(const string &key)
+bool WorkspaceAPI::IsKeyValidLayer(const string &key) const
 {
   RegularExpression re("Layers.Layer\\[[0-9]+\\]");
   if(!re.find(key))
     return false;
 
-  if(!m_Registry.HasFolder(key))
+  const Registry *folder = m_Registry.FindFolder(key);
+  if(!folder)
     return false;
 
-  Registry &folder = m_Registry.Folder(key);
-
-  return folder.HasEntry("AbsolutePath") && folder.HasEntry("Role");
+  return folder->HasEntry("AbsolutePath") && folder->HasEntry("Role");
 }
 
-bool WorkspaceAPI::IsKeyValidMeshLayer(const std::string &key)
+bool WorkspaceAPI::IsKeyValidMeshLayer(const std::string &key) const
 {
   RegularExpression re("MeshLayers.Layer\\[[0-9]+\\]");
   if (!re.find(key))
     return false;
 
-  if (!m_Registry.HasFolder(key))
+  const Registry *meshLayer = m_Registry.FindFolder(key);
+  if (!meshLayer)
     return false;
 
-  Registry &meshLayer = m_Registry.Folder(key);
-
-  if (!meshLayer.HasFolder("MeshTimePoints"))
+  const Registry *tpMeshes = meshLayer->FindFolder("MeshTimePoints");
+  if (!tpMeshes)
     return false;
 
-  Registry &tpMeshes = meshLayer.Folder("MeshTimePoints");
-
   // Get a list of time points
-  auto tpList = tpMeshes.FindFoldersFromPattern("TimePoint\\[[0-9]+\\]");
+  auto tpList = tpMeshes->FindFoldersFromPattern("TimePoint\\[[0-9]+\\]");
   if (tpList.size() <= 0)
     return false;
 
   for (auto &tpKey : tpList)
     {
-    Registry &tpMesh = tpMeshes.Folder(tpKey);
+    const Registry *tpMesh = tpMeshes->FindFolder(tpKey);
 
     // All time points should have at least one polydata file
-    auto polyList = tpMesh.FindFoldersFromPattern("PolyData\\[[0-9]+\\]");
+    auto polyList = tpMesh->FindFoldersFromPattern("PolyData\\[[0-9]+\\]");
     if (polyList.size() <= 0)
       return false;
 
     for (auto &polyKey : polyList)
       {
-      Registry &polyData = tpMesh.Folder(polyKey);
+      const Registry *polyData = tpMesh->FindFolder(polyKey);
 
-      if (!polyData.HasEntry("AbsolutePath") || !polyData.HasEntry("Format"))
+      if (!polyData->HasEntry("AbsolutePath") || !polyData->HasEntry("Format"))
         return false;
       }
     }
@@ -169,10 +284,10 @@ bool WorkspaceAPI::IsKeyValidMeshLayer(const std::string &key)
 }
 
 // TODO: merge with IRISApplication
-string WorkspaceAPI::GetLayerActualPath(Registry &folder)
+string WorkspaceAPI::GetLayerActualPath(const Registry &folder) const
 {
   // Get the filenames for the layer
-  string layer_file_full = folder["AbsolutePath"][""];
+  string layer_file_full = GetEntryString(folder, "AbsolutePath");
 
   // If the project has moved, try finding a relative location
   if(m_Moved)
@@ -210,22 +325,20 @@ string WorkspaceAPI::GetLayerActualPath(Registry &folder)
 
 std::string
 WorkspaceAPI
-::GetMeshLayerPolyDataPath(const std::string &folder, unsigned int tp, unsigned int polyId)
+::GetMeshLayerPolyDataPath(const std::string &folder, unsigned int tp, unsigned int polyId) const
 {
   std::string ret = "";
 
-  if (!m_Registry.HasFolder(folder))
+  const Registry *layerFolder = m_Registry.FindFolder(folder);
+  if (!layerFolder)
     return ret;
 
-  Registry &layerFolder = m_Registry.Folder(folder);
-
   std::string targetKey = Registry::Key("MeshTimePoints.TimePoint[%03d].PolyData[%03d]",
                                         tp, polyId);
 
-  if (layerFolder.HasFolder(targetKey))
+  if (const Registry *polyData = layerFolder->FindFolder(targetKey))
     {
-    Registry &polyData = layerFolder.Folder(targetKey);
-    ret = polyData.Entry("AbsolutePath")[""];
+    ret = GetEntryString(*polyData, "AbsolutePath");
     }
   else
     throw IRISException("Target object %s does not exist", targetKey.c_str());
@@ -280,7 +393,12 @@ Registry *WorkspaceAPI::GetLayerIOHints(Registry &folder)
   return io_hints;
 }
 
-void WorkspaceAPI::PrintLayerList(std::ostream &os, const string &line_prefix)
+const Registry *WorkspaceAPI::GetLayerIOHints(const Registry &folder) const
+{
+  return folder.FindFolder("IOHints");
+}
+
+void WorkspaceAPI::PrintLayerList(std::ostream &os, const string &line_prefix) const
 {
   // Iterate over all the layers stored in the workspace
   int n_layers = this->GetNumberOfLayers();
@@ -326,7 +444,8 @@ void WorkspaceAPI::PrintLayerList(std::ostream &os, const string &line_prefix)
 
   for (int i = 0; i < n_mesh_layers; ++i)
     {
-    Registry &meshLayer = this->GetMeshLayerFolder(i);
+    // Copy the folder corresponding to the mesh layer, as for the layers above
+    Registry meshLayer = this->GetMeshLayerFolder(i);
     Registry &tpMeshes = meshLayer.Folder("MeshTimePoints");
     auto tpMeshKeyList = tpMeshes.FindFoldersFromPattern("TimePoint*");
 
@@ -353,9 +472,9 @@ void WorkspaceAPI::PrintLayerList(std::ostream &os, const string &line_prefix)
   meshTable.Print(os, line_prefix);
 }
 
-int WorkspaceAPI::GetNumberOfAnnotations()
+int WorkspaceAPI::GetNumberOfAnnotations() const
 {
-  return m_Registry["Annotations.Annotations.ArraySize"][0];
+  return GetEntryValue(m_Registry, "Annotations.Annotations.ArraySize", 0);
 }
 
 Registry & WorkspaceAPI::GetAnnotationFolder(int annot_index)
@@ -366,11 +485,12 @@ Registry & WorkspaceAPI::GetAnnotationFolder(int annot_index)
 
 #include "ImageAnnotationData.h"
 
-void WorkspaceAPI::PrintAnnotationList(std::ostream &os, const string &line_prefix)
+void WorkspaceAPI::PrintAnnotationList(std::ostream &os, const string &line_prefix) const
 {
   // Annotations are lightweight, so we can using existing API to load them
   SmartPtr<ImageAnnotationData> iad = ImageAnnotationData::New();
-  Registry f_annot = m_Registry.Folder("Annotations");
+  const Registry *annotations = m_Registry.FindFolder("Annotations");
+  Registry f_annot = annotations ? *annotations : Registry();
   iad->LoadAnnotations(f_annot);
 
   // Use a formatted table
@@ -396,7 +516,7 @@ void WorkspaceAPI::PrintAnnotationList(std::ostream &os, const string &line_pref
   table.Print(os, line_prefix);
 }
 
-std::list<std::string> WorkspaceAPI::FindLayersByTag(const string &tag)
+std::list<std::string> WorkspaceAPI::FindLayersByTag(const string &tag) const
 {
   // Iterate over all the layers stored in the workspace
   int n_layers = this->GetNumberOfLayers();
@@ -409,7 +529,7 @@ std::list<std::string> WorkspaceAPI::FindLayersByTag(const string &tag)
     {
     // Get the key of the layer
     string key = Registry::Key("Layers.Layer[%03d]", i);
-    Registry &f = m_Registry.Folder(key);
+    const Registry &f = this->GetLayerFolder(key);
 
     // Get the tags in this layer
     StringSet tags = WorkspaceAPI::GetTags(f);
@@ -425,7 +545,7 @@ std::list<std::string> WorkspaceAPI::FindLayersByTag(const string &tag)
   for (int i = 0; i < n_mesh_layers; ++i)
     {
     string key = Registry::Key("MeshLayers.Layer[%03d]", i);
-    Registry &f = m_Registry.Folder(key);
+    const Registry &f = this->GetMeshLayerFolder(key);
     StringSet tags = WorkspaceAPI::GetTags(f);
     if (tags.find(tag) != tags.end())
       matches.push_back(key);
@@ -434,18 +554,20 @@ std::list<std::string> WorkspaceAPI::FindLayersByTag(const string &tag)
   return matches;
 }
 
-std::list<unsigned int> WorkspaceAPI::FindTimePointByTag(const string &tag)
+std::list<unsigned int> WorkspaceAPI::FindTimePointByTag(const string &tag) const
 {
   // Iterate over all the timepoints stored in the workspace
   std::list<unsigned int> matches;
 
-  if (!this->m_Registry.HasFolder("TimePointProperties.TimePoints"))
+  const Registry *f_tpp = m_Registry.FindFolder("TimePointProperties.TimePoints");
+  if (!f_tpp)
     {
       cout << "[WorkspaceAPI] workspace does not have time point properties folder" << endl;
       return matches;
     }
 
-  Registry regTPP = this->m_Registry.Folder("TimePointProperties.TimePoints");
+  // Copy the folder, so that the lookups below do not modify the workspace
+  Registry regTPP = *f_tpp;
   unsigned int nt = regTPP["ArraySize"][0u];
 
   // Load all of the time points in the current project
@@ -467,18 +589,20 @@ std::list<unsigned int> WorkspaceAPI::FindTimePointByTag(const string &tag)
   return matches;
 }
 
-std::list<unsigned int> WorkspaceAPI::FindTimePointByName(const string &name)
+std::list<unsigned int> WorkspaceAPI::FindTimePointByName(const string &name) const
 {
   // Iterate over all the timepoints stored in the workspace
   std::list<unsigned int> matches;
 
-  if (!this->m_Registry.HasFolder("TimePointProperties.TimePoints"))
+  const Registry *f_tpp = m_Registry.FindFolder("TimePointProperties.TimePoints");
+  if (!f_tpp)
     {
       cout << "[WorkspaceAPI] workspace does not have time point properties folder" << endl;
       return matches;
     }
 
-  Registry regTPP = this->m_Registry.Folder("TimePointProperties.TimePoints");
+  // Copy the folder, so that the lookups below do not modify the workspace
+  Registry regTPP = *f_tpp;
   unsigned int nt = regTPP["ArraySize"][0u];
 
   // Load all of the time points in the current project
@@ -500,16 +624,18 @@ std::list<unsigned int> WorkspaceAPI::FindTimePointByName(const string &name)
   return matches;
 }
 
-void WorkspaceAPI::PrintTimePointList(std::ostream &os, const string &line_prefix)
+void WorkspaceAPI::PrintTimePointList(std::ostream &os, const string &line_prefix) const
 {
   // Iterate over all the layers stored in the workspace
-  if (!this->m_Registry.HasFolder("TimePointProperties.TimePoints"))
+  const Registry *f_tpp = m_Registry.FindFolder("TimePointProperties.TimePoints");
+  if (!f_tpp)
     {
       cout << "[WorkspaceAPI] workspace does not have time point properties folder" << endl;
       return;
     }
 
-  Registry regTPP = this->m_Registry.Folder("TimePointProperties.TimePoints");
+  // Copy the folder, so that the lookups below do not modify the workspace
+  Registry regTPP = *f_tpp;
   unsigned int nt = regTPP["ArraySize"][0u];
 
   // Use a formatted table
@@ -545,7 +671,7 @@ void WorkspaceAPI::PrintTimePointList(std::ostream &os, const string &line_prefi
 
 
 
-void WorkspaceAPI::ListLayerFilesForTag(const string &tag, ostream &sout, const string &prefix)
+void WorkspaceAPI::ListLayerFilesForTag(const string &tag, ostream &sout, const string &prefix) const
 {
   // Iterate over all the layers stored in the workspace
   int n_layers = this->GetNumberOfLayers();
@@ -553,8 +679,8 @@ void WorkspaceAPI::ListLayerFilesForTag(const string &tag, ostream &sout, const
   // Load all of the layers in the current project
   for(int i = 0; i < n_layers; i++)
     {
-    // Copy the folder corresponding to the layer - to avoid modifying the original
-    Registry &f_layer = this->GetLayerFolder(i);
+    // Get the folder corresponding to the layer
+    const Registry &f_layer = this->GetLayerFolder(i);
 
     // Get the tags for this folder
     set<string> tags = this->GetTags(f_layer);
@@ -568,12 +694,12 @@ void WorkspaceAPI::ListLayerFilesForTag(const string &tag, ostream &sout, const
     }
 }
 
-WorkspaceAPI::StringSet WorkspaceAPI::GetTags(Registry &folder)
+WorkspaceAPI::StringSet WorkspaceAPI::GetTags(const Registry &folder) const
 {
   set<string> tagset;
   if(folder.HasEntry("Tags"))
     {
-    istringstream iss(folder["Tags"][""]);
+    istringstream iss(GetEntryString(folder, "Tags"));
     string tag;
     while(getline(iss,tag,','))
       tagset.insert(tag);
@@ -624,13 +750,14 @@ void WorkspaceAPI::ScrubTag(Registry &folder, const string &tag)
     this->RemoveTag(folder, tag);
 }
 
-void WorkspaceAPI::FindTag(Registry &folder, const string &tag, StringList &found_keys, const string &prefix)
+void WorkspaceAPI::FindTag(const Registry &folder, const string &tag, StringList &found_keys, const string &prefix) const
 {
   // Go over all subfolders of the given folder, recursively
   Registry::StringListType keys;
   folder.GetFolderKeys(keys);
   for(Registry::StringListType::const_iterator it = keys.begin(); it != keys.end(); ++it)
-    this->FindTag(folder.Folder(*it), tag, found_keys, (prefix.length() ? prefix + "." + *it : *it));
+    if(const Registry *child = folder.FindFolder(*it))
+      this->FindTag(*child, tag, found_keys, (prefix.length() ? prefix + "." + *it : *it));
 
   // Do we have a tag entry
   if(folder.HasEntry("Tags"))
@@ -643,7 +770,7 @@ void WorkspaceAPI::FindTag(Registry &folder, const string &tag, StringList &foun
     }
 }
 
-string WorkspaceAPI::FindFolderForUniqueTag(const string &tag)
+string WorkspaceAPI::FindFolderForUniqueTag(const string &tag) const
 {
   list<string> found_keys;
   this->FindTag(m_Registry, tag, found_keys, "");
@@ -655,7 +782,7 @@ string WorkspaceAPI::FindFolderForUniqueTag(const string &tag)
   return found_keys.back();
 }
 
-string WorkspaceAPI::FindLayerByRole(const string &role, int pos_in_role)
+string WorkspaceAPI::FindLayerByRole(const string &role, int pos_in_role) const
 {
   // Iterate over all the layers stored in the workspace
   int n_layers = this->GetNumberOfLayers();
@@ -672,10 +799,10 @@ string WorkspaceAPI::FindLayerByRole(const string &role, int pos_in_role)
   for(int i = start; i != end; i += step)
     {
     // Get the folder corresponding to the layer
-    Registry &f_layer = this->GetLayerFolder(i);
+    const Registry &f_layer = this->GetLayerFolder(i);
 
     // Is this the correct role?
-    string l_role = f_layer["Role"][""];
+    string l_role = GetEntryString(f_layer, "Role");
     if(l_role == role
        || (role == "AnatomicalRole" && (l_role == "MainRole" || l_role == "OverlayRole"))
        || (role == "AnyRole"))
@@ -692,7 +819,7 @@ string WorkspaceAPI::FindLayerByRole(const string &role, int pos_in_role)
   return string();
 }
 
-string WorkspaceAPI::FindMeshLayerById(int id)
+string WorkspaceAPI::FindMeshLayerById(int id) const
 {
   string targetKey = Registry::Key("MeshLayers.Layer[%03d]", id);
   if (m_Registry.HasFolder(targetKey))
@@ -701,7 +828,7 @@ string WorkspaceAPI::FindMeshLayerById(int id)
   return "";
 }
 
-string WorkspaceAPI::LayerSpecToKey(const string &layer_spec)
+string WorkspaceAPI::LayerSpecToKey(const string &layer_spec) const
 {
   // Basic pattern (001)
   RegularExpression reNum("^([0-9]+)$");
@@ -766,7 +893,7 @@ string WorkspaceAPI::LayerSpecToKey(const string &layer_spec)
   throw IRISException("Layer specification %s not found in workspace", layer_spec.c_str());
 }
 
-string WorkspaceAPI::GetMainLayerKey()
+string WorkspaceAPI::GetMainLayerKey() const
 {
   return this->LayerSpecToKey("M");
 }
@@ -779,12 +906,24 @@ void WorkspaceAPI::UpdateMainLayerFieldsFromImage(Registry &main_layer_folder)
   // setting the image dimensions, older versions of SNAP will refuse to read some metadata
   // from project files, which is a problem
   // TODO: there has to be a way to supply some hints!
-  SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
-  Registry hints;
-	io->ReadNativeImageHeader(filename.c_str(), hints);
   Vector3i dims(0);
-  for(int k = 0; k < io->GetIOBase()->GetNumberOfDimensions(); k++)
-    dims[k] = io->GetIOBase()->GetDimensions(k);
+  ImageHeaderIndex::Entry header;
+  ImageHeaderIndex *index = ImageHeaderIndex::GetInstance();
+  if(index->IsEnabled() && index->Find(filename, header))
+    {
+    // The header of this file has been read before and the file is unchanged
+    for(unsigned int k = 0; k < header.Dimensions.size() && k < 3; k++)
+      dims[k] = header.Dimensions[k];
+    }
+  else
+    {
+    SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
+    Registry hints;
+    io->ReadNativeImageHeader(filename.c_str(), hints);
+    for(int k = 0; k < io->GetIOBase()->GetNumberOfDimensions() && k < 3; k++)
+      dims[k] = io->GetIOBase()->GetDimensions(k);
+    index->Store(filename, io->GetIOBase());
+    }
 
   main_layer_folder["ProjectMetaData.Files.Grey.Dimensions"] << dims;
 }
@@ -1055,7 +1194,15 @@ Registry &WorkspaceAPI::GetFolder(const string &key)
   return m_Registry.Folder(key);
 }
 
-bool WorkspaceAPI::HasFolder(const string &key)
+const Registry &WorkspaceAPI::GetFolder(const string &key) const
+{
+  const Registry *folder = m_Registry.FindFolder(key);
+  if(!folder)
+    throw IRISException("Folder %s does not exist in the workspace", key.c_str());
+  return *folder;
+}
+
+bool WorkspaceAPI::HasFolder(const string &key) const
 {
   return m_Registry.HasFolder(key);
 }
@@ -1096,9 +1243,117 @@ string WorkspaceAPI::GetTempDirName()
 
 #include "AllPurposeProgressAccumulator.h"
 
+/**
+ * Check if a layer file can be exported by copying it, rather than by reading
+ * and saving it again. This is the case for gzipped NIfTI files that need no
+ * IO hints and whose gzip header does not carry a file name or a comment that
+ * could reveal the original name of the file. If requested, the MD5 hash of
+ * the contents of the file is returned for use as the scrambled filename.
+ */
+static bool CanCopyLayerFileOnExport(const string &fn, const Registry &io_hints,
+                                     bool compute_md5, string &md5)
+{
+  if(!io_hints.IsEmpty() || !SystemTools::StringEndsWith(SystemTools::LowerCase(fn), ".nii.gz"))
+    return false;
+
+  ifstream ifs(fn.c_str(), ios::binary);
+  unsigned char header[4];
+  if(!ifs.read((char *) header, 4) || header[0] != 0x1f || header[1] != 0x8b)
+    return false;
+
+  // FNAME and FCOMMENT flags
+  if(header[3] & 0x18)
+    return false;
+
+  if(!compute_md5)
+    return true;
+
+  // Hash the file contents
+  char hex_code[33];
+  hex_code[32] = 0;
+  itksysMD5 *hasher = itksysMD5_New();
+  itksysMD5_Initialize(hasher);
+  itksysMD5_Append(hasher, header, 4);
+  vector<char> buffer(1 << 20);
+  while(ifs.read(&buffer[0], buffer.size()) || ifs.gcount() > 0)
+    itksysMD5_Append(hasher, (unsigned char *) &buffer[0], (int) ifs.gcount());
+  itksysMD5_FinalizeHex(hasher, hex_code);
+  itksysMD5_Delete(hasher);
+
+  md5 = hex_code;
+  return true;
+}
+
+/**
+ * Make a hard link to a file, falling back to a copy if the file system does
+ * not support links (e.g., the destination is on a different volume)
+ */
+static bool LinkOrCopyFile(const string &src, const string &dst)
+{
+  SystemTools::RemoveFile(dst);
+#ifdef WIN32
+  if(CreateHardLinkA(dst.c_str(), src.c_str(), NULL))
+    return true;
+#else
+  if(link(src.c_str(), dst.c_str()) == 0)
+    return true;
+#endif
+  return SystemTools::CopyFileAlways(src, dst) ? true : false;
+}
+
+/** Read a layer and save it as a NIfTI file, returning the new filename */
+static string ConvertLayerOnExport(const string &fn_layer, Registry io_hints,
+                                   const string &fn_pattern, string basename,
+                                   bool scramble_filenames, bool fast_compression)
+{
+  // If the hash of the image data is known and a file with that name has
+  // already been exported, the image does not need to be read at all. The
+  // hash of images read with IO hints depends on the hints and is not kept
+  char fn_layer_new[4096];
+  ImageHeaderIndex::Entry header;
+  ImageHeaderIndex *index = ImageHeaderIndex::GetInstance();
+  bool use_index = scramble_filenames && io_hints.IsEmpty() && index->IsEnabled();
+  if(use_index && index->Find(fn_layer, header) && header.Checksum.length())
+    {
+    snprintf(fn_layer_new, 4096, fn_pattern.c_str(), header.Checksum.c_str());
+    if(SystemTools::FileExists(fn_layer_new))
+      return fn_layer_new;
+    }
+
+  // Create a native image IO object for this image
+  SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
+
+  // Load the header of the image and the image data
+  io->ReadNativeImage(fn_layer.c_str(), io_hints);
+
+  // Compute the hash of the image data to generate filename
+  if(scramble_filenames)
+    {
+    basename = io->GetNativeImageMD5Hash();
+    if(use_index)
+      index->StoreChecksum(fn_layer, io->GetIOBase(), basename);
+    }
+
+  snprintf(fn_layer_new, 4096, fn_pattern.c_str(), basename.c_str());
+
+  // With a scrambled name, an existing file already has the same image data
+  if(scramble_filenames && SystemTools::FileExists(fn_layer_new))
+    return fn_layer_new;
+
+  // Save the layer there. Since we are saving as a NIFTI, we don't need to
+  // provide any hints other than the compression level
+  Registry save_hints;
+  if(fast_compression)
+    save_hints["CompressionLevel"] << 1;
+  io->SaveNativeImage(fn_layer_new, save_hints);
+
+  return fn_layer_new;
+}
+
 void WorkspaceAPI::ExportWorkspace(const char *new_workspace,
                                    CommandType *cmd_progress,
-                                   bool scramble_filenames) const
+                                   bool scramble_filenames,
+                                   int flags) const
 {
   // Create a progress tracker
   SmartPtr<TrivalProgressSource> progress = TrivalProgressSource::New();
@@ -1124,6 +1379,23 @@ void WorkspaceAPI::ExportWorkspace(const char *new_workspace,
   // Report progress
   progress->StartProgress(n_layers);
 
+  // Layers that must be converted are read and saved by worker tasks. Without
+  // the fast conversion flag, only one layer is converted at a time, to keep
+  // the memory use down.
+  bool fast = (flags & EXPORT_FAST_CONVERSION) != 0;
+  unsigned int max_tasks = fast ? (std::max)(1u, (std::min)(4u, std::thread::hardware_concurrency())) : 1;
+  std::list<std::pair<int, std::future<string> > > tasks;
+
+  // Handle the layer of the oldest task once it is done
+  auto finish_task = [&]()
+    {
+    Registry &f_layer = wsexp.GetLayerFolder(tasks.front().first);
+    f_layer["AbsolutePath"] << tasks.front().second.get();
+    f_layer.Folder("IOHints").Clear();
+    tasks.pop_front();
+    progress->AddProgress(1.0);
+    };
+
   // Load all of the layers in the current project
   for(int i = 0; i < n_layers; i++)
     {
@@ -1141,41 +1413,58 @@ void WorkspaceAPI::ExportWorkspace(const char *new_workspace,
     if((layer_io_hints = wsexp.GetLayerIOHints(f_layer)))
       io_hints.Update(*layer_io_hints);
 
-    // Create a native image IO object for this image
-    SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
-
-    // Load the header of the image and the image data
-    io->ReadNativeImage(fn_layer.c_str(), io_hints);
-
-    // Report progress
-    progress->AddProgress(0.5);
+    // The new filename combines the layer index with the hash code
+    char fn_pattern[4096];
+    snprintf(fn_pattern, 4096, "%s/layer_%03d_%%s.nii.gz", wsdir.c_str(), i);
 
-    // Compute the hash of the image data to generate filename
-    if(scramble_filenames)
+    // Layers that are already gzipped NIfTI files are copied as they are,
+    // which avoids decompressing and compressing large images again
+    string file_md5;
+    if(CanCopyLayerFileOnExport(fn_layer, io_hints, scramble_filenames, file_md5))
       {
-      // Use the hash as the basename
-      fn_layer_basename = io->GetNativeImageMD5Hash();
-      }
-
-    // Create a filename that combines the layer index with the hash code
-    char fn_layer_new[4096];
-    snprintf(fn_layer_new, 4096, "%s/layer_%03d_%s.nii.gz", wsdir.c_str(), i, fn_layer_basename.c_str());
-
-    // Save the layer there. Since we are saving as a NIFTI, we don't need to
-    // provide any hints
-    Registry dummy_hints;
-    io->SaveNativeImage(fn_layer_new, dummy_hints);
+      if(scramble_filenames)
+        fn_layer_basename = file_md5;
 
-    // Report progress
-    progress->AddProgress(0.5);
+      char fn_layer_new[4096];
+      snprintf(fn_layer_new, 4096, fn_pattern, fn_layer_basename.c_str());
 
-    // Update the layer folder with the new path
-    f_layer["AbsolutePath"] << fn_layer_new;
+      // When linking, a file that is already in place is kept. This is the
+      // case if it is the same file, or if it has the same content hash
+      if(flags & EXPORT_LINK_UNCHANGED)
+        {
+        bool in_place = SystemTools::FileExists(fn_layer_new)
+                        && (scramble_filenames || SystemTools::SameFile(fn_layer, fn_layer_new));
+        if(!in_place && !LinkOrCopyFile(fn_layer, fn_layer_new))
+          throw IRISException("Failed to link %s to %s", fn_layer.c_str(), fn_layer_new);
+        }
+      else if(!SystemTools::CopyFileAlways(fn_layer, fn_layer_new))
+        {
+        throw IRISException("Failed to copy %s to %s", fn_layer.c_str(), fn_layer_new);
+        }
 
-    // There are no hints necessary for NIFTI
-    f_layer.Folder("IOHints").Clear();
+      // Update the layer folder with the new path. There are no hints
+      // necessary for NIFTI
+      f_layer["AbsolutePath"] << fn_layer_new;
+      f_layer.Folder("IOHints").Clear();
+      progress->AddProgress(1.0);
+      }
+    else
+      {
+      // Wait for a worker to become available
+      if(tasks.size() >= max_tasks)
+        finish_task();
+
+      tasks.push_back(std::make_pair(i, std::async(
+                        std::launch::async, ConvertLayerOnExport,
+                        fn_layer, io_hints, string(fn_pattern), fn_layer_basename,
+                        scramble_filenames, fast)));
+      }
     }
 
+  // Wait for the remaining conversions
+  while(tasks.size())
+    finish_task();
+
   // Write the updated project
   wsexp.SaveAsXMLFile(new_workspace);
 
@@ -1183,6 +1472,27 @@ void WorkspaceAPI::ExportWorkspace(const char *new_workspace,
   progress->EndProgress();
 }
 
+/**
+ * The directory where workspaces are exported for upload, and the lock held
+ * while exporting into it. The directory is shared by all the uploads of the
+ * session, so that a layer sent with several tickets, e.g., to different
+ * services, is only converted once: exported layers are named by the hash of
+ * their contents, and an export keeps the files that are already in place.
+ */
+static string GetUploadStagingDirectory(std::unique_lock<std::mutex> &lock)
+{
+  static std::mutex staging_mutex;
+  static string staging_dir;
+
+  lock = std::unique_lock<std::mutex>(staging_mutex);
+  if(staging_dir.empty() || !SystemTools::FileIsDirectory(staging_dir))
+    {
+    staging_dir = WorkspaceAPI::GetTempDirName();
+    SystemTools::MakeDirectory(staging_dir);
+    }
+  return staging_dir;
+}
+
 void WorkspaceAPI::UploadWorkspace(const char *url, int ticket_id,
                                    const char *wsfile_suffix,
                                    CommandType *cmd_progress) const
@@ -1200,26 +1510,26 @@ void WorkspaceAPI::UploadWorkspace(const char *url, int ticket_id,
   SmartPtr<AllPurposeProgressAccumulator> accum_upload = AllPurposeProgressAccumulator::New();
   accum->RegisterSource(accum_upload, 0.5);
 
-  // Create temporary directory for the export
-  string tempdir = GetTempDirName();
-  SystemTools::MakeDirectory(tempdir);
-
-  // Export the workspace file to the temporary directory
+  // Export the workspace file to the staging directory. Only one export runs
+  // at a time, while the uploads of several tickets may run concurrently
   char ws_fname_buffer[4096];
-  snprintf(ws_fname_buffer, 4096, "%s/ticket_%08d%s.itksnap", tempdir.c_str(), ticket_id, wsfile_suffix);
-  ExportWorkspace(ws_fname_buffer, cmd_export);
-
-  // Count the number of files in the directory
   std::vector<std::string> fn_to_upload;
-  Directory dir;
-  dir.Load(tempdir);
-  for(int i = 0; i < dir.GetNumberOfFiles(); i++)
-    {
-    const char *thisfile = dir.GetFile(i);
-    string file_full_path = SystemTools::CollapseFullPath(thisfile, dir.GetPath());
-    if(!SystemTools::FileIsDirectory(file_full_path))
-      fn_to_upload.push_back(file_full_path);
-    }
+  {
+    std::unique_lock<std::mutex> staging_lock;
+    string tempdir = GetUploadStagingDirectory(staging_lock);
+    snprintf(ws_fname_buffer, 4096, "%s/ticket_%08d%s.itksnap", tempdir.c_str(), ticket_id, wsfile_suffix);
+
+    // The export directory is temporary, so unchanged layers can be linked
+    ExportWorkspace(ws_fname_buffer, cmd_export, true, EXPORT_LINK_UNCHANGED);
+  }
+
+  // The files to upload are the workspace and the layers it refers to, and
+  // not the other files in the staging directory
+  WorkspaceAPI exported;
+  exported.ReadFromXMLFile(ws_fname_buffer);
+  fn_to_upload.push_back(ws_fname_buffer);
+  for(int i = 0; i < exported.GetNumberOfLayers(); i++)
+    fn_to_upload.push_back(exported.GetLayerActualPath(exported.GetLayerFolder(i)));
 
   cout << "Exported workspace to " << ws_fname_buffer << endl;
 
@@ -1369,3 +1679,83 @@ string WorkspaceAPI::DownloadTicketFiles(
 
   return oss.str();
 }
+
+string WorkspaceAPI::DownloadTicketFileHeaders(
+    int ticket_id, const char *outdir, bool provider_mode, const char *area)
+{
+  ostringstream oss;
+  const char *url_base = (provider_mode) ? "api/pro" : "api";
+
+  // Get the list of all files for this ticket
+  RESTClient rc;
+  if(!rc.Get("%s/tickets/%d/files/%s", url_base, ticket_id, area))
+    throw IRISException("Failed to get list of files for ticket %d (%s)",
+      ticket_id, rc.GetResponseText());
+
+  FormattedTable ft;
+  ft.ParseCSV(rc.GetOutput());
+  if(ft.Rows() == 0 || ft.Columns() < 2)
+    throw IRISException("Empty or invalid list of files for ticket %d", ticket_id);
+
+  if(!SystemTools::MakeDirectory(outdir))
+    throw IRISException("Unable to create output directory %s", outdir);
+
+  for(int iFile = 0; iFile < ft.Rows(); iFile++)
+    {
+    int file_index = atoi(ft(iFile,0).c_str());
+    string file_name = ft(iFile, 1);
+    string file_path = SystemTools::CollapseFullPath(file_name.c_str(), outdir);
+
+    char url[4096];
+    snprintf(url, 4096, "%s/tickets/%d/files/%s/%d", url_base, ticket_id, area, file_index);
+
+    // Fetch more of an image file until its header can be read. Headers
+    // followed by large extensions may take a few tries.
+    bool have_header = false;
+    if(GuidedNativeImageIO::GuessFormatForFileName(file_name, false) != GuidedNativeImageIO::FORMAT_COUNT)
+      {
+      try
+        {
+        RemoteFile remote(url);
+        for(size_t n = 65536; n <= (16u << 20) && !have_header; n *= 4)
+          {
+          size_t n_read = remote.WritePrefix(file_path, n);
+          try
+            {
+            SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
+            Registry hints;
+            io->ReadNativeImageHeader(file_path.c_str(), hints);
+            have_header = true;
+            }
+          catch(std::exception &)
+            {
+            // The whole file has been fetched, so the header is not the problem
+            if(n_read < n)
+              break;
+            }
+          }
+        }
+      catch(IRISException &)
+        {
+        // The server does not support range requests
+        }
+      }
+
+    // Other files (and images whose header could not be read) are fetched whole
+    if(!have_header)
+      {
+      FILE *fout = fopen(file_path.c_str(), "wb");
+      rc.SetOutputFile(fout);
+      bool ok = rc.Get("%s", url);
+      rc.SetOutputFile(NULL);
+      fclose(fout);
+      if(!ok)
+        throw IRISException("Failed to download file %s for ticket %d (%s)",
+          file_name.c_str(), ticket_id, rc.GetResponseText());
+      }
+
+    oss << file_path << endl;
+    }
+
+  return oss.str();
+}
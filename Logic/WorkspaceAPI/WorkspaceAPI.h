@@ -2,6 +2,7 @@
 #define WORKSPACEAPI_H
 
 #include "Registry.h"
+#include <memory>
 #include <set>
 
 namespace itk { class Command; }
@@ -11,6 +12,14 @@ struct MultiChannelDisplayMode;
 /**
  * This class encapsulates an ITK-SNAP workspace. It is just a wrapper around
  * a registry object, but with extra functions that support workspaces
+ *
+ * Separate workspace objects may be used in different threads at the same
+ * time. A single object may be shared by threads as long as they only call
+ * its const functions, which never add anything to the registry. The usual
+ * way to do this is to read or edit the workspace in one thread and to hand
+ * GetSnapshot() to the threads that answer queries about it. The non-const
+ * functions, including the ones that return a Registry reference for editing
+ * (and create the folder if it is missing), need the object to themselves.
  */
 class WorkspaceAPI
 {
@@ -24,9 +33,12 @@ public:
 
   /**
    * Read the workspace from a file, determine if it has been moved or copied
-   * since it was saved originally.
+   * since it was saved originally. The file may also be a binary workspace
+   * (see SaveAsBinaryFile). For binary workspaces, a list of top-level folders
+   * may be given to only read these folders, e.g., Layers and MeshLayers for
+   * tag queries. Such a partially read workspace should not be saved.
    */
-  void ReadFromXMLFile(const char *proj_file);
+  void ReadFromXMLFile(const char *proj_file, const StringList *folders = NULL);
 
   /**
    * Write the workspace to an XML file. The workspace data structure
@@ -40,6 +52,18 @@ public:
    */
   void SaveAsXMLFile(const char *proj_file);
 
+  /**
+   * Write the workspace to a binary registry file, which is faster to read
+   * than XML for large workspaces. Otherwise the same as SaveAsXMLFile()
+   */
+  void SaveAsBinaryFile(const char *proj_file);
+
+  /**
+   * An immutable copy of the workspace, which may be queried by any number of
+   * threads while this workspace is edited, saved or destroyed
+   */
+  std::shared_ptr<const WorkspaceAPI> GetSnapshot() const;
+
   /**
    * Get number of image layers in the workspace
    */
@@ -60,6 +84,15 @@ public:
    */
   Registry &GetMeshLayerFolder(int layer_index);
 
+  /**
+   * Get the folder for the n-th layer without modifying the workspace. Throws
+   * an exception if there is no such layer
+   */
+  const Registry &GetLayerFolder(int layer_index) const;
+
+  /** Get the folder for the n-th mesh layer without modifying the workspace */
+  const Registry &GetMeshLayerFolder(int layer_index) const;
+
   /**
    * Get the layer folder by key. This function throws an exception if the key does
    * not correspond to a valid layer.
@@ -71,31 +104,37 @@ public:
    */
   Registry &GetMeshLayerFolder(const std::string &layer_key);
 
+  /** Get the layer folder by key without modifying the workspace */
+  const Registry &GetLayerFolder(const std::string &layer_key) const;
+
+  /** Get the mesh layer folder by key without modifying the workspace */
+  const Registry &GetMeshLayerFolder(const std::string &layer_key) const;
+
   /**
    * Check if the provided key specifies a valid layer - a valid layer is specified
    * as "Layers.Layer[xxx]" and contains an absolute filename and a role as the minimum
    * required entries
    */
-  bool IsKeyValidLayer(const std::string &key);
+  bool IsKeyValidLayer(const std::string &key) const;
 
   /**
    * Check if the provided key specifies a valid mesh layer - a valid mesh layer is specified
    * as "MeshLayers.Layer[xxx]" and contains at least one timepoint and one polydata filename
    * for the timepoint
    */
-  bool IsKeyValidMeshLayer(const std::string &key);
+  bool IsKeyValidMeshLayer(const std::string &key) const;
 
   /**
    * Find a physical file corresponding to a file referenced by the project, accouting
    * for the possibility that the project may have been moved or copied
    */
-  std::string GetLayerActualPath(Registry &folder);
+  std::string GetLayerActualPath(const Registry &folder) const;
 
   /**
    * Find a physical file corresponding to a polydata component in the specified meshlayer timepoint,
    * accouting for the possibility that the project may have been moved or copied
    */
-  std::string GetMeshLayerPolyDataPath(const std::string &folder, unsigned int tp, unsigned int polyId);
+  std::string GetMeshLayerPolyDataPath(const std::string &folder, unsigned int tp, unsigned int polyId) const;
 
   /**
    * Add a polydata component to an existing mesh time point
@@ -114,13 +153,15 @@ public:
    */
   Registry * GetLayerIOHints(Registry &folder);
 
-  void PrintLayerList(std::ostream &os, const std::string &line_prefix = "");
+  const Registry * GetLayerIOHints(const Registry &folder) const;
+
+  void PrintLayerList(std::ostream &os, const std::string &line_prefix = "") const;
 
   /** List all layer files associated with a tag */
-  void ListLayerFilesForTag(const std::string &tag, std::ostream &sout, const std::string &prefix);
+  void ListLayerFilesForTag(const std::string &tag, std::ostream &sout, const std::string &prefix) const;
 
   /** Get a list of tags from a particular folder */
-  StringSet GetTags(Registry &folder);
+  StringSet GetTags(const Registry &folder) const;
 
   /** Put tags into a folder. Assumes that there are no commas in the tags */
   void PutTags(Registry &folder, const StringSet &tags);
@@ -137,56 +178,56 @@ public:
   /**
    * Recursive tag search
    */
-  void FindTag(Registry &folder, const std::string &tag, StringList &found_keys, const std::string &prefix);
+  void FindTag(const Registry &folder, const std::string &tag, StringList &found_keys, const std::string &prefix) const;
 
   /**
    * Find a folder for a given tag. This will crash if the tag is missing or
    * if more than one object has the given tag
    */
-  std::string FindFolderForUniqueTag(const std::string &tag);
+  std::string FindFolderForUniqueTag(const std::string &tag) const;
 
   /**
    * Find layer by role. If pos_in_role is negative, this looks from
    * the end for that role
    */
-  std::string FindLayerByRole(const std::string &role, int pos_in_role);
+  std::string FindLayerByRole(const std::string &role, int pos_in_role) const;
 
   /**
    * Find a mesh layer by id
    * e.g. Passing 1 will find MeshLayers.Layer[001]
    */
-  std::string FindMeshLayerById(int id);
+  std::string FindMeshLayerById(int id) const;
 
   /**
    * Find layers that match a tag
    */
-  std::list<std::string> FindLayersByTag(const std::string &tag);
+  std::list<std::string> FindLayersByTag(const std::string &tag) const;
 
   /**
    * Find time point that match a tag
    */
-  std::list<unsigned int> FindTimePointByTag(const std::string &tag);
+  std::list<unsigned int> FindTimePointByTag(const std::string &tag) const;
 
   /**
    * Find time point that match a name
    */
-  std::list<unsigned int> FindTimePointByName(const std::string &name);
+  std::list<unsigned int> FindTimePointByName(const std::string &name) const;
 
   /**
    * Print all time points
    */
-  void PrintTimePointList(std::ostream &os, const std::string &line_prefix = "");
+  void PrintTimePointList(std::ostream &os, const std::string &line_prefix = "") const;
 
   /**
    * Translate a shorthand layer specifier to a folder ID. Will throw an exception if
    * the layer specifier cannot be found or is out of range
    */
-  std::string LayerSpecToKey(const std::string &layer_spec);
+  std::string LayerSpecToKey(const std::string &layer_spec) const;
 
   /**
    * Get the folder id for the main image or throw exception if it does not exist
    */
-  std::string GetMainLayerKey();
+  std::string GetMainLayerKey() const;
 
   /**
    * Set the main layer dimensions in the registry. This should be called whenever the
@@ -242,19 +283,42 @@ public:
   /** Get a folder within the registry - this is just a helper */
   Registry &GetFolder(const std::string &key);
 
+  /** Get a folder within the registry without modifying it, or throw an exception */
+  const Registry &GetFolder(const std::string &key) const;
+
   /** Get a folder within the registry - this is just a helper */
-  bool HasFolder(const std::string &key);
+  bool HasFolder(const std::string &key) const;
 
   /** Get the absolute path to the directory where the project was loaded from */
   std::string GetWorkspaceActualDirectory()  const;
 
-  /** Cross-platform way of getting a temporary path */
+  /** Cross-platform way of getting a new temporary path, unique to the caller */
   static std::string GetTempDirName();
 
-  /** Export the workspace */
-  void ExportWorkspace(const char *new_workspace, CommandType *cmd_progress = NULL, bool scramble_filenames = true) const;
+  /** Options for ExportWorkspace() */
+  enum ExportFlags
+  {
+    /**
+     * Hard link the layer files that are exported unchanged instead of copying
+     * them (copy if the file system does not allow it), and keep such files if
+     * they are already in the export directory. The exported files then share
+     * storage with the originals, which must not be modified in place.
+     */
+    EXPORT_LINK_UNCHANGED = 0x01,
+
+    /** Convert the other layers several at a time, with fast compression */
+    EXPORT_FAST_CONVERSION = 0x02
+  };
+
+  /** Export the workspace. The flags are a combination of ExportFlags */
+  void ExportWorkspace(const char *new_workspace, CommandType *cmd_progress = NULL,
+                       bool scramble_filenames = true, int flags = 0) const;
 
-  /** Upload the workspace */
+  /**
+   * Upload the workspace. It is exported to a staging directory shared by the
+   * uploads of the session, so layers that are uploaded with several tickets
+   * are only exported once. Uploads may run concurrently in several threads.
+   */
   void UploadWorkspace(const char *url, int ticket_id, const char *wsfile_suffix,
                        CommandType *cmd_progress = NULL) const;
 
@@ -269,22 +333,35 @@ public:
       int ticket_id, const char *outdir, bool provider_mode, const char *area,
       const char *workspace_filename = NULL, CommandType *cmd_progress = NULL);
 
+  /**
+   * Download only as much of each image file of a ticket as is needed to read
+   * its header, using HTTP range requests, e.g., for geometry checks. Images
+   * whose headers can not be read this way, other files, and all files from
+   * servers that do not support range requests are downloaded whole. The
+   * truncated images can not be loaded, only their headers are valid.
+   */
+  static std::string DownloadTicketFileHeaders(
+      int ticket_id, const char *outdir, bool provider_mode, const char *area);
+
   /** Get number of annotations in the workspace */
-  int GetNumberOfAnnotations();
+  int GetNumberOfAnnotations() const;
 
   /** Get n-th annotation folder */
   Registry &GetAnnotationFolder(int annot_index);
 
   /** Print a list of all annotations */
-  void PrintAnnotationList(std::ostream &os, const std::string &line_prefix);
+  void PrintAnnotationList(std::ostream &os, const std::string &line_prefix) const;
 
 protected:
 
+  // Common code for SaveAsXMLFile and SaveAsBinaryFile
+  void SaveAs(const char *proj_file, bool binary);
+
   // The Registry object containing workspace data
   Registry m_Registry;
 
   // Has the workspace moved from its original location
-  bool m_Moved;
+  bool m_Moved = false;
 
   // The full path and containing directory of the workspace file
   std::string m_WorkspaceFilePath, m_WorkspaceFileDir;
@@ -18,6 +18,10 @@
 #include <QDir>
 #include <SNAPQApplication.h>
 #include <QDeadlineTimer>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
 
 
 #include "SNAPQtCommon.h"
@@ -77,8 +81,14 @@ SNAPTestQt::LaunchTest(std::string test)
     application_exit(SUCCESS);
     }
 
+  // Benchmark scenarios are kept apart from the tests
+  m_TestId = test;
+  QString script = from_utf8(test);
+  if(m_BenchmarkMode && !QFileInfo(script).isReadable())
+    script = QString(":/scripts/Scripts/bench_%1.js").arg(script);
+
   // Create and run the thread
-  m_Worker = new TestWorker(this, from_utf8(test), m_ScriptEngine, m_Acceleration);
+  m_Worker = new TestWorker(this, script, m_ScriptEngine, m_Acceleration);
 
   connect(m_Worker, SIGNAL(finished()), m_Worker, SLOT(deleteLater()));
 
@@ -244,6 +254,163 @@ void SNAPTestQt::sleep(int milli_sec)
   TestWorker::sleep_ms(ms_actual);
 }
 
+void SNAPTestQt::mark(QString name)
+{
+  m_Marks[name] = SNAPProfiler::ClockType::now();
+}
+
+double SNAPTestQt::measure(QString name, QString fromMark)
+{
+  auto it = m_Marks.find(fromMark);
+  if(it == m_Marks.end())
+    {
+    testFailed(QString("No mark named %1").arg(fromMark));
+    return 0.0;
+    }
+
+  double ms = std::chrono::duration<double, std::milli>(
+        SNAPProfiler::ClockType::now() - it->second).count();
+  GetMeasurement(name, false).Samples.push_back(ms);
+  return ms;
+}
+
+void SNAPTestQt::beginFrames(QString name)
+{
+  if(!SNAPProfiler::IsEnabled())
+    qWarning() << "Frame times are only recorded with --profile or --benchmark";
+  m_FrameStarts[name] = SNAPProfiler::ClockType::now();
+}
+
+int SNAPTestQt::endFrames(QString name)
+{
+  auto it = m_FrameStarts.find(name);
+  if(it == m_FrameStarts.end())
+    {
+    testFailed(QString("Frame capture %1 was not started").arg(name));
+    return 0;
+    }
+
+  // The frames are timed by the render windows, see QtVTKRenderWindowBox
+  Measurement &m = GetMeasurement(name, true);
+  std::vector<double> frames = SNAPProfiler::GetTimings("Frame", it->second);
+  m.Samples.insert(m.Samples.end(), frames.begin(), frames.end());
+  m.Elapsed += std::chrono::duration<double>(
+        SNAPProfiler::ClockType::now() - it->second).count();
+  m_FrameStarts.erase(it);
+  return (int) frames.size();
+}
+
+void SNAPTestQt::settle()
+{
+  // The script runs in the worker thread, so this blocks until the GUI thread
+  // gets to the call, i.e., after the events posted before it
+  if(QThread::currentThread() == this->thread())
+    handlePostedEvents();
+  else
+    QMetaObject::invokeMethod(this, "handlePostedEvents", Qt::BlockingQueuedConnection);
+}
+
+void SNAPTestQt::handlePostedEvents()
+{
+  // Repaints requested while handling the events are posted in turn
+  QCoreApplication::sendPostedEvents();
+  QCoreApplication::sendPostedEvents();
+}
+
+SNAPTestQt::Measurement &SNAPTestQt::GetMeasurement(QString name, bool frames)
+{
+  for(auto &m : m_Measurements)
+    if(m.Name == name)
+      return m;
+
+  m_Measurements.push_back(Measurement());
+  m_Measurements.back().Name = name;
+  m_Measurements.back().IsFrames = frames;
+  return m_Measurements.back();
+}
+
+double SNAPTestQt::Percentile(const std::vector<double> &sorted, double p)
+{
+  // Nearest rank
+  if(sorted.empty())
+    return 0.0;
+  long rank = (long) std::ceil(p * 0.01 * sorted.size());
+  return sorted[std::min((long) sorted.size(), std::max(1l, rank)) - 1];
+}
+
+void SNAPTestQt::report()
+{
+  for(const auto &m : m_Measurements)
+    {
+    std::vector<double> s = m.Samples;
+    std::sort(s.begin(), s.end());
+    qDebug() << QString("%1: n = %2, p50 = %3 ms, p95 = %4 ms, max = %5 ms")
+                .arg(m.Name).arg(s.size()).arg(Percentile(s, 50))
+                .arg(Percentile(s, 95)).arg(Percentile(s, 100));
+    }
+}
+
+void SNAPTestQt::SetBenchmarkMode(std::string fnOutput)
+{
+  m_BenchmarkMode = true;
+  m_BenchmarkOutput = fnOutput;
+}
+
+bool SNAPTestQt::WriteBenchmarkResults()
+{
+  std::ofstream fout;
+  if(m_BenchmarkOutput.size())
+    {
+    fout.open(m_BenchmarkOutput.c_str());
+    if(!fout.good())
+      {
+      qWarning() << "Unable to write benchmark results to" << from_utf8(m_BenchmarkOutput);
+      return false;
+      }
+    }
+  std::ostream &os = m_BenchmarkOutput.size() ? fout : cout;
+
+  // Names come from the scripts, so quotes and backslashes are escaped
+  auto quote = [](const QString &s)
+  {
+    QString q = s;
+    q.replace("\\", "\\\\").replace("\"", "\\\"");
+    return "\"" + q.toStdString() + "\"";
+  };
+
+  os << "{" << endl;
+  os << "  \"scenario\": " << quote(from_utf8(m_TestId)) << "," << endl;
+  os << "  \"acceleration\": " << m_Acceleration << "," << endl;
+  os << "  \"unit\": \"ms\"," << endl;
+  os << "  \"measurements\": [" << endl;
+  for(size_t k = 0; k < m_Measurements.size(); k++)
+    {
+    const Measurement &m = m_Measurements[k];
+    std::vector<double> s = m.Samples;
+    std::sort(s.begin(), s.end());
+    double mean = 0.0;
+    for(double x : s)
+      mean += x / s.size();
+
+    os << "    { \"name\": " << quote(m.Name)
+       << ", \"kind\": \"" << (m.IsFrames ? "frames" : "latency") << "\""
+       << ", \"count\": " << s.size()
+       << ", \"mean\": " << mean
+       << ", \"p50\": " << Percentile(s, 50)
+       << ", \"p90\": " << Percentile(s, 90)
+       << ", \"p95\": " << Percentile(s, 95)
+       << ", \"p99\": " << Percentile(s, 99)
+       << ", \"max\": " << Percentile(s, 100);
+    if(m.IsFrames)
+      os << ", \"fps\": " << (m.Elapsed > 0.0 ? s.size() / m.Elapsed : 0.0);
+    os << " }" << (k + 1 < m_Measurements.size() ? "," : "") << endl;
+    }
+  os << "  ]" << endl;
+  os << "}" << endl;
+
+  return os.good();
+}
+
 void SNAPTestQt::validateFloatValue(double v1, double v2, double precision)
 {
   // Validation involves checking if the values are equal. If not,
@@ -298,13 +465,25 @@ void SNAPTestQt::postMouseEvent(QObject *object, double rel_x, double rel_y, QSt
     else if(button == "middle")
       btn = Qt::MiddleButton;
 
+    // A move event has no button of its own, but the button is held down
     QEvent::Type type = QEvent::None;
+    Qt::MouseButton evbtn = btn;
     if(eventType == "press")
       type = QEvent::MouseButtonPress;
     else if(eventType == "release")
       type = QEvent::MouseButtonRelease;
+    else if(eventType == "move")
+      {
+      type = QEvent::MouseMove;
+      evbtn = Qt::NoButton;
+      }
+
+    if(type == QEvent::None)
+      return;
 
-    QMouseEvent *event = new QMouseEvent(QEvent::MouseButtonPress, point, btn, btn, Qt::NoModifier);
+    // On release, the button is no longer held down
+    Qt::MouseButtons buttons = (type == QEvent::MouseButtonRelease) ? Qt::NoButton : btn;
+    QMouseEvent *event = new QMouseEvent(type, point, evbtn, buttons, Qt::NoModifier);
     QApplication::postEvent(widget, event);
     }
 }
@@ -331,14 +510,15 @@ void SNAPTestQt::postKeyEvent(QObject *object, QString key)
 SNAPTestQt::ReturnCode
 SNAPTestQt::ListTests()
 {
+  QString prefix = m_BenchmarkMode ? "bench_" : "test_";
   QDir script_dir(":/scripts/Scripts");
-  QStringList filters; filters << "test_*.js";
+  QStringList filters; filters << prefix + "*.js";
   script_dir.setNameFilters(filters);
   QStringList files = script_dir.entryList();
 
-  QRegularExpression rx("test_(.*).js");
+  QRegularExpression rx(prefix + "(.*).js");
 
-  cout << "Available Tests" << endl;
+  cout << (m_BenchmarkMode ? "Available Benchmarks" : "Available Tests") << endl;
   foreach(const QString &test, files)
     {
     auto rm = rx.match(test);
@@ -454,6 +634,12 @@ void TestWorker::source(QString script_url)
   else
     {
     qWarning() << "Successfully completed test script:" << rc.toString();
-    SNAPTestQt::application_exit(SNAPTestQt::SUCCESS);
+
+    // Benchmarks report their timings once the whole scenario has run
+    SNAPTestQt *tester = qobject_cast<SNAPTestQt *>(this->parent());
+    if(tester && tester->IsBenchmarkMode() && !tester->WriteBenchmarkResults())
+      SNAPTestQt::application_exit(SNAPTestQt::UNKNOWN_ERROR);
+    else
+      SNAPTestQt::application_exit(SNAPTestQt::SUCCESS);
     }
 }
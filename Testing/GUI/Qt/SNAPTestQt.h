@@ -2,12 +2,15 @@
 #define SNAPTESTQT_H
 
 #include <SNAPCommon.h>
+#include <SNAPProfiler.h>
 #include <QObject>
 #include <QTimer>
 #include <QStringList>
 #include <QThread>
 #include <QVariant>
 #include <QModelIndex>
+#include <map>
+#include <vector>
 
 class MainImageWindow;
 class GlobalUIModel;
@@ -70,6 +73,17 @@ public:
 
   void LaunchTest(std::string test);
 
+  /**
+   * Run benchmark scenarios (bench_*.js) instead of tests. The timings taken
+   * by the script are written as JSON to the given file, or to the standard
+   * output if the filename is empty, when the script completes.
+   */
+  void SetBenchmarkMode(std::string fnOutput);
+  bool IsBenchmarkMode() const { return m_BenchmarkMode; }
+
+  /** Write the timings taken by the script as JSON */
+  bool WriteBenchmarkResults();
+
 public slots:
 
   // Find a child of an object visible to the script
@@ -108,12 +122,56 @@ public slots:
 
   void sleep(int milli_sec);
 
+  // Record the current time under a name
+  void mark(QString name);
+
+  // Add the time elapsed since a mark (ms) to the samples of a measurement
+  double measure(QString name, QString fromMark);
+
+  // Collect the times of the frames rendered between the two calls
+  void beginFrames(QString name);
+  int endFrames(QString name);
+
+  // Wait until the GUI thread has handled the events posted so far, so that
+  // a measurement includes the updates that an action triggers
+  void settle();
+
+  // Print the percentiles of the measurements taken so far
+  void report();
+
   static void application_exit(int rc);
 
+protected slots:
+
+  void handlePostedEvents();
+
 protected:
 
   ReturnCode ListTests();
 
+  typedef SNAPProfiler::TimePoint TimePoint;
+
+  // Samples of a latency or frame time measurement, in milliseconds
+  struct Measurement
+  {
+    QString Name;
+    bool IsFrames = false;
+    std::vector<double> Samples;
+
+    // Time over which frames were collected, in seconds
+    double Elapsed = 0.0;
+  };
+
+  Measurement &GetMeasurement(QString name, bool frames);
+  static double Percentile(const std::vector<double> &sorted, double p);
+
+  // Benchmark mode and timings, only used by the worker thread
+  bool m_BenchmarkMode = false;
+  std::string m_BenchmarkOutput;
+  std::string m_TestId;
+  std::map<QString, TimePoint> m_Marks, m_FrameStarts;
+  std::vector<Measurement> m_Measurements;
+
   // The data directory for testing
   std::string m_DataDir;
 
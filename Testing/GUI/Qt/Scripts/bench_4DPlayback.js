@@ -0,0 +1,31 @@
+// Read the function library
+include("Library");
+
+//=== Open the 4D test workspace
+openWorkspace("img4d_11f.itksnap");
+
+//=== Step through the time points
+var inT = engine.findChild(mainwin, "inCursorT_4D");
+engine.beginFrames("TimePointStepFrames");
+for (let r = 0; r < 3; r++) {
+    for (let t = inT.minimum; t <= inT.maximum; t++) {
+        engine.mark("timepoint");
+        inT.value = t;
+        engine.settle();
+        engine.measure("TimePointStep", "timepoint");
+    }
+}
+engine.endFrames("TimePointStepFrames");
+
+//=== Replay the time points from the layer inspector
+engine.findChild(mainwin, "actionLayerInspector").trigger();
+var grp4D = engine.findChild(mainwin, "grp4DProperties");
+var btnReplay = engine.findChild(grp4D, "btn4DReplay");
+engine.findChild(grp4D, "in4DReplayInterval").text = "20"
+engine.beginFrames("PlaybackFrames");
+btnReplay.click();
+engine.sleep(3000);
+btnReplay.click();
+engine.endFrames("PlaybackFrames");
+
+engine.report();
@@ -0,0 +1,36 @@
+// Read the function library
+include("Library");
+
+//=== Open the test image
+openMainImage("MRIcrop-orig.gipl.gz");
+
+//=== Show the contrast page of the layer inspector
+engine.findChild(mainwin,"actionLayerInspector").trigger();
+var layerdialog = engine.findChild(mainwin,"dlgLayerInspector");
+var cmpcontrast = engine.findChild(layerdialog, "cmpContrast");
+engine.findChild(layerdialog, "tabWidget").setCurrentWidget(cmpcontrast);
+
+//=== Drag the level and the window back and forth
+var inLevel = engine.findChild(cmpcontrast, "inLevel");
+var inWindow = engine.findChild(cmpcontrast, "inWindow");
+var level = inLevel.value, window = inWindow.value;
+engine.beginFrames("ContrastDragFrames");
+for (let i = 0; i < 50; i++) {
+    let f = 0.2 * Math.sin(i * Math.PI / 10);
+    engine.mark("contrast");
+    inLevel.value = level + f * window;
+    engine.settle();
+    engine.measure("ContrastDragLevel", "contrast");
+    engine.mark("contrast");
+    inWindow.value = window * (1.0 + f);
+    engine.settle();
+    engine.measure("ContrastDragWindow", "contrast");
+}
+engine.endFrames("ContrastDragFrames");
+
+//=== Restore the contrast and close the inspector
+inLevel.value = level;
+inWindow.value = window;
+engine.invoke(layerdialog, "close");
+
+engine.report();
@@ -0,0 +1,31 @@
+// Read the function library
+include("Library");
+
+//=== Open the test image
+openMainImage("MRIcrop-orig.gipl.gz");
+
+//=== Show the axial view only and select the paintbrush
+engine.findChild(mainwin, "btnAxial").click();
+var panel0 = engine.findChild(mainwin,"panel0");
+var sliceView = engine.findChild(engine.findChild(panel0, "sliceView"), "internalWidget");
+engine.findChild(mainwin,"actionPaintbrush").trigger();
+
+//=== Paint strokes across the slice
+for (let s = 0; s < 5; s++) {
+    let y = 0.3 + 0.1 * s;
+    engine.beginFrames("PaintStrokeFrames");
+    engine.mark("stroke");
+    engine.postMouseEvent(sliceView, 0.2, y, "press", "left");
+    for (let i = 1; i <= 40; i++) {
+        engine.mark("move");
+        engine.postMouseEvent(sliceView, 0.2 + 0.015 * i, y, "move", "left");
+        engine.settle();
+        engine.measure("PaintStrokeMove", "move");
+    }
+    engine.postMouseEvent(sliceView, 0.8, y, "release", "left");
+    engine.settle();
+    engine.measure("PaintStroke", "stroke");
+    engine.endFrames("PaintStrokeFrames");
+}
+
+engine.report();
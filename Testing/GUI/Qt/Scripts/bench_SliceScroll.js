@@ -0,0 +1,23 @@
+// Read the function library
+include("Library");
+
+//=== Open the test image
+openMainImage("MRIcrop-orig.gipl.gz");
+
+//=== Sweep through the slices along each axis
+var fields = ["inCursorX", "inCursorY", "inCursorZ"];
+for (let d = 0; d < 3; d++) {
+    let input = engine.findChild(mainwin, fields[d]);
+    let center = input.value;
+    engine.beginFrames("SliceScrollFrames");
+    for (let k = input.minimum; k <= input.maximum; k++) {
+        engine.mark("slice");
+        input.value = k;
+        engine.settle();
+        engine.measure("SliceScroll", "slice");
+    }
+    engine.endFrames("SliceScrollFrames");
+    input.value = center;
+}
+
+engine.report();
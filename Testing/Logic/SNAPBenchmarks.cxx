@@ -0,0 +1,360 @@
+/**
+ * Headless benchmarks for the hot paths of the logic layer: slicing and
+ * display mapping during cursor sweeps, contrast changes, segmentation
+ * statistics, mesh extraction, undo/redo and project loading.
+ *
+ * The benchmarks run on a synthetic grey image and segmentation of a given
+ * size, or on real images passed on the command line. The timings are
+ * written as JSON so that they can be compared between releases.
+ */
+#include "IRISApplication.h"
+#include "IRISException.h"
+#include "ImageIODelegates.h"
+#include "GenericImageData.h"
+#include "GlobalState.h"
+#include "LayerIterator.h"
+#include "ImageWrapperBase.h"
+#include "LabelImageWrapper.h"
+#include "DisplayMappingPolicy.h"
+#include "IntensityCurveInterface.h"
+#include "SegmentationStatistics.h"
+#include "SegmentationUpdateIterator.h"
+#include "MultiLabelMeshPipeline.h"
+#include "CommandLineArgumentParser.h"
+#include "DummySystemInfoDelegate.h"
+
+#include <itkImage.h>
+#include <itkImageFileWriter.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkTimeProbe.h>
+#include <itkMultiThreaderBase.h>
+#include <itksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <list>
+
+using namespace std;
+
+/** Timing of one benchmark */
+struct BenchmarkResult
+{
+  string Name;
+  itk::TimeProbe Probe;
+};
+
+/** Runs the benchmarks against an IRISApplication and collects the timings */
+class BenchmarkSuite
+{
+public:
+  BenchmarkSuite(IRISApplication *app, unsigned int repeats)
+    : m_App(app), m_Repeats(repeats) {}
+
+  /** Time a piece of code. Each call to it counts as one sample */
+  itk::TimeProbe &Probe(const string &name)
+  {
+    for(auto &r : m_Results)
+      if(r.Name == name)
+        return r.Probe;
+    m_Results.push_back(BenchmarkResult());
+    m_Results.back().Name = name;
+    return m_Results.back().Probe;
+  }
+
+  void Time(const string &name, const std::function<void()> &code)
+  {
+    itk::TimeProbe &probe = this->Probe(name);
+    probe.Start();
+    code();
+    probe.Stop();
+  }
+
+  /** Bring the display slices of all layers up to date */
+  void UpdateDisplaySlices()
+  {
+    for(LayerIterator it = m_App->GetCurrentImageData()->GetLayers(); !it.IsAtEnd(); ++it)
+      for(unsigned int d = 0; d < 3; d++)
+        it.GetLayer()->GetDisplaySlice(d)->Update();
+  }
+
+  /** Move the cursor through every slice along each axis */
+  void RunCursorSweep()
+  {
+    Vector3ui size = m_App->GetCurrentImageData()->GetMain()->GetSize();
+    Vector3ui center = size / 2u;
+    const char *names[] = { "CursorSweepX", "CursorSweepY", "CursorSweepZ" };
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      for(unsigned int k = 0; k < size[d]; k++)
+        {
+        Vector3ui cursor = center;
+        cursor[d] = k;
+        this->Time(names[d], [this, cursor]()
+        {
+          m_App->SetCursorPosition(cursor);
+          this->UpdateDisplaySlices();
+        });
+        }
+      }
+    m_App->SetCursorPosition(center);
+  }
+
+  /** Drag the middle control point of the contrast curve back and forth */
+  void RunContrastChanges()
+  {
+    ImageWrapperBase *main = m_App->GetCurrentImageData()->GetMain();
+    IntensityCurveInterface *curve = main->GetDisplayMapping()->GetIntensityCurve();
+    if(!curve || curve->GetControlPointCount() < 3)
+      return;
+
+    double t0, x0, t1, x1, t2, x2;
+    curve->GetControlPoint(0, t0, x0);
+    curve->GetControlPoint(1, t1, x1);
+    curve->GetControlPoint(2, t2, x2);
+    for(unsigned int i = 0; i < 20 * m_Repeats; i++)
+      {
+      double t = t0 + (t2 - t0) * (i % 2 ? 0.4 : 0.6);
+      this->Time("ContrastChange", [this, curve, t, x1]()
+      {
+        curve->UpdateControlPoint(1, t, x1);
+        this->UpdateDisplaySlices();
+      });
+      }
+    curve->UpdateControlPoint(1, t1, x1);
+  }
+
+  /** Make undoable edits and compute statistics and meshes after each */
+  void RunEdits()
+  {
+    LabelImageWrapper *seg = m_App->GetSelectedSegmentationLayer();
+    Vector3ui size = seg->GetSize();
+
+    // Statistics and meshes from scratch
+    SegmentationStatistics stats;
+    this->Time("SegmentationStatistics", [&]() { stats.Compute(m_App); });
+
+    SmartPtr<MultiLabelMeshPipeline> mesher = MultiLabelMeshPipeline::New();
+    mesher->SetMeshOptions(m_App->GetGlobalState()->GetMeshOptions());
+    mesher->SetImage(seg->GetImage());
+    this->Time("UpdateMeshes", [&]() { mesher->UpdateMeshes(NULL); });
+
+    // Paint cubes along the diagonal of the image
+    unsigned int nEdits = 5 * m_Repeats;
+    for(unsigned int i = 0; i < nEdits; i++)
+      {
+      SegmentationUpdateIterator::RegionType region;
+      for(unsigned int d = 0; d < 3; d++)
+        {
+        unsigned int w = std::max(size[d] / 8, 1u);
+        region.SetIndex(d, (size[d] - w) * (i + 1) / (nEdits + 1));
+        region.SetSize(d, w);
+        }
+
+      this->Time("SegmentationEdit", [&]()
+      {
+        SegmentationUpdateIterator it(seg, region, 1 + i % 6, DrawOverFilter());
+        for(; !it.IsAtEnd(); ++it)
+          it.PaintAsForeground();
+        it.Finalize("Benchmark edit");
+      });
+
+      this->Time("SegmentationStatisticsAfterEdit", [&]() { stats.Compute(m_App); });
+      this->Time("UpdateMeshesAfterEdit", [&]() { mesher->UpdateMeshes(NULL); });
+      }
+
+    // Walk the undo history back and forth
+    for(unsigned int i = 0; i < nEdits && m_App->IsUndoPossible(); i++)
+      this->Time("Undo", [this]() { m_App->Undo(); });
+    for(unsigned int i = 0; i < nEdits && m_App->IsRedoPossible(); i++)
+      this->Time("Redo", [this]() { m_App->Redo(); });
+  }
+
+  /** Save a project and time reloading it */
+  void RunProjectLoad(const string &fnProject)
+  {
+    m_App->SaveProject(fnProject);
+    for(unsigned int i = 0; i < m_Repeats; i++)
+      {
+      m_App->UnloadMainImage();
+      this->Time("ProjectLoad", [&]()
+      {
+        IRISWarningList wl;
+        m_App->OpenProject(fnProject, wl);
+        this->UpdateDisplaySlices();
+      });
+      }
+  }
+
+  /** Write the results as JSON */
+  void WriteJSON(ostream &os, const Vector3ui &size)
+  {
+    os << "{" << endl;
+    os << "  \"size\": [" << size[0] << ", " << size[1] << ", " << size[2] << "]," << endl;
+    os << "  \"threads\": " << itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads() << "," << endl;
+    os << "  \"unit\": \"s\"," << endl;
+    os << "  \"benchmarks\": [" << endl;
+    unsigned int k = 0;
+    for(auto &r : m_Results)
+      {
+      os << "    { \"name\": \"" << r.Name << "\""
+         << ", \"count\": " << r.Probe.GetNumberOfStops()
+         << ", \"total\": " << r.Probe.GetTotal()
+         << ", \"mean\": " << r.Probe.GetMean()
+         << ", \"min\": " << r.Probe.GetMinimum()
+         << ", \"max\": " << r.Probe.GetMaximum()
+         << ", \"stddev\": " << r.Probe.GetStandardDeviation() << " }"
+         << (++k < m_Results.size() ? "," : "") << endl;
+      }
+    os << "  ]" << endl;
+    os << "}" << endl;
+  }
+
+private:
+  IRISApplication *m_App;
+  unsigned int m_Repeats;
+  std::list<BenchmarkResult> m_Results;
+};
+
+/** Write a synthetic grey image (smooth blobs plus noise) and segmentation */
+void CreateSyntheticImages(unsigned int n, const string &fnGrey, const string &fnSeg)
+{
+  typedef itk::Image<short, 3> GreyImageType;
+  typedef itk::Image<unsigned short, 3> SegImageType;
+
+  GreyImageType::RegionType region;
+  region.SetSize(0, n); region.SetSize(1, n); region.SetSize(2, n);
+
+  GreyImageType::Pointer grey = GreyImageType::New();
+  grey->SetRegions(region);
+  grey->Allocate();
+
+  SegImageType::Pointer seg = SegImageType::New();
+  seg->SetRegions(region);
+  seg->Allocate();
+
+  // Labels are concentric shells around the center, as in a typical
+  // segmentation with a few large structures
+  double c = 0.5 * n;
+  unsigned int seed = 12345;
+  itk::ImageRegionIteratorWithIndex<GreyImageType> itGrey(grey, region);
+  itk::ImageRegionIteratorWithIndex<SegImageType> itSeg(seg, region);
+  for(; !itGrey.IsAtEnd(); ++itGrey, ++itSeg)
+    {
+    GreyImageType::IndexType idx = itGrey.GetIndex();
+    double x = (idx[0] - c) / c, y = (idx[1] - c) / c, z = (idx[2] - c) / c;
+    double r = std::sqrt(x * x + y * y + z * z);
+    seed = seed * 1103515245 + 12345;
+    double noise = ((seed >> 16) & 0xff) - 128.0;
+    itGrey.Set((short)(1000 * std::cos(4 * x) * std::cos(3 * y) * std::cos(2 * z) + noise));
+    itSeg.Set(r < 0.8 ? (unsigned short)(1 + (int)(r * 7.5)) : 0);
+    }
+
+  typedef itk::ImageFileWriter<GreyImageType> GreyWriterType;
+  GreyWriterType::Pointer wGrey = GreyWriterType::New();
+  wGrey->SetInput(grey);
+  wGrey->SetFileName(fnGrey);
+  wGrey->Update();
+
+  typedef itk::ImageFileWriter<SegImageType> SegWriterType;
+  SegWriterType::Pointer wSeg = SegWriterType::New();
+  wSeg->SetInput(seg);
+  wSeg->SetFileName(fnSeg);
+  wSeg->Update();
+}
+
+int usage(const char *program)
+{
+  cout << "Usage: " << program << " [options]" << endl;
+  cout << "Options:" << endl;
+  cout << "   --size N          : Size of the synthetic volume (default 128)" << endl;
+  cout << "   --grey FILE       : Use a real grey image instead of a synthetic one" << endl;
+  cout << "   --seg FILE        : Use a real segmentation image" << endl;
+  cout << "   --repeats N       : Number of repetitions of each benchmark (default 3)" << endl;
+  cout << "   --tempdir DIR     : Directory for the synthetic images and the project" << endl;
+  cout << "   --output FILE     : Write the JSON results to FILE instead of stdout" << endl;
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  CommandLineArgumentParser parser;
+  parser.AddOption("--help", 0);
+  parser.AddSynonim("--help", "-h");
+  parser.AddOption("--size", 1);
+  parser.AddOption("--grey", 1);
+  parser.AddOption("--seg", 1);
+  parser.AddOption("--repeats", 1);
+  parser.AddOption("--tempdir", 1);
+  parser.AddOption("--output", 1);
+
+  CommandLineArgumentParseResult parseResult;
+  if(!parser.TryParseCommandLine(argc, argv, parseResult, true)
+     || parseResult.IsOptionPresent("--help"))
+    return usage(argv[0]);
+
+  unsigned int size = parseResult.IsOptionPresent("--size")
+                      ? atoi(parseResult.GetOptionParameter("--size")) : 128;
+  unsigned int repeats = parseResult.IsOptionPresent("--repeats")
+                         ? atoi(parseResult.GetOptionParameter("--repeats")) : 3;
+  string tempdir = parseResult.IsOptionPresent("--tempdir")
+                   ? parseResult.GetOptionParameter("--tempdir")
+                   : itksys::SystemTools::GetCurrentWorkingDirectory();
+
+  DummySystemInfoDelegate sidel(argv[0]);
+  SystemInterface::SetSystemInfoDelegate(&sidel);
+
+  try
+    {
+    // Use the real images or make synthetic ones
+    string fnGrey = tempdir + "/snap_benchmark_grey.nii";
+    string fnSeg = tempdir + "/snap_benchmark_seg.nii";
+    if(parseResult.IsOptionPresent("--grey"))
+      {
+      fnGrey = parseResult.GetOptionParameter("--grey");
+      fnSeg = parseResult.IsOptionPresent("--seg")
+              ? parseResult.GetOptionParameter("--seg") : string();
+      }
+    else
+      {
+      CreateSyntheticImages(size, fnGrey, fnSeg);
+      }
+
+    IRISApplication::Pointer app = IRISApplication::New();
+    IRISWarningList wl;
+    BenchmarkSuite suite(app, repeats);
+
+    suite.Time("LoadMainImage", [&]() { app->OpenImage(fnGrey.c_str(), MAIN_ROLE, wl); });
+    if(fnSeg.size())
+      suite.Time("LoadSegmentation", [&]() { app->OpenImage(fnSeg.c_str(), LABEL_ROLE, wl); });
+
+    suite.RunCursorSweep();
+    suite.RunContrastChanges();
+    suite.RunEdits();
+
+    Vector3ui dims = app->GetCurrentImageData()->GetMain()->GetSize();
+    suite.RunProjectLoad(tempdir + "/snap_benchmark.itksnap");
+
+    // Report the results
+    if(parseResult.IsOptionPresent("--output"))
+      {
+      ofstream fout(parseResult.GetOptionParameter("--output"));
+      suite.WriteJSON(fout, dims);
+      }
+    else
+      {
+      suite.WriteJSON(cout, dims);
+      }
+
+    app->UnloadMainImage();
+    }
+  catch(std::exception &exc)
+    {
+    cerr << "Benchmark failed: " << exc.what() << endl;
+    return -1;
+    }
+
+  return 0;
+}
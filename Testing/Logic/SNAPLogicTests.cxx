@@ -0,0 +1,1072 @@
+/**
+ * Behavioral tests of the logic layer. The tests run on small synthetic
+ * images and check the results of the optimized code paths against the
+ * results that the straightforward implementation would give.
+ *
+ * Each test is run by name, with a directory for the temporary files:
+ *
+ *   snap_logic_tests TestName tempdir
+ */
+#include "IRISApplication.h"
+#include "IRISException.h"
+#include "GenericImageData.h"
+#include "LabelImageWrapper.h"
+#include "SegmentationUpdateIterator.h"
+#include "SegmentationStatistics.h"
+#include "MemoryAccounting.h"
+#include "RLEImageRegionIterator.h"
+#include "RLERegionOfInterestImageFilter.h"
+#include "RLEConnectedComponents.h"
+#include "Registry.h"
+#include "itkZarrImageIO.h"
+#include "SNAPLevelSetDriver.h"
+#include "DummySystemInfoDelegate.h"
+
+#include <itkImage.h>
+#include <itkImageFileWriter.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkImageFileReader.h>
+#include <itksys/SystemTools.hxx>
+#include <itk_zlib.h>
+#include <itkMultiThreaderBase.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+/** Fail the current test if a condition does not hold */
+#define SNAP_TEST_ASSERT(cond) \
+  do { if(!(cond)) throw IRISException("Line %d: assertion failed: %s", __LINE__, #cond); } while(0)
+
+typedef itk::Image<short, 3> GreyImageType;
+typedef itk::Image<unsigned short, 3> SegImageType;
+typedef LabelImageWrapper::ImageType LabelImageType;
+
+/** A copy of the voxels of a segmentation, in raster order */
+typedef std::vector<LabelType> LabelVoxels;
+
+/** Write a synthetic grey image and a segmentation with a few labels */
+void CreateSyntheticImages(unsigned int n, const string &fnGrey, const string &fnSeg)
+{
+  GreyImageType::RegionType region;
+  region.SetSize(0, n); region.SetSize(1, n); region.SetSize(2, n);
+
+  GreyImageType::Pointer grey = GreyImageType::New();
+  grey->SetRegions(region);
+  grey->Allocate();
+
+  SegImageType::Pointer seg = SegImageType::New();
+  seg->SetRegions(region);
+  seg->Allocate();
+
+  // Labels are concentric shells around the center
+  double c = 0.5 * n;
+  itk::ImageRegionIteratorWithIndex<GreyImageType> itGrey(grey, region);
+  itk::ImageRegionIteratorWithIndex<SegImageType> itSeg(seg, region);
+  for(; !itGrey.IsAtEnd(); ++itGrey, ++itSeg)
+    {
+    GreyImageType::IndexType idx = itGrey.GetIndex();
+    double x = (idx[0] - c) / c, y = (idx[1] - c) / c, z = (idx[2] - c) / c;
+    double r = std::sqrt(x * x + y * y + z * z);
+    itGrey.Set((short)(1000 * std::cos(4 * x) * std::cos(3 * y) * std::cos(2 * z)));
+    itSeg.Set(r < 0.6 ? (unsigned short)(1 + (int)(r * 5)) : 0);
+    }
+
+  typedef itk::ImageFileWriter<GreyImageType> GreyWriterType;
+  GreyWriterType::Pointer wGrey = GreyWriterType::New();
+  wGrey->SetInput(grey);
+  wGrey->SetFileName(fnGrey);
+  wGrey->Update();
+
+  typedef itk::ImageFileWriter<SegImageType> SegWriterType;
+  SegWriterType::Pointer wSeg = SegWriterType::New();
+  wSeg->SetInput(seg);
+  wSeg->SetFileName(fnSeg);
+  wSeg->Update();
+}
+
+/** Load the synthetic images into an application */
+IRISApplication::Pointer LoadSyntheticImages(const string &tempdir, unsigned int n)
+{
+  string fnGrey = tempdir + "/snap_logic_test_grey.nii";
+  string fnSeg = tempdir + "/snap_logic_test_seg.nii";
+  CreateSyntheticImages(n, fnGrey, fnSeg);
+
+  IRISApplication::Pointer app = IRISApplication::New();
+  IRISWarningList wl;
+  app->OpenImage(fnGrey.c_str(), MAIN_ROLE, wl);
+  app->OpenImage(fnSeg.c_str(), LABEL_ROLE, wl);
+  return app;
+}
+
+/** Copy the voxels of an image, in raster order */
+template <class TImage>
+LabelVoxels GetVoxels(TImage *image)
+{
+  LabelVoxels voxels;
+  voxels.reserve(image->GetBufferedRegion().GetNumberOfPixels());
+  itk::ImageRegionConstIterator<TImage> it(image, image->GetBufferedRegion());
+  for(; !it.IsAtEnd(); ++it)
+    voxels.push_back(it.Get());
+  return voxels;
+}
+
+/** Copy the voxels of a segmentation */
+LabelVoxels GetVoxels(LabelImageWrapper *seg)
+{
+  return GetVoxels(seg->GetImage());
+}
+
+/** A cube of the given width centered at a voxel */
+itk::ImageRegion<3> CubeRegion(const itk::Index<3> &center, unsigned int w)
+{
+  itk::ImageRegion<3> region;
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    region.SetIndex(d, center[d] - (long) w / 2);
+    region.SetSize(d, w);
+    }
+  return region;
+}
+
+/**
+ * Make a series of edits, some over the whole image that only change a
+ * small ball (so that the undo deltas are split into tiles), then walk the
+ * undo history back and forth after compressing and spilling it. Each undo
+ * and redo must give back the voxels of the matching edit exactly.
+ */
+void TestUndoRedo(const string &tempdir)
+{
+  IRISApplication::Pointer app = LoadSyntheticImages(tempdir, 64);
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+  itk::ImageRegion<3> whole = seg->GetImage()->GetBufferedRegion();
+
+  std::vector<LabelVoxels> states;
+  states.push_back(GetVoxels(seg));
+
+  unsigned int nEdits = 12;
+  for(unsigned int i = 0; i < nEdits; i++)
+    {
+    itk::Index<3> center;
+    for(unsigned int d = 0; d < 3; d++)
+      center[d] = 8 + (i * (11 + 7 * d)) % 48;
+    LabelType label = (LabelType)(1 + i % 5);
+
+    if(i % 2)
+      {
+      SegmentationUpdateIterator it(seg, CubeRegion(center, 5 + i), label, DrawOverFilter());
+      for(; !it.IsAtEnd(); ++it)
+        it.PaintAsForeground();
+      it.Finalize("Cube");
+      }
+    else
+      {
+      SegmentationUpdateIterator it(seg, whole, label, DrawOverFilter());
+      for(; !it.IsAtEnd(); ++it)
+        {
+        itk::Index<3> idx = it.GetIndex();
+        long r2 = 0;
+        for(unsigned int d = 0; d < 3; d++)
+          r2 += (idx[d] - center[d]) * (idx[d] - center[d]);
+        if(r2 <= 16)
+          it.PaintAsForeground();
+        }
+      it.Finalize("Ball");
+      }
+
+    states.push_back(GetVoxels(seg));
+    SNAP_TEST_ASSERT(states.back() != states[states.size() - 2]);
+    }
+
+  // Compress and spill the undo history by running short of memory
+  MemoryAccounting *ma = MemoryAccounting::GetInstance();
+  size_t budget = ma->GetBudget();
+  ma->SetBudget(1);
+  ma->EnforceBudget();
+  ma->SetBudget(budget);
+
+  for(unsigned int i = nEdits; i > 0; i--)
+    {
+    SNAP_TEST_ASSERT(app->IsUndoPossible());
+    app->Undo();
+    SNAP_TEST_ASSERT(GetVoxels(seg) == states[i - 1]);
+    }
+  SNAP_TEST_ASSERT(!app->IsUndoPossible());
+
+  for(unsigned int i = 1; i <= nEdits; i++)
+    {
+    SNAP_TEST_ASSERT(app->IsRedoPossible());
+    app->Redo();
+    SNAP_TEST_ASSERT(GetVoxels(seg) == states[i]);
+    }
+  SNAP_TEST_ASSERT(!app->IsRedoPossible());
+}
+
+/**
+ * Edit the lines of an RLE image that share their runs with the lines of a
+ * copy of the image, and with other lines of the same image, and check
+ * that the lines they are shared with keep their voxels.
+ */
+void TestRLESharedLines(const string &)
+{
+  // An image whose z-slices repeat, with uniform and multi-run lines
+  typedef itk::Image<LabelType, 3> PlainImageType;
+  PlainImageType::RegionType region;
+  region.SetSize(0, 40); region.SetSize(1, 6); region.SetSize(2, 5);
+  PlainImageType::Pointer plain = PlainImageType::New();
+  plain->SetRegions(region);
+  plain->Allocate();
+  itk::ImageRegionIteratorWithIndex<PlainImageType> itPlain(plain, region);
+  for(; !itPlain.IsAtEnd(); ++itPlain)
+    {
+    PlainImageType::IndexType idx = itPlain.GetIndex();
+    itPlain.Set(idx[1] < 2 ? 0 : (LabelType)((idx[0] / (3 + idx[1])) % 3));
+    }
+
+  typedef itk::RegionOfInterestImageFilter<PlainImageType, LabelImageType> ToRLEFilter;
+  ToRLEFilter::Pointer toRLE = ToRLEFilter::New();
+  toRLE->SetInput(plain);
+  toRLE->SetRegionOfInterest(region);
+  toRLE->Update();
+  LabelImageType::Pointer image = toRLE->GetOutput();
+  image->DisconnectPipeline();
+
+  // Lines repeated along z share their runs
+  SNAP_TEST_ASSERT(image->ShareRepeatedLines() > 0);
+  LabelImageType::BufferType::IndexType b0 = {{3, 0}}, b1 = {{3, 1}};
+  SNAP_TEST_ASSERT(image->GetBuffer()->GetPixel(b0).IsSharedWith(image->GetBuffer()->GetPixel(b1)));
+  LabelVoxels original = GetVoxels(image.GetPointer());
+
+  // A copy of the whole image shares the runs of all of its lines
+  typedef itk::RegionOfInterestImageFilter<LabelImageType, LabelImageType> CopyFilter;
+  CopyFilter::Pointer copier = CopyFilter::New();
+  copier->SetInput(image);
+  copier->SetRegionOfInterest(region);
+  copier->Update();
+  LabelImageType::Pointer copy = copier->GetOutput();
+  copy->DisconnectPipeline();
+  SNAP_TEST_ASSERT(copy->GetBuffer()->GetPixel(b1).IsSharedWith(image->GetBuffer()->GetPixel(b1)));
+  SNAP_TEST_ASSERT(GetVoxels(copy.GetPointer()) == original);
+
+  // Edit a line of the copy that is shared with two lines of the image
+  LabelImageType::IndexType i1 = {{7, 3, 1}};
+  LabelType l_old = copy->GetPixel(i1);
+  copy->SetPixel(i1, l_old + 5);
+  SNAP_TEST_ASSERT(copy->GetPixel(i1) == l_old + 5);
+  SNAP_TEST_ASSERT(GetVoxels(image.GetPointer()) == original);
+  SNAP_TEST_ASSERT(!copy->GetBuffer()->GetPixel(b1).IsSharedWith(image->GetBuffer()->GetPixel(b1)));
+  SNAP_TEST_ASSERT(copy->GetBuffer()->GetPixel(b0).IsSharedWith(image->GetBuffer()->GetPixel(b0)));
+
+  // Edit a line of the image with an iterator, leaving its sibling line in
+  // the next z-slice and the copy unchanged
+  LabelVoxels copied = GetVoxels(copy.GetPointer());
+  LabelImageType::RegionType line_region = region;
+  line_region.SetIndex(1, 3); line_region.SetSize(1, 1);
+  line_region.SetIndex(2, 0); line_region.SetSize(2, 1);
+  for(itk::ImageRegionIterator<LabelImageType> it(image, line_region); !it.IsAtEnd(); ++it)
+    it.Set(9);
+  SNAP_TEST_ASSERT(GetVoxels(copy.GetPointer()) == copied);
+
+  LabelVoxels expected = original;
+  for(unsigned int x = 0; x < 40; x++)
+    expected[x + 40 * 3] = 9;
+  SNAP_TEST_ASSERT(GetVoxels(image.GetPointer()) == expected);
+}
+
+/**
+ * Connected components of the voxels with a label, found by flood filling
+ * the voxels one at a time. Returns the component of each voxel, or -1,
+ * and the number of voxels in each component.
+ */
+std::vector<long> FloodFillComponents(const LabelVoxels &voxels, const itk::Size<3> &size,
+                                      LabelType label, bool fully_connected,
+                                      std::vector<unsigned long> &sizes)
+{
+  std::vector<long> component(voxels.size(), -1);
+  sizes.clear();
+  long nx = size[0], ny = size[1], nz = size[2];
+  for(size_t seed = 0; seed < voxels.size(); seed++)
+    {
+    if(voxels[seed] != label || component[seed] >= 0)
+      continue;
+
+    long id = sizes.size();
+    sizes.push_back(0);
+    std::queue<long> front;
+    component[seed] = id;
+    front.push(seed);
+    while(!front.empty())
+      {
+      long v = front.front();
+      front.pop();
+      sizes[id]++;
+      long x = v % nx, y = (v / nx) % ny, z = v / (nx * ny);
+      for(long dz = -1; dz <= 1; dz++)
+        for(long dy = -1; dy <= 1; dy++)
+          for(long dx = -1; dx <= 1; dx++)
+            {
+            long n_off = std::abs(dx) + std::abs(dy) + std::abs(dz);
+            if(n_off == 0 || (!fully_connected && n_off > 1))
+              continue;
+            long qx = x + dx, qy = y + dy, qz = z + dz;
+            if(qx < 0 || qy < 0 || qz < 0 || qx >= nx || qy >= ny || qz >= nz)
+              continue;
+            long q = qx + nx * (qy + ny * qz);
+            if(voxels[q] == label && component[q] < 0)
+              {
+              component[q] = id;
+              front.push(q);
+              }
+            }
+      }
+    }
+  return component;
+}
+
+/** Fill a region of a segmentation with random voxels of a label */
+void PaintRandomVoxels(LabelImageWrapper *seg, const itk::ImageRegion<3> &region,
+                       LabelType label, unsigned int percent, unsigned int seed)
+{
+  SegmentationUpdateIterator it(seg, region, label, DrawOverFilter());
+  for(; !it.IsAtEnd(); ++it)
+    {
+    seed = seed * 1103515245 + 12345;
+    if(((seed >> 16) % 100) < percent)
+      it.PaintAsForeground();
+    }
+  it.Finalize("Random voxels");
+}
+
+/**
+ * Compare the connected components found from the runs with the ones
+ * found by flood filling, on random voxels that form components of all
+ * shapes and sizes, with face and full connectivity. Then remove the small
+ * components and all but the largest one from a segmentation, which must
+ * clear exactly the voxels of these components, and undo the removal.
+ */
+void TestConnectedComponents(const string &tempdir)
+{
+  IRISApplication::Pointer app = LoadSyntheticImages(tempdir, 40);
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+  itk::ImageRegion<3> whole = seg->GetImage()->GetBufferedRegion();
+  itk::Size<3> size = whole.GetSize();
+
+  LabelType label = 7;
+  PaintRandomVoxels(seg, whole, label, 30, 12345);
+  LabelVoxels painted = GetVoxels(seg);
+
+  for(int full = 0; full < 2; full++)
+    {
+    std::vector<unsigned long> ff_sizes;
+    std::vector<long> ff = FloodFillComponents(painted, size, label, full, ff_sizes);
+
+    RLEConnectedComponents<LabelType> cc;
+    cc.Compute(seg->GetImage(), whole, label, full);
+    SNAP_TEST_ASSERT(cc.GetNumberOfComponents() == ff_sizes.size());
+    SNAP_TEST_ASSERT(ff_sizes.size() > 1);
+
+    // The components are the same sets of voxels
+    std::vector<long> cc_to_ff(cc.GetNumberOfComponents(), -1);
+    itk::ImageRegionConstIteratorWithIndex<LabelImageType> it(seg->GetImage(), whole);
+    for(size_t v = 0; !it.IsAtEnd(); ++it, ++v)
+      {
+      long c = cc.GetComponentAt(it.GetIndex());
+      SNAP_TEST_ASSERT((c < 0) == (ff[v] < 0));
+      if(c >= 0)
+        {
+        if(cc_to_ff[c] < 0)
+          cc_to_ff[c] = ff[v];
+        SNAP_TEST_ASSERT(cc_to_ff[c] == ff[v]);
+        SNAP_TEST_ASSERT(cc.GetComponentSizes()[c] == ff_sizes[ff[v]]);
+        }
+      }
+    }
+
+  // Removing the small components clears the voxels in them
+  std::vector<unsigned long> ff_sizes;
+  std::vector<long> ff = FloodFillComponents(painted, size, label, false, ff_sizes);
+  size_t n_removed = app->RemoveSmallConnectedComponents(label, 4);
+  LabelVoxels expected = painted;
+  size_t n_expected = 0;
+  for(size_t v = 0; v < expected.size(); v++)
+    {
+    if(ff[v] >= 0 && ff_sizes[ff[v]] < 4)
+      {
+      expected[v] = 0;
+      n_expected++;
+      }
+    }
+  SNAP_TEST_ASSERT(n_removed == n_expected);
+  SNAP_TEST_ASSERT(GetVoxels(seg) == expected);
+  SNAP_TEST_ASSERT(seg->GetNumberOfVoxelsWithLabel(label)
+                   == (unsigned long) std::count(expected.begin(), expected.end(), label));
+
+  // Keeping the largest component leaves only its voxels with the label
+  app->Undo();
+  SNAP_TEST_ASSERT(GetVoxels(seg) == painted);
+  long largest = std::max_element(ff_sizes.begin(), ff_sizes.end()) - ff_sizes.begin();
+  app->KeepLargestConnectedComponent(label);
+  expected = painted;
+  for(size_t v = 0; v < expected.size(); v++)
+    if(ff[v] >= 0 && ff[v] != largest)
+      expected[v] = 0;
+  SNAP_TEST_ASSERT(GetVoxels(seg) == expected);
+  SNAP_TEST_ASSERT(seg->GetNumberOfVoxelsWithLabel(label) == ff_sizes[largest]);
+
+  app->Undo();
+  SNAP_TEST_ASSERT(GetVoxels(seg) == painted);
+}
+
+/**
+ * Compare two segmentations, one with the synthetic labels and one with
+ * cubes of some of the same labels, and check the voxel counts for each
+ * pair of labels and the overlap of each label against counts made one
+ * voxel at a time.
+ */
+void TestLabelOverlap(const string &tempdir)
+{
+  IRISApplication::Pointer app = LoadSyntheticImages(tempdir, 40);
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+  app->AddBlankSegmentation();
+  LabelImageWrapper *other = app->GetSelectedSegmentationLayer();
+  SNAP_TEST_ASSERT(other != seg);
+
+  for(unsigned int i = 0; i < 4; i++)
+    {
+    itk::Index<3> center;
+    center[0] = 10 + 6 * i; center[1] = 20; center[2] = 12 + 5 * i;
+    SegmentationUpdateIterator it(other, CubeRegion(center, 9), (LabelType)(1 + i % 3), DrawOverFilter());
+    for(; !it.IsAtEnd(); ++it)
+      it.PaintAsForeground();
+    it.Finalize("Cube");
+    }
+  PaintRandomVoxels(other, other->GetImage()->GetBufferedRegion(), 5, 10, 777);
+
+  LabelVoxels va = GetVoxels(seg), vb = GetVoxels(other);
+  SegmentationStatistics::ConfusionMap expected;
+  for(size_t v = 0; v < va.size(); v++)
+    expected[std::make_pair(va[v], vb[v])]++;
+
+  SegmentationStatistics::ConfusionMap confusion;
+  SNAP_TEST_ASSERT(SegmentationStatistics::ComputeConfusion(seg, other, confusion));
+  SNAP_TEST_ASSERT(confusion == expected);
+
+  SegmentationStatistics stats;
+  SNAP_TEST_ASSERT(stats.ComputeOverlap(seg, other));
+  for(LabelType l = 0; l <= 5; l++)
+    {
+    unsigned long na = std::count(va.begin(), va.end(), l);
+    unsigned long nb = std::count(vb.begin(), vb.end(), l);
+    unsigned long nab = expected[std::make_pair(l, l)];
+    if(na + nb == 0)
+      continue;
+
+    auto it = stats.GetOverlap().find(l);
+    SNAP_TEST_ASSERT(it != stats.GetOverlap().end());
+    const SegmentationStatistics::OverlapEntry &e = it->second;
+    SNAP_TEST_ASSERT(e.count == na && e.other_count == nb && e.common_count == nab);
+    SNAP_TEST_ASSERT(std::fabs(e.dice - 2.0 * nab / (na + nb)) < 1e-12);
+    SNAP_TEST_ASSERT(std::fabs(e.jaccard - (double) nab / (na + nb - nab)) < 1e-12);
+    }
+
+  // A segmentation overlaps itself perfectly
+  SNAP_TEST_ASSERT(stats.ComputeOverlap(seg, seg));
+  for(auto &it : stats.GetOverlap())
+    SNAP_TEST_ASSERT(it.second.dice == 1.0 && it.second.jaccard == 1.0);
+}
+
+/** Random runs of update types that add up to the width of a line */
+SegmentationRunWriter::UpdateLine MakeUpdateLine(long y, long z, unsigned int width)
+{
+  static const SegmentationUpdateIterator::UpdateType types[] = {
+    SegmentationUpdateIterator::FOREGROUND,
+    SegmentationUpdateIterator::BACKGROUND,
+    SegmentationUpdateIterator::SKIP,
+    SegmentationUpdateIterator::FOREGROUND_PRESERVE_CLEAR };
+
+  SegmentationRunWriter::UpdateLine update;
+  unsigned int seed = (unsigned int)(y * 7919 + z * 104729 + 1), x = 0;
+  while(x < width)
+    {
+    seed = seed * 1103515245 + 12345;
+    unsigned int n = std::min(width - x, 1 + (seed >> 16) % 7);
+    update.push_back(std::make_pair(n, types[(seed >> 24) % 4]));
+    x += n;
+    }
+  return update;
+}
+
+/** Check the cached voxel counts of the labels against the voxels */
+void CheckLabelCounts(LabelImageWrapper *seg, const LabelVoxels &voxels)
+{
+  for(LabelType l = 0; l <= 8; l++)
+    SNAP_TEST_ASSERT(seg->GetNumberOfVoxelsWithLabel(l)
+                     == (unsigned long) std::count(voxels.begin(), voxels.end(), l));
+}
+
+/**
+ * Apply the same random updates to a region of a segmentation one voxel at
+ * a time with SegmentationUpdateIterator, one line at a time with
+ * SegmentationRunWriter, and to all lines at once in parallel. The results,
+ * the numbers of changed voxels, the label counts and the undo steps must
+ * be the same, in each draw-over mode. Replacing a label is checked too.
+ */
+void TestSegmentationRunWriter(const string &tempdir)
+{
+  IRISApplication::Pointer app = LoadSyntheticImages(tempdir, 40);
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+  LabelVoxels original = GetVoxels(seg);
+  CheckLabelCounts(seg, original);
+
+  itk::ImageRegion<3> region;
+  region.SetIndex(0, 5); region.SetIndex(1, 3); region.SetIndex(2, 2);
+  region.SetSize(0, 28); region.SetSize(1, 30); region.SetSize(2, 33);
+  unsigned int width = region.GetSize(0);
+
+  DrawOverFilter filters[] = {
+    DrawOverFilter(PAINT_OVER_ALL, 0),
+    DrawOverFilter(PAINT_OVER_ONE, 2),
+    DrawOverFilter(PAINT_OVER_VISIBLE, 0) };
+
+  for(const DrawOverFilter &filter : filters)
+    {
+    LabelType label = 3;
+
+    // Paint one voxel at a time
+    SegmentationUpdateIterator it(seg, region, label, filter);
+    SegmentationRunWriter::UpdateLine update;
+    size_t k = 0;
+    unsigned int left = 0;
+    for(; !it.IsAtEnd(); ++it)
+      {
+      itk::Index<3> idx = it.GetIndex();
+      if(idx[0] == region.GetIndex(0))
+        {
+        update = MakeUpdateLine(idx[1], idx[2], width);
+        k = 0;
+        left = update[0].first;
+        }
+      else if(left == 0)
+        {
+        left = update[++k].first;
+        }
+      left--;
+
+      switch(update[k].second)
+        {
+        case SegmentationUpdateIterator::FOREGROUND: it.PaintAsForeground(); break;
+        case SegmentationUpdateIterator::BACKGROUND: it.PaintAsBackground(); break;
+        case SegmentationUpdateIterator::FOREGROUND_PRESERVE_CLEAR: it.PaintAsForegroundPreserveClear(); break;
+        default: break;
+        }
+      }
+    SNAP_TEST_ASSERT(it.Finalize("Voxels"));
+    unsigned long n_changed = it.GetNumberOfChangedVoxels();
+    LabelVoxels painted = GetVoxels(seg);
+    CheckLabelCounts(seg, painted);
+    app->Undo();
+    SNAP_TEST_ASSERT(GetVoxels(seg) == original);
+    CheckLabelCounts(seg, original);
+
+    // Paint one line at a time
+    SegmentationRunWriter lines(seg, region, label, filter);
+    for(long z = region.GetIndex(2); z < region.GetIndex(2) + (long) region.GetSize(2); z++)
+      for(long y = region.GetIndex(1); y < region.GetIndex(1) + (long) region.GetSize(1); y++)
+        lines.PaintLine(y, z, MakeUpdateLine(y, z, width));
+    SNAP_TEST_ASSERT(lines.Finalize("Lines"));
+    SNAP_TEST_ASSERT(lines.GetNumberOfChangedVoxels() == n_changed);
+    SNAP_TEST_ASSERT(GetVoxels(seg) == painted);
+    CheckLabelCounts(seg, painted);
+    app->Undo();
+    SNAP_TEST_ASSERT(GetVoxels(seg) == original);
+
+    // Paint all lines in parallel
+    SegmentationRunWriter parallel(seg, region, label, filter);
+    parallel.PaintAllLinesWith(
+          [width](const itk::Index<3> &idx, SegmentationRunWriter::UpdateLine &line_update)
+      { line_update = MakeUpdateLine(idx[1], idx[2], width); });
+    SNAP_TEST_ASSERT(parallel.Finalize("Parallel"));
+    SNAP_TEST_ASSERT(parallel.GetNumberOfChangedVoxels() == n_changed);
+    SNAP_TEST_ASSERT(GetVoxels(seg) == painted);
+    CheckLabelCounts(seg, painted);
+    app->Undo();
+    SNAP_TEST_ASSERT(GetVoxels(seg) == original);
+    app->Redo();
+    SNAP_TEST_ASSERT(GetVoxels(seg) == painted);
+    app->Undo();
+    CheckLabelCounts(seg, original);
+    }
+
+  // Replacing a label over the whole image
+  LabelVoxels expected = original;
+  std::replace(expected.begin(), expected.end(), (LabelType) 2, (LabelType) 4);
+  size_t n_replaced = app->ReplaceLabel(4, 2);
+  SNAP_TEST_ASSERT(n_replaced == (size_t) std::count(original.begin(), original.end(), 2));
+  SNAP_TEST_ASSERT(GetVoxels(seg) == expected);
+  CheckLabelCounts(seg, expected);
+  app->Undo();
+  SNAP_TEST_ASSERT(GetVoxels(seg) == original);
+  CheckLabelCounts(seg, original);
+}
+
+/** Layout and encoding of a Zarr array written by WriteZarrArray() */
+struct ZarrArraySpec
+{
+  std::vector<unsigned int> Shape, Chunks;
+  bool FortranOrder = false, BigEndian = false, Compressed = false;
+  std::string Separator = ".";
+  unsigned short FillValue = 0;
+
+  // Chunk that is not written, so that it reads as the fill value
+  std::vector<unsigned int> MissingChunk;
+};
+
+void WriteTextFile(const string &fn, const string &text)
+{
+  std::ofstream ofs(fn.c_str());
+  ofs << text;
+}
+
+/**
+ * Write a 16-bit Zarr (version 2) array into a directory, with the value of
+ * each element given by value(coord), with coord in the order of the axes
+ */
+void WriteZarrArray(const string &dir, const ZarrArraySpec &spec,
+                    const std::function<unsigned short(const std::vector<unsigned int> &)> &value)
+{
+  itksys::SystemTools::MakeDirectory(dir);
+  size_t ndim = spec.Shape.size();
+
+  std::ostringstream za;
+  za << "{ \"zarr_format\": 2, \"shape\": [";
+  for(size_t a = 0; a < ndim; a++)
+    za << (a ? ", " : "") << spec.Shape[a];
+  za << "], \"chunks\": [";
+  for(size_t a = 0; a < ndim; a++)
+    za << (a ? ", " : "") << spec.Chunks[a];
+  za << "], \"dtype\": \"" << (spec.BigEndian ? ">" : "<") << "u2\""
+     << ", \"compressor\": " << (spec.Compressed ? "{ \"id\": \"zlib\", \"level\": 6 }" : "null")
+     << ", \"fill_value\": " << spec.FillValue
+     << ", \"order\": \"" << (spec.FortranOrder ? "F" : "C") << "\""
+     << ", \"filters\": null"
+     << ", \"dimension_separator\": \"" << spec.Separator << "\" }";
+  WriteTextFile(dir + "/.zarray", za.str());
+
+  // Visit all the chunks, including the partial ones at the far edges
+  std::vector<unsigned int> nchunks(ndim), cc(ndim, 0);
+  size_t chunk_size = 1;
+  for(size_t a = 0; a < ndim; a++)
+    {
+    nchunks[a] = (spec.Shape[a] + spec.Chunks[a] - 1) / spec.Chunks[a];
+    chunk_size *= spec.Chunks[a];
+    }
+
+  while(true)
+    {
+    if(cc != spec.MissingChunk)
+      {
+      // Chunks always hold the full chunk shape
+      std::vector<unsigned char> data(2 * chunk_size, 0);
+      std::vector<unsigned int> pos(ndim, 0), coord(ndim);
+      for(size_t i = 0; i < chunk_size; i++)
+        {
+        bool inside = true;
+        for(size_t a = 0; a < ndim; a++)
+          {
+          coord[a] = cc[a] * spec.Chunks[a] + pos[a];
+          inside &= coord[a] < spec.Shape[a];
+          }
+        if(inside)
+          {
+          size_t offset = 0, stride = 1;
+          for(size_t k = 0; k < ndim; k++)
+            {
+            size_t a = spec.FortranOrder ? k : ndim - 1 - k;
+            offset += pos[a] * stride;
+            stride *= spec.Chunks[a];
+            }
+          unsigned short v = value(coord);
+          data[2 * offset + (spec.BigEndian ? 1 : 0)] = (unsigned char)(v & 0xff);
+          data[2 * offset + (spec.BigEndian ? 0 : 1)] = (unsigned char)(v >> 8);
+          }
+
+        for(size_t a = 0; a < ndim && ++pos[a] == spec.Chunks[a]; a++)
+          pos[a] = 0;
+        }
+
+      if(spec.Compressed)
+        {
+        uLongf n = compressBound(data.size());
+        std::vector<unsigned char> packed(n);
+        compress2(packed.data(), &n, data.data(), data.size(), 6);
+        packed.resize(n);
+        data.swap(packed);
+        }
+
+      std::ostringstream fn;
+      fn << dir << "/";
+      for(size_t a = 0; a < ndim; a++)
+        fn << (a ? spec.Separator : "") << cc[a];
+      itksys::SystemTools::MakeDirectory(itksys::SystemTools::GetFilenamePath(fn.str()));
+      std::ofstream ofs(fn.str().c_str(), std::ios::binary);
+      ofs.write(reinterpret_cast<const char *>(data.data()), data.size());
+      }
+
+    size_t a = 0;
+    for(; a < ndim && ++cc[a] == nchunks[a]; a++)
+      cc[a] = 0;
+    if(a == ndim)
+      break;
+    }
+}
+
+/**
+ * Write a two-scale OME-Zarr store with chunks of different layouts and
+ * encodings, and a missing chunk, and read it back whole, in parts (which
+ * only reads some of the chunks) and at the coarser scale.
+ */
+void TestZarrReader(const string &tempdir)
+{
+  string store = tempdir + "/snap_logic_test.zarr";
+  itksys::SystemTools::RemoveADirectory(store);
+  itksys::SystemTools::MakeDirectory(store);
+  WriteTextFile(store + "/.zgroup", "{ \"zarr_format\": 2 }");
+  WriteTextFile(store + "/.zattrs",
+      "{ \"multiscales\": [ { \"version\": \"0.4\","
+      "  \"axes\": [ { \"name\": \"z\", \"type\": \"space\" },"
+      "              { \"name\": \"y\", \"type\": \"space\" },"
+      "              { \"name\": \"x\", \"type\": \"space\" } ],"
+      "  \"datasets\": ["
+      "    { \"path\": \"0\", \"coordinateTransformations\": ["
+      "      { \"type\": \"scale\", \"scale\": [2.0, 1.0, 0.5] },"
+      "      { \"type\": \"translation\", \"translation\": [10.0, 20.0, 30.0] } ] },"
+      "    { \"path\": \"1\", \"coordinateTransformations\": ["
+      "      { \"type\": \"scale\", \"scale\": [4.0, 2.0, 1.0] } ] } ] } ] }");
+
+  // The finest scale is uncompressed, in C order, with a missing chunk
+  ZarrArraySpec fine;
+  fine.Shape = { 7, 10, 13 };
+  fine.Chunks = { 3, 4, 5 };
+  fine.Separator = "/";
+  fine.FillValue = 17;
+  fine.MissingChunk = { 1, 2, 0 };
+  auto fine_value = [](const std::vector<unsigned int> &c)
+    { return (unsigned short)(1000 * c[0] + 37 * c[1] + c[2]); };
+  WriteZarrArray(store + "/0", fine, fine_value);
+
+  // The coarse scale is compressed, big endian and in Fortran order
+  ZarrArraySpec coarse;
+  coarse.Shape = { 4, 5, 7 };
+  coarse.Chunks = { 2, 3, 4 };
+  coarse.FortranOrder = true;
+  coarse.BigEndian = true;
+  coarse.Compressed = true;
+  auto coarse_value = [](const std::vector<unsigned int> &c)
+    { return (unsigned short)(300 * c[0] + c[1] * c[2] + 5); };
+  WriteZarrArray(store + "/1", coarse, coarse_value);
+
+  // The value expected in the image at an index, which is (x, y, z)
+  auto expected_value = [&](const ZarrArraySpec &spec, const itk::Index<3> &idx,
+                            const std::function<unsigned short(const std::vector<unsigned int> &)> &value)
+    {
+    std::vector<unsigned int> c = { (unsigned int) idx[2], (unsigned int) idx[1], (unsigned int) idx[0] };
+    bool missing = spec.MissingChunk.size() == 3;
+    for(size_t a = 0; missing && a < 3; a++)
+      missing = c[a] / spec.Chunks[a] == spec.MissingChunk[a];
+    return missing ? spec.FillValue : value(c);
+    };
+
+  typedef itk::ImageFileReader<SegImageType> ReaderType;
+  itk::ZarrImageIO::Pointer io = itk::ZarrImageIO::New();
+  SNAP_TEST_ASSERT(io->CanReadFile(store.c_str()));
+
+  // Read the whole finest scale
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetImageIO(io);
+  reader->SetFileName(store);
+  reader->Update();
+  SegImageType *image = reader->GetOutput();
+  SNAP_TEST_ASSERT(io->GetNumberOfScaleLevels() == 2 && io->GetSelectedScaleLevel() == 0);
+
+  itk::ImageRegion<3> whole = image->GetLargestPossibleRegion();
+  SNAP_TEST_ASSERT(whole.GetSize(0) == 13 && whole.GetSize(1) == 10 && whole.GetSize(2) == 7);
+  SNAP_TEST_ASSERT(image->GetSpacing()[0] == 0.5 && image->GetSpacing()[2] == 2.0);
+  SNAP_TEST_ASSERT(image->GetOrigin()[0] == 30.0 && image->GetOrigin()[2] == 10.0);
+  for(itk::ImageRegionIteratorWithIndex<SegImageType> it(image, whole); !it.IsAtEnd(); ++it)
+    SNAP_TEST_ASSERT(it.Get() == expected_value(fine, it.GetIndex(), fine_value));
+
+  // Read parts of the image that cut through the chunks
+  for(unsigned int k = 0; k < 3; k++)
+    {
+    itk::ImageRegion<3> part;
+    part.SetIndex(0, 2 + k); part.SetSize(0, 7);
+    part.SetIndex(1, 3 * k); part.SetSize(1, 4);
+    part.SetIndex(2, k + 1); part.SetSize(2, 2 + k);
+
+    ReaderType::Pointer part_reader = ReaderType::New();
+    part_reader->SetImageIO(io);
+    part_reader->SetFileName(store);
+    part_reader->GetOutput()->SetRequestedRegion(part);
+    part_reader->Update();
+    SegImageType *part_image = part_reader->GetOutput();
+    SNAP_TEST_ASSERT(part_image->GetBufferedRegion().IsInside(part));
+    for(itk::ImageRegionIteratorWithIndex<SegImageType> it(part_image, part); !it.IsAtEnd(); ++it)
+      SNAP_TEST_ASSERT(it.Get() == expected_value(fine, it.GetIndex(), fine_value));
+    }
+
+  // Select the coarse scale directly, and with a memory limit that the
+  // finest scale (1820 bytes) does not fit
+  for(unsigned int k = 0; k < 2; k++)
+    {
+    itk::ZarrImageIO::Pointer io_coarse = itk::ZarrImageIO::New();
+    if(k == 0)
+      io_coarse->SetScaleLevel(1);
+    else
+      io_coarse->SetMaximumBytes(1000);
+
+    ReaderType::Pointer coarse_reader = ReaderType::New();
+    coarse_reader->SetImageIO(io_coarse);
+    coarse_reader->SetFileName(store);
+    coarse_reader->Update();
+    SegImageType *coarse_image = coarse_reader->GetOutput();
+    SNAP_TEST_ASSERT(io_coarse->GetSelectedScaleLevel() == 1);
+    SNAP_TEST_ASSERT(coarse_image->GetLargestPossibleRegion().GetSize(0) == 7);
+    SNAP_TEST_ASSERT(coarse_image->GetSpacing()[0] == 1.0 && coarse_image->GetSpacing()[2] == 4.0);
+    for(itk::ImageRegionIteratorWithIndex<SegImageType> it(coarse_image, coarse_image->GetLargestPossibleRegion());
+        !it.IsAtEnd(); ++it)
+      SNAP_TEST_ASSERT(it.Get() == expected_value(coarse, it.GetIndex(), coarse_value));
+    }
+}
+
+/**
+ * Evolve a sphere with the tiled and with the serial sparse field solvers
+ * and check that the zero level sets agree. The speed is not symmetric about
+ * the sphere, and the band is large enough for the tiles to be split among
+ * the work units.
+ */
+void TestSparseFieldSolvers(const string &)
+{
+  typedef SNAPLevelSetDriver<3> DriverType;
+  typedef DriverType::FloatImageType FloatImageType;
+  typedef DriverType::ShortImageType ShortImageType;
+
+  itk::MultiThreaderBase::SetGlobalDefaultNumberOfThreads(4);
+
+  const unsigned int n = 64;
+  itk::ImageRegion<3> region;
+  region.SetSize(0, n); region.SetSize(1, n); region.SetSize(2, n);
+
+  // The front speeds up towards a point off the center of the sphere and
+  // slows down and reverses away from it
+  ShortImageType::Pointer speed = ShortImageType::New();
+  speed->SetRegions(region);
+  speed->Allocate();
+  for(itk::ImageRegionIteratorWithIndex<ShortImageType> it(speed, region); !it.IsAtEnd(); ++it)
+    {
+    itk::Index<3> idx = it.GetIndex();
+    double r = std::sqrt(std::pow(idx[0] - 38.0, 2) + std::pow(idx[1] - 32.0, 2) + std::pow(idx[2] - 28.0, 2));
+    double s = std::max(-1.0, std::min(1.0, (24.0 - r) / 12.0));
+    it.Set((short)(s * 0x7fff));
+    }
+
+  // The level set is negative inside of a sphere of radius 15
+  auto make_sphere = [&]()
+    {
+    FloatImageType::Pointer phi = FloatImageType::New();
+    phi->SetRegions(region);
+    phi->Allocate();
+    for(itk::ImageRegionIteratorWithIndex<FloatImageType> it(phi, region); !it.IsAtEnd(); ++it)
+      {
+      itk::Index<3> idx = it.GetIndex();
+      it.Set((float)(std::sqrt(std::pow(idx[0] - 32.0, 2) + std::pow(idx[1] - 32.0, 2)
+                               + std::pow(idx[2] - 32.0, 2)) - 15.0));
+      }
+    return phi;
+    };
+
+  FloatImageType::Pointer phi_tiled = make_sphere(), phi_serial = make_sphere();
+
+  SnakeParameters param = SnakeParameters::GetDefaultInOutParameters();
+  param.SetCurvatureWeight(0.2);
+
+  param.SetSolver(SnakeParameters::TILED_SPARSE_FIELD_SOLVER);
+  DriverType tiled(phi_tiled, speed, param);
+
+  param.SetSolver(SnakeParameters::SPARSE_FIELD_SOLVER);
+  DriverType serial(phi_serial, speed, param);
+
+  for(unsigned int k = 0; k < 4; k++)
+    {
+    tiled.Run(10);
+    serial.Run(10);
+    SNAP_TEST_ASSERT(tiled.GetElapsedIterations() == serial.GetElapsedIterations());
+
+    // The fronts must be in the same place, with the same sub-voxel offsets
+    FloatImageType *out_tiled = tiled.GetOutput(), *out_serial = serial.GetOutput();
+    unsigned long n_front = 0, n_sign = 0;
+    double max_diff = 0.0;
+    itk::ImageRegionIteratorWithIndex<FloatImageType> itSerial(out_serial, region);
+    for(itk::ImageRegionIteratorWithIndex<FloatImageType> it(out_tiled, region); !it.IsAtEnd(); ++it, ++itSerial)
+      {
+      float a = it.Get(), b = itSerial.Get();
+      if((a < 0.0f) != (b < 0.0f))
+        n_sign++;
+      if(std::fabs(b) <= 0.5f)
+        {
+        n_front++;
+        max_diff = std::max(max_diff, (double) std::fabs(a - b));
+        }
+      }
+
+    SNAP_TEST_ASSERT(n_front > 1000);
+    SNAP_TEST_ASSERT(n_sign * 1000 <= n_front);
+    SNAP_TEST_ASSERT(max_diff < 1.0e-3);
+    }
+}
+
+/** Fill a registry with nested folders and values of different kinds */
+void FillRegistry(Registry &reg)
+{
+  reg["Version"] << 20261014;
+  reg["Description"] << "A value with spaces = signs # and % characters \xc3\xa9";
+  for(int i = 0; i < 5; i++)
+    {
+    Registry &layer = reg.Folder(Registry::Key("Layers.Layer[%03d]", i));
+    layer["AbsolutePath"] << Registry::Key("/data/subject %d/image.nii.gz", i);
+    layer["Role"] << (i ? "OverlayRole" : "MainRole");
+    layer["LayerMetaData.Alpha"] << 0.25 * i;
+    layer["LayerMetaData.Origin"] << Vector3d(1.5 * i, -2.0, 1e-7);
+    layer.Folder("LayerMetaData.DisplayMapping.Curve").PutArray(
+          std::vector<double>(i + 1, 0.5));
+    }
+}
+
+/**
+ * Write a registry as text and as binary files, and check that the binary
+ * file reads back to the same registry as the text file, also when only
+ * some of its folders are read.
+ */
+void TestRegistryBinary(const string &tempdir)
+{
+  Registry reg;
+  FillRegistry(reg);
+
+  string fnText = tempdir + "/snap_logic_test_registry.txt";
+  string fnBinary = tempdir + "/snap_logic_test_registry.bin";
+  reg.WriteToFile(fnText.c_str());
+  reg.WriteToBinaryFile(fnBinary.c_str());
+
+  Registry text, binary, binary_xml;
+  text.ReadFromFile(fnText.c_str());
+  binary.ReadFromBinaryFile(fnBinary.c_str());
+  binary_xml.ReadFromXMLFile(fnBinary.c_str());
+  SNAP_TEST_ASSERT(text == reg);
+  SNAP_TEST_ASSERT(binary == text);
+  SNAP_TEST_ASSERT(binary_xml == text);
+
+  // Reading a nested folder also reads the entries of the folders above it
+  Registry::StringListType folders;
+  folders.push_back("Layers.Layer[003]");
+  Registry partial;
+  partial.ReadFromBinaryFile(fnBinary.c_str(), &folders);
+  SNAP_TEST_ASSERT(partial.HasFolder("Layers.Layer[003]"));
+  SNAP_TEST_ASSERT(!partial.HasFolder("Layers.Layer[002]"));
+  SNAP_TEST_ASSERT(partial.Folder("Layers.Layer[003]") == text.Folder("Layers.Layer[003]"));
+  SNAP_TEST_ASSERT(partial["Version"][(int) 0] == text["Version"][(int) 0]);
+  SNAP_TEST_ASSERT(partial["Description"][string()] == text["Description"][string()]);
+}
+
+/**
+ * Check that a RegistryKey keeps referring to the right entry after keys
+ * are removed from the registry, the registry is cleared or assigned to,
+ * and when the same key is used with another registry.
+ */
+void TestRegistryKey(const string &)
+{
+  Registry reg;
+  RegistryKey key("Layers.Layer[000].LayerMetaData.Alpha");
+  reg[key] << 0.5;
+  SNAP_TEST_ASSERT(&reg[key] == &reg.Entry(key.GetString()));
+  SNAP_TEST_ASSERT(reg[key][0.0] == 0.5);
+
+  // Removing the entry leaves a key that finds or creates the new entry
+  reg.Folder("Layers.Layer[000].LayerMetaData").RemoveKeys("Alpha");
+  SNAP_TEST_ASSERT(!reg.HasEntry(key.GetString()));
+  reg[key] << 0.75;
+  SNAP_TEST_ASSERT(&reg[key] == &reg.Entry(key.GetString()));
+  SNAP_TEST_ASSERT(reg.Entry(key.GetString())[0.0] == 0.75);
+
+  // Clearing a folder above the entry, or the whole registry
+  reg.Folder("Layers").Clear();
+  SNAP_TEST_ASSERT(reg[key].IsNull());
+  reg[key] << 1.0;
+  SNAP_TEST_ASSERT(reg.Entry(key.GetString())[0.0] == 1.0);
+
+  reg.Clear();
+  SNAP_TEST_ASSERT(reg.IsEmpty());
+  reg[key] << 0.25;
+  SNAP_TEST_ASSERT(&reg[key] == &reg.Entry(key.GetString()));
+  SNAP_TEST_ASSERT(reg.Entry(key.GetString())[0.0] == 0.25);
+
+  // The same key used with another registry refers to that registry
+  Registry other;
+  other[key] << 2.0;
+  SNAP_TEST_ASSERT(&other[key] != &reg[key]);
+  SNAP_TEST_ASSERT(reg[key][0.0] == 0.25);
+  SNAP_TEST_ASSERT(other[key][0.0] == 2.0);
+
+  // Assignment replaces the entries of the registry
+  reg = other;
+  SNAP_TEST_ASSERT(&reg[key] == &reg.Entry(key.GetString()));
+  SNAP_TEST_ASSERT(reg[key][0.0] == 2.0);
+}
+
+int usage(const char *program, const std::map<string, std::function<void(const string &)> > &tests)
+{
+  cout << "Usage: " << program << " TestName tempdir" << endl;
+  cout << "Tests:" << endl;
+  for(auto &t : tests)
+    cout << "   " << t.first << endl;
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  std::map<string, std::function<void(const string &)> > tests;
+  tests["ConnectedComponents"] = TestConnectedComponents;
+  tests["LabelOverlap"] = TestLabelOverlap;
+  tests["RegistryBinary"] = TestRegistryBinary;
+  tests["RegistryKey"] = TestRegistryKey;
+  tests["RLESharedLines"] = TestRLESharedLines;
+  tests["SegmentationRunWriter"] = TestSegmentationRunWriter;
+  tests["SparseFieldSolvers"] = TestSparseFieldSolvers;
+  tests["UndoRedo"] = TestUndoRedo;
+  tests["ZarrReader"] = TestZarrReader;
+
+  if(argc < 3 || tests.find(argv[1]) == tests.end())
+    return usage(argv[0], tests);
+
+  DummySystemInfoDelegate sidel(argv[0]);
+  SystemInterface::SetSystemInfoDelegate(&sidel);
+
+  try
+    {
+    tests[argv[1]](argv[2]);
+    }
+  catch(std::exception &exc)
+    {
+    cerr << "Test " << argv[1] << " failed: " << exc.what() << endl;
+    return -1;
+    }
+
+  cout << "Test " << argv[1] << " passed" << endl;
+  return 0;
+}
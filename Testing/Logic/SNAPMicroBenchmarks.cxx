@@ -0,0 +1,508 @@
+/**
+ * Microbenchmarks for the run-length encoded label image and the code that
+ * reads and writes it: encoding and decoding, random voxel access, region
+ * and scanline iteration, slicing along each axis, region of interest
+ * extraction, and the encoding and replay of undo deltas.
+ *
+ * Each benchmark is run on synthetic label images whose mean run length is
+ * given on the command line, so that the effect of a change can be compared
+ * between images with many short runs and images with a few long ones. A
+ * benchmark repeats its loop until it has run for a minimum time, and the
+ * time per iteration is reported, in the manner of Google Benchmark. The
+ * results are written as JSON so that they can be compared between builds.
+ */
+#include "SNAPCommon.h"
+#include "RLEImageRegionIterator.h"
+#include "RLEImageScanlineIterator.h"
+#include "RLERegionOfInterestImageFilter.h"
+#include "IRISSlicer.h"
+#include "UndoDataManager.h"
+#include "CommandLineArgumentParser.h"
+
+#include <itkImage.h>
+#include <itkImageRegionIterator.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef itk::Image<LabelType, 3> LabelImageType;
+typedef itk::Image<LabelType, 2> LabelSliceType;
+typedef RLEImage<LabelType> RLELabelImageType;
+typedef UndoDelta<LabelType> DeltaType;
+
+/**
+ * The loop of a benchmark. The time is measured from the first call to
+ * KeepRunning() to the last, so the setup before the loop is not counted.
+ */
+class MicroBenchmarkState
+{
+public:
+  typedef std::chrono::steady_clock ClockType;
+
+  MicroBenchmarkState(size_t iterations) : m_Iterations(iterations) {}
+
+  bool KeepRunning()
+  {
+    if(m_Done == 0)
+      m_Start = ClockType::now();
+    if(m_Done < m_Iterations)
+      {
+      m_Done++;
+      return true;
+      }
+    m_Elapsed = std::chrono::duration<double>(ClockType::now() - m_Start).count();
+    return false;
+  }
+
+  /** Number of items (voxels, lookups) processed by each iteration */
+  void SetItemsPerIteration(double items) { m_ItemsPerIteration = items; }
+
+  size_t GetIterations() const { return m_Iterations; }
+  double GetElapsed() const { return m_Elapsed; }
+  double GetItemsPerIteration() const { return m_ItemsPerIteration; }
+
+private:
+  size_t m_Iterations, m_Done = 0;
+  ClockType::time_point m_Start;
+  double m_Elapsed = 0.0, m_ItemsPerIteration = 0.0;
+};
+
+/** Keep the compiler from removing a computation whose result is unused */
+template <class T> void DoNotOptimize(const T &value)
+{
+  static volatile T sink;
+  sink = value;
+}
+
+/** Timing of one benchmark */
+struct MicroBenchmarkResult
+{
+  string Name;
+  size_t Iterations;
+  double TimePerIteration, ItemsPerSecond;
+};
+
+/** Runs the benchmarks and collects the timings */
+class MicroBenchmarkSuite
+{
+public:
+  typedef std::function<void (MicroBenchmarkState &)> BenchmarkFunction;
+
+  MicroBenchmarkSuite(double min_time, const string &filter)
+    : m_MinTime(min_time), m_Filter(filter) {}
+
+  /**
+   * Run a benchmark with more and more iterations until it takes at least
+   * the minimum time
+   */
+  void Run(const string &name, const BenchmarkFunction &fn)
+  {
+    if(m_Filter.size() && name.find(m_Filter) == string::npos)
+      return;
+
+    size_t n = 1;
+    while(true)
+      {
+      MicroBenchmarkState state(n);
+      fn(state);
+      double t = state.GetElapsed();
+      if(t >= m_MinTime || n >= 1000000000)
+        {
+        MicroBenchmarkResult r;
+        r.Name = name;
+        r.Iterations = n;
+        r.TimePerIteration = t / n;
+        r.ItemsPerSecond = t > 0.0 ? state.GetItemsPerIteration() * n / t : 0.0;
+        m_Results.push_back(r);
+        cerr << name << ": " << 1.0e6 * r.TimePerIteration << " us/it ("
+             << n << " iterations)" << endl;
+        return;
+        }
+
+      // Aim past the minimum time, but grow by at most 10x at a time
+      double target = t > 0.0 ? 1.4 * m_MinTime * n / t : 10.0 * n;
+      n = std::max(n + 1, (size_t) std::min(10.0 * n, target));
+      }
+  }
+
+  /** Write the results as JSON */
+  void WriteJSON(ostream &os, unsigned int size, const vector<double> &run_lengths)
+  {
+    os << "{" << endl;
+    os << "  \"size\": " << size << "," << endl;
+    os << "  \"run_lengths\": [";
+    for(size_t i = 0; i < run_lengths.size(); i++)
+      os << (i ? ", " : "") << run_lengths[i];
+    os << "]," << endl;
+    os << "  \"unit\": \"s\"," << endl;
+    os << "  \"benchmarks\": [" << endl;
+    for(size_t k = 0; k < m_Results.size(); k++)
+      {
+      const MicroBenchmarkResult &r = m_Results[k];
+      os << "    { \"name\": \"" << r.Name << "\""
+         << ", \"iterations\": " << r.Iterations
+         << ", \"time\": " << r.TimePerIteration
+         << ", \"items_per_second\": " << r.ItemsPerSecond << " }"
+         << (k + 1 < m_Results.size() ? "," : "") << endl;
+      }
+    os << "  ]" << endl;
+    os << "}" << endl;
+  }
+
+private:
+  double m_MinTime;
+  string m_Filter;
+  vector<MicroBenchmarkResult> m_Results;
+};
+
+/** A small deterministic random number generator */
+class SyntheticRandom
+{
+public:
+  SyntheticRandom(unsigned int seed) : m_State(seed) {}
+
+  // Uniform in (0, 1)
+  double Uniform()
+  {
+    m_State = m_State * 6364136223846793005ull + 1442695040888963407ull;
+    return ((m_State >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+  }
+
+  unsigned long Integer(unsigned long n) { return (unsigned long) (this->Uniform() * n); }
+
+private:
+  unsigned long long m_State;
+};
+
+/**
+ * Create a label image whose lines consist of runs with a given mean length.
+ * The run lengths follow a geometric distribution, and every other run is
+ * background, the others having one of a few labels.
+ */
+LabelImageType::Pointer CreateSyntheticLabelImage(unsigned int n, double run_length)
+{
+  LabelImageType::RegionType region;
+  region.SetSize(0, n); region.SetSize(1, n); region.SetSize(2, n);
+
+  LabelImageType::Pointer image = LabelImageType::New();
+  image->SetRegions(region);
+  image->Allocate();
+
+  SyntheticRandom random(12345);
+  LabelType *p = image->GetBufferPointer();
+  for(size_t line = 0; line < (size_t) n * n; line++)
+    {
+    bool background = random.Uniform() < 0.5;
+    for(unsigned int x = 0; x < n; )
+      {
+      size_t len = std::max(1.0, std::round(-run_length * std::log(random.Uniform())));
+      LabelType label = background ? 0 : (LabelType) (1 + random.Integer(7));
+      for(size_t j = 0; j < len && x < n; j++, x++)
+        *p++ = label;
+      background = !background;
+      }
+    }
+
+  return image;
+}
+
+RLELabelImageType::Pointer EncodeRLE(LabelImageType *image)
+{
+  typedef itk::RegionOfInterestImageFilter<LabelImageType, RLELabelImageType> EncoderType;
+  EncoderType::Pointer encoder = EncoderType::New();
+  encoder->SetInput(image);
+  encoder->SetRegionOfInterest(image->GetLargestPossibleRegion());
+  encoder->Update();
+  RLELabelImageType::Pointer rle = encoder->GetOutput();
+  rle->DisconnectPipeline();
+  return rle;
+}
+
+/**
+ * The per-voxel delta of painting a ball of a label in the center of an
+ * image, in raster order of the whole image, as recorded by the paintbrush
+ */
+vector<LabelType> CreateBallDelta(LabelImageType *image, double radius)
+{
+  LabelImageType::SizeType sz = image->GetBufferedRegion().GetSize();
+  vector<LabelType> delta(image->GetBufferedRegion().GetNumberOfPixels(), 0);
+  const LabelType *p = image->GetBufferPointer();
+  size_t i = 0;
+  for(unsigned int z = 0; z < sz[2]; z++)
+    for(unsigned int y = 0; y < sz[1]; y++)
+      for(unsigned int x = 0; x < sz[0]; x++, i++)
+        {
+        double dx = x - 0.5 * sz[0], dy = y - 0.5 * sz[1], dz = z - 0.5 * sz[2];
+        if(dx * dx + dy * dy + dz * dz < radius * radius)
+          delta[i] = (LabelType) (9 - p[i]);
+        }
+  return delta;
+}
+
+/** Run all the benchmarks on a label image with one mean run length */
+void RunBenchmarks(MicroBenchmarkSuite &suite, unsigned int n, double run_length)
+{
+  ostringstream oss; oss << "/" << run_length;
+  string suffix = oss.str();
+
+  LabelImageType::Pointer image = CreateSyntheticLabelImage(n, run_length);
+  RLELabelImageType::Pointer rle = EncodeRLE(image);
+  const LabelImageType::RegionType &region = image->GetBufferedRegion();
+  double voxels = region.GetNumberOfPixels();
+
+  // Encoding and decoding of the whole image
+  suite.Run("Encode" + suffix, [&](MicroBenchmarkState &state)
+  {
+    typedef itk::RegionOfInterestImageFilter<LabelImageType, RLELabelImageType> EncoderType;
+    EncoderType::Pointer encoder = EncoderType::New();
+    encoder->SetInput(image);
+    encoder->SetRegionOfInterest(region);
+    state.SetItemsPerIteration(voxels);
+    while(state.KeepRunning())
+      {
+      encoder->Modified();
+      encoder->Update();
+      }
+  });
+
+  suite.Run("Decode" + suffix, [&](MicroBenchmarkState &state)
+  {
+    typedef itk::RegionOfInterestImageFilter<RLELabelImageType, LabelImageType> DecoderType;
+    DecoderType::Pointer decoder = DecoderType::New();
+    decoder->SetInput(rle);
+    decoder->SetRegionOfInterest(region);
+    state.SetItemsPerIteration(voxels);
+    while(state.KeepRunning())
+      {
+      decoder->Modified();
+      decoder->Update();
+      }
+  });
+
+  // Random voxel access, the lookups are drawn beforehand
+  suite.Run("RandomAccess" + suffix, [&](MicroBenchmarkState &state)
+  {
+    SyntheticRandom random(54321);
+    vector<itk::Index<3> > lookups(4096);
+    for(auto &idx : lookups)
+      for(unsigned int d = 0; d < 3; d++)
+        idx[d] = random.Integer(n);
+
+    state.SetItemsPerIteration(lookups.size());
+    while(state.KeepRunning())
+      {
+      unsigned long sum = 0;
+      for(const auto &idx : lookups)
+        sum += rle->GetPixel(idx);
+      DoNotOptimize(sum);
+      }
+  });
+
+  // Iteration over all the voxels, voxel by voxel and line by line
+  suite.Run("RegionIteration" + suffix, [&](MicroBenchmarkState &state)
+  {
+    state.SetItemsPerIteration(voxels);
+    while(state.KeepRunning())
+      {
+      unsigned long sum = 0;
+      itk::ImageRegionConstIterator<RLELabelImageType> it(rle, region);
+      for(; !it.IsAtEnd(); ++it)
+        sum += it.Get();
+      DoNotOptimize(sum);
+      }
+  });
+
+  suite.Run("ScanlineIteration" + suffix, [&](MicroBenchmarkState &state)
+  {
+    state.SetItemsPerIteration(voxels);
+    while(state.KeepRunning())
+      {
+      unsigned long sum = 0;
+      itk::ImageScanlineConstIterator<RLELabelImageType> it(rle, region);
+      while(!it.IsAtEnd())
+        {
+        for(; !it.IsAtEndOfLine(); ++it)
+          sum += it.Get();
+        it.NextLine();
+        }
+      DoNotOptimize(sum);
+      }
+  });
+
+  // Slicing along each axis, moving through the slices as the cursor does
+  const char *axis_names[] = { "X", "Y", "Z" };
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    suite.Run(string("Slice") + axis_names[d] + suffix, [&](MicroBenchmarkState &state)
+    {
+      typedef IRISSlicer<RLELabelImageType, LabelSliceType, RLELabelImageType> SlicerType;
+      SlicerType::Pointer slicer = SlicerType::New();
+      slicer->SetInput(rle);
+      slicer->SetSliceDirectionImageAxis(d);
+      slicer->SetLineDirectionImageAxis(d == 2 ? 1 : 2);
+      slicer->SetPixelDirectionImageAxis(d == 0 ? 1 : 0);
+      slicer->SetLineTraverseForward(true);
+      slicer->SetPixelTraverseForward(true);
+      state.SetItemsPerIteration(voxels / n);
+      unsigned int k = 0;
+      while(state.KeepRunning())
+        {
+        slicer->SetSliceIndex(k);
+        slicer->Update();
+        k = (k + 1) % n;
+        }
+    });
+    }
+
+  // Extraction of the middle half of the image along each axis
+  suite.Run("RegionOfInterest" + suffix, [&](MicroBenchmarkState &state)
+  {
+    LabelImageType::RegionType roi;
+    for(unsigned int d = 0; d < 3; d++)
+      {
+      roi.SetIndex(d, n / 4);
+      roi.SetSize(d, n / 2);
+      }
+
+    typedef itk::RegionOfInterestImageFilter<RLELabelImageType, RLELabelImageType> ROIType;
+    ROIType::Pointer filter = ROIType::New();
+    filter->SetInput(rle);
+    filter->SetRegionOfInterest(roi);
+    state.SetItemsPerIteration(roi.GetNumberOfPixels());
+    while(state.KeepRunning())
+      {
+      filter->Modified();
+      filter->Update();
+      }
+  });
+
+  // Recording a paintbrush stroke as an undo delta, and replaying it
+  vector<LabelType> ball = CreateBallDelta(image, 0.3 * n);
+  suite.Run("UndoEncode" + suffix, [&](MicroBenchmarkState &state)
+  {
+    state.SetItemsPerIteration(voxels);
+    while(state.KeepRunning())
+      {
+      DeltaType delta;
+      delta.SetRegion(region);
+      for(LabelType v : ball)
+        delta.Encode(v);
+      delta.FinishEncoding();
+      delta.SplitIntoTiles(32);
+      DoNotOptimize(delta.GetNumberOfRLEs());
+      }
+  });
+
+  suite.Run("UndoApply" + suffix, [&](MicroBenchmarkState &state)
+  {
+    DeltaType delta;
+    delta.SetRegion(region);
+    for(LabelType v : ball)
+      delta.Encode(v);
+    delta.FinishEncoding();
+    delta.SplitIntoTiles(32);
+
+    // The delta is undone and redone in turn on a copy of the image, in
+    // the same way as LabelImageWrapper::Undo() and Redo()
+    RLELabelImageType::Pointer target = EncodeRLE(image);
+    state.SetItemsPerIteration(delta.GetTileBoundingRegion().GetNumberOfPixels());
+    bool undo = true;
+    while(state.KeepRunning())
+      {
+      for(size_t k = 0; k < delta.GetNumberOfTiles(); k++)
+        {
+        itk::ImageRegionIterator<RLELabelImageType> it(target, delta.GetTileRegion(k));
+        size_t i0 = delta.GetTileFirstRLE(k), i1 = i0 + delta.GetTileNumberOfRLEs(k);
+        for(size_t i = i0; i < i1; i++)
+          {
+          size_t len = delta.GetRLELength(i);
+          LabelType d = delta.GetRLEValue(i);
+          for(size_t j = 0; j < len; j++, ++it)
+            if(d != 0)
+              it.Set((LabelType) (undo ? it.Get() - d : it.Get() + d));
+          }
+        }
+      undo = !undo;
+      }
+  });
+}
+
+int usage(const char *program)
+{
+  cout << "Usage: " << program << " [options]" << endl;
+  cout << "Options:" << endl;
+  cout << "   --size N          : Size of the synthetic label images (default 128)" << endl;
+  cout << "   --run-lengths L   : Comma-separated mean run lengths of the images (default 2,16,128)" << endl;
+  cout << "   --min-time T      : Minimum time in seconds of each benchmark (default 0.5)" << endl;
+  cout << "   --filter STR      : Only run the benchmarks whose name contains STR" << endl;
+  cout << "   --output FILE     : Write the JSON results to FILE instead of stdout" << endl;
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  CommandLineArgumentParser parser;
+  parser.AddOption("--help", 0);
+  parser.AddSynonim("--help", "-h");
+  parser.AddOption("--size", 1);
+  parser.AddOption("--run-lengths", 1);
+  parser.AddOption("--min-time", 1);
+  parser.AddOption("--filter", 1);
+  parser.AddOption("--output", 1);
+
+  CommandLineArgumentParseResult parseResult;
+  if(!parser.TryParseCommandLine(argc, argv, parseResult, true)
+     || parseResult.IsOptionPresent("--help"))
+    return usage(argv[0]);
+
+  unsigned int size = parseResult.IsOptionPresent("--size")
+                      ? atoi(parseResult.GetOptionParameter("--size")) : 128;
+  double min_time = parseResult.IsOptionPresent("--min-time")
+                    ? atof(parseResult.GetOptionParameter("--min-time")) : 0.5;
+  string filter = parseResult.IsOptionPresent("--filter")
+                  ? parseResult.GetOptionParameter("--filter") : "";
+
+  vector<double> run_lengths;
+  istringstream iss(parseResult.IsOptionPresent("--run-lengths")
+                    ? parseResult.GetOptionParameter("--run-lengths") : "2,16,128");
+  for(string token; getline(iss, token, ','); )
+    if(atof(token.c_str()) >= 1.0)
+      run_lengths.push_back(atof(token.c_str()));
+
+  if(size < 4 || run_lengths.empty())
+    return usage(argv[0]);
+
+  try
+    {
+    MicroBenchmarkSuite suite(min_time, filter);
+    for(double run_length : run_lengths)
+      RunBenchmarks(suite, size, run_length);
+
+    // Report the results
+    if(parseResult.IsOptionPresent("--output"))
+      {
+      ofstream fout(parseResult.GetOptionParameter("--output"));
+      suite.WriteJSON(fout, size, run_lengths);
+      }
+    else
+      {
+      suite.WriteJSON(cout, size, run_lengths);
+      }
+    }
+  catch(std::exception &exc)
+    {
+    cerr << "Benchmark failed: " << exc.what() << endl;
+    return -1;
+    }
+
+  return 0;
+}
@@ -35,9 +35,15 @@
 #include <fstream>
 #include <string>
 #include <cstdarg>
+#include <cstring>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #include "CSVParser.h"
 #include "WorkspaceAPI.h"
+#include "ImageHeaderIndex.h"
 #include "FormattedTable.h"
 #include "RESTClient.h"
 
@@ -51,6 +57,8 @@
 #include "ColorLabelTable.h"
 
 #include "IRISApplication.h"
+#include "RFClassificationEngine.h"
+#include "RandomForestClassifier.h"
 #include "AffineTransformHelper.h"
 #include "itkTransform.h"
 
@@ -78,11 +86,26 @@ int usage(int rc)
   cout << "itksnap-wt : ITK-SNAP Workspace Tool" << endl;
   cout << "Usage: " << endl;
   cout << "  itksnap-wt [commands]" << endl;
+  cout << "  itksnap-wt -batch <file> [n_threads]" << endl;
+  cout << "  itksnap-wt -header-index <file> [commands | -batch <file> [n_threads]]" << endl;
+  cout << "Image header index: " << endl;
+  cout << "  -header-index <file>              : Keep the header information and data hashes of images in an" << endl;
+  cout << "                                      index file shared by all invocations, so that unchanged" << endl;
+  cout << "                                      images are not opened again. Must be the first option. The" << endl;
+  cout << "                                      index can also be given by variable ITKSNAP_WT_HEADER_INDEX" << endl;
   cout << "I/O commands: " << endl;
   cout << "  -i <workspace>                    : Read workspace file" << endl;
+  cout << "  -il <workspace>                   : Read only the layers of a workspace file. This is faster" << endl;
+  cout << "                                      for binary workspaces, but the workspace can not be saved" << endl;
   cout << "  -o <workspace>                    : Write workspace file (without touching external images)" << endl;
+  cout << "  -ob <workspace>                   : Write workspace file in binary format, faster to read for" << endl;
+  cout << "                                      large workspaces. Binary workspaces are read by -i" << endl;
   cout << "  -a <dest_dir>                     : Package workspace into uploadable archive in dest_dir" << endl;
   cout << "  -A <dest_dir>                     : Package workspace preserving filenames" << endl;
+  cout << "  -L <dest_dir>                     : Package workspace preserving filenames, hard linking" << endl;
+  cout << "                                      layers that need no conversion instead of copying" << endl;
+  cout << "  -Lz <dest_dir>                    : Same as -L, converting the other layers in parallel" << endl;
+  cout << "                                      with fast compression" << endl;
   cout << "  -p <prefix>                       : Set the output prefix for the next command only" << endl;
   cout << "  -P                                : No printing of prefix for output commands" << endl;
   cout << "Informational commands: " << endl;
@@ -135,6 +158,11 @@ int usage(int rc)
   cout << "                                      renaming with C printf pattern (e.g. 'left %s')" << endl;
   cout << "Annotation object commands" << endl;
   cout << "  -annot-list                       : List all annotations in the workspace" << endl;
+  cout << "Classification commands" << endl;
+  cout << "  -rf-apply <classifier> <out> [n]  : Apply a random forest classifier saved in the speed image" << endl;
+  cout << "                                      dialog to the main image and overlays of the workspace, and" << endl;
+  cout << "                                      write the speed image to file <out>, computing it in n slabs" << endl;
+  cout << "                                      (default 16). Combine with -batch to classify many subjects" << endl;
   cout << "Distributed segmentation server (DSS) user commands: " << endl;
   cout << "  -dss-auth <url> [user] [passwd]   : Sign in to the server. This will create a token" << endl;
   cout << "                                      that may be used in future -dss calls" << endl;
@@ -147,6 +175,7 @@ int usage(int rc)
   cout << "  -dss-tickets-progress <id>        : Get the total progress for ticket 'id'" << endl;
   cout << "  -dss-tickets-wait <id> [timeout]  : Wait for the ticket 'id' to complete" << endl;
   cout << "  -dss-tickets-download <id> <dir>  : Download the result for ticket 'id' to directory 'dir'" << endl;
+  cout << "  -dss-tickets-headers <id> <dir>   : Download just the image headers of the result for ticket 'id'" << endl;
   cout << "  -dss-tickets-delete <id>          : Delete a ticket" << endl;
   cout << "DSS service provider commands: " << endl;
   cout << "  -dssp-services-list               : List all the services you are listed as provider for" << endl;
@@ -195,7 +224,14 @@ int usage(int rc)
   cout << "  CURVE N t1 y1 ... tN yN           : Fully specified curve with N points" << endl; 
   cout << "Multi-Component Display (MCD) Specification:" << endl;
   cout << "  comp <N>                          : Display N-th component" << endl;
-  cout << "  <mag|avg|max|rgb|grid>            : Special modes" << endl;
+  cout << "  <mag|avg|max|jac|rgb|grid>        : Special modes" << endl;
+  cout << "Batch Mode:" << endl;
+  cout << "  Each line of the batch file (- for standard input) lists the commands for one workspace," << endl;
+  cout << "  as they would be given on the command line. Lines starting with # are skipped. The lines" << endl;
+  cout << "  run in parallel, so they should not write files read by other lines. A workspace read by" << endl;
+  cout << "  several lines is parsed once. The results are printed as one JSON object per line, in the" << endl;
+  cout << "  order of the batch file, with the fields job, line, args, status, output and error." << endl;
+  cout << "  The -dss-auth and -dss-tickets-wait commands are not available in batch mode." << endl;
   cout << "Environment Variables" << endl;
   cout << "  ITKSNAP_WT_DSS_SERVER             : URL of the server to use. When you authenticate with -dss-auth" << endl;
   cout << "                                      the server is stored in a config file. When this variable is set" << endl;
@@ -246,7 +282,7 @@ void print_string_with_prefix(ostream &sout, const string &text, const string &p
     sout << prefix << line << endl;
 }
 
-void simple_rest_get(const char *url, const char *exception_message, const char *prefix, ...)
+void simple_rest_get(ostream &sout, const char *url, const char *exception_message, const char *prefix, ...)
 {
   // Handle the ...
   std::va_list args;
@@ -267,10 +303,10 @@ void simple_rest_get(const char *url, const char *exception_message, const char
   }
 
   // Print CSV
-  print_string_with_prefix(cout, rc.GetFormattedCSVOutput(false), prefix);
+  print_string_with_prefix(sout, rc.GetFormattedCSVOutput(false), prefix);
 }
 
-void simple_rest_post(const char *url, const char *params, const char *exception_message, const char *prefix, ...)
+void simple_rest_post(ostream &sout, const char *url, const char *params, const char *exception_message, const char *prefix, ...)
 {
   // Handle the ...
   std::va_list args;
@@ -280,7 +316,7 @@ void simple_rest_post(const char *url, const char *params, const char *exception
   RESTClient rc;
 
   // Try calling command
-  std::cout << "prefix: " << prefix << std::endl;
+  sout << "prefix: " << prefix << std::endl;
   try {
     if(!rc.PostVA(url, params, args))
       throw IRISException("%s: %s", exception_message, rc.GetResponseText());
@@ -291,13 +327,13 @@ void simple_rest_post(const char *url, const char *params, const char *exception
     throw;
   }
 
-  cout << prefix << rc.GetOutput() << endl;
+  sout << prefix << rc.GetOutput() << endl;
 }
 
 /** 
  * Print ticket log with attachments and nice formatting
  */
-int PrintTicketLog(int ticket_id, int id_start = 0)
+int PrintTicketLog(ostream &sout, int ticket_id, int id_start = 0)
 {
   RESTClient rc;
 
@@ -328,7 +364,7 @@ int PrintTicketLog(int ticket_id, int id_start = 0)
       int n_attach = atoi(ft(i, 3).c_str());
 
       // Print the row
-      ft.PrintRow(cout, i, "", col_filter);
+      ft.PrintRow(sout, i, "", col_filter);
 
       // Process the attachments
       if(n_attach > 0)
@@ -342,7 +378,7 @@ int PrintTicketLog(int ticket_id, int id_start = 0)
 
         for(int k = 0; k < fta.Rows(); k++)
           {
-          printf("  @ %s : %s\n", fta(k, 3).c_str(), fta(k, 1).c_str());
+          sout << "  @ " << fta(k, 3) << " : " << fta(k, 1) << endl;
           }
         }
       }
@@ -352,24 +388,77 @@ int PrintTicketLog(int ticket_id, int id_start = 0)
 } 
 
 
-int main(int argc, char *argv[])
+/**
+ * Workspaces read during a batch run. Jobs that read the same workspace get
+ * a copy of the one parsed first, instead of parsing its XML again. A cached
+ * workspace is parsed again when the file changes on disk, or is written by
+ * one of the jobs.
+ */
+class WorkspaceCache
 {
-  // There must be some commands!
-  if(argc < 2)
-    return usage(-1);
+public:
+  void Read(const string &fn, WorkspaceAPI &ws)
+  {
+    string path = SystemTools::CollapseFullPath(fn);
+    long mtime = SystemTools::ModifiedTime(path);
+    unsigned long length = SystemTools::FileLength(path);
 
-  // Command line parsing helper
-  CommandLineHelper cl(argc, argv);
+    {
+      std::lock_guard<std::mutex> guard(m_Mutex);
+      auto it = m_Entries.find(path);
+      if(it != m_Entries.end() && it->second.ModifiedTime == mtime && it->second.Length == length)
+        {
+        ws = it->second.Workspace;
+        return;
+        }
+    }
 
-  // Current workspace object
-  WorkspaceAPI ws;
+    // Parse outside of the lock so jobs reading other workspaces don't wait
+    ws.ReadFromXMLFile(path.c_str());
+
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    Entry &entry = m_Entries[path];
+    entry.ModifiedTime = mtime;
+    entry.Length = length;
+    entry.Workspace = ws;
+  }
 
+  void Invalidate(const string &fn)
+  {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_Entries.erase(SystemTools::CollapseFullPath(fn));
+  }
+
+private:
+  struct Entry
+  {
+    long ModifiedTime;
+    unsigned long Length;
+    WorkspaceAPI Workspace;
+  };
+
+  std::mutex m_Mutex;
+  std::map<string, Entry> m_Entries;
+};
+
+
+/**
+ * Run the commands on a workspace, writing the output of the commands to sout
+ * and errors to serr. In batch mode, the cache holds the workspaces already
+ * read by this run, and commands that interact with the terminal are refused.
+ */
+int RunCommands(CommandLineHelper &cl, WorkspaceAPI &ws, ostream &sout, ostream &serr,
+                WorkspaceCache *batch_cache = nullptr)
+{
   // Currently selected layer folder
   string layer_folder;
 
   // Index of the currently executed command
   int cmd_index = 1;
 
+  // Whether the workspace was only partially read
+  bool partial_workspace = false;
+
   // Whether printing of prefix has been disabled
   bool prefix_disabled = false;
 
@@ -398,17 +487,44 @@ int main(int argc, char *argv[])
       // Read the next command
       arg = cl.read_command();
 
+      // A partially read workspace must not be written out
+      if(partial_workspace && (arg == "-o" || arg == "-ob" || arg == "-a" || arg == "-A"
+                               || arg == "-L" || arg == "-Lz" || arg == "-dss-tickets-create"
+                               || arg == "-dssp-tickets-upload"))
+        throw IRISException("A workspace read with -il can not be saved or exported");
+
       // Handle the various commands
       
       // Read a workspace
       if(arg == "-i")
         {
-        ws.ReadFromXMLFile(cl.read_existing_filename().c_str());
+        string fn = cl.read_existing_filename();
+        if(batch_cache)
+          batch_cache->Read(fn, ws);
+        else
+          ws.ReadFromXMLFile(fn.c_str());
+        partial_workspace = false;
+        }
+
+      // Read just the layers, e.g., for tag queries
+      else if(arg == "-il")
+        {
+        WorkspaceAPI::StringList folders;
+        folders.push_back("Layers");
+        folders.push_back("MeshLayers");
+        ws.ReadFromXMLFile(cl.read_existing_filename().c_str(), &folders);
+        partial_workspace = true;
         }
 
-      else if(arg == "-o")
+      else if(arg == "-o" || arg == "-ob")
         {
-        ws.SaveAsXMLFile(cl.read_output_filename().c_str());
+        string fn = cl.read_output_filename();
+        if(arg == "-ob")
+          ws.SaveAsBinaryFile(fn.c_str());
+        else
+          ws.SaveAsXMLFile(fn.c_str());
+        if(batch_cache)
+          batch_cache->Invalidate(fn);
         }
 
       // Archive the current workspace build
@@ -424,6 +540,15 @@ int main(int argc, char *argv[])
         ws.ExportWorkspace(cl.read_output_filename().c_str(), nullptr, false);
         }
 
+      else if(arg == "-L" || arg == "-Lz")
+        {
+        // Create an archive that shares unchanged files with the workspace
+        int flags = WorkspaceAPI::EXPORT_LINK_UNCHANGED;
+        if(arg == "-Lz")
+          flags |= WorkspaceAPI::EXPORT_FAST_CONVERSION;
+        ws.ExportWorkspace(cl.read_output_filename().c_str(), nullptr, false, flags);
+        }
+
       // Prefix
       else if(arg == "-p" || arg == "-prefix")
         {
@@ -440,13 +565,13 @@ int main(int argc, char *argv[])
       // Dump the workspace contents
       else if(arg == "-dump")
         {
-        ws.GetRegistry().Print(cout, "  ", prefix);
+        ws.GetRegistry().Print(sout, "  ", prefix);
         }
 
       else if(arg == "-registry-get")
         {
         string key = cl.read_string();
-        cout << prefix << ws.GetRegistry()[key][""] << endl;
+        sout << prefix << ws.GetRegistry()[key][""] << endl;
         }
 
       else if(arg == "-registry-set")
@@ -454,19 +579,19 @@ int main(int argc, char *argv[])
         string key = cl.read_string();
         string value = cl.read_string();
         ws.GetRegistry()[key] << value;
-        cout << "INFO: set registry entry '" << key << "' to '" << ws.GetRegistry()[key][""] << "'" << endl;
+        sout << "INFO: set registry entry '" << key << "' to '" << ws.GetRegistry()[key][""] << "'" << endl;
         }
 
       // List all layers
       else if(arg == "-layers-list" || arg == "-ll")
         {
-        ws.PrintLayerList(cout, prefix);
+        ws.PrintLayerList(sout, prefix);
         }
 
       // List the files associated with a specific tag
       else if(arg == "-layers-list-files" || arg == "-llf")
         {
-        ws.ListLayerFilesForTag(cl.read_string(), cout, prefix);
+        ws.ListLayerFilesForTag(cl.read_string(), sout, prefix);
         }
 
       // Select a layer - the selected layer is target for various property commands
@@ -474,7 +599,7 @@ int main(int argc, char *argv[])
         {
         string layer_id = cl.read_string();
         layer_folder = ws.LayerSpecToKey(layer_id.c_str());
-        cout << "INFO: picked layer " << layer_folder << endl;
+        sout << "INFO: picked layer " << layer_folder << endl;
         }
 
       else if(arg == "-layers-pick-by-tag" || arg == "-lpt" || arg == "-lpbt")
@@ -487,7 +612,7 @@ int main(int argc, char *argv[])
 
         layer_folder = layers.front();
 
-        cout << "INFO: picked layer " << layer_folder << endl;
+        sout << "INFO: picked layer " << layer_folder << endl;
         }
 
       // Add a layer - the layer will be added in the anatomical role
@@ -496,7 +621,7 @@ int main(int argc, char *argv[])
         string filename = cl.read_existing_filename();
         string key = ws.AddLayer("AnatomicalRole", filename.c_str());
         layer_folder = key;
-        cout << "INFO: picked layer " << layer_folder << endl;
+        sout << "INFO: picked layer " << layer_folder << endl;
         }
 
       // Add a layer - the layer will be added in the segmentation role
@@ -505,7 +630,7 @@ int main(int argc, char *argv[])
         string filename = cl.read_existing_filename();
         string key = ws.AddLayer("SegmentationRole", filename.c_str());
         layer_folder = key;
-        cout << "INFO: picked layer " << layer_folder << endl;
+        sout << "INFO: picked layer " << layer_folder << endl;
         }
 
       // Add a layer - the layer will be added in the mesh role
@@ -515,7 +640,7 @@ int main(int argc, char *argv[])
         unsigned int tp = cl.read_integer();
         string key = ws.AddMeshLayer(filename, tp);
         layer_folder = key;
-        cout << "INFO: picked layer " << layer_folder << endl;
+        sout << "INFO: picked layer " << layer_folder << endl;
         }
 
       // Set the main layer
@@ -524,7 +649,7 @@ int main(int argc, char *argv[])
         string filename = cl.read_existing_filename();
         string key = ws.SetLayer("MainRole", filename.c_str());
         layer_folder = key;
-        cout << "INFO: picked layer " << layer_folder << endl;
+        sout << "INFO: picked layer " << layer_folder << endl;
         }
 
       // Set the main layer
@@ -533,7 +658,7 @@ int main(int argc, char *argv[])
         string filename = cl.read_existing_filename();
         string key = ws.SetLayer("SegmentationRole", filename.c_str());
         layer_folder = key;
-        cout << "INFO: picked layer " << layer_folder << endl;
+        sout << "INFO: picked layer " << layer_folder << endl;
         }
 
       else if(arg == "-props-get-filename" || arg == "-pgf")
@@ -541,7 +666,7 @@ int main(int argc, char *argv[])
         if(!ws.IsKeyValidLayer(layer_folder))
           throw IRISException("Selected object %s is not a valid layer", layer_folder.c_str());
 
-        cout << prefix << ws.GetLayerActualPath(ws.GetFolder(layer_folder)) << endl;
+        sout << prefix << ws.GetLayerActualPath(ws.GetFolder(layer_folder)) << endl;
         }
 
       else if(arg == "-props-get-mesh-filename" || arg == "-pgmf")
@@ -558,7 +683,7 @@ int main(int argc, char *argv[])
         if (polyId < 0)
           throw IRISException("Invalid polydata_id value %d. Polydata Id should start from 0.", polyId);
 
-        cout << prefix << ws.GetMeshLayerPolyDataPath(layer_folder, tp, polyId) << endl;
+        sout << prefix << ws.GetMeshLayerPolyDataPath(layer_folder, tp, polyId) << endl;
         }
 
       else if(arg == "-props-add-mesh-polydata" || arg == "-pamp")
@@ -574,7 +699,7 @@ int main(int argc, char *argv[])
 
         unsigned int newPolyId = ws.AddMeshPolyData(layer_folder, tp, filename);
 
-        cout << "INFO: polydata added to timepoint: " << tp
+        sout << "INFO: polydata added to timepoint: " << tp
              << "; New polydata id: " << newPolyId << std::endl;
         }
 
@@ -584,7 +709,7 @@ int main(int argc, char *argv[])
           throw IRISException("Selected object %s is not a valid layer", layer_folder.c_str());
 
         string key = cl.read_string();
-        cout << prefix << ws.GetRegistry().Folder(layer_folder)[key][""] << endl;
+        sout << prefix << ws.GetRegistry().Folder(layer_folder)[key][""] << endl;
         }
 
       else if(arg == "-props-registry-set" || arg == "-prs")
@@ -595,7 +720,7 @@ int main(int argc, char *argv[])
         string key = cl.read_string();
         string value = cl.read_string();
         ws.GetRegistry().Folder(layer_folder)[key] << value;
-        cout << "INFO: set registry entry '" << key << "' to '" << ws.GetRegistry().Folder(layer_folder)[key][""] << "'" << endl;
+        sout << "INFO: set registry entry '" << key << "' to '" << ws.GetRegistry().Folder(layer_folder)[key][""] << "'" << endl;
         }
 
       else if(arg == "-props-registry-dump" || arg == "-prd")
@@ -670,7 +795,7 @@ int main(int argc, char *argv[])
         // Print the matrix
         for(unsigned int i = 0; i < 4; i++)
           {
-          cout << prefix << Q(i,0) << " " << Q(i,1) << " " << Q(i,2) << " " << Q(i,3) << endl;
+          sout << prefix << Q(i,0) << " " << Q(i,1) << " " << Q(i,2) << " " << Q(i,3) << endl;
           }
         }
 
@@ -713,6 +838,8 @@ int main(int argc, char *argv[])
           mcd.SelectedScalarRep = SCALAR_REP_MAGNITUDE;
         else if(mode == "max")
           mcd.SelectedScalarRep = SCALAR_REP_MAX;
+        else if(mode == "jac")
+          mcd.SelectedScalarRep = SCALAR_REP_JACOBIAN;
         else if(mode == "rgb")
           mcd = MultiChannelDisplayMode::DefaultForRGB();
         else if(mode == "grid")
@@ -741,7 +868,7 @@ int main(int argc, char *argv[])
         while (cit != found.cend())
           oss << "," << *cit++;
 
-        cout << prefix << oss.str() << endl;
+        sout << prefix << oss.str() << endl;
         }
 
       else if(arg == "-timepoints-pick-by-name")
@@ -754,12 +881,12 @@ int main(int argc, char *argv[])
 
         unsigned int tp = found.front();
 
-        cout << prefix << tp << endl;
+        sout << prefix << tp << endl;
         }
 
       else if(arg == "-timepoints-list")
         {
-        ws.PrintTimePointList(cout, prefix);
+        ws.PrintTimePointList(sout, prefix);
         }
 
       else if(arg == "-labels-set")
@@ -798,10 +925,36 @@ int main(int argc, char *argv[])
         }
       else if(arg == "-annot-list")
         {
-        ws.PrintAnnotationList(cout, prefix);
+        ws.PrintAnnotationList(sout, prefix);
+        }
+      else if(arg == "-rf-apply")
+        {
+        string fn_classifier = cl.read_existing_filename();
+        string fn_output = cl.read_output_filename();
+        unsigned int n_tiles = cl.command_arg_count() > 0 ? cl.read_integer() : 16;
+
+        // The classifier expects the layers in the order in which SNAP
+        // iterates over them: the main image, then the overlays
+        string key = ws.FindLayerByRole("MainRole", 0);
+        if(!key.length())
+          throw IRISException("The workspace has no main image");
+
+        std::vector<string> inputs;
+        inputs.push_back(ws.GetLayerActualPath(ws.GetFolder(key)));
+        for(int i = 0; (key = ws.FindLayerByRole("OverlayRole", i)).length(); i++)
+          inputs.push_back(ws.GetLayerActualPath(ws.GetFolder(key)));
+
+        int n_components = 0;
+        SmartPtr<IRISApplication::RFClassifier> rf =
+            IRISApplication::RFEngine::ReadClassifier(fn_classifier.c_str(), n_components);
+        IRISApplication::RFEngine::ApplyClassifierToImages(
+              rf, n_components, inputs, fn_output.c_str(), n_tiles);
         }
       else if(arg == "-dss-auth")
         {
+        if(batch_cache)
+          throw IRISException("Command %s can not be used in batch mode", arg.c_str());
+
         // Read the url of the server
         string url = cl.read_string();
 
@@ -822,7 +975,7 @@ int main(int argc, char *argv[])
         {
         RESTClient rc;
         if(rc.Get("api/services"))
-          print_string_with_prefix(cout, rc.GetFormattedCSVOutput(false), prefix);
+          print_string_with_prefix(sout, rc.GetFormattedCSVOutput(false), prefix);
         else
           throw IRISException("Error listing services: %s", rc.GetResponseText());
         }
@@ -831,7 +984,7 @@ int main(int argc, char *argv[])
         string service_githash = cl.read_string();
         RESTClient rc;
         if(rc.Get("api/services/%s/detail", service_githash.c_str()))
-          print_string_with_prefix(cout, rc.GetOutput(), prefix);
+          print_string_with_prefix(sout, rc.GetOutput(), prefix);
         else
           throw IRISException("Error getting service detail: %s", rc.GetResponseText());
 
@@ -840,13 +993,13 @@ int main(int argc, char *argv[])
         {
         string service_githash = cl.read_string();
         int ticket_id = ws.CreateWorkspaceTicket(service_githash.c_str());
-        cout << prefix << ticket_id << endl;
+        sout << prefix << ticket_id << endl;
         }
       else if(arg == "-dss-tickets-list" || arg == "-dtl")
         {
         RESTClient rc;
         if(rc.Get("api/tickets"))
-          print_string_with_prefix(cout, rc.GetFormattedCSVOutput(false), prefix);
+          print_string_with_prefix(sout, rc.GetFormattedCSVOutput(false), prefix);
         else
           throw IRISException("Error listing tickets: %s", rc.GetResponseText());
         }
@@ -855,7 +1008,7 @@ int main(int argc, char *argv[])
         int ticket_id = cl.read_integer();
         RESTClient rc;
         if(rc.Get("api/tickets/%d/delete", ticket_id))
-          cout << prefix << rc.GetOutput() << endl;
+          sout << prefix << rc.GetOutput() << endl;
         else
           throw IRISException("Error deleting ticket %d: %s", ticket_id, rc.GetResponseText());
 
@@ -863,19 +1016,22 @@ int main(int argc, char *argv[])
       else if(arg == "-dss-tickets-log" || arg == "-dt-log")
         {
         int ticket_id = cl.read_integer();
-        PrintTicketLog(ticket_id);
+        PrintTicketLog(sout, ticket_id);
         }
       else if(arg == "-dss-tickets-progress")
         {
         int ticket_id = cl.read_integer();
         RESTClient rc;
         if(rc.Get("api/tickets/%d/progress", ticket_id))
-          cout << prefix << rc.GetOutput() << endl;
+          sout << prefix << rc.GetOutput() << endl;
         else
           throw IRISException("Error getting progress for ticket %d: %s", ticket_id, rc.GetResponseText());
         }
       else if(arg == "-dss-tickets-wait")
         {
+        if(batch_cache)
+          throw IRISException("Command %s can not be used in batch mode", arg.c_str());
+
         // Takes a ticket ID and timeout in seconds
         int ticket_id = cl.read_integer();
         int timeout = cl.command_arg_count() > 0 ? cl.read_integer() : 10000;
@@ -984,7 +1140,7 @@ int main(int argc, char *argv[])
         {
         RESTClient rc;
         if(rc.Get("api/pro/services"))
-          print_string_with_prefix(cout, rc.GetFormattedCSVOutput(false), prefix);
+          print_string_with_prefix(sout, rc.GetFormattedCSVOutput(false), prefix);
         else
           throw IRISException("Error listing services: %s", rc.GetResponseText());
         }
@@ -1012,13 +1168,13 @@ int main(int argc, char *argv[])
           int ticket_id;
           if(ft.Rows() == 1 && (ticket_id = atoi(ft(0, 0).c_str())) > 0)
             {
-            ft.Print(cout, prefix);
+            ft.Print(sout, prefix);
             context_ticket_id = ticket_id;
             break;
             }
           else if(tnow + twait > timeout)
             {
-            cerr << "Timed out waiting for available tickets" << endl;
+            serr << "Timed out waiting for available tickets" << endl;
             exit(1);
             }
           else
@@ -1033,14 +1189,21 @@ int main(int argc, char *argv[])
         int ticket_id = cl.read_integer();
         string output_path = cl.read_string();
         string file_list = WorkspaceAPI::DownloadTicketFiles(ticket_id, output_path.c_str(), false, "results");
-        print_string_with_prefix(cout, file_list, prefix);
+        print_string_with_prefix(sout, file_list, prefix);
+        }
+      else if(arg == "-dss-tickets-headers")
+        {
+        int ticket_id = cl.read_integer();
+        string output_path = cl.read_string();
+        string file_list = WorkspaceAPI::DownloadTicketFileHeaders(ticket_id, output_path.c_str(), false, "results");
+        print_string_with_prefix(sout, file_list, prefix);
         }
       else if(arg == "-dssp-tickets-download")
         {
         int ticket_id = cl.read_integer();
         string output_path = cl.read_string();
         string file_list = WorkspaceAPI::DownloadTicketFiles(ticket_id, output_path.c_str(), true, "input");
-        print_string_with_prefix(cout, file_list, prefix);
+        print_string_with_prefix(sout, file_list, prefix);
         }
       else if(arg == "-dssp-tickets-fail")
         {
@@ -1054,7 +1217,7 @@ int main(int argc, char *argv[])
         RESTClient rc;
         if (rc.Post("api/pro/tickets/%d/status","status=failed", ticket_id))
           {
-          cout << prefix << rc.GetOutput() << endl;
+          sout << prefix << rc.GetOutput() << endl;
           }
         else
           throw IRISException("Error marking ticket %d as failed: %s", 
@@ -1067,7 +1230,7 @@ int main(int argc, char *argv[])
         RESTClient rc;
         if (rc.Post("api/pro/tickets/%d/status","status=success", ticket_id))
           {
-          cout << prefix << rc.GetOutput() << endl;
+          sout << prefix << rc.GetOutput() << endl;
           }
         else
           throw IRISException("Error marking ticket %d as completed: %s", 
@@ -1080,7 +1243,7 @@ int main(int argc, char *argv[])
         if(!rc.Get("api/pro/tickets/%d/status", ticket_id))
           throw IRISException("Error checking status of ticket %d: %s",
             ticket_id, rc.GetResponseText());
-        cout << prefix << rc.GetOutput() << endl;
+        sout << prefix << rc.GetOutput() << endl;
         }
       else if(arg == "-dssp-tickets-set-progress")
         {
@@ -1091,7 +1254,7 @@ int main(int argc, char *argv[])
         double chunk_prog = cl.read_double();
         if(rc.Post("api/pro/tickets/%d/progress","chunk_start=%f&chunk_end=%f&progress=%f", 
             ticket_id, chunk_start, chunk_end, chunk_prog))
-          cout << rc.GetOutput() << endl;
+          sout << rc.GetOutput() << endl;
         else
           throw IRISException("Error setting progress for ticket %d: %s", 
             ticket_id, rc.GetResponseText());
@@ -1119,55 +1282,55 @@ int main(int argc, char *argv[])
         }
       else if(arg == "-dssa-providers-list")
         {
-        simple_rest_get("api/admin/providers", "Error listing providers", prefix.c_str());
+        simple_rest_get(sout, "api/admin/providers", "Error listing providers", prefix.c_str());
         }
       else if(arg == "-dssa-providers-add")
         {
         std::string pname = cl.read_string();
-        simple_rest_post("api/admin/providers", "name=%s", "Error adding provider", prefix.c_str(), pname.c_str());
+        simple_rest_post(sout, "api/admin/providers", "name=%s", "Error adding provider", prefix.c_str(), pname.c_str());
         }
       else if(arg == "-dssa-providers-delete")
         {
         std::string pname = cl.read_string();
-        simple_rest_post("api/admin/providers/%s/delete", NULL, "Error deleting provider", prefix.c_str(), pname.c_str());
+        simple_rest_post(sout, "api/admin/providers/%s/delete", NULL, "Error deleting provider", prefix.c_str(), pname.c_str());
         }
       else if(arg == "-dssa-providers-users-list")
         {
         std::string pname = cl.read_string();
-        simple_rest_get("api/admin/providers/%s/users", "Error listing provider's users", prefix.c_str(), pname.c_str());
+        simple_rest_get(sout, "api/admin/providers/%s/users", "Error listing provider's users", prefix.c_str(), pname.c_str());
         }
       else if(arg == "-dssa-providers-users-add")
         {
         std::string pname = cl.read_string();
         std::string email = cl.read_string();
-        simple_rest_post("api/admin/providers/%s/users", "email=%s", "Error adding user to provider", prefix.c_str(), 
+        simple_rest_post(sout, "api/admin/providers/%s/users", "email=%s", "Error adding user to provider", prefix.c_str(), 
                          pname.c_str(), email.c_str());
         }
       else if(arg == "-dssa-providers-users-delete")
         {
         std::string pname = cl.read_string();
         int user_id = cl.read_integer();
-        simple_rest_post("api/admin/providers/%s/users/%d/delete", NULL, "Error deleting user from provider", prefix.c_str(), 
+        simple_rest_post(sout, "api/admin/providers/%s/users/%d/delete", NULL, "Error deleting user from provider", prefix.c_str(), 
                          pname.c_str(), user_id);
         }
       else if(arg == "-dssa-providers-services-list")
         {
         std::string pname = cl.read_string();
-        simple_rest_get("api/admin/providers/%s/services", "Error listing provider's services", prefix.c_str(), pname.c_str());
+        simple_rest_get(sout, "api/admin/providers/%s/services", "Error listing provider's services", prefix.c_str(), pname.c_str());
         }
       else if(arg == "-dssa-providers-services-add")
         {
         std::string pname = cl.read_string();
         std::string repo = cl.read_string();
         std::string ref = cl.read_string();
-        simple_rest_post("api/admin/providers/%s/services", "repo=%s&ref=%s", "Error adding service to provider", prefix.c_str(), 
+        simple_rest_post(sout, "api/admin/providers/%s/services", "repo=%s&ref=%s", "Error adding service to provider", prefix.c_str(), 
                          pname.c_str(), repo.c_str(), ref.c_str());
         }
       else if(arg == "-dssa-providers-services-delete")
         {
         std::string pname = cl.read_string();
         std::string githash = cl.read_string();
-        simple_rest_post("api/admin/providers/%s/services/%s/delete", NULL, "Error deleting user from provider", prefix.c_str(), 
+        simple_rest_post(sout, "api/admin/providers/%s/services/%s/delete", NULL, "Error deleting user from provider", prefix.c_str(), 
                          pname.c_str(), githash.c_str());
         }
 
@@ -1176,12 +1339,12 @@ int main(int argc, char *argv[])
       }
     catch(IRISException &exc)
       {
-      cerr << "ITK-SNAP exception for command " << arg << " : " << exc.what() << endl;
+      serr << "ITK-SNAP exception for command " << arg << " : " << exc.what() << endl;
       return -1;
       }
     catch(std::exception &sexc)
       {
-      cerr << "System exception for command " << arg << " : " << sexc.what() << endl;
+      serr << "System exception for command " << arg << " : " << sexc.what() << endl;
       return -1;
       }
 
@@ -1191,3 +1354,233 @@ int main(int argc, char *argv[])
 
   return 0;
 }
+
+/**
+ * Split a line of a batch file into arguments. Arguments are separated by
+ * white space, and may be quoted with single or double quotes.
+ */
+vector<string> SplitBatchLine(const string &line)
+{
+  vector<string> args;
+  string word;
+  bool in_word = false;
+  char quote = 0;
+  for(char c : line)
+    {
+    if(quote)
+      {
+      if(c == quote)
+        quote = 0;
+      else
+        word.push_back(c);
+      }
+    else if(c == '"' || c == '\'')
+      {
+      quote = c;
+      in_word = true;
+      }
+    else if(isspace((unsigned char) c))
+      {
+      if(in_word)
+        args.push_back(word);
+      word.clear();
+      in_word = false;
+      }
+    else
+      {
+      word.push_back(c);
+      in_word = true;
+      }
+    }
+
+  if(quote)
+    throw IRISException("Unterminated quote in batch line: %s", line.c_str());
+  if(in_word)
+    args.push_back(word);
+  return args;
+}
+
+/**
+ * Run the command lines listed in a batch file on a pool of worker threads.
+ * Each line is a separate job with its own workspace and command indices.
+ * The results are written to cout as one JSON object per line, in the order
+ * of the jobs in the file. Returns the number of jobs that failed.
+ */
+int RunBatch(const string &batch_file, unsigned int n_threads)
+{
+  // Read the jobs, skipping blank lines and comments
+  ifstream fin;
+  istream *in = &cin;
+  if(batch_file != "-")
+    {
+    fin.open(batch_file.c_str());
+    if(!fin.good())
+      throw IRISException("Can not open batch file %s", batch_file.c_str());
+    in = &fin;
+    }
+
+  struct BatchJob
+  {
+    int Line;
+    vector<string> Args;
+    int Status;
+    string Output, Error;
+    bool Done;
+  };
+
+  vector<BatchJob> jobs;
+  string line;
+  for(int k = 1; getline(*in, line); k++)
+    {
+    vector<string> args = SplitBatchLine(line);
+    if(args.size() && args[0][0] != '#')
+      jobs.push_back(BatchJob { k, args, 0, string(), string(), false });
+    }
+
+  if(n_threads == 0)
+    n_threads = (std::max)(1u, std::thread::hardware_concurrency());
+  n_threads = (unsigned int) (std::max)((size_t) 1, (std::min)((size_t) n_threads, jobs.size()));
+
+  // Workspaces parsed by any of the jobs
+  WorkspaceCache cache;
+
+  // Jobs are taken from a shared counter. A finished job is printed as soon
+  // as all of the jobs before it have finished.
+  std::atomic<size_t> next_job(0);
+  size_t next_print = 0;
+  int n_failed = 0;
+  std::mutex print_mutex;
+
+  Json::StreamWriterBuilder json_builder;
+  json_builder["indentation"] = "";
+
+  auto worker = [&]()
+  {
+    for(size_t j = next_job++; j < jobs.size(); j = next_job++)
+      {
+      BatchJob &job = jobs[j];
+
+      // The command line helper expects the program name in front
+      vector<char *> job_argv;
+      job_argv.push_back(const_cast<char *>("itksnap-wt"));
+      for(string &arg : job.Args)
+        job_argv.push_back(&arg[0]);
+
+      ostringstream sout, serr;
+      try
+        {
+        CommandLineHelper cl((int) job_argv.size(), job_argv.data());
+        WorkspaceAPI ws;
+        job.Status = RunCommands(cl, ws, sout, serr, &cache);
+        }
+      catch(std::exception &exc)
+        {
+        serr << "System exception: " << exc.what() << endl;
+        job.Status = -1;
+        }
+
+      std::lock_guard<std::mutex> guard(print_mutex);
+      job.Output = sout.str();
+      job.Error = serr.str();
+      job.Done = true;
+      for(; next_print < jobs.size() && jobs[next_print].Done; ++next_print)
+        {
+        const BatchJob &pj = jobs[next_print];
+        Json::Value result;
+        result["job"] = (Json::UInt64) next_print;
+        result["line"] = pj.Line;
+        result["args"] = Json::Value(Json::arrayValue);
+        for(const string &arg : pj.Args)
+          result["args"].append(arg);
+        result["status"] = pj.Status;
+        result["output"] = pj.Output;
+        result["error"] = pj.Error;
+        cout << Json::writeString(json_builder, result) << endl;
+        if(pj.Status != 0)
+          n_failed++;
+        }
+      }
+  };
+
+  vector<std::thread> threads;
+  for(unsigned int t = 0; t < n_threads; t++)
+    threads.push_back(std::thread(worker));
+  for(auto &t : threads)
+    t.join();
+
+  return n_failed;
+}
+
+
+/**
+ * Write the entries added to the image header index. This is done once at
+ * the end, rather than after each command, so that batches of commands on
+ * large cohorts do not rewrite the index over and over
+ */
+static int SaveHeaderIndex(int rc)
+{
+  try
+    {
+    ImageHeaderIndex::GetInstance()->Save();
+    }
+  catch(std::exception &exc)
+    {
+    cerr << "Warning: " << exc.what() << endl;
+    }
+  return rc;
+}
+
+int main(int argc, char *argv[])
+{
+  // The image header index is given before all other commands
+  const char *header_index = getenv("ITKSNAP_WT_HEADER_INDEX");
+  if(argc > 2 && string(argv[1]) == "-header-index")
+    {
+    header_index = argv[2];
+    argv[2] = argv[0];
+    argc -= 2; argv += 2;
+    }
+
+  // There must be some commands!
+  if(argc < 2)
+    return usage(-1);
+
+  if(header_index && strlen(header_index))
+    {
+    try
+      {
+      ImageHeaderIndex::GetInstance()->SetFileName(header_index);
+      }
+    catch(std::exception &exc)
+      {
+      cerr << "Error reading image header index: " << exc.what() << endl;
+      return -1;
+      }
+    }
+
+  // Batch mode reads the command lines from a file
+  if(string(argv[1]) == "-batch")
+    {
+    if(argc < 3 || argc > 4)
+      return usage(-1);
+
+    try
+      {
+      unsigned int n_threads = argc > 3 ? (unsigned int) atoi(argv[3]) : 0;
+      return SaveHeaderIndex(RunBatch(argv[2], n_threads) > 0 ? 1 : 0);
+      }
+    catch(std::exception &exc)
+      {
+      cerr << "Batch mode error: " << exc.what() << endl;
+      return -1;
+      }
+    }
+
+  // Command line parsing helper
+  CommandLineHelper cl(argc, argv);
+
+  // Current workspace object
+  WorkspaceAPI ws;
+
+  return SaveHeaderIndex(RunCommands(cl, ws, cout, cerr));
+}